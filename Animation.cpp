@@ -0,0 +1,266 @@
+//--------------------------------------------------------------------------------------
+// Skeletal animation playback
+//--------------------------------------------------------------------------------------
+// See Animation.h for an overview
+
+#include "Animation.h"
+#include "CookedAssets.h"
+#include "Model.h"
+#include "Mesh.h"
+#include "JobSystem.h"
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+
+
+// Animators in each job of UpdateAnimators
+const size_t ANIMATOR_BATCH_SIZE = 16;
+
+const float SQRT_HALF = 0.70710678f;
+
+
+// Unpack a rotation stored as its smallest three components (see CookedClip) into x, y, z, w
+inline void UnpackRotation(const uint16_t* packed, float rotation[4])
+{
+	int largest = ((packed[0] >> 15) << 1) | (packed[1] >> 15);
+	float smallest[3] = { ((packed[0] & 0x7FFF) * (2.0f / 0x7FFF) - 1) * SQRT_HALF,
+	                      ((packed[1] & 0x7FFF) * (2.0f / 0x7FFF) - 1) * SQRT_HALF,
+	                      ((packed[2] & 0x7FFF) * (2.0f / 0x7FFF) - 1) * SQRT_HALF };
+	float sum = smallest[0] * smallest[0] + smallest[1] * smallest[1] + smallest[2] * smallest[2];
+	for (int i = 0, j = 0; i < 4; ++i)
+	{
+		rotation[i] = (i == largest) ? std::sqrt(std::max(0.0f, 1 - sum)) : smallest[j++];
+	}
+}
+
+// Find the key at or before a frame in a channel's times, stepping forward from the cursor (the key found last time),
+// or from the first key if the frame is before the cursor. t is set to how far the frame is from that key to the next,
+// 0 at the last key
+inline uint32_t FindKey(const uint16_t* times, uint32_t numKeys, float frame, uint32_t& cursor, float& t)
+{
+	uint32_t key = cursor;
+	if (key >= numKeys || frame < times[key])  key = 0;
+	while (key + 1 < numKeys && times[key + 1] <= frame)  ++key;
+	cursor = key;
+
+	t = (key + 1 < numKeys) ? (frame - times[key]) / (times[key + 1] - times[key]) : 0.0f;
+	return key;
+}
+
+// Interpolate a quantised position or scale channel at the key found by FindKey
+inline void SampleVector(const uint16_t* packed, float t, const float min[3], const float extent[3], std::vector<float> result[3],
+                         unsigned int node)
+{
+	const float scale = 1.0f / 65535;
+	for (int c = 0; c < 3; ++c)
+	{
+		float value = packed[c];
+		if (t > 0)  value += (packed[c + 3] - value) * t;
+		result[c][node] = min[c] + extent[c] * value * scale;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Poses
+//--------------------------------------------------------------------------------------
+
+void AnimationPose::SetDefault(Mesh* mesh)
+{
+	numNodes = mesh->NumberNodes();
+	unsigned int paddedNodes = (numNodes + 3) & ~3u;
+	for (auto& component : positions)  component.assign(paddedNodes, 0.0f);
+	for (auto& component : rotations)  component.assign(paddedNodes, 0.0f);
+	for (auto& component : scales)     component.assign(paddedNodes, 1.0f);
+	rotations[3].assign(paddedNodes, 1.0f); // Identity rotations in the padding
+
+	for (unsigned int node = 0; node < numNodes; ++node)
+	{
+		CVector3 position, scale;
+		CQuaternion rotation;
+		DecomposeMatrix(mesh->GetNodeDefaultMatrix(node), position, rotation, scale);
+		positions[0][node] = position.x;  positions[1][node] = position.y;  positions[2][node] = position.z;
+		rotations[0][node] = rotation.x;  rotations[1][node] = rotation.y;  rotations[2][node] = rotation.z;  rotations[3][node] = rotation.w;
+		scales[0][node]    = scale.x;     scales[1][node]    = scale.y;     scales[2][node]    = scale.z;
+	}
+}
+
+
+// Four nodes at a time, one component of each in each register
+void BlendPoses(const AnimationPose* const poses[], const float weights[], unsigned int numPoses, AnimationPose& result)
+{
+	float totalWeight = 0;
+	for (unsigned int p = 0; p < numPoses; ++p)  totalWeight += weights[p];
+	const __m128 normalise = _mm_set1_ps(1 / totalWeight);
+	const __m128 zero      = _mm_setzero_ps();
+	const __m128 signBit   = _mm_set1_ps(-0.0f);
+	const __m128 tiny      = _mm_set1_ps(1e-12f);
+
+	const unsigned int paddedNodes = static_cast<unsigned int>(result.positions[0].size());
+	for (unsigned int node = 0; node < paddedNodes; node += 4)
+	{
+		__m128 position[3] = { zero, zero, zero };
+		__m128 rotation[4] = { zero, zero, zero, zero };
+		__m128 scale[3]    = { zero, zero, zero };
+		__m128 first[4];
+		for (int c = 0; c < 4; ++c)  first[c] = _mm_loadu_ps(&poses[0]->rotations[c][node]);
+
+		for (unsigned int p = 0; p < numPoses; ++p)
+		{
+			const AnimationPose& pose = *poses[p];
+			__m128 weight = _mm_set1_ps(weights[p]);
+			for (int c = 0; c < 3; ++c)
+			{
+				position[c] = _mm_add_ps(position[c], _mm_mul_ps(_mm_loadu_ps(&pose.positions[c][node]), weight));
+				scale[c]    = _mm_add_ps(scale[c],    _mm_mul_ps(_mm_loadu_ps(&pose.scales[c][node]), weight));
+			}
+
+			// Negate the weight of rotations on the other side from the first pose's (q and -q are the same rotation)
+			__m128 q[4], dot = zero;
+			for (int c = 0; c < 4; ++c)
+			{
+				q[c] = _mm_loadu_ps(&pose.rotations[c][node]);
+				dot = _mm_add_ps(dot, _mm_mul_ps(q[c], first[c]));
+			}
+			__m128 rotationWeight = _mm_xor_ps(weight, _mm_and_ps(_mm_cmplt_ps(dot, zero), signBit));
+			for (int c = 0; c < 4; ++c)  rotation[c] = _mm_add_ps(rotation[c], _mm_mul_ps(q[c], rotationWeight));
+		}
+
+		__m128 lengthSquared = tiny;
+		for (int c = 0; c < 4; ++c)  lengthSquared = _mm_add_ps(lengthSquared, _mm_mul_ps(rotation[c], rotation[c]));
+		__m128 inverseLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared));
+		for (int c = 0; c < 4; ++c)  _mm_storeu_ps(&result.rotations[c][node], _mm_mul_ps(rotation[c], inverseLength));
+		for (int c = 0; c < 3; ++c)
+		{
+			_mm_storeu_ps(&result.positions[c][node], _mm_mul_ps(position[c], normalise));
+			_mm_storeu_ps(&result.scales[c][node],    _mm_mul_ps(scale[c], normalise));
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Animator - Construction / Usage
+//--------------------------------------------------------------------------------------
+
+Animator::Animator(Model* model) : mModel(model), mMesh(model->GetMesh())
+{
+	mPose.SetDefault(mMesh);
+}
+
+
+void Animator::Play(unsigned int layer, unsigned int clip, float time /*= 0*/, float speed /*= 1*/, float weight /*= 1*/)
+{
+	Layer& playing = mLayers[layer];
+	playing.clip   = &mMesh->GetClip(clip);
+	playing.time   = time;
+	playing.speed  = speed;
+	playing.weight = weight;
+	playing.cursors.assign(playing.clip->tracks.size() * 3, 0);
+	playing.pose.SetDefault(mMesh);
+}
+
+
+void Animator::Advance(float frameTime)
+{
+	const AnimationPose* poses[MAX_LAYERS];
+	float weights[MAX_LAYERS];
+	unsigned int numPoses = 0;
+	for (auto& layer : mLayers)
+	{
+		if (layer.clip == nullptr)  continue;
+		layer.time += frameTime * layer.speed;
+		if (layer.clip->duration > 0)
+		{
+			layer.time = std::fmod(layer.time, layer.clip->duration);
+			if (layer.time < 0)  layer.time += layer.clip->duration;
+		}
+		if (layer.weight <= 0)  continue;
+
+		Sample(layer);
+		poses[numPoses] = &layer.pose;
+		weights[numPoses] = layer.weight;
+		++numPoses;
+	}
+	if (numPoses > 0)  BlendPoses(poses, weights, numPoses, mPose);
+}
+
+
+void Animator::Apply()
+{
+	if (mPose.numNodes <= 1)  return;
+	const float* positions[3] = { &mPose.positions[0][1], &mPose.positions[1][1], &mPose.positions[2][1] };
+	const float* rotations[4] = { &mPose.rotations[0][1], &mPose.rotations[1][1], &mPose.rotations[2][1], &mPose.rotations[3][1] };
+	const float* scales[3]    = { &mPose.scales[0][1],    &mPose.scales[1][1],    &mPose.scales[2][1] };
+	mModel->SetNodeTransforms(1, mPose.numNodes - 1, positions, rotations, scales);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Animator - Private helpers
+//--------------------------------------------------------------------------------------
+
+void Animator::Sample(Layer& layer)
+{
+	const CookedClip& clip = *layer.clip;
+	AnimationPose& pose = layer.pose;
+	const float frame = layer.time * clip.sampleRate;
+
+	for (size_t t = 0; t < clip.tracks.size(); ++t)
+	{
+		const CookedClip::Track& track = clip.tracks[t];
+		uint32_t* cursors = &layer.cursors[t * 3];
+		const unsigned int node = track.node;
+		float between;
+
+		// Rotation - normalised linear interpolation, as the keys were reduced with
+		uint32_t key = FindKey(&clip.rotationTimes[track.firstRotation], track.numRotations, frame, cursors[0], between);
+		const uint16_t* packed = &clip.rotations[(track.firstRotation + key) * 3];
+		float rotation[4];
+		UnpackRotation(packed, rotation);
+		if (between > 0)
+		{
+			float next[4];
+			UnpackRotation(packed + 3, next);
+			float dot = rotation[0] * next[0] + rotation[1] * next[1] + rotation[2] * next[2] + rotation[3] * next[3];
+			float sign = dot < 0 ? -1.0f : 1.0f; // Take the short way round
+			float lengthSquared = 0;
+			for (int c = 0; c < 4; ++c)
+			{
+				rotation[c] += (next[c] * sign - rotation[c]) * between;
+				lengthSquared += rotation[c] * rotation[c];
+			}
+			float inverseLength = 1 / std::sqrt(lengthSquared);
+			for (int c = 0; c < 4; ++c)  rotation[c] *= inverseLength;
+		}
+		for (int c = 0; c < 4; ++c)  pose.rotations[c][node] = rotation[c];
+
+		key = FindKey(&clip.positionTimes[track.firstPosition], track.numPositions, frame, cursors[1], between);
+		SampleVector(&clip.positions[(track.firstPosition + key) * 3], between, track.positionMin, track.positionExtent,
+		             pose.positions, node);
+
+		key = FindKey(&clip.scaleTimes[track.firstScale], track.numScales, frame, cursors[2], between);
+		SampleVector(&clip.scales[(track.firstScale + key) * 3], between, track.scaleMin, track.scaleExtent, pose.scales, node);
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Updating all animators
+//--------------------------------------------------------------------------------------
+
+void UpdateAnimators(Animator* animators, size_t numAnimators, float frameTime)
+{
+	if (numAnimators == 0)  return;
+	CPU_PROFILE_SCOPE("UpdateAnimators");
+
+	gJobSystem.ParallelFor(numAnimators, ANIMATOR_BATCH_SIZE, [animators, frameTime](size_t first, size_t end)
+	{
+		for (size_t i = first; i < end; ++i)  animators[i].Advance(frameTime);
+	});
+
+	// The transform system is main thread only
+	for (size_t i = 0; i < numAnimators; ++i)  animators[i].Apply();
+}
@@ -0,0 +1,113 @@
+//--------------------------------------------------------------------------------------
+// Skeletal animation playback
+//--------------------------------------------------------------------------------------
+// Plays the animation clips imported with a mesh (see CookedClip) on its models. Each animated model has an Animator
+// with up to MAX_LAYERS layers, each playing one clip at its own time, speed and blend weight.
+//
+// Sampling decodes the keys straight from the clip's compressed arrays. Each layer keeps a cursor for each channel of
+// each track (the key found last time), so playing forward only steps over the keys passed since the last frame rather
+// than searching the times again - a clip that loops back starts from its first key. Each layer samples into its own
+// pose, held as a separate array for each component (structure of arrays), so the layers are blended four nodes at a
+// time with SSE: rotations are summed by weight, each turned to the same side as the first layer's so the blend takes
+// the short way round, then normalised; positions and scales are averaged by weight.
+//
+// UpdateAnimators samples and blends all the animators in parallel jobs (see JobSystem.h), each touching only its own
+// data, then writes the poses to the models' nodes. The root node of each model is left alone, so the model can still be
+// placed with its own setters
+
+#ifndef _ANIMATION_H_INCLUDED_
+#define _ANIMATION_H_INCLUDED_
+
+#include <vector>
+#include <stdint.h>
+
+struct CookedClip; // See CookedAssets.h
+class  Model;
+class  Mesh;
+
+
+// The transform of every node of a mesh relative to its parent, each component in its own array (x, y, z then w). The
+// arrays are padded to a multiple of four nodes for BlendPoses
+struct AnimationPose
+{
+	// Size the arrays for the mesh and set every node to its default matrix
+	void SetDefault(Mesh* mesh);
+
+	unsigned int       numNodes = 0;
+	std::vector<float> positions[3];
+	std::vector<float> rotations[4];
+	std::vector<float> scales[3];
+};
+
+// Blend poses of the same mesh by weight into result, which must be the same size. Weights needn't add up to one, but
+// their total must be more than zero
+void BlendPoses(const AnimationPose* const poses[], const float weights[], unsigned int numPoses, AnimationPose& result);
+
+
+class Animator
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Animate a model with the clips of its mesh. No layers are playing to start with, so the model keeps its default pose
+	Animator(Model* model);
+
+	// Play a clip of the model's mesh on a layer from the given time in seconds, at the given speed (1 as imported) and
+	// blend weight. Clips loop
+	void Play(unsigned int layer, unsigned int clip, float time = 0, float speed = 1, float weight = 1);
+
+	void SetWeight(unsigned int layer, float weight)  { mLayers[layer].weight = weight; }
+	void Stop(unsigned int layer)                     { mLayers[layer].clip = nullptr; }
+
+	// Move the layers on by the frame time, then sample them and blend them into the pose. Only touches this animator,
+	// so different animators can be advanced on different threads at once
+	void Advance(float frameTime);
+
+	// Write the pose to the model's nodes (all but the root). Call on the main thread
+	void Apply();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	Model* GetModel()  { return mModel; }
+
+	// Time in seconds into the clip playing on a layer
+	float Time(unsigned int layer)  { return mLayers[layer].time; }
+
+	static const unsigned int MAX_LAYERS = 4;
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	struct Layer
+	{
+		const CookedClip*     clip = nullptr; // Not playing if null
+		float                 time   = 0;
+		float                 speed  = 1;
+		float                 weight = 0;
+		std::vector<uint32_t> cursors; // Key last found in each channel, three for each track (rotation, position, scale)
+		AnimationPose         pose;    // Nodes the clip doesn't animate keep their default transforms
+	};
+
+	// Sample a layer's clip at its time into its pose
+	void Sample(Layer& layer);
+
+	Model*        mModel;
+	Mesh*         mMesh;
+	Layer         mLayers[MAX_LAYERS];
+	AnimationPose mPose; // The blend of the layers
+};
+
+
+// Advance all the given animators by the frame time in parallel jobs, then apply their poses to their models. Call on
+// the main thread before gTransformSystem.Update
+void UpdateAnimators(Animator* animators, size_t numAnimators, float frameTime);
+
+
+#endif //_ANIMATION_H_INCLUDED_
@@ -0,0 +1,20 @@
+//--------------------------------------------------------------------------------------
+// Include file for the post-process anti-aliasing
+//--------------------------------------------------------------------------------------
+// Used by Fxaa_pp and the three SMAA passes (SmaaEdges_pp, SmaaWeights_pp and SmaaBlend_pp), see EffectChain.h
+
+#include "Common.hlsli"
+
+
+// Brightness the edges are found from. HDR colours are tonemapped first, so a highlight doesn't hide the edges around it
+float Luma(float3 colour)
+{
+    colour /= 1 + max(colour.r, max(colour.g, colour.b));
+    return dot(colour, float3(0.299f, 0.587f, 0.114f));
+}
+
+// Read a pixel of a texture the size of gInputSize, clamped to the edges so the border isn't seen as an edge
+float4 LoadClamped(Texture2D source, int2 pixel)
+{
+    return source.Load(int3(clamp(pixel, 0, (int2)gInputSize - 1), 0));
+}
@@ -0,0 +1,323 @@
+//--------------------------------------------------------------------------------------
+// AssetCooker - offline cooking of the app's meshes and textures
+//--------------------------------------------------------------------------------------
+// Usage: AssetCooker [directory] [-tangents] [-nocompress] [-force] [-threads N] [-cubemap image]... [-pack file [-order file]]
+//
+// Walks the directory (default: current directory) and its sub-directories and cooks every mesh and texture found, so
+// the app can load them without importing / decoding at start up. Meshes are imported with exactly the settings the
+// Mesh class uses and written to the same cooked file (see CookedAssets.h), -tangents also cooks the tangent version of
+// each mesh. Textures are written as DDS files with mip-maps alongside the originals, block compressed to BC1 (or BC3 for
+// images with alpha) unless -nocompress is given. Each image named by -cubemap (e.g. Stars.jpg) is also cooked to a
+// cubemap, <image>.cube.dds, for the sky pass (see Sky.h).
+//
+// Cooking is incremental: an asset is skipped if its cooked file is up to date with the source (the same check the app
+// makes), unless -force is given. Assets are cooked in parallel on all cores, or on the number of threads given.
+//
+// -pack then writes the cooked meshes and textures, the other DDS files and the compiled shaders (.cso) into a single
+// asset pack (see AssetPack.h), named by their paths relative to the directory. The files are stored in the order listed
+// in the -order file (the app writes the order it loads them in to Assets.pack.order), then the rest.
+
+#include "../CookedAssets.h"
+#include "../AssetPack.h"
+
+#define NOMINMAX
+#include <windows.h>
+#include <objbase.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+	// A single asset to cook
+	struct Job
+	{
+		enum class Type { Mesh, TangentMesh, Texture, Cubemap };
+
+		Type        type;
+		std::string sourceFileName;
+		std::string cookedFileName;
+	};
+
+	const char* const MESH_EXTENSIONS[]    = { ".x", ".fbx", ".obj", ".3ds" };
+	const char* const TEXTURE_EXTENSIONS[] = { ".jpg", ".jpeg", ".png", ".bmp", ".tif", ".tiff" };
+
+
+	// Case insensitive check of a file name extension
+	bool HasExtension(const std::string& fileName, const char* extension)
+	{
+		size_t length = std::strlen(extension);
+		return fileName.size() > length && _stricmp(fileName.c_str() + fileName.size() - length, extension) == 0;
+	}
+
+	template <size_t N> bool HasAnyExtension(const std::string& fileName, const char* const (&extensions)[N])
+	{
+		for (auto extension : extensions)  if (HasExtension(fileName, extension))  return true;
+		return false;
+	}
+
+
+	// Add jobs for all the assets in a directory and its sub-directories. Images with a file name in cubemaps are also
+	// cooked to cubemaps
+	void FindAssets(const std::string& directory, bool tangents, const std::vector<std::string>& cubemaps, std::vector<Job>& jobs)
+	{
+		WIN32_FIND_DATAA findData;
+		HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &findData);
+		if (find == INVALID_HANDLE_VALUE)  return;
+		do
+		{
+			std::string name = findData.cFileName;
+			if (name[0] == '.')  continue; // Skip ".", ".." and hidden directories such as .git
+
+			std::string path = directory + "\\" + name;
+			if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			{
+				FindAssets(path, tangents, cubemaps, jobs);
+			}
+			else if (HasAnyExtension(name, MESH_EXTENSIONS))
+			{
+				jobs.push_back({ Job::Type::Mesh, path, CookedMeshFileName(path, false) });
+				if (tangents)  jobs.push_back({ Job::Type::TangentMesh, path, CookedMeshFileName(path, true) });
+			}
+			else if (HasAnyExtension(name, TEXTURE_EXTENSIONS))
+			{
+				jobs.push_back({ Job::Type::Texture, path, CookedTextureFileName(path) });
+				for (auto& cubemap : cubemaps)
+				{
+					if (_stricmp(name.c_str(), cubemap.c_str()) == 0)  jobs.push_back({ Job::Type::Cubemap, path, CookedCubemapFileName(path) });
+				}
+			}
+		} while (FindNextFileA(find, &findData));
+		FindClose(find);
+	}
+
+
+	// Check if a job's cooked file is already up to date
+	bool IsCurrent(const Job& job)
+	{
+		switch (job.type)
+		{
+			case Job::Type::Mesh:        return IsCookedMeshCurrent(job.cookedFileName, job.sourceFileName, false);
+			case Job::Type::TangentMesh: return IsCookedMeshCurrent(job.cookedFileName, job.sourceFileName, true);
+			default:                     return IsCookedFileNewer(job.cookedFileName, job.sourceFileName);
+		}
+	}
+
+
+	// Add the DDS files that weren't cooked from another image, and the compiled shaders, in a directory and its
+	// sub-directories for the asset pack. Names are relative to the top directory, given by prefix
+	void FindPackFiles(const std::string& directory, const std::string& prefix, std::vector<AssetPack::File>& files)
+	{
+		WIN32_FIND_DATAA findData;
+		HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &findData);
+		if (find == INVALID_HANDLE_VALUE)  return;
+		do
+		{
+			std::string name = findData.cFileName;
+			if (name[0] == '.')  continue;
+
+			std::string path = directory + "\\" + name;
+			if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			{
+				FindPackFiles(path, prefix + name + "\\", files);
+			}
+			else if (HasExtension(name, ".cso") ||
+			         (HasExtension(name, ".dds") && !HasAnyExtension(name.substr(0, name.size() - 4), TEXTURE_EXTENSIONS) &&
+			          !(HasExtension(name, ".cube.dds") && HasAnyExtension(name.substr(0, name.size() - 9), TEXTURE_EXTENSIONS))))
+			{
+				// The file is its own source, so the pack copy is ignored once the file is changed
+				files.push_back({ prefix + name, path, prefix + name, path });
+			}
+		} while (FindNextFileA(find, &findData));
+		FindClose(find);
+	}
+
+
+	// Write the asset pack from the cooked files that are up to date and the files found by FindPackFiles, in the order
+	// given by the order file (if any) then the rest. Returns false on failure with the reason in error
+	bool WritePack(const std::string& packFileName, const std::string& orderFileName, const std::string& directory,
+	               const std::vector<Job>& found, std::string& error, int& numPacked)
+	{
+		std::vector<AssetPack::File> files;
+		auto relative = [&directory](const std::string& path) { return path.substr(directory.size() + 1); };
+		for (auto& job : found)
+		{
+			if (IsCurrent(job))  files.push_back({ relative(job.cookedFileName), job.cookedFileName, relative(job.sourceFileName), job.sourceFileName });
+		}
+		FindPackFiles(directory, "", files);
+
+		// Rank of each name in the order file, case insensitive like the pack. A stable sort keeps the rest as found
+		std::map<std::string, size_t> rank;
+		if (!orderFileName.empty())
+		{
+			std::ifstream orderFile(orderFileName);
+			if (!orderFile.is_open())
+			{
+				error = "Cannot read " + orderFileName;
+				return false;
+			}
+			std::string line;
+			while (std::getline(orderFile, line))
+			{
+				for (auto& c : line)  c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+				rank.insert({ line, rank.size() });
+			}
+		}
+		auto rankOf = [&rank](const AssetPack::File& file)
+		{
+			std::string name = file.name;
+			for (auto& c : name)  c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+			auto found = rank.find(name);
+			return (found != rank.end()) ? found->second : rank.size();
+		};
+		std::stable_sort(files.begin(), files.end(), [&rankOf](const AssetPack::File& a, const AssetPack::File& b) { return rankOf(a) < rankOf(b); });
+
+		numPacked = static_cast<int>(files.size());
+		return AssetPack::Write(packFileName, files, error);
+	}
+
+
+	// Cook a single asset. Returns false on failure with the reason in error. For meshes, details gets the vertex cache
+	// statistics before and after optimisation and the time taken by each stage of the import
+	bool Cook(const Job& job, bool compress, std::string& error, std::string& details)
+	{
+		if (job.type == Job::Type::Texture)
+		{
+			CookedTexture texture;
+			return DecodeTexture(job.sourceFileName, texture, error) && WriteCookedTexture(job.cookedFileName, texture, error, compress);
+		}
+		if (job.type == Job::Type::Cubemap)
+		{
+			CookedTexture panorama, faces[NUM_CUBE_FACES];
+			if (!DecodeTexture(job.sourceFileName, panorama, error))  return false;
+			PanoramaToCubemap(panorama, std::max(panorama.mips[0].width / 4, 1u), faces);
+			return WriteCookedCubemap(job.cookedFileName, faces, error, compress);
+		}
+
+		bool tangents = (job.type == Job::Type::TangentMesh);
+		try
+		{
+			CookedMesh mesh;
+			MeshCacheStats before, after;
+			MeshImportTimes times;
+			ImportMesh(job.sourceFileName, tangents, mesh, &before, &after, &times);
+			if (!WriteCookedMesh(job.cookedFileName, job.sourceFileName, tangents, mesh))
+			{
+				error = "Cannot write " + job.cookedFileName;
+				return false;
+			}
+
+			char stats[256];
+			std::snprintf(stats, sizeof(stats), " (ACMR %.3f -> %.3f, ATVR %.3f -> %.3f; ms: assimp %.1f, nodes %.1f, "
+			              "vertices %.1f, bones %.1f, indices %.1f, optimise %.1f, clips %.1f)", before.acmr, after.acmr, before.atvr,
+			              after.atvr, times.assimp, times.nodes, times.vertices, times.bones, times.indices, times.optimise, times.clips);
+			details = stats;
+		}
+		catch (std::runtime_error& e)
+		{
+			error = e.what();
+			return false;
+		}
+		return true;
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	std::string directory = ".";
+	bool tangents = false;
+	bool force = false;
+	bool compress = true;
+	std::string packFileName, orderFileName;
+	std::vector<std::string> cubemaps;
+	int numThreads = static_cast<int>(std::thread::hardware_concurrency());
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if      (arg == "-tangents")                   tangents = true;
+		else if (arg == "-force")                      force = true;
+		else if (arg == "-nocompress")                 compress = false;
+		else if (arg == "-threads" && i + 1 < argc)    numThreads = std::atoi(argv[++i]);
+		else if (arg == "-cubemap" && i + 1 < argc)    cubemaps.push_back(argv[++i]);
+		else if (arg == "-pack" && i + 1 < argc)       packFileName = argv[++i];
+		else if (arg == "-order" && i + 1 < argc)      orderFileName = argv[++i];
+		else if (!arg.empty() && arg[0] != '-')        directory = arg;
+		else
+		{
+			std::printf("Usage: AssetCooker [directory] [-tangents] [-nocompress] [-force] [-threads N] [-cubemap image]... [-pack file [-order file]]\n");
+			return 1;
+		}
+	}
+	numThreads = std::max(numThreads, 1);
+
+	auto startTime = std::chrono::steady_clock::now();
+
+	// Find all the assets, then drop those already cooked
+	std::vector<Job> found, jobs;
+	FindAssets(directory, tangents, cubemaps, found);
+	for (auto& job : found)
+	{
+		if (force || !IsCurrent(job))  jobs.push_back(job);
+	}
+	std::printf("Found %d assets in %s, %d to cook on %d threads\n", static_cast<int>(found.size()), directory.c_str(),
+	            static_cast<int>(jobs.size()), std::min(numThreads, std::max(static_cast<int>(jobs.size()), 1)));
+
+	// Each worker takes the next job until there are none left
+	std::atomic<size_t> nextJob(0);
+	std::atomic<int>    numFailed(0);
+	std::mutex          outputMutex;
+	auto worker = [&]()
+	{
+		CoInitializeEx(nullptr, COINIT_MULTITHREADED); // WIC needs COM on each thread that uses it
+		for (size_t j = nextJob++; j < jobs.size(); j = nextJob++)
+		{
+			std::string error, details;
+			bool ok = Cook(jobs[j], compress, error, details);
+			if (!ok)  ++numFailed;
+
+			std::lock_guard<std::mutex> lock(outputMutex);
+			if (ok)  std::printf("  %s%s\n", jobs[j].cookedFileName.c_str(), details.c_str());
+			else     std::printf("  FAILED %s: %s\n", jobs[j].sourceFileName.c_str(), error.c_str());
+		}
+		CoUninitialize();
+	};
+
+	std::vector<std::thread> threads;
+	for (int t = 1; t < std::min(numThreads, static_cast<int>(jobs.size())); ++t)
+	{
+		threads.emplace_back(worker);
+	}
+	worker(); // Main thread works too
+	for (auto& thread : threads)  thread.join();
+
+	float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+	std::printf("Cooked %d, failed %d, up to date %d (%.2fs)\n", static_cast<int>(jobs.size()) - numFailed.load(), numFailed.load(),
+	            static_cast<int>(found.size() - jobs.size()), seconds);
+
+	if (!packFileName.empty())
+	{
+		std::string error;
+		int numPacked = 0;
+		if (!WritePack(packFileName, orderFileName, directory, found, error, numPacked))
+		{
+			std::printf("FAILED writing %s: %s\n", packFileName.c_str(), error.c_str());
+			return 1;
+		}
+		std::printf("Packed %d files into %s\n", numPacked, packFileName.c_str());
+	}
+	return (numFailed > 0) ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+//--------------------------------------------------------------------------------------
+// Parallel asset loading
+//--------------------------------------------------------------------------------------
+
+#include "AssetLoader.h"
+#include "Mesh.h"
+#include "CookedAssets.h"
+#include "GraphicsHelpers.h"
+#include "JobSystem.h"
+#include "CpuProfiler.h"
+#include "StartupProfiler.h"
+#include "PerfMetrics.h"
+#include "Common.h"
+
+#include <stdexcept>
+
+
+// Add a mesh to be loaded, the new mesh is stored in *mesh by Load
+void AssetLoader::AddMesh(const std::string& fileName, Mesh** mesh, bool requireTangents /*= false*/,
+                          bool compactVertices /*= false*/, int numLods /*= 0*/)
+{
+	mJobs.push_back({ fileName, mesh, requireTangents, compactVertices, numLods, nullptr, nullptr, "" });
+}
+
+
+// Add a texture to be loaded, the texture and its shader resource view are stored by Load
+void AssetLoader::AddTexture(const std::string& fileName, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV)
+{
+	mJobs.push_back({ fileName, nullptr, false, false, 0, texture, textureSRV, "" });
+}
+
+
+// Load everything added so far, one job for each asset. Returns false if anything failed to load, with the reason for
+// the first failure in gLastError
+bool AssetLoader::Load()
+{
+	CPU_PROFILE_SCOPE("AssetLoader::Load");
+
+	// Idle threads steal the oldest jobs first, so add the slowest assets first to keep all the threads busy until the end
+	gJobSystem.ParallelFor(mJobs.size(), 1, [this](size_t first, size_t end)
+	{
+		for (size_t j = first; j < end; ++j)  Run(mJobs[j]);
+	});
+
+	bool ok = true;
+	for (auto& job : mJobs)
+	{
+		if (!job.error.empty())
+		{
+			gLastError = job.error;
+			ok = false;
+			break;
+		}
+	}
+	mJobs.clear();
+	return ok;
+}
+
+
+// Load a single asset, storing any error in the job
+void AssetLoader::Run(Job& job)
+{
+	int64_t start = CpuProfiler::Now();
+	STARTUP_SCOPE(StartupStage::Asset, job.fileName);
+	if (job.mesh != nullptr)
+	{
+		CPU_PROFILE_SCOPE("Load mesh");
+		try
+		{
+			// Reading the cooked file is tried first on its own to time it apart from importing. When it fails LoadMeshData
+			// tries it again, which only costs much if the cooked file is there but out of date
+			CookedMesh meshData;
+			bool cooked;
+			{
+				STARTUP_SCOPE(StartupStage::Read, job.fileName);
+				cooked = ReadCookedMesh(CookedMeshFileName(job.fileName, job.requireTangents), job.fileName, job.requireTangents, meshData);
+			}
+			if (!cooked)
+			{
+				STARTUP_SCOPE(StartupStage::Import, job.fileName);
+				LoadMeshData(job.fileName, job.requireTangents, meshData);
+			}
+			{
+				STARTUP_SCOPE(StartupStage::Process, job.fileName);
+				if (job.numLods > 0)      GenerateLods(meshData, job.numLods);
+				if (job.compactVertices)  CompactMesh(meshData);
+			}
+			STARTUP_SCOPE(StartupStage::Upload, job.fileName);
+			*job.mesh = gMeshPool.Create(meshData, job.fileName);
+		}
+		catch (std::runtime_error& e) // Mesh errors are reported with exceptions (see Mesh.cpp)
+		{
+			job.error = e.what();
+		}
+	}
+	else
+	{
+		CPU_PROFILE_SCOPE("Load texture");
+		if (!LoadTexture(job.fileName, job.texture, job.textureSRV))  job.error = "Error loading texture " + job.fileName;
+	}
+	float milliseconds = static_cast<float>(CpuProfiler::Now() - start) * 1000 / CpuProfiler::Frequency();
+	gPerfMetrics.AddSample("load_ms/" + job.fileName, "ms", milliseconds);
+}
@@ -0,0 +1,65 @@
+//--------------------------------------------------------------------------------------
+// Parallel asset loading
+//--------------------------------------------------------------------------------------
+// Meshes and textures to load are added to the loader, then all loaded together as jobs spread over the job system's
+// threads (see JobSystem.h). Each job does the CPU side work (reading cooked files, assimp import, image decoding) and
+// creates the GPU resources with the device, which is free-threaded. Nothing uses the immediate context so the main
+// thread can take part too
+
+#ifndef _ASSET_LOADER_H_INCLUDED_
+#define _ASSET_LOADER_H_INCLUDED_
+
+#include <d3d11.h>
+#include <string>
+#include <vector>
+
+class Mesh;
+
+
+class AssetLoader
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Add a mesh to be loaded, the new mesh (in gMeshPool) is stored in *mesh by Load. Assimp logging is not used for these meshes as
+	// the assimp logger is not thread-safe. Optionally convert the mesh to compact vertex formats (see CompactMesh) and
+	// generate up to numLods levels of detail (see GenerateLods)
+	void AddMesh(const std::string& fileName, Mesh** mesh, bool requireTangents = false, bool compactVertices = false, int numLods = 0);
+
+	// Add a texture to be loaded, the texture and its shader resource view are stored by Load (see LoadTexture)
+	void AddTexture(const std::string& fileName, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV);
+
+
+	// Load everything added so far, one job for each asset. Returns false if anything failed to load, with the reason for
+	// the first failure (in the order added) in gLastError. Assets that did load are still stored and must be released as
+	// usual. The list is cleared ready for the next set of assets
+	bool Load();
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	struct Job
+	{
+		std::string                fileName;
+		Mesh**                     mesh;            // Null for a texture job
+		bool                       requireTangents;
+		bool                       compactVertices;
+		int                        numLods;
+		ID3D11Resource**           texture;
+		ID3D11ShaderResourceView** textureSRV;
+		std::string                error;           // Empty if the job succeeded
+	};
+
+	// Load a single asset, storing any error in the job and its load time in gPerfMetrics
+	void Run(Job& job);
+
+
+	std::vector<Job> mJobs;
+};
+
+
+#endif //_ASSET_LOADER_H_INCLUDED_
@@ -0,0 +1,245 @@
+//--------------------------------------------------------------------------------------
+// Asset pack
+//--------------------------------------------------------------------------------------
+// See AssetPack.h for an overview and the file layout
+
+#include "AssetPack.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+
+AssetPack gAssetPack;
+
+
+AssetPack::~AssetPack()
+{
+	Close();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reading
+//--------------------------------------------------------------------------------------
+
+bool AssetPack::Open(const std::string& fileName)
+{
+	Close();
+
+	// The file is read front to back, which the sequential scan hint lets the OS read ahead for
+	mFile = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (mFile == INVALID_HANDLE_VALUE)  return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(Header)))
+	{
+		Close();
+		return false;
+	}
+	mSize = static_cast<size_t>(fileSize.QuadPart);
+
+	mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+	mData = static_cast<const char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	if (mData == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	// Check the header and that the index and all the files lie inside the pack
+	const Header* header = reinterpret_cast<const Header*>(mData);
+	if (header->magic != MAGIC || header->version != VERSION ||
+	    sizeof(Header) + static_cast<size_t>(header->count) * sizeof(Entry) > mSize)
+	{
+		Close();
+		return false;
+	}
+	mIndex = reinterpret_cast<const Entry*>(mData + sizeof(Header));
+	mCount = header->count;
+	for (uint32_t i = 0; i < mCount; ++i)
+	{
+		if (mIndex[i].offset > mSize || mIndex[i].size > mSize - mIndex[i].offset ||
+		    mIndex[i].name[MAX_NAME_LENGTH - 1] != '\0' || mIndex[i].source[MAX_NAME_LENGTH - 1] != '\0')
+		{
+			Close();
+			return false;
+		}
+	}
+
+	// Ask for the whole pack to be read in now with large sequential reads, rather than a page at a time as each file is
+	// first touched. Only a hint, loading works the same if it fails
+	WIN32_MEMORY_RANGE_ENTRY range = { const_cast<char*>(mData), mSize };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	return true;
+}
+
+
+void AssetPack::Close()
+{
+	if (mData)                          UnmapViewOfFile(mData);
+	if (mMapping)                       CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE)  CloseHandle(mFile);
+	mData    = nullptr;
+	mMapping = nullptr;
+	mFile    = INVALID_HANDLE_VALUE;
+	mSize    = 0;
+	mIndex   = nullptr;
+	mCount   = 0;
+}
+
+
+// Binary search of the sorted index
+bool AssetPack::Find(const std::string& name, const void*& data, size_t& size)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mAskedFor.insert(name).second)  mLoadOrder.push_back(name);
+	}
+	if (mData == nullptr)  return false;
+
+	const Entry* end = mIndex + mCount;
+	const Entry* entry = std::lower_bound(mIndex, end, name,
+	                                      [](const Entry& e, const std::string& n) { return _stricmp(e.name, n.c_str()) < 0; });
+	if (entry == end || _stricmp(entry->name, name.c_str()) != 0)  return false;
+
+	// Only use the packed file if the file it was made from hasn't changed. No source file is fine, packs can be shipped
+	// without the loose files
+	uint64_t writeTime, sourceSize;
+	if (entry->source[0] != '\0' && FileStamp(entry->source, writeTime, sourceSize) &&
+	    (writeTime != entry->sourceWriteTime || sourceSize != entry->sourceSize))
+	{
+		return false;
+	}
+
+	data = mData + entry->offset;
+	size = static_cast<size_t>(entry->size);
+	std::lock_guard<std::mutex> lock(mMutex);
+	++mNumFound;
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writing
+//--------------------------------------------------------------------------------------
+
+bool AssetPack::Write(const std::string& fileName, const std::vector<File>& files, std::string& error)
+{
+	// The files are stored in the order given, the index sorted by name
+	std::vector<Entry> index(files.size());
+	uint64_t offset = sizeof(Header) + index.size() * sizeof(Entry);
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		Entry& entry = index[i];
+		std::memset(&entry, 0, sizeof(entry));
+		if (files[i].name.length() >= MAX_NAME_LENGTH || files[i].sourceName.length() >= MAX_NAME_LENGTH)
+		{
+			error = "Name too long for the pack: " + files[i].name;
+			return false;
+		}
+		std::memcpy(entry.name, files[i].name.c_str(), files[i].name.length());
+		std::memcpy(entry.source, files[i].sourceName.c_str(), files[i].sourceName.length());
+		if (!files[i].sourceName.empty() && !FileStamp(files[i].sourcePath, entry.sourceWriteTime, entry.sourceSize))
+		{
+			error = "Cannot find " + files[i].sourcePath;
+			return false;
+		}
+
+		uint64_t stampTime;
+		if (!FileStamp(files[i].path, stampTime, entry.size))
+		{
+			error = "Cannot find " + files[i].path;
+			return false;
+		}
+		offset = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+		entry.offset = offset;
+		offset += entry.size;
+	}
+	std::vector<Entry> sorted = index;
+	std::sort(sorted.begin(), sorted.end(), [](const Entry& a, const Entry& b) { return _stricmp(a.name, b.name) < 0; });
+	for (size_t i = 1; i < sorted.size(); ++i)
+	{
+		if (_stricmp(sorted[i - 1].name, sorted[i].name) == 0)
+		{
+			error = std::string("File is in the pack twice: ") + sorted[i].name;
+			return false;
+		}
+	}
+
+	// Written to a temporary file then renamed, so a partly written pack is never opened
+	std::string tempFileName = fileName + ".tmp";
+	{
+		std::ofstream pack(tempFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!pack.is_open())
+		{
+			error = "Cannot write " + tempFileName;
+			return false;
+		}
+		Header header = { MAGIC, VERSION, static_cast<uint32_t>(sorted.size()), 0 };
+		pack.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		pack.write(reinterpret_cast<const char*>(sorted.data()), sorted.size() * sizeof(Entry));
+
+		std::vector<char> data;
+		for (size_t i = 0; i < files.size() && !pack.fail(); ++i)
+		{
+			std::vector<char> padding(static_cast<size_t>(index[i].offset - static_cast<uint64_t>(pack.tellp())), 0);
+			pack.write(padding.data(), padding.size());
+
+			std::ifstream file(files[i].path, std::ios::in | std::ios::binary);
+			data.resize(static_cast<size_t>(index[i].size));
+			file.read(data.data(), data.size());
+			if (file.fail())
+			{
+				pack.close();
+				DeleteFileA(tempFileName.c_str());
+				error = "Cannot read " + files[i].path;
+				return false;
+			}
+			pack.write(data.data(), data.size());
+		}
+		if (pack.fail())
+		{
+			pack.close();
+			DeleteFileA(tempFileName.c_str());
+			error = "Cannot write " + tempFileName;
+			return false;
+		}
+	}
+	if (!MoveFileExA(tempFileName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileA(tempFileName.c_str());
+		error = "Cannot write " + fileName;
+		return false;
+	}
+	return true;
+}
+
+
+bool AssetPack::WriteLoadOrder(const std::string& fileName)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::ofstream file(fileName, std::ios::out | std::ios::trunc);
+	if (!file.is_open())  return false;
+	for (auto& name : mLoadOrder)  file << name << "\n";
+	return !file.fail();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+bool AssetPack::FileStamp(const std::string& fileName, uint64_t& writeTime, uint64_t& size)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(fileName.c_str(), GetFileExInfoStandard, &attributes))  return false;
+	writeTime = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	size      = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+	return true;
+}
@@ -0,0 +1,127 @@
+//--------------------------------------------------------------------------------------
+// Asset pack
+//--------------------------------------------------------------------------------------
+// A single file holding the cooked meshes, DDS textures and compiled shaders, built by the AssetCooker tool (-pack).
+// Loading dozens of loose files costs a file open and a separate read for each, which adds up on a hard drive or
+// network storage. The pack is opened once and memory-mapped, and the loaders take their data straight from the
+// mapping: cooked mesh vertices and indices go from it to CreateBuffer, DDS files to CreateDDSTextureFromMemory and
+// shader bytecode to Create*Shader, with no copies.
+//
+// The files are stored in the order the app first asks for them (a load order file written by the app, see
+// WriteLoadOrder), each starting on a page boundary, and the whole pack is prefetched in one go when it is opened - so
+// start up reads it front to back rather than seeking around the disk.
+//
+// Layout: a Header, then Header::count Entry structures sorted by name (case insensitive), then the files. Offsets are
+// from the start of the file. Each entry records the write time and size of the file it was made from, and a packed
+// file is ignored (the loose file is loaded instead) if that source file is present and has changed since.
+//
+// Find is safe to call from several threads at once and the data stays valid until Close
+
+#ifndef _ASSET_PACK_H_INCLUDED_
+#define _ASSET_PACK_H_INCLUDED_
+
+#include <Windows.h>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+
+class AssetPack
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// A file to write to a pack: the name it is found by (as the app opens it, e.g. "Cube.x.cooked") and where to read it
+	// from. Optionally the file it was made from, if its staleness should be checked: its name as the app sees it
+	// (e.g. "Cube.x") and where to find it now
+	struct File
+	{
+		std::string name;
+		std::string path;
+		std::string sourceName;
+		std::string sourcePath;
+	};
+
+	~AssetPack();
+
+	// Memory-map the given pack file and start reading it in. Returns false if it doesn't exist or isn't a valid pack
+	bool Open(const std::string& fileName);
+
+	// Unmap the pack, any pointers from Find are no longer valid
+	void Close();
+
+	// Find the data of the file with the given name. The pointer is into the mapped file and stays valid until Close.
+	// Returns false if the file isn't in the pack (or no pack is open) or it is older than its source file. The names
+	// asked for are recorded either way, for WriteLoadOrder
+	bool Find(const std::string& name, const void*& data, size_t& size);
+
+
+	// Write a pack containing the given files, in the order given. Returns false on failure (reason in error)
+	static bool Write(const std::string& fileName, const std::vector<File>& files, std::string& error);
+
+	// Write the names asked for with Find so far, in the order first asked for, one per line - for AssetCooker -order.
+	// Returns false on failure
+	bool WriteLoadOrder(const std::string& fileName);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	bool IsOpen()    { return mData != nullptr; }
+	int  NumFound()  { std::lock_guard<std::mutex> lock(mMutex);  return mNumFound; } // Files loaded from the pack
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const uint32_t MAGIC   = 0x4B415041; // "APAK"
+	static const uint32_t VERSION = 1;
+	static const int      MAX_NAME_LENGTH = 112;
+	static const uint64_t ALIGNMENT = 4096; // Files start on a page boundary
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t count;
+		uint32_t padding;
+	};
+
+	struct Entry
+	{
+		char     name[MAX_NAME_LENGTH];   // Null terminated
+		char     source[MAX_NAME_LENGTH]; // Empty if not checked
+		uint64_t offset;
+		uint64_t size;
+		uint64_t sourceWriteTime;
+		uint64_t sourceSize;
+	};
+
+	// Write time and size of a file, returns false if it doesn't exist
+	static bool FileStamp(const std::string& fileName, uint64_t& writeTime, uint64_t& size);
+
+
+	HANDLE       mFile    = INVALID_HANDLE_VALUE;
+	HANDLE       mMapping = nullptr;
+	const char*  mData    = nullptr;
+	size_t       mSize    = 0;
+	const Entry* mIndex   = nullptr;
+	uint32_t     mCount   = 0;
+
+	std::mutex               mMutex;     // Guards the load order and count
+	std::vector<std::string> mLoadOrder; // Names asked for, in order
+	std::set<std::string>    mAskedFor;  // --"--, to skip repeats
+	int                      mNumFound = 0;
+};
+
+
+extern AssetPack gAssetPack;
+
+
+#endif //_ASSET_PACK_H_INCLUDED_
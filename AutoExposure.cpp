@@ -0,0 +1,122 @@
+//--------------------------------------------------------------------------------------
+// Auto exposure
+//--------------------------------------------------------------------------------------
+// See AutoExposure.h for an overview
+
+#include "AutoExposure.h"
+#include "Shader.h"
+#include "StateCache.h"
+#include "GraphicsHelpers.h"
+
+#include <cmath>
+
+
+AutoExposure gAutoExposure;
+
+const unsigned int HISTOGRAM_GROUP_SIZE = 16; // Threads per group in x and y in LuminanceHistogram_cs
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+bool AutoExposure::Init()
+{
+	mHistogramBuffer = CreateReadWriteStructuredBuffer(sizeof(unsigned int), NUM_LUMINANCE_BINS,
+	                                                   &mHistogramBufferSRV, &mHistogramBufferUAV);
+	mExposureBuffer  = CreateReadWriteStructuredBuffer(sizeof(ExposureData), 1, &mExposureBufferSRV, &mExposureBufferUAV);
+	mConstantBuffer  = CreateConstantBuffer(sizeof(AutoExposureConstants));
+	if (mHistogramBuffer == nullptr || mExposureBuffer == nullptr || mConstantBuffer == nullptr)
+	{
+		gLastError = "Error creating auto exposure buffers";
+		return false;
+	}
+
+	// The shaders expect an empty histogram and no adapted luminance yet (so the first measurement is used straight away)
+	UINT zeros[4] = {};
+	gD3DContext->ClearUnorderedAccessViewUint(mHistogramBufferUAV, zeros);
+	gD3DContext->ClearUnorderedAccessViewUint(mExposureBufferUAV,  zeros);
+	return true;
+}
+
+
+void AutoExposure::Release()
+{
+	if (mConstantBuffer)      mConstantBuffer->Release();
+	if (mExposureBufferUAV)   mExposureBufferUAV->Release();
+	if (mExposureBufferSRV)   mExposureBufferSRV->Release();
+	if (mExposureBuffer)      mExposureBuffer->Release();
+	if (mHistogramBufferUAV)  mHistogramBufferUAV->Release();
+	if (mHistogramBufferSRV)  mHistogramBufferSRV->Release();
+	if (mHistogramBuffer)     mHistogramBuffer->Release();
+	*this = AutoExposure();
+}
+
+
+void AutoExposure::Measure(ID3D11ShaderResourceView* image, CVector2 uvScale, float frameTime, float bloomThreshold)
+{
+	// The exposure buffer may still be bound for the pixel shaders from the last chain, it can't also be written
+	ID3D11ShaderResourceView* nullSRV = nullptr;
+	gD3DContext->PSSetShaderResources(EXPOSURE_SLOT, 1, &nullSRV);
+
+	AutoExposureConstants constants = {};
+	constants.minLogLuminance   = mSettings.minLogLuminance;
+	constants.logLuminanceRange = mSettings.maxLogLuminance - mSettings.minLogLuminance;
+	constants.adaptation        = 1 - std::exp(-frameTime * mSettings.adaptationRate); // Same speed at any frame rate
+	constants.exposureKey       = mSettings.key;
+	constants.lowPercentile     = mSettings.lowPercentile;
+	constants.highPercentile    = mSettings.highPercentile;
+	constants.bloomThreshold    = bloomThreshold;
+	constants.minExposure       = mSettings.minExposure;
+	constants.maxExposure       = mSettings.maxExposure;
+	constants.measureUVScale    = uvScale;
+	UpdateConstantBuffer(mConstantBuffer, constants);
+	gStateCache.SetConstantBuffer(AUTO_EXPOSURE_CONSTANTS_SLOT, mConstantBuffer);
+
+	// One thread for each pixel measured
+	ID3D11Resource* resource = nullptr;
+	image->GetResource(&resource);
+	ID3D11Texture2D* texture = nullptr;
+	D3D11_TEXTURE2D_DESC desc = {};
+	if (SUCCEEDED(resource->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&texture)))
+	{
+		texture->GetDesc(&desc);
+		texture->Release();
+	}
+	resource->Release();
+	UINT width  = static_cast<UINT>(std::ceil(desc.Width  * uvScale.x));
+	UINT height = static_cast<UINT>(std::ceil(desc.Height * uvScale.y));
+
+	// A multisampled image needs its own version of the histogram shader, measuring the first sample of each pixel
+	D3D11_SHADER_RESOURCE_VIEW_DESC imageDesc = {};
+	image->GetDesc(&imageDesc);
+	ID3D11ComputeShader* histogramShader = gLuminanceHistogram_Compute;
+	if (imageDesc.ViewDimension == D3D11_SRV_DIMENSION_TEXTURE2DMS)
+	{
+		histogramShader = GetComputeShaderPermutation("LuminanceHistogram_cs", { { "MULTISAMPLED", "1" } });
+		if (histogramShader == nullptr)  return; // Compile error (reason in gLastError), the exposure is left as it was
+	}
+
+	ID3D11UnorderedAccessView* uavs[2] = { mHistogramBufferUAV, mExposureBufferUAV };
+	gStateCache.CSSetShader(histogramShader, nullptr, 0);
+	gD3DContext->CSSetShaderResources(0, 1, &image);
+	gD3DContext->CSSetUnorderedAccessViews(0, 1, uavs, nullptr);
+	gD3DContext->Dispatch((width  + HISTOGRAM_GROUP_SIZE - 1) / HISTOGRAM_GROUP_SIZE,
+	                      (height + HISTOGRAM_GROUP_SIZE - 1) / HISTOGRAM_GROUP_SIZE, 1);
+
+	// A single group reduces the histogram
+	gStateCache.CSSetShader(gAutoExposure_Compute, nullptr, 0);
+	gD3DContext->CSSetShaderResources(0, 1, &nullSRV);
+	gD3DContext->CSSetUnorderedAccessViews(0, 2, uavs, nullptr);
+	gD3DContext->Dispatch(1, 1, 1);
+
+	// Unbind so the pixel shaders can read the results
+	ID3D11UnorderedAccessView* nullUAVs[2] = {};
+	gD3DContext->CSSetUnorderedAccessViews(0, 2, nullUAVs, nullptr);
+}
+
+
+void AutoExposure::Bind()
+{
+	gD3DContext->PSSetShaderResources(EXPOSURE_SLOT, 1, &mExposureBufferSRV);
+}
@@ -0,0 +1,89 @@
+//--------------------------------------------------------------------------------------
+// Auto exposure
+//--------------------------------------------------------------------------------------
+// Measures the brightness of an image on the GPU and adjusts the exposure to match, the way an eye or camera adapts.
+// A compute shader counts the pixels into a histogram of log luminance, then a single group reduces it to an average
+// (leaving out the darkest and brightest pixels), moves the adapted luminance towards it over time and works out the
+// exposure and bloom threshold for the frame (see LuminanceHistogram_cs.hlsl and AutoExposure_cs.hlsl). The results
+// stay in a GPU buffer read by the post-process shaders, there is no readback so the CPU never waits for the GPU.
+//
+// Used by EffectChain when its autoExposure setting is on. Measure is called on the main thread before the effects are
+// drawn, Bind makes the results available to the pixel shaders at EXPOSURE_SLOT
+
+#ifndef _AUTO_EXPOSURE_H_INCLUDED_
+#define _AUTO_EXPOSURE_H_INCLUDED_
+
+#include "Common.h"
+#include "CVector2.h"
+
+#include <d3d11.h>
+
+
+// Settings for the measurement and adaptation
+struct AutoExposureSettings
+{
+	float minLogLuminance = -10;    // log2 of the darkest luminance told apart, darker pixels share the lowest bin
+	float maxLogLuminance = 2;      // log2 of the brightest luminance told apart
+	float lowPercentile   = 0.5f;   // Fraction of the lit pixels left out at the dark end of the average
+	float highPercentile  = 0.95f;  // Fraction at which the bright end is cut off
+	float adaptationRate  = 1.5f;   // How fast the exposure follows a change in brightness, higher is faster
+	float key             = 0.18f;  // Luminance the average is exposed to (middle grey)
+	float minExposure     = 0.25f;
+	float maxExposure     = 8;
+};
+
+
+class AutoExposure
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Create the histogram and exposure buffers. Returns false on failure (reason in gLastError)
+	bool Init();
+
+	void Release();
+
+	// Measure the given image and update the exposure. uvScale is the part of the image in use (top-left), frameTime
+	// the time since the last measurement for the adaptation. bloomThreshold is the bright filter threshold used at the
+	// key luminance, the threshold for the frame is scaled to the adapted luminance. The image may be multisampled.
+	// Call on the main thread
+	void Measure(ID3D11ShaderResourceView* image, CVector2 uvScale, float frameTime, float bloomThreshold);
+
+	// Bind the exposure results for the pixel shaders (EXPOSURE_SLOT)
+	void Bind();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	AutoExposureSettings& Settings()  { return mSettings; }
+
+	// The exposure results (one ExposureData), for compute shaders to bind themselves
+	ID3D11ShaderResourceView* ExposureBuffer()  { return mExposureBufferSRV; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	AutoExposureSettings mSettings;
+
+	ID3D11Buffer*              mHistogramBuffer    = nullptr; // NUM_LUMINANCE_BINS pixel counts, cleared after each use
+	ID3D11ShaderResourceView*  mHistogramBufferSRV = nullptr;
+	ID3D11UnorderedAccessView* mHistogramBufferUAV = nullptr;
+
+	ID3D11Buffer*              mExposureBuffer    = nullptr; // One ExposureData, kept between frames for the adaptation
+	ID3D11ShaderResourceView*  mExposureBufferSRV = nullptr;
+	ID3D11UnorderedAccessView* mExposureBufferUAV = nullptr;
+
+	ID3D11Buffer* mConstantBuffer = nullptr;
+};
+
+
+extern AutoExposure gAutoExposure;
+
+
+#endif //_AUTO_EXPOSURE_H_INCLUDED_
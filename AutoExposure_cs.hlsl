@@ -0,0 +1,76 @@
+//--------------------------------------------------------------------------------------
+// Auto Exposure Compute Shader
+//--------------------------------------------------------------------------------------
+// Second pass of auto exposure, a single group. Reduces the luminance histogram from LuminanceHistogram_cs to an
+// average luminance, leaving out the darkest and brightest pixels so a small light or black border doesn't swing it.
+// The average is moved towards that over time and turned into an exposure and a bright filter threshold, which stay in
+// the exposure buffer for the post-processes. Nothing is read back to the CPU. The histogram is cleared for next time
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+RWStructuredBuffer<uint>         Histogram      : register(u0);
+RWStructuredBuffer<ExposureData> ExposureBuffer : register(u1); // One element, kept from frame to frame
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+groupshared float Counts[NUM_LUMINANCE_BINS];
+
+
+// Log luminance at the centre of a bin
+float BinLogLuminance(uint bin)
+{
+	return gMinLogLuminance + (bin - 0.5f) / (NUM_LUMINANCE_BINS - 2) * gLogLuminanceRange;
+}
+
+
+[numthreads(NUM_LUMINANCE_BINS, 1, 1)]
+void main(uint groupIndex : SV_GroupIndex)
+{
+	Counts[groupIndex] = Histogram[groupIndex];
+	Histogram[groupIndex] = 0;
+	GroupMemoryBarrierWithGroupSync();
+
+	if (groupIndex != 0)  return;
+
+	// Walk the bins once, only counting the part of each bin between the low and high percentiles of the lit pixels
+	float total = 0;
+	for (uint bin = 1; bin < NUM_LUMINANCE_BINS; ++bin)  total += Counts[bin];
+
+	ExposureData data = ExposureBuffer[0];
+	if (total > 0)
+	{
+		float low  = total * gExposureLowPercentile;
+		float high = total * gExposureHighPercentile;
+		float below = 0;
+		float weightedSum = 0;
+		float counted = 0;
+		for (uint bin = 1; bin < NUM_LUMINANCE_BINS; ++bin)
+		{
+			float count = Counts[bin];
+			float used = clamp(below + count, low, high) - clamp(below, low, high);
+			weightedSum += used * BinLogLuminance(bin);
+			counted += used;
+			below += count;
+		}
+		float luminance = exp2(weightedSum / max(counted, 1));
+
+		// Jump straight to the first measurement, then adapt
+		data.adaptedLuminance = (data.adaptedLuminance > 0) ? lerp(data.adaptedLuminance, luminance, gExposureAdaptation) : luminance;
+	}
+	else if (data.adaptedLuminance <= 0)
+	{
+		data.adaptedLuminance = gExposureKey; // All black so far, leave the exposure at 1
+	}
+
+	data.exposure = clamp(gExposureKey / data.adaptedLuminance, gMinExposure, gMaxExposure);
+	data.bloomThreshold = gExposureBloomThreshold / data.exposure; // As bright compared to the average as the fixed threshold is to middle grey
+	ExposureBuffer[0] = data;
+}
@@ -0,0 +1,29 @@
+//--------------------------------------------------------------------------------------
+// Light Model Vertex Shader, instanced
+//--------------------------------------------------------------------------------------
+// As BasicTransform_vs, but the world matrix and colour come from the instance buffer so many models can be drawn at once
+
+#include "Instancing.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+InstancedPixelShaderInput main(BasicVertex modelVertex, uint instanceID : SV_InstanceID)
+{
+    InstancedPixelShaderInput output;
+
+    InstanceData instance = GetInstance(instanceID);
+
+    // Usual transformations from model space to world, view and projection space
+    float4 modelPosition     = float4(modelVertex.position, 1);
+    float4 worldPosition     = mul(instance.worldMatrix, modelPosition);
+    float4 viewPosition      = mul(gViewMatrix,       worldPosition);
+    output.projectedPosition = mul(gProjectionMatrix, viewPosition);
+
+    output.uv     = modelVertex.uv;
+    output.colour = instance.objectColour; // Tint for the pixel shader (see TintedTextureInstanced_ps)
+
+    return output;
+}
@@ -0,0 +1,387 @@
+//--------------------------------------------------------------------------------------
+// Batch mode
+//--------------------------------------------------------------------------------------
+// See BatchProcessor.h for an overview
+
+#include "BatchProcessor.h"
+#include "Scene.h"
+#include "Direct3DSetup.h"
+#include "JobSystem.h"
+#include "CpuProfiler.h"
+#include "ResourceRegistry.h"
+#include "Common.h"
+#include "ImageFile.h"
+
+#include <d3d11.h>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+
+
+//--------------------------------------------------------------------------------------
+// State
+//--------------------------------------------------------------------------------------
+
+// An image to process. The pixels hold the decoded input, then the result read back from the GPU
+struct BatchFrame
+{
+	std::string          inputFile;
+	std::string          outputFile;
+	std::vector<uint8_t> pixels; // 8-bit RGBA, no row padding
+	int                  width  = 0;
+	int                  height = 0;
+	std::string          error;  // Set by a job that failed, empty otherwise
+};
+
+// A staging texture the results of one frame are copied to for reading back
+struct ReadbackTexture
+{
+	ID3D11Texture2D* texture = nullptr;
+	int              width   = 0;
+	int              height  = 0;
+};
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+
+std::string LowerCase(std::string text)
+{
+	std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return text;
+}
+
+// The file name without its directory or extension
+std::string FileStem(const std::string& path)
+{
+	size_t nameStart = path.find_last_of("\\/");
+	nameStart = (nameStart == std::string::npos) ? 0 : nameStart + 1;
+	size_t extension = path.find_last_of('.');
+	if (extension == std::string::npos || extension < nameStart)  extension = path.size();
+	return path.substr(nameStart, extension - nameStart);
+}
+
+bool FileExists(const std::string& path)
+{
+	DWORD attributes = GetFileAttributesA(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0;
+}
+
+
+// List the frames of a numbered sequence such as frames\%04d.png, which may start at 0 or 1. Only a single %d with an
+// optional zero-padded width is accepted. Returns false if the pattern isn't valid
+bool ListSequence(const std::string& pattern, std::vector<std::string>& files)
+{
+	size_t percent = pattern.find('%');
+	size_t end = percent + 1;
+	bool zeroPad = (end < pattern.size() && pattern[end] == '0');
+	if (zeroPad)  ++end;
+	int width = 0;
+	while (end < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[end])))  width = width * 10 + (pattern[end++] - '0');
+	if (end >= pattern.size() || pattern[end] != 'd' || pattern.find('%', end) != std::string::npos)
+	{
+		gLastError = "Batch input " + pattern + " should be a directory or contain a single %d (e.g. frames\\%04d.png)";
+		return false;
+	}
+
+	std::string prefix = pattern.substr(0, percent);
+	std::string suffix = pattern.substr(end + 1);
+	auto fileName = [&](int number)
+	{
+		std::string digits = std::to_string(number);
+		if (static_cast<int>(digits.size()) < width)  digits.insert(0, width - digits.size(), zeroPad ? '0' : ' ');
+		return prefix + digits + suffix;
+	};
+
+	int number = FileExists(fileName(0)) ? 0 : 1;
+	while (FileExists(fileName(number)))  files.push_back(fileName(number++));
+	return true;
+}
+
+// List the images in a directory in file name order
+void ListDirectory(const std::string& directory, std::vector<std::string>& files)
+{
+	const char* extensions[] = { ".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff" };
+
+	WIN32_FIND_DATAA found;
+	HANDLE search = FindFirstFileA((directory + "\\*").c_str(), &found);
+	if (search == INVALID_HANDLE_VALUE)  return;
+	do
+	{
+		if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)  continue;
+		std::string name = LowerCase(found.cFileName);
+		for (auto extension : extensions)
+		{
+			size_t length = std::strlen(extension);
+			if (name.size() > length && name.compare(name.size() - length, length, extension) == 0)
+			{
+				files.push_back(directory + "\\" + found.cFileName);
+				break;
+			}
+		}
+	} while (FindNextFileA(search, &found));
+	FindClose(search);
+
+	std::sort(files.begin(), files.end());
+}
+
+
+// Decode a frame's input file into its pixels
+bool DecodeFrame(BatchFrame& frame)
+{
+	if (!ReadImageFile(frame.inputFile, frame.pixels, frame.width, frame.height) ||
+	    frame.width  > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION ||
+	    frame.height > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION)
+	{
+		frame.error = "Error reading image " + frame.inputFile;
+		return false;
+	}
+	return true;
+}
+
+// Write a frame's pixels to its output file as a PNG, then free them
+bool EncodeFrame(BatchFrame& frame)
+{
+	bool written = WritePngFile(frame.outputFile, frame.pixels.data(), frame.width, frame.height);
+	std::vector<uint8_t>().swap(frame.pixels);
+	if (!written)
+	{
+		frame.error = "Error writing image " + frame.outputFile;
+		return false;
+	}
+	return true;
+}
+
+
+// Copy the back buffer to a staging texture, (re)creating it if it isn't the right size
+bool CopyBackBuffer(ReadbackTexture& readback)
+{
+	if (readback.texture == nullptr || readback.width != gViewportWidth || readback.height != gViewportHeight)
+	{
+		if (readback.texture)  readback.texture->Release();
+		readback.texture = nullptr;
+
+		D3D11_TEXTURE2D_DESC desc = {};
+		desc.Width  = gViewportWidth;
+		desc.Height = gViewportHeight;
+		desc.MipLevels = 1;
+		desc.ArraySize = 1;
+		desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_STAGING;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		if (FAILED(gD3DDevice->CreateTexture2D(&desc, nullptr, &readback.texture)))
+		{
+			gLastError = "Error creating batch readback texture";
+			return false;
+		}
+		gResourceRegistry.Track(readback.texture);
+		readback.width  = gViewportWidth;
+		readback.height = gViewportHeight;
+	}
+
+	ID3D11Resource* backBuffer;
+	gBackBufferRenderTarget->GetResource(&backBuffer);
+	gD3DContext->CopyResource(readback.texture, backBuffer);
+	backBuffer->Release();
+	return true;
+}
+
+// Read a frame's results from its staging texture into its pixels. The effects don't keep alpha meaningful, so the
+// images are written opaque
+bool ReadBack(ReadbackTexture& readback, BatchFrame& frame)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(gD3DContext->Map(readback.texture, 0, D3D11_MAP_READ, 0, &mapped)))
+	{
+		gLastError = "Error reading back batch results";
+		return false;
+	}
+	frame.width  = readback.width;
+	frame.height = readback.height;
+	frame.pixels.resize(static_cast<size_t>(frame.width) * frame.height * 4);
+	for (int y = 0; y < frame.height; ++y)
+	{
+		const uint8_t* source = static_cast<const uint8_t*>(mapped.pData) + static_cast<size_t>(y) * mapped.RowPitch;
+		uint8_t* row = frame.pixels.data() + static_cast<size_t>(y) * frame.width * 4;
+		std::memcpy(row, source, frame.width * 4);
+		for (int x = 3; x < frame.width * 4; x += 4)  row[x] = 255;
+	}
+	gD3DContext->Unmap(readback.texture, 0);
+	return true;
+}
+
+
+// Run every frame through the post-processes, pipelined as described in BatchProcessor.h. The first frame has already
+// been decoded
+bool ProcessFrames(std::vector<BatchFrame>& frames)
+{
+	int numFrames = static_cast<int>(frames.size());
+	int groupSize = gJobSystem.NumThreads() + 1;
+	int numGroups = (numFrames + groupSize - 1) / groupSize;
+	auto groupEnd = [&](int group) { return std::min((group + 1) * groupSize, numFrames); };
+
+	// Two sets of staging textures, the group on the GPU uses one while the group before is read back from the other
+	std::vector<ReadbackTexture> readbacks(2 * groupSize);
+
+	bool ok = true;
+	JobGraph decodeFirst;
+	for (int i = 1; i < groupEnd(0); ++i)  decodeFirst.Add([&frames, i]() { DecodeFrame(frames[i]); });
+	gJobSystem.Run(decodeFirst);
+
+	for (int group = 0; group <= numGroups && ok; ++group)
+	{
+		CPU_PROFILE_SCOPE("Batch group");
+
+		// Errors from the last jobs run - decoding this group and encoding the one before last
+		for (int i = group * groupSize; i < groupEnd(group); ++i)
+		{
+			if (!frames[i].error.empty())  { gLastError = frames[i].error; ok = false; }
+		}
+		for (int i = (group - 2) * groupSize; group >= 2 && i < groupEnd(group - 2); ++i)
+		{
+			if (!frames[i].error.empty())  { gLastError = frames[i].error; ok = false; }
+		}
+		if (!ok)  break;
+
+		// Queue this group's work on the GPU, the results are copied to staging textures to read back next time round
+		if (group < numGroups)
+		{
+			for (int i = group * groupSize; i < groupEnd(group) && ok; ++i)
+			{
+				BatchFrame& frame = frames[i];
+				float effectTime = i * SIMULATION_TIME_STEP;
+				ok = PostProcessImage(frame.pixels.data(), frame.width, frame.height, effectTime) &&
+				     CopyBackBuffer(readbacks[(group % 2) * groupSize + i - group * groupSize]);
+			}
+			gD3DContext->Flush(); // Start the GPU on them now rather than when the driver's buffer fills
+		}
+
+		// While the GPU works, read back the group before (long finished) and encode it, and decode the next group
+		JobGraph jobs;
+		if (group > 0)
+		{
+			for (int i = (group - 1) * groupSize; i < groupEnd(group - 1) && ok; ++i)
+			{
+				ok = ReadBack(readbacks[((group - 1) % 2) * groupSize + i - (group - 1) * groupSize], frames[i]);
+				jobs.Add([&frames, i]() { EncodeFrame(frames[i]); });
+			}
+		}
+		for (int i = (group + 1) * groupSize; group + 1 < numGroups && i < groupEnd(group + 1); ++i)
+		{
+			jobs.Add([&frames, i]() { DecodeFrame(frames[i]); });
+		}
+		gJobSystem.Run(jobs); // Even after an error, so no job is left running
+	}
+	for (int i = (numGroups - 1) * groupSize; ok && i < numFrames; ++i)
+	{
+		if (!frames[i].error.empty())  { gLastError = frames[i].error; ok = false; }
+	}
+
+	for (auto& readback : readbacks)
+	{
+		if (readback.texture)  readback.texture->Release();
+	}
+	return ok;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Batch mode
+//--------------------------------------------------------------------------------------
+
+// Post-process flags for a comma separated list of names
+int PostProcessFlags(const std::string& names)
+{
+	struct NamedFlag { const char* name; int flag; };
+	const NamedFlag namedFlags[] =
+	{
+		{ "tint",         POST_PROCESS_TINT          },
+		{ "blur",         POST_PROCESS_BLUR          },
+		{ "gaussianblur", POST_PROCESS_GAUSSIAN_BLUR },
+		{ "underwater",   POST_PROCESS_UNDERWATER    },
+		{ "retro",        POST_PROCESS_RETRO         },
+		{ "bloom",        POST_PROCESS_BLOOM         },
+		{ "star",         POST_PROCESS_STAR_FILTER   },
+	};
+
+	int flags = 0;
+	std::istringstream list(LowerCase(names));
+	std::string name;
+	while (std::getline(list, name, ','))
+	{
+		if (name.empty())  continue;
+		auto found = std::find_if(std::begin(namedFlags), std::end(namedFlags), [&](const NamedFlag& named) { return name == named.name; });
+		if (found == std::end(namedFlags))  return -1;
+		flags |= found->flag;
+	}
+	return flags;
+}
+
+
+// Process every image in the input directory or sequence
+bool RunBatch(const std::string& input, const std::string& outputDirectory, int postProcesses)
+{
+	std::vector<std::string> inputFiles;
+	if (input.find('%') != std::string::npos)
+	{
+		if (!ListSequence(input, inputFiles))  return false;
+	}
+	else
+	{
+		ListDirectory(input, inputFiles);
+	}
+	if (inputFiles.empty())
+	{
+		gLastError = "No images found for batch input " + input;
+		return false;
+	}
+
+	std::vector<BatchFrame> frames(inputFiles.size());
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		frames[i].inputFile  = inputFiles[i];
+		frames[i].outputFile = outputDirectory + "\\" + FileStem(inputFiles[i]) + ".png";
+	}
+	CreateDirectoryA(outputDirectory.c_str(), nullptr); // Fails harmlessly if it already exists
+
+	// The device and targets are created at the size of the first image, they are resized if later images differ
+	bool ok = DecodeFrame(frames[0]);
+	if (ok)
+	{
+		gViewportWidth  = frames[0].width;
+		gViewportHeight = frames[0].height;
+		ok = InitDirect3D();
+		if (ok)
+		{
+			ok = InitGeometry();
+			if (ok)
+			{
+				OutputDebugStringA(("Batch processing " + std::to_string(frames.size()) + " images on " + DeviceDescription() + "\n").c_str());
+				SetPostProcesses(postProcesses);
+
+				int64_t start = CpuProfiler::Now();
+				ok = ProcessFrames(frames);
+				double seconds = static_cast<double>(CpuProfiler::Now() - start) / CpuProfiler::Frequency();
+				if (ok)
+				{
+					std::ostringstream summary;
+					summary.precision(3);
+					summary << std::fixed << "Batch: " << frames.size() << " images in " << seconds << "s ("
+					        << frames.size() / seconds << " images per second)\n";
+					OutputDebugStringA(summary.str().c_str());
+				}
+			}
+			ReleaseResources();
+		}
+		ShutdownDirect3D();
+	}
+	else
+	{
+		gLastError = frames[0].error;
+	}
+
+	return ok;
+}
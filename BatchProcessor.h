@@ -0,0 +1,29 @@
+//--------------------------------------------------------------------------------------
+// Batch mode
+//--------------------------------------------------------------------------------------
+// Runs the post-processes over a sequence of images rather than the rendered scene, with no window or swap chain. Run
+// with the -batch command line switch followed by a directory of images (read in file name order) or a numbered
+// sequence such as frames\%04d.png. The results are written as PNG files of the same names to the -output directory.
+// -effects picks the post-processes (e.g. -effects tint,underwater,retro,bloom) and -warp uses the software rasteriser
+// rather than the GPU.
+//
+// Frames are processed in groups of one per job system thread. While the GPU works on one group, the job system
+// decodes the next group and encodes the one before, whose results were copied to staging textures and so can be read
+// back without waiting. Throughput is written to the debugger output at the end
+
+#ifndef _BATCH_PROCESSOR_H_INCLUDED_
+#define _BATCH_PROCESSOR_H_INCLUDED_
+
+#include <string>
+
+// Post-process flags (POST_PROCESS_ in Scene.h) for a comma separated list of names: tint, blur, gaussianblur,
+// underwater, retro and bloom. Returns -1 if a name isn't recognised
+int PostProcessFlags(const std::string& names);
+
+// Process every image in the input directory or sequence with the given post-processes, writing the results to the
+// output directory (created if needed). Creates and shuts down Direct3D itself at the size of the first image, so call
+// UseHeadless first and don't call InitDirect3D. Returns false on failure (reason in gLastError)
+bool RunBatch(const std::string& input, const std::string& outputDirectory, int postProcesses);
+
+
+#endif //_BATCH_PROCESSOR_H_INCLUDED_
@@ -0,0 +1,256 @@
+//--------------------------------------------------------------------------------------
+// Benchmark mode
+//--------------------------------------------------------------------------------------
+// See Benchmark.h for an overview
+
+#include "Benchmark.h"
+#include "Scene.h"
+#include "GpuProfiler.h"
+#include "PerfMetrics.h"
+#include "RenderTargetPool.h"
+#include "FramePipeline.h"
+#include "Direct3DSetup.h"
+#include "Common.h"
+#include "MathHelpers.h"
+
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+
+//--------------------------------------------------------------------------------------
+// Settings
+//--------------------------------------------------------------------------------------
+
+// Frames run before measuring each combination. Lets the GPU profiler results catch up and shader permutations compile
+const int WARMUP_FRAMES = 30;
+
+// Frames measured for each combination, the camera path is played once over these frames
+const int MEASURED_FRAMES = 300;
+
+const int NUM_COMBINATIONS = 1 << NUM_POST_PROCESS_FLAGS;
+
+// Names of the post-process flags in the metric names, in the same order as the CSV columns
+const char* POST_PROCESS_FLAG_NAMES[NUM_POST_PROCESS_FLAGS] = { "tint", "blur", "gaussianblur", "underwater", "retro", "bloom", "star" };
+
+// Camera path, a loop through these positions / rotations (in degrees) with the camera moving smoothly between them
+struct CameraKey
+{
+	CVector3 position;
+	CVector3 rotation;
+};
+const CameraKey CAMERA_PATH[] =
+{
+	{ {  25, 18, -45 }, { 10,   7, 0 } },
+	{ {  70, 20,  10 }, { 12, -60, 0 } },
+	{ {  30, 30,  80 }, { 18, 200, 0 } },
+	{ { -40, 15,  40 }, {  8, 120, 0 } },
+};
+const int NUM_CAMERA_KEYS = sizeof(CAMERA_PATH) / sizeof(CAMERA_PATH[0]);
+
+
+//--------------------------------------------------------------------------------------
+// State
+//--------------------------------------------------------------------------------------
+
+// Results for one combination of post-processes
+struct BenchmarkResult
+{
+	int   postProcesses;
+	float cpuMean, cpuP50, cpuP95, cpuP99; // Milliseconds
+	float gpuMean, gpuP50, gpuP95, gpuP99;
+};
+
+bool        gBenchmarkRunning = false;
+std::string gBenchmarkFile;
+int         gBenchmarkCombination = 0;
+int         gBenchmarkFrame = 0; // Frame within the current combination, including the warmup frames
+
+std::vector<float>           gCpuTimes; // For the current combination
+std::vector<float>           gGpuTimes;
+std::vector<BenchmarkResult> gBenchmarkResults;
+size_t                       gPeakVideoMemory = 0; // Bytes, over the whole benchmark
+
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+
+// Place the camera at the given point along the path, 0 to 1 for the whole loop
+void SetCameraOnPath(float t)
+{
+	float keyPosition = t * NUM_CAMERA_KEYS;
+	int   key = static_cast<int>(keyPosition) % NUM_CAMERA_KEYS;
+	float s = keyPosition - static_cast<int>(keyPosition);
+	s = s * s * (3 - 2 * s); // Ease in and out of each key
+
+	const CameraKey& key1 = CAMERA_PATH[key];
+	const CameraKey& key2 = CAMERA_PATH[(key + 1) % NUM_CAMERA_KEYS];
+	CVector3 position = key1.position + (key2.position - key1.position) * s;
+	CVector3 rotation = key1.rotation + (key2.rotation - key1.rotation) * s;
+	SetCameraPose(position, { ToRadians(rotation.x), ToRadians(rotation.y), ToRadians(rotation.z) });
+}
+
+// Mean and percentiles of a list of times (which is sorted)
+void Statistics(std::vector<float>& times, float& mean, float& p50, float& p95, float& p99)
+{
+	mean = p50 = p95 = p99 = 0;
+	if (times.empty())  return;
+
+	std::sort(times.begin(), times.end());
+	float total = 0;
+	for (auto time : times)  total += time;
+	mean = total / times.size();
+
+	int last = static_cast<int>(times.size()) - 1;
+	p50 = times[last * 50 / 100];
+	p95 = times[last * 95 / 100];
+	p99 = times[last * 99 / 100];
+}
+
+// Post-processes in a combination for the metric names, e.g. "tint+bloom"
+std::string CombinationName(int postProcesses)
+{
+	std::string name;
+	for (int flag = 0; flag < NUM_POST_PROCESS_FLAGS; ++flag)
+	{
+		if ((postProcesses >> flag) & 1)  name += (name.empty() ? "" : "+") + std::string(POST_PROCESS_FLAG_NAMES[flag]);
+	}
+	return name.empty() ? "none" : name;
+}
+
+// Add a measured frame to the performance metrics. A pass's metric is named by the path of timers down to it, and
+// gathers its times from every combination it runs in
+void RecordFrameMetrics(float cpuMilliseconds, float gpuMilliseconds)
+{
+	std::string combination = CombinationName(gBenchmarkCombination);
+	gPerfMetrics.AddSample("cpu_frame_ms/" + combination, "ms", cpuMilliseconds);
+	gPerfMetrics.AddSample("gpu_frame_ms/" + combination, "ms", gpuMilliseconds);
+	gPerfMetrics.AddSample("cpu_stall_ms/" + combination, "ms", gFramePipeline.StallMilliseconds());
+
+	std::vector<std::string> path;
+	for (auto& timing : gGpuProfiler.Timings())
+	{
+		path.resize(timing.depth);
+		path.push_back(timing.name);
+		std::string name;
+		for (auto& part : path)  name += "/" + part;
+		gPerfMetrics.AddSample("gpu_pass_ms" + name, "ms", timing.milliseconds);
+		if (timing.hasStatistics && timing.pixelShaderInvocations > 0)
+		{
+			gPerfMetrics.AddSample("gpu_pass_ps_invocations" + name, "count", static_cast<float>(timing.pixelShaderInvocations));
+			gPerfMetrics.AddSample("gpu_pass_overdraw" + name, "x", timing.overdraw);
+		}
+	}
+
+	gPeakVideoMemory = std::max(gPeakVideoMemory, VideoMemoryUsage());
+}
+
+// Write all results to the CSV file, returns false on failure
+bool WriteBenchmarkResults()
+{
+	std::ofstream file(gBenchmarkFile);
+	if (!file.is_open())
+	{
+		gLastError = "Error writing benchmark results to " + gBenchmarkFile;
+		return false;
+	}
+
+	file << "Tint,Blur,GaussianBlur,Underwater,Retro,Bloom,StarFilter,Frames,"
+	        "CpuMeanMs,CpuP50Ms,CpuP95Ms,CpuP99Ms,GpuMeanMs,GpuP50Ms,GpuP95Ms,GpuP99Ms\n";
+	file.precision(3);
+	file << std::fixed;
+	for (auto& result : gBenchmarkResults)
+	{
+		for (int flag = 0; flag < NUM_POST_PROCESS_FLAGS; ++flag)
+		{
+			file << (((result.postProcesses >> flag) & 1) ? 1 : 0) << ",";
+		}
+		file << MEASURED_FRAMES << ","
+		     << result.cpuMean << "," << result.cpuP50 << "," << result.cpuP95 << "," << result.cpuP99 << ","
+		     << result.gpuMean << "," << result.gpuP50 << "," << result.gpuP95 << "," << result.gpuP99 << "\n";
+	}
+	if (file.fail())
+	{
+		gLastError = "Error writing benchmark results to " + gBenchmarkFile;
+		return false;
+	}
+
+	// The metrics for the regression gate go alongside, with the loading times recorded before the benchmark began
+	const float megabyte = 1024.0f * 1024.0f;
+	if (gPeakVideoMemory > 0)  gPerfMetrics.AddSample("vram_peak_mb", "MB", gPeakVideoMemory / megabyte);
+	gPerfMetrics.AddSample("render_target_peak_mb", "MB", gRenderTargetPool.PeakMemoryBytes() / megabyte);
+	return gPerfMetrics.Write(MetricsFileName(gBenchmarkFile));
+}
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+// Start the benchmark, results will be written to the given file
+void StartBenchmark(const std::string& resultsFile)
+{
+	gBenchmarkRunning = true;
+	gBenchmarkFile = resultsFile;
+	gBenchmarkCombination = 0;
+	gBenchmarkFrame = 0;
+	gCpuTimes.clear();
+	gGpuTimes.clear();
+	gBenchmarkResults.clear();
+	gPeakVideoMemory = 0;
+
+	SetLockFPS(false);
+	SetFrameRateCap(0);
+	SetPostProcesses(0);
+	SetCameraOnPath(0);
+}
+
+
+bool BenchmarkRunning()
+{
+	return gBenchmarkRunning;
+}
+
+
+// Record the previous frame then set up the scene for the coming one
+bool UpdateBenchmark(float lastFrameTime)
+{
+	if (!gBenchmarkRunning)  return true;
+
+	// The previous frame was a measured one. The GPU time is a few frames old, but still from this combination
+	if (gBenchmarkFrame > WARMUP_FRAMES)
+	{
+		gCpuTimes.push_back(lastFrameTime * 1000);
+		gGpuTimes.push_back(gGpuProfiler.FrameMilliseconds());
+		RecordFrameMetrics(gCpuTimes.back(), gGpuTimes.back());
+	}
+
+	// Finished this combination
+	if (gBenchmarkFrame == WARMUP_FRAMES + MEASURED_FRAMES)
+	{
+		BenchmarkResult result;
+		result.postProcesses = gBenchmarkCombination;
+		Statistics(gCpuTimes, result.cpuMean, result.cpuP50, result.cpuP95, result.cpuP99);
+		Statistics(gGpuTimes, result.gpuMean, result.gpuP50, result.gpuP95, result.gpuP99);
+		gBenchmarkResults.push_back(result);
+		gCpuTimes.clear();
+		gGpuTimes.clear();
+
+		gBenchmarkFrame = 0;
+		++gBenchmarkCombination;
+		if (gBenchmarkCombination == NUM_COMBINATIONS)
+		{
+			gBenchmarkRunning = false;
+			return WriteBenchmarkResults();
+		}
+	}
+
+	// Coming frame. The warmup frames sit at the start of the camera path
+	SetPostProcesses(gBenchmarkCombination);
+	int pathFrame = std::max(gBenchmarkFrame - WARMUP_FRAMES, 0);
+	SetCameraOnPath(static_cast<float>(pathFrame) / MEASURED_FRAMES);
+	++gBenchmarkFrame;
+	return true;
+}
@@ -0,0 +1,35 @@
+//--------------------------------------------------------------------------------------
+// Benchmark mode
+//--------------------------------------------------------------------------------------
+// Run with the -benchmark command line switch (optionally followed by the CSV file name to write). The scene is
+// updated with a fixed time step while the camera follows a scripted path, once for every combination of the
+// post-processes that can be toggled. CPU frame time and GPU time are recorded for each combination and written
+// out with percentiles, then the app quits. The sequence of frames is identical every run so results from
+// different builds or GPUs can be compared directly. The frame times, the GPU time of each pass, peak video memory and
+// the loading times are also written as performance metrics (see PerfMetrics.h) to a .json file of the same name, for
+// the PerfGate regression check
+
+#ifndef _BENCHMARK_H_INCLUDED_
+#define _BENCHMARK_H_INCLUDED_
+
+#include "Scene.h"
+
+#include <string>
+
+// Time step passed to the scene while benchmarking, independent of the real frame time. The same as the simulation
+// step, so every benchmark frame runs exactly one step and renders the same state on every machine
+const float BENCHMARK_TIME_STEP = SIMULATION_TIME_STEP;
+
+// Start the benchmark, results will be written to the given file. Switches off the frame rate lock
+void StartBenchmark(const std::string& resultsFile);
+
+// True from StartBenchmark until the benchmark has finished
+bool BenchmarkRunning();
+
+// Call once per frame before updating the scene, passing the real time taken by the previous frame. Sets up the scene
+// for the coming frame, or writes the results once all combinations are done (BenchmarkRunning then returns false).
+// Returns false if the results couldn't be written (reason in gLastError)
+bool UpdateBenchmark(float lastFrameTime);
+
+
+#endif //_BENCHMARK_H_INCLUDED_
@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// Bitonic Sort Block Compute Shader
+//--------------------------------------------------------------------------------------
+// One group per SORT_BLOCK_SIZE elements of the sort buffer, doing all the steps of the sort that stay within the block
+// in groupshared memory (see GpuSort.h). With a stage of 0 each block is sorted from scratch, otherwise the steps of the
+// stage from SORT_BLOCK_SIZE / 2 down finish merging the sequences that BitonicSortStep_cs has started
+
+#include "GpuSort.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+RWStructuredBuffer<uint2> SortData : register(u0); // Key / value pairs
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+groupshared uint2 Block[SORT_BLOCK_SIZE];
+
+
+// One step of a stage, each thread comparing one pair
+void Step(uint thread, uint blockStart, uint stage, uint step)
+{
+    uint lower = SortPairIndex(thread, step);
+    uint upper = lower + step;
+    uint2 lowerValue = Block[lower];
+    uint2 upperValue = Block[upper];
+    SortCompareExchange(lowerValue, upperValue, blockStart + lower, stage);
+    Block[lower] = lowerValue;
+    Block[upper] = upperValue;
+    GroupMemoryBarrierWithGroupSync();
+}
+
+
+[numthreads(SORT_GROUP_SIZE, 1, 1)]
+void main(uint3 groupID : SV_GroupID, uint groupIndex : SV_GroupIndex)
+{
+    uint blockStart = groupID.x * SORT_BLOCK_SIZE;
+    Block[groupIndex]                   = SortData[blockStart + groupIndex];
+    Block[groupIndex + SORT_GROUP_SIZE] = SortData[blockStart + groupIndex + SORT_GROUP_SIZE];
+    GroupMemoryBarrierWithGroupSync();
+
+    if (gSortStage == 0)
+    {
+        for (uint stage = 2; stage <= SORT_BLOCK_SIZE; stage *= 2)
+        {
+            for (uint step = stage / 2; step > 0; step /= 2)  Step(groupIndex, blockStart, stage, step);
+        }
+    }
+    else
+    {
+        for (uint step = SORT_BLOCK_SIZE / 2; step > 0; step /= 2)  Step(groupIndex, blockStart, gSortStage, step);
+    }
+
+    SortData[blockStart + groupIndex]                   = Block[groupIndex];
+    SortData[blockStart + groupIndex + SORT_GROUP_SIZE] = Block[groupIndex + SORT_GROUP_SIZE];
+}
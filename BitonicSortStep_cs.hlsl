@@ -0,0 +1,33 @@
+//--------------------------------------------------------------------------------------
+// Bitonic Sort Step Compute Shader
+//--------------------------------------------------------------------------------------
+// One step of a stage of the sort comparing elements too far apart to be in the same block, one thread per pair
+// straight from the sort buffer (see GpuSort.h). BitonicSortBlock_cs does the shorter steps
+
+#include "GpuSort.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+RWStructuredBuffer<uint2> SortData : register(u0); // Key / value pairs
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+[numthreads(SORT_GROUP_SIZE, 1, 1)]
+void main(uint3 dispatchID : SV_DispatchThreadID)
+{
+    if (dispatchID.x >= gSortSize / 2)  return;
+
+    uint lower = SortPairIndex(dispatchID.x, gSortStep);
+    uint upper = lower + gSortStep;
+    uint2 lowerValue = SortData[lower];
+    uint2 upperValue = SortData[upper];
+    SortCompareExchange(lowerValue, upperValue, lower, gSortStage);
+    SortData[lower] = lowerValue;
+    SortData[upper] = upperValue;
+}
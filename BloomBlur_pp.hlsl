@@ -0,0 +1,48 @@
+//--------------------------------------------------------------------------------------
+// Bloom Blur Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// One direction of a separable Gaussian blur on a bloom mip. The mips are small so the radius is only a few
+// pixels, the weights are calculated here rather than using the Gaussian blur kernel constants.
+// Compiled as a permutation with BLOOM_BLUR_RADIUS defined so the loop is unrolled with constant weights, the version
+// compiled by the build reads the radius from the constant buffer instead
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D SceneTexture : register(t0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	int2 size = (int2)gInputSize;
+	
+	// Curve falls to about 1% at the edge of the radius
+#ifdef BLOOM_BLUR_RADIUS
+	const int radius = BLOOM_BLUR_RADIUS;
+#else
+	int radius = (int)bloomBlurRadius;
+#endif
+	float sigma = max(radius / 3.0f, 0.5f);
+	
+	int2   pixel  = (int2)input.projectedPosition.xy;
+	int2   direction = (int2)bloomBlurDirection;
+	float3 colour = 0;
+	float  total  = 0;
+	for (int i = -radius; i <= radius; ++i)
+	{
+		int2 pos = clamp(pixel + direction * i, 0, size - 1);
+		float weight = exp(-(i * i) / (2 * sigma * sigma));
+		colour += SceneTexture.Load(int3(pos, 0)).rgb * weight;
+		total += weight;
+	}
+	
+	return float4(colour / total, 1.0f);
+}
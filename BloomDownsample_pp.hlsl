@@ -0,0 +1,48 @@
+//--------------------------------------------------------------------------------------
+// Bloom Downsample Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Halves the size of the image for the bloom mip chain. The first downsample also does the bright filter,
+// so the full size bright texture is never written. HALF_PRECISION 1 filters and averages in min16float (see Common.hlsli)
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+// The larger mip (or the scene for the first downsample)
+Texture2D    SceneTexture   : register(t0);
+SamplerState BilinearSample : register(s1); // Each bilinear tap averages a 2x2 block of the larger texture
+
+StructuredBuffer<ExposureData> ExposureBuffer : register(t8); // EXPOSURE_SLOT, only bound with auto exposure on
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Keep only bright colours, as BrightFilter_pp. A threshold of 0 keeps everything
+pfloat3 BrightFilter(pfloat3 colour, pfloat threshold)
+{
+	pfloat brightness = colour.x + colour.y + colour.z;
+	return (brightness < threshold) ? 0 : colour;
+}
+
+
+// Four bilinear taps around the output pixel cover a 4x4 block of the larger texture, which gives a smoother
+// result than a single 2x2 average and stops small bright spots flickering as the camera moves
+float4 main(PostProcessingInput input) : SV_Target
+{
+	float2 texel = gTexelSize; // size of each pixel of the larger texture, in UV units
+
+	// With auto exposure the threshold follows the brightness of the scene
+	pfloat threshold = (gAutoExposure != 0 && brightFilterThreshold > 0) ? ExposureBuffer[0].bloomThreshold : brightFilterThreshold;
+	
+	pfloat3 colour = BrightFilter(pfloat3(SceneTexture.Sample(BilinearSample, input.uv + texel * float2(-1, -1)).rgb), threshold) +
+	                 BrightFilter(pfloat3(SceneTexture.Sample(BilinearSample, input.uv + texel * float2( 1, -1)).rgb), threshold) +
+	                 BrightFilter(pfloat3(SceneTexture.Sample(BilinearSample, input.uv + texel * float2(-1,  1)).rgb), threshold) +
+	                 BrightFilter(pfloat3(SceneTexture.Sample(BilinearSample, input.uv + texel * float2( 1,  1)).rgb), threshold);
+	
+	return float4(colour * 0.25f, 1.0f);
+}
@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------------------------
+// Bloom Tile Blur Compute Shader
+//--------------------------------------------------------------------------------------
+// Same blur as BloomBlur_pp, for the lit tiles of a bloom mip only (see BloomTiles.h). Dispatched with one group for
+// each tile in the list, which loads the row or column of pixels it needs (the tile plus the radius either side) into
+// groupshared memory once and blurs from there. The rest of the output has been cleared to black.
+// Compiled as a permutation with BLOOM_BLUR_RADIUS defined, like BloomBlur_pp, the version compiled by the build reads
+// the radius from the constant buffer instead, up to MAX_BLOOM_TILE_BLUR_RADIUS
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D            SceneTexture  : register(t0);
+StructuredBuffer<uint> TileList    : register(t2); // t1 is the tile mask, only an input so the classification runs first
+RWTexture2D<float4>  OutputTexture : register(u0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Pixels along each side of a tile, must match BLOOM_TILE_SIZE in BloomTiles.h
+#define BLOOM_TILE_SIZE 16
+
+#ifdef BLOOM_BLUR_RADIUS
+#define MAX_BLOOM_TILE_BLUR_RADIUS BLOOM_BLUR_RADIUS
+#else
+#define MAX_BLOOM_TILE_BLUR_RADIUS 16
+#endif
+
+// One line of pixels along the blur for each row (or column) of the tile
+groupshared float3 Tile[BLOOM_TILE_SIZE][BLOOM_TILE_SIZE + 2 * MAX_BLOOM_TILE_BLUR_RADIUS];
+
+
+[numthreads(BLOOM_TILE_SIZE, BLOOM_TILE_SIZE, 1)]
+void main(uint3 groupID : SV_GroupID, uint3 threadID : SV_GroupThreadID)
+{
+	int width, height;
+	SceneTexture.GetDimensions(width, height);
+
+#ifdef BLOOM_BLUR_RADIUS
+	const int radius = BLOOM_BLUR_RADIUS;
+#else
+	int radius = min((int)bloomBlurRadius, MAX_BLOOM_TILE_BLUR_RADIUS);
+#endif
+	float sigma = max(radius / 3.0f, 0.5f);
+
+	uint  packed = TileList[groupID.x];
+	int2  tileStart = int2(packed & 0xffff, packed >> 16) * BLOOM_TILE_SIZE;
+	int2  direction = (int2)bloomBlurDirection; // Along the blur, and across it below
+	int2  across    = direction.yx;
+	int   along     = dot((int2)threadID.xy, direction);
+	int   row       = dot((int2)threadID.xy, across);
+
+	// Load the line of the tile and its apron, clamped at the edges of the texture like the pixel shader
+	for (int i = along; i < BLOOM_TILE_SIZE + 2 * radius; i += BLOOM_TILE_SIZE)
+	{
+		int2 pos = clamp(tileStart + direction * (i - radius) + across * row, 0, int2(width, height) - 1);
+		Tile[row][i] = SceneTexture.Load(int3(pos, 0)).rgb;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	int2 pixel = tileStart + (int2)threadID.xy;
+	if (pixel.x >= width || pixel.y >= height)  return;
+
+	// Curve falls to about 1% at the edge of the radius
+	float3 colour = 0;
+	float  total  = 0;
+	for (int offset = -radius; offset <= radius; ++offset)
+	{
+		float weight = exp(-(offset * offset) / (2 * sigma * sigma));
+		colour += Tile[row][along + radius + offset] * weight;
+		total += weight;
+	}
+
+	OutputTexture[pixel] = float4(colour / total, 1.0f);
+}
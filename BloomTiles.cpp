@@ -0,0 +1,85 @@
+//--------------------------------------------------------------------------------------
+// Bloom tile classification
+//--------------------------------------------------------------------------------------
+// See BloomTiles.h for an overview
+
+#include "BloomTiles.h"
+#include "Shader.h"
+#include "Common.h"
+
+
+BloomTiles gBloomTiles;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+BloomTiles::~BloomTiles()
+{
+	Release();
+}
+
+
+void BloomTiles::Release()
+{
+	for (auto& level : mLevels)
+	{
+		if (level.arguments)    level.arguments->Release();
+		if (level.tileListUAV)  level.tileListUAV->Release();
+		if (level.tileListSRV)  level.tileListSRV->Release();
+		if (level.tileList)     level.tileList->Release();
+		level = Level();
+	}
+}
+
+
+bool BloomTiles::Prepare(int level, int width, int height)
+{
+	if (level < 0 || level >= MAX_BLOOM_TILE_LEVELS)
+	{
+		gLastError = "Too many bloom mips for the tile lists";
+		return false;
+	}
+
+	Level& buffers = mLevels[level];
+	int numTiles = ((width + BLOOM_TILE_SIZE - 1) / BLOOM_TILE_SIZE) * ((height + BLOOM_TILE_SIZE - 1) / BLOOM_TILE_SIZE);
+	if (numTiles <= buffers.capacity)  return true;
+
+	// Grown but never shrunk, the window is rarely resized and the buffers are small
+	if (buffers.tileListUAV)  buffers.tileListUAV->Release();
+	if (buffers.tileListSRV)  buffers.tileListSRV->Release();
+	if (buffers.tileList)     buffers.tileList->Release();
+	buffers.tileListUAV = nullptr;
+	buffers.tileListSRV = nullptr;
+	buffers.capacity = 0;
+	buffers.tileList = CreateReadWriteStructuredBuffer(sizeof(unsigned int), numTiles, &buffers.tileListSRV, &buffers.tileListUAV,
+	                                                   D3D11_BUFFER_UAV_FLAG_APPEND);
+	if (buffers.arguments == nullptr)  buffers.arguments = CreateDispatchArgumentsBuffer(0, 1, 1);
+	if (buffers.tileList == nullptr || buffers.arguments == nullptr)
+	{
+		if (buffers.tileList == nullptr) // The views were released by the helper
+		{
+			buffers.tileListSRV = nullptr;
+			buffers.tileListUAV = nullptr;
+		}
+		gLastError = "Error creating bloom tile lists";
+		return false;
+	}
+	buffers.capacity = numTiles;
+	return true;
+}
+
+
+void BloomTiles::BindForAppend(int level)
+{
+	UINT emptyList = 0;
+	gD3DContext->CSSetUnorderedAccessViews(1, 1, &mLevels[level].tileListUAV, &emptyList);
+}
+
+
+// Only the group count in x is replaced, y and z stay at 1
+void BloomTiles::UpdateArguments(int level)
+{
+	gD3DContext->CopyStructureCount(mLevels[level].arguments, 0, mLevels[level].tileListUAV);
+}
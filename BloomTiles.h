@@ -0,0 +1,80 @@
+//--------------------------------------------------------------------------------------
+// Bloom tile classification
+//--------------------------------------------------------------------------------------
+// Most of a frame produces no bloom at all: the bright filter blacks out everything under the threshold, so in a dark
+// scene the bloom mips are almost entirely black. With EffectSettings::bloomTiles set, each bloom mip is split into
+// BLOOM_TILE_SIZE square tiles and a compute pass (BloomTiles_cs.hlsl) appends the tiles with any light in them, widened
+// by the blur radius, to a list on the GPU. The blurs then run one group per listed tile (BloomTileBlur_cs.hlsl) with
+// DispatchIndirect, and the tiles left out are cleared to black, so the blur cost follows how much of the screen is lit
+// rather than the resolution. The CPU never reads the list back.
+//
+// This holds the tile list and dispatch arguments for each bloom mip, sized for the largest image seen so far. Used by
+// EffectChain, each mip's buffers are only used between its classification pass and its blurs
+
+#ifndef _BLOOM_TILES_H_INCLUDED_
+#define _BLOOM_TILES_H_INCLUDED_
+
+#include <d3d11.h>
+
+
+// Pixels along each side of a tile, must match BLOOM_TILE_SIZE in BloomTiles_cs.hlsl and BloomTileBlur_cs.hlsl
+const int BLOOM_TILE_SIZE = 16;
+
+// Mips that can be classified
+const int MAX_BLOOM_TILE_LEVELS = 4;
+
+
+class BloomTiles
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~BloomTiles();
+
+	void Release();
+
+	// Make sure the tile list for the given mip can hold every tile of an image of the given size. Returns false on
+	// failure (reason in gLastError), the mip is then blurred as usual
+	bool Prepare(int level, int width, int height);
+
+
+	// For the passes' setups: bind the mip's tile list, emptied, for the classification to append to (at u1)
+	void BindForAppend(int level);
+
+	// Copy the number of tiles listed into the mip's dispatch arguments, after the classification and before the blurs
+	void UpdateArguments(int level);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// The tiles listed for the mip, each packed as x | y << 16 in tiles
+	ID3D11ShaderResourceView* TileList(int level)   { return mLevels[level].tileListSRV; }
+
+	// Arguments for DispatchIndirect, one group for each listed tile
+	ID3D11Buffer*             Arguments(int level)  { return mLevels[level].arguments; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	struct Level
+	{
+		ID3D11Buffer*              tileList    = nullptr;
+		ID3D11ShaderResourceView*  tileListSRV = nullptr;
+		ID3D11UnorderedAccessView* tileListUAV = nullptr;
+		ID3D11Buffer*              arguments   = nullptr;
+		int                        capacity    = 0;
+	};
+	Level mLevels[MAX_BLOOM_TILE_LEVELS];
+};
+
+
+extern BloomTiles gBloomTiles;
+
+
+#endif //_BLOOM_TILES_H_INCLUDED_
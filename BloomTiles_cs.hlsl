@@ -0,0 +1,60 @@
+//--------------------------------------------------------------------------------------
+// Bloom Tile Classification Compute Shader
+//--------------------------------------------------------------------------------------
+// One group for each tile of a bloom mip (see BloomTiles.h). The group checks the tile and the pixels around it within
+// the blur radius for any light, and if there is some the tile is appended to the list the blurs are dispatched over.
+// The mask output holds one texel per tile, 1 for the tiles listed
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D                    SceneTexture : register(t0); // The bright filtered mip
+RWTexture2D<float>           TileMask     : register(u0);
+AppendStructuredBuffer<uint> TileList     : register(u1);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Pixels along each side of a tile, must match BLOOM_TILE_SIZE in BloomTiles.h
+#define BLOOM_TILE_SIZE 16
+
+groupshared uint TileLit;
+
+
+[numthreads(BLOOM_TILE_SIZE, BLOOM_TILE_SIZE, 1)]
+void main(uint3 groupID : SV_GroupID, uint3 threadID : SV_GroupThreadID, uint threadIndex : SV_GroupIndex)
+{
+	int width, height;
+	SceneTexture.GetDimensions(width, height);
+
+	if (threadIndex == 0)  TileLit = 0;
+	GroupMemoryBarrierWithGroupSync();
+
+	// The tile widened by the radius of the blur, clamped at the edges as the blur reads them
+	int radius = (int)bloomBlurRadius;
+	int2 start = (int2)(groupID.xy * BLOOM_TILE_SIZE) - radius;
+	int  size  = BLOOM_TILE_SIZE + 2 * radius;
+	bool lit = false;
+	for (int y = threadID.y; y < size; y += BLOOM_TILE_SIZE)
+	{
+		for (int x = threadID.x; x < size; x += BLOOM_TILE_SIZE)
+		{
+			int2 pixel = clamp(start + int2(x, y), 0, int2(width, height) - 1);
+			lit = lit || any(SceneTexture.Load(int3(pixel, 0)).rgb > 0);
+		}
+	}
+	if (lit)  InterlockedOr(TileLit, 1);
+	GroupMemoryBarrierWithGroupSync();
+
+	if (threadIndex == 0)
+	{
+		TileMask[groupID.xy] = TileLit;
+		if (TileLit != 0)  TileList.Append(groupID.x | (groupID.y << 16));
+	}
+}
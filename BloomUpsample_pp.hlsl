@@ -0,0 +1,31 @@
+//--------------------------------------------------------------------------------------
+// Bloom Upsample Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Works back up the bloom mip chain, adding the weighted blurred mip at this size to the (bilinear filtered)
+// result from the next smaller mip. Each small mip ends up spread wider than the one above it, so the sum is a
+// broad glow made of several blur sizes
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    LevelTexture   : register(t0); // Blurred mip at the output size
+Texture2D    CoarserTexture : register(t1); // Accumulated result from the half size mip
+SamplerState PointSample    : register(s0);
+SamplerState BilinearSample : register(s1);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	float3 level   = LevelTexture.Sample(PointSample, input.uv).rgb;
+	float3 coarser = CoarserTexture.Sample(BilinearSample, input.uv).rgb;
+	
+	return float4(level * bloomLevelWeight + coarser * bloomCoarserWeight, 1.0f);
+}
@@ -0,0 +1,257 @@
+//--------------------------------------------------------------------------------------
+// Blur technique selection
+//--------------------------------------------------------------------------------------
+// See BlurSelector.h for an overview
+
+#include "BlurSelector.h"
+#include "EffectChain.h"
+#include "RenderTargetPool.h"
+#include "Direct3DSetup.h"
+#include "Common.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+
+BlurSelector gBlurSelector;
+
+// Blur strengths measured by the benchmark, each one roughly double the last
+const float CALIBRATION_STRENGTHS[] = { 5, 9, 17, 33, 65, 129 };
+
+// Narrowest blurs the downsampled and dual filter blurs are used for. Below these they visibly lose detail the blur
+// should have kept, however fast they are
+const float MIN_DOWNSAMPLED_BLUR_STRENGTH = 24;
+const float MIN_DUAL_FILTER_BLUR_STRENGTH = 64;
+
+// Blurs timed for each measurement, after one untimed blur to compile shaders and fill the render target pool
+const int CALIBRATION_REPEATS = 4;
+
+// Used without a calibration, as before it existed
+const float DEFAULT_COMPUTE_BLUR_STRENGTH = 16;
+
+
+const char* BlurTechniqueName(BlurTechnique technique)
+{
+	switch (technique)
+	{
+	case BlurTechnique::Pixel:        return "pixel";
+	case BlurTechnique::Compute:      return "compute";
+	case BlurTechnique::Downsampled:  return "downsampled";
+	case BlurTechnique::DualFilter:   return "dualfilter";
+	default:                          return "auto";
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+bool BlurSelector::Calibrate(int width, int height, const std::string& cacheFile /*= "BlurCalibration.txt"*/)
+{
+	mSteps.clear();
+	mMeasured = false;
+
+	std::string device = DeviceDescription();
+	if (LoadCache(cacheFile, device))  return true;
+
+	// Blur a mid-grey image the size of the viewport, the content doesn't change the cost
+	PooledTarget* input  = gRenderTargetPool.Acquire(width, height, DXGI_FORMAT_R8G8B8A8_UNORM);
+	PooledTarget* output = gRenderTargetPool.Acquire(width, height, DXGI_FORMAT_R8G8B8A8_UNORM);
+	if (input == nullptr || output == nullptr)
+	{
+		if (input)   gRenderTargetPool.Return(input);
+		if (output)  gRenderTargetPool.Return(output);
+		return false; // Reason in gLastError
+	}
+	const float grey[4] = { 0.5f, 0.5f, 0.5f, 1.0f };
+	gD3DContext->ClearRenderTargetView(input->renderTarget, grey);
+
+	bool ok = true;
+	for (float strength : CALIBRATION_STRENGTHS)
+	{
+		BlurTechnique techniques[] = { BlurTechnique::Pixel, BlurTechnique::Compute, BlurTechnique::Downsampled, BlurTechnique::DualFilter };
+		BlurTechnique best = BlurTechnique::Pixel;
+		float bestTime = -1;
+		for (auto technique : techniques)
+		{
+			if (technique == BlurTechnique::Downsampled && strength < MIN_DOWNSAMPLED_BLUR_STRENGTH)  continue;
+			if (technique == BlurTechnique::DualFilter  && strength < MIN_DUAL_FILTER_BLUR_STRENGTH)  continue;
+
+			float time = MeasureBlur(technique, strength, input, output);
+			if (time < 0)
+			{
+				ok = false;
+				break;
+			}
+			if (bestTime < 0 || time < bestTime)
+			{
+				bestTime = time;
+				best = technique;
+			}
+		}
+		if (!ok)  break;
+		mSteps.push_back({ strength, best });
+	}
+
+	gRenderTargetPool.Return(input);
+	gRenderTargetPool.Return(output);
+
+	if (!ok)
+	{
+		mSteps.clear();
+		return false;
+	}
+	mMeasured = true;
+	SaveCache(cacheFile, device);
+	return true;
+}
+
+
+BlurTechnique BlurSelector::Select(float blurStrength)
+{
+	if (mSteps.empty())
+	{
+		return blurStrength >= DEFAULT_COMPUTE_BLUR_STRENGTH ? BlurTechnique::Compute : BlurTechnique::Pixel;
+	}
+
+	// Narrower than anything measured uses the narrowest measurement
+	BlurTechnique technique = mSteps.front().technique;
+	for (auto& step : mSteps)
+	{
+		if (step.blurStrength <= blurStrength)  technique = step.technique;
+	}
+
+	// A step measured for wider blurs can't lower the minimums above, e.g. when the cache came from an older version
+	if (technique == BlurTechnique::DualFilter  && blurStrength < MIN_DUAL_FILTER_BLUR_STRENGTH)  technique = BlurTechnique::Downsampled;
+	if (technique == BlurTechnique::Downsampled && blurStrength < MIN_DOWNSAMPLED_BLUR_STRENGTH)  technique = BlurTechnique::Compute;
+	return technique;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+// The blur runs through an effect chain, so it is measured exactly as it is used
+float BlurSelector::MeasureBlur(BlurTechnique technique, float blurStrength, PooledTarget* input, PooledTarget* output)
+{
+	EffectChain chain;
+	chain.Add(Effect::GaussianBlur);
+	chain.Settings().blurStrength  = blurStrength;
+	chain.Settings().blurTechnique = technique;
+	chain.Settings().dualFilterIterations = std::min(std::max(static_cast<int>(std::log2(blurStrength / 4) + 0.5f), 1), 6);
+
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+	ID3D11Query* disjoint = nullptr;
+	gD3DDevice->CreateQuery(&queryDesc, &disjoint);
+	queryDesc.Query = D3D11_QUERY_TIMESTAMP;
+	ID3D11Query* begin = nullptr;
+	ID3D11Query* end   = nullptr;
+	gD3DDevice->CreateQuery(&queryDesc, &begin);
+	gD3DDevice->CreateQuery(&queryDesc, &end);
+
+	float time = -1;
+	if (disjoint != nullptr && begin != nullptr && end != nullptr)
+	{
+		bool ok = chain.Apply(input->shaderResource, output->renderTarget); // Warm up
+		if (ok)
+		{
+			gD3DContext->Begin(disjoint);
+			gD3DContext->End(begin);
+			for (int i = 0; i < CALIBRATION_REPEATS && ok; ++i)
+			{
+				ok = chain.Apply(input->shaderResource, output->renderTarget);
+			}
+			gD3DContext->End(end);
+			gD3DContext->End(disjoint);
+			gD3DContext->Flush();
+		}
+
+		UINT64 beginTime, endTime;
+		D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointData;
+		HRESULT beginResult, endResult, disjointResult;
+		if (ok)
+		{
+			while ((beginResult    = gD3DContext->GetData(begin,    &beginTime,    sizeof(beginTime),    0)) == S_FALSE) {}
+			while ((endResult      = gD3DContext->GetData(end,      &endTime,      sizeof(endTime),      0)) == S_FALSE) {}
+			while ((disjointResult = gD3DContext->GetData(disjoint, &disjointData, sizeof(disjointData), 0)) == S_FALSE) {}
+			ok = (beginResult == S_OK && endResult == S_OK && disjointResult == S_OK && !disjointData.Disjoint);
+			if (ok)
+			{
+				time = static_cast<float>(endTime - beginTime) / disjointData.Frequency * 1000.0f / CALIBRATION_REPEATS;
+			}
+			else
+			{
+				gLastError = "Error reading the GPU clock while measuring blurs";
+			}
+		}
+	}
+	else
+	{
+		gLastError = "Error creating queries to measure blurs";
+	}
+
+	if (end)       end     ->Release();
+	if (begin)     begin   ->Release();
+	if (disjoint)  disjoint->Release();
+	return time;
+}
+
+
+// Cache lines are the device description, a tab, then strength=technique pairs separated by spaces
+bool BlurSelector::LoadCache(const std::string& cacheFile, const std::string& device)
+{
+	std::ifstream file(cacheFile);
+	std::string line;
+	while (std::getline(file, line))
+	{
+		size_t tab = line.find('\t');
+		if (tab == std::string::npos || line.compare(0, tab, device) != 0 || tab != device.size())  continue;
+
+		std::istringstream steps(line.substr(tab + 1));
+		std::string step;
+		while (steps >> step)
+		{
+			size_t equals = step.find('=');
+			if (equals == std::string::npos)  continue;
+			float strength = std::strtof(step.c_str(), nullptr);
+			std::string name = step.substr(equals + 1);
+			for (auto technique : { BlurTechnique::Pixel, BlurTechnique::Compute, BlurTechnique::Downsampled, BlurTechnique::DualFilter })
+			{
+				if (name == BlurTechniqueName(technique))  mSteps.push_back({ strength, technique });
+			}
+		}
+		return !mSteps.empty();
+	}
+	return false;
+}
+
+// Rewrites the file with this device's line replaced, keeping the other adapters
+void BlurSelector::SaveCache(const std::string& cacheFile, const std::string& device)
+{
+	std::vector<std::string> lines;
+	{
+		std::ifstream file(cacheFile);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (line.compare(0, device.size() + 1, device + '\t') != 0)  lines.push_back(line);
+		}
+	}
+
+	std::ostringstream steps;
+	for (auto& step : mSteps)
+	{
+		steps << (steps.tellp() > 0 ? " " : "") << step.blurStrength << "=" << BlurTechniqueName(step.technique);
+	}
+	lines.push_back(device + '\t' + steps.str());
+
+	std::ofstream file(cacheFile);
+	for (auto& line : lines)  file << line << "\n";
+	if (!file)  OutputDebugStringA(("Error writing " + cacheFile + "\n").c_str());
+}
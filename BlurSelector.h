@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------------------
+// Blur technique selection
+//--------------------------------------------------------------------------------------
+// Picks the cheapest way to run a Gaussian blur of a given strength on this GPU. The techniques cost very differently
+// as the blur gets wider, and where they cross over depends on the GPU (texture cache, groupshared memory speed):
+//   Pixel       - separable pixel shaders with pairs of pixels merged into bilinear taps, best for narrow blurs
+//   Compute     - separable compute shaders caching each row / column in groupshared memory
+//   Downsampled - the same Gaussian at half size with half the radius, then a dual filter upsample
+//   DualFilter  - the dual filter (Kawase) blur, an approximation with a cost that hardly grows with the width
+// The downsampled and dual filter blurs are only considered for wide blurs, where the most detailed frequencies they
+// lose are removed by the blur anyway. The box blur always uses the summed-area table, which costs the same at any width.
+//
+// The crossovers are measured by a short GPU benchmark the first time the program runs on an adapter, and cached in a
+// text file with one line per adapter. Until then (or if the benchmark can't run) a fixed rule is used
+
+#ifndef _BLUR_SELECTOR_H_INCLUDED_
+#define _BLUR_SELECTOR_H_INCLUDED_
+
+#include <string>
+#include <vector>
+
+struct PooledTarget;
+
+
+enum class BlurTechnique
+{
+	Auto,        // Ask gBlurSelector
+	Pixel,
+	Compute,
+	Downsampled,
+	DualFilter,
+};
+
+// Name of a technique as used in the cache file and reports
+const char* BlurTechniqueName(BlurTechnique technique);
+
+
+class BlurSelector
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Load the crossovers for the current device from the cache file, or run the benchmark at the given size and add
+	// them to the file. Call on the main thread once the shaders, states and post-processing constant buffers exist.
+	// Returns false if the benchmark couldn't run (reason in gLastError), the fixed rule is used instead
+	bool Calibrate(int width, int height, const std::string& cacheFile = "BlurCalibration.txt");
+
+	// The technique to use for a Gaussian blur of the given strength (width in pixels), never Auto
+	BlurTechnique Select(float blurStrength);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	bool Calibrated()  { return !mSteps.empty(); }
+	bool Measured()    { return mMeasured; } // Calibrated by running the benchmark this time rather than from the cache
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Time one blur, in milliseconds. Negative on failure
+	float MeasureBlur(BlurTechnique technique, float blurStrength, PooledTarget* input, PooledTarget* output);
+
+	bool LoadCache(const std::string& cacheFile, const std::string& device);
+	void SaveCache(const std::string& cacheFile, const std::string& device);
+
+	// The fastest technique from each measured strength up to the next
+	struct Step
+	{
+		float         blurStrength;
+		BlurTechnique technique;
+	};
+	std::vector<Step> mSteps;
+	bool              mMeasured = false;
+};
+
+
+extern BlurSelector gBlurSelector;
+
+
+#endif //_BLUR_SELECTOR_H_INCLUDED_
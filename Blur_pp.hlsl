@@ -5,42 +5,38 @@
 // Textures (texture maps)
 //--------------------------------------------------------------------------------------
 
-// The scene has been rendered to a texture, these variables allow access to that texture
-Texture2D SceneTexture : register(t0);
-SamplerState PointSample : register(s0); // We don't usually want to filter (bilinear, trilinear etc.) the scene texture when
-                                          // post-processing so this sampler will use "point sampling" - no filtering
+// Summed-area table of the scene, built by the SummedAreaTableRows_cs / SummedAreaTableColumns_cs passes. Each texel
+// holds the sum of the scene pixels above and to the left of it (inclusive), minus 0.5 per pixel to keep precision
+Texture2D SummedAreaTable : register(t0);
 
 
 //--------------------------------------------------------------------------------------
 // Shader code
 //--------------------------------------------------------------------------------------
 
-// Post-processing shader that tints the scene texture to a given colour
+// Sum of the table for pixels up to and including the given one, zero outside of the top / left edges
+float3 TableSum(int2 pixel)
+{
+	if (pixel.x < 0 || pixel.y < 0)  return 0;
+	return SummedAreaTable.Load(int3(pixel, 0)).rgb;
+}
+
+
+// Post-processing shader that averages a box of (2 * blurRadius + 1) pixels square around each pixel. The summed-area
+// table gives the total of any box from four reads, so the cost doesn't depend on the blur size
 float4 main(PostProcessingInput input) : SV_Target
 {
-	float width;
-	float height;
-	SceneTexture.GetDimensions(width, height);
-	
-	float w = 1 / width;
-	float h = 1 / height;
-	
+	int2 size = (int2)gInputSize;
 	
-	float3 colour = 0;
-	int i = 0;
+	// Box corners, clipped to the texture. Average over the pixels actually inside the box at the edges
+	int   radius = (int)blurRadius;
+	int2  pixel  = (int2)input.projectedPosition.xy;
+	int2  boxMin = max(pixel - radius, 0) - 1; // Just outside the box
+	int2  boxMax = min(pixel + radius, size - 1);
+	float area   = (boxMax.x - boxMin.x) * (boxMax.y - boxMin.y);
 	
-	for (int y = -blurRadius; y <= blurRadius; y++)
-	{
-		for (int x = -blurRadius; x <= blurRadius; x++)
-		{
-			float2 pos = input.uv + float2(w * x, h * y);
-			colour += SceneTexture.Sample(PointSample, pos).rgb;
-			
-			
-			i++;
-		}
-	}
-	colour /= i;
+	float3 sum = TableSum(boxMax) - TableSum(int2(boxMin.x, boxMax.y)) - TableSum(int2(boxMax.x, boxMin.y)) + TableSum(boxMin);
+	float3 colour = sum / area + 0.5f;
 	
 	return float4(colour, 1.0f);
-}
\ No newline at end of file
+}
@@ -0,0 +1,121 @@
+//--------------------------------------------------------------------------------------
+// Bone palettes
+//--------------------------------------------------------------------------------------
+// See BonePalettes.h for an overview
+
+#include "BonePalettes.h"
+#include "ResourceRegistry.h"
+#include "Model.h"
+#include "JobSystem.h"
+#include "StateCache.h"
+#include "ConstantBufferRing.h"
+#include "CpuProfiler.h"
+
+#include <algorithm>
+
+
+BonePalettes gBonePalettes;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+bool BonePalettes::Update(Model* const models[], unsigned int numModels)
+{
+	CPU_PROFILE_SCOPE("BonePalettes::Update");
+
+	mNumPalettes = numModels;
+	mMapped = false;
+	if (numModels == 0)  return true;
+
+	if (!mOffsetsChecked)
+	{
+		mOffsetsSupported = ConstantBufferOffsetsSupported();
+		mOffsetsChecked = true;
+	}
+
+	// Grow the buffer by doubling so it is rarely recreated as models are added
+	bool ok = true;
+	if (mOffsetsSupported && numModels > mCapacity)
+	{
+		if (mBuffer)  mBuffer->Release();
+		mBuffer = nullptr;
+		mCapacity = std::max(numModels, mCapacity * 2);
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = mCapacity * sizeof(SkeletonConstants);
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		if (FAILED(gD3DDevice->CreateBuffer(&desc, nullptr, &mBuffer)))
+		{
+			mBuffer = nullptr;
+			mCapacity = 0;
+			mOffsetsSupported = false; // Don't try again every frame
+			gLastError = "Error creating bone palette buffer";
+			ok = false;
+		}
+		gResourceRegistry.Track(mBuffer);
+	}
+
+	// The jobs write to the mapped buffer directly. It is write-combined memory, so each palette is only written once
+	// and in order (MultiplyMatrices stores whole rows one after another)
+	SkeletonConstants* palettes = nullptr;
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (mBuffer != nullptr)
+	{
+		if (SUCCEEDED(gD3DContext->Map(mBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		{
+			palettes = static_cast<SkeletonConstants*>(mapped.pData);
+			mMapped = true;
+		}
+		else
+		{
+			gLastError = "Error mapping bone palette buffer";
+			ok = false;
+		}
+	}
+	if (!mMapped)
+	{
+		if (mPalettes.size() < numModels)  mPalettes.resize(numModels);
+		palettes = mPalettes.data();
+	}
+
+	gJobSystem.ParallelFor(numModels, BATCH_SIZE, [models, palettes](size_t first, size_t end)
+	{
+		for (size_t i = first; i < end; ++i)
+		{
+			models[i]->CalculateBonePalette(palettes[i].boneMatrices);
+		}
+	});
+
+	if (mMapped)  gD3DContext->Unmap(mBuffer, 0);
+	return ok;
+}
+
+
+void BonePalettes::Bind(unsigned int index)
+{
+	if (mMapped)
+	{
+		const UINT constants = sizeof(SkeletonConstants) / 16;
+		gStateCache.SetConstantBuffer(SKELETON_CONSTANTS_SLOT, mBuffer, index * constants, constants);
+	}
+	else
+	{
+		BindConstants(SKELETON_CONSTANTS_SLOT, mPalettes[index], gSkeletonConstantBuffer);
+	}
+}
+
+
+void BonePalettes::Release()
+{
+	if (mBuffer)  mBuffer->Release();
+	mBuffer = nullptr;
+	mCapacity = 0;
+	mOffsetsChecked = false;
+	mMapped = false;
+	mPalettes.clear();
+	mNumPalettes = 0;
+}
@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------------------
+// Bone palettes
+//--------------------------------------------------------------------------------------
+// The bone matrices (palette) of every skinned model, calculated together once per frame rather than one model at a
+// time as it is drawn. The models' absolute node matrices already come from the transform system, so each palette is
+// just those multiplied by the mesh's fixed offset matrices. The models are split into batches run as jobs (see
+// JobSystem.h), each using the SSE batch matrix functions.
+//
+// Where constant buffer offsets are supported (see ConstantBufferRing.h) the palettes are written by the jobs straight
+// into one mapped dynamic constant buffer holding all of them, and each model binds its own part of it - one map a
+// frame and no copies. Otherwise the jobs write to CPU-side copies and each one is uploaded as it is bound
+
+#ifndef _BONE_PALETTES_H_INCLUDED_
+#define _BONE_PALETTES_H_INCLUDED_
+
+#include "Common.h"
+
+#include <d3d11.h>
+#include <vector>
+
+class Model;
+
+
+class BonePalettes
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~BonePalettes()  { Release(); }
+
+	// Calculate the palettes of the given models, which must all have skinned meshes. Call on the main thread after
+	// gTransformSystem.Update. Returns false if the buffer can't be created or mapped (reason in gLastError), the
+	// CPU-side copies are used instead then so the palettes can still be bound
+	bool Update(Model* const models[], unsigned int numModels);
+
+	// Bind the palette of the given model from the last Update for whichever shaders read the skeleton constants
+	void Bind(unsigned int index);
+
+	void Release();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	unsigned int NumPalettes()  { return mNumPalettes; }
+
+	// The palettes are in one constant buffer bound with offsets, rather than uploaded one by one
+	bool UsingOffsets()  { return mMapped; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const unsigned int BATCH_SIZE = 16; // Models in each job
+
+	// Each palette is bound as a whole number of 16 constant blocks, as constant buffer offsets require
+	static_assert(sizeof(SkeletonConstants) % 256 == 0, "Skeleton constants must be a multiple of 256 bytes");
+
+	ID3D11Buffer* mBuffer   = nullptr; // Palettes for mCapacity models, when offsets are supported
+	unsigned int  mCapacity = 0;
+	bool          mOffsetsChecked   = false;
+	bool          mOffsetsSupported = false;
+	bool          mMapped = false;     // The last Update wrote to mBuffer rather than mPalettes
+
+	std::vector<SkeletonConstants> mPalettes; // CPU-side copies when the buffer isn't used
+	unsigned int                   mNumPalettes = 0;
+};
+
+
+extern BonePalettes gBonePalettes;
+
+
+#endif //_BONE_PALETTES_H_INCLUDED_
@@ -2,10 +2,15 @@
 // Class encapsulating a camera
 //--------------------------------------------------------------------------------------
 // Holds position, rotation, near/far clip and field of view. These to a view and projection matrices as required
+//
+// The matrices and frustum are only recalculated when requested after a setting has changed. Changes to position or
+// rotation and changes to the projection settings are tracked separately, so moving the camera doesn't rebuild the
+// projection matrix
 
 #include "CVector3.h"
 #include "CMatrix4x4.h"
 #include "MathHelpers.h"
+#include "Bounds.h"
 #include "Input.h"
 
 #ifndef _CAMERA_H_INCLUDED_
@@ -22,7 +27,8 @@ public:
 	// Constructor - initialise all settings, sensible defaults provided for everything.
 	Camera(CVector3 position = {0,0,0}, CVector3 rotation = {0,0,0}, 
            float fov = PI/3, float aspectRatio = 4.0f / 3.0f, float nearClip = 0.1f, float farClip = 10000.0f)
-        : mPosition(position), mRotation(rotation), mFOVx(fov), mAspectRatio(aspectRatio), mNearClip(nearClip), mFarClip(farClip)
+        : mPosition(position), mRotation(rotation), mFOVx(fov), mAspectRatio(aspectRatio), mNearClip(nearClip), mFarClip(farClip),
+          mTransformChanged(true), mProjectionChanged(true)
     {
     }
 
@@ -39,29 +45,38 @@ public:
 	// Getters / setters
 	CVector3 Position()  { return mPosition; }
 	CVector3 Rotation()  { return mRotation;	}
-	void SetPosition(CVector3 position)  { mPosition = position; }
-	void SetRotation(CVector3 rotation)  { mRotation = rotation; }
+	void SetPosition(CVector3 position)  { mPosition = position;  mTransformChanged = true; }
+	void SetRotation(CVector3 rotation)  { mRotation = rotation;  mTransformChanged = true; }
 
-	float FOV()       { return mFOVx;     }
-	float NearClip()  { return mNearClip; }
-	float FarClip()   { return mFarClip;  }
+	float FOV()          { return mFOVx;        }
+	float AspectRatio()  { return mAspectRatio; }
+	float NearClip()     { return mNearClip;    }
+	float FarClip()      { return mFarClip;     }
 
-	void SetFOV     (float fov     )  { mFOVx     = fov;      }
-	void SetNearClip(float nearClip)  { mNearClip = nearClip; }
-	void SetFarClip (float farClip )  { mFarClip  = farClip;  }
+	void SetFOV        (float fov        )  { mFOVx        = fov;          mProjectionChanged = true; }
+	void SetAspectRatio(float aspectRatio)  { mAspectRatio = aspectRatio;  mProjectionChanged = true; }
+	void SetNearClip   (float nearClip   )  { mNearClip    = nearClip;     mProjectionChanged = true; }
+	void SetFarClip    (float farClip    )  { mFarClip     = farClip;      mProjectionChanged = true; }
 
 	// Read only access to camera matrices, updated on request from position, rotation and camera settings
-	CMatrix4x4 WorldMatrix()           { UpdateMatrices(); return mWorldMatrix; }
-	CMatrix4x4 ViewMatrix()            { UpdateMatrices(); return mViewMatrix;           }
-	CMatrix4x4 ProjectionMatrix()      { UpdateMatrices(); return mProjectionMatrix;     }
-	CMatrix4x4 ViewProjectionMatrix()  { UpdateMatrices(); return mViewProjectionMatrix; }
+	const CMatrix4x4& WorldMatrix()           { UpdateMatrices(); return mWorldMatrix;          }
+	const CMatrix4x4& ViewMatrix()            { UpdateMatrices(); return mViewMatrix;           }
+	const CMatrix4x4& ProjectionMatrix()      { UpdateMatrices(); return mProjectionMatrix;     }
+	const CMatrix4x4& ViewProjectionMatrix()  { UpdateMatrices(); return mViewProjectionMatrix; }
+
+	// Takes points from projection space back to world space, e.g. to find the world position of a pixel from its depth
+	const CMatrix4x4& InverseViewProjectionMatrix()  { UpdateMatrices(); return mInverseViewProjectionMatrix; }
+
+	// The planes bounding what the camera can see in world space, taken from the view-projection matrix. Used to skip
+	// rendering models that are off-screen (see Model::IsVisible)
+	const Frustum& ViewFrustum()  { UpdateMatrices(); return mFrustum; }
 
 	
 //-------------------------------------
 // Private members
 //-------------------------------------
 private:
-	// Update the matrices used for the camera in the rendering pipeline
+	// Update the matrices used for the camera in the rendering pipeline, if any settings have changed since last time
 	void UpdateMatrices();
 
 	// Postition and rotations for the camera (rarely scale cameras)
@@ -82,6 +97,15 @@ private:
 	CMatrix4x4 mProjectionMatrix;     // Projection matrix holds the field of view and near/far clip distances
 	CMatrix4x4 mViewProjectionMatrix; // Combine (multiply) the view and projection matrices together, which
 	                                  // can sometimes save a matrix multiply in the shader (optional)
+
+	CMatrix4x4 mInverseProjectionMatrix;     // Kept so only the cheap multiply is needed when just the camera moves
+	CMatrix4x4 mInverseViewProjectionMatrix; // Built from the inverse projection and the world matrix
+
+	Frustum mFrustum; // Updated with the matrices above
+
+	// Whether the position / rotation or the projection settings have changed since the matrices were last updated
+	bool mTransformChanged;
+	bool mProjectionChanged;
 };
 
 
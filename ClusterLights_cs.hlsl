@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------------------------
+// Light Clustering Compute Shader
+//--------------------------------------------------------------------------------------
+// Lists the lights reaching each cluster of the view frustum for the lighting pixel shader (see Lighting.hlsli). One
+// thread per cluster, with every thread in a group sharing a depth slice. The group loads the lights in batches into
+// group shared memory, moving them into view space once, then each thread tests them against its cluster's box
+
+#define BUILDING_LIGHT_CLUSTERS
+#include "Lighting.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------------
+
+StructuredBuffer<LightData> Lights              : register(t0);
+RWStructuredBuffer<uint>    ClusterLightCounts  : register(u0); // Number of lights in each cluster
+RWStructuredBuffer<uint>    ClusterLightIndices : register(u1); // MAX_LIGHTS_PER_CLUSTER light indices for each cluster
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+#define LIGHT_BATCH_SIZE (LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y)
+
+groupshared float4 LightBatch[LIGHT_BATCH_SIZE]; // View-space position and range of each light
+
+
+// One group per depth slice (dispatched with LIGHT_CLUSTERS_Z groups)
+[numthreads(LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y, 1)]
+void main(uint3 groupID : SV_GroupID, uint3 threadID : SV_GroupThreadID, uint threadIndex : SV_GroupIndex)
+{
+	uint3 cluster = uint3(threadID.xy, groupID.x);
+
+	// Corners of the cluster's tile in normalised device coordinates (y is up, tile rows go down the screen)
+	float2 tileSize = float2(2.0f / LIGHT_CLUSTERS_X, 2.0f / LIGHT_CLUSTERS_Y);
+	float2 tileMin = float2(-1 + cluster.x * tileSize.x, 1 - (cluster.y + 1) * tileSize.y);
+	float2 tileMax = tileMin + tileSize;
+
+	// View-space box around the cluster. At view depth z a point at device x, y is at view x, y = device x, y * z / scale,
+	// where scale is the projection matrix's x and y scaling
+	float2 toView = 1 / float2(gProjectionMatrix[0][0], gProjectionMatrix[1][1]);
+	float nearDepth = ClusterSliceDepth(cluster.z);
+	float farDepth  = ClusterSliceDepth(cluster.z + 1);
+	float3 boxMin = float3(min(tileMin * toView * nearDepth, tileMin * toView * farDepth), nearDepth);
+	float3 boxMax = float3(max(tileMax * toView * nearDepth, tileMax * toView * farDepth), farDepth);
+
+	uint clusterIndex = ClusterIndex(cluster);
+	uint listStart = clusterIndex * MAX_LIGHTS_PER_CLUSTER;
+	uint numClusterLights = 0;
+
+	for (uint batchStart = 0; batchStart < gNumLights; batchStart += LIGHT_BATCH_SIZE)
+	{
+		uint lightIndex = batchStart + threadIndex;
+		if (lightIndex < gNumLights)
+		{
+			LightData light = Lights[lightIndex];
+			LightBatch[threadIndex] = float4(mul(gViewMatrix, float4(light.position, 1.0f)).xyz, light.range);
+		}
+		GroupMemoryBarrierWithGroupSync();
+
+		// A light reaches the cluster if the nearest point of the box is within its range
+		uint batchSize = min((uint)LIGHT_BATCH_SIZE, gNumLights - batchStart);
+		for (uint i = 0; i < batchSize; ++i)
+		{
+			float4 light = LightBatch[i];
+			float3 offset = clamp(light.xyz, boxMin, boxMax) - light.xyz;
+			if (dot(offset, offset) <= light.w * light.w && numClusterLights < MAX_LIGHTS_PER_CLUSTER)
+			{
+				ClusterLightIndices[listStart + numClusterLights] = batchStart + i;
+				++numClusterLights;
+			}
+		}
+
+		// Wait for every thread to finish with the batch before the next one overwrites it
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	ClusterLightCounts[clusterIndex] = numClusterLights;
+}
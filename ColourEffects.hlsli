@@ -0,0 +1,162 @@
+//--------------------------------------------------------------------------------------
+// Include file for the fused colour effects
+//--------------------------------------------------------------------------------------
+// Fog (Fog_pp), tint (Tint_pp), underwater (Underwater_pp), retro (Retro_pp then BitColour_pp) and exposure (Exposure_pp)
+// in a single pass. Each of these only moves where the scene is read from and / or changes the colour read, so
+// applying them in one shader gives the same result as the separate passes with one read and one write instead of one
+// per effect. Shared by the pixel shader (ColourEffects_pp) and the compute shader (ColourEffects_cs).
+// Compiled as permutations with COLOUR_EFFECT_FOG / _TINT / _UNDERWATER / _RETRO / _EXPOSURE defined as 0 or 1 (see
+// GetPixelShaderPermutation in Shader.cpp), so each variant only contains the effects it uses. The build compiles the
+// version with all of them off.
+// COLOUR_EFFECT_RETRO_PIXELLATE 0 leaves out the pixellation for input already rendered at the size of the retro blocks.
+// COLOUR_EFFECT_LUT 1 replaces the colour depth reduction with a fetch from the colour grading LUT (see ColourLut.h).
+// COLOUR_EFFECT_MSAA 1 reads a multisampled scene and resolves it in the same pass, so MSAA needs no resolve of its own.
+// The samples are weighted by 1 / (1 + luminance), a few very bright HDR samples would otherwise outweigh the rest and
+// leave the edges they are on as jagged as without MSAA
+// HALF_PRECISION 1 does the colour maths after the scene is read in min16float (see Common.hlsli). The MSAA resolve
+// stays 32-bit, its sums of HDR samples can be large
+
+#ifndef COLOUR_EFFECT_FOG
+#define COLOUR_EFFECT_FOG 0
+#endif
+#ifndef COLOUR_EFFECT_TINT
+#define COLOUR_EFFECT_TINT 0
+#endif
+#ifndef COLOUR_EFFECT_UNDERWATER
+#define COLOUR_EFFECT_UNDERWATER 0
+#endif
+#ifndef COLOUR_EFFECT_RETRO
+#define COLOUR_EFFECT_RETRO 0
+#endif
+#ifndef COLOUR_EFFECT_RETRO_PIXELLATE
+#define COLOUR_EFFECT_RETRO_PIXELLATE 1
+#endif
+#ifndef COLOUR_EFFECT_LUT
+#define COLOUR_EFFECT_LUT 0
+#endif
+#ifndef COLOUR_EFFECT_EXPOSURE
+#define COLOUR_EFFECT_EXPOSURE 0
+#endif
+#ifndef COLOUR_EFFECT_MSAA
+#define COLOUR_EFFECT_MSAA 0
+#endif
+
+#if COLOUR_EFFECT_FOG
+#include "DepthEffects.hlsli"
+#else
+#include "Common.hlsli"
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+// The scene has been rendered to a texture, these variables allow access to that texture
+#if COLOUR_EFFECT_MSAA
+Texture2DMS<float4> SceneTexture : register(t0);
+#else
+Texture2D    SceneTexture : register(t0);
+#endif
+SamplerState PointSample  : register(s0); // We don't usually want to filter (bilinear, trilinear etc.) the scene texture when
+                                          // post-processing so this sampler will use "point sampling" - no filtering
+#if COLOUR_EFFECT_LUT
+Texture3D    ColourLut      : register(t1);
+SamplerState BilinearSample : register(s1); // Clamped, trilinear on a 3D texture
+#endif
+
+#if COLOUR_EFFECT_EXPOSURE
+StructuredBuffer<ExposureData> ExposureBuffer : register(t8); // EXPOSURE_SLOT
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+// The scene colour the point sample at uv picks
+float3 SceneColour(float2 uv, float width, float height)
+{
+#if COLOUR_EFFECT_MSAA
+	float widthMS, heightMS, numSamples;
+	SceneTexture.GetDimensions(widthMS, heightMS, numSamples);
+
+	int2 pixel = int2(min(floor(saturate(uv) * float2(width, height)), float2(width, height) - 1));
+	float3 total = 0;
+	float totalWeight = 0;
+	for (uint i = 0; i < uint(numSamples); ++i)
+	{
+		float3 colour = SceneTexture.Load(pixel, i).rgb;
+		float weight = 1 / (1 + Luminance(colour));
+		total += colour * weight;
+		totalWeight += weight;
+	}
+	return total / totalWeight;
+#else
+	return SceneTexture.SampleLevel(PointSample, uv, 0).rgb;
+#endif
+}
+
+
+// The separate passes run fog, then tint, then underwater, then retro, then exposure. Working backwards from the output
+// pixel, each effect moves the position read from the previous one, with the colour multipliers taken at the position
+// each effect saw
+float3 ColourEffects(float2 uv)
+{
+	float width  = gInputSize.x;
+	float height = gInputSize.y;
+
+	pfloat3 tint = 1;
+
+#if COLOUR_EFFECT_RETRO && COLOUR_EFFECT_RETRO_PIXELLATE
+	// Pixellate - read from the centre of each block of pixels
+	uv = float2(round((uv.x * width)  / gNoiseScale.x) / (width  / gNoiseScale.x),
+	            round((uv.y * height) / gNoiseScale.y) / (height / gNoiseScale.y));
+#endif
+
+#if COLOUR_EFFECT_UNDERWATER
+	// Gradient tint and wavy offset
+	float2 waveOffset = float2((sin(uv.y*3 + hWave) / 60), (sin(uv.x*5 + vWave) / 60) - (sin(uv.x*4 + hWave) / 40));
+	tint *= pfloat3(waterTintColour * uv.y + waterTintColour2 * (1 - uv.y));
+	uv += waveOffset;
+#endif
+
+#if COLOUR_EFFECT_TINT
+	// Gradient tint
+	tint *= pfloat3(gTintColour * uv.y + gTintColour2 * (1 - uv.y));
+#endif
+
+	pfloat3 colour = pfloat3(SceneColour(uv, width, height));
+
+#if COLOUR_EFFECT_FOG
+	// The fog pass ran at each pixel centre, so read the depth at the centre of the pixel the point sample picked
+	float2 pixelCentre = (min(floor(saturate(uv) * float2(width, height)), float2(width, height) - 1) + 0.5f) / float2(width, height);
+	float distance = max(SceneDepth(pixelCentre) - gFogStart, 0);
+	pfloat fog = pfloat((1 - exp(-gFogDensity * distance)) * gFogMaxOpacity);
+	colour = lerp(colour, pfloat3(gFogColour), fog);
+#endif
+
+	colour *= tint;
+
+#if COLOUR_EFFECT_LUT
+	// All the colour transforms in one fetch, reading from the centres of the first and last entries at 0 and 1
+	const float lutScale  = (COLOUR_LUT_SIZE - 1.0f) / COLOUR_LUT_SIZE;
+	const float lutOffset = 0.5f / COLOUR_LUT_SIZE;
+	colour = pfloat3(ColourLut.SampleLevel(BilinearSample, saturate(colour) * lutScale + lutOffset, 0).rgb);
+#elif COLOUR_EFFECT_RETRO
+	// Reduce the colour depth, in steps of bitColour / 256. Scaled in one go so bright HDR colours stay in range at half
+	// precision
+	pfloat step = pfloat(bitColour / 256);
+	colour = round(colour / step) * step;
+#endif
+
+#if COLOUR_EFFECT_EXPOSURE
+	// Exposure then the extended Reinhard tonemap, as Exposure_pp
+	pfloat exposure = pfloat(ExposureBuffer[0].exposure);
+	colour *= exposure;
+	pfloat whiteSquared = exposure * exposure;
+	colour = colour * (1 + colour / whiteSquared) / (1 + colour);
+#endif
+
+	return float3(colour);
+}
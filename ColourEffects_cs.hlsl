@@ -0,0 +1,39 @@
+//--------------------------------------------------------------------------------------
+// Fused Colour Effects Post-Processing Compute Shader
+//--------------------------------------------------------------------------------------
+// Same effects as ColourEffects_pp (see ColourEffects.hlsli for the permutations), one thread per output pixel writing
+// straight to a UAV, with no render target or blending. The best thread group size differs between GPUs, so it is
+// compiled in with GROUP_SIZE_X / _Y chosen by gComputeTuner (see ComputeTuner.h)
+
+#include "ColourEffects.hlsli"
+
+#ifndef GROUP_SIZE_X
+#define GROUP_SIZE_X 8
+#endif
+#ifndef GROUP_SIZE_Y
+#define GROUP_SIZE_Y 8
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+RWTexture2D<float4> OutputTexture : register(u0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+[numthreads(GROUP_SIZE_X, GROUP_SIZE_Y, 1)]
+void main(uint3 pixel : SV_DispatchThreadID)
+{
+	uint width, height;
+	OutputTexture.GetDimensions(width, height);
+	if (pixel.x >= width || pixel.y >= height)  return;
+
+	// The uv of the pixel centre, as the full screen quad gives the pixel shader
+	float2 uv = (pixel.xy + 0.5f) / float2(width, height);
+	OutputTexture[pixel.xy] = float4(ColourEffects(uv), 1.0f);
+}
@@ -0,0 +1,17 @@
+//--------------------------------------------------------------------------------------
+// Fused Colour Effects Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Fog, tint, underwater, retro and exposure in a single pass, see ColourEffects.hlsli for the permutations
+
+#include "ColourEffects.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	// Set alpha to 1 for final output
+	return float4(ColourEffects(input.uv), 1.0f);
+}
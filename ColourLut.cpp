@@ -0,0 +1,84 @@
+//--------------------------------------------------------------------------------------
+// Colour grading LUT
+//--------------------------------------------------------------------------------------
+// See ColourLut.h for an overview
+
+#include "ColourLut.h"
+#include "Shader.h"
+#include "StateCache.h"
+#include "ResourceRegistry.h"
+#include "Common.h"
+#include "GraphicsHelpers.h"
+
+
+ColourLut gColourLut;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+bool ColourLut::Update(const ColourLutSettings& settings)
+{
+	if (mHaveSettings && settings.bitColour == mSettings.bitColour)
+	{
+		if (mLutSRV == nullptr)  gLastError = mError;
+		return mLutSRV != nullptr;
+	}
+	mSettings = settings;
+	mHaveSettings = true;
+	mError = "";
+
+	// Created once, later settings only fill it again
+	if (mLut == nullptr)
+	{
+		D3D11_TEXTURE3D_DESC desc = {};
+		desc.Width  = COLOUR_LUT_SIZE;
+		desc.Height = COLOUR_LUT_SIZE;
+		desc.Depth  = COLOUR_LUT_SIZE;
+		desc.MipLevels = 1;
+		desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+		if (FAILED(gD3DDevice->CreateTexture3D(&desc, nullptr, &mLut)) ||
+		    FAILED(gD3DDevice->CreateShaderResourceView(mLut, nullptr, &mLutSRV)) ||
+		    FAILED(gD3DDevice->CreateUnorderedAccessView(mLut, nullptr, &mLutUAV)))
+		{
+			Release();
+			mHaveSettings = true;
+			mError = gLastError = "Error creating colour LUT";
+			return false;
+		}
+		gResourceRegistry.Track(mLut);
+	}
+
+	// The shader reads the settings from the post-processing constants
+	gPostProcessingConstants.bitColour = settings.bitColour;
+	gPostProcessingConstantBuffer.Update(gPostProcessingConstants);
+
+	// The LUT may still be bound for the colour effects from last frame, it can't also be written
+	ID3D11ShaderResourceView*  nullSRV = nullptr;
+	ID3D11UnorderedAccessView* nullUAV = nullptr;
+	gD3DContext->PSSetShaderResources(1, 1, &nullSRV);
+
+	gStateCache.CSSetShader(gColourLut_Compute, nullptr, 0);
+	gD3DContext->CSSetUnorderedAccessViews(0, 1, &mLutUAV, nullptr);
+	gD3DContext->Dispatch(COLOUR_LUT_SIZE / COLOUR_LUT_GROUP_SIZE, COLOUR_LUT_SIZE / COLOUR_LUT_GROUP_SIZE,
+	                      COLOUR_LUT_SIZE / COLOUR_LUT_GROUP_SIZE);
+	gD3DContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
+
+	++mNumBuilds;
+	return true;
+}
+
+
+void ColourLut::Release()
+{
+	if (mLutUAV)  mLutUAV->Release();
+	if (mLutSRV)  mLutSRV->Release();
+	if (mLut)     mLut->Release();
+	mLutUAV = nullptr;
+	mLutSRV = nullptr;
+	mLut    = nullptr;
+	mHaveSettings = false;
+}
@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------------------------
+// Colour grading LUT
+//--------------------------------------------------------------------------------------
+// The colour transforms that don't depend on the position in the image are baked into a COLOUR_LUT_SIZE cubed 3D
+// texture: indexed by the input colour, holding the output colour. However many transforms are baked in, applying them
+// is a single trilinear fetch in the fused colour effects shader (ColourEffects_pp.hlsl with COLOUR_EFFECT_LUT). The
+// LUT is built by one small compute dispatch (ColourLut_cs.hlsl) only when its settings change.
+//
+// At present it holds retro's colour depth reduction. The tint and underwater gradients vary down the screen, so they
+// stay as arithmetic in the shader. Trilinear filtering softens the edges of the colour bands over 1 / COLOUR_LUT_SIZE
+// of the range, too little to see at the band sizes retro uses
+
+#ifndef _COLOUR_LUT_H_INCLUDED_
+#define _COLOUR_LUT_H_INCLUDED_
+
+#include <d3d11.h>
+#include <string>
+
+
+// The transforms baked into the LUT
+struct ColourLutSettings
+{
+	float bitColour = 0;   // Retro colour step in 1/256ths, 0 for no colour depth reduction
+};
+
+
+class ColourLut
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Rebuild the LUT if the settings have changed since the last call. Call on the main thread while the
+	// post-processing constant buffer is bound (e.g. from EffectChain::Apply). Returns false on failure (reason in
+	// gLastError), which isn't retried until the settings change
+	bool Update(const ColourLutSettings& settings);
+
+	// Release the LUT, the next Update builds it again
+	void Release();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// The 3D texture, null until Update succeeds
+	ID3D11ShaderResourceView* Lut()  { return mLutSRV; }
+
+	int         NumBuilds()  { return mNumBuilds; }
+	std::string Error()      { return mError; } // Why the current settings couldn't be built, empty if they were
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	ColourLutSettings mSettings;
+	bool              mHaveSettings = false;
+	std::string       mError; // Reason the LUT for mSettings couldn't be built
+
+	ID3D11Texture3D*           mLut    = nullptr;
+	ID3D11ShaderResourceView*  mLutSRV = nullptr;
+	ID3D11UnorderedAccessView* mLutUAV = nullptr;
+
+	int mNumBuilds = 0;
+};
+
+
+extern ColourLut gColourLut;
+
+
+#endif //_COLOUR_LUT_H_INCLUDED_
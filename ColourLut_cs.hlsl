@@ -0,0 +1,34 @@
+//--------------------------------------------------------------------------------------
+// Colour Grading LUT Compute Shader
+//--------------------------------------------------------------------------------------
+// Fills the COLOUR_LUT_SIZE cubed colour grading LUT (see ColourLut.h), one thread per entry. Each entry holds the output
+// of the colour transforms for the colour at its position, with the first and last entries on each axis at 0 and 1
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+RWTexture3D<float4> ColourLut : register(u0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+[numthreads(COLOUR_LUT_GROUP_SIZE, COLOUR_LUT_GROUP_SIZE, COLOUR_LUT_GROUP_SIZE)]
+void main(uint3 dispatchID : SV_DispatchThreadID)
+{
+	float3 colour = dispatchID / float(COLOUR_LUT_SIZE - 1);
+
+	// Reduce the colour depth, as retro does (see ColourEffects_pp.hlsl)
+	if (bitColour > 0)
+	{
+		float x = bitColour;
+		colour = (round((colour * 256) / x) * x) / 256;
+	}
+
+	ColourLut[dispatchID] = float4(saturate(colour), 1.0f);
+}
@@ -2,6 +2,7 @@
 // Colour Tint Post-Processing Pixel Shader
 //--------------------------------------------------------------------------------------
 // Just samples a pixel from the scene texture and multiplies it by a fixed colour to tint the scene
+// HALF_PRECISION 1 adds in min16float (see Common.hlsli)
 
 #include "Common.hlsli"
 
@@ -15,6 +16,7 @@ Texture2D BloomTexture : register(t0);
 Texture2D SceneTexture : register(t1);
 SamplerState PointSample  : register(s0); // We don't usually want to filter (bilinear, trilinear etc.) the scene texture when
                                           // post-processing so this sampler will use "point sampling" - no filtering
+SamplerState BilinearSample : register(s1); // The bloom texture may be smaller than the scene, so filter it when scaling up
 
 
 //--------------------------------------------------------------------------------------
@@ -24,8 +26,8 @@ SamplerState PointSample  : register(s0); // We don't usually want to filter (bi
 // Post-processing shader that copies one texture to another
 float4 main(PostProcessingInput input) : SV_Target
 {
-	float3 colour = SceneTexture.Sample(PointSample, input.uv).rgb;
-	float3 bloomcolour = BloomTexture.Sample(PointSample, input.uv).rgb;
+	pfloat3 colour = pfloat3(SceneTexture.Sample(PointSample, input.uv).rgb);
+	pfloat3 bloomcolour = pfloat3(BloomTexture.Sample(BilinearSample, input.uv).rgb);
 	
 	colour = colour + bloomcolour;
 	return float4(colour, 1.0f);
@@ -9,6 +9,7 @@
 #include "CMatrix4x4.h"
 
 #include <d3d11.h>
+#include <d3d11_1.h>
 #include <string>
 
 
@@ -30,7 +31,8 @@ extern int gViewportHeight;
 
 // Important DirectX variables
 extern ID3D11Device*           gD3DDevice;
-extern ID3D11DeviceContext*    gD3DContext;
+extern thread_local ID3D11DeviceContext* gD3DContext; // The immediate context on the main thread, a deferred context while a recording job runs (see DeferredRenderer.h)
+extern thread_local ID3D11DeviceContext1* gD3DContext1; // The same context's D3D11.1 interface, null on a D3D11.0 runtime
 
 extern IDXGISwapChain*           gSwapChain;
 extern ID3D11RenderTargetView*   gBackBufferRenderTarget; // Back buffer is where we render to
@@ -64,30 +66,46 @@ struct PerFrameConstants
 	CMatrix4x4 viewMatrix;
     CMatrix4x4 projectionMatrix;
     CMatrix4x4 viewProjectionMatrix; // The above two matrices multiplied together to combine their effects
-
-    CVector3   light1Position; // 3 floats: x, y z
-    float      viewportWidth;  // Using viewport width and height as padding - see this structure in earlier labs to read about padding here
-    CVector3   light1Colour;
-    float      viewportHeight;
-
-    CVector3   light2Position;
-    float      padding1;
-    CVector3   light2Colour;
-    float      padding2;
+    CMatrix4x4 inverseViewProjectionMatrix; // Back from projection space to world space, for post-processing from depth
 
     CVector3   ambientColour;
     float      specularPower;
 
     CVector3   cameraPosition;
 	float      frameTime;      // This app does updates on the GPU so we pass over the frame update time
+
+    float      viewportWidth;
+    float      viewportHeight;
+    float      nearClip;       // Of the camera being rendered from, the light clusters are spaced between these
+    float      farClip;
+
+    unsigned int numLights;    // Lights in the light buffer (see LightClusters.h)
+    CVector3     padding1;
 };
 
 extern PerFrameConstants gPerFrameConstants;      // This variable holds the CPU-side constant buffer described above
 extern ID3D11Buffer*     gPerFrameConstantBuffer; // This variable controls the GPU-side constant buffer matching to the above structure
 
+// Constant buffer slots - the bN register of each cbuffer in Common.hlsli. The slot and size of every cbuffer a shader uses
+// are checked against these when it is loaded (see ShaderBindings.h)
+static const UINT PER_FRAME_CONSTANTS_SLOT        = 0;
+static const UINT PER_MODEL_CONSTANTS_SLOT        = 1;
+static const UINT POST_PROCESSING_CONSTANTS_SLOT  = 1; // Shares a slot with the per-model constants, they are never used together
+static const UINT BLUR_KERNEL_CONSTANTS_SLOT      = 2;
+static const UINT PROFILER_OVERLAY_CONSTANTS_SLOT = 3;
+static const UINT SKELETON_CONSTANTS_SLOT        = 4;
+static const UINT AUTO_EXPOSURE_CONSTANTS_SLOT   = 5;
+static const UINT PARTICLE_CONSTANTS_SLOT        = 6;
+static const UINT SORT_CONSTANTS_SLOT            = 7;
+static const UINT SHADOW_CONSTANTS_SLOT          = 8;
+static const UINT IMPOSTOR_CONSTANTS_SLOT        = 9;
+static const UINT GPU_CULL_CONSTANTS_SLOT        = 10;
+static const UINT GPU_DRAW_CONSTANTS_SLOT        = 11;
+
 
 
 static const int MAX_BONES = 64;
+static const int MAX_OBJECT_LIGHTS = 8; // Lights given to each model by per-object light assignment, a multiple of 4. Must match Common.hlsli
 
 // This is the matrix that positions the next thing to be rendered in the scene. Unlike the structure above this data can be
 // updated and sent to the GPU several times every frame (once per model). However, apart from that it works in the same way.
@@ -98,10 +116,117 @@ struct PerModelConstants
     CVector3   objectColour;  // Allows each light model to be tinted to match the light colour they cast
 	float      explodeAmount; // Used in the geometry shader to control how much the polygons are exploded outwards
 
+	// The lights chosen for this model by per-object light assignment, as indices into the light buffer. Only read by
+	// the lighting shader built with OBJECT_LIGHTS (see AssignObjectLights in Scene.cpp)
+	unsigned int numObjectLights;
+	unsigned int paddingM[3];
+	unsigned int objectLights[MAX_OBJECT_LIGHTS];
+};
+extern thread_local PerModelConstants gPerModelConstants;      // This variable holds the CPU-side constant buffer described above
+extern thread_local ID3D11Buffer*     gPerModelConstantBuffer; // This variable controls the GPU-side constant buffer related to the above structure
+                                                               // Both are per-thread so render worker threads can update their own
+
+// Bone matrices for skinned meshes, kept apart from the per-model constants so rigid models (most draws) only upload the
+// small structure above. Only skinned shaders read this buffer, so it is only bound for them (see ShaderBindings.h)
+struct SkeletonConstants
+{
 	CMatrix4x4 boneMatrices[MAX_BONES];
 };
-extern PerModelConstants gPerModelConstants;      // This variable holds the CPU-side constant buffer described above
-extern ID3D11Buffer*     gPerModelConstantBuffer; // This variable controls the GPU-side constant buffer related to the above structure
+extern thread_local SkeletonConstants gSkeletonConstants;      // Per-thread like the per-model constants
+extern thread_local ID3D11Buffer*     gSkeletonConstantBuffer; // --"--
+
+// The vertices written by pre-skinning (see Mesh::Skin), in world space. Matches BasicVertex in Common.hlsli
+struct BasicVertex
+{
+	CVector3 position;
+	CVector3 normal;
+	CVector2 uv;
+};
+
+
+// Instanced rendering draws many copies of a mesh at once. Instead of the per-model constants, each copy reads its world
+// matrix, colour and material slice (see MaterialArrays.h) from a structured buffer in vertex shader slot
+// INSTANCE_DATA_SLOT (see Instancing.hlsli)
+static const UINT INSTANCE_DATA_SLOT = 0;
+static const int  MAX_INSTANCES = 256; // Instances per draw call, more are split into several draws
+
+struct InstanceData
+{
+	CMatrix4x4   worldMatrix;
+	CVector3     objectColour;
+	unsigned int textureSlice; // Slice of the material array to sample, 0 for a texture bound on its own
+};
+extern thread_local ID3D11Buffer*             gInstanceBuffer;    // Holds MAX_INSTANCES InstanceData, per-thread like the
+extern thread_local ID3D11ShaderResourceView* gInstanceBufferSRV; // per-model constant buffer
+
+// Light flares - every light in view is drawn as a camera-facing quad with one instanced draw, reading its flare from a
+// structured buffer at vertex shader slot t0, sized from its strength in the shader. Must match LightFlare_vs.hlsl
+static const UINT LIGHT_FLARE_SLOT = 0;
+
+struct LightFlareData
+{
+	CVector3 position;
+	float    strength;
+	CVector3 colour;
+	float    padding;
+};
+
+
+// Clustered lighting - all the point lights are held in a structured buffer and the view frustum is split into a grid of
+// clusters, LIGHT_CLUSTERS_X x LIGHT_CLUSTERS_Y tiles across the screen and LIGHT_CLUSTERS_Z slices in depth. A compute
+// shader lists the lights reaching each cluster every frame and the lighting pixel shader only loops over the lights
+// in its own cluster (see LightClusters.h). These values must match Lighting.hlsli
+static const UINT LIGHT_DATA_SLOT        = 1; // Pixel shader slots t1 (lights), t2 (light count per cluster), t3 (light lists)
+static const int  MAX_LIGHTS             = 1024;
+static const int  LIGHT_CLUSTERS_X       = 16;
+static const int  LIGHT_CLUSTERS_Y       = 9;
+static const int  LIGHT_CLUSTERS_Z       = 24;
+static const int  MAX_LIGHTS_PER_CLUSTER = 64; // Further lights reaching a cluster are dropped
+
+// Deferred shading reads the G-buffer and depth buffer from pixel shader slots t4 (material), t5 (normal), t6 (depth),
+// after the light buffers (see GBuffer.hlsli)
+static const UINT GBUFFER_SLOT = 4;
+
+struct LightData
+{
+	CVector3 position;
+	float    range;   // Lights have no effect beyond this distance
+	CVector3 colour;  // Colour multiplied by strength
+	float    padding;
+};
+
+// Shadows - the first MAX_SHADOW_LIGHTS lights in the light buffer cast shadows from depth cubemaps, one cube of a cubemap
+// array each, read at pixel shader slot t7 with the comparison sampler s1 (see ShadowMaps.h). Must match Common.hlsli
+static const int  MAX_SHADOW_LIGHTS   = 2;
+static const UINT SHADOW_MAP_SLOT     = 7;
+static const UINT SHADOW_SAMPLER_SLOT = 1;
+
+struct ShadowLight
+{
+	CVector3 position; // The shadows are cast from here, which can lag behind the light itself
+	float    range;    // Far clip of the cubemap faces
+};
+
+struct ShadowConstants
+{
+	ShadowLight  shadowLights[MAX_SHADOW_LIGHTS];
+
+	float        shadowNearClip;     // Of the cubemap faces
+	float        shadowNormalOffset; // Surfaces are tested this far out along their normal, for each unit of distance from the light
+	unsigned int numShadowLights;    // Lights with shadow maps, the others are unshadowed
+	float        paddingS;
+};
+
+// Impostors - distant models drawn as camera-facing quads textured from views of their mesh captured into an atlas, a
+// Texture2DArray read at pixel shader slot t0 holding the material in slice 0 and the normal and coverage in slice 1
+// (see Impostors.h). Each mesh's impostor has its own constants. Must match Impostors.hlsli
+struct ImpostorConstants
+{
+	CVector3     impostorCentre; // Of the mesh's bounding sphere in its default pose, in model space
+	float        impostorRadius;
+	unsigned int impostorGrid;   // Views across and down the atlas
+	float        paddingI[3];
+};
 
 
 
@@ -131,7 +256,15 @@ struct PostProcessingConstants
 	float blurRadius;
 	float blurBellcurveStrength;
 	float brightFilterThreshold;
-	float paddingc;
+	float autoExposure; // 1 to take the bright filter threshold from the exposure buffer (see AutoExposure.h)
+
+	// Bloom mip-chain settings, changed by each bloom pass before it is drawn
+	CVector2 bloomBlurDirection; // (1,0) or (0,1)
+	float    bloomBlurRadius;    // In pixels of the mip being blurred
+	float    bloomLevelWeight;   // Weight of this mip when accumulating back up the chain
+	float    bloomCoarserWeight; // Weight of the smaller mip being added on (1 once it already holds weighted mips)
+	CVector2 fftBloomUVScale;    // Part of the FFT bloom texture holding the image (the rest is padding, see EffectChain.cpp)
+	float    fftBloomIntensity;
 
 
 	// Distort post-process settings
@@ -141,9 +274,283 @@ struct PostProcessingConstants
 	// Spiral post-process settings
 	float    spiralLevel;
 	CVector3 paddingE;
+
+	// Dynamic resolution - the scene is rendered into the top-left part of the scene texture, the upscale pass reads it with
+	// passUVScale set to the rendered size / scene texture size
+	CVector2 sceneUVMax;   // Largest uv to sample, half a pixel inside the rendered part
+	float    upscaleSharpness; // 0 to 1, strength of the sharpening after the edge-adaptive upscale
+	float    paddingS;
+
+	// Star filter, changed by each streak pass before it is drawn
+	CVector2 starStreakStep;        // Distance between taps in pixels of the texture read, along the streak direction
+	float    starStreakAttenuation; // Weight of each tap relative to the previous one
+	float    starStreakGain;        // Brightness of the result, applied in the last pass of each streak
+
+	// Mip chain pyramid blur, mip level read at the centre and corners of the screen
+	float    pyramidBlurLevel;
+	float    pyramidBlurEdgeLevel;
+	CVector2 paddingG;
+
+	// Depth-aware effects, reading the depth buffer at POST_PROCESS_DEPTH_SLOT
+	CVector2 depthUVScale;      // Part of the depth buffer covering the image
+	float    depthNearClip;     // Of the camera that wrote the depth buffer, to turn its values back into distances
+	float    depthFarClip;
+
+	// Depth of field
+	float    focusDistance;     // Sharpest distance from the camera, 0 to focus on whatever is at the centre of the screen
+	float    focusRange;        // Distance either side of it that stays sharp
+	float    focusBlurDistance; // Distance beyond the sharp range over which the blur grows to full
+	float    dofBlurRadius;     // Full blur radius in pixels of the half size image
+
+	// Fog
+	CVector3 fogColour;
+	float    fogDensity;        // Fraction of the light lost per unit of distance is 1 - exp(-fogDensity)
+	float    fogStart;          // Distance from the camera before any fog
+	float    fogMaxOpacity;     // Most the fog covers, so the sky still shows through
+	float    dofNearField;      // 1 when blurring the near field of the depth of field, 0 for the far field
+	float    paddingF;
+
+	// Temporal blur and bloom, changed by each resolve pass before it is drawn (see TemporalHistory.h)
+	CMatrix4x4 temporalReprojection;  // From clip space this frame to the previous frame's, identity without a depth buffer
+	float      temporalHistoryWeight; // Fraction of the result taken from the previous frame, 0 when there is none
+	CVector3   paddingH;
+
+	// Set by the post-process graph before each pass (see PostProcessGraph::Execute), so shaders needn't call GetDimensions
+	CVector2 texelSize;    // Size of a pixel of the pass's first input in uv units, 1 / inputSize
+	CVector2 inputSize;    // Of the pass's first input, in pixels
+	CVector2 passUVScale;  // Applied to the full screen uvs (see FullScreenQuad_pp.hlsl), (1,1) and (0,0) unless a pass's
+	CVector2 passUVOffset; // setup reads only part of its inputs
 };
+
+// The depth buffer is read by the depth-aware post-processes at pixel shader slot t9, after the exposure buffer
+static const UINT POST_PROCESS_DEPTH_SLOT = 9;
 extern PostProcessingConstants gPostProcessingConstants;      // This variable holds the CPU-side constant buffer described above
-extern ID3D11Buffer*           gPostProcessingConstantBuffer; // This variable controls the GPU-side constant buffer related to the above structure
+template <class T> class VersionedConstantBuffer; // See GraphicsHelpers.h
+extern VersionedConstantBuffer<PostProcessingConstants> gPostProcessingConstantBuffer; // GPU-side constant buffer, only uploaded when the above structure changes
+
+
+// Gaussian blur kernel, rebuilt on the CPU only when the blur settings change - must match the similar structure in Common.hlsli
+static const int MAX_BLUR_RADIUS = 128;                     // Largest blur half-width in pixels
+static const int MAX_BLUR_TAPS   = MAX_BLUR_RADIUS / 2 + 1; // Bilinear taps for one side of the kernel, plus the centre tap
+
+struct BlurKernelTap
+{
+	float    offset; // Distance from the centre in pixels, a merged tap lies between two pixels
+	float    weight; // Weights across the whole kernel add up to 1
+	CVector2 paddingT;
+};
+
+struct BlurKernelConstants
+{
+	int      tapCount; // Entries used in taps
+	int      radius;   // Blur half-width in pixels, entries used in weights is one more than this
+	CVector2 paddingK;
+
+	BlurKernelTap taps[MAX_BLUR_TAPS];          // Pairs of pixels merged into single bilinear taps (pixel shaders). taps[0] is the centre
+	BlurKernelTap weights[MAX_BLUR_RADIUS + 1]; // Weight of each pixel by distance from the centre (compute shaders), offset unused
+};
+extern BlurKernelConstants gBlurKernelConstants;
+
+
+// FFT bloom is convolved at this size (a power of 2), one FFT_BLOOM_SIZE / 2 thread group per row or column in Fft_cs.
+// Must match the defines in Common.hlsli
+static const int FFT_BLOOM_SIZE      = 256;
+static const int FFT_BLOOM_LOG2_SIZE = 8;
+
+// The colour grading LUT is this size in each direction, built in groups of COLOUR_LUT_GROUP_SIZE cubed threads (see
+// ColourLut.h). Must match the defines in Common.hlsli
+static const int COLOUR_LUT_SIZE       = 64;
+static const int COLOUR_LUT_GROUP_SIZE = 4;
+extern ID3D11Buffer*       gBlurKernelConstantBuffer;
+
+
+// Auto exposure - a compute shader builds a histogram of the log luminance of the scene and another reduces it to an
+// exposure, adapted over time, in a one element buffer read by the post-processes at pixel shader slot t8 (after the
+// pass inputs, see PostProcessGraph.h). Must match the similar structures in Common.hlsli
+static const int  NUM_LUMINANCE_BINS = 256; // Bin 0 holds the black pixels, the rest cover the log luminance range
+static const UINT EXPOSURE_SLOT      = 8;
+
+struct AutoExposureConstants
+{
+	float    minLogLuminance;   // log2 of the darkest luminance in the histogram
+	float    logLuminanceRange; // log2 range covered by the histogram
+	float    adaptation;        // Fraction of the way to move from the previous exposure to the measured one
+	float    exposureKey;       // Luminance the average is exposed to (middle grey)
+
+	float    lowPercentile;     // The darkest and brightest pixels are left out of the average
+	float    highPercentile;
+	float    bloomThreshold;    // Bright filter threshold for an image whose average is exposureKey
+	float    minExposure;
+
+	float    maxExposure;
+	CVector2 measureUVScale;    // Part of the image measured, as a fraction of its size
+	float    paddingX;
+};
+
+struct ExposureData
+{
+	float adaptedLuminance; // Average luminance adapted over time, 0 before the first measurement
+	float exposure;         // Multiplier taking adaptedLuminance to the exposure key
+	float bloomThreshold;   // Bright filter threshold scaled with the adapted luminance
+	float paddingX;
+};
+
+
+// GPU particles - the particles live in a structured buffer, simulated and respawned by a compute shader and drawn as
+// camera-facing quads reading the buffer in the vertex shader (see ParticleSystem.h). Each emitter owns a fixed range of
+// the particles. Must match the similar structures in Particles.hlsli
+static const int  MAX_PARTICLE_EMITTERS = 8;
+static const int  PARTICLE_GROUP_SIZE   = 256; // Threads per group in Particles_cs
+static const UINT PARTICLE_DATA_SLOT    = 0;   // Compute shader u0 (t0 for the sort keys), vertex shader t0
+static const UINT PARTICLE_TEXTURE_SLOT = 0;   // Pixel shader t0, a texture array
+static const UINT PARTICLE_ORDER_SLOT   = 1;   // Vertex shader t1, the particle indices in drawing order (see GpuSort.h)
+static const UINT PARTICLE_DEPTH_SLOT   = 1;   // Pixel shader t1, the depth buffer for soft particles
+
+struct ParticleEmitterData
+{
+	CVector3     position;       // Particles spawn in a sphere of spawnRadius around here
+	float        spawnRadius;
+	CVector3     velocity;       // Initial velocity, plus up to velocitySpread in a random direction
+	float        velocitySpread;
+	CVector3     acceleration;   // Buoyancy, gravity or wind
+	float        drag;           // Fraction of the velocity lost per second is 1 - exp(-drag)
+	CVector3     colour;         // Tint of the texture, can be brighter than 1 for fire
+	float        lifetime;       // Average lifetime in seconds, each particle is within 25% of it
+	float        startSize;      // Size of the quad at the start and end of a particle's life
+	float        endSize;
+	float        spin;           // Maximum rotation speed in radians per second, either way
+	float        additive;       // 0 for alpha blended (smoke), 1 for added to the scene (fire), or in between
+	unsigned int firstLayer;     // Texture array layers the particles pick between at random
+	unsigned int numLayers;
+	unsigned int firstParticle;  // The range of particles owned by the emitter
+	unsigned int endParticle;
+};
+
+struct ParticleConstants
+{
+	ParticleEmitterData emitters[MAX_PARTICLE_EMITTERS];
+	unsigned int        numEmitters;
+	unsigned int        numParticles;
+	float               particleFrameTime; // Time step of the simulation
+	unsigned int        randomSeed;        // Changes every frame
+};
+
+struct ParticleData
+{
+	CVector3     position;
+	float        age;       // Seconds since spawning. Negative before the first spawn, so emitters don't start in a burst
+	CVector3     velocity;
+	float        lifetime;  // 0 if the particle has never spawned
+	float        rotation;
+	float        spinSpeed;
+	unsigned int layer;     // Texture array layer
+	unsigned int emitter;
+};
+
+
+// GPU sorting - a bitonic sort of key / value pairs in a structured buffer (see GpuSort.h). Blocks of SORT_BLOCK_SIZE
+// elements are sorted in groupshared memory, SORT_GROUP_SIZE threads each comparing a pair. Must match GpuSort.hlsli
+static const int  SORT_BLOCK_SIZE = 1024;
+static const int  SORT_GROUP_SIZE = SORT_BLOCK_SIZE / 2;
+static const UINT SORT_DATA_SLOT  = 0; // Compute shader u0
+
+struct SortConstants
+{
+	unsigned int sortSize;  // Elements in the sort buffer, a power of 2
+	unsigned int stage;     // Size of the sequences being merged, 0 to sort each block from scratch
+	unsigned int step;      // Distance between the elements compared
+	unsigned int padding;
+};
+
+
+// GPU-driven culling - the bounds of the instances drawn through the GPU path are tested by a compute shader against the
+// frustum and a hierarchical-Z pyramid of last frame's depth, which writes the visible instances and the arguments of
+// indirect draws (see GpuCuller.h). Must match GpuCulling.hlsli
+static const int  GPU_CULL_GROUP_SIZE   = 64; // Threads per group in GpuCull_cs and GpuCullArgs_cs
+static const int  HI_Z_GROUP_SIZE       = 8;  // Threads across and down each group in HiZ_cs
+static const int  MAX_GPU_CULL_LODS     = 4;  // Levels of detail chosen between on the GPU, coarser ones aren't used
+static const UINT GPU_CULL_VISIBLE_SLOT = 1;  // Vertex shader t1, the visible instances
+
+struct GpuCullPlane
+{
+	CVector3 normal;   // As Plane in Bounds.h, facing into the frustum
+	float    distance;
+};
+
+struct GpuCullConstants
+{
+	CMatrix4x4   hiZViewProjection;  // Camera the pyramid was built from, last frame's
+	GpuCullPlane cullPlanes[6];      // This frame's frustum
+	CVector3     cullViewPoint;
+	float        cullPixelsPerUnit;  // As for Model::SelectLod
+	CVector2     hiZUVScale;         // Viewport over texture size when the pyramid was built
+	CVector2     hiZSize;            // Texels across and down its top level
+	unsigned int numCullInstances;
+	unsigned int numDrawRecords;
+	unsigned int hiZLevels;          // 0 if there is no pyramid to test against
+	float        maxLodPixelError;
+	unsigned int hiZSourceSize[2];   // Level read by HiZ_cs, the depth buffer for the top level
+	unsigned int hiZTargetSize[2];   // Level written
+};
+
+// The arguments of one DrawIndexedInstancedIndirect call, as the GPU reads them
+struct DrawIndexedArguments
+{
+	unsigned int indexCount;
+	unsigned int instanceCount;
+	unsigned int startIndex;
+	int          baseVertex;
+	unsigned int startInstance;
+};
+
+// Drawing constants of each indirect draw, which instances of the visible list it draws and which node of their mesh
+struct GpuDrawConstants
+{
+	unsigned int firstVisible;
+	unsigned int drawNode;
+	unsigned int paddingD[2];
+};
+
+// One instance to cull, a model with its world bounding sphere
+struct GpuCullInstance
+{
+	CVector3     centre;
+	float        radius;
+	float        maxScale;   // Largest scale of the model, for the level of detail
+	unsigned int group;      // Models sharing a mesh and texture, see GpuCullGroup
+	unsigned int firstData;  // Index in the instance buffer of its first node's InstanceData
+	unsigned int paddingC;
+};
+
+struct GpuCullGroup
+{
+	unsigned int firstVisible; // Start of the group's part of the visible list, numModels entries for each level of detail
+	unsigned int numModels;
+	unsigned int numLods;
+	unsigned int firstCount;   // Its visible count for each level of detail
+	float        lodErrors[MAX_GPU_CULL_LODS]; // See Mesh::GetLodError
+};
+
+
+// GPU profiler overlay, one bar per timer - must match the similar structure in Common.hlsli
+static const int MAX_PROFILER_BARS = 32;
+
+struct ProfilerBar
+{
+	float    length; // Fraction of the overlay width
+	float    depth;  // Nesting level of the timer, nested bars are indented
+	CVector2 paddingB;
+};
+
+struct ProfilerOverlayConstants
+{
+	int      numBars;
+	CVector3 paddingP;
+
+	ProfilerBar bars[MAX_PROFILER_BARS];
+};
+extern ProfilerOverlayConstants gProfilerOverlayConstants;
+extern ID3D11Buffer*            gProfilerOverlayConstantBuffer;
 
 //**************************
 
@@ -3,6 +3,9 @@
 //--------------------------------------------------------------------------------------
 // Using include files to define the type of data passed between the shaders
 
+#ifndef _COMMON_HLSLI_INCLUDED_
+#define _COMMON_HLSLI_INCLUDED_
+
 
 //--------------------------------------------------------------------------------------
 // Shader input / output
@@ -16,6 +19,12 @@ struct BasicVertex
     float2 uv       : uv;
 };
 
+// Depth-only passes read the positions alone, from the meshes' position streams (see Mesh::SetSubMeshBuffers)
+struct PositionVertex
+{
+    float3 position : position;
+};
+
 
 
 // This structure describes what data the lighting pixel shader receives from the vertex shader.
@@ -44,6 +53,32 @@ struct SimplePixelShaderInput
     float2 uv : uv;
 };
 
+// The sky triangle passes on the world space direction from the camera through each corner (see Sky_vs.hlsl)
+struct SkyPixelShaderInput
+{
+    float4 projectedPosition : SV_Position;
+    float3 direction : direction;
+};
+
+// The same for instanced light models, with each instance's colour passed on from the vertex shader (see Instancing.hlsli)
+struct InstancedPixelShaderInput
+{
+    float4 projectedPosition : SV_Position;
+    float2 uv : uv;
+    nointerpolation float3 colour : colour; // The same for the whole instance so no need to interpolate
+};
+
+// The same as LightingPixelShaderInput for instanced lit models, with the slice of the material texture array each
+// instance is textured from (see MaterialArrays.h)
+struct InstancedLightingPixelShaderInput
+{
+    float4 projectedPosition : SV_Position;
+    float3 worldPosition : worldPosition;
+    float3 worldNormal   : worldNormal;
+    float2 uv : uv;
+    nointerpolation uint textureSlice : textureSlice;
+};
+
 
 
 //**************************
@@ -56,6 +91,20 @@ struct PostProcessingInput
 	float2 uv                : uv;
 };
 
+// Type of the colour maths in the bandwidth-bound post-processes. Their HALF_PRECISION 1 permutations (selected by
+// HalfPrecisionShader in Shader.cpp on GPUs with 16-bit arithmetic) use min16float, which takes half the registers and
+// can run at twice the rate. Positions and uvs stay 32-bit, 16 bits can't address every pixel of a large target
+#ifndef HALF_PRECISION
+#define HALF_PRECISION 0
+#endif
+#if HALF_PRECISION
+typedef min16float  pfloat;
+typedef min16float3 pfloat3;
+#else
+typedef float  pfloat;
+typedef float3 pfloat3;
+#endif
+
 //**************************
 
 
@@ -76,28 +125,28 @@ cbuffer PerFrameConstants : register(b0) // The b0 gives this constant buffer th
 	float4x4 gViewMatrix;
     float4x4 gProjectionMatrix;
     float4x4 gViewProjectionMatrix; // The above two matrices multiplied together to combine their effects
-
-    float3   gLight1Position; // 3 floats: x, y z
-    float    gViewportWidth;  // Using viewport width and height as padding - see this structure in earlier labs to read about padding here
-    float3   gLight1Colour;
-    float    gViewportHeight;
-
-    float3   gLight2Position;
-    float    padding1;
-    float3   gLight2Colour;
-    float    padding2;
+    float4x4 gInverseViewProjectionMatrix; // Back from projection space to world space, for post-processing from depth
 
     float3   gAmbientColour;
     float    gSpecularPower;
 
     float3   gCameraPosition;
 	float    gFrameTime;      // This app does updates on the GPU so we pass over the frame update time
+
+    float    gViewportWidth;
+    float    gViewportHeight;
+    float    gNearClip;       // Of the camera being rendered from, the light clusters are spaced between these
+    float    gFarClip;
+
+    uint     gNumLights;      // Lights in the light buffer (see Lighting.hlsli)
+    float3   padding1;
 }
 // Note constant buffers are not structs: we don't use the name of the constant buffer, these are really just a collection of global variables (hence the 'g')
 
 
 
 static const int MAX_BONES = 64;
+static const int MAX_OBJECT_LIGHTS = 8; // Must match Common.h
 
 // If we have multiple models then we need to update the world matrix from C++ to GPU multiple times per frame because we
 // only have one world matrix here. Because this data is updated more frequently it is kept in a different buffer for better performance.
@@ -110,6 +159,31 @@ cbuffer PerModelConstants : register(b1) // The b1 gives this constant buffer th
     float3   gObjectColour;  // Useed for tinting light models
 	float    gExplodeAmount; // Used in the geometry shader to control how much the polygons are exploded outwards
 
+    // The lights chosen for this model on the CPU, as indices into the light buffer, packed four to a register. Only
+    // read with OBJECT_LIGHTS (see AddObjectLights in Lighting.hlsli)
+    uint     gNumObjectLights;
+    uint3    paddingM;
+    uint4    gObjectLights[MAX_OBJECT_LIGHTS / 4];
+}
+
+// Shadows from the first few lights in the light buffer, see ShadowMaps.h and LightShadow in Lighting.hlsli
+// These variables must match exactly the ShadowConstants structure in Common.h
+static const int MAX_SHADOW_LIGHTS = 2; // Must match Common.h
+
+cbuffer ShadowConstants : register(b8)
+{
+    float4 gShadowLights[MAX_SHADOW_LIGHTS]; // xyz position the shadows are cast from, w far clip of the cubemap faces
+
+    float  gShadowNearClip;
+    float  gShadowNormalOffset;
+    uint   gNumShadowLights;
+    float  paddingS;
+}
+
+// Bone matrices for skinned meshes, in their own buffer so rigid models don't upload them for every draw
+// These variables must match exactly the gSkeletonConstants structure in Scene.cpp
+cbuffer SkeletonConstants : register(b4)
+{
 	float4x4 gBoneMatrices[MAX_BONES];
 }
 
@@ -141,7 +215,15 @@ cbuffer PostProcessingConstants : register(b1)
 	float blurRadius;
 	float blurBellcurveStrength;
 	float brightFilterThreshold;
-	float paddingc;
+	float gAutoExposure; // 1 to take the bright filter threshold from ExposureBuffer (see AutoExposureConstants below)
+
+	// Bloom mip-chain settings
+	float2 bloomBlurDirection;
+	float  bloomBlurRadius;
+	float  bloomLevelWeight;
+	float  bloomCoarserWeight;
+	float2 gFftBloomUVScale;
+	float  gFftBloomIntensity;
 
 	// Distort post-process settings
 	float  gDistortLevel;
@@ -151,7 +233,136 @@ cbuffer PostProcessingConstants : register(b1)
 	float  gSpiralLevel;
 	float3 paddingE;
 
+	// Dynamic resolution - the part of the scene texture holding the rendered scene
+	float2 gSceneUVMax;
+	float  gUpscaleSharpness;
+	float  paddingS;
+
+	// Star filter streak passes
+	float2 gStarStreakStep;
+	float  gStarStreakAttenuation;
+	float  gStarStreakGain;
+
+	// Mip chain pyramid blur
+	float  gPyramidBlurLevel;
+	float  gPyramidBlurEdgeLevel;
+	float2 paddingG;
+
+	// Depth-aware effects, the depth buffer is in DepthTexture (t9)
+	float2 gDepthUVScale;
+	float  gDepthNearClip;
+	float  gDepthFarClip;
+
+	// Depth of field
+	float  gFocusDistance;
+	float  gFocusRange;
+	float  gFocusBlurDistance;
+	float  gDofBlurRadius;
+
+	// Fog
+	float3 gFogColour;
+	float  gFogDensity;
+	float  gFogStart;
+	float  gFogMaxOpacity;
+	float  gDofNearField;
+	float  paddingF;
+
+	// Temporal blur and bloom resolve passes
+	float4x4 gTemporalReprojection;
+	float    gTemporalHistoryWeight;
+	float3   paddingH;
+
+	// Set for each pass by the post-process graph
+	float2 gTexelSize;    // 1 / gInputSize
+	float2 gInputSize;    // Of the texture at t0, in pixels
+	float2 gPassUVScale;  // Used by FullScreenQuad_pp with PASS_UV_TRANSFORM
+	float2 gPassUVOffset;
+
+}
+
+
+// View depth (distance along the camera's facing) from a depth buffer value, for the camera's near and far clip
+float ViewDepth(float depth, float nearClip, float farClip)
+{
+	return nearClip * farClip / (farClip - depth * (farClip - nearClip));
+}
+
+
+// FFT bloom size, see Common.h
+#define FFT_BLOOM_SIZE      256
+#define FFT_BLOOM_LOG2_SIZE 8
+
+// Colour grading LUT size, see Common.h
+#define COLOUR_LUT_SIZE       64
+#define COLOUR_LUT_GROUP_SIZE 4
+
+
+// Gaussian blur kernel, built on the CPU when the blur settings change
+// These variables must match exactly the gBlurKernelConstants structure in Scene.cpp
+#define MAX_BLUR_RADIUS 128
+#define MAX_BLUR_TAPS   (MAX_BLUR_RADIUS / 2 + 1)
+
+cbuffer BlurKernelConstants : register(b2)
+{
+	int    gBlurTapCount; // Taps used in gBlurTaps
+	int    gBlurRadius;   // Blur half-width in pixels
+	float2 paddingK;
+
+	float4 gBlurTaps[MAX_BLUR_TAPS];          // x = offset in pixels, y = weight. Merged bilinear taps for one side of the kernel, [0] is the centre
+	float4 gBlurWeights[MAX_BLUR_RADIUS + 1]; // y = weight of the pixel at this distance from the centre
 }
 
 //**************************
 
+
+
+// Auto exposure, see AutoExposure.h
+// These variables must match exactly the AutoExposureConstants and ExposureData structures in Common.h
+#define NUM_LUMINANCE_BINS 256
+
+cbuffer AutoExposureConstants : register(b5)
+{
+	float  gMinLogLuminance;
+	float  gLogLuminanceRange;
+	float  gExposureAdaptation;
+	float  gExposureKey;
+
+	float  gExposureLowPercentile;
+	float  gExposureHighPercentile;
+	float  gExposureBloomThreshold;
+	float  gMinExposure;
+
+	float  gMaxExposure;
+	float2 gMeasureUVScale;
+	float  paddingX;
+}
+
+struct ExposureData
+{
+	float adaptedLuminance;
+	float exposure;
+	float bloomThreshold;
+	float paddingX;
+};
+
+// Luminance as used for exposure
+float Luminance(float3 colour)
+{
+	return dot(colour, float3(0.2126f, 0.7152f, 0.0722f));
+}
+
+
+// GPU profiler overlay
+// These variables must match exactly the gProfilerOverlayConstants structure in Scene.cpp
+#define MAX_PROFILER_BARS 32
+
+cbuffer ProfilerOverlayConstants : register(b3)
+{
+	int    gNumProfilerBars;
+	float3 paddingP;
+
+	float4 gProfilerBars[MAX_PROFILER_BARS]; // x = length as a fraction of the overlay width, y = nesting depth
+}
+
+
+#endif //_COMMON_HLSLI_INCLUDED_
@@ -0,0 +1,202 @@
+//--------------------------------------------------------------------------------------
+// Compute shader group size tuning
+//--------------------------------------------------------------------------------------
+// See ComputeTuner.h for an overview
+
+#include "ComputeTuner.h"
+#include "EffectChain.h"
+#include "RenderTargetPool.h"
+#include "Direct3DSetup.h"
+#include "Common.h"
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+
+ComputeTuner gComputeTuner;
+
+// Group sizes tried by the benchmark, from the usual square tiles to wide rows. All are multiples of 32 and 64
+// threads, so no GPU leaves part of a wave idle
+struct GroupSize
+{
+	unsigned int width;
+	unsigned int height;
+};
+const GroupSize CALIBRATION_GROUP_SIZES[] = { { 8, 8 }, { 16, 4 }, { 16, 8 }, { 16, 16 }, { 32, 4 }, { 32, 8 }, { 64, 2 } };
+
+// Passes timed for each size, after one untimed pass to compile the shader and fill the render target pool
+const int CALIBRATION_REPEATS = 8;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+bool ComputeTuner::Calibrate(int width, int height, const std::string& cacheFile /*= "ComputeCalibration.txt"*/)
+{
+	mGroupWidth = mGroupHeight = 8;
+	mCalibrated = mMeasured = false;
+
+	std::string device = DeviceDescription();
+	if (LoadCache(cacheFile, device))
+	{
+		mCalibrated = true;
+		return true;
+	}
+
+	// A mid-grey image the size of the viewport, the content doesn't change the cost
+	PooledTarget* input  = gRenderTargetPool.Acquire(width, height, DXGI_FORMAT_R8G8B8A8_UNORM);
+	PooledTarget* output = gRenderTargetPool.Acquire(width, height, DXGI_FORMAT_R8G8B8A8_UNORM);
+	if (input == nullptr || output == nullptr)
+	{
+		if (input)   gRenderTargetPool.Return(input);
+		if (output)  gRenderTargetPool.Return(output);
+		return false; // Reason in gLastError
+	}
+	const float grey[4] = { 0.5f, 0.5f, 0.5f, 1.0f };
+	gD3DContext->ClearRenderTargetView(input->renderTarget, grey);
+
+	bool ok = true;
+	float bestTime = -1;
+	GroupSize best = { 8, 8 };
+	for (auto& size : CALIBRATION_GROUP_SIZES)
+	{
+		float time = MeasureGroupSize(size.width, size.height, input, output);
+		if (time < 0)
+		{
+			ok = false;
+			break;
+		}
+		if (bestTime < 0 || time < bestTime)
+		{
+			bestTime = time;
+			best = size;
+		}
+	}
+
+	gRenderTargetPool.Return(input);
+	gRenderTargetPool.Return(output);
+
+	if (!ok)  return false;
+	mGroupWidth  = best.width;
+	mGroupHeight = best.height;
+	mCalibrated = mMeasured = true;
+	SaveCache(cacheFile, device);
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+// All the fused colour effects through an effect chain, so the shader is measured exactly as it is used
+float ComputeTuner::MeasureGroupSize(unsigned int groupWidth, unsigned int groupHeight, PooledTarget* input, PooledTarget* output)
+{
+	EffectChain chain;
+	chain.Add(Effect::Tint);
+	chain.Add(Effect::Underwater);
+	chain.Add(Effect::Retro);
+	chain.Settings().computeShaders     = true;
+	chain.Settings().computeGroupWidth  = groupWidth;
+	chain.Settings().computeGroupHeight = groupHeight;
+
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+	ID3D11Query* disjoint = nullptr;
+	gD3DDevice->CreateQuery(&queryDesc, &disjoint);
+	queryDesc.Query = D3D11_QUERY_TIMESTAMP;
+	ID3D11Query* begin = nullptr;
+	ID3D11Query* end   = nullptr;
+	gD3DDevice->CreateQuery(&queryDesc, &begin);
+	gD3DDevice->CreateQuery(&queryDesc, &end);
+
+	float time = -1;
+	if (disjoint != nullptr && begin != nullptr && end != nullptr)
+	{
+		bool ok = chain.Apply(input->shaderResource, output->renderTarget); // Warm up
+		if (ok)
+		{
+			gD3DContext->Begin(disjoint);
+			gD3DContext->End(begin);
+			for (int i = 0; i < CALIBRATION_REPEATS && ok; ++i)
+			{
+				ok = chain.Apply(input->shaderResource, output->renderTarget);
+			}
+			gD3DContext->End(end);
+			gD3DContext->End(disjoint);
+			gD3DContext->Flush();
+		}
+
+		UINT64 beginTime, endTime;
+		D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointData;
+		HRESULT beginResult, endResult, disjointResult;
+		if (ok)
+		{
+			while ((beginResult    = gD3DContext->GetData(begin,    &beginTime,    sizeof(beginTime),    0)) == S_FALSE) {}
+			while ((endResult      = gD3DContext->GetData(end,      &endTime,      sizeof(endTime),      0)) == S_FALSE) {}
+			while ((disjointResult = gD3DContext->GetData(disjoint, &disjointData, sizeof(disjointData), 0)) == S_FALSE) {}
+			ok = (beginResult == S_OK && endResult == S_OK && disjointResult == S_OK && !disjointData.Disjoint);
+			if (ok)
+			{
+				time = static_cast<float>(endTime - beginTime) / disjointData.Frequency * 1000.0f / CALIBRATION_REPEATS;
+			}
+			else
+			{
+				gLastError = "Error reading the GPU clock while measuring compute group sizes";
+			}
+		}
+	}
+	else
+	{
+		gLastError = "Error creating queries to measure compute group sizes";
+	}
+
+	if (end)       end     ->Release();
+	if (begin)     begin   ->Release();
+	if (disjoint)  disjoint->Release();
+	return time;
+}
+
+
+// Cache lines are the device description, a tab, then the group size as widthxheight
+bool ComputeTuner::LoadCache(const std::string& cacheFile, const std::string& device)
+{
+	std::ifstream file(cacheFile);
+	std::string line;
+	while (std::getline(file, line))
+	{
+		size_t tab = line.find('\t');
+		if (tab == std::string::npos || line.compare(0, tab, device) != 0 || tab != device.size())  continue;
+
+		unsigned int width = 0, height = 0;
+		if (std::sscanf(line.c_str() + tab + 1, "%ux%u", &width, &height) != 2 || width == 0 || height == 0 || width * height > 1024)
+		{
+			return false;
+		}
+		mGroupWidth  = width;
+		mGroupHeight = height;
+		return true;
+	}
+	return false;
+}
+
+// Rewrites the file with this device's line replaced, keeping the other adapters
+void ComputeTuner::SaveCache(const std::string& cacheFile, const std::string& device)
+{
+	std::vector<std::string> lines;
+	{
+		std::ifstream file(cacheFile);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (line.compare(0, device.size() + 1, device + '\t') != 0)  lines.push_back(line);
+		}
+	}
+	lines.push_back(device + '\t' + std::to_string(mGroupWidth) + "x" + std::to_string(mGroupHeight));
+
+	std::ofstream file(cacheFile);
+	for (auto& line : lines)  file << line << "\n";
+	if (!file)  OutputDebugStringA(("Error writing " + cacheFile + "\n").c_str());
+}
@@ -0,0 +1,65 @@
+//--------------------------------------------------------------------------------------
+// Compute shader group size tuning
+//--------------------------------------------------------------------------------------
+// Picks the thread group size for the post-processes run as compute shaders (EffectSettings::computeShaders), which
+// write each output pixel from one thread. The fastest shape depends on the GPU: its wave size, how many groups fit on
+// each core and how its texture cache is laid out (square tiles suit some, wide rows suit others).
+//
+// Each candidate size is timed on the fused colour effects shader the first time the program runs on an adapter, and
+// the fastest is cached in a text file with one line per adapter, as BlurSelector does. Until then (or if the benchmark
+// can't run) 8x8 is used
+
+#ifndef _COMPUTE_TUNER_H_INCLUDED_
+#define _COMPUTE_TUNER_H_INCLUDED_
+
+#include <string>
+
+struct PooledTarget;
+
+
+class ComputeTuner
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Load the group size for the current device from the cache file, or run the benchmark at the given size and add it
+	// to the file. Call on the main thread once the shaders, states and post-processing constant buffers exist. Returns
+	// false if the benchmark couldn't run (reason in gLastError), the default size is used instead
+	bool Calibrate(int width, int height, const std::string& cacheFile = "ComputeCalibration.txt");
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// Threads per group in x and y for the compute post-processes
+	unsigned int GroupWidth()   { return mGroupWidth; }
+	unsigned int GroupHeight()  { return mGroupHeight; }
+
+	bool Calibrated()  { return mCalibrated; }
+	bool Measured()    { return mMeasured; } // Calibrated by running the benchmark this time rather than from the cache
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Time the colour effects with the given group size, in milliseconds. Negative on failure
+	float MeasureGroupSize(unsigned int groupWidth, unsigned int groupHeight, PooledTarget* input, PooledTarget* output);
+
+	bool LoadCache(const std::string& cacheFile, const std::string& device);
+	void SaveCache(const std::string& cacheFile, const std::string& device);
+
+	unsigned int mGroupWidth  = 8;
+	unsigned int mGroupHeight = 8;
+	bool         mCalibrated = false;
+	bool         mMeasured   = false;
+};
+
+
+extern ComputeTuner gComputeTuner;
+
+
+#endif //_COMPUTE_TUNER_H_INCLUDED_
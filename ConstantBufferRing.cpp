@@ -0,0 +1,98 @@
+//--------------------------------------------------------------------------------------
+// Constant buffer ring
+//--------------------------------------------------------------------------------------
+// See ConstantBufferRing.h for an overview
+
+#include "ConstantBufferRing.h"
+#include "ResourceRegistry.h"
+
+
+ConstantBufferRing gImmediateConstantRing;
+thread_local ConstantBufferRing* gConstantRing = nullptr;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+bool ConstantBufferRing::Init(UINT size /*= DEFAULT_SIZE*/)
+{
+	Release();
+
+	if (!ConstantBufferOffsetsSupported())
+	{
+		gLastError = "Constant buffer offsets aren't supported";
+		return false;
+	}
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = RoundUp(size);
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	if (FAILED(gD3DDevice->CreateBuffer(&desc, nullptr, &mBuffer)))
+	{
+		gLastError = "Error creating constant buffer ring";
+		return false;
+	}
+	gResourceRegistry.Track(mBuffer);
+	mSize = desc.ByteWidth;
+	mSectionStart = 0;
+	mSectionEnd = mSize;
+	mOffset = 0;
+	mNeedDiscard = true;
+	return true;
+}
+
+
+void ConstantBufferRing::Release()
+{
+	if (mBuffer)  mBuffer->Release();
+	mBuffer = nullptr;
+	mSize = mSectionStart = mSectionEnd = 0;
+}
+
+
+void ConstantBufferRing::BeginFrame(unsigned int slot)
+{
+	UINT sectionSize = mSize / MAX_FRAMES_IN_FLIGHT / ALIGNMENT * ALIGNMENT;
+	mSectionStart = slot * sectionSize;
+	mSectionEnd   = mSectionStart + sectionSize;
+	mOffset       = mSectionStart;
+}
+
+
+bool ConstantBufferOffsetsSupported()
+{
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	return gD3DContext1 != nullptr &&
+	       SUCCEEDED(gD3DDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) &&
+	       options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+void* ConstantBufferRing::Allocate(size_t size)
+{
+	if (mBuffer == nullptr)  return nullptr;
+
+	// Discard to start the section again when full, the GPU keeps reading the old copy of the buffer
+	UINT alignedSize = RoundUp(size);
+	if (alignedSize > mSectionEnd - mSectionStart)  return nullptr;
+	if (mOffset + alignedSize > mSectionEnd)  mNeedDiscard = true;
+	if (mNeedDiscard)  mOffset = mSectionStart;
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(gD3DContext->Map(mBuffer, 0, mNeedDiscard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped)))
+	{
+		return nullptr;
+	}
+	mNeedDiscard = false;
+
+	mLastOffset = mOffset;
+	mOffset += alignedSize;
+	return static_cast<char*>(mapped.pData) + mLastOffset;
+}
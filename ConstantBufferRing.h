@@ -0,0 +1,132 @@
+//--------------------------------------------------------------------------------------
+// Constant buffer ring
+//--------------------------------------------------------------------------------------
+// Per-draw constants (the per-model and skeleton constants in Mesh::Render) used to be written to a small buffer of
+// their own with WRITE_DISCARD for every draw, and each discard makes the driver rename the buffer - find fresh memory
+// for it while the GPU still reads the old copy. Hundreds of renames a frame add up.
+//
+// Instead each draw's constants are written to the next free 256 byte aligned part of one large dynamic buffer with
+// WRITE_NO_OVERWRITE, which promises the driver that nothing the GPU may still read is touched, so there is no
+// renaming. The part written is bound with the D3D11.1 constant buffer offsets (see StateCache::SetConstantBuffer).
+// The buffer is only discarded when it is full and the ring starts again from the top. A deferred context must discard
+// before its first no-overwrite map of each command list, so BeginCommandList is called as each one starts. That makes
+// the renames per frame O(1) for the immediate context and O(chunks) for the render workers rather than O(draws).
+// There is still a Map for each draw, as the constants can't be written while the buffer is mapped and drawn with.
+//
+// Needs a D3D11.1 runtime that supports constant buffer offsets and no-overwrite maps of constant buffers. Where it
+// doesn't, Init fails and the callers go back to their own buffers. Each context has its own ring, gConstantRing is the
+// one for gD3DContext on this thread
+//
+// The immediate context's ring is split into a section for each frame in flight (see FramePipeline.h). BeginFrame moves
+// it to the section of the new frame, which the GPU has finished with, so wrapping around to it needs no discard. It
+// only discards if a frame fills its whole section
+
+#ifndef _CONSTANT_BUFFER_RING_H_INCLUDED_
+#define _CONSTANT_BUFFER_RING_H_INCLUDED_
+
+#include "StateCache.h"
+#include "FramePipeline.h"
+#include "Common.h"
+#include "GraphicsHelpers.h"
+
+#include <d3d11.h>
+#include <cstring>
+
+
+class ConstantBufferRing
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~ConstantBufferRing()  { Release(); }
+
+	// Create the buffer, of the given size in bytes. Returns false if the runtime doesn't support constant buffer offsets
+	// or the buffer can't be created (reason in gLastError), the ring can't be used then
+	bool Init(UINT size = DEFAULT_SIZE);
+	void Release();
+
+	// Call as each deferred context command list starts, its first write must discard the buffer
+	void BeginCommandList()  { mNeedDiscard = true; }
+
+	// Call on the immediate context's ring once FramePipeline::BeginFrame has returned, this frame writes the given
+	// slot's section. A ring that never has BeginFrame called uses the whole buffer as one section
+	void BeginFrame(unsigned int slot);
+
+
+	// Write the data to the next free part of the buffer and bind it for all shaders reading the given slot. Call on the
+	// thread owning the ring's context. Returns false if the ring isn't available, nothing is bound then
+	template <class T>
+	bool Bind(UINT slot, const T& data)
+	{
+		static_assert(sizeof(T) % 16 == 0, "Constant buffer data must be a multiple of 16 bytes");
+		void* destination = Allocate(sizeof(T));
+		if (destination == nullptr)  return false;
+		std::memcpy(destination, &data, sizeof(T));
+		gD3DContext->Unmap(mBuffer, 0);
+		gStateCache.SetConstantBuffer(slot, mBuffer, mLastOffset / 16, RoundUp(sizeof(T)) / 16);
+		return true;
+	}
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	bool Available()  { return mBuffer != nullptr; }
+
+	// Size of the immediate context's ring, a DEFAULT_SIZE section for each frame in flight
+	static const UINT DEFAULT_SIZE = 1024 * 1024;
+	static const UINT FRAME_RING_SIZE = DEFAULT_SIZE * MAX_FRAMES_IN_FLIGHT;
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const UINT ALIGNMENT    = 256; // Offsets and sizes bound must be multiples of 16 constants
+
+	static UINT RoundUp(size_t size)  { return static_cast<UINT>((size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT); }
+
+	// Map the buffer and return the address the given number of bytes can be written at, nullptr if the ring isn't
+	// available. The offset in the buffer is left in mLastOffset, the caller unmaps
+	void* Allocate(size_t size);
+
+	ID3D11Buffer* mBuffer      = nullptr;
+	UINT          mSize        = 0;
+	UINT          mSectionStart = 0;   // Part of the buffer this frame writes
+	UINT          mSectionEnd   = 0;
+	UINT          mOffset      = 0;    // Next free byte
+	UINT          mLastOffset  = 0;
+	bool          mNeedDiscard = true;
+};
+
+
+// Whether the runtime supports binding part of a constant buffer and no-overwrite maps of constant buffers, which the
+// ring needs. Also used by other code binding parts of one large buffer (see BonePalettes.h)
+bool ConstantBufferOffsetsSupported();
+
+
+// Write the constants to this thread's ring and bind them for the given slot, or to the given buffer of their own (with
+// WRITE_DISCARD) and bind that if the ring isn't available
+template <class T>
+void BindConstants(UINT slot, const T& data, ID3D11Buffer* buffer);
+
+
+// The ring for gD3DContext on this thread, null if there isn't one. The main thread's ring is gImmediateConstantRing,
+// the render workers swap in their own while recording (see DeferredRenderer.h)
+extern thread_local ConstantBufferRing* gConstantRing;
+extern ConstantBufferRing gImmediateConstantRing;
+
+
+template <class T>
+void BindConstants(UINT slot, const T& data, ID3D11Buffer* buffer)
+{
+	if (gConstantRing != nullptr && gConstantRing->Bind(slot, data))  return;
+	UpdateConstantBuffer(buffer, data);
+	gStateCache.SetConstantBuffer(slot, buffer);
+}
+
+
+#endif //_CONSTANT_BUFFER_RING_H_INCLUDED_
@@ -0,0 +1,2516 @@
+//--------------------------------------------------------------------------------------
+// Cooked assets
+//--------------------------------------------------------------------------------------
+// Mesh import, texture decoding and the cooked file formats, shared by the app and the AssetCooker tool. See CookedAssets.h
+
+#include "CookedAssets.h"
+#include "AssetPack.h"
+#include "CVector2.h"
+#include "CVector3.h"
+#include "CQuaternion.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <wincodec.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <unordered_map>
+
+
+// Helper functions for ImportMesh, defined at the end of the file
+static unsigned int ImportFlags(const MeshImportSettings& settings);
+static unsigned int CountNodes(aiNode* assimpNode);
+static unsigned int ReadNodes(std::vector<CookedMesh::Node>& nodes, aiNode* assimpNode, unsigned int nodeIndex, unsigned int parentIndex);
+static void ImportClips(const aiScene* scene, const std::unordered_map<std::string, unsigned int>& nodeIndices, CookedMesh& mesh);
+
+namespace
+{
+	// Times the stages of ImportMesh - each Add adds the time since the last one to the given total (if not null)
+	class StageTimer
+	{
+	public:
+		StageTimer() : mLast(std::chrono::steady_clock::now()) {}
+
+		void Add(float* milliseconds)
+		{
+			auto now = std::chrono::steady_clock::now();
+			if (milliseconds != nullptr)  *milliseconds += std::chrono::duration<float, std::milli>(now - mLast).count();
+			mLast = now;
+		}
+
+	private:
+		std::chrono::steady_clock::time_point mLast;
+	};
+}
+
+
+//--------------------------------------------------------------------------------------
+// Import settings
+//--------------------------------------------------------------------------------------
+
+const char* MeshImportProfileName(MeshImportProfile profile)
+{
+	switch (profile)
+	{
+	case MeshImportProfile::StaticProp:       return "static";
+	case MeshImportProfile::SkinnedCharacter: return "skinned";
+	case MeshImportProfile::Terrain:          return "terrain";
+	default:                                  return "full";
+	}
+}
+
+
+// Sidecar lines are a setting name and value, see MeshImportSettings
+MeshImportSettings ReadMeshImportSettings(const std::string& fileName)
+{
+	MeshImportSettings settings;
+	std::ifstream file(fileName + ".import");
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream values(line.substr(0, line.find('#')));
+		std::string name, value;
+		if (!(values >> name >> value))  continue;
+		if (name == "profile")
+		{
+			for (auto profile : { MeshImportProfile::Full, MeshImportProfile::StaticProp, MeshImportProfile::SkinnedCharacter,
+			                      MeshImportProfile::Terrain })
+			{
+				if (value == MeshImportProfileName(profile))  settings.profile = profile;
+			}
+		}
+		else if (name == "vertexcache")
+		{
+			settings.vertexCacheSize = static_cast<unsigned int>(std::max(0l, std::strtol(value.c_str(), nullptr, 10)));
+		}
+	}
+	return settings;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Mesh import
+//--------------------------------------------------------------------------------------
+
+// Import a mesh file with assimp. Optionally request tangents to be calculated (for normal and parallax mapping).
+// Will throw a std::runtime_error exception on failure. Each call uses its own importer so it is safe to import on
+// several threads at once, but assimp's DefaultLogger is global so any logging must be set up by the caller
+void ImportMesh(const std::string& fileName, bool requireTangents, CookedMesh& mesh,
+                MeshCacheStats* before /*= nullptr*/, MeshCacheStats* after /*= nullptr*/, MeshImportTimes* times /*= nullptr*/)
+{
+	mesh.fileData.clear();
+	if (times != nullptr)  *times = MeshImportTimes();
+	StageTimer timer;
+
+	Assimp::Importer importer;
+
+	// Flags for processing the mesh, for the kind of asset it is. Assimp provides a huge amount of control - right click
+	// any of these and "Peek Definition" to see documention above each constant
+	MeshImportSettings settings = ReadMeshImportSettings(fileName);
+	unsigned int assimpFlags = ImportFlags(settings);
+	if (settings.vertexCacheSize > 0)  importer.SetPropertyInteger(AI_CONFIG_PP_ICL_PTCACHE_SIZE, settings.vertexCacheSize);
+
+	// Flags to specify what mesh data to ignore
+	int removeComponents = aiComponent_LIGHTS | aiComponent_CAMERAS | aiComponent_TEXTURES | aiComponent_COLORS |
+		aiComponent_MATERIALS;
+
+	// Add / remove tangents as required by user
+	if (requireTangents)
+	{
+		assimpFlags |= aiProcess_CalcTangentSpace;
+	}
+	else
+	{
+		removeComponents |= aiComponent_TANGENTS_AND_BITANGENTS;
+	}
+
+	// Other miscellaneous settings
+	importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, 80.0f); // Smoothing angle for normals
+	importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);  // Remove points and lines (keep triangles only)
+	importer.SetPropertyBool(AI_CONFIG_PP_FD_REMOVE, true);                 // Remove degenerate triangles
+	importer.SetPropertyBool(AI_CONFIG_PP_DB_ALL_OR_NONE, true);            // Default to removing bones/weights from meshes that don't need skinning
+
+	// Set maximum bones that can affect one vertex, and also maximum bones affecting a single mesh
+	unsigned int maxBonesPerVertex = 4; // The shaders support 4 bones per verted (null bones are added if necessary)
+	unsigned int maxBonesPerMesh = 256; // Bone indexes are stored in a byte, so no more than 256 
+	importer.SetPropertyInteger(AI_CONFIG_PP_LBW_MAX_WEIGHTS, maxBonesPerVertex);
+	importer.SetPropertyInteger(AI_CONFIG_PP_SBBC_MAX_BONES, maxBonesPerMesh);
+
+	importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, removeComponents);
+
+	// Import mesh with assimp given above requirements
+	const aiScene* scene = importer.ReadFile(fileName, assimpFlags);
+	if (scene == nullptr)  throw std::runtime_error("Error loading mesh (" + fileName + "). " + importer.GetErrorString());
+	if (scene->mNumMeshes == 0)  throw std::runtime_error("No usable geometry in mesh: " + fileName);
+
+	// A profile without the bone steps given a mesh with bones would leave it with more bones than the vertices and
+	// shaders can hold, so run those steps after all
+	const unsigned int BONE_STEPS = aiProcess_SplitByBoneCount | aiProcess_LimitBoneWeights;
+	if ((assimpFlags & BONE_STEPS) != BONE_STEPS)
+	{
+		bool hasBones = false;
+		for (unsigned int m = 0; m < scene->mNumMeshes; ++m)  if (scene->mMeshes[m]->HasBones())  hasBones = true;
+		if (hasBones)
+		{
+			OutputDebugStringA(("Mesh " + fileName + " has bones, importing with the bone steps the " +
+			                    MeshImportProfileName(settings.profile) + " profile leaves out\n").c_str());
+			scene = importer.ApplyPostProcessing(BONE_STEPS & ~assimpFlags);
+			if (scene == nullptr)  throw std::runtime_error("Error loading mesh (" + fileName + "). " + importer.GetErrorString());
+		}
+	}
+	timer.Add(times ? &times->assimp : nullptr);
+
+
+	//-----------------------------------
+
+	//*********************************************************************//
+	// Read node hierachy - each node has a matrix and contains sub-meshes //
+
+	// Uses recursive helper functions to build node hierarchy    
+	mesh.nodes.resize(CountNodes(scene->mRootNode));
+	ReadNodes(mesh.nodes, scene->mRootNode, 0, 0);
+
+	// Bones are matched to nodes by name, and bone-less sub-meshes of skinned meshes are bound to the node holding them,
+	// so look both up once here rather than searching the nodes for every bone / sub-mesh
+	std::unordered_map<std::string, unsigned int> nodeIndices;
+	std::vector<unsigned int> subMeshNodes(scene->mNumMeshes, 0);
+	for (unsigned int nodeIndex = 0; nodeIndex < mesh.nodes.size(); ++nodeIndex)
+	{
+		auto& node = mesh.nodes[nodeIndex];
+		nodeIndices.emplace(node.name, nodeIndex); // The first node is kept if names are repeated
+		for (auto& subMeshIndex : node.subMeshes)
+		{
+			subMeshNodes[subMeshIndex] = nodeIndex;
+		}
+		node.offsetMatrix = MatrixIdentity(); // Nodes that aren't bones have no offset
+	}
+	timer.Add(times ? &times->nodes : nullptr);
+
+
+
+	//******************************************//
+	// Read geometry - multiple parts supported //
+
+	mesh.hasBones = false;
+	for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
+		if (scene->mMeshes[m]->HasBones())  mesh.hasBones = true;
+
+
+	// A mesh is made of sub-meshes, each one can have a different material (texture)
+	// Import each sub-mesh in the file to seperate index / vertex buffer (could share buffers between sub-meshes but that would make things more complex)
+	mesh.subMeshes.resize(scene->mNumMeshes);
+	for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
+	{
+		aiMesh* assimpMesh = scene->mMeshes[m];
+		std::string subMeshName = assimpMesh->mName.C_Str();
+		auto& subMesh = mesh.subMeshes[m]; // Short name for the submesh we're currently preparing - makes code below more readable
+
+
+		//-----------------------------------
+
+		// Check for presence of position and normal data. Tangents and UVs are optional.
+		std::vector<D3D11_INPUT_ELEMENT_DESC> vertexElements;
+		unsigned int offset = 0;
+
+		if (!assimpMesh->HasPositions())  throw std::runtime_error("No position data for sub-mesh " + subMeshName + " in " + fileName);
+		unsigned int positionOffset = offset;
+		vertexElements.push_back({ "position", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, positionOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
+		offset += 12;
+
+		if (!assimpMesh->HasNormals())  throw std::runtime_error("No normal data for sub-mesh " + subMeshName + " in " + fileName);
+		unsigned int normalOffset = offset;
+		vertexElements.push_back({ "normal", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, normalOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
+		offset += 12;
+
+		unsigned int tangentOffset = offset;
+		if (requireTangents)
+		{
+			if (!assimpMesh->HasTangentsAndBitangents())  throw std::runtime_error("No tangent data for sub-mesh " + subMeshName + " in " + fileName);
+			vertexElements.push_back({ "tangent", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, tangentOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
+			offset += 12;
+		}
+
+		unsigned int uvOffset = offset;
+		bool hasUVs = (assimpMesh->GetNumUVChannels() > 0 && assimpMesh->HasTextureCoords(0));
+		if (hasUVs)
+		{
+			if (assimpMesh->mNumUVComponents[0] != 2)  throw std::runtime_error("Unsupported texture coordinates in " + subMeshName + " in " + fileName);
+			vertexElements.push_back({ "uv", 0, DXGI_FORMAT_R32G32_FLOAT, 0, uvOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
+			offset += 8;
+		}
+
+		unsigned int bonesOffset = offset;
+		if (mesh.hasBones)
+		{
+			vertexElements.push_back({ "bones"  , 0, DXGI_FORMAT_R8G8B8A8_UINT,      0, bonesOffset,     D3D11_INPUT_PER_VERTEX_DATA, 0 });
+			offset += 4;
+			vertexElements.push_back({ "weights", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, bonesOffset + 4, D3D11_INPUT_PER_VERTEX_DATA, 0 });
+			offset += 16;
+		}
+
+		subMesh.vertexSize = offset;
+
+
+		//-----------------------------------
+
+		// Create CPU-side buffers to hold current mesh data - exact content is flexible so can't use a structure for a vertex - so just a block of bytes
+		// Note: the mesh's arena is used rather than vectors because vectors default-initialise all the values which is a waste of time.
+		subMesh.numVertices = assimpMesh->mNumVertices;
+		subMesh.numIndices = assimpMesh->mNumFaces * 3;
+		unsigned char* vertices = mesh.importedData.AllocateArray<unsigned char>(static_cast<size_t>(subMesh.numVertices) * subMesh.vertexSize);
+		unsigned char* indices  = mesh.importedData.AllocateArray<unsigned char>(static_cast<size_t>(subMesh.numIndices) * 4); // Using 32 bit indexes (4 bytes) for each indeex
+
+
+		//-----------------------------------
+
+		// Copy mesh data from assimp to our CPU-side vertex buffer. Each vertex is written whole before moving on to the
+		// next, so the buffer is walked once from start to end rather than once for each attribute
+
+		const CVector3*   assimpPosition = reinterpret_cast<CVector3*>(assimpMesh->mVertices);
+		const CVector3*   assimpNormal   = reinterpret_cast<CVector3*>(assimpMesh->mNormals);
+		const CVector3*   assimpTangent  = reinterpret_cast<CVector3*>(assimpMesh->mTangents);
+		const aiVector3D* assimpUV       = (hasUVs ? assimpMesh->mTextureCoords[0] : nullptr);
+
+		// Sub-meshes of a skinned mesh that have no bones of their own are given one bone, the node holding them, so
+		// the whole mesh can use one shader. Those that do have bones start with none and have them added below
+		unsigned char rigidBone   = 0;
+		float         rigidWeight = 0.0f;
+		if (mesh.hasBones && !assimpMesh->HasBones())
+		{
+			rigidBone   = static_cast<unsigned char>(subMeshNodes[m]);
+			rigidWeight = 1.0f;
+		}
+
+		unsigned char* vertex = vertices;
+		for (unsigned int v = 0; v < subMesh.numVertices; ++v)
+		{
+			std::memcpy(vertex + positionOffset, &assimpPosition[v], sizeof(CVector3));
+			std::memcpy(vertex + normalOffset,   &assimpNormal[v],   sizeof(CVector3));
+			if (requireTangents)  std::memcpy(vertex + tangentOffset, &assimpTangent[v], sizeof(CVector3));
+			if (hasUVs)
+			{
+				CVector2 uv(assimpUV[v].x, assimpUV[v].y);
+				std::memcpy(vertex + uvOffset, &uv, sizeof(CVector2));
+			}
+			if (mesh.hasBones)
+			{
+				unsigned char* bones = vertex + bonesOffset;
+				std::memset(bones, 0, 20);
+				bones[0] = rigidBone;
+				std::memcpy(bones + 4, &rigidWeight, sizeof(float));
+			}
+			vertex += subMesh.vertexSize;
+		}
+		timer.Add(times ? &times->vertices : nullptr);
+
+
+		if (mesh.hasBones && assimpMesh->HasBones())
+		{
+			// Go through each assimp bone
+			unsigned char* bones = vertices + bonesOffset;
+			for (unsigned int i = 0; i < assimpMesh->mNumBones; ++i)
+			{
+				// Get offset matrix for the bone (transform from skinned mesh root to bone root
+				aiBone* assimpBone = assimpMesh->mBones[i];
+				auto node = nodeIndices.find(assimpBone->mName.C_Str());
+				if (node == nodeIndices.end())  throw std::runtime_error("Bone with no matching node in " + fileName);
+				unsigned int nodeIndex = node->second;
+				mesh.nodes[nodeIndex].offsetMatrix.SetValues(&assimpBone->mOffsetMatrix.a1);
+				mesh.nodes[nodeIndex].offsetMatrix.Transpose(); // Assimp stores matrices differently to this app
+
+				// Go through each weight of the bone and update the vertex it influences
+				// Find the first 0 weight on that vertex and put the new influence / weight there.
+				// A vertex can only have up to 4 influences
+				for (unsigned int j = 0; j < assimpBone->mNumWeights; ++j)
+				{
+					unsigned int vertexIndex = assimpBone->mWeights[j].mVertexId;
+					unsigned char* bone = bones + vertexIndex * subMesh.vertexSize;
+					float* weight = (float*)(bone + 4);
+					float* lastWeight = weight + 3;
+					while (*weight != 0.0f && weight != lastWeight)
+					{
+						bone++; weight++;
+					}
+					if (*weight == 0.0f)
+					{
+						*bone = nodeIndex;
+						*weight = assimpBone->mWeights[j].mWeight;
+					}
+				}
+			}
+			timer.Add(times ? &times->bones : nullptr);
+		}
+
+
+
+		//-----------------------------------
+
+		// Copy face data from assimp to our CPU-side index buffer
+		if (!assimpMesh->HasFaces())  throw std::runtime_error("No face data in " + subMeshName + " in " + fileName);
+
+		DWORD* index = reinterpret_cast<DWORD*>(indices);
+		for (unsigned int face = 0; face < assimpMesh->mNumFaces; ++face)
+		{
+			*index++ = assimpMesh->mFaces[face].mIndices[0];
+			*index++ = assimpMesh->mFaces[face].mIndices[1];
+			*index++ = assimpMesh->mFaces[face].mIndices[2];
+		}
+		timer.Add(times ? &times->indices : nullptr);
+
+
+		subMesh.vertexElements = std::move(vertexElements);
+		subMesh.vertices = vertices;
+		subMesh.indices  = indices;
+	}
+
+
+	//*************************************************************//
+	// Reorder for the vertex cache, overdraw and vertex fetching  //
+
+	if (before != nullptr)  *before = MeasureVertexCache(mesh);
+	OptimiseMesh(mesh);
+	if (after != nullptr)   *after = MeasureVertexCache(mesh);
+	timer.Add(times ? &times->optimise : nullptr);
+
+
+	//*****************************************************//
+	// Read animation clips - resampled, reduced and packed //
+
+	ImportClips(scene, nodeIndices, mesh);
+	timer.Add(times ? &times->clips : nullptr);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Cooked meshes
+//--------------------------------------------------------------------------------------
+// A cooked mesh file holds exactly what ImportMesh builds: the node hierarchy (with bone
+// offset matrices) and, for each sub-mesh, the vertex layout and the interleaved vertex and 32-bit index data. The
+// whole file is read at once and the vertex / index data left in place for the Mesh class to pass straight to CreateBuffer.
+//
+// Layout: CookedHeader, then each node (name length, name, default matrix, offset matrix, parent index, child count, child
+// indexes, sub-mesh count, sub-mesh indexes), then each sub-mesh (vertex size, vertex count, index count, element count,
+// CookedVertexElement for each element, vertex data, index data), then each animation clip (name length, name, duration,
+// sample rate, track count, CookedClip::Track for each track, then a count and the values of each key array). All values
+// are 32-bit except the 16-bit keys.
+//
+// The header records the size and write time of the source file and the settings from its sidecar, so a cooked file is
+// rebuilt when either changes. Increase COOKED_MESH_VERSION when the import code or anything else affecting the result is changed
+
+namespace
+{
+	const uint32_t COOKED_MESH_MAGIC   = 0x4853454D; // "MESH"
+	const uint32_t COOKED_MESH_VERSION = 5; // 2: meshes are optimised (see OptimiseMesh), 3: bone offsets kept for every sub-mesh,
+	                                        // 4: animation clips kept, 5: import settings recorded
+
+	struct CookedHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourceWriteTime;
+		uint64_t sourceSize;
+		uint32_t requireTangents;
+		uint32_t importProfile;   // The MeshImportSettings the mesh was imported with
+		uint32_t vertexCacheSize;
+		uint32_t hasBones;
+		uint32_t numNodes;
+		uint32_t numSubMeshes;
+		uint32_t numClips;
+	};
+
+	struct CookedVertexElement
+	{
+		uint32_t semantic; // Index into SEMANTIC_NAMES
+		uint32_t semanticIndex;
+		uint32_t format;
+		uint32_t offset;
+	};
+
+	// The semantic names used by the importer. D3D11_INPUT_ELEMENT_DESC holds a pointer, so cooked elements refer to these
+	const char* const SEMANTIC_NAMES[] = { "position", "normal", "tangent", "uv", "bones", "weights" };
+	const uint32_t NUM_SEMANTIC_NAMES = sizeof(SEMANTIC_NAMES) / sizeof(SEMANTIC_NAMES[0]);
+
+	// Get the write time and size of the source file, returns false if it doesn't exist
+	bool SourceFileStamp(const std::string& fileName, uint64_t& writeTime, uint64_t& size)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+		if (!GetFileAttributesExA(fileName.c_str(), GetFileExInfoStandard, &attributes))  return false;
+		writeTime = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+		size      = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+		return true;
+	}
+
+	// Reads values from the cooked file image, checking it doesn't run off the end
+	class CookedReader
+	{
+	public:
+		CookedReader(const char* data, size_t size) : mData(data), mEnd(data + size) {}
+
+		// Returns a pointer to the next size bytes, or nullptr if there aren't enough left
+		const char* ReadBytes(size_t size)
+		{
+			if (static_cast<size_t>(mEnd - mData) < size)  return nullptr;
+			const char* data = mData;
+			mData += size;
+			return data;
+		}
+
+		template <class T> bool Read(T& value)
+		{
+			const char* data = ReadBytes(sizeof(T));
+			if (data == nullptr)  return false;
+			std::memcpy(&value, data, sizeof(T));
+			return true;
+		}
+
+		// Read a count then that many values, copied out of the file image
+		template <class T> bool ReadArray(std::vector<T>& values)
+		{
+			uint32_t count;
+			if (!Read(count))  return false;
+			const char* data = ReadBytes(static_cast<size_t>(count) * sizeof(T));
+			if (data == nullptr)  return false;
+			values.resize(count);
+			if (count > 0)  std::memcpy(values.data(), data, static_cast<size_t>(count) * sizeof(T));
+			return true;
+		}
+
+	private:
+		const char* mData;
+		const char* mEnd;
+	};
+
+	template <class T> void Write(std::ostream& stream, const T& value)
+	{
+		stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <class T> void WriteArray(std::ostream& stream, const std::vector<T>& values)
+	{
+		Write(stream, static_cast<uint32_t>(values.size()));
+		stream.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+	}
+
+	// Check the keys of a channel of a track are within the clip's arrays, with the given number of values per key
+	bool IsChannelValid(uint32_t first, uint32_t count, const std::vector<uint16_t>& times, const std::vector<uint16_t>& values,
+	                    size_t valuesPerKey)
+	{
+		return count > 0 && first <= times.size() && count <= times.size() - first && values.size() == times.size() * valuesPerKey;
+	}
+}
+
+
+// Check a cooked file header matches the current format, import settings and source file
+static bool IsHeaderCurrent(const CookedHeader& header, const std::string& sourceFileName, bool requireTangents)
+{
+	uint64_t sourceWriteTime, sourceSize;
+	if (!SourceFileStamp(sourceFileName, sourceWriteTime, sourceSize))  return false;
+	MeshImportSettings settings = ReadMeshImportSettings(sourceFileName);
+
+	return header.magic == COOKED_MESH_MAGIC && header.version == COOKED_MESH_VERSION && header.sourceWriteTime == sourceWriteTime &&
+	       header.sourceSize == sourceSize && header.requireTangents == (requireTangents ? 1u : 0u) &&
+	       header.importProfile == static_cast<uint32_t>(settings.profile) && header.vertexCacheSize == settings.vertexCacheSize &&
+	       header.numSubMeshes != 0;
+}
+
+
+// Name of the cooked file for a mesh file
+std::string CookedMeshFileName(const std::string& fileName, bool requireTangents)
+{
+	return fileName + (requireTangents ? ".tangents.cooked" : ".cooked");
+}
+
+
+// Read the cooked file for a mesh if it is up to date, otherwise import the mesh with assimp and write a new cooked file.
+// Will throw a std::runtime_error exception on failure
+void LoadMeshData(const std::string& fileName, bool requireTangents, CookedMesh& mesh)
+{
+	std::string cookedFileName = CookedMeshFileName(fileName, requireTangents);
+	if (ReadCookedMesh(cookedFileName, fileName, requireTangents, mesh))  return;
+
+	MeshImportTimes times;
+	ImportMesh(fileName, requireTangents, mesh, nullptr, nullptr, &times);
+	char report[256];
+	std::snprintf(report, sizeof(report), "Imported %s (%s profile) in ms: assimp %.1f, nodes %.1f, vertices %.1f, bones %.1f, "
+	              "indices %.1f, optimise %.1f, clips %.1f\n", fileName.c_str(), MeshImportProfileName(ReadMeshImportSettings(fileName).profile),
+	              times.assimp, times.nodes, times.vertices, times.bones, times.indices, times.optimise, times.clips);
+	OutputDebugStringA(report);
+
+	// Not an error if this fails, the mesh will just be imported again next time
+	WriteCookedMesh(cookedFileName, fileName, requireTangents, mesh);
+}
+
+
+// Check if a cooked mesh file is up to date with the source mesh file, only reading its header
+bool IsCookedMeshCurrent(const std::string& cookedFileName, const std::string& sourceFileName, bool requireTangents)
+{
+	std::ifstream file(cookedFileName, std::ios::in | std::ios::binary);
+	if (!file.is_open())  return false;
+	CookedHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (file.fail())  return false;
+	return IsHeaderCurrent(header, sourceFileName, requireTangents);
+}
+
+
+// Read a cooked mesh file in one go, from the asset pack if it is there. Returns false if it is missing, invalid, or out
+// of date with the source mesh file. The vertex and index data is left in the file image held by the mesh, or in the pack
+bool ReadCookedMesh(const std::string& cookedFileName, const std::string& sourceFileName, bool requireTangents, CookedMesh& mesh)
+{
+	std::vector<char> cooked;
+	const void* packData;
+	size_t packSize;
+	const char* data;
+	size_t size;
+	if (gAssetPack.Find(cookedFileName, packData, packSize))
+	{
+		data = static_cast<const char*>(packData);
+		size = packSize;
+	}
+	else
+	{
+		// Read the whole file in one go
+		std::ifstream file(cookedFileName, std::ios::in | std::ios::binary | std::ios::ate);
+		if (!file.is_open())  return false;
+		std::streamoff fileSize = file.tellg();
+		file.seekg(0, std::ios::beg);
+		cooked.resize(static_cast<size_t>(fileSize));
+		file.read(cooked.data(), fileSize);
+		if (file.fail())  return false;
+		data = cooked.data();
+		size = cooked.size();
+	}
+
+	CookedReader reader(data, size);
+	CookedHeader header;
+	if (!reader.Read(header))  return false;
+	if (!IsHeaderCurrent(header, sourceFileName, requireTangents))  return false;
+
+	// Node hierarchy
+	std::vector<CookedMesh::Node> nodes(header.numNodes);
+	for (auto& node : nodes)
+	{
+		uint32_t nameLength, numChildren, numSubMeshes;
+		if (!reader.Read(nameLength))  return false;
+		const char* name = reader.ReadBytes(nameLength);
+		if (name == nullptr)  return false;
+		node.name.assign(name, nameLength);
+
+		if (!reader.Read(node.defaultMatrix) || !reader.Read(node.offsetMatrix) || !reader.Read(node.parentIndex))  return false;
+		if (node.parentIndex >= header.numNodes)  return false;
+
+		if (!reader.Read(numChildren) || numChildren > header.numNodes)  return false;
+		node.childNodes.resize(numChildren);
+		for (auto& child : node.childNodes)  if (!reader.Read(child) || child >= header.numNodes)  return false;
+
+		if (!reader.Read(numSubMeshes) || numSubMeshes > header.numSubMeshes)  return false;
+		node.subMeshes.resize(numSubMeshes);
+		for (auto& subMesh : node.subMeshes)  if (!reader.Read(subMesh) || subMesh >= header.numSubMeshes)  return false;
+	}
+
+	// Sub-mesh layouts and data, pointing into the file image
+	std::vector<CookedMesh::SubMesh> subMeshes(header.numSubMeshes);
+	for (auto& data : subMeshes)
+	{
+		uint32_t numElements;
+		if (!reader.Read(data.vertexSize) || !reader.Read(data.numVertices) || !reader.Read(data.numIndices) || !reader.Read(numElements))  return false;
+		if (numElements > NUM_SEMANTIC_NAMES)  return false;
+		for (uint32_t e = 0; e < numElements; ++e)
+		{
+			CookedVertexElement element;
+			if (!reader.Read(element) || element.semantic >= NUM_SEMANTIC_NAMES)  return false;
+			data.vertexElements.push_back({ SEMANTIC_NAMES[element.semantic], element.semanticIndex, static_cast<DXGI_FORMAT>(element.format),
+			                                0, element.offset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
+		}
+		data.vertices = reinterpret_cast<const unsigned char*>(reader.ReadBytes(static_cast<size_t>(data.numVertices) * data.vertexSize));
+		data.indices  = reinterpret_cast<const unsigned char*>(reader.ReadBytes(static_cast<size_t>(data.numIndices) * sizeof(DWORD)));
+		if (data.vertices == nullptr || data.indices == nullptr)  return false;
+	}
+
+	// Animation clips, small enough to copy out of the file image
+	std::vector<CookedClip> clips(header.numClips);
+	for (auto& clip : clips)
+	{
+		uint32_t nameLength;
+		if (!reader.Read(nameLength))  return false;
+		const char* name = reader.ReadBytes(nameLength);
+		if (name == nullptr)  return false;
+		clip.name.assign(name, nameLength);
+
+		if (!reader.Read(clip.duration) || !reader.Read(clip.sampleRate) || !reader.ReadArray(clip.tracks))  return false;
+		if (!reader.ReadArray(clip.rotationTimes) || !reader.ReadArray(clip.rotations) ||
+		    !reader.ReadArray(clip.positionTimes) || !reader.ReadArray(clip.positions) ||
+		    !reader.ReadArray(clip.scaleTimes)    || !reader.ReadArray(clip.scales))  return false;
+		for (auto& track : clip.tracks)
+		{
+			if (track.node >= header.numNodes ||
+			    !IsChannelValid(track.firstRotation, track.numRotations, clip.rotationTimes, clip.rotations, 3) ||
+			    !IsChannelValid(track.firstPosition, track.numPositions, clip.positionTimes, clip.positions, 3) ||
+			    !IsChannelValid(track.firstScale,    track.numScales,    clip.scaleTimes,    clip.scales,    3))  return false;
+		}
+	}
+
+	// File is valid, the sub-meshes point into the file image so keep that with the mesh (moving a vector keeps its storage).
+	// Nothing to keep if it is in the pack, which stays mapped
+	mesh.nodes     = std::move(nodes);
+	mesh.subMeshes = std::move(subMeshes);
+	mesh.hasBones  = (header.hasBones != 0);
+	mesh.clips     = std::move(clips);
+	mesh.fileData  = std::move(cooked);
+	mesh.importedData.Release();
+	return true;
+}
+
+
+// Write a cooked mesh file, returns false on failure. Written to a temporary file then renamed, so a partly written file
+// is never read
+bool WriteCookedMesh(const std::string& cookedFileName, const std::string& sourceFileName, bool requireTangents, const CookedMesh& mesh)
+{
+	MeshImportSettings settings = ReadMeshImportSettings(sourceFileName);
+	CookedHeader header = { COOKED_MESH_MAGIC, COOKED_MESH_VERSION, 0, 0, requireTangents ? 1u : 0u,
+	                        static_cast<uint32_t>(settings.profile), settings.vertexCacheSize, mesh.hasBones ? 1u : 0u,
+	                        static_cast<uint32_t>(mesh.nodes.size()), static_cast<uint32_t>(mesh.subMeshes.size()),
+	                        static_cast<uint32_t>(mesh.clips.size()) };
+	if (!SourceFileStamp(sourceFileName, header.sourceWriteTime, header.sourceSize))  return false;
+
+	std::ostringstream cooked;
+	Write(cooked, header);
+	for (auto& node : mesh.nodes)
+	{
+		Write(cooked, static_cast<uint32_t>(node.name.length()));
+		cooked.write(node.name.data(), node.name.length());
+		Write(cooked, node.defaultMatrix);
+		Write(cooked, node.offsetMatrix);
+		Write(cooked, static_cast<uint32_t>(node.parentIndex));
+		Write(cooked, static_cast<uint32_t>(node.childNodes.size()));
+		for (auto child : node.childNodes)  Write(cooked, static_cast<uint32_t>(child));
+		Write(cooked, static_cast<uint32_t>(node.subMeshes.size()));
+		for (auto subMesh : node.subMeshes)  Write(cooked, static_cast<uint32_t>(subMesh));
+	}
+	for (auto& data : mesh.subMeshes)
+	{
+		if (data.indexFormat != DXGI_FORMAT_R32_UINT)  return false; // Compact meshes are converted after loading, not cooked
+		Write(cooked, static_cast<uint32_t>(data.vertexSize));
+		Write(cooked, static_cast<uint32_t>(data.numVertices));
+		Write(cooked, static_cast<uint32_t>(data.numIndices));
+		Write(cooked, static_cast<uint32_t>(data.vertexElements.size()));
+		for (auto& element : data.vertexElements)
+		{
+			uint32_t semantic = 0;
+			while (semantic < NUM_SEMANTIC_NAMES && std::strcmp(SEMANTIC_NAMES[semantic], element.SemanticName) != 0)  ++semantic;
+			if (semantic == NUM_SEMANTIC_NAMES)  return false;
+			CookedVertexElement cookedElement = { semantic, element.SemanticIndex, static_cast<uint32_t>(element.Format), element.AlignedByteOffset };
+			Write(cooked, cookedElement);
+		}
+		cooked.write(reinterpret_cast<const char*>(data.vertices), static_cast<std::streamsize>(data.numVertices) * data.vertexSize);
+		cooked.write(reinterpret_cast<const char*>(data.indices),  static_cast<std::streamsize>(data.numIndices) * sizeof(DWORD));
+	}
+	for (auto& clip : mesh.clips)
+	{
+		Write(cooked, static_cast<uint32_t>(clip.name.length()));
+		cooked.write(clip.name.data(), clip.name.length());
+		Write(cooked, clip.duration);
+		Write(cooked, clip.sampleRate);
+		WriteArray(cooked, clip.tracks);
+		WriteArray(cooked, clip.rotationTimes);
+		WriteArray(cooked, clip.rotations);
+		WriteArray(cooked, clip.positionTimes);
+		WriteArray(cooked, clip.positions);
+		WriteArray(cooked, clip.scaleTimes);
+		WriteArray(cooked, clip.scales);
+	}
+
+	std::string tempFileName = cookedFileName + ".tmp";
+	{
+		std::ofstream file(tempFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file.is_open())  return false;
+		std::string image = cooked.str();
+		file.write(image.data(), image.size());
+		if (file.fail())
+		{
+			file.close();
+			DeleteFileA(tempFileName.c_str());
+			return false;
+		}
+	}
+	if (!MoveFileExA(tempFileName.c_str(), cookedFileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileA(tempFileName.c_str());
+		return false;
+	}
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Compact vertices
+//--------------------------------------------------------------------------------------
+// The imported formats are converted to ones the input assembler expands back to floats, so the shaders are unchanged:
+// normals and tangents to R8G8B8A8_SNORM, bone weights to R8G8B8A8_UNORM and UVs to R16G16_FLOAT. Half precision UVs
+// lose too much detail far from the origin, so sub-meshes with UVs outside +-MAX_HALF_UV (heavily tiled textures) keep
+// 32-bit UVs. Positions stay as 32-bit floats
+
+namespace
+{
+	const float MAX_HALF_UV = 4.0f; // Half floats step by 1/256 or finer up to here
+
+	unsigned int FormatSize(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+			case DXGI_FORMAT_R32G32B32A32_FLOAT: return 16;
+			case DXGI_FORMAT_R32G32B32_FLOAT:    return 12;
+			case DXGI_FORMAT_R32G32_FLOAT:       return 8;
+			default:                             return 4; // All the compact formats and R8G8B8A8_UINT bones
+		}
+	}
+
+	// Convert a float to half precision, rounding to nearest. Values are in a small range so there is no need to handle
+	// infinities or NaNs
+	uint16_t FloatToHalf(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		uint32_t sign     = (bits >> 16) & 0x8000;
+		int      exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+		uint32_t mantissa = bits & 0x7fffff;
+
+		if (exponent <= 0) // Too small for a normal half, make a denormal (or zero)
+		{
+			if (exponent < -10)  return static_cast<uint16_t>(sign);
+			mantissa = (mantissa | 0x800000) >> (1 - exponent);
+			return static_cast<uint16_t>(sign | ((mantissa + 0x1000) >> 13));
+		}
+		if (exponent >= 31)  return static_cast<uint16_t>(sign | 0x7bff); // Clamp to largest half
+
+		// Rounding can carry into the exponent, which gives the correct result
+		return static_cast<uint16_t>(sign | ((static_cast<uint32_t>(exponent) << 10) + ((mantissa + 0x1000) >> 13)));
+	}
+
+	uint8_t ToSNorm8(float value)
+	{
+		float clamped = std::min(std::max(value, -1.0f), 1.0f);
+		return static_cast<uint8_t>(static_cast<int8_t>(std::floor(clamped * 127.0f + 0.5f)));
+	}
+
+	// Convert 4 weights to UNORM8, keeping their total exactly 255 so skinned vertices don't shrink or grow
+	void WeightsToUNorm8(const float weights[4], uint8_t* out)
+	{
+		int total = 0, largest = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			int weight = static_cast<int>(std::min(std::max(weights[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+			out[i] = static_cast<uint8_t>(weight);
+			total += weight;
+			if (out[i] > out[largest])  largest = i;
+		}
+		if (total > 0)  out[largest] = static_cast<uint8_t>(std::min(std::max(out[largest] + 255 - total, 0), 255));
+	}
+}
+
+
+// Convert a mesh to compact vertex formats and, for sub-meshes with fewer than 65536 vertices, 16-bit indices
+void CompactMesh(CookedMesh& mesh)
+{
+	for (auto& subMesh : mesh.subMeshes)
+	{
+		// Choose the compact format for each element
+		bool halfUVs = true;
+		for (auto& element : subMesh.vertexElements)
+		{
+			if (std::strcmp(element.SemanticName, "uv") != 0 || element.Format != DXGI_FORMAT_R32G32_FLOAT)  continue;
+			for (unsigned int v = 0; v < subMesh.numVertices; ++v)
+			{
+				float uv[2];
+				std::memcpy(uv, subMesh.vertices + v * subMesh.vertexSize + element.AlignedByteOffset, sizeof(uv));
+				if (std::abs(uv[0]) > MAX_HALF_UV || std::abs(uv[1]) > MAX_HALF_UV)  halfUVs = false;
+			}
+		}
+
+		std::vector<D3D11_INPUT_ELEMENT_DESC> elements = subMesh.vertexElements;
+		unsigned int offset = 0;
+		for (auto& element : elements)
+		{
+			std::string semantic = element.SemanticName;
+			if ((semantic == "normal" || semantic == "tangent") && element.Format == DXGI_FORMAT_R32G32B32_FLOAT)
+			{
+				element.Format = DXGI_FORMAT_R8G8B8A8_SNORM;
+			}
+			else if (semantic == "weights" && element.Format == DXGI_FORMAT_R32G32B32A32_FLOAT)
+			{
+				element.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+			}
+			else if (semantic == "uv" && element.Format == DXGI_FORMAT_R32G32_FLOAT && halfUVs)
+			{
+				element.Format = DXGI_FORMAT_R16G16_FLOAT;
+			}
+			element.AlignedByteOffset = offset;
+			offset += FormatSize(element.Format);
+		}
+		unsigned int vertexSize = offset;
+
+		// Convert the vertices
+		unsigned char* vertices = mesh.importedData.AllocateArray<unsigned char>(static_cast<size_t>(subMesh.numVertices) * vertexSize);
+		for (unsigned int v = 0; v < subMesh.numVertices; ++v)
+		{
+			const unsigned char* source = subMesh.vertices + static_cast<size_t>(v) * subMesh.vertexSize;
+			unsigned char*       dest   = vertices + static_cast<size_t>(v) * vertexSize;
+			for (size_t e = 0; e < elements.size(); ++e)
+			{
+				const unsigned char* from = source + subMesh.vertexElements[e].AlignedByteOffset;
+				unsigned char*       to   = dest + elements[e].AlignedByteOffset;
+				float values[4];
+				std::memcpy(values, from, FormatSize(subMesh.vertexElements[e].Format));
+				switch (elements[e].Format == subMesh.vertexElements[e].Format ? DXGI_FORMAT_UNKNOWN : elements[e].Format)
+				{
+					case DXGI_FORMAT_R8G8B8A8_SNORM:
+						for (int c = 0; c < 3; ++c)  to[c] = ToSNorm8(values[c]);
+						to[3] = 0;
+						break;
+					case DXGI_FORMAT_R8G8B8A8_UNORM:
+						WeightsToUNorm8(values, to);
+						break;
+					case DXGI_FORMAT_R16G16_FLOAT:
+					{
+						uint16_t halves[2] = { FloatToHalf(values[0]), FloatToHalf(values[1]) };
+						std::memcpy(to, halves, sizeof(halves));
+						break;
+					}
+					default: // Unchanged
+						std::memcpy(to, from, FormatSize(elements[e].Format));
+						break;
+				}
+			}
+		}
+
+		// 16-bit indices if every vertex can be reached with one, for the sub-mesh and any levels of detail
+		if (subMesh.indexFormat == DXGI_FORMAT_R32_UINT && subMesh.numVertices < 65536)
+		{
+			auto shortenIndices = [&mesh](const unsigned char* source, unsigned int numIndices)
+			{
+				unsigned char* indices = mesh.importedData.AllocateArray<unsigned char>(static_cast<size_t>(numIndices) * 2);
+				for (unsigned int i = 0; i < numIndices; ++i)
+				{
+					uint32_t index;
+					std::memcpy(&index, source + i * 4, sizeof(index));
+					uint16_t shortIndex = static_cast<uint16_t>(index);
+					std::memcpy(indices + i * 2, &shortIndex, sizeof(shortIndex));
+				}
+				return static_cast<const unsigned char*>(indices);
+			};
+			subMesh.indexFormat = DXGI_FORMAT_R16_UINT;
+			subMesh.indices = shortenIndices(subMesh.indices, subMesh.numIndices);
+			for (auto& lod : subMesh.lods)  lod.indices = shortenIndices(lod.indices, lod.numIndices);
+		}
+
+		subMesh.vertexElements = std::move(elements);
+		subMesh.vertexSize = vertexSize;
+		subMesh.vertices = vertices; // The old data stays until the mesh is destroyed
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Mesh optimisation
+//--------------------------------------------------------------------------------------
+// Three passes over each sub-mesh, in this order since each keeps what the one before did:
+// - Triangles are put in an order that reuses the vertices in the GPU's post-transform cache, using Tom Forsyth's
+//   "Linear-Speed Vertex Cache Optimisation". Each step adds the triangle whose vertices score best, from how recently
+//   they were used and how few triangles they have left
+// - The cache-ordered triangles are split into clusters and the clusters sorted to reduce overdraw, from "Fast Triangle
+//   Reordering for Vertex Locality and Reduced Overdraw" (Sander, Nehab & Barczak). A view-independent order is used:
+//   clusters facing out from the centre of the sub-mesh, and furthest out, are drawn first as they are the most likely
+//   to hide the others. Splitting clusters only where the cache has little to lose keeps most of the cache efficiency
+// - Vertices are stored in the order the triangles first use them, so vertex fetches read memory in order. Vertices no
+//   triangle uses are dropped
+
+namespace
+{
+	const unsigned int OPTIMISE_CACHE_SIZE = 32;    // Size of the LRU cache modelled by the cache optimisation
+	const unsigned int MEASURE_CACHE_SIZE  = 16;    // Size of the FIFO cache for statistics and clustering, a typical hardware size
+	const float        CLUSTER_THRESHOLD   = 1.05f; // Clusters can have this much higher ACMR than the order before splitting
+
+	// Score of a vertex for the cache optimisation, from its position in the cache (-1 if not in it) and its remaining triangles
+	float VertexCacheScore(int cachePosition, unsigned int remainingTriangles)
+	{
+		if (remainingTriangles == 0)  return -1.0f;
+
+		float score = 0;
+		if (cachePosition >= 0)
+		{
+			// The vertices of the last triangle get a fixed score, so the next triangle doesn't always reuse the same edge
+			if (cachePosition < 3)  score = 0.75f;
+			else                    score = std::pow(1.0f - static_cast<float>(cachePosition - 3) / (OPTIMISE_CACHE_SIZE - 3), 1.5f);
+		}
+
+		// Boost vertices with few triangles left, so they are finished off rather than left as isolated triangles
+		return score + 2.0f / std::sqrt(static_cast<float>(remainingTriangles));
+	}
+
+	// Reorder a triangle list for the post-transform vertex cache
+	void OptimiseVertexCache(uint32_t* indices, size_t numIndices, uint32_t numVertices)
+	{
+		size_t numTriangles = numIndices / 3;
+		if (numTriangles < 2)  return;
+
+		// Triangles using each vertex
+		std::vector<uint32_t> firstTriangle(numVertices + 1, 0), vertexTriangles(numIndices);
+		for (size_t i = 0; i < numIndices; ++i)  ++firstTriangle[indices[i] + 1];
+		for (uint32_t v = 0; v < numVertices; ++v)  firstTriangle[v + 1] += firstTriangle[v];
+		std::vector<uint32_t> next(firstTriangle.begin(), firstTriangle.end() - 1);
+		for (size_t i = 0; i < numIndices; ++i)  vertexTriangles[next[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+		std::vector<unsigned int> remaining(numVertices);
+		for (uint32_t v = 0; v < numVertices; ++v)  remaining[v] = firstTriangle[v + 1] - firstTriangle[v];
+		std::vector<float>        vertexScore(numVertices);
+		for (uint32_t v = 0; v < numVertices; ++v)  vertexScore[v] = VertexCacheScore(-1, remaining[v]);
+		std::vector<bool>         added(numTriangles, false);
+
+		std::vector<uint32_t> output;
+		output.reserve(numIndices);
+		std::vector<uint32_t> cache, newCache;
+		size_t scanFrom = 0; // Triangles before this have all been added
+		int best = -1;
+		while (output.size() < numIndices)
+		{
+			// No candidate from the cache (at the start, or a part of the mesh is finished), carry on from the next triangle
+			// not yet added in the original order. Searching all the triangles for the best would be slow for large meshes
+			if (best < 0)
+			{
+				while (added[scanFrom])  ++scanFrom;
+				best = static_cast<int>(scanFrom);
+			}
+
+			// Add the triangle, its vertices go to the front of the cache
+			added[best] = true;
+			newCache.clear();
+			for (int c = 0; c < 3; ++c)
+			{
+				uint32_t v = indices[best * 3 + c];
+				output.push_back(v);
+				if (std::find(newCache.begin(), newCache.end(), v) != newCache.end())  continue; // Degenerate triangle
+				newCache.push_back(v);
+
+				// Remove the triangle from the vertex's list of remaining triangles
+				uint32_t* first = &vertexTriangles[firstTriangle[v]];
+				uint32_t* last  = first + remaining[v];
+				*std::find(first, last, static_cast<uint32_t>(best)) = *(last - 1);
+				--remaining[v];
+			}
+			for (auto v : cache)
+			{
+				if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())  newCache.push_back(v);
+			}
+
+			// Vertices pushed out of the cache lose their cache score
+			for (size_t i = OPTIMISE_CACHE_SIZE; i < newCache.size(); ++i)  vertexScore[newCache[i]] = VertexCacheScore(-1, remaining[newCache[i]]);
+			if (newCache.size() > OPTIMISE_CACHE_SIZE)  newCache.resize(OPTIMISE_CACHE_SIZE);
+			cache.swap(newCache);
+
+			// Rescore the vertices in the cache and their triangles, picking the best of those triangles for the next step
+			for (size_t i = 0; i < cache.size(); ++i)  vertexScore[cache[i]] = VertexCacheScore(static_cast<int>(i), remaining[cache[i]]);
+			best = -1;
+			float bestScore = -1;
+			for (auto v : cache)
+			{
+				for (uint32_t t = 0; t < remaining[v]; ++t)
+				{
+					uint32_t triangle = vertexTriangles[firstTriangle[v] + t];
+					float score = vertexScore[indices[triangle * 3]] + vertexScore[indices[triangle * 3 + 1]] + vertexScore[indices[triangle * 3 + 2]];
+					if (score > bestScore)
+					{
+						bestScore = score;
+						best = static_cast<int>(triangle);
+					}
+				}
+			}
+		}
+		std::copy(output.begin(), output.end(), indices);
+	}
+
+
+	// Simulated FIFO post-transform cache. A vertex is in the cache if it was transformed within the last cacheSize misses
+	class FifoCache
+	{
+	public:
+		FifoCache(uint32_t numVertices, unsigned int cacheSize) : mMissTime(numVertices, 0), mTime(cacheSize + 1), mSize(cacheSize) {}
+
+		// Number of vertices of the triangle that had to be transformed
+		unsigned int AddTriangle(const uint32_t* triangle)
+		{
+			unsigned int misses = 0;
+			for (int c = 0; c < 3; ++c)
+			{
+				if (mTime - mMissTime[triangle[c]] > mSize)
+				{
+					mMissTime[triangle[c]] = mTime++;
+					++misses;
+				}
+			}
+			return misses;
+		}
+
+		void Flush()  { mTime += mSize + 1; }
+
+	private:
+		std::vector<unsigned int> mMissTime;
+		unsigned int              mTime;
+		unsigned int              mSize;
+	};
+
+
+	// Split the triangles into clusters and sort them to reduce overdraw, keeping the order within each cluster
+	void OptimiseOverdraw(uint32_t* indices, size_t numIndices, const std::vector<CVector3>& positions)
+	{
+		size_t numTriangles = numIndices / 3;
+		if (numTriangles < 2)  return;
+		uint32_t numVertices = static_cast<uint32_t>(positions.size());
+
+		// Start a cluster wherever a triangle misses the cache on all three vertices - a new patch of the mesh
+		std::vector<size_t> hardStarts;
+		FifoCache cache(numVertices, MEASURE_CACHE_SIZE);
+		for (size_t t = 0; t < numTriangles; ++t)
+		{
+			if (cache.AddTriangle(&indices[t * 3]) == 3 || t == 0)  hardStarts.push_back(t);
+		}
+		hardStarts.push_back(numTriangles);
+
+		// Then split each of those where the ACMR so far is already within the threshold of the cluster's ACMR. The cache is
+		// flushed at each split as the clusters will be drawn in a different order
+		std::vector<size_t> starts;
+		for (size_t h = 0; h + 1 < hardStarts.size(); ++h)
+		{
+			size_t start = hardStarts[h], end = hardStarts[h + 1];
+			cache.Flush();
+			unsigned int clusterMisses = 0;
+			for (size_t t = start; t < end; ++t)  clusterMisses += cache.AddTriangle(&indices[t * 3]);
+			float threshold = CLUSTER_THRESHOLD * clusterMisses / (end - start);
+
+			starts.push_back(start);
+			cache.Flush();
+			unsigned int misses = 0, triangles = 0;
+			for (size_t t = start; t < end - 1; ++t)
+			{
+				misses += cache.AddTriangle(&indices[t * 3]);
+				++triangles;
+				if (static_cast<float>(misses) / triangles <= threshold)
+				{
+					starts.push_back(t + 1);
+					cache.Flush();
+					misses = triangles = 0;
+				}
+			}
+		}
+		starts.push_back(numTriangles);
+
+		// Centre of the sub-mesh, weighted by area
+		CVector3 meshCentre = { 0, 0, 0 };
+		float meshArea = 0;
+		for (size_t t = 0; t < numTriangles; ++t)
+		{
+			const CVector3& p0 = positions[indices[t * 3]];
+			const CVector3& p1 = positions[indices[t * 3 + 1]];
+			const CVector3& p2 = positions[indices[t * 3 + 2]];
+			float area = Length(Cross(p1 - p0, p2 - p0));
+			meshCentre = meshCentre + (p0 + p1 + p2) * (area / 3);
+			meshArea += area;
+		}
+		if (meshArea > 0)  meshCentre = meshCentre * (1.0f / meshArea);
+
+		// Sort the clusters by how far out they are from the centre in the direction they face
+		struct Cluster
+		{
+			size_t start;
+			size_t end;
+			float  sortValue;
+		};
+		std::vector<Cluster> clusters;
+		for (size_t c = 0; c + 1 < starts.size(); ++c)
+		{
+			CVector3 centre = { 0, 0, 0 }, normal = { 0, 0, 0 };
+			float area = 0;
+			for (size_t t = starts[c]; t < starts[c + 1]; ++t)
+			{
+				const CVector3& p0 = positions[indices[t * 3]];
+				const CVector3& p1 = positions[indices[t * 3 + 1]];
+				const CVector3& p2 = positions[indices[t * 3 + 2]];
+				CVector3 triangleNormal = Cross(p1 - p0, p2 - p0); // Length is twice the area
+				float triangleArea = Length(triangleNormal);
+				centre = centre + (p0 + p1 + p2) * (triangleArea / 3);
+				normal = normal + triangleNormal;
+				area += triangleArea;
+			}
+			float normalLength = Length(normal);
+			float sortValue = 0;
+			if (area > 0 && normalLength > 0)  sortValue = Dot(centre * (1.0f / area) - meshCentre, normal * (1.0f / normalLength));
+			clusters.push_back({ starts[c], starts[c + 1], sortValue });
+		}
+		std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortValue > b.sortValue; });
+
+		std::vector<uint32_t> output;
+		output.reserve(numIndices);
+		for (auto& cluster : clusters)  output.insert(output.end(), indices + cluster.start * 3, indices + cluster.end * 3);
+		std::copy(output.begin(), output.end(), indices);
+	}
+
+
+	// Add the cache misses of a triangle list to the running totals
+	void MeasureVertexCache(const uint32_t* indices, size_t numIndices, uint32_t numVertices, size_t& misses, size_t& triangles)
+	{
+		FifoCache cache(numVertices, MEASURE_CACHE_SIZE);
+		for (size_t i = 0; i + 2 < numIndices; i += 3)  misses += cache.AddTriangle(&indices[i]);
+		triangles += numIndices / 3;
+	}
+}
+
+
+// Post-transform cache statistics for all the sub-meshes of a mesh, which must have 32-bit indices
+MeshCacheStats MeasureVertexCache(const CookedMesh& mesh)
+{
+	size_t misses = 0, triangles = 0, vertices = 0;
+	for (auto& subMesh : mesh.subMeshes)
+	{
+		if (subMesh.indexFormat != DXGI_FORMAT_R32_UINT)  continue;
+		MeasureVertexCache(reinterpret_cast<const uint32_t*>(subMesh.indices), subMesh.numIndices, subMesh.numVertices, misses, triangles);
+		vertices += subMesh.numVertices;
+	}
+
+	MeshCacheStats stats;
+	if (triangles > 0)  stats.acmr = static_cast<float>(misses) / triangles;
+	if (vertices  > 0)  stats.atvr = static_cast<float>(misses) / vertices;
+	return stats;
+}
+
+
+// Reorder the triangles of each sub-mesh for the vertex cache and overdraw, then the vertices for fetch locality
+void OptimiseMesh(CookedMesh& mesh)
+{
+	for (auto& subMesh : mesh.subMeshes)
+	{
+		if (subMesh.indexFormat != DXGI_FORMAT_R32_UINT || subMesh.numIndices < 3)  continue;
+
+		// Work on a copy of the indices, the originals may be in a file image
+		uint32_t* indices = mesh.importedData.AllocateArray<uint32_t>(subMesh.numIndices);
+		std::memcpy(indices, subMesh.indices, subMesh.numIndices * sizeof(uint32_t));
+
+		unsigned int positionOffset = 0;
+		for (auto& element : subMesh.vertexElements)
+		{
+			if (std::strcmp(element.SemanticName, "position") == 0)  positionOffset = element.AlignedByteOffset;
+		}
+		std::vector<CVector3> positions(subMesh.numVertices);
+		for (unsigned int v = 0; v < subMesh.numVertices; ++v)
+		{
+			std::memcpy(&positions[v], subMesh.vertices + static_cast<size_t>(v) * subMesh.vertexSize + positionOffset, sizeof(float) * 3);
+		}
+
+		OptimiseVertexCache(indices, subMesh.numIndices, subMesh.numVertices);
+		OptimiseOverdraw(indices, subMesh.numIndices, positions);
+
+		// Number the vertices in the order they are first used, then copy them into that order
+		const uint32_t UNUSED = 0xffffffff;
+		ArenaScope scratch(ImportArena());
+		ArenaVector<uint32_t> newIndex(subMesh.numVertices, UNUSED, ArenaAllocator<uint32_t>(ImportArena()));
+		uint32_t numUsed = 0;
+		for (unsigned int i = 0; i < subMesh.numIndices; ++i)
+		{
+			if (newIndex[indices[i]] == UNUSED)  newIndex[indices[i]] = numUsed++;
+			indices[i] = newIndex[indices[i]];
+		}
+		unsigned char* vertices = mesh.importedData.AllocateArray<unsigned char>(static_cast<size_t>(numUsed) * subMesh.vertexSize);
+		for (unsigned int v = 0; v < subMesh.numVertices; ++v)
+		{
+			if (newIndex[v] == UNUSED)  continue;
+			std::memcpy(vertices + static_cast<size_t>(newIndex[v]) * subMesh.vertexSize,
+			            subMesh.vertices + static_cast<size_t>(v) * subMesh.vertexSize, subMesh.vertexSize);
+		}
+
+		subMesh.numVertices = numUsed;
+		subMesh.vertices = vertices; // The old data stays until the mesh is destroyed
+		subMesh.indices  = reinterpret_cast<const unsigned char*>(indices);
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Levels of detail
+//--------------------------------------------------------------------------------------
+// Each level is made from the full detail triangles by repeatedly collapsing edges, cheapest first, where the cost is
+// the quadric error of the collapse (Garland & Heckbert, "Surface Simplification Using Quadric Error Metrics"). A vertex
+// is always collapsed onto one of its neighbours rather than a new position, so every level uses the same vertices and
+// only needs its own indices. Vertices on an open border, or on a seam where several vertices share a position (e.g.
+// different UVs either side), are never moved so holes and texture seams don't open up. Collapses that would flip a
+// triangle over are skipped
+
+namespace
+{
+	const int   MAX_SIMPLIFY_PASSES = 32;   // Each pass makes a set of collapses that don't touch each other
+	const float MIN_LOD_REDUCTION   = 0.8f; // Stop making levels when one has more than this fraction of the last one's triangles
+
+	// Sum of squared distances to a set of planes, as a symmetric 4x4 matrix
+	struct Quadric
+	{
+		double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+		// Add the plane ax + by + cz + d = 0, with a unit normal
+		void AddPlane(double a, double b, double c, double d)
+		{
+			a2 += a * a;  ab += a * b;  ac += a * c;  ad += a * d;
+			b2 += b * b;  bc += b * c;  bd += b * d;
+			c2 += c * c;  cd += c * d;
+			d2 += d * d;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a2 += q.a2;  ab += q.ab;  ac += q.ac;  ad += q.ad;  b2 += q.b2;
+			bc += q.bc;  bd += q.bd;  c2 += q.c2;  cd += q.cd;  d2 += q.d2;
+		}
+
+		double Error(const CVector3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			return x * x * a2 + y * y * b2 + z * z * c2 + 2 * (x * y * ab + x * z * ac + y * z * bc + x * ad + y * bd + z * cd) + d2;
+		}
+	};
+
+	// Simplify a triangle list towards the target number of triangles, keeping the locked vertices where they are.
+	// Returns the simplified indices and the error of the most expensive collapse as a distance
+	std::vector<uint32_t> SimplifyTriangles(const std::vector<CVector3>& positions, const std::vector<bool>& locked,
+	                                        std::vector<uint32_t> indices, size_t targetTriangles, float& error)
+	{
+		const uint32_t numVertices = static_cast<uint32_t>(positions.size());
+		error = 0;
+
+		// Each vertex starts with the planes of the triangles around it
+		std::vector<Quadric> quadrics(numVertices);
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			const CVector3& p0 = positions[indices[i]];
+			CVector3 normal = Cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+			float length = Length(normal);
+			if (length == 0)  continue;
+			normal = normal * (1.0f / length);
+			double d = -Dot(normal, p0);
+			for (int c = 0; c < 3; ++c)  quadrics[indices[i + c]].AddPlane(normal.x, normal.y, normal.z, d);
+		}
+
+		struct Collapse
+		{
+			uint32_t from;
+			uint32_t to;
+			double   cost;
+		};
+		std::vector<uint32_t> firstTriangle, triangles, remap(numVertices);
+		std::vector<Collapse> collapses;
+		std::vector<bool>     touched;
+
+		for (int pass = 0; pass < MAX_SIMPLIFY_PASSES && indices.size() / 3 > targetTriangles; ++pass)
+		{
+			// List the triangles around each vertex
+			firstTriangle.assign(numVertices + 1, 0);
+			for (auto index : indices)  ++firstTriangle[index + 1];
+			for (uint32_t v = 0; v < numVertices; ++v)  firstTriangle[v + 1] += firstTriangle[v];
+			triangles.resize(indices.size());
+			std::vector<uint32_t> next(firstTriangle.begin(), firstTriangle.end() - 1);
+			for (size_t i = 0; i < indices.size(); ++i)  triangles[next[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+			// Find the cheapest collapse of each vertex that can move onto one of its neighbours
+			collapses.clear();
+			for (uint32_t v = 0; v < numVertices; ++v)
+			{
+				if (locked[v])  continue;
+				Collapse best = { v, v, 0 };
+				for (uint32_t t = firstTriangle[v]; t < firstTriangle[v + 1]; ++t)
+				{
+					for (int c = 0; c < 3; ++c)
+					{
+						uint32_t w = indices[triangles[t] * 3 + c];
+						if (w == v)  continue;
+						Quadric combined = quadrics[v];
+						combined.Add(quadrics[w]);
+						double cost = combined.Error(positions[w]);
+						if (best.to == v || cost < best.cost)  best = { v, w, cost };
+					}
+				}
+				if (best.to != v)  collapses.push_back(best);
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+			// Make the cheapest collapses, skipping any that involve a triangle already changed in this pass
+			for (uint32_t v = 0; v < numVertices; ++v)  remap[v] = v;
+			touched.assign(numVertices, false);
+			size_t removeTriangles = indices.size() / 3 - targetTriangles;
+			size_t removed = 0;
+			for (auto& collapse : collapses)
+			{
+				if (removed >= removeTriangles)  break;
+				if (touched[collapse.from] || touched[collapse.to])  continue;
+
+				// Check that no triangle kept around the vertex turns over when it moves
+				bool flips = false;
+				size_t collapsed = 0;
+				for (uint32_t t = firstTriangle[collapse.from]; t < firstTriangle[collapse.from + 1] && !flips; ++t)
+				{
+					const uint32_t* triangle = &indices[triangles[t] * 3];
+					if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+					{
+						++collapsed;
+						continue;
+					}
+					CVector3 corners[3], moved[3];
+					for (int c = 0; c < 3; ++c)
+					{
+						corners[c] = positions[triangle[c]];
+						moved[c] = (triangle[c] == collapse.from ? positions[collapse.to] : corners[c]);
+					}
+					CVector3 before = Cross(corners[1] - corners[0], corners[2] - corners[0]);
+					CVector3 after  = Cross(moved[1]   - moved[0],   moved[2]   - moved[0]);
+					flips = (Dot(before, after) <= 0.25f * Length(before) * Length(after)); // Also rejects triangles becoming degenerate
+				}
+				if (flips)  continue;
+
+				remap[collapse.from] = collapse.to;
+				quadrics[collapse.to].Add(quadrics[collapse.from]);
+				for (uint32_t t = firstTriangle[collapse.from]; t < firstTriangle[collapse.from + 1]; ++t)
+				{
+					for (int c = 0; c < 3; ++c)  touched[indices[triangles[t] * 3 + c]] = true;
+				}
+				removed += collapsed;
+				error = std::max(error, static_cast<float>(std::sqrt(std::max(collapse.cost, 0.0))));
+			}
+			if (removed == 0)  break; // Nothing else can be collapsed
+
+			// Move the collapsed vertices and drop the triangles that have become degenerate
+			size_t kept = 0;
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				uint32_t a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+				if (a == b || b == c || c == a)  continue;
+				indices[kept++] = a;
+				indices[kept++] = b;
+				indices[kept++] = c;
+			}
+			indices.resize(kept);
+		}
+		return indices;
+	}
+}
+
+
+// Add simplified levels of detail to each sub-mesh, each with about half the triangles of the last
+void GenerateLods(CookedMesh& mesh, int numLods)
+{
+	for (auto& subMesh : mesh.subMeshes)
+	{
+		subMesh.lods.clear();
+		if (subMesh.indexFormat != DXGI_FORMAT_R32_UINT || subMesh.numIndices < 3)  continue;
+
+		// Read the positions and indices
+		unsigned int positionOffset = 0;
+		for (auto& element : subMesh.vertexElements)
+		{
+			if (std::strcmp(element.SemanticName, "position") == 0)  positionOffset = element.AlignedByteOffset;
+		}
+		std::vector<CVector3> positions(subMesh.numVertices);
+		for (unsigned int v = 0; v < subMesh.numVertices; ++v)
+		{
+			std::memcpy(&positions[v], subMesh.vertices + static_cast<size_t>(v) * subMesh.vertexSize + positionOffset, sizeof(float) * 3);
+		}
+		std::vector<uint32_t> indices(subMesh.numIndices);
+		std::memcpy(indices.data(), subMesh.indices, subMesh.numIndices * sizeof(uint32_t));
+
+		// Lock vertices that share their position with another vertex (seams)...
+		std::vector<bool> locked(subMesh.numVertices, false);
+		std::vector<uint32_t> byPosition(subMesh.numVertices);
+		for (uint32_t v = 0; v < subMesh.numVertices; ++v)  byPosition[v] = v;
+		auto positionLess = [&positions](uint32_t a, uint32_t b)
+		{
+			const CVector3& p = positions[a];
+			const CVector3& q = positions[b];
+			return p.x < q.x || (p.x == q.x && (p.y < q.y || (p.y == q.y && p.z < q.z)));
+		};
+		std::sort(byPosition.begin(), byPosition.end(), positionLess);
+		for (size_t i = 1; i < byPosition.size(); ++i)
+		{
+			if (!positionLess(byPosition[i - 1], byPosition[i]))  locked[byPosition[i - 1]] = locked[byPosition[i]] = true;
+		}
+
+		// ...and those on an edge used by only one triangle (open borders). An edge used in both directions is shared
+		std::vector<uint64_t> edges;
+		edges.reserve(indices.size());
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				uint64_t a = indices[i + c], b = indices[i + (c + 1) % 3];
+				edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for (size_t i = 0; i < edges.size(); )
+		{
+			size_t end = i + 1;
+			while (end < edges.size() && edges[end] == edges[i])  ++end;
+			if (end - i == 1)  locked[edges[i] >> 32] = locked[edges[i] & 0xffffffff] = true;
+			i = end;
+		}
+
+		// Each level is simplified from the full detail triangles, so its error is measured against the original surface
+		size_t lastTriangles = indices.size() / 3;
+		for (int lod = 1; lod <= numLods; ++lod)
+		{
+			float error;
+			std::vector<uint32_t> lodIndices = SimplifyTriangles(positions, locked, indices, (indices.size() / 3) >> lod, error);
+			if (lodIndices.empty() || lodIndices.size() / 3 > lastTriangles * MIN_LOD_REDUCTION)  break;
+			lastTriangles = lodIndices.size() / 3;
+			OptimiseVertexCache(lodIndices.data(), lodIndices.size(), subMesh.numVertices); // Collapses leave the triangles in a poor order
+
+			uint32_t* data = mesh.importedData.AllocateArray<uint32_t>(lodIndices.size());
+			std::memcpy(data, lodIndices.data(), lodIndices.size() * sizeof(uint32_t));
+			CookedMesh::SubMesh::Lod level;
+			level.numIndices = static_cast<unsigned int>(lodIndices.size());
+			level.indices    = reinterpret_cast<const unsigned char*>(data);
+			level.error      = std::max(error, subMesh.lods.empty() ? 0.0f : subMesh.lods.back().error); // Coarser is never better
+			subMesh.lods.push_back(level);
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+
+// A cooked texture is a DDS file holding the image and a full mip chain made with a box filter. It is block compressed to
+// BC1, or BC3 if the image has any alpha, using a quarter or half of the memory of 32-bit RGBA.
+// The app would otherwise generate the mip-maps on the GPU after decoding the image, which needs the immediate context
+
+namespace
+{
+	// Minimal DDS file structures, see "DDS Programming Guide" in the DirectX documentation
+	const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+
+	const uint32_t DDSD_CAPS        = 0x1;
+	const uint32_t DDSD_HEIGHT      = 0x2;
+	const uint32_t DDSD_WIDTH       = 0x4;
+	const uint32_t DDSD_PITCH       = 0x8;
+	const uint32_t DDSD_PIXELFORMAT = 0x1000;
+	const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+	const uint32_t DDSD_LINEARSIZE  = 0x80000;
+	const uint32_t DDPF_ALPHAPIXELS = 0x1;
+	const uint32_t DDPF_FOURCC      = 0x4;
+	const uint32_t DDPF_RGB         = 0x40;
+	const uint32_t FOURCC_DXT1      = 0x31545844; // "DXT1", read by the DDS loader as DXGI_FORMAT_BC1_UNORM
+	const uint32_t FOURCC_DXT5      = 0x35545844; // "DXT5", read as DXGI_FORMAT_BC3_UNORM
+	const uint32_t FOURCC_DXT3      = 0x33545844; // "DXT3", read as DXGI_FORMAT_BC2_UNORM
+	const uint32_t FOURCC_DX10      = 0x30315844; // "DX10", a DDSHeaderDX10 follows the header
+	const uint32_t DDSCAPS_COMPLEX  = 0x8;
+	const uint32_t DDSCAPS_TEXTURE  = 0x1000;
+	const uint32_t DDSCAPS_MIPMAP   = 0x400000;
+	const uint32_t DDSCAPS2_CUBEMAP = 0x200;
+	const uint32_t DDSCAPS2_VOLUME  = 0x200000;
+	const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+	const uint32_t DDS_MISC_TEXTURECUBE    = 0x4;
+
+	struct DDSPixelFormat
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t rBitMask;
+		uint32_t gBitMask;
+		uint32_t bBitMask;
+		uint32_t aBitMask;
+	};
+
+	struct DDSHeader
+	{
+		uint32_t       size;
+		uint32_t       flags;
+		uint32_t       height;
+		uint32_t       width;
+		uint32_t       pitchOrLinearSize;
+		uint32_t       depth;
+		uint32_t       mipMapCount;
+		uint32_t       reserved1[11];
+		DDSPixelFormat pixelFormat;
+		uint32_t       caps;
+		uint32_t       caps2;
+		uint32_t       caps3;
+		uint32_t       caps4;
+		uint32_t       reserved2;
+	};
+
+	struct DDSHeaderDX10
+	{
+		uint32_t dxgiFormat;
+		uint32_t resourceDimension;
+		uint32_t miscFlag;
+		uint32_t arraySize;
+		uint32_t miscFlags2;
+	};
+
+
+	// Releases a COM pointer when it goes out of scope
+	template <class T> struct ComRelease
+	{
+		T* p = nullptr;
+		~ComRelease()  { if (p)  p->Release(); }
+	};
+
+
+	// Decode an image file to 32-bit RGBA with WIC
+	bool DecodeImage(const std::string& fileName, CookedTexture::Mip& image, std::string& error)
+	{
+		ComRelease<IWICImagingFactory>    factory;
+		ComRelease<IWICBitmapDecoder>     decoder;
+		ComRelease<IWICBitmapFrameDecode> frame;
+		ComRelease<IWICBitmapSource>      converted;
+
+		std::wstring wideName(MultiByteToWideChar(CP_ACP, 0, fileName.c_str(), -1, nullptr, 0), L'\0');
+		MultiByteToWideChar(CP_ACP, 0, fileName.c_str(), -1, &wideName[0], static_cast<int>(wideName.size()));
+		if (FAILED(CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory.p))))
+		{
+			error = "Cannot create WIC imaging factory";
+			return false;
+		}
+		if (FAILED(factory.p->CreateDecoderFromFilename(wideName.c_str(), nullptr, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &decoder.p)) ||
+		    FAILED(decoder.p->GetFrame(0, &frame.p)))
+		{
+			error = "Cannot decode image";
+			return false;
+		}
+		if (FAILED(WICConvertBitmapSource(GUID_WICPixelFormat32bppRGBA, frame.p, &converted.p)) ||
+		    FAILED(converted.p->GetSize(&image.width, &image.height)) || image.width == 0 || image.height == 0)
+		{
+			error = "Cannot convert image to RGBA";
+			return false;
+		}
+
+		UINT stride = image.width * 4;
+		image.pixels.resize(static_cast<size_t>(stride) * image.height);
+		if (FAILED(converted.p->CopyPixels(nullptr, stride, static_cast<UINT>(image.pixels.size()), image.pixels.data())))
+		{
+			error = "Cannot read image pixels";
+			return false;
+		}
+		return true;
+	}
+
+
+	// Build the next mip level down by averaging 2x2 blocks of pixels. Odd sizes repeat the last row / column
+	CookedTexture::Mip Downsample(const CookedTexture::Mip& source)
+	{
+		CookedTexture::Mip mip;
+		mip.width  = (source.width  > 1) ? source.width  / 2 : 1;
+		mip.height = (source.height > 1) ? source.height / 2 : 1;
+		mip.pixels.resize(static_cast<size_t>(mip.width) * mip.height * 4);
+
+		for (uint32_t y = 0; y < mip.height; ++y)
+		{
+			uint32_t y0 = std::min(y * 2, source.height - 1);
+			uint32_t y1 = std::min(y * 2 + 1, source.height - 1);
+			for (uint32_t x = 0; x < mip.width; ++x)
+			{
+				uint32_t x0 = std::min(x * 2, source.width - 1);
+				uint32_t x1 = std::min(x * 2 + 1, source.width - 1);
+				const uint8_t* p00 = &source.pixels[(static_cast<size_t>(y0) * source.width + x0) * 4];
+				const uint8_t* p01 = &source.pixels[(static_cast<size_t>(y0) * source.width + x1) * 4];
+				const uint8_t* p10 = &source.pixels[(static_cast<size_t>(y1) * source.width + x0) * 4];
+				const uint8_t* p11 = &source.pixels[(static_cast<size_t>(y1) * source.width + x1) * 4];
+				uint8_t* out = &mip.pixels[(static_cast<size_t>(y) * mip.width + x) * 4];
+				for (int c = 0; c < 4; ++c)
+				{
+					out[c] = static_cast<uint8_t>((p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+				}
+			}
+		}
+		return mip;
+	}
+
+	//-----------------------------------
+	// Block compression
+	//-----------------------------------
+	// BC1 (DXT1) and BC3 (DXT5) compress each 4x4 block of pixels independently. The colours of a block are stored as two
+	// 5:6:5 end points and a 2-bit index per pixel choosing one of four colours along the line between them. BC3 adds a
+	// block of alpha, stored the same way with two 8-bit end points and 3-bit indexes. The end points are found from the
+	// principal axis of the block's colours, which gives good quality for a fast encoder
+
+	// Expand a 5:6:5 colour to 8 bits per channel
+	void Decode565(uint16_t colour, int rgb[3])
+	{
+		int r = (colour >> 11) & 31, g = (colour >> 5) & 63, b = colour & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	uint16_t Encode565(const float rgb[3])
+	{
+		int r = std::min(std::max(static_cast<int>(rgb[0] * 31.0f / 255.0f + 0.5f), 0), 31);
+		int g = std::min(std::max(static_cast<int>(rgb[1] * 63.0f / 255.0f + 0.5f), 0), 63);
+		int b = std::min(std::max(static_cast<int>(rgb[2] * 31.0f / 255.0f + 0.5f), 0), 31);
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+
+	// Get the 4x4 block of pixels with its top-left at x, y. Blocks overlapping the edge of a small mip repeat the last pixels
+	void ReadBlock(const CookedTexture::Mip& mip, uint32_t x, uint32_t y, uint8_t pixels[16][4])
+	{
+		for (uint32_t by = 0; by < 4; ++by)
+		{
+			for (uint32_t bx = 0; bx < 4; ++bx)
+			{
+				uint32_t px = std::min(x + bx, mip.width  - 1);
+				uint32_t py = std::min(y + by, mip.height - 1);
+				std::memcpy(pixels[by * 4 + bx], &mip.pixels[(static_cast<size_t>(py) * mip.width + px) * 4], 4);
+			}
+		}
+	}
+
+
+	// Write the 8 byte BC1 colour block for 16 pixels. Always uses the four colour mode (colour0 > colour1), which is also
+	// the only mode of the colour part of BC3
+	void CompressColourBlock(const uint8_t pixels[16][4], uint8_t* block)
+	{
+		// Mean and covariance of the colours
+		float mean[3] = { 0, 0, 0 };
+		for (int p = 0; p < 16; ++p)  for (int c = 0; c < 3; ++c)  mean[c] += pixels[p][c] / 16.0f;
+		float covariance[6] = { 0, 0, 0, 0, 0, 0 }; // rr, rg, rb, gg, gb, bb
+		for (int p = 0; p < 16; ++p)
+		{
+			float d[3] = { pixels[p][0] - mean[0], pixels[p][1] - mean[1], pixels[p][2] - mean[2] };
+			covariance[0] += d[0] * d[0];  covariance[1] += d[0] * d[1];  covariance[2] += d[0] * d[2];
+			covariance[3] += d[1] * d[1];  covariance[4] += d[1] * d[2];  covariance[5] += d[2] * d[2];
+		}
+
+		// Principal axis by power iteration
+		float axis[3] = { 1, 1, 1 };
+		for (int i = 0; i < 8; ++i)
+		{
+			float next[3] = { covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+			                  covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+			                  covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2] };
+			float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+			if (length < 1e-6f)  break; // All the same colour
+			for (int c = 0; c < 3; ++c)  axis[c] = next[c] / length;
+		}
+
+		// End points are the extremes of the colours projected on the axis
+		float minT = 0, maxT = 0;
+		for (int p = 0; p < 16; ++p)
+		{
+			float t = (pixels[p][0] - mean[0]) * axis[0] + (pixels[p][1] - mean[1]) * axis[1] + (pixels[p][2] - mean[2]) * axis[2];
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+		float end0[3], end1[3];
+		for (int c = 0; c < 3; ++c)
+		{
+			end0[c] = mean[c] + axis[c] * maxT;
+			end1[c] = mean[c] + axis[c] * minT;
+		}
+		uint16_t colour0 = Encode565(end0);
+		uint16_t colour1 = Encode565(end1);
+		if (colour0 < colour1)  std::swap(colour0, colour1);
+
+		// Choose the nearest of the four palette colours for each pixel. If the end points are equal every index is 0
+		uint32_t indices = 0;
+		if (colour0 != colour1)
+		{
+			int palette[4][3];
+			Decode565(colour0, palette[0]);
+			Decode565(colour1, palette[1]);
+			for (int c = 0; c < 3; ++c)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			for (int p = 0; p < 16; ++p)
+			{
+				int best = 0, bestError = INT_MAX;
+				for (int i = 0; i < 4; ++i)
+				{
+					int dr = pixels[p][0] - palette[i][0], dg = pixels[p][1] - palette[i][1], db = pixels[p][2] - palette[i][2];
+					int error = dr * dr + dg * dg + db * db;
+					if (error < bestError)  { best = i;  bestError = error; }
+				}
+				indices |= static_cast<uint32_t>(best) << (p * 2);
+			}
+		}
+
+		std::memcpy(block,     &colour0, 2);
+		std::memcpy(block + 2, &colour1, 2);
+		std::memcpy(block + 4, &indices, 4);
+	}
+
+
+	// Write the 8 byte BC3 alpha block for 16 pixels, using the eight value mode (alpha0 > alpha1)
+	void CompressAlphaBlock(const uint8_t pixels[16][4], uint8_t* block)
+	{
+		int alpha0 = 0, alpha1 = 255;
+		for (int p = 0; p < 16; ++p)
+		{
+			alpha0 = std::max(alpha0, static_cast<int>(pixels[p][3]));
+			alpha1 = std::min(alpha1, static_cast<int>(pixels[p][3]));
+		}
+
+		uint64_t indices = 0;
+		if (alpha0 != alpha1)
+		{
+			int palette[8] = { alpha0, alpha1 };
+			for (int i = 1; i < 7; ++i)  palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+			for (int p = 0; p < 16; ++p)
+			{
+				int best = 0, bestError = INT_MAX;
+				for (int i = 0; i < 8; ++i)
+				{
+					int error = std::abs(pixels[p][3] - palette[i]);
+					if (error < bestError)  { best = i;  bestError = error; }
+				}
+				indices |= static_cast<uint64_t>(best) << (p * 3);
+			}
+		}
+
+		block[0] = static_cast<uint8_t>(alpha0);
+		block[1] = static_cast<uint8_t>(alpha1);
+		for (int i = 0; i < 6; ++i)  block[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+	}
+
+
+	// Compress a whole mip level to BC1 (8 bytes per block) or BC3 (16 bytes per block, alpha first)
+	std::vector<uint8_t> CompressMip(const CookedTexture::Mip& mip, bool alpha)
+	{
+		uint32_t blocksX = (mip.width + 3) / 4, blocksY = (mip.height + 3) / 4;
+		size_t blockSize = alpha ? 16 : 8;
+		std::vector<uint8_t> compressed(static_cast<size_t>(blocksX) * blocksY * blockSize);
+
+		uint8_t* block = compressed.data();
+		uint8_t pixels[16][4];
+		for (uint32_t y = 0; y < blocksY; ++y)
+		{
+			for (uint32_t x = 0; x < blocksX; ++x)
+			{
+				ReadBlock(mip, x * 4, y * 4, pixels);
+				if (alpha)
+				{
+					CompressAlphaBlock(pixels, block);
+					block += 8;
+				}
+				CompressColourBlock(pixels, block);
+				block += 8;
+			}
+		}
+		return compressed;
+	}
+
+
+	// Check if any pixel of the full size image is not fully opaque
+	bool HasAlpha(const CookedTexture::Mip& mip)
+	{
+		for (size_t i = 3; i < mip.pixels.size(); i += 4)  if (mip.pixels[i] != 255)  return true;
+		return false;
+	}
+}
+
+
+// Decode an image file with WIC and build its mip chain. Returns false on failure with the reason in error.
+// COM must have been initialised on the calling thread
+bool DecodeTexture(const std::string& fileName, CookedTexture& texture, std::string& error)
+{
+	texture.mips.resize(1);
+	if (!DecodeImage(fileName, texture.mips[0], error))  return false;
+	while (texture.mips.back().width > 1 || texture.mips.back().height > 1)
+	{
+		texture.mips.push_back(Downsample(texture.mips.back()));
+	}
+	return true;
+}
+
+
+// Bilinear resample of the best mip level, see header
+void ResizeTexture(CookedTexture& texture, uint32_t width, uint32_t height)
+{
+	if (texture.mips.empty() || (texture.mips[0].width == width && texture.mips[0].height == height))  return;
+
+	size_t level = 0;
+	while (level + 1 < texture.mips.size() && texture.mips[level + 1].width >= width && texture.mips[level + 1].height >= height)
+	{
+		++level;
+	}
+	const CookedTexture::Mip& source = texture.mips[level];
+
+	CookedTexture::Mip resized;
+	resized.width  = width;
+	resized.height = height;
+	resized.pixels.resize(static_cast<size_t>(width) * height * 4);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		// Pixel centres map to pixel centres
+		float sy = std::max((y + 0.5f) * source.height / height - 0.5f, 0.0f);
+		uint32_t y0 = std::min(static_cast<uint32_t>(sy), source.height - 1);
+		uint32_t y1 = std::min(y0 + 1, source.height - 1);
+		float fy = sy - y0;
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			float sx = std::max((x + 0.5f) * source.width / width - 0.5f, 0.0f);
+			uint32_t x0 = std::min(static_cast<uint32_t>(sx), source.width - 1);
+			uint32_t x1 = std::min(x0 + 1, source.width - 1);
+			float fx = sx - x0;
+			const uint8_t* p00 = &source.pixels[(static_cast<size_t>(y0) * source.width + x0) * 4];
+			const uint8_t* p01 = &source.pixels[(static_cast<size_t>(y0) * source.width + x1) * 4];
+			const uint8_t* p10 = &source.pixels[(static_cast<size_t>(y1) * source.width + x0) * 4];
+			const uint8_t* p11 = &source.pixels[(static_cast<size_t>(y1) * source.width + x1) * 4];
+			uint8_t* out = &resized.pixels[(static_cast<size_t>(y) * width + x) * 4];
+			for (int c = 0; c < 4; ++c)
+			{
+				float top    = p00[c] + (p01[c] - p00[c]) * fx;
+				float bottom = p10[c] + (p11[c] - p10[c]) * fx;
+				out[c] = static_cast<uint8_t>(top + (bottom - top) * fy + 0.5f);
+			}
+		}
+	}
+
+	texture.mips.resize(1);
+	texture.mips[0] = std::move(resized);
+	while (texture.mips.back().width > 1 || texture.mips.back().height > 1)
+	{
+		texture.mips.push_back(Downsample(texture.mips.back()));
+	}
+}
+
+
+namespace
+{
+	const uint32_t DDSCAPS2_CUBEMAP_ALLFACES = 0xfc00; // +X, -X, +Y, -Y, +Z and -Z are all present
+
+	// Write images to a DDS file, each with all its mip levels: a single texture, or the faces of a cubemap in order.
+	// Block compressed if requested and possible. Returns false on failure with the reason in error
+	bool WriteDDS(const std::string& cookedFileName, const CookedTexture* images, size_t numImages, bool cubemap,
+	              std::string& error, bool compress)
+	{
+		auto& mips = images[0].mips;
+		if (mips.empty())
+		{
+			error = "No texture data for " + cookedFileName;
+			return false;
+		}
+
+		// Direct3D needs the top level of a block compressed texture to be whole blocks
+		if (mips[0].width % 4 != 0 || mips[0].height % 4 != 0)  compress = false;
+		bool alpha = false;
+		for (size_t i = 0; i < numImages && compress; ++i)  alpha = alpha || HasAlpha(images[i].mips[0]);
+
+		DDSHeader header = {};
+		header.size        = sizeof(DDSHeader);
+		header.flags       = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT;
+		header.height      = mips[0].height;
+		header.width       = mips[0].width;
+		header.mipMapCount = static_cast<uint32_t>(mips.size());
+		header.caps        = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+		header.caps2       = cubemap ? DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_ALLFACES : 0;
+		header.pixelFormat.size = sizeof(DDSPixelFormat);
+
+		std::vector<std::vector<uint8_t>> compressed;
+		if (compress)
+		{
+			for (size_t i = 0; i < numImages; ++i)
+			{
+				for (auto& mip : images[i].mips)  compressed.push_back(CompressMip(mip, alpha));
+			}
+
+			header.flags             |= DDSD_LINEARSIZE;
+			header.pitchOrLinearSize  = static_cast<uint32_t>(compressed[0].size());
+			header.pixelFormat.flags  = DDPF_FOURCC;
+			header.pixelFormat.fourCC = alpha ? FOURCC_DXT5 : FOURCC_DXT1;
+		}
+		else
+		{
+			// These masks are read by the DDS loader as DXGI_FORMAT_R8G8B8A8_UNORM, the same format as the WIC loader gives
+			header.flags                  |= DDSD_PITCH;
+			header.pitchOrLinearSize       = mips[0].width * 4;
+			header.pixelFormat.flags       = DDPF_RGB | DDPF_ALPHAPIXELS;
+			header.pixelFormat.rgbBitCount = 32;
+			header.pixelFormat.rBitMask    = 0x000000ff;
+			header.pixelFormat.gBitMask    = 0x0000ff00;
+			header.pixelFormat.bBitMask    = 0x00ff0000;
+			header.pixelFormat.aBitMask    = 0xff000000;
+		}
+
+		// Write to a temporary file then rename, so the app never loads a partly written texture
+		std::string tempFileName = cookedFileName + ".tmp";
+		{
+			std::ofstream file(tempFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+			{
+				error = "Cannot create " + tempFileName;
+				return false;
+			}
+			file.write(reinterpret_cast<const char*>(&DDS_MAGIC), sizeof(DDS_MAGIC));
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			size_t level = 0;
+			for (size_t i = 0; i < numImages; ++i)
+			{
+				for (auto& mip : images[i].mips)
+				{
+					auto& data = compress ? compressed[level] : mip.pixels;
+					file.write(reinterpret_cast<const char*>(data.data()), data.size());
+					++level;
+				}
+			}
+			if (file.fail())
+			{
+				file.close();
+				DeleteFileA(tempFileName.c_str());
+				error = "Cannot write " + tempFileName;
+				return false;
+			}
+		}
+		if (!MoveFileExA(tempFileName.c_str(), cookedFileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+		{
+			DeleteFileA(tempFileName.c_str());
+			error = "Cannot replace " + cookedFileName;
+			return false;
+		}
+		return true;
+	}
+
+
+	// Bilinear sample of an image at a uv, wrapping around horizontally and clamped vertically
+	void SamplePanorama(const CookedTexture::Mip& image, float u, float v, uint8_t out[4])
+	{
+		float sx = (u - std::floor(u)) * image.width - 0.5f;
+		float sy = std::min(std::max(v * image.height - 0.5f, 0.0f), image.height - 1.0f);
+		int   x0 = static_cast<int>(std::floor(sx));
+		int   y0 = static_cast<int>(sy);
+		float fx = sx - x0;
+		float fy = sy - y0;
+		uint32_t xa = static_cast<uint32_t>(x0 + static_cast<int>(image.width)) % image.width;
+		uint32_t xb = (xa + 1) % image.width;
+		uint32_t ya = static_cast<uint32_t>(y0);
+		uint32_t yb = std::min(ya + 1, image.height - 1);
+		const uint8_t* p00 = &image.pixels[(static_cast<size_t>(ya) * image.width + xa) * 4];
+		const uint8_t* p01 = &image.pixels[(static_cast<size_t>(ya) * image.width + xb) * 4];
+		const uint8_t* p10 = &image.pixels[(static_cast<size_t>(yb) * image.width + xa) * 4];
+		const uint8_t* p11 = &image.pixels[(static_cast<size_t>(yb) * image.width + xb) * 4];
+		for (int c = 0; c < 4; ++c)
+		{
+			float top    = p00[c] + (p01[c] - p00[c]) * fx;
+			float bottom = p10[c] + (p11[c] - p10[c]) * fx;
+			out[c] = static_cast<uint8_t>(top + (bottom - top) * fy + 0.5f);
+		}
+	}
+}
+
+
+// Write a decoded texture to a DDS file, block compressed if requested. Returns false on failure with the reason in error
+bool WriteCookedTexture(const std::string& cookedFileName, const CookedTexture& texture, std::string& error,
+                        bool compress /*= true*/)
+{
+	return WriteDDS(cookedFileName, &texture, 1, false, error, compress);
+}
+
+
+// Resample a panorama onto the faces of a cubemap, see header
+void PanoramaToCubemap(const CookedTexture& panorama, uint32_t faceSize, CookedTexture faces[NUM_CUBE_FACES])
+{
+	const float PI = 3.14159265f;
+	const CookedTexture::Mip& source = panorama.mips[0];
+	for (int face = 0; face < NUM_CUBE_FACES; ++face)
+	{
+		CookedTexture::Mip mip;
+		mip.width  = faceSize;
+		mip.height = faceSize;
+		mip.pixels.resize(static_cast<size_t>(faceSize) * faceSize * 4);
+		for (uint32_t y = 0; y < faceSize; ++y)
+		{
+			float t = (y + 0.5f) * 2 / faceSize - 1; // -1 to 1 down the face
+			for (uint32_t x = 0; x < faceSize; ++x)
+			{
+				// Direction through the pixel centre, with the faces laid out as Direct3D samples them
+				float s = (x + 0.5f) * 2 / faceSize - 1;
+				CVector3 direction;
+				switch (face)
+				{
+					case 0:  direction = {  1, -t, -s };  break; // +X
+					case 1:  direction = { -1, -t,  s };  break; // -X
+					case 2:  direction = {  s,  1,  t };  break; // +Y
+					case 3:  direction = {  s, -1, -t };  break; // -Y
+					case 4:  direction = {  s, -t,  1 };  break; // +Z
+					default: direction = { -s, -t, -1 };  break; // -Z
+				}
+				direction = Normalise(direction);
+
+				// The star sphere's uvs: u goes once around the y axis starting 45 degrees from +X towards +Z, v from
+				// the top to the bottom
+				float u = (std::atan2(direction.z, direction.x) - PI / 4) / (2 * PI);
+				float v = std::acos(std::min(std::max(direction.y, -1.0f), 1.0f)) / PI;
+				SamplePanorama(source, u, v, &mip.pixels[(static_cast<size_t>(y) * faceSize + x) * 4]);
+			}
+		}
+
+		faces[face].mips.resize(1);
+		faces[face].mips[0] = std::move(mip);
+		while (faces[face].mips.back().width > 1)
+		{
+			faces[face].mips.push_back(Downsample(faces[face].mips.back()));
+		}
+	}
+}
+
+
+// Write the faces of a cubemap to a DDS file, see header
+bool WriteCookedCubemap(const std::string& cookedFileName, const CookedTexture faces[NUM_CUBE_FACES], std::string& error,
+                        bool compress /*= true*/)
+{
+	return WriteDDS(cookedFileName, faces, NUM_CUBE_FACES, true, error, compress);
+}
+
+
+// Read the layout of a DDS file image holding a single 2D texture with mip-maps. Returns false if it is anything else, or
+// in a format not handled here
+bool ReadDDSLayout(const void* data, size_t size, DDSLayout& layout)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint32_t magic;
+	DDSHeader header;
+	if (size < sizeof(magic) + sizeof(header))  return false;
+	std::memcpy(&magic,  bytes, sizeof(magic));
+	std::memcpy(&header, bytes + sizeof(magic), sizeof(header));
+	if (magic != DDS_MAGIC || header.size != sizeof(DDSHeader) || header.pixelFormat.size != sizeof(DDSPixelFormat))  return false;
+	if ((header.caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME)) != 0 || header.width == 0 || header.height == 0 || header.mipMapCount < 2)
+	{
+		return false;
+	}
+
+	size_t offset = sizeof(magic) + sizeof(header);
+	layout.format = DXGI_FORMAT_UNKNOWN;
+	const DDSPixelFormat& pixelFormat = header.pixelFormat;
+	if ((pixelFormat.flags & DDPF_FOURCC) && pixelFormat.fourCC == FOURCC_DX10)
+	{
+		DDSHeaderDX10 header10;
+		if (size < offset + sizeof(header10))  return false;
+		std::memcpy(&header10, bytes + offset, sizeof(header10));
+		offset += sizeof(header10);
+		if (header10.resourceDimension != DDS_DIMENSION_TEXTURE2D || header10.arraySize != 1 ||
+		    (header10.miscFlag & DDS_MISC_TEXTURECUBE) != 0)
+		{
+			return false;
+		}
+		layout.format = static_cast<DXGI_FORMAT>(header10.dxgiFormat);
+	}
+	else if (pixelFormat.flags & DDPF_FOURCC)
+	{
+		if      (pixelFormat.fourCC == FOURCC_DXT1)  layout.format = DXGI_FORMAT_BC1_UNORM;
+		else if (pixelFormat.fourCC == FOURCC_DXT3)  layout.format = DXGI_FORMAT_BC2_UNORM;
+		else if (pixelFormat.fourCC == FOURCC_DXT5)  layout.format = DXGI_FORMAT_BC3_UNORM;
+	}
+	else if ((pixelFormat.flags & DDPF_RGB) && pixelFormat.rgbBitCount == 32 && pixelFormat.gBitMask == 0x0000ff00 &&
+	         pixelFormat.aBitMask == 0xff000000)
+	{
+		if      (pixelFormat.rBitMask == 0x000000ff && pixelFormat.bBitMask == 0x00ff0000)  layout.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		else if (pixelFormat.rBitMask == 0x00ff0000 && pixelFormat.bBitMask == 0x000000ff)  layout.format = DXGI_FORMAT_B8G8R8A8_UNORM;
+	}
+
+	// Bytes per 4x4 block for block compressed formats, or per pixel otherwise
+	uint32_t blockSize = 0;
+	bool     blocks    = true;
+	switch (layout.format)
+	{
+		case DXGI_FORMAT_BC1_UNORM: case DXGI_FORMAT_BC1_UNORM_SRGB:
+		case DXGI_FORMAT_BC4_UNORM: case DXGI_FORMAT_BC4_SNORM:
+			blockSize = 8;
+			break;
+		case DXGI_FORMAT_BC2_UNORM: case DXGI_FORMAT_BC2_UNORM_SRGB:
+		case DXGI_FORMAT_BC3_UNORM: case DXGI_FORMAT_BC3_UNORM_SRGB:
+		case DXGI_FORMAT_BC5_UNORM: case DXGI_FORMAT_BC5_SNORM:
+		case DXGI_FORMAT_BC6H_UF16: case DXGI_FORMAT_BC6H_SF16:
+		case DXGI_FORMAT_BC7_UNORM: case DXGI_FORMAT_BC7_UNORM_SRGB:
+			blockSize = 16;
+			break;
+		case DXGI_FORMAT_R8G8B8A8_UNORM: case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		case DXGI_FORMAT_B8G8R8A8_UNORM: case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+			blockSize = 4;
+			blocks = false;
+			break;
+		default:
+			return false;
+	}
+
+	// The mip levels follow each other with no padding, largest first
+	layout.blockCompressed = blocks;
+	layout.mips.resize(header.mipMapCount);
+	for (uint32_t m = 0; m < header.mipMapCount; ++m)
+	{
+		DDSLayout::Mip& mip = layout.mips[m];
+		mip.width    = std::max(header.width  >> std::min(m, 31u), 1u);
+		mip.height   = std::max(header.height >> std::min(m, 31u), 1u);
+		mip.rowPitch = blocks ? (mip.width  + 3) / 4 * blockSize : mip.width * blockSize;
+		mip.numRows  = blocks ? (mip.height + 3) / 4             : mip.height;
+		mip.offset   = offset;
+		offset += static_cast<size_t>(mip.rowPitch) * mip.numRows;
+		if (offset > size)  return false;
+	}
+	return true;
+}
+
+
+// Check if a cooked file was last written after its source file. False if either doesn't exist
+bool IsCookedFileNewer(const std::string& cookedFileName, const std::string& sourceFileName)
+{
+	WIN32_FILE_ATTRIBUTE_DATA cooked, source;
+	if (!GetFileAttributesExA(cookedFileName.c_str(), GetFileExInfoStandard, &cooked) ||
+	    !GetFileAttributesExA(sourceFileName.c_str(), GetFileExInfoStandard, &source))
+	{
+		return false;
+	}
+	return CompareFileTime(&cooked.ftLastWriteTime, &source.ftLastWriteTime) > 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Animation clips
+//--------------------------------------------------------------------------------------
+// Each channel of an assimp animation is resampled at CLIP_SAMPLE_RATE, then reduced with a greedy fit: from each kept
+// key, the next key is the furthest sample that linear interpolation can reach while staying within tolerance of every
+// sample in between. Playback interpolates the same way (see Animation.h), so the result follows the source to within
+// the tolerance. The kept keys are then quantised (see CookedClip). A channel with no keys holds the node's default
+
+namespace
+{
+	const float    CLIP_SAMPLE_RATE   = 30;      // Frames per second clips are resampled at
+	const float    MAX_CLIP_FRAMES    = 65535;   // Key times are 16-bit, so longer clips are sampled less often
+	const float    ROTATION_TOLERANCE = 0.002f;  // Radians a reduced rotation may turn away from the source
+	const float    POSITION_TOLERANCE = 0.001f;  // Distance a reduced position or scale may move from the source, as a
+	                                             // fraction of the largest range of the track's channel
+	const float    SQRT_HALF          = 0.70710678f;
+	const uint16_t QUANTISED_MAX      = 65535;
+
+	// Value of a channel at a time in ticks, interpolated linearly between the keys either side
+	aiVector3D SampleChannel(const aiVectorKey* keys, unsigned int numKeys, double time)
+	{
+		const aiVectorKey* next = std::upper_bound(keys, keys + numKeys, time,
+		                                           [](double time, const aiVectorKey& key) { return time < key.mTime; });
+		if (next == keys)            return keys[0].mValue;
+		if (next == keys + numKeys)  return keys[numKeys - 1].mValue;
+		const aiVectorKey* previous = next - 1;
+		float t = static_cast<float>((time - previous->mTime) / (next->mTime - previous->mTime));
+		return previous->mValue + (next->mValue - previous->mValue) * t;
+	}
+
+	// --"-- spherically for rotations
+	aiQuaternion SampleChannel(const aiQuatKey* keys, unsigned int numKeys, double time)
+	{
+		const aiQuatKey* next = std::upper_bound(keys, keys + numKeys, time,
+		                                         [](double time, const aiQuatKey& key) { return time < key.mTime; });
+		if (next == keys)            return keys[0].mValue;
+		if (next == keys + numKeys)  return keys[numKeys - 1].mValue;
+		const aiQuatKey* previous = next - 1;
+		aiQuaternion rotation;
+		aiQuaternion::Interpolate(rotation, previous->mValue, next->mValue,
+		                          static_cast<float>((time - previous->mTime) / (next->mTime - previous->mTime)));
+		return rotation;
+	}
+
+	// Convert an assimp rotation to the app's conventions through a matrix, as ReadNodes does for the node matrices
+	CQuaternion ToQuaternion(const aiQuaternion& rotation)
+	{
+		aiMatrix4x4 assimpMatrix(rotation.GetMatrix());
+		CMatrix4x4 matrix;
+		matrix.SetValues(&assimpMatrix.a1);
+		matrix.Transpose(); // Assimp stores matrices differently to this app
+		return Normalise(QuaternionFromMatrix(matrix));
+	}
+
+
+	// Indexes of the samples to keep as keys using the greedy fit above. fits(a, b, t, s) says whether interpolating
+	// samples a and b at t (0 to 1) is within tolerance of sample s. A channel that never moves keeps only its first sample
+	template <class Fits> std::vector<uint32_t> ReduceKeys(uint32_t numSamples, Fits fits)
+	{
+		std::vector<uint32_t> keys = { 0 };
+		bool constant = true;
+		for (uint32_t s = 1; s < numSamples && constant; ++s)  constant = fits(0, 0, 0.0f, s);
+		if (constant)  return keys;
+
+		uint32_t key = 0;
+		while (key + 1 < numSamples)
+		{
+			uint32_t end = key + 1;
+			while (end + 1 < numSamples)
+			{
+				uint32_t next = end + 1;
+				bool reaches = true;
+				for (uint32_t s = key + 1; s < next && reaches; ++s)
+				{
+					reaches = fits(key, next, static_cast<float>(s - key) / (next - key), s);
+				}
+				if (!reaches)  break;
+				end = next;
+			}
+			keys.push_back(end);
+			key = end;
+		}
+		return keys;
+	}
+
+
+	// Add a unit quaternion to a key array as its smallest three components (see CookedClip)
+	void PackRotation(const CQuaternion& rotation, std::vector<uint16_t>& packed)
+	{
+		const float components[4] = { rotation.x, rotation.y, rotation.z, rotation.w };
+		int largest = 0;
+		for (int i = 1; i < 4; ++i)  if (std::abs(components[i]) > std::abs(components[largest]))  largest = i;
+		float sign = components[largest] < 0 ? -1.0f : 1.0f; // q and -q are the same rotation, so make the largest positive
+
+		uint16_t smallest[3];
+		for (int i = 0, j = 0; i < 4; ++i)
+		{
+			if (i == largest)  continue;
+			float value = std::min(std::max(components[i] * sign / SQRT_HALF, -1.0f), 1.0f);
+			smallest[j++] = static_cast<uint16_t>(std::lround((value * 0.5f + 0.5f) * 0x7FFF));
+		}
+		packed.push_back(static_cast<uint16_t>(smallest[0] | ((largest >> 1) << 15)));
+		packed.push_back(static_cast<uint16_t>(smallest[1] | ((largest & 1) << 15)));
+		packed.push_back(smallest[2]);
+	}
+
+	// Add the kept keys of a position or scale channel to the key arrays, each component quantised over the range of the
+	// kept values
+	void PackVectors(const std::vector<CVector3>& samples, const std::vector<uint32_t>& keys, std::vector<uint16_t>& times,
+	                 std::vector<uint16_t>& packed, float min[3], float extent[3])
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			float low = (&samples[keys[0]].x)[c], high = low;
+			for (auto key : keys)
+			{
+				low  = std::min(low,  (&samples[key].x)[c]);
+				high = std::max(high, (&samples[key].x)[c]);
+			}
+			min[c]    = low;
+			extent[c] = high - low;
+		}
+		for (auto key : keys)
+		{
+			times.push_back(static_cast<uint16_t>(key));
+			for (int c = 0; c < 3; ++c)
+			{
+				float value = extent[c] > 0 ? ((&samples[key].x)[c] - min[c]) / extent[c] : 0.0f;
+				packed.push_back(static_cast<uint16_t>(std::lround(value * QUANTISED_MAX)));
+			}
+		}
+	}
+
+	// Reduce and pack a position or scale channel
+	void CompressVectors(const std::vector<CVector3>& samples, std::vector<uint16_t>& times, std::vector<uint16_t>& packed,
+	                     uint32_t& first, uint32_t& count, float min[3], float extent[3])
+	{
+		CVector3 low = samples[0], high = samples[0];
+		for (auto& sample : samples)
+		{
+			low  = { std::min(low.x, sample.x), std::min(low.y, sample.y), std::min(low.z, sample.z) };
+			high = { std::max(high.x, sample.x), std::max(high.y, sample.y), std::max(high.z, sample.z) };
+		}
+		CVector3 range = high - low;
+		float tolerance = POSITION_TOLERANCE * std::max(range.x, std::max(range.y, range.z));
+
+		auto keys = ReduceKeys(static_cast<uint32_t>(samples.size()), [&](uint32_t a, uint32_t b, float t, uint32_t s)
+		{
+			CVector3 error = samples[a] + (samples[b] - samples[a]) * t - samples[s];
+			return std::abs(error.x) <= tolerance && std::abs(error.y) <= tolerance && std::abs(error.z) <= tolerance;
+		});
+		first = static_cast<uint32_t>(times.size());
+		count = static_cast<uint32_t>(keys.size());
+		PackVectors(samples, keys, times, packed, min, extent);
+	}
+}
+
+
+// Resample, reduce and quantise the animations in the scene into the mesh's clips. Channels for nodes that aren't in
+// the mesh are left out
+static void ImportClips(const aiScene* scene, const std::unordered_map<std::string, unsigned int>& nodeIndices, CookedMesh& mesh)
+{
+	mesh.clips.clear();
+	const float minRotationDot = std::cos(ROTATION_TOLERANCE * 0.5f);
+	for (unsigned int a = 0; a < scene->mNumAnimations; ++a)
+	{
+		const aiAnimation* animation = scene->mAnimations[a];
+		double ticksPerSecond = animation->mTicksPerSecond > 0 ? animation->mTicksPerSecond : 25; // Assimp's default rate
+
+		CookedClip clip;
+		clip.name       = animation->mName.C_Str();
+		clip.duration   = static_cast<float>(animation->mDuration / ticksPerSecond);
+		clip.sampleRate = std::min(CLIP_SAMPLE_RATE, MAX_CLIP_FRAMES / std::max(clip.duration, 1.0f));
+		uint32_t numFrames = std::min(static_cast<uint32_t>(std::ceil(clip.duration * clip.sampleRate)) + 1,
+		                              static_cast<uint32_t>(MAX_CLIP_FRAMES) + 1);
+
+		std::vector<CQuaternion> rotations(numFrames);
+		std::vector<CVector3>    positions(numFrames), scales(numFrames);
+		for (unsigned int c = 0; c < animation->mNumChannels; ++c)
+		{
+			const aiNodeAnim* channel = animation->mChannels[c];
+			auto node = nodeIndices.find(channel->mNodeName.C_Str());
+			if (node == nodeIndices.end())  continue;
+
+			CVector3 defaultPosition, defaultScale;
+			CQuaternion defaultRotation;
+			DecomposeMatrix(mesh.nodes[node->second].defaultMatrix, defaultPosition, defaultRotation, defaultScale);
+
+			for (uint32_t frame = 0; frame < numFrames; ++frame)
+			{
+				double time = std::min(frame / clip.sampleRate, clip.duration) * ticksPerSecond;
+				if (channel->mNumRotationKeys == 0)  rotations[frame] = defaultRotation;
+				else  rotations[frame] = ToQuaternion(SampleChannel(channel->mRotationKeys, channel->mNumRotationKeys, time));
+				if (channel->mNumPositionKeys == 0)  positions[frame] = defaultPosition;
+				else
+				{
+					aiVector3D position = SampleChannel(channel->mPositionKeys, channel->mNumPositionKeys, time);
+					positions[frame] = { position.x, position.y, position.z };
+				}
+				if (channel->mNumScalingKeys == 0)  scales[frame] = defaultScale;
+				else
+				{
+					aiVector3D scale = SampleChannel(channel->mScalingKeys, channel->mNumScalingKeys, time);
+					scales[frame] = { scale.x, scale.y, scale.z };
+				}
+
+				// Keep each rotation on the same side as the last, so interpolating between them takes the short way round
+				const CQuaternion& last = rotations[frame > 0 ? frame - 1 : 0];
+				CQuaternion& rotation = rotations[frame];
+				if (rotation.x * last.x + rotation.y * last.y + rotation.z * last.z + rotation.w * last.w < 0)
+				{
+					rotation = { -rotation.x, -rotation.y, -rotation.z, -rotation.w };
+				}
+			}
+
+			CookedClip::Track track = {};
+			track.node = node->second;
+
+			auto rotationKeys = ReduceKeys(numFrames, [&](uint32_t a, uint32_t b, float t, uint32_t s)
+			{
+				const CQuaternion &qa = rotations[a], &qb = rotations[b], &sample = rotations[s];
+				CQuaternion q = Normalise({ qa.x + (qb.x - qa.x) * t, qa.y + (qb.y - qa.y) * t,
+				                            qa.z + (qb.z - qa.z) * t, qa.w + (qb.w - qa.w) * t });
+				return std::abs(q.x * sample.x + q.y * sample.y + q.z * sample.z + q.w * sample.w) >= minRotationDot;
+			});
+			track.firstRotation = static_cast<uint32_t>(clip.rotationTimes.size());
+			track.numRotations  = static_cast<uint32_t>(rotationKeys.size());
+			for (auto key : rotationKeys)
+			{
+				clip.rotationTimes.push_back(static_cast<uint16_t>(key));
+				PackRotation(rotations[key], clip.rotations);
+			}
+
+			CompressVectors(positions, clip.positionTimes, clip.positions, track.firstPosition, track.numPositions,
+			                track.positionMin, track.positionExtent);
+			CompressVectors(scales, clip.scaleTimes, clip.scales, track.firstScale, track.numScales,
+			                track.scaleMin, track.scaleExtent);
+			clip.tracks.push_back(track);
+		}
+		if (!clip.tracks.empty())  mesh.clips.push_back(std::move(clip));
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+// The assimp post-processing for a mesh's import settings
+static unsigned int ImportFlags(const MeshImportSettings& settings)
+{
+	// Needed by every mesh to match the app's coordinates and vertex layout, and each cheap for a mesh that doesn't need it
+	unsigned int flags = aiProcess_MakeLeftHanded |
+		aiProcess_GenSmoothNormals |
+		aiProcess_GenUVCoords |
+		aiProcess_TransformUVCoords |
+		aiProcess_FlipUVs |
+		aiProcess_FlipWindingOrder |
+		aiProcess_Triangulate |
+		aiProcess_JoinIdenticalVertices |
+		aiProcess_SortByPType |
+		aiProcess_FindDegenerates |
+		aiProcess_RemoveComponent;
+
+	// Sub-meshes sharing a material are merged so there are fewer draws. Skinned meshes are left as they are, merging
+	// would only be split again by bone count
+	const unsigned int MERGE_STEPS = aiProcess_RemoveRedundantMaterials | aiProcess_OptimizeMeshes;
+
+	// Bones kept only where they are needed, and within what the vertices and shaders hold
+	const unsigned int BONE_STEPS = aiProcess_Debone | aiProcess_SplitByBoneCount | aiProcess_LimitBoneWeights;
+
+	switch (settings.profile)
+	{
+	case MeshImportProfile::StaticProp:
+		flags |= MERGE_STEPS;
+		break;
+
+	case MeshImportProfile::SkinnedCharacter:
+		flags |= aiProcess_RemoveRedundantMaterials | aiProcess_SplitByBoneCount | aiProcess_LimitBoneWeights;
+		break;
+
+	case MeshImportProfile::Terrain:
+		break;
+
+	default: // Full, including the slower repairs for meshes of unknown quality
+		flags |= MERGE_STEPS | BONE_STEPS | aiProcess_FixInfacingNormals | aiProcess_FindInvalidData | aiProcess_FindInstances |
+		         aiProcess_ImproveCacheLocality;
+		break;
+	}
+	if (settings.vertexCacheSize > 0)  flags |= aiProcess_ImproveCacheLocality;
+	return flags;
+}
+
+
+// Count the number of nodes with given assimp node as root - recursive
+static unsigned int CountNodes(aiNode* assimpNode)
+{
+	unsigned int count = 1;
+	for (unsigned int child = 0; child < assimpNode->mNumChildren; ++child)
+		count += CountNodes(assimpNode->mChildren[child]);
+	return count;
+}
+
+
+// Help build the arrays of submeshes and nodes from the assimp data - recursive
+static unsigned int ReadNodes(std::vector<CookedMesh::Node>& nodes, aiNode* assimpNode, unsigned int nodeIndex, unsigned int parentIndex)
+{
+	auto& node = nodes[nodeIndex];
+	node.parentIndex = parentIndex;
+	unsigned int thisIndex = nodeIndex;
+	++nodeIndex;
+
+	node.name = assimpNode->mName.C_Str();
+
+	node.defaultMatrix.SetValues(&assimpNode->mTransformation.a1);
+	node.defaultMatrix.Transpose(); // Assimp stores matrices differently to this app
+
+	node.subMeshes.resize(assimpNode->mNumMeshes);
+	for (unsigned int i = 0; i < assimpNode->mNumMeshes; ++i)
+	{
+		node.subMeshes[i] = assimpNode->mMeshes[i];
+	}
+
+	node.childNodes.resize(assimpNode->mNumChildren);
+	for (unsigned int i = 0; i < assimpNode->mNumChildren; ++i)
+	{
+		node.childNodes[i] = nodeIndex;
+		nodeIndex = ReadNodes(nodes, assimpNode->mChildren[i], nodeIndex, thisIndex);
+	}
+
+	return nodeIndex;
+}
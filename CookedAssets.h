@@ -0,0 +1,291 @@
+//--------------------------------------------------------------------------------------
+// Cooked assets
+//--------------------------------------------------------------------------------------
+// Assets are "cooked" into a form that can be loaded directly, without the slow import / processing done by assimp or
+// the texture loaders. Cooking is done by the app the first time an asset is loaded, or ahead of time for a whole
+// directory by the AssetCooker tool. Nothing here uses the Direct3D device, so it can be used by both.
+//
+// Meshes are imported with assimp (ImportMesh) into a CookedMesh, which holds exactly what the Mesh class creates its
+// GPU resources from. This is saved as <mesh file>.cooked (or <mesh file>.tangents.cooked if tangents were requested).
+// Animation clips in the mesh file are resampled, reduced to the keys needed and quantised into a CookedClip (see
+// ImportMesh), saved in the same cooked file. Textures are decoded (DecodeTexture) to RGBA with a full mip chain. AssetCooker saves these as <texture file>.dds, and
+// LoadTexture uses these if they are up to date. A panorama can also be cooked to a cubemap, <image file>.cube.dds, for
+// the sky (see Sky.h).
+
+#ifndef _COOKED_ASSETS_H_INCLUDED_
+#define _COOKED_ASSETS_H_INCLUDED_
+
+#include "CMatrix4x4.h"
+#include "LinearArena.h"
+#define NOMINMAX // Use this to stop Windows headers defining "min" and "max", which breaks some libraries (e.g. assimp)
+#include <d3d11.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Meshes
+//--------------------------------------------------------------------------------------
+
+// A skeletal animation clip, compressed for playback of many models at once (see Animation.h). Each animated node has a
+// track, made of separate key lists for its rotation, position and scale. Each list only has the keys needed to follow
+// the source animation within a tolerance when interpolated linearly, so a channel that doesn't move has a single key.
+// The keys of all the tracks are held in one array per channel (structure of arrays), with their times in a separate
+// array as frame numbers at the clip's sample rate, so searching for a time only touches the times.
+//
+// Rotations are unit quaternions stored as their smallest three components, each in 15 bits over +-1/sqrt(2), with the
+// index of the largest (made positive and rebuilt from the others) in the top bits of the first two. Positions and
+// scales are each stored in 16 bits over the range of their track
+struct CookedClip
+{
+	std::string name;
+	float       duration   = 0; // Seconds
+	float       sampleRate = 0; // Frames per second that key times count in
+
+	struct Track
+	{
+		uint32_t node; // Index into the mesh nodes
+
+		// Keys of each channel, indexes into the arrays below
+		uint32_t firstRotation, numRotations;
+		uint32_t firstPosition, numPositions;
+		uint32_t firstScale,    numScales;
+
+		// Range of the quantised positions and scales - value = min + extent * stored / 65535
+		float    positionMin[3], positionExtent[3];
+		float    scaleMin[3],    scaleExtent[3];
+	};
+	std::vector<Track> tracks;
+
+	// Keys of every track, times as frame numbers and values as above (three per key)
+	std::vector<uint16_t> rotationTimes, rotations;
+	std::vector<uint16_t> positionTimes, positions;
+	std::vector<uint16_t> scaleTimes,    scales;
+};
+
+
+// A mesh ready to create GPU resources from, imported by assimp or read from a cooked mesh file
+struct CookedMesh
+{
+	// A mesh contains a hierarchy of nodes. A node represents a seperate animatable part of the mesh
+	// A node can contain several sub-meshes (because a single node might use multiple textures)
+	// A node can also have child nodes. The children will follow the motion of the parent node
+	// Each node has a default matrix which is it's initial/ default position. Models using this mesh are
+	// given these default matrices as a starting position.
+	struct Node
+	{
+		std::string  name;
+
+		CMatrix4x4   defaultMatrix; // Starting position/rotation/scale for this node. Relative to parent. Used when first creating a model from this mesh
+		CMatrix4x4   offsetMatrix;
+
+		unsigned int parentIndex;   // Index of the parent node (from the nodes vector below). Root node refers to itself (0)
+
+		std::vector<unsigned int> childNodes; // Child nodes that are controlled by this node (indexes into the nodes vector below)
+		std::vector<unsigned int> subMeshes;  // The geometry representing this node (indexes into the subMeshes vector below)
+	};
+
+	// The geometry for one material, as interleaved vertices and indices
+	struct SubMesh
+	{
+		std::vector<D3D11_INPUT_ELEMENT_DESC> vertexElements; // Semantic names are always string literals
+		unsigned int         vertexSize  = 0; // Size in bytes of a single vertex (depends on what it contains, uvs, tangents etc.)
+		unsigned int         numVertices = 0;
+		unsigned int         numIndices  = 0;
+		DXGI_FORMAT          indexFormat = DXGI_FORMAT_R32_UINT; // R16_UINT after CompactMesh if there are few enough vertices
+		const unsigned char* vertices    = nullptr; // Point into fileData, importedData or the asset pack
+		const unsigned char* indices     = nullptr;
+
+		// Simplified versions of the sub-mesh from GenerateLods, coarsest last. Each is an index list over the same
+		// vertices, in the same index format. The error is how far (at most) the surface has moved, in node space
+		struct Lod
+		{
+			unsigned int         numIndices = 0;
+			const unsigned char* indices    = nullptr;
+			float                error      = 0;
+		};
+		std::vector<Lod>     lods;
+	};
+
+	std::vector<Node>    nodes;     // First entry is root, remainder are stored in depth-first order
+	std::vector<SubMesh> subMeshes;
+	bool                 hasBones = false; // If any sub-mesh has bones, then all sub-meshes are given bones
+	std::vector<CookedClip> clips;         // Animation clips, whose tracks refer to the nodes above
+
+	// Storage for the vertex and index data
+	std::vector<char>    fileData;     // The whole cooked file when read from one
+	LinearArena          importedData; // Buffers built by ImportMesh and the mesh processing, freed with the mesh
+};
+
+
+// Post-transform vertex cache statistics, from a simulated 16 entry FIFO cache. ACMR (average cache miss ratio) is the
+// vertices transformed per triangle, 0.5 at best for large meshes and 3 at worst. ATVR (average transformed vertex ratio)
+// is the vertices transformed per vertex in the mesh, 1 at best
+struct MeshCacheStats
+{
+	float acmr = 0;
+	float atvr = 0;
+};
+
+
+// Time taken by each stage of ImportMesh in milliseconds, to keep track of the import cost of large meshes
+struct MeshImportTimes
+{
+	float assimp   = 0; // Reading the file, including assimp's post-processing
+	float nodes    = 0; // Reading the node hierarchy
+	float vertices = 0; // Writing the interleaved vertices
+	float bones    = 0; // Adding the bone influences to the vertices
+	float indices  = 0;
+	float optimise = 0; // OptimiseMesh, and measuring the vertex cache if statistics were requested
+	float clips    = 0; // Resampling, reducing and quantising the animation clips
+};
+
+
+// Which of assimp's post-processing steps ImportMesh runs on a mesh file. Full runs every step, for meshes of unknown
+// kind. The others run only what that kind of asset needs: static props skip the bone steps, skinned characters skip
+// the merging of meshes and instances, and terrain (one large mesh with a single material) skips both
+enum class MeshImportProfile { Full, StaticProp, SkinnedCharacter, Terrain };
+
+// Import settings for a mesh file, from its sidecar file <mesh file>.import if it has one. Sidecar lines are a setting
+// name then its value, '#' starts a comment:
+//   profile full | static | skinned | terrain
+//   vertexcache <entries>  - run assimp's cache locality step for a post-transform cache of that size (AI_CONFIG_PP_ICL_PTCACHE_SIZE)
+// The cache locality step is left out unless a size is given, as OptimiseMesh reorders the triangles after the import
+// anyway, except in the full profile which keeps assimp's default size. Changing a sidecar rebuilds the cooked file
+struct MeshImportSettings
+{
+	MeshImportProfile profile = MeshImportProfile::Full;
+	unsigned int      vertexCacheSize = 0; // 0 for the profile's default
+};
+
+// Read the import settings of a mesh file from its sidecar, the defaults above if there isn't one. Unknown settings
+// are ignored
+MeshImportSettings ReadMeshImportSettings(const std::string& fileName);
+
+// Name of a profile, as used in sidecar files
+const char* MeshImportProfileName(MeshImportProfile profile);
+
+
+// Name of the cooked file for a mesh file
+std::string CookedMeshFileName(const std::string& fileName, bool requireTangents);
+
+// Read the cooked file for a mesh if it is up to date, otherwise import the mesh with assimp and write a new cooked file.
+// Will throw a std::runtime_error exception on failure. Safe to call from several threads at once
+void LoadMeshData(const std::string& fileName, bool requireTangents, CookedMesh& mesh);
+
+// Import a mesh file with assimp. Optionally request tangents to be calculated (for normal and parallax mapping).
+// The post-processing is chosen by the file's import settings (see MeshImportSettings). Animation clips are resampled, reduced and quantised (see CookedClip) and kept with the mesh.
+// The mesh is optimised (see OptimiseMesh), optionally returning the vertex cache statistics before and after, and the
+// time taken by each stage. Will throw a std::runtime_error exception on failure. Safe to call from several threads at once
+void ImportMesh(const std::string& fileName, bool requireTangents, CookedMesh& mesh,
+                MeshCacheStats* before = nullptr, MeshCacheStats* after = nullptr, MeshImportTimes* times = nullptr);
+
+// Read a cooked mesh file in one go, from the asset pack (see AssetPack.h) if it is there. Returns false if it is missing,
+// invalid, or out of date with the source mesh file
+bool ReadCookedMesh(const std::string& cookedFileName, const std::string& sourceFileName, bool requireTangents, CookedMesh& mesh);
+
+// Convert a mesh to compact vertex formats, which the input assembler expands so the same shaders can be used: normals
+// and tangents as R8G8B8A8_SNORM, bone weights as R8G8B8A8_UNORM and (if they are near the origin) UVs as R16G16_FLOAT.
+// Sub-meshes with fewer than 65536 vertices get 16-bit indices. A compacted mesh can't be written to a cooked file
+void CompactMesh(CookedMesh& mesh);
+
+// Reorder the triangles of each sub-mesh for the post-transform vertex cache, then in clusters to reduce overdraw, then
+// reorder the vertices in the order they are first used for fetch locality (unused vertices are dropped). The result
+// draws exactly the same triangles. Needs 32-bit indices, so must be used before CompactMesh
+void OptimiseMesh(CookedMesh& mesh);
+
+// Vertex cache statistics for all the sub-meshes of a mesh with 32-bit indices
+MeshCacheStats MeasureVertexCache(const CookedMesh& mesh);
+
+// Add up to numLods simplified levels of detail to each sub-mesh, each with about half the triangles of the last, using
+// quadric error edge collapses (see GenerateLods in the .cpp). Levels that can't be reduced much further are left out.
+// Must be used before CompactMesh. LODs are not stored in cooked files
+void GenerateLods(CookedMesh& mesh, int numLods);
+
+// Check if a cooked mesh file is up to date with the source mesh file, only reading its header
+bool IsCookedMeshCurrent(const std::string& cookedFileName, const std::string& sourceFileName, bool requireTangents);
+
+// Write a cooked mesh file, returns false on failure. Written to a temporary file then renamed, so a partly written
+// file is never read
+bool WriteCookedMesh(const std::string& cookedFileName, const std::string& sourceFileName, bool requireTangents, const CookedMesh& mesh);
+
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+
+// A decoded image, as 32-bit RGBA with a full mip chain
+struct CookedTexture
+{
+	struct Mip
+	{
+		uint32_t             width  = 0;
+		uint32_t             height = 0;
+		std::vector<uint8_t> pixels; // 4 bytes per pixel, rows are packed
+	};
+
+	std::vector<Mip> mips; // First entry is the full size image, down to 1x1
+};
+
+
+// Name of the cooked file for a texture file
+inline std::string CookedTextureFileName(const std::string& fileName)  { return fileName + ".dds"; }
+
+// Decode an image file with WIC (JPG, PNG, BMP, TIFF etc.) and build its mip chain. Returns false on failure with the
+// reason in error. COM must have been initialised on the calling thread. Safe to call from several threads at once
+bool DecodeTexture(const std::string& fileName, CookedTexture& texture, std::string& error);
+
+// Resample a decoded texture to the given size and rebuild its mip chain, e.g. so images of different sizes can share a
+// texture array. Filtered from the smallest existing mip level at least that size, so shrinking a large image is cheap
+void ResizeTexture(CookedTexture& texture, uint32_t width, uint32_t height);
+
+// Write a decoded texture to a DDS file. If compress is set, it is block compressed to BC1, or BC3 if the image has any
+// alpha (e.g. a specular map), otherwise it is stored as R8G8B8A8_UNORM. Images that aren't a multiple of 4 pixels in
+// width and height are never compressed. Returns false on failure with the reason in error. Written to a temporary file
+// then renamed, so a partly written file is never read
+bool WriteCookedTexture(const std::string& cookedFileName, const CookedTexture& texture, std::string& error,
+                        bool compress = true);
+
+
+// A cubemap's faces in Direct3D order: +X, -X, +Y, -Y, +Z, -Z
+const int NUM_CUBE_FACES = 6;
+
+// Name of the cooked cubemap file made from a panorama image file
+inline std::string CookedCubemapFileName(const std::string& fileName)  { return fileName + ".cube.dds"; }
+
+// Resample a decoded panorama, wrapped around a sphere as the star sphere mesh (Stars.x) maps it, onto the faces of a
+// cubemap of the given size, each with a full mip chain. Bilinear filtered from the full size panorama
+void PanoramaToCubemap(const CookedTexture& panorama, uint32_t faceSize, CookedTexture faces[NUM_CUBE_FACES]);
+
+// Write the faces of a cubemap to a DDS file, compressed as WriteCookedTexture. Returns false on failure with the
+// reason in error
+bool WriteCookedCubemap(const std::string& cookedFileName, const CookedTexture faces[NUM_CUBE_FACES], std::string& error,
+                        bool compress = true);
+
+// Where each mip level of a 2D texture is in a DDS file, so the levels can be uploaded one at a time (see TextureStreamer.h)
+struct DDSLayout
+{
+	struct Mip
+	{
+		uint32_t width    = 0;
+		uint32_t height   = 0;
+		size_t   offset   = 0; // From the start of the file
+		uint32_t rowPitch = 0; // Bytes in a row of pixels, or a row of 4x4 blocks for block compressed formats
+		uint32_t numRows  = 0;
+	};
+
+	DXGI_FORMAT      format = DXGI_FORMAT_UNKNOWN;
+	bool             blockCompressed = false; // Each row is 4 pixels high
+	std::vector<Mip> mips; // Full size first
+};
+
+// Read the layout of a DDS file image. Returns false unless it holds a single 2D texture with mip-maps, in a BC format
+// or 32-bit RGBA / BGRA. Other DDS files can still be loaded whole with the DDS loader
+bool ReadDDSLayout(const void* data, size_t size, DDSLayout& layout);
+
+// Check if a cooked file was last written after its source file. False if either doesn't exist
+bool IsCookedFileNewer(const std::string& cookedFileName, const std::string& sourceFileName);
+
+
+#endif //_COOKED_ASSETS_H_INCLUDED_
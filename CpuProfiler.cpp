@@ -0,0 +1,189 @@
+//--------------------------------------------------------------------------------------
+// CPU profiler
+//--------------------------------------------------------------------------------------
+
+#include "CpuProfiler.h"
+
+#define NOMINMAX
+#include <Windows.h>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+
+CpuProfiler gCpuProfiler;
+
+thread_local int CpuProfileScope::tDepth = 0;
+thread_local CpuProfiler::ThreadEvents* CpuProfiler::tEvents = nullptr;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+void CpuProfiler::EndFrame()
+{
+	float ticksToMilliseconds = 1000.0f / Frequency();
+
+	std::vector<ThreadEvents*> threads;
+	{
+		std::lock_guard<std::mutex> lock(mRegisterMutex);
+		for (auto& thread : mThreads)  threads.push_back(thread.get());
+	}
+
+	// This thread first as thread 0, then the others in the order they registered
+	ThreadEvents* current = tEvents;
+	auto found = std::find(threads.begin(), threads.end(), current);
+	if (found != threads.end())  std::rotate(threads.begin(), found, found + 1);
+
+	mTimings.clear();
+	for (size_t i = 0; i < threads.size(); ++i)
+	{
+		ThreadEvents& thread = *threads[i];
+		uint32_t written = thread.written.load(std::memory_order_acquire);
+		uint32_t first = thread.read;
+		if (written - first > THREAD_CAPACITY)  first = written - THREAD_CAPACITY; // Ring has wrapped, oldest are lost
+		thread.read = written;
+
+		mGathered.clear();
+		for (uint32_t event = first; event != written; ++event)
+		{
+			mGathered.push_back(thread.events[event % THREAD_CAPACITY]);
+		}
+
+		// A scope always begins before those nested in it, and is on the stack below them if they begin together
+		std::sort(mGathered.begin(), mGathered.end(), [](const Event& a, const Event& b)
+		{
+			return a.begin < b.begin || (a.begin == b.begin && a.depth < b.depth);
+		});
+
+		int threadNumber = (threads[0] == current) ? static_cast<int>(i) : static_cast<int>(i) + 1;
+		if (mCapture != nullptr)
+		{
+			for (auto& event : mGathered)  mCapture->push_back({ event.name, threadNumber, event.begin, event.end });
+		}
+		BuildTree(threadNumber, ticksToMilliseconds);
+	}
+}
+
+
+std::string CpuProfiler::Report()
+{
+	std::ostringstream report;
+	report.precision(3);
+	report << std::fixed;
+	int thread = -1;
+	for (auto& timing : mTimings)
+	{
+		if (timing.thread != thread)
+		{
+			thread = timing.thread;
+			report << "  CPU thread " << thread << (thread == 0 ? " (render)" : "") << ":\n";
+		}
+		report << std::string(2 * (timing.depth + 2), ' ') << timing.name << ": " << timing.milliseconds << "ms";
+		if (timing.calls > 1)  report << " (" << timing.calls << " calls)";
+		report << "\n";
+	}
+	return report.str();
+}
+
+
+int64_t CpuProfiler::Now()
+{
+	LARGE_INTEGER time;
+	QueryPerformanceCounter(&time);
+	return time.QuadPart;
+}
+
+int64_t CpuProfiler::Frequency()
+{
+	static const int64_t frequency = [] { LARGE_INTEGER f; QueryPerformanceFrequency(&f); return f.QuadPart; }();
+	return frequency;
+}
+
+
+// Only the recording thread writes to its ring. The event is filled in before the count is increased, so EndFrame
+// never sees a partly written event
+void CpuProfiler::Record(const char* name, int64_t begin, int64_t end, int depth)
+{
+	ThreadEvents* thread = tEvents;
+	if (thread == nullptr)  thread = Register();
+
+	uint32_t written = thread->written.load(std::memory_order_relaxed);
+	thread->events[written % THREAD_CAPACITY] = { name, begin, end, depth };
+	thread->written.store(written + 1, std::memory_order_release);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+CpuProfiler::ThreadEvents* CpuProfiler::Register()
+{
+	std::lock_guard<std::mutex> lock(mRegisterMutex);
+	mThreads.emplace_back(new ThreadEvents);
+	tEvents = mThreads.back().get();
+	return mThreads.back().get();
+}
+
+
+void CpuProfiler::BuildTree(int thread, float ticksToMilliseconds)
+{
+	struct OpenScope
+	{
+		int     node;
+		int64_t end;
+		int     depth; // Of the event, which may differ from the node's if its parents were gathered in an earlier frame
+	};
+	std::vector<OpenScope> open;
+
+	mNodes.clear();
+	int firstRoot = -1, lastRoot = -1;
+	for (auto& event : mGathered)
+	{
+		// Close the scopes that this one isn't nested in
+		while (!open.empty() && (open.back().end <= event.begin || open.back().depth >= event.depth))
+		{
+			open.pop_back();
+		}
+		int  parent    = open.empty() ? -1 : open.back().node;
+		int& firstNode = (parent < 0) ? firstRoot : mNodes[parent].firstChild;
+
+		// Merge with an earlier call under the same parent
+		int node = firstNode;
+		while (node >= 0 && mNodes[node].name != event.name && std::strcmp(mNodes[node].name, event.name) != 0)
+		{
+			node = mNodes[node].nextSibling;
+		}
+		if (node < 0)
+		{
+			node = static_cast<int>(mNodes.size());
+			int depth = (parent < 0) ? 0 : mNodes[parent].depth + 1;
+			mNodes.push_back({ event.name, depth, 0, 0, -1, -1, -1 });
+
+			int& lastNode = (parent < 0) ? lastRoot : mNodes[parent].lastChild; // After push_back, which may move mNodes
+			if (lastNode >= 0)  mNodes[lastNode].nextSibling = node;
+			else if (parent < 0)  firstRoot = node;
+			else  mNodes[parent].firstChild = node;
+			lastNode = node;
+		}
+		++mNodes[node].calls;
+		mNodes[node].ticks += event.end - event.begin;
+
+		open.push_back({ node, event.end, event.depth });
+	}
+
+	// Depth-first through the tree, each node before its children
+	std::vector<int> stack;
+	if (firstRoot >= 0)  stack.push_back(firstRoot);
+	while (!stack.empty())
+	{
+		const Node& node = mNodes[stack.back()];
+		stack.pop_back();
+		mTimings.push_back({ node.name, thread, node.depth, node.calls, node.ticks * ticksToMilliseconds });
+
+		if (node.nextSibling >= 0)  stack.push_back(node.nextSibling);
+		if (node.firstChild  >= 0)  stack.push_back(node.firstChild);
+	}
+}
@@ -0,0 +1,167 @@
+//--------------------------------------------------------------------------------------
+// CPU profiler
+//--------------------------------------------------------------------------------------
+// Measures CPU time spent in named scopes on any thread. Put CPU_PROFILE_SCOPE("Name") at the start of a block to time
+// the rest of it. Scopes can be nested, and a scope entered many times in a frame (e.g. Mesh::Render) is shown once with
+// its total time and number of calls.
+//
+// Each thread writes the scopes it finishes to its own ring of events, only ever touched by that thread apart from being
+// read by EndFrame, so recording a scope takes no locks - just two QueryPerformanceCounter calls and a write. EndFrame
+// gathers the scopes finished on all threads since the last call into a tree for each thread. It should be called
+// between frames by the render thread. Threads still running (e.g. the simulation thread) have their scopes finished so
+// far gathered, and the rest in the next frame. A thread finishing more scopes than its ring holds between calls loses
+// the oldest ones.
+//
+// Define CPU_PROFILER_ENABLED as 0 to compile the scopes out entirely
+
+#ifndef _CPU_PROFILER_H_INCLUDED_
+#define _CPU_PROFILER_H_INCLUDED_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#ifndef CPU_PROFILER_ENABLED
+#define CPU_PROFILER_ENABLED 1
+#endif
+
+#define CPU_PROFILE_JOIN2(a, b) a##b
+#define CPU_PROFILE_JOIN(a, b) CPU_PROFILE_JOIN2(a, b)
+
+#if CPU_PROFILER_ENABLED
+// The name must be a string literal (or otherwise last for the whole program), only the pointer is stored
+#define CPU_PROFILE_SCOPE(name) CpuProfileScope CPU_PROFILE_JOIN(cpuProfileScope, __LINE__)(name)
+#else
+#define CPU_PROFILE_SCOPE(name)
+#endif
+
+
+class CpuProfiler
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Gather the scopes finished on every thread since the last call into Timings. Call on the render thread between frames
+	void EndFrame();
+
+	// A scope as recorded, before merging into the timings. Times are in QueryPerformanceCounter ticks
+	struct Scope
+	{
+		const char* name;
+		int         thread; // As in Timing below
+		int64_t     begin;
+		int64_t     end;
+	};
+
+	// While capturing, EndFrame also adds every scope gathered to the given list. Pass nullptr to stop
+	void SetCapture(std::vector<Scope>* capture)  { mCapture = capture; }
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	struct Timing
+	{
+		const char* name;
+		int         thread;       // 0 for the thread calling EndFrame, others numbered in the order they first used a scope
+		int         depth;        // Nesting level, 0 for top level scopes
+		int         calls;        // Times the scope was entered under the same parent
+		float       milliseconds; // Total over all the calls
+	};
+
+	// Results gathered by the last EndFrame, each parent followed by its children in the order they began, one thread
+	// after another
+	const std::vector<Timing>& Timings()  { return mTimings; }
+
+	// The timings as indented lines of text, for the debugger output
+	std::string Report();
+
+
+	// Used by CpuProfileScope. Now is the current QueryPerformanceCounter value, Frequency its ticks per second
+	static int64_t Now();
+	static int64_t Frequency();
+	void Record(const char* name, int64_t begin, int64_t end, int depth);
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Events in each thread's ring - enough for several thousand draws a frame
+	static const uint32_t THREAD_CAPACITY = 8192;
+
+	struct Event
+	{
+		const char* name;
+		int64_t     begin;
+		int64_t     end;
+		int         depth;
+	};
+
+	struct ThreadEvents
+	{
+		Event                 events[THREAD_CAPACITY];
+		std::atomic<uint32_t> written{ 0 }; // Total events written by the thread, only ever increases
+		uint32_t              read = 0;     // Total events gathered by EndFrame
+	};
+
+	// Scopes with the same name and parent merged together, children and siblings are linked by index (-1 for none)
+	struct Node
+	{
+		const char* name;
+		int         depth;
+		int         calls;
+		int64_t     ticks;
+		int         firstChild, lastChild, nextSibling;
+	};
+
+	// The current thread's ring, created the first time the thread records a scope
+	ThreadEvents* Register();
+	static thread_local ThreadEvents* tEvents;
+
+	// Add one thread's events in mGathered (sorted by begin time) to mTimings as a tree
+	void BuildTree(int thread, float ticksToMilliseconds);
+
+
+	std::mutex                                 mRegisterMutex; // Only used when a thread records its first scope
+	std::vector<std::unique_ptr<ThreadEvents>> mThreads;
+
+	std::vector<Event>  mGathered; // Working space for EndFrame
+	std::vector<Node>   mNodes;    // --"--
+	std::vector<Timing> mTimings;
+	std::vector<Scope>* mCapture = nullptr;
+};
+
+
+extern CpuProfiler gCpuProfiler;
+
+
+// Times from construction to destruction, use CPU_PROFILE_SCOPE rather than this directly
+class CpuProfileScope
+{
+public:
+	CpuProfileScope(const char* name) : mName(name), mBegin(CpuProfiler::Now())  { ++tDepth; }
+	~CpuProfileScope()
+	{
+		--tDepth;
+		gCpuProfiler.Record(mName, mBegin, CpuProfiler::Now(), tDepth);
+	}
+
+	CpuProfileScope(const CpuProfileScope&) = delete;
+	CpuProfileScope& operator=(const CpuProfileScope&) = delete;
+
+private:
+	static thread_local int tDepth; // Scopes currently open on this thread
+
+	const char* mName;
+	int64_t     mBegin;
+};
+
+
+#endif //_CPU_PROFILER_H_INCLUDED_
@@ -0,0 +1,50 @@
+//--------------------------------------------------------------------------------------
+// Deferred Lighting Pixel Shader
+//--------------------------------------------------------------------------------------
+// Lighting pass of deferred shading, drawn as a full screen quad over the scene. Reads the surface from the G-buffer
+// (see GBuffer.hlsli), rebuilds its position from the depth buffer and lights it with the lights in its cluster, the
+// same lights and lighting equations as PixelLighting_ps. Pixels where nothing was drawn are left unchanged
+
+#include "Lighting.hlsli"
+#include "GBuffer.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+// Slots from GBUFFER_SLOT, after the light buffers
+Texture2D GBufferMaterial : register(t4);
+Texture2D GBufferNormal   : register(t5);
+Texture2D DepthMap        : register(t6);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+    int3 pixel = int3(input.projectedPosition.xy, 0);
+    float depth = DepthMap.Load(pixel).r;
+    if (depth >= 1.0f)  discard; // Background
+
+    // Position in view space from the depth using the camera's projection matrix - the projected depth is
+    // a + b / z for view depth z, and the view x and y scale with z
+    float viewDepth = gProjectionMatrix[2][3] / (depth - gProjectionMatrix[2][2]);
+    float2 deviceXY = float2(input.projectedPosition.x / gViewportWidth * 2 - 1, 1 - input.projectedPosition.y / gViewportHeight * 2);
+    float3 viewPosition = float3(deviceXY / float2(gProjectionMatrix[0][0], gProjectionMatrix[1][1]) * viewDepth, viewDepth);
+    float3 worldPosition = mul(gCameraMatrix, float4(viewPosition, 1.0f)).xyz;
+
+    float3 worldNormal = DecodeNormal(GBufferNormal.Load(pixel).rg);
+    float3 cameraDirection = normalize(gCameraPosition - worldPosition);
+
+    float3 diffuseLight = gAmbientColour;
+    float3 specularLight = 0;
+    AddClusterLights(input.projectedPosition.xy, viewDepth, worldPosition, worldNormal, cameraDirection,
+                     diffuseLight, specularLight);
+
+    float4 material = GBufferMaterial.Load(pixel);
+    float3 finalColour = diffuseLight * material.rgb + specularLight * material.a;
+    return float4(finalColour, 1.0f);
+}
@@ -0,0 +1,243 @@
+//--------------------------------------------------------------------------------------
+// Deferred renderer
+//--------------------------------------------------------------------------------------
+
+#include "DeferredRenderer.h"
+#include "JobSystem.h"
+#include "InstanceBufferRing.h"
+#include "StateCache.h"
+#include "Shader.h"
+#include "Common.h"
+
+
+DeferredRenderer gDeferredRenderer;
+
+
+DeferredRenderer::~DeferredRenderer()
+{
+	Release();
+}
+
+
+// Create the recorders. Each one gets a deferred context and its own per-model, skeleton and instance buffers
+bool DeferredRenderer::Init(int numThreads)
+{
+	Release();
+	mNextChunk = 0;
+
+	for (int i = 0; i < numThreads; ++i)
+	{
+		Worker* worker = new Worker;
+		worker->context = nullptr;
+		worker->context1 = nullptr;
+		worker->perModelConstantBuffer = nullptr;
+		worker->skeletonConstantBuffer = nullptr;
+		worker->instanceBuffer = nullptr;
+		worker->instanceBufferSRV = nullptr;
+		mWorkers.push_back(worker);
+
+		if (FAILED(gD3DDevice->CreateDeferredContext(0, &worker->context)))
+		{
+			gLastError = "Error creating deferred context";
+			Release();
+			return false;
+		}
+		if (FAILED(worker->context->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&worker->context1)))  worker->context1 = nullptr;
+		worker->perModelConstantBuffer = CreateConstantBuffer(sizeof(PerModelConstants));
+		worker->skeletonConstantBuffer = CreateConstantBuffer(sizeof(SkeletonConstants));
+		worker->instanceBuffer = CreateStructuredBuffer(sizeof(InstanceData), MAX_INSTANCES, &worker->instanceBufferSRV);
+		if (worker->perModelConstantBuffer == nullptr || worker->skeletonConstantBuffer == nullptr ||
+		    worker->instanceBuffer == nullptr)
+		{
+			gLastError = "Error creating per-thread constant buffer";
+			Release();
+			return false;
+		}
+		worker->constantRing.Init(); // Can fail, e.g. on D3D11.0, the worker's own buffers are used then
+	}
+	return true;
+}
+
+
+void DeferredRenderer::Release()
+{
+	for (auto worker : mWorkers)
+	{
+		if (worker->perModelConstantBuffer)  worker->perModelConstantBuffer->Release();
+		if (worker->skeletonConstantBuffer)  worker->skeletonConstantBuffer->Release();
+		if (worker->instanceBufferSRV)       worker->instanceBufferSRV->Release();
+		if (worker->instanceBuffer)          worker->instanceBuffer->Release();
+		worker->constantRing.Release();
+		if (worker->context1)              worker->context1->Release();
+		if (worker->context)               worker->context->Release();
+		delete worker;
+	}
+	mWorkers.clear();
+
+	for (auto commandList : mCommandLists)
+	{
+		if (commandList)  commandList->Release();
+	}
+	mCommandLists.clear();
+	mChunks.clear();
+	DiscardRetained();
+}
+
+
+void DeferredRenderer::DiscardRetained()
+{
+	for (auto commandList : mRetainedCommandLists)
+	{
+		if (commandList)  commandList->Release();
+	}
+	mRetainedCommandLists.clear();
+	mRetainedChunks.clear();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Recording
+//--------------------------------------------------------------------------------------
+
+bool DeferredRenderer::Record(const std::vector<RenderChunk>& chunks)
+{
+	// Command lists not executed last time are discarded
+	for (auto commandList : mCommandLists)
+	{
+		if (commandList)  commandList->Release();
+	}
+	mChunks = chunks;
+	return RecordCommandLists(mChunks, mCommandLists);
+}
+
+
+bool DeferredRenderer::RecordRetained(const std::vector<RenderChunk>& chunks)
+{
+	DiscardRetained();
+	mRetainedChunks = chunks;
+	if (!RecordCommandLists(mRetainedChunks, mRetainedCommandLists))
+	{
+		DiscardRetained();
+		return false;
+	}
+	return true;
+}
+
+
+bool DeferredRenderer::RecordCommandLists(const std::vector<RenderChunk>& chunks, std::vector<ID3D11CommandList*>& commandLists)
+{
+	commandLists.assign(chunks.size(), nullptr);
+
+	// Without workers the chunks are run directly by Execute
+	if (mWorkers.empty() || chunks.empty())  return true;
+
+	// One job for each recorder (no more than there are chunks), running until all the chunks are taken
+	mNextChunk = 0;
+	JobGraph graph;
+	for (size_t w = 0; w < mWorkers.size() && w < chunks.size(); ++w)
+	{
+		Worker* worker = mWorkers[w];
+		graph.Add([this, worker, &chunks, &commandLists]() { RecordChunks(worker, chunks, commandLists); });
+	}
+	gJobSystem.Run(graph);
+
+	for (auto commandList : commandLists)
+	{
+		if (commandList == nullptr)
+		{
+			gLastError = "Error recording command list";
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// May run on any thread, including the main thread, so the thread's own rendering globals are put back afterwards
+void DeferredRenderer::RecordChunks(Worker* worker, const std::vector<RenderChunk>& chunks, std::vector<ID3D11CommandList*>& commandLists)
+{
+	ID3D11DeviceContext*      context                = gD3DContext;
+	ID3D11DeviceContext1*     context1               = gD3DContext1;
+	ConstantBufferRing*       constantRing           = gConstantRing;
+	InstanceBufferRing*       instanceRing           = gInstanceRing;
+	ID3D11Buffer*             perModelConstantBuffer = gPerModelConstantBuffer;
+	ID3D11Buffer*             skeletonConstantBuffer = gSkeletonConstantBuffer;
+	ID3D11Buffer*             instanceBuffer         = gInstanceBuffer;
+	ID3D11ShaderResourceView* instanceBufferSRV      = gInstanceBufferSRV;
+
+	// Rendering code in the chunks uses the worker's context and constant buffers
+	gD3DContext = worker->context;
+	gD3DContext1 = worker->context1;
+	gConstantRing = &worker->constantRing;
+	gPerModelConstantBuffer = worker->perModelConstantBuffer;
+	gSkeletonConstantBuffer = worker->skeletonConstantBuffer;
+	gInstanceBuffer         = worker->instanceBuffer;
+	gInstanceBufferSRV      = worker->instanceBufferSRV;
+	gInstanceRing           = nullptr; // Deferred contexts can't map without discarding first, see InstanceBufferRing.h
+
+	int numChunks = static_cast<int>(chunks.size());
+	for (int chunk = mNextChunk++; chunk < numChunks; chunk = mNextChunk++)
+	{
+		// The deferred context starts each command list with cleared state
+		gStateCache.Invalidate();
+		gConstantRing->BeginCommandList();
+		chunks[chunk]();
+		if (FAILED(gD3DContext->FinishCommandList(FALSE, &commandLists[chunk])))
+		{
+			commandLists[chunk] = nullptr;
+		}
+	}
+
+	gD3DContext = context;
+	gD3DContext1 = context1;
+	gConstantRing = constantRing;
+	gPerModelConstantBuffer = perModelConstantBuffer;
+	gSkeletonConstantBuffer = skeletonConstantBuffer;
+	gInstanceBuffer         = instanceBuffer;
+	gInstanceBufferSRV      = instanceBufferSRV;
+	gInstanceRing           = instanceRing;
+	gStateCache.Invalidate(); // The cache now holds the worker context's state, not this thread's own context
+}
+
+
+//--------------------------------------------------------------------------------------
+// Execution
+//--------------------------------------------------------------------------------------
+
+void DeferredRenderer::Execute(int first, int count, bool keep /*= false*/)
+{
+	for (int chunk = first; chunk < first + count && chunk < static_cast<int>(mChunks.size()); ++chunk)
+	{
+		if (mWorkers.empty())
+		{
+			mChunks[chunk]();
+		}
+		else if (mCommandLists[chunk] != nullptr)
+		{
+			gD3DContext->ExecuteCommandList(mCommandLists[chunk], FALSE);
+			if (!keep)
+			{
+				mCommandLists[chunk]->Release();
+				mCommandLists[chunk] = nullptr;
+			}
+			gStateCache.Invalidate();
+		}
+	}
+}
+
+
+void DeferredRenderer::ExecuteRetained(int first, int count)
+{
+	for (int chunk = first; chunk < first + count && chunk < static_cast<int>(mRetainedChunks.size()); ++chunk)
+	{
+		if (mWorkers.empty())
+		{
+			mRetainedChunks[chunk]();
+		}
+		else if (mRetainedCommandLists[chunk] != nullptr)
+		{
+			gD3DContext->ExecuteCommandList(mRetainedCommandLists[chunk], FALSE);
+			gStateCache.Invalidate();
+		}
+	}
+}
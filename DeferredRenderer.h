@@ -0,0 +1,121 @@
+//--------------------------------------------------------------------------------------
+// Deferred renderer
+//--------------------------------------------------------------------------------------
+// Records chunks of rendering work as jobs on the job system's threads (see JobSystem.h), each chunk into its own
+// command list using a deferred context. The command lists are then executed on the immediate context in the order the
+// chunks were given, so the result is the same as rendering everything on the main thread.
+//
+// There is a fixed set of recorders, each with a deferred context, and one job for each recorder takes chunks in turn
+// until there are none left. While it runs, gD3DContext (and the other per-thread globals: gStateCache,
+// gPerModelConstants, gSkeletonConstants, their constant buffers and the instance buffer) refer to the recorder's own
+// copies on whichever thread the job is on, so ordinary rendering code such as Mesh::Render can be used unchanged. Each
+// recorder has its own per-model, skeleton and instance buffers and constant buffer ring, so chunks never share a buffer
+// they are updating.
+// A deferred context starts with all state cleared - a chunk must set everything it uses, including render targets
+// and viewports. With no recorders the chunks are simply run on the immediate context.
+//
+// Chunks that draw the same thing every frame can be recorded as retained command lists instead, which are kept and
+// executed again each frame until they are recorded afresh. Constant and instance data written by a retained chunk is
+// recorded with it, but buffers it only binds (e.g. the per-frame constants) are read when it is executed, so they can
+// still be updated on the immediate context each frame
+
+#ifndef _DEFERRED_RENDERER_H_INCLUDED_
+#define _DEFERRED_RENDERER_H_INCLUDED_
+
+#include "ConstantBufferRing.h"
+
+#include <d3d11.h>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+
+class DeferredRenderer
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// A chunk of rendering work. Must not use the GPU profiler or anything else shared between threads
+	typedef std::function<void()> RenderChunk;
+
+	~DeferredRenderer();
+
+	// Create the given number of recorders, each with a deferred context - at most this many chunks are recorded at
+	// once. Returns false on error (reason in gLastError)
+	bool Init(int numThreads);
+
+	// Release the recorders' contexts and any recorded command lists
+	void Release();
+
+
+	// Record the chunks, returning when they have all been recorded. The calling thread records chunks too. Returns false
+	// on error (reason in gLastError)
+	bool Record(const std::vector<RenderChunk>& chunks);
+
+	// Execute the recorded chunks from first to first + count - 1 on the immediate context. Executing a command list
+	// clears the immediate context state, so gStateCache is invalidated afterwards. The command lists are released once
+	// executed, unless keep is true so they can be executed again (e.g. for another view, with the per-frame constants
+	// updated in between)
+	void Execute(int first, int count, bool keep = false);
+
+
+	// Record the chunks as retained command lists, replacing any recorded before. Returns false on error (reason in
+	// gLastError), with no retained chunks then
+	bool RecordRetained(const std::vector<RenderChunk>& chunks);
+
+	// Execute the retained chunks from first to first + count - 1 on the immediate context, keeping them for next time.
+	// Invalidates gStateCache as Execute does
+	void ExecuteRetained(int first, int count);
+
+	// Release the retained command lists
+	void DiscardRetained();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	int NumThreads()  { return static_cast<int>(mWorkers.size()); }
+
+	int NumRetained()  { return static_cast<int>(mRetainedChunks.size()); }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	struct Worker
+	{
+		ID3D11DeviceContext*      context;
+		ID3D11DeviceContext1*     context1; // Null on a D3D11.0 runtime
+		ID3D11Buffer*             perModelConstantBuffer;
+		ID3D11Buffer*             skeletonConstantBuffer;
+		ID3D11Buffer*             instanceBuffer;
+		ID3D11ShaderResourceView* instanceBufferSRV;
+		ConstantBufferRing        constantRing; // Not available on a D3D11.0 runtime, the buffers above are used instead
+	};
+
+	// Record the chunks into the command lists (one for each chunk) using the recorder jobs below. Returns false on error
+	bool RecordCommandLists(const std::vector<RenderChunk>& chunks, std::vector<ID3D11CommandList*>& commandLists);
+
+	// Recorder job, records chunks with the worker's context until there are none left
+	void RecordChunks(Worker* worker, const std::vector<RenderChunk>& chunks, std::vector<ID3D11CommandList*>& commandLists);
+
+
+	std::vector<Worker*>             mWorkers;
+	std::vector<RenderChunk>         mChunks;
+	std::vector<ID3D11CommandList*>  mCommandLists; // One for each chunk, null if it failed to record
+
+	std::vector<RenderChunk>         mRetainedChunks;
+	std::vector<ID3D11CommandList*>  mRetainedCommandLists; // --"--
+
+	std::atomic<int> mNextChunk; // Chunks are taken in order by whichever recorder is free
+};
+
+
+extern DeferredRenderer gDeferredRenderer;
+
+
+#endif //_DEFERRED_RENDERER_H_INCLUDED_
@@ -0,0 +1,38 @@
+//--------------------------------------------------------------------------------------
+// Include file for the depth-aware post-processes
+//--------------------------------------------------------------------------------------
+// Depth of field and fog read the scene's depth buffer, bound at POST_PROCESS_DEPTH_SLOT for their passes (see
+// EffectChain.cpp). With dynamic resolution only the top-left part of the depth buffer is in use, gDepthUVScale of it
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D DepthTexture : register(t9); // POST_PROCESS_DEPTH_SLOT
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+// Distance from the camera of the scene at the given uv of the image (far clip for the sky)
+float SceneDepth(float2 uv)
+{
+	float width, height;
+	DepthTexture.GetDimensions(width, height);
+	int2 pixel = min(int2(uv * gDepthUVScale * float2(width, height)), int2(width, height) - 1);
+	return ViewDepth(DepthTexture.Load(int3(pixel, 0)).r, gDepthNearClip, gDepthFarClip);
+}
+
+
+// How blurred the scene is at the given uv, -1 to 0 in front of the focus range (the near field) and 0 to 1 behind it
+// (the far field). A focus distance of 0 autofocuses on the centre of the screen, there is nothing to read back
+float CircleOfConfusion(float2 uv)
+{
+	float focus = (gFocusDistance > 0) ? gFocusDistance : SceneDepth(float2(0.5f, 0.5f));
+	float offset = SceneDepth(uv) - focus;
+	return sign(offset) * saturate((abs(offset) - gFocusRange) / gFocusBlurDistance);
+}
@@ -0,0 +1,56 @@
+//--------------------------------------------------------------------------------------
+// Depth of Field Blur Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Blurs one field of the half size depth of field image, gathering a disc of taps out to the full blur radius. Run
+// twice, for the far field (gDofNearField 0) then the near field (1):
+// - Far field: only taps behind the focus range are gathered, and only if their own blur reaches this pixel, so sharp
+//   objects in front don't bleed into the blurred background. Alpha is this pixel's far blur
+// - Near field: taps in front of the focus range are gathered whether or not this pixel is, so blurred foreground
+//   objects spread over the sharp scene behind them. Alpha is how much of the near field covers this pixel
+
+#include "DepthEffects.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    HalfSizeTexture : register(t0); // Colour and circle of confusion from DepthOfFieldDownsample_pp
+SamplerState PointSample     : register(s0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+#define DOF_TAPS 32
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	float2 radius = gDofBlurRadius * gTexelSize; // Full blur radius in UV units
+
+	float4 centre = HalfSizeTexture.Sample(PointSample, input.uv);
+	float centreBlur = (gDofNearField != 0) ? max(-centre.a, 0) : max(centre.a, 0);
+
+	// Taps on a golden angle spiral cover the disc evenly, r is the distance as a fraction of the full radius
+	float3 total = 0;
+	float  totalWeight = 0;
+	float  coverage = 0;
+	[unroll] for (int i = 0; i < DOF_TAPS; ++i)
+	{
+		float r = sqrt((i + 0.5f) / DOF_TAPS);
+		float s, c;
+		sincos(i * 2.39996323f, s, c);
+		float4 tap = HalfSizeTexture.SampleLevel(PointSample, input.uv + float2(c, s) * r * radius, 0);
+
+		// A tap contributes if its own blur reaches this far, with a pixel of soft edge
+		float tapBlur = (gDofNearField != 0) ? max(-tap.a, 0) : max(tap.a, 0);
+		float weight = (tapBlur > 0) ? saturate((tapBlur - r) * gDofBlurRadius + 1) : 0;
+		total += tap.rgb * weight;
+		totalWeight += weight;
+		coverage = max(coverage, tapBlur * weight);
+	}
+
+	float3 colour = (totalWeight > 0) ? total / totalWeight : centre.rgb;
+	return float4(colour, (gDofNearField != 0) ? coverage : centreBlur);
+}
@@ -0,0 +1,36 @@
+//--------------------------------------------------------------------------------------
+// Depth of Field Combine Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Last pass of the depth of field. Blends the full size image towards the blurred far field by the full resolution
+// circle of confusion, so the edges of sharp objects stay sharp, then lays the blurred near field over the top
+
+#include "DepthEffects.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    SceneTexture   : register(t0);
+Texture2D    FarField       : register(t1); // Half size, from DepthOfFieldBlur_pp
+Texture2D    NearField      : register(t2);
+SamplerState PointSample    : register(s0);
+SamplerState BilinearSample : register(s1);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	float3 colour = SceneTexture.Sample(PointSample, input.uv).rgb;
+
+	// Fully blurred once the blur is a pixel of the half size image, below that the sharp image is as good
+	float farBlur = max(CircleOfConfusion(input.uv), 0);
+	colour = lerp(colour, FarField.Sample(BilinearSample, input.uv).rgb, saturate(farBlur * gDofBlurRadius));
+
+	float4 near = NearField.Sample(BilinearSample, input.uv);
+	colour = lerp(colour, near.rgb, saturate(near.a * gDofBlurRadius));
+	return float4(colour, 1.0f);
+}
@@ -0,0 +1,26 @@
+//--------------------------------------------------------------------------------------
+// Depth of Field Downsample Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// First pass of the depth of field. Halves the size of the image and stores the signed circle of confusion of each
+// pixel in alpha (see DepthEffects.hlsli), so the blur passes can split it into near and far fields
+
+#include "DepthEffects.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    SceneTexture   : register(t0);
+SamplerState BilinearSample : register(s1); // One bilinear tap averages the 2x2 block under the output pixel
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	float3 colour = SceneTexture.Sample(BilinearSample, input.uv).rgb;
+	return float4(colour, CircleOfConfusion(input.uv));
+}
@@ -0,0 +1,22 @@
+//--------------------------------------------------------------------------------------
+// Depth-Only Vertex Shader, instanced
+//--------------------------------------------------------------------------------------
+// As DepthOnly_vs, but the world matrix comes from the instance buffer so many models can be drawn at once. Also built
+// with GPU_CULLING for the GPU-driven culling's depth pre-pass (see Instancing.hlsli)
+
+#include "Instancing.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PositionVertex modelVertex, uint instanceID : SV_InstanceID) : SV_Position
+{
+    InstanceData instance = GetInstance(instanceID);
+
+    float4 modelPosition = float4(modelVertex.position, 1);
+    float4 worldPosition = mul(instance.worldMatrix, modelPosition);
+    float4 viewPosition  = mul(gViewMatrix,       worldPosition);
+    return                 mul(gProjectionMatrix, viewPosition);
+}
@@ -0,0 +1,20 @@
+//--------------------------------------------------------------------------------------
+// Depth-Only Vertex Shader
+//--------------------------------------------------------------------------------------
+// As BasicTransform_vs but for passes with no pixel shader - the depth pre-pass and the shadow maps. It reads only the
+// position, so meshes are drawn from their position streams, 12 bytes a vertex rather than the whole vertex
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PositionVertex modelVertex) : SV_Position
+{
+    float4 modelPosition = float4(modelVertex.position, 1);
+    float4 worldPosition = mul(gWorldMatrix,      modelPosition);
+    float4 viewPosition  = mul(gViewMatrix,       worldPosition);
+    return                 mul(gProjectionMatrix, viewPosition);
+}
@@ -0,0 +1,35 @@
+//--------------------------------------------------------------------------------------
+// Depth Resolve Pixel Shader
+//--------------------------------------------------------------------------------------
+// With MSAA the scene is drawn with a multisampled depth buffer, which the shaders reading depth as a texture (the
+// particles and the depth-aware post-processes) can't sample. Drawn as a full screen quad into the single sample depth
+// buffer, cleared to the far distance, writing the nearest of each pixel's samples. The nearest keeps the particles
+// and fog behind an edge the colour resolve shows in front
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2DMS<float> DepthTexture : register(t0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float main(PostProcessingInput input) : SV_Depth
+{
+	uint width, height, numSamples;
+	DepthTexture.GetDimensions(width, height, numSamples);
+
+	int2 pixel = int2(input.projectedPosition.xy);
+	float depth = 1.0f;
+	for (uint i = 0; i < numSamples; ++i)
+	{
+		depth = min(depth, DepthTexture.Load(pixel, i));
+	}
+	return depth;
+}
@@ -4,9 +4,14 @@
 
 #include "Direct3DSetup.h"
 #include "Shader.h"
+#include "ResourceRegistry.h"
 #include "Common.h"
 #include <d3d11.h>
+#include <dxgi1_5.h>
 #include <vector>
+#include <string>
+#include <algorithm>
+#include <cctype>
 
 
 //--------------------------------------------------------------------------------------
@@ -16,12 +21,38 @@
 
 // The main Direct3D (D3D) variables
 ID3D11Device*        gD3DDevice  = nullptr; // D3D device for overall features
-ID3D11DeviceContext* gD3DContext = nullptr; // D3D context for specific rendering tasks
+thread_local ID3D11DeviceContext* gD3DContext = nullptr; // D3D context for specific rendering tasks, each render worker thread has its own
+thread_local ID3D11DeviceContext1* gD3DContext1 = nullptr; // Its D3D11.1 interface, for binding parts of constant buffers
 
 // Swap chain and back buffer
 IDXGISwapChain*         gSwapChain              = nullptr;
 ID3D11RenderTargetView* gBackBufferRenderTarget = nullptr;
 
+// Flip-model swap chain settings (see UseFlipModelSwapChain)
+bool   gFlipModel            = false;
+int    gSwapBufferCount      = 2;
+int    gMaxFrameLatency      = 1;
+bool   gTearingSupported     = false;   // Set if the swap chain was created allowing tearing
+HANDLE gFrameLatencyWaitable = nullptr; // Signalled when the swap chain is ready for a new frame
+bool   gSwapChainOccluded    = false;   // Set if the last present (or test) found the window hidden
+UINT   gSwapChainFlags       = 0;
+
+// Headless device with an off-screen back buffer and no swap chain (see UseHeadless)
+bool gHeadless = false;
+bool gUseWarp  = false;
+
+// Device creation settings (see SelectAdapter and UseDebugLayer), and what was actually created
+std::string       gAdapterSelection = "";     // Empty to use the adapter with most video memory
+#ifdef _DEBUG
+bool              gUseDebugLayer    = true;
+#else
+bool              gUseDebugLayer    = false;  // The debug layer validates every call, much too slow outside debug builds
+#endif
+std::string       gAdapterName      = "";
+D3D_FEATURE_LEVEL gFeatureLevel     = D3D_FEATURE_LEVEL_11_0;
+bool              gDebugLayerActive = false;
+IDXGIAdapter3*    gDeviceAdapter    = nullptr;  // For video memory queries, null before Windows 10
+
 // Depth buffer (can also contain "stencil" values, which we will see later)
 ID3D11Texture2D*          gDepthStencilTexture = nullptr; // The texture holding the depth values
 ID3D11DepthStencilView*   gDepthStencil        = nullptr; // The depth buffer referencing above texture
@@ -29,50 +60,41 @@ ID3D11ShaderResourceView* gDepthShaderView     = nullptr; // Allows access to th
 
 
 //--------------------------------------------------------------------------------------
-// Initialise / uninitialise Direct3D
+// Window size dependent resources
 //--------------------------------------------------------------------------------------
+// The back buffer render target and the depth buffer are recreated when the window is resized
+
 // Returns false on failure
-bool InitDirect3D()
+bool CreateSizeDependentResources()
 {
-    // Many DirectX functions return a "HRESULT" variable to indicate success or failure. Microsoft code often uses
-    // the FAILED macro to test this variable, you'll see it throughout the code - it's fairly self explanatory.
     HRESULT hr = S_OK;
 
-
-    //// Initialise DirectX ////
-
-    // Create a Direct3D device (i.e. initialise D3D) and create a swap-chain (create a back buffer to render to)
-    DXGI_SWAP_CHAIN_DESC swapDesc = {};
-    swapDesc.OutputWindow = gHWnd;                           // Target window
-    swapDesc.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;          // Use DXGI_SWAP_EFFECT_SEQUENTIAL to retain the previous back buffer (for feedback blur effects)
-    swapDesc.Windowed = TRUE;
-    swapDesc.BufferCount = 1;
-    swapDesc.BufferDesc.Width  = gViewportWidth;             // Target window size
-    swapDesc.BufferDesc.Height = gViewportHeight;            // --"--
-    swapDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // Pixel format of target window
-    swapDesc.BufferDesc.RefreshRate.Numerator   = 60;        // Refresh rate of monitor (provided as fraction = 60/1 here)
-    swapDesc.BufferDesc.RefreshRate.Denominator = 1;         // --"--
-    swapDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-    swapDesc.SampleDesc.Count   = 1;
-    swapDesc.SampleDesc.Quality = 0;
-    UINT flags = D3D11_CREATE_DEVICE_DEBUG; // Set this to 0, or D3D11_CREATE_DEVICE_DEBUG to get more debugging information (in the "Output" window of Visual Studio)
-    hr = D3D11CreateDeviceAndSwapChain(nullptr, D3D_DRIVER_TYPE_HARDWARE, 0, flags, 0, 0, D3D11_SDK_VERSION,
-                                       &swapDesc, &gSwapChain, &gD3DDevice, nullptr, &gD3DContext);
-    if (FAILED(hr))
+    // Get a "render target view" of back-buffer - standard behaviour. Without a swap chain the back buffer is an ordinary
+    // texture, which can also be copied from to read the results back
+    ID3D11Texture2D* backBuffer;
+    if (gSwapChain != nullptr)
     {
-        gLastError = "Error creating Direct3D device";
-        return false;
+        hr = gSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&backBuffer);
+    }
+    else
+    {
+        D3D11_TEXTURE2D_DESC bbDesc = {};
+        bbDesc.Width  = gViewportWidth;
+        bbDesc.Height = gViewportHeight;
+        bbDesc.MipLevels = 1;
+        bbDesc.ArraySize = 1;
+        bbDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // Same as the swap chain
+        bbDesc.SampleDesc.Count = 1;
+        bbDesc.Usage = D3D11_USAGE_DEFAULT;
+        bbDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+        hr = gD3DDevice->CreateTexture2D(&bbDesc, nullptr, &backBuffer);
     }
-
-
-    // Get a "render target view" of back-buffer - standard behaviour
-    ID3D11Texture2D* backBuffer;
-    hr = gSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&backBuffer);
     if (FAILED(hr))
     {
         gLastError = "Error creating swap chain";
         return false;
     }
+    gResourceRegistry.Track(backBuffer);
     hr = gD3DDevice->CreateRenderTargetView(backBuffer, NULL, &gBackBufferRenderTarget);
     backBuffer->Release();
     if (FAILED(hr))
@@ -104,6 +126,7 @@ bool InitDirect3D()
         gLastError = "Error creating depth buffer texture";
         return false;
     }
+    gResourceRegistry.Track(gDepthStencilTexture);
 
     // Create the depth stencil view - an object to allow us to use the texture
     // just created as a depth buffer
@@ -136,23 +159,414 @@ bool InitDirect3D()
 }
 
 
+void ReleaseSizeDependentResources()
+{
+    if (gDepthShaderView)        gDepthShaderView->Release();
+    if (gDepthStencil)           gDepthStencil->Release();
+    if (gDepthStencilTexture)    gDepthStencilTexture->Release();
+    if (gBackBufferRenderTarget) gBackBufferRenderTarget->Release();
+    gDepthShaderView        = nullptr;
+    gDepthStencil           = nullptr;
+    gDepthStencilTexture    = nullptr;
+    gBackBufferRenderTarget = nullptr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Adapter selection
+//--------------------------------------------------------------------------------------
+
+// Find the adapter matching gAdapterSelection: an index, part of the adapter name (any case) or empty for the adapter
+// with the most dedicated video memory. Software adapters are skipped. Returns nullptr if there is no match
+IDXGIAdapter1* FindAdapter()
+{
+    IDXGIFactory1* factory;
+    if (FAILED(CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void**)&factory)))  return nullptr;
+
+    std::string selection = gAdapterSelection;
+    std::transform(selection.begin(), selection.end(), selection.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    bool byIndex = !selection.empty() && std::all_of(selection.begin(), selection.end(), [](unsigned char c) { return std::isdigit(c) != 0; });
+
+    IDXGIAdapter1* best = nullptr;
+    SIZE_T bestMemory = 0;
+    IDXGIAdapter1* adapter;
+    for (UINT i = 0; factory->EnumAdapters1(i, &adapter) != DXGI_ERROR_NOT_FOUND; ++i)
+    {
+        DXGI_ADAPTER_DESC1 desc;
+        adapter->GetDesc1(&desc);
+        std::wstring wideName = desc.Description;
+        std::string name(wideName.begin(), wideName.end());
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+        bool match;
+        if (byIndex)                 match = (std::stoul(selection) == i);
+        else if (!selection.empty()) match = (name.find(selection) != std::string::npos);
+        else                         match = (desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) == 0 && (best == nullptr || desc.DedicatedVideoMemory > bestMemory);
+
+        if (match && (best == nullptr || selection.empty()))
+        {
+            if (best)  best->Release();
+            best = adapter;
+            bestMemory = desc.DedicatedVideoMemory;
+        }
+        else
+        {
+            adapter->Release();
+        }
+    }
+    factory->Release();
+    return best;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Initialise / uninitialise Direct3D
+//--------------------------------------------------------------------------------------
+// Returns false on failure
+bool InitDirect3D()
+{
+    // Many DirectX functions return a "HRESULT" variable to indicate success or failure. Microsoft code often uses
+    // the FAILED macro to test this variable, you'll see it throughout the code - it's fairly self explanatory.
+    HRESULT hr = S_OK;
+
+
+    //// Initialise DirectX ////
+
+    // Tearing (presenting without waiting for vsync in a window) needs support from both DXGI and the display driver
+    gTearingSupported = false;
+    if (gFlipModel)
+    {
+        IDXGIFactory5* factory;
+        if (SUCCEEDED(CreateDXGIFactory1(__uuidof(IDXGIFactory5), (void**)&factory)))
+        {
+            BOOL allowTearing = FALSE;
+            if (SUCCEEDED(factory->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &allowTearing, sizeof(allowTearing))))
+            {
+                gTearingSupported = (allowTearing == TRUE);
+            }
+            factory->Release();
+        }
+    }
+
+    // Create a Direct3D device (i.e. initialise D3D) and create a swap-chain (create a back buffer to render to)
+    DXGI_SWAP_CHAIN_DESC swapDesc = {};
+    swapDesc.OutputWindow = gHWnd;                           // Target window
+    swapDesc.Windowed = TRUE;
+    if (gFlipModel)
+    {
+        // Flip model hands the back buffers straight to the compositor rather than copying them, and lets us wait
+        // until a buffer is free rather than blocking in Present
+        swapDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+        swapDesc.BufferCount = gSwapBufferCount;
+        swapDesc.Flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+        if (gTearingSupported)  swapDesc.Flags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+    }
+    else
+    {
+        swapDesc.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;      // Use DXGI_SWAP_EFFECT_SEQUENTIAL to retain the previous back buffer (for feedback blur effects)
+        swapDesc.BufferCount = 1;
+    }
+    swapDesc.BufferDesc.Width  = gViewportWidth;             // Target window size
+    swapDesc.BufferDesc.Height = gViewportHeight;            // --"--
+    swapDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // Pixel format of target window
+    swapDesc.BufferDesc.RefreshRate.Numerator   = 60;        // Refresh rate of monitor (provided as fraction = 60/1 here)
+    swapDesc.BufferDesc.RefreshRate.Denominator = 1;         // --"--
+    swapDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+    swapDesc.SampleDesc.Count   = 1;
+    swapDesc.SampleDesc.Quality = 0;
+
+    // The debug layer gives more debugging information (in the "Output" window of Visual Studio), but slows every call
+    UINT flags = gUseDebugLayer ? D3D11_CREATE_DEVICE_DEBUG : 0;
+
+    // A specific adapter needs the "unknown" driver type. All the shaders are shader model 5 so need at least feature level 11.0
+    // WARP is a driver type of its own, with no adapter
+    IDXGIAdapter1* adapter = gUseWarp ? nullptr : FindAdapter();
+    if (adapter == nullptr && !gAdapterSelection.empty() && !gUseWarp)
+    {
+        gLastError = "No graphics adapter matches \"" + gAdapterSelection + "\"";
+        return false;
+    }
+    D3D_DRIVER_TYPE driverType = (adapter != nullptr) ? D3D_DRIVER_TYPE_UNKNOWN : D3D_DRIVER_TYPE_HARDWARE;
+    if (gUseWarp)  driverType = D3D_DRIVER_TYPE_WARP;
+    const D3D_FEATURE_LEVEL featureLevels[] = { D3D_FEATURE_LEVEL_11_1, D3D_FEATURE_LEVEL_11_0 };
+    UINT numFeatureLevels = sizeof(featureLevels) / sizeof(featureLevels[0]);
+
+    auto createDevice = [&](const D3D_FEATURE_LEVEL* levels, UINT numLevels)
+    {
+        if (gHeadless)
+        {
+            return D3D11CreateDevice(adapter, driverType, 0, flags, levels, numLevels, D3D11_SDK_VERSION,
+                                     &gD3DDevice, &gFeatureLevel, &gD3DContext);
+        }
+        return D3D11CreateDeviceAndSwapChain(adapter, driverType, 0, flags, levels, numLevels, D3D11_SDK_VERSION,
+                                             &swapDesc, &gSwapChain, &gD3DDevice, &gFeatureLevel, &gD3DContext);
+    };
+    auto createDeviceAnyLevel = [&]()
+    {
+        HRESULT result = createDevice(featureLevels, numFeatureLevels);
+        if (result == E_INVALIDARG)
+        {
+            // DirectX 11.0 runtimes don't know about feature level 11.1
+            result = createDevice(featureLevels + 1, numFeatureLevels - 1);
+        }
+        return result;
+    };
+    hr = createDeviceAnyLevel();
+    if (FAILED(hr) && (flags & D3D11_CREATE_DEVICE_DEBUG))
+    {
+        // The debug layer isn't available unless the graphics tools are installed, carry on without it
+        flags &= ~D3D11_CREATE_DEVICE_DEBUG;
+        hr = createDeviceAnyLevel();
+    }
+    if (adapter)  adapter->Release();
+    if (FAILED(hr))
+    {
+        gLastError = "Error creating Direct3D device";
+        return false;
+    }
+    gDebugLayerActive = (flags & D3D11_CREATE_DEVICE_DEBUG) != 0;
+
+    // Left null on a D3D11.0 runtime, which can't bind parts of constant buffers (see ConstantBufferRing.h)
+    if (FAILED(gD3DContext->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&gD3DContext1)))  gD3DContext1 = nullptr;
+
+    // Report what was created
+    IDXGIDevice* dxgiDevice;
+    if (SUCCEEDED(gD3DDevice->QueryInterface(__uuidof(IDXGIDevice), (void**)&dxgiDevice)))
+    {
+        IDXGIAdapter* deviceAdapter;
+        if (SUCCEEDED(dxgiDevice->GetAdapter(&deviceAdapter)))
+        {
+            if (FAILED(deviceAdapter->QueryInterface(__uuidof(IDXGIAdapter3), (void**)&gDeviceAdapter)))  gDeviceAdapter = nullptr;
+            IDXGIAdapter1* deviceAdapter1;
+            if (SUCCEEDED(deviceAdapter->QueryInterface(__uuidof(IDXGIAdapter1), (void**)&deviceAdapter1)))
+            {
+                DXGI_ADAPTER_DESC1 desc;
+                deviceAdapter1->GetDesc1(&desc);
+                std::wstring wideName = desc.Description;
+                gAdapterName = std::string(wideName.begin(), wideName.end());
+                deviceAdapter1->Release();
+            }
+            deviceAdapter->Release();
+        }
+        dxgiDevice->Release();
+    }
+    gResourceRegistry.Init(gDeviceAdapter);
+    OutputDebugStringA(("Direct3D device: " + DeviceDescription() + "\n").c_str());
+    gSwapChainFlags = swapDesc.Flags; // ResizeBuffers must be given the same flags
+
+    // Limit the number of frames queued up ahead of the display, and get the object to wait on before each frame
+    if (gFlipModel && gSwapChain != nullptr)
+    {
+        IDXGISwapChain2* swapChain2;
+        hr = gSwapChain->QueryInterface(__uuidof(IDXGISwapChain2), (void**)&swapChain2);
+        if (FAILED(hr))
+        {
+            gLastError = "Error getting frame latency interface from swap chain";
+            return false;
+        }
+        swapChain2->SetMaximumFrameLatency(gMaxFrameLatency);
+        gFrameLatencyWaitable = swapChain2->GetFrameLatencyWaitableObject();
+        swapChain2->Release();
+    }
+
+
+    // Back buffer render target and depth buffer
+    if (!CreateSizeDependentResources())  return false;
+
+    return true;
+}
+
+
 // Release the memory held by all objects created
 void ShutdownDirect3D()
 {
     // Release each Direct3D object to return resources to the system. Leaving these out will cause memory
     // leaks. Check documentation to see which objects need to be released when adding new features in your
     // own projects.
+    if (gD3DContext1)  gD3DContext1->Release();
+    gD3DContext1 = nullptr;
     if (gD3DContext)
     {
         gD3DContext->ClearState(); // This line is also needed to reset the GPU before shutting down DirectX
         gD3DContext->Release();
     }
-    if (gDepthShaderView)        gDepthShaderView->Release();
-    if (gDepthStencil)           gDepthStencil->Release();
-    if (gDepthStencilTexture)    gDepthStencilTexture->Release();
-    if (gBackBufferRenderTarget) gBackBufferRenderTarget->Release();
+    ReleaseSizeDependentResources();
+    if (gFrameLatencyWaitable)   CloseHandle(gFrameLatencyWaitable);
     if (gSwapChain)              gSwapChain->Release();
     if (gD3DDevice)              gD3DDevice->Release();
+    gResourceRegistry.Release();
+    if (gDeviceAdapter)          gDeviceAdapter->Release();
+    gFrameLatencyWaitable = nullptr;
+    gDeviceAdapter = nullptr;
+}
+
+
+// Resize the swap chain buffers to the current viewport size and recreate the back buffer render target and depth
+// buffer. Nothing else is touched. Returns false on failure
+bool ResizeDirect3D()
+{
+    // The swap chain buffers can't be resized while anything refers to them
+    gD3DContext->ClearState();
+    ReleaseSizeDependentResources();
+
+    HRESULT hr = S_OK;
+    if (gSwapChain != nullptr)  hr = gSwapChain->ResizeBuffers(0, gViewportWidth, gViewportHeight, DXGI_FORMAT_UNKNOWN, gSwapChainFlags);
+    if (FAILED(hr))
+    {
+        gLastError = "Error resizing swap chain";
+        return false;
+    }
+    return CreateSizeDependentResources();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Swap chain
+//--------------------------------------------------------------------------------------
+
+// Select the adapter to create the device on, must be called before InitDirect3D. See FindAdapter
+void SelectAdapter(const std::string& adapter)
+{
+    gAdapterSelection = adapter;
+}
+
+// Turn the debug layer on or off, must be called before InitDirect3D. By default it is only used in debug builds
+void UseDebugLayer(bool debugLayer)
+{
+    gUseDebugLayer = debugLayer;
+}
+
+// The adapter, feature level and whether the debug layer is on, e.g. "NVIDIA GeForce GTX 1080, feature level 11.1"
+std::string DeviceDescription()
+{
+    std::string level = (gFeatureLevel == D3D_FEATURE_LEVEL_11_1) ? "11.1" : "11.0";
+    return gAdapterName + ", feature level " + level + (gDebugLayerActive ? ", debug layer" : "") + (gHeadless ? ", headless" : "");
+}
+
+
+// The adapter name in lower case with anything but letters and digits turned into dashes, e.g. "nvidia-geforce-gtx-1080"
+std::string GpuClass()
+{
+    std::string gpuClass;
+    for (char c : gAdapterName)
+    {
+        if (std::isalnum(static_cast<unsigned char>(c)))  gpuClass += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        else if (!gpuClass.empty() && gpuClass.back() != '-')  gpuClass += '-';
+    }
+    while (!gpuClass.empty() && gpuClass.back() == '-')  gpuClass.pop_back();
+    return gpuClass.empty() ? "unknown" : gpuClass;
+}
+
+// Local (dedicated, or shared on integrated GPUs) video memory in use by this process
+size_t VideoMemoryUsage()
+{
+    DXGI_QUERY_VIDEO_MEMORY_INFO info;
+    if (gDeviceAdapter == nullptr || FAILED(gDeviceAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info)))  return 0;
+    return static_cast<size_t>(info.CurrentUsage);
+}
+
+// Create the device without a swap chain, must be called before InitDirect3D
+void UseHeadless(bool warp)
+{
+    gHeadless = true;
+    gUseWarp = warp;
+}
+
+
+// Use a flip-model swap chain, must be called before InitDirect3D
+void UseFlipModelSwapChain(int bufferCount, int maxFrameLatency)
+{
+    gFlipModel = true;
+    gSwapBufferCount = (bufferCount < 2 ? 2 : (bufferCount > 3 ? 3 : bufferCount));
+    gMaxFrameLatency = (maxFrameLatency < 1 ? 1 : maxFrameLatency);
+}
+
+
+// Wait until the swap chain can accept another frame. Waiting here rather than in Present means the frame is rendered
+// with the latest input, and the wait isn't added to the time of the frame's rendering
+void WaitForFrameLatency()
+{
+    if (gFrameLatencyWaitable)  WaitForSingleObjectEx(gFrameLatencyWaitable, 1000, TRUE);
+}
+
+
+// Present the back buffer to the screen. Without vsync a flip-model swap chain must allow tearing to run uncapped
+void PresentFrame(bool vsync)
+{
+    UINT presentFlags = 0;
+    if (!vsync && gTearingSupported)  presentFlags = DXGI_PRESENT_ALLOW_TEARING;
+    if (gSwapChain == nullptr)  return; // Headless
+    gSwapChainOccluded = (gSwapChain->Present(vsync ? 1 : 0, presentFlags) == DXGI_STATUS_OCCLUDED);
+}
+
+
+bool SwapChainOccluded()
+{
+    return gSwapChainOccluded;
+}
+
+// Present only tests the window, nothing is presented
+bool TestOcclusion()
+{
+    if (gSwapChain == nullptr)  return false;
+    gSwapChainOccluded = (gSwapChain->Present(0, DXGI_PRESENT_TEST) == DXGI_STATUS_OCCLUDED);
+    return gSwapChainOccluded;
+}
+
+
+// Another window's swap chain, made by the factory that made the device so it can share the device's resources
+IDXGISwapChain* CreateWindowSwapChain(HWND window, int width, int height)
+{
+    IDXGIFactory* factory = nullptr;
+    IDXGIDevice* dxgiDevice;
+    if (SUCCEEDED(gD3DDevice->QueryInterface(__uuidof(IDXGIDevice), (void**)&dxgiDevice)))
+    {
+        IDXGIAdapter* adapter;
+        if (SUCCEEDED(dxgiDevice->GetAdapter(&adapter)))
+        {
+            if (FAILED(adapter->GetParent(__uuidof(IDXGIFactory), (void**)&factory)))  factory = nullptr;
+            adapter->Release();
+        }
+        dxgiDevice->Release();
+    }
+    if (factory == nullptr)
+    {
+        gLastError = "Error getting the DXGI factory of the device";
+        return nullptr;
+    }
+
+    DXGI_SWAP_CHAIN_DESC swapDesc = {};
+    swapDesc.OutputWindow = window;
+    swapDesc.Windowed = TRUE;
+    if (gFlipModel)
+    {
+        swapDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+        swapDesc.BufferCount = gSwapBufferCount;
+        if (gTearingSupported)  swapDesc.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+    }
+    else
+    {
+        swapDesc.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
+        swapDesc.BufferCount = 1;
+    }
+    swapDesc.BufferDesc.Width  = width;
+    swapDesc.BufferDesc.Height = height;
+    swapDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // Same as the main swap chain
+    swapDesc.BufferDesc.RefreshRate.Numerator   = 60;
+    swapDesc.BufferDesc.RefreshRate.Denominator = 1;
+    swapDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+    swapDesc.SampleDesc.Count   = 1;
+    swapDesc.SampleDesc.Quality = 0;
+
+    IDXGISwapChain* swapChain = nullptr;
+    HRESULT hr = factory->CreateSwapChain(gD3DDevice, &swapDesc, &swapChain);
+    factory->Release();
+    if (FAILED(hr))
+    {
+        gLastError = "Error creating swap chain for another window";
+        return nullptr;
+    }
+    return swapChain;
 }
 
 
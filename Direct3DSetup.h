@@ -1,6 +1,9 @@
 #ifndef _DIRECT3D_SETUP_H_INCLUDED_
 #define _DIRECT3D_SETUP_H_INCLUDED_
 
+#include <d3d11.h>
+#include <string>
+
 //--------------------------------------------------------------------------------------
 // Initialisation of Direct3D and main resources
 //--------------------------------------------------------------------------------------
@@ -11,5 +14,63 @@ bool InitDirect3D();
 // Release the memory held by all objects created
 void ShutdownDirect3D();
 
+// Resize the swap chain to the current gViewportWidth/gViewportHeight, recreating only the back buffer render target and
+// the depth buffer. Clears the context state. Returns false on failure
+bool ResizeDirect3D();
+
+
+//--------------------------------------------------------------------------------------
+// Device
+//--------------------------------------------------------------------------------------
+
+// Choose the graphics adapter by index (e.g. "1") or part of its name (e.g. "nvidia"). Call before InitDirect3D.
+// By default the adapter with the most dedicated video memory is used, which avoids integrated GPUs
+void SelectAdapter(const std::string& adapter);
+
+// Switch the D3D debug layer on or off. Call before InitDirect3D. By default it is only on in debug builds
+void UseDebugLayer(bool debugLayer);
+
+// Create the device with no window or swap chain, for processing images off-screen. The back buffer is then an ordinary
+// texture of the viewport size that can be read back. Uses the WARP software rasteriser if warp is true, otherwise the
+// selected adapter. Call before InitDirect3D
+void UseHeadless(bool warp);
+
+// Adapter name, feature level and whether the debug layer is on, for the device that was created
+std::string DeviceDescription();
+
+// Name for the kind of GPU the device was created on, usable in a file name (e.g. for per-GPU performance baselines)
+std::string GpuClass();
+
+// Bytes of video memory the process is using now, 0 if the OS can't say (before Windows 10)
+size_t VideoMemoryUsage();
+
+
+//--------------------------------------------------------------------------------------
+// Swap chain
+//--------------------------------------------------------------------------------------
+
+// Create a flip-model swap chain with the given number of back buffers (2 or 3) and maximum number of frames queued
+// ahead of the display. Call before InitDirect3D, otherwise a legacy single buffer swap chain is used
+void UseFlipModelSwapChain(int bufferCount, int maxFrameLatency);
+
+// Wait until the swap chain is ready to accept a new frame, call before rendering each frame. Only waits with a flip-model swap chain
+void WaitForFrameLatency();
+
+// Present the back buffer to the screen, optionally waiting for vsync. With a flip-model swap chain
+// and vsync off, tearing is allowed (where supported) so the frame rate isn't capped by the compositor
+void PresentFrame(bool vsync);
+
+// True if the last present found the window hidden (minimised, covered or on a locked screen), so nothing drawn will
+// be seen. Rather than rendering, poll TestOcclusion until this is false again
+bool SwapChainOccluded();
+
+// Check whether the window is still hidden without presenting anything, returns SwapChainOccluded
+bool TestOcclusion();
+
+// Create a swap chain like the main one for another window on the same device, e.g. for the output windows (see
+// OutputWindows.h). There is no frame latency object, the main swap chain's paces the frames. Call after InitDirect3D.
+// Returns null on failure (reason in gLastError)
+IDXGISwapChain* CreateWindowSwapChain(HWND window, int width, int height);
+
 
 #endif //_DIRECT3D_SETUP_H_INCLUDED_
@@ -0,0 +1,36 @@
+//--------------------------------------------------------------------------------------
+// Dual Filter Downsample Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// First half of the dual filter (Kawase) blur. Halves the size of the image with five bilinear taps: one at the
+// centre of the output pixel weighted 4, and one on each corner of it weighted 1. Each tap averages a 2x2 block of the
+// larger texture, so a handful of taps per pass blurs as wide as a much bigger kernel once the passes are chained.
+// DualFilterUpsample_pp works back up to full size
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    SceneTexture   : register(t0); // Texture twice the size of the output
+SamplerState PointSample    : register(s0);
+SamplerState BilinearSample : register(s1);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	float2 texel = gTexelSize; // size of each pixel of the larger texture, half an output pixel
+
+	float3 colour = SceneTexture.Sample(BilinearSample, input.uv).rgb * 4 +
+	                SceneTexture.Sample(BilinearSample, input.uv + texel * float2(-1, -1)).rgb +
+	                SceneTexture.Sample(BilinearSample, input.uv + texel * float2( 1, -1)).rgb +
+	                SceneTexture.Sample(BilinearSample, input.uv + texel * float2(-1,  1)).rgb +
+	                SceneTexture.Sample(BilinearSample, input.uv + texel * float2( 1,  1)).rgb;
+
+	return float4(colour / 8, 1.0f);
+}
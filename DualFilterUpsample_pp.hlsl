@@ -0,0 +1,52 @@
+//--------------------------------------------------------------------------------------
+// Dual Filter Upsample Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Second half of the dual filter (Kawase) blur, doubling the size of the image after DualFilterDownsample_pp. Eight
+// bilinear taps in a diamond around the output pixel, the four on the diagonals weighted twice the four on the axes,
+// make a smooth tent filter of the smaller texture, so the blocks of the small mips don't show.
+//
+// With DUAL_FILTER_ADD_LEVEL set to 1 this is a bloom upsample instead: the weighted mip at the output size is added,
+// as BloomUpsample_pp but with the tent filter doing the blurring in place of separate blur passes
+
+#include "Common.hlsli"
+
+#ifndef DUAL_FILTER_ADD_LEVEL
+#define DUAL_FILTER_ADD_LEVEL 0
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    CoarserTexture : register(t0); // Texture half the size of the output
+Texture2D    LevelTexture   : register(t1); // Bloom mip at the output size, only with DUAL_FILTER_ADD_LEVEL
+SamplerState PointSample    : register(s0);
+SamplerState BilinearSample : register(s1);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	float2 halfTexel = 0.5f * gTexelSize; // half a pixel of the smaller texture, one output pixel
+
+	float3 colour = CoarserTexture.Sample(BilinearSample, input.uv + halfTexel * float2(-2,  0)).rgb +
+	                CoarserTexture.Sample(BilinearSample, input.uv + halfTexel * float2( 2,  0)).rgb +
+	                CoarserTexture.Sample(BilinearSample, input.uv + halfTexel * float2( 0, -2)).rgb +
+	                CoarserTexture.Sample(BilinearSample, input.uv + halfTexel * float2( 0,  2)).rgb +
+	                CoarserTexture.Sample(BilinearSample, input.uv + halfTexel * float2(-1, -1)).rgb * 2 +
+	                CoarserTexture.Sample(BilinearSample, input.uv + halfTexel * float2( 1, -1)).rgb * 2 +
+	                CoarserTexture.Sample(BilinearSample, input.uv + halfTexel * float2(-1,  1)).rgb * 2 +
+	                CoarserTexture.Sample(BilinearSample, input.uv + halfTexel * float2( 1,  1)).rgb * 2;
+	colour /= 12;
+
+#if DUAL_FILTER_ADD_LEVEL
+	float3 level = LevelTexture.Sample(PointSample, input.uv).rgb;
+	colour = level * bloomLevelWeight + colour * bloomCoarserWeight;
+#endif
+
+	return float4(colour, 1.0f);
+}
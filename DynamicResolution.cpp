@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------------------------
+// Dynamic resolution
+//--------------------------------------------------------------------------------------
+
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+DynamicResolution gDynamicResolution;
+
+const float DynamicResolution::MIN_SCALE     = 0.5f;
+const float DynamicResolution::MAX_STEP      = 0.05f;
+const float DynamicResolution::HEADROOM      = 0.85f;
+const int   DynamicResolution::SETTLE_FRAMES = 8;
+const float DynamicResolution::PRESSURE_SCALE    = 0.9f;
+const float DynamicResolution::PRESSURE_HEADROOM = 0.6f;
+
+
+void DynamicResolution::Enable(float budgetMilliseconds)
+{
+	mEnabled = true;
+	mFixed = false;
+	mBudget = budgetMilliseconds;
+	mSmoothedMilliseconds = 0.0f;
+	mFramesSinceChange = 0;
+	mUnderPressure = false;
+}
+
+void DynamicResolution::EnableFixed(float scale)
+{
+	mEnabled = true;
+	mFixed = true;
+	mScale = std::max(MIN_SCALE, std::min(scale, 1.0f));
+	mUnderPressure = false;
+}
+
+void DynamicResolution::Disable()
+{
+	mEnabled = false;
+	mFixed = false;
+	mScale = 1.0f;
+	mUnderPressure = false;
+}
+
+
+// Choose the scale for this frame
+float DynamicResolution::Update(float gpuMilliseconds)
+{
+	if (!mEnabled)  return 1.0f;
+	if (mFixed)  return mScale;
+	if (gpuMilliseconds <= 0.0f)  return mScale; // No timings yet
+
+	// Smooth out single frame spikes, but start from the first timing seen
+	if (mSmoothedMilliseconds <= 0.0f)  mSmoothedMilliseconds = gpuMilliseconds;
+	else                                mSmoothedMilliseconds += 0.1f * (gpuMilliseconds - mSmoothedMilliseconds);
+
+	// Hysteresis between the two thresholds
+	if (mScale < PRESSURE_SCALE)  mUnderPressure = true;
+	else if (mScale >= 1.0f && mSmoothedMilliseconds < mBudget * PRESSURE_HEADROOM)  mUnderPressure = false;
+
+	++mFramesSinceChange;
+	if (mFramesSinceChange < SETTLE_FRAMES)  return mScale;
+
+	// Over budget scale down, well under budget scale up. Cost goes with the square of the scale
+	bool overBudget  = mSmoothedMilliseconds > mBudget;
+	bool underBudget = mSmoothedMilliseconds < mBudget * HEADROOM;
+	if (overBudget || (underBudget && mScale < 1.0f))
+	{
+		float ideal = mScale * std::sqrt(mBudget / mSmoothedMilliseconds);
+		float step  = std::max(-MAX_STEP, std::min(ideal - mScale, MAX_STEP));
+		float scale = std::max(MIN_SCALE, std::min(mScale + step, 1.0f));
+		if (scale != mScale)
+		{
+			mScale = scale;
+			mFramesSinceChange = 0;
+		}
+	}
+	return mScale;
+}
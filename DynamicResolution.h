@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+// Dynamic resolution
+//--------------------------------------------------------------------------------------
+// Picks the scale to render the scene at each frame so the GPU frame time stays within a budget. The scene is
+// rendered at the scale into part of the full size scene texture, then upscaled as the first post-process.
+// GPU cost is taken to be roughly proportional to the number of pixels, i.e. the square of the scale. The GPU
+// timings are a few frames old (see GpuProfiler.h), so the scale changes gradually and waits for each change
+// to show up in the timings before changing again.
+//
+// UnderPressure reports when the budget is being hard to hold, so other costs (e.g. the rate of the smooth
+// post-processes) can be cut too. It turns on once the scale has had to drop noticeably and only turns off again
+// when the scale is back at full with plenty of time to spare, so it doesn't flip between frames.
+//
+// The scale can instead be fixed, e.g. at 67-75% with the edge-adaptive upscale (see EffectSettings::spatialUpscale)
+
+#ifndef _DYNAMIC_RESOLUTION_H_INCLUDED_
+#define _DYNAMIC_RESOLUTION_H_INCLUDED_
+
+
+class DynamicResolution
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Start scaling the resolution to keep the GPU frame time within the given budget in milliseconds
+	void Enable(float budgetMilliseconds);
+
+	// Render at a fixed fraction of the full width and height rather than following the budget
+	void EnableFixed(float scale);
+
+	// Go back to full resolution
+	void Disable();
+
+	// Call once per frame with the most recent GPU frame time, returns the scale to render this frame at
+	float Update(float gpuMilliseconds);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	bool  Enabled()  { return mEnabled; }
+	bool  Fixed()    { return mFixed;   } // Enabled at a fixed scale
+	float Scale()    { return mScale;   } // Fraction of the full width and height
+	float Budget()   { return mBudget;  }
+	bool  UnderPressure()  { return mUnderPressure; } // Struggling to stay within budget, see above
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const float MIN_SCALE;     // Lowest scale allowed
+	static const float MAX_STEP;      // Largest change in scale in a single step
+	static const float HEADROOM;      // Only scale up if the frame time is below this fraction of the budget
+	static const int   SETTLE_FRAMES; // Frames to wait after a change before changing again
+	static const float PRESSURE_SCALE;    // Under pressure once the scale drops below this
+	static const float PRESSURE_HEADROOM; // No longer under pressure at full scale below this fraction of the budget
+
+	bool  mEnabled = false;
+	bool  mFixed   = false;
+	float mBudget  = 15.0f;
+	float mScale   = 1.0f;
+	float mSmoothedMilliseconds = 0.0f; // Exponential moving average of the GPU frame time
+	int   mFramesSinceChange    = 0;
+	bool  mUnderPressure        = false;
+};
+
+
+extern DynamicResolution gDynamicResolution;
+
+
+#endif //_DYNAMIC_RESOLUTION_H_INCLUDED_
@@ -0,0 +1,820 @@
+//--------------------------------------------------------------------------------------
+// Effect chains
+//--------------------------------------------------------------------------------------
+// See EffectChain.h for an overview
+
+#include "EffectChain.h"
+#include "EffectPipeline.h"
+#include "AutoExposure.h"
+#include "BloomTiles.h"
+#include "ColourLut.h"
+#include "ComputeTuner.h"
+#include "EffectResources.h"
+#include "RenderTargetPool.h"
+#include "Shader.h"
+#include "State.h"
+#include "StateCache.h"
+#include "CpuProfiler.h"
+#include "Common.h"
+#include "GraphicsHelpers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+
+// The compute shader Gaussian blurs cache a row / column of pixels in groupshared memory instead of fetching every tap
+// from the texture, when they are worth their extra dispatch overhead is decided by gBlurSelector
+const unsigned int BLUR_GROUP_SIZE = 256; // Threads per group in the compute shaders (GROUP_SIZE)
+const unsigned int UPSCALE_GROUP_SIZE = 8; // Threads across and down each group of SpatialUpscale_cs and Sharpen_cs
+
+// Flags for the fused colour effects shaders (ColourEffects.hlsli), which apply them in this order
+const int COLOUR_EFFECT_FOG        = 1;
+const int COLOUR_EFFECT_TINT       = 2;
+const int COLOUR_EFFECT_UNDERWATER = 4;
+const int COLOUR_EFFECT_RETRO      = 8;
+const int COLOUR_EFFECT_EXPOSURE   = 16;
+const int COLOUR_EFFECT_MSAA       = 32; // Resolve a multisampled input as it is read, before the others
+
+// Bloom is blurred at 1/2, 1/4, 1/8 and 1/16 size. Blur radius (in pixels of that mip) and weight of each mip in the glow
+const int NUM_BLOOM_MIPS = 4;
+float bloomMipRadius[NUM_BLOOM_MIPS] = { 4, 4, 4, 4 };
+float bloomMipWeight[NUM_BLOOM_MIPS] = { 1.0f, 0.8f, 0.6f, 0.5f };
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+// Upload the post-processing constants, called by the post-process graph before each pass is drawn. Most passes don't
+// change any settings, so the upload is usually skipped (the buffer is bound once in Apply)
+void UpdatePostProcessingConstants()
+{
+	gPostProcessingConstantBuffer.Update(gPostProcessingConstants);
+}
+
+
+// Rebuild the Gaussian blur weights if the blur settings have changed since they were last built. The pixel shaders use
+// pairs of neighbouring pixels merged into one bilinear tap placed between them, weighted so that filtering gives
+// the same result as sampling both pixels. This halves the number of texture reads for the same blur
+void UpdateBlurKernel(float blurStrength, float blurCurve)
+{
+	static float builtStrength = -1;
+	static float builtCurve    = -1;
+	if (blurStrength == builtStrength && blurCurve == builtCurve)  return;
+	builtStrength = blurStrength;
+	builtCurve    = blurCurve;
+
+	int radius = static_cast<int>((blurStrength - 1) / 2);
+	if (radius < 0)                radius = 0;
+	if (radius > MAX_BLUR_RADIUS)  radius = MAX_BLUR_RADIUS;
+
+	// Same bell curve as the shaders used to calculate per-pixel (see the desmos graph in GaussianBlurHorizontal_pp.hlsl),
+	// its constant factor is dropped as the weights are normalised afterwards
+	float c = blurCurve;
+	float total = 0;
+	for (int i = 0; i <= radius; ++i)
+	{
+		float x = static_cast<float>(i);
+		float weight = std::exp(-(x * x) / 2 * (c * c));
+		gBlurKernelConstants.weights[i].offset = x;
+		gBlurKernelConstants.weights[i].weight = weight;
+		total += (i == 0 ? weight : 2 * weight); // Pixels either side of the centre
+	}
+	for (int i = 0; i <= radius; ++i)
+	{
+		gBlurKernelConstants.weights[i].weight /= total;
+	}
+
+	// Merge pixels i and i+1 into a single tap between them, leaving the centre pixel on its own
+	gBlurKernelConstants.taps[0] = gBlurKernelConstants.weights[0];
+	int tapCount = 1;
+	for (int i = 1; i <= radius; i += 2)
+	{
+		float weight1 = gBlurKernelConstants.weights[i].weight;
+		float weight2 = (i + 1 <= radius ? gBlurKernelConstants.weights[i + 1].weight : 0.0f);
+		float weight  = weight1 + weight2;
+
+		BlurKernelTap& tap = gBlurKernelConstants.taps[tapCount++];
+		tap.weight = weight;
+		tap.offset = (weight > 0 ? (i * weight1 + (i + 1) * weight2) / weight : static_cast<float>(i));
+	}
+	gBlurKernelConstants.tapCount = tapCount;
+	gBlurKernelConstants.radius   = radius;
+
+	UpdateConstantBuffer(gBlurKernelConstantBuffer, gBlurKernelConstants);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+bool EffectChain::Apply(ID3D11ShaderResourceView* input, ID3D11RenderTargetView* output, ID3D11RenderTargetView* inputTarget /*= nullptr*/)
+{
+	CPU_PROFILE_SCOPE("EffectChain");
+
+	// Using special vertex shader than creates its own data for a full screen triangle, with the uvs set up for each pass
+	gStateCache.VSSetShader(gPostProcessVertexShader, nullptr, 0);
+	gStateCache.GSSetShader(nullptr, nullptr, 0);  // Switch off geometry shader when not using it (pass nullptr for first parameter)
+
+	// States - no blending, ignore depth buffer and culling
+	gStateCache.OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
+	gStateCache.OMSetDepthStencilState(gNoDepthBufferState, 0);
+	gStateCache.RSSetState(gCullNoneState);
+
+	// No need to set vertex/index buffer (see fullscreen quad vertex shader), just indicate that a triangle will be created
+	gStateCache.IASetInputLayout(NULL); // No vertex data
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	// All post-processes use point sampling of their input textures, the Gaussian blur and scaling copies also use bilinear sampling
+	gStateCache.SetSampler(0, gPointSampler);
+	gStateCache.SetSampler(1, gBilinearClampSampler);
+
+	// The settings of this chain. Effects sharing the constant buffer between chains set them all here, each effect's
+	// packing is with its description (see EffectPipeline.h). The passes that need more set their own constants before
+	// they are drawn
+	AllEffects::SetConstants(mSettings, gPostProcessingConstants);
+	gPostProcessingConstants.autoExposure = mSettings.autoExposure ? 1.0f : 0.0f;
+
+	// Post-processing settings are uploaded before each pass if they have changed
+	gStateCache.SetConstantBuffer(POST_PROCESSING_CONSTANTS_SLOT, gPostProcessingConstantBuffer.Buffer());
+
+	// The blur kernel has its own constant buffer as it rarely changes. The downsampled blur uses a kernel half the width
+	// on a half size image, so the bell curve is twice as steep
+	mGaussianBlurTechnique = mSettings.dualFilterBlur ? BlurTechnique::DualFilter : mSettings.blurTechnique;
+	if (mGaussianBlurTechnique == BlurTechnique::Auto)  mGaussianBlurTechnique = gBlurSelector.Select(mSettings.blurStrength);
+	if (mGaussianBlurTechnique == BlurTechnique::Pixel && mSettings.computeShaders)  mGaussianBlurTechnique = BlurTechnique::Compute;
+	if (mSettings.temporal && mGaussianBlurTechnique != BlurTechnique::DualFilter)  mGaussianBlurTechnique = BlurTechnique::Downsampled;
+	if (mGaussianBlurTechnique == BlurTechnique::Downsampled)
+		UpdateBlurKernel(mSettings.blurStrength / 2, mSettings.blurCurve * 2);
+	else
+		UpdateBlurKernel(mSettings.blurStrength, mSettings.blurCurve);
+	gStateCache.SetConstantBuffer(BLUR_KERNEL_CONSTANTS_SLOT, gBlurKernelConstantBuffer);
+
+	// Measure the input before any effects, only the part Upscale reads if the chain has one
+	if (mSettings.autoExposure)
+	{
+		bool upscaled = false;
+		for (auto effect : mEffects)  if (effect == Effect::Upscale)  upscaled = true;
+		gAutoExposure.Measure(input, upscaled ? mSettings.inputUVScale : CVector2(1, 1), mSettings.frameTime, mSettings.bloomThreshold);
+		gAutoExposure.Bind();
+	}
+
+
+	// Declare the effects as a graph. Each pass reads the texture holding the result so far and writes a new one. The
+	// graph decides which real render targets are used, and the final pass writes straight to the output
+	mGraph.SetReducedRate(mSettings.reducedRate, gReducedRateReconstruct_PostProcess);
+	mBlurResolved = mBloomResolved = false;
+	mResolveFailed = false;
+
+	// A multisampled input is resolved by the first pass, which is the colour effects pass with no effects if the chain
+	// doesn't start with one. It can't be reused for the other textures
+	D3D11_SHADER_RESOURCE_VIEW_DESC inputDesc = {};
+	input->GetDesc(&inputDesc);
+	bool multisampled = (inputDesc.ViewDimension == D3D11_SRV_DIMENSION_TEXTURE2DMS);
+	mGraph.Begin(input, multisampled ? nullptr : inputTarget, output, gCopy_PostProcess);
+	mImageFormat = mGraph.Format(mGraph.SceneTexture());
+	PostProcessTexture current = mGraph.SceneTexture();
+
+	// Fog, tint, underwater and retro are collected and run as one fused pass, only split where another effect comes
+	// between them or they are out of the order the fused shader applies them in. Fog is skipped without a depth buffer
+	int colourEffects = multisampled ? COLOUR_EFFECT_MSAA : 0;
+	for (auto effect : mEffects)
+	{
+		if (effect == Effect::Fog && mSettings.depth == nullptr)  continue;
+
+		// Effects with shaders of their own are off until they are loaded
+		if (mSettings.backgroundLoad ? !gEffectResources.Request(effect) : !gEffectResources.Load(effect))
+		{
+			if (!mSettings.backgroundLoad)
+			{
+				mGraph.ReleaseTargets(); // Reason in gLastError
+				return false;
+			}
+			continue;
+		}
+
+		int colourEffect = (effect == Effect::Fog)        ? COLOUR_EFFECT_FOG :
+		                   (effect == Effect::Tint)       ? COLOUR_EFFECT_TINT :
+		                   (effect == Effect::Underwater) ? COLOUR_EFFECT_UNDERWATER :
+		                   (effect == Effect::Retro)      ? COLOUR_EFFECT_RETRO : 0;
+		if (colourEffect != 0)
+		{
+			if ((colourEffects & ~COLOUR_EFFECT_MSAA) >= colourEffect)  // Already has this effect or one applied after it
+			{
+				current = AddColourEffectsPass(current, colourEffects);
+				colourEffects = 0;
+			}
+			colourEffects |= colourEffect;
+			continue;
+		}
+
+		// Other effects need the colour effects so far applied first
+		current = AddColourEffectsPass(current, colourEffects);
+		colourEffects = 0;
+
+		switch (effect)
+		{
+		case Effect::Upscale:
+		{
+			CVector2 uvScale = mSettings.inputUVScale;
+			CVector2 uvMax   = mSettings.inputUVMax;
+			PostProcessTexture upscaled = mGraph.CreateTexture(1.0f, mImageFormat);
+			if (mSettings.spatialUpscale)
+			{
+				// Edge-adaptive upscale then sharpening, both one thread per output pixel
+				float sharpness = mSettings.upscaleSharpness;
+				mGraph.AddComputePass("Spatial Upscale", gSpatialUpscale_Compute, { current }, upscaled,
+				                      UPSCALE_GROUP_SIZE, UPSCALE_GROUP_SIZE,
+				                      [uvScale]() { gPostProcessingConstants.passUVScale = uvScale; });
+				if (sharpness > 0)
+				{
+					PostProcessTexture sharpened = mGraph.CreateTexture(1.0f, mImageFormat);
+					mGraph.AddComputePass("Sharpen", gSharpen_Compute, { upscaled }, sharpened,
+					                      UPSCALE_GROUP_SIZE, UPSCALE_GROUP_SIZE,
+					                      [sharpness]() { gPostProcessingConstants.upscaleSharpness = sharpness; });
+					upscaled = sharpened;
+				}
+			}
+			else
+			{
+				mGraph.AddPass("Upscale", gUpscale_PostProcess, { current }, upscaled,
+				               [uvScale, uvMax]() { gPostProcessingConstants.passUVScale = uvScale;
+				                                    gPostProcessingConstants.sceneUVMax  = uvMax; });
+			}
+			current = upscaled;
+			break;
+		}
+		case Effect::GaussianBlur:  current = AddGaussianBlurPasses(current);  break;
+		case Effect::Blur:          current = AddBoxBlurPasses(current);       break;
+		case Effect::Bloom:         current = mSettings.fftBloom ? AddFftBloomPasses(current) : AddBloomPasses(current);  break;
+		case Effect::StarFilter:    current = AddStarFilterPasses(current);    break;
+		case Effect::DepthOfField:  current = AddDepthOfFieldPasses(current);  break;
+		case Effect::Smaa:          current = AddSmaaPasses(current);          break;
+		case Effect::Fxaa:
+		{
+			PostProcessTexture antialiased = mGraph.CreateTexture(1.0f, mImageFormat);
+			mGraph.AddPass("FXAA", gFxaa_PostProcess, { current }, antialiased);
+			current = antialiased;
+			break;
+		}
+		case Effect::PyramidBlur:
+		{
+			// With the input's mip chain, one GenerateMips and a few trilinear taps replace the full resolution kernel.
+			// Only when nothing has changed the input yet, as the mips are built from it
+			PostProcessTexture blurred = mGraph.CreateTexture(1.0f, mImageFormat);
+			ID3D11ShaderResourceView* mipChain = mSettings.inputMipChain;
+			if (mipChain != nullptr && current == mGraph.SceneTexture())
+			{
+				float level = mSettings.pyramidBlurLevel;
+				float edgeLevel = mSettings.pyramidBlurEdgeLevel;
+				mGraph.AddPass("Pyramid Blur", gPyramidBlurMips_PostProcess, { current }, blurred,
+				               [mipChain, level, edgeLevel]() { gD3DContext->GenerateMips(mipChain);
+				                                                gD3DContext->PSSetShaderResources(0, 1, &mipChain);
+				                                                gPostProcessingConstants.pyramidBlurLevel     = level;
+				                                                gPostProcessingConstants.pyramidBlurEdgeLevel = edgeLevel; });
+			}
+			else
+			{
+				mGraph.AddReducedRatePass("Pyramid Blur", gPyramidBlur_PostProcess, { current }, blurred);
+			}
+			current = blurred;
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	// The exposure is applied to the final colour, so it joins the last colour effects pass
+	current = AddColourEffectsPass(current, colourEffects | (mSettings.autoExposure ? COLOUR_EFFECT_EXPOSURE : 0));
+
+	if (mResolveFailed)
+	{
+		mGraph.ReleaseTargets();
+		return false;
+	}
+
+	// The graph copies the input to the output itself if no passes were added
+	mGraph.SetOutput(current);
+	if (!mGraph.Compile())
+	{
+		mGraph.ReleaseTargets();
+		return false;
+	}
+	mGraph.Execute(UpdatePostProcessingConstants);
+
+	// This frame's temporal results are the history for the next. Histories not used this time are given back, so
+	// switching an effect back on doesn't blend in an old result
+	if (mBlurResolved)   mBlurHistory.Advance(mSettings.viewProjection);
+	else                 mBlurHistory.Release();
+	if (mBloomResolved)  mBloomHistory.Advance(mSettings.viewProjection);
+	else                 mBloomHistory.Release();
+
+	// The depth buffer can't be bound for writing while it is still bound here, nor the exposure buffer by the next
+	// measurement
+	ID3D11ShaderResourceView* nullSRV = nullptr;
+	if (mSettings.depth != nullptr)
+	{
+		gD3DContext->PSSetShaderResources(POST_PROCESS_DEPTH_SLOT, 1, &nullSRV);
+		if (mSettings.computeShaders)  gD3DContext->CSSetShaderResources(POST_PROCESS_DEPTH_SLOT, 1, &nullSRV);
+	}
+	if (mSettings.autoExposure && mSettings.computeShaders)  gD3DContext->CSSetShaderResources(EXPOSURE_SLOT, 1, &nullSRV);
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+// Add a single pass applying the given combination of colour effects (COLOUR_EFFECT_ flags above), using the shader
+// permutation with only those effects compiled in, as a pixel or compute shader. Returns the output texture, nothing is
+// added if no effects are given
+PostProcessTexture EffectChain::AddColourEffectsPass(PostProcessTexture input, int effects)
+{
+	if (effects == 0)  return input;
+
+	ShaderDefines defines = { { "COLOUR_EFFECT_FOG",        (effects & COLOUR_EFFECT_FOG)        ? "1" : "0" },
+	                          { "COLOUR_EFFECT_TINT",       (effects & COLOUR_EFFECT_TINT)       ? "1" : "0" },
+	                          { "COLOUR_EFFECT_UNDERWATER", (effects & COLOUR_EFFECT_UNDERWATER) ? "1" : "0" },
+	                          { "COLOUR_EFFECT_RETRO",      (effects & COLOUR_EFFECT_RETRO)      ? "1" : "0" },
+	                          { "COLOUR_EFFECT_RETRO_PIXELLATE", (effects & COLOUR_EFFECT_RETRO) && !mSettings.retroPixellate ? "0" : "1" },
+	                          { "COLOUR_EFFECT_EXPOSURE",   (effects & COLOUR_EFFECT_EXPOSURE)   ? "1" : "0" },
+	                          { "COLOUR_EFFECT_MSAA",       (effects & COLOUR_EFFECT_MSAA)       ? "1" : "0" } };
+
+	// Retro's colour depth from the colour grading LUT if selected, done with arithmetic if the LUT can't be built
+	ID3D11ShaderResourceView* lut = nullptr;
+	if ((effects & COLOUR_EFFECT_RETRO) && mSettings.colourLut)
+	{
+		ColourLutSettings lutSettings;
+		lutSettings.bitColour = mSettings.bitColour;
+		if (gColourLut.Update(lutSettings))  lut = gColourLut.Lut();
+	}
+	defines.push_back({ "COLOUR_EFFECT_LUT", lut != nullptr ? "1" : "0" });
+	if (mSettings.halfPrecision && HalfPrecisionSupported())  defines.push_back({ "HALF_PRECISION", "1" });
+
+	ID3D11ShaderResourceView* depth    = (effects & COLOUR_EFFECT_FOG)      ? mSettings.depth : nullptr;
+	ID3D11ShaderResourceView* exposure = (effects & COLOUR_EFFECT_EXPOSURE) ? gAutoExposure.ExposureBuffer() : nullptr;
+
+	// The compute version compiles in the group size, and binds the extra textures and samplers itself as the state
+	// cache only binds samplers for the pixel shaders
+	unsigned int groupWidth  = (mSettings.computeGroupWidth  > 0) ? mSettings.computeGroupWidth  : gComputeTuner.GroupWidth();
+	unsigned int groupHeight = (mSettings.computeGroupHeight > 0) ? mSettings.computeGroupHeight : gComputeTuner.GroupHeight();
+	ID3D11ComputeShader* computeShader = nullptr;
+	if (mSettings.computeShaders)
+	{
+		ShaderDefines computeDefines = defines;
+		computeDefines.push_back({ "GROUP_SIZE_X", std::to_string(groupWidth) });
+		computeDefines.push_back({ "GROUP_SIZE_Y", std::to_string(groupHeight) });
+		computeShader = GetComputeShaderPermutation("ColourEffects_cs", computeDefines);
+	}
+	ID3D11PixelShader* shader = (computeShader == nullptr) ? GetPixelShaderPermutation("ColourEffects_pp", defines) : nullptr;
+
+	PostProcessTexture output = (computeShader != nullptr || shader != nullptr) ? mGraph.CreateTexture(1.0f, mImageFormat) : input;
+	if (computeShader != nullptr)
+	{
+		mGraph.AddComputePass("Colour Effects", computeShader, { input }, output, groupWidth, groupHeight,
+		                      [lut, depth, exposure]()
+		                      {
+		                          ID3D11SamplerState* samplers[] = { gPointSampler, gBilinearClampSampler };
+		                          gD3DContext->CSSetSamplers(0, 2, samplers);
+		                          if (lut)       gD3DContext->CSSetShaderResources(1, 1, &lut);
+		                          if (depth)     gD3DContext->CSSetShaderResources(POST_PROCESS_DEPTH_SLOT, 1, &depth);
+		                          if (exposure)  gD3DContext->CSSetShaderResources(EXPOSURE_SLOT, 1, &exposure);
+		                      });
+	}
+	else if (shader != nullptr)
+	{
+		mGraph.AddPass("Colour Effects", shader, { input }, output,
+		               [lut, depth]()
+		               {
+		                   if (lut)    gD3DContext->PSSetShaderResources(1, 1, &lut);
+		                   if (depth)  gD3DContext->PSSetShaderResources(POST_PROCESS_DEPTH_SLOT, 1, &depth);
+		               });
+	}
+	else
+	{
+		// Compile error (reason in gLastError), leave the colour effects off but keep the fog and exposure from their
+		// own shaders, the picture would be badly wrong without them. There is no other way to read a multisampled input
+		if (effects & COLOUR_EFFECT_MSAA)
+		{
+			mResolveFailed = true;
+			return input;
+		}
+		if (depth != nullptr)
+		{
+			PostProcessTexture fogged = mGraph.CreateTexture(1.0f, mImageFormat);
+			mGraph.AddPass("Fog", gFog_PostProcess, { output }, fogged,
+			               [depth]() { gD3DContext->PSSetShaderResources(POST_PROCESS_DEPTH_SLOT, 1, &depth); });
+			output = fogged;
+		}
+		if (exposure != nullptr)
+		{
+			PostProcessTexture exposed = mGraph.CreateTexture(1.0f, mImageFormat);
+			mGraph.AddPass("Exposure", gExposure_PostProcess, { output }, exposed);
+			output = exposed;
+		}
+	}
+	return output;
+}
+
+
+// Horizontal then vertical Gaussian blur passes, in pixel or compute shaders, or at half size between a dual filter
+// downsample and upsample. Or the dual filter blur instead. The technique was chosen in Apply
+PostProcessTexture EffectChain::AddGaussianBlurPasses(PostProcessTexture input)
+{
+	if (mGaussianBlurTechnique == BlurTechnique::DualFilter)  return AddDualFilterBlurPasses(input, mSettings.dualFilterIterations);
+
+	// The half size blur uses the pixel shaders, the kernel is now narrow enough that the compute shaders don't help
+	bool downsampled = (mGaussianBlurTechnique == BlurTechnique::Downsampled);
+	float scale = downsampled ? 0.5f : 1.0f;
+	if (downsampled)
+	{
+		PostProcessTexture smaller = mGraph.CreateTexture(scale, mSettings.blurFormat);
+		mGraph.AddPass("Gaussian Blur Downsample", gDualFilterDownsample_PostProcess, { input }, smaller);
+		input = smaller;
+	}
+
+	PostProcessTexture blurredH = mGraph.CreateTexture(scale, mSettings.blurFormat);
+	PostProcessTexture blurredV = mGraph.CreateTexture(scale, downsampled ? mSettings.blurFormat : mImageFormat);
+	if (mGaussianBlurTechnique == BlurTechnique::Compute)
+	{
+		mGraph.AddComputePass("Gaussian Blur H", EffectShader(gGaussianBlurH_Compute, "GaussianBlurHorizontal_cs"), { input },    blurredH, BLUR_GROUP_SIZE, 1);
+		mGraph.AddComputePass("Gaussian Blur V", EffectShader(gGaussianBlurV_Compute, "GaussianBlurVertical_cs"),   { blurredH }, blurredV, 1, BLUR_GROUP_SIZE);
+	}
+	else
+	{
+		mGraph.AddPass("Gaussian Blur H", EffectShader(gGaussianBlurH_PostProcess, "GaussianBlurHorizontal_pp"), { input }, blurredH);
+		mGraph.AddReducedRatePass("Gaussian Blur V", EffectShader(gGaussianBlurV_PostProcess, "GaussianBlurVertical_pp"), { blurredH }, blurredV); // Half rate keeps the rows
+	}
+
+	// Temporal, the resolve scales the half size blur up in place of the upsample. Only the first blur of the chain, there
+	// is one history
+	if (downsampled && mSettings.temporal && !mBlurResolved && mBlurHistory.Prepare(mGraph.SceneWidth(), mGraph.SceneHeight(), mGraph.Format(blurredV)))
+	{
+		mBlurResolved = true;
+		return AddTemporalResolvePass("Gaussian Blur Temporal", blurredV, mBlurHistory);
+	}
+
+	if (downsampled)
+	{
+		PostProcessTexture upsampled = mGraph.CreateTexture(1.0f, mImageFormat);
+		mGraph.AddPass("Gaussian Blur Upsample", gDualFilterUpsample_PostProcess, { blurredV }, upsampled);
+		blurredV = upsampled;
+	}
+	return blurredV;
+}
+
+
+// Box blur read from a summed-area table of the image, so the cost doesn't depend on the blur strength. The table is
+// built with a prefix sum along the rows then down the columns, in float as the sums get large
+PostProcessTexture EffectChain::AddBoxBlurPasses(PostProcessTexture input)
+{
+	PostProcessTexture rowSums = mGraph.CreateTexture(1.0f, DXGI_FORMAT_R32G32B32A32_FLOAT);
+	PostProcessTexture table   = mGraph.CreateTexture(1.0f, DXGI_FORMAT_R32G32B32A32_FLOAT);
+	PostProcessTexture blurred = mGraph.CreateTexture(1.0f, mImageFormat);
+	mGraph.AddComputePass("Blur Table Rows",    gSummedAreaTableRows_Compute,    { input },   rowSums, 0, 1);
+	mGraph.AddComputePass("Blur Table Columns", gSummedAreaTableColumns_Compute, { rowSums }, table,   1, 0);
+	mGraph.AddPass("Blur", gBlur_PostProcess, { table }, blurred);
+	return blurred;
+}
+
+
+// Bright parts of the image are extracted while halving the size, then the image is halved again down to 1/16 size
+// (or less far with fewer bloom mips).
+// Each mip is blurred, the mips are added back up the chain and the result is added on to the image. With the dual
+// filter blur the downsamples and upsamples do the blurring themselves
+PostProcessTexture EffectChain::AddBloomPasses(PostProcessTexture input)
+{
+	// Temporal, the half size mip isn't blurred. Its weight goes to the quarter size mip instead and the accumulated
+	// result is resolved with the history at half size, in place of the last upsample
+	bool temporal = mSettings.temporal && !mSettings.dualFilterBlur && !mBloomResolved &&
+	                mBloomHistory.Prepare(static_cast<int>(mGraph.SceneWidth()  * 0.5f + 0.5f),
+	                                      static_cast<int>(mGraph.SceneHeight() * 0.5f + 0.5f), mSettings.blurFormat);
+
+	int numMips = std::max(temporal ? 3 : 2, std::min(mSettings.bloomMips, NUM_BLOOM_MIPS)); // Temporal needs an upsample
+	PostProcessTexture blurredMips[NUM_BLOOM_MIPS];
+	float              mipScales  [NUM_BLOOM_MIPS];
+	PostProcessTexture mip = input;
+	float scale = 1.0f;
+	for (int i = 0; i < numMips; ++i)
+	{
+		std::string level = std::to_string(i + 1);
+		scale *= 0.5f;
+		mipScales[i] = scale;
+
+		// Only the first downsample filters. The dual filter downsample blurs as it goes, so the smaller mips use it
+		// and skip the separate blur passes
+		float threshold = (i == 0) ? mSettings.bloomThreshold : 0.0f;
+		PostProcessTexture smaller = mGraph.CreateTexture(scale, mSettings.blurFormat);
+		if (i > 0 && mSettings.dualFilterBlur)
+		{
+			mGraph.AddPass("Bloom Dual Filter Downsample " + level, gDualFilterDownsample_PostProcess, { mip }, smaller);
+		}
+		else
+		{
+			mGraph.AddPass("Bloom Downsample " + level, EffectShader(gBloomDownsample_PostProcess, "BloomDownsample_pp"), { mip }, smaller,
+			               [threshold]() { gPostProcessingConstants.brightFilterThreshold = threshold; });
+		}
+		mip = smaller;
+		if (mSettings.dualFilterBlur || (temporal && i == 0))
+		{
+			blurredMips[i] = mip;
+			continue;
+		}
+
+		// Blur with the radius compiled into the shader, or the general version if it failed to compile
+		float radius = bloomMipRadius[i];
+		ID3D11PixelShader* blurShader = GetPixelShaderPermutation("BloomBlur_pp", { { "BLOOM_BLUR_RADIUS", std::to_string(static_cast<int>(radius)) } });
+		if (blurShader == nullptr)  blurShader = gBloomBlur_PostProcess;
+
+		PostProcessTexture blurredH = mGraph.CreateTexture(scale, mSettings.blurFormat);
+		PostProcessTexture blurredV = mGraph.CreateTexture(scale, mSettings.blurFormat);
+
+		// Tile classified, a list of the lit tiles is made on the GPU and the blurs run one group per listed tile. The
+		// tile mask makes the graph run the classification first
+		ID3D11ComputeShader* tileBlurShader = nullptr;
+		if (mSettings.bloomTiles && gBloomTiles.Prepare(i, mGraph.Width(mip), mGraph.Height(mip)))
+		{
+			tileBlurShader = GetComputeShaderPermutation("BloomTileBlur_cs", { { "BLOOM_BLUR_RADIUS", std::to_string(static_cast<int>(radius)) } });
+			if (tileBlurShader == nullptr)  tileBlurShader = gBloomTileBlur_Compute;
+		}
+		if (tileBlurShader != nullptr)
+		{
+			PostProcessTexture tileMask = mGraph.CreateFixedSizeTexture((mGraph.Width(mip)  + BLOOM_TILE_SIZE - 1) / BLOOM_TILE_SIZE,
+			                                                            (mGraph.Height(mip) + BLOOM_TILE_SIZE - 1) / BLOOM_TILE_SIZE,
+			                                                            DXGI_FORMAT_R8_UNORM);
+			ID3D11ShaderResourceView* tileList = gBloomTiles.TileList(i);
+			mGraph.AddComputePass("Bloom Tiles " + level, gBloomTiles_Compute, { mip }, tileMask, 1, 1,
+			                      [i, radius]() { gBloomTiles.BindForAppend(i);
+			                                      gPostProcessingConstants.bloomBlurRadius = radius; });
+			mGraph.AddIndirectComputePass("Bloom Blur H " + level, tileBlurShader, { mip, tileMask }, blurredH, gBloomTiles.Arguments(i),
+			                              [i, radius, tileList]() { gBloomTiles.UpdateArguments(i);
+			                                                        gD3DContext->CSSetShaderResources(2, 1, &tileList);
+			                                                        gPostProcessingConstants.bloomBlurDirection = { 1, 0 };
+			                                                        gPostProcessingConstants.bloomBlurRadius = radius; });
+			mGraph.AddIndirectComputePass("Bloom Blur V " + level, tileBlurShader, { blurredH, tileMask }, blurredV, gBloomTiles.Arguments(i),
+			                              [radius, tileList]() { gD3DContext->CSSetShaderResources(2, 1, &tileList);
+			                                                     gPostProcessingConstants.bloomBlurDirection = { 0, 1 };
+			                                                     gPostProcessingConstants.bloomBlurRadius = radius; });
+			blurredMips[i] = blurredV;
+			continue;
+		}
+
+		mGraph.AddPass("Bloom Blur H " + level, blurShader, { mip }, blurredH,
+		               [radius]() { gPostProcessingConstants.bloomBlurDirection = { 1, 0 };
+		                            gPostProcessingConstants.bloomBlurRadius = radius; });
+		mGraph.AddPass("Bloom Blur V " + level, blurShader, { blurredH }, blurredV,
+		               [radius]() { gPostProcessingConstants.bloomBlurDirection = { 0, 1 };
+		                            gPostProcessingConstants.bloomBlurRadius = radius; });
+		blurredMips[i] = blurredV;
+	}
+
+	// Upsample-accumulate from the smallest mip. Its weight is applied in the first upsample, after that the
+	// smaller mip already holds weighted values. The dual filter upsample tent filters the smaller mip as it adds it
+	ID3D11PixelShader* dualFilterUpsample = nullptr;
+	if (mSettings.dualFilterBlur)
+	{
+		dualFilterUpsample = GetPixelShaderPermutation("DualFilterUpsample_pp", { { "DUAL_FILTER_ADD_LEVEL", "1" } });
+	}
+	PostProcessTexture accumulated = blurredMips[numMips - 1];
+	float coarserWeight = bloomMipWeight[numMips - 1];
+	int finestLevel = temporal ? 1 : 0;
+	for (int i = numMips - 2; i >= finestLevel; --i)
+	{
+		float levelWeight = bloomMipWeight[i];
+		if (temporal && i == finestLevel)  levelWeight += bloomMipWeight[0];
+		auto setWeights = [levelWeight, coarserWeight]() { gPostProcessingConstants.bloomLevelWeight   = levelWeight;
+		                                                   gPostProcessingConstants.bloomCoarserWeight = coarserWeight; };
+		PostProcessTexture upsampled = mGraph.CreateTexture(mipScales[i], mSettings.blurFormat);
+		if (dualFilterUpsample != nullptr)
+		{
+			mGraph.AddPass("Bloom Dual Filter Upsample " + std::to_string(i + 1), dualFilterUpsample,
+			               { accumulated, blurredMips[i] }, upsampled, setWeights);
+		}
+		else
+		{
+			mGraph.AddPass("Bloom Upsample " + std::to_string(i + 1), gBloomUpsample_PostProcess,
+			               { blurredMips[i], accumulated }, upsampled, setWeights);
+		}
+		accumulated = upsampled;
+		coarserWeight = 1.0f;
+	}
+	if (temporal)
+	{
+		mBloomResolved = true;
+		accumulated = AddTemporalResolvePass("Bloom Temporal", accumulated, mBloomHistory);
+	}
+
+	PostProcessTexture combined = mGraph.CreateTexture(1.0f, mImageFormat);
+	mGraph.AddPass("Bloom Combine", EffectShader(gCombine_PostProcess, "CombineAdditive_pp"), { accumulated, input }, combined); // combine textures from bloom and scene
+	return combined;
+}
+
+
+// Dual filter (Kawase) blur: halve the size the given number of times with 5 taps per pixel, then double it back up
+// with 8. Every pass but the last works on a small texture, so the cost hardly grows with the blur width
+PostProcessTexture EffectChain::AddDualFilterBlurPasses(PostProcessTexture input, int iterations)
+{
+	std::vector<PostProcessTexture> mips = { input };
+	float scale = 1.0f;
+	for (int i = 0; i < iterations; ++i)
+	{
+		scale *= 0.5f;
+		PostProcessTexture smaller = mGraph.CreateTexture(scale, mSettings.blurFormat);
+		mGraph.AddPass("Dual Filter Downsample " + std::to_string(i + 1), gDualFilterDownsample_PostProcess, { mips.back() }, smaller);
+		mips.push_back(smaller);
+	}
+
+	PostProcessTexture current = mips.back();
+	for (int i = iterations - 1; i >= 0; --i)
+	{
+		scale *= 2.0f;
+		PostProcessTexture larger = mGraph.CreateTexture(scale, (i == 0) ? mImageFormat : mSettings.blurFormat);
+		mGraph.AddPass("Dual Filter Upsample " + std::to_string(i + 1), gDualFilterUpsample_PostProcess, { current }, larger);
+		current = larger;
+	}
+	return current;
+}
+
+
+// Bright filter and shrink the image (the bloom's first downsample, then dual filter downsamples), pack it into
+// the corner of an FFT_BLOOM_SIZE square, and convolve it with the kernel: FFT the rows, FFT each column, multiply by the
+// kernel's transform and inverse FFT the column in the same pass, then inverse FFT the rows. The glare is added to the
+// image at full size. Falls back to the usual bloom if the kernel or shaders aren't available (see FftBloomKernel::Error)
+PostProcessTexture EffectChain::AddFftBloomPasses(PostProcessTexture input)
+{
+	ID3D11ComputeShader* rowsShader     = GetFftShader(false, false, false);
+	ID3D11ComputeShader* convolveShader = GetFftShader(true,  false, true);
+	ID3D11ComputeShader* inverseShader  = GetFftShader(false, true,  false);
+	if (!gFftBloomKernel.Update(mSettings.fftBloomKernel) || rowsShader == nullptr || convolveShader == nullptr || inverseShader == nullptr)
+	{
+		return AddBloomPasses(input);
+	}
+	ID3D11ShaderResourceView* spectrum = gFftBloomKernel.Spectrum();
+
+	// The image keeps its shape in the FFT texture, filling at most 3/4 of it so a quarter is left as padding for glare
+	// spreading past the edges
+	float longestSide = static_cast<float>(std::max(mGraph.SceneWidth(), mGraph.SceneHeight()));
+	CVector2 uvScale = { 0.75f * mGraph.SceneWidth() / longestSide, 0.75f * mGraph.SceneHeight() / longestSide };
+	float intensity = mSettings.fftBloomIntensity;
+
+	float threshold = mSettings.bloomThreshold;
+	PostProcessTexture bright = mGraph.CreateTexture(0.5f, mSettings.blurFormat);
+	mGraph.AddPass("FFT Bloom Bright Filter", EffectShader(gBloomDownsample_PostProcess, "BloomDownsample_pp"), { input }, bright,
+	               [threshold]() { gPostProcessingConstants.brightFilterThreshold = threshold; });
+	PostProcessTexture quarter = mGraph.CreateTexture(0.25f, mSettings.blurFormat);
+	mGraph.AddPass("FFT Bloom Downsample 1", gDualFilterDownsample_PostProcess, { bright }, quarter);
+	PostProcessTexture eighth = mGraph.CreateTexture(0.125f, mSettings.blurFormat);
+	mGraph.AddPass("FFT Bloom Downsample 2", gDualFilterDownsample_PostProcess, { quarter }, eighth);
+
+	const DXGI_FORMAT fftFormat = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	PostProcessTexture packed   = mGraph.CreateFixedSizeTexture(FFT_BLOOM_SIZE, FFT_BLOOM_SIZE, fftFormat);
+	PostProcessTexture rows     = mGraph.CreateFixedSizeTexture(FFT_BLOOM_SIZE, FFT_BLOOM_SIZE, fftFormat);
+	PostProcessTexture columns  = mGraph.CreateFixedSizeTexture(FFT_BLOOM_SIZE, FFT_BLOOM_SIZE, fftFormat);
+	PostProcessTexture glare    = mGraph.CreateFixedSizeTexture(FFT_BLOOM_SIZE, FFT_BLOOM_SIZE, fftFormat);
+	mGraph.AddPass("FFT Bloom Pack", gFftBloomPack_PostProcess, { eighth }, packed,
+	               [uvScale]() { gPostProcessingConstants.fftBloomUVScale = uvScale; });
+
+	// One group for each row or column
+	mGraph.AddComputePass("FFT Bloom Rows",     rowsShader, { packed }, rows, 0, 1);
+	mGraph.AddComputePass("FFT Bloom Convolve", convolveShader, { rows }, columns, 1, 0,
+	                      [spectrum]() { gD3DContext->CSSetShaderResources(1, 1, &spectrum); });
+	mGraph.AddComputePass("FFT Bloom Inverse Rows", inverseShader, { columns }, glare, 0, 1);
+
+	PostProcessTexture combined = mGraph.CreateTexture(1.0f, mImageFormat);
+	mGraph.AddPass("FFT Bloom Combine", gFftBloomCombine_PostProcess, { glare, input }, combined,
+	               [uvScale, intensity]() { gPostProcessingConstants.fftBloomUVScale   = uvScale;
+	                                        gPostProcessingConstants.fftBloomIntensity = intensity; });
+	return combined;
+}
+
+
+// Bright filter down to quarter size, then for each point of the star a chain of streak passes, each stepping four
+// times further than the last. The streaks are added together at quarter size, then added on to the image
+PostProcessTexture EffectChain::AddStarFilterPasses(PostProcessTexture input)
+{
+	int streaks = std::max(1, mSettings.starStreaks);
+	float threshold = mSettings.bloomThreshold;
+	PostProcessTexture bright = mGraph.CreateTexture(0.5f, mSettings.blurFormat);
+	mGraph.AddPass("Star Bright Filter", EffectShader(gBloomDownsample_PostProcess, "BloomDownsample_pp"), { input }, bright,
+	               [threshold]() { gPostProcessingConstants.brightFilterThreshold = threshold; });
+	PostProcessTexture quarter = mGraph.CreateTexture(0.25f, mSettings.blurFormat);
+	mGraph.AddPass("Star Downsample", gDualFilterDownsample_PostProcess, { bright }, quarter);
+
+	const float PI = 3.14159265f;
+	PostProcessTexture accumulated = NO_TEXTURE;
+	for (int streak = 0; streak < streaks; ++streak)
+	{
+		float angle = mSettings.starAngle + 2 * PI * streak / streaks;
+		CVector2 direction = { std::cos(angle), std::sin(angle) };
+
+		PostProcessTexture streaked = quarter;
+		float step = 1;
+		for (int i = 0; i < mSettings.starIterations; ++i)
+		{
+			// Attenuation per tap covers the pixels stepped over. The gain is applied once, shared between the streaks
+			CVector2 tapStep = { direction.x * step, direction.y * step };
+			float attenuation = std::pow(mSettings.starAttenuation, step);
+			float gain = (i == mSettings.starIterations - 1) ? mSettings.starIntensity / streaks : 1.0f;
+			PostProcessTexture next = mGraph.CreateTexture(0.25f, mSettings.blurFormat);
+			mGraph.AddPass("Star Streak " + std::to_string(streak + 1) + "." + std::to_string(i + 1), gStarStreak_PostProcess,
+			               { streaked }, next,
+			               [tapStep, attenuation, gain]() { gPostProcessingConstants.starStreakStep = tapStep;
+			                                                gPostProcessingConstants.starStreakAttenuation = attenuation;
+			                                                gPostProcessingConstants.starStreakGain = gain; });
+			streaked = next;
+			step *= 4;
+		}
+
+		if (accumulated == NO_TEXTURE)
+		{
+			accumulated = streaked;
+		}
+		else
+		{
+			PostProcessTexture sum = mGraph.CreateTexture(0.25f, mSettings.blurFormat);
+			mGraph.AddPass("Star Add " + std::to_string(streak + 1), EffectShader(gCombine_PostProcess, "CombineAdditive_pp"), { streaked, accumulated }, sum);
+			accumulated = sum;
+		}
+	}
+
+	PostProcessTexture combined = mGraph.CreateTexture(1.0f, mImageFormat);
+	mGraph.AddPass("Star Combine", EffectShader(gCombine_PostProcess, "CombineAdditive_pp"), { accumulated, input }, combined);
+	return combined;
+}
+
+
+// Blend an effect's result this frame with its result from the last frame, into the history written this frame. The
+// history must have been prepared at the size wanted, the result can be smaller
+PostProcessTexture EffectChain::AddTemporalResolvePass(const std::string& name, PostProcessTexture input, TemporalHistory& history)
+{
+	PooledTarget* previous = history.Previous();
+	PooledTarget* current  = history.Current();
+	PostProcessTexture previousTexture = mGraph.ImportTexture(previous->shaderResource, previous->renderTarget,
+	                                                          previous->width, previous->height, previous->format);
+	PostProcessTexture resolved = mGraph.ImportTexture(current->shaderResource, current->renderTarget,
+	                                                   current->width, current->height, current->format);
+
+	// Without a depth buffer the image is taken as still on the screen, the clamp still keeps moving things sharp
+	ID3D11ShaderResourceView* depth = mSettings.depth;
+	CMatrix4x4 reprojection = (depth != nullptr) ? history.Reprojection(mSettings.inverseViewProjection) : MatrixIdentity();
+	float weight = history.Valid() ? mSettings.temporalHistoryWeight : 0.0f;
+	mGraph.AddPass(name, gTemporalResolve_PostProcess, { input, previousTexture }, resolved,
+	               [depth, reprojection, weight]() { gD3DContext->PSSetShaderResources(POST_PROCESS_DEPTH_SLOT, 1, &depth);
+	                                                 gPostProcessingConstants.temporalReprojection  = reprojection;
+	                                                 gPostProcessingConstants.temporalHistoryWeight = weight; });
+	return resolved;
+}
+
+
+// Halve the size of the image, keeping the circle of confusion from the depth buffer in alpha, then blur the far and
+// near fields separately at half size and blend them with the full size image by depth. The fields are kept apart so
+// the blurred background doesn't leak over sharp objects in front of it, while the blurred foreground does spread
+// over what is behind it
+PostProcessTexture EffectChain::AddDepthOfFieldPasses(PostProcessTexture input)
+{
+	ID3D11ShaderResourceView* depth = mSettings.depth;
+	if (depth == nullptr)  return input;
+	auto bindDepth = [depth]() { gD3DContext->PSSetShaderResources(POST_PROCESS_DEPTH_SLOT, 1, &depth); };
+
+	const DXGI_FORMAT fieldFormat = DXGI_FORMAT_R16G16B16A16_FLOAT; // Signed circle of confusion in alpha
+	PostProcessTexture halfSize = mGraph.CreateTexture(0.5f, fieldFormat);
+	PostProcessTexture farField = mGraph.CreateTexture(0.5f, fieldFormat);
+	PostProcessTexture nearField = mGraph.CreateTexture(0.5f, fieldFormat);
+	mGraph.AddPass("Depth of Field Downsample", gDepthOfFieldDownsample_PostProcess, { input }, halfSize, bindDepth);
+	mGraph.AddPass("Depth of Field Far", gDepthOfFieldBlur_PostProcess, { halfSize }, farField,
+	               []() { gPostProcessingConstants.dofNearField = 0; });
+	mGraph.AddPass("Depth of Field Near", gDepthOfFieldBlur_PostProcess, { halfSize }, nearField,
+	               []() { gPostProcessingConstants.dofNearField = 1; });
+
+	PostProcessTexture combined = mGraph.CreateTexture(1.0f, mImageFormat);
+	mGraph.AddPass("Depth of Field Combine", gDepthOfFieldCombine_PostProcess, { input, farField, nearField }, combined, bindDepth);
+	return combined;
+}
+
+
+// Find the edges, then the blend weights along them (see SmaaWeights_pp.hlsl), then blend each pixel with its neighbours
+// by those weights. The edges need only two channels and the weights four small ones, whatever the image format
+PostProcessTexture EffectChain::AddSmaaPasses(PostProcessTexture input)
+{
+	PostProcessTexture edges = mGraph.CreateTexture(1.0f, DXGI_FORMAT_R8G8_UNORM);
+	mGraph.AddPass("SMAA Edges", gSmaaEdges_PostProcess, { input }, edges);
+	PostProcessTexture weights = mGraph.CreateTexture(1.0f, DXGI_FORMAT_R8G8B8A8_UNORM);
+	mGraph.AddPass("SMAA Weights", gSmaaWeights_PostProcess, { edges }, weights);
+	PostProcessTexture antialiased = mGraph.CreateTexture(1.0f, mImageFormat);
+	mGraph.AddPass("SMAA Blend", gSmaaBlend_PostProcess, { input, weights }, antialiased);
+	return antialiased;
+}
+
+
+ID3D11PixelShader* EffectChain::EffectShader(ID3D11PixelShader* shader, const char* shaderName)
+{
+	return mSettings.halfPrecision ? HalfPrecisionShader(shader, shaderName) : shader;
+}
+
+ID3D11ComputeShader* EffectChain::EffectShader(ID3D11ComputeShader* shader, const char* shaderName)
+{
+	return mSettings.halfPrecision ? HalfPrecisionShader(shader, shaderName) : shader;
+}
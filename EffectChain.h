@@ -0,0 +1,244 @@
+//--------------------------------------------------------------------------------------
+// Effect chains
+//--------------------------------------------------------------------------------------
+// The post-processes as a library. An EffectChain holds an ordered list of effects and their settings, and Apply runs
+// them over any texture into any render target. Several chains can be applied in one frame (e.g. the main view, a
+// minimap, a reflection) - each builds its own post-process graph, and the intermediate render targets come from
+// gRenderTargetPool and go back to it straight afterwards, so later chains reuse the same targets.
+//
+// Neighbouring fog, tint, underwater and retro effects are run as one fused pass where that gives the same result (they
+// are fused in that order only, so e.g. retro followed by tint is two passes), along with the exposure when it follows
+// them. With colourLut set, the colour transforms in that pass that don't depend on the position are a single fetch
+// from a 3D LUT instead
+//
+// With computeShaders set the effects with compute versions run as compute shader passes writing their output to a UAV,
+// with no render target, blending or full screen quad: the fused colour effects pass, and the Gaussian blur with its
+// groupshared row and column tiles wherever the pixel shaders would have been picked. The thread group size of the
+// fused pass is tuned for the GPU (see ComputeTuner.h). The other effects are still pixel shaders, they mostly read
+// smaller targets with bilinear filtering where the pixel shaders are already cheap
+//
+// With halfPrecision set (the default) the fused colour effects, the bloom's bright filter and combine and the Gaussian
+// blurs use their HALF_PRECISION permutations on GPUs with 16-bit shader maths, which do the colour maths in min16float
+// for fewer registers and up to twice the arithmetic rate. The shader benchmark checks them against full precision
+//
+// With autoExposure set the brightness of the input is measured on the GPU (see AutoExposure.h), the bloom threshold
+// follows it and an exposure pass is added at the end of the chain
+//
+// With dualFilterBlur set the Gaussian blur and bloom use the dual filter (Kawase) blur instead: a chain of half size
+// downsamples and mirrored upsamples with a few bilinear taps each, which costs far less than the full resolution
+// separable Gaussian for a similar look. The blur width is set by the number of iterations rather than the kernel size
+//
+// With bloomTiles set the bloom mips are only blurred in the tiles with some light in them, listed on the GPU (see
+// BloomTiles.h), so the blurs cost little in a dark scene. The upsamples and the combine still cover the whole image,
+// the combine has to write every pixel of the result anyway
+//
+// With fftBloom set the bloom is a convolution with a glare kernel done with FFTs at reduced resolution (see FftBloom.h)
+// instead of the blurred mip chain, for very wide or star-shaped glare at a cost that doesn't depend on the kernel size
+//
+// With reducedRate below full the passes whose result is smooth - the vertical pixel shader Gaussian blur and the pyramid
+// blur without the input's mips - are drawn at a half or a quarter of the pixels and scaled back up with an edge-aware
+// reconstruction (see PostProcessGraph.h). The passes producing sharp detail, such as the colour effects, stay at full rate
+//
+// With temporal set the Gaussian blur is done at half size and the bloom leaves out its half size blur, and each is
+// blended with its own result from the previous frame, reprojected with the depth buffer (see TemporalHistory.h). The
+// history hides the shimmer of the smaller images as things move across their pixels, for about half the cost
+//
+// Whole images passed between the effects are kept in the format of the input, so an HDR scene stays HDR until the
+// output. The blurs, bloom and star filter work in blurFormat, R11G11B10_FLOAT by default: those intermediates never
+// need alpha, and a float format holds the real brightness of highlights at the size of an 8-bit RGBA texture
+//
+// A multisampled input (e.g. a scene rendered with MSAA) is resolved by the first pass reading it rather than a resolve
+// of its own: the fused colour effects pass, or that pass with no effects when the chain starts with another effect or
+// is empty (see ColourEffects.hlsli). The samples are averaged with tonemapped weights, so the edges of HDR highlights
+// stay antialiased
+//
+// The anti-aliasing effects smooth the edges of the image they are given, so they go before any effect that would
+// sharpen or spread the steps along them. SMAA finds the edges, then the blend weights of the pixels along them, then
+// blends those pixels with their neighbours. Its edges and weights are intermediates of the graph like any other, and
+// the passes after edge detection return straight away for the pixels with no edges, which are most of the image
+//
+// The Gaussian blur picks its technique from the blur strength (see BlurSelector.h) unless blurTechnique forces one
+//
+// Depth of field and fog read the depth buffer the input was rendered with (EffectSettings::depth) rather than
+// rendering anything again. It is bound only for the passes of the chain, which never have a depth buffer bound, and
+// unbound before Apply returns so the scene can write it again
+//
+// The shaders used by a single effect are loaded the first time it is applied (see EffectResources.h). With
+// backgroundLoad set the effect is left out until they are ready, instead of Apply waiting for them
+
+#ifndef _EFFECT_CHAIN_H_INCLUDED_
+#define _EFFECT_CHAIN_H_INCLUDED_
+
+#include "PostProcessGraph.h"
+#include "FftBloom.h"
+#include "BlurSelector.h"
+#include "TemporalHistory.h"
+#include "CVector2.h"
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+
+#include <d3d11.h>
+#include <vector>
+
+
+enum class Effect
+{
+	Upscale,      // Stretch the top-left part of the input to its full size (see EffectSettings::inputUVScale), bilinear
+	              //   or edge-adaptive and sharpened (EffectSettings::spatialUpscale)
+	Tint,
+	GaussianBlur,
+	Blur,         // Box blur
+	Underwater,
+	Retro,
+	Bloom,
+	StarFilter,   // Streaks from bright lights, drawn at quarter size
+	PyramidBlur,  // Read from the mip chain of the input if EffectSettings::inputMipChain is given
+	DepthOfField, // Blur by distance from the focus, at half size. Needs EffectSettings::depth, skipped without it
+	Fog,          // Fade to the fog colour with distance. Needs EffectSettings::depth, skipped without it
+	Fxaa,         // Anti-aliasing by blurring along the edges found in each pixel's neighbourhood
+	Smaa,         // Anti-aliasing from the shapes of the edges (SMAA 1x), sharper than FXAA for a little more time
+};
+
+
+// Settings shared by the effects in a chain
+struct EffectSettings
+{
+	CVector3 tintColour       = { 0, 1, 1 };    // RGB, top of the screen
+	CVector3 tintColour2      = { 1, 1, 0 };    // RGB, bottom of the screen
+	float    blurStrength     = 50;             // Blur width in pixels, for both blurs
+	float    blurCurve        = 0.03f;          // Gaussian bell curve strength
+	bool     dualFilterBlur   = false;          // Dual filter blur for GaussianBlur and Bloom, cheaper on small GPUs
+	int      dualFilterIterations = 4;          // Halvings of the dual filter blur, each one doubles the blur width
+	BlurTechnique blurTechnique = BlurTechnique::Auto; // How GaussianBlur is done, dualFilterBlur overrides it
+	CVector3 waterTintColour  = { 0, 1, 1 };
+	CVector3 waterTintColour2 = { 0, 0.5f, 1 };
+	float    time             = 0;              // Animates the underwater waves
+	float    pixelSize        = 10;             // Retro block size in pixels
+	float    bitColour        = 90;             // Retro colour levels
+	bool     retroPixellate   = true;           // Off if the input was rendered at one pixel per retro block
+	bool     colourLut        = false;          // Apply retro's colour depth through the colour grading LUT (see ColourLut.h)
+	float    bloomThreshold   = 0.7f;           // Brightness above which bloom glows
+	DXGI_FORMAT blurFormat    = DXGI_FORMAT_R11G11B10_FLOAT; // Of the blur, bloom and star filter intermediates
+	bool     bloomTiles       = false;          // Blur the bloom mips only in the tiles with light in them
+	int      bloomMips        = 4;              // Mips the bloom is blurred at, 2 to 4. Fewer is cheaper, but a smaller glow
+	bool     fftBloom         = false;          // Convolve the bloom with fftBloomKernel instead of blurring it
+	FftBloomKernelSettings fftBloomKernel;
+	float    fftBloomIntensity = 1;
+	int      starStreaks      = 6;              // Points of the star filter, 4 to 8 look best
+	int      starIterations   = 3;              // Passes for each streak, each one makes it 4 times longer
+	float    starAngle        = 0.4f;           // Rotation of the star in radians
+	float    starAttenuation  = 0.95f;          // Fall-off along the streaks, per quarter size pixel
+	float    starIntensity    = 2;              // Brightness of the whole star, shared between its streaks
+	CVector2 inputUVScale     = { 1, 1 };       // Part of the input used by Upscale, as a fraction of its size
+	CVector2 inputUVMax       = { 1, 1 };       // Largest uv Upscale reads, usually half a pixel inside the part used
+	bool     spatialUpscale   = false;          // Upscale along the edges in compute and sharpen, rather than bilinear
+	float    upscaleSharpness = 0.8f;           // Of the spatial upscale, 0 to 1. 0 skips the sharpening pass
+	bool     autoExposure     = false;          // Adapt the exposure to the brightness of the input
+	bool     computeShaders   = false;          // Run the effects that have compute versions as compute shaders
+	bool     halfPrecision    = true;           // Colour maths of the bandwidth-bound effects in min16float, where the
+	                                            //   GPU has 16-bit arithmetic
+	unsigned int computeGroupWidth  = 0;        // Threads per group of the compute effects, 0 for the size tuned for
+	unsigned int computeGroupHeight = 0;        //   this GPU by gComputeTuner
+	ShadingRate reducedRate   = ShadingRate::Full; // Rate of the smooth blur passes, lowered when the GPU is over budget
+	bool     temporal         = false;          // Gaussian blur and bloom at reduced size, blended with the previous frame
+	bool     backgroundLoad   = false;          // Skip effects while their shaders load in the background rather than
+	                                            //   loading them before applying the chain (see EffectResources.h)
+	float    temporalHistoryWeight = 0.8f;      // Fraction of each frame's temporal blur and bloom kept from the last one
+	CMatrix4x4 viewProjection        = MatrixIdentity(); // Of the camera the input was rendered with, to reproject the
+	CMatrix4x4 inverseViewProjection = MatrixIdentity(); //   temporal history (see TemporalHistory.h)
+	ID3D11ShaderResourceView* inputMipChain = nullptr; // All mips of the input, created with D3D11_RESOURCE_MISC_GENERATE_MIPS
+	float    pyramidBlurLevel     = 3;          // Mip level the pyramid blur reads at the centre of the screen
+	float    pyramidBlurEdgeLevel = 3;          // And at the corners
+	float    frameTime        = 0;              // Time since the last Apply, sets how far the exposure adapts
+	ID3D11ShaderResourceView* depth = nullptr;  // Depth buffer the input was rendered with, for the depth-aware effects
+	CVector2 depthUVScale     = { 1, 1 };       // Part of the depth buffer covering the input, as a fraction of its size
+	float    nearClip         = 0.1f;           // Of the camera that rendered the depth buffer
+	float    farClip          = 10000;
+	float    focusDistance    = 0;              // Sharpest distance, 0 to autofocus on the centre of the screen
+	float    focusRange       = 10;             // Distance either side of the focus that stays sharp
+	float    focusBlurDistance = 40;            // Distance beyond the sharp range over which the blur grows to full
+	float    dofBlurRadius    = 8;              // Full depth of field blur radius in pixels of the half size image
+	CVector3 fogColour        = { 0.6f, 0.65f, 0.7f };
+	float    fogDensity       = 0.01f;          // Fraction of the light lost per unit of distance is 1 - exp(-fogDensity)
+	float    fogStart         = 20;             // Distance from the camera before any fog
+	float    fogMaxOpacity    = 0.9f;           // Most the fog covers, so the sky still shows through
+};
+
+
+class EffectChain
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Remove all the effects
+	void Clear()  { mEffects.clear(); }
+
+	// Add an effect to the end of the chain
+	void Add(Effect effect)  { mEffects.push_back(effect); }
+
+
+	// Run the effects over the input texture, writing the result to the output target. The output can be a different
+	// size to the input, the result is scaled to fit. inputTarget (a render target for the input texture) is optional,
+	// if given the input texture is reused for intermediate results once it has been read. The input can be multisampled,
+	// inputTarget is then ignored. With no effects the input is copied to the output. All render targets are back in the pool when this returns. Returns false on error (reason
+	// in gLastError)
+	bool Apply(ID3D11ShaderResourceView* input, ID3D11RenderTargetView* output, ID3D11RenderTargetView* inputTarget = nullptr);
+
+	// Give the render targets kept for the temporal effects back to the pool, e.g. before the pool is released or resized.
+	// The next Apply starts without a history
+	void ReleaseHistory()  { mBlurHistory.Release();  mBloomHistory.Release(); }
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	EffectSettings&            Settings()  { return mSettings; }
+	const std::vector<Effect>& Effects()   { return mEffects; }
+	bool                       Empty()     { return mEffects.empty(); }
+
+	// Statistics for the most recent Apply
+	int NumPasses()   { return mGraph.NumPasses(); }
+	int NumTargets()  { return mGraph.NumTargets(); }
+	int NumReducedRatePasses()  { return mGraph.NumReducedRatePasses(); }
+	BlurTechnique GaussianBlurTechnique()  { return mGaussianBlurTechnique; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Add the passes for one effect to the graph, returns the texture holding the result
+	PostProcessTexture AddColourEffectsPass(PostProcessTexture input, int effects);
+	PostProcessTexture AddGaussianBlurPasses(PostProcessTexture input);
+	PostProcessTexture AddBoxBlurPasses(PostProcessTexture input);
+	PostProcessTexture AddBloomPasses(PostProcessTexture input);
+	PostProcessTexture AddDualFilterBlurPasses(PostProcessTexture input, int iterations);
+	PostProcessTexture AddFftBloomPasses(PostProcessTexture input);
+	PostProcessTexture AddStarFilterPasses(PostProcessTexture input);
+	PostProcessTexture AddDepthOfFieldPasses(PostProcessTexture input);
+	PostProcessTexture AddSmaaPasses(PostProcessTexture input);
+	PostProcessTexture AddTemporalResolvePass(const std::string& name, PostProcessTexture input, TemporalHistory& history);
+
+	// A loaded shader, or its half precision permutation with halfPrecision set (see HalfPrecisionShader in Shader.h)
+	ID3D11PixelShader*   EffectShader(ID3D11PixelShader*   shader, const char* shaderName);
+	ID3D11ComputeShader* EffectShader(ID3D11ComputeShader* shader, const char* shaderName);
+
+	std::vector<Effect> mEffects;
+	EffectSettings      mSettings;
+	PostProcessGraph    mGraph;
+	BlurTechnique       mGaussianBlurTechnique = BlurTechnique::Pixel;
+	DXGI_FORMAT         mImageFormat = DXGI_FORMAT_R8G8B8A8_UNORM; // Of the input, for the whole images between the effects
+	bool                mResolveFailed = false; // A multisampled input couldn't be resolved, Apply fails
+
+	// Results kept from the previous Apply for the temporal effects, each used by the first such effect in the chain
+	TemporalHistory     mBlurHistory;
+	TemporalHistory     mBloomHistory;
+	bool                mBlurResolved  = false; // This Apply
+	bool                mBloomResolved = false;
+};
+
+
+#endif //_EFFECT_CHAIN_H_INCLUDED_
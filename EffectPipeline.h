@@ -0,0 +1,308 @@
+//--------------------------------------------------------------------------------------
+// Effect pipelines
+//--------------------------------------------------------------------------------------
+// The effects described at compile time. Each effect has an EffectTraits specialisation giving its name, whether it
+// reads the depth buffer, where it sits in the fused colour effects pass (see EffectChain.h) and how it packs its
+// settings into PostProcessingConstants. A whole chain can then be declared as a type, e.g.
+//
+//     typedef EffectPipeline<Effect::Fog, Effect::Tint, Effect::Bloom> KioskEffects;
+//     KioskEffects::Build(chain);
+//
+// Build, SetConstants and the queries are expanded over the effects of the type by the compiler, with no virtual calls
+// or lookups at run time, and the queries are constexpr so a fixed pipeline can be checked with static_assert (e.g. that
+// it fuses to a single colour effects pass, or doesn't need a depth buffer). EffectChain packs its constants with
+// AllEffects, so the constants an effect reads are set in one place, next to its description.
+//
+// The members of PostProcessingConstants the effects write are checked against the HLSL packing rules: a member may
+// not straddle a 16 byte register, where HLSL would move it to the next register and the C++ and shader layouts no
+// longer match. The total size is checked too, while the shader bindings check it against the shaders at run time
+
+#ifndef _EFFECT_PIPELINE_H_INCLUDED_
+#define _EFFECT_PIPELINE_H_INCLUDED_
+
+#include "EffectChain.h"
+#include "Common.h"
+
+#include <algorithm>
+#include <cstddef>
+
+
+//--------------------------------------------------------------------------------------
+// Constant buffer layout checks
+//--------------------------------------------------------------------------------------
+
+// Fails to compile if the member crosses a 16 byte boundary of the structure, unless it starts on one (e.g. a matrix)
+#define STATIC_ASSERT_HLSL_PACKING(type, member) \
+	static_assert(offsetof(type, member) % 16 == 0 || \
+	              offsetof(type, member) / 16 == (offsetof(type, member) + sizeof(type::member) - 1) / 16, \
+	              #type "::" #member " straddles a 16 byte register, HLSL would pad before it")
+
+static_assert(sizeof(PostProcessingConstants) % 16 == 0, "PostProcessingConstants must be a whole number of 16 byte registers");
+
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, tintColour);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, tintColour2);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, waterTintColour);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, vWave);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, waterTintColour2);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, hWave);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, noiseScale);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, bitColour);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, blurRadius);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, blurBellcurveStrength);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, autoExposure);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, depthUVScale);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, depthNearClip);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, depthFarClip);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, focusDistance);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, focusRange);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, focusBlurDistance);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, dofBlurRadius);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, fogColour);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, fogDensity);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, fogStart);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, fogMaxOpacity);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, temporalReprojection);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, texelSize);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, passUVScale);
+STATIC_ASSERT_HLSL_PACKING(PostProcessingConstants, passUVOffset);
+
+
+//--------------------------------------------------------------------------------------
+// Effect descriptions
+//--------------------------------------------------------------------------------------
+
+// readsDepth:  needs EffectSettings::depth, the effect is skipped without it
+// fusedOrder:  position in the fused colour effects pass (1 is applied first), 0 for effects with passes of their own
+// SetConstants packs the effect's settings into the post-processing constants. Settings that change between the
+// passes of an effect are set by the passes themselves (see PostProcessGraph::AddPass)
+template <Effect E> struct EffectTraits;
+
+// The depth buffer constants, read by the depth-aware effects and by the temporal resolves of the blur and bloom
+inline void SetDepthConstants(const EffectSettings& settings, PostProcessingConstants& constants)
+{
+	constants.depthUVScale  = settings.depthUVScale;
+	constants.depthNearClip = settings.nearClip;
+	constants.depthFarClip  = settings.farClip;
+}
+
+template <> struct EffectTraits<Effect::Upscale>
+{
+	static const char* Name()  { return "Upscale"; }
+	static const bool readsDepth = false;
+	static const int  fusedOrder = 0;
+	static void SetConstants(const EffectSettings&, PostProcessingConstants&)  {} // Set for its pass
+};
+
+template <> struct EffectTraits<Effect::Fog>
+{
+	static const char* Name()  { return "Fog"; }
+	static const bool readsDepth = true;
+	static const int  fusedOrder = 1;
+	static void SetConstants(const EffectSettings& settings, PostProcessingConstants& constants)
+	{
+		SetDepthConstants(settings, constants);
+		constants.fogColour     = settings.fogColour;
+		constants.fogDensity    = settings.fogDensity;
+		constants.fogStart      = settings.fogStart;
+		constants.fogMaxOpacity = settings.fogMaxOpacity;
+	}
+};
+
+template <> struct EffectTraits<Effect::Tint>
+{
+	static const char* Name()  { return "Tint"; }
+	static const bool readsDepth = false;
+	static const int  fusedOrder = 2;
+	static void SetConstants(const EffectSettings& settings, PostProcessingConstants& constants)
+	{
+		constants.tintColour  = settings.tintColour;
+		constants.tintColour2 = settings.tintColour2;
+	}
+};
+
+template <> struct EffectTraits<Effect::Underwater>
+{
+	static const char* Name()  { return "Underwater"; }
+	static const bool readsDepth = false;
+	static const int  fusedOrder = 3;
+	static void SetConstants(const EffectSettings& settings, PostProcessingConstants& constants)
+	{
+		constants.waterTintColour  = settings.waterTintColour;
+		constants.waterTintColour2 = settings.waterTintColour2;
+		constants.hWave = settings.time;
+		constants.vWave = settings.time / 2;
+	}
+};
+
+template <> struct EffectTraits<Effect::Retro>
+{
+	static const char* Name()  { return "Retro"; }
+	static const bool readsDepth = false;
+	static const int  fusedOrder = 4;
+	static void SetConstants(const EffectSettings& settings, PostProcessingConstants& constants)
+	{
+		constants.noiseScale = { settings.pixelSize, settings.pixelSize };
+		constants.bitColour  = settings.bitColour;
+	}
+};
+
+template <> struct EffectTraits<Effect::GaussianBlur>
+{
+	static const char* Name()  { return "Gaussian Blur"; }
+	static const bool readsDepth = false;
+	static const int  fusedOrder = 0;
+	static void SetConstants(const EffectSettings& settings, PostProcessingConstants& constants)
+	{
+		SetDepthConstants(settings, constants); // The kernel has a buffer of its own (see UpdateBlurKernel)
+	}
+};
+
+template <> struct EffectTraits<Effect::Blur>
+{
+	static const char* Name()  { return "Blur"; }
+	static const bool readsDepth = false;
+	static const int  fusedOrder = 0;
+	static void SetConstants(const EffectSettings& settings, PostProcessingConstants& constants)
+	{
+		constants.blurRadius = settings.blurStrength;
+	}
+};
+
+template <> struct EffectTraits<Effect::Bloom>
+{
+	static const char* Name()  { return "Bloom"; }
+	static const bool readsDepth = false;
+	static const int  fusedOrder = 0;
+	static void SetConstants(const EffectSettings& settings, PostProcessingConstants& constants)
+	{
+		SetDepthConstants(settings, constants); // The threshold and mip settings are set for each pass
+	}
+};
+
+template <> struct EffectTraits<Effect::StarFilter>
+{
+	static const char* Name()  { return "Star Filter"; }
+	static const bool readsDepth = false;
+	static const int  fusedOrder = 0;
+	static void SetConstants(const EffectSettings&, PostProcessingConstants&)  {} // Set for each streak pass
+};
+
+template <> struct EffectTraits<Effect::PyramidBlur>
+{
+	static const char* Name()  { return "Pyramid Blur"; }
+	static const bool readsDepth = false;
+	static const int  fusedOrder = 0;
+	static void SetConstants(const EffectSettings& settings, PostProcessingConstants& constants)
+	{
+		constants.blurRadius            = settings.blurStrength;
+		constants.blurBellcurveStrength = settings.blurCurve;
+	}
+};
+
+template <> struct EffectTraits<Effect::DepthOfField>
+{
+	static const char* Name()  { return "Depth of Field"; }
+	static const bool readsDepth = true;
+	static const int  fusedOrder = 0;
+	static void SetConstants(const EffectSettings& settings, PostProcessingConstants& constants)
+	{
+		SetDepthConstants(settings, constants);
+		constants.focusDistance     = settings.focusDistance;
+		constants.focusRange        = settings.focusRange;
+		constants.focusBlurDistance = std::max(settings.focusBlurDistance, 0.001f);
+		constants.dofBlurRadius     = settings.dofBlurRadius;
+	}
+};
+
+template <> struct EffectTraits<Effect::Fxaa>
+{
+	static const char* Name()  { return "FXAA"; }
+	static const bool readsDepth = false;
+	static const int  fusedOrder = 0;
+	static void SetConstants(const EffectSettings&, PostProcessingConstants&)  {}
+};
+
+template <> struct EffectTraits<Effect::Smaa>
+{
+	static const char* Name()  { return "SMAA"; }
+	static const bool readsDepth = false;
+	static const int  fusedOrder = 0;
+	static void SetConstants(const EffectSettings&, PostProcessingConstants&)  {}
+};
+
+
+//--------------------------------------------------------------------------------------
+// Pipelines
+//--------------------------------------------------------------------------------------
+
+// A chain of effects in the order given, as a type
+template <Effect... Effects>
+struct EffectPipeline
+{
+	static const int NumEffects = static_cast<int>(sizeof...(Effects));
+
+	// Replace the chain's effects with this pipeline's
+	static void Build(EffectChain& chain)
+	{
+		chain.Clear();
+		const int expand[] = { 0, (chain.Add(Effects), 0)... };
+		(void)expand;
+	}
+
+	// Pack the settings of this pipeline's effects into the constants, the others are left as they are
+	static void SetConstants(const EffectSettings& settings, PostProcessingConstants& constants)
+	{
+		const int expand[] = { 0, (EffectTraits<Effects>::SetConstants(settings, constants), 0)... };
+		(void)expand;
+	}
+
+	// True if any of the effects needs a depth buffer
+	static constexpr bool ReadsDepth()
+	{
+		const bool reads[] = { false, EffectTraits<Effects>::readsDepth... };
+		for (bool r : reads)  if (r)  return true;
+		return false;
+	}
+
+	// True if the given effect is in the pipeline
+	template <Effect E>
+	static constexpr bool Contains()
+	{
+		const bool matches[] = { false, (Effects == E)... };
+		for (bool m : matches)  if (m)  return true;
+		return false;
+	}
+
+	// Number of fused colour effects passes the chain runs, following the rules in EffectChain::Apply: colour effects
+	// next to each other share a pass while they are in the fused order, any other effect ends the pass. Leaves out the
+	// exposure, which joins the last pass, and assumes a depth buffer is given to the effects that read one
+	static constexpr int NumColourPasses()
+	{
+		const int orders[] = { 0, EffectTraits<Effects>::fusedOrder... };
+		int passes = 0;
+		int last = 0; // Fused order of the last effect in the current pass, 0 when there is no pass open
+		for (int i = 1; i <= NumEffects; ++i)
+		{
+			if (orders[i] == 0 || orders[i] <= last)
+			{
+				if (last != 0)  ++passes;
+				last = 0;
+			}
+			if (orders[i] != 0)  last = orders[i];
+		}
+		return passes + (last != 0 ? 1 : 0);
+	}
+};
+
+
+// Every effect, used to pack the constants of any chain
+typedef EffectPipeline<Effect::Upscale, Effect::Fog, Effect::Tint, Effect::Underwater, Effect::Retro,
+                       Effect::GaussianBlur, Effect::Blur, Effect::Bloom, Effect::StarFilter, Effect::PyramidBlur,
+                       Effect::DepthOfField, Effect::Fxaa, Effect::Smaa> AllEffects;
+
+static_assert(AllEffects::NumColourPasses() == 1, "The colour effects listed in their fused order should share one pass");
+static_assert(EffectPipeline<Effect::Retro, Effect::Tint>::NumColourPasses() == 2, "Tint can't be fused after retro");
+static_assert(!EffectPipeline<Effect::Tint, Effect::Bloom>::ReadsDepth(), "Neither tint nor bloom reads the depth buffer");
+
+
+#endif //_EFFECT_PIPELINE_H_INCLUDED_
@@ -0,0 +1,323 @@
+//--------------------------------------------------------------------------------------
+// Effect resources loaded on demand
+//--------------------------------------------------------------------------------------
+// See EffectResources.h for an overview
+
+#include "EffectResources.h"
+#include "Shader.h"
+#include "ShaderBindings.h"
+#include "StateCache.h"
+#include "Common.h"
+
+#include <algorithm>
+#include <system_error>
+
+
+EffectResources gEffectResources;
+
+const float EffectResources::DEFAULT_IDLE_SECONDS = 60;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+EffectResources::~EffectResources()
+{
+	Release();
+}
+
+
+void EffectResources::Declare(Effect effect, const std::string& shaderName, ID3D11PixelShader** shader)
+{
+	Entry* entry = FindEntry(effect, true);
+	for (auto& declared : entry->shaders)  if (declared.pixelShader == shader)  return;
+	entry->shaders.push_back({ shaderName, shader, nullptr });
+}
+
+void EffectResources::Declare(Effect effect, const std::string& shaderName, ID3D11ComputeShader** shader)
+{
+	Entry* entry = FindEntry(effect, true);
+	for (auto& declared : entry->shaders)  if (declared.computeShader == shader)  return;
+	entry->shaders.push_back({ shaderName, nullptr, shader });
+}
+
+
+void EffectResources::Release()
+{
+	if (mThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQuit = true;
+		}
+		mWake.notify_all();
+		mThread.join();
+	}
+
+	// Discard any loads that were never swapped in
+	for (auto& loaded : mLoaded)
+	{
+		for (auto& shader : loaded.shaders)
+		{
+			if (shader.pixelShader)    shader.pixelShader  ->Release();
+			if (shader.computeShader)  shader.computeShader->Release();
+		}
+	}
+	mLoaded.clear();
+	mWork.clear();
+
+	// Whatever state an effect is in its globals may be set, by a load or a hot-reload
+	for (auto& entry : mEntries)  Evict(entry);
+	mEntries.clear();
+	mNumLoaded = mNumLoading = mNumEvictions = mNumErrors = 0;
+}
+
+
+bool EffectResources::Load(Effect effect)
+{
+	Entry* entry = FindEntry(effect, false);
+	if (entry == nullptr)  return true; // Nothing declared, the effect only uses shared shaders
+	entry->lastUsed = Clock::now();
+	if (entry->state == State::Loaded)  return true;
+	if (entry->state == State::Failed)
+	{
+		gLastError = "Error loading the shaders of an effect";
+		return false;
+	}
+
+	// A background load still under way is discarded by Update when it arrives
+	std::vector<CreatedShader> created;
+	std::string error;
+	if (entry->state == State::Loading)  --mNumLoading;
+	entry->state = State::Unloaded;
+	if (CreateShaders(entry->shaders, created, error))
+	{
+		if (Publish(*entry, created))  return true;
+	}
+	else
+	{
+		gLastError = error;
+	}
+	entry->state = State::Failed;
+	++mNumErrors;
+	return false;
+}
+
+
+bool EffectResources::Request(Effect effect)
+{
+	Entry* entry = FindEntry(effect, false);
+	if (entry == nullptr)  return true;
+	entry->lastUsed = Clock::now();
+	if (entry->state != State::Unloaded)  return entry->state == State::Loaded;
+
+	if (!mThread.joinable())
+	{
+		mQuit = false;
+		try
+		{
+			mThread = std::thread(&EffectResources::LoaderThread, this);
+		}
+		catch (const std::system_error&)
+		{
+			return Load(effect); // Load here instead, with a pause
+		}
+	}
+
+	entry->state = State::Loading;
+	++mNumLoading;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mWork.push_back({ static_cast<size_t>(entry - mEntries.data()), entry->shaders });
+	}
+	mWake.notify_all();
+	return false;
+}
+
+
+void EffectResources::Update()
+{
+	// Swap in the finished loads, without waiting if the background thread holds the lock
+	std::vector<Loaded> loadedEffects;
+	{
+		std::unique_lock<std::mutex> lock(mMutex, std::try_to_lock);
+		if (lock.owns_lock())  loadedEffects.swap(mLoaded);
+	}
+	for (auto& loaded : loadedEffects)
+	{
+		Entry& entry = mEntries[loaded.entry];
+		if (entry.state != State::Loading) // Loaded by Load in the meantime
+		{
+			for (auto& shader : loaded.shaders)
+			{
+				if (shader.pixelShader)    shader.pixelShader  ->Release();
+				if (shader.computeShader)  shader.computeShader->Release();
+			}
+			continue;
+		}
+
+		--mNumLoading;
+		entry.state = State::Unloaded;
+		if (loaded.shaders.empty())
+		{
+			gLastError = loaded.error;
+		}
+		else if (Publish(entry, loaded.shaders))
+		{
+			continue;
+		}
+		entry.state = State::Failed;
+		++mNumErrors;
+		OutputDebugStringA((gLastError + "\n").c_str()); // Not fatal, the effect stays off
+	}
+
+	// Then release the effects that haven't been used for a while
+	if (mIdleSeconds <= 0)  return;
+	Clock::time_point now = Clock::now();
+	bool evicted = false;
+	for (auto& entry : mEntries)
+	{
+		if (entry.state == State::Loaded && std::chrono::duration<float>(now - entry.lastUsed).count() > mIdleSeconds)
+		{
+			Evict(entry);
+			++mNumEvictions;
+			evicted = true;
+		}
+	}
+	if (evicted)  gStateCache.Invalidate(); // A new shader could be created at a released one's address
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+EffectResources::Entry* EffectResources::FindEntry(Effect effect, bool create)
+{
+	for (auto& entry : mEntries)  if (entry.effect == effect)  return &entry;
+	if (!create)  return nullptr;
+	mEntries.push_back({ effect, {}, State::Unloaded, Clock::now() });
+	return &mEntries.back();
+}
+
+
+bool EffectResources::CreateShaders(const std::vector<DeclaredShader>& declared, std::vector<CreatedShader>& created, std::string& error)
+{
+	for (auto& shader : declared)
+	{
+		CreatedShader newShader = { nullptr, nullptr, {} };
+		bool ok = ReadShaderByteCode(shader.name, newShader.byteCode);
+		if (ok && shader.pixelShader)
+		{
+			ok = SUCCEEDED(gD3DDevice->CreatePixelShader(newShader.byteCode.data(), newShader.byteCode.size(), nullptr, &newShader.pixelShader));
+		}
+		else if (ok)
+		{
+			ok = SUCCEEDED(gD3DDevice->CreateComputeShader(newShader.byteCode.data(), newShader.byteCode.size(), nullptr, &newShader.computeShader));
+		}
+		if (!ok)
+		{
+			for (auto& done : created)
+			{
+				if (done.pixelShader)    done.pixelShader  ->Release();
+				if (done.computeShader)  done.computeShader->Release();
+			}
+			created.clear();
+			error = "Error loading " + shader.name;
+			return false;
+		}
+		created.push_back(std::move(newShader));
+	}
+	return true;
+}
+
+
+bool EffectResources::Publish(Entry& entry, std::vector<CreatedShader>& created)
+{
+	bool ok = true;
+	for (size_t i = 0; i < created.size() && ok; ++i)
+	{
+		const void* shader = created[i].pixelShader ? static_cast<const void*>(created[i].pixelShader) : created[i].computeShader;
+		ok = RegisterBindings(shader, created[i].byteCode.data(), created[i].byteCode.size(), entry.shaders[i].name);
+	}
+	if (!ok)
+	{
+		for (auto& shader : created)
+		{
+			gShaderBindings.Unregister(shader.pixelShader ? static_cast<const void*>(shader.pixelShader) : shader.computeShader);
+			if (shader.pixelShader)    shader.pixelShader  ->Release();
+			if (shader.computeShader)  shader.computeShader->Release();
+		}
+		return false;
+	}
+
+	for (size_t i = 0; i < created.size(); ++i)
+	{
+		DeclaredShader& declared = entry.shaders[i];
+		if (declared.pixelShader && *declared.pixelShader == nullptr)
+		{
+			*declared.pixelShader = created[i].pixelShader;
+		}
+		else if (declared.computeShader && *declared.computeShader == nullptr)
+		{
+			*declared.computeShader = created[i].computeShader;
+		}
+		else // Already swapped in by a hot-reload
+		{
+			gShaderBindings.Unregister(created[i].pixelShader ? static_cast<const void*>(created[i].pixelShader) : created[i].computeShader);
+			if (created[i].pixelShader)    created[i].pixelShader  ->Release();
+			if (created[i].computeShader)  created[i].computeShader->Release();
+		}
+	}
+	entry.state = State::Loaded;
+	++mNumLoaded;
+	return true;
+}
+
+
+void EffectResources::Evict(Entry& entry)
+{
+	for (auto& declared : entry.shaders)
+	{
+		if (declared.pixelShader && *declared.pixelShader)
+		{
+			gShaderBindings.Unregister(*declared.pixelShader);
+			(*declared.pixelShader)->Release();
+			*declared.pixelShader = nullptr;
+		}
+		if (declared.computeShader && *declared.computeShader)
+		{
+			gShaderBindings.Unregister(*declared.computeShader);
+			(*declared.computeShader)->Release();
+			*declared.computeShader = nullptr;
+		}
+	}
+	if (entry.state == State::Loaded)  --mNumLoaded;
+	entry.state = State::Unloaded;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Background thread
+//--------------------------------------------------------------------------------------
+
+void EffectResources::LoaderThread()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true)
+	{
+		mWake.wait(lock, [this] { return mQuit || !mWork.empty(); });
+		if (mQuit)  break;
+
+		auto work = mWork.front();
+		mWork.erase(mWork.begin());
+
+		lock.unlock(); // Don't hold up Update or new requests while loading
+		Loaded loaded = { work.first, {}, {} };
+		CreateShaders(work.second, loaded.shaders, loaded.error);
+		lock.lock();
+
+		mLoaded.push_back(std::move(loaded));
+	}
+}
@@ -0,0 +1,158 @@
+//--------------------------------------------------------------------------------------
+// Effect resources loaded on demand
+//--------------------------------------------------------------------------------------
+// Most runs only switch on one or two post-processing effects, so the shaders used by just one effect are declared
+// against it here (see LoadShaders) rather than created at startup. Their globals stay null until the effect is first
+// applied. The scene's effect chains set EffectSettings::backgroundLoad, which skips an effect while its shaders are
+// read and created on a background thread (the ID3D11Device is free-threaded) and Update swaps them into their globals
+// between frames - the effect simply comes on a frame or two after it is enabled. Other chains (batch processing, the
+// benchmarks) load the shaders before they are applied, as a missing effect would spoil their output.
+//
+// An effect that hasn't been applied for the idle time has its shaders released again, and is loaded afresh the next
+// time it is used. Shaders shared by several effects are still loaded by LoadShaders. Shaders loaded here come from the
+// asset pack or their .cso files, as the shader library is only open while LoadShaders runs
+
+#ifndef _EFFECT_RESOURCES_H_INCLUDED_
+#define _EFFECT_RESOURCES_H_INCLUDED_
+
+#include "EffectChain.h"
+
+#include <d3d11.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+class EffectResources
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~EffectResources();
+
+	// Declare a shader (name without the .hlsl extension) used only by the given effect. The global is set when the effect
+	// is loaded and released when it is evicted
+	void Declare(Effect effect, const std::string& shaderName, ID3D11PixelShader**   shader);
+	void Declare(Effect effect, const std::string& shaderName, ID3D11ComputeShader** shader);
+
+	// Stop the background thread, release the shaders loaded and forget the declarations
+	void Release();
+
+
+	// Make sure the effect's shaders are loaded, loading them now if they aren't. Returns false on failure (reason in
+	// gLastError). Main thread only
+	bool Load(Effect effect);
+
+	// True if the effect's shaders are loaded, otherwise starts loading them in the background. Main thread only
+	bool Request(Effect effect);
+
+	// Call between frames. Swaps in the shaders loaded in the background and releases those of effects idle for longer
+	// than the idle time. Never waits for the background thread
+	void Update();
+
+	// Seconds an effect can go unused before its shaders are released, 0 to keep them once loaded
+	void SetIdleTime(float seconds)  { mIdleSeconds = seconds; }
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	int NumLoaded()     { return mNumLoaded;    } // Effects whose shaders are loaded now
+	int NumLoading()    { return mNumLoading;   } // Effects being loaded in the background
+	int NumEvictions()  { return mNumEvictions; } // Times an idle effect has been released
+	int NumErrors()     { return mNumErrors;    } // Effects that failed to load, they stay off
+
+	float IdleTime()  { return mIdleSeconds; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const float DEFAULT_IDLE_SECONDS;
+
+	typedef std::chrono::steady_clock Clock;
+
+	enum class State
+	{
+		Unloaded,
+		Loading,
+		Loaded,
+		Failed, // Not tried again until Release
+	};
+
+	struct DeclaredShader
+	{
+		std::string           name;
+		ID3D11PixelShader**   pixelShader;   // One of these two is null
+		ID3D11ComputeShader** computeShader;
+	};
+
+	struct Entry
+	{
+		Effect                      effect;
+		std::vector<DeclaredShader> shaders;
+		State                       state;
+		Clock::time_point           lastUsed;
+	};
+
+	// A shader created from its bytecode, which is kept to register its bindings on the main thread
+	struct CreatedShader
+	{
+		ID3D11PixelShader*   pixelShader;
+		ID3D11ComputeShader* computeShader;
+		std::vector<char>    byteCode;
+	};
+
+	// An effect's shaders loaded by the background thread, waiting for Update
+	struct Loaded
+	{
+		size_t                     entry;
+		std::vector<CreatedShader> shaders; // Empty on failure
+		std::string                error;
+	};
+
+	Entry* FindEntry(Effect effect, bool create);
+
+	// Read and create the shaders declared by an entry, any thread. The names are copied so the background thread never
+	// reads mEntries. Returns false on failure, with the reason in error and nothing created
+	static bool CreateShaders(const std::vector<DeclaredShader>& declared, std::vector<CreatedShader>& created, std::string& error);
+
+	// Register the shaders' bindings and set their globals, releasing them on failure (reason in gLastError). Globals
+	// already set (by a shader hot-reload) are kept
+	bool Publish(Entry& entry, std::vector<CreatedShader>& created);
+
+	// Release an entry's shaders and null the globals
+	void Evict(Entry& entry);
+
+	// Background thread loop, loads the queued entries until told to quit
+	void LoaderThread();
+
+
+	std::vector<Entry> mEntries; // Only used on the main thread
+
+	std::thread             mThread;
+	std::mutex              mMutex;
+	std::condition_variable mWake; // Signalled on new work or quit
+	bool                    mQuit = false;
+	std::vector<std::pair<size_t, std::vector<DeclaredShader>>> mWork; // These two guarded by mMutex
+	std::vector<Loaded>                                         mLoaded;
+
+	float mIdleSeconds  = DEFAULT_IDLE_SECONDS;
+	int   mNumLoaded    = 0;
+	int   mNumLoading   = 0;
+	int   mNumEvictions = 0;
+	int   mNumErrors    = 0;
+};
+
+
+extern EffectResources gEffectResources;
+
+
+#endif //_EFFECT_RESOURCES_H_INCLUDED_
@@ -0,0 +1,33 @@
+//--------------------------------------------------------------------------------------
+// Exposure Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Applies the auto exposure measured on the GPU (see AutoExposure_cs.hlsl), then tonemaps so the brightened or darkened
+// image still fits the back buffer. The tonemap is extended Reinhard with the white point at the exposure, which leaves
+// white as white and does nothing at all at an exposure of 1
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    SceneTexture : register(t0);
+SamplerState PointSample  : register(s0);
+
+StructuredBuffer<ExposureData> ExposureBuffer : register(t8); // EXPOSURE_SLOT
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	float exposure = ExposureBuffer[0].exposure;
+	float3 colour = SceneTexture.Sample(PointSample, input.uv).rgb * exposure;
+
+	float whiteSquared = exposure * exposure;
+	colour = colour * (1 + colour / whiteSquared) / (1 + colour);
+	return float4(colour, 1.0f);
+}
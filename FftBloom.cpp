@@ -0,0 +1,227 @@
+//--------------------------------------------------------------------------------------
+// FFT bloom kernels
+//--------------------------------------------------------------------------------------
+// See FftBloom.h for an overview
+
+#include "FftBloom.h"
+#include "Shader.h"
+#include "StateCache.h"
+#include "ImageFile.h"
+#include "ResourceRegistry.h"
+#include "Common.h"
+
+#include <cmath>
+#include <vector>
+
+
+FftBloomKernel gFftBloomKernel;
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+ID3D11ComputeShader* GetFftShader(bool columns, bool inverse, bool convolve)
+{
+	return GetComputeShaderPermutation("Fft_cs", { { "FFT_COLUMNS",  columns  ? "1" : "0" },
+	                                               { "FFT_INVERSE",  inverse  ? "1" : "0" },
+	                                               { "FFT_CONVOLVE", convolve ? "1" : "0" } });
+}
+
+
+// Create an FFT_BLOOM_SIZE square float texture that compute shaders can write, optionally with initial data (four
+// floats per texel). Returns false on failure, anything created must be released by the caller
+static bool CreateFftTexture(const float* data, ID3D11Texture2D** texture, ID3D11ShaderResourceView** srv,
+                             ID3D11UnorderedAccessView** uav)
+{
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width  = FFT_BLOOM_SIZE;
+	desc.Height = FFT_BLOOM_SIZE;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+
+	D3D11_SUBRESOURCE_DATA initData = {};
+	initData.pSysMem = data;
+	initData.SysMemPitch = FFT_BLOOM_SIZE * 4 * sizeof(float);
+	if (FAILED(gD3DDevice->CreateTexture2D(&desc, data ? &initData : nullptr, texture)))  return false;
+	gResourceRegistry.Track(*texture);
+	if (FAILED(gD3DDevice->CreateShaderResourceView(*texture, nullptr, srv)))             return false;
+	return SUCCEEDED(gD3DDevice->CreateUnorderedAccessView(*texture, nullptr, uav));
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+bool FftBloomKernel::Update(const FftBloomKernelSettings& settings)
+{
+	if (mHaveSettings && settings.streaks == mSettings.streaks && settings.streakLength == mSettings.streakLength &&
+	    settings.imageFile == mSettings.imageFile)
+	{
+		if (mSpectrumSRV == nullptr)  gLastError = mError;
+		return mSpectrumSRV != nullptr;
+	}
+	Release();
+	mSettings = settings;
+	mHaveSettings = true;
+	mError = "";
+
+	// Both complex numbers in each texel hold the (real) kernel, so the transform comes out the same in xy and zw
+	std::vector<float> kernel(FFT_BLOOM_SIZE * FFT_BLOOM_SIZE);
+	if (!BuildKernel(settings, kernel.data()))
+	{
+		mError = gLastError;
+		return false;
+	}
+	std::vector<float> texels(FFT_BLOOM_SIZE * FFT_BLOOM_SIZE * 4, 0.0f);
+	for (size_t i = 0; i < kernel.size(); ++i)
+	{
+		texels[i * 4 + 0] = kernel[i];
+		texels[i * 4 + 2] = kernel[i];
+	}
+
+	ID3D11ComputeShader* rowsShader    = GetFftShader(false, false, false);
+	ID3D11ComputeShader* columnsShader = GetFftShader(true,  false, false);
+	if (rowsShader == nullptr || columnsShader == nullptr)
+	{
+		mError = gLastError;
+		return false;
+	}
+
+	ID3D11Texture2D*           kernelTexture = nullptr;
+	ID3D11ShaderResourceView*  kernelSRV     = nullptr;
+	ID3D11UnorderedAccessView* kernelUAV     = nullptr;
+	ID3D11Texture2D*           rowsTexture   = nullptr;
+	ID3D11ShaderResourceView*  rowsSRV       = nullptr;
+	ID3D11UnorderedAccessView* rowsUAV       = nullptr;
+	bool created = CreateFftTexture(texels.data(), &kernelTexture, &kernelSRV, &kernelUAV) &&
+	               CreateFftTexture(nullptr, &rowsTexture, &rowsSRV, &rowsUAV) &&
+	               CreateFftTexture(nullptr, &mSpectrum, &mSpectrumSRV, &mSpectrumUAV);
+	if (created)
+	{
+		// The spectrum may still be bound for the convolution from last frame, it can't also be written
+		ID3D11ShaderResourceView*  nullSRVs[2] = {};
+		ID3D11UnorderedAccessView* nullUAV = nullptr;
+		gD3DContext->CSSetShaderResources(0, 2, nullSRVs);
+
+		// Rows then columns, one group for each
+		gStateCache.CSSetShader(rowsShader, nullptr, 0);
+		gD3DContext->CSSetShaderResources(0, 1, &kernelSRV);
+		gD3DContext->CSSetUnorderedAccessViews(0, 1, &rowsUAV, nullptr);
+		gD3DContext->Dispatch(1, FFT_BLOOM_SIZE, 1);
+		gD3DContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
+
+		gStateCache.CSSetShader(columnsShader, nullptr, 0);
+		gD3DContext->CSSetShaderResources(0, 1, &rowsSRV);
+		gD3DContext->CSSetUnorderedAccessViews(0, 1, &mSpectrumUAV, nullptr);
+		gD3DContext->Dispatch(FFT_BLOOM_SIZE, 1, 1);
+		gD3DContext->CSSetShaderResources(0, 1, nullSRVs);
+		gD3DContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
+	}
+
+	// The working textures are only needed while building
+	if (rowsUAV)        rowsUAV->Release();
+	if (rowsSRV)        rowsSRV->Release();
+	if (rowsTexture)    rowsTexture->Release();
+	if (kernelUAV)      kernelUAV->Release();
+	if (kernelSRV)      kernelSRV->Release();
+	if (kernelTexture)  kernelTexture->Release();
+	if (!created)
+	{
+		Release();
+		mHaveSettings = true;
+		mError = gLastError = "Error creating FFT bloom textures";
+		return false;
+	}
+
+	++mNumBuilds;
+	return true;
+}
+
+
+void FftBloomKernel::Release()
+{
+	if (mSpectrumUAV)  mSpectrumUAV->Release();
+	if (mSpectrumSRV)  mSpectrumSRV->Release();
+	if (mSpectrum)     mSpectrum->Release();
+	mSpectrumUAV = nullptr;
+	mSpectrumSRV = nullptr;
+	mSpectrum    = nullptr;
+	mHaveSettings = false;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+bool FftBloomKernel::BuildKernel(const FftBloomKernelSettings& settings, float* kernel)
+{
+	const int N = FFT_BLOOM_SIZE;
+	float total = 0;
+
+	if (!settings.imageFile.empty())
+	{
+		std::vector<uint8_t> pixels;
+		int width, height;
+		if (!ReadImageFile(settings.imageFile, pixels, width, height))
+		{
+			gLastError = "Error reading FFT bloom kernel " + settings.imageFile;
+			return false;
+		}
+
+		// Centre the image on texel (0, 0), cropping anything larger than the FFT
+		for (int i = 0; i < N * N; ++i)  kernel[i] = 0;
+		for (int y = 0; y < height && y < N; ++y)
+		{
+			for (int x = 0; x < width && x < N; ++x)
+			{
+				const uint8_t* pixel = &pixels[(y * width + x) * 4];
+				float value = (0.2126f * pixel[0] + 0.7152f * pixel[1] + 0.0722f * pixel[2]) / 255.0f;
+				int u = (x - width  / 2 + N) % N;
+				int v = (y - height / 2 + N) % N;
+				kernel[v * N + u] = value;
+				total += value;
+			}
+		}
+	}
+	else
+	{
+		// A narrow bright core and a wider faint halo, plus the streaks - thin lines fading out along their length
+		const float PI = 3.14159265f;
+		float length = std::fmin(settings.streakLength, 0.25f) * N; // The padding around the image is a quarter of the FFT
+		for (int v = 0; v < N; ++v)
+		{
+			for (int u = 0; u < N; ++u)
+			{
+				float x = static_cast<float>(u < N / 2 ? u : u - N);
+				float y = static_cast<float>(v < N / 2 ? v : v - N);
+				float distanceSquared = x * x + y * y;
+				float value = std::exp(-distanceSquared / 2) + 0.02f * std::exp(-distanceSquared / (2 * 16 * 16));
+				for (int streak = 0; streak < settings.streaks; ++streak)
+				{
+					float angle = PI * (streak + 0.5f) / settings.streaks;
+					float along  = std::fabs( std::cos(angle) * x + std::sin(angle) * y);
+					float across = std::fabs(-std::sin(angle) * x + std::cos(angle) * y);
+					float fade = std::fmax(0.0f, 1 - along / length);
+					value += 0.05f * fade * fade * std::exp(-across * across / (2 * 0.6f * 0.6f));
+				}
+				kernel[v * N + u] = value;
+				total += value;
+			}
+		}
+	}
+
+	if (total <= 0)
+	{
+		gLastError = "FFT bloom kernel is empty";
+		return false;
+	}
+	for (int i = 0; i < N * N; ++i)  kernel[i] /= total;
+	return true;
+}
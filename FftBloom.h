@@ -0,0 +1,78 @@
+//--------------------------------------------------------------------------------------
+// FFT bloom kernels
+//--------------------------------------------------------------------------------------
+// FFT bloom convolves the bright parts of the image with a glare kernel by multiplying their Fourier transforms, so the
+// cost is the same for a kernel covering the whole screen as for a small one, and the kernel needn't be separable (e.g.
+// the streaks of a star filter). The image side is a few passes of each EffectChain (see AddFftBloomPasses in
+// EffectChain.cpp), this holds the transformed kernel they multiply by. It is built on the CPU - a star with a soft core,
+// or an image file - then transformed on the GPU, and kept until the kernel settings change
+
+#ifndef _FFT_BLOOM_H_INCLUDED_
+#define _FFT_BLOOM_H_INCLUDED_
+
+#include <d3d11.h>
+#include <string>
+
+
+// The glare shape. An image file replaces the star if given
+struct FftBloomKernelSettings
+{
+	int         streaks      = 3;     // Lines through the centre of the star, 0 for a round glow only
+	float       streakLength = 0.2f;  // Length of each arm of the star as a fraction of the FFT size, at most 0.25
+	std::string imageFile;            // Greyscale kernel image, centred on the middle of the image
+};
+
+
+// Get the permutation of the FFT compute shader (Fft_cs.hlsl) with the given options, nullptr on error (reason in gLastError)
+ID3D11ComputeShader* GetFftShader(bool columns, bool inverse, bool convolve);
+
+
+class FftBloomKernel
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Rebuild the transformed kernel if the settings have changed since the last call. Call on the main thread. Returns
+	// false on failure (reason in gLastError), which isn't retried until the settings change
+	bool Update(const FftBloomKernelSettings& settings);
+
+	// Release the transformed kernel, the next Update builds it again
+	void Release();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// Fourier transform of the kernel, FFT_BLOOM_SIZE square, complex values in xy. Null until Update succeeds
+	ID3D11ShaderResourceView* Spectrum()  { return mSpectrumSRV; }
+
+	int         NumBuilds()  { return mNumBuilds; }
+	std::string Error()      { return mError; } // Why the current settings couldn't be built, empty if they were
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Fill the kernel, FFT_BLOOM_SIZE square with its centre at (0, 0) wrapping round the edges, adding up to 1
+	bool BuildKernel(const FftBloomKernelSettings& settings, float* kernel);
+
+	FftBloomKernelSettings mSettings;
+	bool                   mHaveSettings = false;
+	std::string            mError; // Reason the kernel for mSettings couldn't be built
+
+	ID3D11Texture2D*           mSpectrum    = nullptr;
+	ID3D11ShaderResourceView*  mSpectrumSRV = nullptr;
+	ID3D11UnorderedAccessView* mSpectrumUAV = nullptr;
+
+	int mNumBuilds = 0;
+};
+
+
+extern FftBloomKernel gFftBloomKernel;
+
+
+#endif //_FFT_BLOOM_H_INCLUDED_
@@ -0,0 +1,30 @@
+//--------------------------------------------------------------------------------------
+// FFT Bloom Combine Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Adds the glare convolved by Fft_cs on to the scene. The glare is in the corner of the FFT texture (see
+// FftBloomPack_pp.hlsl), in red, green and blue as the real parts of the two complex numbers
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    GlareTexture   : register(t0);
+Texture2D    SceneTexture   : register(t1);
+SamplerState PointSample    : register(s0);
+SamplerState BilinearSample : register(s1);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	float4 glare = GlareTexture.Sample(BilinearSample, input.uv * gFftBloomUVScale);
+	float3 scene = SceneTexture.Sample(PointSample, input.uv).rgb;
+	
+	return float4(scene + max(float3(glare.x, glare.y, glare.z), 0) * gFftBloomIntensity, 1.0f);
+}
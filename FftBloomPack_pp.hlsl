@@ -0,0 +1,31 @@
+//--------------------------------------------------------------------------------------
+// FFT Bloom Pack Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Copies the bright-filtered image into the corner of the FFT_BLOOM_SIZE square texture the FFT bloom is convolved in.
+// The rest is left black as padding, so glare spreading off one edge doesn't wrap round onto the other. The colour is
+// packed as two complex numbers for Fft_cs: red + i green, and blue + i 0
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    SceneTexture   : register(t0);
+SamplerState PointSample    : register(s0);
+SamplerState BilinearSample : register(s1);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	float2 uv = input.uv / gFftBloomUVScale;
+	if (any(uv > 1))  return float4(0, 0, 0, 0);
+
+	float3 colour = SceneTexture.Sample(BilinearSample, uv).rgb;
+	return float4(colour.r, colour.g, colour.b, 0);
+}
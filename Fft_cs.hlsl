@@ -0,0 +1,122 @@
+//--------------------------------------------------------------------------------------
+// FFT Compute Shader
+//--------------------------------------------------------------------------------------
+// Radix-2 fast Fourier transform of each row or column of an FFT_BLOOM_SIZE square texture, used for FFT bloom (see
+// AddFftBloomPasses in EffectChain.cpp). One group transforms a whole row or column in groupshared memory, each thread
+// doing one butterfly per stage. Each texel holds two complex numbers, xy and zw - the bloom packs red and green into
+// the first and blue into the second, which works because the kernel is real, so red and green come back apart as the
+// real and imaginary parts.
+//
+// Compiled as permutations (see GetComputeShaderPermutation in Shader.cpp):
+//   FFT_COLUMNS  - 0 transforms rows (dispatched one group per row), 1 columns (one group per column)
+//   FFT_INVERSE  - 1 for the inverse transform, scaled by 1 / FFT_BLOOM_SIZE
+//   FFT_CONVOLVE - 1 for a forward transform, multiply by the kernel spectrum in t1, then inverse transform, all in one
+//                  pass, so the column transforms of the convolution never leave groupshared memory
+
+#include "Common.hlsli"
+
+#ifndef FFT_COLUMNS
+#define FFT_COLUMNS 0
+#endif
+#ifndef FFT_INVERSE
+#define FFT_INVERSE 0
+#endif
+#ifndef FFT_CONVOLVE
+#define FFT_CONVOLVE 0
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D<float4>   InputTexture   : register(t0);
+Texture2D<float4>   KernelSpectrum : register(t1); // Only with FFT_CONVOLVE, the transformed kernel in xy
+RWTexture2D<float4> OutputTexture  : register(u0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+static const float PI = 3.14159265f;
+
+groupshared float4 Values[FFT_BLOOM_SIZE];
+
+
+float2 ComplexMultiply(float2 a, float2 b)
+{
+	return float2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+// Position of each value before the butterflies, so the results come out in order
+uint BitReverse(uint index)
+{
+	return reversebits(index) >> (32 - FFT_BLOOM_LOG2_SIZE);
+}
+
+// Transform the values in place, they must already be in bit-reversed order. direction is -1 forward, 1 inverse
+void Transform(uint thread, float direction)
+{
+	for (uint halfSize = 1; halfSize < FFT_BLOOM_SIZE; halfSize *= 2)
+	{
+		GroupMemoryBarrierWithGroupSync();
+
+		// Each thread combines one pair of values halfSize apart
+		uint k = thread % halfSize;
+		uint i = (thread / halfSize) * halfSize * 2 + k;
+		uint j = i + halfSize;
+
+		float angle = direction * PI * k / halfSize;
+		float2 twiddle = float2(cos(angle), sin(angle));
+		float4 a = Values[i];
+		float4 b = Values[j];
+		float4 twiddled = float4(ComplexMultiply(twiddle, b.xy), ComplexMultiply(twiddle, b.zw));
+		Values[i] = a + twiddled;
+		Values[j] = a - twiddled;
+	}
+	GroupMemoryBarrierWithGroupSync();
+}
+
+
+[numthreads(FFT_BLOOM_SIZE / 2, 1, 1)]
+void main(uint3 groupID : SV_GroupID, uint thread : SV_GroupIndex)
+{
+#if FFT_COLUMNS
+	uint lineIndex = groupID.x;
+	#define FFT_TEXEL(index) uint2(lineIndex, index)
+#else
+	uint lineIndex = groupID.y;
+	#define FFT_TEXEL(index) uint2(index, lineIndex)
+#endif
+
+	// Each thread loads and stores two of the values
+	uint index1 = thread;
+	uint index2 = thread + FFT_BLOOM_SIZE / 2;
+	Values[BitReverse(index1)] = InputTexture[FFT_TEXEL(index1)];
+	Values[BitReverse(index2)] = InputTexture[FFT_TEXEL(index2)];
+
+#if FFT_CONVOLVE
+	Transform(thread, -1);
+
+	// Multiply by the kernel and put the products back in bit-reversed order for the inverse transform
+	float4 value1 = Values[index1];
+	float4 value2 = Values[index2];
+	float2 kernel1 = KernelSpectrum[FFT_TEXEL(index1)].xy;
+	float2 kernel2 = KernelSpectrum[FFT_TEXEL(index2)].xy;
+	GroupMemoryBarrierWithGroupSync();
+	Values[BitReverse(index1)] = float4(ComplexMultiply(value1.xy, kernel1), ComplexMultiply(value1.zw, kernel1));
+	Values[BitReverse(index2)] = float4(ComplexMultiply(value2.xy, kernel2), ComplexMultiply(value2.zw, kernel2));
+#endif
+
+#if FFT_INVERSE || FFT_CONVOLVE
+	Transform(thread, 1);
+	float scale = 1.0f / FFT_BLOOM_SIZE;
+#else
+	Transform(thread, -1);
+	float scale = 1.0f;
+#endif
+
+	OutputTexture[FFT_TEXEL(index1)] = Values[index1] * scale;
+	OutputTexture[FFT_TEXEL(index2)] = Values[index2] * scale;
+}
@@ -0,0 +1,30 @@
+//--------------------------------------------------------------------------------------
+// Fog Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Exponential fog by distance from the camera, read from the depth buffer (see DepthEffects.hlsli) rather than added
+// to every lit shader. Light reaching the camera falls off as exp(-density * distance) past the fog start, the rest is
+// made up by the fog colour
+
+#include "DepthEffects.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    SceneTexture : register(t0);
+SamplerState PointSample  : register(s0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	float3 colour = SceneTexture.Sample(PointSample, input.uv).rgb;
+
+	float distance = max(SceneDepth(input.uv) - gFogStart, 0);
+	float fog = (1 - exp(-gFogDensity * distance)) * gFogMaxOpacity;
+	return float4(lerp(colour, gFogColour, fog), 1.0f);
+}
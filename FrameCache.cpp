@@ -0,0 +1,122 @@
+//--------------------------------------------------------------------------------------
+// Frame cache
+//--------------------------------------------------------------------------------------
+// See FrameCache.h for an overview
+
+#include "FrameCache.h"
+#include "ResourceRegistry.h"
+#include "Common.h"
+
+
+FrameCache gFrameCache;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+FrameCache::~FrameCache()
+{
+	Release();
+}
+
+
+void FrameCache::Release()
+{
+	if (mFrame)  mFrame->Release();
+	mFrame = nullptr;
+	Invalidate();
+}
+
+
+void FrameCache::Invalidate()
+{
+	mSceneKey = FrameKey();
+	mPostProcessKey = FrameKey();
+	mSceneStableFrames = mPostProcessStableFrames = 0;
+	mSceneSaved = mFrameSaved = false;
+}
+
+
+void FrameCache::BeginFrame(const FrameKey& sceneKey, const FrameKey& postProcessKey)
+{
+	if (sceneKey == mSceneKey)
+	{
+		if (mSceneStableFrames < SETTLE_FRAMES)  ++mSceneStableFrames;
+	}
+	else
+	{
+		mSceneKey = sceneKey;
+		mSceneStableFrames = 0;
+		mSceneSaved = mFrameSaved = false;
+	}
+
+	if (postProcessKey == mPostProcessKey)
+	{
+		if (mPostProcessStableFrames < SETTLE_FRAMES)  ++mPostProcessStableFrames;
+	}
+	else
+	{
+		mPostProcessKey = postProcessKey;
+		mPostProcessStableFrames = 0;
+		mFrameSaved = false;
+	}
+
+	if      (ReuseFrame())  ++mNumFramesReused;
+	else if (ReuseScene())  ++mNumScenesReused;
+}
+
+
+// Only kept once the key has been unchanged for a frame, a change may still be catching up before that
+void FrameCache::SceneRendered(bool preserved)
+{
+	mSceneSaved = preserved && mSceneStableFrames >= SETTLE_FRAMES - 1;
+}
+
+
+void FrameCache::FrameRendered(ID3D11Resource* frame)
+{
+	mFrameSaved = false;
+	if (mSceneStableFrames < SETTLE_FRAMES - 1 || mPostProcessStableFrames < SETTLE_FRAMES - 1)  return;
+
+	// The copy matches the frame's size and format, it is replaced when they change (the window is resized)
+	ID3D11Texture2D* texture = nullptr;
+	if (FAILED(frame->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&texture)))  return;
+	D3D11_TEXTURE2D_DESC desc;
+	texture->GetDesc(&desc);
+	texture->Release();
+
+	if (mFrame != nullptr)
+	{
+		D3D11_TEXTURE2D_DESC frameDesc;
+		mFrame->GetDesc(&frameDesc);
+		if (frameDesc.Width != desc.Width || frameDesc.Height != desc.Height || frameDesc.Format != desc.Format ||
+		    frameDesc.SampleDesc.Count != desc.SampleDesc.Count)
+		{
+			mFrame->Release();
+			mFrame = nullptr;
+		}
+	}
+	if (mFrame == nullptr)
+	{
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = 0;
+		desc.CPUAccessFlags = 0;
+		desc.MiscFlags = 0;
+		if (FAILED(gD3DDevice->CreateTexture2D(&desc, nullptr, &mFrame)))
+		{
+			mFrame = nullptr;
+			return;
+		}
+		gResourceRegistry.Track(mFrame);
+	}
+
+	gD3DContext->CopyResource(mFrame, frame);
+	mFrameSaved = true;
+}
+
+
+void FrameCache::RestoreFrame(ID3D11Resource* frame)
+{
+	if (mFrame != nullptr)  gD3DContext->CopyResource(frame, mFrame);
+}
@@ -0,0 +1,125 @@
+//--------------------------------------------------------------------------------------
+// Frame cache
+//--------------------------------------------------------------------------------------
+// Reuses the work of earlier frames while nothing on screen changes, for views that sit still for long periods (e.g.
+// kiosk and signage displays). Each frame is described by two keys: one of everything the scene render depends on (the
+// camera, the lights, the render settings and anything animated) and one of everything the post-processing depends on
+// (the effects and their settings, including the time only while an effect is animated by it). Each stage of the frame
+// is reused while its inputs are unchanged:
+//   - While the scene key is unchanged the scene texture still holds the scene, so it isn't rendered again and the
+//     post-processes are run over the old one. The post-processes mustn't reuse the scene texture for their
+//     intermediate results while caching, or it would no longer hold the scene
+//   - While both keys are unchanged the finished frame is copied back from a copy kept of it, and neither stage runs
+// A key must be unchanged for SETTLE_FRAMES frames before its stage is reused, as some results take a frame to catch up
+// with a change (e.g. the occlusion query results, see OcclusionCuller.h).
+//
+// The back buffer is discarded by each present, which is why the finished frame is copied. The copy is taken before
+// anything is drawn over the frame that isn't part of it, such as the profiler overlay
+
+#ifndef _FRAME_CACHE_H_INCLUDED_
+#define _FRAME_CACHE_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+
+#include <d3d11.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+// A list of values describing the inputs of a stage, compared exactly with the last frame's
+class FrameKey
+{
+public:
+	void AddValue(uint64_t value)  { mValues.push_back(value); }
+	void AddFloat(float value)     { uint32_t bits; std::memcpy(&bits, &value, sizeof(bits));  mValues.push_back(bits); }
+	void AddVector(const CVector3& v)  { AddFloat(v.x);  AddFloat(v.y);  AddFloat(v.z); }
+	void AddMatrix(const CMatrix4x4& m)
+	{
+		const float* elements = &m.e00;
+		for (int i = 0; i < 16; ++i)  AddFloat(elements[i]);
+	}
+	void AddString(const std::string& text)  { AddValue(text.size());  for (char c : text)  AddValue(static_cast<unsigned char>(c)); }
+
+	// An object bound by the stage, e.g. a render target. Add its size too, the address of a released object can be reused
+	void AddObject(const void* object)  { mValues.push_back(reinterpret_cast<uintptr_t>(object)); }
+
+	bool operator==(const FrameKey& other) const  { return mValues == other.mValues; }
+
+private:
+	std::vector<uint64_t> mValues;
+};
+
+
+class FrameCache
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~FrameCache();
+
+	// Release the copy of the frame and forget what was rendered
+	void Release();
+
+	// Forget the scene and frame rendered, e.g. after something else has been drawn into the scene texture
+	void Invalidate();
+
+
+	// Compare this frame's keys with the last frame's. Call once per frame before rendering, then ReuseFrame and
+	// ReuseScene say what needn't be rendered
+	void BeginFrame(const FrameKey& sceneKey, const FrameKey& postProcessKey);
+
+	// The copy of the frame matches this frame, copy it to the back buffer with RestoreFrame rather than rendering
+	bool ReuseFrame()  { return mFrameSaved && mSceneStableFrames >= SETTLE_FRAMES && mPostProcessStableFrames >= SETTLE_FRAMES; }
+
+	// The scene texture holds this frame's scene, the scene needn't be rendered
+	bool ReuseScene()  { return mSceneSaved && mSceneStableFrames >= SETTLE_FRAMES; }
+
+
+	// The scene has been rendered, into the scene texture (preserved) or a target that won't keep it until next frame
+	void SceneRendered(bool preserved);
+
+	// The frame has been finished in the given texture (the back buffer), a copy is kept if it may be reused. Copy
+	// failures aren't fatal, the frame is rendered again
+	void FrameRendered(ID3D11Resource* frame);
+
+	// Copy the frame kept by FrameRendered to the given texture
+	void RestoreFrame(ID3D11Resource* frame);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	int NumScenesReused()  { return mNumScenesReused; } // Frames that reused the scene but ran the post-processes
+	int NumFramesReused()  { return mNumFramesReused; } // Frames copied back whole
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const int SETTLE_FRAMES = 2;
+
+	FrameKey mSceneKey;
+	FrameKey mPostProcessKey;
+	int      mSceneStableFrames       = 0; // Frames each key has been unchanged for
+	int      mPostProcessStableFrames = 0;
+	bool     mSceneSaved = false;          // The scene texture holds the scene for mSceneKey
+	bool     mFrameSaved = false;          // mFrame holds the frame for both keys
+
+	ID3D11Texture2D* mFrame = nullptr;
+
+	int mNumScenesReused = 0;
+	int mNumFramesReused = 0;
+};
+
+
+extern FrameCache gFrameCache;
+
+
+#endif //_FRAME_CACHE_H_INCLUDED_
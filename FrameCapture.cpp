@@ -0,0 +1,335 @@
+//--------------------------------------------------------------------------------------
+// Frame capture
+//--------------------------------------------------------------------------------------
+// See FrameCapture.h for an overview
+
+#include "FrameCapture.h"
+#include "ImageFile.h"
+#include "ResourceRegistry.h"
+#include "Common.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+
+FrameCapture gFrameCapture;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+FrameCapture::~FrameCapture()
+{
+	Release();
+}
+
+
+bool FrameCapture::Start(const std::string& destination, float frameRate)
+{
+	if (mCapturing)
+	{
+		gLastError = "A frame capture is already running";
+		return false;
+	}
+
+	std::string extension;
+	size_t dot = destination.find_last_of('.');
+	if (dot != std::string::npos && destination.find_first_of("\\/", dot) == std::string::npos)
+	{
+		extension = destination.substr(dot);
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	}
+	if      (extension == ".y4m")                          mFormat = Format::Y4m;
+	else if (extension == ".rgba" || extension == ".raw")  mFormat = Format::Raw;
+	else                                                   mFormat = Format::Png;
+
+	if (mFormat == Format::Png)
+	{
+		CreateDirectoryA(destination.c_str(), nullptr); // Fails harmlessly if it already exists
+	}
+	else
+	{
+		mFile.open(destination, std::ios::binary | std::ios::trunc);
+		if (!mFile.is_open())
+		{
+			gLastError = "Error opening " + destination + " for frame capture";
+			return false;
+		}
+	}
+
+	mDestination = destination;
+	mFrameRate   = (frameRate > 0) ? frameRate : 60;
+	mNumCaptured = 0;
+	mNumWritten  = 0;
+	mNumDropped  = 0;
+	mVideoWidth = mVideoHeight = 0;
+	mQuit = false;
+	mThread = std::thread(&FrameCapture::EncoderThread, this);
+	mCapturing = true;
+	return true;
+}
+
+
+void FrameCapture::Stop()
+{
+	if (!mCapturing)  return;
+	mCapturing = false;
+
+	// The last few frames are still in the ring. Waiting is fine now the capture is over
+	while (mSlotsInUse > 0)  ReadBackOldest(true);
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_one();
+	mThread.join();
+	if (mFile.is_open())  mFile.close();
+
+	OutputDebugStringA(("Frame capture: " + std::to_string(mNumWritten) + " frames written to " + mDestination + ", " +
+	                    std::to_string(mNumDropped) + " dropped\n").c_str());
+}
+
+
+void FrameCapture::Release()
+{
+	Stop();
+	ReleaseSlots();
+}
+
+
+void FrameCapture::Capture(ID3D11Resource* source)
+{
+	if (!mCapturing)  return;
+
+	// Pass on every frame the GPU has finished copying
+	while (mSlotsInUse > 0 && ReadBackOldest(false)) {}
+
+	// A new size needs new textures, the frames in the old ones are collected first
+	ID3D11Texture2D* texture = nullptr;
+	D3D11_TEXTURE2D_DESC desc;
+	if (FAILED(source->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&texture)))  return;
+	texture->GetDesc(&desc);
+	texture->Release();
+	if (desc.Width != mSlotWidth || desc.Height != mSlotHeight)
+	{
+		while (mSlotsInUse > 0)  ReadBackOldest(true);
+		if (!CreateSlots(desc.Width, desc.Height))
+		{
+			OutputDebugStringA((gLastError + "\n").c_str());
+			++mNumDropped;
+			return;
+		}
+	}
+
+	if (mSlotsInUse == RING_SIZE)
+	{
+		++mNumDropped; // The GPU is more than a ring behind, waiting would change the frame times being recorded
+		return;
+	}
+
+	Slot& slot = mSlots[(mOldestSlot + mSlotsInUse) % RING_SIZE];
+	gD3DContext->CopyResource(slot.texture, source);
+	gD3DContext->End(slot.copied);
+	slot.frame = mNumCaptured++;
+	++mSlotsInUse;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+bool FrameCapture::CreateSlots(UINT width, UINT height)
+{
+	ReleaseSlots();
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width  = width;
+	desc.Height = height;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_EVENT;
+
+	for (auto& slot : mSlots)
+	{
+		if (FAILED(gD3DDevice->CreateTexture2D(&desc, nullptr, &slot.texture)) ||
+		    FAILED(gD3DDevice->CreateQuery(&queryDesc, &slot.copied)))
+		{
+			ReleaseSlots();
+			gLastError = "Error creating frame capture staging textures";
+			return false;
+		}
+		gResourceRegistry.Track(slot.texture);
+	}
+	mSlotWidth  = width;
+	mSlotHeight = height;
+	return true;
+}
+
+void FrameCapture::ReleaseSlots()
+{
+	for (auto& slot : mSlots)
+	{
+		if (slot.texture)  slot.texture->Release();
+		if (slot.copied)   slot.copied->Release();
+		slot.texture = nullptr;
+		slot.copied  = nullptr;
+	}
+	mOldestSlot = mSlotsInUse = 0;
+	mSlotWidth = mSlotHeight = 0;
+}
+
+
+bool FrameCapture::ReadBackOldest(bool wait)
+{
+	Slot& slot = mSlots[mOldestSlot];
+	UINT flags = wait ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH;
+	HRESULT hr;
+	while ((hr = gD3DContext->GetData(slot.copied, nullptr, 0, flags)) == S_FALSE)
+	{
+		if (!wait)  return false;
+		std::this_thread::yield();
+	}
+	mOldestSlot = (mOldestSlot + 1) % RING_SIZE;
+	--mSlotsInUse;
+
+	// Only copy out the pixels if the background thread has room for them
+	bool queueFull;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		queueFull = (mQueue.size() >= MAX_QUEUED_FRAMES);
+	}
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(hr) || queueFull || FAILED(gD3DContext->Map(slot.texture, 0, D3D11_MAP_READ, 0, &mapped)))
+	{
+		++mNumDropped;
+		return true;
+	}
+
+	// The effects don't keep alpha meaningful, so frames are recorded opaque
+	Frame frame = { slot.frame, static_cast<int>(mSlotWidth), static_cast<int>(mSlotHeight) };
+	frame.pixels.resize(static_cast<size_t>(frame.width) * frame.height * 4);
+	for (int y = 0; y < frame.height; ++y)
+	{
+		const uint8_t* source = static_cast<const uint8_t*>(mapped.pData) + static_cast<size_t>(y) * mapped.RowPitch;
+		uint8_t* row = frame.pixels.data() + static_cast<size_t>(y) * frame.width * 4;
+		std::memcpy(row, source, frame.width * 4);
+		for (int x = 3; x < frame.width * 4; x += 4)  row[x] = 255;
+	}
+	gD3DContext->Unmap(slot.texture, 0);
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQueue.push_back(std::move(frame));
+	}
+	mWake.notify_one();
+	return true;
+}
+
+
+void FrameCapture::EncoderThread()
+{
+	while (true)
+	{
+		Frame frame;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [this] { return mQuit || !mQueue.empty(); });
+			if (mQueue.empty())  return; // Quit, with everything written
+			frame = std::move(mQueue.front());
+			mQueue.pop_front();
+		}
+
+		if (Write(frame))  ++mNumWritten;
+		else               ++mNumDropped;
+	}
+}
+
+bool FrameCapture::Write(const Frame& frame)
+{
+	switch (mFormat)
+	{
+	case Format::Png:
+	{
+		char fileName[32];
+		std::snprintf(fileName, sizeof(fileName), "\\frame%05d.png", frame.number);
+		return WritePngFile(mDestination + fileName, frame.pixels.data(), frame.width, frame.height);
+	}
+
+	case Format::Raw:
+		mFile.write(reinterpret_cast<const char*>(frame.pixels.data()), frame.pixels.size());
+		return !mFile.fail();
+
+	case Format::Y4m:
+		if (mVideoWidth == 0)
+		{
+			// The stream header, the frame rate as a fraction
+			mVideoWidth  = frame.width;
+			mVideoHeight = frame.height;
+			int rate = static_cast<int>(std::lround(mFrameRate * 1000));
+			mFile << "YUV4MPEG2 W" << mVideoWidth << " H" << mVideoHeight << " F" << rate << ":1000 Ip A1:1 C420jpeg\n";
+		}
+		if (frame.width != mVideoWidth || frame.height != mVideoHeight)  return false; // Video can't change size
+		WriteY4m(frame);
+		return !mFile.fail();
+	}
+	return false;
+}
+
+// Convert to full range YCbCr (BT.601, as JPEG) with the chroma averaged over each 2x2 block of pixels
+void FrameCapture::WriteY4m(const Frame& frame)
+{
+	int width = frame.width, height = frame.height;
+	int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+	size_t lumaSize = static_cast<size_t>(width) * height, chromaSize = static_cast<size_t>(chromaWidth) * chromaHeight;
+	mPlanes.resize(lumaSize + 2 * chromaSize);
+	uint8_t* lumaPlane = mPlanes.data();
+	uint8_t* cbPlane   = lumaPlane + lumaSize;
+	uint8_t* crPlane   = cbPlane + chromaSize;
+
+	auto toByte = [](float value) { return static_cast<uint8_t>(std::min(std::max(value + 0.5f, 0.0f), 255.0f)); };
+
+	for (int y = 0; y < height; ++y)
+	{
+		const uint8_t* pixel = frame.pixels.data() + static_cast<size_t>(y) * width * 4;
+		for (int x = 0; x < width; ++x, pixel += 4)
+		{
+			lumaPlane[static_cast<size_t>(y) * width + x] = toByte(0.299f * pixel[0] + 0.587f * pixel[1] + 0.114f * pixel[2]);
+		}
+	}
+
+	for (int cy = 0; cy < chromaHeight; ++cy)
+	{
+		for (int cx = 0; cx < chromaWidth; ++cx)
+		{
+			float r = 0, g = 0, b = 0;
+			int count = 0;
+			for (int y = cy * 2; y < std::min(cy * 2 + 2, height); ++y)
+			{
+				for (int x = cx * 2; x < std::min(cx * 2 + 2, width); ++x)
+				{
+					const uint8_t* pixel = frame.pixels.data() + (static_cast<size_t>(y) * width + x) * 4;
+					r += pixel[0];  g += pixel[1];  b += pixel[2];
+					++count;
+				}
+			}
+			r /= count;  g /= count;  b /= count;
+			cbPlane[static_cast<size_t>(cy) * chromaWidth + cx] = toByte(128.0f - 0.168736f * r - 0.331264f * g + 0.5f * b);
+			crPlane[static_cast<size_t>(cy) * chromaWidth + cx] = toByte(128.0f + 0.5f * r - 0.418688f * g - 0.081312f * b);
+		}
+	}
+
+	mFile << "FRAME\n";
+	mFile.write(reinterpret_cast<const char*>(mPlanes.data()), mPlanes.size());
+}
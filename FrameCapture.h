@@ -0,0 +1,136 @@
+//--------------------------------------------------------------------------------------
+// Frame capture
+//--------------------------------------------------------------------------------------
+// Records the frames shown to a video file or a directory of images, without holding up the frames being recorded. Each frame is
+// copied to the next staging texture in a ring, and an event query is issued after the copy. A staging texture is only
+// mapped once its query has signalled, so the copy is finished and mapping it never waits for the GPU. The pixels are
+// then handed to a background thread that encodes and writes them. If the ring is full because the GPU is behind, or
+// the background thread has too many frames waiting, the frame is dropped rather than waited for.
+//
+// The format comes from the destination name: ".y4m" writes YUV4MPEG2 video (4:2:0, full range BT.601, playable with
+// ffmpeg / VLC), ".rgba" or ".raw" writes the RGBA pixels of each frame one after another and anything else is taken as
+// a directory for numbered PNG files. Start a capture with the R key or the -capture command line switch
+
+#ifndef _FRAME_CAPTURE_H_INCLUDED_
+#define _FRAME_CAPTURE_H_INCLUDED_
+
+#include <d3d11.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+
+class FrameCapture
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~FrameCapture();
+
+	// Start capturing to the given file or directory. frameRate is only used for the Y4M header. Returns false if a
+	// capture is already running or the destination can't be written (reason in gLastError)
+	bool Start(const std::string& destination, float frameRate);
+
+	// Stop capturing. Waits for the frames still in the ring to be read back and for the background thread to write
+	// everything it has been given
+	void Stop();
+
+	// Release the staging textures and queries, stopping any capture first
+	void Release();
+
+
+	// Copy the given texture (the back buffer, 8-bit RGBA) to the ring, and pass on any earlier frames the GPU has
+	// finished copying. Call once per frame on the render thread while capturing. Never waits for the GPU
+	void Capture(ID3D11Resource* source);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	bool        Capturing()    { return mCapturing; }
+	std::string Destination()  { return mDestination; }
+	int         NumCaptured()  { return mNumCaptured; } // Frames copied to the ring
+	int         NumWritten()   { return mNumWritten; }  // Frames written out so far
+	int         NumDropped()   { return mNumDropped; }  // Frames not recorded because the ring or queue was full
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Frames the GPU can be behind before frames are dropped, and frames waiting for the background thread
+	static const int    RING_SIZE         = 4;
+	static const size_t MAX_QUEUED_FRAMES = 30;
+
+	enum class Format { Png, Raw, Y4m };
+
+	struct Slot
+	{
+		ID3D11Texture2D* texture = nullptr;
+		ID3D11Query*     copied  = nullptr; // Signalled once the copy into the texture is done
+		int              frame   = 0;
+	};
+
+	struct Frame
+	{
+		int                  number;
+		int                  width;
+		int                  height;
+		std::vector<uint8_t> pixels; // RGBA rows with no padding
+	};
+
+	// (Re)create the ring for textures of the given size. Returns false on failure (reason in gLastError)
+	bool CreateSlots(UINT width, UINT height);
+	void ReleaseSlots();
+
+	// Map the oldest slot and queue its pixels for the background thread. Waits for the GPU first if wait is true,
+	// otherwise returns false if the copy isn't finished
+	bool ReadBackOldest(bool wait);
+
+	// Background thread loop, writes queued frames until told to quit and the queue is empty
+	void EncoderThread();
+	bool Write(const Frame& frame); // Returns false on error
+	void WriteY4m(const Frame& frame);
+
+
+	Slot mSlots[RING_SIZE];
+	int  mOldestSlot = 0; // Slots in use run from here, in the order they were copied to
+	int  mSlotsInUse = 0;
+	UINT mSlotWidth  = 0;
+	UINT mSlotHeight = 0;
+
+	bool             mCapturing = false;
+	Format           mFormat    = Format::Png;
+	std::string      mDestination;
+	float            mFrameRate = 60;
+	int              mNumCaptured = 0;
+	std::atomic<int> mNumWritten{ 0 };
+	std::atomic<int> mNumDropped{ 0 };
+
+	std::thread             mThread;
+	std::mutex              mMutex;
+	std::condition_variable mWake;         // Signalled on a new frame or quit
+	bool                    mQuit = false; // These two guarded by mMutex
+	std::deque<Frame>       mQueue;
+
+	// Only used by the background thread once started
+	std::ofstream        mFile;        // For Raw and Y4m
+	int                  mVideoWidth  = 0; // Y4M frames must all be the size of the first
+	int                  mVideoHeight = 0;
+	std::vector<uint8_t> mPlanes;      // Working space for Y4M
+};
+
+
+extern FrameCapture gFrameCapture;
+
+
+#endif //_FRAME_CAPTURE_H_INCLUDED_
@@ -0,0 +1,124 @@
+//--------------------------------------------------------------------------------------
+// Frame pipeline
+//--------------------------------------------------------------------------------------
+// See FramePipeline.h for an overview
+
+#include "FramePipeline.h"
+#include "CpuProfiler.h"
+#include "Common.h"
+
+#include <algorithm>
+#include <thread>
+
+
+FramePipeline gFramePipeline;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+bool FramePipeline::Init()
+{
+	Release();
+
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_EVENT;
+	for (auto& query : mQueries)
+	{
+		if (FAILED(gD3DDevice->CreateQuery(&queryDesc, &query)))
+		{
+			Release();
+			gLastError = "Error creating frame pipeline queries";
+			return false;
+		}
+	}
+	return true;
+}
+
+void FramePipeline::Release()
+{
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+	{
+		if (mQueries[i])  mQueries[i]->Release();
+		mQueries[i] = nullptr;
+		mQueryFrames[i] = 0;
+	}
+	mCompletedFrame = mFrame; // Nothing is waited for after a release
+}
+
+
+void FramePipeline::SetMaxFramesInFlight(int frames)
+{
+	mMaxFramesInFlight = std::max(1, std::min(frames, MAX_FRAMES_IN_FLIGHT));
+}
+
+
+// The frame MaxFramesInFlight before the new one must have finished. That is never earlier than the last frame to use
+// the new frame's slot, so its copy of each versioned resource is free as well
+void FramePipeline::BeginFrame()
+{
+	++mFrame;
+	uint64_t mustComplete = mFrame - std::min(mFrame, static_cast<uint64_t>(mMaxFramesInFlight));
+
+	int64_t start = CpuProfiler::Now();
+	Poll();
+	if (mCompletedFrame < mustComplete)
+	{
+		CPU_PROFILE_SCOPE("Wait for GPU");
+		gD3DContext->Flush(); // The frame may still be waiting to be sent
+		while (mCompletedFrame < mustComplete && Poll())
+		{
+			std::this_thread::yield();
+		}
+	}
+	mStallMilliseconds = static_cast<float>(CpuProfiler::Now() - start) * 1000.0f / CpuProfiler::Frequency();
+	mAverageStallMilliseconds += (mStallMilliseconds - mAverageStallMilliseconds) * 0.05f;
+}
+
+void FramePipeline::EndFrame()
+{
+	unsigned int slot = Slot();
+	if (mQueries[slot] == nullptr)
+	{
+		mCompletedFrame = mFrame; // No queries, the frames can't be followed so nothing waits for them
+		return;
+	}
+	gD3DContext->End(mQueries[slot]);
+	mQueryFrames[slot] = mFrame;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Data access
+//--------------------------------------------------------------------------------------
+
+bool FramePipeline::Completed(uint64_t frame)
+{
+	if (frame > mCompletedFrame)  Poll();
+	return frame <= mCompletedFrame;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+// The GPU finishes frames in order, so the latest frame with a signalled query has all the ones before it finished too.
+// A query that fails (e.g. the device was removed) counts as finished, rather than waiting for it forever
+bool FramePipeline::Poll()
+{
+	bool pending = false;
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+	{
+		if (mQueryFrames[i] == 0)  continue;
+		if (gD3DContext->GetData(mQueries[i], nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_FALSE)
+		{
+			pending = true;
+			continue;
+		}
+		mCompletedFrame = std::max(mCompletedFrame, mQueryFrames[i]);
+		mQueryFrames[i] = 0;
+	}
+	return pending;
+}
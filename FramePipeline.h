@@ -0,0 +1,98 @@
+//--------------------------------------------------------------------------------------
+// Frame pipeline
+//--------------------------------------------------------------------------------------
+// The CPU records frames while the GPU is still drawing earlier ones. The further ahead it runs, the more work the GPU
+// has queued (throughput) and the longer each frame takes to reach the screen (latency). Left alone the driver queues
+// up to three frames, and every buffer written each frame is renamed with WRITE_DISCARD because the CPU never knows
+// which frames the GPU has finished.
+//
+// The pipeline makes this explicit. An event query is ended after each frame is presented, and BeginFrame waits until
+// the frame MaxFramesInFlight before the new one has finished on the GPU. So at most that many frames are ever queued:
+// 1 for the lowest latency, 3 for the most overlap. The time BeginFrame waits is the CPU's stall on the GPU, shown in
+// the F2 report and recorded by the benchmark.
+//
+// Knowing which frames are finished lets the resources written each frame be versioned. They have MAX_FRAMES_IN_FLIGHT
+// copies, and a frame writes copy Slot(), which the GPU has finished reading by the time BeginFrame returns, so it can
+// be written with WRITE_NO_OVERWRITE. The immediate context's constant buffer ring (see ConstantBufferRing.h) and
+// instance buffer ring (see InstanceBufferRing.h), and the GPU culler's readback of its visible counts, are versioned
+// like this. There are always MAX_FRAMES_IN_FLIGHT copies, so the limit can be changed while running
+
+#ifndef _FRAME_PIPELINE_H_INCLUDED_
+#define _FRAME_PIPELINE_H_INCLUDED_
+
+#include <d3d11.h>
+#include <cstdint>
+
+
+// Most frames the CPU may record ahead of the GPU, and the copies of each versioned resource
+const int MAX_FRAMES_IN_FLIGHT = 3;
+
+
+class FramePipeline
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~FramePipeline()  { Release(); }
+
+	// Create the queries, after InitDirect3D. Returns false on failure (reason in gLastError), frames are then queued as
+	// the driver chooses and Completed only knows about frames the GPU has been asked about
+	bool Init();
+	void Release();
+
+	// Frames the CPU may be ahead of the GPU, 1 to MAX_FRAMES_IN_FLIGHT
+	void SetMaxFramesInFlight(int frames);
+
+	// Wait until there are fewer than MaxFramesInFlight frames queued, then start a new frame. Main thread, before
+	// anything of the frame is written to the GPU
+	void BeginFrame();
+
+	// Mark the end of the frame's GPU work, just after it is presented
+	void EndFrame();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	int MaxFramesInFlight()  { return mMaxFramesInFlight; }
+
+	// The current frame, counted from 1, and which copy of the versioned resources it writes
+	uint64_t     Frame()  { return mFrame; }
+	unsigned int Slot()   { return static_cast<unsigned int>(mFrame % MAX_FRAMES_IN_FLIGHT); }
+
+	// Whether the GPU has finished the given frame. Doesn't wait or flush
+	bool Completed(uint64_t frame);
+
+	// Time the last BeginFrame waited for the GPU, and the average over recent frames, in milliseconds
+	float StallMilliseconds()         { return mStallMilliseconds; }
+	float AverageStallMilliseconds()  { return mAverageStallMilliseconds; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Find which of the frames in flight have finished, without waiting. Returns whether any are still to finish, a
+	// frame that never reached EndFrame has no query and is only known to be finished once a later one is
+	bool Poll();
+
+	// One query for each frame in flight, ended after the frame of the same slot
+	ID3D11Query* mQueries[MAX_FRAMES_IN_FLIGHT] = {};
+	uint64_t     mQueryFrames[MAX_FRAMES_IN_FLIGHT] = {}; // Frame each query was ended after, 0 if none pending
+
+	int      mMaxFramesInFlight = MAX_FRAMES_IN_FLIGHT;
+	uint64_t mFrame = 0;
+	uint64_t mCompletedFrame = 0; // Every frame up to and including this one has finished on the GPU
+
+	float mStallMilliseconds = 0;
+	float mAverageStallMilliseconds = 0;
+};
+
+
+extern FramePipeline gFramePipeline;
+
+
+#endif //_FRAME_PIPELINE_H_INCLUDED_
@@ -1,10 +1,17 @@
 //--------------------------------------------------------------------------------------
 // Full Screen Post-Processing Vertex Shader
 //--------------------------------------------------------------------------------------
-// Vertex shader generates a full screen quad so the pixel shader can copy/process the scene texture to it
+// Vertex shader generates a single triangle covering the screen so the pixel shader can copy/process the scene texture to it.
+// PASS_UV_TRANSFORM 1 scales and offsets the uvs by gPassUVScale / gPassUVOffset from the post-processing constants, so a
+// pass can read part of its inputs (see PostProcessGraph::Execute). The build compiles the version with it off, which reads
+// no constants at all and so can be used outside the post-processing too, where b1 holds the per-model constants
 
 #include "Common.hlsli" // Shaders can also use include files - note the extension
 
+#ifndef PASS_UV_TRANSFORM
+#define PASS_UV_TRANSFORM 0
+#endif
+
 
 //--------------------------------------------------------------------------------------
 // Shader code
@@ -12,27 +19,30 @@
 
 // This rather unusual vertex shader generates its own vertices rather than reading them from a buffer.
 // The only input data is a special value, the "vertex ID". This is an automatically generated increasing index starting at 0.
-// It uses this index to create 4 points of a full screen quad (coordinates -1 to 1), it also generates texture
-// coordinates because the post-processing will sample a texture containing a picture of the scene.
+// It uses this index to create the 3 points of a triangle twice the size of the screen (coordinates -1 to 3), it also
+// generates texture coordinates because the post-processing will sample a texture containing a picture of the scene.
+// The part outside the screen is clipped away for free. A quad made of two triangles would shade the 2x2 pixel blocks
+// along its diagonal twice, once for each triangle.
 // No vertex or index buffer is required, which makes the C++ side simpler
 PostProcessingInput main(uint vertexId : SV_VertexID)
 {
 	PostProcessingInput output; // Defined in Common.hlsi
 
-	// Four corners of the screen in "projection space". X and Y coordinates are -1 to 1. (Z and W are for the depth buffer, not relevant here)
-	const float4 QuadPositions[4] = { float4(-1.0, 1.0, 0.0, 1.0),
-						              float4(-1.0,-1.0, 0.0, 1.0),
-						              float4( 1.0, 1.0, 0.0, 1.0),
-						              float4( 1.0,-1.0, 0.0, 1.0) };
-	// Four corners of the screen as texture coordinates - so we can access the texture showing the scene in the pixel shader that follows
-	const float2 QuadUVs[4] = { float2(0.0, 0.0),
-						        float2(0.0, 1.0),
-						        float2(1.0, 0.0),
-						        float2(1.0, 1.0) };
+	// Corners of the triangle in "projection space". The screen is X and Y coordinates -1 to 1. (Z and W are for the depth buffer, not relevant here)
+	const float4 TrianglePositions[3] = { float4(-1.0, 1.0, 0.0, 1.0),
+	                                      float4( 3.0, 1.0, 0.0, 1.0),
+	                                      float4(-1.0,-3.0, 0.0, 1.0) };
+	// Corners of the triangle as texture coordinates, 0 to 1 across the screen - so we can access the texture showing the scene in the pixel shader that follows
+	const float2 TriangleUVs[3] = { float2(0.0, 0.0),
+	                                float2(2.0, 0.0),
+	                                float2(0.0, 2.0) };
 
 	// Just look up the above arrays with the vertex ID
-	output.projectedPosition = QuadPositions[vertexId];
-	output.uv = QuadUVs[vertexId];
+	output.projectedPosition = TrianglePositions[vertexId];
+	output.uv = TriangleUVs[vertexId];
+#if PASS_UV_TRANSFORM
+	output.uv = output.uv * gPassUVScale + gPassUVOffset;
+#endif
 
 	return output;
 }
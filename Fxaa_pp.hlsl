@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// FXAA Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Fast approximate anti-aliasing (Lottes). The brightness of the four corners around the pixel gives the direction
+// along any edge through it, then the image is blurred along that direction with bilinear taps. Pixels with little
+// contrast are left as they are, and the wider blur is only kept if it doesn't bring in a brightness from outside the
+// corners (it would have crossed another edge)
+
+#include "Antialiasing.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    SceneTexture   : register(t0);
+SamplerState PointSample    : register(s0);
+SamplerState BilinearSample : register(s1);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+static const float EDGE_THRESHOLD     = 0.125f;   // Least contrast blurred, relative to the brightest corner
+static const float EDGE_THRESHOLD_MIN = 0.0312f;  // And in absolute terms, so dark areas aren't blurred for their noise
+static const float REDUCE_MUL         = 1.0f / 8; // Shortens the blur along soft edges
+static const float REDUCE_MIN         = 1.0f / 128;
+static const float SPAN_MAX           = 8;        // Longest blur in pixels
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	float3 colour = SceneTexture.Sample(PointSample, input.uv).rgb;
+
+	// Corners sampled half a pixel away each read the average of four pixels
+	float2 halfTexel = 0.5f * gTexelSize;
+	float lumaNW = Luma(SceneTexture.Sample(BilinearSample, input.uv + float2(-halfTexel.x, -halfTexel.y)).rgb);
+	float lumaNE = Luma(SceneTexture.Sample(BilinearSample, input.uv + float2( halfTexel.x, -halfTexel.y)).rgb);
+	float lumaSW = Luma(SceneTexture.Sample(BilinearSample, input.uv + float2(-halfTexel.x,  halfTexel.y)).rgb);
+	float lumaSE = Luma(SceneTexture.Sample(BilinearSample, input.uv + float2( halfTexel.x,  halfTexel.y)).rgb);
+	float lumaM  = Luma(colour);
+
+	float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+	float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+	if (lumaMax - lumaMin < max(EDGE_THRESHOLD_MIN, lumaMax * EDGE_THRESHOLD))  return float4(colour, 1.0f);
+
+	// Along the edge, at right angles to the brightness gradient
+	float2 direction;
+	direction.x = -((lumaNW + lumaNE) - (lumaSW + lumaSE));
+	direction.y =  ((lumaNW + lumaSW) - (lumaNE + lumaSE));
+	float directionReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25f * REDUCE_MUL, REDUCE_MIN);
+	float scale = 1.0f / (min(abs(direction.x), abs(direction.y)) + directionReduce);
+	direction = clamp(direction * scale, -SPAN_MAX, SPAN_MAX) * gTexelSize;
+
+	float3 colourA = 0.5f * (SceneTexture.Sample(BilinearSample, input.uv + direction * (1.0f / 3 - 0.5f)).rgb +
+	                         SceneTexture.Sample(BilinearSample, input.uv + direction * (2.0f / 3 - 0.5f)).rgb);
+	float3 colourB = 0.5f * colourA + 0.25f * (SceneTexture.Sample(BilinearSample, input.uv - direction * 0.5f).rgb +
+	                                           SceneTexture.Sample(BilinearSample, input.uv + direction * 0.5f).rgb);
+	float lumaB = Luma(colourB);
+	return float4((lumaB < lumaMin || lumaB > lumaMax) ? colourA : colourB, 1.0f);
+}
@@ -0,0 +1,28 @@
+//--------------------------------------------------------------------------------------
+// Include file for the G-buffer used by deferred shading
+//--------------------------------------------------------------------------------------
+// Deferred shading first writes the surface of each pixel into a thin G-buffer, then lights every pixel once in a
+// separate pass. The G-buffer holds:
+//   target 0 (R8G8B8A8_UNORM): diffuse material colour in rgb and specular material colour in a
+//   target 1 (R16G16_SNORM):   world normal, octahedral encoded
+// The world position is rebuilt from the depth buffer, so it isn't stored
+
+#include "Common.hlsli"
+
+
+// Octahedral normal encoding - fold the unit sphere onto an octahedron then flatten that to a square, giving two values
+// in the range -1 to 1 with much more even precision than storing just x and y
+float2 EncodeNormal(float3 normal)
+{
+    normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+    float2 encoded = normal.xy;
+    if (normal.z < 0)  encoded = (1 - abs(normal.yx)) * (encoded >= 0 ? 1 : -1);
+    return encoded;
+}
+
+float3 DecodeNormal(float2 encoded)
+{
+    float3 normal = float3(encoded, 1 - abs(encoded.x) - abs(encoded.y));
+    if (normal.z < 0)  normal.xy = (1 - abs(normal.yx)) * (normal.xy >= 0 ? 1 : -1);
+    return normalize(normal);
+}
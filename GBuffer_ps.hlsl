@@ -0,0 +1,47 @@
+//--------------------------------------------------------------------------------------
+// G-Buffer Pixel Shader
+//--------------------------------------------------------------------------------------
+// Geometry pass of deferred shading. Receives the same input as the per-pixel lighting shader but only stores the
+// material colours and normal of the surface in the G-buffer (see GBuffer.hlsli), DeferredLighting_ps lights it later.
+// MATERIAL_ARRAY selects a material array texture as for PixelLighting_ps
+
+#include "GBuffer.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+#if MATERIAL_ARRAY
+Texture2DArray DiffuseSpecularMap : register(t0);
+#else
+Texture2D DiffuseSpecularMap : register(t0); // Diffuse map in rgb and specular map in a, as for PixelLighting_ps
+#endif
+SamplerState TexSampler      : register(s0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+struct GBufferOutput
+{
+    float4 material : SV_Target0;
+    float2 normal   : SV_Target1;
+};
+
+#if MATERIAL_ARRAY
+GBufferOutput main(InstancedLightingPixelShaderInput input)
+#else
+GBufferOutput main(LightingPixelShaderInput input)
+#endif
+{
+    GBufferOutput output;
+#if MATERIAL_ARRAY
+    output.material = DiffuseSpecularMap.Sample(TexSampler, float3(input.uv, input.textureSlice));
+#else
+    output.material = DiffuseSpecularMap.Sample(TexSampler, input.uv);
+#endif
+    output.normal   = EncodeNormal(normalize(input.worldNormal));
+    return output;
+}
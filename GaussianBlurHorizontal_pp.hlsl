@@ -7,71 +7,33 @@
 
 // The scene has been rendered to a texture, these variables allow access to that texture
 Texture2D SceneTexture : register(t0);
-SamplerState PointSample : register(s0); // We don't usually want to filter (bilinear, trilinear etc.) the scene texture when
-                                          // post-processing so this sampler will use "point sampling" - no filtering
+SamplerState BilinearSample : register(s1); // The blur kernel merges pairs of neighbouring pixels into a single tap placed
+                                            // between them, so this sampler uses bilinear filtering to blend the pair
 
 
 //--------------------------------------------------------------------------------------
 // Shader code
 //--------------------------------------------------------------------------------------
 
-
-// See this desmos graph i made to test this function
+// The Gaussian weights are built on the CPU when the blur settings change (see UpdateBlurKernel in Scene.cpp)
+// See this desmos graph i made to test the curve
 // https://www.desmos.com/calculator/p1s5w5wkjc
-float gaussianCurve(float x)
-{
-	//eulers number
-	const float e = 2.71828182846;
-	const float pi = 3.142f;
-	// standard deviation
-	float c = blurBellcurveStrength;
-	
-	float cSquared = c * c;
-	
-	return (1 / sqrt(2 * pi * cSquared)) * pow(e, -(x * x) / 2 * cSquared);
-
-}
-
-
-
-// Post-processing shader that tints the scene texture to a given colour
+// HALF_PRECISION 1 sums the taps in min16float (see Common.hlsli)
 float4 main(PostProcessingInput input) : SV_Target
 {
-	float width;
-	float height;
-	SceneTexture.GetDimensions(width, height);
-	
-	float w = 1 / width; // width of each pixel, in UV units
-	float h = 1 / height; // height of each pixel, in UV units
-	
-	
+	float w = gTexelSize.x; // width of each pixel, in UV units
+	float h = gTexelSize.y; // height of each pixel, in UV units
 	
-	float3 colour = 0;  //SceneTexture.Sample(PointSample, input.uv).rgb;
 	
-	//int i = 0;
-	//for (int x = -blurRadius; x <= blurRadius; x++)
-	//{
-	//	float2 pos = input.uv + float2(w * x, 0);
-	//	float multiplier = gaussianCurveTest(x);
-	//	colour += (SceneTexture.Sample(PointSample, pos).rgb * multiplier);
-	//	i += multiplier;
-	//}
-	//colour /= i;
-	
-	int m = 0;
-	double half_size = (blurRadius - 1) / 2.0;
-	for (int i = 0; i < blurRadius; ++i)
+	// Centre pixel, then one bilinear tap either side for each merged pair of pixels. Weights already add up to 1
+	pfloat3 colour = pfloat3(SceneTexture.Sample(BilinearSample, input.uv).rgb) * pfloat(gBlurTaps[0].y);
+	for (int i = 1; i < gBlurTapCount; ++i)
 	{
-		double x = i - half_size;
-		float2 pos = input.uv + float2(w * x, 0);
-		float multiplier = gaussianCurve(x);
-		colour += (SceneTexture.Sample(PointSample, pos).rgb * multiplier);
-		m += multiplier;
-
+		float2 offset = float2(w * gBlurTaps[i].x, 0);
+		colour += (pfloat3(SceneTexture.Sample(BilinearSample, input.uv + offset).rgb) +
+		           pfloat3(SceneTexture.Sample(BilinearSample, input.uv - offset).rgb)) * pfloat(gBlurTaps[i].y);
 	}
-	colour /= m;
-	
 	
 	
 	return float4(colour, 1.0f);
-}
\ No newline at end of file
+}
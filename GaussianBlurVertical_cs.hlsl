@@ -0,0 +1,59 @@
+//--------------------------------------------------------------------------------------
+// Vertical Gaussian Blur Post-Processing Compute Shader
+//--------------------------------------------------------------------------------------
+// Same blur as GaussianBlurVertical_pp, but each thread group first loads a column of pixels plus the
+// extra pixels either side needed by the blur (the "apron") into groupshared memory. Every pixel is then
+// read from the texture once per group rather than once per tap, which matters for wide blurs. HALF_PRECISION 1 sums
+// the taps in min16float (see Common.hlsli), the tile is kept at full precision as groupshared memory has no 16-bit form
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D          SceneTexture : register(t0);
+RWTexture2D<float4> OutputTexture : register(u0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Threads per group (pixels per column of the tile), must match BLUR_GROUP_SIZE in Scene.cpp. The largest
+// blur half-width, MAX_BLUR_RADIUS, is in Common.hlsli
+#define GROUP_SIZE 256
+
+groupshared float3 Tile[GROUP_SIZE + 2 * MAX_BLUR_RADIUS];
+
+
+[numthreads(1, GROUP_SIZE, 1)]
+void main(uint3 groupID : SV_GroupID, uint3 threadID : SV_GroupThreadID, uint3 pixel : SV_DispatchThreadID)
+{
+	uint width, height;
+	SceneTexture.GetDimensions(width, height);
+
+	int radius = gBlurRadius; // Already clamped to MAX_BLUR_RADIUS on the CPU
+
+	// Load the tile and its apron - clamp at the edges of the texture like the clamped sampler in the pixel shader
+	int tileStart = (int)(groupID.y * GROUP_SIZE) - radius;
+	for (int i = threadID.y; i < GROUP_SIZE + 2 * radius; i += GROUP_SIZE)
+	{
+		int y = clamp(tileStart + i, 0, (int)height - 1);
+		Tile[i] = SceneTexture.Load(int3(pixel.x, y, 0)).rgb;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	if (pixel.x >= width || pixel.y >= height)  return;
+
+	// Convolve from groupshared memory. The weights from the CPU already add up to 1
+	pfloat3 colour = 0;
+	for (int offset = -radius; offset <= radius; ++offset)
+	{
+		pfloat weight = pfloat(gBlurWeights[abs(offset)].y);
+		colour += pfloat3(Tile[threadID.y + radius + offset]) * weight;
+	}
+
+	OutputTexture[pixel.xy] = float4(colour, 1.0f);
+}
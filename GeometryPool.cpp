@@ -0,0 +1,164 @@
+//--------------------------------------------------------------------------------------
+// Geometry pool
+//--------------------------------------------------------------------------------------
+
+#include "GeometryPool.h"
+#include "ResourceRegistry.h"
+#include "Common.h"
+
+#include <algorithm>
+
+
+GeometryPool gGeometryPool;
+
+
+GeometryPool::~GeometryPool()
+{
+	ReleaseAll();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Usage
+//--------------------------------------------------------------------------------------
+
+bool GeometryPool::Allocate(UINT bindFlags, unsigned int elementSize, unsigned int count, const void* data, GeometryRange& range)
+{
+	if (elementSize == 0 || count == 0)  return false;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// Use the first page of the right kind with a large enough gap, otherwise start a new page
+	int pageIndex = -1;
+	unsigned int first = 0;
+	for (unsigned int p = 0; p < mPages.size(); ++p)
+	{
+		Page& page = mPages[p];
+		if (page.bindFlags == bindFlags && page.elementSize == elementSize && TakeRange(page, count, first))
+		{
+			pageIndex = static_cast<int>(p);
+			break;
+		}
+	}
+	if (pageIndex < 0)
+	{
+		pageIndex = CreatePage(bindFlags, elementSize, count);
+		if (pageIndex < 0 || !TakeRange(mPages[pageIndex], count, first))  return false;
+	}
+
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	mUploads.push_back({ pageIndex, first, std::vector<unsigned char>(bytes, bytes + count * elementSize) });
+	mAllocatedBytes += count * elementSize;
+
+	range.buffer = mPages[pageIndex].buffer;
+	range.first  = first;
+	range.count  = count;
+	range.page   = pageIndex;
+	return true;
+}
+
+
+void GeometryPool::Free(GeometryRange& range)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// Ignore ranges from buffers that have already been released
+	if (range.page < 0 || range.page >= static_cast<int>(mPages.size()) || mPages[range.page].buffer != range.buffer)  return;
+	Page& page = mPages[range.page];
+
+	// Drop any upload that hasn't happened yet
+	mUploads.erase(std::remove_if(mUploads.begin(), mUploads.end(), [&range](const Upload& upload)
+	{
+		return upload.page == range.page && upload.first == range.first;
+	}), mUploads.end());
+
+	// Put the range back in the free list, merging with the gaps either side
+	auto next = std::lower_bound(page.freeRanges.begin(), page.freeRanges.end(), range.first,
+	                             [](const FreeRange& freeRange, unsigned int first) { return freeRange.first < first; });
+	next = page.freeRanges.insert(next, { range.first, range.count });
+	if (next + 1 != page.freeRanges.end() && next->first + next->count == (next + 1)->first)
+	{
+		next->count += (next + 1)->count;
+		page.freeRanges.erase(next + 1);
+	}
+	if (next != page.freeRanges.begin() && (next - 1)->first + (next - 1)->count == next->first)
+	{
+		(next - 1)->count += next->count;
+		page.freeRanges.erase(next);
+	}
+
+	mAllocatedBytes -= range.count * page.elementSize;
+	range = GeometryRange();
+}
+
+
+void GeometryPool::Flush()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (auto& upload : mUploads)
+	{
+		const Page& page = mPages[upload.page];
+		D3D11_BOX box = { upload.first * page.elementSize, 0, 0,
+		                  upload.first * page.elementSize + static_cast<UINT>(upload.data.size()), 1, 1 };
+		gD3DContext->UpdateSubresource(page.buffer, 0, &box, upload.data.data(), 0, 0);
+	}
+	mUploads.clear();
+}
+
+
+void GeometryPool::ReleaseAll()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (auto& page : mPages)
+	{
+		page.buffer->Release();
+	}
+	mPages.clear();
+	mUploads.clear();
+	mAllocatedBytes = 0;
+	mTotalBytes = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+// First fit - meshes are mostly loaded once at start-up so fragmentation isn't a concern
+bool GeometryPool::TakeRange(Page& page, unsigned int count, unsigned int& first)
+{
+	for (auto freeRange = page.freeRanges.begin(); freeRange != page.freeRanges.end(); ++freeRange)
+	{
+		if (freeRange->count >= count)
+		{
+			first = freeRange->first;
+			freeRange->first += count;
+			freeRange->count -= count;
+			if (freeRange->count == 0)  page.freeRanges.erase(freeRange);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+int GeometryPool::CreatePage(UINT bindFlags, unsigned int elementSize, unsigned int count)
+{
+	unsigned int numElements = std::max(PAGE_BYTES / elementSize, count);
+
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = bindFlags;
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT; // Filled with UpdateSubresource in Flush
+	bufferDesc.ByteWidth = numElements * elementSize;
+	bufferDesc.CPUAccessFlags = 0;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = 0;
+
+	ID3D11Buffer* buffer;
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &buffer)))  return -1;
+	gResourceRegistry.Track(buffer);
+
+	mPages.push_back({ buffer, bindFlags, elementSize, numElements, { { 0, numElements } } });
+	mTotalBytes += bufferDesc.ByteWidth;
+	return static_cast<int>(mPages.size()) - 1;
+}
@@ -0,0 +1,123 @@
+//--------------------------------------------------------------------------------------
+// Geometry pool
+//--------------------------------------------------------------------------------------
+// Holds the vertex and index data of many meshes in a few large GPU buffers rather than a pair of buffers for each
+// sub-mesh. A sub-mesh gets a range of a shared buffer and draws with the start of that range as the base vertex and
+// start index of DrawIndexed. Sub-meshes placed in the same buffers then don't change the input assembler state from
+// one draw to the next, so the state cache drops the IASetVertexBuffers / IASetIndexBuffer calls between them.
+// Vertex data is shared between sub-meshes with the same vertex size, index data between those with the same index
+// format. Freed ranges are reused by later allocations
+//
+// Allocate only uses the device and can be called on any thread (meshes are created on worker threads), so the data
+// is not copied to the GPU straight away. Flush must be called on the main thread to upload it before the geometry is
+// drawn - it is called after loading and at the start of each frame
+
+#ifndef _GEOMETRY_POOL_H_INCLUDED_
+#define _GEOMETRY_POOL_H_INCLUDED_
+
+#include <d3d11.h>
+#include <mutex>
+#include <vector>
+
+
+// A range of elements (vertices or indices) in one of the pool's buffers. The buffer is owned by the pool
+struct GeometryRange
+{
+	ID3D11Buffer* buffer = nullptr;
+	unsigned int  first  = 0; // Index of the first element in the buffer
+	unsigned int  count  = 0;
+	int           page   = -1;
+};
+
+
+class GeometryPool
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~GeometryPool();
+
+	// Meshes only use the pool when it is enabled, otherwise each sub-mesh creates its own buffers. Change before loading meshes
+	void SetEnabled(bool enabled)  { mEnabled = enabled; }
+
+	// Get a range of a vertex or index buffer (bindFlags is D3D11_BIND_VERTEX_BUFFER or D3D11_BIND_INDEX_BUFFER) for the given
+	// number of elements of the given size, and queue up the data to copy into it (copied now, so it can be freed on return).
+	// Returns false on failure. Safe to call from any thread
+	bool Allocate(UINT bindFlags, unsigned int elementSize, unsigned int count, const void* data, GeometryRange& range);
+
+	// Return a range to the pool. Safe to call from any thread
+	void Free(GeometryRange& range);
+
+	// Copy the data of new allocations to the GPU. Call on the main thread (uses the immediate context)
+	void Flush();
+
+	// Release all the buffers. Any ranges still allocated are no longer valid
+	void ReleaseAll();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	bool Enabled()  { return mEnabled; }
+
+	// Statistics - the number of buffers and the bytes allocated / held in them
+	int    NumBuffers()     { std::lock_guard<std::mutex> lock(mMutex);  return static_cast<int>(mPages.size()); }
+	size_t AllocatedBytes() { std::lock_guard<std::mutex> lock(mMutex);  return mAllocatedBytes; }
+	size_t TotalBytes()     { std::lock_guard<std::mutex> lock(mMutex);  return mTotalBytes; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Size of each new buffer. Allocations larger than this get a buffer to themselves
+	static const unsigned int PAGE_BYTES = 8 * 1024 * 1024;
+
+	struct FreeRange
+	{
+		unsigned int first;
+		unsigned int count;
+	};
+
+	struct Page
+	{
+		ID3D11Buffer*          buffer;
+		UINT                   bindFlags;
+		unsigned int           elementSize;
+		unsigned int           numElements;
+		std::vector<FreeRange> freeRanges; // Sorted by first element, neighbouring ranges are always merged
+	};
+
+	// Data waiting to be copied into a range by Flush
+	struct Upload
+	{
+		int                        page;
+		unsigned int               first;
+		std::vector<unsigned char> data;
+	};
+
+	// Take a range from the free list of a page, returns false if there is no large enough gap
+	bool TakeRange(Page& page, unsigned int count, unsigned int& first);
+
+	// Create a new page big enough for the given number of elements, returns its index or -1 on failure
+	int CreatePage(UINT bindFlags, unsigned int elementSize, unsigned int count);
+
+
+	std::mutex          mMutex; // Guards everything other than mEnabled
+	std::vector<Page>   mPages;
+	std::vector<Upload> mUploads;
+
+	size_t mAllocatedBytes = 0;
+	size_t mTotalBytes     = 0;
+
+	bool mEnabled = false;
+};
+
+
+extern GeometryPool gGeometryPool;
+
+
+#endif //_GEOMETRY_POOL_H_INCLUDED_
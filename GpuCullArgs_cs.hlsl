@@ -0,0 +1,46 @@
+//--------------------------------------------------------------------------------------
+// GPU Culling Arguments Compute Shader
+//--------------------------------------------------------------------------------------
+// Writes the arguments of each indirect draw once GpuCull_cs has counted the visible instances (see GpuCuller.h), one
+// thread per draw. The CPU lists the draws with the index of their count in place of the instance count
+
+#include "GpuCulling.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------------
+
+// Must match DrawIndexedArguments in Common.h
+struct DrawRecord
+{
+    uint indexCount;
+    uint countIndex; // Replaced by the count
+    uint startIndex;
+    int  baseVertex;
+    uint startInstance;
+};
+
+StructuredBuffer<DrawRecord> DrawRecords   : register(t0);
+StructuredBuffer<uint>       VisibleCounts : register(t1);
+
+RWBuffer<uint> DrawArguments : register(u0); // Five for each draw
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+[numthreads(GPU_CULL_GROUP_SIZE, 1, 1)]
+void main(uint3 dispatchID : SV_DispatchThreadID)
+{
+    if (dispatchID.x >= gNumDrawRecords)  return;
+    DrawRecord record = DrawRecords[dispatchID.x];
+
+    uint first = dispatchID.x * 5;
+    DrawArguments[first + 0] = record.indexCount;
+    DrawArguments[first + 1] = VisibleCounts[record.countIndex];
+    DrawArguments[first + 2] = record.startIndex;
+    DrawArguments[first + 3] = asuint(record.baseVertex);
+    DrawArguments[first + 4] = record.startInstance;
+}
@@ -0,0 +1,99 @@
+//--------------------------------------------------------------------------------------
+// GPU Culling Compute Shader
+//--------------------------------------------------------------------------------------
+// Culls the GPU-driven instances (see GpuCuller.h), one thread per instance. Each instance's bounding sphere is tested
+// against the frustum, then against the hierarchical-Z pyramid of last frame's depth. A visible instance chooses its level
+// of detail as Model::SelectLod does and is added to its group's list for that level, counting the instances the
+// indirect draws of the level will draw
+
+#include "GpuCulling.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Buffers
+//--------------------------------------------------------------------------------------
+
+StructuredBuffer<GpuCullInstance> Instances : register(t0);
+StructuredBuffer<GpuCullGroup>    Groups    : register(t1);
+Texture2D<float>                  HiZ       : register(t2); // Furthest depth, see HiZ_cs
+
+RWStructuredBuffer<uint> VisibleInstances : register(u0); // Index of each visible instance's first InstanceData
+RWStructuredBuffer<uint> VisibleCounts    : register(u1); // For each group and level of detail
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Whether a sphere is wholly behind the depth last frame. The box around it is projected with last frame's camera and
+// its nearest depth compared with the furthest of the pyramid texels covering it, from the level where that is at most
+// two by two texels
+bool HiZOccluded(float3 centre, float radius)
+{
+    if (gHiZLevels == 0)  return false;
+
+    float2 minUV = 1;
+    float2 maxUV = 0;
+    float  nearest = 1;
+    for (uint corner = 0; corner < 8; ++corner)
+    {
+        float3 offset = float3((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius, (corner & 4) ? radius : -radius);
+        float4 projected = mul(gHiZViewProjection, float4(centre + offset, 1));
+        if (projected.w <= 0)  return false; // Reaches behind the camera
+
+        float3 ndc = projected.xyz / projected.w;
+        float2 uv = float2(ndc.x * 0.5f + 0.5f, 0.5f - ndc.y * 0.5f);
+        minUV = min(minUV, uv);
+        maxUV = max(maxUV, uv);
+        nearest = min(nearest, ndc.z);
+    }
+    if (nearest <= 0 || any(maxUV < 0) || any(minUV > 1))  return false; // Wasn't in view last frame, so no depth for it
+    minUV = saturate(minUV);
+    maxUV = saturate(maxUV);
+
+    float2 minTexel = minUV * gHiZUVScale * gHiZSize;
+    float2 maxTexel = maxUV * gHiZUVScale * gHiZSize;
+    float2 size = maxTexel - minTexel;
+    uint level = min(gHiZLevels - 1, (uint)max(0, ceil(log2(max(max(size.x, size.y), 1)))));
+
+    uint2 levelSize = max(uint2(gHiZSize) >> level, 1);
+    uint2 first = min(uint2(minTexel) >> level, levelSize - 1);
+    uint2 last  = min(uint2(maxTexel) >> level, levelSize - 1);
+    float furthest = 0;
+    for (uint y = first.y; y <= last.y && y <= first.y + 1; ++y)
+    {
+        for (uint x = first.x; x <= last.x && x <= first.x + 1; ++x)
+        {
+            furthest = max(furthest, HiZ.Load(int3(x, y, level)));
+        }
+    }
+    return nearest > furthest;
+}
+
+
+[numthreads(GPU_CULL_GROUP_SIZE, 1, 1)]
+void main(uint3 dispatchID : SV_DispatchThreadID)
+{
+    if (dispatchID.x >= gNumCullInstances)  return;
+    GpuCullInstance instance = Instances[dispatchID.x];
+
+    for (int p = 0; p < 6; ++p)
+    {
+        if (dot(gCullPlanes[p].xyz, instance.centre) + gCullPlanes[p].w < -instance.radius)  return;
+    }
+    if (HiZOccluded(instance.centre, instance.radius))  return;
+
+    // Distance to the nearest point of the sphere, so large models close to the camera keep full detail
+    GpuCullGroup group = Groups[instance.group];
+    uint lod = 0;
+    float distance = length(instance.centre - gCullViewPoint) - instance.radius;
+    if (distance > 0)
+    {
+        float pixelsPerError = instance.maxScale * gCullPixelsPerUnit / distance;
+        while (lod + 1 < group.numLods && group.lodErrors[lod + 1] * pixelsPerError <= gMaxLodPixelError)  ++lod;
+    }
+
+    uint slot;
+    InterlockedAdd(VisibleCounts[group.firstCount + lod], 1, slot);
+    VisibleInstances[group.firstVisible + lod * group.numModels + slot] = instance.firstData;
+}
@@ -0,0 +1,470 @@
+//--------------------------------------------------------------------------------------
+// GPU-driven culling
+//--------------------------------------------------------------------------------------
+// See GpuCuller.h for an overview
+
+#include "GpuCuller.h"
+#include "Model.h"
+#include "Mesh.h"
+#include "Shader.h"
+#include "StateCache.h"
+#include "ResourceRegistry.h"
+#include "CpuProfiler.h"
+#include "GraphicsHelpers.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+GpuCuller gGpuCuller;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+void GpuCuller::BeginFrame()
+{
+	++mFrame;
+	mCulled = false;
+	mGroups.clear();
+	mDraws.clear();
+	mInstanceData.clear();
+	mCullInstances.clear();
+	mGroupData.clear();
+	mDrawRecords.clear();
+	mDrawConstants.clear();
+	mNumVisibleSlots = 0;
+	mNumCounts = 0;
+}
+
+
+unsigned int GpuCuller::AddGroup(Model* const models[], const CVector3 colours[], const unsigned int textureSlices[],
+                                 unsigned int numModels)
+{
+	Mesh* mesh = models[0]->GetMesh();
+	unsigned int groupIndex = static_cast<unsigned int>(mGroups.size());
+	unsigned int numNodes = mesh->NumberNodes();
+	unsigned int numLods = std::min(std::max(mesh->NumLods(), 1u), static_cast<unsigned int>(MAX_GPU_CULL_LODS));
+
+	// The group's part of the visible list has room for every model at each level of detail
+	GpuCullGroup groupData = {};
+	groupData.firstVisible = mNumVisibleSlots;
+	groupData.numModels    = numModels;
+	groupData.numLods      = numLods;
+	groupData.firstCount   = mNumCounts;
+	for (unsigned int lod = 0; lod < numLods; ++lod)  groupData.lodErrors[lod] = (lod < mesh->NumLods() ? mesh->GetLodError(lod) : 0);
+	mGroupData.push_back(groupData);
+	mNumVisibleSlots += numModels * numLods;
+	mNumCounts += numLods;
+
+	// Each model is one instance to cull, with the instance data of all its nodes
+	for (unsigned int i = 0; i < numModels; ++i)
+	{
+		BoundingBox bounds = models[i]->WorldBoundingBox();
+		CVector3 scale = models[i]->Scale();
+		GpuCullInstance instance = {};
+		instance.centre    = bounds.Centre();
+		instance.radius    = Length(bounds.HalfExtents());
+		instance.maxScale  = std::max(std::max(scale.x, scale.y), scale.z);
+		instance.group     = groupIndex;
+		instance.firstData = static_cast<unsigned int>(mInstanceData.size());
+		mCullInstances.push_back(instance);
+
+		mInstanceData.resize(mInstanceData.size() + numNodes);
+		models[i]->GetNodeInstances(colours[i], textureSlices ? textureSlices[i] : 0, &mInstanceData[instance.firstData]);
+	}
+
+	// An indirect draw for each node with geometry at each level of detail, drawing as many instances as were counted for
+	// that level. The sub-meshes of a node share its constants
+	Group group = { mesh, static_cast<unsigned int>(mDraws.size()), 0 };
+	for (unsigned int lod = 0; lod < numLods; ++lod)
+	{
+		for (unsigned int node = 0; node < numNodes; ++node)
+		{
+			if (!mesh->NodeHasGeometry(node))  continue;
+
+			size_t firstRecord = mDrawRecords.size();
+			mesh->GetIndirectArguments(node, lod, mDrawRecords);
+			for (size_t r = firstRecord; r < mDrawRecords.size(); ++r)  mDrawRecords[r].instanceCount = groupData.firstCount + lod;
+
+			mDraws.push_back({ node, static_cast<UINT>(firstRecord * sizeof(DrawIndexedArguments)) });
+			mDrawConstants.push_back({ groupData.firstVisible + lod * numModels, node, { 0, 0 } });
+			++group.numDraws;
+		}
+	}
+	mGroups.push_back(group);
+	return groupIndex;
+}
+
+
+bool GpuCuller::Cull(const Frustum& frustum, const CVector3& viewPoint, float pixelsPerUnit, float maxPixelError)
+{
+	ReadVisible();
+	if (mCullInstances.empty())  return true;
+	CPU_PROFILE_SCOPE("GpuCuller::Cull");
+
+	if (mConstantBuffer == nullptr)  mConstantBuffer = CreateConstantBuffer(sizeof(GpuCullConstants));
+	unsigned int numRecords = static_cast<unsigned int>(mDrawRecords.size());
+	if (numRecords > mArgumentsCapacity)
+	{
+		unsigned int capacity = std::max(numRecords, std::max(MIN_CAPACITY, mArgumentsCapacity * 2));
+		if (mArgumentsUAV)  mArgumentsUAV->Release();
+		if (mArguments)     mArguments->Release();
+		mArgumentsUAV = nullptr;
+		mArguments = CreateDrawArgumentsBuffer(capacity, &mArgumentsUAV);
+		mArgumentsCapacity = (mArguments ? capacity : 0);
+	}
+	if (mConstantBuffer == nullptr || mArguments == nullptr ||
+	    !Upload(mInstanceBuffer, mInstanceData) || !Upload(mCullInstanceBuffer, mCullInstances) ||
+	    !Upload(mGroupBuffer, mGroupData) || !Upload(mDrawRecordBuffer, mDrawRecords) ||
+	    !Reserve(mVisibleBuffer, sizeof(unsigned int), mNumVisibleSlots) || !Reserve(mCountBuffer, sizeof(unsigned int), mNumCounts) ||
+	    !UpdateDrawConstants())
+	{
+		gLastError = "Error creating GPU culling buffers";
+		return false;
+	}
+
+	// The pyramid is only of use if it was built from last frame's depth
+	mUsedHiZ = (mHiZ != nullptr && mHiZFrame + 1 == mFrame);
+	mConstants.hiZViewProjection = mHiZViewProjection;
+	for (int p = 0; p < 6; ++p)  mConstants.cullPlanes[p] = { frustum.planes[p].normal, frustum.planes[p].distance };
+	mConstants.cullViewPoint     = viewPoint;
+	mConstants.cullPixelsPerUnit = pixelsPerUnit;
+	mConstants.hiZUVScale        = mHiZUVScale;
+	mConstants.hiZSize           = { static_cast<float>(mHiZWidth), static_cast<float>(mHiZHeight) };
+	mConstants.numCullInstances  = static_cast<unsigned int>(mCullInstances.size());
+	mConstants.numDrawRecords    = numRecords;
+	mConstants.hiZLevels         = (mUsedHiZ ? static_cast<unsigned int>(mHiZLevelUAVs.size()) : 0);
+	mConstants.maxLodPixelError  = maxPixelError;
+	UpdateConstantBuffer(mConstantBuffer, mConstants);
+
+	// The visible list may still be bound for the vertex shaders from last frame, it can't also be written
+	ID3D11ShaderResourceView* nullSRVs[3] = {};
+	ID3D11UnorderedAccessView* nullUAVs[2] = {};
+	gD3DContext->VSSetShaderResources(GPU_CULL_VISIBLE_SLOT, 1, nullSRVs);
+	UINT zeros[4] = {};
+	gD3DContext->ClearUnorderedAccessViewUint(mCountBuffer.uav, zeros);
+
+	// Cull the instances, counting and listing the visible ones
+	ID3D11ShaderResourceView*  cullSRVs[3] = { mCullInstanceBuffer.srv, mGroupBuffer.srv, mUsedHiZ ? mHiZSRV : nullptr };
+	ID3D11UnorderedAccessView* cullUAVs[2] = { mVisibleBuffer.uav, mCountBuffer.uav };
+	gStateCache.CSSetShader(gGpuCull_Compute, nullptr, 0);
+	gStateCache.SetConstantBuffer(GPU_CULL_CONSTANTS_SLOT, mConstantBuffer);
+	gD3DContext->CSSetShaderResources(0, 3, cullSRVs);
+	gD3DContext->CSSetUnorderedAccessViews(0, 2, cullUAVs, nullptr);
+	gD3DContext->Dispatch((mConstants.numCullInstances + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+	gD3DContext->CSSetUnorderedAccessViews(0, 2, nullUAVs, nullptr);
+
+	// Then write the draw arguments from the counts
+	ID3D11ShaderResourceView* argumentSRVs[3] = { mDrawRecordBuffer.srv, mCountBuffer.srv, nullptr };
+	gStateCache.CSSetShader(gGpuCullArgs_Compute, nullptr, 0);
+	gD3DContext->CSSetShaderResources(0, 3, argumentSRVs);
+	gD3DContext->CSSetUnorderedAccessViews(0, 1, &mArgumentsUAV, nullptr);
+	gD3DContext->Dispatch((numRecords + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+	gD3DContext->CSSetUnorderedAccessViews(0, 1, nullUAVs, nullptr);
+	gD3DContext->CSSetShaderResources(0, 3, nullSRVs);
+
+	// Copy the counts back to report how many instances are drawn, into this frame's copy. It was read by ReadVisible
+	// above unless the frame pipeline isn't following the GPU, then it is skipped until it has been
+	Readback& readback = mReadbacks[gFramePipeline.Slot()];
+	if (readback.counts == 0)
+	{
+		if (mNumCounts > readback.capacity)
+		{
+			if (readback.buffer)  readback.buffer->Release();
+			readback.buffer = nullptr;
+			readback.capacity = 0;
+
+			D3D11_BUFFER_DESC bufferDesc = {};
+			bufferDesc.ByteWidth = mCountBuffer.capacity * sizeof(unsigned int);
+			bufferDesc.Usage = D3D11_USAGE_STAGING;
+			bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+			if (SUCCEEDED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &readback.buffer)))
+			{
+				gResourceRegistry.Track(readback.buffer);
+				readback.capacity = mCountBuffer.capacity;
+			}
+		}
+		if (readback.buffer != nullptr)
+		{
+			D3D11_BOX box = { 0, 0, 0, mNumCounts * static_cast<UINT>(sizeof(unsigned int)), 1, 1 };
+			gD3DContext->CopySubresourceRegion(readback.buffer, 0, 0, 0, 0, mCountBuffer.buffer, 0, &box);
+			readback.counts = mNumCounts;
+			readback.frame  = gFramePipeline.Frame();
+		}
+	}
+
+	mCulled = true;
+	return true;
+}
+
+
+void GpuCuller::Render(unsigned int groupIndex)
+{
+	if (!mCulled || groupIndex >= mGroups.size())  return;
+	CPU_PROFILE_SCOPE("GpuCuller::Render");
+
+	gD3DContext->VSSetShaderResources(INSTANCE_DATA_SLOT,    1, &mInstanceBuffer.srv);
+	gD3DContext->VSSetShaderResources(GPU_CULL_VISIBLE_SLOT, 1, &mVisibleBuffer.srv);
+
+	const Group& group = mGroups[groupIndex];
+	for (unsigned int d = group.firstDraw; d < group.firstDraw + group.numDraws; ++d)
+	{
+		gStateCache.SetConstantBuffer(GPU_DRAW_CONSTANTS_SLOT, mDrawConstantBuffers[d]);
+		group.mesh->RenderIndirect(mDraws[d].node, mArguments, mDraws[d].argumentsOffset);
+	}
+}
+
+
+bool GpuCuller::BuildHiZ(ID3D11ShaderResourceView* depth, const CMatrix4x4& viewProjection, const D3D11_VIEWPORT& viewport)
+{
+	CPU_PROFILE_SCOPE("GpuCuller::BuildHiZ");
+
+	ID3D11Resource* depthResource;
+	depth->GetResource(&depthResource);
+	D3D11_TEXTURE2D_DESC depthDesc;
+	static_cast<ID3D11Texture2D*>(depthResource)->GetDesc(&depthDesc);
+	depthResource->Release();
+
+	if (mConstantBuffer == nullptr)  mConstantBuffer = CreateConstantBuffer(sizeof(GpuCullConstants));
+	if (mConstantBuffer == nullptr || !CreateHiZ(depthDesc.Width, depthDesc.Height))
+	{
+		gLastError = "Error creating hierarchical-Z pyramid";
+		return false;
+	}
+
+	// The depth buffer can't be read while it is bound, and the pyramid may still be bound from Cull
+	ID3D11ShaderResourceView*  nullSRVs[3] = {};
+	ID3D11UnorderedAccessView* nullUAV = nullptr;
+	gD3DContext->OMSetRenderTargets(0, nullptr, nullptr);
+	gD3DContext->CSSetShaderResources(0, 3, nullSRVs);
+	gStateCache.CSSetShader(gHiZ_Compute, nullptr, 0);
+	gStateCache.SetConstantBuffer(GPU_CULL_CONSTANTS_SLOT, mConstantBuffer);
+
+	// Each level is read from the one above, the top level from the depth buffer
+	unsigned int sourceWidth = mHiZWidth, sourceHeight = mHiZHeight;
+	for (unsigned int level = 0; level < mHiZLevelUAVs.size(); ++level)
+	{
+		unsigned int targetWidth  = std::max(mHiZWidth  >> level, 1u);
+		unsigned int targetHeight = std::max(mHiZHeight >> level, 1u);
+		mConstants.hiZSourceSize[0] = sourceWidth;
+		mConstants.hiZSourceSize[1] = sourceHeight;
+		mConstants.hiZTargetSize[0] = targetWidth;
+		mConstants.hiZTargetSize[1] = targetHeight;
+		UpdateConstantBuffer(mConstantBuffer, mConstants);
+
+		ID3D11ShaderResourceView* source = (level == 0 ? depth : mHiZLevelSRVs[level - 1]);
+		gD3DContext->CSSetShaderResources(0, 1, &source);
+		gD3DContext->CSSetUnorderedAccessViews(0, 1, &mHiZLevelUAVs[level], nullptr);
+		gD3DContext->Dispatch((targetWidth + HI_Z_GROUP_SIZE - 1) / HI_Z_GROUP_SIZE, (targetHeight + HI_Z_GROUP_SIZE - 1) / HI_Z_GROUP_SIZE, 1);
+		gD3DContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
+		gD3DContext->CSSetShaderResources(0, 1, nullSRVs);
+
+		sourceWidth  = targetWidth;
+		sourceHeight = targetHeight;
+	}
+
+	// With dynamic resolution the scene only covers the top-left of the depth buffer
+	mHiZViewProjection = viewProjection;
+	mHiZUVScale = { viewport.Width / mHiZWidth, viewport.Height / mHiZHeight };
+	mHiZFrame = mFrame;
+	return true;
+}
+
+
+void GpuCuller::Release()
+{
+	BeginFrame();
+	ReleaseHiZ();
+	for (auto& buffer : mDrawConstantBuffers)  buffer->Release();
+	mDrawConstantBuffers.clear();
+	mUploadedDrawConstants.clear();
+	for (auto& readback : mReadbacks)
+	{
+		if (readback.buffer)  readback.buffer->Release();
+		readback = Readback();
+	}
+	if (mConstantBuffer)  mConstantBuffer->Release();
+	if (mArgumentsUAV)    mArgumentsUAV->Release();
+	if (mArguments)       mArguments->Release();
+	mConstantBuffer = nullptr;
+	mArgumentsUAV = nullptr;
+	mArguments = nullptr;
+	mArgumentsCapacity = 0;
+	mNumVisible = -1;
+	ReleaseBuffer(mCountBuffer);
+	ReleaseBuffer(mVisibleBuffer);
+	ReleaseBuffer(mDrawRecordBuffer);
+	ReleaseBuffer(mGroupBuffer);
+	ReleaseBuffer(mCullInstanceBuffer);
+	ReleaseBuffer(mInstanceBuffer);
+	mHiZFrame = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+template <class T>
+bool GpuCuller::Upload(GrowingBuffer& buffer, const std::vector<T>& data)
+{
+	if (data.size() > buffer.capacity)
+	{
+		unsigned int capacity = std::max(static_cast<unsigned int>(data.size()), std::max(MIN_CAPACITY, buffer.capacity * 2));
+		ReleaseBuffer(buffer);
+		buffer.buffer = CreateStructuredBuffer(sizeof(T), capacity, &buffer.srv);
+		if (buffer.buffer == nullptr)  return false;
+		buffer.capacity = capacity;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(gD3DContext->Map(buffer.buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))  return false;
+	std::memcpy(mapped.pData, data.data(), data.size() * sizeof(T));
+	gD3DContext->Unmap(buffer.buffer, 0);
+	return true;
+}
+
+
+bool GpuCuller::Reserve(GrowingBuffer& buffer, unsigned int elementSize, unsigned int size)
+{
+	if (size <= buffer.capacity)  return true;
+
+	unsigned int capacity = std::max(size, std::max(MIN_CAPACITY, buffer.capacity * 2));
+	ReleaseBuffer(buffer);
+	buffer.buffer = CreateReadWriteStructuredBuffer(elementSize, capacity, &buffer.srv, &buffer.uav);
+	if (buffer.buffer == nullptr)  return false;
+	buffer.capacity = capacity;
+	return true;
+}
+
+
+// Most frames lay out the same draws as the last, so few constants change
+bool GpuCuller::UpdateDrawConstants()
+{
+	while (mDrawConstantBuffers.size() < mDrawConstants.size())
+	{
+		ID3D11Buffer* buffer = CreateConstantBuffer(sizeof(GpuDrawConstants));
+		if (buffer == nullptr)  return false;
+		mDrawConstantBuffers.push_back(buffer);
+		mUploadedDrawConstants.push_back({ ~0u, ~0u, { 0, 0 } }); // Matches no draw, so is updated below
+	}
+
+	for (size_t d = 0; d < mDrawConstants.size(); ++d)
+	{
+		if (std::memcmp(&mDrawConstants[d], &mUploadedDrawConstants[d], sizeof(GpuDrawConstants)) == 0)  continue;
+		UpdateConstantBuffer(mDrawConstantBuffers[d], mDrawConstants[d]);
+		mUploadedDrawConstants[d] = mDrawConstants[d];
+	}
+	return true;
+}
+
+
+bool GpuCuller::CreateHiZ(unsigned int width, unsigned int height)
+{
+	if (mHiZ != nullptr && mHiZWidth == width && mHiZHeight == height)  return true;
+	ReleaseHiZ();
+
+	unsigned int numLevels = 1;
+	while ((std::max(width, height) >> numLevels) > 0)  ++numLevels;
+
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = width;
+	textureDesc.Height = height;
+	textureDesc.MipLevels = numLevels;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, nullptr, &mHiZ)))
+	{
+		mHiZ = nullptr;
+		return false;
+	}
+	gResourceRegistry.Track(mHiZ);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = numLevels;
+	bool created = SUCCEEDED(gD3DDevice->CreateShaderResourceView(mHiZ, &srvDesc, &mHiZSRV));
+	if (!created)  mHiZSRV = nullptr;
+
+	// A view of each level on its own, to read it while writing the next
+	srvDesc.Texture2D.MipLevels = 1;
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+	for (unsigned int level = 0; level < numLevels && created; ++level)
+	{
+		ID3D11ShaderResourceView*  levelSRV = nullptr;
+		ID3D11UnorderedAccessView* levelUAV = nullptr;
+		srvDesc.Texture2D.MostDetailedMip = level;
+		uavDesc.Texture2D.MipSlice = level;
+		if (SUCCEEDED(gD3DDevice->CreateShaderResourceView(mHiZ, &srvDesc, &levelSRV)))  mHiZLevelSRVs.push_back(levelSRV);
+		else                                                                               created = false;
+		if (created && SUCCEEDED(gD3DDevice->CreateUnorderedAccessView(mHiZ, &uavDesc, &levelUAV)))  mHiZLevelUAVs.push_back(levelUAV);
+		else                                                                                           created = false;
+	}
+	if (!created)
+	{
+		ReleaseHiZ();
+		return false;
+	}
+
+	mHiZWidth  = width;
+	mHiZHeight = height;
+	return true;
+}
+
+
+// A copy from a frame the pipeline knows is finished is mapped without the DO_NOT_WAIT flag, which it would otherwise
+// need, as the map can't stall then
+void GpuCuller::ReadVisible()
+{
+	for (;;)
+	{
+		Readback* oldest = nullptr;
+		for (auto& readback : mReadbacks)
+		{
+			if (readback.counts != 0 && (oldest == nullptr || readback.frame < oldest->frame))  oldest = &readback;
+		}
+		if (oldest == nullptr)  return;
+
+		UINT flags = gFramePipeline.Completed(oldest->frame) ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT;
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (gD3DContext->Map(oldest->buffer, 0, D3D11_MAP_READ, flags, &mapped) != S_OK)  return; // Not done yet, nor later ones
+		const unsigned int* counts = static_cast<const unsigned int*>(mapped.pData);
+		int numVisible = 0;
+		for (unsigned int c = 0; c < oldest->counts; ++c)  numVisible += counts[c];
+		gD3DContext->Unmap(oldest->buffer, 0);
+
+		mNumVisible = numVisible;
+		oldest->counts = 0;
+	}
+}
+
+
+void GpuCuller::ReleaseBuffer(GrowingBuffer& buffer)
+{
+	if (buffer.uav)     buffer.uav->Release();
+	if (buffer.srv)     buffer.srv->Release();
+	if (buffer.buffer)  buffer.buffer->Release();
+	buffer = GrowingBuffer();
+}
+
+
+void GpuCuller::ReleaseHiZ()
+{
+	for (auto& view : mHiZLevelUAVs)  view->Release();
+	for (auto& view : mHiZLevelSRVs)  view->Release();
+	if (mHiZSRV)  mHiZSRV->Release();
+	if (mHiZ)     mHiZ->Release();
+	mHiZLevelUAVs.clear();
+	mHiZLevelSRVs.clear();
+	mHiZSRV = nullptr;
+	mHiZ = nullptr;
+	mHiZWidth = mHiZHeight = 0;
+}
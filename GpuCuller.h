@@ -0,0 +1,198 @@
+//--------------------------------------------------------------------------------------
+// GPU-driven culling
+//--------------------------------------------------------------------------------------
+// Culling on the CPU still costs a test and some drawing work for every model, so the cost of a frame grows with the
+// size of the scene. Models drawn through this path are instead culled on the GPU, so the CPU work each frame is one
+// bulk upload and a few draws for each mesh, however many models there are:
+//
+// - Each frame the scene adds its rigid models in groups sharing a mesh and texture. Every model is one instance to cull,
+//   with its world bounding sphere, and has the InstanceData of all its nodes in the instance buffer.
+//
+// - Cull uploads the instances and runs GpuCull_cs, one thread per instance. It tests the sphere against the frustum and
+//   against a hierarchical-Z pyramid, the furthest depth over ever larger areas of last frame's depth buffer (built by
+//   HiZ_cs in BuildHiZ), projected with last frame's camera. Visible instances choose their level of detail as
+//   Model::SelectLod does and are appended to their group's list for that level. GpuCullArgs_cs then writes the
+//   arguments of the indirect draws from the counts.
+//
+// - Render draws a group with DrawIndexedInstancedIndirect for each node and level of detail, with the instanced shaders
+//   built with GPU_CULLING (see Instancing.hlsli), which read the visible lists. The CPU never learns what was drawn.
+//
+// The pyramid is a frame behind, so a model that comes out from behind another can appear a frame late, as for the
+// occlusion queries (see OcclusionCuller.h). It is only used while it was built the frame before. Instances with meshes
+// that have bones can't be culled by their bounds so must be left to the CPU path
+
+#ifndef _GPU_CULLER_H_INCLUDED_
+#define _GPU_CULLER_H_INCLUDED_
+
+#include "Common.h"
+#include "FramePipeline.h"
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "Bounds.h"
+
+#include <d3d11.h>
+#include <vector>
+
+class Model;
+class Mesh;
+
+
+class GpuCuller
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~GpuCuller()  { Release(); }
+
+	// Start laying out a frame's instances, forgetting last frame's groups. Call before AddGroup
+	void BeginFrame();
+
+	// Add models sharing a mesh, which mustn't have bones, to be culled and drawn as one group, with the colour and
+	// material array slice (may be null) of each. Reads the models' world matrices. Returns the group for Render. Call
+	// from one thread at a time
+	unsigned int AddGroup(Model* const models[], const CVector3 colours[], const unsigned int textureSlices[],
+	                      unsigned int numModels);
+
+	// Upload the frame's instances and cull them on the GPU for a camera's frustum and view point, choosing levels of
+	// detail as for Model::SelectLod. Main thread, after the groups are added and before any draws of them are recorded.
+	// Returns false on failure (reason in gLastError), nothing is drawn by Render then
+	bool Cull(const Frustum& frustum, const CVector3& viewPoint, float pixelsPerUnit, float maxPixelError);
+
+	// Draw the visible instances of a group. The instanced shaders built with GPU_CULLING must be selected. Any context,
+	// once Cull has run
+	void Render(unsigned int group);
+
+	// Build the pyramid from the single sample depth buffer just drawn, with the camera and viewport it was drawn with,
+	// for next frame's Cull. Main thread. Unbinds the render targets so the depth can be read. Returns false on failure
+	// (reason in gLastError), next frame is culled without it then
+	bool BuildHiZ(ID3D11ShaderResourceView* depth, const CMatrix4x4& viewProjection, const D3D11_VIEWPORT& viewport);
+
+	void Release();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// Instances, groups and indirect draws laid out this frame
+	int NumInstances()  { return static_cast<int>(mCullInstances.size()); }
+	int NumGroups()     { return static_cast<int>(mGroups.size()); }
+	int NumDraws()      { return static_cast<int>(mDraws.size()); }
+
+	// Instances the GPU found visible, read back without waiting so up to MAX_FRAMES_IN_FLIGHT frames behind. -1 until
+	// the first is read
+	int NumVisible()  { return mNumVisible; }
+
+	// Whether the last Cull tested against a pyramid
+	bool UsedHiZ()  { return mUsedHiZ; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// The draws of each group, one for each node with geometry and level of detail
+	struct Group
+	{
+		Mesh*        mesh;
+		unsigned int firstDraw;
+		unsigned int numDraws;
+	};
+
+	struct Draw
+	{
+		unsigned int node;
+		UINT         argumentsOffset; // Bytes into the arguments buffer of its first sub-mesh's arguments
+	};
+
+	// A buffer that grows to hold what it is given each frame
+	struct GrowingBuffer
+	{
+		ID3D11Buffer*              buffer = nullptr;
+		ID3D11ShaderResourceView*  srv = nullptr;
+		ID3D11UnorderedAccessView* uav = nullptr; // Only for buffers written by the GPU
+		unsigned int               capacity = 0;  // Elements
+	};
+
+	// Upload the data to a dynamic structured buffer, first making it larger if needed. Returns false on failure
+	template <class T>
+	bool Upload(GrowingBuffer& buffer, const std::vector<T>& data);
+
+	// Make a buffer written by the GPU large enough for the given number of elements, returns false on failure
+	bool Reserve(GrowingBuffer& buffer, unsigned int elementSize, unsigned int size);
+
+	// Create a constant buffer for each draw that hasn't got one and update those whose constants have changed
+	bool UpdateDrawConstants();
+
+	// Create the pyramid for a depth buffer of the given size, if it isn't that size already. Returns false on failure
+	bool CreateHiZ(unsigned int width, unsigned int height);
+
+	// Collect the visible counts read back from earlier frames that the GPU has finished, oldest first
+	void ReadVisible();
+
+	void ReleaseBuffer(GrowingBuffer& buffer);
+	void ReleaseHiZ();
+
+	static const unsigned int MIN_CAPACITY = 256;
+
+	// This frame's layout, built by AddGroup
+	std::vector<Group>                mGroups;
+	std::vector<Draw>                 mDraws;
+	std::vector<InstanceData>         mInstanceData;
+	std::vector<GpuCullInstance>      mCullInstances;
+	std::vector<GpuCullGroup>         mGroupData;
+	std::vector<DrawIndexedArguments> mDrawRecords;   // Instance count holds the count's index
+	std::vector<GpuDrawConstants>     mDrawConstants; // One for each draw
+	unsigned int                      mNumVisibleSlots = 0;
+	unsigned int                      mNumCounts = 0;
+
+	GrowingBuffer mInstanceBuffer;     // InstanceData, read by the vertex shaders
+	GrowingBuffer mCullInstanceBuffer;
+	GrowingBuffer mGroupBuffer;
+	GrowingBuffer mDrawRecordBuffer;
+	GrowingBuffer mVisibleBuffer;      // Written by GpuCull_cs
+	GrowingBuffer mCountBuffer;        // --"--
+	ID3D11Buffer*              mArguments = nullptr; // Written by GpuCullArgs_cs
+	ID3D11UnorderedAccessView* mArgumentsUAV = nullptr;
+	unsigned int               mArgumentsCapacity = 0;
+
+	// Constants of each draw, updated on the main thread in Cull so the recording threads only bind them
+	std::vector<ID3D11Buffer*>    mDrawConstantBuffers;
+	std::vector<GpuDrawConstants> mUploadedDrawConstants;
+	ID3D11Buffer*                 mConstantBuffer = nullptr;
+	GpuCullConstants              mConstants = {};
+	bool                          mCulled = false; // Cull succeeded this frame
+
+	// Counts copied back to the CPU, one copy for each frame in flight (see FramePipeline.h) so a frame never waits for
+	// an earlier frame's copy to be read before making its own
+	struct Readback
+	{
+		ID3D11Buffer* buffer = nullptr;
+		unsigned int  capacity = 0;
+		unsigned int  counts = 0; // Counts in the copy being waited for, 0 if none
+		uint64_t      frame = 0;  // Frame the copy was made in
+	};
+	Readback mReadbacks[MAX_FRAMES_IN_FLIGHT];
+	int      mNumVisible = -1;
+
+	// The pyramid, one level for each halving down to a single texel
+	ID3D11Texture2D*                        mHiZ = nullptr;
+	ID3D11ShaderResourceView*               mHiZSRV = nullptr; // All the levels
+	std::vector<ID3D11ShaderResourceView*>  mHiZLevelSRVs;
+	std::vector<ID3D11UnorderedAccessView*> mHiZLevelUAVs;
+	unsigned int                            mHiZWidth = 0;
+	unsigned int                            mHiZHeight = 0;
+	CMatrix4x4                              mHiZViewProjection;
+	CVector2                                mHiZUVScale;
+	UINT64                                  mHiZFrame = 0; // Frame the pyramid was built in, 0 if never
+	UINT64                                  mFrame = 0;
+	bool                                    mUsedHiZ = false;
+};
+
+
+extern GpuCuller gGpuCuller;
+
+
+#endif //_GPU_CULLER_H_INCLUDED_
@@ -0,0 +1,47 @@
+//--------------------------------------------------------------------------------------
+// Include file for the GPU-driven culling
+//--------------------------------------------------------------------------------------
+// Used by HiZ_cs, GpuCull_cs and GpuCullArgs_cs, see GpuCuller.h
+
+#include "Common.hlsli"
+
+
+// These variables must match exactly the GpuCullConstants, GpuCullInstance and GpuCullGroup structures in Common.h
+#define GPU_CULL_GROUP_SIZE 64
+#define HI_Z_GROUP_SIZE     8
+#define MAX_GPU_CULL_LODS   4
+
+cbuffer GpuCullConstants : register(b10)
+{
+    float4x4 gHiZViewProjection;
+    float4   gCullPlanes[6];      // Normal in xyz, distance in w
+    float3   gCullViewPoint;
+    float    gCullPixelsPerUnit;
+    float2   gHiZUVScale;
+    float2   gHiZSize;
+    uint     gNumCullInstances;
+    uint     gNumDrawRecords;
+    uint     gHiZLevels;
+    float    gMaxLodPixelError;
+    uint2    gHiZSourceSize;
+    uint2    gHiZTargetSize;
+}
+
+struct GpuCullInstance
+{
+    float3 centre;
+    float  radius;
+    float  maxScale;
+    uint   group;
+    uint   firstData;
+    uint   paddingC;
+};
+
+struct GpuCullGroup
+{
+    uint   firstVisible;
+    uint   numModels;
+    uint   numLods;
+    uint   firstCount;
+    float4 lodErrors;
+};
@@ -0,0 +1,277 @@
+//--------------------------------------------------------------------------------------
+// GPU profiler
+//--------------------------------------------------------------------------------------
+
+#include "GpuProfiler.h"
+#include "CpuProfiler.h"
+#include "Common.h"
+
+
+GpuProfiler gGpuProfiler;
+
+
+GpuProfiler::~GpuProfiler()
+{
+	Release();
+}
+
+
+// Create the frame queries. Timer queries are created as they are first needed
+bool GpuProfiler::Init()
+{
+	Release();
+
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+	for (auto& frame : mFrames)
+	{
+		if (FAILED(gD3DDevice->CreateQuery(&queryDesc, &frame.disjoint)))
+		{
+			frame.disjoint = nullptr;
+			gLastError = "Error creating GPU profiler queries";
+			return false;
+		}
+		frame.frameBegin = CreateTimestamp();
+		frame.frameEnd   = CreateTimestamp();
+		if (frame.frameBegin == nullptr || frame.frameEnd == nullptr)
+		{
+			gLastError = "Error creating GPU profiler queries";
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// Release all queries
+void GpuProfiler::Release()
+{
+	for (auto& frame : mFrames)
+	{
+		for (auto& timer : frame.timers)
+		{
+			if (timer.statistics)  timer.statistics->Release();
+			if (timer.end)         timer.end       ->Release();
+			if (timer.begin)       timer.begin     ->Release();
+		}
+		if (frame.frameEnd)    frame.frameEnd  ->Release();
+		if (frame.frameBegin)  frame.frameBegin->Release();
+		if (frame.disjoint)    frame.disjoint  ->Release();
+		frame = Frame();
+	}
+	mCurrentFrame = 0;
+	mInFrame = false;
+	mOpenTimers.clear();
+}
+
+
+// Start measuring a frame
+void GpuProfiler::BeginFrame()
+{
+	Frame& frame = mFrames[mCurrentFrame];
+	if (frame.disjoint == nullptr)  return; // Not initialised
+
+	// This frame's queries were issued NUM_FRAMES ago. Normally ReadResults will have picked them up already,
+	// but if the GPU is still behind, drop them rather than wait
+	if (frame.pending)  ReadResults(frame);
+	frame.pending = false;
+
+	frame.numTimers = 0;
+	mOpenTimers.clear();
+	gD3DContext->Begin(frame.disjoint);
+	gD3DContext->End(frame.frameBegin);
+	mInFrame = true;
+}
+
+
+// Finish measuring a frame and pick up the results from the oldest frame in the ring if they are ready
+void GpuProfiler::EndFrame()
+{
+	if (!mInFrame)  return;
+	mInFrame = false;
+
+	// Close any timers left open
+	while (!mOpenTimers.empty())  EndTimer();
+
+	Frame& frame = mFrames[mCurrentFrame];
+	gD3DContext->End(frame.frameEnd);
+	gD3DContext->End(frame.disjoint);
+	frame.pending = true;
+
+	mCurrentFrame = (mCurrentFrame + 1) % NUM_FRAMES;
+
+	// Read back every frame that is ready, oldest first, so the results are as recent as possible
+	for (int i = 0; i < NUM_FRAMES; ++i)
+	{
+		Frame& oldFrame = mFrames[(mCurrentFrame + i) % NUM_FRAMES];
+		if (oldFrame.pending && !ReadResults(oldFrame))  break;
+	}
+}
+
+
+// Time a section of the frame
+void GpuProfiler::BeginTimer(const std::string& name)
+{
+	if (!mInFrame)  return;
+
+	Frame& frame = mFrames[mCurrentFrame];
+	if (frame.numTimers == static_cast<int>(frame.timers.size()))
+	{
+		Timer timer = { "", 0, CreateTimestamp(), CreateTimestamp(), nullptr, false, 0 };
+		if (timer.begin == nullptr || timer.end == nullptr)
+		{
+			if (timer.begin)  timer.begin->Release();
+			if (timer.end)    timer.end  ->Release();
+			return;
+		}
+		frame.timers.push_back(timer);
+	}
+
+	Timer& timer = frame.timers[frame.numTimers];
+	timer.name  = name;
+	timer.depth = static_cast<int>(mOpenTimers.size());
+	timer.targetPixels = mTargetPixels;
+	if (mStatisticsEnabled && timer.statistics == nullptr)
+	{
+		D3D11_QUERY_DESC queryDesc = {};
+		queryDesc.Query = D3D11_QUERY_PIPELINE_STATISTICS;
+		if (FAILED(gD3DDevice->CreateQuery(&queryDesc, &timer.statistics)))  timer.statistics = nullptr;
+	}
+	timer.gathering = mStatisticsEnabled && timer.statistics != nullptr;
+	gD3DContext->End(timer.begin);
+	if (timer.gathering)  gD3DContext->Begin(timer.statistics); // Nested timers each have their own query, which may overlap
+	mOpenTimers.push_back(frame.numTimers);
+	++frame.numTimers;
+}
+
+
+// End the most recently begun timer
+void GpuProfiler::EndTimer()
+{
+	if (!mInFrame || mOpenTimers.empty())  return;
+
+	Frame& frame = mFrames[mCurrentFrame];
+	Timer& timer = frame.timers[mOpenTimers.back()];
+	if (timer.gathering)  gD3DContext->End(timer.statistics);
+	gD3DContext->End(timer.end);
+	mOpenTimers.pop_back();
+}
+
+
+// Measure the offset between the GPU and CPU clocks
+bool GpuProfiler::CalibrateClock()
+{
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_EVENT;
+	ID3D11Query* idle = nullptr;
+	gD3DDevice->CreateQuery(&queryDesc, &idle);
+	queryDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+	ID3D11Query* disjoint = nullptr;
+	gD3DDevice->CreateQuery(&queryDesc, &disjoint);
+	ID3D11Query* timestamp = CreateTimestamp();
+
+	bool ok = (idle != nullptr && disjoint != nullptr && timestamp != nullptr);
+	if (ok)
+	{
+		// Wait for all the work already submitted, so the timestamp below is taken as soon as it is flushed
+		gD3DContext->End(idle);
+		BOOL done = FALSE;
+		while (gD3DContext->GetData(idle, &done, sizeof(done), 0) == S_FALSE) {}
+
+		gD3DContext->Begin(disjoint);
+		gD3DContext->End(timestamp);
+		gD3DContext->End(disjoint);
+		gD3DContext->Flush();
+		int64_t cpu = CpuProfiler::Now();
+
+		UINT64 gpu;
+		D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointData;
+		HRESULT gpuResult, disjointResult;
+		while ((gpuResult = gD3DContext->GetData(timestamp, &gpu, sizeof(gpu), 0)) == S_FALSE) {}
+		while ((disjointResult = gD3DContext->GetData(disjoint, &disjointData, sizeof(disjointData), 0)) == S_FALSE) {}
+		ok = (gpuResult == S_OK && disjointResult == S_OK && !disjointData.Disjoint);
+		if (ok)
+		{
+			mCalibrationGpu = gpu;
+			mCalibrationCpu = cpu;
+		}
+	}
+	if (!ok)  gLastError = "Error reading the GPU clock";
+
+	if (timestamp)  timestamp->Release();
+	if (disjoint)   disjoint ->Release();
+	if (idle)       idle     ->Release();
+	return ok;
+}
+
+
+// Create a timestamp query, nullptr on error
+ID3D11Query* GpuProfiler::CreateTimestamp()
+{
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_TIMESTAMP;
+	ID3D11Query* query;
+	if (FAILED(gD3DDevice->CreateQuery(&queryDesc, &query)))  return nullptr;
+	return query;
+}
+
+
+// Read the results of the given frame if they are ready, without flushing the pipeline
+bool GpuProfiler::ReadResults(Frame& frame)
+{
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+	if (gD3DContext->GetData(frame.disjoint, &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)  return false;
+
+	// Once the disjoint query is done all the timestamps inside it are too
+	UINT64 frameBegin, frameEnd;
+	if (gD3DContext->GetData(frame.frameBegin, &frameBegin, sizeof(frameBegin), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+	    gD3DContext->GetData(frame.frameEnd,   &frameEnd,   sizeof(frameEnd),   D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)  return false;
+	frame.pending = false;
+
+	// The GPU clock changed speed during the frame (e.g. power saving), the timestamps can't be used
+	if (disjoint.Disjoint)  return true;
+
+	float toMilliseconds = 1000.0f / static_cast<float>(disjoint.Frequency);
+	mFrameMilliseconds = static_cast<float>(frameEnd - frameBegin) * toMilliseconds;
+	if (mCapture != nullptr)
+	{
+		mCapture->push_back({ "Frame", -1, ToCpuTicks(frameBegin, disjoint.Frequency), ToCpuTicks(frameEnd, disjoint.Frequency) });
+	}
+	mTimings.clear();
+	for (int i = 0; i < frame.numTimers; ++i)
+	{
+		Timer& timer = frame.timers[i];
+		UINT64 begin, end;
+		if (gD3DContext->GetData(timer.begin, &begin, sizeof(begin), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+		    gD3DContext->GetData(timer.end,   &end,   sizeof(end),   D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)  continue;
+
+		Timing timing = { timer.name, timer.depth, static_cast<float>(end - begin) * toMilliseconds, false, 0, 0, 0, 0.0f };
+		D3D11_QUERY_DATA_PIPELINE_STATISTICS statistics;
+		if (timer.gathering &&
+		    gD3DContext->GetData(timer.statistics, &statistics, sizeof(statistics), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+		{
+			timing.hasStatistics           = true;
+			timing.vertexShaderInvocations = statistics.VSInvocations;
+			timing.pixelShaderInvocations  = statistics.PSInvocations;
+			timing.primitives              = statistics.CPrimitives;
+			if (timer.targetPixels > 0)
+			{
+				timing.overdraw = static_cast<float>(statistics.PSInvocations) / static_cast<float>(timer.targetPixels);
+			}
+		}
+		mTimings.push_back(timing);
+		if (mCapture != nullptr)
+		{
+			mCapture->push_back({ timer.name, timer.depth, ToCpuTicks(begin, disjoint.Frequency), ToCpuTicks(end, disjoint.Frequency) });
+		}
+	}
+	return true;
+}
+
+
+// GPU timestamp in CPU clock ticks, the timestamps may be before the calibration point
+int64_t GpuProfiler::ToCpuTicks(UINT64 timestamp, UINT64 frequency)
+{
+	double seconds = static_cast<double>(static_cast<int64_t>(timestamp - mCalibrationGpu)) / static_cast<double>(frequency);
+	return mCalibrationCpu + static_cast<int64_t>(seconds * static_cast<double>(CpuProfiler::Frequency()));
+}
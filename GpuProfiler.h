@@ -0,0 +1,162 @@
+//--------------------------------------------------------------------------------------
+// GPU profiler
+//--------------------------------------------------------------------------------------
+// Measures GPU time spent in named sections of the frame using timestamp queries. The GPU runs a frame or two
+// behind the CPU, so the queries for each frame are kept in a ring and only read back a few frames later when
+// the results are ready - reading them can then never stall the pipeline. If a frame's results are still not
+// ready when its queries are needed again they are dropped.
+//
+// With EnableStatistics each timer also gets a pipeline statistics query, read back through the same ring, giving the
+// vertex and pixel shader invocations and primitives drawn inside it. These say why a section is slow rather than just
+// how slow: the pixel shader invocations divided by the pixels in the target drawn to (see SetTargetPixels) is the
+// overdraw, how many times each pixel was shaded, which shows whether culling or a depth pre-pass is paying off.
+
+#ifndef _GPU_PROFILER_H_INCLUDED_
+#define _GPU_PROFILER_H_INCLUDED_
+
+#include <d3d11.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+class GpuProfiler
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~GpuProfiler();
+
+
+	// Create the frame queries. Returns false on error (reason in gLastError). Timers do nothing until this is called
+	bool Init();
+
+	// Release all queries
+	void Release();
+
+
+	// Bracket everything to be measured in a frame
+	void BeginFrame();
+	void EndFrame();
+
+	// Time a section of the frame. Timers can be nested, each EndTimer ends the most recent BeginTimer
+	void BeginTimer(const std::string& name);
+	void EndTimer();
+
+	// Also gather pipeline statistics for each timer from the next frame. These queries aren't free, so off by default
+	void EnableStatistics(bool enable)  { mStatisticsEnabled = enable; }
+
+	// Pixels in the target being drawn to, for the overdraw of the timers begun after this
+	void SetTargetPixels(UINT64 pixels)  { mTargetPixels = pixels; }
+
+
+	// Measure the offset between the GPU timestamps and the CPU's QueryPerformanceCounter, so GPU times can be placed
+	// on the CPU timeline. Waits for the GPU to go idle first, so only call it occasionally (e.g. when starting a
+	// capture). Returns false if the GPU clock can't be read (reason in gLastError)
+	bool CalibrateClock();
+
+	// A timer as read back, with its times converted to QueryPerformanceCounter ticks using the last CalibrateClock
+	struct Interval
+	{
+		std::string name;
+		int         depth;  // -1 for the whole frame, 0 for top level timers
+		int64_t     begin;
+		int64_t     end;
+	};
+
+	// While capturing, every frame read back adds its frame and timers to the given list. Pass nullptr to stop
+	void SetCapture(std::vector<Interval>* capture)  { mCapture = capture; }
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	struct Timing
+	{
+		std::string name;
+		int         depth;        // Nesting level, 0 for top level timers
+		float       milliseconds;
+
+		// Pipeline statistics, only if hasStatistics (see EnableStatistics)
+		bool        hasStatistics;
+		UINT64      vertexShaderInvocations;
+		UINT64      pixelShaderInvocations;
+		UINT64      primitives;   // Sent to the rasterizer, after clipping
+		float       overdraw;     // Pixel shader invocations for each pixel of the target, 0 if its size wasn't given
+	};
+
+	// Results from the most recent frame that has been read back (a few frames old), in the order the timers began
+	const std::vector<Timing>& Timings()  { return mTimings; }
+
+	// GPU time for the whole of that frame
+	float FrameMilliseconds()  { return mFrameMilliseconds; }
+
+	bool StatisticsEnabled()  { return mStatisticsEnabled; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Frames of queries in the ring - enough for the GPU to have finished the oldest one by the time it is reused
+	static const int NUM_FRAMES = 4;
+
+	struct Timer
+	{
+		std::string  name;
+		int          depth;
+		ID3D11Query* begin;
+		ID3D11Query* end;
+		ID3D11Query* statistics;   // Created the first time the timer is used with statistics enabled
+		bool         gathering;    // The statistics query was issued for this use of the timer
+		UINT64       targetPixels;
+	};
+
+	struct Frame
+	{
+		ID3D11Query*       disjoint;   // Gives the timestamp frequency, and whether the timestamps are usable
+		ID3D11Query*       frameBegin;
+		ID3D11Query*       frameEnd;
+		std::vector<Timer> timers;     // Queries are kept and reused in later frames, only the first numTimers are in use
+		int                numTimers;
+		bool               pending;    // Queries issued but results not read yet
+	};
+
+	// Create a timestamp query, nullptr on error
+	ID3D11Query* CreateTimestamp();
+
+	// Read the results of the given frame if they are ready, returns false if not
+	bool ReadResults(Frame& frame);
+
+	// GPU timestamp in CPU clock ticks, given the GPU timestamp frequency
+	int64_t ToCpuTicks(UINT64 timestamp, UINT64 frequency);
+
+
+	Frame mFrames[NUM_FRAMES] = {};
+	int   mCurrentFrame = 0;
+	bool  mInFrame      = false;
+
+	bool   mStatisticsEnabled = false;
+	UINT64 mTargetPixels      = 0;
+
+	std::vector<int> mOpenTimers; // Timers begun but not ended yet in the current frame
+
+	std::vector<Timing> mTimings;
+	float               mFrameMilliseconds = 0;
+
+	// From CalibrateClock - a GPU timestamp and the CPU time it was taken at
+	UINT64  mCalibrationGpu = 0;
+	int64_t mCalibrationCpu = 0;
+
+	std::vector<Interval>* mCapture = nullptr;
+};
+
+
+// The profiler is used by both the scene and the post-process graph
+extern GpuProfiler gGpuProfiler;
+
+
+#endif //_GPU_PROFILER_H_INCLUDED_
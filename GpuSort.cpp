@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------------
+// GPU sort
+//--------------------------------------------------------------------------------------
+// See GpuSort.h for an overview
+
+#include "GpuSort.h"
+#include "Shader.h"
+#include "StateCache.h"
+#include "GraphicsHelpers.h"
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+bool GpuSort::Init(unsigned int numElements)
+{
+	Release();
+	mSize = SORT_BLOCK_SIZE;
+	while (mSize < numElements)  mSize *= 2;
+
+	mSortData       = CreateReadWriteStructuredBuffer(sizeof(unsigned int) * 2, mSize, &mSortDataSRV, &mSortDataUAV);
+	mConstantBuffer = CreateConstantBuffer(sizeof(SortConstants));
+	if (mSortData == nullptr || mConstantBuffer == nullptr)
+	{
+		gLastError = "Error creating sort buffers";
+		return false;
+	}
+	return true;
+}
+
+
+void GpuSort::Sort()
+{
+	if (mSortData == nullptr)  return;
+
+	gStateCache.SetConstantBuffer(SORT_CONSTANTS_SLOT, mConstantBuffer);
+	gD3DContext->CSSetUnorderedAccessViews(SORT_DATA_SLOT, 1, &mSortDataUAV, nullptr);
+	UINT numBlocks = mSize / SORT_BLOCK_SIZE;
+
+	// Sort each block on its own, alternately ascending and descending, ready to be merged
+	SetConstants(0, 0);
+	gStateCache.CSSetShader(gBitonicSortBlock_Compute, nullptr, 0);
+	gD3DContext->Dispatch(numBlocks, 1, 1);
+
+	// Then merge them in stages, each doubling the length of the sorted sequences until the whole buffer is one
+	for (unsigned int stage = SORT_BLOCK_SIZE * 2; stage <= mSize; stage *= 2)
+	{
+		gStateCache.CSSetShader(gBitonicSortStep_Compute, nullptr, 0);
+		for (unsigned int step = stage / 2; step >= SORT_BLOCK_SIZE; step /= 2)
+		{
+			SetConstants(stage, step);
+			gD3DContext->Dispatch(mSize / 2 / SORT_GROUP_SIZE, 1, 1);
+		}
+
+		SetConstants(stage, 0);
+		gStateCache.CSSetShader(gBitonicSortBlock_Compute, nullptr, 0);
+		gD3DContext->Dispatch(numBlocks, 1, 1);
+	}
+
+	ID3D11UnorderedAccessView* nullUAV = nullptr;
+	gD3DContext->CSSetUnorderedAccessViews(SORT_DATA_SLOT, 1, &nullUAV, nullptr);
+}
+
+
+void GpuSort::Release()
+{
+	if (mConstantBuffer)  mConstantBuffer->Release();
+	if (mSortDataUAV)     mSortDataUAV->Release();
+	if (mSortDataSRV)     mSortDataSRV->Release();
+	if (mSortData)        mSortData->Release();
+	mConstantBuffer = nullptr;
+	mSortDataUAV    = nullptr;
+	mSortDataSRV    = nullptr;
+	mSortData       = nullptr;
+	mSize = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+void GpuSort::SetConstants(unsigned int stage, unsigned int step)
+{
+	SortConstants constants = {};
+	constants.sortSize = mSize;
+	constants.stage    = stage;
+	constants.step     = step;
+	UpdateConstantBuffer(mConstantBuffer, constants);
+}
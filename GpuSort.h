@@ -0,0 +1,69 @@
+//--------------------------------------------------------------------------------------
+// GPU sort
+//--------------------------------------------------------------------------------------
+// Sorts a structured buffer of key / value pairs (two uints each) into ascending order of key entirely on the GPU, for
+// sets too large to sort on the CPU every frame such as the particles. The caller fills the buffer with its own compute
+// shader, writing every element (padding beyond its last item with keys that sort to the end), calls Sort and then
+// reads the values in order - typically indices into its own buffer, so a vertex shader can draw instances in the
+// sorted order by reading the value for each instance ID.
+//
+// A bitonic sort, so the buffer size is a power of 2 of at least SORT_BLOCK_SIZE. BitonicSortBlock_cs sorts each block
+// of SORT_BLOCK_SIZE elements in groupshared memory, then each stage merges pairs of sorted sequences into one twice as
+// long: BitonicSortStep_cs does the steps comparing elements in different blocks, one dispatch each, and the block
+// shader does the rest of the stage in one go. A million elements take 66 dispatches
+
+#ifndef _GPU_SORT_H_INCLUDED_
+#define _GPU_SORT_H_INCLUDED_
+
+#include "Common.h"
+
+#include <d3d11.h>
+
+
+class GpuSort
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~GpuSort()  { Release(); }
+
+	// Create a sort buffer for up to the given number of elements, rounded up to a power of 2. Returns false on failure
+	// (reason in gLastError)
+	bool Init(unsigned int numElements);
+
+	// Sort the whole buffer by key. Call on the main thread after filling the buffer through SortDataUAV
+	void Sort();
+
+	void Release();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// Elements in the buffer, all of them must be written before sorting
+	unsigned int Size()  { return mSize; }
+
+	ID3D11ShaderResourceView*  SortDataSRV()  { return mSortDataSRV; }
+	ID3D11UnorderedAccessView* SortDataUAV()  { return mSortDataUAV; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Update the constants for the next dispatch
+	void SetConstants(unsigned int stage, unsigned int step);
+
+	unsigned int mSize = 0;
+
+	ID3D11Buffer*              mSortData    = nullptr; // mSize key / value pairs
+	ID3D11ShaderResourceView*  mSortDataSRV = nullptr;
+	ID3D11UnorderedAccessView* mSortDataUAV = nullptr;
+	ID3D11Buffer*              mConstantBuffer = nullptr;
+};
+
+
+#endif //_GPU_SORT_H_INCLUDED_
@@ -0,0 +1,38 @@
+//--------------------------------------------------------------------------------------
+// Include file for the GPU bitonic sort
+//--------------------------------------------------------------------------------------
+// Used by BitonicSortBlock_cs and BitonicSortStep_cs, see GpuSort.h. The buffer holds key / value pairs (x / y) sorted
+// into ascending order of key
+
+// These variables must match exactly the SortConstants structure in Common.h
+#define SORT_BLOCK_SIZE 1024
+#define SORT_GROUP_SIZE (SORT_BLOCK_SIZE / 2)
+
+cbuffer SortConstants : register(b7)
+{
+    uint gSortSize;
+    uint gSortStage;
+    uint gSortStep;
+    uint paddingS;
+}
+
+
+// Each thread compares one pair of elements for a step of a stage. Returns the lower index of the pair, the other is
+// this plus the step
+uint SortPairIndex(uint thread, uint step)
+{
+    return (thread / step) * 2 * step + thread % step;
+}
+
+// Compare a pair and swap them if they are out of order. Sequences of the stage size alternate between ascending and
+// descending order, so merging them in the next stage gives a sorted sequence twice as long
+void SortCompareExchange(inout uint2 lower, inout uint2 upper, uint lowerIndex, uint stage)
+{
+    bool ascending = (lowerIndex & stage) == 0;
+    if ((lower.x > upper.x) == ascending)
+    {
+        uint2 temp = lower;
+        lower = upper;
+        upper = temp;
+    }
+}
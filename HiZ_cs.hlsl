@@ -0,0 +1,49 @@
+//--------------------------------------------------------------------------------------
+// Hierarchical-Z Compute Shader
+//--------------------------------------------------------------------------------------
+// Builds one level of the depth pyramid GpuCull_cs tests against (see GpuCuller.h), one thread per texel. The top level
+// is a copy of the depth buffer, each level below holds the furthest depth of the texels it covers in the level above
+
+#include "GpuCulling.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D<float>   SourceDepth : register(t0); // The depth buffer or the level above
+RWTexture2D<float> TargetDepth : register(u0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+[numthreads(HI_Z_GROUP_SIZE, HI_Z_GROUP_SIZE, 1)]
+void main(uint3 dispatchID : SV_DispatchThreadID)
+{
+    if (any(dispatchID.xy >= gHiZTargetSize))  return;
+
+    if (all(gHiZSourceSize == gHiZTargetSize))
+    {
+        TargetDepth[dispatchID.xy] = SourceDepth.Load(int3(dispatchID.xy, 0));
+        return;
+    }
+
+    // Each texel covers two by two of the level above. A level with an odd size has a row or column left over, which the
+    // last texel takes in too so no depth is ever missed
+    uint2 first = dispatchID.xy * 2;
+    uint2 last  = min(first + 1, gHiZSourceSize - 1);
+    if (dispatchID.x == gHiZTargetSize.x - 1)  last.x = gHiZSourceSize.x - 1;
+    if (dispatchID.y == gHiZTargetSize.y - 1)  last.y = gHiZSourceSize.y - 1;
+
+    float furthest = 0;
+    for (uint y = first.y; y <= last.y; ++y)
+    {
+        for (uint x = first.x; x <= last.x; ++x)
+        {
+            furthest = max(furthest, SourceDepth.Load(int3(x, y, 0)));
+        }
+    }
+    TargetDepth[dispatchID.xy] = furthest;
+}
@@ -0,0 +1,102 @@
+//--------------------------------------------------------------------------------------
+// Image files
+//--------------------------------------------------------------------------------------
+
+#include "ImageFile.h"
+
+#include <Windows.h>
+#include <wincodec.h>
+
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+
+// COM must be initialised on every thread using WIC, which the job system and background threads aren't
+struct ComScope
+{
+	ComScope()   { mResult = CoInitializeEx(nullptr, COINIT_MULTITHREADED); }
+	~ComScope()  { if (SUCCEEDED(mResult))  CoUninitialize(); }
+	HRESULT mResult;
+};
+
+// A new WIC factory. Cheap next to decoding or encoding an image, and means nothing is shared between threads
+IWICImagingFactory* CreateImagingFactory()
+{
+	IWICImagingFactory* factory = nullptr;
+	if (FAILED(CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, __uuidof(IWICImagingFactory), (void**)&factory)))
+	{
+		return nullptr;
+	}
+	return factory;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Image files
+//--------------------------------------------------------------------------------------
+
+bool ReadImageFile(const std::string& fileName, std::vector<uint8_t>& pixels, int& width, int& height)
+{
+	ComScope com;
+	IWICImagingFactory* imaging = CreateImagingFactory();
+	if (imaging == nullptr)  return false;
+	std::wstring wideName(fileName.begin(), fileName.end());
+
+	IWICBitmapDecoder*     decoder   = nullptr;
+	IWICBitmapFrameDecode* source    = nullptr;
+	IWICBitmapSource*      converted = nullptr;
+	UINT sourceWidth = 0, sourceHeight = 0;
+	HRESULT hr = imaging->CreateDecoderFromFilename(wideName.c_str(), nullptr, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &decoder);
+	if (SUCCEEDED(hr))  hr = decoder->GetFrame(0, &source);
+	if (SUCCEEDED(hr))  hr = WICConvertBitmapSource(GUID_WICPixelFormat32bppRGBA, source, &converted);
+	if (SUCCEEDED(hr))  hr = converted->GetSize(&sourceWidth, &sourceHeight);
+	if (SUCCEEDED(hr))
+	{
+		pixels.resize(static_cast<size_t>(sourceWidth) * sourceHeight * 4);
+		hr = converted->CopyPixels(nullptr, sourceWidth * 4, static_cast<UINT>(pixels.size()), pixels.data());
+	}
+	if (converted)  converted->Release();
+	if (source)     source->Release();
+	if (decoder)    decoder->Release();
+	imaging->Release();
+
+	if (FAILED(hr))  return false;
+	width  = static_cast<int>(sourceWidth);
+	height = static_cast<int>(sourceHeight);
+	return true;
+}
+
+
+bool WritePngFile(const std::string& fileName, const uint8_t* pixels, int width, int height)
+{
+	ComScope com;
+	IWICImagingFactory* imaging = CreateImagingFactory();
+	if (imaging == nullptr)  return false;
+	std::wstring wideName(fileName.begin(), fileName.end());
+	UINT stride = width * 4;
+
+	IWICStream*            stream  = nullptr;
+	IWICBitmapEncoder*     encoder = nullptr;
+	IWICBitmapFrameEncode* target  = nullptr;
+	IWICBitmap*            bitmap  = nullptr;
+	HRESULT hr = imaging->CreateStream(&stream);
+	if (SUCCEEDED(hr))  hr = stream->InitializeFromFilename(wideName.c_str(), GENERIC_WRITE);
+	if (SUCCEEDED(hr))  hr = imaging->CreateEncoder(GUID_ContainerFormatPng, nullptr, &encoder);
+	if (SUCCEEDED(hr))  hr = encoder->Initialize(stream, WICBitmapEncoderNoCache);
+	if (SUCCEEDED(hr))  hr = encoder->CreateNewFrame(&target, nullptr);
+	if (SUCCEEDED(hr))  hr = target->Initialize(nullptr);
+	if (SUCCEEDED(hr))  hr = target->SetSize(width, height);
+	if (SUCCEEDED(hr))  hr = imaging->CreateBitmapFromMemory(width, height, GUID_WICPixelFormat32bppRGBA, stride, stride * height,
+	                                                         const_cast<BYTE*>(pixels), &bitmap); // Only read
+	if (SUCCEEDED(hr))  hr = target->WriteSource(bitmap, nullptr); // Converts to a format the encoder supports
+	if (SUCCEEDED(hr))  hr = target->Commit();
+	if (SUCCEEDED(hr))  hr = encoder->Commit();
+	if (bitmap)   bitmap->Release();
+	if (target)   target->Release();
+	if (encoder)  encoder->Release();
+	if (stream)   stream->Release();
+	imaging->Release();
+
+	return SUCCEEDED(hr);
+}
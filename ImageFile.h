@@ -0,0 +1,22 @@
+//--------------------------------------------------------------------------------------
+// Image files
+//--------------------------------------------------------------------------------------
+// Reading and writing whole images as 8-bit RGBA pixels using WIC. Can be called from any thread, including job
+// system and background threads, as each call sets up COM and WIC for itself
+
+#ifndef _IMAGE_FILE_H_INCLUDED_
+#define _IMAGE_FILE_H_INCLUDED_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Read any image format WIC can decode (PNG, JPEG, BMP, TIFF...), converted to RGBA rows with no padding. Returns
+// false if the file can't be read
+bool ReadImageFile(const std::string& fileName, std::vector<uint8_t>& pixels, int& width, int& height);
+
+// Write RGBA rows with no padding to a PNG file. Returns false if the file can't be written
+bool WritePngFile(const std::string& fileName, const uint8_t* pixels, int width, int height);
+
+
+#endif //_IMAGE_FILE_H_INCLUDED_
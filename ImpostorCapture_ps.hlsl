@@ -0,0 +1,36 @@
+//--------------------------------------------------------------------------------------
+// Impostor Capture Pixel Shader
+//--------------------------------------------------------------------------------------
+// Draws one view of a mesh into its impostor atlas (see Impostors.h). The surface is stored unlit so the impostor can be
+// lit where it is drawn: the material in the first target as the texture holds it (diffuse in rgb, specular in a), and
+// the normal in the second. The mesh is drawn in model space, so the "world" normal from the vertex shader is the model
+// space normal. Nothing else writes the alpha of the second target, which marks the texels the mesh covers
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    DiffuseSpecularMap : register(t0); // Diffuse map in rgb and specular map in a, as for PixelLighting_ps
+SamplerState TexSampler         : register(s0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+struct ImpostorCaptureOutput
+{
+    float4 material : SV_Target0;
+    float4 normal   : SV_Target1; // Model space normal scaled into the range 0 to 1, coverage in a
+};
+
+ImpostorCaptureOutput main(LightingPixelShaderInput input)
+{
+    ImpostorCaptureOutput output;
+    output.material = DiffuseSpecularMap.Sample(TexSampler, input.uv);
+    output.normal   = float4(normalize(input.worldNormal) * 0.5f + 0.5f, 1);
+    return output;
+}
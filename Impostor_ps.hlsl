@@ -0,0 +1,78 @@
+//--------------------------------------------------------------------------------------
+// Impostor Pixel Shader
+//--------------------------------------------------------------------------------------
+// Blends the four views of the impostor atlas chosen by Impostor_vs, then lights the result as PixelLighting_ps lights
+// the models, with the lights in the pixel's cluster. With GBUFFER defined to 1 the surface is written to the G-buffer
+// instead, as GBuffer_ps does. Texels outside the mesh have zero coverage and are cut out, so the impostors need no
+// blending and write depth like any opaque model
+
+#if GBUFFER
+#include "GBuffer.hlsli"
+#else
+#include "Lighting.hlsli"
+#endif
+#include "Impostors.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2DArray ImpostorAtlas : register(t0); // Slice 0 the material, slice 1 the model space normal with coverage in a
+SamplerState   TexSampler    : register(s0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+#if GBUFFER
+struct GBufferOutput
+{
+    float4 material : SV_Target0;
+    float2 normal   : SV_Target1;
+};
+
+GBufferOutput main(ImpostorPixelShaderInput input)
+#else
+float4 main(ImpostorPixelShaderInput input) : SV_Target
+#endif
+{
+    float2 cellUV[4] = { input.cellUV[0].xy, input.cellUV[0].zw, input.cellUV[1].xy, input.cellUV[1].zw };
+    float cellSize = 1.0f / gImpostorGrid;
+
+    // Each view is clamped to its own cell so the neighbouring views don't bleed in
+    float4 material = 0;
+    float4 normal = 0;
+    [unroll] for (int v = 0; v < 4; ++v)
+    {
+        float2 uv = cellUV[v] + saturate(input.viewUV[v]) * cellSize;
+        material += ImpostorAtlas.Sample(TexSampler, float3(uv, 0)) * input.weights[v];
+        normal   += ImpostorAtlas.Sample(TexSampler, float3(uv, 1)) * input.weights[v];
+    }
+
+    // Filtering blends in the empty texels around the mesh, which are zero, so both are divided by the coverage
+    clip(normal.a - 0.5f);
+    material /= normal.a;
+    float3 modelNormal = normal.rgb / normal.a * 2 - 1;
+    float3 worldNormal = normalize(modelNormal.x * input.worldAxes[0] + modelNormal.y * input.worldAxes[1] +
+                                   modelNormal.z * input.worldAxes[2]);
+
+#if GBUFFER
+    GBufferOutput output;
+    output.material = material;
+    output.normal   = EncodeNormal(worldNormal);
+    return output;
+#else
+    float3 cameraDirection = normalize(gCameraPosition - input.worldPosition);
+
+    float3 diffuseLight = gAmbientColour;
+    float3 specularLight = 0;
+    float viewDepth = mul(gViewMatrix, float4(input.worldPosition, 1.0f)).z;
+    AddClusterLights(input.projectedPosition.xy, viewDepth, input.worldPosition, worldNormal, cameraDirection,
+                     diffuseLight, specularLight);
+
+    float3 finalColour = diffuseLight * material.rgb + specularLight * material.a;
+    return float4(finalColour, 1.0f);
+#endif
+}
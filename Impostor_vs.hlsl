@@ -0,0 +1,65 @@
+//--------------------------------------------------------------------------------------
+// Impostor Vertex Shader
+//--------------------------------------------------------------------------------------
+// Draws each model as a quad facing the camera, covering its mesh's bounding sphere, textured from the views captured
+// in the impostor atlas (see Impostors.h). There is no vertex buffer: the quads are drawn as instanced four vertex
+// triangle strips, the instance ID picks the model's world matrix from the instance buffer and the vertex ID the corner.
+// The direction to the camera picks the four views captured nearest to it, blended by how near each is
+
+#include "Impostors.hlsli"
+#include "Instancing.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+ImpostorPixelShaderInput main(uint vertexID : SV_VertexID, uint instanceID : SV_InstanceID)
+{
+    ImpostorPixelShaderInput output;
+
+    float4x4 worldMatrix = gInstances[instanceID].worldMatrix;
+
+    // Direction from the centre of the mesh to the camera in model space. Multiplying on the left by the world matrix
+    // is multiplying by its transpose, which undoes its rotation, and its scale is normalised away
+    float3 worldCentre = mul(worldMatrix, float4(gImpostorCentre, 1)).xyz;
+    float3 toCamera = normalize(mul(float4(gCameraPosition - worldCentre, 0), worldMatrix).xyz);
+
+    // Corners -1 to 1 along the axes of the view from the camera's direction, so the quad faces the camera
+    float3 right, up;
+    ImpostorAxes(toCamera, right, up);
+    float2 corner = float2((vertexID & 1) ? 1 : -1, (vertexID & 2) ? -1 : 1);
+    float3 offset = (right * corner.x + up * corner.y) * gImpostorRadius;
+
+    float4 worldPosition = mul(worldMatrix, float4(gImpostorCentre + offset, 1));
+    output.projectedPosition = mul(gViewProjectionMatrix, worldPosition);
+    output.worldPosition     = worldPosition.xyz;
+
+    // The four cells around where the direction falls in the octahedral square, weighted bilinearly between their
+    // centres. Directions beyond the outer cell centres use the outer cells
+    float grid = gImpostorGrid;
+    float2 cell = clamp((ImpostorSquare(toCamera) * 0.5f + 0.5f) * grid - 0.5f, 0, grid - 1);
+    float2 base = min(floor(cell), grid - 2);
+    float2 blend = cell - base;
+    output.weights = float4((1 - blend.x) * (1 - blend.y), blend.x * (1 - blend.y), (1 - blend.x) * blend.y, blend.x * blend.y);
+
+    // Each view's uvs found by projecting the corner onto the plane it was captured in, as the capture's orthographic
+    // projection of the bounding sphere did
+    float2 cellUV[4];
+    [unroll] for (int v = 0; v < 4; ++v)
+    {
+        float2 viewCell = base + float2(v & 1, v >> 1);
+        float3 viewRight, viewUp;
+        ImpostorAxes(ImpostorDirection((viewCell + 0.5f) / grid * 2 - 1), viewRight, viewUp);
+        output.viewUV[v] = float2(dot(offset, viewRight), -dot(offset, viewUp)) / (2 * gImpostorRadius) + 0.5f;
+        cellUV[v] = viewCell / grid;
+    }
+    output.cellUV[0] = float4(cellUV[0], cellUV[1]);
+    output.cellUV[1] = float4(cellUV[2], cellUV[3]);
+
+    output.worldAxes[0] = mul(worldMatrix, float4(1, 0, 0, 0)).xyz;
+    output.worldAxes[1] = mul(worldMatrix, float4(0, 1, 0, 0)).xyz;
+    output.worldAxes[2] = mul(worldMatrix, float4(0, 0, 1, 0)).xyz;
+
+    return output;
+}
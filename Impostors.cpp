@@ -0,0 +1,353 @@
+//--------------------------------------------------------------------------------------
+// Octahedral impostors
+//--------------------------------------------------------------------------------------
+// See Impostors.h for an overview
+
+#include "Impostors.h"
+#include "Mesh.h"
+#include "Model.h"
+#include "Shader.h"
+#include "State.h"
+#include "StateCache.h"
+#include "InstanceBufferRing.h"
+#include "ResourceRegistry.h"
+#include "CpuProfiler.h"
+#include "GraphicsHelpers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+Impostors gImpostors;
+
+const float Impostors::MAX_SCREEN_SIZE = static_cast<float>(Impostors::CELL_SIZE);
+
+
+namespace
+{
+	const int ATLAS_SIZE = Impostors::GRID * Impostors::CELL_SIZE;
+
+	// Mips of the atlases, stopping while each view is still 4 pixels across so the views don't bleed into each other
+	const UINT ATLAS_MIP_LEVELS = 5;
+
+	// The direction the mesh is seen from in a cell of the octahedral square, with y as the pole so the top half of the
+	// sphere fills the middle of the atlas. Must match ImpostorDirection in Impostors.hlsli
+	CVector3 ImpostorDirection(int cellX, int cellY)
+	{
+		float u = (cellX + 0.5f) * 2 / Impostors::GRID - 1;
+		float v = (cellY + 0.5f) * 2 / Impostors::GRID - 1;
+		CVector3 direction = { u, 1 - std::abs(u) - std::abs(v), v };
+		if (direction.y < 0)
+		{
+			direction.x = (1 - std::abs(v)) * (u >= 0 ? 1 : -1);
+			direction.z = (1 - std::abs(u)) * (v >= 0 ? 1 : -1);
+		}
+		return Normalise(direction);
+	}
+
+	// The right and up axes of the view from a direction. Must match ImpostorAxes in Impostors.hlsli
+	void ImpostorAxes(const CVector3& direction, CVector3& right, CVector3& up)
+	{
+		CVector3 forward = { -direction.x, -direction.y, -direction.z };
+		CVector3 worldUp = (std::abs(direction.y) > 0.999f ? CVector3{ 0, 0, 1 } : CVector3{ 0, 1, 0 });
+		right = Normalise(Cross(worldUp, forward));
+		up = Cross(forward, right);
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+Impostors::~Impostors()
+{
+	Release();
+}
+
+
+bool Impostors::Capture(Mesh* mesh, ID3D11ShaderResourceView* const* texture)
+{
+	if (Find(mesh) != nullptr)  return true;
+	if (mesh->HasBones())
+	{
+		gLastError = "Impostors can't be captured of skinned meshes";
+		return false;
+	}
+
+	if (mDepthStencil == nullptr)
+	{
+		D3D11_TEXTURE2D_DESC depthDesc = {};
+		depthDesc.Width = ATLAS_SIZE;
+		depthDesc.Height = ATLAS_SIZE;
+		depthDesc.MipLevels = 1;
+		depthDesc.ArraySize = 1;
+		depthDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		depthDesc.SampleDesc.Count = 1;
+		depthDesc.Usage = D3D11_USAGE_DEFAULT;
+		depthDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+		if (FAILED(gD3DDevice->CreateTexture2D(&depthDesc, nullptr, &mDepthBuffer)) ||
+		    FAILED(gD3DDevice->CreateDepthStencilView(mDepthBuffer, nullptr, &mDepthStencil)))
+		{
+			if (mDepthBuffer)  mDepthBuffer->Release();
+			mDepthBuffer = nullptr;
+			gLastError = "Error creating impostor depth buffer";
+			return false;
+		}
+		gResourceRegistry.Track(mDepthBuffer);
+	}
+
+	// The bounding sphere of the whole mesh in its default pose, around the box of all the parts that have geometry
+	unsigned int numNodes = mesh->NumberNodes();
+	std::vector<CMatrix4x4> relative(numNodes), absolute(numNodes);
+	for (unsigned int node = 0; node < numNodes; ++node)  relative[node] = mesh->GetNodeDefaultMatrix(node);
+	ConcatenateHierarchy(relative.data(), mesh->GetNodeParents(), numNodes, absolute.data());
+
+	bool first = true;
+	BoundingBox bounds = { { 0, 0, 0 }, { 0, 0, 0 } };
+	for (unsigned int node = 0; node < numNodes; ++node)
+	{
+		if (!mesh->NodeHasGeometry(node))  continue;
+		BoundingBox nodeBounds = TransformBox(mesh->GetNodeBoundingBox(node), absolute[node]);
+		bounds = first ? nodeBounds : Union(bounds, nodeBounds);
+		first = false;
+	}
+
+	Impostor impostor;
+	impostor.mesh    = mesh;
+	impostor.texture = texture;
+	impostor.centre  = bounds.Centre();
+	impostor.radius  = std::max(Length(bounds.HalfExtents()), 0.001f);
+	if (!CreateAtlas(impostor))
+	{
+		ReleaseImpostor(impostor);
+		return false; // Reason is in gLastError
+	}
+	DrawViews(impostor);
+	mImpostors.push_back(impostor);
+	return true;
+}
+
+
+int Impostors::Update()
+{
+	int numCaptured = 0;
+	for (auto& impostor : mImpostors)
+	{
+		if (*impostor.texture == impostor.capturedTexture)  continue;
+		DrawViews(impostor);
+		++numCaptured;
+	}
+	return numCaptured;
+}
+
+
+void Impostors::Release()
+{
+	for (auto& impostor : mImpostors)  ReleaseImpostor(impostor);
+	mImpostors.clear();
+	if (mDepthStencil)  mDepthStencil->Release();
+	if (mDepthBuffer)   mDepthBuffer->Release();
+	mDepthStencil = nullptr;
+	mDepthBuffer = nullptr;
+	mNumCaptures = 0;
+}
+
+
+void Impostors::Render(Mesh* mesh, Model* const models[], unsigned int numModels)
+{
+	Impostor* impostor = Find(mesh);
+	if (impostor == nullptr || numModels == 0)  return;
+	CPU_PROFILE_SCOPE("Impostors::Render");
+
+	gStateCache.SetConstantBuffer(IMPOSTOR_CONSTANTS_SLOT, impostor->constants);
+	gD3DContext->PSSetShaderResources(0, 1, &impostor->atlasSRV);
+
+	// No vertex buffer, each quad is a four vertex triangle strip placed by the vertex shader from the instance data
+	gStateCache.IASetInputLayout(nullptr);
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	for (unsigned int first = 0; first < numModels; first += MAX_INSTANCES)
+	{
+		unsigned int count = std::min(numModels - first, static_cast<unsigned int>(MAX_INSTANCES));
+
+		InstanceData* instances = MapInstances();
+		if (instances == nullptr)  return;
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			instances[i].worldMatrix  = models[first + i]->WorldMatrix();
+			instances[i].objectColour = { 1, 1, 1 };
+			instances[i].textureSlice = 0;
+		}
+		UnmapInstances();
+		gD3DContext->DrawInstanced(4, count, 0, 0);
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Data access
+//--------------------------------------------------------------------------------------
+
+bool Impostors::Replaces(Model* model, const CVector3& viewPoint, float pixelsPerUnit)
+{
+	Impostor* impostor = Find(model->GetMesh());
+	if (impostor == nullptr)  return false;
+
+	CMatrix4x4 world = model->WorldMatrix();
+	CVector3 scale = world.GetScale();
+	float radius = impostor->radius * std::max(scale.x, std::max(scale.y, scale.z));
+	float distance = Length(TransformPoint(impostor->centre, world) - viewPoint);
+	return distance > radius && 2 * radius * pixelsPerUnit / distance <= MAX_SCREEN_SIZE;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+Impostors::Impostor* Impostors::Find(Mesh* mesh)
+{
+	for (auto& impostor : mImpostors)
+	{
+		if (impostor.mesh == mesh)  return &impostor;
+	}
+	return nullptr;
+}
+
+
+bool Impostors::CreateAtlas(Impostor& impostor)
+{
+	// The mips of both slices are built after each capture. Texels no view covers are left at zero in both, so
+	// the mips hold the material premultiplied by coverage and the impostor shader divides it back out
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = ATLAS_SIZE;
+	textureDesc.Height = ATLAS_SIZE;
+	textureDesc.MipLevels = ATLAS_MIP_LEVELS;
+	textureDesc.ArraySize = 2;
+	textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	textureDesc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+	if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, nullptr, &impostor.atlas)) ||
+	    FAILED(gD3DDevice->CreateShaderResourceView(impostor.atlas, nullptr, &impostor.atlasSRV)))
+	{
+		gLastError = "Error creating impostor atlas";
+		return false;
+	}
+	gResourceRegistry.Track(impostor.atlas);
+
+	D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
+	rtvDesc.Format = textureDesc.Format;
+	rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
+	rtvDesc.Texture2DArray.MipSlice = 0;
+	rtvDesc.Texture2DArray.ArraySize = 1;
+	for (int slice = 0; slice < 2; ++slice)
+	{
+		rtvDesc.Texture2DArray.FirstArraySlice = slice;
+		if (FAILED(gD3DDevice->CreateRenderTargetView(impostor.atlas, &rtvDesc, &impostor.targets[slice])))
+		{
+			gLastError = "Error creating impostor atlas render targets";
+			return false;
+		}
+	}
+
+	impostor.constants = CreateConstantBuffer(sizeof(ImpostorConstants));
+	if (impostor.constants == nullptr)
+	{
+		gLastError = "Error creating impostor constant buffer";
+		return false;
+	}
+	ImpostorConstants constants = {};
+	constants.impostorCentre = impostor.centre;
+	constants.impostorRadius = impostor.radius;
+	constants.impostorGrid   = GRID;
+	UpdateConstantBuffer(impostor.constants, constants);
+	return true;
+}
+
+
+void Impostors::DrawViews(Impostor& impostor)
+{
+	CPU_PROFILE_SCOPE("Impostors::DrawViews");
+
+	// The mesh in its default pose, its root at the origin so the views are in model space
+	Mesh* mesh = impostor.mesh;
+	unsigned int numNodes = mesh->NumberNodes();
+	std::vector<CMatrix4x4> relative(numNodes), absolute(numNodes);
+	for (unsigned int node = 0; node < numNodes; ++node)  relative[node] = mesh->GetNodeDefaultMatrix(node);
+	ConcatenateHierarchy(relative.data(), mesh->GetNodeParents(), numNodes, absolute.data());
+
+	const float clear[4] = { 0, 0, 0, 0 };
+	for (auto target : impostor.targets)  gD3DContext->ClearRenderTargetView(target, clear);
+	gD3DContext->ClearDepthStencilView(mDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
+	gD3DContext->OMSetRenderTargets(2, impostor.targets, mDepthStencil);
+
+	// The lighting vertex shader passes the normals on in "world" space, which is model space here
+	gStateCache.VSSetShader(gPixelLightingVertexShader, nullptr, 0);
+	gStateCache.PSSetShader(gImpostorCapturePixelShader, nullptr, 0);
+	gStateCache.GSSetShader(nullptr, nullptr, 0);
+	gStateCache.OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
+	gStateCache.OMSetDepthStencilState(gUseDepthBufferState, 0);
+	gStateCache.RSSetState(gCullBackState);
+	gStateCache.SetSampler(0, gAnisotropic4xSampler);
+	gStateCache.SetConstantBuffer(PER_FRAME_CONSTANTS_SLOT, gPerFrameConstantBuffer);
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	ID3D11ShaderResourceView* texture = *impostor.texture;
+	gD3DContext->PSSetShaderResources(0, 1, &texture);
+
+	// Each view is an orthographic projection of the bounding sphere, looking at its centre from twice its radius away
+	const float radius = impostor.radius;
+	const float nearClip = 0.9f * radius;
+	const float farClip  = 3.1f * radius;
+	const float depthScale = 1 / (farClip - nearClip);
+	gPerFrameConstants.projectionMatrix = { 1 / radius, 0,          0,                      0,
+	                                        0,          1 / radius, 0,                      0,
+	                                        0,          0,          depthScale,             0,
+	                                        0,          0,          -nearClip * depthScale, 1 };
+	for (int cellY = 0; cellY < GRID; ++cellY)
+	{
+		for (int cellX = 0; cellX < GRID; ++cellX)
+		{
+			CVector3 direction = ImpostorDirection(cellX, cellY);
+			CVector3 right, up;
+			ImpostorAxes(direction, right, up);
+
+			CMatrix4x4 cameraMatrix = MatrixIdentity();
+			cameraMatrix.SetRow(0, right);
+			cameraMatrix.SetRow(1, up);
+			cameraMatrix.SetRow(2, { -direction.x, -direction.y, -direction.z });
+			cameraMatrix.SetRow(3, impostor.centre + direction * (2 * radius));
+			gPerFrameConstants.viewMatrix = InverseAffine(cameraMatrix);
+			gPerFrameConstants.viewProjectionMatrix = gPerFrameConstants.viewMatrix * gPerFrameConstants.projectionMatrix;
+			UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
+
+			D3D11_VIEWPORT viewport = { static_cast<float>(cellX * CELL_SIZE), static_cast<float>(cellY * CELL_SIZE),
+			                            static_cast<float>(CELL_SIZE), static_cast<float>(CELL_SIZE), 0.0f, 1.0f };
+			gD3DContext->RSSetViewports(1, &viewport);
+			mesh->Render(absolute.data());
+		}
+	}
+
+	gD3DContext->OMSetRenderTargets(0, nullptr, nullptr);
+	gD3DContext->GenerateMips(impostor.atlasSRV);
+	impostor.capturedTexture = texture;
+	++mNumCaptures;
+}
+
+
+void Impostors::ReleaseImpostor(Impostor& impostor)
+{
+	if (impostor.constants)  impostor.constants->Release();
+	for (auto& target : impostor.targets)
+	{
+		if (target)  target->Release();
+		target = nullptr;
+	}
+	if (impostor.atlasSRV)  impostor.atlasSRV->Release();
+	if (impostor.atlas)     impostor.atlas->Release();
+	impostor.constants = nullptr;
+	impostor.atlasSRV = nullptr;
+	impostor.atlas = nullptr;
+}
@@ -0,0 +1,117 @@
+//--------------------------------------------------------------------------------------
+// Octahedral impostors
+//--------------------------------------------------------------------------------------
+// Far-away models still cost a draw each, however small they are on screen. A mesh with an impostor is captured once
+// from GRID x GRID directions into an atlas, then models using it that are small enough on screen are drawn as
+// camera-facing quads instead, all those sharing a mesh with one instanced draw (see Scene.cpp).
+//
+// The directions are spread over the whole sphere with an octahedral mapping: the sphere is folded onto an octahedron
+// that is flattened to a square, and each cell of the square is the view from the direction at its centre. Each view
+// is an orthographic projection of the mesh's bounding sphere in its default pose, holding the unlit material (diffuse
+// in rgb, specular in a) and the model space normal and coverage, so the impostors are lit as the models would be.
+// Drawing a quad finds where the direction to the camera falls in the square, then blends the four nearest views by how
+// close they are, each reprojected onto the quad, so the impostor turns smoothly as the camera moves round it.
+//
+// The views are captured on the GPU when the mesh is given to Capture, with the texture the mesh is drawn with. That
+// texture global is read again each Update, as streamed textures are replaced when they load, and the views captured
+// again when it has changed. Only rigid meshes can be captured - the bones of a skinned mesh move it anywhere
+
+#ifndef _IMPOSTORS_H_INCLUDED_
+#define _IMPOSTORS_H_INCLUDED_
+
+#include "CVector3.h"
+
+#include <d3d11.h>
+#include <vector>
+
+class Mesh;
+class Model;
+
+
+class Impostors
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~Impostors();
+
+	// Create an atlas for a mesh and capture its views with the texture global given. Does nothing if the mesh already
+	// has an impostor. Main thread only, uses the immediate context and writes the camera matrices of the per-frame
+	// constants. Returns false on failure (reason in gLastError)
+	bool Capture(Mesh* mesh, ID3D11ShaderResourceView* const* texture);
+
+	// Capture the views again of any mesh whose texture has changed since they were last captured, returns the number
+	// captured. As Capture, so call before binding the camera
+	int Update();
+
+	// Release all the atlases
+	void Release();
+
+
+	// Draw the impostors of the given models, which must all use the mesh given, with one instanced draw for each
+	// MAX_INSTANCES models. The impostor shaders and the pass states must already be selected. Any context
+	void Render(Mesh* mesh, Model* const models[], unsigned int numModels);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// Whether the mesh has an impostor. Any thread, while no impostors are being captured
+	bool Has(Mesh* mesh)  { return Find(mesh) != nullptr; }
+
+	// Whether a model would be drawn as its impostor from a view point: its mesh must have an impostor and its bounding
+	// sphere must be no more than MAX_SCREEN_SIZE pixels across. pixelsPerUnit is the size in pixels of one unit at a
+	// distance of one, as for Model::SelectLod
+	bool Replaces(Model* model, const CVector3& viewPoint, float pixelsPerUnit);
+
+	int NumImpostors()  { return static_cast<int>(mImpostors.size()); }
+	int NumCaptures()   { return mNumCaptures; } // Views captured since the impostors were last released, in whole atlases
+
+	// Views across and down each atlas and the pixels across each view. A model is only replaced once it is smaller
+	// than its view, so the impostor is never magnified
+	static const int   GRID      = 8;
+	static const int   CELL_SIZE = 64;
+	static const float MAX_SCREEN_SIZE;
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	struct Impostor
+	{
+		Mesh*                            mesh;
+		ID3D11ShaderResourceView* const* texture;
+		ID3D11ShaderResourceView*        capturedTexture = nullptr; // What *texture was when the views were captured
+		CVector3                         centre;   // Bounding sphere in model space
+		float                            radius;
+		ID3D11Texture2D*                 atlas = nullptr;
+		ID3D11ShaderResourceView*        atlasSRV = nullptr;
+		ID3D11RenderTargetView*          targets[2] = {}; // Material and normal slices
+		ID3D11Buffer*                    constants = nullptr;
+	};
+
+	Impostor* Find(Mesh* mesh);
+
+	// Create the atlas, its views and constants of an impostor, returns false on failure (reason in gLastError)
+	bool CreateAtlas(Impostor& impostor);
+
+	// Draw every view of the mesh into the impostor's atlas then build its mip levels
+	void DrawViews(Impostor& impostor);
+
+	void ReleaseImpostor(Impostor& impostor);
+
+	std::vector<Impostor>   mImpostors;
+	ID3D11Texture2D*        mDepthBuffer = nullptr; // Shared by every capture, all the atlases are the same size
+	ID3D11DepthStencilView* mDepthStencil = nullptr;
+	int                     mNumCaptures = 0;
+};
+
+
+extern Impostors gImpostors;
+
+
+#endif //_IMPOSTORS_H_INCLUDED_
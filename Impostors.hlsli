@@ -0,0 +1,57 @@
+//--------------------------------------------------------------------------------------
+// Include file for the impostors
+//--------------------------------------------------------------------------------------
+// The views of each mesh are captured by ImpostorCapture_ps and drawn by Impostor_vs / Impostor_ps, see Impostors.h
+
+#include "Common.hlsli"
+
+
+// These variables must match exactly the ImpostorConstants structure in Common.h
+cbuffer ImpostorConstants : register(b9)
+{
+    float3 gImpostorCentre; // Of the mesh's bounding sphere, in model space
+    float  gImpostorRadius;
+    uint   gImpostorGrid;   // Views across and down the atlas
+    float3 paddingI;
+}
+
+
+// The direction the mesh was seen from at a point of the octahedral square (-1 to 1 across), y is the pole. Matches
+// ImpostorDirection in Impostors.cpp
+float3 ImpostorDirection(float2 square)
+{
+    float3 direction = float3(square.x, 1 - abs(square.x) - abs(square.y), square.y);
+    if (direction.y < 0)  direction.xz = (1 - abs(square.yx)) * (square >= 0 ? 1 : -1);
+    return normalize(direction);
+}
+
+// The point of the octahedral square a direction falls on, the inverse of the above
+float2 ImpostorSquare(float3 direction)
+{
+    direction /= abs(direction.x) + abs(direction.y) + abs(direction.z);
+    float2 square = direction.xz;
+    if (direction.y < 0)  square = (1 - abs(direction.zx)) * (square >= 0 ? 1 : -1);
+    return square;
+}
+
+// The right and up axes of the view from a direction. Matches ImpostorAxes in Impostors.cpp
+void ImpostorAxes(float3 direction, out float3 right, out float3 up)
+{
+    float3 forward = -direction;
+    float3 worldUp = abs(direction.y) > 0.999f ? float3(0, 0, 1) : float3(0, 1, 0);
+    right = normalize(cross(worldUp, forward));
+    up = cross(forward, right);
+}
+
+
+// What the impostor pixel shader receives. Each of the four views blended has its own uvs within the view, reprojected
+// from the quad, and the corner of its cell in the atlas
+struct ImpostorPixelShaderInput
+{
+    float4 projectedPosition : SV_Position;
+    float3 worldPosition     : worldPosition;
+    float2 viewUV[4]         : viewUV;
+    nointerpolation float4 cellUV[2] : cellUV;   // Top-left of each view's cell in atlas uvs, two to each
+    nointerpolation float4 weights   : weights;  // Of each view, adding up to one
+    nointerpolation float3 worldAxes[3] : worldAxes; // The model's x, y and z axes in world space, for the normals
+};
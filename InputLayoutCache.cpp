@@ -0,0 +1,82 @@
+//--------------------------------------------------------------------------------------
+// Input layout cache
+//--------------------------------------------------------------------------------------
+
+#include "InputLayoutCache.h"
+#include "Shader.h" // For CreateSignatureForVertexLayout
+#include "Common.h"
+
+
+InputLayoutCache gInputLayoutCache;
+
+
+InputLayoutCache::~InputLayoutCache()
+{
+	ReleaseAll();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Usage
+//--------------------------------------------------------------------------------------
+
+ID3D11InputLayout* InputLayoutCache::Get(const D3D11_INPUT_ELEMENT_DESC vertexLayout[], int numElements)
+{
+	std::string key = MakeKey(vertexLayout, numElements);
+
+	// The lock is held while a new layout is created so two threads loading meshes with the same layout don't both compile
+	// a signature for it. New layouts are rare after the first few meshes so this doesn't hold up other threads for long
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto found = mLayouts.find(key);
+	if (found == mLayouts.end())
+	{
+		Entry entry;
+		entry.signature = CreateSignatureForVertexLayout(vertexLayout, numElements);
+		if (entry.signature == nullptr)  return nullptr;
+
+		HRESULT hr = gD3DDevice->CreateInputLayout(vertexLayout, numElements, entry.signature->GetBufferPointer(),
+		                                           entry.signature->GetBufferSize(), &entry.layout);
+		if (FAILED(hr))
+		{
+			entry.signature->Release();
+			return nullptr;
+		}
+		found = mLayouts.emplace(key, entry).first;
+	}
+
+	found->second.layout->AddRef();
+	return found->second.layout;
+}
+
+
+void InputLayoutCache::ReleaseAll()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (auto& layout : mLayouts)
+	{
+		layout.second.layout->Release();
+		layout.second.signature->Release();
+	}
+	mLayouts.clear();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+std::string InputLayoutCache::MakeKey(const D3D11_INPUT_ELEMENT_DESC vertexLayout[], int numElements)
+{
+	std::string key;
+	for (int elt = 0; elt < numElements; ++elt)
+	{
+		// Semantic names can't contain spaces, so a space separates the name from the binary fields that follow
+		const D3D11_INPUT_ELEMENT_DESC& element = vertexLayout[elt];
+		key += element.SemanticName;
+		key += ' ';
+		UINT fields[] = { element.SemanticIndex, static_cast<UINT>(element.Format), element.InputSlot,
+		                  element.AlignedByteOffset, static_cast<UINT>(element.InputSlotClass), element.InstanceDataStepRate };
+		key.append(reinterpret_cast<const char*>(fields), sizeof(fields));
+	}
+	return key;
+}
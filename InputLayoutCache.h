@@ -0,0 +1,65 @@
+//--------------------------------------------------------------------------------------
+// Input layout cache
+//--------------------------------------------------------------------------------------
+// Creating an input layout needs the signature of a vertex shader using that layout, which is made by compiling a small
+// shader (see CreateSignatureForVertexLayout). That compile is slow, and most meshes share the same few layouts, so
+// the cache creates each unique layout once and hands out the same input layout for every mesh that uses it. Sharing
+// layouts also means the state cache sees fewer input layout changes from one mesh to the next
+
+#ifndef _INPUT_LAYOUT_CACHE_H_INCLUDED_
+#define _INPUT_LAYOUT_CACHE_H_INCLUDED_
+
+#include <d3d11.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+
+class InputLayoutCache
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~InputLayoutCache();
+
+	// Get the input layout for the given vertex elements, creating it if this layout has not been seen before. The
+	// layout has an extra reference for the caller, who must release it. Returns nullptr on failure. Safe to call from
+	// any thread (meshes are created on worker threads)
+	ID3D11InputLayout* Get(const D3D11_INPUT_ELEMENT_DESC vertexLayout[], int numElements);
+
+	// Release the cache's references to all layouts (layouts still held by meshes stay valid until they are released)
+	void ReleaseAll();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	int NumLayouts()  { std::lock_guard<std::mutex> lock(mMutex);  return static_cast<int>(mLayouts.size()); }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	struct Entry
+	{
+		ID3DBlob*          signature;
+		ID3D11InputLayout* layout;
+	};
+
+	// The key for a layout - every field of every element, with the semantic names as text
+	std::string MakeKey(const D3D11_INPUT_ELEMENT_DESC vertexLayout[], int numElements);
+
+
+	std::mutex                             mMutex; // Guards mLayouts
+	std::unordered_map<std::string, Entry> mLayouts;
+};
+
+
+extern InputLayoutCache gInputLayoutCache;
+
+
+#endif //_INPUT_LAYOUT_CACHE_H_INCLUDED_
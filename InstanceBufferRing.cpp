@@ -0,0 +1,139 @@
+//--------------------------------------------------------------------------------------
+// Instance buffer ring
+//--------------------------------------------------------------------------------------
+// See InstanceBufferRing.h for an overview
+
+#include "InstanceBufferRing.h"
+#include "ResourceRegistry.h"
+
+
+InstanceBufferRing gImmediateInstanceRing;
+thread_local InstanceBufferRing* gInstanceRing = nullptr;
+
+// What MapInstances mapped on this thread, for UnmapInstances
+thread_local InstanceBufferRing*       tMappedRing = nullptr;
+thread_local ID3D11ShaderResourceView* tMappedView = nullptr;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+bool InstanceBufferRing::Init()
+{
+	Release();
+
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if (FAILED(gD3DDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) ||
+	    !options.MapNoOverwriteOnDynamicBufferSRV)
+	{
+		gLastError = "No-overwrite maps of shader resource buffers aren't supported";
+		return false;
+	}
+
+	const unsigned int numBlocks = BLOCKS_PER_FRAME * MAX_FRAMES_IN_FLIGHT;
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = numBlocks * MAX_INSTANCES * sizeof(InstanceData);
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = sizeof(InstanceData);
+	if (FAILED(gD3DDevice->CreateBuffer(&desc, nullptr, &mBuffer)))
+	{
+		mBuffer = nullptr;
+		gLastError = "Error creating instance buffer ring";
+		return false;
+	}
+	gResourceRegistry.Track(mBuffer);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN; // Structured buffers have no format
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.NumElements = MAX_INSTANCES;
+	mBlockViews.assign(numBlocks, nullptr);
+	for (unsigned int block = 0; block < numBlocks; ++block)
+	{
+		srvDesc.Buffer.FirstElement = block * MAX_INSTANCES;
+		if (FAILED(gD3DDevice->CreateShaderResourceView(mBuffer, &srvDesc, &mBlockViews[block])))
+		{
+			Release();
+			gLastError = "Error creating instance buffer ring views";
+			return false;
+		}
+	}
+	mNextBlock = mEndBlock = 0;
+	return true;
+}
+
+
+void InstanceBufferRing::Release()
+{
+	for (auto view : mBlockViews)  if (view)  view->Release();
+	mBlockViews.clear();
+	if (mBuffer)  mBuffer->Release();
+	mBuffer = nullptr;
+	mNextBlock = mEndBlock = 0;
+}
+
+
+void InstanceBufferRing::BeginFrame(unsigned int slot)
+{
+	if (mEndBlock > 0)
+	{
+		mBlocksUsed = mNextBlock - mFrameStart;
+		mOverflowDraws = mFrameOverflowDraws;
+	}
+	mFrameStart = mNextBlock = slot * BLOCKS_PER_FRAME;
+	mEndBlock = mNextBlock + BLOCKS_PER_FRAME;
+	mFrameOverflowDraws = 0;
+}
+
+
+InstanceData* InstanceBufferRing::Map(ID3D11ShaderResourceView*& view)
+{
+	if (mBuffer == nullptr)  return nullptr;
+	if (mNextBlock >= mEndBlock)
+	{
+		if (mEndBlock > 0)  ++mFrameOverflowDraws;
+		return nullptr;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(gD3DContext->Map(mBuffer, 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped)))  return nullptr;
+
+	unsigned int block = mNextBlock++;
+	view = mBlockViews[block];
+	return static_cast<InstanceData*>(mapped.pData) + block * MAX_INSTANCES;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Mapping instances
+//--------------------------------------------------------------------------------------
+
+InstanceData* MapInstances()
+{
+	if (gInstanceRing != nullptr)
+	{
+		InstanceData* instances = gInstanceRing->Map(tMappedView);
+		if (instances != nullptr)
+		{
+			tMappedRing = gInstanceRing;
+			return instances;
+		}
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(gD3DContext->Map(gInstanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))  return nullptr;
+	tMappedRing = nullptr;
+	tMappedView = gInstanceBufferSRV;
+	return static_cast<InstanceData*>(mapped.pData);
+}
+
+void UnmapInstances()
+{
+	if (tMappedRing != nullptr)  tMappedRing->Unmap();
+	else                         gD3DContext->Unmap(gInstanceBuffer, 0);
+	gD3DContext->VSSetShaderResources(INSTANCE_DATA_SLOT, 1, &tMappedView);
+}
@@ -0,0 +1,90 @@
+//--------------------------------------------------------------------------------------
+// Instance buffer ring
+//--------------------------------------------------------------------------------------
+// Each instanced draw (Mesh::RenderInstanced, Impostors::Render) used to write its instances to gInstanceBuffer with
+// WRITE_DISCARD, so the driver renamed the buffer for every draw. On the immediate context they are written to blocks of
+// one large buffer instead, with WRITE_NO_OVERWRITE. Each block holds MAX_INSTANCES and has a view of its own, so the
+// shaders still read their instances from index 0 (see Instancing.hlsli).
+//
+// The buffer has BLOCKS_PER_FRAME blocks for each frame in flight (see FramePipeline.h). BeginFrame moves the ring to
+// the blocks of the new frame, which the GPU has finished with, so nothing the GPU may still read is overwritten. A
+// frame with more draws than that, the render workers' deferred contexts and runtimes without no-overwrite maps of
+// shader resource buffers (D3D11.1) all fall back to discarding gInstanceBuffer
+
+#ifndef _INSTANCE_BUFFER_RING_H_INCLUDED_
+#define _INSTANCE_BUFFER_RING_H_INCLUDED_
+
+#include "FramePipeline.h"
+#include "Common.h"
+
+#include <d3d11.h>
+#include <vector>
+
+
+class InstanceBufferRing
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~InstanceBufferRing()  { Release(); }
+
+	// Create the buffer and the views of its blocks. Returns false if the runtime can't map shader resource buffers
+	// without overwriting or the buffer can't be created (reason in gLastError), the ring can't be used then
+	bool Init();
+	void Release();
+
+	// Call once FramePipeline::BeginFrame has returned, this frame writes the given slot's blocks. Until it is first
+	// called every Map fails
+	void BeginFrame(unsigned int slot);
+
+
+	// Map the next free block, returning where to write up to MAX_INSTANCES instances and setting the view of the block.
+	// Returns nullptr if the ring isn't available or this frame's blocks are used up. Call Unmap after writing
+	InstanceData* Map(ID3D11ShaderResourceView*& view);
+	void Unmap()  { gD3DContext->Unmap(mBuffer, 0); }
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	bool Available()  { return mBuffer != nullptr; }
+
+	// Blocks used by the last frame to finish writing, and the draws that found none left and discarded instead
+	unsigned int BlocksUsed()      { return mBlocksUsed; }
+	unsigned int OverflowDraws()   { return mOverflowDraws; }
+
+	static const unsigned int BLOCKS_PER_FRAME = 64;
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	ID3D11Buffer*                          mBuffer = nullptr;
+	std::vector<ID3D11ShaderResourceView*> mBlockViews;
+	unsigned int                           mFrameStart = 0; // This frame's blocks
+	unsigned int                           mNextBlock  = 0;
+	unsigned int                           mEndBlock   = 0;
+	unsigned int                           mBlocksUsed = 0;
+	unsigned int                           mOverflowDraws = 0;
+	unsigned int                           mFrameOverflowDraws = 0;
+};
+
+
+// Map room for up to MAX_INSTANCES instances in this thread's ring, or in gInstanceBuffer with WRITE_DISCARD if there
+// is no ring or it is used up. Returns nullptr on failure. Call UnmapInstances after writing them, which binds them to
+// INSTANCE_DATA_SLOT for the vertex shader
+InstanceData* MapInstances();
+void UnmapInstances();
+
+
+// The ring for gD3DContext on this thread, null if there isn't one. The main thread's ring is gImmediateInstanceRing,
+// the render workers have none (see DeferredRenderer.h)
+extern thread_local InstanceBufferRing* gInstanceRing;
+extern InstanceBufferRing gImmediateInstanceRing;
+
+
+#endif //_INSTANCE_BUFFER_RING_H_INCLUDED_
@@ -0,0 +1,45 @@
+//--------------------------------------------------------------------------------------
+// Include file for instanced rendering
+//--------------------------------------------------------------------------------------
+// Instanced shaders draw many copies of a mesh with one draw call. Each copy reads its world matrix and colour from
+// a structured buffer, indexed by the instance ID, instead of from the per-model constant buffer. The lighting shaders
+// also read the slice of the material texture array each copy is textured from
+
+#include "Common.hlsli"
+
+
+// These variables must match exactly the InstanceData structure in Common.h
+struct InstanceData
+{
+    float4x4 worldMatrix;
+    float3   objectColour;
+    uint     textureSlice;
+};
+
+// Vertex shader resource slot 0 - the C++ code puts the instance buffer here (see INSTANCE_DATA_SLOT)
+StructuredBuffer<InstanceData> gInstances : register(t0);
+
+
+#if GPU_CULLING
+// Built with GPU_CULLING for the indirect draws of the GPU-driven culling (see GpuCuller.h). The instances drawn are the
+// ones the culling shader listed as visible, and the instance buffer holds every node of every instance, so each draw
+// says where its instances start in the list and which node it draws. Must match GpuDrawConstants in Common.h
+StructuredBuffer<uint> gVisibleInstances : register(t1); // Vertex shader slot t1 (GPU_CULL_VISIBLE_SLOT)
+
+cbuffer GpuDrawConstants : register(b11)
+{
+    uint  gFirstVisible;
+    uint  gDrawNode;
+    uint2 paddingD;
+}
+
+InstanceData GetInstance(uint instanceID)
+{
+    return gInstances[gVisibleInstances[gFirstVisible + instanceID] + gDrawNode];
+}
+#else
+InstanceData GetInstance(uint instanceID)
+{
+    return gInstances[instanceID];
+}
+#endif
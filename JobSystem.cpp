@@ -0,0 +1,223 @@
+//--------------------------------------------------------------------------------------
+// Job system
+//--------------------------------------------------------------------------------------
+
+#include "JobSystem.h"
+
+#include <algorithm>
+
+
+JobSystem gJobSystem;
+
+// Index of the current thread's queue, 0 on any thread that isn't a worker
+static thread_local unsigned int tQueue = 0;
+
+
+//--------------------------------------------------------------------------------------
+// Job graph
+//--------------------------------------------------------------------------------------
+
+int JobGraph::Add(JobFunction function)
+{
+	mJobs.push_back({ function, {}, 0 });
+	return static_cast<int>(mJobs.size()) - 1;
+}
+
+
+void JobGraph::AddDependency(int job, int dependsOn)
+{
+	mJobs[dependsOn].dependents.push_back(job);
+	++mJobs[job].numDependencies;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+JobSystem::JobSystem()
+{
+	mQueues.emplace_back(new Queue);
+}
+
+JobSystem::~JobSystem()
+{
+	Release();
+}
+
+
+void JobSystem::Init(int numThreads /*= -1*/)
+{
+	Release();
+	if (numThreads < 0)  numThreads = std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0);
+
+	mQuit = false;
+	for (int i = 0; i < numThreads; ++i)
+	{
+		mQueues.emplace_back(new Queue);
+	}
+	for (int i = 0; i < numThreads; ++i)
+	{
+		mThreads.emplace_back(&JobSystem::WorkerThread, this, i + 1);
+	}
+}
+
+
+void JobSystem::Release()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+
+	for (auto& thread : mThreads)
+	{
+		thread.join();
+	}
+	mThreads.clear();
+	mQueues.resize(1);
+}
+
+
+// Queue the jobs with no dependencies, then run jobs (from any graph) until every job of this one has finished
+void JobSystem::Run(JobGraph& graph)
+{
+	int numJobs = graph.NumJobs();
+	if (numJobs == 0)  return;
+
+	graph.mWaiting.reset(new std::atomic<int>[numJobs]);
+	for (int job = 0; job < numJobs; ++job)
+	{
+		graph.mWaiting[job] = graph.mJobs[job].numDependencies;
+	}
+	graph.mUnfinished = numJobs;
+
+	for (int job = 0; job < numJobs; ++job)
+	{
+		if (graph.mJobs[job].numDependencies == 0)  Push({ &graph, job });
+	}
+
+	while (graph.mUnfinished > 0)
+	{
+		QueuedJob job;
+		if (Pop(job))
+		{
+			Execute(job);
+			continue;
+		}
+
+		// Nothing to do here, wait for more jobs to be queued or for the last ones of this graph to finish elsewhere
+		std::unique_lock<std::mutex> lock(mMutex);
+		mWake.wait(lock, [this, &graph] { return mNumQueued > 0 || graph.mUnfinished == 0; });
+	}
+}
+
+
+void JobSystem::ParallelFor(size_t count, size_t batchSize, const std::function<void(size_t, size_t)>& function)
+{
+	if (count == 0)  return;
+	batchSize = std::max(batchSize, static_cast<size_t>(1));
+
+	// A single batch gains nothing from being queued
+	if (count <= batchSize || mThreads.empty())
+	{
+		function(0, count);
+		return;
+	}
+
+	JobGraph graph;
+	for (size_t first = 0; first < count; first += batchSize)
+	{
+		size_t end = std::min(first + batchSize, count);
+		graph.Add([&function, first, end]() { function(first, end); });
+	}
+	Run(graph);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+void JobSystem::WorkerThread(unsigned int queue)
+{
+	tQueue = queue;
+	while (true)
+	{
+		QueuedJob job;
+		if (Pop(job))
+		{
+			Execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mMutex);
+		mWake.wait(lock, [this] { return mQuit || mNumQueued > 0; });
+		if (mQuit)  return;
+	}
+}
+
+
+void JobSystem::Push(const QueuedJob& job)
+{
+	Queue& queue = *mQueues[tQueue];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(job);
+	}
+	{
+		std::lock_guard<std::mutex> lock(mMutex); // So a thread about to wait can't miss the new job
+		++mNumQueued;
+	}
+	mWake.notify_one();
+}
+
+
+// Newest first from our own queue, as its data is most likely still in the cache. Steal the oldest from the others,
+// starting with the next queue along so the threads don't all pick on the same one
+bool JobSystem::Pop(QueuedJob& job)
+{
+	unsigned int numQueues = static_cast<unsigned int>(mQueues.size());
+	for (unsigned int i = 0; i < numQueues; ++i)
+	{
+		Queue& queue = *mQueues[(tQueue + i) % numQueues];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.empty())  continue;
+
+		if (i == 0)
+		{
+			job = queue.jobs.back();
+			queue.jobs.pop_back();
+		}
+		else
+		{
+			job = queue.jobs.front();
+			queue.jobs.pop_front();
+		}
+		--mNumQueued;
+		return true;
+	}
+	return false;
+}
+
+
+// The graph may be destroyed as soon as its last job finishes, so it isn't touched after that
+void JobSystem::Execute(const QueuedJob& job)
+{
+	JobGraph* graph = job.graph;
+	graph->mJobs[job.job].function();
+
+	for (int dependent : graph->mJobs[job.job].dependents)
+	{
+		if (--graph->mWaiting[dependent] == 0)  Push({ graph, dependent });
+	}
+
+	if (--graph->mUnfinished == 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex); // So the thread waiting in Run can't miss the change
+		}
+		mWake.notify_all();
+	}
+}
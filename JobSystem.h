@@ -0,0 +1,152 @@
+//--------------------------------------------------------------------------------------
+// Job system
+//--------------------------------------------------------------------------------------
+// A pool of worker threads, one for each hardware thread other than the main thread, that runs small jobs. Work is
+// given as a graph of jobs (JobGraph): each job has a count of the jobs it depends on and is only queued once that
+// count reaches zero, so later stages of a task start as soon as the parts they need are done rather than waiting for
+// the whole of the previous stage.
+//
+// Each thread has its own queue. A thread adds the jobs it makes ready to its own queue and takes the most recent from
+// it, so related work stays on one core. A thread with an empty queue steals the oldest job from another thread's
+// queue. The thread calling Run also runs jobs while it waits, so a job can itself call Run (e.g. ParallelFor) without
+// tying up a worker.
+//
+// The workers have no Direct3D context (gD3DContext is null on them) - jobs that render must set up their own, see
+// DeferredRenderer. Jobs must not throw exceptions
+
+#ifndef _JOB_SYSTEM_H_INCLUDED_
+#define _JOB_SYSTEM_H_INCLUDED_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// A set of jobs with dependencies between them, run together by JobSystem::Run. Build the graph then run it, it
+// can be run again once finished
+class JobGraph
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	typedef std::function<void()> JobFunction;
+
+	// Add a job to the graph, returning its index for AddDependency
+	int Add(JobFunction function);
+
+	// Don't start a job until the given job it depends on has finished. Both must already be in the graph
+	void AddDependency(int job, int dependsOn);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	int NumJobs()  { return static_cast<int>(mJobs.size()); }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	friend class JobSystem;
+
+	struct Job
+	{
+		JobFunction      function;
+		std::vector<int> dependents;      // Jobs waiting for this one
+		int              numDependencies; // Number of jobs this one waits for
+	};
+
+	std::vector<Job> mJobs;
+
+	// Used while the graph is running - the dependencies each job is still waiting for, and the jobs not yet finished
+	std::unique_ptr<std::atomic<int>[]> mWaiting;
+	std::atomic<int>                    mUnfinished;
+};
+
+
+class JobSystem
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	JobSystem();
+	~JobSystem();
+
+	// Start the given number of worker threads, -1 for one per hardware thread other than this one. With no workers
+	// every job is run on the thread calling Run
+	void Init(int numThreads = -1);
+
+	// Stop the worker threads. Must not be called while a graph is running
+	void Release();
+
+
+	// Run the jobs in the graph, each once the jobs it depends on have finished, and return when they are all done
+	void Run(JobGraph& graph);
+
+	// Call function(first, end) for the ranges of batchSize items covering 0 to count - 1, spread over the threads
+	void ParallelFor(size_t count, size_t batchSize, const std::function<void(size_t, size_t)>& function);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// Number of worker threads, not counting the threads calling Run
+	int NumThreads()  { return static_cast<int>(mThreads.size()); }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	struct QueuedJob
+	{
+		JobGraph* graph;
+		int       job;
+	};
+
+	struct Queue
+	{
+		std::mutex            mutex;
+		std::deque<QueuedJob> jobs;
+	};
+
+	// Worker thread loop, runs jobs until told to quit
+	void WorkerThread(unsigned int queue);
+
+	// Add a job to the current thread's queue
+	void Push(const QueuedJob& job);
+
+	// Take the newest job from the current thread's queue, or steal the oldest from another. Returns false if all empty
+	bool Pop(QueuedJob& job);
+
+	// Run a job, then queue any dependents that were only waiting for it
+	void Execute(const QueuedJob& job);
+
+
+	// Queue 0 is used by the main thread and any other thread not in the pool, the workers have one each after that
+	std::vector<std::unique_ptr<Queue>> mQueues;
+	std::vector<std::thread>            mThreads;
+
+	std::mutex              mMutex;
+	std::condition_variable mWake;          // Signalled when jobs are queued, when a graph finishes, or on quit
+	std::atomic<int>        mNumQueued{ 0 }; // Jobs in all the queues
+	bool                    mQuit = false;
+};
+
+
+extern JobSystem gJobSystem;
+
+
+#endif //_JOB_SYSTEM_H_INCLUDED_
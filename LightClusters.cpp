@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------------
+// Light clusters
+//--------------------------------------------------------------------------------------
+
+#include "LightClusters.h"
+#include "Shader.h"
+#include "StateCache.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+LightClusters gLightClusters;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+bool LightClusters::Init()
+{
+	mLightBuffer = CreateStructuredBuffer(sizeof(LightData), MAX_LIGHTS, &mLightBufferSRV);
+	mCountBuffer = CreateReadWriteStructuredBuffer(sizeof(unsigned int), NUM_CLUSTERS, &mCountBufferSRV, &mCountBufferUAV);
+	mIndexBuffer = CreateReadWriteStructuredBuffer(sizeof(unsigned int), NUM_CLUSTERS * MAX_LIGHTS_PER_CLUSTER,
+	                                               &mIndexBufferSRV, &mIndexBufferUAV);
+	if (mLightBuffer == nullptr || mCountBuffer == nullptr || mIndexBuffer == nullptr)
+	{
+		gLastError = "Error creating light cluster buffers";
+		return false;
+	}
+	return true;
+}
+
+
+void LightClusters::Release()
+{
+	if (mIndexBufferUAV)  mIndexBufferUAV->Release();
+	if (mIndexBufferSRV)  mIndexBufferSRV->Release();
+	if (mIndexBuffer)     mIndexBuffer->Release();
+	if (mCountBufferUAV)  mCountBufferUAV->Release();
+	if (mCountBufferSRV)  mCountBufferSRV->Release();
+	if (mCountBuffer)     mCountBuffer->Release();
+	if (mLightBufferSRV)  mLightBufferSRV->Release();
+	if (mLightBuffer)     mLightBuffer->Release();
+	*this = LightClusters();
+}
+
+
+void LightClusters::SetLights(const std::vector<LightData>& lights)
+{
+	mNumLights = std::min(static_cast<int>(lights.size()), MAX_LIGHTS);
+	if (mNumLights == 0)  return;
+
+	D3D11_MAPPED_SUBRESOURCE mappedBuffer;
+	if (FAILED(gD3DContext->Map(mLightBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedBuffer)))
+	{
+		mNumLights = 0;
+		return;
+	}
+	std::memcpy(mappedBuffer.pData, lights.data(), mNumLights * sizeof(LightData));
+	gD3DContext->Unmap(mLightBuffer, 0);
+}
+
+
+void LightClusters::Build()
+{
+	// The cluster buffers may still be bound for the pixel shader from the previous camera, they can't also be written
+	ID3D11ShaderResourceView* nullSRVs[3] = {};
+	gD3DContext->PSSetShaderResources(LIGHT_DATA_SLOT, 3, nullSRVs);
+
+	ID3D11UnorderedAccessView* clusterUAVs[2] = { mCountBufferUAV, mIndexBufferUAV };
+	gStateCache.CSSetShader(gClusterLights_Compute, nullptr, 0);
+	gStateCache.SetConstantBuffer(PER_FRAME_CONSTANTS_SLOT, gPerFrameConstantBuffer);
+	gD3DContext->CSSetShaderResources(0, 1, &mLightBufferSRV);
+	gD3DContext->CSSetUnorderedAccessViews(0, 2, clusterUAVs, nullptr);
+
+	// One group for each depth slice, one thread for each cluster in the slice
+	gD3DContext->Dispatch(LIGHT_CLUSTERS_Z, 1, 1);
+
+	// Unbind so the pixel shader can read the results
+	ID3D11UnorderedAccessView* nullUAVs[2] = {};
+	gD3DContext->CSSetShaderResources(0, 1, nullSRVs);
+	gD3DContext->CSSetUnorderedAccessViews(0, 2, nullUAVs, nullptr);
+}
+
+
+void LightClusters::Bind()
+{
+	ID3D11ShaderResourceView* lightSRVs[3] = { mLightBufferSRV, mCountBufferSRV, mIndexBufferSRV };
+	gD3DContext->PSSetShaderResources(LIGHT_DATA_SLOT, 3, lightSRVs);
+}
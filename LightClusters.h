@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+// Light clusters
+//--------------------------------------------------------------------------------------
+// Clustered forward lighting. The point lights are uploaded to a structured buffer each frame, then a compute shader
+// splits the view frustum into a grid of clusters (see LIGHT_CLUSTERS_X/Y/Z in Common.h) and lists the lights whose
+// range reaches each one. The lighting pixel shader finds its cluster from its screen position and depth and only
+// loops over that cluster's lights, so the cost of a pixel depends on the lights near it rather than on every light
+// in the scene (see Lighting.hlsli)
+//
+// Build uses the per-frame constants for the camera and must be called on the main thread after they are uploaded and
+// before the lit models are executed. Bind is called in the lit pass set-up, on whichever thread records it
+
+#ifndef _LIGHT_CLUSTERS_H_INCLUDED_
+#define _LIGHT_CLUSTERS_H_INCLUDED_
+
+#include "Common.h"
+
+#include <d3d11.h>
+#include <vector>
+
+
+class LightClusters
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Create the light and cluster buffers. Returns false on failure (reason in gLastError)
+	bool Init();
+
+	void Release();
+
+	// Copy the lights to the light buffer, up to MAX_LIGHTS. Call on the main thread (uses the immediate context)
+	void SetLights(const std::vector<LightData>& lights);
+
+	// Run the compute shader listing the lights in each cluster for the current camera. Call on the main thread
+	void Build();
+
+	// Bind the lights and cluster lists for the lighting pixel shader (slots LIGHT_DATA_SLOT onwards)
+	void Bind();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	int NumLights()  { return mNumLights; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const int NUM_CLUSTERS = LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z;
+
+	ID3D11Buffer*             mLightBuffer    = nullptr;
+	ID3D11ShaderResourceView* mLightBufferSRV = nullptr;
+
+	ID3D11Buffer*              mCountBuffer    = nullptr; // Number of lights in each cluster
+	ID3D11ShaderResourceView*  mCountBufferSRV = nullptr;
+	ID3D11UnorderedAccessView* mCountBufferUAV = nullptr;
+
+	ID3D11Buffer*              mIndexBuffer    = nullptr; // MAX_LIGHTS_PER_CLUSTER light indices for each cluster
+	ID3D11ShaderResourceView*  mIndexBufferSRV = nullptr;
+	ID3D11UnorderedAccessView* mIndexBufferUAV = nullptr;
+
+	int mNumLights = 0;
+};
+
+
+extern LightClusters gLightClusters;
+
+
+#endif //_LIGHT_CLUSTERS_H_INCLUDED_
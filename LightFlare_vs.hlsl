@@ -0,0 +1,48 @@
+//--------------------------------------------------------------------------------------
+// Light Flare Vertex Shader
+//--------------------------------------------------------------------------------------
+// Draws each light as a camera-facing quad textured with the flare. There is no vertex buffer: all the lights are drawn
+// with one instanced draw of four vertex triangle strips, the instance ID picks the light from the flare buffer and the
+// vertex ID the corner. The tint comes out as for the instanced models, for TintedTextureInstanced_ps
+
+#include "Common.hlsli"
+
+
+// These variables must match exactly the LightFlareData structure in Common.h
+struct LightFlare
+{
+    float3 position;
+    float  strength;
+    float3 colour;
+    float  padding;
+};
+
+// Vertex shader resource slot 0 - the C++ code puts the flare buffer here (see LIGHT_FLARE_SLOT)
+StructuredBuffer<LightFlare> gLightFlares : register(t0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+InstancedPixelShaderInput main(uint vertexID : SV_VertexID, uint instanceID : SV_InstanceID)
+{
+    InstancedPixelShaderInput output;
+
+    LightFlare flare = gLightFlares[instanceID];
+
+    // Convert light strength into a nice size for the flare - equation is ad-hoc, the same as the light models' scale
+    float size = pow(flare.strength, 0.7f);
+
+    // Corners -1 to 1 placed along the camera's right and up axes, the quad is a unit across at a size of one
+    float2 corner = float2((vertexID & 1) ? 1 : -1, (vertexID & 2) ? -1 : 1);
+    float3 cameraRight = mul(gCameraMatrix, float4(1, 0, 0, 0)).xyz;
+    float3 cameraUp    = mul(gCameraMatrix, float4(0, 1, 0, 0)).xyz;
+    float3 worldPosition = flare.position + (cameraRight * corner.x + cameraUp * corner.y) * (size * 0.5f);
+
+    output.projectedPosition = mul(gViewProjectionMatrix, float4(worldPosition, 1));
+    output.uv     = corner * float2(0.5f, -0.5f) + 0.5f;
+    output.colour = flare.colour;
+
+    return output;
+}
@@ -0,0 +1,149 @@
+//--------------------------------------------------------------------------------------
+// Include file for clustered lighting
+//--------------------------------------------------------------------------------------
+// All the point lights are held in one structured buffer. The view frustum is split into a grid of clusters - tiles
+// across the screen, each cut into slices in depth - and the ClusterLights compute shader lists the lights reaching
+// each cluster. A pixel then only loops over the lights in its own cluster, however many lights are in the scene.
+// Depth slices are spaced exponentially so clusters are roughly cube shaped at every distance. Used by both the forward
+// (PixelLighting_ps) and deferred (DeferredLighting_ps) lighting. The first few lights cast shadows (see LightShadow)
+
+#include "Common.hlsli"
+
+
+// These values must match the ones in Common.h
+#define LIGHT_CLUSTERS_X       16
+#define LIGHT_CLUSTERS_Y       9
+#define LIGHT_CLUSTERS_Z       24
+#define MAX_LIGHTS_PER_CLUSTER 64
+
+// The first depth slice covers everything nearer than this, otherwise most slices would be spent within a few units of the
+// near clip plane where there is little to light
+#define CLUSTER_NEAR_DEPTH 5.0f
+
+
+// These variables must match exactly the LightData structure in Common.h
+struct LightData
+{
+    float3 position;
+    float  range;   // Lights have no effect beyond this distance
+    float3 colour;  // Colour multiplied by strength
+    float  padding;
+};
+
+
+// View-space depth of the near side of a depth slice, slice LIGHT_CLUSTERS_Z gives the far side of the last slice
+float ClusterSliceDepth(uint slice)
+{
+    if (slice == 0)  return gNearClip;
+    float farDepth = max(gFarClip, CLUSTER_NEAR_DEPTH * 2);
+    return CLUSTER_NEAR_DEPTH * pow(farDepth / CLUSTER_NEAR_DEPTH, (slice - 1) / (float)(LIGHT_CLUSTERS_Z - 1));
+}
+
+// Depth slice holding the given view-space depth, the inverse of the function above
+uint ClusterSlice(float viewDepth)
+{
+    if (viewDepth < CLUSTER_NEAR_DEPTH)  return 0;
+    float farDepth = max(gFarClip, CLUSTER_NEAR_DEPTH * 2);
+    float slice = 1 + log(viewDepth / CLUSTER_NEAR_DEPTH) / log(farDepth / CLUSTER_NEAR_DEPTH) * (LIGHT_CLUSTERS_Z - 1);
+    return min((uint)slice, (uint)(LIGHT_CLUSTERS_Z - 1));
+}
+
+// Index of a cluster in the cluster buffers
+uint ClusterIndex(uint3 cluster)
+{
+    return (cluster.z * LIGHT_CLUSTERS_Y + cluster.y) * LIGHT_CLUSTERS_X + cluster.x;
+}
+
+// Cluster holding a pixel, given its pixel coordinate and view-space depth
+uint ClusterIndex(float2 pixel, float viewDepth)
+{
+    uint2 tile = min((uint2)(pixel / float2(gViewportWidth, gViewportHeight) * float2(LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y)),
+                     uint2(LIGHT_CLUSTERS_X - 1, LIGHT_CLUSTERS_Y - 1));
+    return ClusterIndex(uint3(tile, ClusterSlice(viewDepth)));
+}
+
+
+// Add the diffuse and specular light from one point light. The light falls off with distance as before, then is faded
+// to nothing at its range so the cut-off at the edge of the light's clusters can't be seen
+void AddPointLight(LightData light, float3 worldPosition, float3 worldNormal, float3 cameraDirection,
+                   inout float3 diffuseLight, inout float3 specularLight)
+{
+    float3 lightVector = light.position - worldPosition;
+    float  lightDist = length(lightVector);
+    if (lightDist >= light.range)  return;
+    float3 lightDirection = lightVector / lightDist;
+
+    float fade = saturate(1 - pow(lightDist / light.range, 4));
+
+    // Equations from lighting lecture
+    float3 diffuse = light.colour * max(dot(worldNormal, lightDirection), 0) / lightDist * fade * fade;
+    float3 halfway = normalize(lightDirection + cameraDirection);
+    diffuseLight  += diffuse;
+    specularLight += diffuse * pow(max(dot(worldNormal, halfway), 0), gSpecularPower); // Multiplying by diffuseLight instead of light colour - my own personal preference
+}
+
+
+// The compute shader building the clusters declares its own views of these buffers
+#ifndef BUILDING_LIGHT_CLUSTERS
+
+// The lights and the lists of lights in each cluster, built by the ClusterLights compute shader (see LIGHT_DATA_SLOT)
+StructuredBuffer<LightData> Lights              : register(t1);
+StructuredBuffer<uint>      ClusterLightCounts  : register(t2);
+StructuredBuffer<uint>      ClusterLightIndices : register(t3);
+
+// Depth cubemaps of the lights casting shadows, one cube for each, and the comparison sampler to test against them
+// (see ShadowMaps.h)
+TextureCubeArray       ShadowMaps    : register(t7);
+SamplerComparisonState ShadowSampler : register(s1);
+
+// How much of a light reaches a surface past the shadow casters, from 0 (in shadow) to 1 (lit), given the light's index
+// in the light buffer. Lights without a shadow map are never shadowed. The point tested is pushed out along the normal
+// by a distance growing with its distance from the light, about the size of a shadow map texel there, so a surface
+// doesn't shadow itself. The depth compared is the one the cubemap face the point is in would have drawn it at
+float LightShadow(uint lightIndex, float3 worldPosition, float3 worldNormal)
+{
+    if (lightIndex >= gNumShadowLights)  return 1;
+
+    float4 shadowLight = gShadowLights[lightIndex]; // Position in xyz, far clip of the faces in w
+    float3 fromLight = worldPosition - shadowLight.xyz;
+    fromLight += worldNormal * (length(fromLight) * gShadowNormalOffset);
+
+    // Each face projects depth along its own axis, the largest component of the direction picks the face
+    float3 axisDistances = abs(fromLight);
+    float  faceDepth = max(axisDistances.x, max(axisDistances.y, axisDistances.z));
+    if (faceDepth >= shadowLight.w)  return 1; // Beyond the light's range, it has no effect anyway
+    float  depth = shadowLight.w / (shadowLight.w - gShadowNearClip) * (1 - gShadowNearClip / faceDepth);
+
+    return ShadowMaps.SampleCmpLevelZero(ShadowSampler, float4(fromLight, lightIndex), depth);
+}
+
+// Add the light from each light in the cluster holding a pixel, given its pixel coordinate and view-space depth
+void AddClusterLights(float2 pixel, float viewDepth, float3 worldPosition, float3 worldNormal, float3 cameraDirection,
+                      inout float3 diffuseLight, inout float3 specularLight)
+{
+    uint cluster = ClusterIndex(pixel, viewDepth);
+    uint numClusterLights = ClusterLightCounts[cluster];
+    for (uint i = 0; i < numClusterLights; ++i)
+    {
+        uint lightIndex = ClusterLightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i];
+        LightData light = Lights[lightIndex];
+        light.colour *= LightShadow(lightIndex, worldPosition, worldNormal);
+        AddPointLight(light, worldPosition, worldNormal, cameraDirection, diffuseLight, specularLight);
+    }
+}
+
+// Add the light from each light chosen for the model on the CPU (per-object light assignment), rather than the lights in
+// the pixel's cluster. The list is the same for the whole draw, so every pixel takes the same path through the loop
+void AddObjectLights(float3 worldPosition, float3 worldNormal, float3 cameraDirection,
+                     inout float3 diffuseLight, inout float3 specularLight)
+{
+    for (uint i = 0; i < gNumObjectLights; ++i)
+    {
+        uint lightIndex = gObjectLights[i / 4][i % 4];
+        LightData light = Lights[lightIndex];
+        light.colour *= LightShadow(lightIndex, worldPosition, worldNormal);
+        AddPointLight(light, worldPosition, worldNormal, cameraDirection, diffuseLight, specularLight);
+    }
+}
+
+#endif
@@ -0,0 +1,171 @@
+//--------------------------------------------------------------------------------------
+// Linear arena allocator
+//--------------------------------------------------------------------------------------
+// See LinearArena.h for an overview
+
+#include "LinearArena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+LinearArena::LinearArena(LinearArena&& other)
+{
+	*this = std::move(other);
+}
+
+LinearArena& LinearArena::operator=(LinearArena&& other)
+{
+	if (&other == this)  return *this;
+	mBlocks    = std::move(other.mBlocks);
+	mBlockSize = other.mBlockSize;
+	mCurrent   = other.mCurrent;
+	mOffset    = other.mOffset;
+	mUsed      = other.mUsed;
+	mCapacity  = other.mCapacity;
+	mHighWater.store(other.HighWater(), std::memory_order_relaxed);
+	other.Release();
+	return *this;
+}
+
+
+void* LinearArena::Allocate(size_t bytes, size_t alignment /*= alignof(std::max_align_t)*/)
+{
+	while (true)
+	{
+		// Try the current block, then any later ones left empty by a Rewind
+		while (mCurrent < mBlocks.size())
+		{
+			Block& block = mBlocks[mCurrent];
+			uintptr_t start = reinterpret_cast<uintptr_t>(block.data.get()) + mOffset;
+			size_t padding = static_cast<size_t>((0 - start) & (alignment - 1));
+			if (mOffset + padding + bytes <= block.size)
+			{
+				mOffset += padding + bytes;
+				mUsed   += padding + bytes;
+				if (mUsed > mHighWater.load(std::memory_order_relaxed))  mHighWater.store(mUsed, std::memory_order_relaxed);
+				return reinterpret_cast<void*>(start + padding);
+			}
+			if (mCurrent + 1 == mBlocks.size())  break;
+			++mCurrent;
+			mOffset = 0;
+		}
+
+		// Each new block is at least as large as all the others together, so there are only a few before a Reset
+		size_t size = std::max(std::max(mBlockSize, mCapacity), bytes + alignment);
+		mBlocks.push_back({ std::unique_ptr<unsigned char[]>(new unsigned char[size]), size });
+		mCapacity += size;
+		mCurrent = mBlocks.size() - 1;
+		mOffset = 0;
+	}
+}
+
+
+void LinearArena::Reset()
+{
+	if (mBlocks.size() > 1)
+	{
+		mBlocks.clear();
+		mBlocks.push_back({ std::unique_ptr<unsigned char[]>(new unsigned char[mCapacity]), mCapacity });
+	}
+	mCurrent = mOffset = mUsed = 0;
+}
+
+
+void LinearArena::Release()
+{
+	mBlocks.clear();
+	mCurrent = mOffset = mUsed = mCapacity = 0;
+}
+
+
+void LinearArena::Rewind(const Mark& mark)
+{
+	mCurrent = mark.block;
+	mOffset  = mark.offset;
+	mUsed    = mark.used;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Per-thread arenas
+//--------------------------------------------------------------------------------------
+
+namespace
+{
+	// Each thread's arenas, listed while the thread exists so the reports can read their high-water marks
+	struct ThreadArenas;
+	std::mutex                  gThreadArenasMutex;
+	std::vector<ThreadArenas*>  gThreadArenas;
+	std::atomic<unsigned int>   gFrameNumber{ 0 };
+
+	struct ThreadArenas
+	{
+		LinearArena  frame;
+		LinearArena  import;
+		unsigned int frameNumber = 0; // Frame the frame arena was last reset for
+
+		ThreadArenas()
+		{
+			std::lock_guard<std::mutex> lock(gThreadArenasMutex);
+			gThreadArenas.push_back(this);
+		}
+		~ThreadArenas()
+		{
+			std::lock_guard<std::mutex> lock(gThreadArenasMutex);
+			gThreadArenas.erase(std::find(gThreadArenas.begin(), gThreadArenas.end(), this));
+		}
+	};
+
+	ThreadArenas& Arenas()
+	{
+		thread_local ThreadArenas arenas;
+		return arenas;
+	}
+}
+
+
+LinearArena& FrameArena()
+{
+	ThreadArenas& arenas = Arenas();
+	unsigned int frameNumber = gFrameNumber.load(std::memory_order_acquire);
+	if (arenas.frameNumber != frameNumber)
+	{
+		arenas.frame.Reset();
+		arenas.frameNumber = frameNumber;
+	}
+	return arenas.frame;
+}
+
+LinearArena& ImportArena()
+{
+	return Arenas().import;
+}
+
+
+void NextFrameArenas()
+{
+	gFrameNumber.fetch_add(1, std::memory_order_release);
+}
+
+
+size_t FrameArenaHighWater()
+{
+	std::lock_guard<std::mutex> lock(gThreadArenasMutex);
+	size_t highWater = 0;
+	for (auto arenas : gThreadArenas)  highWater = std::max(highWater, arenas->frame.HighWater());
+	return highWater;
+}
+
+size_t ImportArenaHighWater()
+{
+	std::lock_guard<std::mutex> lock(gThreadArenasMutex);
+	size_t highWater = 0;
+	for (auto arenas : gThreadArenas)  highWater = std::max(highWater, arenas->import.HighWater());
+	return highWater;
+}
@@ -0,0 +1,170 @@
+//--------------------------------------------------------------------------------------
+// Linear arena allocator
+//--------------------------------------------------------------------------------------
+// Allocate hands out memory by moving an offset through a block, so an allocation is a few instructions and nothing
+// is freed one at a time - the whole arena is reset (or rewound to a mark) when its contents are no longer needed. When
+// a block is full another is added, and Reset replaces them with one block the size of them all, so after the first
+// few uses an arena has a single block large enough for everything put in it and stops calling the heap altogether.
+// Objects put in an arena are never destroyed, so only use it for types that don't need their destructors to run (or
+// containers using ArenaAllocator, whose own destructors free nothing).
+//
+// Each thread has two arenas for its temporaries:
+// - FrameArena, for lists that live until the end of the frame. It is reset the first time the thread uses it after
+//   NextFrameArenas, which the scene calls once the frame is presented
+// - ImportArena, for scratch buffers used while a mesh is loaded. Take an ArenaScope on it around the work, so it is
+//   rewound as soon as the mesh is done
+// Both are only used by their own thread, so need no locks. The high-water marks of all the threads' arenas can be read
+// for reports
+
+#ifndef _LINEAR_ARENA_H_INCLUDED_
+#define _LINEAR_ARENA_H_INCLUDED_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+
+class LinearArena
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// The first block is allocated on first use, with at least the given size
+	explicit LinearArena(size_t blockSize = DEFAULT_BLOCK_SIZE)  : mBlockSize(blockSize) {}
+
+	// Moving keeps the blocks, so pointers into the arena stay valid
+	LinearArena(LinearArena&& other);
+	LinearArena& operator=(LinearArena&& other);
+
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+
+
+	// Uninitialised memory of the given size and alignment (a power of two), valid until the arena is reset or rewound
+	// past it. Never returns null, throws std::bad_alloc if the heap is exhausted
+	void* Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+	// Uninitialised array of a type that needs no destructor
+	template <typename T>
+	T* AllocateArray(size_t count)  { return static_cast<T*>(Allocate(count * sizeof(T), alignof(T))); }
+
+	// Make everything allocated so far available again. Keeps the memory, as a single block if there was more than one
+	void Reset();
+
+	// Free all the memory, e.g. when the arena won't be used again for a while
+	void Release();
+
+
+	// A point to rewind back to, freeing everything allocated after it
+	struct Mark
+	{
+		size_t block;
+		size_t offset;
+		size_t used;
+	};
+	Mark GetMark()  { return { mCurrent, mOffset, mUsed }; }
+	void Rewind(const Mark& mark);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	size_t Used()       { return mUsed; }                                       // Bytes in use, including alignment padding
+	size_t HighWater()  { return mHighWater.load(std::memory_order_relaxed); } // Most bytes in use at once, safe from any thread
+	size_t Capacity()   { return mCapacity; }
+	int    NumBlocks()  { return static_cast<int>(mBlocks.size()); }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+	struct Block
+	{
+		std::unique_ptr<unsigned char[]> data;
+		size_t                           size;
+	};
+
+	std::vector<Block> mBlocks;
+	size_t             mBlockSize;
+	size_t             mCurrent  = 0; // Block being allocated from, and the first free byte in it
+	size_t             mOffset   = 0;
+	size_t             mUsed     = 0;
+	size_t             mCapacity = 0;
+
+	std::atomic<size_t> mHighWater{ 0 }; // Only written by the thread using the arena, read by reports on any thread
+};
+
+
+// Rewinds an arena to where it was when the scope began
+class ArenaScope
+{
+public:
+	explicit ArenaScope(LinearArena& arena)  : mArena(arena), mMark(arena.GetMark()) {}
+	~ArenaScope()  { mArena.Rewind(mMark); }
+
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+	LinearArena&      mArena;
+	LinearArena::Mark mMark;
+};
+
+
+// Standard allocator taking its memory from an arena, for containers of temporaries. Deallocate does nothing, so memory
+// left behind when a vector grows is only reused once the arena is reset - reserve the size when it is known
+template <typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	explicit ArenaAllocator(LinearArena& arena)  : mArena(&arena) {}
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other)  : mArena(other.Arena()) {}
+
+	T*   allocate(size_t count)     { return mArena->AllocateArray<T>(count); }
+	void deallocate(T*, size_t)  {}
+
+	LinearArena* Arena() const  { return mArena; }
+
+private:
+	LinearArena* mArena;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)  { return a.Arena() == b.Arena(); }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)  { return a.Arena() != b.Arena(); }
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+
+//--------------------------------------------------------------------------------------
+// Per-thread arenas
+//--------------------------------------------------------------------------------------
+
+// The calling thread's arena for temporaries that last until the next NextFrameArenas
+LinearArena& FrameArena();
+
+// The calling thread's arena for scratch buffers while loading a mesh, use with an ArenaScope
+LinearArena& ImportArena();
+
+// Start a new frame: each thread's frame arena is reset the next time that thread uses it. Call once everything
+// allocated from the frame arenas for the frame is finished with, e.g. after Present
+void NextFrameArenas();
+
+// Most bytes any one thread's arena of each kind has held at once, over the threads running now
+size_t FrameArenaHighWater();
+size_t ImportArenaHighWater();
+
+
+#endif //_LINEAR_ARENA_H_INCLUDED_
@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+// Luminance Histogram Compute Shader
+//--------------------------------------------------------------------------------------
+// First pass of auto exposure. Counts the pixels of the scene into NUM_LUMINANCE_BINS bins by log luminance. Each group
+// counts its 16x16 block of pixels into groupshared bins, then adds them on to the histogram buffer, so there is only
+// one global atomic per bin per group rather than one per pixel. AutoExposure_cs reduces the histogram and clears it.
+// Compiled with MULTISAMPLED 1 for an MSAA scene (see AutoExposure::Measure), which measures the first sample of each
+// pixel, the others only differ along edges
+
+#ifndef MULTISAMPLED
+#define MULTISAMPLED 0
+#endif
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+#if MULTISAMPLED
+Texture2DMS<float4>   SceneTexture : register(t0);
+#else
+Texture2D             SceneTexture : register(t0);
+#endif
+RWStructuredBuffer<uint> Histogram : register(u0); // NUM_LUMINANCE_BINS counts
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+#define HISTOGRAM_GROUP_SIZE 16 // Must match HISTOGRAM_GROUP_SIZE in AutoExposure.cpp
+
+groupshared uint Bins[NUM_LUMINANCE_BINS];
+
+
+// Black pixels go in bin 0, which the average leaves out, the rest are spread over bins 1 onwards
+uint LuminanceBin(float luminance)
+{
+	if (luminance < 0.0001f)  return 0;
+	float logLuminance = saturate((log2(luminance) - gMinLogLuminance) / gLogLuminanceRange);
+	return uint(logLuminance * (NUM_LUMINANCE_BINS - 2) + 1);
+}
+
+
+[numthreads(HISTOGRAM_GROUP_SIZE, HISTOGRAM_GROUP_SIZE, 1)]
+void main(uint3 dispatchID : SV_DispatchThreadID, uint groupIndex : SV_GroupIndex)
+{
+	// 256 threads, one to clear each bin
+	Bins[groupIndex] = 0;
+	GroupMemoryBarrierWithGroupSync();
+
+	// Only the part of the image in use is measured (with dynamic resolution the scene is in the top-left)
+	uint width, height;
+#if MULTISAMPLED
+	uint numSamples;
+	SceneTexture.GetDimensions(width, height, numSamples);
+#else
+	SceneTexture.GetDimensions(width, height);
+#endif
+	uint2 measureSize = uint2(float2(width, height) * gMeasureUVScale);
+	if (all(dispatchID.xy < measureSize))
+	{
+#if MULTISAMPLED
+		float luminance = Luminance(SceneTexture.Load(int2(dispatchID.xy), 0).rgb);
+#else
+		float luminance = Luminance(SceneTexture.Load(int3(dispatchID.xy, 0)).rgb);
+#endif
+		InterlockedAdd(Bins[LuminanceBin(luminance)], 1);
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	if (Bins[groupIndex] > 0)  InterlockedAdd(Histogram[groupIndex], Bins[groupIndex]);
+}
@@ -0,0 +1,905 @@
+//--------------------------------------------------------------------------------------
+// Entry point for the application
+// Window creation code
+//--------------------------------------------------------------------------------------
+
+#include "Direct3DSetup.h"
+#include "Scene.h"
+#include "Input.h"
+#include "Timer.h"
+#include "CpuProfiler.h"
+#include "TraceCapture.h"
+#include "StartupProfiler.h"
+#include "Common.h"
+#include "Benchmark.h"
+#include "Telemetry.h"
+#include "GpuProfiler.h"
+#include "ShaderReloader.h"
+#include "BatchProcessor.h"
+#include "ShaderBenchmark.h"
+#include "ShaderCost.h"
+#include "PerfMetrics.h"
+#include "SharedOutput.h"
+#include "MetricsServer.h"
+#include "OutputWindows.h"
+#include <Windows.h>
+#include <string>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+
+// Forward declarations of functions in this file
+BOOL             InitWindow(HINSTANCE, int);
+LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
+bool             CommandLineSwitch(const std::wstring&, const std::wstring&, std::string&);
+void             RenderThread(std::wstring);
+void             SimulationThread();
+void             StopRenderThread();
+
+
+//--------------------------------------------------------------------------------------
+// Global Variables
+//--------------------------------------------------------------------------------------
+// Used to keep code simpler, but try to architect your own code in a better way
+
+// Identifiers for the window that will show our app
+HINSTANCE gHInst;
+HWND      gHWnd;
+
+// Viewport size (which determines the size of the window used for our app)
+int gViewportWidth = 1280;
+int gViewportHeight = 960;
+
+// Client area size from the most recent WM_SIZE message, the scene is resized to match before the next frame. Written
+// by the window thread and read by the render thread
+std::atomic<int> gWindowWidth { 0 };
+std::atomic<int> gWindowHeight{ 0 };
+
+// While the window is minimised, hidden or (unless -renderunfocused is given) without focus, the render thread idles -
+// no rendering or presenting, just a check every IDLE_POLL_INTERVAL. With -idlepause the simulation pauses as well
+std::atomic<bool> gWindowMinimised{ false };
+std::atomic<bool> gWindowFocused  { true };
+std::atomic<bool> gIdle           { false };
+bool gRenderUnfocused       = false;
+bool gPauseSimulationInIdle = false;
+const int IDLE_POLL_INTERVAL = 100; // Milliseconds
+
+// A timer class to provide frame timing
+Timer gTimer;
+
+// When wWinMain started, in CpuProfiler ticks, for the startup time performance metric (see PerfMetrics.h)
+int64_t gStartTime = 0;
+
+// The window thread only handles window messages and input. Everything from creating the device onwards happens on the
+// render thread, and the simulation steps on a third thread (except when benchmarking). The simulation passes each
+// step to the renderer through a triple buffer (see AcquireSimulationState), so neither waits for the other and a
+// stalled window thread (e.g. while the window is dragged) stops neither
+std::thread       gRenderThread;
+std::atomic<bool> gQuit{ false }; // Tells the render and simulation threads to finish
+
+// Most time the simulation catches up on. After a long stall it skips ahead rather than running a long burst of steps
+const float MAX_SIMULATION_CATCH_UP = 0.25f;
+
+// A global error message to help track down fatal errors - set it to a useful message
+// when a serious error occurs. See how it is used belwo
+std::string gLastError;
+
+
+//--------------------------------------------------------------------------------------
+// The entry function for a Windows application is called wWinMain
+//--------------------------------------------------------------------------------------
+int APIENTRY wWinMain(_In_     HINSTANCE hInstance,
+                      _In_opt_ HINSTANCE hPrevInstance,
+                      _In_     LPWSTR    lpCmdLine,
+                      _In_     int       nCmdShow)
+{
+    UNREFERENCED_PARAMETER(hPrevInstance); // Stop warnings when not using some parameters
+    gStartTime = CpuProfiler::Now();
+    gStartupProfiler.Start(gStartTime);
+    
+
+    // Device creation: -adapter <index or part of name> -debuglayer / -nodebuglayer
+    std::string adapter;
+    if (CommandLineSwitch(lpCmdLine, L"-adapter", adapter) && !adapter.empty())  SelectAdapter(adapter);
+    std::string unused;
+    if (CommandLineSwitch(lpCmdLine, L"-debuglayer",   unused))  UseDebugLayer(true);
+    if (CommandLineSwitch(lpCmdLine, L"-nodebuglayer", unused))  UseDebugLayer(false);
+
+    // Flip-model swap chain: -flip [buffer count] -latency <max frames queued>
+    std::string swapBuffers = "2", frameLatency = "1";
+    CommandLineSwitch(lpCmdLine, L"-latency", frameLatency);
+    if (CommandLineSwitch(lpCmdLine, L"-flip", swapBuffers))
+    {
+        UseFlipModelSwapChain(std::atoi(swapBuffers.c_str()), std::atoi(frameLatency.c_str()));
+    }
+
+    // Multithreaded scene recording: -threads <count> -chunksize <models per command list>
+    std::string renderThreads, renderChunkSize;
+    if (CommandLineSwitch(lpCmdLine, L"-threads",   renderThreads)   && !renderThreads.empty())    SetRenderThreads(std::atoi(renderThreads.c_str()));
+    if (CommandLineSwitch(lpCmdLine, L"-chunksize", renderChunkSize) && !renderChunkSize.empty())  SetRenderChunkSize(std::atoi(renderChunkSize.c_str()));
+
+    // Half precision / 8-bit vertex attributes and 16-bit indices
+    if (CommandLineSwitch(lpCmdLine, L"-compactvertices", unused))  SetCompactVertices(true);
+
+    // Draw each model separately rather than instancing models that share a mesh (F4 toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-noinstancing", unused))  SetInstancedRendering(false);
+
+    // Pack the model textures into texture arrays so instancing can cover models with different textures (+ toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-materialarrays", unused))  SetMaterialArrays(true);
+
+    // Merge the static models sharing a texture into a few world space batches (Insert toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-staticbatch", unused))  SetStaticBatching(true);
+
+    // Draw the sky as the star sphere mesh rather than a full screen pass sampling a cubemap (Delete toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-skymesh", unused))  SetSkyPass(false);
+
+    // Light each model with only the lights chosen for it on the CPU, needs -noinstancing (Page Up toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-objectlights", unused))  SetObjectLights(true);
+
+    // Light the scene without shadows from the main lights (Backspace toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-noshadows", unused))  SetShadows(false);
+
+    // Gather shader invocations, primitives and overdraw for each GPU timer (Page Down toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-pipelinestats", unused))  SetPipelineStatistics(true);
+
+    // Give each sub-mesh its own vertex and index buffers rather than sharing a few large ones
+    if (CommandLineSwitch(lpCmdLine, L"-nogeometrypool", unused))  SetGeometryPool(false);
+
+    // Don't skip models hidden behind others (U toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-noocclusion", unused))  SetOcclusionCulling(false);
+
+    // Draw the particles in buffer order rather than back to front (Y toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-noparticlesort", unused))  SetParticleSorting(false);
+
+    // Always draw models at full detail (F7 toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-nolod", unused))  SetLodSelection(false);
+
+    // Draw distant models in full rather than as impostors (Numpad 0 toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-noimpostors", unused))  SetImpostors(false);
+
+    // Cull the rigid models on the GPU and draw them with indirect draws (Numpad 1 toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-gpuculling", unused))  SetGpuCulling(true);
+
+    // Lay down the depth of the opaque models before lighting them (F8 toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-depthprepass", unused))  SetDepthPrePass(true);
+
+    // Replay the static models and sky from command lists kept between frames (C toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-staticlists", unused))  SetStaticCommandLists(true);
+
+    // Reuse unchanged frames while the view sits still, e.g. for kiosk displays (Z toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-framecache", unused))  SetFrameCaching(true);
+
+    // Bloom with an FFT convolution, -fftbloom [kernel image] (N toggles while running)
+    std::string fftBloomKernel;
+    if (CommandLineSwitch(lpCmdLine, L"-fftbloom", fftBloomKernel))  SetFftBloom(true, fftBloomKernel);
+
+    // Blur the bloom only in the tiles with light in them (T toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-bloomtiles", unused))  SetBloomTiles(true);
+
+    // Use the dual filter (Kawase) blur for the Gaussian blur and bloom (J toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-dualfilterblur", unused))  SetDualFilterBlur(true);
+
+    // Render the scene at one pixel per block for the retro effect instead of pixellating it (M toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-lowresretro", unused))  SetLowResolutionRetro(true);
+
+    // Reduce the retro colour depth through a 3D colour grading LUT (H toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-colourlut", unused))  SetColourLut(true);
+
+    // Run the post-processes that have compute versions as compute shaders (E toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-computepostprocess", unused))  SetComputePostProcessing(true);
+
+    // Keep the post-processes at full precision on GPUs with 16-bit shader maths (Numpad 3 toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-nohalfprecision", unused))  SetHalfPrecisionEffects(false);
+
+    // Most frames the CPU may record ahead of the GPU, -framesinflight 1|2|3 (Numpad 4 cycles while running)
+    std::string framesInFlight;
+    if (CommandLineSwitch(lpCmdLine, L"-framesinflight", framesInFlight))  SetFramesInFlight(std::atoi(framesInFlight.c_str()));
+
+    // Draw the smooth blur passes at a reduced rate, -reducedrate auto|half|quarter. Auto only reduces it while -dynres
+    // is struggling to hold its budget (Q steps through the modes while running)
+    std::string reducedRate;
+    if (CommandLineSwitch(lpCmdLine, L"-reducedrate", reducedRate))
+    {
+        SetReducedRate(reducedRate == "half"    ? ReducedRateMode::Half :
+                       reducedRate == "quarter" ? ReducedRateMode::Quarter : ReducedRateMode::Auto);
+    }
+
+    // Anti-alias the scene's image in the post-processing, -postaa fxaa|smaa (SMAA by default, K steps through them)
+    std::string postAntiAliasing;
+    if (CommandLineSwitch(lpCmdLine, L"-postaa", postAntiAliasing))
+    {
+        SetPostAntiAliasing(postAntiAliasing == "fxaa" ? PostAntiAliasing::Fxaa : PostAntiAliasing::Smaa);
+    }
+
+    // Render the scene in HDR so the bloom works on real highlights, -hdr [r11g11b10] (R16G16B16A16_FLOAT by default)
+    std::string hdrFormat;
+    if (CommandLineSwitch(lpCmdLine, L"-hdr", hdrFormat))
+    {
+        SetSceneFormat(hdrFormat == "r11g11b10" ? DXGI_FORMAT_R11G11B10_FLOAT : DXGI_FORMAT_R16G16B16A16_FLOAT);
+    }
+
+    // Antialias the scene with the given number of samples per pixel, -msaa 2|4|8 (Tab steps through them while running)
+    std::string msaaSamples;
+    if (CommandLineSwitch(lpCmdLine, L"-msaa", msaaSamples) && !msaaSamples.empty())  SetMsaaSamples(std::atoi(msaaSamples.c_str()));
+
+    // Blur and bloom at reduced size, blended with the reprojected previous frame (F12 toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-temporal", unused))  SetTemporalEffects(true);
+
+    // Adapt the exposure to the brightness of the scene, measured on the GPU (X toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-autoexposure", unused))  SetAutoExposure(true);
+
+    // Keep rendering when another window has focus, and pause the simulation while idle (see gIdle)
+    if (CommandLineSwitch(lpCmdLine, L"-renderunfocused", unused))  gRenderUnfocused = true;
+    if (CommandLineSwitch(lpCmdLine, L"-idlepause",       unused))  gPauseSimulationInIdle = true;
+
+    // Light the models with deferred shading rather than forward lighting (F9 toggles while running)
+    if (CommandLineSwitch(lpCmdLine, L"-deferred", unused))  SetDeferredShading(true);
+
+    // Add this many small lights around the scene, to test the clustered lighting
+    std::string extraLights;
+    if (CommandLineSwitch(lpCmdLine, L"-lights", extraLights) && !extraLights.empty())  SetExtraLights(std::atoi(extraLights.c_str()));
+
+    // Number of GPU particles in the smoke and fire
+    std::string particles;
+    if (CommandLineSwitch(lpCmdLine, L"-particles", particles) && !particles.empty())  SetParticles(std::atoi(particles.c_str()));
+
+    // Stress scene for scale testing: -stressmodels N [-stresslights M] [-stressgrid] [-stressstatic], N models and M
+    // lights scattered at random (or in a grid), the models animated unless static
+    std::string stressModels, stressLights;
+    bool stressModelsGiven = CommandLineSwitch(lpCmdLine, L"-stressmodels", stressModels);
+    bool stressLightsGiven = CommandLineSwitch(lpCmdLine, L"-stresslights", stressLights);
+    if (stressModelsGiven || stressLightsGiven)
+    {
+        SetStressScene(std::atoi(stressModels.c_str()), std::atoi(stressLights.c_str()),
+                       CommandLineSwitch(lpCmdLine, L"-stressgrid",   unused),
+                       !CommandLineSwitch(lpCmdLine, L"-stressstatic", unused));
+    }
+
+    // Memory budget in megabytes for the model textures whose mip levels are streamed
+    std::string textureBudget;
+    if (CommandLineSwitch(lpCmdLine, L"-texturebudget", textureBudget) && !textureBudget.empty())  SetTextureBudget(std::atoi(textureBudget.c_str()));
+
+    // Seconds an effect can stay off before its shaders are released, 0 to keep them once loaded
+    std::string effectIdleTime;
+    if (CommandLineSwitch(lpCmdLine, L"-effectidle", effectIdleTime) && !effectIdleTime.empty())  SetEffectIdleTime(std::atoi(effectIdleTime.c_str()));
+
+    // Headless batch mode, no window: -batch <image directory or sequence e.g. frames\%04d.png> [-output <directory>]
+    // [-effects <names, e.g. tint,underwater>] [-warp]. Results go to the debugger output, the exit code is 1 on failure
+    std::string batchInput;
+    if (CommandLineSwitch(lpCmdLine, L"-batch", batchInput) && !batchInput.empty())
+    {
+        std::string batchOutput = "output", effects = "tint,underwater,retro,bloom";
+        CommandLineSwitch(lpCmdLine, L"-output",  batchOutput);
+        CommandLineSwitch(lpCmdLine, L"-effects", effects);
+        int postProcesses = PostProcessFlags(effects);
+        if (postProcesses < 0)
+        {
+            OutputDebugStringA(("Unknown post-process in -effects " + effects + "\n").c_str());
+            return 1;
+        }
+
+        UseHeadless(CommandLineSwitch(lpCmdLine, L"-warp", unused));
+        if (!RunBatch(batchInput, batchOutput, postProcesses))
+        {
+            OutputDebugStringA((gLastError + "\n").c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    // Headless shader benchmark, no window: -shaderbenchmark [results.csv] [-shaderfilter <text>] [-baseline <earlier
+    // results.csv>] [-warp]. Results go to the debugger output, the exit code is 1 on failure or any regression
+    std::string shaderBenchmarkFile = "shaderbenchmark.csv";
+    if (CommandLineSwitch(lpCmdLine, L"-shaderbenchmark", shaderBenchmarkFile))
+    {
+        std::string filter, baseline;
+        CommandLineSwitch(lpCmdLine, L"-shaderfilter", filter);
+        CommandLineSwitch(lpCmdLine, L"-baseline",     baseline);
+
+        UseHeadless(CommandLineSwitch(lpCmdLine, L"-warp", unused));
+        if (!RunShaderBenchmark(shaderBenchmarkFile, filter, baseline))
+        {
+            OutputDebugStringA((gLastError + "\n").c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    // Shader cost report from the compiler statistics, no window or device: -shadercost [shadercost.csv] [-baseline
+    // <previous build's shadercost.csv>]. Results go to the debugger output, the exit code is 1 on failure or any shader
+    // getting costlier
+    std::string shaderCostFile = "shadercost.csv";
+    if (CommandLineSwitch(lpCmdLine, L"-shadercost", shaderCostFile))
+    {
+        std::string baseline;
+        CommandLineSwitch(lpCmdLine, L"-baseline", baseline);
+        if (!RunShaderCostReport(shaderCostFile, baseline))
+        {
+            OutputDebugStringA((gLastError + "\n").c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    // Create a window to display the scene
+    if (!InitWindow(hInstance, nCmdShow))  { return 0; }
+
+    // More windows showing the scene from the one device, one on each other display where there are enough:
+    // -windows [count]. Their cameras carry on a panorama to the right unless -windowseparation <distance> is given
+    std::string numWindows = "1";
+    if (CommandLineSwitch(lpCmdLine, L"-windows", numWindows) && !gOutputWindows.Open(hInstance, gHWnd, std::atoi(numWindows.c_str())))
+    {
+        MessageBoxA(gHWnd, gLastError.c_str(), NULL, MB_OK);
+    }
+
+    // Prepare TL-Engine style input functions
+    InitInput(); 
+    InitRawInput(gHWnd); // Falls back to the WM_KEYDOWN/UP messages if raw input isn't available
+
+    // Main message loop - the render thread does everything else, and closes the window when it is done
+    gRenderThread = std::thread(RenderThread, std::wstring(lpCmdLine));
+    MSG msg = {};
+    while (GetMessage(&msg, nullptr, 0, 0) > 0) // Until the window has been destroyed
+    {
+        // The actual message processing happens in the function WndProc below
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
+    StopRenderThread();
+
+    return (int)msg.wParam;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Render thread - set up Direct3D and the scene, then update and render it until told to quit. Closes the window on
+// error or when it finishes by itself (e.g. Escape key)
+//--------------------------------------------------------------------------------------
+void RenderThread(std::wstring commandLine)
+{
+    // Initialise Direct3D
+    bool initialised;
+    {
+        STARTUP_SCOPE(StartupStage::Phase, "InitDirect3D");
+        initialised = InitDirect3D();
+    }
+    if (!initialised)
+    {
+        MessageBoxA(gHWnd, gLastError.c_str(), NULL, MB_OK);
+        PostMessage(gHWnd, WM_CLOSE, 0, 0);
+        return;
+    }
+
+    // The output windows share the device. Any that fail stay blank
+    if (!gOutputWindows.CreateSwapChains())
+    {
+        MessageBoxA(gHWnd, gLastError.c_str(), NULL, MB_OK);
+        gOutputWindows.Release();
+    }
+
+    // Initialise scene
+    {
+        STARTUP_SCOPE(StartupStage::Phase, "InitGeometry");
+        initialised = InitGeometry();
+    }
+    if (initialised)
+    {
+        STARTUP_SCOPE(StartupStage::Phase, "InitScene");
+        initialised = InitScene();
+    }
+    if (!initialised)
+    {   
+        MessageBoxA(gHWnd, gLastError.c_str(), NULL, MB_OK);
+        ReleaseResources();
+        ShutdownDirect3D();
+        PostMessage(gHWnd, WM_CLOSE, 0, 0);
+        return;
+    }
+
+    // List where the loading time went in the debugger output
+    gCpuProfiler.EndFrame();
+    OutputDebugStringA(("Loading:\n" + gCpuProfiler.Report()).c_str());
+    float startupTime = static_cast<float>(CpuProfiler::Now() - gStartTime) * 1000 / CpuProfiler::Frequency();
+    gPerfMetrics.AddSample("startup_ms", "ms", startupTime);
+
+    // Benchmark mode: -benchmark [results.csv]
+    std::string benchmarkFile = "benchmark.csv";
+    if (CommandLineSwitch(commandLine, L"-benchmark", benchmarkFile))
+    {
+        StartBenchmark(benchmarkFile);
+    }
+
+    // Dynamic resolution: -dynres [GPU budget in ms]
+    std::string resolutionBudget = "15";
+    if (CommandLineSwitch(commandLine, L"-dynres", resolutionBudget))
+    {
+        SetDynamicResolution(true, static_cast<float>(std::atof(resolutionBudget.c_str())));
+    }
+
+    // Fixed reduced resolution: -renderscale [fraction of the window size], 0.75 by default
+    std::string renderScale = "0.75";
+    if (CommandLineSwitch(commandLine, L"-renderscale", renderScale))
+    {
+        SetRenderScale(static_cast<float>(std::atof(renderScale.c_str())));
+    }
+
+    // Upscale the reduced resolution scene along its edges and sharpen it: -spatialupscale [sharpness 0 to 1] (Numpad 2
+    // toggles while running)
+    std::string upscaleSharpness = "0.8";
+    if (CommandLineSwitch(commandLine, L"-spatialupscale", upscaleSharpness))
+    {
+        SetSpatialUpscale(true, static_cast<float>(std::atof(upscaleSharpness.c_str())));
+    }
+
+    // Several views side by side: -stereo [eye separation] for a stereo pair, -views [count] for a panorama
+    std::string stereoSeparation = "0.5";
+    std::string numViews = "3";
+    if (CommandLineSwitch(commandLine, L"-stereo", stereoSeparation))
+    {
+        SetMultiView(2, static_cast<float>(std::atof(stereoSeparation.c_str())));
+    }
+    else if (CommandLineSwitch(commandLine, L"-views", numViews))
+    {
+        SetMultiView(std::atoi(numViews.c_str()), 0);
+    }
+    std::string windowSeparation;
+    if (CommandLineSwitch(commandLine, L"-windowseparation", windowSeparation))
+    {
+        SetOutputWindowSeparation(static_cast<float>(std::atof(windowSeparation.c_str())));
+    }
+
+    // Effect quality governor: -governor [GPU budget in ms]
+    std::string governorBudget = "15";
+    if (CommandLineSwitch(commandLine, L"-governor", governorBudget))
+    {
+        SetQualityGovernor(true, static_cast<float>(std::atof(governorBudget.c_str())));
+    }
+
+    // Stream frame times: -telemetry <file.csv or \\.\pipe\name>
+    std::string telemetryStream;
+    if (CommandLineSwitch(commandLine, L"-telemetry", telemetryStream) && !telemetryStream.empty())
+    {
+        if (!gTelemetry.OpenStream(telemetryStream))
+        {
+            MessageBoxA(gHWnd, gLastError.c_str(), NULL, MB_OK);
+        }
+    }
+
+    // Record the input and frame times to reproduce a session later: -recordinput [input.rec]. Replay a recording with a
+    // fixed time step then quit, given the same switches as when it was recorded: -replayinput <input.rec>
+    std::string inputRecording = "input.rec";
+    if (CommandLineSwitch(commandLine, L"-recordinput", inputRecording) && !StartInputRecording(inputRecording))
+    {
+        MessageBoxA(gHWnd, ("Error creating input recording " + inputRecording).c_str(), NULL, MB_OK);
+    }
+    std::string inputReplay;
+    bool replayingInput = false;
+    if (CommandLineSwitch(commandLine, L"-replayinput", inputReplay) && !inputReplay.empty())
+    {
+        replayingInput = StartInputReplay(inputReplay);
+        if (replayingInput)  OutputDebugStringA(InputReplaySummary().c_str());
+        else                 MessageBoxA(gHWnd, ("Error reading input recording " + inputReplay).c_str(), NULL, MB_OK);
+    }
+
+    // Serve live metrics for monitoring in the Prometheus text format: -metrics [port]
+    std::string metricsPort = std::to_string(MetricsServer::DEFAULT_PORT);
+    if (CommandLineSwitch(commandLine, L"-metrics", metricsPort))
+    {
+        if (!gMetricsServer.Start(std::atoi(metricsPort.c_str())))
+        {
+            MessageBoxA(gHWnd, gLastError.c_str(), NULL, MB_OK);
+        }
+    }
+
+    // Cap the frame rate in software: -fpscap <frames per second>
+    std::string frameRateCap;
+    if (CommandLineSwitch(commandLine, L"-fpscap", frameRateCap) && !frameRateCap.empty())
+    {
+        SetFrameRateCap(static_cast<float>(std::atof(frameRateCap.c_str())));
+    }
+
+    // Record the frames shown: -capture <video.y4m, frames.rgba or directory for PNG files>
+    std::string captureDestination;
+    if (CommandLineSwitch(commandLine, L"-capture", captureDestination) && !captureDestination.empty())
+    {
+        if (!StartFrameCapture(captureDestination))
+        {
+            MessageBoxA(gHWnd, gLastError.c_str(), NULL, MB_OK);
+        }
+    }
+
+    // Hand the frames to other processes on the GPU: -shareoutput [shared memory name]
+    std::string sharedOutputName = "Local\\PostProcessingOutput";
+    if (CommandLineSwitch(commandLine, L"-shareoutput", sharedOutputName))
+    {
+        if (!gSharedOutput.Start(sharedOutputName))
+        {
+            MessageBoxA(gHWnd, gLastError.c_str(), NULL, MB_OK);
+        }
+    }
+
+    // Capture the first frames to a Chrome trace file: -trace [trace.json]
+    std::string traceFile = "trace.json";
+    if (CommandLineSwitch(commandLine, L"-trace", traceFile))
+    {
+        if (!StartTraceCapture(traceFile, TRACE_CAPTURE_FRAMES))
+        {
+            MessageBoxA(gHWnd, gLastError.c_str(), NULL, MB_OK);
+        }
+    }
+
+    // Write the startup timeline, each phase and asset load on the thread it ran on, to a Chrome trace file once the
+    // streamed textures have loaded: -startuptrace [startup.json]. The summary always goes to the debugger output
+    std::string startupTraceFile = "startup.json";
+    if (!CommandLineSwitch(commandLine, L"-startuptrace", startupTraceFile))  startupTraceFile.clear();
+
+    // Recompile shaders when their source files are edited: -hotreload
+    std::string unused;
+    if (CommandLineSwitch(commandLine, L"-hotreload", unused))
+    {
+        if (!gShaderReloader.Start())
+        {
+            MessageBoxA(gHWnd, gLastError.c_str(), NULL, MB_OK);
+        }
+    }
+
+    // Will use a timer class to help in this tutorial (not part of DirectX). It's like a stopwatch - start it counting now
+    gTimer.Start();
+
+    // The benchmark and input replay step the simulation themselves, once per frame, so every run renders exactly the same
+    // frames
+    std::thread simulationThread;
+    if (!BenchmarkRunning() && !replayingInput)  simulationThread = std::thread(SimulationThread);
+
+    while (!gQuit)
+    {
+        if (replayingInput && !InputReplaying())  break; // Every recorded step replayed
+
+        // Nothing would be seen, so do no GPU work until the window is visible again. A benchmark or replay always runs
+        bool idle = gWindowMinimised || (!gWindowFocused && !gRenderUnfocused) || SwapChainOccluded();
+        if (idle && !BenchmarkRunning() && !replayingInput)
+        {
+            gIdle = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_POLL_INTERVAL));
+            if (SwapChainOccluded())  TestOcclusion();
+            gTimer.GetLapTime(); // Idle time isn't a frame
+            continue;
+        }
+        gIdle = false;
+
+        // Recreate the targets if the window size has changed
+        if (!ResizeScene(gWindowWidth, gWindowHeight))
+        {
+            MessageBoxA(gHWnd, gLastError.c_str(), NULL, MB_OK);
+            break;
+        }
+
+        // Update the scene by the amount of time since the last frame
+        float frameTime = gTimer.GetLapTime();
+        RecordFrameTime(frameTime);
+        gTelemetry.RecordFrame(frameTime * 1000, gGpuProfiler.FrameMilliseconds());
+        gMetricsServer.Update(frameTime);
+
+        // The benchmark records the real frame time, but updates the scene with a fixed time step so every run is the same.
+        // A replay does the same, each frame taking the input of the next recorded step
+        float interpolation;
+        if (BenchmarkRunning() || replayingInput)
+        {
+            if (BenchmarkRunning())
+            {
+                if (!UpdateBenchmark(frameTime))
+                {
+                    MessageBoxA(gHWnd, gLastError.c_str(), NULL, MB_OK);
+                }
+                if (!BenchmarkRunning())  break; // Finished
+            }
+
+            frameTime = BENCHMARK_TIME_STEP;
+            ProcessInputEvents(CpuProfiler::Now());
+            SimulateScene(0);
+            AcquireSimulationState();
+            interpolation = 1; // Draw the step just simulated
+        }
+        else
+        {
+            // Draw the moving parts as they were at this moment, between the two states of the latest step
+            double stepEnd = AcquireSimulationState();
+            double now = static_cast<double>(CpuProfiler::Now()) / CpuProfiler::Frequency();
+            interpolation = 1.0f - static_cast<float>((stepEnd - now) / SIMULATION_TIME_STEP);
+            interpolation = (interpolation < 0.0f) ? 0.0f : (interpolation > 1.0f) ? 1.0f : interpolation;
+        }
+
+        UpdateScene(frameTime);
+
+        // Draw the scene
+        RenderScene(frameTime, interpolation);
+
+        // Gather the CPU timings of this frame's update and render for the report (see Scene.cpp)
+        gCpuProfiler.EndFrame();
+        if (!UpdateTraceCapture())
+        {
+            MessageBoxA(gHWnd, gLastError.c_str(), NULL, MB_OK);
+        }
+        if (!gStartupProfiler.Update(TexturesStreaming(), startupTraceFile))
+        {
+            MessageBoxA(gHWnd, gLastError.c_str(), NULL, MB_OK);
+        }
+
+        if (KeyHit(Key_Escape))  break;
+    }
+
+    // Release everything before quitting
+    gQuit = true;
+    if (simulationThread.joinable())  simulationThread.join();
+    StopInputRecording();
+    gMetricsServer.Stop();
+    ReleaseResources();
+    ShutdownDirect3D();
+
+    // Close the window if it wasn't closed already (this will ultimately end the message loop)
+    PostMessage(gHWnd, WM_CLOSE, 0, 0);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Simulation thread - step the simulation in time with the real clock until told to quit
+//--------------------------------------------------------------------------------------
+void SimulationThread()
+{
+    timeBeginPeriod(1); // Sleep to the nearest millisecond rather than the default 15ms or so
+
+    int64_t frequency = CpuProfiler::Frequency();
+    int64_t stepTicks = static_cast<int64_t>(SIMULATION_TIME_STEP * frequency);
+    int64_t maxCatchUp = static_cast<int64_t>(MAX_SIMULATION_CATCH_UP * frequency);
+    int64_t nextStep = CpuProfiler::Now(); // Start time of the next step
+
+    while (!gQuit)
+    {
+        if (gIdle && gPauseSimulationInIdle)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_POLL_INTERVAL));
+            nextStep = CpuProfiler::Now(); // Carry on from where it stopped rather than catching up
+            continue;
+        }
+
+        // Run each step as soon as its start time is reached, so its end state is ready in time to be drawn
+        int64_t now = CpuProfiler::Now();
+        if (now < nextStep)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds((nextStep - now) * 1000000 / frequency));
+            continue;
+        }
+        if (now - nextStep > maxCatchUp)  nextStep = now;
+
+        nextStep += stepTicks;
+        ProcessInputEvents(nextStep); // Steps run in a burst to catch up only see the input that came before each
+        SimulateScene(static_cast<double>(nextStep) / frequency);
+    }
+
+    timeEndPeriod(1);
+}
+
+
+// Tell the render thread to finish and wait for it, still handling window messages meanwhile (the render thread may be
+// waiting on the window, e.g. while setting its title)
+void StopRenderThread()
+{
+    if (!gRenderThread.joinable() || gQuit)  return; // Not running, or already being stopped further up the stack
+    gQuit = true;
+
+    HANDLE thread = gRenderThread.native_handle();
+    while (MsgWaitForMultipleObjects(1, &thread, FALSE, INFINITE, QS_ALLINPUT) == WAIT_OBJECT_0 + 1)
+    {
+        MSG msg;
+        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+        {
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+    }
+    gRenderThread.join();
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Create a window to display our scene, returns false on failure.
+//--------------------------------------------------------------------------------------
+BOOL InitWindow(HINSTANCE hInstance, int nCmdShow)
+{
+    // Get a stock icon to show on the taskbar for this program.
+    SHSTOCKICONINFO stockIcon;
+    stockIcon.cbSize = sizeof(stockIcon);
+    if (SHGetStockIconInfo(SIID_APPLICATION, SHGSI_ICON, &stockIcon) != S_OK) // Returns false on failure
+    {
+        return false;
+    }
+
+    // Register window class. Defines various UI features of the window for our application.
+    WNDCLASSEX wcex;
+    wcex.cbSize = sizeof(WNDCLASSEX);
+    wcex.style = CS_HREDRAW | CS_VREDRAW;
+    wcex.lpfnWndProc = WndProc;    // Which function deals with windows messages
+    wcex.cbClsExtra = 0;
+    wcex.cbWndExtra = 0; SIID_APPLICATION;
+    wcex.hInstance = hInstance;
+    wcex.hIcon = stockIcon.hIcon; // Which icon to use for the window
+    wcex.hCursor = LoadCursor(nullptr, IDC_ARROW); // What cursor appears over the window
+    wcex.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+    wcex.lpszMenuName = nullptr;
+    wcex.lpszClassName = L"CO3303WindowClass";
+    wcex.hIconSm = stockIcon.hIcon;
+    if (!RegisterClassEx(&wcex)) // Returns false on failure
+    {
+        return false;
+    }
+
+
+    // Select the type of window to show our application in
+    DWORD windowStyle = WS_OVERLAPPEDWINDOW; // Standard window
+    //DWORD windowStyle = WS_POPUP;          // Alternative: borderless. If you also set the viewport size to the monitor resolution, you 
+                                             // get a "fullscreen borderless" window, which works better with alt-tab than DirectX fullscreen,
+                                             // which is an option in Direct3DSetup.cpp
+
+    // Calculate overall dimensions for the window. We will render to the *inside* of the window. But the
+    // overall winder will be larger if it includes borders, title bar etc. This code calculates the overall
+    // size of the window given our choice of viewport size.
+    RECT rc = { 0, 0, gViewportWidth, gViewportHeight };
+    AdjustWindowRect(&rc, windowStyle, FALSE);
+
+    // Create window, the second parameter is the text that appears in the title bar at first
+    gHInst = hInstance;
+    gHWnd = CreateWindow(L"CO3303WindowClass", L"Direct3D 11", windowStyle,
+                         CW_USEDEFAULT, CW_USEDEFAULT, rc.right - rc.left, rc.bottom - rc.top, nullptr, nullptr, hInstance, nullptr);
+    if (!gHWnd)
+    {
+        return false;
+    }
+
+    ShowWindow(gHWnd, nCmdShow);
+    UpdateWindow(gHWnd);
+
+    return TRUE;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Deal with a message from Windows. There are very many possible messages, such as keyboard/mouse input, resizing
+// or minimizing windows, the system shutting down etc. We only deal with messages that we are interested in
+//--------------------------------------------------------------------------------------
+LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    switch (message)
+    {
+    case WM_PAINT: // A necessary message to ensure the window content is displayed
+    {
+        PAINTSTRUCT ps;
+        HDC hdc = BeginPaint(hWnd, &ps);
+        EndPaint(hWnd, &ps);
+    }
+    break;
+
+    case WM_CLOSE: // Stop rendering into the window before it goes
+        StopRenderThread();
+        DestroyWindow(hWnd);
+        break;
+
+    case WM_DESTROY: // Another necessary message to deal with the window being closed
+        gOutputWindows.Close(); // The render thread has stopped by now
+        PostQuitMessage(0);
+        break;
+
+    case WM_SIZE: // The window has been resized, the new client area size is in lParam. The resize happens in the main loop
+        gWindowMinimised = (wParam == SIZE_MINIMIZED);
+        if (wParam != SIZE_MINIMIZED)
+        {
+            gWindowWidth  = LOWORD(lParam);
+            gWindowHeight = HIWORD(lParam);
+        }
+        break;
+
+
+    // Keyboard input from InitRawInput. The default handling must still be called to release the message's data
+    case WM_INPUT:
+        RawInputEvent(lParam);
+        return DefWindowProc(hWnd, message, wParam, lParam);
+
+    case WM_KILLFOCUS: // Keys released while another window has focus are never reported
+        FocusLostEvent();
+        gWindowFocused = false;
+        break;
+
+    case WM_SETFOCUS:
+        gWindowFocused = true;
+        break;
+
+    // The WM_KEYXXXX messages report keyboard input to our window.
+    // This application has added some simple functions (not DirectX) to process these messages (all in Input.cpp/h)
+    // so you don't need to change this code. Instead simply use KeyHit, KeyHeld etc.
+    case WM_KEYDOWN:
+        KeyDownEvent(static_cast<KeyCode>(wParam));
+        break;
+
+    case WM_KEYUP:
+        KeyUpEvent(static_cast<KeyCode>(wParam));
+        break;
+
+
+    // The following WM_XXXX messages report mouse movement and button presses
+    // Use KeyHit to get mouse buttons, GetMouseX, GetMouseY for its position
+    case WM_MOUSEMOVE:
+    {
+        MouseMoveEvent(LOWORD(lParam), HIWORD(lParam));
+        break;
+    }
+    case WM_LBUTTONDOWN:
+    {
+        KeyDownEvent(Mouse_LButton);
+        break;
+    }
+    case WM_LBUTTONUP:
+    {
+        KeyUpEvent(Mouse_LButton);
+        break;
+    }
+    case WM_RBUTTONDOWN:
+    {
+        KeyDownEvent(Mouse_RButton);
+        break;
+    }
+    case WM_RBUTTONUP:
+    {
+        KeyUpEvent(Mouse_RButton);
+        break;
+    }
+    case WM_MBUTTONDOWN:
+    {
+        KeyDownEvent(Mouse_MButton);
+        break;
+    }
+    case WM_MBUTTONUP:
+    {
+        KeyUpEvent(Mouse_MButton);
+        break;
+    }
+
+
+    // Any messages we don't handle are passed back to Windows default handling
+    default:
+        return DefWindowProc(hWnd, message, wParam, lParam);
+    }
+
+    return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Look for a switch such as "-benchmark" on the command line, returns true if it is there. If the switch is
+// followed by a value (anything not starting with '-') it is returned in value, otherwise value is unchanged. Only
+// whole switches match, so "-windows" isn't found inside "-windowseparation"
+//--------------------------------------------------------------------------------------
+bool CommandLineSwitch(const std::wstring& commandLine, const std::wstring& name, std::string& value)
+{
+    size_t switchStart = commandLine.find(name);
+    while (switchStart != std::wstring::npos)
+    {
+        size_t switchEnd = switchStart + name.length();
+        if ((switchStart == 0 || commandLine[switchStart - 1] == L' ') &&
+            (switchEnd == commandLine.length() || commandLine[switchEnd] == L' '))
+        {
+            break;
+        }
+        switchStart = commandLine.find(name, switchStart + 1);
+    }
+    if (switchStart == std::wstring::npos)  return false;
+
+    size_t valueStart = commandLine.find_first_not_of(L' ', switchStart + name.length());
+    if (valueStart != std::wstring::npos && commandLine[valueStart] != L'-')
+    {
+        std::wstring wideValue = commandLine.substr(valueStart, commandLine.find(L' ', valueStart) - valueStart);
+        value = std::string(wideValue.begin(), wideValue.end());
+    }
+    return true;
+}
@@ -0,0 +1,203 @@
+//--------------------------------------------------------------------------------------
+// Material texture arrays
+//--------------------------------------------------------------------------------------
+// See MaterialArrays.h for an overview
+
+#include "MaterialArrays.h"
+#include "ResourceRegistry.h"
+#include "Common.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+MaterialArrays gMaterialArrays;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+MaterialArrays::~MaterialArrays()
+{
+	Release();
+}
+
+
+void MaterialArrays::Release()
+{
+	ReleaseArrays();
+	mSources.clear();
+	mFailed = false;
+}
+
+
+bool MaterialArrays::Update(const std::vector<ID3D11ShaderResourceView*>& textures)
+{
+	std::vector<Source> sources;
+	for (auto* texture : textures)
+	{
+		if (texture == nullptr)  continue; // Not loaded
+		if (std::any_of(sources.begin(), sources.end(), [texture](const Source& source) { return source.texture == texture; }))  continue;
+
+		Source source = {};
+		source.texture = texture;
+		texture->GetDesc(&source.viewDesc);
+		if (source.viewDesc.ViewDimension != D3D11_SRV_DIMENSION_TEXTURE2D)  continue; // Only plain 2D textures are packed
+
+		ID3D11Resource* resource;
+		texture->GetResource(&resource);
+		HRESULT result = resource->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&source.resource));
+		resource->Release();
+		if (FAILED(result))  continue;
+		source.resource->Release(); // Kept alive by the view
+		source.resource->GetDesc(&source.desc);
+		source.minLOD = gD3DContext->GetResourceMinLOD(source.resource);
+		sources.push_back(source);
+	}
+
+	// Nothing to do unless a texture has been replaced, resized or has had a level completed
+	auto same = [](const Source& a, const Source& b)
+	{
+		return a.texture == b.texture && a.resource == b.resource && a.minLOD == b.minLOD &&
+		       std::memcmp(&a.desc, &b.desc, sizeof(a.desc)) == 0 && std::memcmp(&a.viewDesc, &b.viewDesc, sizeof(a.viewDesc)) == 0;
+	};
+	if (sources.size() == mSources.size() && std::equal(sources.begin(), sources.end(), mSources.begin(), same))  return !mFailed;
+
+	ReleaseArrays();
+	mSources = sources;
+	++mVersion;
+
+	// Each source goes in the array of the first earlier source it is compatible with, so the slices keep their order
+	bool ok = true;
+	std::vector<bool> packed(mSources.size(), false);
+	for (size_t i = 0; i < mSources.size(); ++i)
+	{
+		if (packed[i])  continue;
+		std::vector<const Source*> group;
+		for (size_t j = i; j < mSources.size(); ++j)
+		{
+			if (!packed[j] && Compatible(mSources[i], mSources[j]))
+			{
+				group.push_back(&mSources[j]);
+				packed[j] = true;
+			}
+		}
+		if (!Pack(group))  ok = false; // The others are still packed
+	}
+	mFailed = !ok;
+	return ok;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Data access
+//--------------------------------------------------------------------------------------
+
+ID3D11ShaderResourceView* MaterialArrays::Find(ID3D11ShaderResourceView* texture, unsigned int* slice)
+{
+	for (auto& entry : mEntries)
+	{
+		if (entry.texture == texture)
+		{
+			*slice = entry.slice;
+			return entry.array;
+		}
+	}
+	*slice = 0;
+	return nullptr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+// The array takes its description from the first texture, so its levels and view must fit every other
+bool MaterialArrays::Compatible(const Source& a, const Source& b)
+{
+	return a.desc.Width == b.desc.Width && a.desc.Height == b.desc.Height && a.desc.MipLevels == b.desc.MipLevels &&
+	       a.desc.Format == b.desc.Format && a.desc.ArraySize == 1 && b.desc.ArraySize == 1 &&
+	       a.desc.SampleDesc.Count == 1 && b.desc.SampleDesc.Count == 1 && a.viewDesc.Format == b.viewDesc.Format &&
+	       a.viewDesc.Texture2D.MostDetailedMip == b.viewDesc.Texture2D.MostDetailedMip &&
+	       a.viewDesc.Texture2D.MipLevels == b.viewDesc.Texture2D.MipLevels;
+}
+
+
+void MaterialArrays::ReleaseArrays()
+{
+	for (auto* view : mArrayViews)        view->Release();
+	for (auto* texture : mArrayTextures)  texture->Release();
+	mArrayViews.clear();
+	mArrayTextures.clear();
+	mEntries.clear();
+	mNumArrays = mNumPacked = 0;
+}
+
+
+bool MaterialArrays::Pack(const std::vector<const Source*>& sources)
+{
+	const Source& first = *sources[0];
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+	viewDesc.Format = first.viewDesc.Format;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	viewDesc.Texture2DArray.MostDetailedMip = first.viewDesc.Texture2D.MostDetailedMip;
+	viewDesc.Texture2DArray.MipLevels = first.viewDesc.Texture2D.MipLevels;
+	viewDesc.Texture2DArray.FirstArraySlice = 0;
+	viewDesc.Texture2DArray.ArraySize = static_cast<UINT>(sources.size());
+
+	// A texture on its own is viewed as an array of one, the shaders only read arrays
+	ID3D11ShaderResourceView* view = nullptr;
+	if (sources.size() == 1)
+	{
+		if (FAILED(gD3DDevice->CreateShaderResourceView(first.resource, &viewDesc, &view)))
+		{
+			gLastError = "Error creating material array view";
+			return false;
+		}
+		mArrayViews.push_back(view);
+		mEntries.push_back({ first.texture, view, 0 });
+		return true;
+	}
+
+	D3D11_TEXTURE2D_DESC textureDesc = first.desc;
+	textureDesc.ArraySize = static_cast<UINT>(sources.size());
+	textureDesc.Usage = D3D11_USAGE_DEFAULT; // Copied into
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	textureDesc.CPUAccessFlags = 0;
+	textureDesc.MiscFlags = 0;
+	ID3D11Texture2D* texture = nullptr;
+	if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, nullptr, &texture)))
+	{
+		gLastError = "Error creating material array";
+		return false;
+	}
+	gResourceRegistry.Track(texture);
+	if (FAILED(gD3DDevice->CreateShaderResourceView(texture, &viewDesc, &view)))
+	{
+		texture->Release();
+		gLastError = "Error creating material array view";
+		return false;
+	}
+
+	// Every level of every source, the levels a source is still streaming are hidden by the array's min LOD as they were
+	// by the source's own
+	float minLOD = 0;
+	for (UINT slice = 0; slice < sources.size(); ++slice)
+	{
+		for (UINT mip = 0; mip < textureDesc.MipLevels; ++mip)
+		{
+			gD3DContext->CopySubresourceRegion(texture, D3D11CalcSubresource(mip, slice, textureDesc.MipLevels), 0, 0, 0,
+			                                   sources[slice]->resource, D3D11CalcSubresource(mip, 0, textureDesc.MipLevels), nullptr);
+		}
+		minLOD = std::max(minLOD, sources[slice]->minLOD);
+		mEntries.push_back({ sources[slice]->texture, view, slice });
+	}
+	gD3DContext->SetResourceMinLOD(texture, minLOD);
+
+	mArrayTextures.push_back(texture);
+	mArrayViews.push_back(view);
+	++mNumArrays;
+	mNumPacked += static_cast<int>(sources.size());
+	return true;
+}
@@ -0,0 +1,98 @@
+//--------------------------------------------------------------------------------------
+// Material texture arrays
+//--------------------------------------------------------------------------------------
+// An instanced draw can only cover models sharing a texture as well as a mesh, as the texture is bound between draws.
+// This packs the model textures that have the same size, format and mip levels into a Texture2DArray each, giving every
+// texture a slice in its array. The instanced lighting shaders with MATERIAL_ARRAY defined read the slice from each
+// instance's data (InstanceData::textureSlice), so models whose textures share an array are drawn by one instanced draw. A texture with
+// nothing to share with is viewed as an array of one slice, with no copy.
+//
+// The model textures are streamed (see TextureStreamer.h), so they are replaced and change size as mip levels are added
+// and dropped. Update repacks the arrays, copying the textures on the GPU, whenever any of the textures, their levels or
+// the level they can be sampled from (SetResourceMinLOD) have changed - each time a streamed level is complete. The
+// copies settle when the streaming does. The packed textures take twice their memory while they are in an array
+
+#ifndef _MATERIAL_ARRAYS_H_INCLUDED_
+#define _MATERIAL_ARRAYS_H_INCLUDED_
+
+#include <d3d11.h>
+#include <cstdint>
+#include <vector>
+
+
+class MaterialArrays
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~MaterialArrays();
+
+	void Release();
+
+	// Repack the arrays for the given textures if anything about them has changed since the last call. Call on the main
+	// thread between frames, after gTextureStreamer.Update, with every texture drawn by the instanced lighting shaders.
+	// Returns false on failure (reason in gLastError), the textures that couldn't be packed have no array
+	bool Update(const std::vector<ID3D11ShaderResourceView*>& textures);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// The array holding a texture given to the last Update, with the texture's slice in it. Null if the texture wasn't
+	// given or couldn't be packed. Safe to call from several threads at once, but not at the same time as Update
+	ID3D11ShaderResourceView* Find(ID3D11ShaderResourceView* texture, unsigned int* slice);
+
+	int      NumArrays()  { return mNumArrays; } // Arrays holding more than one texture
+	int      NumPacked()  { return mNumPacked; } // Textures copied into them
+	uint64_t Version()    { return mVersion;   } // Changes each time the arrays are repacked
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// What the arrays were packed from, Update only repacks when this changes
+	struct Source
+	{
+		ID3D11ShaderResourceView*       texture;
+		ID3D11Texture2D*                resource; // Not referenced, valid while the texture is
+		D3D11_TEXTURE2D_DESC            desc;
+		D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+		float                           minLOD;
+	};
+
+	// Textures can share an array if everything about them but their contents matches
+	static bool Compatible(const Source& a, const Source& b);
+
+	// Release the arrays but not the sources they were packed from
+	void ReleaseArrays();
+
+	// Create one array from the given sources, adding their entries. Returns false on failure (reason in gLastError)
+	bool Pack(const std::vector<const Source*>& sources);
+
+	// Where each source went
+	struct Entry
+	{
+		ID3D11ShaderResourceView* texture;
+		ID3D11ShaderResourceView* array;
+		unsigned int              slice;
+	};
+
+	std::vector<Source>                    mSources;
+	std::vector<Entry>                     mEntries;
+	std::vector<ID3D11Texture2D*>          mArrayTextures; // Only for the arrays of more than one texture
+	std::vector<ID3D11ShaderResourceView*> mArrayViews;
+	int      mNumArrays = 0;
+	int      mNumPacked = 0;
+	uint64_t mVersion   = 0;
+	bool     mFailed    = false; // Returned again by Update until the sources change
+};
+
+
+extern MaterialArrays gMaterialArrays;
+
+
+#endif //_MATERIAL_ARRAYS_H_INCLUDED_
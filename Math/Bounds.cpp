@@ -0,0 +1,154 @@
+//--------------------------------------------------------------------------------------
+// Bounding volumes and view frustum tests
+//--------------------------------------------------------------------------------------
+
+#include "Bounds.h"
+
+#include <algorithm>
+
+
+/*-----------------------------------------------------------------------------------------
+  Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// The smallest box containing both boxes
+BoundingBox Union(const BoundingBox& a, const BoundingBox& b)
+{
+    return { { std::min(a.minimum.x, b.minimum.x), std::min(a.minimum.y, b.minimum.y), std::min(a.minimum.z, b.minimum.z) },
+             { std::max(a.maximum.x, b.maximum.x), std::max(a.maximum.y, b.maximum.y), std::max(a.maximum.z, b.maximum.z) } };
+}
+
+// Test if the outer box entirely contains the inner one
+bool Contains(const BoundingBox& outer, const BoundingBox& inner)
+{
+    return outer.minimum.x <= inner.minimum.x && outer.minimum.y <= inner.minimum.y && outer.minimum.z <= inner.minimum.z &&
+           outer.maximum.x >= inner.maximum.x && outer.maximum.y >= inner.maximum.y && outer.maximum.z >= inner.maximum.z;
+}
+
+// The axis-aligned box that encloses the given box transformed by a world matrix. The transformed centre plus the half
+// extents projected onto each world axis
+BoundingBox TransformBox(const BoundingBox& box, const CMatrix4x4& world)
+{
+    CVector3 e = box.HalfExtents();
+    CVector3 centre = TransformPoint(box.Centre(), world);
+    CVector3 extents = { e.x * std::abs(world.e00) + e.y * std::abs(world.e10) + e.z * std::abs(world.e20),
+                         e.x * std::abs(world.e01) + e.y * std::abs(world.e11) + e.z * std::abs(world.e21),
+                         e.x * std::abs(world.e02) + e.y * std::abs(world.e12) + e.z * std::abs(world.e22) };
+    return { centre - extents, centre + extents };
+}
+
+// Test if a box and sphere overlap - compare the distance from the sphere centre to the nearest point in the box
+bool Overlaps(const BoundingBox& box, const CVector3& centre, float radius)
+{
+    CVector3 nearest = { std::min(std::max(centre.x, box.minimum.x), box.maximum.x),
+                         std::min(std::max(centre.y, box.minimum.y), box.maximum.y),
+                         std::min(std::max(centre.z, box.minimum.z), box.maximum.z) };
+    CVector3 offset = nearest - centre;
+    return Dot(offset, offset) <= radius * radius;
+}
+
+// Find where a ray first enters a box, if it does so within the given distance. Uses the slab method: the ray is
+// inside the box where it is between all three pairs of planes
+bool IntersectRay(const BoundingBox& box, const CVector3& origin, const CVector3& inverseDirection, float maxDistance, float& distance)
+{
+    const float* minimum = &box.minimum.x;
+    const float* maximum = &box.maximum.x;
+    const float* start   = &origin.x;
+    const float* inverse = &inverseDirection.x;
+
+    float enter = 0.0f;
+    float leave = maxDistance;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float t1 = (minimum[axis] - start[axis]) * inverse[axis];
+        float t2 = (maximum[axis] - start[axis]) * inverse[axis];
+        if (t1 > t2)  std::swap(t1, t2);
+
+        // A ray parallel to a slab and outside it gives NaN from 0 * infinity, the comparisons below reject those
+        if (!(t1 <= leave) || !(t2 >= enter))  return false;
+        enter = std::max(enter, t1);
+        leave = std::min(leave, t2);
+    }
+    distance = enter;
+    return true;
+}
+
+// Extract the frustum planes from a view-projection matrix (DirectX conventions: row vectors, depth from 0 to 1).
+// A point p is projected to clip space (x,y,z,w) using the columns of the matrix, and is inside the frustum if
+// -w <= x <= w, -w <= y <= w and 0 <= z <= w. Each of those inequalities is a plane made from two columns
+Frustum FrustumFromMatrix(const CMatrix4x4& m)
+{
+    const float column[4][4] = { { m.e00, m.e10, m.e20, m.e30 },
+                                 { m.e01, m.e11, m.e21, m.e31 },
+                                 { m.e02, m.e12, m.e22, m.e32 },
+                                 { m.e03, m.e13, m.e23, m.e33 } };
+
+    // Left, right, bottom, top, near, far: w+x, w-x, w+y, w-y, z, w-z
+    const int   axis[6] = { 0, 0, 1, 1, 2, 2 };
+    const float sign[6] = { 1, -1, 1, -1, 1, -1 };
+    const float w[6]    = { 1, 1, 1, 1, 0, 1 };
+
+    Frustum frustum;
+    for (int i = 0; i < 6; ++i)
+    {
+        const float* c = column[axis[i]];
+        CVector3 normal = { w[i] * column[3][0] + sign[i] * c[0],
+                            w[i] * column[3][1] + sign[i] * c[1],
+                            w[i] * column[3][2] + sign[i] * c[2] };
+        float distance = w[i] * column[3][3] + sign[i] * c[3];
+
+        // Normalise so distances to the plane are in world units (needed for the sphere test)
+        float length = Length(normal);
+        frustum.planes[i].normal   = normal * (1.0f / length);
+        frustum.planes[i].distance = distance / length;
+    }
+    return frustum;
+}
+
+
+// Test if a box and sphere (around the same points) transformed by the given world matrix are at least partly inside
+// the frustum
+bool IsInFrustum(const Frustum& frustum, const BoundingBox& box, const BoundingSphere& sphere, const CMatrix4x4& world)
+{
+    // The sphere in world space. Non-uniform scaling makes the sphere an ellipsoid, use the largest scale to enclose it
+    CVector3 xAxis = world.GetRow(0), yAxis = world.GetRow(1), zAxis = world.GetRow(2);
+    CVector3 centre = TransformPoint(sphere.centre, world);
+    float radius = sphere.radius * std::max(Length(xAxis), std::max(Length(yAxis), Length(zAxis)));
+    for (auto& plane : frustum.planes)
+    {
+        if (Dot(plane.normal, centre) + plane.distance < -radius)  return false;
+    }
+
+    // The box in world space is an oriented box - its centre and its half extents along each of the scaled axes of the
+    // world matrix. Its extent towards a plane is the sum of the half extents projected onto the plane normal
+    CVector3 halfExtents = box.HalfExtents();
+    centre = TransformPoint(box.Centre(), world);
+    for (auto& plane : frustum.planes)
+    {
+        float extent = halfExtents.x * std::abs(Dot(plane.normal, xAxis)) +
+                       halfExtents.y * std::abs(Dot(plane.normal, yAxis)) +
+                       halfExtents.z * std::abs(Dot(plane.normal, zAxis));
+        if (Dot(plane.normal, centre) + plane.distance < -extent)  return false;
+    }
+    return true;
+}
+
+
+// Test a world space axis-aligned box against the frustum. For each plane, the box corner furthest along the plane normal
+// is outside the frustum only if the whole box is, and if the nearest corner is inside then the whole box is in front
+// of that plane
+FrustumTest TestFrustum(const Frustum& frustum, const BoundingBox& box)
+{
+    CVector3 centre = box.Centre();
+    CVector3 halfExtents = box.HalfExtents();
+    FrustumTest result = FrustumTest::Inside;
+    for (auto& plane : frustum.planes)
+    {
+        float distance = Dot(plane.normal, centre) + plane.distance;
+        float extent = halfExtents.x * std::abs(plane.normal.x) + halfExtents.y * std::abs(plane.normal.y) +
+                       halfExtents.z * std::abs(plane.normal.z);
+        if (distance < -extent)  return FrustumTest::Outside;
+        if (distance <  extent)  result = FrustumTest::Intersects;
+    }
+    return result;
+}
@@ -0,0 +1,88 @@
+//--------------------------------------------------------------------------------------
+// Bounding volumes and view frustum tests
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+
+#ifndef _BOUNDS_H_DEFINED_
+#define _BOUNDS_H_DEFINED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+
+
+// Axis-aligned box, in whatever space the points it was made from were in
+struct BoundingBox
+{
+    CVector3 minimum;
+    CVector3 maximum;
+
+    CVector3 Centre() const       { return 0.5f * (minimum + maximum); }
+    CVector3 HalfExtents() const  { return 0.5f * (maximum - minimum); }
+
+    // Half the surface area - the relative cost of a box in a bounding volume hierarchy
+    float HalfArea() const
+    {
+        CVector3 size = maximum - minimum;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+};
+
+// Sphere that encloses the same points as a bounding box, often tighter for rounded shapes
+struct BoundingSphere
+{
+    CVector3 centre;
+    float    radius;
+};
+
+
+// A plane with its normal facing into the frustum, so points inside have Dot(normal, point) + distance >= 0
+struct Plane
+{
+    CVector3 normal;
+    float    distance;
+};
+
+// The six planes bounding what a camera can see: left, right, bottom, top, near, far
+struct Frustum
+{
+    Plane planes[6];
+};
+
+
+/*-----------------------------------------------------------------------------------------
+  Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// The smallest box containing both boxes
+BoundingBox Union(const BoundingBox& a, const BoundingBox& b);
+
+// Test if the outer box entirely contains the inner one
+bool Contains(const BoundingBox& outer, const BoundingBox& inner);
+
+// The axis-aligned box that encloses the given box transformed by a world matrix
+BoundingBox TransformBox(const BoundingBox& box, const CMatrix4x4& world);
+
+// Test if a box and sphere overlap
+bool Overlaps(const BoundingBox& box, const CVector3& centre, float radius);
+
+// Find where a ray first enters a box, if it does so within the given distance. Pass the reciprocal of each component of
+// the ray direction (infinities for zero components are handled correctly). Distance is 0 if the ray starts inside
+bool IntersectRay(const BoundingBox& box, const CVector3& origin, const CVector3& inverseDirection, float maxDistance, float& distance);
+
+
+// Extract the frustum planes from a view-projection matrix (DirectX conventions: row vectors, depth from 0 to 1).
+// The planes are in world space
+Frustum FrustumFromMatrix(const CMatrix4x4& viewProjection);
+
+// Test if a box and sphere (around the same points) transformed by the given world matrix are at least partly inside
+// the frustum. The sphere is tested first as it is cheaper, then the box as an oriented box in world space. Can
+// return true for volumes just outside a corner of the frustum, but never returns false for a visible volume
+bool IsInFrustum(const Frustum& frustum, const BoundingBox& box, const BoundingSphere& sphere, const CMatrix4x4& world);
+
+// Test a world space axis-aligned box against the frustum. Like IsInFrustum, boxes just outside a corner can be
+// reported as intersecting
+enum class FrustumTest { Outside, Intersects, Inside };
+FrustumTest TestFrustum(const Frustum& frustum, const BoundingBox& box);
+
+
+#endif // _BOUNDS_H_DEFINED_
@@ -6,6 +6,16 @@
 
 #include <algorithm>
 
+
+// Cross product of the x, y and z of two SSE registers
+static __m128 CrossXYZ(__m128 a, __m128 b)
+{
+    __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
 /*-----------------------------------------------------------------------------------------
     Member functions
 -----------------------------------------------------------------------------------------*/
@@ -29,84 +39,55 @@ CVector3 CMatrix4x4::GetRow(int iRow) const
 }
 
 
-// Post-multiply this matrix by the given one
-CMatrix4x4& CMatrix4x4::operator*=(const CMatrix4x4& m)
-{
-    if (this == &m)
-    {
-        // Special case of multiplying by self - no copy optimisations so use binary version
-        *this = m * m;
-    }
-    else
-    {
-        float t0, t1, t2;
-
-        t0 = e00 * m.e00 + e01 * m.e10 + e02 * m.e20 + e03 * m.e30;
-        t1 = e00 * m.e01 + e01 * m.e11 + e02 * m.e21 + e03 * m.e31;
-        t2 = e00 * m.e02 + e01 * m.e12 + e02 * m.e22 + e03 * m.e32;
-        e03 = e00 * m.e03 + e01 * m.e13 + e02 * m.e23 + e03 * m.e33;
-        e00 = t0;
-        e01 = t1;
-        e02 = t2;
-
-        t0 = e10 * m.e00 + e11 * m.e10 + e12 * m.e20 + e13 * m.e30;
-        t1 = e10 * m.e01 + e11 * m.e11 + e12 * m.e21 + e13 * m.e31;
-        t2 = e10 * m.e02 + e11 * m.e12 + e12 * m.e22 + e13 * m.e32;
-        e13 = e10 * m.e03 + e11 * m.e13 + e12 * m.e23 + e13 * m.e33;
-        e10 = t0;
-        e11 = t1;
-        e12 = t2;
-
-        t0 = e20 * m.e00 + e21 * m.e10 + e22 * m.e20 + e23 * m.e30;
-        t1 = e20 * m.e01 + e21 * m.e11 + e22 * m.e21 + e23 * m.e31;
-        t2 = e20 * m.e02 + e21 * m.e12 + e22 * m.e22 + e23 * m.e32;
-        e23 = e20 * m.e03 + e21 * m.e13 + e22 * m.e23 + e23 * m.e33;
-        e20 = t0;
-        e21 = t1;
-        e22 = t2;
-
-        t0 = e30 * m.e00 + e31 * m.e10 + e32 * m.e20 + e33 * m.e30;
-        t1 = e30 * m.e01 + e31 * m.e11 + e32 * m.e21 + e33 * m.e31;
-        t2 = e30 * m.e02 + e31 * m.e12 + e32 * m.e22 + e33 * m.e32;
-        e33 = e30 * m.e03 + e31 * m.e13 + e32 * m.e23 + e33 * m.e33;
-        e30 = t0;
-        e31 = t1;
-        e32 = t2;
-    }
-    return *this;
-}
-
-
 /*-----------------------------------------------------------------------------------------
     Operators
 -----------------------------------------------------------------------------------------*/
 
-// Matrix-matrix multiplication
-CMatrix4x4 operator*(const CMatrix4x4& m1, const CMatrix4x4& m2)
-{
-    CMatrix4x4 mOut;
+// Matrix multiplication and transforms are inline in the header
 
-    mOut.e00 = m1.e00*m2.e00 + m1.e01*m2.e10 + m1.e02*m2.e20 + m1.e03*m2.e30;
-    mOut.e01 = m1.e00*m2.e01 + m1.e01*m2.e11 + m1.e02*m2.e21 + m1.e03*m2.e31;
-    mOut.e02 = m1.e00*m2.e02 + m1.e01*m2.e12 + m1.e02*m2.e22 + m1.e03*m2.e32;
-    mOut.e03 = m1.e00*m2.e03 + m1.e01*m2.e13 + m1.e02*m2.e23 + m1.e03*m2.e33;
 
-    mOut.e10 = m1.e10*m2.e00 + m1.e11*m2.e10 + m1.e12*m2.e20 + m1.e13*m2.e30;
-    mOut.e11 = m1.e10*m2.e01 + m1.e11*m2.e11 + m1.e12*m2.e21 + m1.e13*m2.e31;
-    mOut.e12 = m1.e10*m2.e02 + m1.e11*m2.e12 + m1.e12*m2.e22 + m1.e13*m2.e32;
-    mOut.e13 = m1.e10*m2.e03 + m1.e11*m2.e13 + m1.e12*m2.e23 + m1.e13*m2.e33;
+/*-----------------------------------------------------------------------------------------
+    Batch functions
+-----------------------------------------------------------------------------------------*/
 
-    mOut.e20 = m1.e20*m2.e00 + m1.e21*m2.e10 + m1.e22*m2.e20 + m1.e23*m2.e30;
-    mOut.e21 = m1.e20*m2.e01 + m1.e21*m2.e11 + m1.e22*m2.e21 + m1.e23*m2.e31;
-    mOut.e22 = m1.e20*m2.e02 + m1.e21*m2.e12 + m1.e22*m2.e22 + m1.e23*m2.e32;
-    mOut.e23 = m1.e20*m2.e03 + m1.e21*m2.e13 + m1.e22*m2.e23 + m1.e23*m2.e33;
+// Multiply pairs of matrices: out[i] = m1[i] * m2[i]. The output may be the same array as either input
+void MultiplyMatrices(const CMatrix4x4* m1, const CMatrix4x4* m2, CMatrix4x4* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        MultiplyMatrix(m1[i], m2[i], out[i]);
+    }
+}
 
-    mOut.e30 = m1.e30*m2.e00 + m1.e31*m2.e10 + m1.e32*m2.e20 + m1.e33*m2.e30;
-    mOut.e31 = m1.e30*m2.e01 + m1.e31*m2.e11 + m1.e32*m2.e21 + m1.e33*m2.e31;
-    mOut.e32 = m1.e30*m2.e02 + m1.e31*m2.e12 + m1.e32*m2.e22 + m1.e33*m2.e32;
-    mOut.e33 = m1.e30*m2.e03 + m1.e31*m2.e13 + m1.e32*m2.e23 + m1.e33*m2.e33;
+// Concatenate a hierarchy of matrices each relative to its parent node into absolute matrices
+void ConcatenateHierarchy(const CMatrix4x4* relative, const unsigned int* parents, size_t count, CMatrix4x4* absolute)
+{
+    if (count == 0)  return;
+    absolute[0] = relative[0];
+    for (size_t i = 1; i < count; ++i)
+    {
+        MultiplyMatrix(relative[i], absolute[parents[i]], absolute[i]);
+    }
+}
 
-    return mOut;
+// Transform an array of points by one matrix, loading the matrix rows once for the whole array
+void TransformPoints(const CVector3* points, size_t count, const CMatrix4x4& m, CVector3* out)
+{
+    const float* rows = &m.e00;
+    __m128 r0 = _mm_loadu_ps(rows);
+    __m128 r1 = _mm_loadu_ps(rows + 4);
+    __m128 r2 = _mm_loadu_ps(rows + 8);
+    __m128 r3 = _mm_loadu_ps(rows + 12);
+    for (size_t i = 0; i < count; ++i)
+    {
+        __m128 result =        _mm_mul_ps(_mm_set1_ps(points[i].x), r0);
+        result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(points[i].y), r1));
+        result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(points[i].z), r2));
+        result = _mm_add_ps(result, r3);
+        float transformed[4];
+        _mm_storeu_ps(transformed, result);
+        out[i] = { transformed[0], transformed[1], transformed[2] };
+    }
 }
 
 
@@ -198,34 +179,40 @@ CMatrix4x4 MatrixScaling(const float s)
 // Advanced calulation needed to get the view matrix from the camera's positioning matrix
 CMatrix4x4 InverseAffine(const CMatrix4x4& m)
 {
-    CMatrix4x4 mOut;
-
-    // Calculate determinant of upper left 3x3
-    float det0 = m.e11*m.e22 - m.e12*m.e21;
-    float det1 = m.e12*m.e20 - m.e10*m.e22;
-    float det2 = m.e10*m.e21 - m.e11*m.e20;
-    float det = m.e00*det0 + m.e01*det1 + m.e02*det2;
-
-    // Calculate inverse of upper left 3x3
-    float invDet = 1.0f / det;
-    mOut.e00 = invDet * det0;
-    mOut.e10 = invDet * det1;
-    mOut.e20 = invDet * det2;
-
-    mOut.e01 = invDet * (m.e21*m.e02 - m.e22*m.e01);
-    mOut.e11 = invDet * (m.e22*m.e00 - m.e20*m.e02);
-    mOut.e21 = invDet * (m.e20*m.e01 - m.e21*m.e00);
-
-    mOut.e02 = invDet * (m.e01*m.e12 - m.e02*m.e11);
-    mOut.e12 = invDet * (m.e02*m.e10 - m.e00*m.e12);
-    mOut.e22 = invDet * (m.e00*m.e11 - m.e01*m.e10);
+    // The inverse of the upper left 3x3 has the cross products of pairs of its rows as columns, divided by the determinant
+    const float* rows = &m.e00;
+    __m128 row0 = _mm_loadu_ps(rows);
+    __m128 row1 = _mm_loadu_ps(rows + 4);
+    __m128 row2 = _mm_loadu_ps(rows + 8);
+    __m128 column0 = CrossXYZ(row1, row2);
+    __m128 column1 = CrossXYZ(row2, row0);
+    __m128 column2 = CrossXYZ(row0, row1);
+
+    // Determinant is row0 . (row1 x row2), summed over x, y and z only
+    float products[4];
+    _mm_storeu_ps(products, _mm_mul_ps(row0, column0));
+    __m128 invDet = _mm_set1_ps(1.0f / (products[0] + products[1] + products[2]));
+    column0 = _mm_mul_ps(column0, invDet);
+    column1 = _mm_mul_ps(column1, invDet);
+    column2 = _mm_mul_ps(column2, invDet);
+
+    // Transpose the columns into rows, the 4th column becomes zero
+    __m128 column3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(column0, column1, column2, column3);
 
     // Transform negative translation by inverted 3x3 to get inverse
-    mOut.e30 = -m.e30*mOut.e00 - m.e31*mOut.e10 - m.e32*mOut.e20;
-    mOut.e31 = -m.e30*mOut.e01 - m.e31*mOut.e11 - m.e32*mOut.e21;
-    mOut.e32 = -m.e30*mOut.e02 - m.e31*mOut.e12 - m.e32*mOut.e22;
+    __m128 translation = _mm_mul_ps(_mm_set1_ps(-m.e30), column0);
+    translation = _mm_add_ps(translation, _mm_mul_ps(_mm_set1_ps(-m.e31), column1));
+    translation = _mm_add_ps(translation, _mm_mul_ps(_mm_set1_ps(-m.e32), column2));
+
+    CMatrix4x4 mOut;
+    float* out = &mOut.e00;
+    _mm_storeu_ps(out,      column0);
+    _mm_storeu_ps(out + 4,  column1);
+    _mm_storeu_ps(out + 8,  column2);
+    _mm_storeu_ps(out + 12, translation);
 
-    // Fill in right column for affine matrix
+    // Fill in right column for affine matrix (the w of the cross products may not be zero if the input isn't affine)
     mOut.e03 = 0.0f;
     mOut.e13 = 0.0f;
     mOut.e23 = 0.0f;
@@ -1,13 +1,18 @@
 //--------------------------------------------------------------------------------------
 // Matrix4x4 class (cut down version) to hold matrices for 3D
 //--------------------------------------------------------------------------------------
-// Code in .cpp file
+// Code in .cpp file, except the multiplication and transform functions, which are inline below. These use SSE (always
+// available on x64): the matrix rows are loaded as 4-float registers and each row of a result is a sum of the rows of
+// the second matrix scaled by the elements of a row of the first. Matrices are stored by rows and don't need to be
+// aligned
 
 #ifndef _CMATRIX4X4_H_DEFINED_
 #define _CMATRIX4X4_H_DEFINED_
 
 #include "CVector3.h"
 #include <cmath>
+#include <cstddef>
+#include <xmmintrin.h>
 
 
 // Matrix class
@@ -47,7 +52,7 @@ public:
     CVector3 GetScale() const  { return { Length(GetXAxis()), Length(GetYAxis()) , Length(GetZAxis()) }; }
 
     // Post-multiply this matrix by the given one
-    CMatrix4x4& operator*=(const CMatrix4x4& m);
+    inline CMatrix4x4& operator*=(const CMatrix4x4& m);
 
     // Make this matrix an affine 3D transformation matrix to face from current position to given
     // target (in the Z direction). Can pass up vector for the constructed matrix and specify
@@ -66,8 +71,89 @@ public:
     Operators
 -----------------------------------------------------------------------------------------*/
 
+// Sum of the rows r0-r3 scaled by the four elements of the given row
+inline __m128 CombineMatrixRows(const float* row, __m128 r0, __m128 r1, __m128 r2, __m128 r3)
+{
+    __m128 result =        _mm_mul_ps(_mm_set1_ps(row[0]), r0);
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(row[1]), r1));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(row[2]), r2));
+    return   _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(row[3]), r3));
+}
+
+// Matrix-matrix multiplication into the given output, which may be either input. The second matrix is loaded first
+// and each row of the first is read before that row of the output is written
+inline void MultiplyMatrix(const CMatrix4x4& m1, const CMatrix4x4& m2, CMatrix4x4& mOut)
+{
+    const float* a = &m1.e00;
+    const float* b = &m2.e00;
+    float* out = &mOut.e00;
+    __m128 r0 = _mm_loadu_ps(b);
+    __m128 r1 = _mm_loadu_ps(b + 4);
+    __m128 r2 = _mm_loadu_ps(b + 8);
+    __m128 r3 = _mm_loadu_ps(b + 12);
+    _mm_storeu_ps(out,      CombineMatrixRows(a,      r0, r1, r2, r3));
+    _mm_storeu_ps(out + 4,  CombineMatrixRows(a + 4,  r0, r1, r2, r3));
+    _mm_storeu_ps(out + 8,  CombineMatrixRows(a + 8,  r0, r1, r2, r3));
+    _mm_storeu_ps(out + 12, CombineMatrixRows(a + 12, r0, r1, r2, r3));
+}
+
 // Matrix-matrix multiplication
-CMatrix4x4 operator*(const CMatrix4x4& m1, const CMatrix4x4& m2);
+inline CMatrix4x4 operator*(const CMatrix4x4& m1, const CMatrix4x4& m2)
+{
+    CMatrix4x4 mOut;
+    MultiplyMatrix(m1, m2, mOut);
+    return mOut;
+}
+
+// Post-multiply this matrix by the given one
+inline CMatrix4x4& CMatrix4x4::operator*=(const CMatrix4x4& m)
+{
+    MultiplyMatrix(*this, m, *this);
+    return *this;
+}
+
+
+// Transform a point (w = 1) by a matrix, using the same row vector convention as the matrices: point * m
+inline CVector3 TransformPoint(const CVector3& p, const CMatrix4x4& m)
+{
+    const float* rows = &m.e00;
+    __m128 result =        _mm_mul_ps(_mm_set1_ps(p.x), _mm_loadu_ps(rows));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(p.y), _mm_loadu_ps(rows + 4)));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(p.z), _mm_loadu_ps(rows + 8)));
+    result = _mm_add_ps(result, _mm_loadu_ps(rows + 12));
+    float out[4];
+    _mm_storeu_ps(out, result);
+    return { out[0], out[1], out[2] };
+}
+
+// Transform a vector (w = 0, so no translation) by a matrix
+inline CVector3 TransformVector(const CVector3& v, const CMatrix4x4& m)
+{
+    const float* rows = &m.e00;
+    __m128 result =        _mm_mul_ps(_mm_set1_ps(v.x), _mm_loadu_ps(rows));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(v.y), _mm_loadu_ps(rows + 4)));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(v.z), _mm_loadu_ps(rows + 8)));
+    float out[4];
+    _mm_storeu_ps(out, result);
+    return { out[0], out[1], out[2] };
+}
+
+
+/*-----------------------------------------------------------------------------------------
+  Batch functions
+-----------------------------------------------------------------------------------------*/
+// Process whole arrays in one call, e.g. for bone palettes and node hierarchies
+
+// Multiply pairs of matrices: out[i] = m1[i] * m2[i]. The output may be the same array as either input
+void MultiplyMatrices(const CMatrix4x4* m1, const CMatrix4x4* m2, CMatrix4x4* out, size_t count);
+
+// Concatenate a hierarchy of matrices each relative to its parent node into absolute matrices:
+// absolute[i] = relative[i] * absolute[parents[i]]. Parents must come before their children (e.g. depth-first order),
+// the root (entry 0) is copied unchanged
+void ConcatenateHierarchy(const CMatrix4x4* relative, const unsigned int* parents, size_t count, CMatrix4x4* absolute);
+
+// Transform an array of points by one matrix. The output may be the same array as the input
+void TransformPoints(const CVector3* points, size_t count, const CMatrix4x4& m, CVector3* out);
 
 
 /*-----------------------------------------------------------------------------------------
@@ -0,0 +1,146 @@
+//--------------------------------------------------------------------------------------
+// Quaternion class (cut down version), to hold rotations
+//--------------------------------------------------------------------------------------
+
+#include "CQuaternion.h"
+
+
+/*-----------------------------------------------------------------------------------------
+    Operators
+-----------------------------------------------------------------------------------------*/
+
+// Combine two rotations, the result is the rotation q1 followed by q2. This is the usual quaternion product q2 q1
+CQuaternion operator* (const CQuaternion& q1, const CQuaternion& q2)
+{
+    return CQuaternion{ q2.w*q1.x + q2.x*q1.w + q2.y*q1.z - q2.z*q1.y,
+                        q2.w*q1.y - q2.x*q1.z + q2.y*q1.w + q2.z*q1.x,
+                        q2.w*q1.z + q2.x*q1.y - q2.y*q1.x + q2.z*q1.w,
+                        q2.w*q1.w - q2.x*q1.x - q2.y*q1.y - q2.z*q1.z };
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return unit length quaternion in the same direction as given one
+CQuaternion Normalise(const CQuaternion& q)
+{
+    float lengthSq = q.x*q.x + q.y*q.y + q.z*q.z + q.w*q.w;
+
+    // Ensure quaternion is not zero length (use BaseMath.h float approx. fn with default epsilon)
+    if (IsZero(lengthSq))
+    {
+        return QuaternionIdentity();
+    }
+    else
+    {
+        float invLength = InvSqrt(lengthSq);
+        return CQuaternion{ q.x * invLength, q.y * invLength, q.z * invLength, q.w * invLength };
+    }
+}
+
+// Rotate a vector by a (unit length) quaternion, v + 2w(u x v) + 2u x (u x v) where u is the x, y, z part
+CVector3 Rotate(const CVector3& v, const CQuaternion& q)
+{
+    CVector3 u = { q.x, q.y, q.z };
+    CVector3 t = Cross(u, v) * 2.0f;
+    return v + t * q.w + Cross(u, t);
+}
+
+
+// The identity (no rotation)
+CQuaternion QuaternionIdentity()
+{
+    return CQuaternion{ 0, 0, 0, 1 };
+}
+
+// Return an X-axis rotation of the given angle (in radians)
+CQuaternion QuaternionRotationX(float x)
+{
+    return CQuaternion{ std::sin(x * 0.5f), 0, 0, std::cos(x * 0.5f) };
+}
+
+// Return a Y-axis rotation of the given angle (in radians)
+CQuaternion QuaternionRotationY(float y)
+{
+    return CQuaternion{ 0, std::sin(y * 0.5f), 0, std::cos(y * 0.5f) };
+}
+
+// Return a Z-axis rotation of the given angle (in radians)
+CQuaternion QuaternionRotationZ(float z)
+{
+    return CQuaternion{ 0, 0, std::sin(z * 0.5f), std::cos(z * 0.5f) };
+}
+
+// Return a rotation from Euler angles (in radians), Z first, then X, then Y - the same as MatrixRotationZ(angles.z) *
+// MatrixRotationX(angles.x) * MatrixRotationY(angles.y)
+CQuaternion QuaternionFromEulerAngles(const CVector3& angles)
+{
+    return QuaternionRotationZ(angles.z) * QuaternionRotationX(angles.x) * QuaternionRotationY(angles.y);
+}
+
+// Return the rotation held in the top-left 3x3 of a matrix with no scaling. Uses the largest of w, x, y or z to find the
+// others, so the result stays accurate for rotations near 180 degrees
+CQuaternion QuaternionFromMatrix(const CMatrix4x4& m)
+{
+    float trace = m.e00 + m.e11 + m.e22;
+    if (trace > 0)
+    {
+        float s = 2 * std::sqrt(1 + trace);
+        return CQuaternion{ (m.e12 - m.e21) / s, (m.e20 - m.e02) / s, (m.e01 - m.e10) / s, 0.25f * s };
+    }
+    else if (m.e00 > m.e11 && m.e00 > m.e22)
+    {
+        float s = 2 * std::sqrt(1 + m.e00 - m.e11 - m.e22);
+        return CQuaternion{ 0.25f * s, (m.e01 + m.e10) / s, (m.e20 + m.e02) / s, (m.e12 - m.e21) / s };
+    }
+    else if (m.e11 > m.e22)
+    {
+        float s = 2 * std::sqrt(1 + m.e11 - m.e00 - m.e22);
+        return CQuaternion{ (m.e01 + m.e10) / s, 0.25f * s, (m.e12 + m.e21) / s, (m.e20 - m.e02) / s };
+    }
+    else
+    {
+        float s = 2 * std::sqrt(1 + m.e22 - m.e00 - m.e11);
+        return CQuaternion{ (m.e20 + m.e02) / s, (m.e12 + m.e21) / s, 0.25f * s, (m.e01 - m.e10) / s };
+    }
+}
+
+
+// Return the rotation matrix for a (unit length) quaternion
+CMatrix4x4 MatrixRotation(const CQuaternion& q)
+{
+    float xx = q.x * q.x * 2, yy = q.y * q.y * 2, zz = q.z * q.z * 2;
+    float xy = q.x * q.y * 2, xz = q.x * q.z * 2, yz = q.y * q.z * 2;
+    float wx = q.w * q.x * 2, wy = q.w * q.y * 2, wz = q.w * q.z * 2;
+
+    return CMatrix4x4{ 1 - yy - zz,      xy + wz,      xz - wy,  0,
+                           xy - wz,  1 - xx - zz,      yz + wx,  0,
+                           xz + wy,      yz - wx,  1 - xx - yy,  0,
+                                 0,            0,            0,  1 };
+}
+
+
+// Scale is the length of rows 0-2 of the matrix, position is on the bottom row and the rotation is what remains of
+// rows 0-2 once the scaling is removed
+void DecomposeMatrix(const CMatrix4x4& m, CVector3& position, CQuaternion& rotation, CVector3& scale)
+{
+    CVector3 xAxis = m.GetRow(0), yAxis = m.GetRow(1), zAxis = m.GetRow(2);
+    scale = { Length(xAxis), Length(yAxis), Length(zAxis) };
+
+    rotation = QuaternionIdentity();
+    if (!IsZero(scale.x) && !IsZero(scale.y) && !IsZero(scale.z))
+    {
+        // A mirroring matrix can't be held as a rotation, so flip the X axis and make the X scale negative instead
+        if (Dot(Cross(xAxis, yAxis), zAxis) < 0)  scale.x = -scale.x;
+
+        CMatrix4x4 rotationMatrix = MatrixIdentity();
+        rotationMatrix.SetRow(0, xAxis * (1 / scale.x));
+        rotationMatrix.SetRow(1, yAxis * (1 / scale.y));
+        rotationMatrix.SetRow(2, zAxis * (1 / scale.z));
+        rotation = Normalise(QuaternionFromMatrix(rotationMatrix));
+    }
+
+    position = m.GetRow(3);
+}
@@ -0,0 +1,85 @@
+//--------------------------------------------------------------------------------------
+// Quaternion class (cut down version), to hold rotations
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Quaternions follow the same conventions as the matrices: q1 * q2 is the rotation q1 followed by q2, so a rotation
+// matrix made from q1 * q2 is the same as MatrixRotation(q1) * MatrixRotation(q2)
+
+#ifndef _CQUATERNION_H_DEFINED_
+#define _CQUATERNION_H_DEFINED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+
+
+class CQuaternion
+{
+// Concrete class - public access
+public:
+    // Quaternion components, x, y, z are the axis of rotation scaled by sin(angle / 2) and w is cos(angle / 2)
+    float x;
+    float y;
+    float z;
+    float w;
+
+    /*-----------------------------------------------------------------------------------------
+        Constructors
+    -----------------------------------------------------------------------------------------*/
+
+    // Default constructor - leaves values uninitialised (for performance)
+    CQuaternion() {}
+
+    // Construct with 4 values
+    CQuaternion(const float xIn, const float yIn, const float zIn, const float wIn)
+    {
+        x = xIn;
+        y = yIn;
+        z = zIn;
+        w = wIn;
+    }
+};
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member operators
+-----------------------------------------------------------------------------------------*/
+
+// Combine two rotations, the result is the rotation q1 followed by q2
+CQuaternion operator* (const CQuaternion& q1, const CQuaternion& q2);
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return unit length quaternion (a pure rotation) in the same direction as given one. Use after combining many rotations
+CQuaternion Normalise(const CQuaternion& q);
+
+// Rotate a vector by a (unit length) quaternion
+CVector3 Rotate(const CVector3& v, const CQuaternion& q);
+
+
+// The identity (no rotation)
+CQuaternion QuaternionIdentity();
+
+// Return a rotation about the X, Y or Z axis of the given angle (in radians)
+CQuaternion QuaternionRotationX(float x);
+CQuaternion QuaternionRotationY(float y);
+CQuaternion QuaternionRotationZ(float z);
+
+// Return a rotation from Euler angles (in radians), applied in the same order as the models use: Z first, then X, then Y
+CQuaternion QuaternionFromEulerAngles(const CVector3& angles);
+
+// Return the rotation held in the top-left 3x3 of a matrix, which must have no scaling (i.e. unit length X, Y and Z rows)
+CQuaternion QuaternionFromMatrix(const CMatrix4x4& m);
+
+
+// Return the rotation matrix for a (unit length) quaternion
+CMatrix4x4 MatrixRotation(const CQuaternion& q);
+
+// Split a matrix into position, rotation and scale. Any shearing in the matrix is lost, and a mirroring matrix gets a
+// negative X scale
+void DecomposeMatrix(const CMatrix4x4& m, CVector3& position, CQuaternion& rotation, CVector3& scale);
+
+
+#endif // _CQUATERNION_H_DEFINED_
@@ -0,0 +1,374 @@
+//--------------------------------------------------------------------------------------
+// MathBenchmark - microbenchmarks of the Math library
+//--------------------------------------------------------------------------------------
+// Usage: MathBenchmark [-filter text] [-time ms] [-repeats N] [-json file]
+//
+// Times the matrix and vector functions on the app's hot paths (the transform hierarchy, camera, skinning and light
+// orbit) over arrays of realistic sizes: 64 (a skeleton), 1024 (the scene's nodes) and 65536 (a large mesh or particle
+// batch). The functions that use SSE are also timed against plain scalar versions written here, so the benefit of the
+// SIMD code is measured rather than assumed.
+//
+// Each benchmark is run for at least the given time (default 200ms) per repeat, and the median of the repeats (default
+// 5) is reported in nanoseconds per item. -filter runs only the benchmarks whose names contain the text. -json writes
+// the results in the same layout as Google Benchmark's JSON output, so its comparison tools can track regressions
+// between builds. Build in Release, Debug timings mean little.
+
+#include "../Math/CMatrix4x4.h"
+#include "../Math/CVector3.h"
+#include "../Math/CVector2.h"
+
+#define NOMINMAX
+#include <windows.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+	// A benchmark processes a fixed number of items each time it is called
+	struct Benchmark
+	{
+		std::string           name;
+		size_t                items; // Per call
+		std::function<void()> run;
+	};
+
+	struct Result
+	{
+		std::string name;
+		size_t      iterations; // Calls in the median repeat
+		double      realTime;   // Nanoseconds per item
+		double      cpuTime;
+		double      itemsPerSecond;
+	};
+
+	// Results are added in here so the compiler can't drop the work that produced them
+	volatile float gSink = 0;
+
+
+	//--------------------------------------------------------------------------------------
+	// Test data
+	//--------------------------------------------------------------------------------------
+
+	const size_t ARRAY_SIZES[] = { 64, 1024, 65536 };
+
+	std::mt19937 gRandom(12345); // The same data each run
+
+	float RandomFloat(float low, float high)
+	{
+		return std::uniform_real_distribution<float>(low, high)(gRandom);
+	}
+
+	CVector3 RandomVector(float range)
+	{
+		return { RandomFloat(-range, range), RandomFloat(-range, range), RandomFloat(-range, range) };
+	}
+
+	// Rotation, scale and translation like the scene's model matrices
+	CMatrix4x4 RandomAffine()
+	{
+		return MatrixScaling(RandomFloat(0.5f, 2.0f)) * MatrixRotationZ(RandomFloat(-3, 3)) * MatrixRotationX(RandomFloat(-3, 3)) *
+		       MatrixRotationY(RandomFloat(-3, 3)) * MatrixTranslation(RandomVector(100));
+	}
+
+	std::vector<CMatrix4x4> RandomMatrices(size_t count)
+	{
+		std::vector<CMatrix4x4> matrices(count);
+		for (auto& m : matrices)  m = RandomAffine();
+		return matrices;
+	}
+
+	std::vector<CVector3> RandomVectors(size_t count, float range)
+	{
+		std::vector<CVector3> vectors(count);
+		for (auto& v : vectors)  v = RandomVector(range);
+		return vectors;
+	}
+
+
+	//--------------------------------------------------------------------------------------
+	// Scalar versions
+	//--------------------------------------------------------------------------------------
+	// Plain loops doing the same sums as the SSE functions in CMatrix4x4.h, the compiler may still vectorise them
+
+	void MultiplyMatrixScalar(const CMatrix4x4& m1, const CMatrix4x4& m2, CMatrix4x4& mOut)
+	{
+		const float* a = &m1.e00;
+		const float* b = &m2.e00;
+		float out[16];
+		for (int row = 0; row < 4; ++row)
+		{
+			for (int column = 0; column < 4; ++column)
+			{
+				out[row * 4 + column] = a[row * 4] * b[column] + a[row * 4 + 1] * b[4 + column] +
+				                        a[row * 4 + 2] * b[8 + column] + a[row * 4 + 3] * b[12 + column];
+			}
+		}
+		std::memcpy(&mOut.e00, out, sizeof(out));
+	}
+
+	CVector3 TransformPointScalar(const CVector3& p, const CMatrix4x4& m)
+	{
+		return { p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30,
+		         p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31,
+		         p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32 };
+	}
+
+
+	//--------------------------------------------------------------------------------------
+	// Benchmarks
+	//--------------------------------------------------------------------------------------
+
+	// The data is created once here and captured by the benchmarks, so only the work itself is timed
+	std::vector<Benchmark> CreateBenchmarks()
+	{
+		std::vector<Benchmark> benchmarks;
+		for (size_t size : ARRAY_SIZES)
+		{
+			std::string suffix = "/" + std::to_string(size);
+			auto matrices1 = std::make_shared<std::vector<CMatrix4x4>>(RandomMatrices(size));
+			auto matrices2 = std::make_shared<std::vector<CMatrix4x4>>(RandomMatrices(size));
+			auto matrixOut = std::make_shared<std::vector<CMatrix4x4>>(size);
+			auto points    = std::make_shared<std::vector<CVector3>>(RandomVectors(size, 10));
+			auto pointsOut = std::make_shared<std::vector<CVector3>>(size);
+			auto angles    = std::make_shared<std::vector<float>>(size);
+			for (auto& angle : *angles)  angle = RandomFloat(-3, 3);
+
+			// Each node's parent is an earlier node, as in a flattened scene tree
+			auto parents = std::make_shared<std::vector<unsigned int>>(size);
+			for (size_t i = 1; i < size; ++i)  (*parents)[i] = static_cast<unsigned int>(gRandom() % i);
+
+			benchmarks.push_back({ "MatrixMultiply/SSE" + suffix, size, [=]()
+			{
+				for (size_t i = 0; i < size; ++i)  (*matrixOut)[i] = (*matrices1)[i] * (*matrices2)[i];
+				gSink = gSink + (*matrixOut)[size - 1].e30;
+			}});
+			benchmarks.push_back({ "MatrixMultiply/Scalar" + suffix, size, [=]()
+			{
+				for (size_t i = 0; i < size; ++i)  MultiplyMatrixScalar((*matrices1)[i], (*matrices2)[i], (*matrixOut)[i]);
+				gSink = gSink + (*matrixOut)[size - 1].e30;
+			}});
+			benchmarks.push_back({ "MultiplyMatrices/Batch" + suffix, size, [=]()
+			{
+				MultiplyMatrices(matrices1->data(), matrices2->data(), matrixOut->data(), size);
+				gSink = gSink + (*matrixOut)[size - 1].e30;
+			}});
+			benchmarks.push_back({ "ConcatenateHierarchy" + suffix, size, [=]()
+			{
+				ConcatenateHierarchy(matrices1->data(), parents->data(), size, matrixOut->data());
+				gSink = gSink + (*matrixOut)[size - 1].e30;
+			}});
+
+			benchmarks.push_back({ "InverseAffine" + suffix, size, [=]()
+			{
+				for (size_t i = 0; i < size; ++i)  (*matrixOut)[i] = InverseAffine((*matrices1)[i]);
+				gSink = gSink + (*matrixOut)[size - 1].e30;
+			}});
+			benchmarks.push_back({ "GetEulerAngles" + suffix, size, [=]()
+			{
+				float total = 0;
+				for (size_t i = 0; i < size; ++i)  total += (*matrices1)[i].GetEulerAngles().y;
+				gSink = gSink + total;
+			}});
+
+			benchmarks.push_back({ "MatrixRotationX" + suffix, size, [=]()
+			{
+				for (size_t i = 0; i < size; ++i)  (*matrixOut)[i] = MatrixRotationX((*angles)[i]);
+				gSink = gSink + (*matrixOut)[size - 1].e11;
+			}});
+			benchmarks.push_back({ "MatrixRotationY" + suffix, size, [=]()
+			{
+				for (size_t i = 0; i < size; ++i)  (*matrixOut)[i] = MatrixRotationY((*angles)[i]);
+				gSink = gSink + (*matrixOut)[size - 1].e00;
+			}});
+			benchmarks.push_back({ "MatrixRotationZ" + suffix, size, [=]()
+			{
+				for (size_t i = 0; i < size; ++i)  (*matrixOut)[i] = MatrixRotationZ((*angles)[i]);
+				gSink = gSink + (*matrixOut)[size - 1].e00;
+			}});
+
+			benchmarks.push_back({ "Normalise/CVector3" + suffix, size, [=]()
+			{
+				for (size_t i = 0; i < size; ++i)  (*pointsOut)[i] = Normalise((*points)[i]);
+				gSink = gSink + (*pointsOut)[size - 1].x;
+			}});
+			benchmarks.push_back({ "Normalise/CVector2" + suffix, size, [=]()
+			{
+				float total = 0;
+				for (size_t i = 0; i < size; ++i)  total += Normalise(CVector2((*points)[i].x, (*points)[i].y)).x;
+				gSink = gSink + total;
+			}});
+
+			benchmarks.push_back({ "TransformPoint/SSE" + suffix, size, [=]()
+			{
+				const CMatrix4x4& m = (*matrices1)[0];
+				for (size_t i = 0; i < size; ++i)  (*pointsOut)[i] = TransformPoint((*points)[i], m);
+				gSink = gSink + (*pointsOut)[size - 1].x;
+			}});
+			benchmarks.push_back({ "TransformPoint/Scalar" + suffix, size, [=]()
+			{
+				const CMatrix4x4& m = (*matrices1)[0];
+				for (size_t i = 0; i < size; ++i)  (*pointsOut)[i] = TransformPointScalar((*points)[i], m);
+				gSink = gSink + (*pointsOut)[size - 1].x;
+			}});
+			benchmarks.push_back({ "TransformPoints/Batch" + suffix, size, [=]()
+			{
+				TransformPoints(points->data(), size, (*matrices1)[0], pointsOut->data());
+				gSink = gSink + (*pointsOut)[size - 1].x;
+			}});
+		}
+		return benchmarks;
+	}
+
+
+	//--------------------------------------------------------------------------------------
+	// Timing
+	//--------------------------------------------------------------------------------------
+
+	// CPU time used by this thread in nanoseconds, so time lost to other processes can be told apart
+	double ThreadCpuTime()
+	{
+		FILETIME creation, exit, kernel, user;
+		if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))  return 0;
+		ULARGE_INTEGER kernelTime = { { kernel.dwLowDateTime, kernel.dwHighDateTime } };
+		ULARGE_INTEGER userTime   = { { user.dwLowDateTime,   user.dwHighDateTime   } };
+		return static_cast<double>(kernelTime.QuadPart + userTime.QuadPart) * 100; // FILETIME counts 100ns units
+	}
+
+	// Run the benchmark enough times to last the minimum time, for each repeat, and keep the median repeat
+	Result Run(const Benchmark& benchmark, double minTime, int repeats)
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		// Warm up the caches, then find how many calls to make per repeat from a short trial
+		benchmark.run();
+		size_t iterations = 1;
+		for (;;)
+		{
+			auto start = Clock::now();
+			for (size_t i = 0; i < iterations; ++i)  benchmark.run();
+			double elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+			if (elapsed >= minTime / 10)
+			{
+				iterations = std::max<size_t>(1, static_cast<size_t>(iterations * minTime / elapsed));
+				break;
+			}
+			iterations *= 10;
+		}
+
+		std::vector<Result> results;
+		for (int repeat = 0; repeat < repeats; ++repeat)
+		{
+			double cpuStart = ThreadCpuTime();
+			auto start = Clock::now();
+			for (size_t i = 0; i < iterations; ++i)  benchmark.run();
+			double elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+			double cpuElapsed = ThreadCpuTime() - cpuStart;
+
+			double items = static_cast<double>(iterations) * benchmark.items;
+			results.push_back({ benchmark.name, iterations, elapsed / items, cpuElapsed / items, items / (elapsed * 1e-9) });
+		}
+		std::sort(results.begin(), results.end(), [](const Result& a, const Result& b) { return a.realTime < b.realTime; });
+		return results[results.size() / 2];
+	}
+
+
+	//--------------------------------------------------------------------------------------
+	// Output
+	//--------------------------------------------------------------------------------------
+
+	// The subset of Google Benchmark's JSON layout its comparison tools read
+	bool WriteJson(const std::string& fileName, const std::vector<Result>& results)
+	{
+		FILE* file = std::fopen(fileName.c_str(), "w");
+		if (file == nullptr)  return false;
+
+		char date[64] = "";
+		std::time_t now = std::time(nullptr);
+		std::tm local = {};
+		if (localtime_s(&local, &now) == 0)  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &local);
+
+		SYSTEM_INFO system = {};
+		GetSystemInfo(&system);
+
+		std::fprintf(file, "{\n  \"context\": {\n    \"date\": \"%s\",\n    \"executable\": \"MathBenchmark\",\n", date);
+		std::fprintf(file, "    \"num_cpus\": %u,\n", static_cast<unsigned int>(system.dwNumberOfProcessors));
+#ifdef NDEBUG
+		std::fprintf(file, "    \"library_build_type\": \"release\"\n  },\n");
+#else
+		std::fprintf(file, "    \"library_build_type\": \"debug\"\n  },\n");
+#endif
+		std::fprintf(file, "  \"benchmarks\": [\n");
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const Result& result = results[i];
+			std::fprintf(file, "    {\n      \"name\": \"%s\",\n      \"run_name\": \"%s\",\n      \"run_type\": \"iteration\",\n",
+			             result.name.c_str(), result.name.c_str());
+			std::fprintf(file, "      \"iterations\": %zu,\n      \"real_time\": %.4f,\n      \"cpu_time\": %.4f,\n",
+			             result.iterations, result.realTime, result.cpuTime);
+			std::fprintf(file, "      \"time_unit\": \"ns\",\n      \"items_per_second\": %.1f\n    }%s\n",
+			             result.itemsPerSecond, (i + 1 < results.size()) ? "," : "");
+		}
+		std::fprintf(file, "  ]\n}\n");
+		return std::fclose(file) == 0;
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	std::string filter;
+	std::string jsonFile;
+	double minTime = 200e6; // Nanoseconds
+	int repeats = 5;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if      (arg == "-filter"  && hasValue)  filter   = argv[++i];
+		else if (arg == "-json"    && hasValue)  jsonFile = argv[++i];
+		else if (arg == "-time"    && hasValue)  minTime  = std::max(1.0, std::atof(argv[++i])) * 1e6;
+		else if (arg == "-repeats" && hasValue)  repeats  = std::max(1, std::atoi(argv[++i]));
+		else
+		{
+			std::printf("Usage: MathBenchmark [-filter text] [-time ms] [-repeats N] [-json file]\n");
+			return 1;
+		}
+	}
+
+	// Timings are steadier on a thread that stays on one core at high priority
+	SetThreadAffinityMask(GetCurrentThread(), 1);
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+
+	std::vector<Result> results;
+	std::printf("%-36s %14s %14s %16s\n", "Benchmark", "Time (ns/item)", "CPU (ns/item)", "Items/s");
+	for (const auto& benchmark : CreateBenchmarks())
+	{
+		if (!filter.empty() && benchmark.name.find(filter) == std::string::npos)  continue;
+		Result result = Run(benchmark, minTime, repeats);
+		std::printf("%-36s %14.3f %14.3f %16.0f\n", result.name.c_str(), result.realTime, result.cpuTime, result.itemsPerSecond);
+		results.push_back(result);
+	}
+
+	if (!jsonFile.empty())
+	{
+		if (!WriteJson(jsonFile, results))
+		{
+			std::printf("Error writing %s\n", jsonFile.c_str());
+			return 1;
+		}
+		std::printf("Results written to %s\n", jsonFile.c_str());
+	}
+	return 0;
+}
@@ -6,510 +6,824 @@
 // expected to select these things. A later lab will introduce a more robust loader.
 
 #include "Mesh.h"
-#include "Shader.h" // Needed for helper function CreateSignatureForVertexLayout
+#include "ResourceRegistry.h"
+#include "LinearArena.h"
+#include "InputLayoutCache.h"
+#include "StateCache.h"
+#include "ConstantBufferRing.h"
+#include "InstanceBufferRing.h"
+#include "CpuProfiler.h"
+#include "Shader.h"
 #include "GraphicsHelpers.h" // Helper functions to unclutter the code here
-#include "CVector2.h" 
-#include "CVector3.h" 
+#include "CVector2.h"
 
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
 #include <assimp/DefaultLogger.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 
-#include <memory>
+
+ObjectPool<Mesh> gMeshPool;
 
 
 // Pass the name of the mesh file to load. Uses assimp (http://www.assimp.org/) to support many file types
 // Optionally request tangents to be calculated (for normal and parallax mapping - see later lab)
+// Optionally convert the vertices to compact formats with 16-bit indices where possible (see CompactMesh)
+// Optionally generate up to numLods simplified levels of detail (see GenerateLods)
 // Will throw a std::runtime_error exception on failure (since constructors can't return errors).
-Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
+Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/, bool compactVertices /*= false*/, int numLods /*= 0*/)
 {
-	Assimp::Importer importer;
-
-	// Flags for processing the mesh. Assimp provides a huge amount of control - right click any of these
-	// and "Peek Definition" to see documention above each constant
-	unsigned int assimpFlags = aiProcess_MakeLeftHanded |
-		aiProcess_GenSmoothNormals |
-		aiProcess_FixInfacingNormals |
-		aiProcess_GenUVCoords |
-		aiProcess_TransformUVCoords |
-		aiProcess_FlipUVs |
-		aiProcess_FlipWindingOrder |
-		aiProcess_Triangulate |
-		aiProcess_JoinIdenticalVertices |
-		aiProcess_ImproveCacheLocality |
-		aiProcess_SortByPType |
-		aiProcess_FindInvalidData |
-		aiProcess_OptimizeMeshes |
-		aiProcess_FindInstances |
-		aiProcess_FindDegenerates |
-		aiProcess_RemoveRedundantMaterials |
-		aiProcess_Debone |
-		aiProcess_SplitByBoneCount |
-		aiProcess_LimitBoneWeights |
-		aiProcess_RemoveComponent;
-
-	// Flags to specify what mesh data to ignore
-	int removeComponents = aiComponent_LIGHTS | aiComponent_CAMERAS | aiComponent_TEXTURES | aiComponent_COLORS |
-		aiComponent_ANIMATIONS | aiComponent_MATERIALS;
-
-	// Add / remove tangents as required by user
-	if (requireTangents)
-	{
-		assimpFlags |= aiProcess_CalcTangentSpace;
+	// Use the cooked version of the mesh if it is up to date, otherwise import with assimp (logging its output) and write
+	// a new cooked file
+	CookedMesh mesh;
+	Assimp::DefaultLogger::create("", Assimp::DefaultLogger::VERBOSE);
+	try
+	{
+		LoadMeshData(fileName, requireTangents, mesh);
 	}
-	else
+	catch (...)
 	{
-		removeComponents |= aiComponent_TANGENTS_AND_BITANGENTS;
+		Assimp::DefaultLogger::kill();
+		throw;
 	}
+	Assimp::DefaultLogger::kill();
 
-	// Other miscellaneous settings
-	importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, 80.0f); // Smoothing angle for normals
-	importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);  // Remove points and lines (keep triangles only)
-	importer.SetPropertyBool(AI_CONFIG_PP_FD_REMOVE, true);                 // Remove degenerate triangles
-	importer.SetPropertyBool(AI_CONFIG_PP_DB_ALL_OR_NONE, true);            // Default to removing bones/weights from meshes that don't need skinning
+	if (numLods > 0)      GenerateLods(mesh, numLods);
+	if (compactVertices)  CompactMesh(mesh);
+	Create(mesh, fileName);
+}
 
-	// Set maximum bones that can affect one vertex, and also maximum bones affecting a single mesh
-	unsigned int maxBonesPerVertex = 4; // The shaders support 4 bones per verted (null bones are added if necessary)
-	unsigned int maxBonesPerMesh = 256; // Bone indexes are stored in a byte, so no more than 256 
-	importer.SetPropertyInteger(AI_CONFIG_PP_LBW_MAX_WEIGHTS, maxBonesPerVertex);
-	importer.SetPropertyInteger(AI_CONFIG_PP_SBBC_MAX_BONES, maxBonesPerMesh);
 
-	importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, removeComponents);
+// Create the mesh from data already imported / read (see CookedAssets.h). The file name is only used in error messages
+// Only uses the device, so meshes can be created on worker threads. Will throw a std::runtime_error exception on failure
+Mesh::Mesh(const CookedMesh& mesh, const std::string& fileName)
+{
+	Create(mesh, fileName);
+}
 
-	// Import mesh with assimp given above requirements - log output
-	Assimp::DefaultLogger::create("", Assimp::DefaultLogger::VERBOSE);
-	const aiScene* scene = importer.ReadFile(fileName, assimpFlags);
-	Assimp::DefaultLogger::kill();
-	if (scene == nullptr)  throw std::runtime_error("Error loading mesh (" + fileName + "). " + importer.GetErrorString());
-	if (scene->mNumMeshes == 0)  throw std::runtime_error("No usable geometry in mesh: " + fileName);
+
+Mesh::~Mesh()
+{
+	for (auto& subMesh : mSubMeshes)
+	{
+		if (subMesh.indexBuffer)   subMesh.indexBuffer ->Release();
+		if (subMesh.vertexBuffer)  subMesh.vertexBuffer->Release();
+		if (subMesh.vertexLayout)  subMesh.vertexLayout->Release();
+		if (subMesh.positionBuffer)  subMesh.positionBuffer->Release();
+		if (subMesh.positionLayout)  subMesh.positionLayout->Release();
+		gGeometryPool.Free(subMesh.indexRange);
+		gGeometryPool.Free(subMesh.vertexRange);
+		gGeometryPool.Free(subMesh.positionRange);
+	}
+	if (mSkinnedLayout)  mSkinnedLayout->Release();
+}
 
 
-	//-----------------------------------
+//--------------------------------------------------------------------------------------
 
-	//*********************************************************************//
-	// Read node hierachy - each node has a matrix and contains sub-meshes //
+// Helper function for Render function - renders a given sub-mesh. World matrices / textures / states etc. must already be set
+// Pass a number of instances to draw that many copies with an instanced draw call (see RenderInstanced)
+// Draws the given level of detail, or the coarsest the sub-mesh has if it doesn't have that many
+// Draws the skinned vertices from Skin instead of the sub-mesh's own if they are given
+void Mesh::RenderSubMesh(const SubMesh& subMesh, unsigned int numInstances /*= 0*/, unsigned int lod /*= 0*/,
+                         ID3D11Buffer* skinnedVertices /*= nullptr*/)
+{
+	INT baseVertex = SetSubMeshBuffers(subMesh, skinnedVertices);
+
+	// Render mesh, starting from its range of the buffers if they are shared (both are zero otherwise)
+	const SubMesh::Lod& level = subMesh.lods[std::min(lod, static_cast<unsigned int>(subMesh.lods.size()) - 1)];
+	UINT startIndex = subMesh.indexRange.first + level.startIndex;
+	if (numInstances > 0)  gD3DContext->DrawIndexedInstanced(level.numIndices, numInstances, startIndex, baseVertex, 0);
+	else                   gD3DContext->DrawIndexed(level.numIndices, startIndex, baseVertex);
+}
 
-	// Uses recursive helper functions to build node hierarchy    
-	mNodes.resize(CountNodes(scene->mRootNode));
-	ReadNodes(scene->mRootNode, 0, 0);
 
+INT Mesh::SetSubMeshBuffers(const SubMesh& subMesh, ID3D11Buffer* skinnedVertices /*= nullptr*/,
+                            bool allowPositionStream /*= true*/)
+{
+	// Set vertex buffer as next data source for GPU, with the layout of its vertices. Skinned vertices are in a buffer of
+	// their own. Depth-only shaders read just the positions, a third or less of most vertices, so fetch less from the
+	// position stream
+	INT  baseVertex = 0;
+	UINT offset = 0;
+	if (skinnedVertices)
+	{
+		UINT stride = sizeof(BasicVertex);
+		gStateCache.IASetVertexBuffers(0, 1, &skinnedVertices, &stride, &offset);
+		gStateCache.IASetInputLayout(mSkinnedLayout);
+	}
+	else if (allowPositionStream && subMesh.positionBuffer && gStateCache.VSReadsPositionOnly())
+	{
+		UINT stride = sizeof(CVector3);
+		gStateCache.IASetVertexBuffers(0, 1, &subMesh.positionBuffer, &stride, &offset);
+		gStateCache.IASetInputLayout(subMesh.positionLayout);
+		baseVertex = static_cast<INT>(subMesh.positionRange.first);
+	}
+	else
+	{
+		UINT stride = subMesh.vertexSize;
+		gStateCache.IASetVertexBuffers(0, 1, &subMesh.vertexBuffer, &stride, &offset);
+		gStateCache.IASetInputLayout(subMesh.vertexLayout);
+		baseVertex = static_cast<INT>(subMesh.vertexRange.first);
+	}
 
+	// Set index buffer as next data source for GPU, indicate whether it uses 16 or 32-bit integers
+	gStateCache.IASetIndexBuffer(subMesh.indexBuffer, subMesh.indexFormat, 0);
 
-	//******************************************//
-	// Read geometry - multiple parts supported //
+	// Using triangle lists only in this class
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	return baseVertex;
+}
 
-	mHasBones = false;
-	for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
-		if (scene->mMeshes[m]->HasBones())  mHasBones = true;
 
 
-	// A mesh is made of sub-meshes, each one can have a different material (texture)
-	// Import each sub-mesh in the file to seperate index / vertex buffer (could share buffers between sub-meshes but that would make things more complex)
-	mSubMeshes.resize(scene->mNumMeshes);
-	for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
+// Render the mesh with the given absolute (world space) node matrices, calculated by the model (see Model::Render)
+// Handles rigid body meshes (including single part meshes) as well as skinned meshes
+// LIMITATION: The mesh must use a single texture throughout
+void Mesh::Render(const CMatrix4x4* absoluteMatrices, unsigned int lod /*= 0*/)
+{
+	CPU_PROFILE_SCOPE("Mesh::Render");
+
+	if (mHasBones) // Render a mesh that uses skinning
 	{
-		aiMesh* assimpMesh = scene->mMeshes[m];
-		std::string subMeshName = assimpMesh->mName.C_Str();
-		auto& subMesh = mSubMeshes[m]; // Short name for the submesh we're currently preparing - makes code below more readable
+		// Advanced point: the above loop will get the absolute world matrices **of the bones**. However, they are
+		// not actually rendered, they merely influence the skinned mesh, which has its origin at a particular node.
+		// So for each bone there is a fixed offset (transform) between where that bone is and where the root of the
+		// skinned mesh is. We need to apply that offset to each of the bone matrices calculated in the last loop to make
+		// the bone influences work on the skinned mesh.
+		// These offset matrices are fixed for the model and have been calculated when the mesh was imported.
+		// The offset bone matrices are written straight into the skeleton constant buffer to send over to the GPU for
+		// skinning - each matrix can represent a bone which influences nearby vertices
+		CalculateBonePalette(absoluteMatrices, gSkeletonConstants.boneMatrices);
+		// Send to the GPU and bind for whichever of the current shaders read them. The per-model constants are still
+		// needed for the colour and other settings
+		BindConstants(SKELETON_CONSTANTS_SLOT,  gSkeletonConstants, gSkeletonConstantBuffer);
+		BindConstants(PER_MODEL_CONSTANTS_SLOT, gPerModelConstants, gPerModelConstantBuffer);
 
+		// Already sent over all the absolute matrices for the entire mesh so we can render sub-meshes directly
+		// rather than iterating through the nodes. 
+		for (auto& subMesh : mSubMeshes)
+		{
+			RenderSubMesh(subMesh, 0, lod);
+		}
+	}
+	else
+	{
+		// Render a mesh without skinning. Although reorganised to use the absolute matrices calculated by the
+		// model, this is basically the same code as the rigid body animation lab
+		// Iterate through each node
+		for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+		{
+			// Send this node's matrix to the GPU via a constant buffer, bound for whichever of the current shaders read it
+			gPerModelConstants.worldMatrix = absoluteMatrices[nodeIndex];
+			BindConstants(PER_MODEL_CONSTANTS_SLOT, gPerModelConstants, gPerModelConstantBuffer);
 
-		//-----------------------------------
+			// Render the sub-meshes attached to this node (no bones - rigid movement)
+			for (auto& subMeshIndex : mNodes[nodeIndex].subMeshes)
+			{
+				RenderSubMesh(mSubMeshes[subMeshIndex], 0, lod);
+			}
+		}
+	}
+}
 
-		// Check for presence of position and normal data. Tangents and UVs are optional.
-		std::vector<D3D11_INPUT_ELEMENT_DESC> vertexElements;
-		unsigned int offset = 0;
 
-		if (!assimpMesh->HasPositions())  throw std::runtime_error("No position data for sub-mesh " + subMeshName + " in " + fileName);
-		unsigned int positionOffset = offset;
-		vertexElements.push_back({ "position", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, positionOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
-		offset += 12;
+// Render the geometry of one node for several instances at once, each with its own absolute world matrix and colour
+// Instanced shaders must be selected, they read the instances from the instance buffer
+void Mesh::RenderInstanced(unsigned int node, const InstanceData* instances, unsigned int numInstances, unsigned int lod /*= 0*/)
+{
+	CPU_PROFILE_SCOPE("Mesh::RenderInstanced");
 
-		if (!assimpMesh->HasNormals())  throw std::runtime_error("No normal data for sub-mesh " + subMeshName + " in " + fileName);
-		unsigned int normalOffset = offset;
-		vertexElements.push_back({ "normal", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, normalOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
-		offset += 12;
+	if (mNodes[node].subMeshes.empty())  return; // Nothing to draw for dummy nodes
 
-		unsigned int tangentOffset = offset;
-		if (requireTangents)
-		{
-			if (!assimpMesh->HasTangentsAndBitangents())  throw std::runtime_error("No tangent data for sub-mesh " + subMeshName + " in " + fileName);
-			vertexElements.push_back({ "tangent", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, tangentOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
-			offset += 12;
-		}
+	// Each map holds MAX_INSTANCES at a time, so larger numbers are split into several draws
+	for (unsigned int first = 0; first < numInstances; first += MAX_INSTANCES)
+	{
+		unsigned int count = std::min(numInstances - first, static_cast<unsigned int>(MAX_INSTANCES));
 
-		unsigned int uvOffset = offset;
-		if (assimpMesh->GetNumUVChannels() > 0 && assimpMesh->HasTextureCoords(0))
+		InstanceData* mapped = MapInstances();
+		if (mapped == nullptr)  return;
+		memcpy(mapped, instances + first, count * sizeof(InstanceData));
+		UnmapInstances();
+
+		for (auto& subMeshIndex : mNodes[node].subMeshes)
 		{
-			if (assimpMesh->mNumUVComponents[0] != 2)  throw std::runtime_error("Unsupported texture coordinates in " + subMeshName + " in " + fileName);
-			vertexElements.push_back({ "uv", 0, DXGI_FORMAT_R32G32_FLOAT, 0, uvOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
-			offset += 8;
+			RenderSubMesh(mSubMeshes[subMeshIndex], count, lod);
 		}
+	}
+}
+
+
+// The same ranges RenderSubMesh draws, see above
+void Mesh::GetIndirectArguments(unsigned int node, unsigned int lod,
+                                std::vector<DrawIndexedArguments>& arguments)
+{
+	for (auto& subMeshIndex : mNodes[node].subMeshes)
+	{
+		const SubMesh& subMesh = mSubMeshes[subMeshIndex];
+		const SubMesh::Lod& level = subMesh.lods[std::min(lod, static_cast<unsigned int>(subMesh.lods.size()) - 1)];
+		arguments.push_back({ level.numIndices, 0, subMesh.indexRange.first + level.startIndex,
+		                      static_cast<INT>(subMesh.vertexRange.first), 0 });
+	}
+}
+
+
+void Mesh::RenderIndirect(unsigned int node, ID3D11Buffer* arguments, UINT offset)
+{
+	for (auto& subMeshIndex : mNodes[node].subMeshes)
+	{
+		SetSubMeshBuffers(mSubMeshes[subMeshIndex], nullptr, false);
+		gD3DContext->DrawIndexedInstancedIndirect(arguments, offset);
+		offset += sizeof(DrawIndexedArguments);
+	}
+}
+
 
-		unsigned int bonesOffset = offset;
-		if (mHasBones)
+//--------------------------------------------------------------------------------------
+// Pre-skinning
+//--------------------------------------------------------------------------------------
+
+// Create a vertex buffer for each sub-mesh to hold one model's skinned vertices, to be released by the caller.
+// Returns false on failure (reason in gLastError), with no buffers to release
+bool Mesh::CreateSkinnedVertices(std::vector<ID3D11Buffer*>& skinnedVertices)
+{
+	skinnedVertices.assign(mSubMeshes.size(), nullptr);
+	for (unsigned int m = 0; m < mSubMeshes.size(); ++m)
+	{
+		// Written by the stream-out stage then read as an ordinary vertex buffer
+		D3D11_BUFFER_DESC bufferDesc = {};
+		bufferDesc.BindFlags = D3D11_BIND_STREAM_OUTPUT | D3D11_BIND_VERTEX_BUFFER;
+		bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		bufferDesc.ByteWidth = mSubMeshes[m].numVertices * sizeof(BasicVertex);
+		if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &skinnedVertices[m])))
 		{
-			vertexElements.push_back({ "bones"  , 0, DXGI_FORMAT_R8G8B8A8_UINT,      0, bonesOffset,     D3D11_INPUT_PER_VERTEX_DATA, 0 });
-			offset += 4;
-			vertexElements.push_back({ "weights", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, bonesOffset + 4, D3D11_INPUT_PER_VERTEX_DATA, 0 });
-			offset += 16;
+			for (auto& buffer : skinnedVertices)  if (buffer)  buffer->Release();
+			skinnedVertices.clear();
+			gLastError = "Error creating skinned vertex buffer";
+			return false;
 		}
+		gResourceRegistry.Track(skinnedVertices[m]);
+	}
+	return true;
+}
 
-		subMesh.vertexSize = offset;
 
+// Calculate the bone matrices used for skinning from the given absolute node matrices, see the comments in Render
+void Mesh::CalculateBonePalette(const CMatrix4x4* absoluteMatrices, CMatrix4x4* palette)
+{
+	MultiplyMatrices(mOffsetMatrices.data(), absoluteMatrices, palette, mNodes.size());
+}
 
-		// Create a "vertex layout" to describe to DirectX what is data in each vertex of this mesh
-		auto shaderSignature = CreateSignatureForVertexLayout(vertexElements.data(), static_cast<int>(vertexElements.size()));
-		HRESULT hr = gD3DDevice->CreateInputLayout(vertexElements.data(), static_cast<UINT>(vertexElements.size()),
-			shaderSignature->GetBufferPointer(), shaderSignature->GetBufferSize(),
-			&subMesh.vertexLayout);
-		if (shaderSignature)  shaderSignature->Release();
-		if (FAILED(hr))  throw std::runtime_error("Failure creating input layout for " + fileName);
 
+// Skin the mesh into buffers from CreateSkinnedVertices with the bone palette currently bound. Changes the shaders,
+// so select them again before rendering
+void Mesh::Skin(ID3D11Buffer* const skinnedVertices[])
+{
+	CPU_PROFILE_SCOPE("Mesh::Skin");
+
+	// Each vertex is skinned once and streamed out in order, so the skinned buffer lines up with the sub-mesh's index
+	// buffer. Nothing is rasterised (the stream-out shader has no rasterized stream)
+	gStateCache.VSSetShader(gSkinningVertexShader, nullptr, 0);
+	gStateCache.GSSetShader(gSkinningStreamOutShader, nullptr, 0);
+	gStateCache.PSSetShader(nullptr, nullptr, 0);
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
+	for (unsigned int m = 0; m < mSubMeshes.size(); ++m)
+	{
+		const SubMesh& subMesh = mSubMeshes[m];
+		UINT stride = subMesh.vertexSize;
+		UINT offset = 0;
+		gStateCache.IASetVertexBuffers(0, 1, &subMesh.vertexBuffer, &stride, &offset);
+		gStateCache.IASetInputLayout(subMesh.vertexLayout);
+		gD3DContext->SOSetTargets(1, &skinnedVertices[m], &offset);
+		gD3DContext->Draw(subMesh.numVertices, subMesh.vertexRange.first);
+	}
 
+	// Unbind the skinned buffers so they can be used as vertex buffers, and restore the usual state
+	ID3D11Buffer* noBuffer = nullptr;
+	UINT offset = 0;
+	gD3DContext->SOSetTargets(1, &noBuffer, &offset);
+	gStateCache.GSSetShader(nullptr, nullptr, 0);
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+}
 
-		//-----------------------------------
 
-		// Create CPU-side buffers to hold current mesh data - exact content is flexible so can't use a structure for a vertex - so just a block of bytes
-		// Note: for large arrays a unique_ptr is better than a vector because vectors default-initialise all the values which is a waste of time.
-		subMesh.numVertices = assimpMesh->mNumVertices;
-		subMesh.numIndices = assimpMesh->mNumFaces * 3;
-		auto vertices = std::make_unique<unsigned char[]>(subMesh.numVertices * subMesh.vertexSize);
-		auto indices  = std::make_unique<unsigned char[]>(subMesh.numIndices * 4); // Using 32 bit indexes (4 bytes) for each indeex
+// Render the vertices written by Skin with the current shaders, which should be those for non-skinned models. The
+// vertices are already in world space
+void Mesh::RenderSkinned(ID3D11Buffer* const skinnedVertices[], unsigned int lod /*= 0*/)
+{
+	CPU_PROFILE_SCOPE("Mesh::RenderSkinned");
 
+	gPerModelConstants.worldMatrix = MatrixIdentity();
+	BindConstants(PER_MODEL_CONSTANTS_SLOT, gPerModelConstants, gPerModelConstantBuffer);
+	for (unsigned int m = 0; m < mSubMeshes.size(); ++m)
+	{
+		RenderSubMesh(mSubMeshes[m], 0, lod, skinnedVertices[m]);
+	}
+}
 
-		//-----------------------------------
 
-		// Copy mesh data from assimp to our CPU-side vertex buffer
+//--------------------------------------------------------------------------------------
+// Static batching
+//--------------------------------------------------------------------------------------
 
-		CVector3* assimpPosition = reinterpret_cast<CVector3*>(assimpMesh->mVertices);
-		unsigned char* position = vertices.get() + positionOffset;
-		unsigned char* positionEnd = position + subMesh.numVertices * subMesh.vertexSize;
-		while (position != positionEnd)
-		{
-			*(CVector3*)position = *assimpPosition;
-			position += subMesh.vertexSize;
-			++assimpPosition;
-		}
+unsigned int Mesh::NumBakedVertices()
+{
+	unsigned int numVertices = 0;
+	for (auto& node : mNodes)
+	{
+		for (auto subMeshIndex : node.subMeshes)  numVertices += mSubMeshes[subMeshIndex].numVertices;
+	}
+	return numVertices;
+}
 
-		CVector3* assimpNormal = reinterpret_cast<CVector3*>(assimpMesh->mNormals);
-		unsigned char* normal = vertices.get() + normalOffset;
-		unsigned char* normalEnd = normal + subMesh.numVertices * subMesh.vertexSize;
-		while (normal != normalEnd)
+
+// Write the world space geometry for a static batch, see StaticBatches::Bake
+bool Mesh::BakeWorldGeometry(const CMatrix4x4* absoluteMatrices, ID3D11Buffer* vertices, unsigned int firstVertex,
+                             uint32_t indexBase, std::vector<uint32_t>& indices)
+{
+	// As in Skin, each vertex is transformed once and streamed out in order, so the written vertices line up with the
+	// sub-mesh's indices
+	unsigned int written = 0;
+	for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+	{
+		if (mNodes[nodeIndex].subMeshes.empty())  continue;
+		gPerModelConstants.worldMatrix = absoluteMatrices[nodeIndex];
+		BindConstants(PER_MODEL_CONSTANTS_SLOT, gPerModelConstants, gPerModelConstantBuffer);
+		for (auto& subMeshIndex : mNodes[nodeIndex].subMeshes)
 		{
-			*(CVector3*)normal = *assimpNormal;
-			normal += subMesh.vertexSize;
-			++assimpNormal;
+			const SubMesh& subMesh = mSubMeshes[subMeshIndex];
+			if (!ReadIndices(subMesh, indexBase + written, indices))  return false;
+
+			UINT stride = subMesh.vertexSize;
+			UINT offset = 0;
+			UINT outputOffset = (firstVertex + written) * sizeof(BasicVertex);
+			gStateCache.IASetVertexBuffers(0, 1, &subMesh.vertexBuffer, &stride, &offset);
+			gStateCache.IASetInputLayout(subMesh.vertexLayout);
+			gD3DContext->SOSetTargets(1, &vertices, &outputOffset);
+			gD3DContext->Draw(subMesh.numVertices, subMesh.vertexRange.first);
+			written += subMesh.numVertices;
 		}
+	}
+	return true;
+}
+
 
-		if (requireTangents)
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+// Copy the node hierarchy and create the GPU resources for each sub-mesh. Throws a std::runtime_error on failure
+void Mesh::Create(const CookedMesh& mesh, const std::string& fileName)
+{
+	mNodes = mesh.nodes;
+	mOffsetMatrices.resize(mNodes.size());
+	mNodeParents.resize(mNodes.size());
+	for (unsigned int node = 0; node < mNodes.size(); ++node)
+	{
+		mOffsetMatrices[node] = mNodes[node].offsetMatrix;
+		mNodeParents[node]    = mNodes[node].parentIndex;
+	}
+	mHasBones = mesh.hasBones;
+	mClips    = mesh.clips;
+	mSubMeshes.resize(mesh.subMeshes.size());
+	for (unsigned int m = 0; m < mesh.subMeshes.size(); ++m)
+	{
+		CreateSubMesh(mSubMeshes[m], mesh.subMeshes[m], fileName);
+	}
+
+	// Skinned meshes can be pre-skinned if the skinning shader can read all their sub-meshes. Otherwise they are drawn
+	// as before with no pre-skinning, so a missing layout isn't an error
+	if (mHasBones)
+	{
+		bool canPreSkin = true;
+		for (auto& subMesh : mesh.subMeshes)
 		{
-			CVector3* assimpTangent = reinterpret_cast<CVector3*>(assimpMesh->mTangents);
-			unsigned char* tangent = vertices.get() + tangentOffset;
-			unsigned char* tangentEnd = tangent + subMesh.numVertices * subMesh.vertexSize;
-			while (tangent != tangentEnd)
+			int found = 0;
+			for (auto& element : subMesh.vertexElements)
 			{
-				*(CVector3*)tangent = *assimpTangent;
-				tangent += subMesh.vertexSize;
-				++assimpTangent;
+				for (const char* semantic : { "position", "normal", "uv", "bones", "weights" })
+				{
+					if (std::strcmp(element.SemanticName, semantic) == 0)  ++found;
+				}
 			}
+			if (found < 5)  canPreSkin = false;
 		}
-
-		if (assimpMesh->GetNumUVChannels() > 0 && assimpMesh->HasTextureCoords(0))
+		if (canPreSkin)
 		{
-			aiVector3D* assimpUV = assimpMesh->mTextureCoords[0];
-			unsigned char* uv = vertices.get() + uvOffset;
-			unsigned char* uvEnd = uv + subMesh.numVertices * subMesh.vertexSize;
-			while (uv != uvEnd)
+			const D3D11_INPUT_ELEMENT_DESC skinnedLayout[] =
 			{
-				*(CVector2*)uv = CVector2(assimpUV->x, assimpUV->y);
-				uv += subMesh.vertexSize;
-				++assimpUV;
-			}
+				{ "position", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,  0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+				{ "normal",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+				{ "uv",       0, DXGI_FORMAT_R32G32_FLOAT,    0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			};
+			mSkinnedLayout = gInputLayoutCache.Get(skinnedLayout, 3);
 		}
+	}
 
-
-		if (mHasBones)
+	// Rigid meshes can be baked into static batches if the bake shader can read all their sub-meshes
+	if (!mHasBones)
+	{
+		mCanBake = true;
+		for (auto& subMesh : mesh.subMeshes)
 		{
-			if (assimpMesh->HasBones())
+			int found = 0;
+			for (auto& element : subMesh.vertexElements)
 			{
-				// Set all bones and weights to 0 to start with
-				unsigned char* bones = vertices.get() + bonesOffset;
-				unsigned char* bonesEnd = bones + subMesh.numVertices * subMesh.vertexSize;
-				while (bones != bonesEnd)
-				{
-					memset(bones, 0, 20);
-					bones += subMesh.vertexSize;
-				}
-
-				for (auto& node : mNodes)
-				{
-					node.offsetMatrix = MatrixIdentity();
-				}
-
-				// Go through each assimp bone
-				bones = vertices.get() + bonesOffset;
-				for (unsigned int i = 0; i < assimpMesh->mNumBones; ++i)
+				for (const char* semantic : { "position", "normal", "uv" })
 				{
-					// Get offset matrix for the bone (transform from skinned mesh root to bone root
-					aiBone* assimpBone = assimpMesh->mBones[i];
-					std::string boneName = assimpBone->mName.C_Str();
-					unsigned int nodeIndex;
-					for (nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
-					{
-						if (mNodes[nodeIndex].name == boneName)
-						{
-							mNodes[nodeIndex].offsetMatrix.SetValues(&assimpBone->mOffsetMatrix.a1);
-							mNodes[nodeIndex].offsetMatrix.Transpose(); // Assimp stores matrices differently to this app
-							break;
-						}
-					}
-					if (nodeIndex == mNodes.size())  throw std::runtime_error("Bone with no matching node in " + fileName);
-
-					// Go through each weight of the bone and update the vertex it influences
-					// Find the first 0 weight on that vertex and put the new influence / weight there.
-					// A vertex can only have up to 4 influences
-					for (unsigned int j = 0; j < assimpBone->mNumWeights; ++j)
-					{
-						unsigned int vertexIndex = assimpBone->mWeights[j].mVertexId;
-						unsigned char* bone = bones + vertexIndex * subMesh.vertexSize;
-						float* weight = (float*)(bone + 4);
-						float* lastWeight = weight + 3;
-						while (*weight != 0.0f && weight != lastWeight)
-						{
-							bone++; weight++;
-						}
-						if (*weight == 0.0f)
-						{
-							*bone = nodeIndex;
-							*weight = assimpBone->mWeights[j].mWeight;
-						}
-					}
+					if (std::strcmp(element.SemanticName, semantic) == 0)  ++found;
 				}
 			}
-			else
-			{
-				// In a mesh that uses skinning any sub-meshes that don't contain bones are given bones so the whole mesh can use one shader
-				unsigned int subMeshNode = 0;
-				for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
-				{
-					for (auto& subMeshIndex : mNodes[nodeIndex].subMeshes)
-					{
-						if (subMeshIndex == m)
-							subMeshNode = nodeIndex;
-					}
-				}
-
-				unsigned char* bones = vertices.get() + bonesOffset;
-				unsigned char* bonesEnd = bones + subMesh.numVertices * subMesh.vertexSize;
-				while (bones != bonesEnd)
-				{
-					memset(bones, 0, 20);
-					bones[0] = subMeshNode;
-					*(float*)(bones + 4) = 1.0f;
-					bones += subMesh.vertexSize;
-				}
+			if (found < 3)  mCanBake = false;
+		}
+	}
+	CalculateBounds(mesh);
+	CalculateUVDensity(mesh);
+	KeepOccluderTriangles(mesh);
 
-			}
+	// The error of each level of detail is the worst of any sub-mesh. Sub-meshes with fewer levels use their coarsest one
+	mLodErrors.assign(1, 0.0f);
+	for (auto& subMesh : mesh.subMeshes)
+	{
+		if (subMesh.lods.size() + 1 > mLodErrors.size())  mLodErrors.resize(subMesh.lods.size() + 1, 0.0f);
+	}
+	for (unsigned int lod = 1; lod < mLodErrors.size(); ++lod)
+	{
+		for (auto& subMesh : mesh.subMeshes)
+		{
+			if (subMesh.lods.empty())  continue;
+			float error = subMesh.lods[std::min(static_cast<size_t>(lod), subMesh.lods.size()) - 1].error;
+			mLodErrors[lod] = std::max(mLodErrors[lod], error);
 		}
+	}
+}
 
 
+// Create the input layout and GPU-side vertex and index buffers for a sub-mesh. Throws a std::runtime_error on failure
+void Mesh::CreateSubMesh(SubMesh& subMesh, const CookedMesh::SubMesh& data, const std::string& fileName)
+{
+	subMesh.vertexSize  = data.vertexSize;
+	subMesh.numVertices = data.numVertices;
+	subMesh.numIndices  = data.numIndices;
+	subMesh.indexFormat = data.indexFormat;
+
+	// Get a "vertex layout" to describe to DirectX what is data in each vertex of this mesh. Layouts are shared by all
+	// sub-meshes with the same vertex elements, so each one is only created once
+	subMesh.vertexLayout = gInputLayoutCache.Get(data.vertexElements.data(), static_cast<int>(data.vertexElements.size()));
+	if (subMesh.vertexLayout == nullptr)  throw std::runtime_error("Unsupported vertex layout in " + fileName);
 
-		//-----------------------------------
+	CreatePositionStream(subMesh, data, fileName);
 
-		// Copy face data from assimp to our CPU-side index buffer
-		if (!assimpMesh->HasFaces())  throw std::runtime_error("No face data in " + subMeshName + " in " + fileName);
+	unsigned int indexSize = (subMesh.indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4);
 
-		DWORD* index = reinterpret_cast<DWORD*>(indices.get());
-		for (unsigned int face = 0; face < assimpMesh->mNumFaces; ++face)
+	// The levels of detail follow the full detail indices in the same index buffer
+	subMesh.lods.push_back({ 0, subMesh.numIndices });
+	unsigned int totalIndices = subMesh.numIndices;
+	for (auto& lod : data.lods)
+	{
+		subMesh.lods.push_back({ totalIndices, lod.numIndices });
+		totalIndices += lod.numIndices;
+	}
+	// Joined in this thread's import arena, which is rewound once the buffers are created
+	ArenaScope scratch(ImportArena());
+	const unsigned char* indices = data.indices;
+	if (!data.lods.empty())
+	{
+		unsigned char* allIndices = ImportArena().AllocateArray<unsigned char>(static_cast<size_t>(totalIndices) * indexSize);
+		std::memcpy(allIndices, data.indices, static_cast<size_t>(subMesh.numIndices) * indexSize);
+		for (unsigned int lod = 1; lod < subMesh.lods.size(); ++lod)
 		{
-			*index++ = assimpMesh->mFaces[face].mIndices[0];
-			*index++ = assimpMesh->mFaces[face].mIndices[1];
-			*index++ = assimpMesh->mFaces[face].mIndices[2];
+			std::memcpy(allIndices + static_cast<size_t>(subMesh.lods[lod].startIndex) * indexSize, data.lods[lod - 1].indices,
+			            static_cast<size_t>(subMesh.lods[lod].numIndices) * indexSize);
 		}
+		indices = allIndices;
+	}
 
+	// Take ranges of the shared buffers if the geometry pool is in use. The sub-mesh holds its own reference to the buffers
+	// so it can release them like the buffers it creates itself
+	if (gGeometryPool.Enabled())
+	{
+		if (!gGeometryPool.Allocate(D3D11_BIND_VERTEX_BUFFER, subMesh.vertexSize, subMesh.numVertices, data.vertices, subMesh.vertexRange))
+		{
+			throw std::runtime_error("Failure allocating vertex buffer for " + fileName);
+		}
+		subMesh.vertexBuffer = subMesh.vertexRange.buffer;
+		subMesh.vertexBuffer->AddRef();
 
-		//-----------------------------------
+		if (!gGeometryPool.Allocate(D3D11_BIND_INDEX_BUFFER, indexSize, totalIndices, indices, subMesh.indexRange))
+		{
+			throw std::runtime_error("Failure allocating index buffer for " + fileName);
+		}
+		subMesh.indexBuffer = subMesh.indexRange.buffer;
+		subMesh.indexBuffer->AddRef();
+		return;
+	}
 
-		D3D11_BUFFER_DESC bufferDesc;
-		D3D11_SUBRESOURCE_DATA initData;
 
-		// Create GPU-side vertex buffer and copy the vertices imported by assimp into it
-		bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Indicate it is a vertex buffer
-		bufferDesc.Usage = D3D11_USAGE_DEFAULT;          // Default usage for this buffer - we'll see other usages later
-		bufferDesc.ByteWidth = subMesh.numVertices * subMesh.vertexSize; // Size of the buffer in bytes
-		bufferDesc.CPUAccessFlags = 0;
-		bufferDesc.MiscFlags = 0;
-		initData.pSysMem = vertices.get(); // Fill the new vertex buffer with data loaded by assimp
+	D3D11_BUFFER_DESC bufferDesc;
+	D3D11_SUBRESOURCE_DATA initData;
 
-		hr = gD3DDevice->CreateBuffer(&bufferDesc, &initData, &subMesh.vertexBuffer);
-		if (FAILED(hr))  throw std::runtime_error("Failure creating vertex buffer for " + fileName);
+	// Create GPU-side vertex buffer and copy the vertices into it
+	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Indicate it is a vertex buffer
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT;          // Default usage for this buffer - we'll see other usages later
+	bufferDesc.ByteWidth = subMesh.numVertices * subMesh.vertexSize; // Size of the buffer in bytes
+	bufferDesc.CPUAccessFlags = 0;
+	bufferDesc.MiscFlags = 0;
+	initData.pSysMem = data.vertices; // Fill the new vertex buffer with the imported / cooked data
 
+	HRESULT hr = gD3DDevice->CreateBuffer(&bufferDesc, &initData, &subMesh.vertexBuffer);
+	if (FAILED(hr))  throw std::runtime_error("Failure creating vertex buffer for " + fileName);
+	gResourceRegistry.Track(subMesh.vertexBuffer);
 
-		// Create GPU-side index buffer and copy the vertices imported by assimp into it
-		bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER; // Indicate it is an index buffer
-		bufferDesc.Usage = D3D11_USAGE_DEFAULT;         // Default usage for this buffer - we'll see other usages later
-		bufferDesc.ByteWidth = subMesh.numIndices * sizeof(DWORD); // Size of the buffer in bytes
-		bufferDesc.CPUAccessFlags = 0;
-		bufferDesc.MiscFlags = 0;
-		initData.pSysMem = indices.get(); // Fill the new index buffer with data loaded by assimp
 
-		hr = gD3DDevice->CreateBuffer(&bufferDesc, &initData, &subMesh.indexBuffer);
-		if (FAILED(hr))  throw std::runtime_error("Failure creating index buffer for " + fileName);
-	}
+	// Create GPU-side index buffer and copy the indices into it
+	bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER; // Indicate it is an index buffer
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT;         // Default usage for this buffer - we'll see other usages later
+	bufferDesc.ByteWidth = totalIndices * indexSize; // Size of the buffer in bytes
+	bufferDesc.CPUAccessFlags = 0;
+	bufferDesc.MiscFlags = 0;
+	initData.pSysMem = indices; // Fill the new index buffer with the imported / cooked data and any levels of detail
+
+	hr = gD3DDevice->CreateBuffer(&bufferDesc, &initData, &subMesh.indexBuffer);
+	if (FAILED(hr))  throw std::runtime_error("Failure creating index buffer for " + fileName);
+	gResourceRegistry.Track(subMesh.indexBuffer);
 }
 
 
-Mesh::~Mesh()
+// Copy the positions out of the vertices into a buffer of their own, in the geometry pool if it is in use
+void Mesh::CreatePositionStream(SubMesh& subMesh, const CookedMesh::SubMesh& data, const std::string& fileName)
 {
-	for (auto& subMesh : mSubMeshes)
+	const D3D11_INPUT_ELEMENT_DESC* position = nullptr;
+	for (auto& element : data.vertexElements)
 	{
-		if (subMesh.indexBuffer)   subMesh.indexBuffer ->Release();
-		if (subMesh.vertexBuffer)  subMesh.vertexBuffer->Release();
-		if (subMesh.vertexLayout)  subMesh.vertexLayout->Release();
+		if (std::strcmp(element.SemanticName, "position") == 0)  position = &element;
+	}
+	if (position == nullptr || position->Format != DXGI_FORMAT_R32G32B32_FLOAT || subMesh.vertexSize <= sizeof(CVector3))  return;
+
+	// All position streams share the one layout
+	D3D11_INPUT_ELEMENT_DESC positionElement = *position;
+	positionElement.InputSlot = 0;
+	positionElement.AlignedByteOffset = 0;
+	subMesh.positionLayout = gInputLayoutCache.Get(&positionElement, 1);
+	if (subMesh.positionLayout == nullptr)  throw std::runtime_error("Unsupported position layout in " + fileName);
+
+	ArenaScope scratch(ImportArena());
+	CVector3* positions = ImportArena().AllocateArray<CVector3>(subMesh.numVertices);
+	for (unsigned int v = 0; v < subMesh.numVertices; ++v)
+	{
+		std::memcpy(&positions[v], data.vertices + static_cast<size_t>(v) * data.vertexSize + position->AlignedByteOffset,
+		            sizeof(CVector3));
 	}
-}
 
+	if (gGeometryPool.Enabled())
+	{
+		if (!gGeometryPool.Allocate(D3D11_BIND_VERTEX_BUFFER, sizeof(CVector3), subMesh.numVertices, positions, subMesh.positionRange))
+		{
+			throw std::runtime_error("Failure allocating position buffer for " + fileName);
+		}
+		subMesh.positionBuffer = subMesh.positionRange.buffer;
+		subMesh.positionBuffer->AddRef();
+		return;
+	}
 
-//--------------------------------------------------------------------------------------
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	bufferDesc.ByteWidth = subMesh.numVertices * sizeof(CVector3);
+	D3D11_SUBRESOURCE_DATA initData = {};
+	initData.pSysMem = positions;
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, &initData, &subMesh.positionBuffer)))
+	{
+		throw std::runtime_error("Failure creating position buffer for " + fileName);
+	}
+	gResourceRegistry.Track(subMesh.positionBuffer);
+}
 
-// Helper function for Render function - renders a given sub-mesh. World matrices / textures / states etc. must already be set
-void Mesh::RenderSubMesh(const SubMesh& subMesh)
-{
-	// Set vertex buffer as next data source for GPU
-	UINT stride = subMesh.vertexSize;
-	UINT offset = 0;
-	gD3DContext->IASetVertexBuffers(0, 1, &subMesh.vertexBuffer, &stride, &offset);
 
-	// Indicate the layout of vertex buffer
-	gD3DContext->IASetInputLayout(subMesh.vertexLayout);
+// Calculate a bounding box and sphere around the sub-meshes of each node from their vertex positions. The sphere is
+// centred on the box and just encloses the vertices, so is often tighter than the sphere around the box
+void Mesh::CalculateBounds(const CookedMesh& mesh)
+{
+	mNodeBounds.assign(mNodes.size(), { { { 0, 0, 0 }, { 0, 0, 0 } }, { { 0, 0, 0 }, 0 } });
+	for (unsigned int node = 0; node < mNodes.size(); ++node)
+	{
+		bool first = true;
+		BoundingBox& box = mNodeBounds[node].box;
+		for (int pass = 0; pass < 2; ++pass) // First pass for the box, second for the sphere radius
+		{
+			for (auto& subMeshIndex : mNodes[node].subMeshes)
+			{
+				const CookedMesh::SubMesh& data = mesh.subMeshes[subMeshIndex];
+				unsigned int positionOffset = 0; // Always the first element in practice, but look it up to be sure
+				for (auto& element : data.vertexElements)
+				{
+					if (std::strcmp(element.SemanticName, "position") == 0)  positionOffset = element.AlignedByteOffset;
+				}
 
-	// Set index buffer as next data source for GPU, indicate it uses 32-bit integers
-	gD3DContext->IASetIndexBuffer(subMesh.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+				for (unsigned int v = 0; v < data.numVertices; ++v)
+				{
+					CVector3 position;
+					memcpy(&position, data.vertices + static_cast<size_t>(v) * data.vertexSize + positionOffset, sizeof(position));
+					if (pass == 0)
+					{
+						if (first)  box.minimum = box.maximum = position;
+						box.minimum = { std::min(box.minimum.x, position.x), std::min(box.minimum.y, position.y), std::min(box.minimum.z, position.z) };
+						box.maximum = { std::max(box.maximum.x, position.x), std::max(box.maximum.y, position.y), std::max(box.maximum.z, position.z) };
+						first = false;
+					}
+					else
+					{
+						BoundingSphere& sphere = mNodeBounds[node].sphere;
+						sphere.radius = std::max(sphere.radius, Length(position - sphere.centre));
+					}
+				}
+			}
+			mNodeBounds[node].sphere.centre = box.Centre();
+		}
+	}
+}
 
-	// Using triangle lists only in this class
-	gD3DContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	// Render mesh
-	gD3DContext->DrawIndexed(subMesh.numIndices, 0, 0);
+// Convert a half precision float (as stored by CompactMesh) to a float. Denormals are treated as zero, they are far too
+// small to matter for texture coordinates
+static float HalfToFloat(uint16_t half)
+{
+	uint32_t sign     = static_cast<uint32_t>(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1f;
+	uint32_t mantissa = half & 0x3ff;
+	uint32_t bits = sign;
+	if (exponent == 0x1f)     bits |= 0x7f800000 | (mantissa << 13); // Infinity or NaN
+	else if (exponent != 0)   bits |= ((exponent + 112) << 23) | (mantissa << 13);
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
 }
 
 
-
-// Render the mesh with the given matrices
-// Handles rigid body meshes (including single part meshes) as well as skinned meshes
-// LIMITATION: The mesh must use a single texture throughout
-void Mesh::Render(std::vector<CMatrix4x4>& modelMatrices)
+// Calculate how many uv units there are to a unit of length across the surface of the full detail mesh, for choosing
+// texture mip levels (see Model::UVsPerPixel). The square root of the total uv area over the total surface area
+void Mesh::CalculateUVDensity(const CookedMesh& mesh)
 {
-	// Skinning needs all matrices available in the shader at the same time, so first calculate all the absolute
-	// matrices before rendering anything
-	std::vector<CMatrix4x4> absoluteMatrices(modelMatrices.size());
-	absoluteMatrices[0] = modelMatrices[0]; // First matrix for a model is the root matrix, already in world space
-	for (unsigned int nodeIndex = 1; nodeIndex < mNodes.size(); ++nodeIndex)
-	{
-		// Multiply each model matrix by its parent's absolute world matrix (already calculated earlier in this loop)
-		// Same process as for rigid bodies, simply done prior to rendering now
-		absoluteMatrices[nodeIndex] = modelMatrices[nodeIndex] * absoluteMatrices[mNodes[nodeIndex].parentIndex];
-	}
-
-	if (mHasBones) // Render a mesh that uses skinning
+	double surfaceArea = 0, uvArea = 0;
+	for (auto& data : mesh.subMeshes)
 	{
-		// Advanced point: the above loop will get the absolute world matrices **of the bones**. However, they are
-		// not actually rendered, they merely influence the skinned mesh, which has its origin at a particular node.
-		// So for each bone there is a fixed offset (transform) between where that bone is and where the root of the
-		// skinned mesh is. We need to apply that offset to each of the bone matrices calculated in the last loop to make
-		// the bone influences work on the skinned mesh.
-		// These offset matrices are fixed for the model and have been calculated when the mesh was imported
-		for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+		const D3D11_INPUT_ELEMENT_DESC* position = nullptr;
+		const D3D11_INPUT_ELEMENT_DESC* uv       = nullptr;
+		for (auto& element : data.vertexElements)
 		{
-			absoluteMatrices[nodeIndex] = mNodes[nodeIndex].offsetMatrix * absoluteMatrices[nodeIndex];
+			if (std::strcmp(element.SemanticName, "position") == 0)                         position = &element;
+			if (std::strcmp(element.SemanticName, "uv") == 0 && element.SemanticIndex == 0)  uv = &element;
 		}
-
-		// Send all matrices over to the GPU for skinning via a constant buffer - each matrix can represent a bone which influences nearby vertices
-		// MISSING - code to fill the gPerModelConstants.boneMatrices array with the contents of the absoluteMatrices vector
-		for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+		if (position == nullptr || uv == nullptr ||
+		    (uv->Format != DXGI_FORMAT_R32G32_FLOAT && uv->Format != DXGI_FORMAT_R16G16_FLOAT))
 		{
-			gPerModelConstants.boneMatrices[nodeIndex] = absoluteMatrices[nodeIndex];
+			continue;
 		}
-		UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants); // Send to GPU
 
-		// Indicate that the constant buffer we just updated is for use in the vertex shader (VS), geometry shader (GS) and pixel shader (PS)
-		gD3DContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
-		gD3DContext->GSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
-		gD3DContext->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+		auto readVertex = [&data, position, uv](unsigned int index, CVector3& p, CVector2& t)
+		{
+			const unsigned char* vertex = data.vertices + static_cast<size_t>(index) * data.vertexSize;
+			std::memcpy(&p, vertex + position->AlignedByteOffset, sizeof(p));
+			if (uv->Format == DXGI_FORMAT_R32G32_FLOAT)
+			{
+				std::memcpy(&t, vertex + uv->AlignedByteOffset, sizeof(t));
+			}
+			else
+			{
+				uint16_t halves[2];
+				std::memcpy(halves, vertex + uv->AlignedByteOffset, sizeof(halves));
+				t = { HalfToFloat(halves[0]), HalfToFloat(halves[1]) };
+			}
+		};
 
-		// Already sent over all the absolute matrices for the entire mesh so we can render sub-meshes directly
-		// rather than iterating through the nodes. 
-		for (auto& subMesh : mSubMeshes)
+		bool shortIndices = (data.indexFormat == DXGI_FORMAT_R16_UINT);
+		for (unsigned int i = 0; i + 2 < data.numIndices; i += 3)
 		{
-			RenderSubMesh(subMesh);
+			CVector3 p[3];
+			CVector2 t[3];
+			for (unsigned int c = 0; c < 3; ++c)
+			{
+				unsigned int index;
+				if (shortIndices)
+				{
+					uint16_t shortIndex;
+					std::memcpy(&shortIndex, data.indices + (i + c) * sizeof(uint16_t), sizeof(shortIndex));
+					index = shortIndex;
+				}
+				else
+				{
+					std::memcpy(&index, data.indices + (i + c) * sizeof(uint32_t), sizeof(index));
+				}
+				if (index >= data.numVertices)  return; // Invalid mesh, keep the default density
+				readVertex(index, p[c], t[c]);
+			}
+			surfaceArea += 0.5 * Length(Cross(p[1] - p[0], p[2] - p[0]));
+			CVector2 e1 = t[1] - t[0], e2 = t[2] - t[0];
+			uvArea += 0.5 * std::abs(e1.x * e2.y - e1.y * e2.x);
 		}
 	}
-	else
+	if (surfaceArea > 0 && uvArea > 0)  mUVDensity = static_cast<float>(std::sqrt(uvArea / surfaceArea));
+}
+
+
+// Copy the positions of the coarsest level of detail of each sub-mesh, as whole triangles for each node
+void Mesh::KeepOccluderTriangles(const CookedMesh& mesh)
+{
+	mOccluderTriangles.assign(mNodes.size(), {});
+	size_t numTriangles = 0;
+	for (unsigned int node = 0; node < mNodes.size(); ++node)
 	{
-		// Render a mesh without skinning. Although slightly reorganised to use the matrices calculated
-		// above, this is basically the same code as the rigid body animation lab
-		// Iterate through each node
-		for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+		for (auto& subMeshIndex : mNodes[node].subMeshes)
 		{
-			// Send this node's matrix to the GPU via a constant buffer
-			gPerModelConstants.worldMatrix = absoluteMatrices[nodeIndex];
-			UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants); // Send to GPU
-
-			// Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
-			gD3DContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
-			gD3DContext->GSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
-			gD3DContext->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+			const CookedMesh::SubMesh& data = mesh.subMeshes[subMeshIndex];
+			unsigned int numIndices = data.lods.empty() ? data.numIndices : data.lods.back().numIndices;
+			const unsigned char* indices = data.lods.empty() ? data.indices : data.lods.back().indices;
+			numTriangles += numIndices / 3;
+			if (numTriangles > MAX_OCCLUDER_TRIANGLES)
+			{
+				mOccluderTriangles.assign(mNodes.size(), {}); // Too detailed to rasterise every frame
+				return;
+			}
 
-			// Render the sub-meshes attached to this node (no bones - rigid movement)
-			for (auto& subMeshIndex : mNodes[nodeIndex].subMeshes)
+			unsigned int positionOffset = 0;
+			for (auto& element : data.vertexElements)
 			{
-				RenderSubMesh(mSubMeshes[subMeshIndex]);
+				if (std::strcmp(element.SemanticName, "position") == 0)  positionOffset = element.AlignedByteOffset;
+			}
+			bool shortIndices = (data.indexFormat == DXGI_FORMAT_R16_UINT);
+			for (unsigned int i = 0; i < numIndices / 3 * 3; ++i)
+			{
+				unsigned int index;
+				if (shortIndices)
+				{
+					uint16_t shortIndex;
+					std::memcpy(&shortIndex, indices + i * sizeof(uint16_t), sizeof(shortIndex));
+					index = shortIndex;
+				}
+				else
+				{
+					std::memcpy(&index, indices + i * sizeof(uint32_t), sizeof(index));
+				}
+				if (index >= data.numVertices)  break;
+
+				CVector3 position;
+				std::memcpy(&position, data.vertices + static_cast<size_t>(index) * data.vertexSize + positionOffset, sizeof(position));
+				mOccluderTriangles[node].push_back(position);
 			}
+			mOccluderTriangles[node].resize(mOccluderTriangles[node].size() / 3 * 3); // Whole triangles only
 		}
 	}
 }
 
 
-//--------------------------------------------------------------------------------------
-// Helper functions
-//--------------------------------------------------------------------------------------
-
-// Count the number of nodes with given assimp node as root - recursive
-unsigned int Mesh::CountNodes(aiNode* assimpNode)
+// Copy the full detail indices of a sub-mesh back through a staging buffer, adding base to each
+bool Mesh::ReadIndices(const SubMesh& subMesh, uint32_t base, std::vector<uint32_t>& indices)
 {
-	unsigned int count = 1;
-	for (unsigned int child = 0; child < assimpNode->mNumChildren; ++child)
-		count += CountNodes(assimpNode->mChildren[child]);
-	return count;
-}
-
-
-// Help build the arrays of submeshes and nodes from the assimp data - recursive
-unsigned int Mesh::ReadNodes(aiNode* assimpNode, unsigned int nodeIndex, unsigned int parentIndex)
-{
-	auto& node = mNodes[nodeIndex];
-	node.parentIndex = parentIndex;
-	unsigned int thisIndex = nodeIndex;
-	++nodeIndex;
-
-	node.name = assimpNode->mName.C_Str();
+	unsigned int indexSize = (subMesh.indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4);
+	const SubMesh::Lod& level = subMesh.lods[0];
+	if (level.numIndices == 0)  return true;
+
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.ByteWidth = level.numIndices * indexSize;
+	bufferDesc.Usage = D3D11_USAGE_STAGING;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	ID3D11Buffer* staging = nullptr;
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &staging)))
+	{
+		gLastError = "Error creating index readback buffer";
+		return false;
+	}
 
-	node.defaultMatrix.SetValues(&assimpNode->mTransformation.a1);
-	node.defaultMatrix.Transpose(); // Assimp stores matrices differently to this app
+	// The indices may be a range of the geometry pool's shared buffer
+	UINT first = (subMesh.indexRange.first + level.startIndex) * indexSize;
+	D3D11_BOX box = { first, 0, 0, first + bufferDesc.ByteWidth, 1, 1 };
+	gD3DContext->CopySubresourceRegion(staging, 0, 0, 0, 0, subMesh.indexBuffer, 0, &box);
 
-	node.subMeshes.resize(assimpNode->mNumMeshes);
-	for (unsigned int i = 0; i < assimpNode->mNumMeshes; ++i)
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(gD3DContext->Map(staging, 0, D3D11_MAP_READ, 0, &mapped)))
 	{
-		node.subMeshes[i] = assimpNode->mMeshes[i];
+		staging->Release();
+		gLastError = "Error reading back mesh indices";
+		return false;
 	}
-
-	node.childNodes.resize(assimpNode->mNumChildren);
-	for (unsigned int i = 0; i < assimpNode->mNumChildren; ++i)
+	const unsigned char* data = static_cast<const unsigned char*>(mapped.pData);
+	for (unsigned int i = 0; i < level.numIndices; ++i)
 	{
-		node.childNodes[i] = nodeIndex;
-		nodeIndex = ReadNodes(assimpNode->mChildren[i], nodeIndex, thisIndex);
+		if (indexSize == 2)
+		{
+			uint16_t index;
+			std::memcpy(&index, data + i * 2, sizeof(index));
+			indices.push_back(base + index);
+		}
+		else
+		{
+			uint32_t index;
+			std::memcpy(&index, data + i * 4, sizeof(index));
+			indices.push_back(base + index);
+		}
 	}
-
-	return nodeIndex;
+	gD3DContext->Unmap(staging, 0);
+	staging->Release();
+	return true;
 }
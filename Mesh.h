@@ -5,16 +5,22 @@
 // The class also doesn't load textures, filters or shaders as the outer code is
 // expected to select these things
 
+#include "CookedAssets.h"
+#include "GeometryPool.h"
 #include "CMatrix4x4.h"
+#include "Bounds.h"
+#include "ObjectPool.h"
 #define NOMINMAX // Use this to stop Windows headers defining "min" and "max", which breaks some libraries (e.g. assimp)
 #include <d3d11.h>
-#include <assimp/scene.h>
 #include <string>
 #include <vector>
 
 #ifndef _MESH_H_INCLUDED_
 #define _MESH_H_INCLUDED_
 
+struct InstanceData; // See Common.h
+struct DrawIndexedArguments; // --"--
+
 class Mesh
 {
 //--------------------------------------------------------------------------------------
@@ -24,8 +30,16 @@ public:
 
     // Pass the name of the mesh file to load. Uses assimp (http://www.assimp.org/) to support many file types
     // Optionally request tangents to be calculated (for normal and parallax mapping - see later lab)
+    // The result of the import is saved in a "cooked" file next to the mesh file (e.g. Cube.x.cooked), which is loaded
+    // directly on later runs without using assimp. The cooked file is rebuilt when the mesh file changes
+    // Optionally convert the vertices to compact formats with 16-bit indices where possible (see CompactMesh)
+    // Optionally generate up to numLods simplified levels of detail (see GenerateLods)
     // Will throw a std::runtime_error exception on failure (since constructors can't return errors).
-    Mesh(const std::string& fileName, bool requireTangents = false);
+    Mesh(const std::string& fileName, bool requireTangents = false, bool compactVertices = false, int numLods = 0);
+
+    // Create the mesh from data already imported or read from a cooked file (see LoadMeshData in CookedAssets.h)
+    // Only uses the device, so meshes can be created on worker threads (see AssetLoader.h). The file name is for errors
+    Mesh(const CookedMesh& mesh, const std::string& fileName);
     ~Mesh();
 
 
@@ -36,11 +50,96 @@ public:
     // The default matrix for a given node - used to set the initial position for a new model
     CMatrix4x4 GetNodeDefaultMatrix(unsigned int node) { return mNodes[node].defaultMatrix; }
 
+    // The parent of a given node. Nodes are stored depth-first so a parent always comes before its children (the root
+    // node refers to itself)
+    unsigned int GetNodeParent(unsigned int node)  { return mNodes[node].parentIndex; }
+
+    // The parent of every node in one array, in node order - for ConcatenateHierarchy
+    const unsigned int* GetNodeParents()  { return mNodeParents.data(); }
+
+    // Bounds of the geometry attached to a node, in the node's own space - transform with the node's absolute matrix.
+    // Calculated when the mesh is loaded. Nodes with no geometry have empty bounds at the origin
+    bool                  NodeHasGeometry(unsigned int node)        { return !mNodes[node].subMeshes.empty(); }
+    const BoundingBox&    GetNodeBoundingBox(unsigned int node)     { return mNodeBounds[node].box;    }
+    const BoundingSphere& GetNodeBoundingSphere(unsigned int node)  { return mNodeBounds[node].sphere; }
+
+    // Skinned meshes are deformed by their bones, so the node bounds only cover the mesh in its default pose
+    bool HasBones()  { return mHasBones; }
+
+    // Number of levels of detail, including the full detail mesh (level 0), and how far the surface of each level may be
+    // from the full detail surface, in node space (0 for level 0). Levels are coarser and have larger errors as they go up
+    unsigned int NumLods()                      { return static_cast<unsigned int>(mLodErrors.size()); }
+    float        GetLodError(unsigned int lod)  { return mLodErrors[lod]; }
+
+    // Average uv units per unit of length across the surface, in node space, for choosing texture mip levels. Calculated
+    // when the mesh is loaded, 0 if the mesh has no uvs
+    float GetUVDensity()  { return mUVDensity; }
+
+    // Triangles of the coarsest level of detail of the geometry attached to a node, three corners each in node space,
+    // for the software occlusion rasteriser (see OcclusionCuller.h). Kept when the mesh is loaded unless the mesh has
+    // more than MAX_OCCLUDER_TRIANGLES at that level, in which case every node's list is empty
+    const std::vector<CVector3>& GetOccluderTriangles(unsigned int node)  { return mOccluderTriangles[node]; }
+
+    // Animation clips imported with the mesh, compressed (see CookedClip). Played on models with an Animator (see Animation.h)
+    unsigned int      NumClips()                  { return static_cast<unsigned int>(mClips.size()); }
+    const CookedClip& GetClip(unsigned int clip)  { return mClips[clip]; }
+
 
-	// Render the mesh with the given matrices
-	// Handles rigid body meshes (including single part meshes) as well as skinned meshes
+	// Render the mesh with the given absolute (world space) node matrices, one per node (see Model::Render)
+	// With a vertex shader reading only positions (e.g. DepthOnly_vs), draws from a stream holding just the positions
+	// Handles rigid body meshes (including single part meshes) as well as skinned meshes. Renders the given level of detail,
+	// or the coarsest available if the mesh doesn't have that many
 	// LIMITATION: The mesh must use a single texture throughout
-	void Render(std::vector<CMatrix4x4>& modelMatrices);
+	void Render(const CMatrix4x4* absoluteMatrices, unsigned int lod = 0);
+
+	// Render the geometry of one node for several instances at once, each with its own absolute world matrix and colour
+	// (see Model::RenderInstanced). Instanced shaders must be selected, they read the instances from the instance buffer
+	// LIMITATION: Skinned meshes are drawn as rigid meshes, bone matrices are not used
+	void RenderInstanced(unsigned int node, const InstanceData* instances, unsigned int numInstances, unsigned int lod = 0);
+
+	// GPU-driven drawing (see GpuCuller.h) - add the arguments of an indirect draw of each sub-mesh of a node at a level of
+	// detail (or the coarsest the sub-mesh has) to the list, with no instances. The caller fills in the instance counts
+	void GetIndirectArguments(unsigned int node, unsigned int lod, std::vector<DrawIndexedArguments>& arguments);
+
+	// Draw the sub-meshes of a node with the arguments at the given byte offset, one set for each sub-mesh in the order
+	// GetIndirectArguments lists them. Instanced shaders reading the GPU's visible instances must be selected
+	void RenderIndirect(unsigned int node, ID3D11Buffer* arguments, UINT offset);
+
+
+	// Pre-skinning - a model with a skinned mesh can skin its vertices once per frame into its own vertex buffers (see
+	// Model::Skin), then each pass that frame draws those with the shaders for non-skinned models instead of skinning
+	// every vertex again. Only skinned meshes with positions, normals and uvs can be pre-skinned
+	bool CanPreSkin()  { return mSkinnedLayout != nullptr; }
+
+	// Create a vertex buffer for each sub-mesh to hold one model's skinned vertices, to be released by the caller.
+	// Returns false on failure (reason in gLastError), with no buffers to release
+	bool CreateSkinnedVertices(std::vector<ID3D11Buffer*>& skinnedVertices);
+
+	// Calculate the bone matrices used for skinning from the given absolute node matrices, one per node
+	void CalculateBonePalette(const CMatrix4x4* absoluteMatrices, CMatrix4x4* palette);
+
+	// Skin the mesh into buffers from CreateSkinnedVertices with the bone palette currently bound (see BonePalettes.h).
+	// Changes the shaders, so select them again before rendering
+	void Skin(ID3D11Buffer* const skinnedVertices[]);
+
+	// Render the vertices written by Skin with the current shaders, which should be those for non-skinned models. The
+	// vertices are already in world space
+	void RenderSkinned(ID3D11Buffer* const skinnedVertices[], unsigned int lod = 0);
+
+
+	// Static batching - the full detail geometry of a model that never moves can be written out once in world space and
+	// merged with others into large batches (see StaticBatches.h). Only rigid meshes with normals and uvs can be baked
+	bool CanBake()  { return mCanBake; }
+
+	// Number of vertices BakeWorldGeometry writes, one copy of each sub-mesh's vertices for each node it is attached to
+	unsigned int NumBakedVertices();
+
+	// Write the vertices transformed by the given absolute node matrices to a stream-out buffer as BasicVertex, starting
+	// at firstVertex, and add the full detail indices to the list with indexBase added to the first vertex's index. The
+	// bake shaders must be selected (see StaticBatches::Bake). Reads the indices back from the GPU so use on the main
+	// thread only. Returns false on failure (reason in gLastError)
+	bool BakeWorldGeometry(const CMatrix4x4* absoluteMatrices, ID3D11Buffer* vertices, unsigned int firstVertex,
+	                       uint32_t indexBase, std::vector<uint32_t>& indices);
 
 
 
@@ -50,7 +149,7 @@ public:
 private:
 
 	// A mesh is made of multiple sub-meshes. Each one uses a single material (texture).
-	// Each sub-mesh has a vertex / index buffer on the GPU. Could share buffers for performance but that would be complex.
+	// Each sub-mesh has a vertex / index buffer on the GPU, or a range of the shared buffers when the geometry pool is enabled
 	struct SubMesh
 	{
 		unsigned int       vertexSize = 0;         // Size in bytes of a single vertex (depends on what it contains, uvs, tangents etc.)
@@ -61,26 +160,38 @@ private:
 		ID3D11Buffer*      vertexBuffer = nullptr;
 
 		unsigned int       numIndices = 0;
+		DXGI_FORMAT        indexFormat = DXGI_FORMAT_R32_UINT; // 16-bit for compact meshes with few enough vertices
 		ID3D11Buffer*      indexBuffer  = nullptr;
-	};
 
+		// Ranges of the geometry pool's buffers holding the vertices / indices, if used (see GeometryPool.h). The buffers above
+		// then refer to the pool's buffers, and the first vertex / index are the base vertex and start index for drawing
+		GeometryRange      vertexRange;
+		GeometryRange      indexRange;
+
+		// The positions alone, tightly packed, for depth-only passes (see SetSubMeshBuffers). Null if the vertices are
+		// only positions already or their positions aren't floats. The range is of the geometry pool as above
+		ID3D11Buffer*      positionBuffer = nullptr;
+		ID3D11InputLayout* positionLayout = nullptr;
+		GeometryRange      positionRange;
+
+		// The indices of each level of detail follow each other in the index buffer, starting with the full detail ones.
+		// All levels use the same vertices
+		struct Lod
+		{
+			unsigned int   startIndex;
+			unsigned int   numIndices;
+		};
+		std::vector<Lod>   lods;
+	};
 
-	// A mesh contains a hierarchy of nodes. A node represents a seperate animatable part of the mesh
-	// A node can contain several sub-meshes (because a single node might use multiple textures)
-	// A node can also have child nodes. The children will follow the motion of the parent node
-	// Each node has a default matrix which is it's initial/ default position. Models using this mesh are
-	// given these default matrices as a starting position.
-	struct Node
-	{
-		std::string  name;
-
-		CMatrix4x4   defaultMatrix; // Starting position/rotation/scale for this node. Relative to parent. Used when first creating a model from this mesh
-		CMatrix4x4   offsetMatrix;
 
-		unsigned int parentIndex;   // Index of the parent node (from the mNodes vector below). Root node refers to itself (0)
+	// The node hierarchy, see CookedAssets.h
+	typedef CookedMesh::Node Node;
 
-		std::vector<unsigned int> childNodes; // Child nodes that are controlled by this node (indexes into the mNodes vector below)
-		std::vector<unsigned int> subMeshes;  // The geometry representing this node (indexes into the mSubMeshes vector below)
+	struct NodeBounds
+	{
+		BoundingBox    box;
+		BoundingSphere sphere;
 	};
 
 
@@ -89,14 +200,36 @@ private:
 //--------------------------------------------------------------------------------------
 private:
 
-	// Count the number of nodes with given assimp node as root
-	unsigned int CountNodes(aiNode* assimpNode);
+	// Copy the node hierarchy and create the GPU resources for each sub-mesh. Throws a std::runtime_error on failure
+	void Create(const CookedMesh& mesh, const std::string& fileName);
 
-	// Help build the arrays of submeshes and nodes from the assimp data - recursive
-	unsigned int ReadNodes(aiNode* assimpNode, unsigned int nodeIndex, unsigned int parentIndex);
+	// Create the input layout and GPU-side buffers for a sub-mesh. Throws a std::runtime_error on failure
+	void CreateSubMesh(SubMesh& subMesh, const CookedMesh::SubMesh& data, const std::string& fileName);
+
+	// Create the position stream of a sub-mesh, if it can have one. Throws a std::runtime_error on failure
+	void CreatePositionStream(SubMesh& subMesh, const CookedMesh::SubMesh& data, const std::string& fileName);
+
+	// Calculate a bounding box and sphere around the sub-meshes of each node from their vertex positions
+	void CalculateBounds(const CookedMesh& mesh);
+
+	// Calculate the average uv density of the surface, see GetUVDensity
+	void CalculateUVDensity(const CookedMesh& mesh);
+
+	// Copy the coarsest level of each sub-mesh for GetOccluderTriangles
+	void KeepOccluderTriangles(const CookedMesh& mesh);
+
+	// Copy the full detail indices of a sub-mesh back from the GPU, converted to 32-bit with base added to each. Returns
+	// false on failure (reason in gLastError)
+	bool ReadIndices(const SubMesh& subMesh, uint32_t base, std::vector<uint32_t>& indices);
 
 	// Helper function for Render function - renders a given sub-mesh. World matrices / textures / states etc. must already be set
-	void RenderSubMesh(const SubMesh& subMesh);
+	// Draws the skinned vertices from Skin instead of the sub-mesh's own if they are given
+	void RenderSubMesh(const SubMesh& subMesh, unsigned int numInstances = 0, unsigned int lod = 0, ID3D11Buffer* skinnedVertices = nullptr);
+
+	// Select a sub-mesh's vertex and index buffers and layout for drawing, or the skinned vertices from Skin if given.
+	// Selects the position stream instead when the current vertex shader reads only positions, unless that isn't allowed
+	// (indirect draws have the base vertex of the full vertices). Returns the base vertex to draw with
+	INT SetSubMeshBuffers(const SubMesh& subMesh, ID3D11Buffer* skinnedVertices = nullptr, bool allowPositionStream = true);
 
 
 
@@ -107,10 +240,25 @@ private:
 
     std::vector<SubMesh> mSubMeshes; // The mesh geometry. Nodes refer to sub-meshes in this vector
     std::vector<Node>    mNodes;     // The mesh hierarchy. First entry is root. remainder aree stored in depth-first order
+    std::vector<CMatrix4x4>   mOffsetMatrices; // Copies of the node offset matrices and parents in plain arrays so the
+    std::vector<unsigned int> mNodeParents;    // batch matrix functions can work through them in one call
+    std::vector<NodeBounds> mNodeBounds; // Bounds of the geometry attached to each node, in node space
+    std::vector<float>   mLodErrors; // Largest error of any sub-mesh at each level of detail, see GetLodError
+    float                mUVDensity = 0; // See GetUVDensity
+    std::vector<std::vector<CVector3>> mOccluderTriangles; // For each node, see GetOccluderTriangles
+    std::vector<CookedClip>            mClips; // See GetClip
+
+    static const size_t MAX_OCCLUDER_TRIANGLES = 4096;
 
 	bool mHasBones; // If any submesh has bones, then all submeshes are given bones - makes rendering easier (one shader for the whole mesh)
+	ID3D11InputLayout* mSkinnedLayout = nullptr; // Layout of the pre-skinned vertices (BasicVertex), if the mesh can be pre-skinned
+	bool mCanBake = false; // See CanBake
 };
 
 
+// All the meshes, created with gMeshPool.Create(...) (see ObjectPool.h). Destroy the models using them first
+extern ObjectPool<Mesh> gMeshPool;
+
+
 #endif //_MESH_H_INCLUDED_
 
@@ -0,0 +1,211 @@
+//--------------------------------------------------------------------------------------
+// Live metrics server
+//--------------------------------------------------------------------------------------
+// See MetricsServer.h for an overview
+
+#include "MetricsServer.h"
+#include <winsock2.h> // Before anything including Windows.h
+#include "GpuProfiler.h"
+#include "ResourceRegistry.h"
+#include "Direct3DSetup.h"
+#include "Scene.h"
+#include "Common.h"
+
+#include <sstream>
+
+
+MetricsServer gMetricsServer;
+
+const float MetricsServer::PUBLISH_INTERVAL = 0.5f;
+
+
+// Names for the POST_PROCESS_ flags in the effect label, as in -effects (see BatchProcessor.h)
+const char* const POST_PROCESS_NAMES[NUM_POST_PROCESS_FLAGS] = { "tint", "blur", "gaussianblur", "underwater", "retro", "bloom", "star" };
+
+// Requests are read up to the end of the headers or this size, whichever is first. The request itself is ignored
+const int MAX_REQUEST_SIZE = 4096;
+
+
+// Escape a label value for the Prometheus text format
+std::string PrometheusLabel(const std::string& value)
+{
+	std::string escaped;
+	for (char c : value)
+	{
+		if (c == '\\' || c == '"')  escaped += '\\';
+		if (c == '\n')  { escaped += "\\n"; continue; }
+		escaped += c;
+	}
+	return escaped;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+MetricsServer::~MetricsServer()
+{
+	Stop();
+}
+
+
+bool MetricsServer::Start(int port)
+{
+	Stop();
+
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		gLastError = "Error starting Winsock for the metrics server";
+		return false;
+	}
+	mWinsock = true;
+
+	SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(static_cast<u_short>(port));
+	if (listener == INVALID_SOCKET || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR ||
+	    listen(listener, SOMAXCONN) == SOCKET_ERROR)
+	{
+		if (listener != INVALID_SOCKET)  closesocket(listener);
+		Stop();
+		gLastError = "Error listening for metrics requests on port " + std::to_string(port);
+		return false;
+	}
+	mListener = listener;
+
+	mQuit = false;
+	mNumRequests = 0;
+	mTimeSincePublish = PUBLISH_INTERVAL; // Publish on the first Update
+	mThread = std::thread(&MetricsServer::ServerThread, this);
+	return true;
+}
+
+
+void MetricsServer::Stop()
+{
+	if (mThread.joinable())
+	{
+		mQuit = true;
+		mThread.join();
+	}
+	if (mListener != INVALID_SOCKET)  closesocket(static_cast<SOCKET>(mListener));
+	mListener = INVALID_SOCKET;
+	if (mWinsock)  WSACleanup();
+	mWinsock = false;
+}
+
+
+void MetricsServer::Update(float frameTime)
+{
+	if (!Running())  return;
+	mTimeSincePublish += frameTime;
+	if (mTimeSincePublish < PUBLISH_INTERVAL)  return;
+	mTimeSincePublish = 0;
+
+	// The back copy's strings keep their storage from when it was last filled, so this rarely allocates
+	Snapshot& snapshot = mSnapshots.Back();
+	snapshot.frames        = gTelemetry.NumFrames();
+	snapshot.cpu           = gTelemetry.CpuStats();
+	snapshot.gpu           = gTelemetry.GpuStats();
+	snapshot.hitches       = gTelemetry.NumHitches();
+	snapshot.videoMemory   = VideoMemoryUsage();
+	snapshot.videoBudget   = gResourceRegistry.LocalBudget();
+	snapshot.postProcesses = PostProcesses();
+	const auto& timings = gGpuProfiler.Timings();
+	snapshot.passes.resize(timings.size());
+	for (size_t i = 0; i < timings.size(); ++i)
+	{
+		snapshot.passes[i].first  = timings[i].name;
+		snapshot.passes[i].second = timings[i].milliseconds;
+	}
+	mSnapshots.Publish();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+void MetricsServer::ServerThread()
+{
+	SOCKET listener = static_cast<SOCKET>(mListener);
+	while (!mQuit)
+	{
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(listener, &readable);
+		timeval timeout = { 0, POLL_MILLISECONDS * 1000 };
+		if (select(0, &readable, nullptr, nullptr, &timeout) <= 0)  continue;
+
+		SOCKET client = accept(listener, nullptr, nullptr);
+		if (client == INVALID_SOCKET)  continue;
+
+		// Read the request up to the blank line ending its headers, giving up on a client that sends nothing
+		DWORD receiveTimeout = 1000;
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&receiveTimeout), sizeof(receiveTimeout));
+		std::string request;
+		char buffer[512];
+		while (request.size() < MAX_REQUEST_SIZE && request.find("\r\n\r\n") == std::string::npos)
+		{
+			int received = recv(client, buffer, sizeof(buffer), 0);
+			if (received <= 0)  break;
+			request.append(buffer, received);
+		}
+
+		mSnapshots.Acquire(); // Keeps the previous copy if nothing new was published
+		std::string body = Format(mSnapshots.Front());
+		std::string response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+		                       std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+		send(client, response.data(), static_cast<int>(response.size()), 0);
+		shutdown(client, SD_SEND);
+		closesocket(client);
+		++mNumRequests;
+	}
+}
+
+
+std::string MetricsServer::Format(const Snapshot& snapshot)
+{
+	std::ostringstream text;
+	text << "# TYPE postprocessing_frames_total counter\n"
+	     << "postprocessing_frames_total " << snapshot.frames << "\n"
+	     << "# TYPE postprocessing_hitches_total counter\n"
+	     << "postprocessing_hitches_total " << snapshot.hitches << "\n";
+
+	// Percentiles over the frames in the telemetry ring
+	struct NamedStats { const char* name; const FrameTelemetry::Stats& stats; };
+	for (const NamedStats& named : { NamedStats{ "cpu", snapshot.cpu }, NamedStats{ "gpu", snapshot.gpu } })
+	{
+		text << "# TYPE postprocessing_frame_" << named.name << "_ms gauge\n"
+		     << "postprocessing_frame_" << named.name << "_ms{quantile=\"0.5\"} "  << named.stats.p50 << "\n"
+		     << "postprocessing_frame_" << named.name << "_ms{quantile=\"0.95\"} " << named.stats.p95 << "\n"
+		     << "postprocessing_frame_" << named.name << "_ms{quantile=\"0.99\"} " << named.stats.p99 << "\n"
+		     << "postprocessing_frame_" << named.name << "_ms{quantile=\"1\"} "    << named.stats.max << "\n";
+	}
+
+	text << "# TYPE postprocessing_gpu_pass_ms gauge\n";
+	for (auto& pass : snapshot.passes)
+	{
+		text << "postprocessing_gpu_pass_ms{pass=\"" << PrometheusLabel(pass.first) << "\"} " << pass.second << "\n";
+	}
+
+	text << "# TYPE postprocessing_video_memory_bytes gauge\n"
+	     << "postprocessing_video_memory_bytes " << snapshot.videoMemory << "\n";
+	if (snapshot.videoBudget > 0)
+	{
+		text << "# TYPE postprocessing_video_budget_bytes gauge\n"
+		     << "postprocessing_video_budget_bytes " << snapshot.videoBudget << "\n";
+	}
+
+	text << "# TYPE postprocessing_effect_enabled gauge\n";
+	for (int flag = 0; flag < NUM_POST_PROCESS_FLAGS; ++flag)
+	{
+		text << "postprocessing_effect_enabled{effect=\"" << POST_PROCESS_NAMES[flag] << "\"} "
+		     << ((snapshot.postProcesses & (1 << flag)) != 0 ? 1 : 0) << "\n";
+	}
+	return text.str();
+}
@@ -0,0 +1,103 @@
+//--------------------------------------------------------------------------------------
+// Live metrics server
+//--------------------------------------------------------------------------------------
+// Serves the app's live performance over HTTP in the Prometheus text format, so unattended installs can be scraped and
+// watched centrally: frame time percentiles and hitches from the telemetry (see Telemetry.h), the GPU time of each
+// profiled pass, video memory use against the OS budget, and which post-processes are switched on. Any request on the
+// port gets the metrics (e.g. http://machine:9150/metrics).
+//
+// The render loop never waits for the server. Update copies the numbers into a triple buffer (see TripleBuffer.h) a
+// couple of times a second, and the server thread takes the latest copy when a request arrives, so a slow or
+// stalled scraper costs the render loop nothing. The server thread waits on the socket with a timeout to notice Stop
+
+#ifndef _METRICS_SERVER_H_INCLUDED_
+#define _METRICS_SERVER_H_INCLUDED_
+
+#include "Telemetry.h"
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+
+class MetricsServer
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~MetricsServer();
+
+	// Listen on the given TCP port on all interfaces, serving from a background thread. Returns false on error (reason
+	// in gLastError)
+	bool Start(int port);
+
+	// Stop the server thread and close the socket
+	void Stop();
+
+
+	// Call once per frame from the render loop, after the frame is recorded in the telemetry. Publishes the current
+	// numbers every PUBLISH_INTERVAL seconds, never waits for the server thread
+	void Update(float frameTime);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	bool Running()  { return mThread.joinable(); }
+
+	int NumRequests()  { return mNumRequests; } // Requests served since Start
+
+	// Port the server listens on, and the one used when none is given
+	static const int DEFAULT_PORT = 9150;
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const float PUBLISH_INTERVAL;        // Seconds between copies of the numbers for the server thread
+	static const int   POLL_MILLISECONDS = 250; // How often the server thread checks it should stop
+
+	// The numbers served, copied from the render loop
+	struct Snapshot
+	{
+		long long             frames = 0;
+		FrameTelemetry::Stats cpu = {};
+		FrameTelemetry::Stats gpu = {};
+		int                   hitches = 0;
+		uint64_t              videoMemory = 0;
+		uint64_t              videoBudget = 0; // 0 if the OS can't say
+		int                   postProcesses = 0; // POST_PROCESS_ flags (see Scene.h)
+		std::vector<std::pair<std::string, float>> passes; // GPU timer names and milliseconds, from a few frames ago
+	};
+
+	// Background thread loop, answers requests until told to stop
+	void ServerThread();
+
+	// The Prometheus text for a snapshot
+	std::string Format(const Snapshot& snapshot);
+
+	TripleBuffer<Snapshot> mSnapshots;
+	float                  mTimeSincePublish = 0;
+
+	// The listening SOCKET (INVALID_SOCKET when not running), kept as its underlying type so this header needn't include
+	// winsock2.h, which must come before Windows.h
+	uintptr_t         mListener = ~static_cast<uintptr_t>(0);
+	bool              mWinsock = false; // WSAStartup succeeded
+	std::thread       mThread;
+	std::atomic<bool> mQuit{ false };
+	std::atomic<int>  mNumRequests{ 0 };
+};
+
+
+extern MetricsServer gMetricsServer;
+
+
+#endif //_METRICS_SERVER_H_INCLUDED_
@@ -1,31 +1,205 @@
 //--------------------------------------------------------------------------------------
 // Class encapsulating a model
 //--------------------------------------------------------------------------------------
-// Holds a pointer to a mesh as well as position, rotation and scaling, which are converted to a world matrix when required
-// This is more of a convenience class, the Mesh class does most of the difficult work.
+// Holds a pointer to a mesh and the index of its nodes in the transform system, which holds their position, rotation and
+// scaling and converts them to world matrices each frame (see TransformSystem). A model is just a light handle onto
+// those nodes. This is more of a convenience class, the Mesh class does most of the difficult work.
 
 #include "Model.h"
 #include "Mesh.h"
 #include "GraphicsHelpers.h"
 #include "Common.h"
 
+#include <algorithm>
+
+
+ObjectPool<Model> gModelPool;
+
 
 Model::Model(Mesh* mesh, CVector3 position /*= { 0,0,0 }*/, CVector3 rotation /*= { 0,0,0 }*/, float scale /*= 1*/)
     : mMesh(mesh)
 {
-    // Set default matrices from mesh
-    mWorldMatrices.resize(mesh->NumberNodes());
-    for (int i = 0; i < mWorldMatrices.size(); ++i)
-        mWorldMatrices[i] = mesh->GetNodeDefaultMatrix(i);
+    // Set default transforms from mesh, every absolute matrix is calculated on the next gTransformSystem.Update
+    std::vector<CMatrix4x4> defaultMatrices(mesh->NumberNodes());
+    for (unsigned int i = 0; i < defaultMatrices.size(); ++i)
+        defaultMatrices[i] = mesh->GetNodeDefaultMatrix(i);
+    mFirstNode = gTransformSystem.Add(mesh->NumberNodes(), mesh->GetNodeParents(), defaultMatrices.data());
+}
+
+
+Model::~Model()
+{
+    gTransformSystem.Remove(mFirstNode, mMesh->NumberNodes());
+    for (auto& buffer : mSkinnedVertices)  buffer->Release();
 }
 
 
 
-// The render function simply passes this model's matrices over to Mesh:Render.
+// The render function passes the absolute matrices from the transform system over to Mesh:Render.
 // All other per-frame constants must have been set already along with shaders, textures, samplers, states etc.
+// Pre-skinned models draw the vertices from the last Skin instead
 void Model::Render()
 {
-    mMesh->Render(mWorldMatrices);
+    if (!mSkinnedVertices.empty())  mMesh->RenderSkinned(mSkinnedVertices.data(), mLod);
+    else                            mMesh->Render(gTransformSystem.WorldMatrices(mFirstNode), mLod);
+}
+
+
+// Calculate the bone matrices of a skinned model from the transform system's matrices
+void Model::CalculateBonePalette(CMatrix4x4* palette)
+{
+    mMesh->CalculateBonePalette(gTransformSystem.WorldMatrices(mFirstNode), palette);
+}
+
+
+// Skin a skinned model into vertex buffers of its own, created on the first call
+void Model::Skin()
+{
+    if (!mMesh->CanPreSkin() || mSkinningFailed)  return;
+    if (mSkinnedVertices.empty() && !mMesh->CreateSkinnedVertices(mSkinnedVertices))
+    {
+        OutputDebugStringA((gLastError + "\n").c_str()); // Not fatal, the model is drawn as before
+        mSkinningFailed = true;
+        return;
+    }
+    mMesh->Skin(mSkinnedVertices.data());
+}
+
+
+bool Model::BakeWorldGeometry(ID3D11Buffer* vertices, unsigned int firstVertex, uint32_t indexBase, std::vector<uint32_t>& indices)
+{
+    return mMesh->BakeWorldGeometry(gTransformSystem.WorldMatrices(mFirstNode), vertices, firstVertex, indexBase, indices);
+}
+
+
+// Render several models that share the same mesh with instanced draw calls, one per node that has geometry
+void Model::RenderInstanced(Model* const models[], const CVector3 colours[], unsigned int numModels,
+                            const unsigned int textureSlices[] /*= nullptr*/)
+{
+    if (numModels == 0)  return;
+    Mesh* mesh = models[0]->mMesh;
+
+    // Kept from one call to the next (per-thread, models are rendered on the render worker threads) so it only allocates
+    // when more models are drawn than ever before
+    thread_local std::vector<InstanceData> instances;
+    if (instances.size() < numModels)  instances.resize(numModels);
+
+    for (unsigned int node = 0; node < mesh->NumberNodes(); ++node)
+    {
+        for (unsigned int i = 0; i < numModels; ++i)
+        {
+            instances[i].worldMatrix  = gTransformSystem.WorldMatrices(models[i]->mFirstNode)[node];
+            instances[i].objectColour = colours[i];
+            instances[i].textureSlice = (textureSlices ? textureSlices[i] : 0);
+        }
+        mesh->RenderInstanced(node, instances.data(), numModels, models[0]->mLod);
+    }
+}
+
+
+void Model::GetNodeInstances(const CVector3& colour, unsigned int textureSlice, InstanceData* instances)
+{
+    const CMatrix4x4* absoluteMatrices = gTransformSystem.WorldMatrices(mFirstNode);
+    for (unsigned int node = 0; node < mMesh->NumberNodes(); ++node)
+    {
+        instances[node].worldMatrix  = absoluteMatrices[node];
+        instances[node].objectColour = colour;
+        instances[node].textureSlice = textureSlice;
+    }
+}
+
+
+// Test if any part of the model is inside the given frustum using the bounds of the mesh
+bool Model::IsVisible(const Frustum& frustum)
+{
+    // Bones can move the vertices anywhere, so the bounds of a skinned mesh don't hold once it is animated
+    if (mMesh->HasBones())  return true;
+
+    const CMatrix4x4* absoluteMatrices = gTransformSystem.WorldMatrices(mFirstNode);
+    for (unsigned int node = 0; node < mMesh->NumberNodes(); ++node)
+    {
+        if (mMesh->NodeHasGeometry(node) &&
+            IsInFrustum(frustum, mMesh->GetNodeBoundingBox(node), mMesh->GetNodeBoundingSphere(node), absoluteMatrices[node]))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// The world space axis-aligned box around all the parts of the model
+BoundingBox Model::WorldBoundingBox()
+{
+    const CMatrix4x4* absoluteMatrices = gTransformSystem.WorldMatrices(mFirstNode);
+
+    bool first = true;
+    BoundingBox bounds = { absoluteMatrices[0].GetRow(3), absoluteMatrices[0].GetRow(3) }; // Just the origin if no geometry
+    for (unsigned int node = 0; node < mMesh->NumberNodes(); ++node)
+    {
+        if (!mMesh->NodeHasGeometry(node))  continue;
+        BoundingBox nodeBounds = TransformBox(mMesh->GetNodeBoundingBox(node), absoluteMatrices[node]);
+        bounds = first ? nodeBounds : Union(bounds, nodeBounds);
+        first = false;
+    }
+    return bounds;
+}
+
+
+// Choose the coarsest level of detail whose error is no more than maxPixelError pixels on screen. The mesh errors are
+// in node space so are scaled up by the largest scale of the model
+unsigned int Model::SelectLod(const CVector3& viewPoint, float pixelsPerUnit, float maxPixelError)
+{
+    mLod = 0;
+    if (mMesh->NumLods() < 2)  return mLod;
+
+    // Distance to the nearest point of the bounds, so large models close to the camera keep full detail
+    BoundingBox bounds = WorldBoundingBox();
+    CVector3 nearest = { std::min(std::max(viewPoint.x, bounds.minimum.x), bounds.maximum.x),
+                         std::min(std::max(viewPoint.y, bounds.minimum.y), bounds.maximum.y),
+                         std::min(std::max(viewPoint.z, bounds.minimum.z), bounds.maximum.z) };
+    float distance = Length(nearest - viewPoint);
+    if (distance <= 0)  return mLod;
+
+    CVector3 scale = Scale();
+    float pixelsPerError = std::max(std::max(scale.x, scale.y), scale.z) * pixelsPerUnit / distance;
+    while (mLod + 1 < mMesh->NumLods() && mMesh->GetLodError(mLod + 1) * pixelsPerError <= maxPixelError)
+    {
+        ++mLod;
+    }
+    return mLod;
+}
+
+
+// UV units covered by a pixel at the nearest point of the model, see header
+float Model::UVsPerPixel(const CVector3& viewPoint, float pixelsPerUnit)
+{
+    BoundingBox bounds = WorldBoundingBox();
+    CVector3 nearest = { std::min(std::max(viewPoint.x, bounds.minimum.x), bounds.maximum.x),
+                         std::min(std::max(viewPoint.y, bounds.minimum.y), bounds.maximum.y),
+                         std::min(std::max(viewPoint.z, bounds.minimum.z), bounds.maximum.z) };
+    float distance = Length(nearest - viewPoint);
+    if (distance <= 0 || pixelsPerUnit <= 0)  return 0;
+
+    // The largest scale stretches the texture the most, so needs the most detail
+    CVector3 scale = Scale();
+    float pixelsPerLength = std::max(std::max(scale.x, scale.y), scale.z) * pixelsPerUnit / distance; // Per node space unit
+    return (pixelsPerLength > 0) ? mMesh->GetUVDensity() / pixelsPerLength : 0;
+}
+
+
+// World space occluder triangles, see header
+void Model::GetOccluderTriangles(std::vector<CVector3>& triangles)
+{
+    const CMatrix4x4* absoluteMatrices = gTransformSystem.WorldMatrices(mFirstNode);
+    for (unsigned int node = 0; node < mMesh->NumberNodes(); ++node)
+    {
+        const std::vector<CVector3>& nodeTriangles = mMesh->GetOccluderTriangles(node);
+        if (nodeTriangles.empty())  continue;
+        size_t first = triangles.size();
+        triangles.resize(first + nodeTriangles.size());
+        TransformPoints(nodeTriangles.data(), nodeTriangles.size(), absoluteMatrices[node], &triangles[first]);
+    }
 }
 
 
@@ -33,42 +207,53 @@ void Model::Render()
 void Model::Control(int node, float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode turnLeft, KeyCode turnRight,
                                                KeyCode turnCW, KeyCode turnCCW, KeyCode moveForward, KeyCode moveBackward)
 {
-    auto& matrix = mWorldMatrices[node]; // Use reference to node matrix to make code below more readable
+	if (!KeyHeld( turnUp ) && !KeyHeld( turnDown ) && !KeyHeld( turnLeft ) && !KeyHeld( turnRight ) &&
+	    !KeyHeld( turnCW ) && !KeyHeld( turnCCW ) && !KeyHeld( moveForward ) && !KeyHeld( moveBackward ))
+	{
+		return;
+	}
 
+	// Rotations are applied before the existing rotation, so they turn the node around its own axes
+	CQuaternion rotation = gTransformSystem.Rotation(mFirstNode + node);
 	if (KeyHeld( turnUp ))
 	{
-		matrix = MatrixRotationX(ROTATION_SPEED * frameTime) * matrix;
+		rotation = QuaternionRotationX(ROTATION_SPEED * frameTime) * rotation;
 	}
 	if (KeyHeld( turnDown ))
 	{
-		matrix = MatrixRotationX(-ROTATION_SPEED * frameTime) * matrix;
+		rotation = QuaternionRotationX(-ROTATION_SPEED * frameTime) * rotation;
 	}
 	if (KeyHeld( turnRight ))
 	{
-		matrix = MatrixRotationY(ROTATION_SPEED * frameTime) * matrix;
+		rotation = QuaternionRotationY(ROTATION_SPEED * frameTime) * rotation;
 	}
 	if (KeyHeld( turnLeft ))
 	{
-		matrix = MatrixRotationY(-ROTATION_SPEED * frameTime) * matrix;
+		rotation = QuaternionRotationY(-ROTATION_SPEED * frameTime) * rotation;
 	}
 	if (KeyHeld( turnCW ))
 	{
-		matrix = MatrixRotationZ(ROTATION_SPEED * frameTime) * matrix;
+		rotation = QuaternionRotationZ(ROTATION_SPEED * frameTime) * rotation;
 	}
 	if (KeyHeld( turnCCW ))
 	{
-		matrix = MatrixRotationZ(-ROTATION_SPEED * frameTime) * matrix;
+		rotation = QuaternionRotationZ(-ROTATION_SPEED * frameTime) * rotation;
 	}
+	rotation = Normalise(rotation); // Stop rounding errors building up over many frames
 
-	// Local Z movement - move in the direction of the Z axis, get axis from world matrix
-    CVector3 localZDir = Normalise(matrix.GetRow(2)); // normalise axis in case world matrix has scaling
+	// Local Z movement - move in the direction of the Z axis, the rotated Z axis is unit length whatever the scaling
+	CVector3 position = gTransformSystem.Position(mFirstNode + node);
+	CVector3 localZDir = Rotate({ 0, 0, 1 }, rotation);
 	if (KeyHeld( moveForward ))
 	{
-
-		matrix.SetRow(3, matrix.GetRow(3) + localZDir * MOVEMENT_SPEED * frameTime);
+		position += localZDir * MOVEMENT_SPEED * frameTime;
 	}
 	if (KeyHeld( moveBackward ))
 	{
-		matrix.SetRow(3, matrix.GetRow(3) - localZDir * MOVEMENT_SPEED * frameTime);
+		position -= localZDir * MOVEMENT_SPEED * frameTime;
 	}
+
+	gTransformSystem.SetRotation(mFirstNode + node, rotation);
+	gTransformSystem.SetPosition(mFirstNode + node, position);
+	++mVersion;
 }
@@ -1,12 +1,16 @@
 //--------------------------------------------------------------------------------------
 // Class encapsulating a model
 //--------------------------------------------------------------------------------------
-// Holds a pointer to a mesh as well as position, rotation and scaling, which are converted to a world matrix when required
-// This is more of a convenience class, the Mesh class does most of the difficult work.
+// Holds a pointer to a mesh and the index of its nodes in the transform system, which holds their position, rotation and
+// scaling and converts them to world matrices each frame (see TransformSystem). A model is just a light handle onto
+// those nodes. This is more of a convenience class, the Mesh class does most of the difficult work.
 
 #include "CVector3.h"
 #include "CMatrix4x4.h"
+#include "Bounds.h"
 #include "Input.h"
+#include "TransformSystem.h"
+#include "ObjectPool.h"
 
 #include <vector>
 
@@ -14,6 +18,8 @@
 #define _MODEL_H_INCLUDED_
 
 class Mesh;
+struct ID3D11Buffer;
+struct InstanceData; // See Common.h
 
 class Model
 {
@@ -23,12 +29,62 @@ public:
 	//-------------------------------------
 
     Model(Mesh* mesh, CVector3 position = { 0,0,0 }, CVector3 rotation = { 0,0,0 }, float scale = 1);
+    ~Model();
 
+    // Models own their nodes in the transform system, so can't be copied
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
 
-    // The render function simply passes this model's matrices over to Mesh:Render.
-    // All other per-frame constants must have been set already along with shaders, textures, samplers, states etc.
+
+    // The render function passes the absolute matrices from the transform system over to Mesh:Render, so
+    // gTransformSystem.Update must have been called since the model was last moved. All other per-frame constants must
+    // have been set already along with shaders, textures, samplers, states etc.
     void Render();
 
+    // Calculate the bone matrices of a skinned model from the transform system's matrices (see BonePalettes.h). Safe to
+    // call from job threads
+    void CalculateBonePalette(CMatrix4x4* palette);
+
+    // Skin a skinned model into vertex buffers of its own (see Mesh::Skin), so the passes that follow draw it with the
+    // shaders for non-skinned models. Call once per frame on the immediate context with the model's palette bound
+    // (see BonePalettes::Bind), before any rendering. Does nothing for rigid models or meshes that can't be pre-skinned.
+    // Changes the shaders
+    void Skin();
+
+    // Write the model's full detail geometry into a static batch in world space, see Mesh::BakeWorldGeometry
+    bool BakeWorldGeometry(ID3D11Buffer* vertices, unsigned int firstVertex, uint32_t indexBase, std::vector<uint32_t>& indices);
+
+    // Render several models that share the same mesh with instanced draw calls, one per node that has geometry, rather
+    // than a draw per model. Each model is tinted with the matching colour, and textured from the matching slice of the
+    // bound material array if slices are given (see MaterialArrays.h). Instanced shaders must be selected
+    static void RenderInstanced(Model* const models[], const CVector3 colours[], unsigned int numModels,
+                                const unsigned int textureSlices[] = nullptr);
+
+    // Write the instance data of each node of the model, tinted and textured as for RenderInstanced, one for each node of
+    // the mesh - for draws whose instances are chosen on the GPU (see GpuCuller.h)
+    void GetNodeInstances(const CVector3& colour, unsigned int textureSlice, InstanceData* instances);
+
+    // Test if any part of the model is inside the given frustum using the bounds of the mesh, so models that are off-screen
+    // can be skipped before doing any rendering work for them. Skinned models are always treated as visible
+    bool IsVisible(const Frustum& frustum);
+
+    // The world space axis-aligned box around all the parts of the model. For skinned models this only covers the default pose
+    BoundingBox WorldBoundingBox();
+
+    // Choose the mesh level of detail to render (see Mesh::NumLods) from how large its error would look on screen - the
+    // coarsest level whose error, seen from the nearest point of the model's bounds, is no more than maxPixelError pixels.
+    // pixelsPerUnit is the size in pixels of one unit at a distance of one, i.e. viewport width / (2 * tan(FOV / 2))
+    unsigned int SelectLod(const CVector3& viewPoint, float pixelsPerUnit, float maxPixelError);
+
+    // How many uv units one pixel covers on the model's surface at the nearest point of its bounds, from the mesh's uv
+    // density (see Mesh::GetUVDensity) - for choosing the texture mip levels the model needs (see TextureStreamer). 0 if
+    // the viewpoint is inside the bounds or the mesh has no uvs, which asks for full detail
+    float UVsPerPixel(const CVector3& viewPoint, float pixelsPerUnit);
+
+    // Add the world space triangles of the mesh's coarsest level of detail (see Mesh::GetOccluderTriangles) to the list,
+    // three corners each - for the software occlusion rasteriser
+    void GetOccluderTriangles(std::vector<CVector3>& triangles);
+
 
 	// Control a given node in the model using keys provided. Amount of motion performed depends on frame time
 	void Control(int node, float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode turnLeft, KeyCode turnRight,  
@@ -43,36 +99,55 @@ public:
     // All functions now accept a "node" parameter which specifies which node in the hierarchy to use. Defaults to 0, the root.
     // The hierarchy is stored in depth-first order
 
-	// Getters - model only stores matrices. Position, rotation and scale are extracted if requested.
-	CVector3 Position(int node = 0)  { return mWorldMatrices[node].GetRow(3); }         // Position is on bottom row of matrix
-	CVector3 Rotation(int node = 0)  { return mWorldMatrices[node].GetEulerAngles(); }  // Getting angles from a matrix is complex - see .cpp file
-	CVector3 Scale(int node = 0)     { return { Length(mWorldMatrices[node].GetRow(0)),
-                                                Length(mWorldMatrices[node].GetRow(1)), 
-                                                Length(mWorldMatrices[node].GetRow(2)) }; } // Scale is length of rows 0-2 in matrix
-	CMatrix4x4 WorldMatrix(int node = 0)  { return mWorldMatrices[node]; }
+	// Getters - the transform system stores position, rotation (as a quaternion) and scale. Each is relative to the parent
+	// node, the root's are in world space
+	CVector3 Position(int node = 0)  { return gTransformSystem.Position(mFirstNode + node); }
+	CVector3 Rotation(int node = 0)  { return MatrixRotation(gTransformSystem.Rotation(mFirstNode + node)).GetEulerAngles(); } // Getting angles from a matrix is complex - see .cpp file
+	CVector3 Scale(int node = 0)     { return gTransformSystem.Scale(mFirstNode + node); }
+	CMatrix4x4 WorldMatrix(int node = 0)  { return gTransformSystem.LocalMatrix(mFirstNode + node); }
 
-    // Setters - model only stores matricies , so if user sets position, rotation or scale, just update those aspects of the matrix
-	void SetPosition(CVector3 position, int node = 0)  { mWorldMatrices[node].SetRow(3, position); }
+	Mesh* GetMesh()  { return mMesh; }
 
+	// The level of detail used by Render and RenderInstanced (all models in an instanced draw use the level of the first)
+	unsigned int Lod()  { return mLod; }
+	void SetLod(unsigned int lod)  { mLod = lod; }
+
+	// Changes each time the model is moved, rotated or scaled (or any node is), so other code can tell when to update
+	// anything that depends on where the model is (e.g. see SceneTree)
+	unsigned int Version()  { return mVersion; }
+
+	// A static model isn't expected to move, so may be merged with others into world space batches (see StaticBatches.h).
+	// Moving one still works, but the batches are baked again
+	bool IsStatic()  { return mStatic; }
+	void SetStatic(bool isStatic)  { mStatic = isStatic;  ++mVersion; }
+
+    // Setters - position, rotation and scale are stored separately so each can be set without affecting the others
+	// Each setter marks the node as changed, so its absolute matrix (and those of its children) is recalculated on the
+	// next gTransformSystem.Update
+	void SetPosition(CVector3 position, int node = 0)  { gTransformSystem.SetPosition(mFirstNode + node, position);  ++mVersion; }
+
+	// Rotation angles are applied Z first, then X, then Y
 	void SetRotation(CVector3 rotation, int node = 0)
     {
-        // To put rotation angles into a matrix we need to build the matrix from scratch to make sure we retain existing scaling and position
-        mWorldMatrices[node] = MatrixScaling(Scale(node)) *
-                               MatrixRotationZ(rotation.z) * MatrixRotationX(rotation.x) * MatrixRotationY(rotation.y) *
-                               MatrixTranslation(Position(node));
+        gTransformSystem.SetRotation(mFirstNode + node, QuaternionFromEulerAngles(rotation));
+        ++mVersion;
     }
 
 	// Two ways to set scale: x,y,z separately, or all to the same value
-    // To set scale without affecting rotation, normalise each row, then multiply it by the scale value.
-	void SetScale(CVector3 scale, int node = 0)
-    {
-        mWorldMatrices[node].SetRow(0, Normalise(mWorldMatrices[node].GetRow(0)) * scale.x); 
-        mWorldMatrices[node].SetRow(1, Normalise(mWorldMatrices[node].GetRow(1)) * scale.y); 
-        mWorldMatrices[node].SetRow(2, Normalise(mWorldMatrices[node].GetRow(2)) * scale.z); 
-    }
+	void SetScale(CVector3 scale, int node = 0)  { gTransformSystem.SetScale(mFirstNode + node, scale);  ++mVersion; }
 	void SetScale(float scale)  { SetScale({ scale, scale, scale });}
 
-    void SetWorldMatrix(CMatrix4x4 matrix, int node = 0)  { mWorldMatrices[node] = matrix; }
+    // Any shearing in the matrix is lost, the transform system only holds position, rotation and scale
+    void SetWorldMatrix(CMatrix4x4 matrix, int node = 0)  { gTransformSystem.SetMatrix(mFirstNode + node, matrix);  ++mVersion; }
+
+	// Set the transforms of count nodes from the given one, from a separate array of each component - e.g. an animated
+	// pose (see Animation.h)
+	void SetNodeTransforms(int node, unsigned int count, const float* const position[3], const float* const rotation[4],
+	                       const float* const scale[3])
+	{
+		gTransformSystem.SetTransforms(mFirstNode + node, count, position, rotation, scale);
+		++mVersion;
+	}
 
 
 	//-------------------------------------
@@ -81,11 +156,22 @@ public:
 private:
     Mesh* mMesh;
 
-	// World matrices for the model
-    // Now that meshes have multiple parts, we need multiple matrices. The root matrix (the first one) is the world matrix
-    // for the entire model. The remaining matrices are relative to their parent part. The hierarchy is defined in the mesh (nodes)
-	std::vector<CMatrix4x4> mWorldMatrices;
+	// Index of the model's first node in gTransformSystem, the others follow it in the same order as the mesh nodes. The
+	// root node is the world transform for the entire model, the remaining nodes are relative to their parent part
+	unsigned int mFirstNode;
+	unsigned int mVersion = 0;
+	bool         mStatic  = false;
+
+	unsigned int mLod = 0;
+
+	// The vertices written by Skin, one buffer per sub-mesh. Empty until the first Skin, or if the model isn't pre-skinned
+	std::vector<ID3D11Buffer*> mSkinnedVertices;
+	bool mSkinningFailed = false; // Buffers couldn't be created, don't try again every frame
 };
 
 
+// All the models, created with gModelPool.Create(mesh, ...) (see ObjectPool.h)
+extern ObjectPool<Model> gModelPool;
+
+
 #endif //_MODEL_H_INCLUDED_
@@ -0,0 +1,194 @@
+//--------------------------------------------------------------------------------------
+// Object pool with generational handles
+//--------------------------------------------------------------------------------------
+// Holds objects of one type in chunks of contiguous slots rather than allocating each one on the heap, so objects made
+// together sit together in memory and creating or destroying one is a free-list push or pop. Objects never move once
+// created - the scene, scene tree and draw lists keep plain pointers to models and meshes - and a dense list of the live
+// objects is kept for iterating over them without visiting the empty slots. Clear destroys every object at once.
+//
+// Code that may outlive an object keeps a PoolHandle instead of its pointer. Each slot counts the objects it has held,
+// so a handle to a destroyed object is recognised as stale (Get returns null) even after its slot has been reused.
+//
+// Create and Destroy may be called on several threads at once, e.g. meshes created by the asset loader's jobs. The
+// object is constructed outside the lock. Get, Objects and Clear must not run while another thread is creating or
+// destroying objects
+
+#ifndef _OBJECT_POOL_H_INCLUDED_
+#define _OBJECT_POOL_H_INCLUDED_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+// Refers to an object in an ObjectPool. The default handle refers to nothing
+struct PoolHandle
+{
+	uint32_t index      = 0;
+	uint32_t generation = 0; // Live objects' generations start at 1
+
+	explicit operator bool() const  { return generation != 0; }
+};
+
+inline bool operator==(const PoolHandle& a, const PoolHandle& b)  { return a.index == b.index && a.generation == b.generation; }
+inline bool operator!=(const PoolHandle& a, const PoolHandle& b)  { return !(a == b); }
+
+
+template <typename T>
+class ObjectPool
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	ObjectPool() = default;
+	~ObjectPool()  { Release(); }
+
+	ObjectPool(const ObjectPool&) = delete;
+	ObjectPool& operator=(const ObjectPool&) = delete;
+
+
+	// Construct a new object in a free slot with the given constructor arguments. Any exception from the constructor is
+	// passed on, with the slot freed again
+	template <typename... Args>
+	T* Create(Args&&... args)
+	{
+		uint32_t index;
+		Slot* slot;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mFree.empty())
+			{
+				uint32_t first = static_cast<uint32_t>(mChunks.size()) * CHUNK_SIZE;
+				mChunks.push_back(std::unique_ptr<Slot[]>(new Slot[CHUNK_SIZE]));
+				for (uint32_t i = CHUNK_SIZE; i-- > 0; )
+				{
+					mChunks.back()[i].index = first + i;
+					mFree.push_back(first + i);
+				}
+			}
+			index = mFree.back();
+			mFree.pop_back();
+			slot = &SlotAt(index);
+		}
+
+		T* object;
+		try
+		{
+			object = new (&slot->storage) T(std::forward<Args>(args)...);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mFree.push_back(index);
+			throw;
+		}
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		++slot->generation;
+		slot->live   = true;
+		slot->object = static_cast<uint32_t>(mObjects.size());
+		mObjects.push_back(object);
+		return object;
+	}
+
+	// Destroy the object a handle refers to. Returns false if the handle is stale or null
+	bool Destroy(PoolHandle handle)
+	{
+		T* object = Get(handle);
+		if (object == nullptr)  return false;
+		Destroy(object);
+		return true;
+	}
+
+	// Destroy an object made by this pool
+	void Destroy(T* object)
+	{
+		object->~T();
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		Slot& slot = SlotOf(object);
+		slot.live = false;
+		mObjects[slot.object] = mObjects.back(); // Keeps the live list dense, the last object takes this one's place
+		SlotOf(mObjects[slot.object]).object = slot.object;
+		mObjects.pop_back();
+		mFree.push_back(slot.index);
+	}
+
+	// Destroy all the objects. The slots are kept for the next objects
+	void Clear()
+	{
+		while (!mObjects.empty())  Destroy(mObjects.back());
+	}
+
+	// Destroy all the objects and free the slots. Outstanding handles stay stale
+	void Release()
+	{
+		Clear();
+		mFree.clear();
+		mChunks.clear();
+	}
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// The object a handle refers to, or null if it has been destroyed
+	T* Get(PoolHandle handle)
+	{
+		if (handle.index >= mChunks.size() * CHUNK_SIZE)  return nullptr;
+		Slot& slot = SlotAt(handle.index);
+		return (slot.live && slot.generation == handle.generation ? reinterpret_cast<T*>(&slot.storage) : nullptr);
+	}
+
+	// A handle to a live object made by this pool
+	PoolHandle Handle(const T* object)
+	{
+		const Slot& slot = SlotOf(object);
+		PoolHandle handle;
+		handle.index      = slot.index;
+		handle.generation = slot.generation;
+		return handle;
+	}
+
+	// The live objects, in no particular order (destroying an object moves the last one into its place)
+	const std::vector<T*>& Objects()  { return mObjects; }
+
+	int Size()      { return static_cast<int>(mObjects.size()); }
+	int Capacity()  { return static_cast<int>(mChunks.size() * CHUNK_SIZE); }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const uint32_t CHUNK_SIZE = 64; // Slots added at a time
+
+	// The object is first, so its address is the slot's
+	struct Slot
+	{
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+		uint32_t index      = 0;     // Of this slot in the pool
+		uint32_t generation = 0;     // Objects this slot has held
+		uint32_t object     = 0;     // Index in mObjects while live
+		bool     live       = false;
+	};
+
+	Slot& SlotAt(uint32_t index)  { return mChunks[index / CHUNK_SIZE][index % CHUNK_SIZE]; }
+	static Slot& SlotOf(const T* object)  { return *reinterpret_cast<Slot*>(const_cast<T*>(object)); }
+
+
+	std::vector<std::unique_ptr<Slot[]>> mChunks; // Never move, so objects can be constructed outside the lock
+	std::vector<uint32_t>                mFree;    // Slot indices, the most recently freed last
+	std::vector<T*>                      mObjects; // Live objects
+	std::mutex                           mMutex;
+};
+
+
+#endif //_OBJECT_POOL_H_INCLUDED_
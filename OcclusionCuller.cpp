@@ -0,0 +1,338 @@
+//--------------------------------------------------------------------------------------
+// Occlusion culling
+//--------------------------------------------------------------------------------------
+// See OcclusionCuller.h for an overview
+
+#include "OcclusionCuller.h"
+#include "Model.h"
+#include "Mesh.h"
+#include "Shader.h"
+#include "State.h"
+#include "StateCache.h"
+#include "InputLayoutCache.h"
+#include "ConstantBufferRing.h"
+#include "CpuProfiler.h"
+#include "ResourceRegistry.h"
+#include "Common.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+OcclusionCuller gOcclusionCuller;
+
+const float OcclusionCuller::BOX_EXPANSION = 0.01f;
+const float OcclusionCuller::MIN_W         = 0.001f;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+void OcclusionCuller::BeginFrame(const CMatrix4x4& viewProjection, const CVector3& viewPoint, float nearClip)
+{
+	++mFrame;
+	mViewProjection = viewProjection;
+	mViewPoint = viewPoint;
+	mNearMargin = 2 * nearClip; // Far enough to cover the corners of the near plane as well
+	mCandidates.clear();
+	mNumSoftwareCulled = 0;
+	mNumQueryCulled = 0;
+	mNumPredicated = 0;
+
+	// Collect the results that are ready. DONOTFLUSH so this never makes the GPU start work early, and any not ready are
+	// just tried again next frame
+	for (auto entry = mQueries.begin(); entry != mQueries.end();)
+	{
+		Queries& queries = entry->second;
+		for (int i = 0; i < QUERIES_PER_MODEL; ++i)
+		{
+			if (queries.issuedFrame[i] == 0)  continue;
+			BOOL anyPassed;
+			if (gD3DContext->GetData(queries.predicates[i], &anyPassed, sizeof(anyPassed), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+			{
+				if (queries.issuedFrame[i] > queries.resultFrame)
+				{
+					queries.resultFrame = queries.issuedFrame[i];
+					queries.occluded = !anyPassed;
+				}
+				queries.issuedFrame[i] = 0;
+			}
+		}
+
+		// Models that have gone (or not been in view for a while) give their queries back
+		if (mFrame - queries.testedFrame > UNUSED_FRAMES)
+		{
+			for (auto& predicate : queries.predicates)  if (predicate)  predicate->Release();
+			entry = mQueries.erase(entry);
+		}
+		else
+		{
+			++entry;
+		}
+	}
+}
+
+
+void OcclusionCuller::RasteriseOccluders()
+{
+	CPU_PROFILE_SCOPE("OcclusionCuller::RasteriseOccluders");
+
+	mTriangles.clear();
+	for (auto& occluder : mOccluders)  occluder->GetOccluderTriangles(mTriangles);
+	mAnyOccluders = !mTriangles.empty();
+	if (!mAnyOccluders)  return;
+
+	mDepth.assign(DEPTH_WIDTH * DEPTH_HEIGHT, 1.0f);
+	for (size_t i = 0; i + 2 < mTriangles.size(); i += 3)
+	{
+		// Triangles crossing the camera plane are left out rather than clipped, leaving out occluders is always safe
+		CVector3 a, b, c;
+		if (Project(mTriangles[i], a) && Project(mTriangles[i + 1], b) && Project(mTriangles[i + 2], c))
+		{
+			RasteriseTriangle(a, b, c);
+		}
+	}
+}
+
+
+bool OcclusionCuller::IsOccluded(Model* model, ID3D11Predicate*& predicate)
+{
+	predicate = nullptr;
+	if (model->GetMesh()->HasBones())  return false;
+
+	BoundingBox box = model->WorldBoundingBox();
+	if (std::find(mOccluders.begin(), mOccluders.end(), model) == mOccluders.end() && BoxOccluded(box))
+	{
+		++mNumSoftwareCulled;
+		return true;
+	}
+
+	// With the camera inside the box, or near enough that the near plane cuts its front faces away, only faces behind the
+	// model would be drawn and the model may well be in view
+	BoundingBox queryBox = QueryBox(box);
+	if (mViewPoint.x >= queryBox.minimum.x - mNearMargin && mViewPoint.x <= queryBox.maximum.x + mNearMargin &&
+	    mViewPoint.y >= queryBox.minimum.y - mNearMargin && mViewPoint.y <= queryBox.maximum.y + mNearMargin &&
+	    mViewPoint.z >= queryBox.minimum.z - mNearMargin && mViewPoint.z <= queryBox.maximum.z + mNearMargin)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mCandidates.push_back(model);
+	Queries& queries = mQueries[model];
+	queries.testedFrame = mFrame;
+
+	// A recent result that is back from the GPU culls the model outright. Otherwise draw it predicated on the query from
+	// last frame, unless that result is already known
+	if (queries.resultFrame > 0 && queries.occluded && mFrame - queries.resultFrame <= MAX_RESULT_AGE)
+	{
+		++mNumQueryCulled;
+		return true;
+	}
+	if (queries.latest >= 0 && queries.latestFrame + 1 == mFrame && queries.resultFrame < queries.latestFrame)
+	{
+		predicate = queries.predicates[queries.latest];
+		++mNumPredicated;
+	}
+	return false;
+}
+
+
+bool OcclusionCuller::IssueQueries(ID3D11DepthStencilView* depthStencil, const D3D11_VIEWPORT& viewport)
+{
+	mNumQueried = 0;
+	if (mCandidates.empty() || mQueriesFailed)  return !mQueriesFailed;
+
+	if (mBoxVertices == nullptr)
+	{
+		// The twelve triangles of a unit cube, both windings are drawn since culling is off
+		static const int corners[36] = { 0,1,3, 0,3,2, 4,6,7, 4,7,5, 0,4,5, 0,5,1, 2,3,7, 2,7,6, 0,2,6, 0,6,4, 1,5,7, 1,7,3 };
+		BasicVertex vertices[36] = {};
+		for (int i = 0; i < 36; ++i)
+		{
+			vertices[i].position = { (corners[i] & 1) ? 1.0f : 0.0f, (corners[i] & 2) ? 1.0f : 0.0f, (corners[i] & 4) ? 1.0f : 0.0f };
+		}
+
+		D3D11_BUFFER_DESC bufferDesc = {};
+		bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		bufferDesc.ByteWidth = sizeof(vertices);
+		D3D11_SUBRESOURCE_DATA initData = { vertices, 0, 0 };
+		if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, &initData, &mBoxVertices)))
+		{
+			mBoxVertices = nullptr;
+			mQueriesFailed = true;
+			gLastError = "Error creating occlusion query box";
+			return false;
+		}
+		gResourceRegistry.Track(mBoxVertices);
+	}
+
+	// Depth test only against the depth buffer the opaque models were just drawn to
+	gD3DContext->OMSetRenderTargets(0, nullptr, depthStencil);
+	gD3DContext->RSSetViewports(1, &viewport);
+	gStateCache.SetConstantBuffer(PER_FRAME_CONSTANTS_SLOT, gPerFrameConstantBuffer);
+	gStateCache.VSSetShader(gDepthOnlyVertexShader, nullptr, 0);
+	gStateCache.PSSetShader(nullptr, nullptr, 0);
+	gStateCache.GSSetShader(nullptr, nullptr, 0);
+	gStateCache.OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
+	gStateCache.OMSetDepthStencilState(gDepthReadOnlyState, 0);
+	gStateCache.RSSetState(gCullNoneState);
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	const D3D11_INPUT_ELEMENT_DESC boxLayout[] =
+	{
+		{ "position", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,  0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "normal",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "uv",       0, DXGI_FORMAT_R32G32_FLOAT,    0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
+	UINT stride = sizeof(BasicVertex);
+	UINT offset = 0;
+	gStateCache.IASetVertexBuffers(0, 1, &mBoxVertices, &stride, &offset);
+	gStateCache.IASetInputLayout(gInputLayoutCache.Get(boxLayout, 3));
+
+	bool ok = true;
+	for (auto& model : mCandidates)
+	{
+		Queries& queries = mQueries[model];
+		int next = (queries.latest + 1) % QUERIES_PER_MODEL;
+		if (queries.predicates[next] == nullptr)
+		{
+			D3D11_QUERY_DESC queryDesc = { D3D11_QUERY_OCCLUSION_PREDICATE, D3D11_QUERY_MISC_PREDICATEHINT };
+			if (FAILED(gD3DDevice->CreatePredicate(&queryDesc, &queries.predicates[next])))
+			{
+				queries.predicates[next] = nullptr;
+				mQueriesFailed = true;
+				gLastError = "Error creating occlusion query";
+				ok = false;
+				break;
+			}
+		}
+
+		BoundingBox box = QueryBox(model->WorldBoundingBox());
+		gPerModelConstants.worldMatrix = MatrixScaling(box.maximum - box.minimum) * MatrixTranslation(box.minimum);
+		BindConstants(PER_MODEL_CONSTANTS_SLOT, gPerModelConstants, gPerModelConstantBuffer);
+
+		gD3DContext->Begin(queries.predicates[next]);
+		gD3DContext->Draw(36, 0);
+		gD3DContext->End(queries.predicates[next]);
+		queries.latest = next;
+		queries.latestFrame = mFrame;
+		queries.issuedFrame[next] = mFrame;
+		++mNumQueried;
+	}
+	return ok;
+}
+
+
+void OcclusionCuller::Release()
+{
+	for (auto& entry : mQueries)
+	{
+		for (auto& predicate : entry.second.predicates)  if (predicate)  predicate->Release();
+	}
+	mQueries.clear();
+	mCandidates.clear();
+	if (mBoxVertices)  mBoxVertices->Release();
+	mBoxVertices = nullptr;
+	mQueriesFailed = false;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+bool OcclusionCuller::Project(const CVector3& point, CVector3& projected)
+{
+	const CMatrix4x4& m = mViewProjection;
+	float x = point.x * m.e00 + point.y * m.e10 + point.z * m.e20 + m.e30;
+	float y = point.x * m.e01 + point.y * m.e11 + point.z * m.e21 + m.e31;
+	float z = point.x * m.e02 + point.y * m.e12 + point.z * m.e22 + m.e32;
+	float w = point.x * m.e03 + point.y * m.e13 + point.z * m.e23 + m.e33;
+	if (w < MIN_W)  return false;
+
+	projected.x = (x / w * 0.5f + 0.5f) * DEPTH_WIDTH;
+	projected.y = (0.5f - y / w * 0.5f) * DEPTH_HEIGHT;
+	projected.z = z / w;
+	return true;
+}
+
+
+// Edge functions tested at pixel centres, with the depth interpolated across the triangle in screen space (depth is
+// linear in screen space after the divide by w)
+void OcclusionCuller::RasteriseTriangle(const CVector3& a, const CVector3& b, const CVector3& c)
+{
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (std::abs(area) < 1e-6f)  return;
+
+	int minX = std::max(static_cast<int>(std::floor(std::min({ a.x, b.x, c.x }))), 0);
+	int maxX = std::min(static_cast<int>(std::ceil (std::max({ a.x, b.x, c.x }))), DEPTH_WIDTH - 1);
+	int minY = std::max(static_cast<int>(std::floor(std::min({ a.y, b.y, c.y }))), 0);
+	int maxY = std::min(static_cast<int>(std::ceil (std::max({ a.y, b.y, c.y }))), DEPTH_HEIGHT - 1);
+	if (minX > maxX || minY > maxY)  return;
+
+	float inverseArea = 1.0f / area;
+	for (int py = minY; py <= maxY; ++py)
+	{
+		float y = py + 0.5f;
+		float* row = &mDepth[py * DEPTH_WIDTH];
+		for (int px = minX; px <= maxX; ++px)
+		{
+			float x = px + 0.5f;
+			float wa = ((b.x - x) * (c.y - y) - (b.y - y) * (c.x - x)) * inverseArea;
+			float wb = ((c.x - x) * (a.y - y) - (c.y - y) * (a.x - x)) * inverseArea;
+			float wc = 1.0f - wa - wb;
+			if (wa < 0 || wb < 0 || wc < 0)  continue;
+
+			float depth = wa * a.z + wb * b.z + wc * c.z;
+			if (depth < row[px])  row[px] = depth;
+		}
+	}
+}
+
+
+// The box is hidden if its nearest point is behind the occluders at every pixel of its screen rectangle. The rectangle
+// is grown by a pixel since the occluders only cover the pixel centres they contain
+bool OcclusionCuller::BoxOccluded(const BoundingBox& box)
+{
+	if (!mAnyOccluders)  return false;
+
+	float minX = static_cast<float>(DEPTH_WIDTH), maxX = 0, minY = static_cast<float>(DEPTH_HEIGHT), maxY = 0;
+	float nearest = 1.0f;
+	for (int i = 0; i < 8; ++i)
+	{
+		CVector3 corner = { (i & 1) ? box.maximum.x : box.minimum.x,
+		                    (i & 2) ? box.maximum.y : box.minimum.y,
+		                    (i & 4) ? box.maximum.z : box.minimum.z };
+		CVector3 projected;
+		if (!Project(corner, projected))  return false; // Reaches the camera plane
+		minX = std::min(minX, projected.x);  maxX = std::max(maxX, projected.x);
+		minY = std::min(minY, projected.y);  maxY = std::max(maxY, projected.y);
+		nearest = std::min(nearest, projected.z);
+	}
+
+	int left   = std::max(static_cast<int>(std::floor(minX)) - 1, 0);
+	int right  = std::min(static_cast<int>(std::ceil (maxX)) + 1, DEPTH_WIDTH - 1);
+	int top    = std::max(static_cast<int>(std::floor(minY)) - 1, 0);
+	int bottom = std::min(static_cast<int>(std::ceil (maxY)) + 1, DEPTH_HEIGHT - 1);
+	if (left > right || top > bottom)  return false; // Off-screen, left to frustum culling
+
+	for (int py = top; py <= bottom; ++py)
+	{
+		const float* row = &mDepth[py * DEPTH_WIDTH];
+		for (int px = left; px <= right; ++px)
+		{
+			if (row[px] >= nearest)  return false;
+		}
+	}
+	return true;
+}
+
+
+BoundingBox OcclusionCuller::QueryBox(const BoundingBox& box)
+{
+	CVector3 expansion = (box.maximum - box.minimum) * BOX_EXPANSION;
+	return { box.minimum - expansion, box.maximum + expansion };
+}
@@ -0,0 +1,143 @@
+//--------------------------------------------------------------------------------------
+// Occlusion culling
+//--------------------------------------------------------------------------------------
+// Skips models hidden behind others, after frustum culling. Two tests are used:
+//
+// - A software test against a small CPU depth buffer, into which the coarse occluders (the hills and the crate) are
+//   rasterised at the start of each frame. A model is culled if its bounding box is behind the occluders over the whole of
+//   its screen rectangle. No GPU work and no latency, but only covers the chosen occluders.
+//
+// - Hardware occlusion queries. After the opaque models are drawn, the bounding box of each model that was tested is
+//   drawn depth test only into the real depth buffer inside an occlusion predicate query. Next frame that model's draw is
+//   predicated on the query (ID3D11DeviceContext::SetPredication) so the GPU skips it if none of the box passed, with no
+//   wait for the result. Results the CPU has read back without stalling (they are never waited for) cull the model before
+//   any rendering work is done for it, but only while they are recent. Each model cycles through a few queries so the
+//   one the GPU is still working on is never reused.
+//
+// Results are a frame behind the view, so a model coming into view can appear a frame late. Skinned models are never
+// tested since their bounds don't hold once animated
+
+#ifndef _OCCLUSION_CULLER_H_INCLUDED_
+#define _OCCLUSION_CULLER_H_INCLUDED_
+
+#include "CMatrix4x4.h"
+#include "CVector3.h"
+#include "Bounds.h"
+
+#include <d3d11.h>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class Model;
+
+
+class OcclusionCuller
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~OcclusionCuller()  { Release(); }
+
+	// The models rasterised into the CPU depth buffer each frame. Best kept to a few large models with simple meshes, only
+	// their coarsest level of detail is used (see Mesh::GetOccluderTriangles)
+	void SetOccluders(const std::vector<Model*>& occluders)  { mOccluders = occluders; }
+
+	// Start a frame viewed from the given camera. Collects any query results the GPU has finished without waiting. Call on
+	// the main thread before any other use this frame
+	void BeginFrame(const CMatrix4x4& viewProjection, const CVector3& viewPoint, float nearClip);
+
+	// Rasterise the occluders into the CPU depth buffer. Can be run as a job, and must be finished before IsOccluded is used
+	void RasteriseOccluders();
+
+	// Test if a model is hidden this frame. If not, predicate is set to the query the draw should be predicated on (null for
+	// none). Safe to call from several threads at once. The model's bounding box is queried again in IssueQueries
+	bool IsOccluded(Model* model, ID3D11Predicate*& predicate);
+
+	// Draw the bounding boxes of the models tested this frame inside occlusion queries. Call on the main thread once the
+	// opaque models have been executed, with the depth buffer they were drawn to and its viewport. Leaves only the depth
+	// buffer bound. Returns false if queries can't be created (reason in gLastError), the models are just not queried then
+	bool IssueQueries(ID3D11DepthStencilView* depthStencil, const D3D11_VIEWPORT& viewport);
+
+	void Release();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// Models culled by each test in the last frame, and those drawn predicated on a query
+	int NumSoftwareCulled()  { return mNumSoftwareCulled; }
+	int NumQueryCulled()     { return mNumQueryCulled;    }
+	int NumPredicated()      { return mNumPredicated;     }
+	int NumQueried()         { return mNumQueried;        }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const int   DEPTH_WIDTH  = 256;      // Size of the CPU depth buffer, much coarser than the screen
+	static const int   DEPTH_HEIGHT = 128;
+	static const int   QUERIES_PER_MODEL = 3;   // Enough that a query still in flight on the GPU isn't reused
+	static const int   MAX_RESULT_AGE    = 2;   // Frames a read back result is used to cull on the CPU
+	static const int   UNUSED_FRAMES     = 120; // Frames a model goes untested before its queries are released
+	static const float BOX_EXPANSION;           // Queried boxes are this much larger than the model bounds (relative), so
+	                                            // the model's own surface never hides its box
+	static const float MIN_W;                   // Points nearer the camera plane than this count as visible
+
+	struct Queries
+	{
+		ID3D11Predicate* predicates[QUERIES_PER_MODEL] = {};
+		UINT64           issuedFrame[QUERIES_PER_MODEL] = {}; // 0 if not pending
+		int              latest = -1;     // Last query issued
+		UINT64           latestFrame = 0; // --"--
+		UINT64           resultFrame = 0; // Frame of the newest query read back
+		bool             occluded = false; // Its result
+		UINT64           testedFrame = 0;  // Last frame the model was tested
+	};
+
+	// Project a world point to the CPU depth buffer, x and y in pixels and z the depth. Returns false if too near the camera
+	bool Project(const CVector3& point, CVector3& projected);
+
+	// Rasterise a triangle with the corners already projected, keeping the nearest depth
+	void RasteriseTriangle(const CVector3& a, const CVector3& b, const CVector3& c);
+
+	// Test if the given world box is behind the CPU depth buffer everywhere it covers
+	bool BoxOccluded(const BoundingBox& box);
+
+	// The given world box with the query expansion added
+	BoundingBox QueryBox(const BoundingBox& box);
+
+
+	std::vector<Model*> mOccluders;
+	CMatrix4x4          mViewProjection;
+	CVector3            mViewPoint;
+	float               mNearMargin = 0; // Boxes this near the camera are never queried
+	UINT64              mFrame = 0;
+
+	std::vector<float>    mDepth;     // DEPTH_WIDTH * DEPTH_HEIGHT, 1 is far
+	std::vector<CVector3> mTriangles; // Occluder triangles, reused each frame
+	bool                  mAnyOccluders = false;
+
+	std::mutex                          mMutex;      // Guards the queries and candidates while models are tested
+	std::unordered_map<Model*, Queries> mQueries;
+	std::vector<Model*>                 mCandidates; // Models tested this frame, to query
+
+	ID3D11Buffer* mBoxVertices = nullptr; // Unit cube 0..1, triangle list
+	bool          mQueriesFailed = false; // Don't try to create them again every frame
+
+	std::atomic<int> mNumSoftwareCulled{ 0 };
+	std::atomic<int> mNumQueryCulled{ 0 };
+	std::atomic<int> mNumPredicated{ 0 };
+	int              mNumQueried = 0;
+};
+
+
+extern OcclusionCuller gOcclusionCuller;
+
+
+#endif //_OCCLUSION_CULLER_H_INCLUDED_
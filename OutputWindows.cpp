@@ -0,0 +1,243 @@
+//--------------------------------------------------------------------------------------
+// Output windows
+//--------------------------------------------------------------------------------------
+
+#include "OutputWindows.h"
+#include "Direct3DSetup.h"
+#include "Common.h"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+
+
+OutputWindows gOutputWindows;
+
+const wchar_t OUTPUT_WINDOW_CLASS[] = L"OutputWindowClass";
+
+
+// Collect the rectangles of the displays other than the given one
+BOOL CALLBACK AddOtherMonitor(HMONITOR monitor, HDC, LPRECT rect, LPARAM data)
+{
+	auto monitors = reinterpret_cast<std::pair<HMONITOR, std::vector<RECT>>*>(data);
+	if (monitor != monitors->first)  monitors->second.push_back(*rect);
+	return TRUE;
+}
+
+
+// Open the windows on the other displays, or beside the main window
+bool OutputWindows::Open(HINSTANCE instance, HWND mainWindow, int count)
+{
+	mMainWindow = mainWindow;
+	count = std::max(0, std::min(count, MAX_WINDOWS));
+	if (count == 0)  return true;
+
+	WNDCLASSEX wcex = {};
+	wcex.cbSize = sizeof(WNDCLASSEX);
+	wcex.style = CS_HREDRAW | CS_VREDRAW;
+	wcex.lpfnWndProc = WindowProc;
+	wcex.hInstance = instance;
+	wcex.hCursor = LoadCursor(nullptr, IDC_ARROW);
+	wcex.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+	wcex.lpszClassName = OUTPUT_WINDOW_CLASS;
+	if (!RegisterClassEx(&wcex))
+	{
+		gLastError = "Error registering the output window class";
+		return false;
+	}
+
+	std::pair<HMONITOR, std::vector<RECT>> monitors;
+	monitors.first = MonitorFromWindow(mainWindow, MONITOR_DEFAULTTOPRIMARY);
+	EnumDisplayMonitors(nullptr, nullptr, AddOtherMonitor, reinterpret_cast<LPARAM>(&monitors));
+
+	RECT mainClient;
+	GetClientRect(mainWindow, &mainClient);
+	for (int i = 0; i < count; ++i)
+	{
+		// Borderless over a whole display if there is one left, otherwise a window the size of the main one's. Neither
+		// takes the focus when clicked
+		DWORD style = WS_OVERLAPPEDWINDOW;
+		RECT  rect  = mainClient;
+		bool  ownDisplay = (i < static_cast<int>(monitors.second.size()));
+		if (ownDisplay)
+		{
+			style = WS_POPUP;
+			rect  = monitors.second[i];
+		}
+		else
+		{
+			AdjustWindowRect(&rect, style, FALSE);
+		}
+
+		Window& window = mWindows[i];
+		std::wstring title = L"Direct3D 11 - Output " + std::to_wstring(i + 1);
+		window.hWnd = CreateWindowEx(WS_EX_NOACTIVATE | WS_EX_APPWINDOW, OUTPUT_WINDOW_CLASS, title.c_str(), style,
+		                             ownDisplay ? rect.left : CW_USEDEFAULT, ownDisplay ? rect.top : CW_USEDEFAULT,
+		                             rect.right - rect.left, rect.bottom - rect.top, nullptr, nullptr, instance, nullptr);
+		if (window.hWnd == nullptr)
+		{
+			gLastError = "Error creating output window";
+			Close();
+			return false;
+		}
+		SetWindowLongPtr(window.hWnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(&window));
+
+		RECT client;
+		GetClientRect(window.hWnd, &client);
+		window.clientWidth  = client.right - client.left;
+		window.clientHeight = client.bottom - client.top;
+		ShowWindow(window.hWnd, SW_SHOWNOACTIVATE);
+		UpdateWindow(window.hWnd);
+		++mNumWindows;
+	}
+	return true;
+}
+
+
+// Destroy the windows
+void OutputWindows::Close()
+{
+	for (int i = 0; i < mNumWindows; ++i)
+	{
+		if (mWindows[i].hWnd != nullptr)  DestroyWindow(mWindows[i].hWnd);
+		mWindows[i].hWnd = nullptr;
+	}
+	mNumWindows = 0;
+}
+
+
+// The messages of the output windows, resizing is done by the render thread in Update
+LRESULT CALLBACK OutputWindows::WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+	Window* window = reinterpret_cast<Window*>(GetWindowLongPtr(hWnd, GWLP_USERDATA));
+	switch (message)
+	{
+	case WM_PAINT:
+	{
+		PAINTSTRUCT ps;
+		BeginPaint(hWnd, &ps);
+		EndPaint(hWnd, &ps);
+		return 0;
+	}
+
+	case WM_CLOSE: // The windows go with the main window
+		PostMessage(gOutputWindows.mMainWindow, WM_CLOSE, 0, 0);
+		return 0;
+
+	case WM_MOUSEACTIVATE: // Keep the focus on the main window
+		return MA_NOACTIVATE;
+
+	case WM_SIZE:
+		if (window == nullptr)  break;
+		window->minimised = (wParam == SIZE_MINIMIZED);
+		if (wParam != SIZE_MINIMIZED)
+		{
+			window->clientWidth  = LOWORD(lParam);
+			window->clientHeight = HIWORD(lParam);
+		}
+		return 0;
+	}
+	return DefWindowProc(hWnd, message, wParam, lParam);
+}
+
+
+// Create the swap chains on the shared device
+bool OutputWindows::CreateSwapChains()
+{
+	for (int i = 0; i < mNumWindows; ++i)
+	{
+		Window& window = mWindows[i];
+		window.width  = std::max(window.clientWidth.load(),  1);
+		window.height = std::max(window.clientHeight.load(), 1);
+		window.swapChain = CreateWindowSwapChain(window.hWnd, window.width, window.height);
+		if (window.swapChain == nullptr)  return false;
+
+		// The output windows handle their own full screen, DXGI's Alt+Enter would only apply to one of them
+		IDXGIFactory* factory;
+		if (SUCCEEDED(window.swapChain->GetParent(__uuidof(IDXGIFactory), (void**)&factory)))
+		{
+			factory->MakeWindowAssociation(window.hWnd, DXGI_MWA_NO_ALT_ENTER);
+			factory->Release();
+		}
+		if (!CreateBackBuffer(i))  return false;
+	}
+	return true;
+}
+
+bool OutputWindows::CreateBackBuffer(int i)
+{
+	Window& window = mWindows[i];
+	ID3D11Texture2D* texture;
+	if (FAILED(window.swapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (void**)&texture)))
+	{
+		gLastError = "Error getting output window back buffer";
+		return false;
+	}
+	HRESULT hr = gD3DDevice->CreateRenderTargetView(texture, nullptr, &window.backBuffer);
+	texture->Release();
+	if (FAILED(hr))
+	{
+		gLastError = "Error creating output window render target view";
+		return false;
+	}
+	return true;
+}
+
+
+// Follow the sizes the window thread has seen
+bool OutputWindows::Update()
+{
+	for (int i = 0; i < mNumWindows; ++i)
+	{
+		Window& window = mWindows[i];
+		int width  = window.clientWidth;
+		int height = window.clientHeight;
+		if (window.swapChain == nullptr || window.minimised || width <= 0 || height <= 0)  continue;
+		if (width == window.width && height == window.height)  continue;
+
+		// Nothing may refer to the buffers while they are resized
+		gD3DContext->OMSetRenderTargets(0, nullptr, nullptr);
+		window.backBuffer->Release();
+		window.backBuffer = nullptr;
+		DXGI_SWAP_CHAIN_DESC desc;
+		window.swapChain->GetDesc(&desc);
+		if (FAILED(window.swapChain->ResizeBuffers(0, width, height, DXGI_FORMAT_UNKNOWN, desc.Flags)))
+		{
+			gLastError = "Error resizing output window swap chain";
+			return false;
+		}
+		window.width  = width;
+		window.height = height;
+		window.effects.ReleaseHistory();
+		if (!CreateBackBuffer(i))  return false;
+	}
+	return true;
+}
+
+
+// Present without waiting, allowing tearing where the swap chain must be told it may
+void OutputWindows::Present()
+{
+	for (int i = 0; i < mNumWindows; ++i)
+	{
+		Window& window = mWindows[i];
+		if (window.swapChain == nullptr || window.minimised)  continue;
+		DXGI_SWAP_CHAIN_DESC desc;
+		window.swapChain->GetDesc(&desc);
+		window.swapChain->Present(0, (desc.Flags & DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING) ? DXGI_PRESENT_ALLOW_TEARING : 0);
+	}
+}
+
+
+void OutputWindows::Release()
+{
+	for (int i = 0; i < mNumWindows; ++i)
+	{
+		Window& window = mWindows[i];
+		window.effects.ReleaseHistory();
+		if (window.backBuffer)  window.backBuffer->Release();
+		if (window.swapChain)   window.swapChain->Release();
+		window.backBuffer = nullptr;
+		window.swapChain  = nullptr;
+	}
+}
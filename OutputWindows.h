@@ -0,0 +1,106 @@
+//--------------------------------------------------------------------------------------
+// Output windows
+//--------------------------------------------------------------------------------------
+// More windows showing the scene, e.g. one for each display of a multi-display install, all from the one process so the
+// device, the meshes, textures and shaders are only created once. Each window has its own swap chain on gD3DDevice, its
+// own camera (placed around the main one by the scene, see SetOutputWindows in Scene.h) and its own effect chain.
+//
+// The scene draws the windows as extra views of the main camera's draws (see RenderSceneFromCamera in Scene.cpp), so
+// the update, culling, levels of detail and command recording are done once for everything any window can see, and
+// only executing the draws is repeated for each window. Each view is drawn at the main window's scene size and its
+// effect chain scales it to the window.
+//
+// The windows are created on the window thread, which owns them and handles their messages, the swap chains on the
+// render thread. The windows can't take the focus, so the keyboard stays with the main window, and closing one closes
+// the program
+
+#ifndef _OUTPUT_WINDOWS_H_INCLUDED_
+#define _OUTPUT_WINDOWS_H_INCLUDED_
+
+#include "EffectChain.h"
+
+#include <d3d11.h>
+#include <atomic>
+
+
+class OutputWindows
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~OutputWindows()  { Release(); }
+
+	// Open the given number of windows. Each one covers one of the displays other than the main window's, borderless,
+	// or if there aren't enough displays is an ordinary window the size of the main one. Window thread, after the main
+	// window is created and before the render thread starts. Returns false on failure (reason in gLastError)
+	bool Open(HINSTANCE instance, HWND mainWindow, int count);
+
+	// Destroy the windows. Window thread, once the render thread has released the swap chains
+	void Close();
+
+
+	// Create the windows' swap chains, render thread after InitDirect3D. Returns false on failure (reason in gLastError)
+	bool CreateSwapChains();
+
+	// Resize the swap chains of windows whose size has changed. Render thread, before each frame. Returns false on
+	// failure (reason in gLastError)
+	bool Update();
+
+	// Show each window's back buffer. Never waits for vsync, the main window's present does that
+	void Present();
+
+	// Release the swap chains, render thread before ShutdownDirect3D
+	void Release();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	int NumWindows()  { return mNumWindows; }
+
+	// Render target, client area size and effects of a window, the target is null while it is minimised
+	ID3D11RenderTargetView* BackBuffer(int window)  { return mWindows[window].minimised ? nullptr : mWindows[window].backBuffer; }
+	int                     Width(int window)       { return mWindows[window].width;  }
+	int                     Height(int window)      { return mWindows[window].height; }
+	EffectChain&            Effects(int window)     { return mWindows[window].effects; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static LRESULT CALLBACK WindowProc(HWND window, UINT message, WPARAM wParam, LPARAM lParam);
+
+	// Create the render target of a window's back buffer, returns false on failure
+	bool CreateBackBuffer(int window);
+
+	static const int MAX_WINDOWS = 8;
+
+	struct Window
+	{
+		HWND                    hWnd = nullptr;
+		IDXGISwapChain*         swapChain  = nullptr;
+		ID3D11RenderTargetView* backBuffer = nullptr;
+		int                     width  = 0; // Of the swap chain
+		int                     height = 0;
+		EffectChain             effects;
+
+		// Written by the window thread, from WM_SIZE
+		std::atomic<int>  clientWidth { 0 };
+		std::atomic<int>  clientHeight{ 0 };
+		std::atomic<bool> minimised   { false };
+	};
+
+	Window mWindows[MAX_WINDOWS];
+	int    mNumWindows = 0;
+	HWND   mMainWindow = nullptr;
+};
+
+
+extern OutputWindows gOutputWindows;
+
+
+#endif //_OUTPUT_WINDOWS_H_INCLUDED_
@@ -0,0 +1,52 @@
+//--------------------------------------------------------------------------------------
+// Particle Sort Keys Compute Shader
+//--------------------------------------------------------------------------------------
+// Fills the sort buffer with a key / index pair for each particle before it is sorted (see GpuSort.h). The keys put the
+// particles back to front from the camera being rendered, so the alpha blended smoke covers what is behind it. One
+// thread for each element of the sort buffer, the elements past the last particle are padding that sorts to the end.
+// When sorting is off the buffer is used as it is, so the particles are drawn in buffer order
+
+#include "Particles.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+StructuredBuffer<Particle> Particles : register(t0);
+RWStructuredBuffer<uint2>  SortData  : register(u0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+#define PADDING_KEY 0xffffffff
+#define UNSEEN_KEY  0xfffffffe // Particles not yet spawned, sorted after the others but still before the padding
+
+
+[numthreads(PARTICLE_GROUP_SIZE, 1, 1)]
+void main(uint3 dispatchID : SV_DispatchThreadID)
+{
+    uint sortSize, stride;
+    SortData.GetDimensions(sortSize, stride);
+    uint index = dispatchID.x;
+    if (index >= sortSize)  return;
+
+    uint key = PADDING_KEY;
+    if (index < gNumParticles)
+    {
+        Particle particle = Particles[index];
+        if (particle.age < 0 || particle.lifetime == 0)
+        {
+            key = UNSEEN_KEY;
+        }
+        else
+        {
+            // Positive floats sort in the same order as their bits, inverted so the furthest comes first
+            float viewDepth = mul(gViewMatrix, float4(particle.position, 1)).z;
+            key = min(~asuint(max(viewDepth, 0.0f)), UNSEEN_KEY - 1);
+        }
+    }
+    SortData[index] = uint2(key, index);
+}
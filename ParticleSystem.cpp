@@ -0,0 +1,215 @@
+//--------------------------------------------------------------------------------------
+// GPU particle system
+//--------------------------------------------------------------------------------------
+// See ParticleSystem.h for an overview
+
+#include "ParticleSystem.h"
+#include "ResourceRegistry.h"
+#include "Shader.h"
+#include "State.h"
+#include "StateCache.h"
+#include "CookedAssets.h"
+#include "JobSystem.h"
+#include "GraphicsHelpers.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+ParticleSystem gParticleSystem;
+
+const float ParticleSystem::MAX_TIME_STEP = 0.1f;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+int ParticleSystem::AddEmitter(const ParticleEmitterData& emitter, float share)
+{
+	if (mConstants.numEmitters >= MAX_PARTICLE_EMITTERS)  return -1;
+	int index = mConstants.numEmitters++;
+	mConstants.emitters[index] = emitter;
+	mShares[index] = std::max(share, 0.0f);
+	return index;
+}
+
+
+bool ParticleSystem::Init(unsigned int numParticles, const std::vector<std::string>& textures)
+{
+	// Split the particles between the emitters by their shares, the last emitter takes any left over from rounding
+	float totalShare = 0;
+	for (unsigned int i = 0; i < mConstants.numEmitters; ++i)  totalShare += mShares[i];
+	unsigned int first = 0;
+	for (unsigned int i = 0; i < mConstants.numEmitters; ++i)
+	{
+		unsigned int count = (totalShare > 0) ? static_cast<unsigned int>(numParticles * (mShares[i] / totalShare)) : 0;
+		if (i + 1 == mConstants.numEmitters)  count = numParticles - first;
+		mConstants.emitters[i].firstParticle = first;
+		mConstants.emitters[i].endParticle   = first + count;
+		first += count;
+	}
+	mConstants.numParticles = numParticles;
+	if (numParticles == 0)  return true;
+
+	mParticleBuffer = CreateReadWriteStructuredBuffer(sizeof(ParticleData), numParticles, &mParticleBufferSRV, &mParticleBufferUAV);
+	mConstantBuffer = CreateConstantBuffer(sizeof(ParticleConstants));
+	if (mParticleBuffer == nullptr || mConstantBuffer == nullptr)
+	{
+		gLastError = "Error creating particle buffers";
+		return false;
+	}
+	if (!mDrawOrder.Init(numParticles))  return false;
+
+	// A zero lifetime marks a particle that has never spawned, the simulation spreads their first spawns out
+	UINT zeros[4] = {};
+	gD3DContext->ClearUnorderedAccessViewUint(mParticleBufferUAV, zeros);
+
+
+	// Decode the images on the job system, they are large PNGs and decoding dominates the loading time
+	std::vector<CookedTexture> images(textures.size());
+	std::vector<std::string>   errors(textures.size());
+	gJobSystem.ParallelFor(textures.size(), 1, [&](size_t firstImage, size_t endImage)
+	{
+		HRESULT comResult = CoInitializeEx(nullptr, COINIT_MULTITHREADED); // For WIC image decoding
+		for (size_t i = firstImage; i < endImage; ++i)
+		{
+			if (DecodeTexture(textures[i], images[i], errors[i]))  ResizeTexture(images[i], TEXTURE_SIZE, TEXTURE_SIZE);
+		}
+		if (SUCCEEDED(comResult))  CoUninitialize();
+	});
+	for (size_t i = 0; i < textures.size(); ++i)
+	{
+		if (images[i].mips.empty())
+		{
+			gLastError = "Error loading particle texture " + textures[i] + ": " + errors[i];
+			return false;
+		}
+	}
+
+	if (!textures.empty())
+	{
+		UINT numMips = static_cast<UINT>(images[0].mips.size());
+		std::vector<D3D11_SUBRESOURCE_DATA> initData;
+		for (auto& image : images)
+		{
+			for (auto& mip : image.mips)  initData.push_back({ mip.pixels.data(), mip.width * 4, 0 });
+		}
+
+		D3D11_TEXTURE2D_DESC textureDesc = {};
+		textureDesc.Width     = TEXTURE_SIZE;
+		textureDesc.Height    = TEXTURE_SIZE;
+		textureDesc.MipLevels = numMips;
+		textureDesc.ArraySize = static_cast<UINT>(images.size());
+		textureDesc.Format    = DXGI_FORMAT_R8G8B8A8_UNORM;
+		textureDesc.SampleDesc.Count = 1;
+		textureDesc.Usage     = D3D11_USAGE_IMMUTABLE;
+		textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, initData.data(), &mTextures)) ||
+		    FAILED(gD3DDevice->CreateShaderResourceView(mTextures, nullptr, &mTexturesSRV)))
+		{
+			gLastError = "Error creating particle texture array";
+			return false;
+		}
+		gResourceRegistry.Track(mTextures);
+	}
+	return true;
+}
+
+
+void ParticleSystem::Simulate(float frameTime)
+{
+	if (mParticleBuffer == nullptr)  return;
+
+	mConstants.particleFrameTime = std::min(frameTime, MAX_TIME_STEP);
+	++mConstants.randomSeed;
+	UpdateConstantBuffer(mConstantBuffer, mConstants);
+
+	gStateCache.CSSetShader(gParticles_Compute, nullptr, 0);
+	gStateCache.SetConstantBuffer(PARTICLE_CONSTANTS_SLOT, mConstantBuffer);
+	gD3DContext->CSSetUnorderedAccessViews(PARTICLE_DATA_SLOT, 1, &mParticleBufferUAV, nullptr);
+	gD3DContext->Dispatch((mConstants.numParticles + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE, 1, 1);
+
+	ID3D11UnorderedAccessView* nullUAV = nullptr;
+	gD3DContext->CSSetUnorderedAccessViews(PARTICLE_DATA_SLOT, 1, &nullUAV, nullptr);
+}
+
+
+void ParticleSystem::Sort(bool sort)
+{
+	if (mParticleBuffer == nullptr)  return;
+
+	// One thread for each element of the sort buffer, including the padding past the last particle
+	ID3D11UnorderedAccessView* sortDataUAV = mDrawOrder.SortDataUAV();
+	gStateCache.CSSetShader(gParticleSortKeys_Compute, nullptr, 0);
+	gStateCache.SetConstantBuffer(PER_FRAME_CONSTANTS_SLOT, gPerFrameConstantBuffer);
+	gStateCache.SetConstantBuffer(PARTICLE_CONSTANTS_SLOT, mConstantBuffer);
+	gD3DContext->CSSetShaderResources(PARTICLE_DATA_SLOT, 1, &mParticleBufferSRV);
+	gD3DContext->CSSetUnorderedAccessViews(SORT_DATA_SLOT, 1, &sortDataUAV, nullptr);
+	gD3DContext->Dispatch((mDrawOrder.Size() + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE, 1, 1);
+
+	ID3D11ShaderResourceView*  nullSRV = nullptr;
+	ID3D11UnorderedAccessView* nullUAV = nullptr;
+	gD3DContext->CSSetShaderResources(PARTICLE_DATA_SLOT, 1, &nullSRV);
+	gD3DContext->CSSetUnorderedAccessViews(SORT_DATA_SLOT, 1, &nullUAV, nullptr);
+
+	if (sort)  mDrawOrder.Sort();
+}
+
+
+void ParticleSystem::Render(ID3D11RenderTargetView* target, const D3D11_VIEWPORT& viewport)
+{
+	if (mParticleBuffer == nullptr || mTexturesSRV == nullptr)  return;
+
+	// The depth buffer is read as a texture for soft particles, so it can't also be bound as the depth buffer. The
+	// pixel shader does the depth test itself
+	gD3DContext->OMSetRenderTargets(1, &target, nullptr);
+	gD3DContext->RSSetViewports(1, &viewport);
+
+	gStateCache.VSSetShader(gParticleVertexShader, nullptr, 0);
+	gStateCache.PSSetShader(gParticlePixelShader, nullptr, 0);
+	gStateCache.GSSetShader(nullptr, nullptr, 0);
+	gStateCache.SetConstantBuffer(PER_FRAME_CONSTANTS_SLOT, gPerFrameConstantBuffer);
+	gStateCache.SetConstantBuffer(PARTICLE_CONSTANTS_SLOT, mConstantBuffer);
+
+	// States - premultiplied alpha blending, no depth buffer and no culling (the quads may be rotated either way)
+	gStateCache.OMSetBlendState(gPremultipliedAlphaBlendingState, nullptr, 0xffffff);
+	gStateCache.OMSetDepthStencilState(gNoDepthBufferState, 0);
+	gStateCache.RSSetState(gCullNoneState);
+	gStateCache.SetSampler(0, gTrilinearSampler);
+
+	// No vertex buffer, the vertex shader builds the quads from the particle buffer
+	gStateCache.IASetInputLayout(nullptr);
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	ID3D11ShaderResourceView* drawOrderSRV = mDrawOrder.SortDataSRV();
+	gD3DContext->VSSetShaderResources(PARTICLE_DATA_SLOT,  1, &mParticleBufferSRV);
+	gD3DContext->VSSetShaderResources(PARTICLE_ORDER_SLOT, 1, &drawOrderSRV);
+	gD3DContext->PSSetShaderResources(PARTICLE_TEXTURE_SLOT, 1, &mTexturesSRV);
+	gD3DContext->PSSetShaderResources(PARTICLE_DEPTH_SLOT,   1, &gDepthShaderView);
+	gD3DContext->DrawInstanced(4, mConstants.numParticles, 0, 0);
+
+	ID3D11ShaderResourceView* nullSRV = nullptr;
+	gD3DContext->VSSetShaderResources(PARTICLE_DATA_SLOT,  1, &nullSRV); // So the next Simulate and Sort can write them
+	gD3DContext->VSSetShaderResources(PARTICLE_ORDER_SLOT, 1, &nullSRV);
+	gD3DContext->PSSetShaderResources(PARTICLE_DEPTH_SLOT, 1, &nullSRV); // So the depth buffer can be written again
+}
+
+
+// The emitters are kept, so Init can be called again
+void ParticleSystem::Release()
+{
+	if (mTexturesSRV)        mTexturesSRV->Release();
+	if (mTextures)           mTextures->Release();
+	if (mParticleBufferUAV)  mParticleBufferUAV->Release();
+	if (mParticleBufferSRV)  mParticleBufferSRV->Release();
+	if (mParticleBuffer)     mParticleBuffer->Release();
+	if (mConstantBuffer)     mConstantBuffer->Release();
+	mDrawOrder.Release();
+	mTexturesSRV       = nullptr;
+	mTextures          = nullptr;
+	mParticleBufferUAV = nullptr;
+	mParticleBufferSRV = nullptr;
+	mParticleBuffer    = nullptr;
+	mConstantBuffer    = nullptr;
+	mConstants.numParticles = 0;
+}
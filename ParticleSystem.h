@@ -0,0 +1,98 @@
+//--------------------------------------------------------------------------------------
+// GPU particle system
+//--------------------------------------------------------------------------------------
+// Smoke and fire particles simulated and drawn entirely on the GPU, so the CPU cost is the same for a hundred particles
+// or a million. The particles live in one structured buffer, each emitter owning a fixed range of it:
+//
+// - Simulate runs Particles_cs with one thread per particle, moving each by its velocity and respawning it at its
+//   emitter when its lifetime is up. The emitters are in a small constant buffer, the only data uploaded each frame.
+// - Render draws every particle as an instanced four vertex triangle strip with no vertex buffer. Particle_vs reads the
+//   particle buffer to place a camera-facing quad and Particle_ps textures it from a texture array holding all the
+//   particle images (each image is resized to TEXTURE_SIZE so they fit one array).
+//
+// - Sort puts the particles back to front from the camera with a GPU sort of their view depths (see GpuSort.h), so the
+//   CPU never sees them. Render draws the instances in the sorted order, each reading its particle index from the sort
+//   buffer.
+//
+// Particles are drawn with premultiplied alpha blending after the other blended models, so additive fire and alpha
+// blended smoke share one draw call
+
+#ifndef _PARTICLE_SYSTEM_H_INCLUDED_
+#define _PARTICLE_SYSTEM_H_INCLUDED_
+
+#include "Common.h"
+#include "GpuSort.h"
+
+#include <d3d11.h>
+#include <string>
+#include <vector>
+
+
+class ParticleSystem
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~ParticleSystem()  { Release(); }
+
+	// Add an emitter, which gets the given share of the particles (shares are relative to each other). Its layers are
+	// indices into the texture list given to Init. The particle range is filled in by Init. Call before Init, returns the
+	// emitter's index or -1 if there are already MAX_PARTICLE_EMITTERS
+	int AddEmitter(const ParticleEmitterData& emitter, float share);
+
+	// Move an emitter, particles already emitted carry on from where they are
+	void SetEmitterPosition(int emitter, const CVector3& position)  { mConstants.emitters[emitter].position = position; }
+
+	// Create the particle buffer for the given number of particles, shared between the emitters, and the texture
+	// array from the given image files. Returns false on failure (reason in gLastError)
+	bool Init(unsigned int numParticles, const std::vector<std::string>& textures);
+
+	// Move the particles on by the given time and respawn those that have expired. Call on the main thread
+	void Simulate(float frameTime);
+
+	// Put the particles in drawing order for the camera in gPerFrameConstantBuffer: back to front, or in buffer order if
+	// sort is false. Call on the main thread for each camera before Render
+	void Sort(bool sort);
+
+	// Draw the particles to the given target, faded out against the main depth buffer (soft particles). The depth buffer
+	// is unbound to be read as a texture and left unbound. Call on the main thread
+	void Render(ID3D11RenderTargetView* target, const D3D11_VIEWPORT& viewport);
+
+	void Release();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	unsigned int NumParticles()  { return mConstants.numParticles; }
+	unsigned int NumEmitters()   { return mConstants.numEmitters;  }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const unsigned int TEXTURE_SIZE = 256; // Width and height of each layer of the texture array
+	static const float        MAX_TIME_STEP;      // Longer frames (e.g. after a stall) are simulated as this long
+
+	ParticleConstants  mConstants = {};
+	float              mShares[MAX_PARTICLE_EMITTERS] = {};
+	ID3D11Buffer*      mConstantBuffer = nullptr;
+
+	ID3D11Buffer*              mParticleBuffer    = nullptr; // mConstants.numParticles ParticleData, only touched by the GPU
+	ID3D11ShaderResourceView*  mParticleBufferSRV = nullptr;
+	ID3D11UnorderedAccessView* mParticleBufferUAV = nullptr;
+	GpuSort                    mDrawOrder; // Keys and particle indices in drawing order
+
+	ID3D11Texture2D*          mTextures    = nullptr; // Array of the particle images
+	ID3D11ShaderResourceView* mTexturesSRV = nullptr;
+};
+
+
+extern ParticleSystem gParticleSystem;
+
+
+#endif //_PARTICLE_SYSTEM_H_INCLUDED_
@@ -0,0 +1,35 @@
+//--------------------------------------------------------------------------------------
+// Particle Pixel Shader
+//--------------------------------------------------------------------------------------
+// Textures a particle quad from its layer of the particle texture array. The output is premultiplied by the opacity,
+// for the premultiplied alpha blending state, so smoke (alpha blended) and fire (additive) are drawn in the same pass.
+//
+// Soft particles: the particle fades out as it gets close to the scene behind it, read from the depth buffer, so the
+// quads don't cut hard lines where they meet the ground. The depth buffer is a texture here, not bound for depth
+// testing, so this fade is also the depth test - particles behind the scene fade to nothing and are discarded
+
+#include "Particles.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2DArray ParticleTextures : register(t0);
+SamplerState   TexSampler       : register(s0);
+Texture2D      DepthMap         : register(t1); // PARTICLE_DEPTH_SLOT, the main depth buffer
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(ParticlePixelShaderInput input) : SV_Target
+{
+    float sceneDepth = ViewDepth(DepthMap.Load(int3(input.projectedPosition.xy, 0)).r, gNearClip, gFarClip);
+    float fade = saturate((sceneDepth - input.viewDepth) / input.fadeDistance);
+    if (fade <= 0)  discard;
+
+    float4 texel = ParticleTextures.Sample(TexSampler, float3(input.uv, input.layer));
+    return float4(texel.rgb * texel.a, texel.a) * input.colour * fade;
+}
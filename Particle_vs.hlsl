@@ -0,0 +1,65 @@
+//--------------------------------------------------------------------------------------
+// Particle Vertex Shader
+//--------------------------------------------------------------------------------------
+// Draws each particle as a camera-facing quad. There is no vertex buffer: the particles are drawn as instanced four
+// vertex triangle strips, the instance ID picks the particle through the drawing order and the vertex ID the corner
+
+#include "Particles.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+StructuredBuffer<Particle> Particles : register(t0); // Written by Particles_cs
+StructuredBuffer<uint2>    DrawOrder : register(t1); // Sort keys and particle indices in drawing order (see GpuSort.h)
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+ParticlePixelShaderInput main(uint vertexID : SV_VertexID, uint instanceID : SV_InstanceID)
+{
+    ParticlePixelShaderInput output;
+
+    Particle particle = Particles[DrawOrder[instanceID].y];
+    ParticleEmitter emitter = gEmitters[particle.emitter];
+
+    // Particles not yet spawned are collapsed to a point off-screen and cost nothing in the pixel shader
+    if (particle.age < 0 || particle.lifetime == 0)
+    {
+        output.projectedPosition = float4(0, 0, -1, 1);
+        output.uv     = 0;
+        output.viewDepth    = 0;
+        output.fadeDistance = 1;
+        output.layer  = 0;
+        output.colour = 0;
+        return output;
+    }
+
+    // Grows over its life, fading in quickly and out slowly
+    float life = saturate(particle.age / particle.lifetime);
+    float size = lerp(emitter.startSize, emitter.endSize, life);
+    float opacity = saturate(life * 10) * (1 - life);
+
+    // Corners -1 to 1, rotated in the plane of the screen then placed along the camera's right and up axes
+    float2 corner = float2((vertexID & 1) ? 1 : -1, (vertexID & 2) ? -1 : 1);
+    float s, c;
+    sincos(particle.rotation, s, c);
+    float2 rotated = float2(corner.x * c - corner.y * s, corner.x * s + corner.y * c) * (size * 0.5f);
+    float3 cameraRight = mul(gCameraMatrix, float4(1, 0, 0, 0)).xyz;
+    float3 cameraUp    = mul(gCameraMatrix, float4(0, 1, 0, 0)).xyz;
+    float3 worldPosition = particle.position + cameraRight * rotated.x + cameraUp * rotated.y;
+
+    output.projectedPosition = mul(gViewProjectionMatrix, float4(worldPosition, 1));
+    output.uv    = corner * float2(0.5f, -0.5f) + 0.5f;
+    output.viewDepth    = mul(gViewMatrix, float4(worldPosition, 1)).z;
+    output.fadeDistance = size * 0.5f; // Fully faded in once the scene is half the particle's size behind it
+    output.layer = particle.layer;
+
+    // Premultiplied: alpha blended particles cover the scene by their opacity, additive ones leave it as it is
+    output.colour = float4(emitter.colour * opacity, opacity * (1 - emitter.additive));
+
+    return output;
+}
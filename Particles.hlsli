@@ -0,0 +1,64 @@
+//--------------------------------------------------------------------------------------
+// Include file for the GPU particles
+//--------------------------------------------------------------------------------------
+// The particles are simulated by Particles_cs and drawn by Particle_vs / Particle_ps, see ParticleSystem.h
+
+#include "Common.hlsli"
+
+
+// These variables must match exactly the ParticleConstants, ParticleEmitterData and ParticleData structures in Common.h
+#define MAX_PARTICLE_EMITTERS 8
+#define PARTICLE_GROUP_SIZE   256
+
+struct ParticleEmitter
+{
+    float3 position;
+    float  spawnRadius;
+    float3 velocity;
+    float  velocitySpread;
+    float3 acceleration;
+    float  drag;
+    float3 colour;
+    float  lifetime;
+    float  startSize;
+    float  endSize;
+    float  spin;
+    float  additive;
+    uint   firstLayer;
+    uint   numLayers;
+    uint   firstParticle;
+    uint   endParticle;
+};
+
+cbuffer ParticleConstants : register(b6)
+{
+    ParticleEmitter gEmitters[MAX_PARTICLE_EMITTERS];
+    uint            gNumEmitters;
+    uint            gNumParticles;
+    float           gParticleFrameTime;
+    uint            gRandomSeed;
+}
+
+struct Particle
+{
+    float3 position;
+    float  age;      // Negative before the first spawn
+    float3 velocity;
+    float  lifetime; // 0 if never spawned
+    float  rotation;
+    float  spinSpeed;
+    uint   layer;
+    uint   emitter;
+};
+
+
+// What the particle pixel shader receives, the colour is premultiplied by the opacity
+struct ParticlePixelShaderInput
+{
+    float4 projectedPosition : SV_Position;
+    float2 uv                : uv;
+    float  viewDepth         : viewDepth; // For the soft particle fade against the depth buffer
+    nointerpolation float  fadeDistance : fadeDistance;
+    nointerpolation uint   layer  : layer;
+    nointerpolation float4 colour : colour;
+};
@@ -0,0 +1,87 @@
+//--------------------------------------------------------------------------------------
+// Particle Simulation Compute Shader
+//--------------------------------------------------------------------------------------
+// One thread per particle. Moves the particle by its velocity, which is changed by its emitter's acceleration and drag,
+// and respawns it at its emitter once its lifetime is up - so each emitter keeps its range of the particles in flight
+// with no work on the CPU. Random numbers come from a hash of the particle index and a seed that changes each frame
+
+#include "Particles.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+RWStructuredBuffer<Particle> Particles : register(u0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// PCG hash, a good spread of bits from consecutive inputs
+uint Hash(uint value)
+{
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Next random number from 0 to 1, updating the state
+float Random(inout uint state)
+{
+    state = Hash(state);
+    return float(state) / 4294967295.0f;
+}
+
+// Random point inside a unit sphere, not quite uniform but cheap and without a loop
+float3 RandomInSphere(inout uint state)
+{
+    float z     = Random(state) * 2 - 1;
+    float angle = Random(state) * 6.283185f;
+    float r     = sqrt(1 - z * z);
+    return float3(r * cos(angle), r * sin(angle), z) * pow(Random(state), 1.0f / 3.0f);
+}
+
+
+[numthreads(PARTICLE_GROUP_SIZE, 1, 1)]
+void main(uint3 dispatchID : SV_DispatchThreadID)
+{
+    uint index = dispatchID.x;
+    if (index >= gNumParticles)  return;
+
+    // Find the emitter owning this particle. Few emitters and whole groups usually take the same path
+    uint e = 0;
+    while (e < gNumEmitters && index >= gEmitters[e].endParticle)  ++e;
+    if (e >= gNumEmitters || index < gEmitters[e].firstParticle)  return;
+    ParticleEmitter emitter = gEmitters[e];
+
+    Particle particle = Particles[index];
+    particle.age += gParticleFrameTime;
+
+    if (particle.age >= particle.lifetime)
+    {
+        uint random = Hash(index ^ Hash(gRandomSeed));
+        bool firstSpawn = (particle.lifetime == 0);
+
+        particle.position  = emitter.position + RandomInSphere(random) * emitter.spawnRadius;
+        particle.velocity  = emitter.velocity + RandomInSphere(random) * emitter.velocitySpread;
+        particle.lifetime  = emitter.lifetime * (0.75f + 0.5f * Random(random));
+        particle.rotation  = Random(random) * 6.283185f;
+        particle.spinSpeed = (Random(random) * 2 - 1) * emitter.spin;
+        particle.layer     = emitter.firstLayer + min(uint(Random(random) * emitter.numLayers), emitter.numLayers - 1);
+        particle.emitter   = e;
+
+        // The first spawn is delayed by up to a lifetime, spreading the particles evenly through their lives from the start
+        particle.age = firstSpawn ? -Random(random) * particle.lifetime : 0;
+    }
+    else if (particle.age >= 0)
+    {
+        particle.velocity += emitter.acceleration * gParticleFrameTime;
+        particle.velocity *= exp(-emitter.drag * gParticleFrameTime);
+        particle.position += particle.velocity * gParticleFrameTime;
+        particle.rotation += particle.spinSpeed * gParticleFrameTime;
+    }
+
+    Particles[index] = particle;
+}
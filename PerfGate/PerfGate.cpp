@@ -0,0 +1,308 @@
+//--------------------------------------------------------------------------------------
+// PerfGate - performance regression check
+//--------------------------------------------------------------------------------------
+// Usage: PerfGate <metrics.json> [-baselines directory] [-update]
+//
+// Compares the performance metrics from a benchmark run (the .json written by -benchmark or -shaderbenchmark, see
+// PerfMetrics.h) with the baseline for the same kind of GPU, <directory>\<gpuClass>.json (default directory
+// PerfBaselines). The report lists every metric that got slower or bigger (regressions) or faster or smaller
+// (improvements) by more than its threshold, and the exit code is 1 if there were any regressions, 2 on error.
+// -update then replaces the baseline with this run, e.g. after a deliberate change or for a new GPU class.
+//
+// A metric's threshold allows for its noise. The metrics hold the median of their samples and the median absolute
+// deviation, which gives the standard error of each median. A change must be NOISE_SIGMAS standard errors of the
+// difference to count, and also at least RELATIVE_TOLERANCE of the baseline (or SINGLE_SAMPLE_TOLERANCE for metrics of
+// one sample, like the startup time, whose noise can't be measured) and the unit's smallest change worth reporting.
+// Metrics in only one of the files are counted but never fail the check, so metrics can be added or renamed.
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+	// Thresholds, see above
+	const double NOISE_SIGMAS            = 4;
+	const double RELATIVE_TOLERANCE      = 0.05;
+	const double SINGLE_SAMPLE_TOLERANCE = 0.25;
+	const double MIN_CHANGE_MS           = 0.02;
+	const double MIN_CHANGE_MB           = 8;
+
+	// Scale from the median absolute deviation to the standard deviation of normally distributed samples, and from that
+	// to the standard error of a median of n samples (divided by sqrt(n))
+	const double MAD_TO_SIGMA         = 1.4826;
+	const double MEDIAN_STANDARD_ERROR = 1.2533;
+
+
+	struct Metric
+	{
+		std::string unit;
+		double      median = 0;
+		double      mad    = 0;
+		double      count  = 0;
+	};
+
+	struct MetricsFile
+	{
+		std::string                   device;
+		std::string                   gpuClass;
+		std::map<std::string, Metric> metrics;
+	};
+
+
+	//--------------------------------------------------------------------------------------
+	// Reading
+	//--------------------------------------------------------------------------------------
+
+	// Just enough of a JSON reader for the files PerfMetrics writes: objects, strings and numbers
+	class JsonReader
+	{
+	public:
+		JsonReader(const std::string& text) : mText(text) {}
+
+		bool ReadFile(MetricsFile& file)
+		{
+			return ReadObject([&](const std::string& key)
+			{
+				if (key == "device")    return ReadString(file.device);
+				if (key == "gpuClass")  return ReadString(file.gpuClass);
+				if (key == "metrics")   return ReadObject([&](const std::string& name) { return ReadMetric(file.metrics[name]); });
+				return SkipValue();
+			});
+		}
+
+	private:
+		bool ReadMetric(Metric& metric)
+		{
+			return ReadObject([&](const std::string& key)
+			{
+				if (key == "unit")    return ReadString(metric.unit);
+				if (key == "median")  return ReadNumber(metric.median);
+				if (key == "mad")     return ReadNumber(metric.mad);
+				if (key == "count")   return ReadNumber(metric.count);
+				return SkipValue();
+			});
+		}
+
+		// Calls readMember for each key, positioned at its value
+		template <class ReadMember> bool ReadObject(ReadMember readMember)
+		{
+			if (!Expect('{'))  return false;
+			if (Peek() == '}')  return Expect('}');
+			for (;;)
+			{
+				std::string key;
+				if (!ReadString(key) || !Expect(':') || !readMember(key))  return false;
+				if (Peek() == ',')  { Expect(','); continue; }
+				return Expect('}');
+			}
+		}
+
+		bool ReadString(std::string& value)
+		{
+			if (!Expect('"'))  return false;
+			value.clear();
+			while (mPosition < mText.size() && mText[mPosition] != '"')
+			{
+				if (mText[mPosition] == '\\' && mPosition + 1 < mText.size())  ++mPosition; // Only \" and \\ are written
+				value += mText[mPosition++];
+			}
+			return Expect('"');
+		}
+
+		bool ReadNumber(double& value)
+		{
+			SkipSpace();
+			const char* start = mText.c_str() + mPosition;
+			char* end;
+			value = std::strtod(start, &end);
+			mPosition += end - start;
+			return end != start;
+		}
+
+		bool SkipValue()
+		{
+			char c = Peek();
+			if (c == '"')  { std::string unused; return ReadString(unused); }
+			if (c == '{')  return ReadObject([&](const std::string&) { return SkipValue(); });
+			double unused;
+			return ReadNumber(unused);
+		}
+
+		void SkipSpace()
+		{
+			while (mPosition < mText.size() && std::isspace(static_cast<unsigned char>(mText[mPosition])))  ++mPosition;
+		}
+
+		char Peek()
+		{
+			SkipSpace();
+			return mPosition < mText.size() ? mText[mPosition] : '\0';
+		}
+
+		bool Expect(char c)
+		{
+			if (Peek() != c)  return false;
+			++mPosition;
+			return true;
+		}
+
+		const std::string& mText;
+		size_t             mPosition = 0;
+	};
+
+
+	bool ReadMetricsFile(const std::string& fileName, MetricsFile& file, std::string& text)
+	{
+		std::ifstream stream(fileName, std::ios::binary);
+		if (!stream.is_open())  return false;
+		std::ostringstream contents;
+		contents << stream.rdbuf();
+		text = contents.str();
+		JsonReader reader(text);
+		if (!reader.ReadFile(file))
+		{
+			std::printf("Error: %s is not a valid metrics file\n", fileName.c_str());
+			return false;
+		}
+		return true;
+	}
+
+
+	//--------------------------------------------------------------------------------------
+	// Comparison
+	//--------------------------------------------------------------------------------------
+
+	struct Change
+	{
+		std::string name;
+		std::string unit;
+		double      baseline;
+		double      current;
+		double      threshold;
+	};
+
+	// Smallest change in a metric that counts, see the top of the file
+	double Threshold(const Metric& baseline, const Metric& current)
+	{
+		double standardError2 = 0;
+		for (const Metric* metric : { &baseline, &current })
+		{
+			if (metric->count < 1)  continue;
+			double error = MEDIAN_STANDARD_ERROR * MAD_TO_SIGMA * metric->mad / std::sqrt(metric->count);
+			standardError2 += error * error;
+		}
+		bool singleSample = (baseline.count <= 1 || current.count <= 1);
+		double tolerance = (singleSample ? SINGLE_SAMPLE_TOLERANCE : RELATIVE_TOLERANCE) * std::abs(baseline.median);
+		double minChange = (baseline.unit == "ms") ? MIN_CHANGE_MS : (baseline.unit == "MB") ? MIN_CHANGE_MB : 0;
+		return std::max({ NOISE_SIGMAS * std::sqrt(standardError2), tolerance, minChange });
+	}
+
+	void PrintChanges(const char* title, std::vector<Change>& changes)
+	{
+		if (changes.empty())  return;
+
+		// Biggest relative change first
+		auto relative = [](const Change& change) { return std::abs(change.current - change.baseline) / std::max(std::abs(change.baseline), 1e-9); };
+		std::sort(changes.begin(), changes.end(), [&](const Change& a, const Change& b) { return relative(a) > relative(b); });
+
+		size_t nameWidth = 0;
+		for (auto& change : changes)  nameWidth = std::max(nameWidth, change.name.size());
+		std::printf("\n%s (%zu):\n", title, changes.size());
+		for (auto& change : changes)
+		{
+			double difference = change.current - change.baseline;
+			std::printf("  %-*s %10.3f -> %10.3f %-2s  %+7.1f%%  (threshold %.3f)\n", static_cast<int>(nameWidth), change.name.c_str(),
+			            change.baseline, change.current, change.unit.c_str(), 100 * relative(change) * (difference < 0 ? -1 : 1),
+			            change.threshold);
+		}
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	std::string runFile;
+	std::string baselineDirectory = "PerfBaselines";
+	bool update = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if      (arg == "-baselines" && i + 1 < argc)  baselineDirectory = argv[++i];
+		else if (arg == "-update")                     update = true;
+		else if (arg[0] != '-' && runFile.empty())     runFile = arg;
+		else
+		{
+			runFile.clear(); // Shows the usage
+			break;
+		}
+	}
+	if (runFile.empty())
+	{
+		std::printf("Usage: PerfGate <metrics.json> [-baselines directory] [-update]\n");
+		return 2;
+	}
+
+	MetricsFile run;
+	std::string runText;
+	if (!ReadMetricsFile(runFile, run, runText))
+	{
+		std::printf("Error reading %s\n", runFile.c_str());
+		return 2;
+	}
+	std::string baselineFile = baselineDirectory + "\\" + run.gpuClass + ".json";
+	std::printf("Perf gate: %s (%s)\n  against %s\n", runFile.c_str(), run.device.c_str(), baselineFile.c_str());
+
+	MetricsFile baseline;
+	std::string baselineText;
+	bool haveBaseline = ReadMetricsFile(baselineFile, baseline, baselineText);
+	int regressions = 0;
+	if (!haveBaseline)
+	{
+		std::printf("\nNo baseline for GPU class %s, nothing compared\n", run.gpuClass.c_str());
+	}
+	else
+	{
+		std::vector<Change> slower, faster;
+		int added = 0, removed = 0, compared = 0;
+		for (auto& entry : run.metrics)
+		{
+			auto found = baseline.metrics.find(entry.first);
+			if (found == baseline.metrics.end())  { ++added; continue; }
+			++compared;
+
+			// Every metric is a time or a size, so bigger is worse
+			Change change = { entry.first, found->second.unit, found->second.median, entry.second.median, Threshold(found->second, entry.second) };
+			if      (change.current - change.baseline > change.threshold)  slower.push_back(change);
+			else if (change.baseline - change.current > change.threshold)  faster.push_back(change);
+		}
+		for (auto& entry : baseline.metrics)  if (run.metrics.count(entry.first) == 0)  ++removed;
+
+		PrintChanges("Regressions", slower);
+		PrintChanges("Improvements", faster);
+		std::printf("\n%d metrics compared, %d new, %d missing from this run\n", compared, added, removed);
+		regressions = static_cast<int>(slower.size());
+		std::printf("Result: %s\n", regressions > 0 ? "FAIL" : "PASS");
+	}
+
+	if (update)
+	{
+		std::ofstream file(baselineFile, std::ios::binary);
+		file << runText;
+		if (!file)
+		{
+			std::printf("Error writing %s (does %s exist?)\n", baselineFile.c_str(), baselineDirectory.c_str());
+			return 2;
+		}
+		std::printf("Baseline %s updated\n", baselineFile.c_str());
+	}
+	return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,106 @@
+//--------------------------------------------------------------------------------------
+// Performance metrics
+//--------------------------------------------------------------------------------------
+// See PerfMetrics.h for an overview
+
+#include "PerfMetrics.h"
+#include "Direct3DSetup.h"
+#include "Common.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+
+PerfMetrics gPerfMetrics;
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+// Quote a string for JSON, names can hold file paths with backslashes
+std::string JsonString(const std::string& text)
+{
+	std::string quoted = "\"";
+	for (char c : text)
+	{
+		if      (c == '"' || c == '\\')  { quoted += '\\'; quoted += c; }
+		else if (static_cast<unsigned char>(c) < 0x20)  quoted += ' ';
+		else                             quoted += c;
+	}
+	return quoted + "\"";
+}
+
+// Median of a list of values (which is reordered)
+float MedianOf(std::vector<float>& values)
+{
+	if (values.empty())  return 0;
+	auto middle = values.begin() + values.size() / 2;
+	std::nth_element(values.begin(), middle, values.end());
+	return *middle;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+void PerfMetrics::AddSample(const std::string& name, const std::string& unit, float value)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	Metric& metric = mMetrics[name];
+	if (metric.samples.empty())  metric.unit = unit;
+	metric.samples.push_back(value);
+}
+
+
+void PerfMetrics::Clear()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mMetrics.clear();
+}
+
+
+bool PerfMetrics::Write(const std::string& fileName)
+{
+	std::ofstream file(fileName);
+	if (!file.is_open())
+	{
+		gLastError = "Error writing performance metrics to " + fileName;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	file << "{\n  \"device\": " << JsonString(DeviceDescription()) << ",\n  \"gpuClass\": " << JsonString(GpuClass())
+	     << ",\n  \"metrics\": {\n";
+	file.precision(6);
+	size_t written = 0;
+	for (auto& entry : mMetrics)
+	{
+		std::vector<float> samples = entry.second.samples;
+		float median = MedianOf(samples);
+		for (auto& sample : samples)  sample = std::abs(sample - median);
+		float deviation = MedianOf(samples);
+
+		file << "    " << JsonString(entry.first) << ": { \"unit\": " << JsonString(entry.second.unit) << ", \"median\": "
+		     << median << ", \"mad\": " << deviation << ", \"count\": " << samples.size() << " }"
+		     << (++written < mMetrics.size() ? "," : "") << "\n";
+	}
+	file << "  }\n}\n";
+	if (file.fail())
+	{
+		gLastError = "Error writing performance metrics to " + fileName;
+		return false;
+	}
+	return true;
+}
+
+
+std::string MetricsFileName(const std::string& fileName)
+{
+	size_t extension = fileName.find_last_of('.');
+	size_t directory = fileName.find_last_of("\\/");
+	if (extension == std::string::npos || (directory != std::string::npos && extension < directory))  return fileName + ".json";
+	return fileName.substr(0, extension) + ".json";
+}
@@ -0,0 +1,62 @@
+//--------------------------------------------------------------------------------------
+// Performance metrics
+//--------------------------------------------------------------------------------------
+// Named measurements kept for the performance regression gate (PerfGate). Anything worth tracking between builds adds
+// samples to a metric as it runs (e.g. one sample per benchmark frame for a pass's GPU time, or one for the startup
+// time), and the benchmark modes write them all as a JSON file at the end. Each metric is written as the median of its
+// samples, their median absolute deviation (how noisy it is) and the number of samples, along with the device and its
+// GPU class so PerfGate can pick the baseline measured on the same kind of GPU.
+//
+// Metric names are a kind then a path, e.g. gpu_pass_ms/Bloom/Bloom Blur, and the unit is a short string (ms, MB)
+
+#ifndef _PERF_METRICS_H_INCLUDED_
+#define _PERF_METRICS_H_INCLUDED_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+class PerfMetrics
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Add a sample to a metric, creating it if it is new. The unit is only taken from the first sample. Can be called on
+	// any thread (assets are timed as they load on the job system)
+	void AddSample(const std::string& name, const std::string& unit, float value);
+
+	// Remove every metric
+	void Clear();
+
+	// Write all the metrics to a JSON file, with the description and class of the current device (see Direct3DSetup.h).
+	// Returns false on failure (reason in gLastError)
+	bool Write(const std::string& fileName);
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	struct Metric
+	{
+		std::string        unit;
+		std::vector<float> samples;
+	};
+
+	std::mutex                    mMutex;
+	std::map<std::string, Metric> mMetrics; // Sorted by name, so files from different runs line up
+};
+
+
+// The file name with its extension (if any) replaced by .json
+std::string MetricsFileName(const std::string& fileName);
+
+
+extern PerfMetrics gPerfMetrics;
+
+
+#endif //_PERF_METRICS_H_INCLUDED_
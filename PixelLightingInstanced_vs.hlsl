@@ -0,0 +1,36 @@
+//--------------------------------------------------------------------------------------
+// Per-Pixel Lighting Vertex Shader, instanced
+//--------------------------------------------------------------------------------------
+// As PixelLighting_vs, but the world matrix comes from the instance buffer so many models can be drawn at once. Also passes
+// on each instance's material array slice for the instanced lighting pixel shaders
+
+#include "Instancing.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+InstancedLightingPixelShaderInput main(BasicVertex modelVertex, uint instanceID : SV_InstanceID)
+{
+    InstancedLightingPixelShaderInput output;
+
+    InstanceData instance = GetInstance(instanceID);
+    float4x4 worldMatrix = instance.worldMatrix;
+
+    // Usual transformations from model space to world, view and projection space
+    float4 modelPosition     = float4(modelVertex.position, 1);
+    float4 worldPosition     = mul(worldMatrix,       modelPosition);
+    float4 viewPosition      = mul(gViewMatrix,       worldPosition);
+    output.projectedPosition = mul(gProjectionMatrix, viewPosition);
+
+    // World space normal and position for the per-pixel lighting
+    float4 modelNormal   = float4(modelVertex.normal, 0);
+    output.worldNormal   = mul(worldMatrix, modelNormal).xyz;
+    output.worldPosition = worldPosition.xyz;
+
+    output.uv = modelVertex.uv;
+    output.textureSlice = instance.textureSlice;
+
+    return output;
+}
@@ -3,8 +3,11 @@
 //--------------------------------------------------------------------------------------
 // Pixel shader receives position and normal from the vertex shader and uses them to calculate
 // lighting per pixel. Also samples a samples a diffuse + specular texture map and combines with light colour.
+// Only the lights reaching the pixel's cluster are used (see Lighting.hlsli), or with OBJECT_LIGHTS defined to 1 only the
+// lights chosen for the model on the CPU (see AssignObjectLights in Scene.cpp)
+// With MATERIAL_ARRAY defined to 1 the texture is a slice of a material array, chosen per instance (see MaterialArrays.h)
 
-#include "Common.hlsli" // Shaders can also use include files - note the extension
+#include "Lighting.hlsli" // Shaders can also use include files - note the extension
 
 
 //--------------------------------------------------------------------------------------
@@ -14,7 +17,11 @@
 // Here we allow the shader access to a texture that has been loaded from the C++ side and stored in GPU memory.
 // Note that textures are often called maps (because texture mapping describes wrapping a texture round a mesh).
 // Get used to people using the word "texture" and "map" interchangably.
+#if MATERIAL_ARRAY
+Texture2DArray DiffuseSpecularMap : register(t0); // The textures of several models, each instance samples its own slice
+#else
 Texture2D DiffuseSpecularMap : register(t0); // Textures here can contain a diffuse map (main colour) in their rgb channels and a specular map (shininess) in the a channel
+#endif
 SamplerState TexSampler      : register(s0); // A sampler is a filter for a texture like bilinear, trilinear or anisotropic - this is the sampler used for the texture above
 
 
@@ -24,7 +31,11 @@ SamplerState TexSampler      : register(s0); // A sampler is a filter for a text
 
 // Pixel shader entry point - each shader has a "main" function
 // This shader just samples a diffuse texture map
+#if MATERIAL_ARRAY
+float4 main(InstancedLightingPixelShaderInput input) : SV_Target
+#else
 float4 main(LightingPixelShaderInput input) : SV_Target
+#endif
 {
     // Normal might have been scaled by model scaling or interpolation so renormalise
     input.worldNormal = normalize(input.worldNormal); 
@@ -35,37 +46,29 @@ float4 main(LightingPixelShaderInput input) : SV_Target
     // Direction from pixel to camera
     float3 cameraDirection = normalize(gCameraPosition - input.worldPosition);
 
-	//// Light 1 ////
+	// Sum the effect of the lights in this pixel's cluster - start with the ambient rather than adding it for each light (or we
+	// will get too much ambient)
+	float3 diffuseLight = gAmbientColour;
+	float3 specularLight = 0;
 
-	// Direction and distance from pixel to light
-	float3 light1Direction = normalize(gLight1Position - input.worldPosition);
-    float3 light1Dist = length(gLight1Position - input.worldPosition);
-    
-    // Equations from lighting lecture
-    float3 diffuseLight1 = gLight1Colour * max(dot(input.worldNormal, light1Direction), 0) / light1Dist; 
-    float3 halfway = normalize(light1Direction + cameraDirection);
-    float3 specularLight1 =  diffuseLight1 * pow(max(dot(input.worldNormal, halfway), 0), gSpecularPower); // Multiplying by diffuseLight instead of light colour - my own personal preference
-
-
-	//// Light 2 ////
-
-	float3 light2Direction = normalize(gLight2Position - input.worldPosition);
-    float3 light2Dist = length(gLight2Position - input.worldPosition);
-    float3 diffuseLight2 = gLight2Colour * max(dot(input.worldNormal, light2Direction), 0) / light2Dist; 
-    halfway = normalize(light2Direction + cameraDirection);
-    float3 specularLight2 =  diffuseLight2 * pow(max(dot(input.worldNormal, halfway), 0), gSpecularPower);
-
-
-	// Sum the effect of the lights - add the ambient at this stage rather than for each light (or we will get too much ambient)
-	float3 diffuseLight = gAmbientColour + diffuseLight1 + diffuseLight2;
-	float3 specularLight = specularLight1 + specularLight2;
+#if OBJECT_LIGHTS
+	AddObjectLights(input.worldPosition, input.worldNormal, cameraDirection, diffuseLight, specularLight);
+#else
+	float viewDepth = mul(gViewMatrix, float4(input.worldPosition, 1.0f)).z;
+	AddClusterLights(input.projectedPosition.xy, viewDepth, input.worldPosition, input.worldNormal, cameraDirection,
+	                 diffuseLight, specularLight);
+#endif
 
 
 	////////////////////
 	// Combine lighting and textures
 
     // Sample diffuse material and specular material colour for this pixel from a texture using a given sampler that you set up in the C++ code
+#if MATERIAL_ARRAY
+    float4 textureColour = DiffuseSpecularMap.Sample(TexSampler, float3(input.uv, input.textureSlice));
+#else
     float4 textureColour = DiffuseSpecularMap.Sample(TexSampler, input.uv);
+#endif
     float3 diffuseMaterialColour = textureColour.rgb; // Diffuse material colour in texture RGB (base colour of model)
     float specularMaterialColour = textureColour.a;   // Specular material colour in texture A (shininess of the surface)
 
@@ -0,0 +1,445 @@
+//--------------------------------------------------------------------------------------
+// Post-process graph
+//--------------------------------------------------------------------------------------
+// See PostProcessGraph.h for an overview
+
+#include "PostProcessGraph.h"
+#include "GpuProfiler.h"
+#include "StateCache.h"
+#include "Common.h"
+
+#include <algorithm>
+#include <climits>
+
+
+// Maximum number of input textures for a single pass
+const int MAX_PASS_INPUTS = 8;
+
+// Output and extra UAVs bound for a compute pass, see AddComputePass
+const int MAX_PASS_UAVS = 2;
+
+
+PostProcessGraph::~PostProcessGraph()
+{
+	ReleaseTargets();
+}
+
+
+// Start declaring a new graph, discarding the passes from the previous frame
+void PostProcessGraph::Begin(ID3D11ShaderResourceView* sceneSRV, ID3D11RenderTargetView* sceneTarget,
+                             ID3D11RenderTargetView* outputTarget, ID3D11PixelShader* copyShader)
+{
+	ReleaseTargets();
+	mTextures.clear();
+	mPasses.clear();
+	mOrder.clear();
+	mOutput = NO_TEXTURE;
+	mNumReducedRatePasses = 0;
+	mOutputTarget = outputTarget;
+	mCopyShader = copyShader;
+
+	// Get scene texture size and format from the texture itself
+	ID3D11Resource* sceneResource = nullptr;
+	ID3D11Texture2D* sceneTexture = nullptr;
+	D3D11_TEXTURE2D_DESC sceneDesc = {};
+	sceneSRV->GetResource(&sceneResource);
+	if (SUCCEEDED(sceneResource->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&sceneTexture))))
+	{
+		sceneTexture->GetDesc(&sceneDesc);
+		sceneTexture->Release();
+	}
+	sceneResource->Release();
+
+	mSceneWidth  = sceneDesc.Width;
+	mSceneHeight = sceneDesc.Height;
+
+	D3D11_RENDER_TARGET_VIEW_DESC outputDesc = {};
+	outputTarget->GetDesc(&outputDesc);
+	mOutputFormat = outputDesc.Format;
+
+	// The output can be a different size to the scene, the final pass is then a scaling copy
+	ID3D11Resource* outputResource = nullptr;
+	ID3D11Texture2D* outputTexture = nullptr;
+	D3D11_TEXTURE2D_DESC outputTextureDesc = sceneDesc;
+	outputTarget->GetResource(&outputResource);
+	if (SUCCEEDED(outputResource->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&outputTexture))))
+	{
+		outputTexture->GetDesc(&outputTextureDesc);
+		outputTexture->Release();
+	}
+	outputResource->Release();
+	mOutputWidth  = outputTextureDesc.Width;
+	mOutputHeight = outputTextureDesc.Height;
+
+	// The scene texture is always texture 0 and target 0
+	Target scene = { sceneTarget, sceneSRV, nullptr, mSceneWidth, mSceneHeight, sceneDesc.Format, 0, nullptr };
+	mTargets.push_back(scene);
+
+	Texture sceneTextureEntry = { 1.0f, sceneDesc.Format, -1, -1, 0, false, 0, 0, false };
+	mTextures.push_back(sceneTextureEntry);
+}
+
+
+// Declare an intermediate texture
+PostProcessTexture PostProcessGraph::CreateTexture(float scale /*= 1.0f*/, DXGI_FORMAT format /*= DXGI_FORMAT_R8G8B8A8_UNORM*/)
+{
+	Texture texture = { scale, format, -1, -1, -1, false, 0, 0, false };
+	mTextures.push_back(texture);
+	return static_cast<PostProcessTexture>(mTextures.size() - 1);
+}
+
+// Declare an intermediate texture of a fixed size
+PostProcessTexture PostProcessGraph::CreateFixedSizeTexture(int width, int height, DXGI_FORMAT format)
+{
+	Texture texture = { 1.0f, format, -1, -1, -1, false, width, height, false };
+	mTextures.push_back(texture);
+	return static_cast<PostProcessTexture>(mTextures.size() - 1);
+}
+
+// Declare a texture from outside the graph. Its target is never free, so no other texture is given it
+PostProcessTexture PostProcessGraph::ImportTexture(ID3D11ShaderResourceView* shaderResource, ID3D11RenderTargetView* renderTarget,
+                                                   int width, int height, DXGI_FORMAT format)
+{
+	Target target = { renderTarget, shaderResource, nullptr, width, height, format, INT_MAX, nullptr };
+	mTargets.push_back(target);
+
+	Texture texture = { 1.0f, format, -1, -1, static_cast<int>(mTargets.size() - 1), false, width, height, true };
+	mTextures.push_back(texture);
+	return static_cast<PostProcessTexture>(mTextures.size() - 1);
+}
+
+
+// Declare a full screen pass. Nothing is checked until Compile
+void PostProcessGraph::AddPass(const std::string& name, ID3D11PixelShader* shader,
+                               const std::vector<PostProcessTexture>& inputs, PostProcessTexture output, PassSetup setup /*= nullptr*/)
+{
+	Pass pass = { name, shader, nullptr, 0, 0, inputs, output, setup, nullptr };
+	mPasses.push_back(pass);
+}
+
+
+// Declare a full screen pass that tolerates a reduced rate. At a reduced rate it is drawn to a smaller texture, then a
+// reconstruction pass scales that up into the declared output
+void PostProcessGraph::AddReducedRatePass(const std::string& name, ID3D11PixelShader* shader,
+                                          const std::vector<PostProcessTexture>& inputs, PostProcessTexture output,
+                                          PassSetup setup /*= nullptr*/)
+{
+	if (mReducedRate == ShadingRate::Full || mReconstructShader == nullptr || inputs.empty() ||
+	    output <= 0 || output >= static_cast<int>(mTextures.size()))
+	{
+		AddPass(name, shader, inputs, output, setup);
+		return;
+	}
+
+	int width  = TextureWidth (mTextures[output]);
+	int height = TextureHeight(mTextures[output]);
+	if (mReducedRate == ShadingRate::Quarter)  height = (height + 1) / 2;
+	PostProcessTexture reduced = CreateFixedSizeTexture((width + 1) / 2, height, mTextures[output].format);
+	AddPass(name, shader, inputs, reduced, setup);
+	AddPass(name + " Reconstruct", mReconstructShader, { reduced, inputs[0] }, output);
+	++mNumReducedRatePasses;
+}
+
+
+// Declare a compute shader pass
+void PostProcessGraph::AddComputePass(const std::string& name, ID3D11ComputeShader* shader,
+                                      const std::vector<PostProcessTexture>& inputs, PostProcessTexture output,
+                                      unsigned int groupSizeX, unsigned int groupSizeY, PassSetup setup /*= nullptr*/)
+{
+	Pass pass = { name, nullptr, shader, groupSizeX, groupSizeY, inputs, output, setup, nullptr };
+	mPasses.push_back(pass);
+}
+
+
+// Declare a compute shader pass dispatched with DispatchIndirect
+void PostProcessGraph::AddIndirectComputePass(const std::string& name, ID3D11ComputeShader* shader,
+                                              const std::vector<PostProcessTexture>& inputs, PostProcessTexture output,
+                                              ID3D11Buffer* arguments, PassSetup setup /*= nullptr*/)
+{
+	Pass pass = { name, nullptr, shader, 1, 1, inputs, output, setup, arguments };
+	mPasses.push_back(pass);
+}
+
+
+// Order and cull the passes, then assign render targets. Call once after the passes for a frame have been declared
+bool PostProcessGraph::Compile()
+{
+	int numTextures = static_cast<int>(mTextures.size());
+	if (mOutput < 0 || mOutput >= numTextures)
+	{
+		gLastError = "Post-process graph has no output";
+		return false;
+	}
+
+	// Find which pass writes each texture. Each texture can only be written once and the scene texture never
+	for (int p = 0; p < static_cast<int>(mPasses.size()); ++p)
+	{
+		const Pass& pass = mPasses[p];
+		if (pass.output <= 0 || pass.output >= numTextures || mTextures[pass.output].producer != -1 ||
+		    (mTextures[pass.output].imported && (pass.computeShader != nullptr || mTargets[mTextures[pass.output].target].renderTarget == nullptr)))
+		{
+			gLastError = "Post-process pass " + pass.name + " has an invalid output";
+			return false;
+		}
+		if (static_cast<int>(pass.inputs.size()) > MAX_PASS_INPUTS)
+		{
+			gLastError = "Post-process pass " + pass.name + " has too many inputs";
+			return false;
+		}
+		for (auto input : pass.inputs)
+		{
+			if (input < 0 || input >= numTextures)
+			{
+				gLastError = "Post-process pass " + pass.name + " has an invalid input";
+				return false;
+			}
+		}
+		mTextures[pass.output].producer = p;
+		mTextures[pass.output].unorderedAccess = (pass.computeShader != nullptr);
+	}
+
+	// Work back from the output to find the passes that contribute to it, others are culled
+	std::vector<bool> required(mPasses.size(), false);
+	std::vector<PostProcessTexture> toVisit(1, mOutput);
+	while (!toVisit.empty())
+	{
+		PostProcessTexture texture = toVisit.back();
+		toVisit.pop_back();
+
+		int producer = mTextures[texture].producer;
+		if (producer == -1)
+		{
+			if (texture != SceneTexture() && !mTextures[texture].imported)
+			{
+				gLastError = "Post-process graph reads a texture that is never written";
+				return false;
+			}
+		}
+		else if (!required[producer])
+		{
+			required[producer] = true;
+			toVisit.insert(toVisit.end(), mPasses[producer].inputs.begin(), mPasses[producer].inputs.end());
+		}
+	}
+
+	// Order the required passes so each one runs after the passes writing its inputs. When there is a choice, the
+	// pass declared first goes first, so a simple chain of passes runs in the order it was declared
+	mOrder.clear();
+	std::vector<bool> done(mPasses.size(), false);
+	int numRequired = static_cast<int>(std::count(required.begin(), required.end(), true));
+	while (static_cast<int>(mOrder.size()) < numRequired)
+	{
+		int next = -1;
+		for (int p = 0; p < static_cast<int>(mPasses.size()) && next == -1; ++p)
+		{
+			if (!required[p] || done[p])  continue;
+
+			bool ready = true;
+			for (auto input : mPasses[p].inputs)
+			{
+				int producer = mTextures[input].producer;
+				if (producer != -1 && !done[producer])  ready = false;
+			}
+			if (ready)  next = p;
+		}
+		if (next == -1)
+		{
+			gLastError = "Post-process graph has a cycle";
+			return false;
+		}
+		done[next] = true;
+		mOrder.push_back(next);
+	}
+
+	// The final pass can write straight to the output target if its texture matches it and nothing else reads it. Otherwise
+	// (including when there are no passes at all, or the final pass is a compute pass) add a copy pass at the end
+	bool outputRead = false;
+	for (auto p : mOrder)
+	{
+		for (auto input : mPasses[p].inputs)
+		{
+			if (input == mOutput)  outputRead = true;
+		}
+	}
+	const Texture& output = mTextures[mOutput];
+	int finalTexture = mOutput;
+	if (mOutput == SceneTexture() || output.imported || outputRead || output.unorderedAccess || output.format != mOutputFormat ||
+	    TextureWidth(output) != mOutputWidth || TextureHeight(output) != mOutputHeight)
+	{
+		finalTexture = CreateTexture(1.0f, mOutputFormat);
+		AddPass("Copy to output", mCopyShader, { mOutput }, finalTexture);
+		mTextures[finalTexture].producer = static_cast<int>(mPasses.size() - 1);
+		mOrder.push_back(mTextures[finalTexture].producer);
+	}
+
+	// Find the last pass reading each texture, which is when its render target becomes free again
+	for (int i = 0; i < static_cast<int>(mOrder.size()); ++i)
+	{
+		for (auto input : mPasses[mOrder[i]].inputs)
+		{
+			mTextures[input].lastUse = i;
+		}
+	}
+
+	// Assign render targets in pass order. The scene texture is free once the scene has been read for the last time,
+	// unless there is no render target for it
+	mTargets[0].freeFrom = (mTargets[0].renderTarget != nullptr) ? mTextures[SceneTexture()].lastUse + 1 : INT_MAX;
+	for (int i = 0; i < static_cast<int>(mOrder.size()); ++i)
+	{
+		Texture& texture = mTextures[mPasses[mOrder[i]].output];
+		if (mPasses[mOrder[i]].output == finalTexture)
+		{
+			texture.target = -1; // Output target
+			continue;
+		}
+		if (texture.imported)  continue;
+
+		texture.target = AcquireTarget(TextureWidth(texture), TextureHeight(texture), texture.format, texture.unorderedAccess, i);
+		if (texture.target == -1)  return false;
+		mTargets[texture.target].freeFrom = std::max(texture.lastUse, i) + 1;
+	}
+	mNumTargets = static_cast<int>(mTargets.size());
+
+	return true;
+}
+
+
+// Find a target of the given size and format that is free at the given position in the pass order, creating one if needed
+int PostProcessGraph::AcquireTarget(int width, int height, DXGI_FORMAT format, bool unorderedAccess, int position)
+{
+	for (int t = 0; t < static_cast<int>(mTargets.size()); ++t)
+	{
+		const Target& target = mTargets[t];
+		if (target.width == width && target.height == height && target.format == format && target.freeFrom <= position &&
+		    (!unorderedAccess || target.unorderedAccess != nullptr))
+		{
+			return t;
+		}
+	}
+
+	// No target used so far this frame is available so get another from the pool
+	PooledTarget* pooled = gRenderTargetPool.Acquire(width, height, format, unorderedAccess ? RENDER_TARGET_UNORDERED_ACCESS : 0);
+	if (pooled == nullptr)  return -1;
+
+	Target target = { pooled->renderTarget, pooled->shaderResource, pooled->unorderedAccess, width, height, format, 0, pooled };
+	mTargets.push_back(target);
+	return static_cast<int>(mTargets.size() - 1);
+}
+
+
+// Run the compiled passes
+void PostProcessGraph::Execute(const PassSetup& commonSetup /*= nullptr*/)
+{
+	ID3D11ShaderResourceView* nullSRVs[MAX_PASS_INPUTS] = {};
+
+	D3D11_VIEWPORT vp;
+	vp.MinDepth = 0.0f;
+	vp.MaxDepth = 1.0f;
+	vp.TopLeftX = 0;
+	vp.TopLeftY = 0;
+
+	for (auto p : mOrder)
+	{
+		const Pass& pass = mPasses[p];
+		const Texture& output = mTextures[pass.output];
+		int outputWidth  = (output.target == -1) ? mOutputWidth  : TextureWidth(output);
+		int outputHeight = (output.target == -1) ? mOutputHeight : TextureHeight(output);
+		gGpuProfiler.SetTargetPixels(static_cast<UINT64>(outputWidth) * outputHeight);
+		gGpuProfiler.BeginTimer(pass.name);
+
+		ID3D11ShaderResourceView* inputs[MAX_PASS_INPUTS];
+		for (int i = 0; i < static_cast<int>(pass.inputs.size()); ++i)
+		{
+			inputs[i] = mTargets[mTextures[pass.inputs[i]].target].shaderResource;
+		}
+		UINT numInputs = static_cast<UINT>(pass.inputs.size());
+
+		// The size of the first input (or of the output if there are none) so shaders needn't call GetDimensions, and
+		// uvs across the whole of the inputs. The pass's setup can change the uvs to read only part of them
+		const Texture& sized = pass.inputs.empty() ? output : mTextures[pass.inputs[0]];
+		int sizedWidth  = (sized.target == -1) ? mOutputWidth  : TextureWidth(sized);
+		int sizedHeight = (sized.target == -1) ? mOutputHeight : TextureHeight(sized);
+		gPostProcessingConstants.inputSize    = { static_cast<float>(sizedWidth), static_cast<float>(sizedHeight) };
+		gPostProcessingConstants.texelSize    = { 1.0f / sizedWidth, 1.0f / sizedHeight };
+		gPostProcessingConstants.passUVScale  = { 1.0f, 1.0f };
+		gPostProcessingConstants.passUVOffset = { 0.0f, 0.0f };
+
+		if (pass.computeShader != nullptr)
+		{
+			// The output may have been a render target in an earlier pass, it can't be bound as both
+			gD3DContext->OMSetRenderTargets(0, nullptr, nullptr);
+
+			ID3D11UnorderedAccessView* outputUAV = mTargets[output.target].unorderedAccess;
+			if (gD3DContext1 && pass.indirectArguments == nullptr)  gD3DContext1->DiscardView(outputUAV); // Cleared below otherwise
+			gStateCache.CSSetShader(pass.computeShader, nullptr, 0);
+			gD3DContext->CSSetShaderResources(0, numInputs, inputs);
+			gD3DContext->CSSetUnorderedAccessViews(0, 1, &outputUAV, nullptr);
+
+			if (pass.setup)   pass.setup();
+			if (commonSetup)  commonSetup();
+
+			if (pass.indirectArguments != nullptr)
+			{
+				// Only the groups listed on the GPU run, the rest of the output is left black
+				const FLOAT zero[4] = { 0, 0, 0, 0 };
+				gD3DContext->ClearUnorderedAccessViewFloat(outputUAV, zero);
+				gD3DContext->DispatchIndirect(pass.indirectArguments, 0);
+			}
+			else
+			{
+				// One thread per output pixel, rounding up the number of groups. A group size of 0 means a single group
+				// covers that whole dimension, looping over the pixels itself
+				UINT width  = TextureWidth(output);
+				UINT height = TextureHeight(output);
+				UINT groupsX = (pass.groupSizeX == 0) ? 1 : (width  + pass.groupSizeX - 1) / pass.groupSizeX;
+				UINT groupsY = (pass.groupSizeY == 0) ? 1 : (height + pass.groupSizeY - 1) / pass.groupSizeY;
+				gD3DContext->Dispatch(groupsX, groupsY, 1);
+			}
+
+			// Unbind the inputs and output, and anything the setup bound, so they can be used by later passes
+			ID3D11UnorderedAccessView* nullUAVs[MAX_PASS_UAVS] = {};
+			gD3DContext->CSSetShaderResources(0, MAX_PASS_INPUTS, nullSRVs);
+			gD3DContext->CSSetUnorderedAccessViews(0, MAX_PASS_UAVS, nullUAVs, nullptr);
+			gGpuProfiler.EndTimer();
+			continue;
+		}
+
+		// Post-processes don't use the depth buffer, and it may not match the size of the target anyway
+		ID3D11RenderTargetView* renderTarget = (output.target == -1) ? mOutputTarget : mTargets[output.target].renderTarget;
+		if (gD3DContext1)  gD3DContext1->DiscardView(renderTarget);
+		gD3DContext->OMSetRenderTargets(1, &renderTarget, nullptr);
+		vp.Width  = static_cast<FLOAT>(outputWidth);
+		vp.Height = static_cast<FLOAT>(outputHeight);
+		gD3DContext->RSSetViewports(1, &vp);
+
+		gStateCache.PSSetShader(pass.shader, nullptr, 0);
+		gD3DContext->PSSetShaderResources(0, numInputs, inputs);
+
+		if (pass.setup)   pass.setup();
+		if (commonSetup)  commonSetup();
+
+		gD3DContext->Draw(3, 0); // One triangle covering the target, see FullScreenQuad_pp.hlsl
+
+		// Unbind the inputs so they can be used as render targets by later passes
+		gD3DContext->PSSetShaderResources(0, numInputs, nullSRVs);
+		gGpuProfiler.EndTimer();
+	}
+
+	// Leave the viewport at the full scene size
+	vp.Width  = static_cast<FLOAT>(mSceneWidth);
+	vp.Height = static_cast<FLOAT>(mSceneHeight);
+	gD3DContext->RSSetViewports(1, &vp);
+
+	ReleaseTargets();
+}
+
+
+// Return the render targets to the pool. The scene texture belongs to the caller so is not returned
+void PostProcessGraph::ReleaseTargets()
+{
+	for (auto& target : mTargets)
+	{
+		if (target.pooled)  gRenderTargetPool.Return(target.pooled);
+	}
+	mTargets.clear();
+}
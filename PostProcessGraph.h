@@ -0,0 +1,218 @@
+//--------------------------------------------------------------------------------------
+// Post-process graph
+//--------------------------------------------------------------------------------------
+// Post-processes are declared each frame as a set of passes. Each pass names the textures it reads
+// and the single texture it writes, along with the resolution scale of that texture. Passes are either
+// full screen pixel shader passes or compute shader passes that write their output as a UAV. Compile puts
+// the passes in dependency order, drops any pass whose result never reaches the graph output and
+// maps the declared textures onto as few real render targets as possible - a render target is
+// reused as soon as the last pass reading its current contents has run. The render targets come from
+// gRenderTargetPool and are returned to it after Execute, so they can be shared with other rendering.
+//
+// Passes whose result is smooth (e.g. wide blurs) can be declared as tolerating a reduced rate. When SetReducedRate has
+// chosen one, they are drawn to a texture of a half or a quarter of the pixels - the 2x1 and 2x2 coarse rates of
+// variable rate shading, without needing the hardware or vendor extensions for it - and a reconstruction pass scales
+// the result back up, guided by the pass's first input so its edges stay sharp.
+//
+// Every pass writes the whole of its output, so the old contents of a target are discarded (DiscardView, D3D11.1) before
+// each pass writes it. Tiled and integrated GPUs would otherwise load them into tile memory to be kept, as the driver
+// can't tell they are about to be overwritten.
+
+#ifndef _POST_PROCESS_GRAPH_H_INCLUDED_
+#define _POST_PROCESS_GRAPH_H_INCLUDED_
+
+#include "RenderTargetPool.h"
+
+#include <d3d11.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Textures in the graph are referred to by index. They are only "virtual" until Compile maps them to render targets
+typedef int PostProcessTexture;
+const PostProcessTexture NO_TEXTURE = -1;
+
+// Pixels shaded by the passes that tolerate a reduced rate
+enum class ShadingRate
+{
+	Full,    // Every pixel
+	Half,    // One pixel in each 2x1 block, half width
+	Quarter, // One pixel in each 2x2 block, half width and height
+};
+
+
+class PostProcessGraph
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Called just before a pass is drawn - set any constants or extra textures / samplers the pass needs
+	typedef std::function<void()> PassSetup;
+
+	~PostProcessGraph();
+
+
+	// Start declaring a new graph. The scene has been rendered to the given scene texture (available as SceneTexture()),
+	// and the graph output will be written to outputTarget. The copy shader is used if the output can't be written directly,
+	// including when outputTarget is a different size to the scene. sceneTarget can be null if the scene texture can't be
+	// rendered to, it is then never reused for intermediate textures
+	void Begin(ID3D11ShaderResourceView* sceneSRV, ID3D11RenderTargetView* sceneTarget,
+	           ID3D11RenderTargetView* outputTarget, ID3D11PixelShader* copyShader);
+
+	// The texture holding the rendered scene
+	PostProcessTexture SceneTexture()  { return 0; }
+
+	// Declare an intermediate texture. Scale is relative to the scene texture, e.g. 0.5f for half width and height
+	PostProcessTexture CreateTexture(float scale = 1.0f, DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM);
+
+	// Declare an intermediate texture of a fixed size in pixels, whatever the size of the scene (e.g. for an FFT)
+	PostProcessTexture CreateFixedSizeTexture(int width, int height, DXGI_FORMAT format);
+
+	// Declare a texture that lives outside the graph, e.g. a history kept from one frame to the next. A graph can either
+	// read its contents from before the graph ran or write it with a pixel shader pass, not both. What is written stays in
+	// it after Execute. Never reused for other textures
+	PostProcessTexture ImportTexture(ID3D11ShaderResourceView* shaderResource, ID3D11RenderTargetView* renderTarget,
+	                                 int width, int height, DXGI_FORMAT format);
+
+	// Declare a full screen pass with the given pixel shader. Inputs are bound to t0, t1... in the order given. The size of
+	// the first input is in the post-processing constants (texelSize, inputSize), and the setup can set passUVScale /
+	// passUVOffset to read only part of the inputs
+	void AddPass(const std::string& name, ID3D11PixelShader* shader,
+	             const std::vector<PostProcessTexture>& inputs, PostProcessTexture output, PassSetup setup = nullptr);
+
+	// Declare a full screen pass that tolerates a reduced rate, its result is smooth enough to be scaled up without visible
+	// loss. Otherwise as AddPass. The shader must work from the uv rather than the pixel position
+	void AddReducedRatePass(const std::string& name, ID3D11PixelShader* shader,
+	                        const std::vector<PostProcessTexture>& inputs, PostProcessTexture output, PassSetup setup = nullptr);
+
+	// Set the rate of the passes declared with AddReducedRatePass from now on, and the shader scaling up their results
+	// (reading the reduced result at t0 and the pass's first input at t1). Stays set for later graphs
+	void SetReducedRate(ShadingRate rate, ID3D11PixelShader* reconstructShader)  { mReducedRate = rate;  mReconstructShader = reconstructShader; }
+
+	// Declare a compute shader pass. Inputs are bound to t0, t1... and the output to u0. One thread is run for each output
+	// pixel, with the given number of threads per group in x and y (must match the numthreads of the shader), or 1 for
+	// shaders running a whole group for each output pixel. A group size of 0 dispatches a single group along that
+	// direction, for shaders that loop over a whole row or column (e.g. prefix sums). The setup can bind extra resources
+	// in the slots after the inputs up to t7, and in u1. They are unbound along with the inputs and output after the pass
+	void AddComputePass(const std::string& name, ID3D11ComputeShader* shader,
+	                    const std::vector<PostProcessTexture>& inputs, PostProcessTexture output,
+	                    unsigned int groupSizeX, unsigned int groupSizeY, PassSetup setup = nullptr);
+
+	// Declare a compute shader pass whose number of groups is read from a buffer on the GPU (three UINTs, see
+	// DispatchIndirect), e.g. one group for each tile in a list built by an earlier pass. The groups needn't cover the
+	// whole output, which is cleared to zero first. Bound as AddComputePass
+	void AddIndirectComputePass(const std::string& name, ID3D11ComputeShader* shader,
+	                            const std::vector<PostProcessTexture>& inputs, PostProcessTexture output,
+	                            ID3D11Buffer* arguments, PassSetup setup = nullptr);
+
+	// Select the texture that ends up in the output target
+	void SetOutput(PostProcessTexture texture)  { mOutput = texture; }
+
+
+	// Order and cull the passes, then assign render targets. Returns false on error (reason in gLastError)
+	bool Compile();
+
+	// Run the compiled passes. The common setup function is called after each pass's own setup (e.g. to upload constants).
+	// Each pass is timed by the GPU profiler under its name. The render targets are returned to the pool afterwards
+	void Execute(const PassSetup& commonSetup = nullptr);
+
+
+	// Return any render targets the graph is holding to the pool (only needed if Compile is not followed by Execute)
+	void ReleaseTargets();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// Statistics for the most recent Compile
+	int NumPasses()   { return static_cast<int>(mOrder.size()); }  // Passes that will run, after culling
+	int NumTargets()  { return mNumTargets; } // Render targets used, including the scene texture
+	int NumReducedRatePasses()  { return mNumReducedRatePasses; } // Passes declared at a reduced rate
+
+	// Size of the scene texture given to Begin
+	int SceneWidth()   { return mSceneWidth; }
+	int SceneHeight()  { return mSceneHeight; }
+
+	// Size in pixels and format of a declared texture
+	int Width (PostProcessTexture texture)  { return TextureWidth (mTextures[texture]); }
+	int Height(PostProcessTexture texture)  { return TextureHeight(mTextures[texture]); }
+	DXGI_FORMAT Format(PostProcessTexture texture)  { return mTextures[texture].format; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	struct Texture
+	{
+		float       scale;
+		DXGI_FORMAT format;
+		int         producer; // Pass that writes this texture, -1 if none
+		int         lastUse;  // Position in mOrder of the last pass that reads it
+		int         target;   // Index into mTargets, -1 for the graph output
+		bool        unorderedAccess; // Written by a compute pass so needs a UAV
+		int         width;    // Fixed size in pixels, 0 to size by scale
+		int         height;
+		bool        imported; // Declared with ImportTexture, its target is set from the start
+	};
+
+	struct Pass
+	{
+		std::string                     name;
+		ID3D11PixelShader*              shader;
+		ID3D11ComputeShader*            computeShader; // Used instead of the pixel shader if not null
+		unsigned int                    groupSizeX;
+		unsigned int                    groupSizeY;
+		std::vector<PostProcessTexture> inputs;
+		PostProcessTexture              output;
+		PassSetup                       setup;
+		ID3D11Buffer*                   indirectArguments; // Compute passes dispatched with DispatchIndirect
+	};
+
+	// A real render target, acquired from the render target pool. The first one is always the scene texture, which
+	// belongs to the caller
+	struct Target
+	{
+		ID3D11RenderTargetView*    renderTarget;
+		ID3D11ShaderResourceView*  shaderResource;
+		ID3D11UnorderedAccessView* unorderedAccess; // Only present for targets written by compute passes
+		int                        width;
+		int                        height;
+		DXGI_FORMAT                format;
+		int                        freeFrom; // Position in mOrder from which this target can be written again
+		PooledTarget*              pooled;   // Null for the scene texture
+	};
+
+	// Find a target of the given size and format that is free at the given position, getting one from the pool if needed. -1 on error
+	int AcquireTarget(int width, int height, DXGI_FORMAT format, bool unorderedAccess, int position);
+
+	int TextureWidth (const Texture& texture)  { return texture.width  > 0 ? texture.width  : static_cast<int>(mSceneWidth  * texture.scale + 0.5f); }
+	int TextureHeight(const Texture& texture)  { return texture.height > 0 ? texture.height : static_cast<int>(mSceneHeight * texture.scale + 0.5f); }
+
+
+	std::vector<Texture> mTextures;
+	std::vector<Pass>    mPasses;
+	std::vector<int>     mOrder; // Indexes of passes to run, in order
+	std::vector<Target>  mTargets;
+
+	PostProcessTexture mOutput = NO_TEXTURE;
+	int                mNumTargets = 0;
+
+	ShadingRate        mReducedRate = ShadingRate::Full;
+	ID3D11PixelShader* mReconstructShader = nullptr;
+	int                mNumReducedRatePasses = 0;
+
+	ID3D11RenderTargetView* mOutputTarget = nullptr;
+	ID3D11PixelShader*      mCopyShader   = nullptr;
+	int                     mSceneWidth   = 0;
+	int                     mSceneHeight  = 0;
+	DXGI_FORMAT             mOutputFormat = DXGI_FORMAT_UNKNOWN;
+	int                     mOutputWidth  = 0;
+	int                     mOutputHeight = 0;
+};
+
+
+#endif //_POST_PROCESS_GRAPH_H_INCLUDED_
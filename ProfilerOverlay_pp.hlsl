@@ -0,0 +1,33 @@
+//--------------------------------------------------------------------------------------
+// GPU Profiler Overlay Pixel Shader
+//--------------------------------------------------------------------------------------
+// Draws the GPU profiler timings as a bar chart, one row per timer. Drawn with the full screen quad vertex
+// shader into a small viewport in the corner of the screen
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	const float3 background = 0.1f;
+	
+	float rows = input.uv.y * gNumProfilerBars;
+	int   bar  = min((int)rows, gNumProfilerBars - 1);
+	float row  = frac(rows);
+	
+	// Gap between rows
+	if (row < 0.15f || row > 0.85f)  return float4(background * 0.5f, 1.0f);
+	
+	// Nested timers are indented, the bar is a fraction of the overlay width
+	float x = input.uv.x - gProfilerBars[bar].y * 0.02f;
+	if (x < 0 || x > gProfilerBars[bar].x)  return float4(background, 1.0f);
+	
+	// Different hue for each bar so neighbouring bars can be told apart
+	float  hue    = frac(bar * 0.618034f);
+	float3 colour = saturate(abs(frac(hue + float3(0, 2.0f / 3, 1.0f / 3)) * 6 - 3) - 1);
+	return float4(colour * 0.8f + 0.2f, 1.0f);
+}
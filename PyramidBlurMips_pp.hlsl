@@ -0,0 +1,41 @@
+//--------------------------------------------------------------------------------------
+// Mip Chain Pyramid Blur Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Pyramid blur read from the mip chain of the scene texture, built by GenerateMips just before this pass. Each mip is
+// a 2x2 box filter of the one above, so reading at a fractional level of detail with trilinear filtering gives a blur
+// of any width for the same few taps. The level can vary across the screen: it blends from gPyramidBlurLevel at the
+// centre to gPyramidBlurEdgeLevel at the corners (the same at both for an even blur), and a per-pixel level from depth
+// would give depth of field. Four taps half a texel apart at the chosen level smooth out the blocks of the small mips
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    SceneTexture   : register(t0); // All mips of the scene texture
+SamplerState PointSample    : register(s0);
+SamplerState BilinearSample : register(s1); // Also filters between mips
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	float width, height, numLevels;
+	SceneTexture.GetDimensions(0, width, height, numLevels);
+
+	float edge = saturate(distance(input.uv, 0.5f) / 0.7071f);
+	float level = clamp(lerp(gPyramidBlurLevel, gPyramidBlurEdgeLevel, edge * edge), 0, numLevels - 1);
+
+	float2 halfTexel = 0.5f * exp2(level) / float2(width, height); // Half a pixel of the level read
+	float3 colour = SceneTexture.SampleLevel(BilinearSample, input.uv + halfTexel * float2(-1, -1), level).rgb +
+	                SceneTexture.SampleLevel(BilinearSample, input.uv + halfTexel * float2( 1, -1), level).rgb +
+	                SceneTexture.SampleLevel(BilinearSample, input.uv + halfTexel * float2(-1,  1), level).rgb +
+	                SceneTexture.SampleLevel(BilinearSample, input.uv + halfTexel * float2( 1,  1), level).rgb;
+
+	return float4(colour * 0.25f, 1.0f);
+}
@@ -18,12 +18,8 @@ SamplerState PointSample : register(s0); // We don't usually want to filter (bil
 // Post-processing shader that tints the scene texture to a given colour
 float4 main(PostProcessingInput input) : SV_Target
 {
-	float width;
-	float height;
-	SceneTexture.GetDimensions(width, height);
-	
-	float w = 1 / width;
-	float h = 1 / height;
+	float w = gTexelSize.x;
+	float h = gTexelSize.y;
 	
 	
 	
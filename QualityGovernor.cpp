@@ -0,0 +1,143 @@
+//--------------------------------------------------------------------------------------
+// Effect quality governor
+//--------------------------------------------------------------------------------------
+// See QualityGovernor.h for an overview
+
+#include "QualityGovernor.h"
+#include "Common.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+
+QualityGovernor gQualityGovernor;
+
+const float QualityGovernor::HEADROOM      = 0.85f;
+const int   QualityGovernor::SETTLE_FRAMES = 8;
+const int   QualityGovernor::LOG_SIZE      = 8;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+int QualityGovernor::AddKnob(const std::string& name, int numLevels, const std::vector<std::string>& passPrefixes)
+{
+	Knob knob;
+	knob.name         = name;
+	knob.numLevels    = std::max(numLevels, 1);
+	knob.passPrefixes = passPrefixes;
+	mKnobs.push_back(knob);
+	return static_cast<int>(mKnobs.size()) - 1;
+}
+
+
+void QualityGovernor::Enable(float budgetMilliseconds)
+{
+	mEnabled = true;
+	mBudget = budgetMilliseconds;
+	mSmoothedMilliseconds = 0.0f;
+	mFramesSinceChange = 0;
+}
+
+void QualityGovernor::Disable()
+{
+	mEnabled = false;
+	for (auto& knob : mKnobs)  knob.level = 0;
+	mLowered.clear();
+}
+
+
+// Lower or raise one knob if the frame time calls for it
+void QualityGovernor::Update(float gpuMilliseconds, const std::vector<GpuProfiler::Timing>& timings, bool mayLower /*= true*/)
+{
+	if (!mEnabled)  return;
+	if (gpuMilliseconds <= 0.0f)  return; // No timings yet
+
+	// Smooth out single frame spikes, but start from the first timing seen
+	if (mSmoothedMilliseconds <= 0.0f)  mSmoothedMilliseconds = gpuMilliseconds;
+	else                                mSmoothedMilliseconds += 0.1f * (gpuMilliseconds - mSmoothedMilliseconds);
+
+	++mFramesSinceChange;
+	if (mFramesSinceChange < SETTLE_FRAMES)  return;
+
+	std::ostringstream decision;
+	decision << std::fixed << std::setprecision(1);
+	if (mSmoothedMilliseconds > mBudget && mayLower)
+	{
+		// Lower the most expensive knob that has a level left. Knobs whose passes didn't run this frame cost nothing, so
+		// the effects that are off are never lowered
+		int   chosen = -1;
+		float chosenMilliseconds = 0.0f;
+		for (int k = 0; k < NumKnobs(); ++k)
+		{
+			if (mKnobs[k].level >= mKnobs[k].numLevels - 1)  continue;
+			float milliseconds = KnobMilliseconds(k, timings);
+			if (milliseconds > chosenMilliseconds)
+			{
+				chosen = k;
+				chosenMilliseconds = milliseconds;
+			}
+		}
+		if (chosen < 0)  return;
+
+		Knob& knob = mKnobs[chosen];
+		++knob.level;
+		mLowered.push_back({ chosen, chosenMilliseconds });
+		decision << "Quality governor: " << mSmoothedMilliseconds << "ms over the " << mBudget << "ms budget, lowered "
+		         << knob.name << " to level " << knob.level << " of " << knob.numLevels - 1 << " (its passes took "
+		         << chosenMilliseconds << "ms)";
+	}
+	else if (mSmoothedMilliseconds < mBudget * HEADROOM && !mLowered.empty())
+	{
+		// Raise the knob lowered last if the time it saved would fit back within the headroom
+		Lowering lowering = mLowered.back();
+		Knob& knob = mKnobs[lowering.knob];
+		float saved = std::max(lowering.milliseconds - KnobMilliseconds(lowering.knob, timings), 0.0f);
+		if (mSmoothedMilliseconds + saved >= mBudget * HEADROOM)  return;
+
+		--knob.level;
+		mLowered.pop_back();
+		decision << "Quality governor: " << mSmoothedMilliseconds << "ms within the " << mBudget << "ms budget, raised "
+		         << knob.name << " to level " << knob.level << " (expected to cost " << saved << "ms more)";
+	}
+	else
+	{
+		return;
+	}
+
+	mFramesSinceChange = 0;
+	++mNumChanges;
+	LogDecision(decision.str());
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+float QualityGovernor::KnobMilliseconds(int knob, const std::vector<GpuProfiler::Timing>& timings)
+{
+	float milliseconds = 0.0f;
+	for (auto& timing : timings)
+	{
+		for (auto& prefix : mKnobs[knob].passPrefixes)
+		{
+			if (timing.name.compare(0, prefix.size(), prefix) == 0)
+			{
+				milliseconds += timing.milliseconds;
+				break;
+			}
+		}
+	}
+	return milliseconds;
+}
+
+
+void QualityGovernor::LogDecision(const std::string& decision)
+{
+	OutputDebugStringA((decision + "\n").c_str());
+	mLog.push_back(decision);
+	if (static_cast<int>(mLog.size()) > LOG_SIZE)  mLog.erase(mLog.begin());
+}
@@ -0,0 +1,110 @@
+//--------------------------------------------------------------------------------------
+// Effect quality governor
+//--------------------------------------------------------------------------------------
+// Lowers the quality of the post-processing effects when the GPU frame time goes over a budget, and raises it again
+// when there is time to spare. Each effect declares its quality knobs with AddKnob: a name, the number of levels (0 is
+// full quality, each level after it is cheaper) and the names of the GPU profiler timers of its passes (see
+// PostProcessGraph.h, matched by prefix). The scene reads each knob's level when it fills in the effect settings.
+//
+// Over budget, the knob whose passes took the most GPU time is lowered one level, so the effects costing the most give
+// way first. Under budget, the knob lowered most recently is raised again, but only once the frame time is well inside
+// the budget and would still be with the time that knob saved added back on, so a knob isn't raised just to be lowered
+// again a few frames later. The timings are a few frames old (see GpuProfiler.h), so after each change the governor
+// waits for it to show up in them. Every change is logged with the frame time and pass times it was based on
+
+#ifndef _QUALITY_GOVERNOR_H_INCLUDED_
+#define _QUALITY_GOVERNOR_H_INCLUDED_
+
+#include "GpuProfiler.h"
+
+#include <string>
+#include <vector>
+
+
+class QualityGovernor
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Declare a quality knob with the given number of levels, timed by the GPU timers whose names start with any of the
+	// given prefixes. Returns its index for Level. Starts at full quality
+	int AddKnob(const std::string& name, int numLevels, const std::vector<std::string>& passPrefixes);
+
+	// Start adjusting the knobs to keep the GPU frame time within the given budget in milliseconds
+	void Enable(float budgetMilliseconds);
+
+	// Put every knob back to full quality
+	void Disable();
+
+	// Call once per frame with the most recent GPU frame time and timings. With mayLower false the knobs can only be
+	// raised, e.g. while another control (dynamic resolution) still has room to hold the budget itself
+	void Update(float gpuMilliseconds, const std::vector<GpuProfiler::Timing>& timings, bool mayLower = true);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	bool  Enabled()  { return mEnabled; }
+	float Budget()   { return mBudget;  }
+
+	// Current level of a knob, 0 for full quality
+	int Level(int knob)  { return mKnobs[knob].level; }
+
+	int                NumKnobs()              { return static_cast<int>(mKnobs.size()); }
+	const std::string& KnobName(int knob)      { return mKnobs[knob].name; }
+	int                NumKnobLevels(int knob) { return mKnobs[knob].numLevels; }
+	int                NumLowered()            { return static_cast<int>(mLowered.size()); } // Levels below full quality in total
+	int                NumChanges()            { return mNumChanges; }
+
+	// The most recent decisions, oldest first
+	const std::vector<std::string>& Log()  { return mLog; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const float HEADROOM;      // Only raise a knob if the frame time is below this fraction of the budget
+	static const int   SETTLE_FRAMES; // Frames to wait after a change before changing again
+	static const int   LOG_SIZE;      // Decisions kept for Log
+
+	// GPU time in the timings spent in a knob's passes
+	float KnobMilliseconds(int knob, const std::vector<GpuProfiler::Timing>& timings);
+
+	// Note a decision in the log and the debugger output
+	void LogDecision(const std::string& decision);
+
+	struct Knob
+	{
+		std::string              name;
+		int                      numLevels;
+		std::vector<std::string> passPrefixes;
+		int                      level = 0;
+	};
+
+	// A knob lowered by one level, and the time its passes took just before
+	struct Lowering
+	{
+		int   knob;
+		float milliseconds;
+	};
+
+	std::vector<Knob>        mKnobs;
+	std::vector<Lowering>    mLowered; // Most recent last, raised in reverse order
+	std::vector<std::string> mLog;
+
+	bool  mEnabled = false;
+	float mBudget  = 15.0f;
+	float mSmoothedMilliseconds = 0.0f; // Exponential moving average of the GPU frame time
+	int   mFramesSinceChange    = 0;
+	int   mNumChanges           = 0;
+};
+
+
+extern QualityGovernor gQualityGovernor;
+
+
+#endif //_QUALITY_GOVERNOR_H_INCLUDED_
@@ -0,0 +1,57 @@
+//--------------------------------------------------------------------------------------
+// Reduced Rate Reconstruction Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Scales up the result of a pass drawn at a reduced rate (see PostProcessGraph.h) with a joint bilateral upsample: the
+// four nearest reduced pixels are blended as a bilinear filter would, but each is weighted down the more the pass's
+// input around it differs from the input at this pixel. So where the input has an edge, the result is taken from the
+// side of the edge this pixel is on rather than smeared across it
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    ReducedTexture : register(t0); // The pass's result at the reduced rate
+Texture2D    GuideTexture   : register(t1); // The pass's first input, at full rate
+SamplerState PointSample    : register(s0);
+SamplerState BilinearSample : register(s1);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// How quickly a difference in the input turns a reduced pixel's weight down (by the square of the RGB distance)
+static const float EDGE_SHARPNESS = 40;
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	float2 size = gInputSize;
+
+	// The reduced pixels around this one and how far between them it is
+	float2 position = input.uv * size - 0.5f;
+	int2   base     = (int2)floor(position);
+	float2 fraction = position - base;
+
+	float3 centre = GuideTexture.Sample(PointSample, input.uv).rgb;
+	float3 colour = 0;
+	float  total  = 0;
+	for (int y = 0; y <= 1; ++y)
+	{
+		for (int x = 0; x <= 1; ++x)
+		{
+			int2  pixel = clamp(base + int2(x, y), 0, int2(size) - 1);
+			float bilinear = (x ? fraction.x : 1 - fraction.x) * (y ? fraction.y : 1 - fraction.y);
+
+			// The input averaged over the area the reduced pixel covers, filtering gives that for 2x1 and 2x2 blocks
+			float3 guide = GuideTexture.Sample(BilinearSample, (pixel + 0.5f) / size).rgb - centre;
+			float  weight = bilinear * exp(-dot(guide, guide) * EDGE_SHARPNESS) + 0.0001f; // Never all zero
+
+			colour += ReducedTexture.Load(int3(pixel, 0)).rgb * weight;
+			total  += weight;
+		}
+	}
+	return float4(colour / total, 1.0f);
+}
@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+// Render queue
+//--------------------------------------------------------------------------------------
+
+#include "RenderQueue.h"
+
+#include <cstring>
+
+
+// Least significant digit radix sort on the keys, 8 bits at a time. Passes where every key has the same digit are
+// skipped - most keys share their pass and state bits, and the unused top bits are always zero
+void RenderQueue::Sort()
+{
+	if (mItems.size() < 2)  return;
+	mScratch.resize(mItems.size());
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		unsigned int counts[256];
+		std::memset(counts, 0, sizeof(counts));
+		for (auto& item : mItems)  ++counts[(item.key >> shift) & 0xff];
+
+		// Nothing to do if all the keys fall in one bucket
+		if (counts[(mItems[0].key >> shift) & 0xff] == mItems.size())  continue;
+
+		// Turn the counts into the first position for each bucket, then scatter into the scratch buffer
+		unsigned int position = 0;
+		for (auto& count : counts)
+		{
+			unsigned int bucketSize = count;
+			count = position;
+			position += bucketSize;
+		}
+		for (auto& item : mItems)  mScratch[counts[(item.key >> shift) & 0xff]++] = item;
+
+		mItems.swap(mScratch);
+	}
+}
+
+
+uint64_t RenderQueue::OpaqueKey(unsigned int pass, unsigned int state, const void* texture, const void* mesh, float depth, float farDepth)
+{
+	return (static_cast<uint64_t>(pass  & 0xf)  << 60) |
+	       (static_cast<uint64_t>(state & 0xff) << 52) |
+	       (ResourceId(texture) << 40) |
+	       (ResourceId(mesh)    << 28) |
+	       (QuantiseDepth(depth, farDepth) << 4);
+}
+
+uint64_t RenderQueue::BlendedKey(unsigned int pass, unsigned int state, const void* texture, const void* mesh, float depth, float farDepth)
+{
+	return (static_cast<uint64_t>(pass  & 0xf)  << 60) |
+	       (static_cast<uint64_t>(state & 0xff) << 52) |
+	       ((DEPTH_MASK - QuantiseDepth(depth, farDepth)) << 28) | // Back to front
+	       (ResourceId(texture) << 16) |
+	       (ResourceId(mesh)    << 4);
+}
+
+
+uint64_t RenderQueue::ResourceId(const void* resource)
+{
+	auto id = mResourceIds.find(resource);
+	if (id == mResourceIds.end())
+	{
+		id = mResourceIds.emplace(resource, static_cast<unsigned int>(mResourceIds.size())).first;
+	}
+	return id->second & ID_MASK;
+}
+
+uint64_t RenderQueue::QuantiseDepth(float depth, float farDepth)
+{
+	if (!(depth > 0) || farDepth <= 0)  return 0; // Also catches NaN
+	if (depth >= farDepth)              return DEPTH_MASK;
+	return static_cast<uint64_t>(depth / farDepth * DEPTH_MASK);
+}
@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------------------------
+// Render queue
+//--------------------------------------------------------------------------------------
+// Draws are added to the queue with a 64-bit sort key and the index of the draw in the caller's own list. Sort puts
+// them in key order with a radix sort, so draws that need the same state end up next to each other and the state
+// cache can drop the repeated Set calls between them. The key holds, from the most significant bits down:
+//   pass (4 bits) - draws for earlier passes come first
+//   state (8 bits) - shaders / blend state selected by the caller
+//   then for opaque draws:   texture (12 bits), mesh (12 bits), depth (24 bits) - nearest first, for early-Z
+//   or for blended draws:    depth (24 bits, furthest first), texture (12 bits), mesh (12 bits)
+// Textures and meshes are given small ids the first time they are seen. Ids are kept between frames so the order
+// stays stable while nothing changes
+
+#ifndef _RENDER_QUEUE_H_INCLUDED_
+#define _RENDER_QUEUE_H_INCLUDED_
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+class RenderQueue
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	struct Item
+	{
+		uint64_t     key;
+		unsigned int index; // Index of the draw in the caller's list
+	};
+
+	// Remove all the draws, ready to fill the queue again. The texture and mesh ids are kept
+	void Clear()  { mItems.clear(); }
+
+	// Add a draw with the given key (see OpaqueKey / BlendedKey)
+	void Add(uint64_t key, unsigned int index)  { mItems.push_back({ key, index }); }
+
+	// Sort the draws into key order. Sorting is stable, draws with equal keys stay in the order they were added
+	void Sort();
+
+
+	// Build the sort key for an opaque or blended draw. Depth is the distance in front of the camera, clamped to the
+	// given far distance. Texture and mesh can be any pointer that identifies the resource
+	uint64_t OpaqueKey (unsigned int pass, unsigned int state, const void* texture, const void* mesh, float depth, float farDepth);
+	uint64_t BlendedKey(unsigned int pass, unsigned int state, const void* texture, const void* mesh, float depth, float farDepth);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// The draws, in key order after Sort
+	const std::vector<Item>& Items()  { return mItems; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const int      ID_BITS    = 12;
+	static const int      DEPTH_BITS = 24;
+	static const uint64_t ID_MASK    = (1ull << ID_BITS) - 1;
+	static const uint64_t DEPTH_MASK = (1ull << DEPTH_BITS) - 1;
+
+	// Small id for a texture or mesh, given out in the order they are first seen. Wraps if more than 4096 are seen,
+	// which only makes the sorting less effective
+	uint64_t ResourceId(const void* resource);
+
+	// Depth scaled to the range of a depth field
+	uint64_t QuantiseDepth(float depth, float farDepth);
+
+
+	std::vector<Item> mItems;
+	std::vector<Item> mScratch; // Second buffer for the radix sort passes
+
+	std::unordered_map<const void*, unsigned int> mResourceIds;
+};
+
+
+#endif //_RENDER_QUEUE_H_INCLUDED_
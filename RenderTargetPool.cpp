@@ -0,0 +1,169 @@
+//--------------------------------------------------------------------------------------
+// Render target pool
+//--------------------------------------------------------------------------------------
+
+#include "RenderTargetPool.h"
+#include "ResourceRegistry.h"
+#include "Common.h"
+
+#include <algorithm>
+
+
+RenderTargetPool gRenderTargetPool;
+
+
+// Bytes per pixel for the formats used as render targets, for the memory statistics
+int BytesPerPixel(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:  return 16;
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+	case DXGI_FORMAT_R32G32_FLOAT:        return 8;
+	case DXGI_FORMAT_R16_FLOAT:           return 2;
+	case DXGI_FORMAT_R8_UNORM:            return 1;
+	default:                              return 4; // Most 32-bit formats, e.g. R8G8B8A8_UNORM, R11G11B10_FLOAT, R32_FLOAT
+	}
+}
+
+
+RenderTargetPool::~RenderTargetPool()
+{
+	ReleaseAll();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Usage
+//--------------------------------------------------------------------------------------
+
+PooledTarget* RenderTargetPool::Acquire(int width, int height, DXGI_FORMAT format, unsigned int flags /*= 0*/)
+{
+	for (auto entry : mEntries)
+	{
+		const PooledTarget& target = entry->target;
+		if (!entry->inUse && target.width == width && target.height == height && target.format == format &&
+		    (target.flags & flags) == flags)
+		{
+			entry->inUse = true;
+			entry->unusedFrames = 0;
+			return &entry->target;
+		}
+	}
+
+	// No free target matches so create a new one
+	PooledTarget target = { nullptr, nullptr, nullptr, nullptr, width, height, format, flags };
+
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = width;
+	textureDesc.Height = height;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = format;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	if (flags & RENDER_TARGET_UNORDERED_ACCESS)  textureDesc.BindFlags |= D3D11_BIND_UNORDERED_ACCESS;
+	textureDesc.CPUAccessFlags = 0;
+	textureDesc.MiscFlags = 0;
+	if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, NULL, &target.texture)))
+	{
+		gLastError = "Error creating pooled render target";
+		return nullptr;
+	}
+	gResourceRegistry.Track(target.texture);
+	if (FAILED(gD3DDevice->CreateRenderTargetView(target.texture, NULL, &target.renderTarget)) ||
+	    FAILED(gD3DDevice->CreateShaderResourceView(target.texture, NULL, &target.shaderResource)) ||
+	    ((flags & RENDER_TARGET_UNORDERED_ACCESS) && FAILED(gD3DDevice->CreateUnorderedAccessView(target.texture, NULL, &target.unorderedAccess))))
+	{
+		if (target.shaderResource)  target.shaderResource->Release();
+		if (target.renderTarget)    target.renderTarget->Release();
+		target.texture->Release();
+		gLastError = "Error creating pooled render target views";
+		return nullptr;
+	}
+
+	Entry* entry = new Entry;
+	entry->target = target;
+	entry->inUse = true;
+	entry->unusedFrames = 0;
+	entry->bytes = static_cast<size_t>(width) * height * BytesPerPixel(format);
+	mEntries.push_back(entry);
+
+	mMemoryBytes += entry->bytes;
+	mPeakMemoryBytes = std::max(mPeakMemoryBytes, mMemoryBytes);
+	return &entry->target;
+}
+
+
+void RenderTargetPool::Return(PooledTarget* target)
+{
+	for (auto entry : mEntries)
+	{
+		if (&entry->target == target)
+		{
+			entry->inUse = false;
+			return;
+		}
+	}
+}
+
+
+// Release targets that no one has used for MAX_UNUSED_FRAMES frames
+void RenderTargetPool::EndFrame()
+{
+	for (auto it = mEntries.begin(); it != mEntries.end(); )
+	{
+		Entry* entry = *it;
+		if (!entry->inUse && ++entry->unusedFrames > MAX_UNUSED_FRAMES)
+		{
+			ReleaseEntry(entry);
+			it = mEntries.erase(it);
+		}
+		else
+		{
+			if (entry->inUse)  entry->unusedFrames = 0;
+			++it;
+		}
+	}
+}
+
+
+void RenderTargetPool::ReleaseUnused()
+{
+	for (auto it = mEntries.begin(); it != mEntries.end(); )
+	{
+		if (!(*it)->inUse)
+		{
+			ReleaseEntry(*it);
+			it = mEntries.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+
+void RenderTargetPool::ReleaseAll()
+{
+	for (auto entry : mEntries)
+	{
+		ReleaseEntry(entry);
+	}
+	mEntries.clear();
+}
+
+
+void RenderTargetPool::ReleaseEntry(Entry* entry)
+{
+	PooledTarget& target = entry->target;
+	if (target.unorderedAccess)  target.unorderedAccess->Release();
+	if (target.shaderResource)   target.shaderResource->Release();
+	if (target.renderTarget)     target.renderTarget->Release();
+	if (target.texture)          target.texture->Release();
+	mMemoryBytes -= entry->bytes;
+	delete entry;
+}
@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------------
+// Render target pool
+//--------------------------------------------------------------------------------------
+// Shared store of textures used as temporary render targets. Code that needs a target for part of a frame acquires
+// one by size, format and flags, and returns it when done. Returned targets are handed out again to any later
+// request that matches, in the same frame or later ones, so new effects don't each need their own textures.
+// Targets that haven't been used for a while are released, so memory use follows what is actually being rendered
+
+#ifndef _RENDER_TARGET_POOL_H_INCLUDED_
+#define _RENDER_TARGET_POOL_H_INCLUDED_
+
+#include <d3d11.h>
+#include <vector>
+
+// Flags for RenderTargetPool::Acquire
+const unsigned int RENDER_TARGET_UNORDERED_ACCESS = 1 << 0; // Also create a UAV so compute shaders can write the target
+
+
+// A texture from the pool along with its views. The UAV is only present if requested
+struct PooledTarget
+{
+	ID3D11Texture2D*           texture;
+	ID3D11RenderTargetView*    renderTarget;
+	ID3D11ShaderResourceView*  shaderResource;
+	ID3D11UnorderedAccessView* unorderedAccess;
+	int                        width;
+	int                        height;
+	DXGI_FORMAT                format;
+	unsigned int               flags;
+};
+
+
+class RenderTargetPool
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~RenderTargetPool();
+
+	// Get a target with the given size and format, and at least the given flags. It belongs to the caller until returned.
+	// Returns nullptr on error (reason in gLastError)
+	PooledTarget* Acquire(int width, int height, DXGI_FORMAT format, unsigned int flags = 0);
+
+	// Give a target back to the pool so it can be reused
+	void Return(PooledTarget* target);
+
+	// Call at the end of each frame, releases targets that have not been used for a while
+	void EndFrame();
+
+	// Release all the targets not currently in use, e.g. after a resize when none of the old sizes will be needed
+	void ReleaseUnused();
+
+	// Release all targets, none must still be in use
+	void ReleaseAll();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	int    NumTargets()       { return static_cast<int>(mEntries.size()); }
+	size_t MemoryBytes()      { return mMemoryBytes;     } // Video memory used by all targets in the pool, approximately
+	size_t PeakMemoryBytes()  { return mPeakMemoryBytes; } // Highest value of MemoryBytes so far
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Frames a target can go unused before it is released
+	static const int MAX_UNUSED_FRAMES = 120;
+
+	struct Entry
+	{
+		PooledTarget target;
+		bool         inUse;
+		int          unusedFrames;
+		size_t       bytes;
+	};
+
+	void ReleaseEntry(Entry* entry);
+
+
+	std::vector<Entry*> mEntries; // Pointers so PooledTarget pointers stay valid as the pool grows
+
+	size_t mMemoryBytes     = 0;
+	size_t mPeakMemoryBytes = 0;
+};
+
+
+extern RenderTargetPool gRenderTargetPool;
+
+
+#endif //_RENDER_TARGET_POOL_H_INCLUDED_
@@ -0,0 +1,340 @@
+//--------------------------------------------------------------------------------------
+// Memory used by the app's resources
+//--------------------------------------------------------------------------------------
+// See ResourceRegistry.h for an overview
+
+#include "ResourceRegistry.h"
+
+#include <algorithm>
+
+
+ResourceRegistry gResourceRegistry;
+
+// Private data GUID the tags are attached with, {5A1C7E2B-93D4-4F6A-B8E1-0C2D4F6A8B3E}
+static const GUID MEMORY_TAG_GUID = { 0x5a1c7e2b, 0x93d4, 0x4f6a, { 0xb8, 0xe1, 0x0c, 0x2d, 0x4f, 0x6a, 0x8b, 0x3e } };
+
+
+//--------------------------------------------------------------------------------------
+// Tag
+//--------------------------------------------------------------------------------------
+
+class ResourceRegistry::Tag : public IUnknown
+{
+public:
+	Tag(ResourceRegistry* registry, int category, int64_t bytes) : mRegistry(registry), mCategory(category), mBytes(bytes)
+	{
+		mRegistry->Add(mCategory, mBytes, 1);
+	}
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID iid, void** object) override
+	{
+		if (object == nullptr)  return E_POINTER;
+		if (iid != __uuidof(IUnknown))
+		{
+			*object = nullptr;
+			return E_NOINTERFACE;
+		}
+		AddRef();
+		*object = static_cast<IUnknown*>(this);
+		return S_OK;
+	}
+
+	ULONG STDMETHODCALLTYPE AddRef() override  { return ++mReferences; }
+
+	ULONG STDMETHODCALLTYPE Release() override
+	{
+		ULONG references = --mReferences;
+		if (references == 0)
+		{
+			mRegistry->Add(mCategory, -mBytes, -1);
+			delete this;
+		}
+		return references;
+	}
+
+private:
+	ResourceRegistry*  mRegistry;
+	int                mCategory;
+	int64_t            mBytes;
+	std::atomic<ULONG> mReferences{ 1 };
+};
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+ResourceRegistry::ResourceRegistry()
+{
+	for (int i = 0; i < NUM_MEMORY_CATEGORIES; ++i)
+	{
+		mBytes[i]  = 0;
+		mCounts[i] = 0;
+	}
+	mPeakLocalBytes = 0;
+}
+
+ResourceRegistry::~ResourceRegistry()
+{
+	Release();
+}
+
+
+void ResourceRegistry::Init(IDXGIAdapter3* adapter)
+{
+	Release();
+	mAdapter = adapter;
+	if (mAdapter == nullptr)  return;
+	mAdapter->AddRef();
+
+	// Without the event the budgets are only read once
+	mBudgetEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	if (mBudgetEvent && FAILED(mAdapter->RegisterVideoMemoryBudgetChangeNotificationEvent(mBudgetEvent, &mBudgetCookie)))
+	{
+		CloseHandle(mBudgetEvent);
+		mBudgetEvent = nullptr;
+	}
+}
+
+
+void ResourceRegistry::Release()
+{
+	if (mBudgetEvent)
+	{
+		mAdapter->UnregisterVideoMemoryBudgetChangeNotification(mBudgetCookie);
+		CloseHandle(mBudgetEvent);
+		mBudgetEvent = nullptr;
+	}
+	if (mAdapter)  mAdapter->Release();
+	mAdapter = nullptr;
+	mBudgetRead = false;
+	mLocalBudget = mNonLocalBudget = 0;
+	mUntrackedBytes = 0;
+}
+
+
+void ResourceRegistry::Track(ID3D11Resource* resource)
+{
+	if (resource == nullptr)  return;
+	int64_t bytes;
+	MemoryCategory category = Categorise(resource, bytes);
+
+	// The resource holds the only reference to the tag, so it is released with the resource. Replaces, and so releases,
+	// any tag from an earlier Track
+	Tag* tag = new Tag(this, static_cast<int>(category), bytes);
+	resource->SetPrivateDataInterface(MEMORY_TAG_GUID, tag);
+	tag->Release();
+}
+
+
+bool ResourceRegistry::Update()
+{
+	if (mAdapter == nullptr)  return false;
+	if (mBudgetRead && (mBudgetEvent == nullptr || WaitForSingleObject(mBudgetEvent, 0) != WAIT_OBJECT_0))  return false;
+
+	DXGI_QUERY_VIDEO_MEMORY_INFO local, nonLocal;
+	if (FAILED(mAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL,     &local)) ||
+	    FAILED(mAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_NON_LOCAL, &nonLocal)))
+	{
+		return false;
+	}
+	if (mBudgetRead)  ++mNumBudgetChanges;
+	mBudgetRead = true;
+	mLocalBudget    = local.Budget;
+	mNonLocalBudget = nonLocal.Budget;
+	mUntrackedBytes = std::max(static_cast<int64_t>(local.CurrentUsage) - LocalBytes(), static_cast<int64_t>(0));
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Data access
+//--------------------------------------------------------------------------------------
+
+int64_t ResourceRegistry::LocalBytes()
+{
+	int64_t bytes = 0;
+	for (int i = 0; i < NUM_MEMORY_CATEGORIES; ++i)
+	{
+		if (i != static_cast<int>(MemoryCategory::Staging))  bytes += mBytes[i];
+	}
+	return bytes;
+}
+
+
+uint64_t ResourceRegistry::LocalUsage()
+{
+	DXGI_QUERY_VIDEO_MEMORY_INFO info;
+	if (mAdapter == nullptr || FAILED(mAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info)))  return 0;
+	return info.CurrentUsage;
+}
+
+uint64_t ResourceRegistry::NonLocalUsage()
+{
+	DXGI_QUERY_VIDEO_MEMORY_INFO info;
+	if (mAdapter == nullptr || FAILED(mAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_NON_LOCAL, &info)))  return 0;
+	return info.CurrentUsage;
+}
+
+
+const char* ResourceRegistry::CategoryName(MemoryCategory category)
+{
+	switch (category)
+	{
+	case MemoryCategory::Textures:         return "Textures";
+	case MemoryCategory::RenderTargets:    return "Render targets";
+	case MemoryCategory::Meshes:           return "Meshes";
+	case MemoryCategory::ConstantBuffers:  return "Constant buffers";
+	case MemoryCategory::Buffers:          return "Buffers";
+	case MemoryCategory::Staging:          return "Staging";
+	default:                               return "Unknown";
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+// Bits per pixel of a format, for block compressed formats averaged over a 4x4 block
+static unsigned int BitsPerPixel(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_TYPELESS: case DXGI_FORMAT_R32G32B32A32_FLOAT:
+	case DXGI_FORMAT_R32G32B32A32_UINT:     case DXGI_FORMAT_R32G32B32A32_SINT:
+		return 128;
+
+	case DXGI_FORMAT_R32G32B32_TYPELESS: case DXGI_FORMAT_R32G32B32_FLOAT:
+	case DXGI_FORMAT_R32G32B32_UINT:     case DXGI_FORMAT_R32G32B32_SINT:
+		return 96;
+
+	case DXGI_FORMAT_R16G16B16A16_TYPELESS: case DXGI_FORMAT_R16G16B16A16_FLOAT: case DXGI_FORMAT_R16G16B16A16_UNORM:
+	case DXGI_FORMAT_R16G16B16A16_UINT:     case DXGI_FORMAT_R16G16B16A16_SNORM: case DXGI_FORMAT_R16G16B16A16_SINT:
+	case DXGI_FORMAT_R32G32_TYPELESS:       case DXGI_FORMAT_R32G32_FLOAT:
+	case DXGI_FORMAT_R32G32_UINT:           case DXGI_FORMAT_R32G32_SINT:
+	case DXGI_FORMAT_R32G8X24_TYPELESS:     case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+		return 64;
+
+	case DXGI_FORMAT_R16_TYPELESS: case DXGI_FORMAT_R16_FLOAT: case DXGI_FORMAT_R16_UNORM: case DXGI_FORMAT_R16_UINT:
+	case DXGI_FORMAT_R16_SNORM:    case DXGI_FORMAT_R16_SINT:  case DXGI_FORMAT_D16_UNORM:
+	case DXGI_FORMAT_R8G8_TYPELESS: case DXGI_FORMAT_R8G8_UNORM: case DXGI_FORMAT_R8G8_UINT:
+	case DXGI_FORMAT_R8G8_SNORM:    case DXGI_FORMAT_R8G8_SINT:
+		return 16;
+
+	case DXGI_FORMAT_R8_TYPELESS: case DXGI_FORMAT_R8_UNORM: case DXGI_FORMAT_R8_UINT:
+	case DXGI_FORMAT_R8_SNORM:    case DXGI_FORMAT_R8_SINT:  case DXGI_FORMAT_A8_UNORM:
+	case DXGI_FORMAT_BC2_TYPELESS: case DXGI_FORMAT_BC2_UNORM: case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_TYPELESS: case DXGI_FORMAT_BC3_UNORM: case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_TYPELESS: case DXGI_FORMAT_BC5_UNORM: case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_TYPELESS: case DXGI_FORMAT_BC6H_UF16: case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_TYPELESS: case DXGI_FORMAT_BC7_UNORM: case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return 8;
+
+	case DXGI_FORMAT_BC1_TYPELESS: case DXGI_FORMAT_BC1_UNORM: case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_TYPELESS: case DXGI_FORMAT_BC4_UNORM: case DXGI_FORMAT_BC4_SNORM:
+		return 4;
+
+	default:
+		return 32; // Most other formats, e.g. R8G8B8A8_UNORM, R11G11B10_FLOAT, R32_FLOAT, D24_UNORM_S8_UINT
+	}
+}
+
+static bool BlockCompressed(DXGI_FORMAT format)
+{
+	return (format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM) ||
+	       (format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+}
+
+// Bytes in all the mip levels of one slice of a texture
+static int64_t MipChainBytes(UINT width, UINT height, UINT depth, UINT mipLevels, DXGI_FORMAT format)
+{
+	// A full chain has a level for each halving of the largest side
+	if (mipLevels == 0)
+	{
+		mipLevels = 1;
+		for (UINT size = std::max(std::max(width, height), depth); size > 1; size /= 2)  ++mipLevels;
+	}
+
+	int64_t bytes = 0;
+	unsigned int bits = BitsPerPixel(format);
+	bool blocks = BlockCompressed(format);
+	for (UINT mip = 0; mip < mipLevels; ++mip)
+	{
+		int64_t w = std::max(width  >> mip, 1u);
+		int64_t h = std::max(height >> mip, 1u);
+		int64_t d = std::max(depth  >> mip, 1u);
+		if (blocks) // Whole 4x4 blocks
+		{
+			w = (w + 3) & ~3;
+			h = (h + 3) & ~3;
+		}
+		bytes += w * h * d * bits / 8;
+	}
+	return bytes;
+}
+
+
+MemoryCategory ResourceRegistry::Categorise(ID3D11Resource* resource, int64_t& bytes)
+{
+	D3D11_RESOURCE_DIMENSION dimension;
+	resource->GetType(&dimension);
+
+	D3D11_USAGE usage = D3D11_USAGE_DEFAULT;
+	UINT bindFlags = 0;
+	bytes = 0;
+	if (dimension == D3D11_RESOURCE_DIMENSION_BUFFER)
+	{
+		D3D11_BUFFER_DESC desc;
+		static_cast<ID3D11Buffer*>(resource)->GetDesc(&desc);
+		bytes = desc.ByteWidth;
+		usage = desc.Usage;
+		bindFlags = desc.BindFlags;
+		if (usage == D3D11_USAGE_STAGING)                                                 return MemoryCategory::Staging;
+		if (bindFlags & D3D11_BIND_CONSTANT_BUFFER)                                       return MemoryCategory::ConstantBuffers;
+		if (bindFlags & (D3D11_BIND_VERTEX_BUFFER | D3D11_BIND_INDEX_BUFFER))             return MemoryCategory::Meshes;
+		return MemoryCategory::Buffers;
+	}
+
+	if (dimension == D3D11_RESOURCE_DIMENSION_TEXTURE1D)
+	{
+		D3D11_TEXTURE1D_DESC desc;
+		static_cast<ID3D11Texture1D*>(resource)->GetDesc(&desc);
+		bytes = MipChainBytes(desc.Width, 1, 1, desc.MipLevels, desc.Format) * desc.ArraySize;
+		usage = desc.Usage;
+		bindFlags = desc.BindFlags;
+	}
+	else if (dimension == D3D11_RESOURCE_DIMENSION_TEXTURE2D)
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		static_cast<ID3D11Texture2D*>(resource)->GetDesc(&desc);
+		bytes = MipChainBytes(desc.Width, desc.Height, 1, desc.MipLevels, desc.Format) * desc.ArraySize * desc.SampleDesc.Count;
+		usage = desc.Usage;
+		bindFlags = desc.BindFlags;
+	}
+	else if (dimension == D3D11_RESOURCE_DIMENSION_TEXTURE3D)
+	{
+		D3D11_TEXTURE3D_DESC desc;
+		static_cast<ID3D11Texture3D*>(resource)->GetDesc(&desc);
+		bytes = MipChainBytes(desc.Width, desc.Height, desc.Depth, desc.MipLevels, desc.Format);
+		usage = desc.Usage;
+		bindFlags = desc.BindFlags;
+	}
+
+	if (usage == D3D11_USAGE_STAGING)  return MemoryCategory::Staging;
+	if (bindFlags & (D3D11_BIND_RENDER_TARGET | D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_UNORDERED_ACCESS))  return MemoryCategory::RenderTargets;
+	return MemoryCategory::Textures;
+}
+
+
+// Called by the tags on any thread, with negative bytes and count when a resource is released
+void ResourceRegistry::Add(int category, int64_t bytes, int count)
+{
+	mBytes[category] += bytes;
+	mCounts[category] += count;
+	if (bytes <= 0 || category == static_cast<int>(MemoryCategory::Staging))  return;
+
+	int64_t local = LocalBytes();
+	int64_t peak = mPeakLocalBytes;
+	while (local > peak && !mPeakLocalBytes.compare_exchange_weak(peak, local)) {}
+}
@@ -0,0 +1,123 @@
+//--------------------------------------------------------------------------------------
+// Memory used by the app's resources
+//--------------------------------------------------------------------------------------
+// Each texture and buffer is passed to Track as it is created. Its size is worked out from its description, and the
+// bytes are added to a category chosen from how it is bound (render targets, meshes, constant buffers...). The driver
+// allocates a little more than this for alignment and padding. Nothing has to be done when it is released: Track
+// attaches a small tag to the resource as private data (SetPrivateDataInterface). D3D releases the tag with the
+// resource, which takes its bytes back off. So resources can be tracked and released on any thread.
+//
+// Update reads the memory the OS allows the process (IDXGIAdapter3::QueryVideoMemoryInfo) each time the budget changes,
+// as other apps come and go. There are two budgets: local memory (dedicated VRAM, or shared on integrated GPUs) and the
+// non-local system memory the GPU reads. The scene keeps the streamed textures within the local budget left over by
+// everything else (see TextureStreamer::SetMemoryLimit), so they give up mip levels before the OS starts paging
+// resources out. Memory that isn't tracked (the swap chain's other buffers, shaders, the driver's own) is measured as the
+// difference between the OS's figure and the tracked total
+
+#ifndef _RESOURCE_REGISTRY_H_INCLUDED_
+#define _RESOURCE_REGISTRY_H_INCLUDED_
+
+#include <d3d11.h>
+#include <dxgi1_4.h>
+#include <atomic>
+#include <cstdint>
+
+
+// What a resource is used for, chosen by Track from its description
+enum class MemoryCategory
+{
+	Textures,        // Read-only textures, e.g. loaded from files
+	RenderTargets,   // Textures the GPU writes: render targets, depth buffers and UAV textures
+	Meshes,          // Vertex and index buffers
+	ConstantBuffers,
+	Buffers,         // Other buffers, e.g. structured buffers
+	Staging,         // CPU readback and upload copies, held in system memory
+};
+const int NUM_MEMORY_CATEGORIES = 6;
+
+
+class ResourceRegistry
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	ResourceRegistry();
+	~ResourceRegistry();
+
+	// Listen for budget changes on the adapter the device was created on. A null adapter (before Windows 10) still
+	// tracks the resources but has no budget
+	void Init(IDXGIAdapter3* adapter);
+
+	// Stop listening for budget changes, call before the adapter is released. Tracked resources still take their bytes
+	// off when they are released
+	void Release();
+
+
+	// Count a resource's memory until it is released. Tracking a resource again moves it to the right category for its
+	// description now. Safe to call from any thread
+	void Track(ID3D11Resource* resource);
+
+	// Call on the main thread between frames. Reads the budgets again if the OS has changed them since the last call (or
+	// on the first call), returns true if it did
+	bool Update();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// Bytes and number of resources tracked in a category now
+	int64_t Bytes(MemoryCategory category)         { return mBytes[static_cast<int>(category)];     }
+	int     NumResources(MemoryCategory category)  { return mCounts[static_cast<int>(category)];    }
+	int64_t LocalBytes(); // All categories but staging, which is in system memory
+	int64_t PeakLocalBytes()  { return mPeakLocalBytes; }
+
+	// Budgets as of the last Update that read them, 0 if the OS can't say
+	uint64_t LocalBudget()     { return mLocalBudget;    }
+	uint64_t NonLocalBudget()  { return mNonLocalBudget; }
+	int      NumBudgetChanges()  { return mNumBudgetChanges; }
+
+	// Local memory the OS says the process is using that isn't tracked, as of the last Update that read the budgets
+	int64_t UntrackedBytes()  { return mUntrackedBytes; }
+
+	// Memory the OS says the process is using now, 0 if it can't say
+	uint64_t LocalUsage();
+	uint64_t NonLocalUsage();
+
+	static const char* CategoryName(MemoryCategory category);
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Attached to each tracked resource, takes the resource's bytes off its category when D3D releases it
+	class Tag;
+
+	static MemoryCategory Categorise(ID3D11Resource* resource, int64_t& bytes);
+
+	void Add(int category, int64_t bytes, int count);
+
+
+	IDXGIAdapter3* mAdapter       = nullptr;
+	HANDLE         mBudgetEvent   = nullptr; // Signalled by the OS when a budget changes
+	DWORD          mBudgetCookie  = 0;
+	bool           mBudgetRead    = false;
+
+	std::atomic<int64_t> mBytes[NUM_MEMORY_CATEGORIES];
+	std::atomic<int>     mCounts[NUM_MEMORY_CATEGORIES];
+	std::atomic<int64_t> mPeakLocalBytes;
+
+	uint64_t mLocalBudget      = 0;
+	uint64_t mNonLocalBudget   = 0;
+	int64_t  mUntrackedBytes   = 0;
+	int      mNumBudgetChanges = 0;
+};
+
+
+extern ResourceRegistry gResourceRegistry;
+
+
+#endif //_RESOURCE_REGISTRY_H_INCLUDED_
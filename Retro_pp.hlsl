@@ -24,9 +24,8 @@ SamplerState PointSample  : register(s0); // We don't usually want to filter (bi
 float4 main(PostProcessingInput input) : SV_Target
 {
 	
-	float width;
-	float height;
-	SceneTexture.GetDimensions(width, height);
+	float width  = gInputSize.x;
+	float height = gInputSize.y;
 	
 	
 	//float2 noiseScaleInUVSpace = { width / gNoiseScale.x, height / gNoiseScale.y };
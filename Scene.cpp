@@ -4,6 +4,7 @@
 //--------------------------------------------------------------------------------------
 
 #include "Scene.h"
+#include "Direct3DSetup.h"
 #include "Mesh.h"
 #include "Model.h"
 #include "Camera.h"
@@ -11,6 +12,56 @@
 #include "Shader.h"
 #include "Input.h"
 #include "Common.h"
+#include "EffectChain.h"
+#include "GpuProfiler.h"
+#include "Telemetry.h"
+#include "StateCache.h"
+#include "DeferredRenderer.h"
+#include "RenderTargetPool.h"
+#include "DynamicResolution.h"
+#include "ShaderReloader.h"
+#include "ShaderCache.h"
+#include "AssetLoader.h"
+#include "TextureStreamer.h"
+#include "InputLayoutCache.h"
+#include "GeometryPool.h"
+#include "SceneTree.h"
+#include "RenderQueue.h"
+#include "LightClusters.h"
+#include "TransformSystem.h"
+#include "JobSystem.h"
+#include "CpuProfiler.h"
+#include "StartupProfiler.h"
+#include "MetricsServer.h"
+#include "TraceCapture.h"
+#include "TripleBuffer.h"
+#include "FrameLimiter.h"
+#include "FrameCapture.h"
+#include "SharedOutput.h"
+#include "AutoExposure.h"
+#include "ColourLut.h"
+#include "ConstantBufferRing.h"
+#include "InstanceBufferRing.h"
+#include "FramePipeline.h"
+#include "BonePalettes.h"
+#include "Animation.h"
+#include "AssetPack.h"
+#include "OcclusionCuller.h"
+#include "ParticleSystem.h"
+#include "FrameCache.h"
+#include "ComputeTuner.h"
+#include "BloomTiles.h"
+#include "MaterialArrays.h"
+#include "EffectResources.h"
+#include "ResourceRegistry.h"
+#include "LinearArena.h"
+#include "StaticBatches.h"
+#include "QualityGovernor.h"
+#include "Sky.h"
+#include "ShadowMaps.h"
+#include "Impostors.h"
+#include "GpuCuller.h"
+#include "OutputWindows.h"
 
 #include "CVector2.h" 
 #include "CVector3.h" 
@@ -22,6 +73,14 @@
 #include <sstream>
 #include <memory>
 #include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <atomic>
+#include <vector>
 
 
 //--------------------------------------------------------------------------------------
@@ -50,31 +109,236 @@ const float MOVEMENT_SPEED = 50.0f; // Units per second for movement (what a uni
 // Lock FPS to monitor refresh rate, which will typically set it to 60fps. Press 'p' to toggle to full fps
 bool lockFPS = true;
 
-
-// Meshes, models and cameras, same meaning as TL-Engine. Meshes prepared in InitGeometry function, Models & camera in InitScene
+// Cap the frame rate in software, on top of any vsync (see FrameLimiter.h). Press 'o' to step through the caps
+FrameLimiter gFrameLimiter;
+const float FRAME_RATE_CAPS[] = { 0, 30, 48, 60, 90, 120 }; // 0 for no cap
+
+// Show the GPU profiler bar chart in the corner of the screen and list the timings in the debugger output. Press F2 to toggle
+bool showProfiler = false;
+
+// Show the memory used by each category of resource against the OS's budget in the other corner, and list it in the
+// debugger output (see ResourceRegistry.h). Press - to toggle
+bool showMemory = false;
+
+// Deferred contexts recording the scene into command lists (see DeferredRenderer.h), and the number of models recorded
+// in each command list. A negative count uses one for each job system thread and the main thread, 0 renders on the main
+// thread
+int renderThreads   = -1;
+int renderChunkSize = 2;
+
+// Load meshes with compact vertex formats and 16-bit indices (see CompactMesh), halving the vertex data for most meshes
+bool compactVertices = false;
+
+// Place the vertices and indices of all meshes in a few shared buffers (see GeometryPool.h), so drawing different meshes
+// doesn't rebind the input assembler buffers each time
+bool geometryPool = true;
+
+// Draw models that share a mesh and texture with one instanced draw call rather than one per model. Press F4 to toggle
+bool instancedRendering = true;
+
+// Pack the model textures into texture arrays (see MaterialArrays.h) so instanced draws can cover models with different
+// textures as well as those sharing one. Press + to toggle. Off by default as the packed textures are copies. Set if the
+// last repack failed, the models are then instanced by texture as usual
+bool materialArrays = false;
+bool materialArraysFailed = false;
+
+// Merge the static models sharing a texture into a few world space batches (see StaticBatches.h), each drawn with one
+// call. Press Insert to toggle. Off by default as the batches are copies of the meshes. The number of batches drawn is for
+// the most recent RenderSceneFromCamera
+bool staticBatching = false;
+int staticBatchesDrawn = 0;
+
+// Draw the sky as a full screen triangle at the far plane sampling a cubemap (see Sky.h), rather than as the star sphere
+// mesh. Press Delete to toggle. The star sphere is drawn instead if the cubemap didn't load
+bool skyPass = true;
+
+// The main lights cast shadows from cached cubemaps, the static models only drawn into them again when they or the light
+// change (see ShadowMaps.h). Press Backspace to toggle
+bool shadows = true;
+const int SHADOW_MAP_SIZE = 512; // Pixels across each cubemap face
+
+// Light each model in the forward pass with only the few lights chosen for it on the CPU, from its bounding sphere (see
+// AssignObjectLights), rather than the lights in each pixel's cluster. Press Page Up to toggle. Only used for models
+// drawn one at a time with forward shading, instanced draws, static batches and deferred shading keep the clusters
+bool objectLights = false;
+
+// Gather pipeline statistics for each GPU profiler timer (see GpuProfiler::EnableStatistics), shown with the timings in
+// the F2 report. Press Page Down to toggle
+bool pipelineStatistics = false;
+
+// Skip models outside the camera's view frustum (found with a gSceneTree query). Press F5 to toggle. The counts are for the most
+// recent RenderSceneFromCamera. Counted by the jobs preparing the draws, so atomic
+bool frustumCulling = true;
+std::atomic<int> modelsConsidered(0);
+std::atomic<int> modelsCulled(0);
+
+// Skip models hidden behind others, tested against a CPU depth buffer holding the hills and crate and with GPU occlusion
+// queries drawn the frame before (see OcclusionCuller.h). Press U to toggle
+bool occlusionCulling = true;
+
+// Smoke and fire particles simulated and drawn on the GPU (see ParticleSystem.h). Press I to toggle
+bool particles = true;
+unsigned int numParticles = 131072;
+
+// Sort the particles back to front on the GPU for each camera so the smoke blends correctly (see GpuSort.h). Press Y to toggle
+bool particleSorting = true;
+
+// Render each model at the coarsest level of detail whose error is no more than LOD_PIXEL_ERROR pixels on screen (see
+// Model::SelectLod), otherwise always at full detail. Press F7 to toggle. Meshes are loaded with NUM_MESH_LODS levels
+// below full detail. The count is the models drawn below full detail in the most recent RenderSceneFromCamera
+bool lodSelection = true;
+std::atomic<int> modelsReducedLod(0);
+const int   NUM_MESH_LODS   = 3;
+const float LOD_PIXEL_ERROR = 1.0f;
+
+// Draw models small enough on screen as impostors, quads blending views of their mesh captured when the scene is set up,
+// all those sharing a mesh with one instanced draw (see Impostors.h). The stress scene's rigid meshes have impostors,
+// used once a model is no more than Impostors::MAX_SCREEN_SIZE pixels across. Press Numpad 0 to toggle. The count is
+// the models drawn as impostors in the most recent RenderSceneFromCamera
+bool impostors = true;
+std::atomic<int> modelsImpostored(0);
+
+// Cull the models whose meshes have no bones on the GPU against the frustum and last frame's depth, choosing their levels
+// of detail there too, and draw them with indirect draws (see GpuCuller.h). Needs instanced rendering and a single view,
+// otherwise they are culled on the CPU as usual. These models aren't drawn as impostors. Press Numpad 1 to toggle. The
+// count is the models given to the GPU in the most recent RenderSceneFromCamera
+bool gpuCulling = false;
+std::atomic<int> modelsGpuCulled(0);
+
+// Draw the opaque models into the depth buffer first with no pixel shader, then light them with an equal depth test so
+// each pixel is only lit once, however many models overlap it. Press F8 to toggle
+bool depthPrePass = false;
+
+// Deferred shading - the opaque models write their material and normal to a G-buffer, then every pixel is lit once by
+// a full screen pass using the same light clusters as the forward lighting. Press F9 to toggle
+bool deferredShading = false;
+
+// Sort the draws in each pass by texture and mesh, then depth, before recording them (see RenderQueue). Press F6 to toggle
+bool sortDraws = true;
+
+// Record the models that never move, and the sky, into command lists once and replay them every frame. They are only
+// recorded again when one of them changes or they would be drawn differently (see UpdateStaticChunks). They are drawn
+// without culling or levels of detail, trading GPU time for CPU time. Needs render threads. Press C to toggle
+bool staticCommandLists = false;
+
+// Reuse the last frame, or just its rendered scene, while nothing they depend on changes (see FrameCache.h). For views
+// that sit still, anything animated (e.g. the particles) makes every frame different. Press Z to toggle
+bool frameCaching = false;
+
+// Pack of cooked assets built by the AssetCooker tool (see AssetPack.h), and the file the load order is written to for
+// its -order option
+const char* const ASSET_PACK_FILE       = "Assets.pack";
+const char* const ASSET_PACK_ORDER_FILE = "Assets.pack.order";
+
+// GPU frame time to aim for when dynamic resolution is switched on (with F3), a little inside 60fps
+const float DYNAMIC_RESOLUTION_BUDGET = 15.0f;
+
+// The effects' quality knobs adjusted by the quality governor (see QualityGovernor.h), switched on with the Home key
+// using the same budget: the Gaussian blur technique (as chosen, half size, dual filter), the number of bloom mips
+// (4, 3, 2) and the rate of the smooth blur passes (full, half, quarter)
+int governorBlurKnob  = -1;
+int governorBloomKnob = -1;
+int governorRateKnob  = -1;
+
+// Size the scene is rendered at this frame, less than the viewport size when using dynamic resolution
+int sceneWidth  = 0;
+int sceneHeight = 0;
+
+
+// Meshes, models and cameras, same meaning as TL-Engine. Meshes prepared in InitGeometry function, Models & camera in InitScene.
+// The meshes and models are held in gMeshPool and gModelPool (see ObjectPool.h), these just point into them
 Mesh* gStarsMesh;
 Mesh* gGroundMesh;
 Mesh* gCubeMesh;
 Mesh* gCrateMesh;
 Mesh* gLightMesh;
+Mesh* gTeapotMesh; // Only loaded for the stress scene, see below
+Mesh* gSphereMesh; // --"--
+Mesh* gTrollMesh;  // --"--
 
 Model* gStars;
 Model* gGround;
 Model* gCube;
 Model* gCrate;
 
+// The models with skinned meshes, skinned once per frame for all the passes that draw them (see Model::Skin)
+std::vector<Model*> gSkinnedModels;
+
 Camera* gCamera;
 
+// Views drawn side by side from cameras placed around the main camera, e.g. a stereo pair or a row of projectors (see
+// SetMultiView). Press End to switch between one view and a stereo pair. Adjacent views are multiViewSeparation apart
+// along the camera's right axis or, with no separation, turned by the camera's field of view to make a panorama. The
+// view cameras are placed again from the main camera each frame
+const float STEREO_SEPARATION = 0.5f; // World units between the stereo pair the End key gives
+int   multiViews = 1;
+float multiViewSeparation = 0;
+std::vector<Camera> gViewCameras;
+
+// The cameras of the output windows (see OutputWindows.h), placed to the right of the main camera in turn like the
+// views above, outputWindowSeparation apart or as a panorama. They are drawn as more views of the main camera's draws
+float outputWindowSeparation = 0;
+std::vector<Camera> gWindowCameras;
+
+// A view of a multi-view frame: its camera and the left edge of its part of the scene target. The view of an output
+// window is instead left in a pooled target of its own, given to the caller in image
+struct MultiView
+{
+	Camera*        camera;
+	UINT           left;
+	PooledTarget** image;
+};
+
+// The scene is drawn from just the main camera, the culling that uses the main camera's depth can be used
+bool SingleView()
+{
+	return multiViews == 1 && gOutputWindows.NumWindows() == 0;
+}
+
 
-// Store lights in an array in this exercise
-const int NUM_LIGHTS = 2;
+// Store lights in an array in this exercise. The first NUM_MAIN_LIGHTS are the main lights of the scene, any more are small
+// lights scattered around it (see SetExtraLights). All of them are lit through the light clusters (see LightClusters.h)
+const int NUM_MAIN_LIGHTS = 2;
+int numExtraLights = 0;
+// Each light's model places it and gives it bounds for culling, it is drawn as a flare (see LightFlareData in Common.h)
 struct Light
 {
 	Model*   model;
 	CVector3 colour;
 	float    strength;
 };
-Light gLights[NUM_LIGHTS];
+std::vector<Light> gLights;
+
+// Stress scene for scale testing (see SetStressScene). Copies of the meshes above are laid out in a grid or at random
+// around the middle of the scene, each spinning and bobbing up and down unless static, with extra lights spread over the
+// same area. They are drawn, culled and lit like the other models, so the costs of those can be measured at scale
+int  numStressModels = 0;
+int  numStressLights = 0;
+bool stressGrid      = false;
+bool stressAnimated  = true;
+const float STRESS_SPACING = 8.0f; // Distance between neighbouring models, random layouts cover the same area
+const float STRESS_HEIGHT  = 8.0f; // Height of the grid, random layouts are between half and twice this
+const float STRESS_BOB     = 1.5f; // How far animated models move up and down
+struct StressModel
+{
+	Model*                     model;
+	ID3D11ShaderResourceView** texture; // Points at the texture global, which changes as the texture streams in
+	CVector3                   position;
+	float                      spin;    // Radians per second about the Y axis
+	float                      phase;   // Start of the spin and bob, so the models don't move in step
+};
+std::vector<StressModel> gStressModels;
+
+// Animated stress models whose mesh has animation clips also play them, the first clip blended with the second if there
+// is one, from the start of their spin so they don't move in step (see Animation.h)
+std::vector<Animator> gStressAnimators;
+
+// Light falls off with distance, a light's range is the distance where it drops to this level (see LightRange)
+const float LIGHT_CUTOFF = 0.05f;
+
+// The lights sent to the light buffer this frame, in the same order, for per-object light assignment. Written on the main
+// thread before the chunks are prepared and only read while they are
+std::vector<LightData> gFrameLights;
 
 
 // Additional light information
@@ -86,6 +350,32 @@ ColourRGBA gBackgroundColor = { 0.3f, 0.3f, 0.4f, 1.0f };
 // Variables controlling light1's orbiting of the cube
 const float gLightOrbitRadius = 20.0f;
 const float gLightOrbitSpeed = 0.7f;
+std::atomic<bool> gLightOrbiting{ true }; // The L key toggles, read by the simulation thread
+
+
+// Everything the simulation moves (see SimulateScene). The last two steps are kept, and each frame is rendered part
+// way between them (see ApplySimulationState). These belong to the thread running SimulateScene
+struct SimulationState
+{
+	CVector3 cameraPosition;
+	CVector3 cameraRotation;
+	float    lightOrbit;      // Angle of light1 around its orbit
+	float    tintHue;         // Hue of the two tint post-process colours, 0 to 360
+	float    tintHue2;
+	float    postProcessTime; // Animates the underwater and spiral post-processes
+};
+SimulationState gPreviousState;
+SimulationState gCurrentState;
+Camera          gSimulationCamera; // Moved by the keys in SimulateScene, the main camera is placed from the states
+
+// The last two states as of a simulation step, passed from SimulateScene to the rendering
+struct SimulationSnapshot
+{
+	SimulationState previous;
+	SimulationState current;
+	double          time; // Given to SimulateScene for the step
+};
+TripleBuffer<SimulationSnapshot> gSimulationSnapshots;
 
 
 
@@ -100,12 +390,27 @@ const float gLightOrbitSpeed = 0.7f;
 PerFrameConstants gPerFrameConstants;      // The constants (settings) that need to be sent to the GPU each frame (see common.h for structure)
 ID3D11Buffer*     gPerFrameConstantBuffer; // The GPU buffer that will recieve the constants above
 
-PerModelConstants gPerModelConstants;      // As above, but constants (settings) that change per-model (e.g. world matrix)
-ID3D11Buffer*     gPerModelConstantBuffer; // --"--
+thread_local PerModelConstants gPerModelConstants;      // As above, but constants (settings) that change per-model (e.g. world matrix)
+thread_local ID3D11Buffer*     gPerModelConstantBuffer; // --"-- (each render worker thread has its own, see DeferredRenderer.h)
+
+thread_local SkeletonConstants gSkeletonConstants;      // Bone matrices for skinned models, only uploaded when one is rendered
+thread_local ID3D11Buffer*     gSkeletonConstantBuffer; // --"--
+
+thread_local ID3D11Buffer*             gInstanceBuffer;    // World matrices and colours for instanced rendering
+thread_local ID3D11ShaderResourceView* gInstanceBufferSRV; // --"--
+
+ID3D11Buffer*             gLightFlareBuffer    = nullptr; // MAX_LIGHTS LightFlareData, written on the main thread each view
+ID3D11ShaderResourceView* gLightFlareBufferSRV = nullptr; // --"--
 
 //**************************
 PostProcessingConstants gPostProcessingConstants;       // As above, but constants (settings) for each post-process
-ID3D11Buffer*           gPostProcessingConstantBuffer; // --"--
+VersionedConstantBuffer<PostProcessingConstants> gPostProcessingConstantBuffer; // --"--, skips the upload if nothing changed
+
+BlurKernelConstants gBlurKernelConstants;       // Gaussian blur weights, only rebuilt when the blur settings change (see UpdateBlurKernel in EffectChain.cpp)
+ID3D11Buffer*       gBlurKernelConstantBuffer; // --"--
+
+ProfilerOverlayConstants gProfilerOverlayConstants;       // Bars for the GPU profiler overlay
+ID3D11Buffer*            gProfilerOverlayConstantBuffer; // --"--
 //**************************
 
 
@@ -122,6 +427,10 @@ ID3D11Resource*           gCrateDiffuseSpecularMap = nullptr;
 ID3D11ShaderResourceView* gCrateDiffuseSpecularMapSRV = nullptr;
 ID3D11Resource*           gCubeDiffuseSpecularMap = nullptr;
 ID3D11ShaderResourceView* gCubeDiffuseSpecularMapSRV = nullptr;
+ID3D11Resource*           gWoodDiffuseSpecularMap = nullptr;  // Only loaded for the stress scene
+ID3D11ShaderResourceView* gWoodDiffuseSpecularMapSRV = nullptr;
+ID3D11Resource*           gTrollDiffuseSpecularMap = nullptr; // --"--
+ID3D11ShaderResourceView* gTrollDiffuseSpecularMapSRV = nullptr;
 
 ID3D11Resource*           gLightDiffuseMap = nullptr;
 ID3D11ShaderResourceView* gLightDiffuseMapSRV = nullptr;
@@ -135,25 +444,37 @@ ID3D11ShaderResourceView* gLightDiffuseMapSRV = nullptr;
 ID3D11Texture2D*          gSceneTexture      = nullptr; // 2d texture
 ID3D11RenderTargetView*   gSceneRenderTarget = nullptr; // a reference to the above texture that can be rendered to
 ID3D11ShaderResourceView* gSceneTextureSRV   = nullptr; // a reference to the above texture that can be passed to shaders
+ID3D11ShaderResourceView* gSceneTextureMipsSRV = nullptr; // All its mip-maps, only valid after GenerateMips (see pyramid blur)
+
+// With MSAA the scene is drawn into this texture and depth buffer instead, and the first post-process resolves it (see
+// EffectChain.h). Its depth is resolved into the usual depth buffer for the passes that read depth as a texture
+ID3D11Texture2D*          gSceneTextureMS        = nullptr;
+ID3D11RenderTargetView*   gSceneRenderTargetMS   = nullptr;
+ID3D11ShaderResourceView* gSceneTextureMSSRV     = nullptr;
+ID3D11Texture2D*          gDepthStencilTextureMS = nullptr;
+ID3D11DepthStencilView*   gDepthStencilMS        = nullptr;
+ID3D11ShaderResourceView* gDepthShaderViewMS     = nullptr;
+
+// The depth buffer the scene is drawn with this frame, gDepthStencil or gDepthStencilMS
+ID3D11DepthStencilView*   gSceneDepthStencil     = nullptr;
+
+// Format of the scene texture. A float format keeps the brightness of highlights above 1 for the bloom, the post-processes
+// keep whole images in the same format until the final pass writes the back buffer
+DXGI_FORMAT gSceneFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
 
-// a texture used for most post processing
-ID3D11Texture2D*          gPostProcessTexture      = nullptr;
-ID3D11RenderTargetView*   gPostProcessRenderTarget = nullptr;
-ID3D11ShaderResourceView* gPostProcessTextureSRV   = nullptr;
+// The scene's post-processes, run as a graph of passes which creates and reuses the other render targets they need
+EffectChain gSceneEffects;
 
-// a secondary post processing texture used for bloom
-ID3D11Texture2D*          gBloomTexture      = nullptr; 
-ID3D11RenderTargetView*   gBloomRenderTarget = nullptr; 
-ID3D11ShaderResourceView* gBloomTextureSRV   = nullptr; 
+// With low resolution retro the scene is rendered into this target, one pixel per retro block, and the effects up to
+// and including retro are run at that size before it is enlarged (see PostProcessing). Only held during a frame
+PooledTarget* gRetroSceneTarget = nullptr;
+EffectChain   gRetroEffects;
 
 
-// Additional textures used for specific post-processes
-ID3D11Resource*           gNoiseMap = nullptr;
-ID3D11ShaderResourceView* gNoiseMapSRV = nullptr;
-ID3D11Resource*           gBurnMap = nullptr;
-ID3D11ShaderResourceView* gBurnMapSRV = nullptr;
-ID3D11Resource*           gDistortMap = nullptr;
-ID3D11ShaderResourceView* gDistortMapSRV = nullptr;
+// Order the scene draws to minimise state changes (see SortSceneDraws), one for each pass so the passes can be sorted
+// at the same time by different jobs
+const unsigned int NUM_SCENE_PASSES = 3;
+RenderQueue gRenderQueues[NUM_SCENE_PASSES];
 
 
 //****************************
@@ -161,16 +482,67 @@ ID3D11ShaderResourceView* gDistortMapSRV = nullptr;
 
 float blurStrength = 50;
 float blurCurve = 0.03f;
+
+// Blur with the dual filter (Kawase) blur rather than the Gaussian, for the Gaussian blur and bloom (see EffectChain.h)
+bool dualFilterBlur = false;
+
+// Bloom by convolving with a star shaped glare kernel using FFTs, or the kernel in the given image (see FftBloom.h)
+bool fftBloom = false;
+std::string fftBloomKernelImage;
+
+// Blur the bloom mips only in the tiles with light in them, listed on the GPU (see BloomTiles.h)
+bool bloomTiles = false;
 float timer = 0; 
 float bitColour = 90;
 float pixelSize = 10;
 
+// Render the scene at one pixel per retro block when retro is on, rather than pixellating the full resolution image
+bool lowResolutionRetro = false;
+
+// Reduce retro's colour depth with a fetch from the colour grading LUT (see ColourLut.h)
+bool colourLut = false;
+
+// Run the post-processes that have compute versions as compute shaders writing UAVs (see EffectChain.h)
+bool computePostProcess = false;
+
+// Do the colour maths of the bandwidth-bound post-processes in min16float, on GPUs with 16-bit shader arithmetic
+bool halfPrecisionEffects = true;
+
+// Draw the smooth blur passes at a reduced rate: never, while dynamic resolution is struggling to hold its budget, or
+// always at half or quarter rate (see PostProcessGraph.h)
+ReducedRateMode reducedRateMode = ReducedRateMode::Off;
+
+// Gaussian blur and bloom at reduced size, blended with the previous frame's result (see TemporalHistory.h)
+bool temporalEffects = false;
+
+// Samples per pixel in the scene, 1 for no MSAA. Only used when forward shading into the scene texture, the G-buffer
+// and the low resolution retro target have a single sample
+int msaaSamples = 1;
+
+// Anti-alias the scene's image with FXAA or SMAA ahead of the other effects (see EffectChain.h). Cheaper than MSAA and
+// also smooths the edges within textures and the deferred shading, but only sees one sample per pixel. Left out for the
+// low resolution retro scene, whose blocks are meant to be sharp
+PostAntiAliasing postAntiAliasing = PostAntiAliasing::Off;
+
+// Upscale the reduced resolution scene of dynamic resolution along its edges and sharpen it, rather than bilinear, so it
+// can render at 67-75% and still look close to full resolution
+bool  spatialUpscale   = false;
+float upscaleSharpness = 0.8f;
+
 bool Tint;
 bool Blur;
 bool GaussianBlur;
 bool Underwater;
 bool Retro;
 bool Bloom;
+bool StarFilter;
+
+// Depth-aware effects reading the depth buffer the scene was rendered with (see EffectChain.h). Press 8 and 9 to toggle
+bool DepthOfField = false;
+bool Fog = false;
+
+// Adapt the exposure of the post-processed image to its brightness (see AutoExposure.h)
+bool autoExposure = false;
 
 
 
@@ -318,80 +690,98 @@ CVector3 tintColour =  RGBToHSL({ 0, 1, 1 });
 CVector3 tintColour2 = RGBToHSL({ 1, 1, 0 });
 
 
-bool InitGeometry()
+void ReleaseMultisampledSceneTargets()
 {
-	////--------------- Load meshes ---------------////
-
-	// Load mesh geometry data, just like TL-Engine this doesn't create anything in the scene. Create a Model for that.
-	try
-	{
-		gStarsMesh  = new Mesh("Stars.x");
-		gGroundMesh = new Mesh("Hills.x");
-		gCubeMesh   = new Mesh("Cube.x");
-		gCrateMesh  = new Mesh("CargoContainer.x");
-		gLightMesh  = new Mesh("Light.x");
-	}
-	catch (std::runtime_error e)  // Constructors cannot return error messages so use exceptions to catch mesh errors (fairly standard approach this)
-	{
-		gLastError = e.what(); // This picks up the error message put in the exception (see Mesh.cpp)
-		return false;
-	}
-
-
-	////--------------- Load / prepare textures & GPU states ---------------////
+	if (gDepthShaderViewMS)      gDepthShaderViewMS->Release();
+	if (gDepthStencilMS)         gDepthStencilMS->Release();
+	if (gDepthStencilTextureMS)  gDepthStencilTextureMS->Release();
+	if (gSceneTextureMSSRV)      gSceneTextureMSSRV->Release();
+	if (gSceneRenderTargetMS)    gSceneRenderTargetMS->Release();
+	if (gSceneTextureMS)         gSceneTextureMS->Release();
+	gDepthShaderViewMS     = nullptr;
+	gDepthStencilMS        = nullptr;
+	gDepthStencilTextureMS = nullptr;
+	gSceneTextureMSSRV     = nullptr;
+	gSceneRenderTargetMS   = nullptr;
+	gSceneTextureMS        = nullptr;
+}
 
-	// Load textures and create DirectX objects for them
-	// The LoadTexture function requires you to pass a ID3D11Resource* (e.g. &gCubeDiffuseMap), which manages the GPU memory for the
-	// texture and also a ID3D11ShaderResourceView* (e.g. &gCubeDiffuseMapSRV), which allows us to use the texture in shaders
-	// The function will fill in these pointers with usable data. The variables used here are globals found near the top of the file.
-	if (!LoadTexture("Stars.jpg",                &gStarsDiffuseSpecularMap,  &gStarsDiffuseSpecularMapSRV) ||
-		!LoadTexture("GrassDiffuseSpecular.dds", &gGroundDiffuseSpecularMap, &gGroundDiffuseSpecularMapSRV) ||
-		!LoadTexture("StoneDiffuseSpecular.dds", &gCubeDiffuseSpecularMap,   &gCubeDiffuseSpecularMapSRV) ||
-		!LoadTexture("CargoA.dds",               &gCrateDiffuseSpecularMap,  &gCrateDiffuseSpecularMapSRV) ||
-		!LoadTexture("Flare.jpg",                &gLightDiffuseMap,          &gLightDiffuseMapSRV) ||
-		!LoadTexture("Noise.png",                &gNoiseMap,   &gNoiseMapSRV) ||
-		!LoadTexture("Burn.png",                 &gBurnMap,    &gBurnMapSRV) ||
-		!LoadTexture("Distort.png",              &gDistortMap, &gDistortMapSRV))
+// Create the multisampled scene texture and depth buffer with msaaSamples at the current viewport size. Returns false
+// on failure (reason in gLastError)
+bool CreateMultisampledSceneTargets()
+{
+	UINT colourQuality = 0;
+	UINT depthQuality  = 0;
+	gD3DDevice->CheckMultisampleQualityLevels(gSceneFormat, msaaSamples, &colourQuality);
+	gD3DDevice->CheckMultisampleQualityLevels(DXGI_FORMAT_D32_FLOAT, msaaSamples, &depthQuality);
+	if (colourQuality == 0 || depthQuality == 0)
 	{
-		gLastError = "Error loading textures";
+		gLastError = std::to_string(msaaSamples) + "x MSAA isn't supported for the scene format";
 		return false;
 	}
 
-
-	// Create all filtering modes, blending modes etc. used by the app (see State.cpp/.h)
-	if (!CreateStates())
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = gViewportWidth;
+	textureDesc.Height = gViewportHeight;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = gSceneFormat;
+	textureDesc.SampleDesc.Count = msaaSamples;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, NULL, &gSceneTextureMS)) ||
+	    FAILED(gD3DDevice->CreateRenderTargetView(gSceneTextureMS, NULL, &gSceneRenderTargetMS)) ||
+	    FAILED(gD3DDevice->CreateShaderResourceView(gSceneTextureMS, NULL, &gSceneTextureMSSRV)))
 	{
-		gLastError = "Error creating states";
+		gLastError = "Error creating multisampled scene texture";
 		return false;
 	}
-
-
-	////--------------- Prepare shaders and constant buffers to communicate with them ---------------////
-
-	// Load the shaders required for the geometry we will use (see Shader.cpp / .h)
-	if (!LoadShaders())
+	gResourceRegistry.Track(gSceneTextureMS);
+
+	// Typeless so it can also be read as a texture, as the usual depth buffer (see Direct3DSetup.cpp)
+	textureDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	textureDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DMS;
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DMS;
+	if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, NULL, &gDepthStencilTextureMS)) ||
+	    FAILED(gD3DDevice->CreateDepthStencilView(gDepthStencilTextureMS, &dsvDesc, &gDepthStencilMS)) ||
+	    FAILED(gD3DDevice->CreateShaderResourceView(gDepthStencilTextureMS, &srvDesc, &gDepthShaderViewMS)))
 	{
-		gLastError = "Error loading shaders";
+		gLastError = "Error creating multisampled depth buffer";
 		return false;
 	}
+	gResourceRegistry.Track(gDepthStencilTextureMS);
+	return true;
+}
 
-	// Create GPU-side constant buffers to receive the gPerFrameConstants and gPerModelConstants structures above
-	// These allow us to pass data from CPU to shaders such as lighting information or matrices
-	// See the comments above where these variable are declared and also the UpdateScene function
-	gPerFrameConstantBuffer       = CreateConstantBuffer(sizeof(gPerFrameConstants));
-	gPerModelConstantBuffer       = CreateConstantBuffer(sizeof(gPerModelConstants));
-	gPostProcessingConstantBuffer = CreateConstantBuffer(sizeof(gPostProcessingConstants));
-	if (gPerFrameConstantBuffer == nullptr || gPerModelConstantBuffer == nullptr || gPostProcessingConstantBuffer == nullptr)
+// Recreate the multisampled targets for the current sample count and viewport size. If they can't be created the scene
+// is drawn without MSAA rather than not at all
+void UpdateMultisampledSceneTargets()
+{
+	ReleaseMultisampledSceneTargets();
+	if (msaaSamples > 1 && !CreateMultisampledSceneTargets())
 	{
-		gLastError = "Error creating constant buffers";
-		return false;
+		OutputDebugStringA((gLastError + "\n").c_str());
+		ReleaseMultisampledSceneTargets();
+		msaaSamples = 1;
 	}
+}
 
+// The scene is drawn with MSAA this frame
+bool MultisampledScene()
+{
+	return gSceneRenderTargetMS != nullptr && !deferredShading && gRetroSceneTarget == nullptr && SingleView();
+}
 
 
-	//********************************************
-	//**** Create Scene Texture
-
+// Create the scene texture at the current viewport size. Returns false on failure (reason in gLastError)
+bool CreateSceneTexture()
+{
 	// We will render the scene to this texture instead of the back-buffer (screen), then we post-process the texture onto the screen
 	// This is exactly the same code we used in the graphics module when we were rendering the scene onto a cube using a texture
 
@@ -400,30 +790,21 @@ bool InitGeometry()
 	D3D11_TEXTURE2D_DESC sceneTextureDesc = {};
 	sceneTextureDesc.Width = gViewportWidth;  // Full-screen post-processing - use full screen size for texture
 	sceneTextureDesc.Height = gViewportHeight;
-	sceneTextureDesc.MipLevels = 1; // No mip-maps when rendering to textures (or we would have to render every level)
+	sceneTextureDesc.MipLevels = 0; // Full mip chain, only rendered at the top level. The pyramid blur builds the rest with GenerateMips
 	sceneTextureDesc.ArraySize = 1;
-	sceneTextureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // RGBA texture (8-bits each)
+	sceneTextureDesc.Format = gSceneFormat; // RGBA texture (8-bits each) unless HDR
 	sceneTextureDesc.SampleDesc.Count = 1;
 	sceneTextureDesc.SampleDesc.Quality = 0;
 	sceneTextureDesc.Usage = D3D11_USAGE_DEFAULT;
 	sceneTextureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE; // IMPORTANT: Indicate we will use texture as render target, and pass it to shaders
 	sceneTextureDesc.CPUAccessFlags = 0;
-	sceneTextureDesc.MiscFlags = 0;
+	sceneTextureDesc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
 	if (FAILED(gD3DDevice->CreateTexture2D(&sceneTextureDesc, NULL, &gSceneTexture)))
 	{
 		gLastError = "Error creating scene texture";
 		return false;
 	}
-	if (FAILED(gD3DDevice->CreateTexture2D(&sceneTextureDesc, NULL, &gPostProcessTexture)))
-	{
-		gLastError = "Error creating scene texture";
-		return false;
-	}
-	if (FAILED(gD3DDevice->CreateTexture2D(&sceneTextureDesc, NULL, &gBloomTexture)))
-	{
-		gLastError = "Error creating scene texture";
-		return false;
-	}
+	gResourceRegistry.Track(gSceneTexture);
 
 	// We created the scene texture above, now we get a "view" of it as a render target, i.e. get a special pointer to the texture that
 	// we use when rendering to it (see RenderScene function below)
@@ -432,18 +813,10 @@ bool InitGeometry()
 		gLastError = "Error creating scene render target view";
 		return false;
 	}
-	if (FAILED(gD3DDevice->CreateRenderTargetView(gPostProcessTexture, NULL, &gPostProcessRenderTarget)))
-	{
-		gLastError = "Error creating scene render target view";
-		return false;
-	}
-	if (FAILED(gD3DDevice->CreateRenderTargetView(gBloomTexture, NULL, &gBloomRenderTarget)))
-	{
-		gLastError = "Error creating scene render target view";
-		return false;
-	}
 
-	// We also need to send this texture (resource) to the shaders. To do that we must create a shader-resource "view"
+	// We also need to send this texture (resource) to the shaders. To do that we must create a shader-resource "view".
+	// This one only sees the top level - the other mips are stale except straight after GenerateMips, and shaders
+	// sampling this texture at a smaller size would otherwise read them
 	D3D11_SHADER_RESOURCE_VIEW_DESC srDesc = {};
 	srDesc.Format = sceneTextureDesc.Format;
 	srDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
@@ -454,17 +827,193 @@ bool InitGeometry()
 		gLastError = "Error creating scene shader resource view";
 		return false;
 	}
-	if (FAILED(gD3DDevice->CreateShaderResourceView(gPostProcessTexture, &srDesc, &gPostProcessTextureSRV)))
+	srDesc.Texture2D.MipLevels = static_cast<UINT>(-1);
+	if (FAILED(gD3DDevice->CreateShaderResourceView(gSceneTexture, &srDesc, &gSceneTextureMipsSRV)))
 	{
-		gLastError = "Error creating scene shader resource view";
+		gLastError = "Error creating scene mip chain shader resource view";
 		return false;
 	}
-	if (FAILED(gD3DDevice->CreateShaderResourceView(gBloomTexture, &srDesc, &gBloomTextureSRV)))
+
+	UpdateMultisampledSceneTargets();
+	return true;
+}
+
+void ReleaseSceneTexture()
+{
+	if (gSceneTextureMipsSRV)  gSceneTextureMipsSRV->Release();
+	if (gSceneTextureSRV)      gSceneTextureSRV->Release();
+	if (gSceneRenderTarget)    gSceneRenderTarget->Release();
+	if (gSceneTexture)         gSceneTexture->Release();
+	gSceneTextureMipsSRV = nullptr;
+	gSceneTextureSRV     = nullptr;
+	gSceneRenderTarget   = nullptr;
+	gSceneTexture        = nullptr;
+	ReleaseMultisampledSceneTargets();
+}
+
+
+bool InitGeometry()
+{
+	CPU_PROFILE_SCOPE("InitGeometry");
+
+	// Threads for loading, updating and recording the scene, one for each hardware thread
+	gJobSystem.Init();
+
+	// Cooked meshes, textures and shaders are taken from the asset pack where it has them (see AssetPack.h). Not an error
+	// if there is no pack, the loose files are loaded instead
+	gAssetPack.Open(ASSET_PACK_FILE);
+
+	////--------------- Load meshes & textures ---------------////
+
+	// Load mesh geometry data, just like TL-Engine this doesn't create anything in the scene. Create a Model for that.
+	// Also load textures and create DirectX objects for them. Each texture needs a ID3D11Resource* (e.g. &gCubeDiffuseMap),
+	// which manages the GPU memory for the texture and also a ID3D11ShaderResourceView* (e.g. &gCubeDiffuseMapSRV), which
+	// allows us to use the texture in shaders. The variables used here are globals found near the top of the file.
+	// The meshes and post-processing textures are all loaded at once, spread over all the cores (see AssetLoader.h).
+	// Meshes are added first as they are the slowest to load
+	{
+		STARTUP_SCOPE(StartupStage::Phase, "Load meshes");
+		gGeometryPool.SetEnabled(geometryPool);
+		AssetLoader loader;
+		loader.AddMesh("Stars.x",          &gStarsMesh,  false, compactVertices, NUM_MESH_LODS);
+		loader.AddMesh("Hills.x",          &gGroundMesh, false, compactVertices, NUM_MESH_LODS);
+		loader.AddMesh("Cube.x",           &gCubeMesh,   false, compactVertices, NUM_MESH_LODS);
+		loader.AddMesh("CargoContainer.x", &gCrateMesh,  false, compactVertices, NUM_MESH_LODS);
+		loader.AddMesh("Light.x",          &gLightMesh,  false, compactVertices, NUM_MESH_LODS);
+		if (numStressModels > 0)
+		{
+			loader.AddMesh("Teapot.x", &gTeapotMesh, false, compactVertices, NUM_MESH_LODS);
+			loader.AddMesh("Sphere.x", &gSphereMesh, false, compactVertices, NUM_MESH_LODS);
+			loader.AddMesh("Troll.x",  &gTrollMesh,  false, compactVertices, NUM_MESH_LODS);
+		}
+
+		if (!loader.Load())  return false; // Reason is in gLastError
+		gGeometryPool.Flush(); // Upload the shared mesh buffers, the loader could only use the device
+	}
+
+	// Model textures are streamed in the background, starting with a placeholder, so the first frame isn't held up by them
+	// (see TextureStreamer.h)
 	{
-		gLastError = "Error creating scene shader resource view";
+		STARTUP_SCOPE(StartupStage::Phase, "Start textures");
+		if (!gTextureStreamer.LoadTextureAsync("Stars.jpg",                &gStarsDiffuseSpecularMap,  &gStarsDiffuseSpecularMapSRV) ||
+		    !gTextureStreamer.LoadTextureAsync("GrassDiffuseSpecular.dds", &gGroundDiffuseSpecularMap, &gGroundDiffuseSpecularMapSRV) ||
+		    !gTextureStreamer.LoadTextureAsync("StoneDiffuseSpecular.dds", &gCubeDiffuseSpecularMap,   &gCubeDiffuseSpecularMapSRV) ||
+		    !gTextureStreamer.LoadTextureAsync("CargoA.dds",               &gCrateDiffuseSpecularMap,  &gCrateDiffuseSpecularMapSRV) ||
+		    !gTextureStreamer.LoadTextureAsync("Flare.jpg",                &gLightDiffuseMap,          &gLightDiffuseMapSRV))
+		{
+			return false; // Reason is in gLastError
+		}
+		if (!gSky.Load("Stars.jpg"))  OutputDebugStringA(("Sky pass unavailable, drawing the star sphere: " + gLastError + "\n").c_str());
+		if (numStressModels > 0 &&
+		    (!gTextureStreamer.LoadTextureAsync("WoodDiffuseSpecular.dds",  &gWoodDiffuseSpecularMap,  &gWoodDiffuseSpecularMapSRV) ||
+		     !gTextureStreamer.LoadTextureAsync("TrollDiffuseSpecular.dds", &gTrollDiffuseSpecularMap, &gTrollDiffuseSpecularMapSRV)))
+		{
+			return false; // Reason is in gLastError
+		}
+	}
+
+
+	////--------------- Prepare GPU states ---------------////
+
+	// Create all filtering modes, blending modes etc. used by the app (see State.cpp/.h)
+	{
+		STARTUP_SCOPE(StartupStage::Phase, "Create states");
+		if (!CreateStates())
+		{
+			gLastError = "Error creating states";
+			return false;
+		}
+	}
+
+
+	////--------------- Prepare shaders and constant buffers to communicate with them ---------------////
+
+	// Load the shaders required for the geometry we will use (see Shader.cpp / .h)
+	{
+		STARTUP_SCOPE(StartupStage::Phase, "Load shaders");
+		if (!LoadShaders())
+		{
+			gLastError = "Error loading shaders";
+			return false;
+		}
+	}
+
+	// Create GPU-side constant buffers to receive the gPerFrameConstants and gPerModelConstants structures above
+	// These allow us to pass data from CPU to shaders such as lighting information or matrices
+	// See the comments above where these variable are declared and also the UpdateScene function
+	gPerFrameConstantBuffer       = CreateConstantBuffer(sizeof(gPerFrameConstants));
+	gPerModelConstantBuffer       = CreateConstantBuffer(sizeof(gPerModelConstants));
+	gSkeletonConstantBuffer       = CreateConstantBuffer(sizeof(gSkeletonConstants));
+	gInstanceBuffer               = CreateStructuredBuffer(sizeof(InstanceData), MAX_INSTANCES, &gInstanceBufferSRV);
+	gLightFlareBuffer             = CreateStructuredBuffer(sizeof(LightFlareData), MAX_LIGHTS, &gLightFlareBufferSRV);
+	gBlurKernelConstantBuffer     = CreateConstantBuffer(sizeof(gBlurKernelConstants));
+	gProfilerOverlayConstantBuffer = CreateConstantBuffer(sizeof(gProfilerOverlayConstants));
+	bool postProcessingBufferCreated = gPostProcessingConstantBuffer.Create();
+	if (gPerFrameConstantBuffer == nullptr || gPerModelConstantBuffer == nullptr || gSkeletonConstantBuffer == nullptr ||
+	    gInstanceBuffer == nullptr || gLightFlareBuffer == nullptr || !postProcessingBufferCreated ||
+	    gBlurKernelConstantBuffer == nullptr || gProfilerOverlayConstantBuffer == nullptr)
+	{
+		gLastError = "Error creating constant buffers";
 		return false;
 	}
 
+	// Per-draw constants are written to one large buffer bound at offsets where D3D11.1 allows it, rather than each draw
+	// discarding a small buffer. Not fatal, the buffers above are used if not
+	// The ring has a section for each frame in flight (see FramePipeline.h)
+	gConstantRing = &gImmediateConstantRing;
+	if (!gImmediateConstantRing.Init(ConstantBufferRing::FRAME_RING_SIZE))  OutputDebugStringA((gLastError + "\n").c_str());
+
+	// Likewise the instances of instanced draws, written to blocks of one buffer where D3D11.1 allows it
+	gInstanceRing = &gImmediateInstanceRing;
+	if (!gImmediateInstanceRing.Init())  OutputDebugStringA((gLastError + "\n").c_str());
+
+	// Queries following the frames in flight, without them frames are queued as the driver chooses and the versioned
+	// resources above fall back to discarding when the GPU may still be reading them
+	if (!gFramePipeline.Init())  OutputDebugStringA((gLastError + "\n").c_str());
+
+	// Buffers holding the lights and the lights reaching each cluster of the view
+	if (!gLightClusters.Init())  return false;
+
+	// Shadow cubemaps for the main lights. Not fatal, the lights are unshadowed without them
+	if (!gShadowMaps.Init(SHADOW_MAP_SIZE))  OutputDebugStringA(("Shadows unavailable: " + gLastError + "\n").c_str());
+
+	// Histogram and exposure buffers for auto exposure
+	if (!gAutoExposure.Init())  return false;
+
+	// Timestamp queries for the GPU profiler
+	if (!gGpuProfiler.Init())  return false;
+
+	// The quality governor's knobs, timed by the passes each one makes cheaper
+	if (gQualityGovernor.NumKnobs() == 0)
+	{
+		governorBlurKnob  = gQualityGovernor.AddKnob("Gaussian blur", 3, { "Gaussian Blur" });
+		governorBloomKnob = gQualityGovernor.AddKnob("Bloom mips", 3, { "Bloom" });
+		governorRateKnob  = gQualityGovernor.AddKnob("Blur rate", 3, { "Gaussian Blur V", "Pyramid Blur" });
+	}
+
+	// Deferred contexts for recording the scene, by default one for each job system thread and one for the main thread
+	int numThreads = renderThreads;
+	if (numThreads < 0)  numThreads = gJobSystem.NumThreads() + 1;
+	if (!gDeferredRenderer.Init(numThreads))  return false;
+
+	// Texture the scene is rendered to for post-processing
+	if (!CreateSceneTexture())  return false;
+
+	// Find which Gaussian blur technique is fastest at each width on this GPU, measured once per adapter and cached. Not
+	// fatal, a fixed rule is used if this fails
+	{
+		STARTUP_SCOPE(StartupStage::Phase, "Calibrate");
+		if (!gBlurSelector.Calibrate(gViewportWidth, gViewportHeight))
+		{
+			OutputDebugStringA(("Blur calibration failed: " + gLastError + "\n").c_str());
+		}
+
+		// Likewise the thread group size of the compute post-processes, 8x8 if this fails
+		if (!gComputeTuner.Calibrate(gViewportWidth, gViewportHeight))
+		{
+			OutputDebugStringA(("Compute group size calibration failed: " + gLastError + "\n").c_str());
+		}
+	}
 
 	return true;
 }
@@ -478,10 +1027,10 @@ bool InitScene()
 
 	////--------------- Set up scene ---------------////
 
-	gStars  = new Model(gStarsMesh);
-	gGround = new Model(gGroundMesh);
-	gCube   = new Model(gCubeMesh);
-	gCrate  = new Model(gCrateMesh);
+	gStars  = gModelPool.Create(gStarsMesh);
+	gGround = gModelPool.Create(gGroundMesh);
+	gCube   = gModelPool.Create(gCubeMesh);
+	gCrate  = gModelPool.Create(gCrateMesh);
 
 	// Initial positions
 	gCube->SetPosition({ 42, 5, -10 });
@@ -490,13 +1039,85 @@ bool InitScene()
 	gCrate->SetPosition({ -10, 0, 90 });
 	gCrate->SetRotation({ 0.0f, ToRadians(40.0f), 0.0f });
 	gCrate->SetScale(6.0f);
+	for (Model* model : { gGround, gCube, gCrate })  model->SetStatic(true);
 	gStars->SetScale(8000.0f);
 
+	for (Model* model : { gStars, gGround, gCube, gCrate })
+	{
+		if (model->GetMesh()->HasBones())  gSkinnedModels.push_back(model);
+	}
+
+	// Stress scene models, a random mesh each with a random size and spin (the same each run). The stress area is square,
+	// large enough to hold all the models in a grid STRESS_SPACING apart
+	int stressSide = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(numStressModels))));
+	float stressExtent = 0.5f * stressSide * STRESS_SPACING;
+	if (numStressModels > 0)
+	{
+		struct StressMesh { Mesh* mesh; ID3D11ShaderResourceView** texture; float scale; }; // Scales bring each to about 4 units across
+		const StressMesh stressMeshes[] = { { gCrateMesh,  &gCrateDiffuseSpecularMapSRV, 0.7f },
+		                                    { gCubeMesh,   &gCubeDiffuseSpecularMapSRV,  0.4f },
+		                                    { gTeapotMesh, &gWoodDiffuseSpecularMapSRV,  0.2f },
+		                                    { gSphereMesh, &gCubeDiffuseSpecularMapSRV,  0.2f },
+		                                    { gTrollMesh,  &gTrollDiffuseSpecularMapSRV, 1.6f } };
+		const int numStressMeshes = sizeof(stressMeshes) / sizeof(stressMeshes[0]);
+
+		std::mt19937 random(2);
+		std::uniform_int_distribution<int>    randomMesh(0, numStressMeshes - 1);
+		std::uniform_real_distribution<float> randomScale(0.7f, 1.3f);
+		std::uniform_real_distribution<float> randomSpin(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> randomAngle(0.0f, 2 * PI);
+		std::uniform_real_distribution<float> randomPosition(-stressExtent, stressExtent);
+		std::uniform_real_distribution<float> randomHeight(0.5f * STRESS_HEIGHT, 2.0f * STRESS_HEIGHT);
+		gStressModels.resize(numStressModels);
+		for (int i = 0; i < numStressModels; ++i)
+		{
+			const StressMesh& stressMesh = stressMeshes[randomMesh(random)];
+			StressModel& stress = gStressModels[i];
+			stress.model   = gModelPool.Create(stressMesh.mesh);
+			stress.texture = stressMesh.texture;
+			stress.spin    = randomSpin(random);
+			stress.phase   = randomAngle(random);
+			if (stressGrid)  stress.position = { -stressExtent + (i % stressSide + 0.5f) * STRESS_SPACING, STRESS_HEIGHT,
+			                                     -stressExtent + (i / stressSide + 0.5f) * STRESS_SPACING };
+			else             stress.position = { randomPosition(random), randomHeight(random), randomPosition(random) };
+			stress.model->SetPosition(stress.position);
+			stress.model->SetRotation({ 0.0f, stress.phase, 0.0f });
+			stress.model->SetScale(stressMesh.scale * randomScale(random));
+			stress.model->SetStatic(!stressAnimated);
+
+			Mesh* mesh = stressMesh.mesh;
+			if (stressAnimated && mesh->NumClips() > 0)
+			{
+				gStressAnimators.emplace_back(stress.model);
+				Animator& animator = gStressAnimators.back();
+				for (unsigned int clip = 0; clip < std::min(mesh->NumClips(), 2u); ++clip)
+				{
+					float start = stress.phase / (2 * PI) * mesh->GetClip(clip).duration;
+					animator.Play(clip, clip, start, 1.0f, clip == 0 ? 1.0f : 0.5f);
+				}
+			}
+		}
+
+		// Capture the impostors of the rigid meshes whether or not they are switched on, so they can be toggled. Not fatal,
+		// models without one are always drawn in full
+		STARTUP_SCOPE(StartupStage::Phase, "Capture impostors");
+		for (auto& stressMesh : stressMeshes)
+		{
+			if (stressMesh.mesh->HasBones())  continue;
+			if (!gImpostors.Capture(stressMesh.mesh, stressMesh.texture))
+			{
+				OutputDebugStringA(("Impostor capture failed: " + gLastError + "\n").c_str());
+			}
+		}
+	}
+
 
 	// Light set-up - using an array this time
-	for (int i = 0; i < NUM_LIGHTS; ++i)
+	int stressLights = std::min(numStressLights, MAX_LIGHTS - NUM_MAIN_LIGHTS - numExtraLights);
+	gLights.resize(NUM_MAIN_LIGHTS + numExtraLights + stressLights);
+	for (auto& light : gLights)
 	{
-		gLights[i].model = new Model(gLightMesh);
+		light.model = gModelPool.Create(gLightMesh);
 	}
 
 	gLights[0].colour = { 0.8f, 0.8f, 1.0f };
@@ -509,30 +1130,137 @@ bool InitScene()
 	gLights[1].model->SetPosition({ -70, 30, 100 });
 	gLights[1].model->SetScale(pow(gLights[1].strength, 0.7f));
 
+	// Extra lights are dim, so they only reach a small area, and have random colours and positions (the same each run)
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> randomColour(0.2f, 1.0f);
+	std::uniform_real_distribution<float> randomPosition(-150.0f, 150.0f);
+	std::uniform_real_distribution<float> randomHeight(1.0f, 15.0f);
+	for (int i = NUM_MAIN_LIGHTS; i < NUM_MAIN_LIGHTS + numExtraLights; ++i)
+	{
+		gLights[i].colour = { randomColour(random), randomColour(random), randomColour(random) };
+		gLights[i].strength = 2;
+		float x = randomPosition(random);
+		float z = randomPosition(random);
+		gLights[i].model->SetPosition({ x, randomHeight(random), z });
+		gLights[i].model->SetScale(pow(gLights[i].strength, 0.7f));
+	}
+
+	// Stress scene lights are laid out over the stress area like its models, a little brighter than the extra lights
+	// as they are further apart. With no stress models the area is the one the extra lights cover
+	if (numStressModels == 0)  stressExtent = 150.0f;
+	int lightSide = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(stressLights))));
+	float lightSpacing = (stressLights > 0) ? 2 * stressExtent / lightSide : 0;
+	std::uniform_real_distribution<float> randomStressPosition(-stressExtent, stressExtent);
+	for (int i = 0; i < stressLights; ++i)
+	{
+		Light& light = gLights[NUM_MAIN_LIGHTS + numExtraLights + i];
+		light.colour = { randomColour(random), randomColour(random), randomColour(random) };
+		light.strength = 4;
+		if (stressGrid)  light.model->SetPosition({ -stressExtent + (i % lightSide + 0.5f) * lightSpacing, 0.5f * STRESS_HEIGHT,
+		                                            -stressExtent + (i / lightSide + 0.5f) * lightSpacing });
+		else             light.model->SetPosition({ randomStressPosition(random), randomHeight(random), randomStressPosition(random) });
+		light.model->SetScale(pow(light.strength, 0.7f));
+	}
+
+	// Add the models to the scene tree used for culling, now their initial positions are set (the tree reads their
+	// world matrices)
+	gTransformSystem.Update();
+	gSceneTree.Insert(gStars);
+	gSceneTree.Insert(gGround);
+	gSceneTree.Insert(gCube);
+	gSceneTree.Insert(gCrate);
+	for (auto& stress : gStressModels)
+	{
+		gSceneTree.Insert(stress.model);
+	}
+	for (auto& light : gLights)
+	{
+		gSceneTree.Insert(light.model);
+	}
+
+	// The large, simple models that hide others, rasterised on the CPU for occlusion culling
+	gOcclusionCuller.SetOccluders({ gGround, gCrate });
+
+
+	////--------------- Particles ---------------////
+
+	// A fire beside the crate with a plume of smoke drifting away on the wind. The texture layers are the images below
+	ParticleEmitterData fire = {};
+	fire.position       = { 8, 1, 78 };
+	fire.spawnRadius    = 1.5f;
+	fire.velocity       = { 0, 5, 0 };
+	fire.velocitySpread = 1.5f;
+	fire.acceleration   = { 0, 3, 0 };
+	fire.drag           = 1.0f;
+	fire.colour         = { 3.0f, 1.6f, 0.7f };
+	fire.lifetime       = 1.2f;
+	fire.startSize      = 2.5f;
+	fire.endSize        = 0.8f;
+	fire.spin           = 1.0f;
+	fire.additive       = 1.0f;
+	fire.firstLayer     = 5;
+	fire.numLayers      = 1;
+	gParticleSystem.AddEmitter(fire, 1);
+
+	ParticleEmitterData smoke = {};
+	smoke.position       = { 8, 5, 78 };
+	smoke.spawnRadius    = 1.5f;
+	smoke.velocity       = { 0, 4, 0 };
+	smoke.velocitySpread = 1.0f;
+	smoke.acceleration   = { 1.5f, 0.3f, 0.5f };
+	smoke.drag           = 0.3f;
+	smoke.colour         = { 0.3f, 0.3f, 0.3f };
+	smoke.lifetime       = 9.0f;
+	smoke.startSize      = 1.0f;
+	smoke.endSize        = 5.0f;
+	smoke.spin           = 0.4f;
+	smoke.additive       = 0.0f;
+	smoke.firstLayer     = 0;
+	smoke.numLayers      = 5;
+	gParticleSystem.AddEmitter(smoke, 3);
+
+	if (!gParticleSystem.Init(numParticles, { "smoke0.png", "Smoke1.png", "smoke2.png", "smoke3.png", "smoke4.png", "fire1.png" }))
+	{
+		return false;
+	}
+
 
 	////--------------- Set up camera ---------------////
 
 	gCamera = new Camera();
+	gCamera->SetAspectRatio(static_cast<float>(gViewportWidth) / gViewportHeight);
 	gCamera->SetPosition({ 25, 18, -45 });
 	gCamera->SetRotation({ ToRadians(10.0f), ToRadians(7.0f), 0.0f });
 
+	gCurrentState = { gCamera->Position(), gCamera->Rotation(), 0.0f, tintColour.x, tintColour2.x, 0.0f };
+	gPreviousState = gCurrentState;
+	gSimulationSnapshots.Back() = { gPreviousState, gCurrentState, 0.0 };
+	gSimulationSnapshots.Publish();
+
 	return true;
 }
 void ReleaseResources()
 {
+	gTextureStreamer.Release(); // Must stop before the streamed textures are released
+	gMaterialArrays.Release();
+	gFrameCapture.Release();     // Writes out the frames still being captured
+	gSharedOutput.Release();
+	gOutputWindows.Release();
+	gFrameCache.Release();
+	gDeferredRenderer.Release();
 	ReleaseStates();
 
-	if (gSceneTextureSRV)              gSceneTextureSRV->Release();
-	if (gSceneRenderTarget)            gSceneRenderTarget->Release();
-	if (gSceneTexture)                 gSceneTexture->Release();
+	gSceneEffects.ReleaseHistory();
+	gRetroEffects.ReleaseHistory();
+	gRenderTargetPool.ReleaseAll();
 
-	if (gDistortMapSRV)                gDistortMapSRV->Release();
-	if (gDistortMap)                   gDistortMap->Release();
-	if (gBurnMapSRV)                   gBurnMapSRV->Release();
-	if (gBurnMap)                      gBurnMap->Release();
-	if (gNoiseMapSRV)                  gNoiseMapSRV->Release();
-	if (gNoiseMap)                     gNoiseMap->Release();
+	ReleaseSceneTexture();
 
+
+	if (gTrollDiffuseSpecularMapSRV)   gTrollDiffuseSpecularMapSRV->Release();
+	if (gTrollDiffuseSpecularMap)      gTrollDiffuseSpecularMap->Release();
+	if (gWoodDiffuseSpecularMapSRV)    gWoodDiffuseSpecularMapSRV->Release();
+	if (gWoodDiffuseSpecularMap)       gWoodDiffuseSpecularMap->Release();
 	if (gLightDiffuseMapSRV)           gLightDiffuseMapSRV->Release();
 	if (gLightDiffuseMap)              gLightDiffuseMap->Release();
 	if (gCrateDiffuseSpecularMapSRV)   gCrateDiffuseSpecularMapSRV->Release();
@@ -543,416 +1271,2138 @@ void ReleaseResources()
 	if (gGroundDiffuseSpecularMap)     gGroundDiffuseSpecularMap->Release();
 	if (gStarsDiffuseSpecularMapSRV)   gStarsDiffuseSpecularMapSRV->Release();
 	if (gStarsDiffuseSpecularMap)      gStarsDiffuseSpecularMap->Release();
-
-	if (gPostProcessingConstantBuffer)  gPostProcessingConstantBuffer->Release();
+	gSky.Release();
+
+	gGpuProfiler.Release();
+	gLightClusters.Release();
+	gShadowMaps.Release();
+	gImpostors.Release();
+	gGpuCuller.Release();
+	gAutoExposure.Release();
+	gFftBloomKernel.Release();
+	gBloomTiles.Release();
+	gColourLut.Release();
+	gImmediateConstantRing.Release();
+	gImmediateInstanceRing.Release();
+	gFramePipeline.Release();
+	gBonePalettes.Release();
+	gOcclusionCuller.Release();
+	gParticleSystem.Release();
+
+	if (gProfilerOverlayConstantBuffer) gProfilerOverlayConstantBuffer->Release();
+	if (gBlurKernelConstantBuffer)      gBlurKernelConstantBuffer->Release();
+	gPostProcessingConstantBuffer.Release();
+	if (gInstanceBufferSRV)             gInstanceBufferSRV->Release();
+	if (gInstanceBuffer)                gInstanceBuffer->Release();
+	if (gLightFlareBufferSRV)           gLightFlareBufferSRV->Release();
+	if (gLightFlareBuffer)              gLightFlareBuffer->Release();
+	if (gSkeletonConstantBuffer)        gSkeletonConstantBuffer->Release();
 	if (gPerModelConstantBuffer)        gPerModelConstantBuffer->Release();
 	if (gPerFrameConstantBuffer)        gPerFrameConstantBuffer->Release();
 
 	ReleaseShaders();
 
-	// See note in InitGeometry about why we're not using unique_ptr and having to manually delete
-	for (int i = 0; i < NUM_LIGHTS; ++i)
-	{
-		delete gLights[i].model;  gLights[i].model = nullptr;
-	}
+	// Everything pointing at the models goes first, then all the models and meshes are destroyed together
+	gStaticBatches.Release();
+	gSceneTree.Clear();
+	gLights.clear();
+	gStressAnimators.clear();
+	gStressModels.clear();
+	gSkinnedModels.clear();
 	delete gCamera;  gCamera = nullptr;
-	delete gCrate;   gCrate = nullptr;
-	delete gCube;    gCube = nullptr;
-	delete gGround;  gGround = nullptr;
-	delete gStars;   gStars = nullptr;
+	gModelPool.Clear(); // Before the meshes they use
+	gStars = gGround = gCube = gCrate = nullptr;
 
-	delete gLightMesh;   gLightMesh = nullptr;
-	delete gCrateMesh;   gCrateMesh = nullptr;
-	delete gCubeMesh;    gCubeMesh = nullptr;
-	delete gGroundMesh;  gGroundMesh = nullptr;
-	delete gStarsMesh;   gStarsMesh = nullptr;
-}
+	gMeshPool.Clear();
+	gStarsMesh = gGroundMesh = gCubeMesh = gCrateMesh = gLightMesh = gTeapotMesh = gSphereMesh = gTrollMesh = nullptr;
 
+	gInputLayoutCache.ReleaseAll();
+	gGeometryPool.ReleaseAll();
+	gJobSystem.Release();
 
+	// Record the order the files were loaded in, so AssetCooker -order can lay out the next pack to match
+	gAssetPack.WriteLoadOrder(ASSET_PACK_ORDER_FILE);
+	gAssetPack.Close();
+}
 
-//--------------------------------------------------------------------------------------
-// Scene Rendering
-//--------------------------------------------------------------------------------------
 
-// Render everything in the scene from the given camera
-void RenderSceneFromCamera(Camera* camera)
+bool TexturesStreaming()
 {
-	// Set camera matrices in the constant buffer and send over to GPU
-	gPerFrameConstants.cameraMatrix = camera->WorldMatrix();
-	gPerFrameConstants.viewMatrix = camera->ViewMatrix();
-	gPerFrameConstants.projectionMatrix = camera->ProjectionMatrix();
-	gPerFrameConstants.viewProjectionMatrix = camera->ViewProjectionMatrix();
-	UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
-
-	// Indicate that the constant buffer we just updated is for use in the vertex shader (VS), geometry shader (GS) and pixel shader (PS)
-	gD3DContext->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer); // First parameter must match constant buffer number in the shader 
-	gD3DContext->GSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
-	gD3DContext->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
+	return gTextureStreamer.NumPending() > 0;
+}
 
-	gD3DContext->PSSetShader(gPixelLightingPixelShader, nullptr, 0);
 
 
-	////--------------- Render ordinary models ---------------///
+//--------------------------------------------------------------------------------------
+// Scene Rendering
+//--------------------------------------------------------------------------------------
 
-	// Select which shaders to use next
-	gD3DContext->VSSetShader(gPixelLightingVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gPixelLightingPixelShader, nullptr, 0);
-	gD3DContext->GSSetShader(nullptr, nullptr, 0);  // Switch off geometry shader when not using it (pass nullptr for first parameter)
+// The camera settings used when preparing the draws. Read once on the main thread - the camera recalculates its matrices
+// whenever they are asked for, so can't be shared by the jobs preparing each pass
+struct SceneView
+{
+	CVector3 position;
+	CVector3 forward;
+	float    farClip;
+	float    pixelsPerUnit; // Size in pixels of one unit at a distance of one, for Model::SelectLod
+};
 
-	// States - no blending, normal depth buffer and back-face culling (standard set-up for opaque models)
-	gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-	gD3DContext->OMSetDepthStencilState(gUseDepthBufferState, 0);
-	gD3DContext->RSSetState(gCullBackState);
+// A model drawn as part of the scene, with the texture and colour to render it with
+struct SceneDraw
+{
+	Model*                    model;
+	ID3D11ShaderResourceView* texture;
+	CVector3                  colour;
+	ID3D11Predicate*          predicate; // Occlusion query the draw is predicated on, or null (see OcclusionCullSceneDraws)
+};
 
-	// Render lit models, only change textures for each onee
-	gD3DContext->PSSetSamplers(0, 1, &gAnisotropic4xSampler);
+// A pass's draws for one frame, in the frame arena of the thread preparing them (see LinearArena.h). The chunks copy
+// the draws they record, as static chunks outlive the frame
+typedef ArenaVector<SceneDraw> SceneDrawList;
 
-	gD3DContext->PSSetShaderResources(0, 1, &gGroundDiffuseSpecularMapSRV); // First parameter must match texture slot number in the shader
-	gGround->Render();
+SceneDrawList FrameDrawList()
+{
+	return SceneDrawList(ArenaAllocator<SceneDraw>(FrameArena()));
+}
 
-	gD3DContext->PSSetShaderResources(0, 1, &gCrateDiffuseSpecularMapSRV); // First parameter must match texture slot number in the shader
-	gCrate->Render();
+// Models that share a mesh, level of detail and texture, drawn together with instanced draw calls. With material arrays
+// the texture is the array holding all their textures, each model's slice in it is in slices
+struct SceneInstances
+{
+	ID3D11ShaderResourceView* texture;
+	std::vector<Model*>       models;
+	std::vector<CVector3>     colours;
+	std::vector<unsigned int> slices;
+};
 
-	gD3DContext->PSSetShaderResources(0, 1, &gCubeDiffuseSpecularMapSRV); // First parameter must match texture slot number in the shader
-	gCube->Render();
+// Start recording a chunk by setting the render target, viewport and per-frame constants (a deferred context starts
+// with no state) then the given pass states
+void BeginSceneChunk(ID3D11RenderTargetView* target, const D3D11_VIEWPORT& viewport, const std::function<void()>& passSetup)
+{
+	gD3DContext->OMSetRenderTargets(1, &target, gSceneDepthStencil);
+	gD3DContext->RSSetViewports(1, &viewport);
 
+	// Bind the per-frame constant buffer for whichever shaders read it
+	gStateCache.SetConstantBuffer(PER_FRAME_CONSTANTS_SLOT, gPerFrameConstantBuffer);
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	passSetup();
+}
 
-	////--------------- Render sky ---------------////
+// Choose the lights reaching a model for per-object light assignment and put their indices in the per-model constants,
+// the MAX_OBJECT_LIGHTS most influential first. A light's influence is its brightness falling off with distance from the
+// model's bounding sphere as the shader's does, so models out of range of every light get none. Any thread
+void AssignObjectLights(Model* model)
+{
+	BoundingBox bounds = model->WorldBoundingBox();
+	CVector3 centre = bounds.Centre();
+	float radius = Length(bounds.HalfExtents());
+
+	// Few lights reach any one model, so a small sorted list of the best so far is kept
+	std::pair<float, unsigned int> chosen[MAX_OBJECT_LIGHTS];
+	unsigned int numChosen = 0;
+	for (unsigned int i = 0; i < gFrameLights.size(); ++i)
+	{
+		const LightData& light = gFrameLights[i];
+		float distance = std::max(Length(light.position - centre) - radius, 0.0f);
+		if (distance >= light.range)  continue;
+
+		float fade = 1 - std::pow(distance / light.range, 4.0f);
+		float influence = std::max({ light.colour.x, light.colour.y, light.colour.z }) * fade * fade / std::max(distance, 1.0f);
+		if (numChosen == MAX_OBJECT_LIGHTS && influence <= chosen[numChosen - 1].first)  continue;
+
+		unsigned int slot = std::min(numChosen, static_cast<unsigned int>(MAX_OBJECT_LIGHTS - 1));
+		while (slot > 0 && chosen[slot - 1].first < influence)
+		{
+			chosen[slot] = chosen[slot - 1];
+			--slot;
+		}
+		chosen[slot] = { influence, i };
+		numChosen = std::min(numChosen + 1, static_cast<unsigned int>(MAX_OBJECT_LIGHTS));
+	}
 
-	// Select which shaders to use next
-	gD3DContext->VSSetShader(gBasicTransformVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gTintedTexturePixelShader, nullptr, 0);
+	gPerModelConstants.numObjectLights = numChosen;
+	for (unsigned int i = 0; i < numChosen; ++i)  gPerModelConstants.objectLights[i] = chosen[i].second;
+}
 
-	// Using a pixel shader that tints the texture - don't need a tint on the sky so set it to white
-	gPerModelConstants.objectColour = { 1, 1, 1 };
 
-	// Stars point inwards
-	gD3DContext->RSSetState(gCullNoneState);
+// Split the draws into chunks of renderChunkSize models and add them to the list. With instanced rendering the draws
+// sharing a mesh and texture are grouped first and each chunk holds renderChunkSize groups, each drawn with instancing.
+// The pass setup must select the instanced shaders in that case. With useMaterialArrays the draws are grouped by the
+// material array holding their texture instead, and the setup must select shaders reading the arrays. All the draws'
+// textures must then have been given to the last gMaterialArrays.Update. With useObjectLights each draw that isn't
+// instanced is given its own lights (see AssignObjectLights), for a pass setup selecting the OBJECT_LIGHTS shader
+void AddSceneChunks(std::vector<DeferredRenderer::RenderChunk>& chunks, const SceneDrawList& draws,
+                    ID3D11RenderTargetView* target, const D3D11_VIEWPORT& viewport, std::function<void()> passSetup,
+                    bool useMaterialArrays = false, bool useObjectLights = false)
+{
+	if (instancedRendering)
+	{
+		// Group the draws, keeping the groups in the order they first appear
+		std::vector<SceneInstances> groups;
+		for (auto& draw : draws)
+		{
+			unsigned int slice = 0;
+			ID3D11ShaderResourceView* texture = (useMaterialArrays ? gMaterialArrays.Find(draw.texture, &slice) : draw.texture);
+			auto group = std::find_if(groups.begin(), groups.end(), [&draw, texture](const SceneInstances& instances)
+			{
+				return instances.texture == texture && instances.models[0]->GetMesh() == draw.model->GetMesh() &&
+				       instances.models[0]->Lod() == draw.model->Lod();
+			});
+			if (group == groups.end())  group = groups.insert(groups.end(), { texture, {}, {}, {} });
+			group->models.push_back(draw.model);
+			group->colours.push_back(draw.colour);
+			group->slices.push_back(slice);
+		}
+
+		int chunkSize = (renderChunkSize > 0 ? renderChunkSize : static_cast<int>(groups.size()));
+		for (size_t first = 0; first < groups.size(); first += chunkSize)
+		{
+			std::vector<SceneInstances> chunkGroups(groups.begin() + first, groups.begin() + std::min(first + chunkSize, groups.size()));
+			chunks.push_back([chunkGroups, target, viewport, passSetup]()
+			{
+				BeginSceneChunk(target, viewport, passSetup);
+				for (auto& group : chunkGroups)
+				{
+					gD3DContext->PSSetShaderResources(0, 1, &group.texture);
+					Model::RenderInstanced(group.models.data(), group.colours.data(), static_cast<unsigned int>(group.models.size()),
+					                       group.slices.data());
+				}
+			});
+		}
+		return;
+	}
 
-	// Render sky
-	gD3DContext->PSSetShaderResources(0, 1, &gStarsDiffuseSpecularMapSRV);
-	gStars->Render();
+	int chunkSize = (renderChunkSize > 0 ? renderChunkSize : static_cast<int>(draws.size()));
+	for (size_t first = 0; first < draws.size(); first += chunkSize)
+	{
+		std::vector<SceneDraw> chunkDraws(draws.begin() + first, draws.begin() + std::min(first + chunkSize, draws.size()));
+		chunks.push_back([chunkDraws, target, viewport, passSetup, useObjectLights]()
+		{
+			BeginSceneChunk(target, viewport, passSetup);
+			ID3D11ShaderResourceView* boundTexture = nullptr;
+			for (auto& draw : chunkDraws)
+			{
+				// Sorted draws often share a texture with the previous draw, shader resources aren't filtered by the state cache
+				if (draw.texture != boundTexture)
+				{
+					gD3DContext->PSSetShaderResources(0, 1, &draw.texture); // First parameter must match texture slot number in the shader
+					boundTexture = draw.texture;
+				}
+				gPerModelConstants.objectColour = draw.colour; // Set any per-model constants apart from the world matrix just before calling render
+				if (useObjectLights)  AssignObjectLights(draw.model);
+				if (draw.predicate)  gD3DContext->SetPredication(draw.predicate, FALSE); // Skipped by the GPU if the query found it hidden
+				draw.model->Render();
+				if (draw.predicate)  gD3DContext->SetPredication(nullptr, FALSE);
+			}
+		});
+	}
+}
 
 
+// Add a chunk drawing the impostors of the given draws, those sharing a mesh with one instanced draw for each MAX_INSTANCES
+// (see Impostors.h). The pass setup must select the impostor shaders. They aren't predicated on occlusion queries
+void AddImpostorChunk(std::vector<DeferredRenderer::RenderChunk>& chunks, const SceneDrawList& draws,
+                      ID3D11RenderTargetView* target, const D3D11_VIEWPORT& viewport, std::function<void()> passSetup)
+{
+	if (draws.empty())  return;
 
-	////--------------- Render lights ---------------////
+	std::vector<std::pair<Mesh*, std::vector<Model*>>> groups;
+	for (auto& draw : draws)
+	{
+		Mesh* mesh = draw.model->GetMesh();
+		auto group = std::find_if(groups.begin(), groups.end(), [mesh](const std::pair<Mesh*, std::vector<Model*>>& models)
+		{
+			return models.first == mesh;
+		});
+		if (group == groups.end())  group = groups.insert(groups.end(), { mesh, {} });
+		group->second.push_back(draw.model);
+	}
 
-	// Select which shaders to use next (actually same as before, so we could skip this)
-	gD3DContext->VSSetShader(gBasicTransformVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gTintedTexturePixelShader, nullptr, 0);
+	chunks.push_back([groups, target, viewport, passSetup]()
+	{
+		BeginSceneChunk(target, viewport, passSetup);
+		for (auto& group : groups)
+		{
+			gImpostors.Render(group.first, group.second.data(), static_cast<unsigned int>(group.second.size()));
+		}
+	});
+}
 
-	// Select the texture and sampler to use in the pixel shader
-	gD3DContext->PSSetShaderResources(0, 1, &gLightDiffuseMapSRV); // First parameter must match texture slot number in the shaer
 
-	// States - additive blending, read-only depth buffer and no culling (standard set-up for blending)
-	gD3DContext->OMSetBlendState(gAdditiveBlendingState, nullptr, 0xffffff);
-	gD3DContext->OMSetDepthStencilState(gDepthReadOnlyState, 0);
-	gD3DContext->RSSetState(gCullNoneState);
+// Lay out the draws to be culled on the GPU in groups sharing a mesh and texture (or material array with
+// useMaterialArrays) and add a chunk drawing them to the model pass, and to the pre-pass if it is given. The pass setups
+// must select the shaders built with GPU_CULLING. Their levels of detail are only known to the GPU, so their streamed
+// textures are wanted at full detail
+void AddGpuCulledChunks(std::vector<DeferredRenderer::RenderChunk>* prePassChunks,
+                        std::vector<DeferredRenderer::RenderChunk>& modelChunks, const SceneDrawList& draws,
+                        ID3D11RenderTargetView* target, const D3D11_VIEWPORT& viewport,
+                        std::function<void()> prePassSetup, std::function<void()> modelSetup, bool useMaterialArrays)
+{
+	if (draws.empty())  return;
 
-	// Render all the lights in the array
-	for (int i = 0; i < NUM_LIGHTS; ++i)
+	std::vector<SceneInstances> groups;
+	for (auto& draw : draws)
 	{
-		gPerModelConstants.objectColour = gLights[i].colour; // Set any per-model constants apart from the world matrix just before calling render (light colour here)
-		gLights[i].model->Render();
+		unsigned int slice = 0;
+		ID3D11ShaderResourceView* texture = (useMaterialArrays ? gMaterialArrays.Find(draw.texture, &slice) : draw.texture);
+		auto group = std::find_if(groups.begin(), groups.end(), [&draw, texture](const SceneInstances& instances)
+		{
+			return instances.texture == texture && instances.models[0]->GetMesh() == draw.model->GetMesh();
+		});
+		if (group == groups.end())  group = groups.insert(groups.end(), { texture, {}, {}, {} });
+		group->models.push_back(draw.model);
+		group->colours.push_back(draw.colour);
+		group->slices.push_back(slice);
+		gTextureStreamer.NoteUsage(draw.texture, 0);
 	}
 
+	std::vector<std::pair<ID3D11ShaderResourceView*, unsigned int>> culledGroups; // Texture and GpuCuller group
+	for (auto& group : groups)
+	{
+		unsigned int culled = gGpuCuller.AddGroup(group.models.data(), group.colours.data(), group.slices.data(),
+		                                          static_cast<unsigned int>(group.models.size()));
+		culledGroups.push_back({ group.texture, culled });
+	}
 
-
-
+	auto addChunk = [&culledGroups, target, viewport](std::vector<DeferredRenderer::RenderChunk>& chunks,
+	                                                  std::function<void()> passSetup)
+	{
+		chunks.push_back([culledGroups, target, viewport, passSetup]()
+		{
+			BeginSceneChunk(target, viewport, passSetup);
+			for (auto& group : culledGroups)
+			{
+				gD3DContext->PSSetShaderResources(0, 1, &group.first);
+				gGpuCuller.Render(group.second);
+			}
+		});
+	};
+	if (prePassChunks)  addChunk(*prePassChunks, prePassSetup);
+	addChunk(modelChunks, modelSetup);
 }
 
-//**************************
-
 
-
-//this function calls the Draw() function to render the quad, but also switches the textures.
-void RenderAndReset()
+// Add a chunk drawing the given static batches (see StaticBatches.h) with the pass states, but the given shaders for
+// models that aren't instanced and don't read material arrays
+void AddStaticBatchChunk(std::vector<DeferredRenderer::RenderChunk>& chunks, const std::vector<unsigned int>& batches,
+                         ID3D11RenderTargetView* target, const D3D11_VIEWPORT& viewport, std::function<void()> passSetup,
+                         ID3D11VertexShader* vertexShader, ID3D11PixelShader* pixelShader)
 {
-	// ########### render to texture ############
-	//update buffers before rendering (so that shaders get up to date values)
-	UpdateConstantBuffer(gPostProcessingConstantBuffer, gPostProcessingConstants);
-	gD3DContext->PSSetConstantBuffers(1, 1, &gPostProcessingConstantBuffer);
-	// draw the quad -- run the shaders
-	gD3DContext->Draw(4, 0);
-	// unbind SRV, ready for next render
-	ID3D11ShaderResourceView* nullSRV = nullptr;
-	gD3DContext->PSSetShaderResources(0, 1, &nullSRV);
-	//###########################################
-
-	// copy post process texture back to the scene texture
-	gD3DContext->OMSetRenderTargets(1, &gSceneRenderTarget, gDepthStencil);
-	gD3DContext->PSSetShader(gCopy_PostProcess, nullptr, 0);
-	gD3DContext->PSSetShaderResources(0, 1, &gPostProcessTextureSRV);
-
-	// ########### render to texture ############ (same as above)
-	//update buffers before rendering (so that shaders get up to date values)
-	UpdateConstantBuffer(gPostProcessingConstantBuffer, gPostProcessingConstants);
-	gD3DContext->PSSetConstantBuffers(1, 1, &gPostProcessingConstantBuffer);
-	// draw the quad
-	gD3DContext->Draw(4, 0);
-	// unbind SRV, ready for next render
-	gD3DContext->PSSetShaderResources(0, 1, &nullSRV);
-	//###########################################
+	if (batches.empty())  return;
+	chunks.push_back([batches, target, viewport, passSetup, vertexShader, pixelShader]()
+	{
+		BeginSceneChunk(target, viewport, passSetup);
+		gStateCache.VSSetShader(vertexShader, nullptr, 0);
+		gStateCache.PSSetShader(pixelShader, nullptr, 0);
+		gStaticBatches.Render(batches.data(), static_cast<unsigned int>(batches.size()));
+	});
 }
 
-// Run any scene post-processing steps
-void PostProcessing(float frameTime)
+
+// Remove the draws for models outside the frustum, before any rendering work is done for them. The visible models
+// come from a scene tree query and must be sorted
+void CullSceneDraws(SceneDrawList& draws, const std::vector<Model*>& visible)
 {
-	timer += frameTime;
+	modelsConsidered += static_cast<int>(draws.size());
+	if (!frustumCulling)  return;
 
-	// Using special vertex shader than creates its own data for a full screen quad
-	gD3DContext->VSSetShader(gFullScreenQuadVertexShader, nullptr, 0);
-	gD3DContext->GSSetShader(nullptr, nullptr, 0);  // Switch off geometry shader when not using it (pass nullptr for first parameter)
+	auto culled = std::remove_if(draws.begin(), draws.end(), [&visible](const SceneDraw& draw)
+	{
+		return !std::binary_search(visible.begin(), visible.end(), draw.model);
+	});
+	modelsCulled += static_cast<int>(draws.end() - culled);
+	draws.erase(culled, draws.end());
+}
 
-	// States - no blending, ignore depth buffer and culling
-	gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-	gD3DContext->OMSetDepthStencilState(gNoDepthBufferState, 0);
-	gD3DContext->RSSetState(gCullNoneState);
 
-	// No need to set vertex/index buffer (see fullscreen quad vertex shader), just indicate that the quad will be created as a triangle strip
-	gD3DContext->IASetInputLayout(NULL); // No vertex data
-	gD3DContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+// Remove the draws for models hidden behind others (see OcclusionCuller.h), after frustum culling. Draws that still need
+// the GPU's query result are given the query to be predicated on. Instanced groups are drawn together so only use the
+// tests that cull on the CPU
+void OcclusionCullSceneDraws(SceneDrawList& draws)
+{
+	if (!occlusionCulling || !SingleView())  return; // The occlusion is only found for the main camera
 
-	gPostProcessingConstants.blurBellcurveStrength = blurCurve;
-	gPostProcessingConstants.blurRadius = blurStrength;
-	
-	// Prepare custom settings for current post-process
-	if (Tint)
+	auto culled = std::remove_if(draws.begin(), draws.end(), [](SceneDraw& draw)
 	{
-		// choose render target
-		gD3DContext->OMSetRenderTargets(1, &gPostProcessRenderTarget, gDepthStencil);
+		bool occluded = gOcclusionCuller.IsOccluded(draw.model, draw.predicate);
+		if (instancedRendering)  draw.predicate = nullptr;
+		return occluded;
+	});
+	draws.erase(culled, draws.end());
+}
 
-		//shader settings
-		gPostProcessingConstants.tintColour = HSLToRGB(tintColour);
-		gPostProcessingConstants.tintColour2 = HSLToRGB(tintColour2);
 
-		//shader
-		gD3DContext->PSSetShader(gTintPostProcess, nullptr, 0);
-		gD3DContext->PSSetShaderResources(0, 1, &gSceneTextureSRV);
-		gD3DContext->PSSetSamplers(0, 1, &gPointSampler);
+// Choose the level of detail of each model to draw, from its distance and the camera's field of view. Also note how much
+// texture detail each model needs, which the streamed textures load mip levels for (see TextureStreamer.h)
+void SelectSceneLods(SceneDrawList& draws, const SceneView& view)
+{
+	for (auto& draw : draws)
+	{
+		if (lodSelection)  draw.model->SelectLod(view.position, view.pixelsPerUnit, LOD_PIXEL_ERROR);
+		else               draw.model->SetLod(0);
+		if (draw.model->Lod() > 0)  ++modelsReducedLod;
+		gTextureStreamer.NoteUsage(draw.texture, draw.model->UVsPerPixel(view.position, view.pixelsPerUnit));
+	}
+}
 
 
-		RenderAndReset();
-	}
-	if (GaussianBlur)
+// Move the draws of models small enough on screen to be drawn as impostors (see Impostors.h) into their own list, after
+// the levels of detail are chosen so their textures are still kept at the detail the impostors were captured from
+void SplitImpostorDraws(SceneDrawList& draws, SceneDrawList& impostorDraws, const SceneView& view)
+{
+	auto replaced = std::partition(draws.begin(), draws.end(), [&view](const SceneDraw& draw)
 	{
-		// the first pass - blur horizontally
-		gD3DContext->OMSetRenderTargets(1, &gPostProcessRenderTarget, gDepthStencil);
+		return !gImpostors.Replaces(draw.model, view.position, view.pixelsPerUnit);
+	});
+	impostorDraws.insert(impostorDraws.end(), replaced, draws.end());
+	draws.erase(replaced, draws.end());
+	modelsImpostored += static_cast<int>(impostorDraws.size());
+}
 
-		// blur Horizontally shader
-		gPostProcessingConstants.blurBellcurveStrength = blurCurve;
-		gPostProcessingConstants.blurRadius = blurStrength;
 
-		//blur
-		gD3DContext->PSSetShader(gGaussianBlurH_PostProcess, nullptr, 0);
-		gD3DContext->PSSetShaderResources(0, 1, &gSceneTextureSRV);
-		gD3DContext->PSSetSamplers(0, 1, &gPointSampler);
+// Move the draws of models that can be culled on the GPU (see GpuCuller.h), those whose meshes have no bones, into their
+// own list before any culling is done for them on the CPU
+void SplitGpuCulledDraws(SceneDrawList& draws, SceneDrawList& gpuDraws)
+{
+	auto rigid = std::partition(draws.begin(), draws.end(), [](const SceneDraw& draw)
+	{
+		return draw.model->GetMesh()->HasBones();
+	});
+	gpuDraws.insert(gpuDraws.end(), rigid, draws.end());
+	draws.erase(rigid, draws.end());
+	modelsGpuCulled += static_cast<int>(gpuDraws.size());
+}
 
 
-		RenderAndReset();
+// Put the draws for a pass in sort key order (see RenderQueue), so draws sharing a texture and mesh are recorded
+// together. Opaque draws go nearest first within each batch, blended draws furthest first
+void SortSceneDraws(SceneDrawList& draws, unsigned int pass, const SceneView& view, bool blended)
+{
+	if (!sortDraws || draws.size() < 2)  return;
 
-		// the second pass - blur vertically
-		gD3DContext->OMSetRenderTargets(1, &gPostProcessRenderTarget, gDepthStencil);
+	RenderQueue& queue = gRenderQueues[pass];
+	queue.Clear();
+	for (unsigned int i = 0; i < draws.size(); ++i)
+	{
+		float depth = Dot(draws[i].model->Position() - view.position, view.forward);
+		const char* mesh = reinterpret_cast<const char*>(draws[i].model->GetMesh()) + draws[i].model->Lod(); // Each level counts as a mesh
+		queue.Add(blended ? queue.BlendedKey(pass, 0, draws[i].texture, mesh, depth, view.farClip)
+		                  : queue.OpaqueKey (pass, 0, draws[i].texture, mesh, depth, view.farClip), i);
+	}
+	queue.Sort();
 
-		// blur Vertically shader
-		gD3DContext->PSSetShader(gGaussianBlurV_PostProcess, nullptr, 0);
-		gD3DContext->PSSetShaderResources(0, 1, &gSceneTextureSRV); // use postprocess texture as input
-		gD3DContext->PSSetSamplers(0, 1, &gPointSampler);
+	SceneDrawList sorted(draws.get_allocator());
+	sorted.reserve(draws.size());
+	for (auto& item : queue.Items())  sorted.push_back(draws[item.index]);
+	draws.swap(sorted);
+}
 
-		RenderAndReset();
 
+// The ordinary models to draw, either the static ones (drawn from the static command lists) or those that move. Static
+// models in the static batches are left out, the batches are drawn instead
+SceneDrawList ModelDraws(bool staticModels)
+{
+	SceneDrawList draws = FrameDrawList();
+	if (staticModels)
+	{
+		draws = { { gGround, gGroundDiffuseSpecularMapSRV, { 1, 1, 1 } },
+		          { gCrate,  gCrateDiffuseSpecularMapSRV,  { 1, 1, 1 } },
+		          { gCube,   gCubeDiffuseSpecularMapSRV,   { 1, 1, 1 } } };
 	}
-	if (Blur)
+	if (stressAnimated != staticModels)
 	{
-		// choose render target
-		gD3DContext->OMSetRenderTargets(1, &gPostProcessRenderTarget, gDepthStencil);
-
-		// blur settings
-		gPostProcessingConstants.blurBellcurveStrength = blurCurve;
-		gPostProcessingConstants.blurRadius = blurStrength;
-
-		// blur
-		gD3DContext->PSSetShader(gBlur_PostProcess, nullptr, 0);
-		gD3DContext->PSSetShaderResources(0, 1, &gSceneTextureSRV);
-		gD3DContext->PSSetSamplers(0, 1, &gPointSampler);
-
-		RenderAndReset();
+		draws.reserve(draws.size() + gStressModels.size());
+		for (auto& stress : gStressModels)  draws.push_back({ stress.model, *stress.texture, { 1, 1, 1 }, nullptr });
 	}
-	if (Underwater)
+	if (staticModels && staticBatching && gStaticBatches.NumModels() > 0)
 	{
-		// choose render target
-		gD3DContext->OMSetRenderTargets(1, &gPostProcessRenderTarget, gDepthStencil);
-
-		// underwater settings
-		gPostProcessingConstants.waterTintColour = { 0, 1, 1 };
-		gPostProcessingConstants.waterTintColour2 = { 0, 0.5, 1 };
-		gPostProcessingConstants.hWave = timer;
-		gPostProcessingConstants.vWave = timer / 2;
+		auto batched = std::remove_if(draws.begin(), draws.end(), [](const SceneDraw& draw) { return gStaticBatches.Contains(draw.model); });
+		draws.erase(batched, draws.end());
+	}
+	return draws;
+}
 
-		// underwater shader
-		gD3DContext->PSSetShader(gUnderwater_PostProcess, nullptr, 0);
-		gD3DContext->PSSetShaderResources(0, 1, &gSceneTextureSRV);
-		gD3DContext->PSSetSamplers(0, 1, &gPointSampler);
 
-		RenderAndReset();
+// The models last baked into the static batches, with their versions (see UpdateStaticBatches)
+std::vector<uintptr_t> gStaticBatchesKey;
 
-	}
-	if (Retro)
+// Bake the static batches again if any of the static models have moved or changed since they were last baked, or
+// release them while unused. Needs the models' world matrices, so call after the transform system update
+void UpdateStaticBatches()
+{
+	if (!staticBatching)
 	{
-		// choose render target
-		gD3DContext->OMSetRenderTargets(1, &gPostProcessRenderTarget, gDepthStencil);
+		gStaticBatches.Release();
+		gStaticBatchesKey.clear();
+		return;
+	}
 
-		//shader settings
-		gPostProcessingConstants.noiseScale = { pixelSize, pixelSize };
+	std::vector<StaticBatches::Source> sources = { { gGround, &gGroundDiffuseSpecularMapSRV },
+	                                               { gCrate,  &gCrateDiffuseSpecularMapSRV  },
+	                                               { gCube,   &gCubeDiffuseSpecularMapSRV   } };
+	for (auto& stress : gStressModels)  sources.push_back({ stress.model, stress.texture });
 
-		//pixellate
-		gD3DContext->PSSetShader(gPixellate_PostProcess, nullptr, 0);
-		gD3DContext->PSSetShaderResources(0, 1, &gSceneTextureSRV);
-		gD3DContext->PSSetSamplers(0, 1, &gPointSampler);
+	std::vector<uintptr_t> key;
+	key.reserve(3 * sources.size());
+	for (auto& source : sources)
+	{
+		key.push_back(reinterpret_cast<uintptr_t>(source.model));
+		key.push_back(reinterpret_cast<uintptr_t>(source.texture));
+		key.push_back(source.model->Version());
+	}
+	if (key == gStaticBatchesKey)  return;
+	gStaticBatchesKey.swap(key);
 
-		RenderAndReset();
+	// Not fatal, the models are drawn one by one until they change again
+	if (!gStaticBatches.Bake(sources))  OutputDebugStringA(("Static batching failed: " + gLastError + "\n").c_str());
+}
 
 
-		// choose render target
-		gD3DContext->OMSetRenderTargets(1, &gPostProcessRenderTarget, gDepthStencil);
+// The static chunks last recorded, in the retained command lists of the deferred renderer: the depth pre-pass, models
+// and sky chunks in that order. The key holds everything they were recorded with (see UpdateStaticChunks)
+std::vector<uintptr_t> gStaticChunksKey;
+int numStaticPrePassChunks = 0;
+int numStaticModelChunks   = 0;
+int numStaticSkyChunks     = 0;
+int numStaticRecordings    = 0;
+
+// Record the static models and the sky as retained command lists, if they have changed since they were last recorded or
+// would now be drawn differently. Everything the chunks depend on is put in a key compared with the last one: the
+// objects bound, the pass options and each model's version. The command lists hold a reference to each object they
+// use, so none of the addresses in the key can be reused for another object while they exist. The models are drawn
+// at full detail, as a level of detail chosen for one camera position would be wrong for the next
+void UpdateStaticChunks(SceneDrawList& models, SceneDrawList& sky, const SceneView& view,
+                        ID3D11RenderTargetView* target, const D3D11_VIEWPORT& viewport, bool deferred,
+                        ID3D11RenderTargetView* const gBufferTargets[2], const std::function<void()>& prePassSetup,
+                        const std::function<void()>& modelSetup, const std::function<void()>& skySetup, bool useMaterialArrays,
+                        bool useObjectLights)
+{
+	std::vector<uintptr_t> key;
+	key.reserve(32 + 3 * (models.size() + sky.size()));
+	auto addObject = [&key](const void* object) { key.push_back(reinterpret_cast<uintptr_t>(object)); };
+	for (const void* object : { static_cast<const void*>(target), static_cast<const void*>(gSceneDepthStencil),
+	                            static_cast<const void*>(gBufferTargets[0]), static_cast<const void*>(gBufferTargets[1]),
+	                            static_cast<const void*>(gBasicTransformVertexShader), static_cast<const void*>(gBasicTransformInstancedVertexShader),
+	                            static_cast<const void*>(gDepthOnlyVertexShader), static_cast<const void*>(gDepthOnlyInstancedVertexShader),
+	                            static_cast<const void*>(gPixelLightingVertexShader), static_cast<const void*>(gPixelLightingInstancedVertexShader),
+	                            static_cast<const void*>(gPixelLightingPixelShader), static_cast<const void*>(gGBufferPixelShader),
+	                            static_cast<const void*>(gTintedTexturePixelShader), static_cast<const void*>(gTintedTextureInstancedPixelShader) })
+	{
+		addObject(object);
+	}
+	for (float value : { viewport.TopLeftX, viewport.TopLeftY, viewport.Width, viewport.Height })
+	{
+		key.push_back(static_cast<uintptr_t>(value)); // Whole pixels
+	}
+	key.push_back((deferred ? 1 : 0) | (depthPrePass ? 2 : 0) | (instancedRendering ? 4 : 0) | (useMaterialArrays ? 8 : 0) |
+	              (useObjectLights ? 16 : 0));
+	key.push_back(static_cast<uintptr_t>(renderChunkSize));
+	key.push_back(static_cast<uintptr_t>(gMaterialArrays.Version()));
+	for (auto* draws : { &models, &sky })
+	{
+		for (auto& draw : *draws)
+		{
+			addObject(draw.model);
+			addObject(draw.texture);
+			key.push_back(draw.model->Version());
+		}
+	}
+	if (useObjectLights) // Each model's lights are recorded with it, so record again whenever a light moves or changes
+	{
+		for (auto& light : gFrameLights)
+		{
+			for (float value : { light.position.x, light.position.y, light.position.z, light.range, light.colour.x, light.colour.y, light.colour.z })
+			{
+				uint32_t bits;
+				std::memcpy(&bits, &value, sizeof(bits));
+				key.push_back(bits);
+			}
+		}
+	}
+	if (key == gStaticChunksKey && gDeferredRenderer.NumRetained() > 0)  return;
+
+	CPU_PROFILE_SCOPE("RecordStaticChunks");
+	for (auto* draws : { &models, &sky })
+	{
+		for (auto& draw : *draws)  draw.model->SetLod(0);
+	}
+	SortSceneDraws(models, 0, view, false);
+	SortSceneDraws(sky, 1, view, false);
+
+	std::vector<DeferredRenderer::RenderChunk> prePassChunks, modelChunks, skyChunks;
+	if (depthPrePass && !deferred)  AddSceneChunks(prePassChunks, models, target, viewport, prePassSetup, useMaterialArrays);
+	AddSceneChunks(modelChunks, models, target, viewport, modelSetup, useMaterialArrays, useObjectLights);
+	AddSceneChunks(skyChunks, sky, target, viewport, skySetup);
+
+	std::vector<DeferredRenderer::RenderChunk> chunks;
+	chunks.insert(chunks.end(), prePassChunks.begin(), prePassChunks.end());
+	chunks.insert(chunks.end(), modelChunks.begin(),   modelChunks.end());
+	chunks.insert(chunks.end(), skyChunks.begin(),     skyChunks.end());
+	numStaticPrePassChunks = static_cast<int>(prePassChunks.size());
+	numStaticModelChunks   = static_cast<int>(modelChunks.size());
+	numStaticSkyChunks     = static_cast<int>(skyChunks.size());
+	++numStaticRecordings;
+	gStaticChunksKey.swap(key);
+
+	// Not fatal, the static models are recorded every frame with the others instead from the next frame
+	if (!gDeferredRenderer.RecordRetained(chunks))
+	{
+		OutputDebugStringA(("Static command lists switched off: " + gLastError + "\n").c_str());
+		staticCommandLists = false;
+		gStaticChunksKey.clear();
+	}
+}
+
+
+// Light the G-buffer written by the opaque models with deferred shading, writing the lit pixels to the given target.
+// Called on the main thread once the models have been executed
+void LightGBuffer(ID3D11RenderTargetView* target, const D3D11_VIEWPORT& viewport, PooledTarget* material, PooledTarget* normal)
+{
+	// The depth buffer is read as a texture here so it can't also be bound as the depth buffer
+	gD3DContext->OMSetRenderTargets(1, &target, nullptr);
+	gD3DContext->RSSetViewports(1, &viewport);
+
+	gStateCache.VSSetShader(gFullScreenQuadVertexShader, nullptr, 0);
+	gStateCache.GSSetShader(nullptr, nullptr, 0);
+	gStateCache.PSSetShader(gDeferredLightingPixelShader, nullptr, 0);
+	gStateCache.SetConstantBuffer(PER_FRAME_CONSTANTS_SLOT, gPerFrameConstantBuffer);
+	gLightClusters.Bind();
+	gShadowMaps.Bind();
+	ID3D11ShaderResourceView* gBufferViews[3] = { material->shaderResource, normal->shaderResource, gDepthShaderView };
+	gD3DContext->PSSetShaderResources(GBUFFER_SLOT, 3, gBufferViews);
+
+	gStateCache.OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
+	gStateCache.OMSetDepthStencilState(gNoDepthBufferState, 0);
+	gStateCache.RSSetState(gCullNoneState);
+	gStateCache.IASetInputLayout(NULL);
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	gD3DContext->Draw(3, 0);
+
+	// Unbind the depth buffer so it can be used for the sky and lights
+	ID3D11ShaderResourceView* nullViews[3] = {};
+	gD3DContext->PSSetShaderResources(GBUFFER_SLOT, 3, nullViews);
+}
 
-		gPostProcessingConstants.bitColour = bitColour;
-		//bitColour
-		gD3DContext->PSSetShader(gBitColour_PostProcess, nullptr, 0);
-		gD3DContext->PSSetShaderResources(0, 1, &gSceneTextureSRV);
-		gD3DContext->PSSetSamplers(0, 1, &gPointSampler);
 
-		RenderAndReset();
+// Write the nearest sample of each pixel of the multisampled depth buffer into the usual one, cleared to the far distance
+void ResolveSceneDepth(const D3D11_VIEWPORT& viewport)
+{
+	gD3DContext->OMSetRenderTargets(0, nullptr, gDepthStencil);
+	gD3DContext->RSSetViewports(1, &viewport);
+
+	gStateCache.VSSetShader(gFullScreenQuadVertexShader, nullptr, 0);
+	gStateCache.GSSetShader(nullptr, nullptr, 0);
+	gStateCache.PSSetShader(gDepthResolvePixelShader, nullptr, 0);
+	gD3DContext->PSSetShaderResources(0, 1, &gDepthShaderViewMS);
+
+	gStateCache.OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
+	gStateCache.OMSetDepthStencilState(gUseDepthBufferState, 0);
+	gStateCache.RSSetState(gCullNoneState);
+	gStateCache.IASetInputLayout(NULL);
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	gD3DContext->Draw(3, 0);
+
+	ID3D11ShaderResourceView* nullView = nullptr;
+	gD3DContext->PSSetShaderResources(0, 1, &nullView);
+}
 
+
+// Render everything in the scene from the given camera into the given target. The scene is split into chunks
+// that are recorded by jobs on the job system's threads, then executed here in order
+// Place the cameras of the views around the main camera, from left to right, each with the given aspect ratio
+void UpdateViewCameras(float aspectRatio)
+{
+	gViewCameras.assign(multiViews, *gCamera);
+	CVector3 right = gCamera->WorldMatrix().GetRow(0);
+	for (int i = 0; i < multiViews; ++i)
+	{
+		float offset = i - (multiViews - 1) * 0.5f;
+		Camera& viewCamera = gViewCameras[i];
+		viewCamera.SetAspectRatio(aspectRatio);
+		if (multiViewSeparation > 0)
+		{
+			viewCamera.SetPosition(gCamera->Position() + right * (offset * multiViewSeparation));
+		}
+		else
+		{
+			CVector3 rotation = gCamera->Rotation();
+			rotation.y += offset * gCamera->FOV();
+			viewCamera.SetRotation(rotation);
+		}
 	}
-	if (Bloom)
+}
+
+
+// Place the cameras of the output windows to the right of the main camera in turn, each with its window's aspect ratio
+void UpdateWindowCameras()
+{
+	int numWindows = gOutputWindows.NumWindows();
+	gWindowCameras.assign(numWindows, *gCamera);
+	CVector3 right = gCamera->WorldMatrix().GetRow(0);
+	for (int i = 0; i < numWindows; ++i)
 	{
-		// render to the bloom texture
-		gD3DContext->OMSetRenderTargets(1, &gBloomRenderTarget, gDepthStencil); //render to bloom texture
-																				//   ^
-		gPostProcessingConstants.brightFilterThreshold = 0.7f;					//   |
-		//shader																//   |
-		gD3DContext->PSSetShader(gBrightFilter_PostProcess, nullptr, 0);		//   |
-		gD3DContext->PSSetShaderResources(0, 1, &gSceneTextureSRV);				// render from scene
-		gD3DContext->PSSetSamplers(0, 1, &gPointSampler);
+		float offset = static_cast<float>(i + 1);
+		Camera& windowCamera = gWindowCameras[i];
+		windowCamera.SetAspectRatio(static_cast<float>(gOutputWindows.Width(i)) / gOutputWindows.Height(i));
+		if (outputWindowSeparation > 0)
+		{
+			windowCamera.SetPosition(gCamera->Position() + right * (offset * outputWindowSeparation));
+		}
+		else
+		{
+			CVector3 rotation = gCamera->Rotation();
+			rotation.y += offset * gCamera->FOV();
+			windowCamera.SetRotation(rotation);
+		}
+	}
+}
 
 
-			// ########### Draw and reset - no copy  ############
-			UpdateConstantBuffer(gPostProcessingConstantBuffer, gPostProcessingConstants);
-			gD3DContext->PSSetConstantBuffers(1, 1, &gPostProcessingConstantBuffer);
-			gD3DContext->Draw(4, 0);
-			ID3D11ShaderResourceView* nullSRV = nullptr;
-			gD3DContext->PSSetShaderResources(0, 1, &nullSRV);
-			//###########################################
+// Set the camera matrices in the per-frame constants and send them to the GPU, then list the lights reaching each
+// cluster of the camera's view. Done on the immediate context before any chunks are executed, so all the chunks see
+// the same per-frame constants
+void BindViewCamera(Camera* camera)
+{
+	gPerFrameConstants.cameraMatrix = camera->WorldMatrix();
+	gPerFrameConstants.viewMatrix = camera->ViewMatrix();
+	gPerFrameConstants.projectionMatrix = camera->ProjectionMatrix();
+	gPerFrameConstants.viewProjectionMatrix = camera->ViewProjectionMatrix();
+	gPerFrameConstants.inverseViewProjectionMatrix = camera->InverseViewProjectionMatrix();
+	gPerFrameConstants.cameraPosition = camera->Position();
+	gPerFrameConstants.nearClip = camera->NearClip();
+	gPerFrameConstants.farClip  = camera->FarClip();
+	UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
 
+	gGpuProfiler.BeginTimer("Light Clusters");
+	gLightClusters.Build();
+	gGpuProfiler.EndTimer();
+}
 
-		gD3DContext->OMSetRenderTargets(1, &gPostProcessRenderTarget, gDepthStencil);	// render to post process
-																						//  ^
-		// blur Horizontally shader														//  |
-		gPostProcessingConstants.blurBellcurveStrength = blurCurve;						//  |
-		gPostProcessingConstants.blurRadius = blurStrength;								//  |
-																						//  |
-		//blur																			//  |
-		gD3DContext->PSSetShader(gGaussianBlurH_PostProcess, nullptr, 0);				//  |
-		gD3DContext->PSSetShaderResources(0, 1, &gBloomTextureSRV);						// render from bloom
-		gD3DContext->PSSetSamplers(0, 1, &gPointSampler);
 
+// Render the scene from a camera into the viewport of the target. With views given (see SetMultiView), the draws are
+// prepared and recorded once from the camera, for everything any of the views can see, and the recorded command lists
+// are executed once for each view with its own per-frame constants and light clusters. Each view is drawn into the
+// viewport in turn, the first one last, and the others copied to their own part of the target once they are all drawn,
+// or handed out in their image (null if no target could be had)
+void RenderSceneFromCamera(Camera* camera, ID3D11RenderTargetView* target, const D3D11_VIEWPORT& viewport,
+                           const std::vector<MultiView>& views = {})
+{
+	CPU_PROFILE_SCOPE("RenderSceneFromCamera");
+
+	SceneView view = { camera->Position(), camera->WorldMatrix().GetRow(2), camera->FarClip(),
+	                   viewport.Width / (2 * std::tan(camera->FOV() * 0.5f)) };
+	std::vector<Frustum> frustums;
+	if (views.empty())  frustums.push_back(camera->ViewFrustum());
+	for (auto& multiView : views)  frustums.push_back(multiView.camera->ViewFrustum());
+	modelsConsidered = 0;
+	modelsCulled = 0;
+	modelsReducedLod = 0;
+	modelsImpostored = 0;
+	modelsGpuCulled = 0;
+	gGpuCuller.BeginFrame();
+	gOcclusionCuller.BeginFrame(camera->ViewProjectionMatrix(), camera->Position(), camera->NearClip());
+
+	// Targets for the G-buffer when using deferred shading, falls back to forward lighting if they can't be created
+	PooledTarget* gBufferMaterial = nullptr;
+	PooledTarget* gBufferNormal   = nullptr;
+	if (deferredShading)
+	{
+		gBufferMaterial = gRenderTargetPool.Acquire(gViewportWidth, gViewportHeight, DXGI_FORMAT_R8G8B8A8_UNORM);
+		gBufferNormal   = gRenderTargetPool.Acquire(gViewportWidth, gViewportHeight, DXGI_FORMAT_R16G16_SNORM);
+		if (gBufferMaterial == nullptr || gBufferNormal == nullptr)
+		{
+			if (gBufferMaterial)  gRenderTargetPool.Return(gBufferMaterial);
+			if (gBufferNormal)    gRenderTargetPool.Return(gBufferNormal);
+			gBufferMaterial = gBufferNormal = nullptr;
+		}
+	}
+	bool deferred = (gBufferMaterial != nullptr);
+	ID3D11RenderTargetView* gBufferTargets[2] = { deferred ? gBufferMaterial->renderTarget : nullptr,
+	                                              deferred ? gBufferNormal->renderTarget   : nullptr };
 
-			// ########### Draw and reset - no copy  ############
-			UpdateConstantBuffer(gPostProcessingConstantBuffer, gPostProcessingConstants);
-			gD3DContext->PSSetConstantBuffers(1, 1, &gPostProcessingConstantBuffer);
-			gD3DContext->Draw(4, 0);
-			gD3DContext->PSSetShaderResources(0, 1, &nullSRV);
-			//###########################################
+	// The lit models' pixel shader reading material arrays, compiled the first time it is used
+	ID3D11PixelShader* materialArrayShader = nullptr;
+	if (instancedRendering && materialArrays && !materialArraysFailed)
+	{
+		materialArrayShader = GetPixelShaderPermutation(deferred ? "GBuffer_ps" : "PixelLighting_ps", { { "MATERIAL_ARRAY", "1" } });
+		if (materialArrayShader == nullptr)
+		{
+			OutputDebugStringA((gLastError + "\n").c_str());
+			materialArrays = false; // Not tried again until toggled back on
+		}
+	}
+	bool useMaterialArrays = (materialArrayShader != nullptr);
 
-		gD3DContext->OMSetRenderTargets(1, &gBloomRenderTarget, gDepthStencil);		// render to bloom texture
-																					//  ^
-		// blur Vertically shader													//  |
-		gD3DContext->PSSetShader(gGaussianBlurV_PostProcess, nullptr, 0);			//  |
-		gD3DContext->PSSetShaderResources(0, 1, &gPostProcessTextureSRV);			// render from  post process
-		gD3DContext->PSSetSamplers(0, 1, &gPointSampler);
+	// The forward lighting pixel shader reading each model's own lights, for the models drawn one at a time
+	ID3D11PixelShader* objectLightShader = nullptr;
+	if (objectLights && !instancedRendering && !deferred)
+	{
+		objectLightShader = GetPixelShaderPermutation("PixelLighting_ps", { { "OBJECT_LIGHTS", "1" } });
+		if (objectLightShader == nullptr)
+		{
+			OutputDebugStringA((gLastError + "\n").c_str());
+			objectLights = false;
+		}
+	}
+	bool useObjectLights = (objectLightShader != nullptr);
 
-			// ########### Draw and reset - no copy  ############
-			UpdateConstantBuffer(gPostProcessingConstantBuffer, gPostProcessingConstants);
-			gD3DContext->PSSetConstantBuffers(1, 1, &gPostProcessingConstantBuffer);
-			gD3DContext->Draw(4, 0);
-			gD3DContext->PSSetShaderResources(0, 1, &nullSRV);
-			//###########################################
+	// The impostors' pixel shader, writing the G-buffer for deferred shading where it is compiled the first time it is used
+	ID3D11PixelShader* impostorShader = nullptr;
+	if (impostors && gImpostors.NumImpostors() > 0)
+	{
+		impostorShader = deferred ? GetPixelShaderPermutation("Impostor_ps", { { "GBUFFER", "1" } }) : gImpostorPixelShader;
+		if (impostorShader == nullptr)
+		{
+			OutputDebugStringA((gLastError + "\n").c_str());
+			impostors = false;
+		}
+	}
+	bool useImpostors = (impostorShader != nullptr);
 
-		// combine
-		gD3DContext->OMSetRenderTargets(1, &gPostProcessRenderTarget, gDepthStencil);		// render to postProcess
+	// The instanced vertex shaders reading the instances the GPU found visible, compiled the first time they are used
+	ID3D11VertexShader* gpuCullLightingShader = nullptr;
+	ID3D11VertexShader* gpuCullTransformShader = nullptr;
+	if (gpuCulling && instancedRendering && SingleView())
+	{
+		gpuCullLightingShader  = GetVertexShaderPermutation("PixelLightingInstanced_vs",  { { "GPU_CULLING", "1" } });
+		gpuCullTransformShader = GetVertexShaderPermutation("DepthOnlyInstanced_vs",      { { "GPU_CULLING", "1" } });
+		if (gpuCullLightingShader == nullptr || gpuCullTransformShader == nullptr)
+		{
+			OutputDebugStringA((gLastError + "\n").c_str());
+			gpuCulling = false;
+			gpuCullLightingShader = gpuCullTransformShader = nullptr;
+		}
+	}
+	bool useGpuCulling = (gpuCullLightingShader != nullptr);
 
-		// combine shader											
-		gD3DContext->PSSetShader(gCombine_PostProcess, nullptr, 0);
-		gD3DContext->PSSetShaderResources(0, 1, &gBloomTextureSRV);							// combine textures from
-		gD3DContext->PSSetShaderResources(1, 1, &gSceneTextureSRV);							//  bloom and scene
-		gD3DContext->PSSetSamplers(0, 1, &gPointSampler);
+	// The sky is a full screen pass after the opaque models (see Sky.h), leaving no sky draws for the chunks
+	bool useSkyPass = skyPass && gSky.Loaded();
 
+	// The states for each pass, shared by the chunks recorded each frame and the static chunks (see UpdateStaticChunks)
+	std::function<void()> prePassSetup = []()
+	{
+		gStateCache.VSSetShader(instancedRendering ? gDepthOnlyInstancedVertexShader : gDepthOnlyVertexShader, nullptr, 0);
+		gStateCache.PSSetShader(nullptr, nullptr, 0); // Depth only
+		gStateCache.GSSetShader(nullptr, nullptr, 0);
 
+		gStateCache.OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
+		gStateCache.OMSetDepthStencilState(gUseDepthBufferState, 0);
+		gStateCache.RSSetState(gCullBackState);
+	};
 
-		RenderAndReset();
+	std::function<void()> modelSetup;
+	if (deferred)
+	{
+		modelSetup = [gBufferTargets, materialArrayShader]()
+		{
+			gD3DContext->OMSetRenderTargets(2, gBufferTargets, gDepthStencil);
+
+			gStateCache.VSSetShader(instancedRendering ? gPixelLightingInstancedVertexShader : gPixelLightingVertexShader, nullptr, 0);
+			gStateCache.PSSetShader(materialArrayShader ? materialArrayShader : gGBufferPixelShader, nullptr, 0);
+			gStateCache.GSSetShader(nullptr, nullptr, 0);
+
+			gStateCache.OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
+			gStateCache.OMSetDepthStencilState(gUseDepthBufferState, 0);
+			gStateCache.RSSetState(gCullBackState);
+			gStateCache.SetSampler(0, gAnisotropic4xSampler);
+		};
+	}
+	else
+	{
+		modelSetup = [materialArrayShader, objectLightShader]()
+		{
+			// Select which shaders to use next
+			gStateCache.VSSetShader(instancedRendering ? gPixelLightingInstancedVertexShader : gPixelLightingVertexShader, nullptr, 0);
+			gStateCache.PSSetShader(materialArrayShader ? materialArrayShader : objectLightShader ? objectLightShader : gPixelLightingPixelShader,
+			                        nullptr, 0);
+			gStateCache.GSSetShader(nullptr, nullptr, 0);  // Switch off geometry shader when not using it (pass nullptr for first parameter)
+
+			// States - no blending, normal depth buffer and back-face culling (standard set-up for opaque models). After a depth
+			// pre-pass the depth buffer already holds the opaque models, so only pixels at exactly that depth are lit
+			gStateCache.OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
+			gStateCache.OMSetDepthStencilState(depthPrePass ? gDepthEqualReadOnlyState : gUseDepthBufferState, 0);
+			gStateCache.RSSetState(gCullBackState);
+			gStateCache.SetSampler(0, gAnisotropic4xSampler);
+			gLightClusters.Bind();
+			gShadowMaps.Bind();
+		};
 	}
 
+	// Impostors are cut out of their quads, which face the camera so needn't be culled. They aren't in the depth pre-pass
+	// so test depth as usual
+	std::function<void()> impostorSetup = [deferred, gBufferTargets, impostorShader]()
+	{
+		if (deferred)  gD3DContext->OMSetRenderTargets(2, gBufferTargets, gDepthStencil);
+
+		gStateCache.VSSetShader(gImpostorVertexShader, nullptr, 0);
+		gStateCache.PSSetShader(impostorShader, nullptr, 0);
+		gStateCache.GSSetShader(nullptr, nullptr, 0);
+
+		gStateCache.OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
+		gStateCache.OMSetDepthStencilState(gUseDepthBufferState, 0);
+		gStateCache.RSSetState(gCullNoneState);
+		gStateCache.SetSampler(0, gTrilinearSampler);
+		if (!deferred)
+		{
+			gLightClusters.Bind();
+			gShadowMaps.Bind();
+		}
+	};
+
+	// The models culled on the GPU are drawn with the same states as the others, but the vertex shaders reading the
+	// visible instances
+	std::function<void()> gpuPrePassSetup = [prePassSetup, gpuCullTransformShader]()
+	{
+		prePassSetup();
+		gStateCache.VSSetShader(gpuCullTransformShader, nullptr, 0);
+	};
+	std::function<void()> gpuModelSetup = [modelSetup, gpuCullLightingShader]()
+	{
+		modelSetup();
+		gStateCache.VSSetShader(gpuCullLightingShader, nullptr, 0);
+	};
+
+	std::function<void()> skySetup = []()
+	{
+		gStateCache.VSSetShader(instancedRendering ? gBasicTransformInstancedVertexShader : gBasicTransformVertexShader, nullptr, 0);
+		gStateCache.PSSetShader(instancedRendering ? gTintedTextureInstancedPixelShader : gTintedTexturePixelShader, nullptr, 0);
+		gStateCache.GSSetShader(nullptr, nullptr, 0);
+
+		// Stars point inwards
+		gStateCache.OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
+		gStateCache.OMSetDepthStencilState(gUseDepthBufferState, 0);
+		gStateCache.RSSetState(gCullNoneState);
+		gStateCache.SetSampler(0, gAnisotropic4xSampler);
+	};
+
+	// The static models and sky are replayed from command lists kept between frames, when they can be recorded on the
+	// render threads. Otherwise they are drawn with the others
+	bool replayStatic = staticCommandLists && gDeferredRenderer.NumThreads() > 0;
+	if (!replayStatic && gDeferredRenderer.NumRetained() > 0)
+	{
+		gDeferredRenderer.DiscardRetained();
+		gStaticChunksKey.clear();
+	}
 
+	// The draws are prepared as jobs: one walk of the scene tree finds the models in view, then each pass culls, chooses
+	// levels of detail, sorts and splits its draws into chunks at the same time as the others. Each pass has its own list
+	// of chunks, joined in pass order once they are all done
+	JobGraph graph;
+	std::vector<DeferredRenderer::RenderChunk> prePassChunks, modelChunks, skyChunks, lightChunks;
 
-	else if (gCurrentPostProcess == PostProcess::Spiral)
+	// Find the models in view with one walk of the scene tree, rather than testing every model against the frustum
+	std::vector<Model*> visible;
+	int findVisible = graph.Add([&visible, &frustums]()
+	{
+		if (!frustumCulling)  return;
+		gSceneTree.Update();
+		for (auto& frustum : frustums)  gSceneTree.QueryFrustum(frustum, visible);
+		std::sort(visible.begin(), visible.end());
+		visible.erase(std::unique(visible.begin(), visible.end()), visible.end()); // Seen by more than one view
+	});
+
+	// Rasterise the occluders for the software occlusion test at the same time
+	int rasteriseOccluders = graph.Add([]()
 	{
-		gD3DContext->PSSetShader(gNoise_PostProcess, nullptr, 0);
+		if (occlusionCulling && SingleView())  gOcclusionCuller.RasteriseOccluders();
+	});
+
+
+	////--------------- Ordinary models ---------------///
+	int prepareModels = graph.Add([&, deferred]()
+	{
+		SceneDrawList models = ModelDraws(false);
+		if (!replayStatic)
+		{
+			SceneDrawList staticModels = ModelDraws(true);
+			models.insert(models.end(), staticModels.begin(), staticModels.end());
+		}
+		SceneDrawList gpuDraws = FrameDrawList();
+		if (useGpuCulling)  SplitGpuCulledDraws(models, gpuDraws);
+		CullSceneDraws(models, visible);
+		OcclusionCullSceneDraws(models);
+		SelectSceneLods(models, view);
+		SceneDrawList impostorDraws = FrameDrawList();
+		if (useImpostors)  SplitImpostorDraws(models, impostorDraws, view);
+		SortSceneDraws(models, 0, view, false);
+
+		// Depth pre-pass - the basic transform shaders place the vertices exactly as the lighting shaders do, so the equal
+		// depth test in the lit pass passes for the nearest surface only. Not needed for deferred shading, where the G-buffer
+		// pass is cheap and the lighting is done once per pixel anyway
+		if (depthPrePass && !deferred)  AddSceneChunks(prePassChunks, models, target, viewport, prePassSetup, useMaterialArrays);
+		AddSceneChunks(modelChunks, models, target, viewport, modelSetup, useMaterialArrays, useObjectLights);
+		AddImpostorChunk(modelChunks, impostorDraws, target, viewport, impostorSetup);
+		if (depthPrePass && !deferred)
+		{
+			AddGpuCulledChunks(&prePassChunks, modelChunks, gpuDraws, target, viewport, gpuPrePassSetup, gpuModelSetup, useMaterialArrays);
+		}
+		else
+		{
+			AddGpuCulledChunks(nullptr, modelChunks, gpuDraws, target, viewport, nullptr, gpuModelSetup, useMaterialArrays);
+		}
+
+		// The static batches, drawn every frame after the models. Their streamed textures are always wanted at full detail
+		std::vector<unsigned int> batches;
+		if (frustumCulling)
+		{
+			for (auto& frustum : frustums)  gStaticBatches.Cull(frustum, batches);
+			std::sort(batches.begin(), batches.end());
+			batches.erase(std::unique(batches.begin(), batches.end()), batches.end());
+		}
+		else
+		{
+			for (int b = 0; b < gStaticBatches.NumBatches(); ++b)  batches.push_back(b);
+		}
+		for (unsigned int b : batches)  gTextureStreamer.NoteUsage(gStaticBatches.BatchTexture(b), 0);
+		staticBatchesDrawn = static_cast<int>(batches.size());
+		if (depthPrePass && !deferred)  AddStaticBatchChunk(prePassChunks, batches, target, viewport, prePassSetup, gDepthOnlyVertexShader, nullptr);
+		AddStaticBatchChunk(modelChunks, batches, target, viewport, modelSetup, gPixelLightingVertexShader,
+		                    deferred ? gGBufferPixelShader : gPixelLightingPixelShader);
+	});
+	graph.AddDependency(prepareModels, findVisible);
+	graph.AddDependency(prepareModels, rasteriseOccluders);
+
+
+	////--------------- Sky ---------------////
+	int prepareSky = graph.Add([&]()
+	{
+		if (replayStatic || useSkyPass)  return;
+
+		// Using a pixel shader that tints the texture - don't need a tint on the sky so it is white
+		SceneDrawList sky = FrameDrawList();
+		sky.push_back({ gStars, gStarsDiffuseSpecularMapSRV, { 1, 1, 1 }, nullptr });
+		CullSceneDraws(sky, visible);
+		SelectSceneLods(sky, view);
+		SortSceneDraws(sky, 1, view, false);
+		AddSceneChunks(skyChunks, sky, target, viewport, skySetup);
+	});
+	graph.AddDependency(prepareSky, findVisible);
+
+
+	////--------------- Lights ---------------////
+	// Culled like the models, then the flares of those left are drawn as camera-facing quads with one instanced draw.
+	// Additive blending doesn't depend on order, so they aren't sorted. The flares are written to the flare buffer on
+	// this thread once the jobs are done, the chunk only reads it
+	std::vector<LightFlareData> lightFlares;
+	int prepareLights = graph.Add([&]()
+	{
+		SceneDrawList lights = FrameDrawList();
+		lights.reserve(gLights.size());
+		for (auto& light : gLights)
+		{
+			lights.push_back({ light.model, gLightDiffuseMapSRV, light.colour }); // Flares are tinted with the light colour
+		}
+		CullSceneDraws(lights, visible);
+		OcclusionCullSceneDraws(lights);
+		if (lights.empty())  return;
+		gTextureStreamer.NoteUsage(gLightDiffuseMapSRV, 0);
+
+		// The draws are in the order of gLights, so each light is found by walking along them
+		lightFlares.reserve(lights.size());
+		auto draw = lights.begin();
+		for (auto& light : gLights)
+		{
+			if (draw == lights.end())  break;
+			if (draw->model != light.model)  continue;
+			lightFlares.push_back({ light.model->Position(), light.strength, light.colour, 0.0f });
+			++draw;
+		}
+
+		UINT numFlares = static_cast<UINT>(lightFlares.size());
+		lightChunks.push_back([target, viewport, numFlares]()
+		{
+			BeginSceneChunk(target, viewport, []()
+			{
+				gStateCache.VSSetShader(gLightFlareVertexShader, nullptr, 0);
+				gStateCache.PSSetShader(gTintedTextureInstancedPixelShader, nullptr, 0);
+				gStateCache.GSSetShader(nullptr, nullptr, 0);
+
+				// States - additive blending, read-only depth buffer and no culling (standard set-up for blending)
+				gStateCache.OMSetBlendState(gAdditiveBlendingState, nullptr, 0xffffff);
+				gStateCache.OMSetDepthStencilState(gDepthReadOnlyState, 0);
+				gStateCache.RSSetState(gCullNoneState);
+				gStateCache.SetSampler(0, gAnisotropic4xSampler);
+			});
+
+			// No vertex buffer, each quad is a four vertex triangle strip placed by the vertex shader from its flare
+			gD3DContext->PSSetShaderResources(0, 1, &gLightDiffuseMapSRV);
+			gD3DContext->VSSetShaderResources(LIGHT_FLARE_SLOT, 1, &gLightFlareBufferSRV);
+			gStateCache.IASetInputLayout(nullptr);
+			gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+			gD3DContext->DrawInstanced(4, numFlares, 0, 0);
+		});
+	});
+	graph.AddDependency(prepareLights, findVisible);
+	graph.AddDependency(prepareLights, rasteriseOccluders);
+
+	gJobSystem.Run(graph);
+
+	// Write the flares of the lights in view, before the chunk drawing them is recorded. Main thread, the immediate
+	// context runs this view's command lists after it so they see this view's flares
+	if (!lightFlares.empty())
+	{
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (SUCCEEDED(gD3DContext->Map(gLightFlareBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		{
+			memcpy(mapped.pData, lightFlares.data(), lightFlares.size() * sizeof(LightFlareData));
+			gD3DContext->Unmap(gLightFlareBuffer, 0);
+		}
+	}
 
-		static float wiggle = 0.0f;
+	// Cull the GPU's models now their groups are laid out, before the chunks drawing them are recorded
+	if (useGpuCulling && !gGpuCuller.Cull(camera->ViewFrustum(), camera->Position(), view.pixelsPerUnit,
+	                                      lodSelection ? LOD_PIXEL_ERROR : 0))
+	{
+		OutputDebugStringA((gLastError + "\n").c_str());
+	}
+
+	// Record the static chunks again if anything they draw has changed, then set aside how many there are of each pass
+	if (replayStatic)
+	{
+		SceneDrawList staticModels = ModelDraws(true);
+		SceneDrawList staticSky = FrameDrawList();
+		if (!useSkyPass)  staticSky.push_back({ gStars, gStarsDiffuseSpecularMapSRV, { 1, 1, 1 }, nullptr });
+		UpdateStaticChunks(staticModels, staticSky, view, target, viewport, deferred, gBufferTargets, prePassSetup, modelSetup, skySetup,
+		                   useMaterialArrays, useObjectLights);
+	}
+	int staticPrePass = (gDeferredRenderer.NumRetained() > 0 ? numStaticPrePassChunks : 0);
+	int staticModels  = (gDeferredRenderer.NumRetained() > 0 ? numStaticModelChunks   : 0);
+	int staticSky     = (gDeferredRenderer.NumRetained() > 0 ? numStaticSkyChunks     : 0);
+
+	std::vector<DeferredRenderer::RenderChunk> chunks;
+	chunks.insert(chunks.end(), prePassChunks.begin(), prePassChunks.end());
+	chunks.insert(chunks.end(), modelChunks.begin(),   modelChunks.end());
+	chunks.insert(chunks.end(), skyChunks.begin(),     skyChunks.end());
+	chunks.insert(chunks.end(), lightChunks.begin(),   lightChunks.end());
+	int numPrePassChunks = static_cast<int>(prePassChunks.size());
+	int numModelChunks   = static_cast<int>(modelChunks.size());
+	int numSkyChunks     = static_cast<int>(skyChunks.size());
+	int numLightChunks   = static_cast<int>(lightChunks.size());
+
+
+	// Record as jobs, then execute in order. The GPU profiler is only used here on the main thread
+	if (!gDeferredRenderer.Record(chunks))
+	{
+		OutputDebugStringA((gLastError + "\n").c_str());
+	}
+
+	// Each view but the first is copied out of the viewport into a target of its own as soon as it is drawn, and into
+	// its own part of the scene target once every view is done (a copy can't read and write the same texture)
+	ID3D11Resource* targetResource;
+	target->GetResource(&targetResource);
+	std::vector<PooledTarget*> viewImages(views.size(), nullptr);
+	int numViews = std::max(static_cast<int>(views.size()), 1);
+	gGpuProfiler.SetTargetPixels(static_cast<UINT64>(viewport.Width) * static_cast<UINT64>(viewport.Height));
+	for (int v = numViews - 1; v >= 0; --v)
+	{
+		bool lastView = (v == 0);
+		BindViewCamera(views.empty() ? camera : views[v].camera);
+		if (v < numViews - 1)
+		{
+			gD3DContext->ClearRenderTargetView(target, &gBackgroundColor.r);
+			gD3DContext->ClearDepthStencilView(gSceneDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
+		}
+
+		if (depthPrePass)
+		{
+			gGpuProfiler.BeginTimer("Depth Pre-Pass");
+			gDeferredRenderer.ExecuteRetained(0, staticPrePass);
+			gDeferredRenderer.Execute(0, numPrePassChunks, !lastView);
+			gGpuProfiler.EndTimer();
+		}
+
+		gGpuProfiler.BeginTimer("Models");
+		gDeferredRenderer.ExecuteRetained(staticPrePass, staticModels);
+		gDeferredRenderer.Execute(numPrePassChunks, numModelChunks, !lastView);
+		gGpuProfiler.EndTimer();
+
+		// Query the bounding boxes of the models tested for occlusion against the opaque models' depth, for next frame
+		if (occlusionCulling && SingleView())
+		{
+			gGpuProfiler.BeginTimer("Occlusion Queries");
+			if (!gOcclusionCuller.IssueQueries(gSceneDepthStencil, viewport))  OutputDebugStringA((gLastError + "\n").c_str());
+			gGpuProfiler.EndTimer();
+		}
+
+		if (deferred)
+		{
+			gGpuProfiler.BeginTimer("Deferred Lighting");
+			LightGBuffer(target, viewport, gBufferMaterial, gBufferNormal);
+			gGpuProfiler.EndTimer();
+		}
+
+		gGpuProfiler.BeginTimer("Sky");
+		gDeferredRenderer.ExecuteRetained(staticPrePass + staticModels, staticSky);
+		gDeferredRenderer.Execute(numPrePassChunks + numModelChunks, numSkyChunks, !lastView);
+		if (useSkyPass)
+		{
+			gD3DContext->OMSetRenderTargets(1, &target, gSceneDepthStencil);
+			gD3DContext->RSSetViewports(1, &viewport);
+			gStateCache.SetConstantBuffer(PER_FRAME_CONSTANTS_SLOT, gPerFrameConstantBuffer);
+			gSky.Render();
+		}
+		gGpuProfiler.EndTimer();
+
+		gGpuProfiler.BeginTimer("Lights");
+		gDeferredRenderer.Execute(numPrePassChunks + numModelChunks + numSkyChunks, numLightChunks, !lastView);
+		gGpuProfiler.EndTimer();
+
+		// The particles and post-processes read the depth as a texture, which needs a single sample
+		if (target == gSceneRenderTargetMS)
+		{
+			gGpuProfiler.BeginTimer("Depth Resolve");
+			ResolveSceneDepth(viewport);
+			gGpuProfiler.EndTimer();
+			if (gD3DContext1)  gD3DContext1->DiscardView(gDepthStencilMS); // Only the resolved depth is used from here on
+		}
+
+		// Particles last, blended over everything else
+		if (particles)
+		{
+			gGpuProfiler.BeginTimer("Particle Sort");
+			gParticleSystem.Sort(particleSorting);
+			gGpuProfiler.EndTimer();
+
+			gGpuProfiler.BeginTimer("Particles");
+			gParticleSystem.Render(target, viewport);
+			gGpuProfiler.EndTimer();
+		}
+
+		// Keep the view's image. If a target can't be had the view is left out and its part of the target stays clear
+		if (!lastView)
+		{
+			D3D11_TEXTURE2D_DESC targetDesc;
+			static_cast<ID3D11Texture2D*>(targetResource)->GetDesc(&targetDesc);
+			viewImages[v] = gRenderTargetPool.Acquire(static_cast<int>(viewport.Width), static_cast<int>(viewport.Height), targetDesc.Format);
+			if (viewImages[v] == nullptr)  OutputDebugStringA((gLastError + "\n").c_str());
+			else
+			{
+				D3D11_BOX box = { static_cast<UINT>(viewport.TopLeftX), static_cast<UINT>(viewport.TopLeftY), 0,
+				                  static_cast<UINT>(viewport.TopLeftX + viewport.Width), static_cast<UINT>(viewport.TopLeftY + viewport.Height), 1 };
+				gD3DContext->CopySubresourceRegion(viewImages[v]->texture, 0, 0, 0, 0, targetResource, 0, &box);
+			}
+		}
+	}
+	for (size_t v = 1; v < viewImages.size(); ++v)
+	{
+		if (views[v].image != nullptr)
+		{
+			*views[v].image = viewImages[v];
+			continue;
+		}
+		if (viewImages[v] == nullptr)  continue;
+		gD3DContext->CopySubresourceRegion(targetResource, 0, views[v].left, static_cast<UINT>(viewport.TopLeftY), 0,
+		                                   viewImages[v]->texture, 0, nullptr);
+		gRenderTargetPool.Return(viewImages[v]);
+	}
+	targetResource->Release();
+
+	// The GPU's models are culled against this frame's depth next frame
+	if (useGpuCulling && !gGpuCuller.BuildHiZ(gDepthShaderView, camera->ViewProjectionMatrix(), viewport))
+	{
+		OutputDebugStringA((gLastError + "\n").c_str());
+	}
+
+	if (deferred)
+	{
+		gRenderTargetPool.Return(gBufferNormal);
+		gRenderTargetPool.Return(gBufferMaterial);
+	}
+}
+
+//**************************
+
+
+
+// Number of dual filter blur iterations giving about the same width as a Gaussian blur of the given strength. Each
+// iteration doubles the width, the first reaching a few pixels either side
+int DualFilterIterations(float strength)
+{
+	int iterations = static_cast<int>(std::log2(strength / 4) + 0.5f);
+	return std::max(1, std::min(iterations, 6));
+}
+
+// The rate for this frame's smooth post-processes. The automatic mode only lowers it under budget pressure, the
+// dynamic resolution has already cut the scene cost by then
+ShadingRate CurrentReducedRate()
+{
+	switch (reducedRateMode)
+	{
+	case ReducedRateMode::Auto:     return gDynamicResolution.UnderPressure() ? ShadingRate::Half : ShadingRate::Full;
+	case ReducedRateMode::Half:     return ShadingRate::Half;
+	case ReducedRateMode::Quarter:  return ShadingRate::Quarter;
+	default:                        return ShadingRate::Full;
+	}
+}
+
+// Run any scene post-processing steps. sceneDepth is false for an image without a depth buffer (see PostProcessImage),
+// which leaves out the depth-aware effects. multisampled is true if the scene was drawn into the MSAA scene texture
+void PostProcessing(float frameTime, bool sceneDepth, bool multisampled = false)
+{
+	CPU_PROFILE_SCOPE("PostProcessing");
+
+	// The scene's effects are rebuilt from the toggles each frame, in the order they have always run. If the scene was
+	// rendered at low resolution for retro, the effects up to retro go in their own chain run at that size
+	gSceneEffects.Clear();
+	gRetroEffects.Clear();
+	bool lowResolution = (gRetroSceneTarget != nullptr);
+	EffectChain& earlyEffects = lowResolution ? gRetroEffects : gSceneEffects;
+
+	// With dynamic resolution, first stretch the rendered part of the scene texture to full size
+	EffectSettings& settings = gSceneEffects.Settings();
+	if (gDynamicResolution.Enabled() && !lowResolution)
+	{
+		settings.inputUVScale = { static_cast<float>(sceneWidth) / gViewportWidth, static_cast<float>(sceneHeight) / gViewportHeight };
+		settings.inputUVMax   = { (sceneWidth - 0.5f) / gViewportWidth, (sceneHeight - 0.5f) / gViewportHeight };
+		settings.spatialUpscale   = spatialUpscale;
+		settings.upscaleSharpness = upscaleSharpness;
+		gSceneEffects.Add(Effect::Upscale);
+	}
+
+	// Anti-aliasing before anything sharpens or spreads the steps along the edges
+	if (!lowResolution)
+	{
+		if (postAntiAliasing == PostAntiAliasing::Fxaa)  earlyEffects.Add(Effect::Fxaa);
+		if (postAntiAliasing == PostAntiAliasing::Smaa)  earlyEffects.Add(Effect::Smaa);
+	}
+
+	// Fog and depth of field first, while the image still matches the depth buffer. Left out for images without one
+	if (Fog && sceneDepth)           earlyEffects.Add(Effect::Fog);
+	if (DepthOfField && sceneDepth)  earlyEffects.Add(Effect::DepthOfField);
+	if (Tint)          earlyEffects.Add(Effect::Tint);
+	if (GaussianBlur)  earlyEffects.Add(Effect::GaussianBlur);
+	if (Blur)          earlyEffects.Add(Effect::Blur);
+	if (Underwater)    earlyEffects.Add(Effect::Underwater);
+	if (Retro)         earlyEffects.Add(Effect::Retro);
+	if (StarFilter)    gSceneEffects.Add(Effect::StarFilter);
+	if (Bloom)
+	{
+		gSceneEffects.Add(Effect::Bloom);
+	}
+	else if (gCurrentPostProcess == PostProcess::Spiral)
+	{
 		const float wiggleSpeed = 1.0f;
+		float wiggle = wiggleSpeed * timer;
 
-		// Set and increase the amount of spiral - use a tweaked cos wave to animate
+		// Set the amount of spiral - use a tweaked cos wave to animate
 		gPostProcessingConstants.spiralLevel = ((1.0f - cos(wiggle)) * 4.0f );
-		wiggle += wiggleSpeed * frameTime;
 	}
 	else if (gCurrentPostProcess == PostProcess::PyramidBlur)
 	{
-	// choose render target
-	gD3DContext->OMSetRenderTargets(1, &gPostProcessRenderTarget, gDepthStencil);
+		gSceneEffects.Add(Effect::PyramidBlur);
+	}
 
-	gD3DContext->PSSetShader(gPyramidBlur_PostProcess, nullptr, 0);
-	gD3DContext->PSSetShaderResources(0, 1, &gSceneTextureSRV);
-	gD3DContext->PSSetSamplers(0, 1, &gPointSampler);
+	settings.tintColour   = HSLToRGB(tintColour);
+	settings.tintColour2  = HSLToRGB(tintColour2);
+	settings.blurStrength = blurStrength;
+	settings.blurCurve    = blurCurve;
+	settings.dualFilterBlur = dualFilterBlur;
+	settings.dualFilterIterations = DualFilterIterations(blurStrength);
+	settings.fftBloom = fftBloom;
+	settings.bloomTiles = bloomTiles;
+	settings.fftBloomKernel.imageFile = fftBloomKernelImage;
+	settings.time         = timer;
+	settings.pixelSize    = pixelSize;
+	settings.bitColour    = bitColour;
+	settings.colourLut    = colourLut;
+	settings.computeShaders = computePostProcess;
+	settings.halfPrecision  = halfPrecisionEffects;
+	settings.reducedRate  = CurrentReducedRate();
+	settings.bloomMips    = 4;
+	settings.blurTechnique = BlurTechnique::Auto;
+
+	// Cheaper effects while the quality governor is holding the GPU budget
+	if (gQualityGovernor.Enabled())
+	{
+		const BlurTechnique blurTechniques[] = { BlurTechnique::Auto, BlurTechnique::Downsampled, BlurTechnique::DualFilter };
+		settings.blurTechnique = blurTechniques[gQualityGovernor.Level(governorBlurKnob)];
+		settings.bloomMips -= gQualityGovernor.Level(governorBloomKnob);
+		settings.reducedRate = std::max(settings.reducedRate, static_cast<ShadingRate>(gQualityGovernor.Level(governorRateKnob)));
+	}
+	settings.temporal     = temporalEffects;
+	settings.backgroundLoad = true; // An effect switched on for the first time comes on once it has loaded
+	settings.viewProjection        = gCamera->ViewProjectionMatrix();
+	settings.inverseViewProjection = gCamera->InverseViewProjectionMatrix();
+	settings.inputMipChain = multisampled ? nullptr : gSceneTextureMipsSRV;
+	settings.pyramidBlurLevel = settings.pyramidBlurEdgeLevel = std::log2(std::max(blurStrength, 4.0f) / 4);
+	settings.autoExposure = autoExposure;
+	settings.frameTime    = frameTime;
+	settings.depth        = sceneDepth ? gDepthShaderView : nullptr;
+	settings.depthUVScale = { static_cast<float>(sceneWidth) / gViewportWidth, static_cast<float>(sceneHeight) / gViewportHeight };
+	settings.nearClip     = gCamera->NearClip();
+	settings.farClip      = gCamera->FarClip();
+
+	// The low resolution effects are enlarged by the point sampled copy the graph ends with, into the scene texture for
+	// the remaining effects or straight to the back buffer if there are none. Blurs are scaled to look the same size
+	if (lowResolution)
+	{
+		EffectSettings& retroSettings = gRetroEffects.Settings();
+		retroSettings = settings;
+		retroSettings.blurStrength = blurStrength / pixelSize;
+		retroSettings.blurCurve    = blurCurve * pixelSize;
+		retroSettings.dualFilterIterations = DualFilterIterations(blurStrength / pixelSize);
+		retroSettings.retroPixellate = false;
+		retroSettings.autoExposure   = false;
+		retroSettings.inputMipChain  = nullptr;
+
+		bool lateEffects = !gSceneEffects.Empty() || autoExposure;
+		bool applied = gRetroEffects.Apply(gRetroSceneTarget->shaderResource, lateEffects ? gSceneRenderTarget : gBackBufferRenderTarget,
+		                                   gRetroSceneTarget->renderTarget);
+		gRenderTargetPool.Return(gRetroSceneTarget);
+		gRetroSceneTarget = nullptr;
+		if (!applied)  OutputDebugStringA((gLastError + "\n").c_str());
+		if (!applied || !lateEffects)  return;
+	}
 
-	RenderAndReset();
+	// The final pass writes straight to the back buffer
+	// While frame caching the scene texture must still hold the scene afterwards, so it isn't reused for intermediates
+	ID3D11ShaderResourceView* sceneTexture = multisampled ? gSceneTextureMSSRV : gSceneTextureSRV;
+	if (!gSceneEffects.Apply(sceneTexture, gBackBufferRenderTarget, frameCaching ? nullptr : gSceneRenderTarget))
+	{
+		OutputDebugStringA((gLastError + "\n").c_str());
 	}
+}
 
-	//copy to back buffer
-	gD3DContext->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
-	gD3DContext->PSSetShader(gCopy_PostProcess, nullptr, 0);
-	gD3DContext->PSSetShaderResources(0, 1, &gSceneTextureSRV);
+// Run each output window's effects over its view into its back buffer, then give the view back to the pool. The effects
+// are the scene's, less those that need the depth buffer as it only holds the main view. The exposure adapted to the
+// main view is used as it is. postProcessing is false if the scene has no effects this frame
+void PostProcessWindows(std::vector<PooledTarget*>& images, bool postProcessing)
+{
+	for (int i = 0; i < static_cast<int>(images.size()); ++i)
+	{
+		if (images[i] == nullptr)  continue;
+
+		EffectChain& effects = gOutputWindows.Effects(i);
+		effects.Clear();
+		if (postProcessing)
+		{
+			for (auto effect : gSceneEffects.Effects())  if (effect != Effect::Upscale)  effects.Add(effect); // Drawn full size
+		}
+		EffectSettings& settings = effects.Settings();
+		settings = gSceneEffects.Settings();
+		settings.depth         = nullptr;
+		settings.inputMipChain = nullptr;
+		settings.frameTime     = 0;
+		settings.viewProjection        = gWindowCameras[i].ViewProjectionMatrix();
+		settings.inverseViewProjection = gWindowCameras[i].InverseViewProjectionMatrix();
+		if (!effects.Apply(images[i]->shaderResource, gOutputWindows.BackBuffer(i), images[i]->renderTarget))
+		{
+			OutputDebugStringA((gLastError + "\n").c_str());
+		}
+		gRenderTargetPool.Return(images[i]);
+		images[i] = nullptr;
+	}
+}
+
+//**************************
 
-	gD3DContext->Draw(4, 0);
 
 
-	// These lines unbind the scene texture from the pixel shader to stop DirectX issuing a warning when we try to render to it again next frame
-	ID3D11ShaderResourceView* nullSRV = nullptr;
-	gD3DContext->PSSetShaderResources(0, 1, &nullSRV);
+//--------------------------------------------------------------------------------------
+// Scene Control
+//--------------------------------------------------------------------------------------
+
+// Switch on exactly the given post-processes (POST_PROCESS_ flags in Scene.h)
+void SetPostProcesses(int postProcesses)
+{
+	Tint         = (postProcesses & POST_PROCESS_TINT)          != 0;
+	Blur         = (postProcesses & POST_PROCESS_BLUR)          != 0;
+	GaussianBlur = (postProcesses & POST_PROCESS_GAUSSIAN_BLUR) != 0;
+	Underwater   = (postProcesses & POST_PROCESS_UNDERWATER)    != 0;
+	Retro        = (postProcesses & POST_PROCESS_RETRO)         != 0;
+	Bloom        = (postProcesses & POST_PROCESS_BLOOM)         != 0;
+	StarFilter   = (postProcesses & POST_PROCESS_STAR_FILTER)   != 0;
 }
 
-//**************************
+// The post-processes switched on
+int PostProcesses()
+{
+	return (Tint         ? POST_PROCESS_TINT          : 0) |
+	       (Blur         ? POST_PROCESS_BLUR          : 0) |
+	       (GaussianBlur ? POST_PROCESS_GAUSSIAN_BLUR : 0) |
+	       (Underwater   ? POST_PROCESS_UNDERWATER    : 0) |
+	       (Retro        ? POST_PROCESS_RETRO         : 0) |
+	       (Bloom        ? POST_PROCESS_BLOOM         : 0) |
+	       (StarFilter   ? POST_PROCESS_STAR_FILTER   : 0);
+}
+
+// Place the main camera
+void SetCameraPose(CVector3 position, CVector3 rotation)
+{
+	gCamera->SetPosition(position);
+	gCamera->SetRotation(rotation);
+
+	// Jump straight there rather than blending from the old pose
+	gCurrentState.cameraPosition = gPreviousState.cameraPosition = position;
+	gCurrentState.cameraRotation = gPreviousState.cameraRotation = rotation;
+}
+
+// Lock the frame rate to the monitor refresh rate
+void SetLockFPS(bool lock)
+{
+	lockFPS = lock;
+}
+
+// Cap the frame rate in software, 0 for no cap
+void SetFrameRateCap(float framesPerSecond)
+{
+	gFrameLimiter.SetFrameRate(framesPerSecond);
+}
+
+// Record the frames shown, video files are played back at the frame rate cap or 60fps
+bool StartFrameCapture(const std::string& destination)
+{
+	float frameRate = gFrameLimiter.FrameRate();
+	return gFrameCapture.Start(destination, frameRate > 0 ? frameRate : 60);
+}
+
+// Resize everything that depends on the window size. Meshes, textures and shaders are kept, and the post-process
+// graph gets targets of the new size from the render target pool
+bool ResizeScene(int width, int height)
+{
+	if (width <= 0 || height <= 0)  return true; // Minimised
+	if (width == gViewportWidth && height == gViewportHeight)  return true;
+
+	gViewportWidth  = width;
+	gViewportHeight = height;
+
+	ReleaseSceneTexture();
+	gSceneEffects.ReleaseHistory();
+	gRetroEffects.ReleaseHistory();
+	gRenderTargetPool.ReleaseUnused(); // None of the old sizes will be needed again
+	if (!ResizeDirect3D())  return false;
+	gStateCache.Invalidate(); // Resizing clears the context state
+	gFrameCache.Invalidate();
+	if (!CreateSceneTexture())  return false;
+
+	if (gCamera != nullptr)  gCamera->SetAspectRatio(static_cast<float>(width) / height);
+	return true;
+}
+
+void SetDynamicResolution(bool enable, float budgetMilliseconds)
+{
+	if (enable)  gDynamicResolution.Enable(budgetMilliseconds);
+	else         gDynamicResolution.Disable();
+}
+
+void SetOutputWindowSeparation(float separation)
+{
+	outputWindowSeparation = std::max(separation, 0.0f);
+}
+
+void SetMultiView(int numViews, float separation)
+{
+	multiViews = std::max(numViews, 1);
+	multiViewSeparation = std::max(separation, 0.0f);
+}
+
+void SetQualityGovernor(bool enable, float budgetMilliseconds)
+{
+	if (enable)  gQualityGovernor.Enable(budgetMilliseconds);
+	else         gQualityGovernor.Disable();
+}
+
+void SetRenderThreads(int numThreads)
+{
+	renderThreads = numThreads;
+}
+
+void SetRenderChunkSize(int chunkSize)
+{
+	renderChunkSize = chunkSize;
+}
+
+void SetCompactVertices(bool compact)
+{
+	compactVertices = compact;
+}
+
+void SetInstancedRendering(bool enable)
+{
+	instancedRendering = enable;
+}
+
+void SetMaterialArrays(bool enable)
+{
+	materialArrays = enable;
+}
+
+void SetStaticBatching(bool enable)
+{
+	staticBatching = enable;
+}
+
+void SetSkyPass(bool enable)
+{
+	skyPass = enable;
+}
+
+void SetObjectLights(bool enable)
+{
+	objectLights = enable;
+}
+
+void SetShadows(bool enable)
+{
+	shadows = enable;
+}
+
+void SetPipelineStatistics(bool enable)
+{
+	pipelineStatistics = enable;
+}
+
+void SetGeometryPool(bool enable)
+{
+	geometryPool = enable;
+}
+
+void SetLodSelection(bool enable)
+{
+	lodSelection = enable;
+}
+
+void SetImpostors(bool enable)
+{
+	impostors = enable;
+}
+
+void SetGpuCulling(bool enable)
+{
+	gpuCulling = enable;
+}
+
+void SetFftBloom(bool enable, const std::string& kernelImage)
+{
+	fftBloom = enable;
+	fftBloomKernelImage = kernelImage;
+}
+
+void SetBloomTiles(bool enable)
+{
+	bloomTiles = enable;
+}
+
+void SetDualFilterBlur(bool enable)
+{
+	dualFilterBlur = enable;
+}
+
+void SetLowResolutionRetro(bool enable)
+{
+	lowResolutionRetro = enable;
+}
+
+void SetColourLut(bool enable)
+{
+	colourLut = enable;
+}
+
+void SetComputePostProcessing(bool enable)
+{
+	computePostProcess = enable;
+}
+
+void SetHalfPrecisionEffects(bool enable)
+{
+	halfPrecisionEffects = enable;
+}
+
+void SetFramesInFlight(int frames)
+{
+	gFramePipeline.SetMaxFramesInFlight(frames);
+}
+
+void SetAutoExposure(bool enable)
+{
+	autoExposure = enable;
+}
+
+void SetReducedRate(ReducedRateMode mode)
+{
+	reducedRateMode = mode;
+}
+
+void SetPostAntiAliasing(PostAntiAliasing mode)
+{
+	postAntiAliasing = mode;
+}
+
+void SetSpatialUpscale(bool enable, float sharpness)
+{
+	spatialUpscale = enable;
+	upscaleSharpness = std::max(0.0f, std::min(sharpness, 1.0f));
+}
+
+void SetRenderScale(float scale)
+{
+	if (scale < 1.0f)  gDynamicResolution.EnableFixed(scale);
+	else               gDynamicResolution.Disable();
+}
+
+void SetTemporalEffects(bool enable)
+{
+	temporalEffects = enable;
+}
+
+void SetSceneFormat(DXGI_FORMAT format)
+{
+	gSceneFormat = format;
+}
+
+void SetMsaaSamples(int samples)
+{
+	msaaSamples = (samples >= 8) ? 8 : (samples >= 4) ? 4 : (samples >= 2) ? 2 : 1;
+	if (gSceneTexture != nullptr)  UpdateMultisampledSceneTargets(); // Otherwise created with the scene texture
+}
+
+void SetStaticCommandLists(bool enable)
+{
+	staticCommandLists = enable;
+}
+
+void SetFrameCaching(bool enable)
+{
+	frameCaching = enable;
+	gFrameCache.Invalidate(); // The post-processes may have reused the scene texture while it was off
+}
+
+void SetDepthPrePass(bool enable)
+{
+	depthPrePass = enable;
+}
+
+void SetDeferredShading(bool enable)
+{
+	deferredShading = enable;
+}
+
+void SetExtraLights(int numLights)
+{
+	numExtraLights = std::max(std::min(numLights, MAX_LIGHTS - NUM_MAIN_LIGHTS), 0);
+}
+
+void SetOcclusionCulling(bool enable)
+{
+	occlusionCulling = enable;
+}
+
+void SetParticles(int count)
+{
+	numParticles = static_cast<unsigned int>(std::max(count, 0));
+}
+
+void SetParticleSorting(bool enable)
+{
+	particleSorting = enable;
+}
+
+void SetStressScene(int numModels, int numLights, bool grid, bool animated)
+{
+	numStressModels = std::max(numModels, 0);
+	numStressLights = std::max(std::min(numLights, MAX_LIGHTS - NUM_MAIN_LIGHTS), 0);
+	stressGrid      = grid;
+	stressAnimated  = animated;
+}
+
+void SetTextureBudget(int megabytes)
+{
+	gTextureStreamer.SetBudget(static_cast<size_t>(std::max(megabytes, 1)) * 1024 * 1024);
+}
+
+void SetEffectIdleTime(int seconds)
+{
+	gEffectResources.SetIdleTime(static_cast<float>(std::max(seconds, 0)));
+}
+
+
+// Fraction of the OS's local memory budget to stay within, leaving room for the driver and resources created part way
+// through a frame
+const double MEMORY_BUDGET_HEADROOM = 0.9;
+
+// Keep the streamed textures within the local memory budget left by everything else, so they give up mip levels when
+// the budget shrinks rather than the OS paging resources out (see ResourceRegistry.h). The other resources are counted
+// each frame, so a resize that grows the render targets also takes memory from the textures
+void LimitStreamedTextures()
+{
+	gResourceRegistry.Update();
+	uint64_t budget = gResourceRegistry.LocalBudget();
+	if (budget == 0)  return; // The OS can't say, keep to the streamer's own budget
+
+	int64_t others = gResourceRegistry.LocalBytes() + gResourceRegistry.UntrackedBytes() - gTextureStreamer.ResidentBytes();
+	int64_t limit = static_cast<int64_t>(budget * MEMORY_BUDGET_HEADROOM) - std::max(others, static_cast<int64_t>(0));
+	gTextureStreamer.SetMemoryLimit(static_cast<size_t>(std::max(limit, static_cast<int64_t>(0))));
+}
+
+
+// GPU profiler overlay settings - size of each bar in pixels (also used by the memory overlay), and the time shown by a
+// bar the full width of the overlay
+const int   PROFILER_OVERLAY_WIDTH   = 400;
+const int   PROFILER_BAR_HEIGHT      = 12;
+const float PROFILER_OVERLAY_FULL_MS = 4.0f;
+
+// Draw the bars in gProfilerOverlayConstants in the top corner of the back buffer, from the given left edge in pixels
+void RenderOverlayBars(int numBars, int left)
+{
+	gProfilerOverlayConstants.numBars = numBars;
+	UpdateConstantBuffer(gProfilerOverlayConstantBuffer, gProfilerOverlayConstants);
+
+	// Full screen quad shader drawn into a viewport covering just the overlay
+	gD3DContext->OMSetRenderTargets(1, &gBackBufferRenderTarget, nullptr);
+	D3D11_VIEWPORT vp;
+	vp.Width    = static_cast<FLOAT>(PROFILER_OVERLAY_WIDTH);
+	vp.Height   = static_cast<FLOAT>(numBars * PROFILER_BAR_HEIGHT);
+	vp.MinDepth = 0.0f;
+	vp.MaxDepth = 1.0f;
+	vp.TopLeftX = static_cast<FLOAT>(left);
+	vp.TopLeftY = 0;
+	gD3DContext->RSSetViewports(1, &vp);
+
+	gStateCache.VSSetShader(gFullScreenQuadVertexShader, nullptr, 0);
+	gStateCache.GSSetShader(nullptr, nullptr, 0);
+	gStateCache.PSSetShader(gProfilerOverlay_PostProcess, nullptr, 0);
+	gStateCache.SetConstantBuffer(PROFILER_OVERLAY_CONSTANTS_SLOT, gProfilerOverlayConstantBuffer);
+
+	gStateCache.OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
+	gStateCache.OMSetDepthStencilState(gNoDepthBufferState, 0);
+	gStateCache.RSSetState(gCullNoneState);
+	gStateCache.IASetInputLayout(NULL);
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	gD3DContext->Draw(3, 0);
+}
+
+
+// Draw the GPU profiler timings as a bar chart in the top-left corner of the back buffer, the first bar is the whole frame.
+// The timings are a few frames old (see GpuProfiler.h)
+void RenderProfilerOverlay()
+{
+	const std::vector<GpuProfiler::Timing>& timings = gGpuProfiler.Timings();
+	int numBars = 1;
+	gProfilerOverlayConstants.bars[0].length = gGpuProfiler.FrameMilliseconds() / PROFILER_OVERLAY_FULL_MS;
+	gProfilerOverlayConstants.bars[0].depth  = 0;
+	for (auto& timing : timings)
+	{
+		if (numBars == MAX_PROFILER_BARS)  break;
+		gProfilerOverlayConstants.bars[numBars].length = timing.milliseconds / PROFILER_OVERLAY_FULL_MS;
+		gProfilerOverlayConstants.bars[numBars].depth  = static_cast<float>(timing.depth + 1);
+		++numBars;
+	}
+	RenderOverlayBars(numBars, 0);
+}
+
+
+// Draw the memory used as a bar chart in the top-right corner of the back buffer, each bar a fraction of the OS's
+// budget (or of the memory used when it can't say). The first bar is all the local memory the OS says is in use, then
+// each category, then what isn't tracked. Staging resources are measured against the non-local budget
+void RenderMemoryOverlay()
+{
+	double localUsage = static_cast<double>(gResourceRegistry.LocalUsage());
+	double localFull  = static_cast<double>(gResourceRegistry.LocalBudget());
+	double stagingFull = static_cast<double>(gResourceRegistry.NonLocalBudget());
+	if (localFull  <= 0)  localFull = std::max(localUsage, static_cast<double>(gResourceRegistry.LocalBytes()));
+	if (stagingFull <= 0)  stagingFull = localFull;
+	if (localFull  <= 0)  return;
+
+	int numBars = 0;
+	auto addBar = [&numBars](double bytes, double full, float depth)
+	{
+		gProfilerOverlayConstants.bars[numBars].length = static_cast<float>(bytes / full);
+		gProfilerOverlayConstants.bars[numBars].depth  = depth;
+		++numBars;
+	};
+	addBar(localUsage, localFull, 0);
+	for (int i = 0; i < NUM_MEMORY_CATEGORIES; ++i)
+	{
+		MemoryCategory category = static_cast<MemoryCategory>(i);
+		double bytes = static_cast<double>(gResourceRegistry.Bytes(category));
+		addBar(bytes, category == MemoryCategory::Staging ? stagingFull : localFull, 1);
+	}
+	addBar(static_cast<double>(gResourceRegistry.UntrackedBytes()), localFull, 1);
+	RenderOverlayBars(numBars, std::max(gViewportWidth - PROFILER_OVERLAY_WIDTH, 0));
+}
+
+
+// Distance at which a light's brightest colour channel falls to LIGHT_CUTOFF. The lighting shader fades each light out
+// towards its range, so it can be left out of the clusters beyond it
+float LightRange(const Light& light)
+{
+	float brightest = std::max({ light.colour.x, light.colour.y, light.colour.z }) * light.strength;
+	return std::max(brightest / LIGHT_CUTOFF, 1.0f);
+}
+
+
+// A hue the given fraction of the way from hue1 to hue2, going forwards past 360 if hue2 has wrapped around
+float BlendHue(float hue1, float hue2, float t)
+{
+	if (hue2 < hue1)  hue2 += 360;
+	float hue = hue1 + (hue2 - hue1) * t;
+	return (hue > 360) ? hue - 360 : hue;
+}
+
+// Place the camera, orbiting light and animated effects the given fraction of the way from the previous simulation step
+// to the latest
+void ApplySimulationState(float t)
+{
+	const SimulationState& s1 = gSimulationSnapshots.Front().previous;
+	const SimulationState& s2 = gSimulationSnapshots.Front().current;
+
+	gCamera->SetPosition(s1.cameraPosition + (s2.cameraPosition - s1.cameraPosition) * t);
+	gCamera->SetRotation(s1.cameraRotation + (s2.cameraRotation - s1.cameraRotation) * t);
+
+	float orbit = s1.lightOrbit + (s2.lightOrbit - s1.lightOrbit) * t;
+	gLights[0].model->SetPosition({ 20 + cos(orbit) * gLightOrbitRadius, 10, 20 + sin(orbit) * gLightOrbitRadius });
+
+	tintColour.x  = BlendHue(s1.tintHue,  s2.tintHue,  t);
+	tintColour2.x = BlendHue(s1.tintHue2, s2.tintHue2, t);
+	timer = s1.postProcessTime + (s2.postProcessTime - s1.postProcessTime) * t;
+}
+
+// Spin the stress scene models and bob them up and down, at the post-processing time just placed, and move on the clips of
+// those with animation. Every model moves every frame, so the transform system and scene tree updates are measured at
+// their worst
+void AnimateStressScene(float frameTime)
+{
+	if (!stressAnimated || gStressModels.empty())  return;
+	CPU_PROFILE_SCOPE("AnimateStressScene");
+
+	for (auto& stress : gStressModels)
+	{
+		float angle = stress.phase + stress.spin * timer;
+		stress.model->SetPosition(stress.position + CVector3{ 0, STRESS_BOB * sin(angle), 0 });
+		stress.model->SetRotation({ 0.0f, angle, 0.0f });
+	}
+	UpdateAnimators(gStressAnimators.data(), gStressAnimators.size(), frameTime);
+}
+
+
+// Everything the scene render depends on, for the frame cache (see FrameCache.h). The particles and the animated stress
+// models move every frame, so every key is different while there are any
+FrameKey SceneKey(ID3D11RenderTargetView* sceneTarget)
+{
+	static uint64_t frameNumber = 0;
+	++frameNumber;
+
+	FrameKey key;
+	key.AddObject(sceneTarget);
+	key.AddObject(gSceneDepthStencil);
+	key.AddValue(sceneTarget == gSceneRenderTargetMS ? msaaSamples : 1);
+	key.AddValue(sceneWidth);
+	key.AddValue(sceneHeight);
+	key.AddMatrix(gCamera->WorldMatrix());
+	key.AddMatrix(gCamera->ProjectionMatrix());
+	key.AddValue(multiViews);
+	key.AddFloat(multiViewSeparation);
+	for (auto& light : gLights)
+	{
+		key.AddVector(light.model->Position());
+		key.AddVector(light.colour);
+		key.AddFloat(light.strength);
+	}
+	key.AddValue((frustumCulling ? 1 : 0) | (occlusionCulling ? 2 : 0) | (lodSelection ? 4 : 0) | (depthPrePass ? 8 : 0) |
+	             (deferredShading ? 16 : 0) | (instancedRendering ? 32 : 0) | (particles ? 64 : 0) | (materialArrays ? 128 : 0) |
+	             (staticBatching ? 256 : 0) | (skyPass ? 512 : 0) |
+	             (objectLights ? 1024 : 0) | (shadows ? 2048 : 0) | (impostors ? 4096 : 0) |
+	             (gpuCulling ? 8192 : 0));
+	key.AddValue(gMaterialArrays.Version());
+	key.AddValue(gShadowMaps.Version());
+	key.AddValue(gTextureStreamer.NumPending());
+	key.AddValue(gTextureStreamer.NumStreamed());
+	key.AddValue(gTextureStreamer.ResidentBytes());
+	key.AddValue(gTextureStreamer.MipBias());
+	key.AddValue(gShaderReloader.NumReloads());
+	if ((particles && gParticleSystem.NumEmitters() > 0) || (stressAnimated && !gStressModels.empty()))  key.AddValue(frameNumber);
+	return key;
+}
 
+// Everything the post-processing depends on, for the frame cache. The time is only included while an effect is
+// animated by it, and auto exposure and the temporal effects build up over many frames so every key is different while
+// either is on
+FrameKey PostProcessKey()
+{
+	static uint64_t frameNumber = 0;
+	++frameNumber;
+
+	FrameKey key;
+	key.AddObject(gBackBufferRenderTarget);
+	key.AddValue(gViewportWidth);
+	key.AddValue(gViewportHeight);
+	key.AddValue(static_cast<uint64_t>(gCurrentPostProcess));
+	key.AddValue((Tint ? 1 : 0) | (Blur ? 2 : 0) | (GaussianBlur ? 4 : 0) | (Underwater ? 8 : 0) | (Retro ? 16 : 0) |
+	             (Bloom ? 32 : 0) | (StarFilter ? 64 : 0) | (DepthOfField ? 128 : 0) | (Fog ? 256 : 0) |
+	             (dualFilterBlur ? 512 : 0) | (fftBloom ? 1024 : 0) | (lowResolutionRetro ? 2048 : 0) | (colourLut ? 4096 : 0) |
+	             (gDynamicResolution.Enabled() ? 8192 : 0) | (computePostProcess ? 16384 : 0) |
+	             (bloomTiles ? 32768 : 0) | (static_cast<int>(CurrentReducedRate()) * 65536) |
+	             (static_cast<int>(postAntiAliasing) * 262144) | (spatialUpscale ? 1048576 : 0) |
+	             (halfPrecisionEffects ? 2097152 : 0));
+	key.AddVector(tintColour);
+	key.AddVector(tintColour2);
+	key.AddFloat(blurStrength);
+	key.AddFloat(blurCurve);
+	key.AddFloat(pixelSize);
+	key.AddFloat(bitColour);
+	key.AddFloat(upscaleSharpness);
+	key.AddString(fftBloomKernelImage);
+	key.AddValue(gEffectResources.NumLoaded()); // An effect comes on when its shaders have loaded
+	key.AddValue(gQualityGovernor.NumChanges());
+	key.AddValue(gEffectResources.NumLoading());
+	if (Underwater || gCurrentPostProcess == PostProcess::Spiral)  key.AddFloat(timer);
+	if (autoExposure || temporalEffects)  key.AddValue(frameNumber);
+	return key;
+}
 
 
 // Rendering the scene
-void RenderScene(float frameTime)
+// Pack the textures of the lit models into material arrays again if any have changed, or free the arrays while unused
+void UpdateMaterialArrays()
 {
+	if (!materialArrays || !instancedRendering)
+	{
+		gMaterialArrays.Release();
+		materialArraysFailed = false;
+		return;
+	}
+
+	std::vector<ID3D11ShaderResourceView*> textures = { gGroundDiffuseSpecularMapSRV, gCrateDiffuseSpecularMapSRV, gCubeDiffuseSpecularMapSRV,
+	                                                    gWoodDiffuseSpecularMapSRV,   gTrollDiffuseSpecularMapSRV };
+	bool failed = !gMaterialArrays.Update(textures);
+	if (failed && !materialArraysFailed)  OutputDebugStringA((gLastError + "\n").c_str());
+	materialArraysFailed = failed;
+}
+
+// Bring the main lights' shadow maps up to date for this frame, or switch them off. The models drawn into them are those
+// the camera passes draw, the static ones to the cached maps. Changes the camera matrices of the per-frame constants,
+// so call before RenderSceneFromCamera
+void UpdateShadows()
+{
+	if (!shadows)
+	{
+		if (gShadowMaps.Enabled())  gShadowMaps.Disable();
+		return;
+	}
+
+	std::vector<ShadowMaps::Light> lights;
+	for (int i = 0; i < std::min(static_cast<int>(gFrameLights.size()), MAX_SHADOW_LIGHTS); ++i)
+	{
+		lights.push_back({ gFrameLights[i].position, gFrameLights[i].range });
+	}
+	std::vector<Model*> staticCasters, dynamicCasters;
+	for (auto& draw : ModelDraws(true))   staticCasters.push_back(draw.model);
+	for (auto& draw : ModelDraws(false))  dynamicCasters.push_back(draw.model);
+
+	gGpuProfiler.BeginTimer("Shadow Maps");
+	gShadowMaps.Update(lights, staticCasters, staticBatching && gStaticBatches.NumModels() > 0, dynamicCasters);
+	gGpuProfiler.EndTimer();
+}
+
+// The star sphere covers the whole view when the camera is well inside it and all of it is nearer than the far clip, so
+// every pixel the models leave is drawn by the sky. The sphere's bounding box gives its radius. The sky pass always does
+bool SkyFillsView()
+{
+	if (skyPass && gSky.Loaded())  return true;
+
+	BoundingBox bounds = gStars->WorldBoundingBox();
+	CVector3 halfExtents = bounds.HalfExtents();
+	float innerRadius = std::min(halfExtents.x, std::min(halfExtents.y, halfExtents.z));
+	float outerRadius = std::max(halfExtents.x, std::max(halfExtents.y, halfExtents.z));
+	float distance = Length(gCamera->Position() - bounds.Centre());
+	return distance < innerRadius * 0.5f && distance + outerRadius < gCamera->FarClip();
+}
+
+void RenderScene(float frameTime, float interpolation)
+{
+	CPU_PROFILE_SCOPE("RenderScene");
+
+	WaitForFrameLatency();
+
+	// Wait for the GPU to finish the frame MaxFramesInFlight back, then this frame writes the copies that frame used
+	gFramePipeline.BeginFrame();
+	gImmediateConstantRing.BeginFrame(gFramePipeline.Slot());
+	gImmediateInstanceRing.BeginFrame(gFramePipeline.Slot());
+
+	if (!gOutputWindows.Update())  OutputDebugStringA((gLastError + "\n").c_str()); // Follow any resized windows
+	ApplySimulationState(interpolation); // Place everything that moves before composing the model matrices below
+	AnimateStressScene(frameTime);
+	gShaderReloader.Update(); // Swap in any edited shaders before anything uses them
+	gEffectResources.Update(); // --"-- and the shaders of effects just switched on, releasing those of unused effects
+	LimitStreamedTextures();   // --"-- and any change in the memory the OS allows
+	gTextureStreamer.Update(); // --"-- and any textures that have finished streaming
+	UpdateMaterialArrays();    // --"-- and pack them into arrays again if they have changed
+	gGeometryPool.Flush();     // --"-- and the geometry of any meshes created since the last frame
+	gTransformSystem.Update(); // Compose the matrices of any models moved since the last frame
+	UpdateStaticBatches();     // --"-- then bake the static models into batches again if any of them have changed
+	gImpostors.Update();       // --"-- and capture the impostors again of meshes whose textures have streamed in
+
+	// Then calculate the bone palettes of all the skinned models together and skin them once for all the passes below
+	if (!gBonePalettes.Update(gSkinnedModels.data(), static_cast<unsigned int>(gSkinnedModels.size())))
+	{
+		OutputDebugStringA((gLastError + "\n").c_str()); // Not fatal, the palettes are uploaded one at a time instead
+	}
+	for (unsigned int i = 0; i < gSkinnedModels.size(); ++i)
+	{
+		gBonePalettes.Bind(i);
+		gSkinnedModels[i]->Skin();
+	}
+	gGpuProfiler.EnableStatistics(pipelineStatistics);
+	gGpuProfiler.BeginFrame();
+
+	// Move the particles on, once per frame for all the cameras
+	if (particles)
+	{
+		gGpuProfiler.BeginTimer("Particle Simulation");
+		gParticleSystem.Simulate(frameTime);
+		gGpuProfiler.EndTimer();
+	}
+
 	//// Common settings ////
 
-	// Set up the light information in the constant buffer
+	// Send the lights to the light buffer, the clusters are built for each camera in RenderSceneFromCamera
+	std::vector<LightData> lights;
+	for (auto& light : gLights)
+	{
+		lights.push_back({ light.model->Position(), LightRange(light), light.colour * light.strength, 0.0f });
+	}
+	gLightClusters.SetLights(lights);
+	if (lights.size() > static_cast<size_t>(MAX_LIGHTS))  lights.resize(MAX_LIGHTS); // As many as the light buffer holds
+	gFrameLights.swap(lights);
+
+	// Set up the other lighting information in the constant buffer
 	// Don't send to the GPU yet, the function RenderSceneFromCamera will do that
-	gPerFrameConstants.light1Colour   = gLights[0].colour * gLights[0].strength;
-	gPerFrameConstants.light1Position = gLights[0].model->Position();
-	gPerFrameConstants.light2Colour   = gLights[1].colour * gLights[1].strength;
-	gPerFrameConstants.light2Position = gLights[1].model->Position();
+	gPerFrameConstants.numLights      = static_cast<unsigned int>(gLightClusters.NumLights());
 
 	gPerFrameConstants.ambientColour  = gAmbientColour;
 	gPerFrameConstants.specularPower  = gSpecularPower;
 	gPerFrameConstants.cameraPosition = gCamera->Position();
 
-	gPerFrameConstants.viewportWidth  = static_cast<float>(gViewportWidth);
-	gPerFrameConstants.viewportHeight = static_cast<float>(gViewportHeight);
+	// Pick the resolution for this frame, the scene is rendered into the top-left of the scene texture
+	float scale = gDynamicResolution.Update(gGpuProfiler.FrameMilliseconds());
+
+	// And the quality of the effects. With dynamic resolution on as well, the effects are only made cheaper once the
+	// resolution has had to drop noticeably
+	gQualityGovernor.Update(gGpuProfiler.FrameMilliseconds(), gGpuProfiler.Timings(),
+	                        !gDynamicResolution.Enabled() || gDynamicResolution.UnderPressure());
+	sceneWidth  = std::max(static_cast<int>(gViewportWidth  * scale + 0.5f), 1);
+	sceneHeight = std::max(static_cast<int>(gViewportHeight * scale + 0.5f), 1);
+
+	// Low resolution retro renders one pixel per retro block into a target of its own, overriding dynamic resolution.
+	// The full size depth buffer is still used, only its top-left part is touched
+	if (Retro && lowResolutionRetro && SingleView())
+	{
+		int retroWidth  = std::max(static_cast<int>(gViewportWidth  / pixelSize + 0.5f), 1);
+		int retroHeight = std::max(static_cast<int>(gViewportHeight / pixelSize + 0.5f), 1);
+		gRetroSceneTarget = gRenderTargetPool.Acquire(retroWidth, retroHeight, gSceneFormat);
+		if (gRetroSceneTarget != nullptr)
+		{
+			sceneWidth  = retroWidth;
+			sceneHeight = retroHeight;
+		}
+		else
+		{
+			OutputDebugStringA((gLastError + "\n").c_str()); // Pixellate the usual way instead
+		}
+	}
+
+	gPerFrameConstants.viewportWidth  = static_cast<float>(sceneWidth);
+	gPerFrameConstants.viewportHeight = static_cast<float>(sceneHeight);
 
 	gPerFrameConstants.frameTime = frameTime;
 
@@ -962,53 +3412,184 @@ void RenderScene(float frameTime)
 
 	// Set the target for rendering and select the main depth buffer.
 	// If using post-processing then render to the scene texture, otherwise to the usual back buffer
-	// Also clear the render target to a fixed colour and the depth buffer to the far distance
-	if (gCurrentPostProcess != PostProcess::None
+	bool postProcessing = (gCurrentPostProcess != PostProcess::None
 		|| Tint
 		|| Blur
 		|| GaussianBlur
 		|| Underwater
 		|| Retro
-		|| Bloom)
+		|| Bloom
+		|| StarFilter
+		|| DepthOfField
+		|| Fog
+		|| autoExposure
+		|| postAntiAliasing != PostAntiAliasing::Off
+		|| gDynamicResolution.Enabled()
+		|| MultisampledScene());
+	ID3D11RenderTargetView* sceneTarget = postProcessing ? gSceneRenderTarget : gBackBufferRenderTarget;
+	if (gRetroSceneTarget != nullptr)  sceneTarget = gRetroSceneTarget->renderTarget;
+
+	// With MSAA the scene is drawn into the multisampled texture and depth buffer, the post-processing resolves it
+	bool multisampled = MultisampledScene();
+	if (multisampled)  sceneTarget = gSceneRenderTargetMS;
+	gSceneDepthStencil = multisampled ? gDepthStencilMS : gDepthStencil;
+
+	// Shadows first, they are part of what the frame cache's key covers
+	UpdateShadows();
+
+	// Reuse the last frame, or its scene, when nothing they depend on has changed (see FrameCache.h). Not with output
+	// windows, whose views aren't kept
+	bool caching = frameCaching && gOutputWindows.NumWindows() == 0;
+	if (caching)  gFrameCache.BeginFrame(SceneKey(sceneTarget), PostProcessKey());
+	bool reuseFrame = caching && gFrameCache.ReuseFrame();
+	bool reuseScene = caching && gFrameCache.ReuseScene() && postProcessing;
+	std::vector<PooledTarget*> windowImages(gOutputWindows.NumWindows(), nullptr);
+
+	ID3D11Resource* backBuffer;
+	gBackBufferRenderTarget->GetResource(&backBuffer);
+	if (reuseFrame)
 	{
-		gD3DContext->OMSetRenderTargets(1, &gSceneRenderTarget, gDepthStencil);
-		gD3DContext->ClearRenderTargetView(gSceneRenderTarget, &gBackgroundColor.r);
+		gFrameCache.RestoreFrame(backBuffer);
+		if (gRetroSceneTarget != nullptr)
+		{
+			gRenderTargetPool.Return(gRetroSceneTarget);
+			gRetroSceneTarget = nullptr;
+		}
 	}
 	else
 	{
-		gD3DContext->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
-		gD3DContext->ClearRenderTargetView(gBackBufferRenderTarget, &gBackgroundColor.r);
+		if (!reuseScene)
+		{
+			// Clear the render target to a fixed colour and the depth buffer to the far distance. If the sky will cover
+			// the target anyway its old contents are only discarded, so tiled GPUs neither load nor clear them
+			if (gD3DContext1 && SkyFillsView())
+				gD3DContext1->DiscardView(sceneTarget);
+			else
+				gD3DContext->ClearRenderTargetView(sceneTarget, &gBackgroundColor.r);
+			gD3DContext->ClearDepthStencilView(gSceneDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
+			if (multisampled)  gD3DContext->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0); // For the depth resolve
+
+			// Setup the viewport to the size of the main window, or to an equal part of its width for each view
+			D3D11_VIEWPORT vp;
+			vp.Width = static_cast<FLOAT>(std::max(sceneWidth / multiViews, 1));
+			vp.Height = static_cast<FLOAT>(sceneHeight);
+			vp.MinDepth = 0.0f;
+			vp.MaxDepth = 1.0f;
+			vp.TopLeftX = 0;
+			vp.TopLeftY = 0;
+
+			// The output windows are more views, drawn the same size
+			std::vector<MultiView> views;
+			if (!SingleView())
+			{
+				UpdateViewCameras(vp.Width / vp.Height);
+				for (int i = 0; i < multiViews; ++i)  views.push_back({ &gViewCameras[i], static_cast<UINT>(i * vp.Width), nullptr });
+				UpdateWindowCameras();
+				for (int i = 0; i < gOutputWindows.NumWindows(); ++i)
+				{
+					if (gOutputWindows.BackBuffer(i) != nullptr)  views.push_back({ &gWindowCameras[i], 0, &windowImages[i] });
+				}
+			}
+
+			// Render the scene from the main camera, or its views
+			RenderSceneFromCamera(gCamera, sceneTarget, vp, views);
+			if (caching)  gFrameCache.SceneRendered(sceneTarget == gSceneRenderTarget || multisampled);
+		}
+
+
+		////--------------- Scene completion ---------------////
+
+		// Run any post-processing steps
+		if (postProcessing)
+		{
+			gGpuProfiler.BeginTimer("Post-Processing");
+			PostProcessing(frameTime, multiViews == 1, multisampled); // The depth buffer only holds the first of several views
+			gGpuProfiler.EndTimer();
+		}
+		if (gOutputWindows.NumWindows() > 0)
+		{
+			gGpuProfiler.BeginTimer("Output Windows");
+			PostProcessWindows(windowImages, postProcessing);
+			gGpuProfiler.EndTimer();
+		}
+
+		// Nothing reads the depth buffer or the multisampled scene again this frame, unless the frame cache may reuse
+		// the scene with them
+		if (gD3DContext1 && !caching)
+		{
+			gD3DContext1->DiscardView(gDepthStencil);
+			if (multisampled)  gD3DContext1->DiscardView(gSceneRenderTargetMS);
+		}
+		if (caching)  gFrameCache.FrameRendered(backBuffer);
 	}
-	gD3DContext->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
 
-	// Setup the viewport to the size of the main window
-	D3D11_VIEWPORT vp;
-	vp.Width = static_cast<FLOAT>(gViewportWidth);
-	vp.Height = static_cast<FLOAT>(gViewportHeight);
-	vp.MinDepth = 0.0f;
-	vp.MaxDepth = 1.0f;
-	vp.TopLeftX = 0;
-	vp.TopLeftY = 0;
-	gD3DContext->RSSetViewports(1, &vp);
+	// Record and share the finished frame, before the overlay is drawn over it
+	if (gFrameCapture.Capturing() || gSharedOutput.Sharing())
+	{
+		{
+			CPU_PROFILE_SCOPE("Frame capture");
+			gFrameCapture.Capture(backBuffer);
+		}
+		gSharedOutput.Share(backBuffer);
+	}
+	backBuffer->Release();
 
-	// Render the scene from the main camera
-	RenderSceneFromCamera(gCamera);
+	if (showProfiler)  RenderProfilerOverlay();
+	if (showMemory)    RenderMemoryOverlay();
+	gGpuProfiler.EndFrame();
+	gStateCache.EndFrame();
+	gRenderTargetPool.EndFrame();
 
+	// When drawing to the off-screen back buffer is complete, we "present" the image to the front buffer (the screen)
+	// Locking the FPS waits for vsync, the frame rate cap waits before presenting so frames are presented evenly
+	{
+		CPU_PROFILE_SCOPE("Frame limiter");
+		gFrameLimiter.Wait();
+	}
+	gOutputWindows.Present(); // First, the main window's present may wait for vsync
+	PresentFrame(lockFPS);
+	gFramePipeline.EndFrame();
+	NextFrameArenas(); // The draw lists are finished with once the frame is recorded and presented
+}
 
-	////--------------- Scene completion ---------------////
 
-	// Run any post-processing steps
-	if (gCurrentPostProcess != PostProcess::None || Tint
-		|| Blur
-		|| GaussianBlur
-		|| Underwater
-		|| Retro
-		|| Bloom)  
-		PostProcessing(frameTime);
+// Run the post-processes on an image in place of the rendered scene, the result is left in the back buffer
+bool PostProcessImage(const void* pixels, int width, int height, float effectTime)
+{
+	CPU_PROFILE_SCOPE("PostProcessImage");
 
-	// When drawing to the off-screen back buffer is complete, we "present" the image to the front buffer (the screen)
-	// Set first parameter to 1 to lock to vsync
-	gSwapChain->Present(lockFPS ? 1 : 0, 0);
+	if (!ResizeScene(width, height))  return false;
+	if (gSceneFormat == DXGI_FORMAT_R8G8B8A8_UNORM)
+	{
+		gD3DContext->UpdateSubresource(gSceneTexture, 0, nullptr, pixels, width * 4, 0);
+	}
+	else
+	{
+		// An HDR scene texture can't take the 8-bit pixels directly, they are converted by an effect chain's copy
+		PooledTarget* image = gRenderTargetPool.Acquire(width, height, DXGI_FORMAT_R8G8B8A8_UNORM);
+		if (image == nullptr)  return false;
+		gD3DContext->UpdateSubresource(image->texture, 0, nullptr, pixels, width * 4, 0);
+		EffectChain copy;
+		bool copied = copy.Apply(image->shaderResource, gSceneRenderTarget);
+		gRenderTargetPool.Return(image);
+		if (!copied)  return false;
+	}
+	gFrameCache.Invalidate(); // The scene texture no longer holds the scene
+
+	gGpuProfiler.EnableStatistics(pipelineStatistics);
+	gGpuProfiler.BeginFrame();
+	sceneWidth  = gViewportWidth; // The whole scene texture is used, there is no dynamic resolution here
+	sceneHeight = gViewportHeight;
+	timer = effectTime;
+
+	gGpuProfiler.BeginTimer("Post-Processing");
+	PostProcessing(SIMULATION_TIME_STEP, false);
+	gGpuProfiler.EndTimer();
+
+	gGpuProfiler.EndFrame();
+	gStateCache.EndFrame();
+	gRenderTargetPool.EndFrame();
+	return true;
 }
 
 
@@ -1016,14 +3597,48 @@ void RenderScene(float frameTime)
 // Scene Update
 //--------------------------------------------------------------------------------------
 
-// Update models and camera. frameTime is the time passed since the last frame
-void UpdateScene(float frameTime)
+// Pick up the latest simulation step for RenderScene
+double AcquireSimulationState()
 {
-	tintColour.x += frameTime * 20;
-	if (tintColour.x > 360) tintColour.x = 0;
-	tintColour2.x += (frameTime*50);
-	if (tintColour2.x > 360) tintColour2.x = 0;
+	gSimulationSnapshots.Acquire();
+	return gSimulationSnapshots.Front().time;
+}
+
 
+// Advance everything that moves by one fixed step
+void SimulateScene(double time)
+{
+	CPU_PROFILE_SCOPE("SimulateScene");
+
+	gPreviousState = gCurrentState;
+	SimulationState& state = gCurrentState;
+	const float timeStep = SIMULATION_TIME_STEP;
+
+	state.tintHue += timeStep * 20;
+	if (state.tintHue > 360)  state.tintHue -= 360;
+	state.tintHue2 += timeStep * 50;
+	if (state.tintHue2 > 360)  state.tintHue2 -= 360;
+	state.postProcessTime += timeStep;
+
+	// Orbit one light
+	if (gLightOrbiting)  state.lightOrbit -= gLightOrbitSpeed * timeStep;
+
+	// Control of camera
+	gSimulationCamera.SetPosition(state.cameraPosition);
+	gSimulationCamera.SetRotation(state.cameraRotation);
+	gSimulationCamera.Control(timeStep, Key_Up, Key_Down, Key_Left, Key_Right, Key_W, Key_S, Key_A, Key_D);
+	state.cameraPosition = gSimulationCamera.Position();
+	state.cameraRotation = gSimulationCamera.Rotation();
+
+	gSimulationSnapshots.Back() = { gPreviousState, gCurrentState, time };
+	gSimulationSnapshots.Publish();
+}
+
+
+// Handle keys and the window title. frameTime is the time passed since the last frame
+void UpdateScene(float frameTime)
+{
+	CPU_PROFILE_SCOPE("UpdateScene");
 
 	// Select post process on keys
 	if (KeyHit(Key_1))   Tint = !Tint;
@@ -1031,10 +3646,32 @@ void UpdateScene(float frameTime)
 	if (KeyHit(Key_2))   GaussianBlur = !GaussianBlur;
 	if (KeyHit(Key_3))   Underwater = !Underwater;
 	if (KeyHit(Key_4))   Retro = !Retro;
+	if (KeyHit(Key_M))   lowResolutionRetro = !lowResolutionRetro;
+	if (KeyHit(Key_H))   colourLut = !colourLut;
+	if (KeyHit(Key_E))   computePostProcess = !computePostProcess;
 	if (KeyHit(Key_5))   Bloom = !Bloom;
+	if (KeyHit(Key_6))   StarFilter = !StarFilter;
+	if (KeyHit(Key_8))   DepthOfField = !DepthOfField;
+	if (KeyHit(Key_9))   Fog = !Fog;
+	if (KeyHit(Key_X))   autoExposure = !autoExposure;
+	if (KeyHit(Key_J))   dualFilterBlur = !dualFilterBlur;
+	if (KeyHit(Key_N))   fftBloom = !fftBloom;
+	if (KeyHit(Key_T))   bloomTiles = !bloomTiles;
+	if (KeyHit(Key_F12)) temporalEffects = !temporalEffects;
+	if (KeyHit(Key_Q))   reducedRateMode = static_cast<ReducedRateMode>((static_cast<int>(reducedRateMode) + 1) % 4);
+	if (KeyHit(Key_K))   postAntiAliasing = static_cast<PostAntiAliasing>((static_cast<int>(postAntiAliasing) + 1) % 3);
+	if (KeyHit(Key_Numpad2))  spatialUpscale = !spatialUpscale;
+	if (KeyHit(Key_Numpad3))  halfPrecisionEffects = !halfPrecisionEffects;
+	if (KeyHit(Key_Numpad4))  gFramePipeline.SetMaxFramesInFlight(gFramePipeline.MaxFramesInFlight() % MAX_FRAMES_IN_FLIGHT + 1);
+	if (KeyHit(Key_Tab))
+	{
+		msaaSamples = (msaaSamples >= 8) ? 1 : msaaSamples * 2;
+		UpdateMultisampledSceneTargets();
+	}
 
 
 	//if (KeyHit(Key_5))  gCurrentPostProcess = PostProcess::Spiral;
+	if (KeyHit(Key_7))  gCurrentPostProcess = PostProcess::PyramidBlur;
 	if (KeyHit(Key_0))  gCurrentPostProcess = PostProcess::None;
 
 	if (KeyHeld(Key_Comma)) blurStrength--;
@@ -1055,36 +3692,369 @@ void UpdateScene(float frameTime)
 	if (pixelSize < 1) pixelSize = 1;
 	if (KeyHeld(Key_G)) pixelSize++;
 
-	// Orbit one light - a bit of a cheat with the static variable [ask the tutor if you want to know what this is]
-	static float lightRotate = 0.0f;
-	static bool go = true;
-	gLights[0].model->SetPosition({ 20 + cos(lightRotate) * gLightOrbitRadius, 10, 20 + sin(lightRotate) * gLightOrbitRadius });
-	if (go)  lightRotate -= gLightOrbitSpeed * frameTime;
-	if (KeyHit(Key_L))  go = !go;
-
-	// Control of camera
-	gCamera->Control(frameTime, Key_Up, Key_Down, Key_Left, Key_Right, Key_W, Key_S, Key_A, Key_D);
+	// Pause / restart the orbiting light
+	if (KeyHit(Key_L))  gLightOrbiting = !gLightOrbiting;
 
 	// Toggle FPS limiting
 	if (KeyHit(Key_P))  lockFPS = !lockFPS;
 
-	// Show frame time / FPS in the window title //
-	const float fpsUpdateTime = 0.5f; // How long between updates (in seconds)
-	static float totalFrameTime = 0;
-	static int frameCount = 0;
-	totalFrameTime += frameTime;
-	++frameCount;
-	if (totalFrameTime > fpsUpdateTime)
-	{
-		// Displays FPS rounded to nearest int, and frame time (more useful for developers) in milliseconds to 2 decimal places
-		float avgFrameTime = totalFrameTime / frameCount;
-		std::ostringstream frameTimeMs;
-		frameTimeMs.precision(2);
-		frameTimeMs << std::fixed << avgFrameTime * 1000;
-		std::string windowTitle = "CO3303 Week 13: Full Screen Post Processing - Frame Time: " + frameTimeMs.str() +
-			"ms, FPS: " + std::to_string(static_cast<int>(1 / avgFrameTime + 0.5f));
-		SetWindowTextA(gHWnd, windowTitle.c_str());
-		totalFrameTime = 0;
-		frameCount = 0;
+	// Step through the frame rate caps
+	if (KeyHit(Key_O))
+	{
+		const int numCaps = sizeof(FRAME_RATE_CAPS) / sizeof(FRAME_RATE_CAPS[0]);
+		int cap = 0;
+		while (cap < numCaps && FRAME_RATE_CAPS[cap] != gFrameLimiter.FrameRate())  ++cap;
+		SetFrameRateCap(FRAME_RATE_CAPS[(cap + 1) % numCaps]); // A cap not in the list (from the command line) goes back to none
+	}
+
+	// Start / stop recording the frames shown
+	if (KeyHit(Key_R))
+	{
+		if (gFrameCapture.Capturing())  gFrameCapture.Stop();
+		else if (!StartFrameCapture("capture.y4m"))  OutputDebugStringA((gLastError + "\n").c_str());
+	}
+
+	// Toggle GPU profiler overlay
+	if (KeyHit(Key_F2))  showProfiler = !showProfiler;
+
+	// Toggle the memory overlay
+	if (KeyHit(Key_Minus))  showMemory = !showMemory;
+
+	// Toggle dynamic resolution
+	if (KeyHit(Key_F3))  SetDynamicResolution(!gDynamicResolution.Enabled(), DYNAMIC_RESOLUTION_BUDGET);
+
+	// Toggle between one view and a stereo pair
+	if (KeyHit(Key_End))  SetMultiView(multiViews == 1 ? 2 : 1, STEREO_SEPARATION);
+
+	// Toggle the effect quality governor
+	if (KeyHit(Key_Home))  SetQualityGovernor(!gQualityGovernor.Enabled(), DYNAMIC_RESOLUTION_BUDGET);
+
+	// Toggle instanced rendering
+	if (KeyHit(Key_F4))  instancedRendering = !instancedRendering;
+
+	// Toggle material arrays
+	if (KeyHit(Key_Plus))  materialArrays = !materialArrays;
+
+	// Toggle static batching
+	if (KeyHit(Key_Insert))  staticBatching = !staticBatching;
+
+	// Toggle the sky pass
+	if (KeyHit(Key_Delete))  skyPass = !skyPass;
+
+	// Toggle per-object light assignment
+	if (KeyHit(Key_Prior))  objectLights = !objectLights;
+
+	// Toggle shadows
+	if (KeyHit(Key_Back))  shadows = !shadows;
+
+	// Toggle the pipeline statistics
+	if (KeyHit(Key_Next))  pipelineStatistics = !pipelineStatistics;
+
+	// Toggle frustum culling
+	if (KeyHit(Key_F5))  frustumCulling = !frustumCulling;
+
+	// Toggle occlusion culling
+	if (KeyHit(Key_U))  occlusionCulling = !occlusionCulling;
+
+	// Toggle the particles
+	if (KeyHit(Key_I))  particles = !particles;
+
+	// Toggle sorting the particles back to front
+	if (KeyHit(Key_Y))  particleSorting = !particleSorting;
+
+	// Toggle sorting the scene draws
+	if (KeyHit(Key_F6))  sortDraws = !sortDraws;
+
+	// Toggle level of detail selection
+	if (KeyHit(Key_F7))  lodSelection = !lodSelection;
+
+	// Toggle drawing distant models as impostors
+	if (KeyHit(Key_Numpad0))  impostors = !impostors;
+
+	// Toggle culling the rigid models on the GPU
+	if (KeyHit(Key_Numpad1))  gpuCulling = !gpuCulling;
+
+	// Toggle replaying the static models from command lists kept between frames
+	if (KeyHit(Key_C))  staticCommandLists = !staticCommandLists;
+
+	// Toggle reusing unchanged frames
+	if (KeyHit(Key_Z))  SetFrameCaching(!frameCaching);
+
+	// Toggle the depth pre-pass
+	if (KeyHit(Key_F8))  depthPrePass = !depthPrePass;
+
+	// Switch between forward and deferred shading
+	if (KeyHit(Key_F9))  deferredShading = !deferredShading;
+
+	// Capture the next frames' CPU and GPU timelines to a trace file (see TraceCapture.h)
+	if (KeyHit(Key_F11) && !TraceCaptureRunning())
+	{
+		if (StartTraceCapture("trace.json", TRACE_CAPTURE_FRAMES))  OutputDebugStringA("Capturing trace to trace.json\n");
+		else                                                         OutputDebugStringA((gLastError + "\n").c_str());
+	}
+
+	// Show frame time statistics in the window title. Percentiles and max are over the most recent frames recorded by
+	// the telemetry (see Main.cpp), so single slow frames show up rather than being averaged away
+	const float titleUpdateTime = 0.5f; // How long between updates (in seconds)
+	static float timeSinceTitleUpdate = 0;
+	timeSinceTitleUpdate += frameTime;
+	if (timeSinceTitleUpdate > titleUpdateTime)
+	{
+		FrameTelemetry::Stats cpu = gTelemetry.CpuStats();
+		FrameTelemetry::Stats gpu = gTelemetry.GpuStats();
+		char windowTitle[256]; // Fixed size, nothing allocated for each update
+		std::snprintf(windowTitle, sizeof(windowTitle),
+		              "CO3303 Week 13: Full Screen Post Processing - Frame p50/p95/p99/max: %.2f/%.2f/%.2f/%.2fms, GPU p50/p99: %.2f/%.2fms, Hitches: %d",
+		              cpu.p50, cpu.p95, cpu.p99, cpu.max, gpu.p50, gpu.p99, gTelemetry.NumHitches());
+		SetWindowTextA(gHWnd, windowTitle);
+
+		// The overlay has no text, so list the timings in the debugger output window at the same rate
+		if (showProfiler)
+		{
+			std::ostringstream report;
+			report.precision(3);
+			report << "Device: " << DeviceDescription() << "\n";
+			report << std::fixed << "GPU frame: " << gGpuProfiler.FrameMilliseconds() << "ms\n";
+			report << "Post-processing constant uploads: " << gPostProcessingConstantBuffer.NumUploads()
+			       << " (" << gPostProcessingConstantBuffer.NumSkipped() << " skipped as unchanged)\n";
+			gPostProcessingConstantBuffer.ResetCounts();
+			report << "Render target pool: " << gRenderTargetPool.NumTargets() << " targets, "
+			       << gRenderTargetPool.MemoryBytes() / (1024.0f * 1024.0f) << "MB (peak "
+			       << gRenderTargetPool.PeakMemoryBytes() / (1024.0f * 1024.0f) << "MB)\n";
+			report << "Input layouts: " << gInputLayoutCache.NumLayouts() << "\n";
+			report << "Geometry pool: " << gGeometryPool.NumBuffers() << " buffers, " << gGeometryPool.AllocatedBytes() / 1024
+			       << " of " << gGeometryPool.TotalBytes() / 1024 << " KB used" << (gGeometryPool.Enabled() ? "" : " (off)") << "\n";
+			report << "Levels of detail: " << modelsReducedLod << " of " << modelsConsidered - modelsCulled << " models reduced"
+			       << (lodSelection ? "" : " (off)") << "\n";
+			report << "Impostors: " << modelsImpostored << " models drawn as " << gImpostors.NumImpostors() << " impostors, "
+			       << gImpostors.NumCaptures() << " captures" << (impostors ? "" : " (off)") << "\n";
+			report << "GPU culling: " << modelsGpuCulled << " models in " << gGpuCuller.NumGroups() << " groups, "
+			       << gGpuCuller.NumDraws() << " indirect draws, ";
+			if (gGpuCuller.NumVisible() >= 0)  report << gGpuCuller.NumVisible() << " visible, ";
+			report << "Hi-Z " << (gGpuCuller.UsedHiZ() ? "on" : "off") << (gpuCulling ? "" : " (off)") << "\n";
+			report << "Lights: " << gLightClusters.NumLights() << " in " << LIGHT_CLUSTERS_X << "x" << LIGHT_CLUSTERS_Y << "x"
+			       << LIGHT_CLUSTERS_Z << " clusters\n";
+			if (staticCommandLists)
+			{
+				report << "Static command lists: " << gDeferredRenderer.NumRetained() << " kept, recorded " << numStaticRecordings
+				       << " times" << (gDeferredRenderer.NumThreads() > 0 ? "" : " (off, needs render threads)") << "\n";
+			}
+			if (frameCaching)
+			{
+				report << "Frame cache: " << gFrameCache.NumFramesReused() << " frames reused, " << gFrameCache.NumScenesReused()
+				       << " more reused the scene and ran the post-processes\n";
+			}
+			report << "Scene format: " << (gSceneFormat == DXGI_FORMAT_R16G16B16A16_FLOAT ? "HDR, R16G16B16A16_FLOAT" :
+			                              gSceneFormat == DXGI_FORMAT_R11G11B10_FLOAT    ? "HDR, R11G11B10_FLOAT" : "R8G8B8A8_UNORM")
+			       << "\n";
+			report << "MSAA: " << (msaaSamples > 1 ? std::to_string(msaaSamples) + "x" : std::string("off"))
+			       << (msaaSamples > 1 && deferredShading ? " (unused with deferred shading)" : "")
+			       << (msaaSamples > 1 && Retro && lowResolutionRetro ? " (unused with low resolution retro)" : "")
+			       << "\n";
+			report << "Depth pre-pass: " << (depthPrePass ? "on" : "off") << "\n";
+			report << "Post-process anti-aliasing: " << (postAntiAliasing == PostAntiAliasing::Fxaa ? "FXAA" :
+			                                             postAntiAliasing == PostAntiAliasing::Smaa ? "SMAA" : "off")
+			       << (postAntiAliasing != PostAntiAliasing::Off && Retro && lowResolutionRetro ? " (unused with low resolution retro)" : "")
+			       << "\n";
+			report << "Auto exposure: " << (autoExposure ? "on" : "off") << "\n";
+			report << "Compute post-processing: " << (computePostProcess ? "on" : "off") << ", groups of "
+			       << gComputeTuner.GroupWidth() << "x" << gComputeTuner.GroupHeight()
+			       << (gComputeTuner.Calibrated() ? (gComputeTuner.Measured() ? " (calibrated)" : " (calibration cached)") : " (not calibrated)")
+			       << "\n";
+			report << "Half precision effects: " << (halfPrecisionEffects ? "on" : "off")
+			       << (halfPrecisionEffects && !HalfPrecisionSupported() ? " (no 16-bit shader maths on this GPU)" : "") << "\n";
+			report << "Temporal blur and bloom: " << (temporalEffects ? "on" : "off") << "\n";
+			if (reducedRateMode != ReducedRateMode::Off)
+			{
+				const char* rates[] = { "full", "half", "quarter" };
+				report << "Reduced rate: " << (reducedRateMode == ReducedRateMode::Auto ? "auto" : "always") << ", "
+				       << rates[static_cast<int>(CurrentReducedRate())] << " rate now, " << gSceneEffects.NumReducedRatePasses()
+				       << " passes" << (reducedRateMode == ReducedRateMode::Auto && !gDynamicResolution.Enabled() ? " (needs dynamic resolution)" : "")
+				       << "\n";
+			}
+			report << "Frames in flight: " << gFramePipeline.MaxFramesInFlight() << ", CPU stall "
+			       << gFramePipeline.StallMilliseconds() << "ms (average " << gFramePipeline.AverageStallMilliseconds() << "ms)\n";
+			report << "Constant buffer ring: " << (gImmediateConstantRing.Available() ? "on" : "off, needs D3D11.1 constant buffer offsets") << "\n";
+			report << "Instance buffer ring: ";
+			if (gImmediateInstanceRing.Available())
+			{
+				report << gImmediateInstanceRing.BlocksUsed() << "/" << InstanceBufferRing::BLOCKS_PER_FRAME << " blocks";
+				if (gImmediateInstanceRing.OverflowDraws() > 0)  report << ", " << gImmediateInstanceRing.OverflowDraws() << " draws discarding";
+				report << "\n";
+			}
+			else  report << "off, needs D3D11.1 no-overwrite maps of shader resource buffers\n";
+			if (Bloom && !fftBloom)
+			{
+				report << "Bloom tiles: " << (bloomTiles ? (dualFilterBlur ? "on, unused by the dual filter blur" : "on") : "off") << "\n";
+			}
+			if (fftBloom)
+			{
+				report << "FFT bloom: " << (gFftBloomKernel.Error().empty() ? "kernel built " + std::to_string(gFftBloomKernel.NumBuilds()) + " times"
+				                                                            : "using the usual bloom, " + gFftBloomKernel.Error()) << "\n";
+			}
+			report << "Blur: " << (dualFilterBlur ? "dual filter, " + std::to_string(DualFilterIterations(blurStrength)) + " iterations"
+			                                      : std::string("Gaussian, ") + BlurTechniqueName(gSceneEffects.GaussianBlurTechnique()))
+			       << (gBlurSelector.Calibrated() ? (gBlurSelector.Measured() ? " (calibrated)" : " (calibration cached)") : " (not calibrated)")
+			       << "\n";
+			if (Retro)
+			{
+				report << "Retro: " << (lowResolutionRetro ? "rendered at " + std::to_string(sceneWidth) + "x" + std::to_string(sceneHeight)
+				                                           : std::string("pixellated at full resolution"))
+				       << (colourLut ? ", colour LUT built " + std::to_string(gColourLut.NumBuilds()) + " times" : std::string()) << "\n";
+			}
+			if (gFrameLimiter.FrameRate() > 0)
+			{
+				report << "Frame rate cap: " << gFrameLimiter.FrameRate() << "fps, pacing error "
+				       << gFrameLimiter.AveragePacingError() << "ms average, " << gFrameLimiter.MaxPacingError() << "ms worst\n";
+			}
+			if (gSharedOutput.Sharing())
+			{
+				report << "Shared output: " << gSharedOutput.Name() << ", " << gSharedOutput.NumShared() << " frames shared, "
+				       << gSharedOutput.NumSkipped() << " skipped while a consumer held the texture\n";
+			}
+			if (gMetricsServer.Running())
+			{
+				report << "Metrics server: " << gMetricsServer.NumRequests() << " requests served\n";
+			}
+			if (gFrameCapture.Capturing())
+			{
+				report << "Frame capture: " << gFrameCapture.NumCaptured() << " frames to " << gFrameCapture.Destination() << ", "
+				       << gFrameCapture.NumWritten() << " written, " << gFrameCapture.NumDropped() << " dropped\n";
+			}
+			report << "Shading: " << (deferredShading ? "deferred" : "forward") << "\n";
+			report << "Material arrays: " << (!materialArrays ? "off" : !instancedRendering ? "on, unused without instancing" :
+			                                  materialArraysFailed ? "failed, instanced by texture" :
+			                                  std::to_string(gMaterialArrays.NumPacked()) + " textures packed in " +
+			                                  std::to_string(gMaterialArrays.NumArrays()) + " arrays") << "\n";
+			report << "Static batches: " << (!staticBatching ? "off" : std::to_string(gStaticBatches.NumBatches()) + " batches from " +
+			                                 std::to_string(gStaticBatches.NumModels()) + " models, " + std::to_string(staticBatchesDrawn) +
+			                                 " drawn, " + std::to_string(gStaticBatches.NumVertices()) + " vertices") << "\n";
+			report << "Sky: " << (!skyPass ? "star sphere mesh" : !gSky.Loaded() ? "star sphere mesh, cubemap unavailable" :
+			                      "full screen pass, " + std::to_string(gSky.FaceSize()) + " pixel cubemap faces") << "\n";
+			report << "Light assignment: " << (!objectLights ? "clusters" : instancedRendering || deferredShading ?
+			                                   "per-object, unused with instancing or deferred shading" :
+			                                   "per-object, up to " + std::to_string(MAX_OBJECT_LIGHTS) + " lights per model") << "\n";
+			report << "Shadows: " << (!shadows ? "off" : !gShadowMaps.Enabled() ? "unavailable" :
+			                          std::to_string(gShadowMaps.NumLights()) + " lights, " + std::to_string(gShadowMaps.FaceSize()) +
+			                          " pixel faces, " + std::to_string(gShadowMaps.NumCacheUpdates()) + " caches redrawn (" +
+			                          std::to_string(gShadowMaps.NumStaticDraws()) + " static draws), " +
+			                          std::to_string(gShadowMaps.NumDynamicDraws()) + " dynamic draws") << "\n";
+			report << "Job system: " << gJobSystem.NumThreads() << " worker threads, " << gDeferredRenderer.NumThreads()
+			       << " recording contexts\n";
+			if (!gStressModels.empty() || numStressLights > 0)
+			{
+				report << "Stress scene: " << gStressModels.size() << " models, " << numStressLights << " lights, "
+				       << (stressGrid ? "grid" : "random") << (stressAnimated ? ", animated" : ", static");
+				if (!gStressAnimators.empty())  report << ", " << gStressAnimators.size() << " playing clips";
+				report << "\n";
+			}
+			report << "Object pools: " << gModelPool.Size() << " models (" << gModelPool.Capacity() << " slots), " << gMeshPool.Size()
+			       << " meshes (" << gMeshPool.Capacity() << " slots)\n";
+			report << "Scene tree: " << gSceneTree.NumModels() << " models, height " << gSceneTree.Height() << "\n";
+			report << "Frustum culling: " << modelsCulled << " of " << modelsConsidered << " models culled"
+			       << (frustumCulling ? "" : " (off)") << "\n";
+			if (occlusionCulling)
+			{
+				report << "Occlusion culling: " << gOcclusionCuller.NumSoftwareCulled() << " culled on the CPU, "
+				       << gOcclusionCuller.NumQueryCulled() << " by query results, " << gOcclusionCuller.NumPredicated()
+				       << " predicated, " << gOcclusionCuller.NumQueried() << " queries\n";
+			}
+			report << "Particles: " << gParticleSystem.NumParticles() << " from " << gParticleSystem.NumEmitters() << " emitters"
+			       << (particles ? (particleSorting ? ", sorted" : ", unsorted") : " (off)") << "\n";
+			if (gDynamicResolution.Enabled())
+			{
+				report << "Dynamic resolution: " << sceneWidth << "x" << sceneHeight << " (" << gDynamicResolution.Scale() * 100.0f << "%, ";
+				if (gDynamicResolution.Fixed())  report << "fixed";
+				else                             report << "budget " << gDynamicResolution.Budget() << "ms";
+				report << "), ";
+				if (spatialUpscale)  report << "edge-adaptive upscale, sharpness " << upscaleSharpness << "\n";
+				else                 report << "bilinear upscale\n";
+			}
+			if (multiViews > 1)
+			{
+				report << "Multi-view: " << multiViews << " views of " << std::max(sceneWidth / multiViews, 1) << "x" << sceneHeight << ", "
+				       << (multiViewSeparation > 0 ? std::to_string(multiViewSeparation) + " apart" : std::string("panorama"))
+				       << ", recorded once\n";
+			}
+			if (gOutputWindows.NumWindows() > 0)
+			{
+				report << "Output windows: " << gOutputWindows.NumWindows() << ", drawn at " << std::max(sceneWidth / multiViews, 1) << "x"
+				       << sceneHeight << " as more views, " << (outputWindowSeparation > 0 ? std::to_string(outputWindowSeparation) + " apart"
+				                                                                            : std::string("panorama")) << "\n";
+			}
+			if (gQualityGovernor.Enabled())
+			{
+				report << "Quality governor: budget " << gQualityGovernor.Budget() << "ms,";
+				for (int k = 0; k < gQualityGovernor.NumKnobs(); ++k)
+				{
+					report << (k > 0 ? "," : "") << " " << gQualityGovernor.KnobName(k) << " " << gQualityGovernor.Level(k) << "/"
+					       << gQualityGovernor.NumKnobLevels(k) - 1;
+				}
+				report << ", " << gQualityGovernor.NumChanges() << " changes\n";
+				if (!gQualityGovernor.Log().empty())  report << "  " << gQualityGovernor.Log().back() << "\n";
+			}
+			if (gAssetPack.IsOpen())  report << "Asset pack: " << gAssetPack.NumFound() << " files loaded from " << ASSET_PACK_FILE << "\n";
+			report << "Shader cache: " << gShaderCache.NumHits() << " hits, " << gShaderCache.NumMisses() << " misses ("
+			       << gShaderCache.HitRate() * 100.0f << "% hit rate)\n";
+			report << "Effect shaders: " << gEffectResources.NumLoaded() << " effects loaded, " << gEffectResources.NumLoading()
+			       << " loading, " << gEffectResources.NumEvictions() << " released after "
+			       << (gEffectResources.IdleTime() > 0 ? std::to_string(static_cast<int>(gEffectResources.IdleTime())) + "s idle" : std::string("never"))
+			       << (gEffectResources.NumErrors() > 0 ? ", " + std::to_string(gEffectResources.NumErrors()) + " failed" : std::string()) << "\n";
+			report << "Arenas: frame peak " << FrameArenaHighWater() / 1024 << " KB, import peak " << ImportArenaHighWater() / 1024
+			       << " KB (largest on any thread)\n";
+			if (gTextureStreamer.NumPending() > 0 || gTextureStreamer.NumErrors() > 0)
+			{
+				report << "Texture streaming: " << gTextureStreamer.NumPending() << " pending, " << gTextureStreamer.NumErrors() << " failed\n";
+			}
+			if (gTextureStreamer.NumStreamed() > 0)
+			{
+				report << "Texture mips: " << gTextureStreamer.NumStreamed() << " textures streamed, "
+				       << gTextureStreamer.ResidentBytes() / (1024 * 1024) << " of " << gTextureStreamer.Budget() / (1024 * 1024)
+				       << "MB, mip bias " << gTextureStreamer.MipBias() << "\n";
+			}
+			report << "State changes last frame: " << gStateCache.NumIssued()
+			       << " (" << gStateCache.NumFiltered() << " filtered as redundant)\n";
+			for (auto& timing : gGpuProfiler.Timings())
+			{
+				report << std::string(2 * (timing.depth + 1), ' ') << timing.name << ": " << timing.milliseconds << "ms";
+				if (timing.hasStatistics && (timing.vertexShaderInvocations > 0 || timing.pixelShaderInvocations > 0))
+				{
+					report << " (VS " << timing.vertexShaderInvocations << ", PS " << timing.pixelShaderInvocations << ", "
+					       << timing.primitives << " primitives, overdraw " << timing.overdraw << "x)";
+				}
+				report << "\n";
+			}
+			report << "CPU scopes last frame:\n" << gCpuProfiler.Report();
+			OutputDebugStringA(report.str().c_str());
+		}
+		if (showMemory)
+		{
+			const float megabyte = 1024.0f * 1024.0f;
+			std::ostringstream report;
+			report.precision(1);
+			report << std::fixed << "Video memory: " << gResourceRegistry.LocalUsage() / megabyte << "MB in use";
+			if (gResourceRegistry.LocalBudget() > 0)
+			{
+				report << " of a " << gResourceRegistry.LocalBudget() / megabyte << "MB budget, system memory "
+				       << gResourceRegistry.NonLocalUsage() / megabyte << " of " << gResourceRegistry.NonLocalBudget() / megabyte
+				       << "MB, budget changed " << gResourceRegistry.NumBudgetChanges() << " times";
+			}
+			report << "\n";
+			for (int i = 0; i < NUM_MEMORY_CATEGORIES; ++i)
+			{
+				MemoryCategory category = static_cast<MemoryCategory>(i);
+				report << "  " << ResourceRegistry::CategoryName(category) << ": " << gResourceRegistry.Bytes(category) / megabyte
+				       << "MB in " << gResourceRegistry.NumResources(category) << " resources\n";
+			}
+			report << "  Untracked: " << gResourceRegistry.UntrackedBytes() / megabyte << "MB\n";
+			report << "  Tracked total: " << gResourceRegistry.LocalBytes() / megabyte << "MB (peak "
+			       << gResourceRegistry.PeakLocalBytes() / megabyte << "MB)\n";
+			if (gTextureStreamer.NumStreamed() > 0)
+			{
+				report << "  Streamed textures: within " << gTextureStreamer.Budget() / megabyte << "MB\n";
+			}
+			OutputDebugStringA(report.str().c_str());
+		}
+		timeSinceTitleUpdate = 0;
 	}
 }
@@ -6,6 +6,10 @@
 #ifndef _SCENE_H_INCLUDED_
 #define _SCENE_H_INCLUDED_
 
+#include "CVector3.h"
+#include <d3d11.h>
+#include <string>
+
 //--------------------------------------------------------------------------------------
 // Scene Geometry and Layout
 //--------------------------------------------------------------------------------------
@@ -18,20 +22,263 @@ bool InitGeometry();
 // Returns true on success
 bool InitScene();
 
+// Recreate the window size dependent resources at the new size, after the window has been resized
+// Returns true on success
+bool ResizeScene(int width, int height);
+
 // Release the geometry resources created above
 void ReleaseResources();
 
+// True until the textures streamed in after InitGeometry have all loaded at full detail (see TextureStreamer.h)
+bool TexturesStreaming();
+
 
 //--------------------------------------------------------------------------------------
 // Scene Render and Update
 //--------------------------------------------------------------------------------------
 
-void RenderScene(float frameTime);
+// The simulation (camera, orbiting light and animated effects) runs in steps of this length whatever the frame rate,
+// so it behaves the same on every machine
+const float SIMULATION_TIME_STEP = 1.0f / 60.0f;
+
+// Pick up the state from the most recent SimulateScene for the following RenderScenes, which may be on another thread.
+// Returns the time that was passed to SimulateScene for it
+double AcquireSimulationState();
 
+// frameTime is the time passed since the last frame. interpolation (0 to 1) is how far between the acquired simulation
+// step's previous and latest state to draw the things that move
+void RenderScene(float frameTime, float interpolation);
 
-// frameTime is the time passed since the last frame
+
+// Run the post-processes switched on (see SetPostProcesses) on an image instead of the rendered scene, leaving the result
+// in the back buffer. pixels are 8-bit RGBA rows with no padding. effectTime (seconds) drives the animated effects.
+// The scene is resized to the image size first if needed. Returns false on failure (reason in gLastError)
+bool PostProcessImage(const void* pixels, int width, int height, float effectTime);
+
+
+// Handle keys toggling settings and update the window title. frameTime is the time passed since the last frame
 void UpdateScene(float frameTime);
 
+// Advance the simulation by SIMULATION_TIME_STEP, to the given time (in seconds, passed back by AcquireSimulationState).
+// Can run on its own thread alongside the rendering, but only one thread may call it
+void SimulateScene(double time);
+
+
+//--------------------------------------------------------------------------------------
+// Scene Control
+//--------------------------------------------------------------------------------------
+// Used to drive the scene from code rather than keys, e.g. by the benchmark
+
+// Post-processes that can be toggled on and off, combine as flags for SetPostProcesses
+const int POST_PROCESS_TINT          = 1 << 0;
+const int POST_PROCESS_BLUR          = 1 << 1;
+const int POST_PROCESS_GAUSSIAN_BLUR = 1 << 2;
+const int POST_PROCESS_UNDERWATER    = 1 << 3;
+const int POST_PROCESS_RETRO         = 1 << 4;
+const int POST_PROCESS_BLOOM         = 1 << 5;
+const int POST_PROCESS_STAR_FILTER   = 1 << 6;
+const int NUM_POST_PROCESS_FLAGS     = 7;
+
+// Switch on exactly the given post-processes
+void SetPostProcesses(int postProcesses);
+
+// The post-processes switched on now, as flags for SetPostProcesses. Main thread only
+int PostProcesses();
+
+// Place the main camera. Must be called on the thread calling SimulateScene
+void SetCameraPose(CVector3 position, CVector3 rotation);
+
+// Lock the frame rate to the monitor refresh rate (the P key toggles this)
+void SetLockFPS(bool lock);
+
+// Cap the frame rate in software at any rate, 0 for no cap (the O key steps through 30, 48, 60, 90 and 120)
+void SetFrameRateCap(float framesPerSecond);
+
+// Record the frames shown to a file or directory, at the frame rate cap or 60fps (see FrameCapture.h, the R key toggles a
+// capture to capture.y4m). Returns false on failure (reason in gLastError)
+bool StartFrameCapture(const std::string& destination);
+
+// Render the scene at a reduced resolution when needed to keep the GPU frame time within the budget (the F3 key toggles this)
+void SetDynamicResolution(bool enable, float budgetMilliseconds);
+
+// Draw several views side by side from cameras placed around the main one: adjacent views are the given separation apart
+// along the camera's right axis, or with no separation turned by its field of view to make a panorama. The draws are
+// prepared and recorded once for all the views. Depth-aware effects, MSAA and occlusion culling are off while there are
+// several views (the End key switches between one view and a stereo pair)
+void SetMultiView(int numViews, float separation);
+
+// Place the cameras of the output windows (see OutputWindows.h) to the right of the main camera in turn: adjacent ones the
+// given separation apart along its right axis, or with no separation turned by its field of view to carry on a panorama.
+// They are drawn as more views of the main camera's draws, so the same is off as for several views above
+void SetOutputWindowSeparation(float separation);
+
+// Lower the quality of the costliest post-processing effects when needed to keep the GPU frame time within the budget
+// (see QualityGovernor.h, the Home key toggles this)
+void SetQualityGovernor(bool enable, float budgetMilliseconds);
+
+// Number of deferred contexts recording the scene at once (each used by a job, see DeferredRenderer.h), 0 to render on
+// the main thread and negative for one for each job system thread and the main thread. Must be called before InitGeometry
+void SetRenderThreads(int numThreads);
+
+// Number of models recorded into each command list by the recording jobs, 0 or less for one list per type of model
+void SetRenderChunkSize(int chunkSize);
+
+// Load meshes with compact vertex formats and 16-bit indices where possible. Must be called before InitGeometry
+void SetCompactVertices(bool compact);
+
+// Draw models sharing a mesh and texture with instanced draw calls (the F4 key toggles this)
+void SetInstancedRendering(bool enable);
+
+// Pack the model textures into texture arrays so models with different textures share instanced draws (see
+// MaterialArrays.h, the + key toggles this)
+void SetMaterialArrays(bool enable);
+
+// Merge the static models sharing a texture into a few world space batches drawn with one call each (see
+// StaticBatches.h, the Insert key toggles this)
+void SetStaticBatching(bool enable);
+
+// Draw the sky as a full screen pass sampling a cubemap rather than as the star sphere mesh (see Sky.h, on by default,
+// the Delete key toggles this)
+void SetSkyPass(bool enable);
+
+// Light each forward shaded model with only the few lights chosen for it on the CPU rather than the light clusters (off
+// by default, the Page Up key toggles this). Not used for instanced draws or deferred shading
+void SetObjectLights(bool enable);
+
+// Cast shadows from the main lights with cached shadow cubemaps (see ShadowMaps.h, on by default, the Backspace key
+// toggles this)
+void SetShadows(bool enable);
+
+// Gather pipeline statistics (shader invocations, primitives and overdraw) for each GPU timer, shown in the F2 report and
+// recorded by benchmarks (off by default, the Page Down key toggles this)
+void SetPipelineStatistics(bool enable);
+
+// Share a few large vertex and index buffers between all meshes (see GeometryPool.h). Must be called before InitGeometry
+void SetGeometryPool(bool enable);
+
+// Draw distant models with simplified levels of detail (the F7 key toggles this)
+void SetLodSelection(bool enable);
+
+// Draw models small on screen as impostors captured from their meshes (Numpad 0 toggles this)
+void SetImpostors(bool enable);
+
+// Cull the rigid models on the GPU and draw them with indirect draws (Numpad 1 toggles this)
+void SetGpuCulling(bool enable);
+
+// Bloom by convolving with a glare kernel using FFTs, a star or the kernel in the given image file if not empty (the N
+// key toggles this)
+void SetFftBloom(bool enable, const std::string& kernelImage);
+
+// Blur the bloom only in the tiles with light in them, found on the GPU each frame (see BloomTiles.h, the T key toggles this)
+void SetBloomTiles(bool enable);
+
+// When the smooth blur passes are drawn at a reduced rate and scaled back up (see PostProcessGraph.h)
+enum class ReducedRateMode
+{
+	Off,
+	Auto,    // Half rate while dynamic resolution is struggling to stay within its budget
+	Half,
+	Quarter,
+};
+
+// Draw the smooth blur passes at a reduced rate (the Q key steps through the modes)
+void SetReducedRate(ReducedRateMode mode);
+
+// Render the scene to a texture of the given format, e.g. DXGI_FORMAT_R16G16B16A16_FLOAT or DXGI_FORMAT_R11G11B10_FLOAT
+// for HDR so the bloom sees the real brightness of highlights. Must be called before the scene texture is created
+void SetSceneFormat(DXGI_FORMAT format);
+
+// Draw the scene with 2, 4 or 8 samples per pixel, or 1 for no MSAA. Resolved by the first post-process, and only used
+// with forward shading (the Tab key steps through the sample counts)
+void SetMsaaSamples(int samples);
+
+// Anti-aliasing done on the rendered image by the post-processing, before the other effects (see EffectChain.h)
+enum class PostAntiAliasing
+{
+	Off,
+	Fxaa,
+	Smaa,
+};
+
+// Anti-alias the scene's image with FXAA or SMAA (the K key steps through the modes)
+void SetPostAntiAliasing(PostAntiAliasing mode);
+
+// Upscale a reduced resolution scene along its edges and sharpen it by the given amount (0 to 1), rather than stretching
+// it with bilinear filtering (the Numpad 2 key toggles this)
+void SetSpatialUpscale(bool enable, float sharpness);
+
+// Render the scene at a fixed fraction of the window's width and height and upscale it, 1 for full resolution. Replaces
+// dynamic resolution
+void SetRenderScale(float scale);
+
+// Compute the Gaussian blur and bloom at reduced size and blend them with the previous frame, reprojected with the depth
+// buffer (see TemporalHistory.h, the F12 key toggles this)
+void SetTemporalEffects(bool enable);
+
+// Blur with the cheaper dual filter (Kawase) blur for the Gaussian blur and bloom (the J key toggles this)
+void SetDualFilterBlur(bool enable);
+
+// Render the scene at one pixel per retro block when retro is on, and enlarge it after the colour effects, rather than
+// pixellating the full resolution image (the M key toggles this)
+void SetLowResolutionRetro(bool enable);
+
+// Reduce retro's colour depth with a single fetch from a 3D colour grading LUT, rebuilt only when the colour depth
+// changes (the H key toggles this)
+void SetColourLut(bool enable);
+
+// Run the post-processes that have compute versions as compute shaders writing UAVs, with thread groups sized for this GPU
+// (see EffectChain.h and ComputeTuner.h, the E key toggles this)
+void SetComputePostProcessing(bool enable);
+
+// Do the colour maths of the fused colour effects, bloom bright filter and combine and Gaussian blurs in min16float on
+// GPUs with 16-bit shader arithmetic (see EffectChain.h). On by default, the Numpad 3 key toggles this
+void SetHalfPrecisionEffects(bool enable);
+
+// Most frames the CPU may record ahead of the GPU, 1 (lowest latency) to 3 (most overlap, the default). Each frame waits
+// for the GPU to finish the frame that many before it, the time waited is the CPU stall in the F2 report (see
+// FramePipeline.h). The Numpad 4 key cycles through them
+void SetFramesInFlight(int frames);
+
+// Adapt the exposure of the post-processed image to its brightness, measured on the GPU (the X key toggles this)
+void SetAutoExposure(bool enable);
+
+// Replay the models that never move and the sky from command lists recorded once, and again only when they change (the
+// C key toggles this). Needs render threads, see SetRenderThreads
+void SetStaticCommandLists(bool enable);
+
+// Reuse the last frame, or the scene it rendered, while nothing they depend on changes (see FrameCache.h, the Z key
+// toggles this)
+void SetFrameCaching(bool enable);
+
+// Lay down the depth of the opaque models before lighting them, so overlapped pixels are only lit once (the F8 key toggles this)
+void SetDepthPrePass(bool enable);
+
+// Light the opaque models with deferred shading rather than forward lighting (the F9 key toggles this)
+void SetDeferredShading(bool enable);
+
+// Scatter the given number of small lights around the scene as well as the two main lights. Call before InitScene
+void SetExtraLights(int numLights);
+
+// Skip models hidden behind others with occlusion queries and a software depth test (the U key toggles this)
+void SetOcclusionCulling(bool enable);
+
+// Number of GPU particles shared between the smoke and fire emitters (the I key toggles them). Call before InitScene
+void SetParticles(int count);
+
+// Sort the particles back to front on the GPU for each camera (on by default, the Y key toggles it)
+void SetParticleSorting(bool enable);
+
+// Stress scene for scale testing: add this many models (copies of the crate, cube, teapot, sphere and troll meshes) and
+// lights, laid out in a grid or at random around the middle of the scene. Animated models spin and bob up and down
+// every frame. Call before InitGeometry, which only loads the extra meshes when there are stress models
+void SetStressScene(int numModels, int numLights, bool grid, bool animated);
+
+// Keep the model textures whose mip levels are streamed within this many megabytes (see TextureStreamer.h)
+void SetTextureBudget(int megabytes);
+
+// Release the shaders of an effect once it has been off for this many seconds, 0 to keep them (see EffectResources.h)
+void SetEffectIdleTime(int seconds);
+
 
 
 
@@ -0,0 +1,407 @@
+//--------------------------------------------------------------------------------------
+// Scene tree
+//--------------------------------------------------------------------------------------
+
+#include "SceneTree.h"
+#include "Model.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <limits>
+
+
+SceneTree gSceneTree;
+
+const float SceneTree::BOX_MARGIN = 0.1f;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+void SceneTree::Insert(Model* model)
+{
+	if (mEntryIndices.count(model))  return;
+
+	Entry entry = { model, NO_NODE, model->Version(), model->WorldBoundingBox() };
+	int entryIndex = static_cast<int>(mEntries.size());
+	if (!model->GetMesh()->HasBones())
+	{
+		entry.leaf = AllocateNode();
+		mNodes[entry.leaf].box   = EnlargedBox(entry.box);
+		mNodes[entry.leaf].entry = entryIndex;
+		InsertLeaf(entry.leaf);
+	}
+	mEntries.push_back(entry);
+	mEntryIndices[model] = entryIndex;
+}
+
+
+void SceneTree::Remove(Model* model)
+{
+	auto found = mEntryIndices.find(model);
+	if (found == mEntryIndices.end())  return;
+	int entryIndex = found->second;
+	mEntryIndices.erase(found);
+
+	if (mEntries[entryIndex].leaf != NO_NODE)
+	{
+		RemoveLeaf(mEntries[entryIndex].leaf);
+		FreeNode(mEntries[entryIndex].leaf);
+	}
+
+	// Move the last entry into the gap
+	if (entryIndex != static_cast<int>(mEntries.size()) - 1)
+	{
+		mEntries[entryIndex] = mEntries.back();
+		mEntryIndices[mEntries[entryIndex].model] = entryIndex;
+		if (mEntries[entryIndex].leaf != NO_NODE)  mNodes[mEntries[entryIndex].leaf].entry = entryIndex;
+	}
+	mEntries.pop_back();
+}
+
+
+void SceneTree::Clear()
+{
+	mNodes.clear();
+	mRoot = NO_NODE;
+	mFreeList = NO_NODE;
+	mEntries.clear();
+	mEntryIndices.clear();
+}
+
+
+// Update the tree for any models that have moved since the last update
+void SceneTree::Update()
+{
+	for (auto& entry : mEntries)
+	{
+		unsigned int version = entry.model->Version();
+		if (version == entry.version)  continue;
+		entry.version = version;
+		entry.box = entry.model->WorldBoundingBox();
+
+		// Only reinsert when the model has moved outside its enlarged box
+		if (entry.leaf != NO_NODE && !Contains(mNodes[entry.leaf].box, entry.box))
+		{
+			RemoveLeaf(entry.leaf);
+			mNodes[entry.leaf].box = EnlargedBox(entry.box);
+			InsertLeaf(entry.leaf);
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Queries
+//--------------------------------------------------------------------------------------
+
+void SceneTree::QueryFrustum(const Frustum& frustum, std::vector<Model*>& results)
+{
+	for (auto& entry : mEntries)
+	{
+		if (entry.leaf == NO_NODE)  results.push_back(entry.model);
+	}
+	if (mRoot == NO_NODE)  return;
+
+	thread_local std::vector<int> stack; // Kept between queries so it doesn't allocate each time
+	stack.clear();
+	stack.push_back(mRoot);
+	while (!stack.empty())
+	{
+		int node = stack.back();
+		stack.pop_back();
+
+		FrustumTest test = TestFrustum(frustum, mNodes[node].box);
+		if (test == FrustumTest::Outside)  continue;
+		if (test == FrustumTest::Inside)
+		{
+			AddSubtree(node, results); // No need to test anything below here
+		}
+		else if (IsLeaf(node))
+		{
+			// The leaf box is enlarged so test the exact box too
+			const Entry& entry = mEntries[mNodes[node].entry];
+			if (TestFrustum(frustum, entry.box) != FrustumTest::Outside)  results.push_back(entry.model);
+		}
+		else
+		{
+			stack.push_back(mNodes[node].child1);
+			stack.push_back(mNodes[node].child2);
+		}
+	}
+}
+
+
+void SceneTree::QuerySphere(const CVector3& centre, float radius, std::vector<Model*>& results)
+{
+	for (auto& entry : mEntries)
+	{
+		if (entry.leaf == NO_NODE)  results.push_back(entry.model);
+	}
+	if (mRoot == NO_NODE)  return;
+
+	thread_local std::vector<int> stack;
+	stack.clear();
+	stack.push_back(mRoot);
+	while (!stack.empty())
+	{
+		int node = stack.back();
+		stack.pop_back();
+		if (!Overlaps(mNodes[node].box, centre, radius))  continue;
+
+		if (IsLeaf(node))
+		{
+			const Entry& entry = mEntries[mNodes[node].entry];
+			if (Overlaps(entry.box, centre, radius))  results.push_back(entry.model);
+		}
+		else
+		{
+			stack.push_back(mNodes[node].child1);
+			stack.push_back(mNodes[node].child2);
+		}
+	}
+}
+
+
+bool SceneTree::Raycast(const CVector3& origin, const CVector3& direction, float maxDistance, Model*& hitModel, float& hitDistance)
+{
+	if (mRoot == NO_NODE)  return false;
+
+	// Division by zero gives infinity, which the ray-box test expects for rays parallel to an axis
+	CVector3 inverseDirection = { 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+	hitModel = nullptr;
+	hitDistance = maxDistance;
+
+	thread_local std::vector<int> stack;
+	stack.clear();
+	stack.push_back(mRoot);
+	while (!stack.empty())
+	{
+		int node = stack.back();
+		stack.pop_back();
+
+		// Anything further than the nearest hit so far can be skipped
+		float distance;
+		if (!IntersectRay(mNodes[node].box, origin, inverseDirection, hitDistance, distance))  continue;
+
+		if (IsLeaf(node))
+		{
+			const Entry& entry = mEntries[mNodes[node].entry];
+			if (IntersectRay(entry.box, origin, inverseDirection, hitDistance, distance))
+			{
+				hitModel = entry.model;
+				hitDistance = distance;
+			}
+		}
+		else
+		{
+			stack.push_back(mNodes[node].child1);
+			stack.push_back(mNodes[node].child2);
+		}
+	}
+	return hitModel != nullptr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+int SceneTree::AllocateNode()
+{
+	int node;
+	if (mFreeList != NO_NODE)
+	{
+		node = mFreeList;
+		mFreeList = mNodes[node].parent;
+	}
+	else
+	{
+		node = static_cast<int>(mNodes.size());
+		mNodes.emplace_back();
+	}
+	mNodes[node].parent = NO_NODE;
+	mNodes[node].child1 = NO_NODE;
+	mNodes[node].child2 = NO_NODE;
+	mNodes[node].height = 0;
+	mNodes[node].entry  = -1;
+	return node;
+}
+
+void SceneTree::FreeNode(int node)
+{
+	mNodes[node].parent = mFreeList;
+	mNodes[node].height = -1;
+	mFreeList = node;
+}
+
+
+BoundingBox SceneTree::EnlargedBox(const BoundingBox& box)
+{
+	CVector3 size = box.maximum - box.minimum;
+	float margin = BOX_MARGIN * std::max(size.x, std::max(size.y, size.z));
+	CVector3 enlarge = { margin, margin, margin };
+	return { box.minimum - enlarge, box.maximum + enlarge };
+}
+
+
+// Find the best sibling for the new leaf by walking down from the root, choosing the child that increases the total box
+// area the least. Stop when pairing with the current node is cheaper than going further down
+void SceneTree::InsertLeaf(int leaf)
+{
+	if (mRoot == NO_NODE)
+	{
+		mRoot = leaf;
+		mNodes[leaf].parent = NO_NODE;
+		return;
+	}
+
+	BoundingBox leafBox = mNodes[leaf].box;
+	int sibling = mRoot;
+	while (!IsLeaf(sibling))
+	{
+		int child1 = mNodes[sibling].child1;
+		int child2 = mNodes[sibling].child2;
+
+		float area = mNodes[sibling].box.HalfArea();
+		float combinedArea = Union(mNodes[sibling].box, leafBox).HalfArea();
+
+		// Cost of making a new parent for this node and the leaf, and the cost pushed down to children (every ancestor
+		// of the leaf grows to contain it)
+		float cost = 2.0f * combinedArea;
+		float inheritedCost = 2.0f * (combinedArea - area);
+
+		float cost1 = Union(mNodes[child1].box, leafBox).HalfArea() + inheritedCost;
+		if (!IsLeaf(child1))  cost1 -= mNodes[child1].box.HalfArea();
+		float cost2 = Union(mNodes[child2].box, leafBox).HalfArea() + inheritedCost;
+		if (!IsLeaf(child2))  cost2 -= mNodes[child2].box.HalfArea();
+
+		if (cost < cost1 && cost < cost2)  break;
+		sibling = (cost1 < cost2 ? child1 : child2);
+	}
+
+	// Make a new parent for the sibling and the leaf
+	int oldParent = mNodes[sibling].parent;
+	int newParent = AllocateNode();
+	mNodes[newParent].parent = oldParent;
+	mNodes[newParent].box    = Union(leafBox, mNodes[sibling].box);
+	mNodes[newParent].height = mNodes[sibling].height + 1;
+	mNodes[newParent].child1 = sibling;
+	mNodes[newParent].child2 = leaf;
+	mNodes[sibling].parent = newParent;
+	mNodes[leaf].parent    = newParent;
+
+	if (oldParent == NO_NODE)
+	{
+		mRoot = newParent;
+	}
+	else
+	{
+		if (mNodes[oldParent].child1 == sibling)  mNodes[oldParent].child1 = newParent;
+		else                                      mNodes[oldParent].child2 = newParent;
+	}
+
+	RefitAncestors(mNodes[leaf].parent);
+}
+
+
+// Remove a leaf from the tree (the leaf node itself is kept). Its sibling takes the place of their parent
+void SceneTree::RemoveLeaf(int leaf)
+{
+	if (leaf == mRoot)
+	{
+		mRoot = NO_NODE;
+		return;
+	}
+
+	int parent      = mNodes[leaf].parent;
+	int grandParent = mNodes[parent].parent;
+	int sibling     = (mNodes[parent].child1 == leaf ? mNodes[parent].child2 : mNodes[parent].child1);
+
+	mNodes[sibling].parent = grandParent;
+	FreeNode(parent);
+	if (grandParent == NO_NODE)
+	{
+		mRoot = sibling;
+	}
+	else
+	{
+		if (mNodes[grandParent].child1 == parent)  mNodes[grandParent].child1 = sibling;
+		else                                       mNodes[grandParent].child2 = sibling;
+		RefitAncestors(grandParent);
+	}
+	mNodes[leaf].parent = NO_NODE;
+}
+
+
+// Rotate the tree at node A if one child is more than a level taller than the other. The taller child takes A's
+// place and A takes the shorter of that child's two children, the taller grandchild staying where it was
+int SceneTree::Balance(int a)
+{
+	if (IsLeaf(a) || mNodes[a].height < 2)  return a;
+
+	int b = mNodes[a].child1;
+	int c = mNodes[a].child2;
+	int balance = mNodes[c].height - mNodes[b].height;
+	if (balance >= -1 && balance <= 1)  return a;
+
+	// Rotate the taller child up. The code is the same for both sides, so pick out which is which
+	bool rightTaller = balance > 1;
+	int up    = rightTaller ? c : b; // Taller child, moves into A's position
+	int other = rightTaller ? b : c; // Shorter child, stays under A
+	int f = mNodes[up].child1;
+	int g = mNodes[up].child2;
+
+	// Up replaces A in A's parent
+	mNodes[up].parent = mNodes[a].parent;
+	mNodes[a].parent = up;
+	if (mNodes[up].parent == NO_NODE)                    mRoot = up;
+	else if (mNodes[mNodes[up].parent].child1 == a)      mNodes[mNodes[up].parent].child1 = up;
+	else                                                 mNodes[mNodes[up].parent].child2 = up;
+
+	// The taller grandchild stays under Up along with A, and A takes the shorter grandchild in Up's old place
+	int keep = (mNodes[f].height > mNodes[g].height ? f : g);
+	int move = (keep == f ? g : f);
+	mNodes[up].child1 = a;
+	mNodes[up].child2 = keep;
+	if (rightTaller)  mNodes[a].child2 = move;
+	else              mNodes[a].child1 = move;
+	mNodes[move].parent = a;
+
+	mNodes[a].box     = Union(mNodes[other].box, mNodes[move].box);
+	mNodes[a].height  = 1 + std::max(mNodes[other].height, mNodes[move].height);
+	mNodes[up].box    = Union(mNodes[a].box, mNodes[keep].box);
+	mNodes[up].height = 1 + std::max(mNodes[a].height, mNodes[keep].height);
+	return up;
+}
+
+
+// Walk up from a node, rebalancing and refitting boxes and heights
+void SceneTree::RefitAncestors(int node)
+{
+	while (node != NO_NODE)
+	{
+		node = Balance(node);
+
+		int child1 = mNodes[node].child1;
+		int child2 = mNodes[node].child2;
+		mNodes[node].height = 1 + std::max(mNodes[child1].height, mNodes[child2].height);
+		mNodes[node].box    = Union(mNodes[child1].box, mNodes[child2].box);
+
+		node = mNodes[node].parent;
+	}
+}
+
+
+// Add every model in the subtree, used once a node is known to be entirely inside a query
+void SceneTree::AddSubtree(int node, std::vector<Model*>& results)
+{
+	if (IsLeaf(node))
+	{
+		results.push_back(mEntries[mNodes[node].entry].model);
+		return;
+	}
+	AddSubtree(mNodes[node].child1, results);
+	AddSubtree(mNodes[node].child2, results);
+}
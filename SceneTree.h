@@ -0,0 +1,122 @@
+//--------------------------------------------------------------------------------------
+// Scene tree
+//--------------------------------------------------------------------------------------
+// Holds the models in the scene in a bounding volume hierarchy, so frustum, sphere and ray queries only visit the parts
+// of the scene near what they are looking for rather than testing every model. The tree is a dynamic AABB tree: each
+// model is a leaf with a slightly enlarged world space box, and each internal node's box encloses its two children.
+// Leaves are placed to keep the total box area low and the tree is kept balanced with rotations as it changes.
+//
+// Models that move are found by their version number (see Model::Version) when Update is called. A model is only
+// reinserted when it has moved outside its enlarged box, so small movements cost nothing more than updating its own box.
+// Skinned models can't be bounded (their bones can move the vertices anywhere) so they are held outside the tree and
+// always returned by frustum and sphere queries. Ray queries ignore them.
+
+#ifndef _SCENE_TREE_H_INCLUDED_
+#define _SCENE_TREE_H_INCLUDED_
+
+#include "Bounds.h"
+
+#include <unordered_map>
+#include <vector>
+
+class Model;
+
+
+class SceneTree
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Add or remove a model. The tree doesn't own the models, remove them (or Clear) before they are deleted
+	void Insert(Model* model);
+	void Remove(Model* model);
+	void Clear();
+
+	// Update the tree for any models that have moved since the last update. Call before querying each frame
+	void Update();
+
+
+	// Add the models that are at least partly inside the frustum to the results. Models just outside a corner of the
+	// frustum may also be included
+	void QueryFrustum(const Frustum& frustum, std::vector<Model*>& results);
+
+	// Add the models whose bounds overlap the sphere to the results
+	void QuerySphere(const CVector3& centre, float radius, std::vector<Model*>& results);
+
+	// Find the nearest model whose bounds are hit by a ray within the given distance, which is in multiples of the
+	// direction (that doesn't need to be normalised). Returns false if nothing is hit
+	bool Raycast(const CVector3& origin, const CVector3& direction, float maxDistance, Model*& hitModel, float& hitDistance);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	int NumModels()  { return static_cast<int>(mEntries.size()); }
+	int Height()     { return mRoot == NO_NODE ? 0 : mNodes[mRoot].height + 1; } // Number of levels in the tree
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const int NO_NODE = -1;
+
+	// Leaf boxes are enlarged by this fraction of their largest dimension on each side, so models can move a little
+	// without being reinserted
+	static const float BOX_MARGIN;
+
+	struct Node
+	{
+		BoundingBox box;
+		int         parent; // Next free node when the node is on the free list
+		int         child1; // NO_NODE for leaves
+		int         child2;
+		int         height; // 0 for leaves
+		int         entry;  // Index into mEntries for leaves
+	};
+
+	struct Entry
+	{
+		Model*       model;
+		int          leaf;    // NO_NODE for models held outside the tree
+		unsigned int version; // Model version when the box was last updated
+		BoundingBox  box;     // Exact world bounds, the leaf box is enlarged
+	};
+
+	bool IsLeaf(int node)  { return mNodes[node].child1 == NO_NODE; }
+
+	int  AllocateNode();
+	void FreeNode(int node);
+
+	BoundingBox EnlargedBox(const BoundingBox& box);
+
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+
+	// Rotate the tree at the given node if one side is more than a level taller than the other. Returns the node that
+	// is now at this position
+	int Balance(int node);
+
+	// Walk up from a node, rebalancing and refitting boxes and heights
+	void RefitAncestors(int node);
+
+	// Add every model in the subtree, used once a node is known to be entirely inside a query
+	void AddSubtree(int node, std::vector<Model*>& results);
+
+
+	std::vector<Node>  mNodes;
+	int                mRoot     = NO_NODE;
+	int                mFreeList = NO_NODE;
+
+	std::vector<Entry>              mEntries;
+	std::unordered_map<Model*, int> mEntryIndices; // Model to index in mEntries
+};
+
+
+extern SceneTree gSceneTree;
+
+
+#endif //_SCENE_TREE_H_INCLUDED_
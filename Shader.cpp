@@ -4,10 +4,21 @@
 //--------------------------------------------------------------------------------------
 
 #include "Shader.h"
+#include "ResourceRegistry.h"
 #include "Common.h"
+#include "ShaderLibrary.h"
+#include "ShaderReloader.h"
+#include "ShaderCache.h"
+#include "ShaderBindings.h"
+#include "AssetPack.h"
+#include "EffectResources.h"
+#include "StartupProfiler.h"
 #include <d3dcompiler.h>
 #include <fstream>
 #include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
 
 //--------------------------------------------------------------------------------------
 // Global Variables
@@ -21,24 +32,108 @@ ID3D11VertexShader*   gPixelLightingVertexShader    = nullptr;
 ID3D11PixelShader*    gTintedTexturePixelShader     = nullptr;
 ID3D11PixelShader*    gPixelLightingPixelShader     = nullptr;
 
+ID3D11VertexShader*   gBasicTransformInstancedVertexShader = nullptr;
+ID3D11VertexShader*   gPixelLightingInstancedVertexShader  = nullptr;
+ID3D11PixelShader*    gTintedTextureInstancedPixelShader   = nullptr;
+
+ID3D11VertexShader*   gDepthOnlyVertexShader          = nullptr;
+ID3D11VertexShader*   gDepthOnlyInstancedVertexShader = nullptr;
+
+ID3D11PixelShader*    gGBufferPixelShader          = nullptr;
+ID3D11PixelShader*    gDeferredLightingPixelShader = nullptr;
+
+ID3D11PixelShader*    gDepthResolvePixelShader = nullptr;
+
+ID3D11VertexShader*   gSkinningVertexShader    = nullptr;
+ID3D11GeometryShader* gSkinningStreamOutShader = nullptr;
+ID3D11VertexShader*   gStaticBakeVertexShader    = nullptr;
+ID3D11GeometryShader* gStaticBakeStreamOutShader = nullptr;
+
+ID3D11VertexShader*   gParticleVertexShader = nullptr;
+ID3D11PixelShader*    gParticlePixelShader  = nullptr;
+
+ID3D11VertexShader*   gSkyVertexShader = nullptr;
+ID3D11PixelShader*    gSkyPixelShader  = nullptr;
+
+ID3D11VertexShader*   gLightFlareVertexShader = nullptr;
+
+ID3D11VertexShader*   gImpostorVertexShader       = nullptr;
+ID3D11PixelShader*    gImpostorPixelShader        = nullptr;
+ID3D11PixelShader*    gImpostorCapturePixelShader = nullptr;
+
 
 //*******************************
 //**** Post-processing shader DirectX objects
 // These are also added to Shader.h
 ID3D11VertexShader* gFullScreenQuadVertexShader = nullptr;
-ID3D11PixelShader*  gTintPostProcess = nullptr;
+ID3D11VertexShader* gPostProcessVertexShader    = nullptr; // Owned by the permutation cache
 
 ID3D11PixelShader*  gBlur_PostProcess = nullptr;
 ID3D11PixelShader*  gPyramidBlur_PostProcess = nullptr;
 ID3D11PixelShader*  gGaussianBlurH_PostProcess = nullptr;
 ID3D11PixelShader*  gGaussianBlurV_PostProcess = nullptr;
 ID3D11PixelShader*  gCopy_PostProcess = nullptr;
-ID3D11PixelShader*  gPixellate_PostProcess = nullptr;
-ID3D11PixelShader*  gBitColour_PostProcess = nullptr;
-ID3D11PixelShader*  gBrightFilter_PostProcess = nullptr;
-ID3D11PixelShader*  gUnderwater_PostProcess = nullptr;
-ID3D11PixelShader*  gNoise_PostProcess = nullptr;
 ID3D11PixelShader*  gCombine_PostProcess = nullptr;
+ID3D11PixelShader*  gBloomDownsample_PostProcess = nullptr;
+ID3D11PixelShader*  gBloomBlur_PostProcess = nullptr;
+ID3D11PixelShader*  gBloomUpsample_PostProcess = nullptr;
+ID3D11PixelShader*  gProfilerOverlay_PostProcess = nullptr;
+ID3D11PixelShader*  gUpscale_PostProcess = nullptr;
+ID3D11PixelShader*  gExposure_PostProcess = nullptr;
+ID3D11PixelShader*  gDualFilterDownsample_PostProcess = nullptr;
+ID3D11PixelShader*  gDualFilterUpsample_PostProcess = nullptr;
+ID3D11PixelShader*  gFftBloomPack_PostProcess = nullptr;
+ID3D11PixelShader*  gFftBloomCombine_PostProcess = nullptr;
+ID3D11PixelShader*  gStarStreak_PostProcess = nullptr;
+ID3D11PixelShader*  gPyramidBlurMips_PostProcess = nullptr;
+ID3D11PixelShader*  gDepthOfFieldDownsample_PostProcess = nullptr;
+ID3D11PixelShader*  gDepthOfFieldBlur_PostProcess = nullptr;
+ID3D11PixelShader*  gDepthOfFieldCombine_PostProcess = nullptr;
+ID3D11PixelShader*  gFxaa_PostProcess = nullptr;
+ID3D11PixelShader*  gSmaaEdges_PostProcess = nullptr;
+ID3D11PixelShader*  gSmaaWeights_PostProcess = nullptr;
+ID3D11PixelShader*  gSmaaBlend_PostProcess = nullptr;
+ID3D11PixelShader*  gFog_PostProcess = nullptr;
+ID3D11PixelShader*  gReducedRateReconstruct_PostProcess = nullptr;
+ID3D11PixelShader*  gTemporalResolve_PostProcess = nullptr;
+
+ID3D11ComputeShader* gGaussianBlurH_Compute = nullptr;
+ID3D11ComputeShader* gGaussianBlurV_Compute = nullptr;
+ID3D11ComputeShader* gSummedAreaTableRows_Compute = nullptr;
+ID3D11ComputeShader* gSummedAreaTableColumns_Compute = nullptr;
+ID3D11ComputeShader* gBloomTiles_Compute = nullptr;
+ID3D11ComputeShader* gBloomTileBlur_Compute = nullptr;
+ID3D11ComputeShader* gSpatialUpscale_Compute = nullptr;
+ID3D11ComputeShader* gSharpen_Compute = nullptr;
+ID3D11ComputeShader* gClusterLights_Compute = nullptr;
+ID3D11ComputeShader* gLuminanceHistogram_Compute = nullptr;
+ID3D11ComputeShader* gAutoExposure_Compute = nullptr;
+ID3D11ComputeShader* gColourLut_Compute = nullptr;
+ID3D11ComputeShader* gParticles_Compute = nullptr;
+ID3D11ComputeShader* gParticleSortKeys_Compute = nullptr;
+ID3D11ComputeShader* gBitonicSortBlock_Compute = nullptr;
+ID3D11ComputeShader* gBitonicSortStep_Compute = nullptr;
+ID3D11ComputeShader* gHiZ_Compute = nullptr;
+ID3D11ComputeShader* gGpuCull_Compute = nullptr;
+ID3D11ComputeShader* gGpuCullArgs_Compute = nullptr;
+
+// Shader permutations compiled so far, keyed by shader name and defines (see PermutationKey)
+std::map<std::string, ID3D11VertexShader*>  gVertexShaderPermutations;
+std::map<std::string, ID3D11PixelShader*>   gPixelShaderPermutations;
+std::map<std::string, ID3D11ComputeShader*> gComputeShaderPermutations;
+
+// Whether the device has 16-bit shader maths (see HalfPrecisionSupported), -1 until asked. And the half precision
+// permutations that failed to compile, so they aren't tried again every frame
+int                   gHalfPrecisionSupport = -1;
+std::set<std::string> gHalfPrecisionFailures;
+
+// All the compiled shaders packed into one memory-mapped file, see ShaderLibrary.h. If the library is missing (e.g. the
+// project has just been built, which deletes it) or doesn't hold a shader, the shader's .cso file is read instead and the
+// library is rewritten with everything loaded, so the next run opens one file rather than one per shader
+const char*   SHADER_LIBRARY_FILE = "Shaders.shlib";
+ShaderLibrary gShaderLibrary;
+ShaderLibrary::ShaderList gLooseShaders;       // Bytecode read from .cso files while loading
+std::vector<std::string>  gLibraryShadersUsed; // Shaders found in the library while loading
 
 
 
@@ -52,141 +147,462 @@ bool LoadShaders()
 	// Shaders must be added to the Visual Studio project to be compiled, they use the extension ".hlsl".
 	// To load them for use, include them here without the extension. Use the correct function for each.
 	// Ensure you release the shaders in the ShutdownDirect3D function below
+	gLastError.clear();
+
+	// Shaders are checked against the C++ constant buffer structures as they are loaded
+	gShaderBindings.DeclareConstantBuffer("PerFrameConstants",        PER_FRAME_CONSTANTS_SLOT,        sizeof(PerFrameConstants));
+	gShaderBindings.DeclareConstantBuffer("PerModelConstants",        PER_MODEL_CONSTANTS_SLOT,        sizeof(PerModelConstants));
+	gShaderBindings.DeclareConstantBuffer("PostProcessingConstants",  POST_PROCESSING_CONSTANTS_SLOT,  sizeof(PostProcessingConstants));
+	gShaderBindings.DeclareConstantBuffer("BlurKernelConstants",      BLUR_KERNEL_CONSTANTS_SLOT,      sizeof(BlurKernelConstants));
+	gShaderBindings.DeclareConstantBuffer("ProfilerOverlayConstants", PROFILER_OVERLAY_CONSTANTS_SLOT, sizeof(ProfilerOverlayConstants));
+	gShaderBindings.DeclareConstantBuffer("SkeletonConstants",        SKELETON_CONSTANTS_SLOT,         sizeof(SkeletonConstants));
+	gShaderBindings.DeclareConstantBuffer("AutoExposureConstants",    AUTO_EXPOSURE_CONSTANTS_SLOT,    sizeof(AutoExposureConstants));
+	gShaderBindings.DeclareConstantBuffer("ParticleConstants",        PARTICLE_CONSTANTS_SLOT,         sizeof(ParticleConstants));
+	gShaderBindings.DeclareConstantBuffer("SortConstants",            SORT_CONSTANTS_SLOT,             sizeof(SortConstants));
+	gShaderBindings.DeclareConstantBuffer("ShadowConstants",          SHADOW_CONSTANTS_SLOT,           sizeof(ShadowConstants));
+	gShaderBindings.DeclareConstantBuffer("ImpostorConstants",        IMPOSTOR_CONSTANTS_SLOT,         sizeof(ImpostorConstants));
+	gShaderBindings.DeclareConstantBuffer("GpuCullConstants",         GPU_CULL_CONSTANTS_SLOT,         sizeof(GpuCullConstants));
+	gShaderBindings.DeclareConstantBuffer("GpuDrawConstants",         GPU_DRAW_CONSTANTS_SLOT,         sizeof(GpuDrawConstants));
+
+	gShaderLibrary.Open(SHADER_LIBRARY_FILE); // Fall back to the .cso files if this fails
+	gLooseShaders.clear();
+	gLibraryShadersUsed.clear();
+
 	gBasicTransformVertexShader   = LoadVertexShader  ("BasicTransform_vs"  );
 	gPixelLightingVertexShader    = LoadVertexShader  ("PixelLighting_vs"   );
 	gTintedTexturePixelShader     = LoadPixelShader   ("TintedTexture_ps"   );
 	gPixelLightingPixelShader     = LoadPixelShader   ("PixelLighting_ps"   );
 
+	gBasicTransformInstancedVertexShader = LoadVertexShader("BasicTransformInstanced_vs");
+	gPixelLightingInstancedVertexShader  = LoadVertexShader("PixelLightingInstanced_vs" );
+	gTintedTextureInstancedPixelShader   = LoadPixelShader ("TintedTextureInstanced_ps" );
+
+	gDepthOnlyVertexShader          = LoadVertexShader("DepthOnly_vs"         );
+	gDepthOnlyInstancedVertexShader = LoadVertexShader("DepthOnlyInstanced_vs");
+
+	gGBufferPixelShader          = LoadPixelShader("GBuffer_ps"         );
+	gDeferredLightingPixelShader = LoadPixelShader("DeferredLighting_ps");
+
+	gDepthResolvePixelShader = LoadPixelShader("DepthResolve_ps");
+
+	// Pre-skinning streams the output of the skinning vertex shader straight out to a vertex buffer, with no geometry
+	// shader of its own (a stream-out geometry shader can be made from vertex shader code). The declaration matches
+	// BasicVertex in Common.hlsli
+	D3D11_SO_DECLARATION_ENTRY skinnedVertexDecl[] =
+	{
+		{ 0, "position", 0, 0, 3, 0 },
+		{ 0, "normal",   0, 0, 3, 0 },
+		{ 0, "uv",       0, 0, 2, 0 },
+	};
+	gSkinningVertexShader    = LoadVertexShader("Skinning_vs");
+	gSkinningStreamOutShader = LoadStreamOutGeometryShader("Skinning_vs", skinnedVertexDecl, 3, sizeof(BasicVertex));
+
+	// Static batches are baked into world space the same way, writing the same vertices (see StaticBatches.h)
+	gStaticBakeVertexShader    = LoadVertexShader("StaticBake_vs");
+	gStaticBakeStreamOutShader = LoadStreamOutGeometryShader("StaticBake_vs", skinnedVertexDecl, 3, sizeof(BasicVertex));
+
+	gParticleVertexShader = LoadVertexShader("Particle_vs");
+	gParticlePixelShader  = LoadPixelShader ("Particle_ps");
+
+	gSkyVertexShader = LoadVertexShader("Sky_vs");
+	gSkyPixelShader  = LoadPixelShader ("Sky_ps");
+
+	gLightFlareVertexShader = LoadVertexShader("LightFlare_vs");
+
+	gImpostorVertexShader       = LoadVertexShader("Impostor_vs");
+	gImpostorPixelShader        = LoadPixelShader ("Impostor_ps");
+	gImpostorCapturePixelShader = LoadPixelShader ("ImpostorCapture_ps");
+
 	//***************************************
 	//**** Post processing shaders
 
 	gFullScreenQuadVertexShader = LoadVertexShader("FullScreenQuad_pp");
-	gTintPostProcess            = LoadPixelShader ("Tint_pp");
+	gPostProcessVertexShader    = GetVertexShaderPermutation("FullScreenQuad_pp", { { "PASS_UV_TRANSFORM", "1" } });
 
-	gBlur_PostProcess            = LoadPixelShader ("Blur_pp");
-	gPyramidBlur_PostProcess     = LoadPixelShader("PyramidBlur_pp");
-	gGaussianBlurH_PostProcess    = LoadPixelShader("GaussianBlurHorizontal_pp");
-	gGaussianBlurV_PostProcess    = LoadPixelShader("GaussianBlurVertical_pp");
 	gCopy_PostProcess    = LoadPixelShader("Copy_pp");
-	gPixellate_PostProcess    = LoadPixelShader("Retro_pp");
-	gBitColour_PostProcess    = LoadPixelShader("BitColour_pp");
-	gBrightFilter_PostProcess = LoadPixelShader("BrightFilter_pp");
 	gCombine_PostProcess = LoadPixelShader("CombineAdditive_pp");
+	gBloomDownsample_PostProcess = LoadPixelShader("BloomDownsample_pp");
+	gProfilerOverlay_PostProcess = LoadPixelShader("ProfilerOverlay_pp");
+	gUpscale_PostProcess         = LoadPixelShader("Upscale_pp");
+	gExposure_PostProcess        = LoadPixelShader("Exposure_pp");
+	gDualFilterDownsample_PostProcess = LoadPixelShader("DualFilterDownsample_pp");
+	gDualFilterUpsample_PostProcess   = LoadPixelShader("DualFilterUpsample_pp");
+	gFog_PostProcess                  = LoadPixelShader("Fog_pp");
+	gReducedRateReconstruct_PostProcess = LoadPixelShader("ReducedRateReconstruct_pp");
+	gTemporalResolve_PostProcess      = LoadPixelShader("TemporalResolve_pp");
+
+	gClusterLights_Compute          = LoadComputeShader("ClusterLights_cs");
+	gLuminanceHistogram_Compute     = LoadComputeShader("LuminanceHistogram_cs");
+	gAutoExposure_Compute           = LoadComputeShader("AutoExposure_cs");
+	gColourLut_Compute              = LoadComputeShader("ColourLut_cs");
+	gParticles_Compute              = LoadComputeShader("Particles_cs");
+	gParticleSortKeys_Compute       = LoadComputeShader("ParticleSortKeys_cs");
+	gBitonicSortBlock_Compute       = LoadComputeShader("BitonicSortBlock_cs");
+	gBitonicSortStep_Compute        = LoadComputeShader("BitonicSortStep_cs");
+	gHiZ_Compute                    = LoadComputeShader("HiZ_cs");
+	gGpuCull_Compute                = LoadComputeShader("GpuCull_cs");
+	gGpuCullArgs_Compute            = LoadComputeShader("GpuCullArgs_cs");
 
-	gUnderwater_PostProcess         = LoadPixelShader ("Underwater_pp");
-	gNoise_PostProcess          = LoadPixelShader ("GreyNoise_pp");
+	// Shaders used by a single effect are only loaded when the effect is first applied (see EffectResources.h)
+	gEffectResources.Declare(Effect::GaussianBlur, "GaussianBlurHorizontal_pp", &gGaussianBlurH_PostProcess);
+	gEffectResources.Declare(Effect::GaussianBlur, "GaussianBlurVertical_pp",   &gGaussianBlurV_PostProcess);
+	gEffectResources.Declare(Effect::GaussianBlur, "GaussianBlurHorizontal_cs", &gGaussianBlurH_Compute);
+	gEffectResources.Declare(Effect::GaussianBlur, "GaussianBlurVertical_cs",   &gGaussianBlurV_Compute);
+	gEffectResources.Declare(Effect::Blur,         "Blur_pp",                   &gBlur_PostProcess);
+	gEffectResources.Declare(Effect::Blur,         "SummedAreaTableRows_cs",    &gSummedAreaTableRows_Compute);
+	gEffectResources.Declare(Effect::Blur,         "SummedAreaTableColumns_cs", &gSummedAreaTableColumns_Compute);
+	gEffectResources.Declare(Effect::Bloom,        "BloomBlur_pp",              &gBloomBlur_PostProcess);
+	gEffectResources.Declare(Effect::Bloom,        "BloomUpsample_pp",          &gBloomUpsample_PostProcess);
+	gEffectResources.Declare(Effect::Bloom,        "FftBloomPack_pp",           &gFftBloomPack_PostProcess);
+	gEffectResources.Declare(Effect::Bloom,        "FftBloomCombine_pp",        &gFftBloomCombine_PostProcess);
+	gEffectResources.Declare(Effect::Bloom,        "BloomTiles_cs",             &gBloomTiles_Compute);
+	gEffectResources.Declare(Effect::Bloom,        "BloomTileBlur_cs",          &gBloomTileBlur_Compute);
+	gEffectResources.Declare(Effect::Upscale,      "SpatialUpscale_cs",         &gSpatialUpscale_Compute);
+	gEffectResources.Declare(Effect::Upscale,      "Sharpen_cs",                &gSharpen_Compute);
+	gEffectResources.Declare(Effect::StarFilter,   "StarStreak_pp",             &gStarStreak_PostProcess);
+	gEffectResources.Declare(Effect::PyramidBlur,  "PyramidBlur_pp",            &gPyramidBlur_PostProcess);
+	gEffectResources.Declare(Effect::PyramidBlur,  "PyramidBlurMips_pp",        &gPyramidBlurMips_PostProcess);
+	gEffectResources.Declare(Effect::DepthOfField, "DepthOfFieldDownsample_pp", &gDepthOfFieldDownsample_PostProcess);
+	gEffectResources.Declare(Effect::DepthOfField, "DepthOfFieldBlur_pp",       &gDepthOfFieldBlur_PostProcess);
+	gEffectResources.Declare(Effect::DepthOfField, "DepthOfFieldCombine_pp",    &gDepthOfFieldCombine_PostProcess);
+	gEffectResources.Declare(Effect::Fxaa,         "Fxaa_pp",                   &gFxaa_PostProcess);
+	gEffectResources.Declare(Effect::Smaa,         "SmaaEdges_pp",              &gSmaaEdges_PostProcess);
+	gEffectResources.Declare(Effect::Smaa,         "SmaaWeights_pp",            &gSmaaWeights_PostProcess);
+	gEffectResources.Declare(Effect::Smaa,         "SmaaBlend_pp",              &gSmaaBlend_PostProcess);
 
 	if (
 		gBasicTransformVertexShader    == nullptr 
 		|| gPixelLightingVertexShader  == nullptr 
 		|| gTintedTexturePixelShader   == nullptr 
 		|| gPixelLightingPixelShader   == nullptr 
+		|| gBasicTransformInstancedVertexShader == nullptr
+		|| gPixelLightingInstancedVertexShader  == nullptr
+		|| gTintedTextureInstancedPixelShader   == nullptr
+		|| gDepthOnlyVertexShader               == nullptr
+		|| gDepthOnlyInstancedVertexShader      == nullptr
+		|| gGBufferPixelShader                  == nullptr
+		|| gDeferredLightingPixelShader         == nullptr
+		|| gDepthResolvePixelShader             == nullptr
+		|| gSkinningVertexShader                == nullptr
+		|| gSkinningStreamOutShader             == nullptr
+		|| gStaticBakeVertexShader              == nullptr
+		|| gStaticBakeStreamOutShader           == nullptr
+		|| gParticleVertexShader                == nullptr
+		|| gParticlePixelShader                 == nullptr
+		|| gSkyVertexShader                     == nullptr
+		|| gSkyPixelShader                      == nullptr
+		|| gLightFlareVertexShader              == nullptr
+		|| gImpostorVertexShader                == nullptr
+		|| gImpostorPixelShader                 == nullptr
+		|| gImpostorCapturePixelShader          == nullptr
 		|| gFullScreenQuadVertexShader == nullptr 
-		|| gTintPostProcess            == nullptr 
-		|| gPyramidBlur_PostProcess    == nullptr 
-		|| gBlur_PostProcess           == nullptr 
-		|| gUnderwater_PostProcess     == nullptr 
-		|| gNoise_PostProcess          == nullptr
-		|| gGaussianBlurH_PostProcess == nullptr
-		|| gGaussianBlurV_PostProcess == nullptr
+		|| gPostProcessVertexShader    == nullptr
 		|| gCopy_PostProcess == nullptr
-		|| gPixellate_PostProcess == nullptr
-		|| gBitColour_PostProcess == nullptr
-		|| gBrightFilter_PostProcess == nullptr
 		|| gCombine_PostProcess == nullptr
+		|| gBloomDownsample_PostProcess == nullptr
+		|| gProfilerOverlay_PostProcess == nullptr
+		|| gUpscale_PostProcess == nullptr
+		|| gExposure_PostProcess == nullptr
+		|| gDualFilterDownsample_PostProcess == nullptr
+		|| gDualFilterUpsample_PostProcess == nullptr
+		|| gFog_PostProcess == nullptr
+		|| gReducedRateReconstruct_PostProcess == nullptr
+		|| gTemporalResolve_PostProcess == nullptr
+		|| gClusterLights_Compute == nullptr
+		|| gLuminanceHistogram_Compute == nullptr
+		|| gAutoExposure_Compute == nullptr
+		|| gColourLut_Compute == nullptr
+		|| gParticles_Compute == nullptr
+		|| gParticleSortKeys_Compute == nullptr
+		|| gBitonicSortBlock_Compute == nullptr
+		|| gBitonicSortStep_Compute == nullptr
+		|| gHiZ_Compute == nullptr
+		|| gGpuCull_Compute == nullptr
+		|| gGpuCullArgs_Compute == nullptr
 		)
 	{
-		gLastError = "Error loading shaders";
+		gShaderLibrary.Close();
+		gLooseShaders.clear();
+		gLibraryShadersUsed.clear();
+		gLastError = gLastError.empty() ? "Error loading shaders" : "Error loading shaders: " + gLastError; // Add the reason if known
 		return false;
 	}
 
+	// If any shaders came from .cso files then repack the library with all the shaders loaded. Shaders that did come
+	// from the library must be copied out before it is closed and overwritten
+	if (!gLooseShaders.empty())
+	{
+		for (auto& shaderName : gLibraryShadersUsed)
+		{
+			const void* byteCode;
+			size_t size;
+			gShaderLibrary.Find(shaderName, byteCode, size);
+			const char* data = static_cast<const char*>(byteCode);
+			gLooseShaders.emplace_back(shaderName, std::vector<char>(data, data + size));
+		}
+		gShaderLibrary.Close();
+		ShaderLibrary::Write(SHADER_LIBRARY_FILE, gLooseShaders); // Not an error if this fails, the .cso files are still used
+	}
+	gShaderLibrary.Close();
+	gLooseShaders.clear();
+	gLibraryShadersUsed.clear();
+
+	// Pixel and compute shaders can be edited while the app is running if hot-reload is started (see ShaderReloader.h)
+	gShaderReloader.Watch("TintedTexture_ps",          &gTintedTexturePixelShader);
+	gShaderReloader.Watch("PixelLighting_ps",          &gPixelLightingPixelShader);
+	gShaderReloader.Watch("TintedTextureInstanced_ps", &gTintedTextureInstancedPixelShader);
+	gShaderReloader.Watch("GBuffer_ps",                &gGBufferPixelShader);
+	gShaderReloader.Watch("DeferredLighting_ps",       &gDeferredLightingPixelShader);
+	gShaderReloader.Watch("DepthResolve_ps",           &gDepthResolvePixelShader);
+	gShaderReloader.Watch("Particle_ps",               &gParticlePixelShader);
+	gShaderReloader.Watch("Sky_ps",                    &gSkyPixelShader);
+	gShaderReloader.Watch("Impostor_ps",               &gImpostorPixelShader);
+	gShaderReloader.Watch("ImpostorCapture_ps",        &gImpostorCapturePixelShader);
+	gShaderReloader.Watch("Blur_pp",                   &gBlur_PostProcess);
+	gShaderReloader.Watch("PyramidBlur_pp",            &gPyramidBlur_PostProcess);
+	gShaderReloader.Watch("GaussianBlurHorizontal_pp", &gGaussianBlurH_PostProcess);
+	gShaderReloader.Watch("GaussianBlurVertical_pp",   &gGaussianBlurV_PostProcess);
+	gShaderReloader.Watch("Copy_pp",                   &gCopy_PostProcess);
+	gShaderReloader.Watch("CombineAdditive_pp",        &gCombine_PostProcess);
+	gShaderReloader.Watch("BloomDownsample_pp",        &gBloomDownsample_PostProcess);
+	gShaderReloader.Watch("BloomBlur_pp",              &gBloomBlur_PostProcess);
+	gShaderReloader.Watch("BloomUpsample_pp",          &gBloomUpsample_PostProcess);
+	gShaderReloader.Watch("ProfilerOverlay_pp",        &gProfilerOverlay_PostProcess);
+	gShaderReloader.Watch("Upscale_pp",                &gUpscale_PostProcess);
+	gShaderReloader.Watch("Exposure_pp",               &gExposure_PostProcess);
+	gShaderReloader.Watch("DualFilterDownsample_pp",   &gDualFilterDownsample_PostProcess);
+	gShaderReloader.Watch("DualFilterUpsample_pp",     &gDualFilterUpsample_PostProcess);
+	gShaderReloader.Watch("FftBloomPack_pp",           &gFftBloomPack_PostProcess);
+	gShaderReloader.Watch("FftBloomCombine_pp",        &gFftBloomCombine_PostProcess);
+	gShaderReloader.Watch("StarStreak_pp",             &gStarStreak_PostProcess);
+	gShaderReloader.Watch("PyramidBlurMips_pp",        &gPyramidBlurMips_PostProcess);
+	gShaderReloader.Watch("DepthOfFieldDownsample_pp", &gDepthOfFieldDownsample_PostProcess);
+	gShaderReloader.Watch("DepthOfFieldBlur_pp",       &gDepthOfFieldBlur_PostProcess);
+	gShaderReloader.Watch("DepthOfFieldCombine_pp",    &gDepthOfFieldCombine_PostProcess);
+	gShaderReloader.Watch("Fxaa_pp",                   &gFxaa_PostProcess);
+	gShaderReloader.Watch("SmaaEdges_pp",              &gSmaaEdges_PostProcess);
+	gShaderReloader.Watch("SmaaWeights_pp",            &gSmaaWeights_PostProcess);
+	gShaderReloader.Watch("SmaaBlend_pp",              &gSmaaBlend_PostProcess);
+	gShaderReloader.Watch("Fog_pp",                    &gFog_PostProcess);
+	gShaderReloader.Watch("ReducedRateReconstruct_pp", &gReducedRateReconstruct_PostProcess);
+	gShaderReloader.Watch("TemporalResolve_pp",        &gTemporalResolve_PostProcess);
+	gShaderReloader.Watch("GaussianBlurHorizontal_cs", &gGaussianBlurH_Compute);
+	gShaderReloader.Watch("GaussianBlurVertical_cs",   &gGaussianBlurV_Compute);
+	gShaderReloader.Watch("SummedAreaTableRows_cs",    &gSummedAreaTableRows_Compute);
+	gShaderReloader.Watch("SummedAreaTableColumns_cs", &gSummedAreaTableColumns_Compute);
+	gShaderReloader.Watch("BloomTiles_cs",             &gBloomTiles_Compute);
+	gShaderReloader.Watch("BloomTileBlur_cs",          &gBloomTileBlur_Compute);
+	gShaderReloader.Watch("SpatialUpscale_cs",         &gSpatialUpscale_Compute);
+	gShaderReloader.Watch("Sharpen_cs",                &gSharpen_Compute);
+	gShaderReloader.Watch("ClusterLights_cs",          &gClusterLights_Compute);
+	gShaderReloader.Watch("LuminanceHistogram_cs",     &gLuminanceHistogram_Compute);
+	gShaderReloader.Watch("AutoExposure_cs",           &gAutoExposure_Compute);
+	gShaderReloader.Watch("ColourLut_cs",              &gColourLut_Compute);
+	gShaderReloader.Watch("Particles_cs",              &gParticles_Compute);
+	gShaderReloader.Watch("ParticleSortKeys_cs",       &gParticleSortKeys_Compute);
+	gShaderReloader.Watch("HiZ_cs",                    &gHiZ_Compute);
+	gShaderReloader.Watch("GpuCull_cs",                &gGpuCull_Compute);
+	gShaderReloader.Watch("GpuCullArgs_cs",            &gGpuCullArgs_Compute);
+
 	return true;
 }
 
 
 void ReleaseShaders()
 {
-	if (gNoise_PostProcess)             gNoise_PostProcess         ->Release();
-	if (gUnderwater_PostProcess)        gUnderwater_PostProcess    ->Release();
-	if (gBlur_PostProcess)              gBlur_PostProcess          ->Release();
-	if (gPyramidBlur_PostProcess)       gPyramidBlur_PostProcess   ->Release();
-	if (gGaussianBlurH_PostProcess)     gGaussianBlurH_PostProcess ->Release();
-	if (gGaussianBlurV_PostProcess)     gGaussianBlurV_PostProcess ->Release();
+	gShaderReloader.Release(); // Stop swapping shaders before they are released
+	gEffectResources.Release();
+	gShaderBindings.Clear();
+
 	if (gCopy_PostProcess)              gCopy_PostProcess          ->Release();
-	if (gTintPostProcess)               gTintPostProcess           ->Release();
 	if (gFullScreenQuadVertexShader)    gFullScreenQuadVertexShader->Release();
 	if (gPixelLightingPixelShader)      gPixelLightingPixelShader  ->Release();
 	if (gTintedTexturePixelShader)      gTintedTexturePixelShader  ->Release();
 	if (gPixelLightingVertexShader)     gPixelLightingVertexShader ->Release();
 	if (gBasicTransformVertexShader)    gBasicTransformVertexShader->Release();
-	if (gPixellate_PostProcess)			gPixellate_PostProcess->Release();
-	if (gBitColour_PostProcess)			gBitColour_PostProcess->Release();
-	if (gBrightFilter_PostProcess)		gBrightFilter_PostProcess->Release();
+	if (gTintedTextureInstancedPixelShader)    gTintedTextureInstancedPixelShader  ->Release();
+	if (gDepthResolvePixelShader)              gDepthResolvePixelShader            ->Release();
+	if (gDeferredLightingPixelShader)          gDeferredLightingPixelShader        ->Release();
+	if (gGBufferPixelShader)                   gGBufferPixelShader                 ->Release();
+	if (gPixelLightingInstancedVertexShader)   gPixelLightingInstancedVertexShader ->Release();
+	if (gBasicTransformInstancedVertexShader)  gBasicTransformInstancedVertexShader->Release();
+	if (gDepthOnlyInstancedVertexShader)       gDepthOnlyInstancedVertexShader     ->Release();
+	if (gDepthOnlyVertexShader)                gDepthOnlyVertexShader              ->Release();
+	if (gStaticBakeStreamOutShader)            gStaticBakeStreamOutShader          ->Release();
+	if (gStaticBakeVertexShader)               gStaticBakeVertexShader             ->Release();
+	if (gSkinningStreamOutShader)              gSkinningStreamOutShader            ->Release();
+	if (gSkinningVertexShader)                 gSkinningVertexShader               ->Release();
+	if (gParticlePixelShader)                  gParticlePixelShader                ->Release();
+	if (gParticleVertexShader)                 gParticleVertexShader               ->Release();
+	if (gSkyPixelShader)                       gSkyPixelShader                     ->Release();
+	if (gSkyVertexShader)                      gSkyVertexShader                    ->Release();
+	if (gImpostorCapturePixelShader)           gImpostorCapturePixelShader         ->Release();
+	if (gImpostorPixelShader)                  gImpostorPixelShader                ->Release();
+	if (gLightFlareVertexShader)               gLightFlareVertexShader             ->Release();
+	if (gImpostorVertexShader)                 gImpostorVertexShader               ->Release();
 	if (gCombine_PostProcess)			gCombine_PostProcess->Release();
+	if (gBloomDownsample_PostProcess)	gBloomDownsample_PostProcess->Release();
+	if (gProfilerOverlay_PostProcess)	gProfilerOverlay_PostProcess->Release();
+	if (gUpscale_PostProcess)			gUpscale_PostProcess->Release();
+	if (gExposure_PostProcess)			gExposure_PostProcess->Release();
+	if (gDualFilterDownsample_PostProcess)  gDualFilterDownsample_PostProcess->Release();
+	if (gDualFilterUpsample_PostProcess)    gDualFilterUpsample_PostProcess->Release();
+	if (gFog_PostProcess)                   gFog_PostProcess->Release();
+	if (gReducedRateReconstruct_PostProcess) gReducedRateReconstruct_PostProcess->Release();
+	if (gTemporalResolve_PostProcess)       gTemporalResolve_PostProcess->Release();
+
+	for (auto& permutation : gVertexShaderPermutations)   permutation.second->Release();
+	for (auto& permutation : gPixelShaderPermutations)    permutation.second->Release();
+	for (auto& permutation : gComputeShaderPermutations)  permutation.second->Release();
+	gVertexShaderPermutations.clear();
+	gPixelShaderPermutations.clear();
+	gComputeShaderPermutations.clear();
+	gHalfPrecisionSupport = -1;
+	gHalfPrecisionFailures.clear();
+	if (gClusterLights_Compute)			gClusterLights_Compute->Release();
+	if (gLuminanceHistogram_Compute)	gLuminanceHistogram_Compute->Release();
+	if (gAutoExposure_Compute)			gAutoExposure_Compute->Release();
+	if (gColourLut_Compute)				gColourLut_Compute->Release();
+	if (gParticles_Compute)				gParticles_Compute->Release();
+	if (gParticleSortKeys_Compute)		gParticleSortKeys_Compute->Release();
+	if (gBitonicSortBlock_Compute)		gBitonicSortBlock_Compute->Release();
+	if (gBitonicSortStep_Compute)		gBitonicSortStep_Compute->Release();
+	if (gHiZ_Compute)					gHiZ_Compute->Release();
+	if (gGpuCull_Compute)				gGpuCull_Compute->Release();
+	if (gGpuCullArgs_Compute)			gGpuCullArgs_Compute->Release();
 }
 
 
 
-// Load a vertex shader, include the file in the project and pass the name (without the .hlsl extension)
-// to this function. The returned pointer needs to be released before quitting. Returns nullptr on failure. 
-ID3D11VertexShader* LoadVertexShader(std::string shaderName)
+// Record the slots read by a newly created shader (see ShaderBindings.h). Returns false if its constant buffers don't
+// match the C++ code, with the reason in gLastError
+bool RegisterBindings(const void* shader, const void* byteCode, size_t size, const std::string& shaderName)
 {
+	std::string error;
+	if (!gShaderBindings.Register(shader, byteCode, size, shaderName, error))
+	{
+		gLastError = error;
+		return false;
+	}
+	return true;
+}
+
+
+// Get the compiled bytecode for a shader, from the shader library if it is open and holds the shader, then the asset
+// pack, otherwise from the shader's .cso file. Bytecode read from a .cso is kept in gLooseShaders so it can be packed
+// into the library. The bytecode pointer is valid until the library or pack is closed or gLooseShaders is cleared.
+// Returns false on failure
+bool GetShaderByteCode(const std::string& shaderName, const void*& byteCode, size_t& size)
+{
+	STARTUP_SCOPE(StartupStage::Read, shaderName);
+	if (gShaderLibrary.Find(shaderName, byteCode, size))
+	{
+		gLibraryShadersUsed.push_back(shaderName);
+		return true;
+	}
+	if (gAssetPack.Find(shaderName + ".cso", byteCode, size))  return true;
+
 	// Open compiled shader object file
 	std::ifstream shaderFile(shaderName + ".cso", std::ios::in | std::ios::binary | std::ios::ate);
 	if (!shaderFile.is_open())
 	{
-		return nullptr;
+		return false;
 	}
 
 	// Read file into vector of chars
 	std::streamoff fileSize = shaderFile.tellg();
 	shaderFile.seekg(0, std::ios::beg);
-	std::vector<char> byteCode(fileSize);
-	shaderFile.read(&byteCode[0], fileSize);
+	std::vector<char> fileData(static_cast<size_t>(fileSize));
+	shaderFile.read(fileData.data(), fileSize);
 	if (shaderFile.fail())
+	{
+		return false;
+	}
+
+	gLooseShaders.emplace_back(shaderName, std::move(fileData));
+	byteCode = gLooseShaders.back().second.data();
+	size = gLooseShaders.back().second.size();
+	return true;
+}
+
+
+// As GetShaderByteCode, but copying the bytecode out and without the shader library or gLooseShaders, which are only used
+// by LoadShaders on the main thread
+bool ReadShaderByteCode(const std::string& shaderName, std::vector<char>& byteCode)
+{
+	const void* packData;
+	size_t size;
+	if (gAssetPack.Find(shaderName + ".cso", packData, size))
+	{
+		const char* data = static_cast<const char*>(packData);
+		byteCode.assign(data, data + size);
+		return true;
+	}
+
+	std::ifstream shaderFile(shaderName + ".cso", std::ios::in | std::ios::binary | std::ios::ate);
+	if (!shaderFile.is_open())  return false;
+	std::streamoff fileSize = shaderFile.tellg();
+	shaderFile.seekg(0, std::ios::beg);
+	byteCode.resize(static_cast<size_t>(fileSize));
+	shaderFile.read(byteCode.data(), fileSize);
+	return !shaderFile.fail();
+}
+
+
+// Load a vertex shader, include the file in the project and pass the name (without the .hlsl extension)
+// to this function. The returned pointer needs to be released before quitting. Returns nullptr on failure. 
+ID3D11VertexShader* LoadVertexShader(std::string shaderName)
+{
+	STARTUP_SCOPE(StartupStage::Asset, shaderName);
+	const void* byteCode;
+	size_t size;
+	if (!GetShaderByteCode(shaderName, byteCode, size))
 	{
 		return nullptr;
 	}
 
 	// Create shader object from loaded file (we will use the object later when rendering)
 	ID3D11VertexShader* shader;
-	HRESULT hr = gD3DDevice->CreateVertexShader(byteCode.data(), byteCode.size(), nullptr, &shader);
+	HRESULT hr = gD3DDevice->CreateVertexShader(byteCode, size, nullptr, &shader);
 	if (FAILED(hr))
 	{
 		return nullptr;
 	}
 
+	if (!RegisterBindings(shader, byteCode, size, shaderName))
+	{
+		shader->Release();
+		return nullptr;
+	}
+
 	return shader;
 }
 
 
 // Load a geometry shader, include the file in the project and pass the name (without the .hlsl extension)
 // to this function. The returned pointer needs to be released before quitting. Returns nullptr on failure. 
-// Basically the same code as above but for pixel shaders
+// Basically the same code as above but for geometry shaders
 ID3D11GeometryShader* LoadGeometryShader(std::string shaderName)
 {
-	// Open compiled shader object file
-	std::ifstream shaderFile(shaderName + ".cso", std::ios::in | std::ios::binary | std::ios::ate);
-	if (!shaderFile.is_open())
+	STARTUP_SCOPE(StartupStage::Asset, shaderName);
+	const void* byteCode;
+	size_t size;
+	if (!GetShaderByteCode(shaderName, byteCode, size))
 	{
 		return nullptr;
 	}
 
-	// Read file into vector of chars
-	std::streamoff fileSize = shaderFile.tellg();
-	shaderFile.seekg(0, std::ios::beg);
-	std::vector<char>byteCode(fileSize);
-	shaderFile.read(&byteCode[0], fileSize);
-	if (shaderFile.fail())
+	// Create shader object from loaded file (we will use the object later when rendering)
+	ID3D11GeometryShader* shader;
+	HRESULT hr = gD3DDevice->CreateGeometryShader(byteCode, size, nullptr, &shader);
+	if (FAILED(hr))
 	{
 		return nullptr;
 	}
 
-	// Create shader object from loaded file (we will use the object later when rendering)
-	ID3D11GeometryShader* shader;
-	HRESULT hr = gD3DDevice->CreateGeometryShader(byteCode.data(), byteCode.size(), nullptr, &shader);
-	if (FAILED(hr))
+	if (!RegisterBindings(shader, byteCode, size, shaderName))
 	{
+		shader->Release();
 		return nullptr;
 	}
 
@@ -199,32 +615,29 @@ ID3D11GeometryShader* LoadGeometryShader(std::string shaderName)
 // The returned pointer needs to be released before quitting. Returns nullptr on failure. 
 ID3D11GeometryShader* LoadStreamOutGeometryShader(std::string shaderName, D3D11_SO_DECLARATION_ENTRY* soDecl, unsigned int soNumEntries, unsigned int soStride)
 {
-	// Open compiled shader object file
-	std::ifstream shaderFile(shaderName + ".cso", std::ios::in | std::ios::binary | std::ios::ate);
-	if (!shaderFile.is_open())
-	{
-		return nullptr;
-	}
-
-	// Read file into vector of chars
-	std::streamoff fileSize = shaderFile.tellg();
-	shaderFile.seekg(0, std::ios::beg);
-	std::vector<char>byteCode(fileSize);
-	shaderFile.read(&byteCode[0], fileSize);
-	if (shaderFile.fail())
+	STARTUP_SCOPE(StartupStage::Asset, shaderName);
+	const void* byteCode;
+	size_t size;
+	if (!GetShaderByteCode(shaderName, byteCode, size))
 	{
 		return nullptr;
 	}
 
 	// Create shader object from loaded file (we will use the object later when rendering)
 	ID3D11GeometryShader* shader;
-	HRESULT hr = gD3DDevice->CreateGeometryShaderWithStreamOutput(byteCode.data(), byteCode.size(),
+	HRESULT hr = gD3DDevice->CreateGeometryShaderWithStreamOutput(byteCode, size,
 		                                                          soDecl, soNumEntries, &soStride, 1, D3D11_SO_NO_RASTERIZED_STREAM, nullptr, &shader);
 	if(FAILED(hr))
 	{
 		return nullptr;
 	}
 
+	if (!RegisterBindings(shader, byteCode, size, shaderName))
+	{
+		shader->Release();
+		return nullptr;
+	}
+
 	return shader;
 }
 
@@ -236,31 +649,236 @@ ID3D11GeometryShader* LoadStreamOutGeometryShader(std::string shaderName, D3D11_
 // Basically the same code as above but for pixel shaders
 ID3D11PixelShader* LoadPixelShader(std::string shaderName)
 {
-	// Open compiled shader object file
-	std::ifstream shaderFile(shaderName + ".cso", std::ios::in | std::ios::binary | std::ios::ate);
-	if (!shaderFile.is_open())
+	STARTUP_SCOPE(StartupStage::Asset, shaderName);
+	const void* byteCode;
+	size_t size;
+	if (!GetShaderByteCode(shaderName, byteCode, size))
 	{
 		return nullptr;
 	}
 
-	// Read file into vector of chars
-	std::streamoff fileSize = shaderFile.tellg();
-	shaderFile.seekg(0, std::ios::beg);
-	std::vector<char>byteCode(fileSize);
-	shaderFile.read(&byteCode[0], fileSize);
-	if (shaderFile.fail())
+	// Create shader object from loaded file (we will use the object later when rendering)
+	ID3D11PixelShader* shader;
+	HRESULT hr = gD3DDevice->CreatePixelShader(byteCode, size, nullptr, &shader);
+	if (FAILED(hr))
+	{
+		return nullptr;
+	}
+
+	if (!RegisterBindings(shader, byteCode, size, shaderName))
+	{
+		shader->Release();
+		return nullptr;
+	}
+
+	return shader;
+}
+
+
+
+// Load a compute shader, include the file in the project and pass the name (without the .hlsl extension)
+// to this function. The returned pointer needs to be released before quitting. Returns nullptr on failure. 
+// Basically the same code as above but for compute shaders
+ID3D11ComputeShader* LoadComputeShader(std::string shaderName)
+{
+	STARTUP_SCOPE(StartupStage::Asset, shaderName);
+	const void* byteCode;
+	size_t size;
+	if (!GetShaderByteCode(shaderName, byteCode, size))
 	{
 		return nullptr;
 	}
 
 	// Create shader object from loaded file (we will use the object later when rendering)
+	ID3D11ComputeShader* shader;
+	HRESULT hr = gD3DDevice->CreateComputeShader(byteCode, size, nullptr, &shader);
+	if (FAILED(hr))
+	{
+		return nullptr;
+	}
+
+	if (!RegisterBindings(shader, byteCode, size, shaderName))
+	{
+		shader->Release();
+		return nullptr;
+	}
+
+	return shader;
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Shader permutations
+//--------------------------------------------------------------------------------------
+
+// Cache key for a permutation, e.g. "ColourEffects_pp:COLOUR_EFFECT_RETRO=1;COLOUR_EFFECT_TINT=0;". Defines are sorted so
+// the order they are given in doesn't matter
+std::string PermutationKey(const std::string& shaderName, ShaderDefines defines)
+{
+	std::sort(defines.begin(), defines.end());
+	std::string key = shaderName + ":";
+	for (auto& define : defines)
+	{
+		key += define.first + "=" + define.second + ";";
+	}
+	return key;
+}
+
+// Compile the given shader file with the defines for the given target (e.g. "ps_5_0"). Returns nullptr on failure
+ID3DBlob* CompilePermutation(const std::string& shaderName, const ShaderDefines& defines, const char* target)
+{
+	std::vector<D3D_SHADER_MACRO> macros;
+	for (auto& define : defines)
+	{
+		macros.push_back({ define.first.c_str(), define.second.c_str() });
+	}
+	macros.push_back({ nullptr, nullptr });
+
+	UINT flags = D3DCOMPILE_OPTIMIZATION_LEVEL3;
+#ifdef _DEBUG
+	flags |= D3DCOMPILE_DEBUG;
+#endif
+
+	std::string errors;
+	ID3DBlob* compiledShader = gShaderCache.CompileFile(shaderName + ".hlsl", macros.data(), "main", target, flags, &errors);
+	if (compiledShader == nullptr)
+	{
+		gLastError = "Error compiling " + PermutationKey(shaderName, defines);
+		if (!errors.empty())  gLastError += "\n" + errors;
+	}
+	return compiledShader;
+}
+
+
+
+// Get the permutation of the given vertex shader with the given defines, compiling it the first time it is used
+ID3D11VertexShader* GetVertexShaderPermutation(const std::string& shaderName, const ShaderDefines& defines)
+{
+	std::string key = PermutationKey(shaderName, defines);
+	auto cached = gVertexShaderPermutations.find(key);
+	if (cached != gVertexShaderPermutations.end())  return cached->second;
+
+	ID3DBlob* compiledShader = CompilePermutation(shaderName, defines, "vs_5_0");
+	if (compiledShader == nullptr)  return nullptr;
+
+	ID3D11VertexShader* shader;
+	HRESULT hr = gD3DDevice->CreateVertexShader(compiledShader->GetBufferPointer(), compiledShader->GetBufferSize(), nullptr, &shader);
+	if (FAILED(hr))
+	{
+		compiledShader->Release();
+		gLastError = "Error creating " + key;
+		return nullptr;
+	}
+	bool registered = RegisterBindings(shader, compiledShader->GetBufferPointer(), compiledShader->GetBufferSize(), key);
+	compiledShader->Release();
+	if (!registered)
+	{
+		shader->Release();
+		return nullptr;
+	}
+
+	gVertexShaderPermutations[key] = shader;
+	return shader;
+}
+
+
+// Get the permutation of the given pixel shader with the given defines, compiling it the first time it is used
+ID3D11PixelShader* GetPixelShaderPermutation(const std::string& shaderName, const ShaderDefines& defines)
+{
+	std::string key = PermutationKey(shaderName, defines);
+	auto cached = gPixelShaderPermutations.find(key);
+	if (cached != gPixelShaderPermutations.end())  return cached->second;
+
+	ID3DBlob* compiledShader = CompilePermutation(shaderName, defines, "ps_5_0");
+	if (compiledShader == nullptr)  return nullptr;
+
 	ID3D11PixelShader* shader;
-	HRESULT hr = gD3DDevice->CreatePixelShader(byteCode.data(), byteCode.size(), nullptr, &shader);
+	HRESULT hr = gD3DDevice->CreatePixelShader(compiledShader->GetBufferPointer(), compiledShader->GetBufferSize(), nullptr, &shader);
 	if (FAILED(hr))
 	{
+		compiledShader->Release();
+		gLastError = "Error creating " + key;
+		return nullptr;
+	}
+	bool registered = RegisterBindings(shader, compiledShader->GetBufferPointer(), compiledShader->GetBufferSize(), key);
+	compiledShader->Release();
+	if (!registered)
+	{
+		shader->Release();
 		return nullptr;
 	}
 
+	gPixelShaderPermutations[key] = shader;
+	return shader;
+}
+
+
+// Get the permutation of the given compute shader with the given defines, compiling it the first time it is used
+ID3D11ComputeShader* GetComputeShaderPermutation(const std::string& shaderName, const ShaderDefines& defines)
+{
+	std::string key = PermutationKey(shaderName, defines);
+	auto cached = gComputeShaderPermutations.find(key);
+	if (cached != gComputeShaderPermutations.end())  return cached->second;
+
+	ID3DBlob* compiledShader = CompilePermutation(shaderName, defines, "cs_5_0");
+	if (compiledShader == nullptr)  return nullptr;
+
+	ID3D11ComputeShader* shader;
+	HRESULT hr = gD3DDevice->CreateComputeShader(compiledShader->GetBufferPointer(), compiledShader->GetBufferSize(), nullptr, &shader);
+	if (FAILED(hr))
+	{
+		compiledShader->Release();
+		gLastError = "Error creating " + key;
+		return nullptr;
+	}
+	bool registered = RegisterBindings(shader, compiledShader->GetBufferPointer(), compiledShader->GetBufferSize(), key);
+	compiledShader->Release();
+	if (!registered)
+	{
+		shader->Release();
+		return nullptr;
+	}
+
+	gComputeShaderPermutations[key] = shader;
+	return shader;
+}
+
+
+// Ask the device once whether min16float is really 16-bit in the pixel shaders and the other stages. Drivers without
+// 16-bit maths run it at 32 bits, where the half precision permutations would only be duplicates
+bool HalfPrecisionSupported()
+{
+	if (gHalfPrecisionSupport < 0)
+	{
+		D3D11_FEATURE_DATA_SHADER_MIN_PRECISION_SUPPORT precision = {};
+		bool supported = SUCCEEDED(gD3DDevice->CheckFeatureSupport(D3D11_FEATURE_SHADER_MIN_PRECISION_SUPPORT, &precision, sizeof(precision))) &&
+		                 (precision.PixelShaderMinPrecision          & D3D11_SHADER_MIN_PRECISION_16_BIT) &&
+		                 (precision.AllOtherShaderStagesMinPrecision & D3D11_SHADER_MIN_PRECISION_16_BIT);
+		gHalfPrecisionSupport = supported ? 1 : 0;
+	}
+	return gHalfPrecisionSupport != 0;
+}
+
+
+// The HALF_PRECISION permutation of a shader, falling back to the shader itself
+ID3D11PixelShader* HalfPrecisionShader(ID3D11PixelShader* shader, const std::string& shaderName)
+{
+	if (shader == nullptr || !HalfPrecisionSupported() || gHalfPrecisionFailures.count(shaderName) != 0)  return shader;
+
+	ID3D11PixelShader* halfShader = GetPixelShaderPermutation(shaderName, { { "HALF_PRECISION", "1" } });
+	if (halfShader != nullptr)  return halfShader;
+	gHalfPrecisionFailures.insert(shaderName);
+	return shader;
+}
+
+ID3D11ComputeShader* HalfPrecisionShader(ID3D11ComputeShader* shader, const std::string& shaderName)
+{
+	if (shader == nullptr || !HalfPrecisionSupported() || gHalfPrecisionFailures.count(shaderName) != 0)  return shader;
+
+	ID3D11ComputeShader* halfShader = GetComputeShaderPermutation(shaderName, { { "HALF_PRECISION", "1" } });
+	if (halfShader != nullptr)  return halfShader;
+	gHalfPrecisionFailures.insert(shaderName);
 	return shader;
 }
 
@@ -284,6 +902,9 @@ ID3DBlob* CreateSignatureForVertexLayout(const D3D11_INPUT_ELEMENT_DESC vertexLa
 		else if (format == DXGI_FORMAT_R32G32_FLOAT)       shaderSource += "float2";
 		else if (format == DXGI_FORMAT_R32_FLOAT)          shaderSource += "float";
 		else if (format == DXGI_FORMAT_R8G8B8A8_UINT)      shaderSource += "uint4";
+		else if (format == DXGI_FORMAT_R16G16_FLOAT)       shaderSource += "float2"; // Compact formats (see CompactMesh)
+		else if (format == DXGI_FORMAT_R8G8B8A8_SNORM)     shaderSource += "float4";
+		else if (format == DXGI_FORMAT_R8G8B8A8_UNORM)     shaderSource += "float4";
 		else return nullptr; // Unsupported type in layout
 
 		uint8_t index = static_cast<uint8_t>(vertexLayout[elt].SemanticIndex);
@@ -298,15 +919,8 @@ ID3DBlob* CreateSignatureForVertexLayout(const D3D11_INPUT_ELEMENT_DESC vertexLa
 	}
 	shaderSource += ") : SV_Position {return 0;}";
 
-	ID3DBlob* compiledShader;
-	HRESULT hr = D3DCompile(shaderSource.c_str(), shaderSource.length(), NULL, NULL, NULL, "main",
-		                    "vs_5_0", D3DCOMPILE_OPTIMIZATION_LEVEL0, 0, &compiledShader, NULL);
-	if (FAILED(hr))
-	{
-		return nullptr;
-	}
-
-	return compiledShader;
+	// Loaded from the shader cache if this layout has been seen before
+	return gShaderCache.Compile(shaderSource, "", nullptr, "main", "vs_5_0", D3DCOMPILE_OPTIMIZATION_LEVEL0);
 }
 
 
@@ -337,8 +951,134 @@ ID3D11Buffer* CreateConstantBuffer(int size)
 	{
 		return nullptr;
 	}
+	gResourceRegistry.Track(constantBuffer);
 
 	return constantBuffer;
 }
 
 
+// Create and return a dynamic structured buffer holding the given number of elements, along with a shader resource view
+// for shaders to read it. Both need to be released before quitting. Returns nullptr on failure
+ID3D11Buffer* CreateStructuredBuffer(int elementSize, int numElements, ID3D11ShaderResourceView** shaderResourceView)
+{
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bufferDesc.ByteWidth = elementSize * numElements;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;             // Rewritten for each draw that uses it
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufferDesc.StructureByteStride = elementSize;
+	ID3D11Buffer* structuredBuffer;
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &structuredBuffer)))
+	{
+		return nullptr;
+	}
+	gResourceRegistry.Track(structuredBuffer);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN; // Structured buffers have no format
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = numElements;
+	if (FAILED(gD3DDevice->CreateShaderResourceView(structuredBuffer, &srvDesc, shaderResourceView)))
+	{
+		structuredBuffer->Release();
+		return nullptr;
+	}
+
+	return structuredBuffer;
+}
+
+
+ID3D11Buffer* CreateReadWriteStructuredBuffer(int elementSize, int numElements, ID3D11ShaderResourceView** shaderResourceView,
+                                              ID3D11UnorderedAccessView** unorderedAccessView, UINT uavFlags /*= 0*/)
+{
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	bufferDesc.ByteWidth = elementSize * numElements;
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT; // Only written by the GPU
+	bufferDesc.CPUAccessFlags = 0;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufferDesc.StructureByteStride = elementSize;
+	ID3D11Buffer* structuredBuffer;
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &structuredBuffer)))
+	{
+		return nullptr;
+	}
+	gResourceRegistry.Track(structuredBuffer);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = numElements;
+	if (FAILED(gD3DDevice->CreateShaderResourceView(structuredBuffer, &srvDesc, shaderResourceView)))
+	{
+		structuredBuffer->Release();
+		return nullptr;
+	}
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.NumElements = numElements;
+	uavDesc.Buffer.Flags = uavFlags;
+	if (FAILED(gD3DDevice->CreateUnorderedAccessView(structuredBuffer, &uavDesc, unorderedAccessView)))
+	{
+		(*shaderResourceView)->Release();
+		structuredBuffer->Release();
+		return nullptr;
+	}
+
+	return structuredBuffer;
+}
+
+
+ID3D11Buffer* CreateDispatchArgumentsBuffer(UINT groupsX, UINT groupsY, UINT groupsZ)
+{
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.ByteWidth = 3 * sizeof(UINT);
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT; // Written by the GPU (CopyStructureCount)
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS;
+	UINT groups[3] = { groupsX, groupsY, groupsZ };
+	D3D11_SUBRESOURCE_DATA initialData = { groups, 0, 0 };
+	ID3D11Buffer* argumentsBuffer;
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, &initialData, &argumentsBuffer)))
+	{
+		return nullptr;
+	}
+	gResourceRegistry.Track(argumentsBuffer);
+	return argumentsBuffer;
+}
+
+
+ID3D11Buffer* CreateDrawArgumentsBuffer(UINT numDraws, ID3D11UnorderedAccessView** unorderedAccessView)
+{
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.ByteWidth = numDraws * sizeof(DrawIndexedArguments);
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT; // Only written by the GPU
+	bufferDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS;
+	ID3D11Buffer* argumentsBuffer;
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &argumentsBuffer)))
+	{
+		return nullptr;
+	}
+	gResourceRegistry.Track(argumentsBuffer);
+
+	// Indirect argument buffers can't be structured, so the view is typed
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32_UINT;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.NumElements = numDraws * 5;
+	if (FAILED(gD3DDevice->CreateUnorderedAccessView(argumentsBuffer, &uavDesc, unorderedAccessView)))
+	{
+		argumentsBuffer->Release();
+		return nullptr;
+	}
+	return argumentsBuffer;
+}
+
+
@@ -7,6 +7,8 @@
 
 #include <d3d11.h>
 #include <string>
+#include <vector>
+#include <utility>
 
 //--------------------------------------------------------------------------------------
 // Global Variables
@@ -21,21 +23,101 @@ extern ID3D11VertexShader*   gPixelLightingVertexShader;
 extern ID3D11PixelShader*    gTintedTexturePixelShader;
 extern ID3D11PixelShader*    gPixelLightingPixelShader;
 
+// Instanced versions of the shaders above, reading world matrices and colours from the instance buffer
+extern ID3D11VertexShader*   gBasicTransformInstancedVertexShader;
+extern ID3D11VertexShader*   gPixelLightingInstancedVertexShader;
+extern ID3D11PixelShader*    gTintedTextureInstancedPixelShader;
+
+// Depth-only passes (depth pre-pass, shadow maps) - read only the position, so meshes are drawn from their position streams
+extern ID3D11VertexShader*   gDepthOnlyVertexShader;
+extern ID3D11VertexShader*   gDepthOnlyInstancedVertexShader;
+
+// Deferred shading - writes the G-buffer for the models, then lights it with a full screen quad
+extern ID3D11PixelShader*    gGBufferPixelShader;
+extern ID3D11PixelShader*    gDeferredLightingPixelShader;
+
+// MSAA - writes the nearest sample of the multisampled depth buffer into the single sample one (see RenderSceneFromCamera)
+extern ID3D11PixelShader*    gDepthResolvePixelShader;
+
+// Pre-skinning - skins the vertices of skinned models into vertex buffers through the stream-out stage (see Mesh::Skin)
+extern ID3D11VertexShader*   gSkinningVertexShader;
+extern ID3D11GeometryShader* gSkinningStreamOutShader;
+
+// Static batching - writes the vertices of models that never move into world space batches, also through the stream-out
+// stage (see StaticBatches.h)
+extern ID3D11VertexShader*   gStaticBakeVertexShader;
+extern ID3D11GeometryShader* gStaticBakeStreamOutShader;
+
+// GPU particles - drawn as camera-facing quads straight from the particle buffer (see ParticleSystem.h)
+extern ID3D11VertexShader*   gParticleVertexShader;
+extern ID3D11PixelShader*    gParticlePixelShader;
+
+// Sky - a full screen triangle at the far plane sampling the sky cubemap along each pixel's view direction (see Sky.h)
+extern ID3D11VertexShader*   gSkyVertexShader;
+extern ID3D11PixelShader*    gSkyPixelShader;
+
+// Light flares - every light drawn as a camera-facing quad from the flare buffer with one instanced draw, tinted by
+// gTintedTextureInstancedPixelShader (see LightFlareData in Common.h)
+extern ID3D11VertexShader*   gLightFlareVertexShader;
+
+// Impostors - distant models drawn as camera-facing quads blending views of their mesh captured into an atlas, and the
+// shader capturing those views (see Impostors.h)
+extern ID3D11VertexShader*   gImpostorVertexShader;
+extern ID3D11PixelShader*    gImpostorPixelShader;
+extern ID3D11PixelShader*    gImpostorCapturePixelShader;
+
 //*******************************
 //**** Post-processing shader DirectX objects
 extern ID3D11VertexShader* gFullScreenQuadVertexShader;
-extern ID3D11PixelShader*  gTintPostProcess;
+extern ID3D11VertexShader* gPostProcessVertexShader;    // The same with PASS_UV_TRANSFORM, for the post-process graph's passes
 extern ID3D11PixelShader*  gBlur_PostProcess;
 extern ID3D11PixelShader*  gPyramidBlur_PostProcess;
 extern ID3D11PixelShader*  gGaussianBlurH_PostProcess;
 extern ID3D11PixelShader*  gCopy_PostProcess;
 extern ID3D11PixelShader*  gGaussianBlurV_PostProcess;
-extern ID3D11PixelShader*  gUnderwater_PostProcess;
-extern ID3D11PixelShader*  gNoise_PostProcess;
-extern ID3D11PixelShader*  gPixellate_PostProcess;
-extern ID3D11PixelShader* gBitColour_PostProcess;
-extern ID3D11PixelShader* gBrightFilter_PostProcess;
 extern ID3D11PixelShader* gCombine_PostProcess;
+extern ID3D11PixelShader* gBloomDownsample_PostProcess;
+extern ID3D11PixelShader* gBloomBlur_PostProcess;
+extern ID3D11PixelShader* gBloomUpsample_PostProcess;
+extern ID3D11PixelShader* gProfilerOverlay_PostProcess;
+extern ID3D11PixelShader* gUpscale_PostProcess;
+extern ID3D11PixelShader* gExposure_PostProcess;
+extern ID3D11PixelShader* gDualFilterDownsample_PostProcess;
+extern ID3D11PixelShader* gDualFilterUpsample_PostProcess;
+extern ID3D11PixelShader* gFftBloomPack_PostProcess;
+extern ID3D11PixelShader* gFftBloomCombine_PostProcess;
+extern ID3D11PixelShader* gStarStreak_PostProcess;
+extern ID3D11PixelShader* gPyramidBlurMips_PostProcess;
+extern ID3D11PixelShader* gDepthOfFieldDownsample_PostProcess;
+extern ID3D11PixelShader* gDepthOfFieldBlur_PostProcess;
+extern ID3D11PixelShader* gDepthOfFieldCombine_PostProcess;
+extern ID3D11PixelShader* gFxaa_PostProcess;
+extern ID3D11PixelShader* gSmaaEdges_PostProcess;
+extern ID3D11PixelShader* gSmaaWeights_PostProcess;
+extern ID3D11PixelShader* gSmaaBlend_PostProcess;
+extern ID3D11PixelShader* gFog_PostProcess;
+extern ID3D11PixelShader* gReducedRateReconstruct_PostProcess;
+extern ID3D11PixelShader* gTemporalResolve_PostProcess;
+
+extern ID3D11ComputeShader* gGaussianBlurH_Compute;
+extern ID3D11ComputeShader* gGaussianBlurV_Compute;
+extern ID3D11ComputeShader* gSummedAreaTableRows_Compute;
+extern ID3D11ComputeShader* gSummedAreaTableColumns_Compute;
+extern ID3D11ComputeShader* gBloomTiles_Compute;
+extern ID3D11ComputeShader* gBloomTileBlur_Compute;
+extern ID3D11ComputeShader* gSpatialUpscale_Compute;
+extern ID3D11ComputeShader* gSharpen_Compute;
+extern ID3D11ComputeShader* gClusterLights_Compute;
+extern ID3D11ComputeShader* gLuminanceHistogram_Compute;
+extern ID3D11ComputeShader* gAutoExposure_Compute;
+extern ID3D11ComputeShader* gColourLut_Compute;
+extern ID3D11ComputeShader* gParticles_Compute;
+extern ID3D11ComputeShader* gParticleSortKeys_Compute;
+extern ID3D11ComputeShader* gBitonicSortBlock_Compute;
+extern ID3D11ComputeShader* gBitonicSortStep_Compute;
+extern ID3D11ComputeShader* gHiZ_Compute;
+extern ID3D11ComputeShader* gGpuCull_Compute;
+extern ID3D11ComputeShader* gGpuCullArgs_Compute;
 
 
 //--------------------------------------------------------------------------------------
@@ -57,6 +139,25 @@ void ReleaseShaders();
 // The returned pointer needs to be released before quitting. Returns nullptr on failure
 ID3D11Buffer* CreateConstantBuffer(int size);
 
+// Create and return a dynamic structured buffer holding the given number of elements, along with a shader resource view
+// for shaders to read it. Both need to be released before quitting. Returns nullptr on failure
+ID3D11Buffer* CreateStructuredBuffer(int elementSize, int numElements, ID3D11ShaderResourceView** shaderResourceView);
+
+// Create and return a structured buffer written by compute shaders, along with an unordered access view for the compute
+// shader and a shader resource view for later shaders to read it. All three need to be released before quitting. The
+// UAV flags can make it an append buffer (D3D11_BUFFER_UAV_FLAG_APPEND). Returns nullptr on failure
+ID3D11Buffer* CreateReadWriteStructuredBuffer(int elementSize, int numElements, ID3D11ShaderResourceView** shaderResourceView,
+                                              ID3D11UnorderedAccessView** unorderedAccessView, UINT uavFlags = 0);
+
+// Create and return a buffer of arguments for DispatchIndirect, starting with the given group counts (e.g. an append
+// buffer's count copied over x with CopyStructureCount). Needs to be released before quitting. Returns nullptr on failure
+ID3D11Buffer* CreateDispatchArgumentsBuffer(UINT groupsX, UINT groupsY, UINT groupsZ);
+
+// Create and return a buffer of arguments for the given number of DrawIndexedInstancedIndirect calls, along with an
+// unordered access view (R32_UINT, five for each draw) for a compute shader to write them. Both need to be released
+// before quitting. Returns nullptr on failure
+ID3D11Buffer* CreateDrawArgumentsBuffer(UINT numDraws, ID3D11UnorderedAccessView** unorderedAccessView);
+
 
 //--------------------------------------------------------------------------------------
 // Helper functions
@@ -67,12 +168,50 @@ ID3D11Buffer* CreateConstantBuffer(int size);
 ID3D11VertexShader*   LoadVertexShader  (std::string shaderName);
 ID3D11GeometryShader* LoadGeometryShader(std::string shaderName);
 ID3D11PixelShader*    LoadPixelShader   (std::string shaderName);
+ID3D11ComputeShader*  LoadComputeShader (std::string shaderName);
 
 // Special method to load a geometry shader that can use the stream-out stage, Use like the other functions in this file except
 // also pass the stream out declaration, number of entries in the declaration and the size of each output element. 
 // The returned pointer needs to be released before quitting. Returns nullptr on failure. 
 ID3D11GeometryShader* LoadStreamOutGeometryShader(std::string shaderName, D3D11_SO_DECLARATION_ENTRY* soDecl, unsigned int soNumEntries, unsigned int soStride);
 
+// Read the compiled bytecode of a shader from the asset pack or its .cso file, for shaders created after LoadShaders (see
+// EffectResources.h). Safe on any thread. Returns false on failure
+bool ReadShaderByteCode(const std::string& shaderName, std::vector<char>& byteCode);
+
+// Record the slots read by a newly created shader (see ShaderBindings.h). Main thread only. Returns false if its constant
+// buffers don't match the C++ code, with the reason in gLastError
+bool RegisterBindings(const void* shader, const void* byteCode, size_t size, const std::string& shaderName);
+
+
+//--------------------------------------------------------------------------------------
+// Shader permutations
+//--------------------------------------------------------------------------------------
+// Some shaders have #define "axes" (e.g. which effects are enabled, or a loop count) so that each combination compiles to a
+// specialised shader with constant loop bounds and no dead branches. A permutation is compiled from the .hlsl file the first
+// time it is requested and cached by shader name and defines, so selecting one each frame is just a lookup
+
+// Defines (name, value) selecting one permutation of a shader
+typedef std::vector<std::pair<std::string, std::string>> ShaderDefines;
+
+// Get the permutation of the given shader (name without the .hlsl extension) with the given defines. Returns nullptr on failure,
+// with the compiler errors in gLastError. The shaders are owned by the cache and released by ReleaseShaders
+ID3D11VertexShader*  GetVertexShaderPermutation (const std::string& shaderName, const ShaderDefines& defines);
+ID3D11PixelShader*   GetPixelShaderPermutation  (const std::string& shaderName, const ShaderDefines& defines);
+ID3D11ComputeShader* GetComputeShaderPermutation(const std::string& shaderName, const ShaderDefines& defines);
+
+
+// The bandwidth-bound post-processes (the fused colour effects, bright filter, combine and Gaussian blurs) have a
+// HALF_PRECISION axis that does their colour maths in min16float (see Common.hlsli). Whether the device runs it as
+// 16-bit in the pixel and compute shaders, asked once
+bool HalfPrecisionSupported();
+
+// The HALF_PRECISION 1 permutation of one of those shaders, given with its name without the .hlsl extension. Returns
+// the shader itself if the device has no 16-bit maths, the shader is null (not loaded yet) or the permutation doesn't
+// compile (it isn't tried again then)
+ID3D11PixelShader*   HalfPrecisionShader(ID3D11PixelShader*   shader, const std::string& shaderName);
+ID3D11ComputeShader* HalfPrecisionShader(ID3D11ComputeShader* shader, const std::string& shaderName);
+
 
 // Helper function. Returns nullptr on failure.
 ID3DBlob* CreateSignatureForVertexLayout(const D3D11_INPUT_ELEMENT_DESC vertexLayout[], int numElements);
@@ -0,0 +1,564 @@
+//--------------------------------------------------------------------------------------
+// Shader benchmark mode
+//--------------------------------------------------------------------------------------
+// See ShaderBenchmark.h for an overview
+
+#include "ShaderBenchmark.h"
+#include "EffectChain.h"
+#include "RenderTargetPool.h"
+#include "Scene.h"
+#include "Direct3DSetup.h"
+#include "PerfMetrics.h"
+#include "ResourceRegistry.h"
+#include "Shader.h"
+#include "Common.h"
+
+#include <d3d11.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Settings
+//--------------------------------------------------------------------------------------
+
+// Image sizes every effect is measured at
+struct ShaderBenchmarkResolution
+{
+	int width;
+	int height;
+};
+const ShaderBenchmarkResolution SHADER_BENCHMARK_RESOLUTIONS[] = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+
+// Times each combination is applied and measured, after one untimed run to compile shaders and fill the render target pool
+const int SHADER_BENCHMARK_RUNS = 200;
+
+
+//--------------------------------------------------------------------------------------
+// State
+//--------------------------------------------------------------------------------------
+
+// An effect to measure, with the setting swept and the values it takes. Effects without a key setting have one value
+struct ShaderBenchmarkEffect
+{
+	std::string        name;
+	Effect             effect;
+	std::string        parameter; // Empty if nothing is swept
+	std::vector<float> values;
+	std::function<void(EffectSettings&, float)> setup; // Sets the chain's settings for one of the values
+};
+
+// The synthetic input, noise so no effect gets an easy ride from flat colour, and a depth buffer for the depth-aware
+// effects sloping away from the camera up the screen
+struct ShaderBenchmarkImage
+{
+	ID3D11Texture2D*          texture  = nullptr; // With a full mip chain, for the pyramid blur's mip variant
+	ID3D11ShaderResourceView* input    = nullptr; // The top mip only, as the effects normally get
+	ID3D11ShaderResourceView* mipChain = nullptr;
+	ID3D11Texture2D*          depthTexture = nullptr;
+	ID3D11ShaderResourceView* depth        = nullptr;
+};
+
+// Results for one value of one effect at one size
+struct ShaderBenchmarkResult
+{
+	std::string name;
+	std::string parameter;
+	float       value;
+	int         width;
+	int         height;
+	int         passes;
+	float       medianMs;
+	float       minMs;
+	float       gbPerSecond;
+	int         halfMaxDifference = -1; // Largest channel difference of the half precision output, -1 if not compared
+	float       halfOutliers      = 0;  // Fraction of its pixels more than SHADER_BENCHMARK_HALF_LEVELS out
+};
+
+// Timestamps taken between every two runs of a combination, and the disjoint query giving their frequency
+struct ShaderBenchmarkQueries
+{
+	ID3D11Query*              disjoint = nullptr;
+	std::vector<ID3D11Query*> timestamps; // SHADER_BENCHMARK_RUNS + 1
+};
+
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+
+// The effects measured. Blur strengths and the pyramid blur radius are the widths in pixels the app's settings use, the
+// pyramid blur reads (2 * radius + 1) squared pixels so it is kept narrow to stay within the GPU timeout
+std::vector<ShaderBenchmarkEffect> ShaderBenchmarkEffects()
+{
+	auto nothing = [](EffectSettings&, float) {};
+	auto compute = [](EffectSettings& settings, float) { settings.computeShaders = true; };
+	auto gaussianBlur = [](BlurTechnique technique)
+	{
+		return [technique](EffectSettings& settings, float strength) { settings.blurTechnique = technique;
+		                                                               settings.blurStrength  = strength; };
+	};
+	const std::vector<float> blurStrengths = { 5, 10, 25, 50, 100 };
+
+	return
+	{
+		{ "Tint",                 Effect::Tint,         "",                     { 0 },                  nothing },
+		{ "Tint/compute",         Effect::Tint,         "",                     { 0 },                  compute },
+		{ "Underwater",           Effect::Underwater,   "",                     { 0 },                  nothing },
+		{ "Retro/pixelSize",      Effect::Retro,        "pixelSize",            { 2, 5, 10, 20, 40 },   [](EffectSettings& s, float v) { s.pixelSize = v; } },
+		{ "Retro/bitColour",      Effect::Retro,        "bitColour",            { 4, 16, 90, 256 },     [](EffectSettings& s, float v) { s.bitColour = v; } },
+		{ "Retro/compute",        Effect::Retro,        "bitColour",            { 4, 16, 90, 256 },     [](EffectSettings& s, float v) { s.bitColour = v;
+		                                                                                                                                 s.computeShaders = true; } },
+		{ "GaussianBlur/pixel",   Effect::GaussianBlur, "blurStrength",         blurStrengths,          gaussianBlur(BlurTechnique::Pixel) },
+		{ "GaussianBlur/compute", Effect::GaussianBlur, "blurStrength",         blurStrengths,          gaussianBlur(BlurTechnique::Compute) },
+		{ "GaussianBlur/quarterrate", Effect::GaussianBlur, "blurStrength",     blurStrengths,          [](EffectSettings& s, float v) { s.blurTechnique = BlurTechnique::Pixel;
+		                                                                                                                                 s.blurStrength  = v;
+		                                                                                                                                 s.reducedRate   = ShadingRate::Quarter; } },
+		{ "GaussianBlur/downsampled", Effect::GaussianBlur, "blurStrength",     blurStrengths,          gaussianBlur(BlurTechnique::Downsampled) },
+		{ "GaussianBlur/temporal", Effect::GaussianBlur, "blurStrength",        blurStrengths,          [](EffectSettings& s, float v) { s.blurStrength = v;
+		                                                                                                                                 s.temporal     = true; } },
+		{ "GaussianBlur/dualfilter",  Effect::GaussianBlur, "dualFilterIterations", { 1, 2, 4, 6 },     [](EffectSettings& s, float v) { s.dualFilterBlur = true;
+		                                                                                                                                 s.dualFilterIterations = static_cast<int>(v); } },
+		{ "Blur",                 Effect::Blur,         "blurStrength",         blurStrengths,          [](EffectSettings& s, float v) { s.blurStrength = v; } },
+		{ "PyramidBlur",          Effect::PyramidBlur,  "blurStrength",         { 2, 4, 8, 16 },        [](EffectSettings& s, float v) { s.blurStrength = v; } },
+		{ "PyramidBlur/halfrate", Effect::PyramidBlur,  "blurStrength",         { 2, 4, 8, 16 },        [](EffectSettings& s, float v) { s.blurStrength = v;
+		                                                                                                                                 s.reducedRate  = ShadingRate::Half; } },
+		{ "PyramidBlur/mips",     Effect::PyramidBlur,  "pyramidBlurLevel",     { 1, 2, 3, 4 },         [](EffectSettings& s, float v) { s.pyramidBlurLevel = s.pyramidBlurEdgeLevel = v; } },
+		{ "Bloom",                Effect::Bloom,        "",                     { 0 },                  nothing },
+		{ "Bloom/dualfilter",     Effect::Bloom,        "",                     { 0 },                  [](EffectSettings& s, float) { s.dualFilterBlur = true; } },
+		{ "Bloom/tiles",          Effect::Bloom,        "",                     { 0 },                  [](EffectSettings& s, float) { s.bloomTiles = true; } },
+		{ "Bloom/rgba8",          Effect::Bloom,        "",                     { 0 },                  [](EffectSettings& s, float) { s.blurFormat = DXGI_FORMAT_R8G8B8A8_UNORM; } },
+		{ "Bloom/temporal",       Effect::Bloom,        "",                     { 0 },                  [](EffectSettings& s, float) { s.temporal = true; } },
+		{ "Bloom/fft",            Effect::Bloom,        "",                     { 0 },                  [](EffectSettings& s, float) { s.fftBloom = true; } },
+		{ "StarFilter",           Effect::StarFilter,   "starIterations",       { 1, 2, 3 },            [](EffectSettings& s, float v) { s.starIterations = static_cast<int>(v); } },
+		{ "Upscale",              Effect::Upscale,      "inputUVScale",         { 0.5f, 0.75f },        [](EffectSettings& s, float v) { s.inputUVScale = s.inputUVMax = { v, v }; } },
+		{ "Upscale/spatial",      Effect::Upscale,      "inputUVScale",         { 0.5f, 0.75f },        [](EffectSettings& s, float v) { s.inputUVScale = s.inputUVMax = { v, v };
+		                                                                                                                                 s.spatialUpscale = true; } },
+		{ "DepthOfField",         Effect::DepthOfField, "dofBlurRadius",        { 4, 8, 16 },           [](EffectSettings& s, float v) { s.dofBlurRadius = v; } },
+		{ "Fog",                  Effect::Fog,          "",                     { 0 },                  nothing },
+		{ "Fog/compute",          Effect::Fog,          "",                     { 0 },                  compute },
+		{ "Fxaa",                 Effect::Fxaa,         "",                     { 0 },                  nothing },
+		{ "Smaa",                 Effect::Smaa,         "",                     { 0 },                  nothing },
+	};
+}
+
+
+// Create the synthetic input at the given size, returns false on error (reason in gLastError)
+bool CreateShaderBenchmarkImage(int width, int height, ShaderBenchmarkImage& image)
+{
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width     = width;
+	desc.Height    = height;
+	desc.MipLevels = 0; // Full chain
+	desc.ArraySize = 1;
+	desc.Format    = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage     = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET; // Render target for GenerateMips
+	desc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC inputDesc = {};
+	inputDesc.Format = desc.Format;
+	inputDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	inputDesc.Texture2D.MostDetailedMip = 0;
+	inputDesc.Texture2D.MipLevels = 1;
+
+	if (FAILED(gD3DDevice->CreateTexture2D(&desc, nullptr, &image.texture)) ||
+	    FAILED(gD3DDevice->CreateShaderResourceView(image.texture, &inputDesc, &image.input)) ||
+	    FAILED(gD3DDevice->CreateShaderResourceView(image.texture, nullptr, &image.mipChain)))
+	{
+		gLastError = "Error creating shader benchmark input";
+		return false;
+	}
+	gResourceRegistry.Track(image.texture);
+
+	std::mt19937 random(12345); // The same image every run
+	std::vector<uint32_t> pixels(static_cast<size_t>(width) * height);
+	for (auto& pixel : pixels)  pixel = random() | 0xff000000; // Opaque
+	gD3DContext->UpdateSubresource(image.texture, 0, nullptr, pixels.data(), width * 4, 0);
+	gD3DContext->GenerateMips(image.mipChain);
+
+	// Depth buffer values from the near clip at the bottom of the screen to the far clip (sky) at the top
+	std::vector<float> depths(static_cast<size_t>(width) * height);
+	for (int y = 0; y < height; ++y)
+	{
+		float depth = 1.0f - static_cast<float>(y) / height * 0.02f;
+		std::fill(depths.begin() + static_cast<size_t>(y) * width, depths.begin() + static_cast<size_t>(y + 1) * width, depth);
+	}
+	D3D11_SUBRESOURCE_DATA depthData = { depths.data(), static_cast<UINT>(width * sizeof(float)), 0 };
+	desc.MipLevels = 1;
+	desc.Format    = DXGI_FORMAT_R32_FLOAT;
+	desc.Usage     = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.MiscFlags = 0;
+	if (FAILED(gD3DDevice->CreateTexture2D(&desc, &depthData, &image.depthTexture)) ||
+	    FAILED(gD3DDevice->CreateShaderResourceView(image.depthTexture, nullptr, &image.depth)))
+	{
+		gLastError = "Error creating shader benchmark depth buffer";
+		return false;
+	}
+	gResourceRegistry.Track(image.depthTexture);
+	return true;
+}
+
+void ReleaseShaderBenchmarkImage(ShaderBenchmarkImage& image)
+{
+	if (image.depth)         image.depth->Release();
+	if (image.depthTexture)  image.depthTexture->Release();
+	if (image.mipChain)      image.mipChain->Release();
+	if (image.input)         image.input->Release();
+	if (image.texture)       image.texture->Release();
+	image = ShaderBenchmarkImage();
+}
+
+
+// Set up a one-effect chain for one value of an effect
+void SetUpShaderBenchmarkChain(EffectChain& chain, const ShaderBenchmarkEffect& effect, float value, const ShaderBenchmarkImage& image)
+{
+	chain.Add(effect.effect);
+	chain.Settings().depth = image.depth;
+	if (effect.name == "PyramidBlur/mips")  chain.Settings().inputMipChain = image.mipChain;
+	effect.setup(chain.Settings(), value);
+}
+
+
+// Apply the chain SHADER_BENCHMARK_RUNS times to the input, writing the time of each run in milliseconds. Returns false
+// on error (reason in gLastError)
+bool MeasureEffectChain(EffectChain& chain, ID3D11ShaderResourceView* input, ID3D11RenderTargetView* output,
+                        ShaderBenchmarkQueries& queries, std::vector<float>& times)
+{
+	if (!chain.Apply(input, output))  return false; // Warm up
+
+	bool ok = true;
+	gD3DContext->Begin(queries.disjoint);
+	gD3DContext->End(queries.timestamps[0]);
+	for (int i = 0; i < SHADER_BENCHMARK_RUNS && ok; ++i)
+	{
+		ok = chain.Apply(input, output);
+		gD3DContext->End(queries.timestamps[i + 1]);
+	}
+	gD3DContext->End(queries.disjoint);
+	gD3DContext->Flush();
+
+	// Wait for all the results even after an error, so the queries can be reused
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointData;
+	HRESULT result;
+	while ((result = gD3DContext->GetData(queries.disjoint, &disjointData, sizeof(disjointData), 0)) == S_FALSE) {}
+	if (!ok)  return false;
+	if (result != S_OK || disjointData.Disjoint)
+	{
+		gLastError = "Error reading the GPU clock in the shader benchmark";
+		return false;
+	}
+
+	std::vector<UINT64> timestamps(queries.timestamps.size());
+	for (size_t i = 0; i < timestamps.size(); ++i)
+	{
+		while ((result = gD3DContext->GetData(queries.timestamps[i], &timestamps[i], sizeof(UINT64), 0)) == S_FALSE) {}
+		if (result != S_OK)
+		{
+			gLastError = "Error reading the GPU clock in the shader benchmark";
+			return false;
+		}
+	}
+	times.clear();
+	for (size_t i = 1; i < timestamps.size(); ++i)
+	{
+		times.push_back(static_cast<float>(timestamps[i] - timestamps[i - 1]) / disjointData.Frequency * 1000.0f);
+	}
+	return true;
+}
+
+
+// Apply one value of an effect once with a new chain, with or without the half precision shaders, and read back the
+// output through the staging texture. Returns false on error (reason in gLastError)
+bool ReadShaderBenchmarkOutput(const ShaderBenchmarkEffect& effect, float value, const ShaderBenchmarkImage& image,
+                               PooledTarget* output, ID3D11Texture2D* staging, bool halfPrecision, std::vector<uint32_t>& pixels)
+{
+	EffectChain chain;
+	SetUpShaderBenchmarkChain(chain, effect, value, image);
+	chain.Settings().halfPrecision = halfPrecision;
+	if (!chain.Apply(image.input, output->renderTarget))  return false;
+	gD3DContext->CopyResource(staging, output->texture);
+
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(gD3DContext->Map(staging, 0, D3D11_MAP_READ, 0, &mapped)))
+	{
+		gLastError = "Error reading back shader benchmark output";
+		return false;
+	}
+	pixels.resize(static_cast<size_t>(output->width) * output->height);
+	for (int y = 0; y < output->height; ++y)
+	{
+		std::memcpy(&pixels[static_cast<size_t>(y) * output->width],
+		            static_cast<const char*>(mapped.pData) + static_cast<size_t>(y) * mapped.RowPitch, output->width * 4);
+	}
+	gD3DContext->Unmap(staging, 0);
+	return true;
+}
+
+// Compare the half precision output of one value of an effect with its full precision output, writing the largest
+// difference of any channel in 8-bit levels and the fraction of pixels with a channel more than
+// SHADER_BENCHMARK_HALF_LEVELS out to the result. Returns false on error (reason in gLastError)
+bool CompareHalfPrecisionOutput(const ShaderBenchmarkEffect& effect, float value, const ShaderBenchmarkImage& image,
+                                PooledTarget* output, ID3D11Texture2D* staging, ShaderBenchmarkResult& result)
+{
+	std::vector<uint32_t> full, half;
+	if (!ReadShaderBenchmarkOutput(effect, value, image, output, staging, false, full) ||
+	    !ReadShaderBenchmarkOutput(effect, value, image, output, staging, true,  half))  return false;
+
+	int maxDifference = 0;
+	size_t outliers = 0;
+	for (size_t i = 0; i < full.size(); ++i)
+	{
+		int difference = 0;
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			int fullLevel = (full[i] >> shift) & 0xff;
+			int halfLevel = (half[i] >> shift) & 0xff;
+			difference = std::max(difference, std::abs(fullLevel - halfLevel));
+		}
+		maxDifference = std::max(maxDifference, difference);
+		if (difference > SHADER_BENCHMARK_HALF_LEVELS)  ++outliers;
+	}
+	result.halfMaxDifference = maxDifference;
+	result.halfOutliers = full.empty() ? 0 : static_cast<float>(outliers) / full.size();
+	return true;
+}
+
+
+// Name, parameter, value and size identify a result, the same key for it in this run and in a baseline file
+std::string ShaderBenchmarkKey(const std::string& name, const std::string& parameter, float value, int width, int height)
+{
+	std::ostringstream key;
+	key << name << "," << parameter << "," << value << "," << width << "," << height;
+	return key.str();
+}
+
+// Write all results to the CSV file, returns false on failure (reason in gLastError)
+bool WriteShaderBenchmarkResults(const std::string& resultsFile, const std::vector<ShaderBenchmarkResult>& results)
+{
+	std::ofstream file(resultsFile);
+	if (!file.is_open())
+	{
+		gLastError = "Error writing shader benchmark results to " + resultsFile;
+		return false;
+	}
+
+	file << "Effect,Parameter,Value,Width,Height,Passes,Runs,MedianMs,MinMs,GBPerSecond,HalfMaxDifference,HalfOutliers\n";
+	for (auto& result : results)
+	{
+		file << ShaderBenchmarkKey(result.name, result.parameter, result.value, result.width, result.height) << ","
+		     << result.passes << "," << SHADER_BENCHMARK_RUNS << "," << result.medianMs << "," << result.minMs << ","
+		     << result.gbPerSecond << "," << result.halfMaxDifference << "," << result.halfOutliers << "\n";
+	}
+	return !file.fail();
+}
+
+// List the results more than SHADER_BENCHMARK_TOLERANCE slower than in the baseline file in the debugger output,
+// returns the number of them. Entries missing from either side are skipped, so effects can be added or removed
+int CompareShaderBenchmarkBaseline(const std::string& baselineFile, const std::vector<ShaderBenchmarkResult>& results)
+{
+	std::ifstream file(baselineFile);
+	if (!file.is_open())
+	{
+		OutputDebugStringA(("Shader benchmark baseline " + baselineFile + " not found, nothing compared\n").c_str());
+		return 0;
+	}
+
+	// The key is the first five fields, the median time the eighth
+	std::vector<std::pair<std::string, float>> baseline;
+	std::string line;
+	std::getline(file, line); // Header
+	while (std::getline(file, line))
+	{
+		std::vector<std::string> fields;
+		std::istringstream values(line);
+		std::string field;
+		while (std::getline(values, field, ','))  fields.push_back(field);
+		if (fields.size() < 8)  continue;
+		std::string key = fields[0] + "," + fields[1] + "," + fields[2] + "," + fields[3] + "," + fields[4];
+		baseline.push_back({ key, std::strtof(fields[7].c_str(), nullptr) });
+	}
+
+	int regressions = 0;
+	for (auto& result : results)
+	{
+		std::string key = ShaderBenchmarkKey(result.name, result.parameter, result.value, result.width, result.height);
+		auto found = std::find_if(baseline.begin(), baseline.end(), [&](const std::pair<std::string, float>& entry) { return entry.first == key; });
+		if (found == baseline.end() || result.medianMs <= found->second * (1 + SHADER_BENCHMARK_TOLERANCE))  continue;
+
+		std::ostringstream report;
+		report.precision(3);
+		report << std::fixed << "Shader benchmark regression: " << key << " " << result.medianMs << "ms, baseline "
+		       << found->second << "ms\n";
+		OutputDebugStringA(report.str().c_str());
+		++regressions;
+	}
+	return regressions;
+}
+
+
+// Measure every value of the effects passing the filter at one size, adding to the results
+bool RunShaderBenchmarkResolution(const ShaderBenchmarkResolution& resolution, const std::vector<ShaderBenchmarkEffect>& effects,
+                                  const std::string& filter, ShaderBenchmarkQueries& queries, std::vector<ShaderBenchmarkResult>& results)
+{
+	ShaderBenchmarkImage image;
+	PooledTarget* output = nullptr;
+	bool ok = CreateShaderBenchmarkImage(resolution.width, resolution.height, image);
+	if (ok)
+	{
+		output = gRenderTargetPool.Acquire(resolution.width, resolution.height, DXGI_FORMAT_R8G8B8A8_UNORM);
+		ok = (output != nullptr);
+	}
+
+	// The outputs are only compared where the half precision shaders are used
+	ID3D11Texture2D* staging = nullptr;
+	if (ok && HalfPrecisionSupported())
+	{
+		D3D11_TEXTURE2D_DESC desc = {};
+		desc.Width     = resolution.width;
+		desc.Height    = resolution.height;
+		desc.MipLevels = 1;
+		desc.ArraySize = 1;
+		desc.Format    = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.SampleDesc.Count = 1;
+		desc.Usage     = D3D11_USAGE_STAGING;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		ok = SUCCEEDED(gD3DDevice->CreateTexture2D(&desc, nullptr, &staging));
+		if (ok)  gResourceRegistry.Track(staging);
+		else     gLastError = "Error creating shader benchmark staging texture";
+	}
+
+	std::vector<float> times;
+	for (auto& effect : effects)
+	{
+		if (!ok)  break;
+		if (!filter.empty() && effect.name.find(filter) == std::string::npos)  continue;
+
+		for (float value : effect.values)
+		{
+			EffectChain chain;
+			SetUpShaderBenchmarkChain(chain, effect, value, image);
+
+			ok = MeasureEffectChain(chain, image.input, output->renderTarget, queries, times);
+			if (!ok)  break;
+
+			// Every run is a sample, so the regression gate knows how noisy each combination is
+			std::ostringstream metric;
+			metric << "shader_ms/" << effect.name;
+			if (!effect.parameter.empty())  metric << "/" << effect.parameter << "=" << value;
+			metric << "/" << resolution.width << "x" << resolution.height;
+			for (float time : times)  gPerfMetrics.AddSample(metric.str(), "ms", time);
+
+			std::sort(times.begin(), times.end());
+			ShaderBenchmarkResult result;
+			result.name      = effect.name;
+			result.parameter = effect.parameter;
+			result.value     = value;
+			result.width     = resolution.width;
+			result.height    = resolution.height;
+			result.passes    = chain.NumPasses();
+			result.medianMs  = times[times.size() / 2];
+			result.minMs     = times.front();
+			double bytes = 2.0 * resolution.width * resolution.height * 4; // Read and write RGBA8 once
+			result.gbPerSecond = (result.medianMs > 0) ? static_cast<float>(bytes / (result.medianMs * 1e-3) / 1e9) : 0;
+			ok = (staging == nullptr) || CompareHalfPrecisionOutput(effect, value, image, output, staging, result);
+			if (!ok)  break;
+			results.push_back(result);
+
+			std::ostringstream report;
+			report.precision(3);
+			report << std::fixed << ShaderBenchmarkKey(result.name, result.parameter, value, result.width, result.height)
+			       << ": " << result.medianMs << "ms, " << result.gbPerSecond << " GB/s";
+			if (result.halfMaxDifference >= 0)
+			{
+				report << ", half precision up to " << result.halfMaxDifference << " levels out, " << result.halfOutliers * 100
+				       << "% of pixels over " << SHADER_BENCHMARK_HALF_LEVELS;
+				if (result.halfOutliers > SHADER_BENCHMARK_HALF_OUTLIERS)  report << " - MISMATCH";
+			}
+			report << "\n";
+			OutputDebugStringA(report.str().c_str());
+		}
+	}
+
+	if (staging)  staging->Release();
+	if (output)   gRenderTargetPool.Return(output);
+	ReleaseShaderBenchmarkImage(image);
+	gRenderTargetPool.ReleaseUnused(); // None of this size will be needed again
+	return ok;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Shader benchmark
+//--------------------------------------------------------------------------------------
+
+// Run every effect passing the filter at every size and write the results
+bool RunShaderBenchmark(const std::string& resultsFile, const std::string& filter, const std::string& baselineFile)
+{
+	// The device is created at the smallest size, the benchmark draws to its own targets rather than the back buffer
+	gViewportWidth  = SHADER_BENCHMARK_RESOLUTIONS[0].width;
+	gViewportHeight = SHADER_BENCHMARK_RESOLUTIONS[0].height;
+	if (!InitDirect3D())
+	{
+		ShutdownDirect3D();
+		return false;
+	}
+
+	bool ok = InitGeometry();
+	std::vector<ShaderBenchmarkResult> results;
+	ShaderBenchmarkQueries queries;
+	if (ok)
+	{
+		OutputDebugStringA(("Shader benchmark on " + DeviceDescription() + "\n").c_str());
+
+		D3D11_QUERY_DESC queryDesc = {};
+		queryDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+		ok = SUCCEEDED(gD3DDevice->CreateQuery(&queryDesc, &queries.disjoint));
+		queryDesc.Query = D3D11_QUERY_TIMESTAMP;
+		queries.timestamps.resize(SHADER_BENCHMARK_RUNS + 1, nullptr);
+		for (auto& timestamp : queries.timestamps)  ok = ok && SUCCEEDED(gD3DDevice->CreateQuery(&queryDesc, &timestamp));
+		if (!ok)  gLastError = "Error creating queries for the shader benchmark";
+
+		auto effects = ShaderBenchmarkEffects();
+		for (auto& resolution : SHADER_BENCHMARK_RESOLUTIONS)
+		{
+			if (!ok)  break;
+			ok = RunShaderBenchmarkResolution(resolution, effects, filter, queries, results);
+		}
+		if (ok)  ok = WriteShaderBenchmarkResults(resultsFile, results) && gPerfMetrics.Write(MetricsFileName(resultsFile));
+	}
+
+	for (auto timestamp : queries.timestamps)  if (timestamp)  timestamp->Release();
+	if (queries.disjoint)  queries.disjoint->Release();
+	ReleaseResources();
+	ShutdownDirect3D();
+
+	if (ok && !baselineFile.empty())
+	{
+		int regressions = CompareShaderBenchmarkBaseline(baselineFile, results);
+		if (regressions > 0)
+		{
+			gLastError = std::to_string(regressions) + " shader benchmark results slower than " + baselineFile;
+			return false;
+		}
+	}
+	if (ok)
+	{
+		auto mismatches = std::count_if(results.begin(), results.end(), [](const ShaderBenchmarkResult& result)
+		                                { return result.halfOutliers > SHADER_BENCHMARK_HALF_OUTLIERS; });
+		if (mismatches > 0)
+		{
+			gLastError = std::to_string(mismatches) + " shader benchmark results differ at half precision";
+			return false;
+		}
+	}
+	return ok;
+}
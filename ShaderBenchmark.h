@@ -0,0 +1,43 @@
+//--------------------------------------------------------------------------------------
+// Shader benchmark mode
+//--------------------------------------------------------------------------------------
+// Times each post-process on its own over a synthetic image, with no window or scene, so shader regressions show up on
+// the build agents before anyone sees them. Run with the -shaderbenchmark command line switch (optionally followed by
+// the CSV file name to write), -shaderfilter to run only the effects whose names contain some text, -baseline with the
+// CSV from an earlier run to compare against and -warp to use the software rasteriser.
+//
+// Each effect runs as a one-effect EffectChain, as BlurSelector measures the blurs, so its shaders get the same inputs,
+// constants and intermediate targets as in the app. Compute variants (e.g. the compute shader Gaussian blur) are
+// separate entries. Every effect runs at 720p, 1080p, 1440p and 4K, for each value of its key setting (e.g. blur
+// strength 5 to 100, retro pixel size and colour levels). Each combination is applied a few hundred times with a GPU
+// timestamp between every two, and the median time is written along with an effective bandwidth: one read of the input
+// and one write of the output per pixel over that time, so multi-pass effects show less than the memory system
+// really moved (it compares builds, not effects). Every run is also added to the performance metrics (see
+// PerfMetrics.h), written to a .json file of the same name for the PerfGate regression check.
+//
+// On GPUs with 16-bit shader maths the effects use their half precision shaders (see EffectChain.h), so each
+// combination is also applied once with full precision and once with half, and the two outputs compared. The largest
+// difference of any channel and the fraction of pixels more than SHADER_BENCHMARK_HALF_LEVELS out are written with the
+// times, and a combination with more than SHADER_BENCHMARK_HALF_OUTLIERS of its pixels out fails the run
+
+#ifndef _SHADER_BENCHMARK_H_INCLUDED_
+#define _SHADER_BENCHMARK_H_INCLUDED_
+
+#include <string>
+
+// A result more than this fraction slower than the baseline counts as a regression
+const float SHADER_BENCHMARK_TOLERANCE = 0.1f;
+
+// 8-bit levels a channel of the half precision output may differ from full precision by, and the fraction of pixels
+// allowed further out. A few pixels on the boundaries of retro's colour steps round the other way
+const int   SHADER_BENCHMARK_HALF_LEVELS   = 2;
+const float SHADER_BENCHMARK_HALF_OUTLIERS = 0.01f;
+
+// Run every effect whose name contains the filter (all if empty) and write the results to the given CSV file. If a
+// baseline file is given, results slower than the same entry in it are listed in the debugger output. Creates and shuts
+// down Direct3D itself, so call UseHeadless first and don't call InitDirect3D. Returns false on failure or if there
+// were any regressions or half precision mismatches (reason in gLastError)
+bool RunShaderBenchmark(const std::string& resultsFile, const std::string& filter, const std::string& baselineFile);
+
+
+#endif //_SHADER_BENCHMARK_H_INCLUDED_
@@ -0,0 +1,133 @@
+//--------------------------------------------------------------------------------------
+// Shader bindings
+//--------------------------------------------------------------------------------------
+
+#include "ShaderBindings.h"
+
+#include <d3dcompiler.h>
+#include <d3d11shader.h>
+#include <cstring>
+
+
+ShaderBindings gShaderBindings;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+void ShaderBindings::DeclareConstantBuffer(const std::string& name, UINT slot, size_t size)
+{
+	mDeclaredBuffers[name] = { slot, size };
+}
+
+
+bool ShaderBindings::Register(const void* shader, const void* byteCode, size_t byteCodeSize, const std::string& shaderName, std::string& error)
+{
+	ID3D11ShaderReflection* reflection = nullptr;
+	if (FAILED(D3DReflect(byteCode, byteCodeSize, IID_ID3D11ShaderReflection, reinterpret_cast<void**>(&reflection))))
+	{
+		error = "Error reflecting shader " + shaderName;
+		return false;
+	}
+
+	D3D11_SHADER_DESC shaderDesc;
+	reflection->GetDesc(&shaderDesc);
+
+	ShaderUsage usage = {};
+	for (UINT i = 0; i < shaderDesc.BoundResources; ++i)
+	{
+		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
+		reflection->GetResourceBindingDesc(i, &bindDesc);
+		for (UINT slot = bindDesc.BindPoint; slot < bindDesc.BindPoint + bindDesc.BindCount; ++slot)
+		{
+			if (bindDesc.Type == D3D_SIT_CBUFFER && slot < 32)        usage.constantBuffers |= 1u << slot;
+			else if (bindDesc.Type == D3D_SIT_SAMPLER && slot < 32)   usage.samplers        |= 1u << slot;
+			else if ((bindDesc.Type == D3D_SIT_TEXTURE || bindDesc.Type == D3D_SIT_TBUFFER ||
+			          bindDesc.Type == D3D_SIT_STRUCTURED || bindDesc.Type == D3D_SIT_BYTEADDRESS) && slot < 64)
+			{
+				usage.shaderResources |= 1ull << slot;
+			}
+		}
+
+		// Check the cbuffer against the C++ structure. HLSL sizes are rounded up to 16 bytes, as are the C++ buffers (see CreateConstantBuffer)
+		if (bindDesc.Type != D3D_SIT_CBUFFER)  continue;
+		auto declared = mDeclaredBuffers.find(bindDesc.Name);
+		if (declared == mDeclaredBuffers.end())  continue;
+
+		D3D11_SHADER_BUFFER_DESC bufferDesc;
+		reflection->GetConstantBufferByName(bindDesc.Name)->GetDesc(&bufferDesc);
+		size_t expectedSize = 16 * ((declared->second.size + 15) / 16);
+		if (bindDesc.BindPoint != declared->second.slot)
+		{
+			error = shaderName + ": cbuffer " + bindDesc.Name + " is in register b" + std::to_string(bindDesc.BindPoint) +
+			        " but the C++ code uses slot " + std::to_string(declared->second.slot);
+			reflection->Release();
+			return false;
+		}
+		if (bufferDesc.Size != expectedSize)
+		{
+			error = shaderName + ": cbuffer " + bindDesc.Name + " is " + std::to_string(bufferDesc.Size) +
+			        " bytes but the C++ structure is " + std::to_string(expectedSize) + " bytes";
+			reflection->Release();
+			return false;
+		}
+	}
+
+	// Note vertex shaders reading only the position. System values such as SV_InstanceID aren't read from the vertex buffers
+	if (D3D11_SHVER_GET_TYPE(shaderDesc.Version) == D3D11_SHVER_VERTEX_SHADER)
+	{
+		bool readsPosition = false, readsOthers = false;
+		for (UINT i = 0; i < shaderDesc.InputParameters; ++i)
+		{
+			D3D11_SIGNATURE_PARAMETER_DESC parameterDesc;
+			reflection->GetInputParameterDesc(i, &parameterDesc);
+			if (parameterDesc.SystemValueType != D3D_NAME_UNDEFINED)  continue;
+			if (_stricmp(parameterDesc.SemanticName, "position") == 0)  readsPosition = true;
+			else                                                          readsOthers   = true;
+		}
+		usage.positionOnly = readsPosition && !readsOthers;
+	}
+	reflection->Release();
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mShaders[shader] = usage;
+	return true;
+}
+
+
+void ShaderBindings::Unregister(const void* shader)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mShaders.erase(shader);
+}
+
+void ShaderBindings::Clear()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mShaders.clear();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Data access
+//--------------------------------------------------------------------------------------
+
+bool ShaderBindings::Find(const void* shader, ShaderUsage& usage)
+{
+	if (shader == nullptr)
+	{
+		usage = {};
+		return true;
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto found = mShaders.find(shader);
+	if (found == mShaders.end())
+	{
+		usage = { ~0u, ~0u, ~0ull };
+		return false;
+	}
+	usage = found->second;
+	return true;
+}
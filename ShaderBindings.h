@@ -0,0 +1,84 @@
+//--------------------------------------------------------------------------------------
+// Shader bindings
+//--------------------------------------------------------------------------------------
+// Uses shader reflection to record which constant buffers, shader resources and samplers each shader actually reads
+// (the compiler removes any declared but unused). The state cache uses this to bind a constant buffer or sampler only
+// to the stages whose current shader reads it - see StateCache::SetConstantBuffer. Vertex shaders that read nothing of
+// a vertex but its position are noted too, meshes draw those from their position streams (see Mesh::SetSubMeshBuffers).
+//
+// The C++ structures for the constant buffers are declared with their slot and size, and every shader that uses one
+// of those cbuffers is checked against the declaration when it is registered. A cbuffer that has been moved to another
+// register, or has a different size to the C++ structure, is reported as a load error rather than seen as bad rendering.
+
+#ifndef _SHADER_BINDINGS_H_INCLUDED_
+#define _SHADER_BINDINGS_H_INCLUDED_
+
+#include <d3d11.h>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+
+// Slots read by one shader, one bit per slot
+struct ShaderUsage
+{
+	uint32_t constantBuffers; // 14 slots
+	uint32_t samplers;        // 16 slots
+	uint64_t shaderResources; // Only the first 64 of the 128 slots are recorded, higher slots are never used here
+	bool     positionOnly;    // A vertex shader whose only vertex input is the position (see Mesh::SetSubMeshBuffers)
+};
+
+
+class ShaderBindings
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Declare the slot and C++ size of a cbuffer. Shaders using that cbuffer are checked against it when registered
+	void DeclareConstantBuffer(const std::string& name, UINT slot, size_t size);
+
+	// Reflect the bytecode of a shader and record what it reads. Returns false, with the reason in error, if the bytecode
+	// can't be reflected or a cbuffer doesn't match its declaration. Safe to call from any thread
+	bool Register(const void* shader, const void* byteCode, size_t byteCodeSize, const std::string& shaderName, std::string& error);
+
+	// Forget a shader, call before releasing it (a new shader could be created at the same address)
+	void Unregister(const void* shader);
+
+	// Forget all shaders
+	void Clear();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// Get the slots read by a shader. A null shader reads nothing. Returns false for a shader that has not been registered,
+	// with usage set to every slot
+	bool Find(const void* shader, ShaderUsage& usage);
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	struct DeclaredBuffer
+	{
+		UINT   slot;
+		size_t size;
+	};
+
+	std::map<std::string, DeclaredBuffer> mDeclaredBuffers; // Declared once at start up, before any shader is registered
+
+	std::mutex                                   mMutex; // Guards mShaders, render worker threads look up shaders too
+	std::unordered_map<const void*, ShaderUsage> mShaders;
+};
+
+
+extern ShaderBindings gShaderBindings;
+
+
+#endif //_SHADER_BINDINGS_H_INCLUDED_
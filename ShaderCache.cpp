@@ -0,0 +1,225 @@
+//--------------------------------------------------------------------------------------
+// Compiled shader cache
+//--------------------------------------------------------------------------------------
+
+#include "ShaderCache.h"
+
+#include <Windows.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <functional>
+
+
+ShaderCache gShaderCache;
+
+
+//--------------------------------------------------------------------------------------
+// Hashing
+//--------------------------------------------------------------------------------------
+
+namespace
+{
+	// 64-bit FNV-1a
+	const uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+	const uint64_t FNV_PRIME  = 0x100000001b3ull;
+
+	void HashBytes(uint64_t& hash, const void* data, size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash = (hash ^ bytes[i]) * FNV_PRIME;
+		}
+	}
+
+	// Strings are hashed with their terminator, so "ab" + "c" and "a" + "bc" hash differently
+	void HashString(uint64_t& hash, const char* string)
+	{
+		if (string == nullptr)  string = "";
+		HashBytes(hash, string, std::strlen(string) + 1);
+	}
+
+	// Read a whole file as text, returns false if it can't be opened
+	bool ReadFile(const std::string& fileName, std::string& text)
+	{
+		std::ifstream file(fileName, std::ios::in | std::ios::binary);
+		if (!file.is_open())  return false;
+		std::ostringstream contents;
+		contents << file.rdbuf();
+		text = contents.str();
+		return true;
+	}
+
+	// Directory part of a path including the final slash, or an empty string
+	std::string DirectoryOf(const std::string& path)
+	{
+		size_t slash = path.find_last_of("\\/");
+		return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	}
+}
+
+
+uint64_t ShaderCache::Hash(const std::string& source, const std::string& sourceName, const D3D_SHADER_MACRO* defines,
+                           const char* entryPoint, const char* target, UINT flags)
+{
+	uint64_t hash = FNV_OFFSET;
+	HashBytes(hash, source.data(), source.size());
+	HashIncludes(source, sourceName, hash, 0);
+	for (auto define = defines; define != nullptr && define->Name != nullptr; ++define)
+	{
+		HashString(hash, define->Name);
+		HashString(hash, define->Definition);
+	}
+	HashString(hash, "");
+	HashString(hash, entryPoint);
+	HashString(hash, target);
+	HashBytes(hash, &flags, sizeof(flags));
+	const int compilerVersion = D3D_COMPILER_VERSION;
+	HashBytes(hash, &compilerVersion, sizeof(compilerVersion));
+	return hash;
+}
+
+
+// Looks for #include "file" lines. Includes inside inactive #if blocks are hashed too, which is harmless. Files that
+// can't be opened are skipped here - the compiler will report them
+void ShaderCache::HashIncludes(const std::string& source, const std::string& sourceName, uint64_t& hash, int depth)
+{
+	if (depth > 16)  return; // Recursive includes, the compiler will report them
+
+	std::istringstream lines(source);
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		size_t hashSign = line.find_first_not_of(" \t");
+		if (hashSign == std::string::npos || line.compare(hashSign, 8, "#include") != 0)  continue;
+		size_t open = line.find_first_of("\"<", hashSign + 8);
+		if (open == std::string::npos)  continue;
+		size_t close = line.find_first_of("\">", open + 1);
+		if (close == std::string::npos)  continue;
+
+		std::string includeName = DirectoryOf(sourceName) + line.substr(open + 1, close - open - 1);
+		std::string includeSource;
+		if (!ReadFile(includeName, includeSource))  continue;
+		HashString(hash, includeName.c_str());
+		HashBytes(hash, includeSource.data(), includeSource.size());
+		HashIncludes(includeSource, includeName, hash, depth + 1);
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Compiling
+//--------------------------------------------------------------------------------------
+
+ID3DBlob* ShaderCache::Compile(const std::string& source, const std::string& sourceName, const D3D_SHADER_MACRO* defines,
+                               const char* entryPoint, const char* target, UINT flags, std::string* errors)
+{
+	uint64_t hash = Hash(source, sourceName, defines, entryPoint, target, flags);
+	ID3DBlob* byteCode = Load(hash);
+	if (byteCode != nullptr)
+	{
+		++mNumHits;
+		return byteCode;
+	}
+	++mNumMisses;
+
+	// The standard include handler finds includes relative to the source name, as HashIncludes does
+	ID3DBlob* compilerErrors = nullptr;
+	HRESULT hr = D3DCompile(source.data(), source.size(), sourceName.empty() ? nullptr : sourceName.c_str(), defines,
+	                        D3D_COMPILE_STANDARD_FILE_INCLUDE, entryPoint, target, flags, 0, &byteCode, &compilerErrors);
+	if (FAILED(hr))
+	{
+		if (errors != nullptr && compilerErrors != nullptr)
+		{
+			*errors = std::string(static_cast<const char*>(compilerErrors->GetBufferPointer()), compilerErrors->GetBufferSize());
+		}
+		if (compilerErrors != nullptr)  compilerErrors->Release();
+		return nullptr;
+	}
+	if (compilerErrors != nullptr)  compilerErrors->Release(); // Warnings
+
+	Store(hash, byteCode);
+	return byteCode;
+}
+
+
+ID3DBlob* ShaderCache::CompileFile(const std::string& fileName, const D3D_SHADER_MACRO* defines,
+                                   const char* entryPoint, const char* target, UINT flags, std::string* errors)
+{
+	std::string source;
+	if (!ReadFile(fileName, source))
+	{
+		if (errors != nullptr)  *errors = "Cannot open " + fileName;
+		return nullptr;
+	}
+	return Compile(source, fileName, defines, entryPoint, target, flags, errors);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Cache files
+//--------------------------------------------------------------------------------------
+
+std::string ShaderCache::EntryFileName(uint64_t hash)
+{
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+	return mDirectory + "\\" + name + ".cso";
+}
+
+
+ID3DBlob* ShaderCache::Load(uint64_t hash)
+{
+	std::ifstream file(EntryFileName(hash), std::ios::in | std::ios::binary);
+	if (!file.is_open())  return nullptr;
+
+	EntryHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (file.fail() || header.magic != MAGIC || header.version != VERSION || header.hash != hash || header.size == 0)
+	{
+		return nullptr;
+	}
+
+	ID3DBlob* byteCode = nullptr;
+	if (FAILED(D3DCreateBlob(static_cast<SIZE_T>(header.size), &byteCode)))  return nullptr;
+	file.read(static_cast<char*>(byteCode->GetBufferPointer()), header.size);
+	if (file.fail())
+	{
+		byteCode->Release();
+		return nullptr;
+	}
+	return byteCode;
+}
+
+
+// Failing to store an entry is not an error, the shader will just be compiled again next time
+void ShaderCache::Store(uint64_t hash, ID3DBlob* byteCode)
+{
+	CreateDirectoryA(mDirectory.c_str(), nullptr); // Fails harmlessly if it already exists
+
+	// Write to a file name unique to this process and thread, then rename it into place. If another process has stored
+	// the same entry meanwhile the rename may fail, which is fine as the entries are identical
+	std::string fileName = EntryFileName(hash);
+	std::ostringstream tempName;
+	tempName << fileName << "." << GetCurrentProcessId() << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+	{
+		std::ofstream file(tempName.str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file.is_open())  return;
+		EntryHeader header = { MAGIC, VERSION, hash, byteCode->GetBufferSize() };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(static_cast<const char*>(byteCode->GetBufferPointer()), byteCode->GetBufferSize());
+		if (file.fail())
+		{
+			file.close();
+			DeleteFileA(tempName.str().c_str());
+			return;
+		}
+	}
+	if (!MoveFileExA(tempName.str().c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileA(tempName.str().c_str());
+	}
+}
@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------------
+// Compiled shader cache
+//--------------------------------------------------------------------------------------
+// Shaders compiled at run time (permutations, hot-reload and vertex layout signatures) are kept on disk, so later runs
+// load the bytecode instead of calling the compiler again. Each entry is stored in its own file in the cache directory,
+// named after a hash of everything that affects the result: the source text and the text of every file it #includes,
+// the defines, entry point, target profile, compile flags and compiler version. Changing any of these gives a new
+// hash, so stale entries are never used (they are just left behind - delete the directory to clear them).
+//
+// Entries are written to a temporary file and then renamed into place, so several processes can share the cache
+// directory - a reader only ever sees complete entries. Safe to use from several threads at once.
+
+#ifndef _SHADER_CACHE_H_INCLUDED_
+#define _SHADER_CACHE_H_INCLUDED_
+
+#include <d3d11.h>
+#include <d3dcompiler.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+
+class ShaderCache
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	ShaderCache() : mNumHits(0), mNumMisses(0) {}
+
+	// Compile the given source text, or load it from the cache if it has been compiled before. The source name is used
+	// in error messages and to find #include files. The defines array is terminated by a null entry and may be null.
+	// Returns the bytecode, which must be released, or nullptr on failure with the compiler errors in errors (if given)
+	ID3DBlob* Compile(const std::string& source, const std::string& sourceName, const D3D_SHADER_MACRO* defines,
+	                  const char* entryPoint, const char* target, UINT flags, std::string* errors = nullptr);
+
+	// As above, but reading the source from a file
+	ID3DBlob* CompileFile(const std::string& fileName, const D3D_SHADER_MACRO* defines,
+	                      const char* entryPoint, const char* target, UINT flags, std::string* errors = nullptr);
+
+	// Set the directory used for the cache, by default "ShaderCache" in the working directory
+	void SetDirectory(const std::string& directory)  { mDirectory = directory; }
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	int NumHits()    { return mNumHits;   }
+	int NumMisses()  { return mNumMisses; }
+
+	// Proportion of requests that were loaded from the cache (0 if there have been none)
+	float HitRate()  { int total = mNumHits + mNumMisses;  return total > 0 ? static_cast<float>(mNumHits) / total : 0.0f; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const uint32_t MAGIC   = 0x48435348; // "HSCH"
+	static const uint32_t VERSION = 1;
+
+	// Header at the start of each cache file, followed by the bytecode
+	struct EntryHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t hash;
+		uint64_t size;
+	};
+
+	// Hash of the source, its includes and the compile settings
+	uint64_t Hash(const std::string& source, const std::string& sourceName, const D3D_SHADER_MACRO* defines,
+	              const char* entryPoint, const char* target, UINT flags);
+
+	// Add the contents of every file #included by the source (recursively) to the hash
+	void HashIncludes(const std::string& source, const std::string& sourceName, uint64_t& hash, int depth);
+
+	std::string EntryFileName(uint64_t hash);
+
+	// Returns nullptr if there is no valid entry with the given hash
+	ID3DBlob* Load(uint64_t hash);
+	void      Store(uint64_t hash, ID3DBlob* byteCode);
+
+
+	std::string      mDirectory = "ShaderCache";
+	std::atomic<int> mNumHits;
+	std::atomic<int> mNumMisses;
+};
+
+
+extern ShaderCache gShaderCache;
+
+
+#endif //_SHADER_CACHE_H_INCLUDED_
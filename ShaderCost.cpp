@@ -0,0 +1,318 @@
+//--------------------------------------------------------------------------------------
+// Shader cost report
+//--------------------------------------------------------------------------------------
+// See ShaderCost.h for an overview
+
+#include "ShaderCost.h"
+#include "Shader.h"
+#include "PerfMetrics.h"
+#include "Common.h"
+
+#include <Windows.h>
+#include <d3dcompiler.h>
+#include <d3d11shader.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Analysis
+//--------------------------------------------------------------------------------------
+
+// The statistics of one shader
+struct ShaderCost
+{
+	std::string name;
+	int instructions     = 0; // As counted by the compiler, including declarations
+	int temps            = 0; // Temporary registers, the compiler's register pressure (more can mean fewer waves in flight)
+	int samples          = 0; // Texture samples, loads and gathers
+	int loopSamples      = 0; // Of those, the ones inside loops
+	int staticFlow       = 0; // Flow control on constants
+	int dynamicFlow      = 0; // Flow control on values computed in the shader
+	int loops            = 0; // Loops left after unrolling
+	int logs             = 0; // log instructions, one for each pow
+	int exps             = 0;
+	int loopLogs         = 0; // log instructions inside loops
+	int doubles          = 0; // Double precision instructions
+	std::string hazards;      // Separated by semicolons, empty if none
+};
+
+
+bool StartsWith(const std::string& text, const char* prefix)
+{
+	return text.compare(0, std::strlen(prefix), prefix) == 0;
+}
+
+// Count what the reflection statistics miss from the shader's disassembly, one instruction per line
+bool ScanShaderDisassembly(const void* byteCode, size_t size, ShaderCost& cost)
+{
+	ID3DBlob* disassembly = nullptr;
+	if (FAILED(D3DDisassemble(byteCode, size, 0, nullptr, &disassembly)))  return false;
+
+	static const char* DOUBLE_OPCODES[] = { "dadd", "dmul", "ddiv", "dfma", "drcp", "dmax", "dmin", "dmov", "dmovc",
+	                                        "deq", "dge", "dlt", "dne", "dtof", "ftod", "dtoi", "dtou", "itod", "utod" };
+	std::istringstream lines(std::string(static_cast<const char*>(disassembly->GetBufferPointer()), disassembly->GetBufferSize()));
+	disassembly->Release();
+
+	int loopDepth = 0;
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		// The opcode is the first word, up to any modifiers (e.g. sample_indexable(texture2d)(float,float,float,float))
+		size_t start = line.find_first_not_of(" \t0123456789:"); // Skipping any line numbers
+		if (start == std::string::npos || line.compare(start, 2, "//") == 0)  continue;
+		std::string opcode = line.substr(start, line.find_first_of(" \t", start) - start);
+		std::string base = opcode.substr(0, opcode.find_first_of("_("));
+
+		if (base == "loop")
+		{
+			++cost.loops;
+			++loopDepth;
+		}
+		else if (base == "endloop")
+		{
+			loopDepth = std::max(loopDepth - 1, 0);
+		}
+		else if (base == "log")
+		{
+			++cost.logs;
+			if (loopDepth > 0)  ++cost.loopLogs;
+		}
+		else if (base == "exp")
+		{
+			++cost.exps;
+		}
+		else if (StartsWith(opcode, "sample") || StartsWith(opcode, "gather4") || base == "ld2dms" ||
+		         (base == "ld" && !StartsWith(opcode, "ld_structured") && !StartsWith(opcode, "ld_raw"))) // Not buffer loads
+		{
+			if (loopDepth > 0)  ++cost.loopSamples;
+		}
+		else if (std::find_if(std::begin(DOUBLE_OPCODES), std::end(DOUBLE_OPCODES), [&](const char* name) { return base == name; }) !=
+		         std::end(DOUBLE_OPCODES))
+		{
+			++cost.doubles;
+		}
+	}
+	return true;
+}
+
+// Analyse one compiled shader. Returns false on failure (reason in gLastError)
+bool AnalyseShader(const std::string& shaderName, const std::vector<char>& byteCode, ShaderCost& cost)
+{
+	ID3D11ShaderReflection* reflection = nullptr;
+	if (FAILED(D3DReflect(byteCode.data(), byteCode.size(), IID_ID3D11ShaderReflection, reinterpret_cast<void**>(&reflection))))
+	{
+		gLastError = "Error reflecting shader " + shaderName;
+		return false;
+	}
+	D3D11_SHADER_DESC desc;
+	reflection->GetDesc(&desc);
+	bool requiresDoubles = (reflection->GetRequiresFlags() & D3D_SHADER_REQUIRES_DOUBLES) != 0;
+	reflection->Release();
+
+	cost.name         = shaderName;
+	cost.instructions = desc.InstructionCount;
+	cost.temps        = desc.TempRegisterCount;
+	cost.samples      = desc.TextureNormalInstructions + desc.TextureLoadInstructions + desc.TextureCompInstructions +
+	                    desc.TextureBiasInstructions + desc.TextureGradientInstructions;
+	cost.staticFlow   = desc.StaticFlowControlCount;
+	cost.dynamicFlow  = desc.DynamicFlowControlCount;
+	if (!ScanShaderDisassembly(byteCode.data(), byteCode.size(), cost))
+	{
+		gLastError = "Error disassembling shader " + shaderName;
+		return false;
+	}
+
+	std::vector<std::string> hazards;
+	if (cost.doubles > 0 || requiresDoubles)   hazards.push_back("double arithmetic");
+	if (cost.loopSamples > 0)                  hazards.push_back("samples in a dynamic loop");
+	if (cost.loopLogs > 0)                     hazards.push_back("pow in a loop");
+	if (cost.logs >= SHADER_COST_POW_LIMIT)    hazards.push_back("pow-heavy");
+	for (auto& hazard : hazards)  cost.hazards += (cost.hazards.empty() ? "" : ";") + hazard;
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Results
+//--------------------------------------------------------------------------------------
+
+// Write all results to the CSV file, returns false on failure (reason in gLastError)
+bool WriteShaderCosts(const std::string& resultsFile, const std::vector<ShaderCost>& costs)
+{
+	std::ofstream file(resultsFile);
+	if (!file.is_open())
+	{
+		gLastError = "Error writing shader costs to " + resultsFile;
+		return false;
+	}
+
+	file << "Shader,Instructions,Temps,Samples,LoopSamples,StaticFlow,DynamicFlow,Loops,Logs,Exps,LoopLogs,Doubles,Hazards\n";
+	for (auto& cost : costs)
+	{
+		file << cost.name << "," << cost.instructions << "," << cost.temps << "," << cost.samples << "," << cost.loopSamples << ","
+		     << cost.staticFlow << "," << cost.dynamicFlow << "," << cost.loops << "," << cost.logs << "," << cost.exps << ","
+		     << cost.loopLogs << "," << cost.doubles << "," << cost.hazards << "\n";
+	}
+	return !file.fail();
+}
+
+// Read a CSV file written by WriteShaderCosts, only the fields compared with the baseline. False if it can't be opened
+bool ReadShaderCosts(const std::string& resultsFile, std::vector<ShaderCost>& costs)
+{
+	std::ifstream file(resultsFile);
+	if (!file.is_open())  return false;
+
+	std::string line;
+	std::getline(file, line); // Header
+	while (std::getline(file, line))
+	{
+		std::vector<std::string> fields;
+		std::istringstream values(line);
+		std::string field;
+		while (std::getline(values, field, ','))  fields.push_back(field);
+		if (fields.size() < 12)  continue;
+
+		ShaderCost cost;
+		cost.name         = fields[0];
+		cost.instructions = std::atoi(fields[1].c_str());
+		cost.temps        = std::atoi(fields[2].c_str());
+		cost.samples      = std::atoi(fields[3].c_str());
+		cost.loopSamples  = std::atoi(fields[4].c_str());
+		cost.loops        = std::atoi(fields[7].c_str());
+		cost.logs         = std::atoi(fields[8].c_str());
+		cost.doubles      = std::atoi(fields[11].c_str());
+		if (fields.size() > 12)  cost.hazards = fields[12];
+		costs.push_back(cost);
+	}
+	return true;
+}
+
+// List every change from the baseline file in the debugger output, returns the number of regressions: counts grown by
+// more than SHADER_COST_TOLERANCE or hazards the shader didn't have before. Shaders added or removed are listed but not
+// regressions, a new shader's hazards are already in the report
+int CompareShaderCostBaseline(const std::string& baselineFile, const std::vector<ShaderCost>& costs)
+{
+	std::vector<ShaderCost> baseline;
+	if (!ReadShaderCosts(baselineFile, baseline))
+	{
+		OutputDebugStringA(("Shader cost baseline " + baselineFile + " not found, nothing compared\n").c_str());
+		return 0;
+	}
+
+	int regressions = 0;
+	for (auto& cost : costs)
+	{
+		auto found = std::find_if(baseline.begin(), baseline.end(), [&](const ShaderCost& entry) { return entry.name == cost.name; });
+		if (found == baseline.end())
+		{
+			OutputDebugStringA(("Shader cost: " + cost.name + " is new\n").c_str());
+			continue;
+		}
+
+		// Each count that changed, marking the ones that grew too much
+		std::ostringstream changes;
+		bool regressed = false;
+		auto compare = [&](const char* label, int value, int baselineValue, bool gate)
+		{
+			if (value == baselineValue)  return;
+			bool grew = gate && value > baselineValue * (1 + SHADER_COST_TOLERANCE);
+			changes << " " << label << " " << baselineValue << " -> " << value << (grew ? " (regression)" : "");
+			regressed = regressed || grew;
+		};
+		compare("instructions", cost.instructions, found->instructions, true);
+		compare("temps",        cost.temps,        found->temps,        true);
+		compare("samples",      cost.samples,      found->samples,      true);
+		compare("loop samples", cost.loopSamples,  found->loopSamples,  false);
+		compare("loops",        cost.loops,        found->loops,        false);
+		compare("logs",         cost.logs,         found->logs,         false);
+		compare("doubles",      cost.doubles,      found->doubles,      false);
+
+		std::istringstream hazards(cost.hazards);
+		std::string hazard;
+		while (std::getline(hazards, hazard, ';'))
+		{
+			if (found->hazards.find(hazard) != std::string::npos)  continue;
+			changes << " new hazard: " << hazard << " (regression)";
+			regressed = true;
+		}
+
+		if (!changes.str().empty())  OutputDebugStringA(("Shader cost: " + cost.name + changes.str() + "\n").c_str());
+		if (regressed)  ++regressions;
+	}
+	for (auto& entry : baseline)
+	{
+		auto found = std::find_if(costs.begin(), costs.end(), [&](const ShaderCost& cost) { return cost.name == entry.name; });
+		if (found == costs.end())  OutputDebugStringA(("Shader cost: " + entry.name + " was removed\n").c_str());
+	}
+	return regressions;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Report
+//--------------------------------------------------------------------------------------
+
+bool RunShaderCostReport(const std::string& resultsFile, const std::string& baselineFile)
+{
+	// The compiled shaders, in name order so the files from different builds line up
+	std::vector<std::string> shaderNames;
+	WIN32_FIND_DATAA found;
+	HANDLE search = FindFirstFileA("*.cso", &found);
+	if (search != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			std::string fileName = found.cFileName;
+			shaderNames.push_back(fileName.substr(0, fileName.size() - 4));
+		} while (FindNextFileA(search, &found));
+		FindClose(search);
+	}
+	if (shaderNames.empty())
+	{
+		gLastError = "No compiled shaders (.cso files) found for the shader cost report";
+		return false;
+	}
+	std::sort(shaderNames.begin(), shaderNames.end());
+
+	std::vector<ShaderCost> costs;
+	std::vector<char> byteCode;
+	for (auto& shaderName : shaderNames)
+	{
+		ShaderCost cost;
+		if (!ReadShaderByteCode(shaderName, byteCode))
+		{
+			gLastError = "Error reading shader " + shaderName;
+			return false;
+		}
+		if (!AnalyseShader(shaderName, byteCode, cost))  return false;
+		costs.push_back(cost);
+
+		gPerfMetrics.AddSample("shader_instructions/" + shaderName, "instructions", static_cast<float>(cost.instructions));
+		gPerfMetrics.AddSample("shader_temps/" + shaderName, "registers", static_cast<float>(cost.temps));
+		gPerfMetrics.AddSample("shader_samples/" + shaderName, "samples", static_cast<float>(cost.samples));
+
+		std::ostringstream report;
+		report << shaderName << ": " << cost.instructions << " instructions, " << cost.temps << " temps, " << cost.samples
+		       << " samples, " << cost.dynamicFlow << " dynamic flow control, " << cost.loops << " loops";
+		if (!cost.hazards.empty())  report << " - " << cost.hazards;
+		OutputDebugStringA((report.str() + "\n").c_str());
+	}
+	if (!WriteShaderCosts(resultsFile, costs) || !gPerfMetrics.Write(MetricsFileName(resultsFile)))  return false;
+
+	if (!baselineFile.empty())
+	{
+		int regressions = CompareShaderCostBaseline(baselineFile, costs);
+		if (regressions > 0)
+		{
+			gLastError = std::to_string(regressions) + " shaders costlier than in " + baselineFile;
+			return false;
+		}
+	}
+	return true;
+}
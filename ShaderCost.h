@@ -0,0 +1,35 @@
+//--------------------------------------------------------------------------------------
+// Shader cost report
+//--------------------------------------------------------------------------------------
+// Lists what each compiled shader costs, from the compiler's own statistics rather than timings, so a change that makes
+// a shader costlier shows up in review. Run with the -shadercost command line switch (optionally followed by the CSV
+// file name to write) and -baseline with the CSV from the previous build to compare against. No window or device is
+// needed, so it can run as a build step straight after the shaders compile.
+//
+// Every .cso file in the working directory is read (from the asset pack if the shader is there, as the app would) and
+// passed to D3DReflect for the instruction, temp register, texture sample and flow control counts. The disassembly is
+// scanned for the things the statistics miss: loops the compiler couldn't unroll, samples inside them, log and exp
+// instructions (each pow compiles to a log, a multiply and an exp) and double precision arithmetic. Known hazards are
+// flagged: any doubles, samples in a dynamic loop, pow inside a loop and pow-heavy code (SHADER_COST_POW_LIMIT or more
+// log instructions, typically a pow per tap of a filter). The counts are also added to the performance metrics (see
+// PerfMetrics.h), written to a .json file of the same name for the PerfGate regression check
+
+#ifndef _SHADER_COST_H_INCLUDED_
+#define _SHADER_COST_H_INCLUDED_
+
+#include <string>
+
+// A count more than this fraction above the baseline counts as a regression
+const float SHADER_COST_TOLERANCE = 0.05f;
+
+// Shaders with at least this many log instructions are flagged as pow-heavy
+const int SHADER_COST_POW_LIMIT = 8;
+
+// Analyse every compiled shader and write the results to the given CSV file, each shader's hazards to the debugger
+// output. If a baseline file is given, the differences from it are listed in the debugger output as well. Returns false
+// on failure, or if any shader's instructions, temp registers or texture samples grew by more than SHADER_COST_TOLERANCE
+// or it gained a hazard (reason in gLastError)
+bool RunShaderCostReport(const std::string& resultsFile, const std::string& baselineFile);
+
+
+#endif //_SHADER_COST_H_INCLUDED_
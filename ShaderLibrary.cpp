@@ -0,0 +1,135 @@
+//--------------------------------------------------------------------------------------
+// Shader library
+//--------------------------------------------------------------------------------------
+
+#include "ShaderLibrary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+
+ShaderLibrary::~ShaderLibrary()
+{
+	Close();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reading
+//--------------------------------------------------------------------------------------
+
+bool ShaderLibrary::Open(const std::string& fileName)
+{
+	Close();
+
+	mFile = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mFile == INVALID_HANDLE_VALUE)  return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(Header)))
+	{
+		Close();
+		return false;
+	}
+	mSize = static_cast<size_t>(fileSize.QuadPart);
+
+	mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+	mData = static_cast<const char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	if (mData == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	// Check the header and that the index and all the bytecode lie inside the file
+	const Header* header = reinterpret_cast<const Header*>(mData);
+	if (header->magic != MAGIC || header->version != VERSION ||
+	    sizeof(Header) + static_cast<size_t>(header->count) * sizeof(IndexEntry) > mSize)
+	{
+		Close();
+		return false;
+	}
+	mIndex = reinterpret_cast<const IndexEntry*>(mData + sizeof(Header));
+	mCount = header->count;
+	for (unsigned int i = 0; i < mCount; ++i)
+	{
+		if (static_cast<size_t>(mIndex[i].offset) + mIndex[i].size > mSize || mIndex[i].name[MAX_NAME_LENGTH - 1] != '\0')
+		{
+			Close();
+			return false;
+		}
+	}
+	return true;
+}
+
+
+void ShaderLibrary::Close()
+{
+	if (mData)                          UnmapViewOfFile(mData);
+	if (mMapping)                       CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE)  CloseHandle(mFile);
+	mData    = nullptr;
+	mMapping = nullptr;
+	mFile    = INVALID_HANDLE_VALUE;
+	mSize    = 0;
+	mIndex   = nullptr;
+	mCount   = 0;
+}
+
+
+// Binary search of the sorted index
+bool ShaderLibrary::Find(const std::string& shaderName, const void*& byteCode, size_t& size)
+{
+	if (mData == nullptr)  return false;
+
+	const IndexEntry* end = mIndex + mCount;
+	const IndexEntry* entry = std::lower_bound(mIndex, end, shaderName,
+	                                           [](const IndexEntry& e, const std::string& name) { return std::strcmp(e.name, name.c_str()) < 0; });
+	if (entry == end || shaderName != entry->name)  return false;
+
+	byteCode = mData + entry->offset;
+	size = entry->size;
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writing
+//--------------------------------------------------------------------------------------
+
+bool ShaderLibrary::Write(const std::string& fileName, ShaderList shaders)
+{
+	std::sort(shaders.begin(), shaders.end(),
+	          [](const ShaderList::value_type& a, const ShaderList::value_type& b) { return a.first < b.first; });
+
+	Header header = { MAGIC, VERSION, static_cast<unsigned int>(shaders.size()), 0 };
+	std::vector<IndexEntry> index(shaders.size());
+	unsigned int offset = static_cast<unsigned int>(sizeof(Header) + index.size() * sizeof(IndexEntry));
+	for (size_t i = 0; i < shaders.size(); ++i)
+	{
+		if (shaders[i].first.length() >= MAX_NAME_LENGTH)  return false;
+		std::memset(index[i].name, 0, MAX_NAME_LENGTH);
+		std::memcpy(index[i].name, shaders[i].first.c_str(), shaders[i].first.length());
+		index[i].offset = offset;
+		index[i].size   = static_cast<unsigned int>(shaders[i].second.size());
+		offset += (index[i].size + 3) & ~3u;
+	}
+
+	std::ofstream file(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())  return false;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(IndexEntry));
+	const char padding[4] = {};
+	for (auto& shader : shaders)
+	{
+		file.write(shader.second.data(), shader.second.size());
+		file.write(padding, (4 - shader.second.size() % 4) % 4);
+	}
+	return !file.fail();
+}
@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------------------
+// Shader library
+//--------------------------------------------------------------------------------------
+// A single archive holding the compiled bytecode of all the shaders, so they can be loaded with one file open
+// rather than one per shader. The file is memory-mapped and the bytecode passed straight from the mapping to the
+// Create*Shader functions, so nothing is copied.
+//
+// Layout: a Header, then Header::count IndexEntry structures sorted by name, then the bytecode of each shader
+// (4-byte aligned). Offsets are from the start of the file
+
+#ifndef _SHADER_LIBRARY_H_INCLUDED_
+#define _SHADER_LIBRARY_H_INCLUDED_
+
+#include <Windows.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+class ShaderLibrary
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// A shader to write to a library: name (without extension) and bytecode
+	typedef std::vector<std::pair<std::string, std::vector<char>>> ShaderList;
+
+	~ShaderLibrary();
+
+	// Memory-map the given library file. Returns false if it doesn't exist or isn't a valid library
+	bool Open(const std::string& fileName);
+
+	// Unmap the library, any bytecode pointers from Find are no longer valid
+	void Close();
+
+	// Find the bytecode for the shader with the given name (without extension). The pointer is into the mapped
+	// file and stays valid until Close. Returns false if the shader isn't in the library
+	bool Find(const std::string& shaderName, const void*& byteCode, size_t& size);
+
+	// Write a library file containing the given shaders. Returns false on failure
+	static bool Write(const std::string& fileName, ShaderList shaders);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	bool IsOpen()  { return mData != nullptr; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const unsigned int MAGIC   = 0x42494C53; // "SLIB"
+	static const unsigned int VERSION = 1;
+	static const int          MAX_NAME_LENGTH = 56;
+
+	struct Header
+	{
+		unsigned int magic;
+		unsigned int version;
+		unsigned int count;
+		unsigned int padding;
+	};
+
+	struct IndexEntry
+	{
+		char         name[MAX_NAME_LENGTH]; // Null terminated
+		unsigned int offset;
+		unsigned int size;
+	};
+
+
+	HANDLE            mFile    = INVALID_HANDLE_VALUE;
+	HANDLE            mMapping = nullptr;
+	const char*       mData    = nullptr;
+	size_t            mSize    = 0;
+	const IndexEntry* mIndex   = nullptr;
+	unsigned int      mCount   = 0;
+};
+
+
+#endif //_SHADER_LIBRARY_H_INCLUDED_
@@ -0,0 +1,245 @@
+//--------------------------------------------------------------------------------------
+// Shader hot-reload
+//--------------------------------------------------------------------------------------
+
+#include "ShaderReloader.h"
+#include "StateCache.h"
+#include "ShaderCache.h"
+#include "ShaderBindings.h"
+#include "Common.h"
+
+#include <d3dcompiler.h>
+#include <chrono>
+#include <system_error>
+
+
+ShaderReloader gShaderReloader;
+
+const char* const ShaderReloader::INCLUDE_FILES[] = { "Common.hlsli" };
+
+
+ShaderReloader::~ShaderReloader()
+{
+	Release();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Set up
+//--------------------------------------------------------------------------------------
+
+void ShaderReloader::Watch(const std::string& shaderName, ID3D11PixelShader** shader)
+{
+	WatchedShader watched = { shaderName, shader, nullptr, {} };
+	LastWriteTime(shaderName + ".hlsl", watched.lastWrite);
+	mShaders.push_back(watched);
+}
+
+void ShaderReloader::Watch(const std::string& shaderName, ID3D11ComputeShader** shader)
+{
+	WatchedShader watched = { shaderName, nullptr, shader, {} };
+	LastWriteTime(shaderName + ".hlsl", watched.lastWrite);
+	mShaders.push_back(watched);
+}
+
+
+bool ShaderReloader::Start()
+{
+	if (Running())  return true;
+
+	mIncludeTimes.clear();
+	for (auto includeFile : INCLUDE_FILES)
+	{
+		FILETIME time = {};
+		LastWriteTime(includeFile, time);
+		mIncludeTimes.push_back(time);
+	}
+
+	mQuit = false;
+	mNumReloads = 0;
+	mNumErrors  = 0;
+	try
+	{
+		mThread = std::thread(&ShaderReloader::WatcherThread, this);
+	}
+	catch (const std::system_error&)
+	{
+		gLastError = "Error starting shader reload thread";
+		return false;
+	}
+	return true;
+}
+
+
+void ShaderReloader::Release()
+{
+	if (mThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQuit = true;
+		}
+		mWake.notify_all();
+		mThread.join();
+	}
+
+	// Discard any shaders that were never swapped in
+	for (auto& reloaded : mReloaded)
+	{
+		gShaderBindings.Unregister(reloaded.pixelShader ? static_cast<const void*>(reloaded.pixelShader) : reloaded.computeShader);
+		if (reloaded.pixelShader)    reloaded.pixelShader  ->Release();
+		if (reloaded.computeShader)  reloaded.computeShader->Release();
+	}
+	mReloaded.clear();
+	mShaders.clear();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Swapping
+//--------------------------------------------------------------------------------------
+
+void ShaderReloader::Update()
+{
+	std::unique_lock<std::mutex> lock(mMutex, std::try_to_lock);
+	if (!lock.owns_lock() || mReloaded.empty())  return;
+
+	for (auto& reloaded : mReloaded)
+	{
+		WatchedShader& watched = mShaders[reloaded.watched];
+		if (watched.pixelShader)
+		{
+			gShaderBindings.Unregister(*watched.pixelShader);
+			if (*watched.pixelShader)  (*watched.pixelShader)->Release();
+			*watched.pixelShader = reloaded.pixelShader;
+		}
+		else
+		{
+			gShaderBindings.Unregister(*watched.computeShader);
+			if (*watched.computeShader)  (*watched.computeShader)->Release();
+			*watched.computeShader = reloaded.computeShader;
+		}
+		++mNumReloads;
+	}
+	mReloaded.clear();
+
+	// The cache may hold the released shaders, and a new object could be created at the same address
+	gStateCache.Invalidate();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Background thread
+//--------------------------------------------------------------------------------------
+
+void ShaderReloader::WatcherThread()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (!mWake.wait_for(lock, std::chrono::milliseconds(POLL_MILLISECONDS), [this] { return mQuit; }))
+	{
+		lock.unlock(); // Don't hold up Update while checking files and compiling
+
+		bool includeChanged = false;
+		for (size_t i = 0; i < mIncludeTimes.size(); ++i)
+		{
+			FILETIME time;
+			if (LastWriteTime(INCLUDE_FILES[i], time) && CompareFileTime(&time, &mIncludeTimes[i]) != 0)
+			{
+				mIncludeTimes[i] = time;
+				includeChanged = true;
+			}
+		}
+
+		for (int i = 0; i < static_cast<int>(mShaders.size()); ++i)
+		{
+			FILETIME time;
+			if (!LastWriteTime(mShaders[i].name + ".hlsl", time))  continue;
+			if (includeChanged || CompareFileTime(&time, &mShaders[i].lastWrite) != 0)
+			{
+				// Record the time even if the compile fails, so a broken file isn't recompiled until it is saved again
+				mShaders[i].lastWrite = time;
+				if (!Recompile(i))  ++mNumErrors;
+			}
+		}
+
+		lock.lock();
+	}
+}
+
+
+bool ShaderReloader::Recompile(int watched)
+{
+	const WatchedShader& shader = mShaders[watched];
+
+	UINT flags = D3DCOMPILE_OPTIMIZATION_LEVEL3;
+#ifdef _DEBUG
+	flags |= D3DCOMPILE_DEBUG;
+#endif
+
+	// Compile with the same settings as the project (shader model 5.0, entry point main)
+	// Goes through the shader cache, so undoing an edit is instant
+	std::string fileName = shader.name + ".hlsl";
+	std::string errors;
+	ID3DBlob* compiledShader = gShaderCache.CompileFile(fileName, nullptr, "main", shader.pixelShader ? "ps_5_0" : "cs_5_0", flags, &errors);
+	if (compiledShader == nullptr)
+	{
+		OutputDebugStringA(("Shader reload: error compiling " + fileName + "\n" + errors + "\n").c_str());
+		return false;
+	}
+
+	ReloadedShader reloaded = { watched, nullptr, nullptr };
+	HRESULT hr;
+	if (shader.pixelShader)
+	{
+		hr = gD3DDevice->CreatePixelShader(compiledShader->GetBufferPointer(), compiledShader->GetBufferSize(), nullptr, &reloaded.pixelShader);
+	}
+	else
+	{
+		hr = gD3DDevice->CreateComputeShader(compiledShader->GetBufferPointer(), compiledShader->GetBufferSize(), nullptr, &reloaded.computeShader);
+	}
+	if (FAILED(hr))
+	{
+		compiledShader->Release();
+		OutputDebugStringA(("Shader reload: error creating " + fileName + "\n").c_str());
+		return false;
+	}
+
+	// A shader whose constant buffers no longer match the C++ code is rejected like a compile error
+	const void* newShader = reloaded.pixelShader ? static_cast<const void*>(reloaded.pixelShader) : reloaded.computeShader;
+	std::string bindingError;
+	bool registered = gShaderBindings.Register(newShader, compiledShader->GetBufferPointer(), compiledShader->GetBufferSize(), shader.name, bindingError);
+	compiledShader->Release();
+	if (!registered)
+	{
+		OutputDebugStringA(("Shader reload: " + bindingError + "\n").c_str());
+		if (reloaded.pixelShader)    reloaded.pixelShader  ->Release();
+		if (reloaded.computeShader)  reloaded.computeShader->Release();
+		return false;
+	}
+	OutputDebugStringA(("Shader reload: recompiled " + fileName + "\n").c_str());
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (auto& pending : mReloaded)
+	{
+		// Saved again before the last compile was swapped in, replace it
+		if (pending.watched == watched)
+		{
+			gShaderBindings.Unregister(pending.pixelShader ? static_cast<const void*>(pending.pixelShader) : pending.computeShader);
+			if (pending.pixelShader)    pending.pixelShader  ->Release();
+			if (pending.computeShader)  pending.computeShader->Release();
+			pending = reloaded;
+			return true;
+		}
+	}
+	mReloaded.push_back(reloaded);
+	return true;
+}
+
+
+bool ShaderReloader::LastWriteTime(const std::string& fileName, FILETIME& time)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(fileName.c_str(), GetFileExInfoStandard, &attributes))  return false;
+	time = attributes.ftLastWriteTime;
+	return true;
+}
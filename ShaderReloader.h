@@ -0,0 +1,114 @@
+//--------------------------------------------------------------------------------------
+// Shader hot-reload
+//--------------------------------------------------------------------------------------
+// Watches the .hlsl sources of shaders and recompiles any that are edited while the app is running, so shader changes
+// can be seen without rebuilding and restarting. A background thread checks the file times a few times a second. When
+// a file changes, the thread compiles it and creates the new shader object; the ID3D11Device is free-threaded, so this
+// does not need the render loop. Update swaps the new shaders into their globals between frames. If a shader fails
+// to compile, the old one stays in place and the compiler errors are sent to the debugger output.
+//
+// An edit to one of the shared include files (INCLUDE_FILES) recompiles every watched shader.
+
+#ifndef _SHADER_RELOADER_H_INCLUDED_
+#define _SHADER_RELOADER_H_INCLUDED_
+
+#include <d3d11.h>
+#include <Windows.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+class ShaderReloader
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	ShaderReloader() : mNumErrors(0) {}
+	~ShaderReloader();
+
+	// Watch the source of a shader (name without the .hlsl extension) and replace the shader held in the given global
+	// when it is recompiled. Must be called before Start
+	void Watch(const std::string& shaderName, ID3D11PixelShader**   shader);
+	void Watch(const std::string& shaderName, ID3D11ComputeShader** shader);
+
+	// Start watching on a background thread. Returns false on error (reason in gLastError)
+	bool Start();
+
+	// Stop the background thread and forget the watched shaders. Must be called before the watched shaders are released
+	void Release();
+
+
+	// Call between frames. Swaps any recompiled shaders into their globals and releases the shaders they replace. Never
+	// waits for the background thread - if it is busy then the swap happens next frame
+	void Update();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	bool Running()  { return mThread.joinable(); }
+
+	int NumReloads()  { return mNumReloads; } // Shaders swapped in since Start
+	int NumErrors()   { return mNumErrors;  } // Recompiles that failed since Start
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Shared include files - if one of these changes, every watched shader is recompiled
+	static const char* const INCLUDE_FILES[];
+
+	static const int POLL_MILLISECONDS = 250;
+
+	struct WatchedShader
+	{
+		std::string           name;
+		ID3D11PixelShader**   pixelShader;   // One of these two is null
+		ID3D11ComputeShader** computeShader;
+		FILETIME              lastWrite;
+	};
+
+	// A shader that has been recompiled and is waiting for Update to swap it in
+	struct ReloadedShader
+	{
+		int                  watched; // Index into mShaders
+		ID3D11PixelShader*   pixelShader;
+		ID3D11ComputeShader* computeShader;
+	};
+
+	// Background thread loop, polls the watched files until told to quit
+	void WatcherThread();
+
+	// Recompile the given watched shader and queue it for Update. Returns false if it failed to compile
+	bool Recompile(int watched);
+
+	// Get the last write time of a file, returns false if it doesn't exist
+	static bool LastWriteTime(const std::string& fileName, FILETIME& time);
+
+
+	std::vector<WatchedShader> mShaders;      // Only changed while the background thread is not running
+	std::vector<FILETIME>      mIncludeTimes; // Last write time of each of INCLUDE_FILES
+
+	std::thread                 mThread;
+	std::mutex                  mMutex;
+	std::condition_variable     mWake;     // Signalled on quit
+	bool                        mQuit = false;
+	std::vector<ReloadedShader> mReloaded; // Guarded by mMutex
+
+	int              mNumReloads = 0;
+	std::atomic<int> mNumErrors; // Changed by the background thread
+};
+
+
+extern ShaderReloader gShaderReloader;
+
+
+#endif //_SHADER_RELOADER_H_INCLUDED_
@@ -0,0 +1,294 @@
+//--------------------------------------------------------------------------------------
+// Cached point light shadow maps
+//--------------------------------------------------------------------------------------
+// See ShadowMaps.h for an overview
+
+#include "ShadowMaps.h"
+#include "Model.h"
+#include "StaticBatches.h"
+#include "Shader.h"
+#include "State.h"
+#include "StateCache.h"
+#include "ResourceRegistry.h"
+#include "CpuProfiler.h"
+#include "GraphicsHelpers.h"
+
+#include <algorithm>
+
+
+ShadowMaps gShadowMaps;
+
+const int   ShadowMaps::UPDATE_INTERVAL = 4;
+const float ShadowMaps::NEAR_CLIP       = 0.1f;
+
+
+namespace
+{
+	// The direction each cubemap face looks along and its up direction, in the order of the faces in a Direct3D cubemap
+	// (+X, -X, +Y, -Y, +Z, -Z) so that sampling the cubemap along a direction finds what the face drew there
+	const CVector3 FACE_FORWARDS[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1,  0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	const CVector3 FACE_UPS[6]      = { { 0, 1, 0 }, {  0, 1, 0 }, { 0, 0, -1 }, { 0,  0, 1 }, { 0, 1, 0 }, { 0, 1,  0 } };
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+bool ShadowMaps::Init(int faceSize)
+{
+	Release();
+	mFaceSize = faceSize;
+	if (!CreateCubemaps(&mCache, mCacheFaces, nullptr) || !CreateCubemaps(&mMaps, mMapFaces, &mMapsSRV))
+	{
+		Release();
+		return false; // Reason is in gLastError
+	}
+
+	mConstantBuffer = CreateConstantBuffer(sizeof(ShadowConstants));
+	if (mConstantBuffer == nullptr)
+	{
+		Release();
+		gLastError = "Error creating shadow constant buffer";
+		return false;
+	}
+	Disable();
+	return true;
+}
+
+
+void ShadowMaps::Release()
+{
+	if (mConstantBuffer)  mConstantBuffer->Release();
+	if (mMapsSRV)         mMapsSRV->Release();
+	for (auto& face : mMapFaces)    if (face)  face->Release();
+	for (auto& face : mCacheFaces)  if (face)  face->Release();
+	if (mMaps)            mMaps->Release();
+	if (mCache)           mCache->Release();
+	*this = ShadowMaps();
+}
+
+
+void ShadowMaps::Update(const std::vector<Light>& lights, const std::vector<Model*>& staticCasters, bool staticBatches,
+                        const std::vector<Model*>& dynamicCasters)
+{
+	if (mConstantBuffer == nullptr)  return;
+	CPU_PROFILE_SCOPE("ShadowMaps::Update");
+
+	// The maps may still be bound for the lighting from last frame, they can't also be drawn into
+	ID3D11ShaderResourceView* nullSRV = nullptr;
+	gD3DContext->PSSetShaderResources(SHADOW_MAP_SLOT, 1, &nullSRV);
+
+	D3D11_VIEWPORT viewport = { 0, 0, static_cast<float>(mFaceSize), static_cast<float>(mFaceSize), 0, 1 };
+	gD3DContext->RSSetViewports(1, &viewport);
+	gStateCache.VSSetShader(gDepthOnlyVertexShader, nullptr, 0); // Draws the meshes' position streams
+	gStateCache.PSSetShader(nullptr, nullptr, 0); // Depth only
+	gStateCache.GSSetShader(nullptr, nullptr, 0);
+	gStateCache.OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
+	gStateCache.OMSetDepthStencilState(gUseDepthBufferState, 0);
+	gStateCache.RSSetState(gShadowCasterState);
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	gStateCache.SetConstantBuffer(PER_FRAME_CONSTANTS_SLOT, gPerFrameConstantBuffer);
+
+	// Any change to the static casters means every cache must be drawn again
+	StaticKey(staticCasters, staticBatches, mFrameKey);
+	bool staticChanged = (mFrameKey != mStaticKey);
+	if (staticChanged)  mStaticKey.swap(mFrameKey);
+
+	mNumLights = std::min(static_cast<int>(lights.size()), MAX_SHADOW_LIGHTS);
+	mNumCacheUpdates = mNumDynamicDraws = mNumStaticDraws = 0;
+	std::vector<Model*> casters;
+	for (int l = 0; l < mNumLights; ++l)
+	{
+		const Light& light = lights[l];
+		CachedLight& cached = mCachedLights[l];
+
+		// A moving light's cache is only drawn again once it is old enough, until then its shadows are cast from where the
+		// cache was drawn
+		++cached.age;
+		bool moved = (cached.position.x != light.position.x || cached.position.y != light.position.y ||
+		              cached.position.z != light.position.z || cached.range != light.range);
+		bool updateCache = !cached.valid || staticChanged || (moved && cached.age >= UPDATE_INTERVAL);
+		if (updateCache)
+		{
+			cached.valid    = true;
+			cached.position = light.position;
+			cached.range    = light.range;
+			cached.age      = 0;
+
+			casters.clear();
+			for (auto model : staticCasters)
+			{
+				if (Overlaps(model->WorldBoundingBox(), cached.position, cached.range))  casters.push_back(model);
+			}
+			for (int f = 0; f < NUM_FACES; ++f)
+			{
+				gD3DContext->ClearDepthStencilView(mCacheFaces[l * NUM_FACES + f], D3D11_CLEAR_DEPTH, 1.0f, 0);
+				mNumStaticDraws += DrawFace(mCacheFaces[l * NUM_FACES + f], f, cached.position, cached.range, casters, staticBatches);
+			}
+			++mNumCacheUpdates;
+		}
+
+		casters.clear();
+		for (auto model : dynamicCasters)
+		{
+			if (Overlaps(model->WorldBoundingBox(), cached.position, cached.range))  casters.push_back(model);
+		}
+
+		// The lighting map only needs the cache copied into it again if the cache has changed or there are dynamic casters
+		// to draw over it or to clear off it
+		if (!updateCache && casters.empty() && !cached.hadDynamic)  continue;
+		cached.hadDynamic = !casters.empty();
+		++mVersion;
+
+		for (int f = 0; f < NUM_FACES; ++f)
+		{
+			UINT subresource = D3D11CalcSubresource(0, l * NUM_FACES + f, 1);
+			gD3DContext->CopySubresourceRegion(mMaps, subresource, 0, 0, 0, mCache, subresource, nullptr);
+			if (!casters.empty())
+			{
+				mNumDynamicDraws += DrawFace(mMapFaces[l * NUM_FACES + f], f, cached.position, cached.range, casters, false);
+			}
+		}
+	}
+
+	// The lights after the last one with a map cast no shadows, they are no longer cached either
+	for (int l = mNumLights; l < MAX_SHADOW_LIGHTS; ++l)  mCachedLights[l] = CachedLight();
+
+	mConstants.numShadowLights = static_cast<unsigned int>(mNumLights);
+	mConstants.shadowNearClip = NEAR_CLIP;
+	mConstants.shadowNormalOffset = 3.0f / mFaceSize; // About one and a half texels at any distance (a face spans 90 degrees)
+	for (int l = 0; l < mNumLights; ++l)
+	{
+		mConstants.shadowLights[l] = { mCachedLights[l].position, mCachedLights[l].range };
+	}
+	UpdateConstantBuffer(mConstantBuffer, mConstants);
+	gD3DContext->OMSetRenderTargets(0, nullptr, nullptr);
+}
+
+
+void ShadowMaps::Disable()
+{
+	mNumLights = mNumCacheUpdates = mNumDynamicDraws = mNumStaticDraws = 0;
+	for (auto& cached : mCachedLights)  cached = CachedLight();
+	mStaticKey.clear();
+	++mVersion;
+	if (mConstantBuffer == nullptr)  return;
+
+	mConstants.numShadowLights = 0;
+	UpdateConstantBuffer(mConstantBuffer, mConstants);
+}
+
+
+void ShadowMaps::Bind()
+{
+	if (mConstantBuffer == nullptr)  return;
+	gD3DContext->PSSetShaderResources(SHADOW_MAP_SLOT, 1, &mMapsSRV);
+	gStateCache.SetSampler(SHADOW_SAMPLER_SLOT, gShadowComparisonSampler);
+	gStateCache.SetConstantBuffer(SHADOW_CONSTANTS_SLOT, mConstantBuffer);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+bool ShadowMaps::CreateCubemaps(ID3D11Texture2D** texture, ID3D11DepthStencilView** faceViews, ID3D11ShaderResourceView** view)
+{
+	// Typeless so the faces can be drawn with a depth format and the whole array read with a float format. The cache and
+	// lighting maps are made alike so the faces can be copied from one to the other
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = mFaceSize;
+	textureDesc.Height = mFaceSize;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = MAX_SHADOW_LIGHTS * NUM_FACES;
+	textureDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	textureDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+	if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, nullptr, texture)))
+	{
+		gLastError = "Error creating shadow map cubemaps";
+		return false;
+	}
+	gResourceRegistry.Track(*texture);
+
+	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+	dsvDesc.Texture2DArray.MipSlice = 0;
+	dsvDesc.Texture2DArray.ArraySize = 1;
+	for (int face = 0; face < MAX_SHADOW_LIGHTS * NUM_FACES; ++face)
+	{
+		dsvDesc.Texture2DArray.FirstArraySlice = face;
+		if (FAILED(gD3DDevice->CreateDepthStencilView(*texture, &dsvDesc, &faceViews[face])))
+		{
+			gLastError = "Error creating shadow map face views";
+			return false;
+		}
+		gD3DContext->ClearDepthStencilView(faceViews[face], D3D11_CLEAR_DEPTH, 1.0f, 0);
+	}
+
+	if (view == nullptr)  return true;
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBEARRAY;
+	srvDesc.TextureCubeArray.MostDetailedMip = 0;
+	srvDesc.TextureCubeArray.MipLevels = 1;
+	srvDesc.TextureCubeArray.First2DArrayFace = 0;
+	srvDesc.TextureCubeArray.NumCubes = MAX_SHADOW_LIGHTS;
+	if (FAILED(gD3DDevice->CreateShaderResourceView(*texture, &srvDesc, view)))
+	{
+		gLastError = "Error creating shadow map shader resource view";
+		return false;
+	}
+	return true;
+}
+
+
+int ShadowMaps::DrawFace(ID3D11DepthStencilView* face, int faceIndex, const CVector3& position, float range,
+                         const std::vector<Model*>& casters, bool staticBatches)
+{
+	// The face's camera, looking out from the light with a 90 degree field of view so the six faces meet at their edges
+	CMatrix4x4 worldMatrix = MatrixIdentity();
+	worldMatrix.SetRow(0, Cross(FACE_UPS[faceIndex], FACE_FORWARDS[faceIndex]));
+	worldMatrix.SetRow(1, FACE_UPS[faceIndex]);
+	worldMatrix.SetRow(2, FACE_FORWARDS[faceIndex]);
+	worldMatrix.SetRow(3, position);
+	gPerFrameConstants.viewMatrix = InverseAffine(worldMatrix);
+	gPerFrameConstants.projectionMatrix = MakeProjectionMatrix(1.0f, ToRadians(90.0f), NEAR_CLIP, range);
+	gPerFrameConstants.viewProjectionMatrix = gPerFrameConstants.viewMatrix * gPerFrameConstants.projectionMatrix;
+	UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
+	Frustum frustum = FrustumFromMatrix(gPerFrameConstants.viewProjectionMatrix);
+
+	gD3DContext->OMSetRenderTargets(0, nullptr, face);
+
+	int numDraws = 0;
+	for (auto model : casters)
+	{
+		if (TestFrustum(frustum, model->WorldBoundingBox()) == FrustumTest::Outside)  continue;
+		model->Render();
+		++numDraws;
+	}
+	if (staticBatches)
+	{
+		std::vector<unsigned int> batches;
+		gStaticBatches.Cull(frustum, batches);
+		gStaticBatches.Render(batches.data(), static_cast<unsigned int>(batches.size()));
+		numDraws += static_cast<int>(batches.size());
+	}
+	return numDraws;
+}
+
+
+void ShadowMaps::StaticKey(const std::vector<Model*>& staticCasters, bool staticBatches, std::vector<uintptr_t>& key)
+{
+	key.clear();
+	key.push_back(staticBatches ? gStaticBatches.Version() + 1 : 0);
+	for (auto model : staticCasters)
+	{
+		key.push_back(reinterpret_cast<uintptr_t>(model));
+		key.push_back(model->Version());
+	}
+}
@@ -0,0 +1,141 @@
+//--------------------------------------------------------------------------------------
+// Cached point light shadow maps
+//--------------------------------------------------------------------------------------
+// The main lights cast shadows from depth cubemaps, one slice of a cubemap array for each light, read by the lighting
+// shaders with a comparison sampler (see LightShadow in Lighting.hlsli). Most of the scene never moves, so each light
+// keeps two maps: a cache holding only the static casters, and the map used for lighting, a copy of the cache with the
+// dynamic casters drawn over it each frame. Drawing the static casters into six faces is by far the most costly part,
+// and is only done again when the static casters change or the light moves.
+//
+// A light that moves every frame has its cache drawn again at a reduced rate, at most once every UPDATE_INTERVAL
+// frames. Between updates the light's shadows are cast from where it was when the cache was drawn: the dynamic casters
+// and the shadow tests use the same position so the static and dynamic shadows still line up, and the shadows lag the
+// light by a few frames rather than breaking apart. The 2x2 filtering of the comparison sampler softens the small steps
+// the shadows jump by at each update. With no dynamic casters in range, a light's map is left as it was and costs nothing
+
+#ifndef _SHADOW_MAPS_H_INCLUDED_
+#define _SHADOW_MAPS_H_INCLUDED_
+
+#include "Bounds.h"
+#include "Common.h"
+
+#include <d3d11.h>
+#include <vector>
+
+class Model;
+
+
+class ShadowMaps
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Create the cache and lighting cubemaps for MAX_SHADOW_LIGHTS lights, each face the given size. Returns false on
+	// failure (reason in gLastError)
+	bool Init(int faceSize);
+
+	// Release the cubemaps
+	void Release();
+
+
+	// A light casting shadows, in the order of the light buffer (the shaders look up light i's map in slice i)
+	struct Light
+	{
+		CVector3 position;
+		float    range;    // Casters further away than this are left out, it is also the far clip of the faces
+	};
+
+	// Bring each light's maps up to date with the casters given: the static casters are only drawn into the light's cache
+	// when they have changed or the light has moved (see UPDATE_INTERVAL), the dynamic ones over a copy of it each frame.
+	// The static batches (see StaticBatches.h) are static casters too if staticBatches is true. Up to MAX_SHADOW_LIGHTS
+	// lights are used. Main thread only, uses the immediate context and writes the camera matrices of the per-frame
+	// constants, so call it before binding the camera. Sets its own render target, viewport and states
+	void Update(const std::vector<Light>& lights, const std::vector<Model*>& staticCasters, bool staticBatches,
+	            const std::vector<Model*>& dynamicCasters);
+
+	// Stop casting shadows, the lighting shaders are told there are no shadow maps. The caches are drawn again when
+	// Update is next called
+	void Disable();
+
+	// Bind the lighting maps, comparison sampler and shadow constants for the pixel shaders (SHADOW_MAP_SLOT,
+	// SHADOW_SAMPLER_SLOT and SHADOW_CONSTANTS_SLOT). Any context
+	void Bind();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	int FaceSize()          { return mFaceSize; }
+	int NumLights()         { return mNumLights; }
+	int NumCacheUpdates()   { return mNumCacheUpdates; }   // Caches drawn again last frame
+	int NumDynamicDraws()   { return mNumDynamicDraws; }   // Dynamic caster draws last frame, over all the faces
+	int NumStaticDraws()    { return mNumStaticDraws; }    // Static caster draws last frame (0 when all the caches were kept)
+
+	bool Enabled()  { return mNumLights > 0; }
+
+	// Changes whenever the lighting maps or the lights they are cast from change, for caches of frames lit by them (see
+	// FrameCache.h). A moving light's shadows can catch up with it a few frames after it stops
+	unsigned int Version()  { return mVersion; }
+
+	// Frames a moving light keeps its cache before it is drawn again
+	static const int UPDATE_INTERVAL;
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const int   NUM_FACES = 6;
+	static const float NEAR_CLIP;      // Of every face, the far clip is the light's range
+
+	// Create a cubemap array with a depth view for each face, and a shader resource view of the whole array if view isn't
+	// null. Returns false on failure (reason in gLastError)
+	bool CreateCubemaps(ID3D11Texture2D** texture, ID3D11DepthStencilView** faceViews, ID3D11ShaderResourceView** view);
+
+	// Draw the casters inside the face's frustum (and the static batches inside it if staticBatches is true) over what
+	// the face already holds. Returns the number of draws made
+	int DrawFace(ID3D11DepthStencilView* face, int faceIndex, const CVector3& position, float range,
+	             const std::vector<Model*>& casters, bool staticBatches);
+
+	// Key identifying the static casters, to tell when a cache must be drawn again
+	void StaticKey(const std::vector<Model*>& staticCasters, bool staticBatches, std::vector<uintptr_t>& key);
+
+	// What each light's cache was last drawn with
+	struct CachedLight
+	{
+		bool     valid = false;
+		CVector3 position;        // The shadows are cast from here until the cache is drawn again
+		float    range = 0.0f;
+		int      age   = 0;       // Frames since the cache was drawn
+		bool     hadDynamic = false; // The lighting map has dynamic casters drawn over the cache that must be cleared
+	};
+
+	int mFaceSize  = 0;
+	int mNumLights = 0;
+
+	ID3D11Texture2D*          mCache = nullptr;
+	ID3D11DepthStencilView*   mCacheFaces[MAX_SHADOW_LIGHTS * NUM_FACES] = {};
+	ID3D11Texture2D*          mMaps = nullptr;
+	ID3D11DepthStencilView*   mMapFaces[MAX_SHADOW_LIGHTS * NUM_FACES] = {};
+	ID3D11ShaderResourceView* mMapsSRV = nullptr;
+	ID3D11Buffer*             mConstantBuffer = nullptr;
+
+	CachedLight            mCachedLights[MAX_SHADOW_LIGHTS];
+	std::vector<uintptr_t> mStaticKey;     // Of the static casters the caches were drawn with
+	std::vector<uintptr_t> mFrameKey;      // Built each frame, kept to save allocating
+	ShadowConstants        mConstants = {};
+
+	int mNumCacheUpdates = 0;
+	int mNumDynamicDraws = 0;
+	int mNumStaticDraws  = 0;
+	unsigned int mVersion = 0;
+};
+
+
+extern ShadowMaps gShadowMaps;
+
+
+#endif //_SHADOW_MAPS_H_INCLUDED_
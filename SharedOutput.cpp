@@ -0,0 +1,171 @@
+//--------------------------------------------------------------------------------------
+// Shared texture output
+//--------------------------------------------------------------------------------------
+// See SharedOutput.h for an overview and the protocol consumers follow
+
+#include "SharedOutput.h"
+#include "ResourceRegistry.h"
+#include "Common.h"
+
+#include <dxgi1_2.h>
+#include <cstring>
+#include <cwchar>
+
+
+SharedOutput gSharedOutput;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+SharedOutput::~SharedOutput()
+{
+	Release();
+}
+
+
+bool SharedOutput::Start(const std::string& name)
+{
+	Release();
+
+	mMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(SharedOutputHeader), name.c_str());
+	if (mMapping == nullptr)
+	{
+		gLastError = "Error creating shared memory " + name;
+		return false;
+	}
+	mHeader = static_cast<SharedOutputHeader*>(MapViewOfFile(mMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedOutputHeader)));
+	if (mHeader == nullptr)
+	{
+		CloseHandle(mMapping);
+		mMapping = nullptr;
+		gLastError = "Error mapping shared memory " + name;
+		return false;
+	}
+
+	// No texture until the first frame, consumers wait for a generation above 0
+	std::memset(mHeader, 0, sizeof(SharedOutputHeader));
+	mHeader->version = SharedOutputHeader::VERSION;
+	mHeader->producerProcessId = GetCurrentProcessId();
+	mHeader->magic = SharedOutputHeader::MAGIC;
+
+	mName = name;
+	mNumShared = mNumSkipped = 0;
+	return true;
+}
+
+
+void SharedOutput::Release()
+{
+	ReleaseTexture();
+	if (mHeader)   UnmapViewOfFile(mHeader);
+	if (mMapping)  CloseHandle(mMapping);
+	mHeader  = nullptr;
+	mMapping = nullptr;
+}
+
+
+void SharedOutput::Share(ID3D11Resource* source)
+{
+	if (mHeader == nullptr)  return;
+
+	ID3D11Texture2D* texture = nullptr;
+	D3D11_TEXTURE2D_DESC desc;
+	if (FAILED(source->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&texture)))  return;
+	texture->GetDesc(&desc);
+	texture->Release();
+	if (desc.Width != mWidth || desc.Height != mHeight)
+	{
+		if (!CreateTexture(desc.Width, desc.Height))
+		{
+			OutputDebugStringA((gLastError + "\n").c_str());
+			Release(); // Don't try again every frame
+			return;
+		}
+	}
+
+	// Don't wait for a consumer, they get the next frame instead
+	if (mMutex->AcquireSync(0, 0) != S_OK)
+	{
+		++mNumSkipped;
+		return;
+	}
+	gD3DContext->CopyResource(mTexture, source);
+	mMutex->ReleaseSync(0);
+
+	InterlockedExchange(&mHeader->frameNumber, mHeader->frameNumber + 1);
+	++mNumShared;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+bool SharedOutput::CreateTexture(UINT width, UINT height)
+{
+	ReleaseTexture();
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width  = width;
+	desc.Height = height;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET; // So consumers can sample or draw into it
+	desc.MiscFlags = D3D11_RESOURCE_MISC_SHARED_NTHANDLE | D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX;
+	if (FAILED(gD3DDevice->CreateTexture2D(&desc, nullptr, &mTexture)))
+	{
+		gLastError = "Error creating shared output texture";
+		return false;
+	}
+	gResourceRegistry.Track(mTexture);
+	if (FAILED(mTexture->QueryInterface(__uuidof(IDXGIKeyedMutex), (void**)&mMutex)))
+	{
+		ReleaseTexture();
+		gLastError = "Error getting shared output texture mutex";
+		return false;
+	}
+
+	// A new name for each texture, so a consumer can't open the old one by mistake after a resize
+	long generation = mHeader->generation + 1;
+	wchar_t textureName[64];
+	std::swprintf(textureName, 64, L"Local\\PostProcessingOutput_%lu_%ld", GetCurrentProcessId(), generation);
+
+	IDXGIResource1* resource = nullptr;
+	HRESULT hr = mTexture->QueryInterface(__uuidof(IDXGIResource1), (void**)&resource);
+	if (SUCCEEDED(hr))
+	{
+		hr = resource->CreateSharedHandle(nullptr, DXGI_SHARED_RESOURCE_READ | DXGI_SHARED_RESOURCE_WRITE, textureName, &mTextureHandle);
+		resource->Release();
+	}
+	if (FAILED(hr))
+	{
+		ReleaseTexture();
+		gLastError = "Error creating shared output texture handle";
+		return false;
+	}
+
+	mWidth  = width;
+	mHeight = height;
+	mHeader->width  = width;
+	mHeader->height = height;
+	mHeader->format = desc.Format;
+	std::wcsncpy(mHeader->textureName, textureName, 64);
+	InterlockedExchange(&mHeader->generation, generation); // Last, consumers read the rest once this changes
+	return true;
+}
+
+void SharedOutput::ReleaseTexture()
+{
+	if (mTextureHandle)  CloseHandle(mTextureHandle);
+	if (mMutex)          mMutex->Release();
+	if (mTexture)        mTexture->Release();
+	mTextureHandle = nullptr;
+	mMutex   = nullptr;
+	mTexture = nullptr;
+	mWidth = mHeight = 0;
+}
@@ -0,0 +1,103 @@
+//--------------------------------------------------------------------------------------
+// Shared texture output
+//--------------------------------------------------------------------------------------
+// Hands the finished frames to other processes (a streaming encoder, a compositor) on the GPU, with no copy through
+// system memory. Each frame is copied into a texture created as a shared resource with an NT handle and a keyed mutex,
+// which other processes open on their own device. The copy stays in video memory, so this keeps up at sizes where
+// reading the frames back to the CPU (see FrameCapture.h) can't.
+//
+// The details a consumer needs are published in a small block of named shared memory, laid out as SharedOutputHeader
+// below. To read the frames:
+//   - Open the file mapping named by the -shareoutput switch (default "Local\PostProcessingOutput") and map it
+//   - Open the texture with ID3D11Device1::OpenSharedResourceByName, using textureName from the header
+//   - Each frame, AcquireSync(0, timeout) on the texture's IDXGIKeyedMutex, copy or read it, then ReleaseSync(0)
+//   - frameNumber goes up after every frame written. If generation changes the texture has been replaced (the window
+//     was resized) - release the old texture and open the new name
+// There is only one texture, holding the latest frame. The renderer never waits for a consumer: if a consumer holds
+// the mutex when a frame is finished, that frame isn't shared. Consumers should hold it only as long as a copy takes
+
+#ifndef _SHARED_OUTPUT_H_INCLUDED_
+#define _SHARED_OUTPUT_H_INCLUDED_
+
+#include <d3d11.h>
+#include <string>
+#include <stdint.h>
+
+
+// Layout of the shared memory read by consumers. Check magic and version before using the rest
+struct SharedOutputHeader
+{
+	static const uint32_t MAGIC   = 0x54554F50; // "POUT"
+	static const uint32_t VERSION = 1;
+
+	uint32_t      magic;
+	uint32_t      version;
+	uint32_t      producerProcessId;
+	uint32_t      width;
+	uint32_t      height;
+	uint32_t      format;      // DXGI_FORMAT of the texture
+	volatile long generation;  // Goes up each time the texture is replaced, textureName changes with it
+	volatile long frameNumber; // Goes up after each frame is written to the texture
+	wchar_t       textureName[64];
+};
+
+
+class SharedOutput
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~SharedOutput();
+
+	// Publish the frames under the given shared memory name. The texture is created on the first call to Share.
+	// Returns false if the shared memory can't be created (reason in gLastError)
+	bool Start(const std::string& name);
+
+	// Stop sharing and release the texture and shared memory
+	void Release();
+
+
+	// Copy the given texture (the back buffer, 8-bit RGBA) to the shared texture. Skips the frame rather than waiting if
+	// a consumer holds the keyed mutex. Call once per frame on the render thread
+	void Share(ID3D11Resource* source);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	bool        Sharing()     { return mHeader != nullptr; }
+	std::string Name()        { return mName; }
+	int         NumShared()   { return mNumShared; }  // Frames written to the texture
+	int         NumSkipped()  { return mNumSkipped; } // Frames not shared because a consumer held the texture
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Replace the shared texture with one of the given size. Returns false on failure (reason in gLastError)
+	bool CreateTexture(UINT width, UINT height);
+	void ReleaseTexture();
+
+	std::string         mName;
+	HANDLE              mMapping = nullptr;
+	SharedOutputHeader* mHeader  = nullptr;
+
+	ID3D11Texture2D* mTexture       = nullptr;
+	IDXGIKeyedMutex* mMutex         = nullptr;
+	HANDLE           mTextureHandle = nullptr; // Keeps the named handle open for consumers
+	UINT             mWidth  = 0;
+	UINT             mHeight = 0;
+
+	int mNumShared  = 0;
+	int mNumSkipped = 0;
+};
+
+
+extern SharedOutput gSharedOutput;
+
+
+#endif //_SHARED_OUTPUT_H_INCLUDED_
@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+// Contrast-Adaptive Sharpening Post-Processing Compute Shader
+//--------------------------------------------------------------------------------------
+// Run after SpatialUpscale_cs, after the robust contrast-adaptive sharpening (RCAS) of FidelityFX Super Resolution 1.
+// Each pixel is pushed away from its four neighbours by as much as it can be without any channel leaving the range
+// of the neighbourhood, so fine detail sharpens while edges that are already hard don't overshoot or halo. The work
+// is done on tonemapped colours so HDR highlights don't stop the rest of the image sharpening
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D           SceneTexture  : register(t0);
+RWTexture2D<float4> OutputTexture : register(u0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Threads across and down each group, must match UPSCALE_GROUP_SIZE in EffectChain.cpp
+#define GROUP_SIZE 8
+
+// Strongest sharpening allowed, as in RCAS. Stronger still and the noise in flat areas is picked out
+#define MAX_SHARPEN_LOBE 0.1875f
+
+// Tonemap into 0 to 1 by the brightest channel so the hue is kept, and back again
+float3 Compress(float3 colour)
+{
+	return colour / (1 + max(colour.r, max(colour.g, colour.b)));
+}
+
+float3 Expand(float3 colour)
+{
+	return colour / max(1 - max(colour.r, max(colour.g, colour.b)), 1.0f / 256.0f);
+}
+
+float3 LoadCompressed(int2 pixel, int2 maxPixel)
+{
+	return Compress(SceneTexture.Load(int3(clamp(pixel, 0, maxPixel), 0)).rgb);
+}
+
+
+[numthreads(GROUP_SIZE, GROUP_SIZE, 1)]
+void main(uint3 pixel : SV_DispatchThreadID)
+{
+	int2 size = int2(gInputSize);
+	if (any(int2(pixel.xy) >= size))  return;
+
+	// The pixel (e) and its neighbours
+	//      b
+	//    d e f
+	//      h
+	int2 maxPixel = size - 1;
+	float3 b = LoadCompressed(int2(pixel.xy) + int2( 0, -1), maxPixel);
+	float3 d = LoadCompressed(int2(pixel.xy) + int2(-1,  0), maxPixel);
+	float3 e = LoadCompressed(int2(pixel.xy),                maxPixel);
+	float3 f = LoadCompressed(int2(pixel.xy) + int2( 1,  0), maxPixel);
+	float3 h = LoadCompressed(int2(pixel.xy) + int2( 0,  1), maxPixel);
+
+	// The most negative weight for the neighbours that keeps every channel of the result within 0 to 1 and the range
+	// of the neighbourhood
+	float3 minimum = min(min(b, d), min(f, h));
+	float3 maximum = max(max(b, d), max(f, h));
+	float3 hitMinimum = min(minimum, e) / max(4 * maximum, 1e-5f);
+	float3 hitMaximum = (1 - max(maximum, e)) / min(4 * minimum - 4, -1e-5f);
+	float3 lobes = max(-hitMinimum, hitMaximum);
+	float  lobe  = max(-MAX_SHARPEN_LOBE, min(max(lobes.r, max(lobes.g, lobes.b)), 0)) * gUpscaleSharpness;
+
+	float3 colour = (lobe * (b + d + f + h) + e) / (4 * lobe + 1);
+	OutputTexture[pixel.xy] = float4(Expand(colour), 1.0f);
+}
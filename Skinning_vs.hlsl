@@ -0,0 +1,49 @@
+//--------------------------------------------------------------------------------------
+// Pre-skinning Vertex Shader
+//--------------------------------------------------------------------------------------
+// Skins the vertices of a skinned mesh once per frame. The result is written straight to a vertex buffer with the
+// stream-out stage (see Mesh::Skin) rather than drawn, and the passes that follow draw that buffer with the ordinary
+// non-skinned shaders. The output vertices are in world space since the bone matrices already include the world matrix
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Shader input / output
+//--------------------------------------------------------------------------------------
+
+// Vertex data for skinned models - up to four bones influence each vertex, the weights add up to 1
+struct SkinnedVertex
+{
+    float3 position : position;
+    float3 normal   : normal;
+    float2 uv       : uv;
+    uint4  bones    : bones;
+    float4 weights  : weights;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Blend the matrices of the bones influencing the vertex and transform it by the result. The output has the same
+// layout as BasicVertex so it can be used by any vertex shader for non-skinned models
+BasicVertex main(SkinnedVertex skinnedVertex)
+{
+    BasicVertex output;
+
+    float4x4 skinMatrix = gBoneMatrices[skinnedVertex.bones.x] * skinnedVertex.weights.x
+                        + gBoneMatrices[skinnedVertex.bones.y] * skinnedVertex.weights.y
+                        + gBoneMatrices[skinnedVertex.bones.z] * skinnedVertex.weights.z
+                        + gBoneMatrices[skinnedVertex.bones.w] * skinnedVertex.weights.w;
+
+    output.position = mul(skinMatrix, float4(skinnedVertex.position, 1)).xyz;
+
+    // The blended matrix may have some scaling, so renormalise the normal (later shaders expect unit normals)
+    output.normal = normalize(mul(skinMatrix, float4(skinnedVertex.normal, 0)).xyz);
+
+    output.uv = skinnedVertex.uv;
+
+    return output;
+}
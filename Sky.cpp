@@ -0,0 +1,169 @@
+//--------------------------------------------------------------------------------------
+// Sky pass
+//--------------------------------------------------------------------------------------
+// See Sky.h for an overview
+
+#include "Sky.h"
+#include "CookedAssets.h"
+#include "AssetPack.h"
+#include "Shader.h"
+#include "State.h"
+#include "StateCache.h"
+#include "ResourceRegistry.h"
+#include "CpuProfiler.h"
+#include "StartupProfiler.h"
+#include "Common.h"
+
+#include <DDSTextureLoader.h>
+#include <algorithm>
+#include <vector>
+#include <atlbase.h> // C-string to unicode conversion function CA2CT
+
+
+Sky gSky;
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+namespace
+{
+	// Create a cubemap texture and shader resource view from decoded faces, as R8G8B8A8_UNORM. Only uses the device
+	bool CreateCubemapFromFaces(const CookedTexture faces[NUM_CUBE_FACES], ID3D11Resource** texture,
+	                            ID3D11ShaderResourceView** textureSRV)
+	{
+		D3D11_TEXTURE2D_DESC textureDesc = {};
+		textureDesc.Width = faces[0].mips[0].width;
+		textureDesc.Height = faces[0].mips[0].height;
+		textureDesc.MipLevels = static_cast<UINT>(faces[0].mips.size());
+		textureDesc.ArraySize = NUM_CUBE_FACES;
+		textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		textureDesc.SampleDesc.Count = 1;
+		textureDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		textureDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+
+		// Subresources are each face's mips in turn
+		std::vector<D3D11_SUBRESOURCE_DATA> initData;
+		for (int face = 0; face < NUM_CUBE_FACES; ++face)
+		{
+			for (auto& mip : faces[face].mips)  initData.push_back({ mip.pixels.data(), mip.width * 4, 0 });
+		}
+
+		ID3D11Texture2D* texture2D;
+		if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, initData.data(), &texture2D)))  return false;
+		gResourceRegistry.Track(texture2D);
+		if (FAILED(gD3DDevice->CreateShaderResourceView(texture2D, nullptr, textureSRV)))
+		{
+			texture2D->Release();
+			return false;
+		}
+		*texture = texture2D;
+		return true;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+Sky::~Sky()
+{
+	Release();
+}
+
+
+bool Sky::Load(const std::string& panoramaFileName)
+{
+	CPU_PROFILE_SCOPE("Sky::Load");
+	STARTUP_SCOPE(StartupStage::Asset, panoramaFileName);
+	Release();
+
+	// Use the cooked cubemap from the asset pack or beside the image if there is one
+	std::string cookedFileName = CookedCubemapFileName(panoramaFileName);
+	const void* packData;
+	size_t packSize;
+	bool loaded = gAssetPack.Find(cookedFileName, packData, packSize) &&
+	              SUCCEEDED(DirectX::CreateDDSTextureFromMemory(gD3DDevice, static_cast<const uint8_t*>(packData), packSize, &mCubemap, &mCubemapSRV));
+	if (!loaded && IsCookedFileNewer(cookedFileName, panoramaFileName))
+	{
+		loaded = SUCCEEDED(DirectX::CreateDDSTextureFromFile(gD3DDevice, CA2CT(cookedFileName.c_str()), &mCubemap, &mCubemapSRV));
+	}
+
+	if (!loaded)
+	{
+		// Build the cubemap from the image. WIC needs COM on this thread, leave it as it was if it is already initialised
+		// in another mode
+		HRESULT comResult = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+		CookedTexture panorama;
+		std::string error;
+		bool decoded = DecodeTexture(panoramaFileName, panorama, error);
+		if (SUCCEEDED(comResult))  CoUninitialize();
+		if (!decoded)
+		{
+			gLastError = "Error loading sky " + panoramaFileName + ": " + error;
+			return false;
+		}
+
+		// A quarter of the panorama's width gives about the same detail around the horizon
+		CookedTexture faces[NUM_CUBE_FACES];
+		PanoramaToCubemap(panorama, std::max(panorama.mips[0].width / 4, 1u), faces);
+		if (!CreateCubemapFromFaces(faces, &mCubemap, &mCubemapSRV))
+		{
+			Release();
+			gLastError = "Error creating sky cubemap for " + panoramaFileName;
+			return false;
+		}
+
+		// Not fatal, the cubemap is just built again next time
+		if (!WriteCookedCubemap(cookedFileName, faces, error))  OutputDebugStringA((error + "\n").c_str());
+	}
+	else
+	{
+		gResourceRegistry.Track(mCubemap);
+	}
+
+	ID3D11Texture2D* texture2D;
+	if (SUCCEEDED(mCubemap->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&texture2D))))
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		texture2D->GetDesc(&desc);
+		mFaceSize = desc.Width;
+		texture2D->Release();
+	}
+	return true;
+}
+
+
+void Sky::Release()
+{
+	if (mCubemapSRV)  mCubemapSRV->Release();
+	if (mCubemap)     mCubemap   ->Release();
+	mCubemapSRV = nullptr;
+	mCubemap    = nullptr;
+	mFaceSize   = 0;
+}
+
+
+void Sky::Render()
+{
+	if (mCubemapSRV == nullptr)  return;
+
+	// No vertex or index buffers, the vertex shader makes the triangle from the vertex ID (as FullScreenQuad_pp.hlsl)
+	gStateCache.VSSetShader(gSkyVertexShader, nullptr, 0);
+	gStateCache.PSSetShader(gSkyPixelShader, nullptr, 0);
+	gStateCache.GSSetShader(nullptr, nullptr, 0);
+	gStateCache.IASetInputLayout(nullptr);
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	// Only where the depth buffer still holds the far plane
+	gStateCache.OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
+	gStateCache.OMSetDepthStencilState(gDepthLessEqualReadOnlyState, 0);
+	gStateCache.RSSetState(gCullNoneState);
+	gStateCache.SetSampler(0, gTrilinearSampler);
+	gD3DContext->PSSetShaderResources(0, 1, &mCubemapSRV);
+
+	gD3DContext->Draw(3, 0);
+}
@@ -0,0 +1,66 @@
+//--------------------------------------------------------------------------------------
+// Sky pass
+//--------------------------------------------------------------------------------------
+// The sky is drawn as one full screen triangle at the far plane after the opaque models, rather than as a huge star
+// sphere mesh. Its vertex shader works out each corner's world space view direction from the inverse view-projection
+// matrix, and the pixel shader samples a cubemap along the interpolated direction. With a less-equal read-only depth
+// test only the pixels the models left at the cleared depth are shaded, so there is no overdraw behind the models and no
+// mesh to transform, cull or sort, and the sky is the same however far the camera moves.
+//
+// The cubemap is made from the same panorama image the star sphere was textured with (see PanoramaToCubemap in
+// CookedAssets.h). It is normally cooked ahead of time by AssetCooker -cubemap, otherwise the first time it is loaded,
+// and saved beside the image for next time
+
+#ifndef _SKY_H_INCLUDED_
+#define _SKY_H_INCLUDED_
+
+#include <d3d11.h>
+#include <string>
+
+
+class Sky
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~Sky();
+
+	// Load the sky cubemap made from a panorama image: from the asset pack or the cooked cubemap file if either is up to
+	// date, otherwise from the image itself, writing the cooked file for next time. Main thread only, decoding the image
+	// and building the cubemap can take a second. Returns false on failure (reason in gLastError)
+	bool Load(const std::string& panoramaFileName);
+
+	// Release the cubemap
+	void Release();
+
+
+	// Draw the sky behind everything drawn so far. The immediate context's render target, depth buffer (with the opaque
+	// models in it) and viewport must be set and the camera's per-frame constants bound. Uses texture and sampler slot 0
+	void Render();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	bool Loaded()  { return mCubemapSRV != nullptr; }
+
+	int FaceSize()  { return static_cast<int>(mFaceSize); }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	ID3D11Resource*           mCubemap    = nullptr;
+	ID3D11ShaderResourceView* mCubemapSRV = nullptr;
+	unsigned int              mFaceSize   = 0;
+};
+
+
+extern Sky gSky;
+
+
+#endif //_SKY_H_INCLUDED_
@@ -0,0 +1,25 @@
+//--------------------------------------------------------------------------------------
+// Sky Pixel Shader
+//--------------------------------------------------------------------------------------
+// Samples the sky cubemap along the view direction through the pixel (see Sky.h)
+
+#include "Common.hlsli" // Shaders can also use include files - note the extension
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+TextureCube  SkyMap     : register(t0); // Made from the panorama the star sphere mesh was textured with
+SamplerState TexSampler : register(s0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(SkyPixelShaderInput input) : SV_Target
+{
+	// The cube is sampled by direction, which doesn't need to be unit length
+	return float4(SkyMap.Sample(TexSampler, input.direction).rgb, 1.0f);
+}
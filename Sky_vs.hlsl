@@ -0,0 +1,31 @@
+//--------------------------------------------------------------------------------------
+// Sky Vertex Shader
+//--------------------------------------------------------------------------------------
+// Generates a single triangle covering the screen at the far plane, as FullScreenQuad_pp.hlsl does, and passes on the
+// world space view direction through each corner for the sky pixel shader to sample the cubemap with (see Sky.h)
+
+#include "Common.hlsli" // Shaders can also use include files - note the extension
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+SkyPixelShaderInput main(uint vertexId : SV_VertexID)
+{
+	SkyPixelShaderInput output;
+
+	// Corners in projection space, with z = w so the depth is exactly 1, the value the depth buffer is cleared to. The
+	// less-equal depth test then only passes where no model has been drawn
+	const float2 TrianglePositions[3] = { float2(-1.0, 1.0),
+	                                      float2( 3.0, 1.0),
+	                                      float2(-1.0,-3.0) };
+	output.projectedPosition = float4(TrianglePositions[vertexId], 1.0, 1.0);
+
+	// Back to the point on the far plane in world space. The far plane is flat, so the direction towards it from the
+	// camera can be interpolated across the triangle and only needs normalising in the pixel shader
+	float4 worldPosition = mul(gInverseViewProjectionMatrix, output.projectedPosition);
+	output.direction = worldPosition.xyz / worldPosition.w - gCameraPosition;
+
+	return output;
+}
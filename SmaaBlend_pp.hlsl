@@ -0,0 +1,41 @@
+//--------------------------------------------------------------------------------------
+// SMAA Neighbourhood Blending Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Last pass of subpixel morphological anti-aliasing. Each pixel takes in the colours of its four neighbours by the
+// weights SmaaWeights_pp found on the edges between them. Pixels with no weights on any side are copied as they are
+
+#include "Antialiasing.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D SceneTexture   : register(t0);
+Texture2D WeightsTexture : register(t1);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	int2 pixel = (int2)input.projectedPosition.xy;
+	float4 colour = SceneTexture.Load(int3(pixel, 0));
+
+	// Weights towards the neighbour above, below, left and right. The edges below and right belong to those pixels
+	float4 own = WeightsTexture.Load(int3(pixel, 0));
+	float4 weights = float4(own.r, LoadClamped(WeightsTexture, pixel + int2(0, 1)).g,
+	                        own.b, LoadClamped(WeightsTexture, pixel + int2(1, 0)).a);
+	float total = dot(weights, 1);
+	if (total == 0)  return float4(colour.rgb, 1.0f);
+	if (total > 1)  weights /= total;
+
+	float3 blended = colour.rgb * (1 - dot(weights, 1));
+	blended += LoadClamped(SceneTexture, pixel + int2( 0, -1)).rgb * weights.x;
+	blended += LoadClamped(SceneTexture, pixel + int2( 0,  1)).rgb * weights.y;
+	blended += LoadClamped(SceneTexture, pixel + int2(-1,  0)).rgb * weights.z;
+	blended += LoadClamped(SceneTexture, pixel + int2( 1,  0)).rgb * weights.w;
+	return float4(blended, 1.0f);
+}
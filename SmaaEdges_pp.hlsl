@@ -0,0 +1,47 @@
+//--------------------------------------------------------------------------------------
+// SMAA Edge Detection Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// First pass of subpixel morphological anti-aliasing (Jimenez et al.). Marks the left (r) and top (g) edges of each
+// pixel, where its brightness differs enough from the pixel on that side. With local contrast adaptation an edge is
+// dropped when a much stronger one is next to it, as that is the edge the eye follows
+
+#include "Antialiasing.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D SceneTexture : register(t0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+static const float EDGE_THRESHOLD            = 0.1f;
+static const float LOCAL_CONTRAST_ADAPTATION = 2.0f; // An edge is kept unless a neighbouring one is this much stronger
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	int2 pixel = (int2)input.projectedPosition.xy;
+	float luma = Luma(LoadClamped(SceneTexture, pixel).rgb);
+	float lumaLeft = Luma(LoadClamped(SceneTexture, pixel + int2(-1, 0)).rgb);
+	float lumaTop  = Luma(LoadClamped(SceneTexture, pixel + int2(0, -1)).rgb);
+
+	float2 delta = abs(luma - float2(lumaLeft, lumaTop));
+	float2 edges = step(EDGE_THRESHOLD, delta);
+	if (dot(edges, 1) == 0)  return 0;
+
+	// The strongest edge around the two found
+	float lumaRight    = Luma(LoadClamped(SceneTexture, pixel + int2( 1,  0)).rgb);
+	float lumaBottom   = Luma(LoadClamped(SceneTexture, pixel + int2( 0,  1)).rgb);
+	float lumaLeftLeft = Luma(LoadClamped(SceneTexture, pixel + int2(-2,  0)).rgb);
+	float lumaTopTop   = Luma(LoadClamped(SceneTexture, pixel + int2( 0, -2)).rgb);
+	float2 maxDelta = max(delta, abs(luma - float2(lumaRight, lumaBottom)));
+	maxDelta = max(maxDelta, abs(float2(lumaLeft, lumaTop) - float2(lumaLeftLeft, lumaTopTop)));
+	float finalDelta = max(maxDelta.x, maxDelta.y);
+
+	edges *= step(finalDelta, LOCAL_CONTRAST_ADAPTATION * delta);
+	return float4(edges, 0, 0);
+}
@@ -0,0 +1,107 @@
+//--------------------------------------------------------------------------------------
+// SMAA Blending Weight Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Second pass of subpixel morphological anti-aliasing. For each edge of a pixel found by SmaaEdges_pp, the edge is
+// followed both ways to its ends, and the edges crossing it there give its shape: an L, Z or U step in the outline of
+// the object. The outline is then redrawn as lines through the middles of the steps, and the area of the pixel and its
+// neighbour on the wrong side of the line is how much of each should take the other's colour.
+//
+// SMAA reads those areas from a precomputed texture for every pattern and distance. Here they are worked out from the
+// lines directly, which gives the same result for these sharp patterns without shipping the table.
+//
+// r: how much of the pixel takes the colour of the one above, g: how much of the one above takes this pixel's
+// b and a: the same for the pixel on the left
+
+#include "Antialiasing.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D EdgesTexture : register(t0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+static const int MAX_SEARCH_STEPS = 16; // Pixels followed each way along an edge
+
+// The positive and negative areas between a line and the edge over [x0, x1], going from height y0 to y1
+float2 LineArea(float x0, float y0, float x1, float y1)
+{
+	float width = x1 - x0;
+	if (width <= 0)  return 0;
+	if (y0 * y1 >= 0)
+	{
+		float area = 0.5f * (y0 + y1) * width;
+		return float2(max(area, 0), max(-area, 0));
+	}
+	float crossing = width * y0 / (y0 - y1); // Where the line crosses the edge
+	float area0 = 0.5f * y0 * crossing;
+	float area1 = 0.5f * y1 * (width - crossing);
+	return float2(max(area0, 0) + max(area1, 0), max(-area0, 0) + max(-area1, 0));
+}
+
+// Height of the redrawn outline at a distance along the edge. The ends are at start and end, with heights of half a
+// pixel towards the side of any step there. With a step at both ends the lines meet on the edge halfway
+float OutlineHeight(float x, float start, float end, float startHeight, float endHeight)
+{
+	if (startHeight != 0 && endHeight != 0)
+	{
+		float middle = 0.5f * (start + end);
+		return (x < middle) ? lerp(startHeight, 0, (x - start) / (middle - start))
+		                    : lerp(0, endHeight, (x - middle) / (end - middle));
+	}
+	return lerp(startHeight, endHeight, (x - start) / (end - start));
+}
+
+// Follow the edge of the pixel along a direction, edge is the component of the edges texture marking it (the top edge
+// for a horizontal edge) and crossing the component marking edges across it. across points to the neighbour on the
+// other side. Returns the areas of the pixel: x for the neighbour to take this pixel's colour, y for this pixel to take
+// the neighbour's
+float2 EdgeAreas(int2 pixel, int2 along, int2 across, int edge, int crossing)
+{
+	// Distances to the last pixels along the edge each way
+	int before = 0, after = 0;
+	[loop] for (; before < MAX_SEARCH_STEPS; ++before)
+	{
+		if (LoadClamped(EdgesTexture, pixel - (before + 1) * along)[edge] == 0)  break;
+	}
+	[loop] for (; after < MAX_SEARCH_STEPS; ++after)
+	{
+		if (LoadClamped(EdgesTexture, pixel + (after + 1) * along)[edge] == 0)  break;
+	}
+
+	// A step at an end is an edge crossing at the start of the pixel there, on the neighbour's side (the outline turns
+	// towards it) or this side. Both is a crossroads, with no step either way
+	int2  startPixel = pixel - before * along;
+	int2  endPixel   = pixel + (after + 1) * along;
+	float startHeight = 0.5f * (LoadClamped(EdgesTexture, startPixel + across)[crossing] - LoadClamped(EdgesTexture, startPixel)[crossing]);
+	float endHeight   = 0.5f * (LoadClamped(EdgesTexture, endPixel   + across)[crossing] - LoadClamped(EdgesTexture, endPixel  )[crossing]);
+	if (startHeight == 0 && endHeight == 0)  return 0; // A straight edge, nothing to smooth
+
+	// The pixel is from 0 to 1 along the edge, which runs from -before to after + 1
+	float start = -before, end = after + 1;
+	float height0 = OutlineHeight(0, start, end, startHeight, endHeight);
+	float height1 = OutlineHeight(1, start, end, startHeight, endHeight);
+	float middle = 0.5f * (start + end);
+	if (startHeight != 0 && endHeight != 0 && middle > 0 && middle < 1)
+	{
+		return LineArea(0, height0, middle, 0) + LineArea(middle, 0, 1, height1);
+	}
+	return LineArea(0, height0, 1, height1);
+}
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	int2 pixel = (int2)input.projectedPosition.xy;
+	float2 edges = EdgesTexture.Load(int3(pixel, 0)).rg;
+	if (dot(edges, 1) == 0)  return 0; // Most pixels, no search
+
+	float4 weights = 0;
+	if (edges.g > 0)  weights.gr = EdgeAreas(pixel, int2(1, 0), int2(0, -1), 1, 0);
+	if (edges.r > 0)  weights.ab = EdgeAreas(pixel, int2(0, 1), int2(-1, 0), 0, 1);
+	return weights;
+}
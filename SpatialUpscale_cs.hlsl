@@ -0,0 +1,160 @@
+//--------------------------------------------------------------------------------------
+// Edge-Adaptive Spatial Upscale Post-Processing Compute Shader
+//--------------------------------------------------------------------------------------
+// A sharper alternative to Upscale_pp for dynamic resolution, after AMD's FidelityFX Super Resolution 1 (EASU). Each
+// output pixel finds the direction and strength of the edge through the nearest four rendered pixels, then filters 12
+// rendered pixels with a Lanczos-like kernel stretched along that edge, so edges stay crisp rather than blurring
+// across. The result is clamped to the nearest four pixels so the kernel's negative lobes can't ring. Sharpen_cs is
+// run afterwards to restore detail lost to the low resolution
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D           SceneTexture  : register(t0); // Rendered into its top-left part, gPassUVScale of its size
+RWTexture2D<float4> OutputTexture : register(u0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Threads across and down each group, must match UPSCALE_GROUP_SIZE in EffectChain.cpp
+#define GROUP_SIZE 8
+
+// Size of the rendered part of the scene texture, in whole pixels
+static int2 RenderedMax;
+
+float3 LoadRendered(int2 pixel)
+{
+	return SceneTexture.Load(int3(clamp(pixel, 0, RenderedMax), 0)).rgb;
+}
+
+// Brightness for finding edges, compressed so HDR highlights don't swamp the rest
+float EdgeLuma(float3 colour)
+{
+	float luma = 0.5f * colour.r + colour.g + 0.5f * colour.b;
+	return luma / (1 + luma);
+}
+
+
+// Add the edge direction and length at one of the four nearest pixels (c), from its four neighbours, weighted by its
+// bilinear weight
+void AddEdge(inout float2 direction, inout float length, float weight,
+             float up, float left, float centre, float right, float down)
+{
+	float dirX  = right - left;
+	float lenX  = max(abs(right - centre), abs(centre - left));
+	lenX = saturate(abs(dirX) / max(lenX, 1e-5f));
+	direction.x += dirX * weight;
+	length      += lenX * lenX * weight;
+
+	float dirY  = down - up;
+	float lenY  = max(abs(down - centre), abs(centre - up));
+	lenY = saturate(abs(dirY) / max(lenY, 1e-5f));
+	direction.y += dirY * weight;
+	length      += lenY * lenY * weight;
+}
+
+// Add one tap, offset from the output position in rendered pixels. The offset is rotated into the edge's frame and
+// scaled by the stretch, then weighted by a polynomial approximation of a windowed Lanczos-2 whose negative lobe is
+// set by the edge strength
+void AddTap(inout float3 total, inout float totalWeight, float2 offset, float2 direction, float2 stretch,
+            float lobe, float clip, float3 colour)
+{
+	float2 v = float2(offset.x * direction.x + offset.y * direction.y,
+	                  offset.y * direction.x - offset.x * direction.y) * stretch;
+	float d2 = min(dot(v, v), clip);
+
+	float window = 0.4f * d2 - 1;
+	float base   = lobe * d2 - 1;
+	window = (25.0f / 16.0f) * window * window - (25.0f / 16.0f - 1);
+	float weight = window * base * base;
+
+	total       += colour * weight;
+	totalWeight += weight;
+}
+
+
+[numthreads(GROUP_SIZE, GROUP_SIZE, 1)]
+void main(uint3 pixel : SV_DispatchThreadID)
+{
+	uint outputWidth, outputHeight;
+	OutputTexture.GetDimensions(outputWidth, outputHeight);
+	if (pixel.x >= outputWidth || pixel.y >= outputHeight)  return;
+
+	float2 renderedSize = gInputSize * gPassUVScale;
+	RenderedMax = max(int2(renderedSize + 0.5f) - 1, 0);
+
+	// Position in the rendered pixels, split into the top-left of the nearest four and the fraction between them
+	float2 position = (pixel.xy + 0.5f) * renderedSize / float2(outputWidth, outputHeight) - 0.5f;
+	float2 topLeft  = floor(position);
+	float2 fraction = position - topLeft;
+	int2   f0 = int2(topLeft);
+
+	// The 12 taps, the nearest four (f g j k) and the two beyond each side of them
+	//      b c
+	//    e f g h
+	//    i j k l
+	//      n o
+	float3 b = LoadRendered(f0 + int2( 0, -1));
+	float3 c = LoadRendered(f0 + int2( 1, -1));
+	float3 e = LoadRendered(f0 + int2(-1,  0));
+	float3 f = LoadRendered(f0 + int2( 0,  0));
+	float3 g = LoadRendered(f0 + int2( 1,  0));
+	float3 h = LoadRendered(f0 + int2( 2,  0));
+	float3 i = LoadRendered(f0 + int2(-1,  1));
+	float3 j = LoadRendered(f0 + int2( 0,  1));
+	float3 k = LoadRendered(f0 + int2( 1,  1));
+	float3 l = LoadRendered(f0 + int2( 2,  1));
+	float3 n = LoadRendered(f0 + int2( 0,  2));
+	float3 o = LoadRendered(f0 + int2( 1,  2));
+
+	float lb = EdgeLuma(b), lc = EdgeLuma(c), le = EdgeLuma(e), lf = EdgeLuma(f), lg = EdgeLuma(g), lh = EdgeLuma(h);
+	float li = EdgeLuma(i), lj = EdgeLuma(j), lk = EdgeLuma(k), ll = EdgeLuma(l), ln = EdgeLuma(n), lo = EdgeLuma(o);
+
+	// Edge direction and length, blended bilinearly from the nearest four
+	float2 direction = 0;
+	float  length    = 0;
+	AddEdge(direction, length, (1 - fraction.x) * (1 - fraction.y), lb, le, lf, lg, lj);
+	AddEdge(direction, length,      fraction.x  * (1 - fraction.y), lc, lf, lg, lh, lk);
+	AddEdge(direction, length, (1 - fraction.x) *      fraction.y,  lf, li, lj, lk, ln);
+	AddEdge(direction, length,      fraction.x  *      fraction.y,  lg, lj, lk, ll, lo);
+
+	// Normalise the direction, flat areas filter as if the edge were horizontal
+	float directionSquared = dot(direction, direction);
+	direction = (directionSquared < 1.0f / 32768.0f) ? float2(1, 0) : direction * rsqrt(directionSquared);
+
+	// Stretch the kernel along the edge, more so for diagonal edges, and sharpen it across strong edges
+	length = 0.5f * length;
+	length *= length;
+	float diagonal = 1 / max(abs(direction.x), abs(direction.y));
+	float2 stretch = float2(1 + (diagonal - 1) * length, 1 - 0.5f * length);
+	float  lobe    = 0.5f + ((1.0f / 4.0f - 0.04f) - 0.5f) * length;
+	float  clip    = 1 / lobe;
+
+	float3 total = 0;
+	float  totalWeight = 0;
+	AddTap(total, totalWeight, float2( 0, -1) - fraction, direction, stretch, lobe, clip, b);
+	AddTap(total, totalWeight, float2( 1, -1) - fraction, direction, stretch, lobe, clip, c);
+	AddTap(total, totalWeight, float2(-1,  1) - fraction, direction, stretch, lobe, clip, i);
+	AddTap(total, totalWeight, float2( 0,  1) - fraction, direction, stretch, lobe, clip, j);
+	AddTap(total, totalWeight, float2( 0,  0) - fraction, direction, stretch, lobe, clip, f);
+	AddTap(total, totalWeight, float2(-1,  0) - fraction, direction, stretch, lobe, clip, e);
+	AddTap(total, totalWeight, float2( 1,  1) - fraction, direction, stretch, lobe, clip, k);
+	AddTap(total, totalWeight, float2( 2,  1) - fraction, direction, stretch, lobe, clip, l);
+	AddTap(total, totalWeight, float2( 2,  0) - fraction, direction, stretch, lobe, clip, h);
+	AddTap(total, totalWeight, float2( 1,  0) - fraction, direction, stretch, lobe, clip, g);
+	AddTap(total, totalWeight, float2( 1,  2) - fraction, direction, stretch, lobe, clip, o);
+	AddTap(total, totalWeight, float2( 0,  2) - fraction, direction, stretch, lobe, clip, n);
+
+	// Deringing - keep within the range of the nearest four
+	float3 minimum = min(min(f, g), min(j, k));
+	float3 maximum = max(max(f, g), max(j, k));
+	float3 colour = clamp(total / totalWeight, minimum, maximum);
+
+	OutputTexture[pixel.xy] = float4(colour, 1.0f);
+}
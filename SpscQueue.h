@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------------------------
+// Single producer / single consumer queue
+//--------------------------------------------------------------------------------------
+// A fixed size ring passing items from one thread to another in order, without locks. Only one thread may push and only
+// one (other) thread may pop. The producer writes an item before moving its end of the ring on, and the consumer reads
+// it before moving its own end, so neither ever sees a slot the other is using. Push fails rather than waits when full.
+
+#ifndef _SPSC_QUEUE_H_INCLUDED_
+#define _SPSC_QUEUE_H_INCLUDED_
+
+#include <atomic>
+#include <stdint.h>
+
+
+// Capacity must be a power of two
+template <typename T, uint32_t Capacity>
+class SpscQueue
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+	//-------------------------------------
+	// Producer
+	//-------------------------------------
+
+	// Add an item to the end of the queue. Returns false, dropping the item, if the queue is full
+	bool Push(const T& item)
+	{
+		uint32_t pushed = mPushed.load(std::memory_order_relaxed);
+		if (pushed - mPopped.load(std::memory_order_acquire) == Capacity)  return false;
+
+		mItems[pushed & (Capacity - 1)] = item;
+		mPushed.store(pushed + 1, std::memory_order_release);
+		return true;
+	}
+
+
+	//-------------------------------------
+	// Consumer
+	//-------------------------------------
+
+	// The item at the front of the queue, without removing it. Returns false if the queue is empty
+	bool Peek(T& item)
+	{
+		uint32_t popped = mPopped.load(std::memory_order_relaxed);
+		if (popped == mPushed.load(std::memory_order_acquire))  return false;
+
+		item = mItems[popped & (Capacity - 1)];
+		return true;
+	}
+
+	// Remove the item at the front of the queue. Returns false if the queue is empty
+	bool Pop(T& item)
+	{
+		if (!Peek(item))  return false;
+		mPopped.store(mPopped.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		return true;
+	}
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	T mItems[Capacity] = {};
+
+	// Totals pushed and popped, only ever increase. On separate cache lines so the two threads don't share one
+	alignas(64) std::atomic<uint32_t> mPushed{ 0 };
+	alignas(64) std::atomic<uint32_t> mPopped{ 0 };
+};
+
+
+#endif //_SPSC_QUEUE_H_INCLUDED_
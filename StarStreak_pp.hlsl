@@ -0,0 +1,40 @@
+//--------------------------------------------------------------------------------------
+// Star Streak Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// One pass of a star filter streak (Kawase's streak filter). Four bilinear taps in a line behind the pixel, along the
+// streak direction, weighted by an exponential fall-off and normalised. Each pass is run with a step four times longer
+// than the last, so after n passes each bright pixel is smeared into an exponentially fading line 4^n pixels long from
+// only 4n taps per pixel. One pass chain is run for each point of the star, then they are added together
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    SceneTexture   : register(t0);
+SamplerState PointSample    : register(s0);
+SamplerState BilinearSample : register(s1);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	float2 step = gStarStreakStep * gTexelSize; // gStarStreakStep is in pixels of this texture
+
+	float3 colour = 0;
+	float  weight = 1;
+	float  totalWeight = 0;
+	for (int tap = 0; tap < 4; ++tap)
+	{
+		colour += SceneTexture.Sample(BilinearSample, input.uv + step * tap).rgb * weight;
+		totalWeight += weight;
+		weight *= gStarStreakAttenuation;
+	}
+
+	return float4(colour / totalWeight * gStarStreakGain, 1.0f);
+}
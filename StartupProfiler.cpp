@@ -0,0 +1,217 @@
+//--------------------------------------------------------------------------------------
+// Startup profiler
+//--------------------------------------------------------------------------------------
+// See StartupProfiler.h for an overview
+
+#include "StartupProfiler.h"
+#include "TraceCapture.h"
+#include "PerfMetrics.h"
+#include "Common.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+
+StartupProfiler gStartupProfiler;
+
+const float StartupProfiler::TIME_LIMIT     = 60.0f;
+const int   StartupProfiler::SLOWEST_ASSETS = 10;
+
+thread_local int StartupProfiler::tThread = -1;
+
+
+namespace
+{
+	const char* STAGE_NAMES[] = { "phase", "asset", "read", "import", "process", "upload" };
+
+	const char* StageName(StartupStage stage)  { return STAGE_NAMES[static_cast<int>(stage)]; }
+
+	// True if the scope lies within the other's time
+	bool Within(const StartupProfiler::Scope& inner, const StartupProfiler::Scope& outer)
+	{
+		return inner.begin >= outer.begin && inner.end <= outer.end;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+void StartupProfiler::Start(int64_t origin)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mScopes.clear();
+	mSummary.clear();
+	mOrigin = origin;
+	mRecording = true;
+}
+
+
+bool StartupProfiler::Update(bool loading, const std::string& traceFile)
+{
+	if (!Recording())  return true;
+	if (loading && Milliseconds(CpuProfiler::Now() - mOrigin) < TIME_LIMIT * 1000)  return true;
+
+	// Scopes still open on other threads are dropped when they finish
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mRecording = false;
+	}
+	std::sort(mScopes.begin(), mScopes.end(), [](const Scope& a, const Scope& b) { return a.begin < b.begin; });
+
+	mSummary = BuildSummary();
+	OutputDebugStringA(mSummary.c_str());
+	for (auto& scope : mScopes)
+	{
+		if (scope.stage == StartupStage::Phase)  gPerfMetrics.AddSample("startup_phase_ms/" + scope.name, "ms", Milliseconds(scope.end - scope.begin));
+	}
+	return traceFile.empty() || WriteTrace(traceFile);
+}
+
+
+void StartupProfiler::Record(StartupStage stage, const std::string& name, int64_t begin, int64_t end)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (!mRecording)  return;
+	if (tThread < 0)  tThread = mNumThreads++;
+	mScopes.push_back({ stage, name, tThread, begin, end });
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+std::string StartupProfiler::BuildSummary()
+{
+	std::ostringstream summary;
+	summary << std::fixed << std::setprecision(1);
+
+	// Each asset's stages are the scopes on its thread within its time
+	struct Asset
+	{
+		const Scope* scope;
+		float        stageMilliseconds[6] = {};
+		bool         cold = false;
+	};
+	std::vector<Asset> assets;
+	std::set<int> assetThreads;
+	int numCold = 0;
+	for (auto& scope : mScopes)
+	{
+		if (scope.stage != StartupStage::Asset)  continue;
+		Asset asset;
+		asset.scope = &scope;
+		for (auto& stage : mScopes)
+		{
+			if (stage.stage <= StartupStage::Asset || stage.thread != scope.thread || !Within(stage, scope))  continue;
+			asset.stageMilliseconds[static_cast<int>(stage.stage)] += Milliseconds(stage.end - stage.begin);
+			if (stage.stage == StartupStage::Import)  asset.cold = true;
+		}
+		if (asset.cold)  ++numCold;
+		assetThreads.insert(scope.thread);
+		assets.push_back(asset);
+	}
+
+	int64_t lastEnd = mOrigin;
+	for (auto& scope : mScopes)  lastEnd = std::max(lastEnd, scope.end);
+	summary << "Startup: " << Milliseconds(lastEnd - mOrigin) << "ms until loading finished, " << assets.size() << " assets ("
+	        << assets.size() - numCold << " warm, " << numCold << " cold) on " << assetThreads.size() << " threads\n";
+
+	// Phases indented by nesting, with the assets loaded during each. The work done against the time taken shows how well
+	// the parallel loading scaled, given for the innermost phase holding the assets
+	for (auto& phase : mScopes)
+	{
+		if (phase.stage != StartupStage::Phase)  continue;
+		int depth = 0;
+		bool childHasAssets = false;
+		int numAssets = 0;
+		float work = 0.0f;
+		std::set<int> threads;
+		for (auto& asset : assets)
+		{
+			if (!Within(*asset.scope, phase))  continue;
+			++numAssets;
+			work += Milliseconds(asset.scope->end - asset.scope->begin);
+			threads.insert(asset.scope->thread);
+		}
+		for (auto& other : mScopes)
+		{
+			if (other.stage != StartupStage::Phase || &other == &phase || other.thread != phase.thread)  continue;
+			if (Within(phase, other))  ++depth;
+			if (Within(other, phase))
+			{
+				for (auto& asset : assets)  childHasAssets = childHasAssets || Within(*asset.scope, other);
+			}
+		}
+
+		float milliseconds = Milliseconds(phase.end - phase.begin);
+		summary << std::string(2 + depth * 2, ' ') << phase.name << " " << milliseconds << "ms";
+		if (numAssets > 0 && !childHasAssets)
+		{
+			summary << " - " << numAssets << " assets on " << threads.size() << " threads, " << work << "ms of loading ("
+			        << (milliseconds > 0.0f ? work / milliseconds : 0.0f) << "x)";
+		}
+		summary << "\n";
+	}
+
+	// The slowest assets, each stage's share and which thread loaded it
+	std::sort(assets.begin(), assets.end(), [](const Asset& a, const Asset& b)
+	{
+		return a.scope->end - a.scope->begin > b.scope->end - b.scope->begin;
+	});
+	if (!assets.empty())  summary << "Slowest assets:\n";
+	for (int a = 0; a < std::min(static_cast<int>(assets.size()), SLOWEST_ASSETS); ++a)
+	{
+		const Asset& asset = assets[a];
+		summary << "  " << asset.scope->name << " " << Milliseconds(asset.scope->end - asset.scope->begin) << "ms "
+		        << (asset.cold ? "cold" : "warm") << " on thread " << asset.scope->thread << ":";
+		for (int stage = static_cast<int>(StartupStage::Read); stage <= static_cast<int>(StartupStage::Upload); ++stage)
+		{
+			summary << " " << STAGE_NAMES[stage] << " " << asset.stageMilliseconds[stage];
+		}
+		summary << "\n";
+	}
+	return summary.str();
+}
+
+
+bool StartupProfiler::WriteTrace(const std::string& traceFile)
+{
+	std::ofstream file(traceFile);
+	if (!file.is_open())
+	{
+		gLastError = "Error writing startup trace to " + traceFile;
+		return false;
+	}
+
+	file.precision(3);
+	file << std::fixed;
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"PostProcessing startup\"}}";
+
+	double ticksToMicroseconds = 1000000.0 / static_cast<double>(CpuProfiler::Frequency());
+	for (auto& scope : mScopes)
+	{
+		file << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << scope.thread << ",\"cat\":\"" << StageName(scope.stage) << "\",\"name\":";
+		WriteJsonString(file, scope.stage <= StartupStage::Asset ? scope.name : StageName(scope.stage) + (" " + scope.name));
+		file << ",\"ts\":" << (scope.begin - mOrigin) * ticksToMicroseconds << ",\"dur\":" << (scope.end - scope.begin) * ticksToMicroseconds << "}";
+	}
+	for (int thread = 0; thread < mNumThreads; ++thread)
+	{
+		WriteTrackName(file, thread, thread == 0 ? "Render thread" : "Thread " + std::to_string(thread));
+	}
+
+	file << "\n]}\n";
+	return !file.fail();
+}
+
+
+float StartupProfiler::Milliseconds(int64_t ticks)
+{
+	return static_cast<float>(ticks) * 1000 / CpuProfiler::Frequency();
+}
@@ -0,0 +1,127 @@
+//--------------------------------------------------------------------------------------
+// Startup profiler
+//--------------------------------------------------------------------------------------
+// Times the phases of startup (InitDirect3D, InitGeometry and its parts, InitScene) and each asset loaded during it, split
+// into stages: reading the file, importing or decoding the source asset (only when there is no cooked or packed copy),
+// processing it (LODs, compaction) and creating its GPU resources. Put STARTUP_SCOPE(stage, name) at the start of a block
+// to time the rest of it. Unlike CPU_PROFILE_SCOPE the name can be built at run time (e.g. a file name), so each asset
+// gets its own scopes, and they are kept until startup finishes rather than merged each frame.
+//
+// Every scope is tagged with the thread it ran on, numbered in the order threads first record one. Startup finishes once
+// the streamed textures have loaded (or after a time limit), then a summary goes to the debugger output: the time in each
+// phase, the slowest assets with the time in each stage and whether they loaded warm (from cooked files or the asset
+// pack) or cold (imported or decoded from the source), and for each phase that loaded assets in parallel, the work done
+// against the time taken. With -startuptrace the scopes are also written as a Chrome Trace Event JSON file, one track
+// per thread, like TraceCapture.h. Recording takes a lock, fine for the few hundred scopes of startup, and scopes after
+// startup are skipped with a single check
+
+#ifndef _STARTUP_PROFILER_H_INCLUDED_
+#define _STARTUP_PROFILER_H_INCLUDED_
+
+#include "CpuProfiler.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#define STARTUP_SCOPE(stage, name) StartupScope CPU_PROFILE_JOIN(startupScope, __LINE__)(stage, name)
+
+
+// What a startup scope covers. Phases are the steps of startup on the render thread, assets enclose the stages of
+// loading one asset
+enum class StartupStage { Phase, Asset, Read, Import, Process, Upload };
+
+
+class StartupProfiler
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Start recording, with times measured from the given QueryPerformanceCounter value (the start of the process)
+	void Start(int64_t origin);
+
+	// Call once per frame after startup. Once nothing is left loading, or the time limit has passed, recording stops and
+	// the summary is written to the debugger output, and the timeline to the given file unless it is empty. Returns
+	// false if the file couldn't be written (reason in gLastError)
+	bool Update(bool loading, const std::string& traceFile);
+
+	// Used by StartupScope
+	bool Recording()  { return mRecording.load(std::memory_order_relaxed); }
+	void Record(StartupStage stage, const std::string& name, int64_t begin, int64_t end);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// A finished scope, times in QueryPerformanceCounter ticks
+	struct Scope
+	{
+		StartupStage stage;
+		std::string  name;
+		int          thread; // 0 for the first thread to record a scope (the render thread), others in order after it
+		int64_t      begin;
+		int64_t      end;
+	};
+
+	// The summary written when recording stopped, empty before
+	const std::string& Summary()  { return mSummary; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const float TIME_LIMIT;   // Seconds after the start to stop recording even if assets are still loading
+	static const int   SLOWEST_ASSETS; // Assets listed in the summary
+
+	// Build the summary text from the scopes
+	std::string BuildSummary();
+
+	// Write the scopes as a Chrome trace, returns false on failure (reason in gLastError)
+	bool WriteTrace(const std::string& traceFile);
+
+	float Milliseconds(int64_t ticks);
+
+	std::atomic<bool>  mRecording{ false };
+	std::mutex         mMutex;    // Guards the scopes and thread numbers while recording
+	std::vector<Scope> mScopes;
+	int                mNumThreads = 0;
+	int64_t            mOrigin = 0;
+	std::string        mSummary;
+
+	static thread_local int tThread; // This thread's number, -1 until it records a scope
+};
+
+
+extern StartupProfiler gStartupProfiler;
+
+
+// Times from construction to destruction while the startup profiler is recording, use STARTUP_SCOPE rather than this
+// directly
+class StartupScope
+{
+public:
+	StartupScope(StartupStage stage, const std::string& name)
+		: mStage(stage), mName(gStartupProfiler.Recording() ? name : std::string()),
+		  mBegin(gStartupProfiler.Recording() ? CpuProfiler::Now() : 0)  {}
+	~StartupScope()
+	{
+		if (mBegin != 0)  gStartupProfiler.Record(mStage, mName, mBegin, CpuProfiler::Now());
+	}
+
+	StartupScope(const StartupScope&) = delete;
+	StartupScope& operator=(const StartupScope&) = delete;
+
+private:
+	StartupStage mStage;
+	std::string  mName;
+	int64_t      mBegin;
+};
+
+
+#endif //_STARTUP_PROFILER_H_INCLUDED_
@@ -22,21 +22,27 @@
 ID3D11SamplerState* gPointSampler         = nullptr;
 ID3D11SamplerState* gTrilinearSampler     = nullptr;
 ID3D11SamplerState* gAnisotropic4xSampler = nullptr;
+ID3D11SamplerState* gBilinearClampSampler = nullptr;
+ID3D11SamplerState* gShadowComparisonSampler = nullptr;
 
 // Blend states allow us to switch between blending modes (none, additive, multiplicative etc.)
 ID3D11BlendState* gNoBlendingState       = nullptr;
 ID3D11BlendState* gAdditiveBlendingState = nullptr;
 ID3D11BlendState* gAlphaBlendingState    = nullptr;
+ID3D11BlendState* gPremultipliedAlphaBlendingState = nullptr;
 
 
 // Rasterizer states affect how triangles are drawn
 ID3D11RasterizerState* gCullBackState  = nullptr;
 ID3D11RasterizerState* gCullFrontState = nullptr;
 ID3D11RasterizerState* gCullNoneState  = nullptr;
+ID3D11RasterizerState* gShadowCasterState = nullptr;
 
 // Depth-stencil states allow us change how the depth buffer is used
 ID3D11DepthStencilState* gUseDepthBufferState = nullptr;
 ID3D11DepthStencilState* gDepthReadOnlyState  = nullptr;
+ID3D11DepthStencilState* gDepthEqualReadOnlyState = nullptr;
+ID3D11DepthStencilState* gDepthLessEqualReadOnlyState = nullptr;
 ID3D11DepthStencilState* gNoDepthBufferState  = nullptr;
 
 
@@ -108,6 +114,42 @@ bool CreateStates()
 	}
 
 
+	////-------- Bilinear Sampling with clamping (filtered reads of render targets in post-processing) --------////
+	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR; // Bilinear filtering, render targets have no mip-maps
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;   // Clamp so blurs don't pull in colours from the opposite edge of the screen
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;   // --"--
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;   // --"--
+	samplerDesc.MaxAnisotropy = 1;
+
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	samplerDesc.MinLOD = 0;
+
+	if (FAILED(gD3DDevice->CreateSamplerState(&samplerDesc, &gBilinearClampSampler)))
+	{
+		gLastError = "Error creating bilinear clamp sampler";
+		return false;
+	}
+
+
+	////-------- Shadow map comparison (filtered depth tests against the shadow maps) --------////
+	// Each of the four nearest texels is compared with the given depth and the results blended, softening the edges
+	samplerDesc.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	samplerDesc.MaxAnisotropy = 1;
+	samplerDesc.ComparisonFunc = D3D11_COMPARISON_LESS_EQUAL; // Lit if no nearer than the nearest caster
+
+	samplerDesc.MaxLOD = 0;
+	samplerDesc.MinLOD = 0;
+
+	if (FAILED(gD3DDevice->CreateSamplerState(&samplerDesc, &gShadowComparisonSampler)))
+	{
+		gLastError = "Error creating shadow comparison sampler";
+		return false;
+	}
+
+
     //--------------------------------------------------------------------------------------
 	// Rasterizer States
 	//--------------------------------------------------------------------------------------
@@ -156,6 +198,23 @@ bool CreateStates()
         gLastError = "Error creating cull-none state";
         return false;
     }
+
+
+    ////-------- Shadow casters --------////
+    // Both sides of the faces are drawn into shadow maps so open meshes still cast shadows. The depths are pushed away
+    // from the light, more on surfaces at a steep angle to it, so surfaces don't shadow themselves
+    rasterizerDesc.FillMode              = D3D11_FILL_SOLID;
+    rasterizerDesc.CullMode              = D3D11_CULL_NONE;
+    rasterizerDesc.DepthBias             = 100;
+    rasterizerDesc.SlopeScaledDepthBias  = 2.0f;
+    rasterizerDesc.DepthBiasClamp        = 0.0f;
+    rasterizerDesc.DepthClipEnable       = TRUE;
+
+    if (FAILED(gD3DDevice->CreateRasterizerState(&rasterizerDesc, &gShadowCasterState)))
+    {
+        gLastError = "Error creating shadow caster state";
+        return false;
+    }
 	
 	
     //--------------------------------------------------------------------------------------
@@ -225,6 +284,18 @@ bool CreateStates()
         gLastError = "Error creating additive blending state";
         return false;
     }
+
+
+	////-------- Premultiplied Alpha Blending State --------////
+    // The source colour has already been multiplied by its alpha, so alpha blended and additive (alpha 0) pixels can be
+    // drawn together in one pass
+    blendDesc.RenderTarget[0].SrcBlend  = D3D11_BLEND_ONE;
+    blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+    if (FAILED(gD3DDevice->CreateBlendState(&blendDesc, &gPremultipliedAlphaBlendingState)))
+    {
+        gLastError = "Error creating premultiplied alpha blending state";
+        return false;
+    }
     	
 	
 	//--------------------------------------------------------------------------------------
@@ -264,6 +335,36 @@ bool CreateStates()
     }
 
 
+    ////-------- Depth buffer equal, read only --------////
+    // Only draws pixels exactly at the depth already in the buffer - used after a depth pre-pass so each pixel is only shaded
+    // by the nearest surface. The geometry must be transformed in exactly the same way in both passes
+    depthStencilDesc.DepthEnable      = TRUE;
+    depthStencilDesc.DepthWriteMask   = D3D11_DEPTH_WRITE_MASK_ZERO;
+    depthStencilDesc.DepthFunc        = D3D11_COMPARISON_EQUAL;
+    depthStencilDesc.StencilEnable    = FALSE;
+
+    if (FAILED(gD3DDevice->CreateDepthStencilState(&depthStencilDesc, &gDepthEqualReadOnlyState)))
+    {
+        gLastError = "Error creating depth-equal-read-only state";
+        return false;
+    }
+
+
+    ////-------- Depth buffer less-equal, read only --------////
+    // Draws pixels at or in front of the depth already in the buffer - used for the sky, drawn at the far plane after
+    // the opaque models so it only covers the pixels they left at the cleared depth of 1
+    depthStencilDesc.DepthEnable      = TRUE;
+    depthStencilDesc.DepthWriteMask   = D3D11_DEPTH_WRITE_MASK_ZERO;
+    depthStencilDesc.DepthFunc        = D3D11_COMPARISON_LESS_EQUAL;
+    depthStencilDesc.StencilEnable    = FALSE;
+
+    if (FAILED(gD3DDevice->CreateDepthStencilState(&depthStencilDesc, &gDepthLessEqualReadOnlyState)))
+    {
+        gLastError = "Error creating depth-less-equal-read-only state";
+        return false;
+    }
+
+
 	////-------- Disable depth buffer --------////
     depthStencilDesc.DepthEnable      = FALSE;
     depthStencilDesc.DepthWriteMask   = D3D11_DEPTH_WRITE_MASK_ALL;
@@ -286,13 +387,19 @@ void ReleaseStates()
 {
     if (gUseDepthBufferState)    gUseDepthBufferState->Release();
     if (gDepthReadOnlyState)     gDepthReadOnlyState->Release();
+    if (gDepthEqualReadOnlyState) gDepthEqualReadOnlyState->Release();
+    if (gDepthLessEqualReadOnlyState) gDepthLessEqualReadOnlyState->Release();
     if (gNoDepthBufferState)     gNoDepthBufferState->Release();
     if (gCullBackState)          gCullBackState->Release();
     if (gCullFrontState)         gCullFrontState->Release();
+    if (gShadowCasterState)      gShadowCasterState->Release();
     if (gCullNoneState)          gCullNoneState->Release();
     if (gNoBlendingState)        gNoBlendingState->Release();
     if (gAlphaBlendingState)     gAlphaBlendingState->Release();
+    if (gPremultipliedAlphaBlendingState)  gPremultipliedAlphaBlendingState->Release();
     if (gAdditiveBlendingState)  gAdditiveBlendingState->Release();
+    if (gShadowComparisonSampler)  gShadowComparisonSampler->Release();
+    if (gBilinearClampSampler)   gBilinearClampSampler->Release();
     if (gAnisotropic4xSampler)   gAnisotropic4xSampler->Release();
     if (gTrilinearSampler)       gTrilinearSampler->Release();
     if (gPointSampler)           gPointSampler->Release();
@@ -21,17 +21,23 @@
 extern ID3D11SamplerState* gPointSampler;
 extern ID3D11SamplerState* gTrilinearSampler;
 extern ID3D11SamplerState* gAnisotropic4xSampler;
+extern ID3D11SamplerState* gBilinearClampSampler;
+extern ID3D11SamplerState* gShadowComparisonSampler; // Compares with the shadow maps' depths, 2x2 filtered (see ShadowMaps.h)
 
 extern ID3D11BlendState* gNoBlendingState;
 extern ID3D11BlendState* gAdditiveBlendingState;
 extern ID3D11BlendState* gAlphaBlendingState;
+extern ID3D11BlendState* gPremultipliedAlphaBlendingState; // Colours already multiplied by alpha, so alpha 0 is additive
 
 extern ID3D11RasterizerState*   gCullBackState;
 extern ID3D11RasterizerState*   gCullFrontState;
 extern ID3D11RasterizerState*   gCullNoneState;
+extern ID3D11RasterizerState*   gShadowCasterState; // No culling with a depth bias, for drawing into shadow maps
 
 extern ID3D11DepthStencilState* gUseDepthBufferState;
 extern ID3D11DepthStencilState* gDepthReadOnlyState;
+extern ID3D11DepthStencilState* gDepthEqualReadOnlyState;
+extern ID3D11DepthStencilState* gDepthLessEqualReadOnlyState;
 extern ID3D11DepthStencilState* gNoDepthBufferState;
 
 
@@ -0,0 +1,370 @@
+//--------------------------------------------------------------------------------------
+// Context state cache
+//--------------------------------------------------------------------------------------
+
+#include "StateCache.h"
+#include "Common.h"
+
+thread_local StateCache gStateCache; // Each render worker thread caches the state of its own deferred context
+
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+
+template <class T>
+bool StateCache::UpdateValue(Cached<T>& cached, const T& value)
+{
+	if (cached.known && !(cached.value != value))  return false;
+	cached.value = value;
+	cached.known = true;
+	return true;
+}
+
+template <class T>
+bool StateCache::UpdateSlots(Cached<T>* slots, int numSlots, UINT startSlot, UINT count, T const* values,
+                             UINT& firstChanged, UINT& numChanged)
+{
+	int lastChanged = -1;
+	int first = -1;
+	for (UINT i = 0; i < count; ++i)
+	{
+		T value = (values != nullptr ? values[i] : T());
+		UINT slot = startSlot + i;
+		if (static_cast<int>(slot) >= numSlots)
+		{
+			// Outside the cached range, must be set
+			if (first < 0)  first = i;
+			lastChanged = i;
+		}
+		else if (UpdateValue(slots[slot], value))
+		{
+			if (first < 0)  first = i;
+			lastChanged = i;
+		}
+	}
+	if (first < 0)  return false;
+
+	firstChanged = first;
+	numChanged = lastChanged - first + 1;
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+void StateCache::Invalidate()
+{
+	mVertexShader.known = mGeometryShader.known = mPixelShader.known = mComputeShader.known = false;
+	for (int i = 0; i < NUM_CONSTANT_BUFFERS; ++i)
+	{
+		mVSConstantBuffers[i].known = mGSConstantBuffers[i].known = false;
+		mPSConstantBuffers[i].known = mCSConstantBuffers[i].known = false;
+		mVSConstantFirst[i].known = mGSConstantFirst[i].known = false;
+		mPSConstantFirst[i].known = mCSConstantFirst[i].known = false;
+	}
+	for (int i = 0; i < NUM_SAMPLERS; ++i)  mPSSamplers[i].known = false;
+
+	// Bindings made by SetConstantBuffer / SetSampler are forgotten too, they may have been released
+	for (int i = 0; i < NUM_CONSTANT_BUFFERS; ++i)
+	{
+		mSlotConstantBuffers[i] = nullptr;
+		mSlotConstantFirst[i] = WHOLE_BUFFER;
+		mSlotConstantCount[i] = 0;
+	}
+	for (int i = 0; i < NUM_SAMPLERS; ++i)          mSlotSamplers[i] = nullptr;
+	mVSUsage = mGSUsage = mPSUsage = mCSUsage = {};
+
+	mBlendState.known = mBlendFactor.known = mSampleMask.known = false;
+	mDepthStencilState.known = mStencilRef.known = false;
+	mRasterizerState.known = false;
+
+	mInputLayout.known = mTopology.known = false;
+	for (int i = 0; i < NUM_VERTEX_BUFFERS; ++i)
+	{
+		mVertexBuffers[i].known = mVertexStrides[i].known = mVertexOffsets[i].known = false;
+	}
+	mIndexBuffer.known = mIndexFormat.known = mIndexOffset.known = false;
+}
+
+void StateCache::EndFrame()
+{
+	mLastFrameIssued   = mIssued;
+	mLastFrameFiltered = mFiltered;
+	mIssued   = 0;
+	mFiltered = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Shaders
+//--------------------------------------------------------------------------------------
+// Class instances are not cached - calls using them are always passed on and make the cached shader unknown.
+// When the shader changes, the slots it reads are looked up and any bound with SetConstantBuffer / SetSampler are set
+
+void StateCache::VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances)
+{
+	if (numClassInstances > 0)  mVertexShader.known = false;
+	else if (!Count(UpdateValue(mVertexShader, shader)))  return;
+	gD3DContext->VSSetShader(shader, classInstances, numClassInstances);
+	gShaderBindings.Find(shader, mVSUsage);
+	BindUsedSlots(mVSUsage, &StateCache::VSSetConstantBuffers, &StateCache::VSSetConstantBufferRange, nullptr);
+}
+
+void StateCache::GSSetShader(ID3D11GeometryShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances)
+{
+	if (numClassInstances > 0)  mGeometryShader.known = false;
+	else if (!Count(UpdateValue(mGeometryShader, shader)))  return;
+	gD3DContext->GSSetShader(shader, classInstances, numClassInstances);
+	gShaderBindings.Find(shader, mGSUsage);
+	BindUsedSlots(mGSUsage, &StateCache::GSSetConstantBuffers, &StateCache::GSSetConstantBufferRange, nullptr);
+}
+
+void StateCache::PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances)
+{
+	if (numClassInstances > 0)  mPixelShader.known = false;
+	else if (!Count(UpdateValue(mPixelShader, shader)))  return;
+	gD3DContext->PSSetShader(shader, classInstances, numClassInstances);
+	gShaderBindings.Find(shader, mPSUsage);
+	BindUsedSlots(mPSUsage, &StateCache::PSSetConstantBuffers, &StateCache::PSSetConstantBufferRange, &StateCache::PSSetSamplers);
+}
+
+void StateCache::CSSetShader(ID3D11ComputeShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances)
+{
+	if (numClassInstances > 0)  mComputeShader.known = false;
+	else if (!Count(UpdateValue(mComputeShader, shader)))  return;
+	gD3DContext->CSSetShader(shader, classInstances, numClassInstances);
+	gShaderBindings.Find(shader, mCSUsage);
+	BindUsedSlots(mCSUsage, &StateCache::CSSetConstantBuffers, &StateCache::CSSetConstantBufferRange, nullptr);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Constant buffers and samplers
+//--------------------------------------------------------------------------------------
+// Only the smallest range of slots that actually changed is set
+
+void StateCache::VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+	ForgetRanges(mVSConstantBuffers, mVSConstantFirst, startSlot, numBuffers);
+	UINT first, count;
+	if (!Count(UpdateSlots(mVSConstantBuffers, NUM_CONSTANT_BUFFERS, startSlot, numBuffers, buffers, first, count)))  return;
+	gD3DContext->VSSetConstantBuffers(startSlot + first, count, buffers + first);
+}
+
+void StateCache::GSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+	ForgetRanges(mGSConstantBuffers, mGSConstantFirst, startSlot, numBuffers);
+	UINT first, count;
+	if (!Count(UpdateSlots(mGSConstantBuffers, NUM_CONSTANT_BUFFERS, startSlot, numBuffers, buffers, first, count)))  return;
+	gD3DContext->GSSetConstantBuffers(startSlot + first, count, buffers + first);
+}
+
+void StateCache::PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+	ForgetRanges(mPSConstantBuffers, mPSConstantFirst, startSlot, numBuffers);
+	UINT first, count;
+	if (!Count(UpdateSlots(mPSConstantBuffers, NUM_CONSTANT_BUFFERS, startSlot, numBuffers, buffers, first, count)))  return;
+	gD3DContext->PSSetConstantBuffers(startSlot + first, count, buffers + first);
+}
+
+void StateCache::CSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers)
+{
+	ForgetRanges(mCSConstantBuffers, mCSConstantFirst, startSlot, numBuffers);
+	UINT first, count;
+	if (!Count(UpdateSlots(mCSConstantBuffers, NUM_CONSTANT_BUFFERS, startSlot, numBuffers, buffers, first, count)))  return;
+	gD3DContext->CSSetConstantBuffers(startSlot + first, count, buffers + first);
+}
+
+void StateCache::PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers)
+{
+	UINT first, count;
+	if (!Count(UpdateSlots(mPSSamplers, NUM_SAMPLERS, startSlot, numSamplers, samplers, first, count)))  return;
+	gD3DContext->PSSetSamplers(startSlot + first, count, samplers + first);
+}
+
+
+// Binding by slot, only set for the stages whose current shader reads the slot
+
+void StateCache::SetConstantBuffer(UINT slot, ID3D11Buffer* buffer)
+{
+	if (slot >= NUM_CONSTANT_BUFFERS)  return;
+	mSlotConstantBuffers[slot] = buffer;
+	mSlotConstantFirst[slot] = WHOLE_BUFFER;
+	uint32_t bit = 1u << slot;
+	if (mVSUsage.constantBuffers & bit)  VSSetConstantBuffers(slot, 1, &buffer);
+	if (mGSUsage.constantBuffers & bit)  GSSetConstantBuffers(slot, 1, &buffer);
+	if (mPSUsage.constantBuffers & bit)  PSSetConstantBuffers(slot, 1, &buffer);
+	if (mCSUsage.constantBuffers & bit)  CSSetConstantBuffers(slot, 1, &buffer);
+}
+
+void StateCache::SetConstantBuffer(UINT slot, ID3D11Buffer* buffer, UINT firstConstant, UINT numConstants)
+{
+	if (slot >= NUM_CONSTANT_BUFFERS)  return;
+	mSlotConstantBuffers[slot] = buffer;
+	mSlotConstantFirst[slot] = firstConstant;
+	mSlotConstantCount[slot] = numConstants;
+	uint32_t bit = 1u << slot;
+	if (mVSUsage.constantBuffers & bit)  VSSetConstantBufferRange(slot, buffer, firstConstant, numConstants);
+	if (mGSUsage.constantBuffers & bit)  GSSetConstantBufferRange(slot, buffer, firstConstant, numConstants);
+	if (mPSUsage.constantBuffers & bit)  PSSetConstantBufferRange(slot, buffer, firstConstant, numConstants);
+	if (mCSUsage.constantBuffers & bit)  CSSetConstantBufferRange(slot, buffer, firstConstant, numConstants);
+}
+
+void StateCache::SetSampler(UINT slot, ID3D11SamplerState* sampler)
+{
+	if (slot >= NUM_SAMPLERS)  return;
+	mSlotSamplers[slot] = sampler;
+	if (mPSUsage.samplers & (1u << slot))  PSSetSamplers(slot, 1, &sampler);
+}
+
+void StateCache::BindUsedSlots(const ShaderUsage& usage, void (StateCache::*setConstantBuffers)(UINT, UINT, ID3D11Buffer* const*),
+                               void (StateCache::*setConstantBufferRange)(UINT, ID3D11Buffer*, UINT, UINT),
+                               void (StateCache::*setSamplers)(UINT, UINT, ID3D11SamplerState* const*))
+{
+	for (UINT slot = 0; slot < NUM_CONSTANT_BUFFERS; ++slot)
+	{
+		if ((usage.constantBuffers & (1u << slot)) && mSlotConstantBuffers[slot] != nullptr)
+		{
+			if (mSlotConstantFirst[slot] == WHOLE_BUFFER)
+				(this->*setConstantBuffers)(slot, 1, &mSlotConstantBuffers[slot]);
+			else
+				(this->*setConstantBufferRange)(slot, mSlotConstantBuffers[slot], mSlotConstantFirst[slot], mSlotConstantCount[slot]);
+		}
+	}
+	if (setSamplers == nullptr)  return;
+	for (UINT slot = 0; slot < NUM_SAMPLERS; ++slot)
+	{
+		if ((usage.samplers & (1u << slot)) && mSlotSamplers[slot] != nullptr)
+		{
+			(this->*setSamplers)(slot, 1, &mSlotSamplers[slot]);
+		}
+	}
+}
+
+
+
+// Parts of constant buffers, cached by buffer and first constant. The count is the same for a given buffer and offset
+
+void StateCache::VSSetConstantBufferRange(UINT slot, ID3D11Buffer* buffer, UINT firstConstant, UINT numConstants)
+{
+	SetConstantBufferRange(mVSConstantBuffers, mVSConstantFirst, slot, buffer, firstConstant, numConstants, &ID3D11DeviceContext1::VSSetConstantBuffers1);
+}
+
+void StateCache::GSSetConstantBufferRange(UINT slot, ID3D11Buffer* buffer, UINT firstConstant, UINT numConstants)
+{
+	SetConstantBufferRange(mGSConstantBuffers, mGSConstantFirst, slot, buffer, firstConstant, numConstants, &ID3D11DeviceContext1::GSSetConstantBuffers1);
+}
+
+void StateCache::PSSetConstantBufferRange(UINT slot, ID3D11Buffer* buffer, UINT firstConstant, UINT numConstants)
+{
+	SetConstantBufferRange(mPSConstantBuffers, mPSConstantFirst, slot, buffer, firstConstant, numConstants, &ID3D11DeviceContext1::PSSetConstantBuffers1);
+}
+
+void StateCache::CSSetConstantBufferRange(UINT slot, ID3D11Buffer* buffer, UINT firstConstant, UINT numConstants)
+{
+	SetConstantBufferRange(mCSConstantBuffers, mCSConstantFirst, slot, buffer, firstConstant, numConstants, &ID3D11DeviceContext1::CSSetConstantBuffers1);
+}
+
+template <class SetFunction>
+void StateCache::SetConstantBufferRange(Cached<ID3D11Buffer*>* buffers, Cached<UINT>* firsts, UINT slot, ID3D11Buffer* buffer,
+                                        UINT firstConstant, UINT numConstants, SetFunction set)
+{
+	bool changed = UpdateValue(buffers[slot], buffer);
+	changed = UpdateValue(firsts[slot], firstConstant) || changed;
+	if (!Count(changed))  return;
+	(gD3DContext1->*set)(slot, 1, &buffer, &firstConstant, &numConstants);
+}
+
+void StateCache::ForgetRanges(Cached<ID3D11Buffer*>* buffers, Cached<UINT>* firsts, UINT startSlot, UINT count)
+{
+	for (UINT slot = startSlot; slot < startSlot + count && slot < NUM_CONSTANT_BUFFERS; ++slot)
+	{
+		if (!firsts[slot].known || firsts[slot].value != WHOLE_BUFFER)
+		{
+			buffers[slot].known = false;
+			firsts[slot].value = WHOLE_BUFFER;
+			firsts[slot].known = true;
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Pipeline states
+//--------------------------------------------------------------------------------------
+
+void StateCache::OMSetBlendState(ID3D11BlendState* state, const FLOAT blendFactor[4], UINT sampleMask)
+{
+	// A null blend factor means all 1s
+	BlendFactor factor = { { 1.0f, 1.0f, 1.0f, 1.0f } };
+	if (blendFactor != nullptr)  for (int i = 0; i < 4; ++i)  factor.rgba[i] = blendFactor[i];
+
+	bool changed = UpdateValue(mBlendState, state);
+	changed = UpdateValue(mBlendFactor, factor) || changed;
+	changed = UpdateValue(mSampleMask, sampleMask) || changed;
+	if (!Count(changed))  return;
+	gD3DContext->OMSetBlendState(state, blendFactor, sampleMask);
+}
+
+void StateCache::OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef)
+{
+	bool changed = UpdateValue(mDepthStencilState, state);
+	changed = UpdateValue(mStencilRef, stencilRef) || changed;
+	if (!Count(changed))  return;
+	gD3DContext->OMSetDepthStencilState(state, stencilRef);
+}
+
+void StateCache::RSSetState(ID3D11RasterizerState* state)
+{
+	if (!Count(UpdateValue(mRasterizerState, state)))  return;
+	gD3DContext->RSSetState(state);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Input assembler
+//--------------------------------------------------------------------------------------
+
+void StateCache::IASetInputLayout(ID3D11InputLayout* layout)
+{
+	if (!Count(UpdateValue(mInputLayout, layout)))  return;
+	gD3DContext->IASetInputLayout(layout);
+}
+
+void StateCache::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	if (!Count(UpdateValue(mTopology, topology)))  return;
+	gD3DContext->IASetPrimitiveTopology(topology);
+}
+
+// Slots are compared as a whole (buffer, stride and offset), and all the given slots are set if any of them changed
+void StateCache::IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets)
+{
+	bool changed = false;
+	for (UINT i = 0; i < numBuffers; ++i)
+	{
+		UINT slot = startSlot + i;
+		if (slot >= NUM_VERTEX_BUFFERS)
+		{
+			changed = true;
+			continue;
+		}
+		changed = UpdateValue(mVertexBuffers[slot], buffers[i]) || changed;
+		changed = UpdateValue(mVertexStrides[slot], strides[i]) || changed;
+		changed = UpdateValue(mVertexOffsets[slot], offsets[i]) || changed;
+	}
+	if (!Count(changed))  return;
+	gD3DContext->IASetVertexBuffers(startSlot, numBuffers, buffers, strides, offsets);
+}
+
+void StateCache::IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+	bool changed = UpdateValue(mIndexBuffer, buffer);
+	changed = UpdateValue(mIndexFormat, format) || changed;
+	changed = UpdateValue(mIndexOffset, offset) || changed;
+	if (!Count(changed))  return;
+	gD3DContext->IASetIndexBuffer(buffer, format, offset);
+}
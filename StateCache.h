@@ -0,0 +1,193 @@
+//--------------------------------------------------------------------------------------
+// Context state cache
+//--------------------------------------------------------------------------------------
+// Sits in front of the immediate context for the shader, constant buffer, sampler, pipeline state and input
+// assembler Set functions. Remembers what is bound and drops calls that would bind the same thing again, so code
+// can set up everything it needs for a draw without worrying about the cost of repeating what was already set.
+// The functions match the ID3D11DeviceContext ones. All calls of these Set functions must go through the cache
+// (or call Invalidate afterwards), otherwise it won't know what is really bound. Shader resources aren't cached
+//
+// SetConstantBuffer and SetSampler bind by slot for whichever shaders read that slot, rather than for a given stage.
+// Using the slots recorded by gShaderBindings, only the stages whose current shader reads the slot are set; setting
+// a shader later binds the slots it reads. This replaces binding the same buffer to every stage that might want it.
+// A slot can also be bound to part of a buffer (D3D11.1 constant buffer offsets, see ConstantBufferRing.h)
+
+#ifndef _STATE_CACHE_H_INCLUDED_
+#define _STATE_CACHE_H_INCLUDED_
+
+#include "ShaderBindings.h"
+
+#include <d3d11.h>
+
+
+class StateCache
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	StateCache()  { Invalidate(); }
+
+	// Forget everything that is bound, so the next call of each function is always passed on
+	void Invalidate();
+
+	// Call at the end of each frame to update the per-frame counts
+	void EndFrame();
+
+
+	void VSSetShader(ID3D11VertexShader*   shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances);
+	void GSSetShader(ID3D11GeometryShader* shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances);
+	void PSSetShader(ID3D11PixelShader*    shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances);
+	void CSSetShader(ID3D11ComputeShader*  shader, ID3D11ClassInstance* const* classInstances, UINT numClassInstances);
+
+	void VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers);
+	void GSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers);
+	void PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers);
+	void CSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers);
+
+	void PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers);
+
+	// Bind a constant buffer / sampler for all shaders that read the given slot (samplers are pixel shader only). Stays
+	// bound for shaders set later, until replaced or the cache is invalidated
+	void SetConstantBuffer(UINT slot, ID3D11Buffer* buffer);
+	void SetSampler(UINT slot, ID3D11SamplerState* sampler);
+
+	// Bind part of a constant buffer by slot, from firstConstant for numConstants (16 byte constants, both multiples of 16).
+	// Only when gD3DContext1 is available
+	void SetConstantBuffer(UINT slot, ID3D11Buffer* buffer, UINT firstConstant, UINT numConstants);
+
+	void OMSetBlendState(ID3D11BlendState* state, const FLOAT blendFactor[4], UINT sampleMask);
+	void OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef);
+	void RSSetState(ID3D11RasterizerState* state);
+
+	void IASetInputLayout(ID3D11InputLayout* layout);
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets);
+	void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// Calls passed on to / dropped by the cache in the last complete frame
+	int NumIssued()    { return mLastFrameIssued;   }
+	int NumFiltered()  { return mLastFrameFiltered; }
+
+	// Whether the current vertex shader reads only the vertex positions, see ShaderBindings.h
+	bool VSReadsPositionOnly()  { return mVSUsage.positionOnly; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const int NUM_CONSTANT_BUFFERS = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+	static const int NUM_SAMPLERS         = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT;
+	static const int NUM_VERTEX_BUFFERS   = 4; // Only the first few vertex buffer slots are cached, the rest always pass through
+	static const UINT WHOLE_BUFFER        = ~0u; // First constant cached for slots bound without an offset
+
+	// Bound objects, with a flag for whether the cached value is known at all
+	template <class T> struct Cached
+	{
+		T    value;
+		bool known;
+	};
+
+	// Blend factor in a form that can be compared and cached like the other values
+	struct BlendFactor
+	{
+		FLOAT rgba[4];
+		bool operator!=(const BlendFactor& other) const
+		{
+			return rgba[0] != other.rgba[0] || rgba[1] != other.rgba[1] || rgba[2] != other.rgba[2] || rgba[3] != other.rgba[3];
+		}
+	};
+
+	// Update the cached slots in the given range, returns false if nothing changed. On change, firstChanged / numChanged
+	// give the smallest range of slots that need setting
+	template <class T>
+	bool UpdateSlots(Cached<T>* slots, int numSlots, UINT startSlot, UINT count, T const* values, UINT& firstChanged, UINT& numChanged);
+
+	// Update a single cached value, returns false if it was already bound
+	template <class T>
+	bool UpdateValue(Cached<T>& cached, const T& value);
+
+	// Bind the constant buffers and samplers from SetConstantBuffer / SetSampler that the current shader of each stage reads
+	void BindUsedSlots(const ShaderUsage& usage, void (StateCache::*setConstantBuffers)(UINT, UINT, ID3D11Buffer* const*),
+	                   void (StateCache::*setConstantBufferRange)(UINT, ID3D11Buffer*, UINT, UINT),
+	                   void (StateCache::*setSamplers)(UINT, UINT, ID3D11SamplerState* const*));
+
+	// Bind part of a constant buffer to a single slot of one stage, cached along with the offset
+	void VSSetConstantBufferRange(UINT slot, ID3D11Buffer* buffer, UINT firstConstant, UINT numConstants);
+	void GSSetConstantBufferRange(UINT slot, ID3D11Buffer* buffer, UINT firstConstant, UINT numConstants);
+	void PSSetConstantBufferRange(UINT slot, ID3D11Buffer* buffer, UINT firstConstant, UINT numConstants);
+	void CSSetConstantBufferRange(UINT slot, ID3D11Buffer* buffer, UINT firstConstant, UINT numConstants);
+
+	// Shared by the above, set is the stage's D3D11.1 function
+	template <class SetFunction>
+	void SetConstantBufferRange(Cached<ID3D11Buffer*>* buffers, Cached<UINT>* firsts, UINT slot, ID3D11Buffer* buffer,
+	                            UINT firstConstant, UINT numConstants, SetFunction set);
+
+	// Before binding whole buffers to the given slots of a stage, forget the buffers of any that had an offset, so the
+	// same buffer without the offset isn't dropped as already bound
+	void ForgetRanges(Cached<ID3D11Buffer*>* buffers, Cached<UINT>* firsts, UINT startSlot, UINT count);
+
+	// Count a call as issued or filtered, returns issued
+	bool Count(bool issued)  { if (issued) ++mIssued; else ++mFiltered;  return issued; }
+
+
+	Cached<ID3D11VertexShader*>   mVertexShader;
+	Cached<ID3D11GeometryShader*> mGeometryShader;
+	Cached<ID3D11PixelShader*>    mPixelShader;
+	Cached<ID3D11ComputeShader*>  mComputeShader;
+
+	Cached<ID3D11Buffer*> mVSConstantBuffers[NUM_CONSTANT_BUFFERS];
+	Cached<ID3D11Buffer*> mGSConstantBuffers[NUM_CONSTANT_BUFFERS];
+	Cached<ID3D11Buffer*> mPSConstantBuffers[NUM_CONSTANT_BUFFERS];
+	Cached<ID3D11Buffer*> mCSConstantBuffers[NUM_CONSTANT_BUFFERS];
+	Cached<UINT>          mVSConstantFirst[NUM_CONSTANT_BUFFERS]; // First constant bound in each slot, or WHOLE_BUFFER
+	Cached<UINT>          mGSConstantFirst[NUM_CONSTANT_BUFFERS];
+	Cached<UINT>          mPSConstantFirst[NUM_CONSTANT_BUFFERS];
+	Cached<UINT>          mCSConstantFirst[NUM_CONSTANT_BUFFERS];
+
+	Cached<ID3D11SamplerState*> mPSSamplers[NUM_SAMPLERS];
+
+	// Given to SetConstantBuffer / SetSampler, and the slots read by the current shader of each stage
+	ID3D11Buffer*       mSlotConstantBuffers[NUM_CONSTANT_BUFFERS];
+	UINT                mSlotConstantFirst[NUM_CONSTANT_BUFFERS]; // WHOLE_BUFFER unless bound with an offset
+	UINT                mSlotConstantCount[NUM_CONSTANT_BUFFERS];
+	ID3D11SamplerState* mSlotSamplers[NUM_SAMPLERS];
+	ShaderUsage         mVSUsage;
+	ShaderUsage         mGSUsage;
+	ShaderUsage         mPSUsage;
+	ShaderUsage         mCSUsage;
+
+	Cached<ID3D11BlendState*>        mBlendState;
+	Cached<BlendFactor>              mBlendFactor;
+	Cached<UINT>                     mSampleMask;
+	Cached<ID3D11DepthStencilState*> mDepthStencilState;
+	Cached<UINT>                     mStencilRef;
+	Cached<ID3D11RasterizerState*>   mRasterizerState;
+
+	Cached<ID3D11InputLayout*>       mInputLayout;
+	Cached<D3D11_PRIMITIVE_TOPOLOGY> mTopology;
+	Cached<ID3D11Buffer*>            mVertexBuffers[NUM_VERTEX_BUFFERS];
+	Cached<UINT>                     mVertexStrides[NUM_VERTEX_BUFFERS];
+	Cached<UINT>                     mVertexOffsets[NUM_VERTEX_BUFFERS];
+	Cached<ID3D11Buffer*>            mIndexBuffer;
+	Cached<DXGI_FORMAT>              mIndexFormat;
+	Cached<UINT>                     mIndexOffset;
+
+	int mIssued   = 0; // Counts for the current frame
+	int mFiltered = 0;
+	int mLastFrameIssued   = 0;
+	int mLastFrameFiltered = 0;
+};
+
+
+extern thread_local StateCache gStateCache;
+
+
+#endif //_STATE_CACHE_H_INCLUDED_
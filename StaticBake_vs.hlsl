@@ -0,0 +1,28 @@
+//--------------------------------------------------------------------------------------
+// Static Batch Baking Vertex Shader
+//--------------------------------------------------------------------------------------
+// Transforms the vertices of a model that never moves into world space once, when the static batches are baked. The
+// result is written straight to the batch vertex buffer with the stream-out stage (see StaticBatches.h) rather than
+// drawn, and the batches are then drawn by the ordinary shaders with an identity world matrix
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// The output has the same layout as BasicVertex so it can be used by any vertex shader for non-skinned models
+BasicVertex main(BasicVertex modelVertex)
+{
+    BasicVertex output;
+
+    output.position = mul(gWorldMatrix, float4(modelVertex.position, 1)).xyz;
+
+    // The world matrix may have some scaling, so renormalise the normal (later shaders expect unit normals)
+    output.normal = normalize(mul(gWorldMatrix, float4(modelVertex.normal, 0)).xyz);
+
+    output.uv = modelVertex.uv;
+
+    return output;
+}
@@ -0,0 +1,197 @@
+//--------------------------------------------------------------------------------------
+// Static geometry batches
+//--------------------------------------------------------------------------------------
+// See StaticBatches.h for an overview
+
+#include "StaticBatches.h"
+#include "Model.h"
+#include "Mesh.h"
+#include "Shader.h"
+#include "StateCache.h"
+#include "InputLayoutCache.h"
+#include "ConstantBufferRing.h"
+#include "ResourceRegistry.h"
+#include "CpuProfiler.h"
+#include "Common.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+
+
+StaticBatches gStaticBatches;
+
+const float StaticBatches::CELL_SIZE = 64.0f;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+StaticBatches::~StaticBatches()
+{
+	Release();
+}
+
+
+bool StaticBatches::Bake(const std::vector<Source>& sources)
+{
+	CPU_PROFILE_SCOPE("StaticBatches::Bake");
+	Release();
+
+	// Group the models by texture and grid cell, in a fixed order so the same scene gives the same batches
+	typedef std::tuple<const void*, int, int> GroupKey;
+	std::map<GroupKey, std::vector<const Source*>> groups;
+	for (auto& source : sources)
+	{
+		if (!source.model->IsStatic() || !source.model->GetMesh()->CanBake())  continue;
+		CVector3 centre = source.model->WorldBoundingBox().Centre();
+		int cellX = static_cast<int>(std::floor(centre.x / CELL_SIZE));
+		int cellZ = static_cast<int>(std::floor(centre.z / CELL_SIZE));
+		groups[GroupKey(source.texture, cellX, cellZ)].push_back(&source);
+		mNumVertices += source.model->GetMesh()->NumBakedVertices();
+	}
+	if (mNumVertices == 0)  return true;
+
+	// Written by the stream-out stage then read as an ordinary vertex buffer
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.BindFlags = D3D11_BIND_STREAM_OUTPUT | D3D11_BIND_VERTEX_BUFFER;
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	bufferDesc.ByteWidth = mNumVertices * sizeof(BasicVertex);
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &mVertexBuffer)))
+	{
+		Release();
+		gLastError = "Error creating static batch vertex buffer";
+		return false;
+	}
+	gResourceRegistry.Track(mVertexBuffer);
+
+	// Nothing is rasterised (the stream-out shader has no rasterized stream)
+	gStateCache.VSSetShader(gStaticBakeVertexShader, nullptr, 0);
+	gStateCache.GSSetShader(gStaticBakeStreamOutShader, nullptr, 0);
+	gStateCache.PSSetShader(nullptr, nullptr, 0);
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
+
+	std::vector<uint32_t> indices;
+	unsigned int written = 0;
+	bool ok = true;
+	for (auto& group : groups)
+	{
+		Batch batch;
+		batch.texture     = group.second[0]->texture;
+		batch.firstVertex = written;
+		batch.startIndex  = static_cast<unsigned int>(indices.size());
+		for (size_t m = 0; m < group.second.size() && ok; ++m)
+		{
+			Model* model = group.second[m]->model;
+			ok = model->BakeWorldGeometry(mVertexBuffer, written, written - batch.firstVertex, indices);
+			written += model->GetMesh()->NumBakedVertices();
+			batch.bounds = (m == 0 ? model->WorldBoundingBox() : Union(batch.bounds, model->WorldBoundingBox()));
+			mModels.push_back(model);
+		}
+		batch.numIndices = static_cast<unsigned int>(indices.size()) - batch.startIndex;
+		mBatches.push_back(batch);
+	}
+
+	// Unbind the batch buffer so it can be used as a vertex buffer, and restore the usual state
+	ID3D11Buffer* noBuffer = nullptr;
+	UINT offset = 0;
+	gD3DContext->SOSetTargets(1, &noBuffer, &offset);
+	gStateCache.GSSetShader(nullptr, nullptr, 0);
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	if (!ok)
+	{
+		Release();
+		return false; // Reason is in gLastError
+	}
+
+	bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	bufferDesc.ByteWidth = static_cast<UINT>(indices.size() * sizeof(uint32_t));
+	D3D11_SUBRESOURCE_DATA initData = { indices.data(), 0, 0 };
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, &initData, &mIndexBuffer)))
+	{
+		Release();
+		gLastError = "Error creating static batch index buffer";
+		return false;
+	}
+	gResourceRegistry.Track(mIndexBuffer);
+	mNumIndices = static_cast<unsigned int>(indices.size());
+
+	const D3D11_INPUT_ELEMENT_DESC basicLayout[] =
+	{
+		{ "position", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,  0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "normal",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "uv",       0, DXGI_FORMAT_R32G32_FLOAT,    0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
+	mLayout = gInputLayoutCache.Get(basicLayout, 3);
+	if (mLayout == nullptr)
+	{
+		Release();
+		gLastError = "Error creating static batch vertex layout";
+		return false;
+	}
+
+	std::sort(mModels.begin(), mModels.end());
+	return true;
+}
+
+
+void StaticBatches::Release()
+{
+	if (mIndexBuffer)   mIndexBuffer ->Release();
+	if (mVertexBuffer)  mVertexBuffer->Release();
+	mIndexBuffer  = nullptr;
+	mVertexBuffer = nullptr;
+	mLayout       = nullptr;
+	mBatches.clear();
+	mModels.clear();
+	mNumVertices = mNumIndices = 0;
+	++mVersion;
+}
+
+
+void StaticBatches::Cull(const Frustum& frustum, std::vector<unsigned int>& batches)
+{
+	for (unsigned int b = 0; b < mBatches.size(); ++b)
+	{
+		if (TestFrustum(frustum, mBatches[b].bounds) != FrustumTest::Outside)  batches.push_back(b);
+	}
+}
+
+
+void StaticBatches::Render(const unsigned int* batches, unsigned int numBatches)
+{
+	if (numBatches == 0 || mIndexBuffer == nullptr)  return;
+	CPU_PROFILE_SCOPE("StaticBatches::Render");
+
+	// The vertices are already in world space
+	gPerModelConstants.worldMatrix = MatrixIdentity();
+	gPerModelConstants.objectColour = { 1, 1, 1 };
+	BindConstants(PER_MODEL_CONSTANTS_SLOT, gPerModelConstants, gPerModelConstantBuffer);
+
+	UINT stride = sizeof(BasicVertex);
+	UINT offset = 0;
+	gStateCache.IASetVertexBuffers(0, 1, &mVertexBuffer, &stride, &offset);
+	gStateCache.IASetInputLayout(mLayout);
+	gStateCache.IASetIndexBuffer(mIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	gStateCache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	for (unsigned int i = 0; i < numBatches; ++i)
+	{
+		const Batch& batch = mBatches[batches[i]];
+		ID3D11ShaderResourceView* texture = (batch.texture ? *batch.texture : nullptr);
+		gD3DContext->PSSetShaderResources(0, 1, &texture);
+		gD3DContext->DrawIndexed(batch.numIndices, batch.startIndex, static_cast<INT>(batch.firstVertex));
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Data access
+//--------------------------------------------------------------------------------------
+
+bool StaticBatches::Contains(Model* model)
+{
+	return std::binary_search(mModels.begin(), mModels.end(), model);
+}
@@ -0,0 +1,108 @@
+//--------------------------------------------------------------------------------------
+// Static geometry batches
+//--------------------------------------------------------------------------------------
+// Models that never move (see Model::SetStatic) are baked once into world space: each model's full detail vertices are
+// transformed by its world matrices on the GPU and streamed out into one shared vertex buffer (see Mesh::BakeWorldGeometry),
+// and its indices copied into one shared index buffer. Models sharing a texture are merged into a batch for each cell
+// of a grid over the ground, so a batch can still be frustum culled as a whole. A batch is drawn with one DrawIndexed
+// and an identity world matrix, so a scene dressed with hundreds of static models needs only a handful of draws.
+//
+// The batches are always drawn at full detail and aren't occlusion culled, trading GPU time for CPU time as the static
+// command lists do. Only rigid meshes with normals and uvs can be baked (see Mesh::CanBake), other models are left out
+// and drawn as before. Bake again whenever a baked model moves or changes
+
+#ifndef _STATIC_BATCHES_H_INCLUDED_
+#define _STATIC_BATCHES_H_INCLUDED_
+
+#include "Bounds.h"
+
+#include <d3d11.h>
+#include <vector>
+
+class Model;
+
+
+class StaticBatches
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~StaticBatches();
+
+	// A model to bake and the texture global it is drawn with, read each time the batch is drawn as streamed textures
+	// are replaced when they load
+	struct Source
+	{
+		Model*                           model;
+		ID3D11ShaderResourceView* const* texture;
+	};
+
+	// Replace the batches with new ones holding the static models in the list that can be baked (see Contains). Uses the
+	// immediate context and waits for the GPU, so main thread only and not every frame. Returns false on failure (reason
+	// in gLastError), leaving no batches
+	bool Bake(const std::vector<Source>& sources);
+
+	// Release the batches
+	void Release();
+
+
+	// Find the batches at least partly inside the frustum. Safe on any thread
+	void Cull(const Frustum& frustum, std::vector<unsigned int>& batches);
+
+	// Draw the given batches. Any context, the shaders for non-instanced models and the pass states must be selected.
+	// Binds each batch's texture to slot 0
+	void Render(const unsigned int* batches, unsigned int numBatches);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// True if the model is in one of the batches, so shouldn't be drawn separately
+	bool Contains(Model* model);
+
+	int NumBatches()    { return static_cast<int>(mBatches.size()); }
+	int NumModels()     { return static_cast<int>(mModels.size()); }
+	int NumVertices()   { return static_cast<int>(mNumVertices); }
+	int NumTriangles()  { return static_cast<int>(mNumIndices / 3); }
+
+	// Changes each time the batches are baked or released, for caches of what the batches draw (see ShadowMaps.h)
+	unsigned int Version()  { return mVersion; }
+
+	ID3D11ShaderResourceView* BatchTexture(unsigned int batch)  { return (mBatches[batch].texture ? *mBatches[batch].texture : nullptr); }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Size of the grid cells the batches are split into, in world units across the X-Z plane
+	static const float CELL_SIZE;
+
+	struct Batch
+	{
+		ID3D11ShaderResourceView* const* texture;
+		unsigned int                     firstVertex;
+		unsigned int                     startIndex;
+		unsigned int                     numIndices;
+		BoundingBox                      bounds;      // World space, around all its models
+	};
+
+	std::vector<Batch>  mBatches;
+	std::vector<Model*> mModels; // In the batches, sorted for Contains
+
+	ID3D11Buffer*      mVertexBuffer = nullptr; // BasicVertex in world space, written by the stream-out stage
+	ID3D11Buffer*      mIndexBuffer  = nullptr; // 32-bit, relative to each batch's first vertex
+	ID3D11InputLayout* mLayout       = nullptr; // From gInputLayoutCache, not released here
+	unsigned int       mNumVertices  = 0;
+	unsigned int       mNumIndices   = 0;
+	unsigned int       mVersion      = 0;
+};
+
+
+extern StaticBatches gStaticBatches;
+
+
+#endif //_STATIC_BATCHES_H_INCLUDED_
@@ -0,0 +1,64 @@
+//--------------------------------------------------------------------------------------
+// Summed-Area Table Column Compute Shader
+//--------------------------------------------------------------------------------------
+// Second pass of the summed-area table (SAT) used by the box blur. Each thread group runs a prefix sum down one
+// column of the output of the rows pass, so each output pixel holds the sum of all scene pixels above and to the left
+// of it (inclusive)
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D           RowSums : register(t0);
+RWTexture2D<float4> OutputTexture : register(u0); // R32G32B32A32_FLOAT
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Threads per group, the column is scanned in chunks of this many pixels
+#define SCAN_GROUP_SIZE 256
+
+// Double buffered so each step of the scan reads the previous step's results
+groupshared float4 Scan[2][SCAN_GROUP_SIZE];
+
+
+// One group per column (dispatched with a group size of 0 along the column, see PostProcessGraph::AddComputePass)
+[numthreads(1, SCAN_GROUP_SIZE, 1)]
+void main(uint3 groupID : SV_GroupID, uint3 threadID : SV_GroupThreadID)
+{
+	uint width, height;
+	RowSums.GetDimensions(width, height);
+
+	uint lineIndex = groupID.x;
+	uint thread = threadID.y;
+	float4 carry = 0; // Sum of all the chunks before the current one
+
+	for (uint start = 0; start < height; start += SCAN_GROUP_SIZE)
+	{
+		uint i = start + thread;
+		Scan[0][thread] = (i < height) ? float4(RowSums.Load(int3(lineIndex, i, 0)).rgb, 0.0f) : 0;
+		GroupMemoryBarrierWithGroupSync();
+
+		// Inclusive prefix sum over the chunk (Hillis-Steele), log2(SCAN_GROUP_SIZE) steps
+		uint current = 0;
+		for (uint stride = 1; stride < SCAN_GROUP_SIZE; stride *= 2)
+		{
+			float4 sum = Scan[current][thread];
+			if (thread >= stride)  sum += Scan[current][thread - stride];
+			Scan[1 - current][thread] = sum;
+			current = 1 - current;
+			GroupMemoryBarrierWithGroupSync();
+		}
+
+		if (i < height)  OutputTexture[uint2(lineIndex, i)] = Scan[current][thread] + carry;
+		carry += Scan[current][SCAN_GROUP_SIZE - 1];
+
+		// Wait for every thread to read the chunk total before the next chunk overwrites it
+		GroupMemoryBarrierWithGroupSync();
+	}
+}
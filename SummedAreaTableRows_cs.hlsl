@@ -0,0 +1,65 @@
+//--------------------------------------------------------------------------------------
+// Summed-Area Table Row Compute Shader
+//--------------------------------------------------------------------------------------
+// First pass of the summed-area table (SAT) used by the box blur. Each thread group runs a prefix sum along one row
+// of the scene, so each output pixel holds the sum of all pixels to its left (inclusive). The columns pass then sums
+// this result downwards to give the full table. Values are stored minus 0.5 so the sums stay near zero - with a
+// float table the size of the screen this keeps much more precision for the box averages read from it
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D           SceneTexture : register(t0);
+RWTexture2D<float4> OutputTexture : register(u0); // R32G32B32A32_FLOAT
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Threads per group, the row is scanned in chunks of this many pixels
+#define SCAN_GROUP_SIZE 256
+
+// Double buffered so each step of the scan reads the previous step's results
+groupshared float4 Scan[2][SCAN_GROUP_SIZE];
+
+
+// One group per row (dispatched with a group size of 0 along the row, see PostProcessGraph::AddComputePass)
+[numthreads(SCAN_GROUP_SIZE, 1, 1)]
+void main(uint3 groupID : SV_GroupID, uint3 threadID : SV_GroupThreadID)
+{
+	uint width, height;
+	SceneTexture.GetDimensions(width, height);
+
+	uint lineIndex = groupID.y;
+	uint thread = threadID.x;
+	float4 carry = 0; // Sum of all the chunks before the current one
+
+	for (uint start = 0; start < width; start += SCAN_GROUP_SIZE)
+	{
+		uint i = start + thread;
+		Scan[0][thread] = (i < width) ? float4(SceneTexture.Load(int3(i, lineIndex, 0)).rgb - 0.5f, 0.0f) : 0;
+		GroupMemoryBarrierWithGroupSync();
+
+		// Inclusive prefix sum over the chunk (Hillis-Steele), log2(SCAN_GROUP_SIZE) steps
+		uint current = 0;
+		for (uint stride = 1; stride < SCAN_GROUP_SIZE; stride *= 2)
+		{
+			float4 sum = Scan[current][thread];
+			if (thread >= stride)  sum += Scan[current][thread - stride];
+			Scan[1 - current][thread] = sum;
+			current = 1 - current;
+			GroupMemoryBarrierWithGroupSync();
+		}
+
+		if (i < width)  OutputTexture[uint2(i, lineIndex)] = Scan[current][thread] + carry;
+		carry += Scan[current][SCAN_GROUP_SIZE - 1];
+
+		// Wait for every thread to read the chunk total before the next chunk overwrites it
+		GroupMemoryBarrierWithGroupSync();
+	}
+}
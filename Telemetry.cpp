@@ -0,0 +1,105 @@
+//--------------------------------------------------------------------------------------
+// Frame time telemetry
+//--------------------------------------------------------------------------------------
+// See Telemetry.h for an overview
+
+#include "Telemetry.h"
+#include "Common.h"
+
+#include <algorithm>
+
+
+FrameTelemetry gTelemetry;
+
+
+// A frame is a hitch if it takes this many times longer than the normal frame time, and at least this much longer
+const float HITCH_FACTOR = 2.0f;
+const float HITCH_MIN_MS = 4.0f;
+
+// How quickly the normal frame time follows changes (per frame), and the frames to wait before looking for hitches
+const float BASELINE_RATE   = 0.05f;
+const int   BASELINE_FRAMES   = 30;
+
+// Frames between flushes of the stream, so a reader sees the data soon without flushing every frame
+const int STREAM_FLUSH_FRAMES = 30;
+
+
+FrameTelemetry::~FrameTelemetry()
+{
+	CloseStream();
+}
+
+
+// Stream every frame to the given CSV file or named pipe
+bool FrameTelemetry::OpenStream(const std::string& path)
+{
+	CloseStream();
+	mStream = std::fopen(path.c_str(), "w");
+	if (mStream == nullptr)
+	{
+		gLastError = "Error opening telemetry stream " + path;
+		return false;
+	}
+	std::fprintf(mStream, "Frame,CpuMs,GpuMs,Hitch\n");
+	return true;
+}
+
+void FrameTelemetry::CloseStream()
+{
+	if (mStream)  std::fclose(mStream);
+	mStream = nullptr;
+}
+
+
+// Record the times taken by a frame
+void FrameTelemetry::RecordFrame(float cpuMilliseconds, float gpuMilliseconds)
+{
+	mCpuTimes[mNext] = cpuMilliseconds;
+	mGpuTimes[mNext] = gpuMilliseconds;
+	mNext = (mNext + 1) % CAPACITY;
+	if (mCount < CAPACITY)  ++mCount;
+	++mNumFrames;
+
+	// Compare against the smoothed time of normal frames. Hitches are left out of the smoothing so a spike
+	// doesn't hide the ones just after it
+	bool hitch = mNumFrames > BASELINE_FRAMES &&
+	             cpuMilliseconds > mBaseline * HITCH_FACTOR && cpuMilliseconds > mBaseline + HITCH_MIN_MS;
+	if (hitch)
+	{
+		++mNumHitches;
+	}
+	else
+	{
+		mBaseline = (mNumFrames == 1) ? cpuMilliseconds : mBaseline + (cpuMilliseconds - mBaseline) * BASELINE_RATE;
+	}
+
+	if (mStream)
+	{
+		std::fprintf(mStream, "%lld,%.3f,%.3f,%d\n", mNumFrames, cpuMilliseconds, gpuMilliseconds, hitch ? 1 : 0);
+		if (mNumFrames % STREAM_FLUSH_FRAMES == 0)  std::fflush(mStream);
+	}
+}
+
+
+// Percentiles and maximum of the times in the ring
+FrameTelemetry::Stats FrameTelemetry::Calculate(const float* times)
+{
+	Stats stats = { 0, 0, 0, 0 };
+	if (mCount == 0)  return stats;
+
+	// Only the percentiles need to be in place, not a full sort
+	std::copy(times, times + mCount, mSorted);
+	float* end = mSorted + mCount;
+	float* p99 = mSorted + (mCount - 1) * 99 / 100;
+	float* p95 = mSorted + (mCount - 1) * 95 / 100;
+	float* p50 = mSorted + (mCount - 1) * 50 / 100;
+	std::nth_element(mSorted, p99, end);
+	std::nth_element(mSorted, p95, p99);
+	std::nth_element(mSorted, p50, p95);
+
+	stats.p50 = *p50;
+	stats.p95 = *p95;
+	stats.p99 = *p99;
+	stats.max = *std::max_element(p99, end);
+	return stats;
+}
@@ -0,0 +1,78 @@
+//--------------------------------------------------------------------------------------
+// Frame time telemetry
+//--------------------------------------------------------------------------------------
+// Records the CPU and GPU time of every frame into a fixed size ring, so recording never allocates. Gives live
+// percentiles over the most recent frames and counts hitches - single frames much slower than the frames around
+// them, which an average hides. Each frame can also be streamed as a line of CSV to a file or a named pipe.
+
+#ifndef _TELEMETRY_H_INCLUDED_
+#define _TELEMETRY_H_INCLUDED_
+
+#include <string>
+#include <cstdio>
+
+
+class FrameTelemetry
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Number of most recent frames kept for the statistics
+	static const int CAPACITY = 1024;
+
+	~FrameTelemetry();
+
+
+	// Stream every frame to the given CSV file, or a named pipe (\\.\pipe\name, the pipe must already have been created
+	// by the reader). Returns false on error (reason in gLastError)
+	bool OpenStream(const std::string& path);
+	void CloseStream();
+
+	// Record the times taken by a frame
+	void RecordFrame(float cpuMilliseconds, float gpuMilliseconds);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	struct Stats
+	{
+		float p50, p95, p99, max; // Milliseconds
+	};
+
+	// Statistics over the frames in the ring
+	Stats CpuStats()  { return Calculate(mCpuTimes); }
+	Stats GpuStats()  { return Calculate(mGpuTimes); }
+
+	// Hitches since the start, and the number of frames they are out of
+	int       NumHitches()  { return mNumHitches; }
+	long long NumFrames()   { return mNumFrames; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	Stats Calculate(const float* times);
+
+	float mCpuTimes[CAPACITY] = {};
+	float mGpuTimes[CAPACITY] = {};
+	float mSorted  [CAPACITY] = {}; // Working space for Calculate
+	int   mNext  = 0; // Where the next frame goes in the ring
+	int   mCount = 0; // Frames in the ring
+
+	long long mNumFrames  = 0;
+	int       mNumHitches = 0;
+	float     mBaseline   = 0; // Smoothed CPU time of normal (non-hitch) frames
+
+	FILE* mStream = nullptr;
+};
+
+
+extern FrameTelemetry gTelemetry;
+
+
+#endif //_TELEMETRY_H_INCLUDED_
@@ -0,0 +1,56 @@
+//--------------------------------------------------------------------------------------
+// Temporal history
+//--------------------------------------------------------------------------------------
+// See TemporalHistory.h for an overview
+
+#include "TemporalHistory.h"
+#include "RenderTargetPool.h"
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+TemporalHistory::~TemporalHistory()
+{
+	Release();
+}
+
+
+void TemporalHistory::Release()
+{
+	for (auto& target : mTargets)
+	{
+		if (target)  gRenderTargetPool.Return(target);
+		target = nullptr;
+	}
+	mValid = false;
+}
+
+
+bool TemporalHistory::Prepare(int width, int height, DXGI_FORMAT format)
+{
+	PooledTarget* current = mTargets[0];
+	if (current != nullptr && current->width == width && current->height == height && current->format == format)  return true;
+
+	// Kept from the pool for as long as the effect runs, the pool doesn't release targets in use
+	Release();
+	for (auto& target : mTargets)
+	{
+		target = gRenderTargetPool.Acquire(width, height, format);
+		if (target == nullptr)
+		{
+			Release();
+			return false; // Reason in gLastError
+		}
+	}
+	return true;
+}
+
+
+void TemporalHistory::Advance(const CMatrix4x4& viewProjection)
+{
+	mPreviousViewProjection = viewProjection;
+	mCurrent ^= 1;
+	mValid = true;
+}
@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------------------
+// Temporal history
+//--------------------------------------------------------------------------------------
+// Wide blurs and bloom change slowly from frame to frame, so with EffectSettings::temporal set they are computed at a
+// reduced resolution and blended with the previous frame's result (TemporalResolve_pp.hlsl) rather than at full detail
+// every frame. The previous result is reprojected to where each pixel was last frame, from the depth buffer and the
+// camera's previous view-projection matrix, and clamped to the range of the new result around the pixel so anything
+// that has moved or been uncovered doesn't leave a trail.
+//
+// This holds one effect's pair of history textures: the result written last frame, read this frame, and the one being
+// written this frame. The pair swaps over once the frame's result is written. Used by EffectChain, one history for
+// each effect that is resolved temporally
+
+#ifndef _TEMPORAL_HISTORY_H_INCLUDED_
+#define _TEMPORAL_HISTORY_H_INCLUDED_
+
+#include "CMatrix4x4.h"
+
+#include <d3d11.h>
+
+struct PooledTarget;
+
+
+class TemporalHistory
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	~TemporalHistory();
+
+	// Return the textures to the render target pool, the next frame starts again without a history
+	void Release();
+
+	// Make sure the pair of textures have the given size and format. Any change throws away the history. Returns false on
+	// failure (reason in gLastError), the effect is then computed as usual
+	bool Prepare(int width, int height, DXGI_FORMAT format);
+
+	// Call once this frame's result is written, with the view-projection matrix of the camera it was rendered with. The
+	// result becomes the previous frame's for the next frame
+	void Advance(const CMatrix4x4& viewProjection);
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	PooledTarget* Previous()  { return mTargets[mCurrent ^ 1]; } // Read this frame
+	PooledTarget* Current()   { return mTargets[mCurrent]; }     // Written this frame
+
+	// Previous() holds last frame's result
+	bool Valid()  { return mValid; }
+
+	// From clip space of the camera with the given inverse view-projection matrix to last frame's clip space
+	CMatrix4x4 Reprojection(const CMatrix4x4& inverseViewProjection)  { return inverseViewProjection * mPreviousViewProjection; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	PooledTarget* mTargets[2] = { nullptr, nullptr };
+	int           mCurrent = 0;
+	bool          mValid   = false;
+	CMatrix4x4    mPreviousViewProjection = MatrixIdentity();
+};
+
+
+#endif //_TEMPORAL_HISTORY_H_INCLUDED_
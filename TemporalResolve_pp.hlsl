@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// Temporal Resolve Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// Blends an effect's result this frame, computed at a reduced size, with its result from the previous frame (see
+// TemporalHistory.h). The pixel is moved back to where it was last frame using its depth and gTemporalReprojection,
+// and the history read there is clamped to the range of the new result around the pixel, which rejects history that
+// no longer belongs here (something moved in front, or the pixel was off screen)
+
+#include "DepthEffects.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    CurrentTexture : register(t0); // This frame's result, usually smaller than the output
+Texture2D    HistoryTexture : register(t1); // Last frame's output
+SamplerState PointSample    : register(s0);
+SamplerState BilinearSample : register(s1);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	// The new result and its range over the neighbouring texels
+	float2 texel = gTexelSize;
+
+	float3 current = CurrentTexture.Sample(BilinearSample, input.uv).rgb;
+	float3 low  = current;
+	float3 high = current;
+	for (int y = -1; y <= 1; ++y)
+	{
+		for (int x = -1; x <= 1; ++x)
+		{
+			float3 neighbour = CurrentTexture.Sample(BilinearSample, input.uv + float2(x, y) * texel).rgb;
+			low  = min(low,  neighbour);
+			high = max(high, neighbour);
+		}
+	}
+
+	// Where this pixel was last frame, from the depth buffer value at it (unbound, so 0, without a depth buffer, the
+	// reprojection is then the identity)
+	float depthWidth, depthHeight;
+	DepthTexture.GetDimensions(depthWidth, depthHeight);
+	int2  depthPixel = min(int2(input.uv * gDepthUVScale * float2(depthWidth, depthHeight)), int2(depthWidth, depthHeight) - 1);
+	float depth = DepthTexture.Load(int3(depthPixel, 0)).r;
+
+	float4 clipPosition     = float4(input.uv.x * 2 - 1, 1 - input.uv.y * 2, depth, 1);
+	float4 previousPosition = mul(gTemporalReprojection, clipPosition);
+	float2 previousUV = float2(previousPosition.x, -previousPosition.y) / previousPosition.w * 0.5f + 0.5f;
+
+	// Off screen last frame there is no history to use
+	float weight = gTemporalHistoryWeight;
+	if (any(previousUV != saturate(previousUV)))  weight = 0;
+
+	float3 history = clamp(HistoryTexture.Sample(BilinearSample, previousUV).rgb, low, high);
+	return float4(lerp(current, history, weight), 1.0f);
+}
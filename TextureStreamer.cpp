@@ -0,0 +1,495 @@
+//--------------------------------------------------------------------------------------
+// Texture streaming
+//--------------------------------------------------------------------------------------
+
+#include "TextureStreamer.h"
+#include "StateCache.h"
+#include "CookedAssets.h"
+#include "GraphicsHelpers.h"
+#include "ResourceRegistry.h"
+#include "StartupProfiler.h"
+#include "Common.h"
+
+#include <DDSTextureLoader.h>
+#include <algorithm>
+#include <fstream>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <system_error>
+
+
+TextureStreamer gTextureStreamer;
+
+
+TextureStreamer::~TextureStreamer()
+{
+	Release();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Requests
+//--------------------------------------------------------------------------------------
+
+bool TextureStreamer::LoadTextureAsync(const std::string& filename, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV)
+{
+	if (!CreatePlaceholder())  return false;
+
+	if (!mThread.joinable())
+	{
+		mQuit = false;
+		mNumErrors = 0;
+		try
+		{
+			mThread = std::thread(&TextureStreamer::StreamerThread, this);
+		}
+		catch (const std::system_error&)
+		{
+			gLastError = "Error starting texture streaming thread";
+			return false;
+		}
+	}
+
+	// Each request holds its own reference to the placeholder, so it is released like any other texture
+	mPlaceholder->AddRef();
+	mPlaceholderSRV->AddRef();
+	*texture    = mPlaceholder;
+	*textureSRV = mPlaceholderSRV;
+
+	mRequests.push_back({ texture, textureSRV, nullptr });
+	{
+		std::lock_guard<std::mutex> lock(mUsageMutex);
+		mUsage.resize(mRequests.size(), std::numeric_limits<float>::infinity());
+	}
+	++mNumPending;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mLowDetailWork.push_back({ mRequests.size() - 1, filename, true });
+	}
+	mWake.notify_all();
+	return true;
+}
+
+
+void TextureStreamer::Release()
+{
+	if (mThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQuit = true;
+		}
+		mWake.notify_all();
+		mThread.join();
+	}
+
+	// Discard any textures that were never swapped in
+	for (auto& loaded : mLoaded)
+	{
+		if (loaded.textureSRV)  loaded.textureSRV->Release();
+		if (loaded.texture)     loaded.texture   ->Release();
+	}
+	mLoaded.clear();
+	mLowDetailWork.clear();
+	mFullWork.clear();
+	mRequests.clear();
+	mUsage.clear();
+	mNumPending = 0;
+	mResidentBytes = 0;
+	mMipBias = 0;
+	mNumStreamed = 0;
+
+	if (mPlaceholderSRV)  mPlaceholderSRV->Release();  mPlaceholderSRV = nullptr;
+	if (mPlaceholder)     mPlaceholder   ->Release();  mPlaceholder    = nullptr;
+}
+
+
+bool TextureStreamer::CreatePlaceholder()
+{
+	if (mPlaceholderSRV != nullptr)  return true;
+
+	CookedTexture image;
+	image.mips.resize(1);
+	image.mips[0].width  = 1;
+	image.mips[0].height = 1;
+	image.mips[0].pixels = { 128, 128, 128, 255 };
+	if (!CreateTextureFromImage(image, &mPlaceholder, &mPlaceholderSRV))
+	{
+		gLastError = "Error creating placeholder texture";
+		return false;
+	}
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Swapping
+//--------------------------------------------------------------------------------------
+
+void TextureStreamer::Update()
+{
+	bool replaced = false;
+	std::unique_lock<std::mutex> lock(mMutex, std::try_to_lock);
+	if (lock.owns_lock() && !mLoaded.empty())
+	{
+		for (auto& loaded : mLoaded)
+		{
+			Request& request = mRequests[loaded.request];
+			if (loaded.textureSRV != nullptr) // Null if the load failed, the texture keeps the version it has
+			{
+				Replace(request, loaded.texture, loaded.textureSRV);
+				if (loaded.streamed)  request.streamed = std::move(loaded.streamed);
+			}
+			if (loaded.final)  --mNumPending;
+		}
+		mLoaded.clear();
+		replaced = true;
+	}
+	lock.unlock();
+
+	if (StreamMips())  replaced = true;
+
+	// The cache may hold the released views, and a new object could be created at the same address
+	if (replaced)  gStateCache.Invalidate();
+}
+
+
+void TextureStreamer::Replace(Request& request, ID3D11Resource* texture, ID3D11ShaderResourceView* textureSRV)
+{
+	(*request.textureSRV)->Release();
+	(*request.texture)   ->Release();
+	*request.textureSRV = textureSRV;
+	*request.texture    = texture;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Mip streaming
+//--------------------------------------------------------------------------------------
+
+void TextureStreamer::NoteUsage(ID3D11ShaderResourceView* textureSRV, float uvsPerPixel)
+{
+	std::lock_guard<std::mutex> lock(mUsageMutex);
+	for (size_t i = 0; i < mUsage.size(); ++i)
+	{
+		if (*mRequests[i].textureSRV == textureSRV)
+		{
+			mUsage[i] = std::min(mUsage[i], uvsPerPixel);
+			return;
+		}
+	}
+}
+
+
+bool TextureStreamer::StreamMips()
+{
+	// Take the usage noted while drawing the last frame, and start afresh for the next
+	std::vector<float> usage(mRequests.size(), std::numeric_limits<float>::infinity());
+	{
+		std::lock_guard<std::mutex> lock(mUsageMutex);
+		usage.swap(mUsage);
+	}
+
+	// The finest level each texture needs: the level with about one texel per pixel. Unused textures need only their
+	// low detail version
+	std::vector<unsigned int> needed(mRequests.size(), 0);
+	mNumStreamed = 0;
+	for (size_t i = 0; i < mRequests.size(); ++i)
+	{
+		if (!mRequests[i].streamed)  continue;
+		++mNumStreamed;
+		const Streamed& streamed = *mRequests[i].streamed;
+		needed[i] = streamed.lowestMip;
+		if (usage[i] < std::numeric_limits<float>::infinity())
+		{
+			const DDSLayout::Mip& full = streamed.layout.mips[0];
+			float texelsPerPixel = usage[i] * std::max(full.width, full.height);
+			unsigned int level = (texelsPerPixel > 1) ? static_cast<unsigned int>(std::log2(texelsPerPixel)) : 0;
+			needed[i] = std::max(std::min(level, streamed.lowestMip), streamed.finestMip);
+		}
+	}
+	if (mNumStreamed == 0)  return false;
+
+	// The smallest mip bias that keeps all the needed levels within the budget, or as close as the low detail versions allow
+	mMipBias = 0;
+	while (true)
+	{
+		size_t total = 0;
+		bool canCoarsen = false;
+		for (size_t i = 0; i < mRequests.size(); ++i)
+		{
+			if (!mRequests[i].streamed)  continue;
+			const Streamed& streamed = *mRequests[i].streamed;
+			unsigned int level = std::min(needed[i] + mMipBias, streamed.lowestMip);
+			total += MipBytes(streamed, level);
+			if (level < streamed.lowestMip)  canCoarsen = true;
+		}
+		if (total <= Budget() || !canCoarsen)  break;
+		++mMipBias;
+	}
+	bool overBudget = (mResidentBytes > Budget());
+
+	// Move each texture a step towards its biased level. Adding a level is spread over several frames by the upload
+	// budget, dropping levels is a GPU copy so is done in one go
+	bool replaced = false;
+	size_t uploadBytes = UPLOAD_BYTES_PER_FRAME;
+	mResidentBytes = 0;
+	for (size_t i = 0; i < mRequests.size(); ++i)
+	{
+		Request& request = mRequests[i];
+		if (!request.streamed)  continue;
+		Streamed& streamed = *request.streamed;
+		unsigned int target = std::min(needed[i] + mMipBias, streamed.lowestMip);
+
+		if (target > streamed.residentMip && streamed.topMip == streamed.residentMip)
+		{
+			if (++streamed.coarserFrames >= DROP_DELAY_FRAMES || overBudget)
+			{
+				if (DropMips(request, target))  replaced = true;
+				streamed.coarserFrames = 0;
+			}
+		}
+		else
+		{
+			streamed.coarserFrames = 0;
+			if (streamed.topMip < streamed.residentMip)
+			{
+				uploadBytes -= UploadRows(request, uploadBytes);
+			}
+			else if (target < streamed.residentMip && uploadBytes > 0 && AddMip(request))
+			{
+				replaced = true;
+				uploadBytes -= UploadRows(request, uploadBytes);
+			}
+		}
+		mResidentBytes += MipBytes(streamed, streamed.topMip);
+	}
+	return replaced;
+}
+
+
+bool TextureStreamer::AddMip(Request& request)
+{
+	Streamed& streamed = *request.streamed;
+	unsigned int topMip = streamed.topMip - 1;
+	ID3D11Texture2D* texture;
+	ID3D11ShaderResourceView* textureSRV;
+	if (!CreateMipTexture(streamed, topMip, &texture, &textureSRV))
+	{
+		streamed.finestMip = streamed.topMip; // Don't try again every frame
+		return false;
+	}
+
+	// Copy the levels already loaded below the new one, which isn't sampled until it has been uploaded
+	for (unsigned int mip = streamed.topMip; mip < streamed.layout.mips.size(); ++mip)
+	{
+		gD3DContext->CopySubresourceRegion(texture, mip - topMip, 0, 0, 0, *request.texture, mip - streamed.topMip, nullptr);
+	}
+	gD3DContext->SetResourceMinLOD(texture, 1.0f);
+
+	Replace(request, texture, textureSRV);
+	streamed.topMip = topMip;
+	streamed.uploadedRows = 0;
+	return true;
+}
+
+
+bool TextureStreamer::DropMips(Request& request, unsigned int topMip)
+{
+	Streamed& streamed = *request.streamed;
+	ID3D11Texture2D* texture;
+	ID3D11ShaderResourceView* textureSRV;
+	if (!CreateMipTexture(streamed, topMip, &texture, &textureSRV))  return false;
+
+	for (unsigned int mip = topMip; mip < streamed.layout.mips.size(); ++mip)
+	{
+		gD3DContext->CopySubresourceRegion(texture, mip - topMip, 0, 0, 0, *request.texture, mip - streamed.topMip, nullptr);
+	}
+
+	Replace(request, texture, textureSRV);
+	streamed.topMip = streamed.residentMip = topMip;
+	return true;
+}
+
+
+size_t TextureStreamer::UploadRows(Request& request, size_t maxBytes)
+{
+	Streamed& streamed = *request.streamed;
+	const DDSLayout::Mip& mip = streamed.layout.mips[streamed.topMip];
+	if (maxBytes == 0)  return 0;
+
+	// At least one row each frame, so a level larger than the budget still completes
+	unsigned int rows = static_cast<unsigned int>(std::max(maxBytes / mip.rowPitch, static_cast<size_t>(1)));
+	rows = std::min(rows, mip.numRows - streamed.uploadedRows);
+	unsigned int rowHeight = streamed.layout.blockCompressed ? 4 : 1;
+	D3D11_BOX box = { 0, streamed.uploadedRows * rowHeight, 0, mip.width, std::min((streamed.uploadedRows + rows) * rowHeight, mip.height), 1 };
+	const uint8_t* data = streamed.data + mip.offset + static_cast<size_t>(streamed.uploadedRows) * mip.rowPitch;
+	gD3DContext->UpdateSubresource(*request.texture, 0, &box, data, mip.rowPitch, 0);
+
+	streamed.uploadedRows += rows;
+	if (streamed.uploadedRows == mip.numRows)
+	{
+		gD3DContext->SetResourceMinLOD(*request.texture, 0.0f); // The whole level is there now
+		streamed.residentMip = streamed.topMip;
+	}
+	return std::min(static_cast<size_t>(rows) * mip.rowPitch, maxBytes);
+}
+
+
+bool TextureStreamer::CreateMipTexture(const Streamed& streamed, unsigned int topMip, ID3D11Texture2D** texture,
+                                       ID3D11ShaderResourceView** textureSRV)
+{
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = streamed.layout.mips[topMip].width;
+	textureDesc.Height = streamed.layout.mips[topMip].height;
+	textureDesc.MipLevels = static_cast<UINT>(streamed.layout.mips.size() - topMip);
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = streamed.layout.format;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT; // Levels are copied and uploaded into it
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, nullptr, texture)))  return false;
+	gResourceRegistry.Track(*texture);
+	if (FAILED(gD3DDevice->CreateShaderResourceView(*texture, nullptr, textureSRV)))
+	{
+		(*texture)->Release();
+		return false;
+	}
+	return true;
+}
+
+
+size_t TextureStreamer::MipBytes(const Streamed& streamed, unsigned int topMip)
+{
+	size_t bytes = 0;
+	for (unsigned int mip = topMip; mip < streamed.layout.mips.size(); ++mip)
+	{
+		bytes += static_cast<size_t>(streamed.layout.mips[mip].rowPitch) * streamed.layout.mips[mip].numRows;
+	}
+	return bytes;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Background thread
+//--------------------------------------------------------------------------------------
+
+void TextureStreamer::StreamerThread()
+{
+	HRESULT comResult = CoInitializeEx(nullptr, COINIT_MULTITHREADED); // For WIC image decoding
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true)
+	{
+		mWake.wait(lock, [this] { return mQuit || !mLowDetailWork.empty() || !mFullWork.empty(); });
+		if (mQuit)  break;
+
+		// Low detail versions of all the waiting textures come first
+		std::deque<Work>& queue = mLowDetailWork.empty() ? mFullWork : mLowDetailWork;
+		Work work = queue.front();
+		queue.pop_front();
+
+		lock.unlock(); // Don't hold up Update or new requests while loading
+		bool streamed = false;
+		Load(work, streamed);
+		lock.lock();
+
+		if (work.lowDetail && !streamed)
+		{
+			work.lowDetail = false;
+			mFullWork.push_back(work);
+		}
+	}
+	lock.unlock();
+
+	if (SUCCEEDED(comResult))  CoUninitialize();
+}
+
+
+bool TextureStreamer::Load(const Work& work, bool& streamed)
+{
+	STARTUP_SCOPE(StartupStage::Asset, work.lowDetail ? work.filename + " (low detail)" : work.filename);
+	Loaded loaded = { work.request, nullptr, nullptr, !work.lowDetail, nullptr };
+	if (work.lowDetail)
+	{
+		// Only DDS files have mip-maps ready to load on their own, and there is no point if the texture is already small.
+		// Taken straight from the asset pack if it is there, otherwise read from the file
+		std::vector<uint8_t> fileData;
+		const void* packData;
+		const uint8_t* data;
+		size_t size;
+		if (FindPackedDDS(work.filename, packData, size))
+		{
+			data = static_cast<const uint8_t*>(packData);
+		}
+		else
+		{
+			std::string ddsFile = DDSFileForTexture(work.filename);
+			if (ddsFile.empty())  return false;
+
+			std::ifstream file(ddsFile, std::ios::in | std::ios::binary | std::ios::ate);
+			if (!file.is_open())  return false;
+			fileData.resize(static_cast<size_t>(file.tellg()));
+			file.seekg(0, std::ios::beg);
+			file.read(reinterpret_cast<char*>(fileData.data()), fileData.size());
+			if (file.fail())  return false;
+			data = fileData.data();
+			size = fileData.size();
+		}
+		if (size < 20)  return false;
+
+		uint32_t height, width; // Following the "DDS " magic value, header size and flags
+		std::memcpy(&height, &data[12], sizeof(height));
+		std::memcpy(&width,  &data[16], sizeof(width));
+		if (std::max(width, height) <= LOW_DETAIL_SIZE)  return false;
+
+		// Fails if the texture has no mip-maps small enough, the full texture will just replace the placeholder directly
+		if (FAILED(DirectX::CreateDDSTextureFromMemory(gD3DDevice, data, size, &loaded.texture, &loaded.textureSRV,
+		                                                LOW_DETAIL_SIZE)))
+		{
+			return false;
+		}
+		gResourceRegistry.Track(loaded.texture);
+
+		// Stream the finer levels if the file's layout can be read and matches the levels the DDS loader created
+		std::unique_ptr<Streamed> mips(new Streamed);
+		ID3D11Texture2D* texture2D = nullptr;
+		if (ReadDDSLayout(data, size, mips->layout) &&
+		    SUCCEEDED(loaded.texture->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&texture2D))))
+		{
+			D3D11_TEXTURE2D_DESC desc;
+			texture2D->GetDesc(&desc);
+			texture2D->Release();
+			for (unsigned int mip = 0; mip < mips->layout.mips.size(); ++mip)
+			{
+				if (mips->layout.mips[mip].width == desc.Width && mips->layout.mips[mip].height == desc.Height &&
+				    desc.MipLevels == mips->layout.mips.size() - mip && desc.Format == mips->layout.format && desc.ArraySize == 1)
+				{
+					mips->lowestMip = mips->topMip = mips->residentMip = mip;
+					mips->data = data;
+					if (!fileData.empty())
+					{
+						mips->fileData = std::move(fileData); // Moving keeps the storage, so data is still valid
+					}
+					loaded.streamed = std::move(mips);
+					loaded.final = true;
+					streamed = true;
+					break;
+				}
+			}
+		}
+	}
+	else if (!LoadTexture(work.filename, &loaded.texture, &loaded.textureSRV))
+	{
+		++mNumErrors;
+		OutputDebugStringA(("Error loading texture " + work.filename + "\n").c_str());
+		loaded.texture    = nullptr; // Queued anyway so the texture is no longer counted as pending
+		loaded.textureSRV = nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mLoaded.push_back(std::move(loaded));
+	return true;
+}
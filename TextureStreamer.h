@@ -0,0 +1,209 @@
+//--------------------------------------------------------------------------------------
+// Texture streaming
+//--------------------------------------------------------------------------------------
+// Loads textures on a background thread so the app can start rendering before they are ready. A texture requested
+// with LoadTextureAsync is given a 1x1 grey placeholder straight away. The background thread then loads the real texture
+// with the free-threaded device, and Update swaps it into the caller's pointers between frames.
+//
+// DDS textures (including cooked ones, see CookedAssets.h) are loaded in two steps: first the small mip levels only
+// (LOW_DETAIL_SIZE and below), then the whole texture. The low detail versions of every requested texture are loaded
+// before any full size ones, so the scene quickly shows something close to the right colours. Other images must be
+// fully decoded before any mip-map can be made, so are loaded in a single step.
+//
+// Where the DDS file's layout can be read (see ReadDDSLayout in CookedAssets.h) the finer mip levels are then streamed
+// by how large the texture is seen rather than always loaded: while drawing, the scene reports how many uv units a
+// pixel covers for each texture (NoteUsage, see Model::UVsPerPixel), which gives the finest level needed. Update adds
+// the levels one at a time - a texture one level larger is created, the levels already loaded are copied across on the
+// GPU, then the new level is uploaded a band of rows each frame with UpdateSubresource (within UPLOAD_BYTES_PER_FRAME
+// for all the textures) and is kept from being sampled with SetResourceMinLOD until complete. Levels that stop being
+// needed are dropped by copying the rest into a smaller texture. The streamed textures are kept within a memory budget
+// (SetBudget) by coarsening every texture's needed level together - a mip bias - when they wouldn't all fit.
+
+#ifndef _TEXTURE_STREAMER_H_INCLUDED_
+#define _TEXTURE_STREAMER_H_INCLUDED_
+
+#include "CookedAssets.h"
+
+#include <d3d11.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+class TextureStreamer
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	TextureStreamer() : mNumErrors(0) {}
+	~TextureStreamer();
+
+	// Start loading a texture in the background. The texture and shader resource view pointers are given a placeholder
+	// immediately, which Update replaces when the texture has loaded. Release the pointers as usual when finished with
+	// them, but only after calling Release below. Returns false on error (reason in gLastError)
+	bool LoadTextureAsync(const std::string& filename, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV);
+
+	// Stop the background thread and forget the requested textures, any not yet loaded keep the version they have now.
+	// Must be called before the pointers passed to LoadTextureAsync are released
+	void Release();
+
+
+	// Call between frames. Swaps any newly loaded textures into their pointers and releases the textures they replace,
+	// then adds or drops mip levels of the streamed textures for the usage noted during the last frame. Never waits for
+	// the background thread - if it is busy then the swap happens next frame
+	void Update();
+
+	// Note that a texture is drawn this frame with one pixel covering the given number of uv units (see
+	// Model::UVsPerPixel), the texture keeps the detail needed by its most demanding use. Ignored for textures that
+	// aren't streamed. Safe to call from several threads at once, but not at the same time as LoadTextureAsync or Update
+	void NoteUsage(ID3D11ShaderResourceView* textureSRV, float uvsPerPixel);
+
+	// Memory the streamed textures are kept within, in bytes
+	void SetBudget(size_t bytes)  { mBudget = bytes; }
+
+	// Memory the OS leaves the streamed textures (see ResourceRegistry.h), the budget is lowered to this while it is smaller.
+	// Levels are dropped straight away to get back within it
+	void SetMemoryLimit(size_t bytes)  { mMemoryLimit = bytes; }
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	int NumPending()  { return mNumPending; } // Textures not yet swapped in at full detail
+	int NumErrors()   { return mNumErrors;  } // Textures that failed to load, they keep their placeholder
+
+	// Mip streaming state, as of the last Update
+	int    NumStreamed()    { return mNumStreamed;   } // Textures with mip levels streamed
+	size_t ResidentBytes()  { return mResidentBytes; } // Memory used by their current textures
+	size_t Budget()         { return std::min(mBudget, mMemoryLimit); } // Lowered by the memory limit
+	int    MipBias()        { return mMipBias;       } // Levels every texture is coarsened by to stay within the budget
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Largest width or height of the low detail version of a DDS texture
+	static const size_t LOW_DETAIL_SIZE = 64;
+
+	// Bytes of mip levels uploaded each Update, over all the streamed textures
+	static const size_t UPLOAD_BYTES_PER_FRAME = 2 * 1024 * 1024;
+
+	// Frames a texture must need less detail than it has before levels are dropped (unless over budget), so looking
+	// away briefly doesn't drop levels that are needed again straight after
+	static const unsigned int DROP_DELAY_FRAMES = 60;
+
+	static const size_t DEFAULT_BUDGET = 1024 * 1024 * 1024;
+
+	// Mip streaming state for one texture. Levels are numbered from the full size texture, level 0
+	struct Streamed
+	{
+		std::vector<uint8_t> fileData;        // The DDS file, unless it is in the asset pack
+		const uint8_t*       data = nullptr;  // The DDS file, in fileData or the pack
+		DDSLayout            layout;
+		unsigned int         lowestMip = 0;   // Level 0 of the low detail version, never dropped below
+		unsigned int         finestMip = 0;   // Finest level that can be loaded, raised if a texture can't be created
+		unsigned int         topMip = 0;      // Level 0 of the current texture
+		unsigned int         residentMip = 0; // Finest level fully uploaded, topMip + 1 while topMip is uploading
+		unsigned int         uploadedRows = 0;  // Of topMip, while uploading
+		unsigned int         coarserFrames = 0; // Frames in a row needing less detail than resident
+	};
+
+	struct Request
+	{
+		ID3D11Resource**           texture;
+		ID3D11ShaderResourceView** textureSRV;
+		std::unique_ptr<Streamed>  streamed; // Null unless mip levels are streamed
+	};
+
+	// A load for the background thread to do. The filename is copied so the thread never reads mRequests
+	struct Work
+	{
+		size_t      request; // Index into mRequests
+		std::string filename;
+		bool        lowDetail;
+	};
+
+	// A texture that has been loaded and is waiting for Update to swap it in
+	struct Loaded
+	{
+		size_t                    request;
+		ID3D11Resource*           texture;
+		ID3D11ShaderResourceView* textureSRV;
+		bool                      final;    // False for a low detail version, the final one follows
+		std::unique_ptr<Streamed> streamed; // Set with a low detail version whose finer levels will be streamed
+	};
+
+	// Background thread loop, works through the queues until told to quit
+	void StreamerThread();
+
+	// Do a single load, returns true if the result was queued for Update. Sets streamed if the final load isn't needed,
+	// the texture's mip levels are streamed instead
+	bool Load(const Work& work, bool& streamed);
+
+	// Create the shared placeholder texture if it hasn't been yet
+	bool CreatePlaceholder();
+
+
+	// Add or drop mip levels of the streamed textures for the usage noted since the last call. Main thread only.
+	// Returns true if any textures were replaced
+	bool StreamMips();
+
+	// Replace a streamed texture with one a level larger and start uploading the new level, or with a smaller one
+	// holding the levels from the given one down. Both return false if the new texture can't be created
+	bool AddMip(Request& request);
+	bool DropMips(Request& request, unsigned int topMip);
+
+	// Upload rows of the level being added to a texture, up to the given bytes. Returns the bytes uploaded
+	size_t UploadRows(Request& request, size_t maxBytes);
+
+	// Create a texture holding the levels of a streamed texture from the given one down, and its view
+	bool CreateMipTexture(const Streamed& streamed, unsigned int topMip, ID3D11Texture2D** texture, ID3D11ShaderResourceView** textureSRV);
+
+	// Swap a new texture into a request's pointers, releasing the old one
+	void Replace(Request& request, ID3D11Resource* texture, ID3D11ShaderResourceView* textureSRV);
+
+	// Memory used by the levels of a streamed texture from the given one down
+	static size_t MipBytes(const Streamed& streamed, unsigned int topMip);
+
+
+	ID3D11Resource*           mPlaceholder    = nullptr;
+	ID3D11ShaderResourceView* mPlaceholderSRV = nullptr;
+
+	std::vector<Request> mRequests; // Only used on the main thread
+	int                  mNumPending = 0;
+
+	std::thread             mThread;
+	std::mutex              mMutex;
+	std::condition_variable mWake;        // Signalled on new work or quit
+	bool                    mQuit = false;
+	std::deque<Work>        mLowDetailWork; // These three guarded by mMutex. Low detail work is always done first
+	std::deque<Work>        mFullWork;
+	std::vector<Loaded>     mLoaded;
+
+	std::atomic<int> mNumErrors; // Changed by the background thread
+
+	std::mutex         mUsageMutex;
+	std::vector<float> mUsage; // Finest uvs per pixel noted for each request since the last Update, guarded by mUsageMutex
+
+	size_t mBudget        = DEFAULT_BUDGET;
+	size_t mMemoryLimit   = SIZE_MAX;
+	size_t mResidentBytes = 0;
+	int    mMipBias       = 0;
+	int    mNumStreamed   = 0;
+};
+
+
+extern TextureStreamer gTextureStreamer;
+
+
+#endif //_TEXTURE_STREAMER_H_INCLUDED_
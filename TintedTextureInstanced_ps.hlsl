@@ -0,0 +1,25 @@
+//--------------------------------------------------------------------------------------
+// Light Model Pixel Shader, instanced
+//--------------------------------------------------------------------------------------
+// As TintedTexture_ps, but the tint is each instance's colour from the vertex shader (see BasicTransformInstanced_vs)
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+Texture2D    DiffuseMap : register(t0);
+SamplerState TexSampler : register(s0);
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(InstancedPixelShaderInput input) : SV_Target
+{
+    float3 diffuseMapColour = DiffuseMap.Sample(TexSampler, input.uv).rgb;
+    return float4(input.colour * diffuseMapColour, 1.0f);
+}
@@ -0,0 +1,194 @@
+//--------------------------------------------------------------------------------------
+// Trace capture
+//--------------------------------------------------------------------------------------
+// See TraceCapture.h for an overview
+
+#include "TraceCapture.h"
+#include "CpuProfiler.h"
+#include "GpuProfiler.h"
+#include "Common.h"
+
+#include <vector>
+#include <algorithm>
+#include <fstream>
+
+
+//--------------------------------------------------------------------------------------
+// Settings
+//--------------------------------------------------------------------------------------
+
+// Frames to wait for the GPU results after the CPU has finished, more than the GPU profiler ever lags by. GPU frames
+// that are never read back (e.g. the clock changed speed) are left out rather than waited for
+const int GPU_WAIT_FRAMES = 10;
+
+// Thread id used for the GPU track, after any CPU threads
+const int GPU_TRACK = 1000;
+
+
+//--------------------------------------------------------------------------------------
+// State
+//--------------------------------------------------------------------------------------
+
+bool        gTraceRunning = false;
+std::string gTraceFile;
+int         gTraceFrames = 0;   // Frames to record
+int         gTraceCpuFrames = 0; // Frames recorded so far
+int         gTraceWaitFrames = 0;
+int64_t     gTraceStart = 0;    // CPU time the capture started, times in the file are relative to this
+
+std::vector<CpuProfiler::Scope>    gTraceCpuScopes;
+std::vector<GpuProfiler::Interval> gTraceGpuIntervals;
+
+
+//--------------------------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------------------------
+
+// Write a string as a JSON string, with quotes
+void WriteJsonString(std::ofstream& file, const std::string& text)
+{
+	file << '"';
+	for (char c : text)
+	{
+		if      (c == '"' || c == '\\')  file << '\\' << c;
+		else if (c >= 0 && c < ' ')      file << ' ';
+		else                             file << c;
+	}
+	file << '"';
+}
+
+// Write a complete ("X") event, times in CPU ticks
+void WriteTraceEvent(std::ofstream& file, const std::string& name, int thread, int64_t begin, int64_t end)
+{
+	double ticksToMicroseconds = 1000000.0 / static_cast<double>(CpuProfiler::Frequency());
+	file << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << thread << ",\"name\":";
+	WriteJsonString(file, name);
+	file << ",\"ts\":" << (begin - gTraceStart) * ticksToMicroseconds << ",\"dur\":" << (end - begin) * ticksToMicroseconds << "}";
+}
+
+// Name a track in the viewer
+void WriteTrackName(std::ofstream& file, int thread, const std::string& name)
+{
+	file << ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":" << thread << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+	WriteJsonString(file, name);
+	file << "}}";
+	file << ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":" << thread << ",\"name\":\"thread_sort_index\",\"args\":{\"sort_index\":"
+	     << thread << "}}";
+}
+
+// Write everything recorded to the trace file, returns false on failure
+bool WriteTrace()
+{
+	std::ofstream file(gTraceFile);
+	if (!file.is_open())
+	{
+		gLastError = "Error writing trace to " + gTraceFile;
+		return false;
+	}
+
+	file.precision(3);
+	file << std::fixed;
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"PostProcessing\"}}";
+
+	int numThreads = 0;
+	for (auto& scope : gTraceCpuScopes)
+	{
+		numThreads = std::max(numThreads, scope.thread + 1);
+		WriteTraceEvent(file, scope.name, scope.thread, scope.begin, scope.end);
+	}
+	for (int thread = 0; thread < numThreads; ++thread)
+	{
+		WriteTrackName(file, thread, thread == 0 ? "Render thread" : "Thread " + std::to_string(thread));
+	}
+
+	// Each GPU frame is followed by its timers. Frames begun before the capture started, and any read back after the
+	// number captured while waiting for the last ones, are left out
+	int  numGpuFrames = 0;
+	bool writeFrame = false;
+	for (auto& interval : gTraceGpuIntervals)
+	{
+		if (interval.depth < 0)  writeFrame = (interval.begin >= gTraceStart && ++numGpuFrames <= gTraceFrames);
+		if (writeFrame)  WriteTraceEvent(file, interval.name, GPU_TRACK, interval.begin, interval.end);
+	}
+	WriteTrackName(file, GPU_TRACK, "GPU");
+
+	file << "\n]}\n";
+	return !file.fail();
+}
+
+// Count the GPU frames read back that were rendered during the capture
+int CountGpuFrames()
+{
+	int numFrames = 0;
+	for (auto& interval : gTraceGpuIntervals)
+	{
+		if (interval.depth < 0 && interval.begin >= gTraceStart)  ++numFrames;
+	}
+	return numFrames;
+}
+
+void StopRecording()
+{
+	gCpuProfiler.SetCapture(nullptr);
+	gGpuProfiler.SetCapture(nullptr);
+	gTraceRunning = false;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Trace capture
+//--------------------------------------------------------------------------------------
+
+// Start recording the given number of frames
+bool StartTraceCapture(const std::string& traceFile, int numFrames)
+{
+	if (gTraceRunning)
+	{
+		gLastError = "A trace capture is already running";
+		return false;
+	}
+	if (!gGpuProfiler.CalibrateClock())  return false;
+
+	gTraceFile = traceFile;
+	gTraceFrames = std::max(numFrames, 1);
+	gTraceCpuFrames = 0;
+	gTraceWaitFrames = 0;
+	gTraceCpuScopes.clear();
+	gTraceGpuIntervals.clear();
+
+	// Scopes already finished belong to frames before the capture, gather them now so they aren't recorded
+	gCpuProfiler.EndFrame();
+	gTraceStart = CpuProfiler::Now();
+
+	gCpuProfiler.SetCapture(&gTraceCpuScopes);
+	gGpuProfiler.SetCapture(&gTraceGpuIntervals);
+	gTraceRunning = true;
+	return true;
+}
+
+// True from StartTraceCapture until the file has been written
+bool TraceCaptureRunning()
+{
+	return gTraceRunning;
+}
+
+// Call once per frame after gathering the CPU profiler timings
+bool UpdateTraceCapture()
+{
+	if (!gTraceRunning)  return true;
+
+	if (gTraceCpuFrames < gTraceFrames)
+	{
+		++gTraceCpuFrames;
+		if (gTraceCpuFrames == gTraceFrames)  gCpuProfiler.SetCapture(nullptr);
+		return true;
+	}
+
+	// All CPU frames are done, wait until the GPU has caught up
+	++gTraceWaitFrames;
+	if (CountGpuFrames() < gTraceFrames && gTraceWaitFrames < GPU_WAIT_FRAMES)  return true;
+
+	StopRecording();
+	return WriteTrace();
+}
@@ -0,0 +1,37 @@
+//--------------------------------------------------------------------------------------
+// Trace capture
+//--------------------------------------------------------------------------------------
+// Records the CPU scopes (see CpuProfiler.h) and GPU timers (see GpuProfiler.h) of a number of frames and writes them as
+// a Chrome Trace Event JSON file, which can be opened in chrome://tracing or ui.perfetto.dev. Each CPU thread gets its
+// own track, and the GPU gets one more with its times moved onto the CPU clock, so GPU passes can be lined up against
+// the CPU work that submitted them. Start a capture with F11 or the -trace command line switch
+
+#ifndef _TRACE_CAPTURE_H_INCLUDED_
+#define _TRACE_CAPTURE_H_INCLUDED_
+
+#include <fstream>
+#include <string>
+
+// Frames recorded by a capture started with F11
+const int TRACE_CAPTURE_FRAMES = 60;
+
+// Start recording the given number of frames, to be written to the given file. Briefly waits for the GPU to go idle to
+// line up its clock with the CPU's. Returns false if a capture is already running or the GPU clock can't be read
+// (reason in gLastError)
+bool StartTraceCapture(const std::string& traceFile, int numFrames);
+
+// True from StartTraceCapture until the file has been written
+bool TraceCaptureRunning();
+
+// Call once per frame after gathering the CPU profiler timings. Writes the file once all the frames have been recorded
+// on the CPU and read back from the GPU. Returns false if the file couldn't be written (reason in gLastError)
+bool UpdateTraceCapture();
+
+
+// Write a string as a JSON string with quotes, and name a track of a trace file. Shared with the startup timeline (see
+// StartupProfiler.h)
+void WriteJsonString(std::ofstream& file, const std::string& text);
+void WriteTrackName(std::ofstream& file, int thread, const std::string& name);
+
+
+#endif //_TRACE_CAPTURE_H_INCLUDED_
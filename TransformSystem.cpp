@@ -0,0 +1,292 @@
+//--------------------------------------------------------------------------------------
+// Transform system
+//--------------------------------------------------------------------------------------
+
+#include "TransformSystem.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <xmmintrin.h>
+
+
+TransformSystem gTransformSystem;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+unsigned int TransformSystem::Add(unsigned int numNodes, const unsigned int* parents, const CMatrix4x4* matrices)
+{
+	unsigned int first;
+	if (!TakeRange(numNodes, first))
+	{
+		first = mNumNodes;
+		Resize(mNumNodes + numNodes);
+	}
+
+	for (unsigned int node = 0; node < numNodes; ++node)
+	{
+		mParents[first + node] = (parents[node] == node) ? -1 : static_cast<int>(first + parents[node]);
+		SetMatrix(first + node, matrices[node]);
+	}
+	return first;
+}
+
+
+void TransformSystem::Remove(unsigned int first, unsigned int numNodes)
+{
+	if (numNodes == 0)  return;
+
+	// Unused nodes are roots that never change, so Update passes over them
+	for (unsigned int node = first; node < first + numNodes; ++node)
+	{
+		mParents[node] = -1;
+		mChanged[node] = false;
+	}
+
+	// Put the range back in the free list, merging with the gaps either side
+	auto next = std::lower_bound(mFreeRanges.begin(), mFreeRanges.end(), first,
+	                             [](const FreeRange& freeRange, unsigned int first) { return freeRange.first < first; });
+	next = mFreeRanges.insert(next, { first, numNodes });
+	if (next + 1 != mFreeRanges.end() && next->first + next->count == (next + 1)->first)
+	{
+		next->count += (next + 1)->count;
+		mFreeRanges.erase(next + 1);
+	}
+	if (next != mFreeRanges.begin() && (next - 1)->first + (next - 1)->count == next->first)
+	{
+		(next - 1)->count += next->count;
+		mFreeRanges.erase(next);
+	}
+}
+
+
+// Recalculate the absolute matrices of changed nodes and their children. Split into jobs: the local matrices are built
+// in batches of nodes, then each batch of whole hierarchies is combined with its parents once the batches building its
+// local matrices are done
+void TransformSystem::Update()
+{
+	if (!mAnyChanged)  return;
+
+	JobGraph graph;
+	std::vector<int> composeJobs;
+	for (unsigned int first = 0; first < mNumNodes; first += UPDATE_BATCH_SIZE)
+	{
+		unsigned int end = std::min(first + UPDATE_BATCH_SIZE, mNumNodes);
+		composeJobs.push_back(graph.Add([this, first, end]() { ComposeLocalMatrices(first, end); }));
+	}
+
+	// Hierarchy batches must start at a root so each holds whole hierarchies
+	for (unsigned int first = 0; first < mNumNodes; )
+	{
+		unsigned int end = std::min(first + UPDATE_BATCH_SIZE, mNumNodes);
+		while (end < mNumNodes && mParents[end] >= 0)  ++end;
+
+		int job = graph.Add([this, first, end]() { CombineWithParents(first, end); });
+		for (unsigned int batch = first / UPDATE_BATCH_SIZE; batch <= (end - 1) / UPDATE_BATCH_SIZE; ++batch)
+		{
+			graph.AddDependency(job, composeJobs[batch]);
+		}
+		first = end;
+	}
+	gJobSystem.Run(graph);
+
+	std::fill(mChanged.begin(), mChanged.end(), static_cast<unsigned char>(false));
+	mAnyChanged = false;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Data access
+//--------------------------------------------------------------------------------------
+
+CMatrix4x4 TransformSystem::LocalMatrix(unsigned int node)
+{
+	CMatrix4x4 matrix = MatrixRotation(Rotation(node));
+	matrix.SetRow(0, matrix.GetRow(0) * mScaleX[node]);
+	matrix.SetRow(1, matrix.GetRow(1) * mScaleY[node]);
+	matrix.SetRow(2, matrix.GetRow(2) * mScaleZ[node]);
+	matrix.SetRow(3, Position(node));
+	return matrix;
+}
+
+
+void TransformSystem::SetPosition(unsigned int node, const CVector3& position)
+{
+	mPositionX[node] = position.x;
+	mPositionY[node] = position.y;
+	mPositionZ[node] = position.z;
+	SetChanged(node);
+}
+
+void TransformSystem::SetRotation(unsigned int node, const CQuaternion& rotation)
+{
+	mRotationX[node] = rotation.x;
+	mRotationY[node] = rotation.y;
+	mRotationZ[node] = rotation.z;
+	mRotationW[node] = rotation.w;
+	SetChanged(node);
+}
+
+void TransformSystem::SetScale(unsigned int node, const CVector3& scale)
+{
+	mScaleX[node] = scale.x;
+	mScaleY[node] = scale.y;
+	mScaleZ[node] = scale.z;
+	SetChanged(node);
+}
+
+
+void TransformSystem::SetMatrix(unsigned int node, const CMatrix4x4& matrix)
+{
+	CVector3 position, scale;
+	CQuaternion rotation;
+	DecomposeMatrix(matrix, position, rotation, scale);
+	SetPosition(node, position);
+	SetRotation(node, rotation);
+	SetScale(node, scale);
+}
+
+
+void TransformSystem::SetTransforms(unsigned int first, unsigned int count, const float* const position[3],
+                                    const float* const rotation[4], const float* const scale[3])
+{
+	if (count == 0)  return;
+	std::copy(position[0], position[0] + count, &mPositionX[first]);
+	std::copy(position[1], position[1] + count, &mPositionY[first]);
+	std::copy(position[2], position[2] + count, &mPositionZ[first]);
+	std::copy(rotation[0], rotation[0] + count, &mRotationX[first]);
+	std::copy(rotation[1], rotation[1] + count, &mRotationY[first]);
+	std::copy(rotation[2], rotation[2] + count, &mRotationZ[first]);
+	std::copy(rotation[3], rotation[3] + count, &mRotationW[first]);
+	std::copy(scale[0], scale[0] + count, &mScaleX[first]);
+	std::copy(scale[1], scale[1] + count, &mScaleY[first]);
+	std::copy(scale[2], scale[2] + count, &mScaleZ[first]);
+	std::fill(&mChanged[first], &mChanged[first] + count, static_cast<unsigned char>(true));
+	mAnyChanged = true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helpers
+//--------------------------------------------------------------------------------------
+
+// First fit - models are mostly created once at start-up so fragmentation isn't a concern
+bool TransformSystem::TakeRange(unsigned int count, unsigned int& first)
+{
+	for (auto freeRange = mFreeRanges.begin(); freeRange != mFreeRanges.end(); ++freeRange)
+	{
+		if (freeRange->count >= count)
+		{
+			first = freeRange->first;
+			freeRange->first += count;
+			freeRange->count -= count;
+			if (freeRange->count == 0)  mFreeRanges.erase(freeRange);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// New nodes (including the padding) start as unchanged roots with no transform
+void TransformSystem::Resize(unsigned int numNodes)
+{
+	mNumNodes = numNodes;
+	size_t size = (numNodes + 3) & ~3u;
+
+	mPositionX.resize(size, 0.0f);  mPositionY.resize(size, 0.0f);  mPositionZ.resize(size, 0.0f);
+	mRotationX.resize(size, 0.0f);  mRotationY.resize(size, 0.0f);  mRotationZ.resize(size, 0.0f);  mRotationW.resize(size, 1.0f);
+	mScaleX.resize(size, 1.0f);     mScaleY.resize(size, 1.0f);     mScaleZ.resize(size, 1.0f);
+	mParents.resize(size, -1);
+
+	mLocalMatrices.resize(size, MatrixIdentity());
+	mWorldMatrices.resize(size, MatrixIdentity());
+	mChanged.resize(size, false);
+}
+
+
+// Build the local matrices of changed nodes from first to end - 1, four at a time (the arrays are padded to a multiple
+// of four and first is a multiple of four)
+void TransformSystem::ComposeLocalMatrices(unsigned int first, unsigned int end)
+{
+	for (unsigned int node = first; node < end; node += 4)
+	{
+		if (mChanged[node] | mChanged[node + 1] | mChanged[node + 2] | mChanged[node + 3])
+		{
+			ComposeFourLocalMatrices(node);
+		}
+	}
+}
+
+
+// Combine the local matrices of the nodes from first to end - 1 with their parents in node order. A parent has already
+// been updated (and marked as changed) by the time its children are reached
+void TransformSystem::CombineWithParents(unsigned int first, unsigned int end)
+{
+	for (unsigned int node = first; node < end; ++node)
+	{
+		int parent = mParents[node];
+		if (parent >= 0 && mChanged[parent])  mChanged[node] = true;
+		if (!mChanged[node])  continue;
+
+		if (parent < 0)  mWorldMatrices[node] = mLocalMatrices[node];
+		else             MultiplyMatrix(mLocalMatrices[node], mWorldMatrices[parent], mWorldMatrices[node]);
+	}
+}
+
+
+// Each of the four lanes of the SSE registers holds a different node. The rotation matrix of each node is calculated
+// from its quaternion as in MatrixRotation, each row multiplied by the matching scale. Transposing turns four registers
+// holding one element of a row for each node into four registers holding that row of each node
+void TransformSystem::ComposeFourLocalMatrices(unsigned int first)
+{
+	__m128 x = _mm_loadu_ps(&mRotationX[first]);
+	__m128 y = _mm_loadu_ps(&mRotationY[first]);
+	__m128 z = _mm_loadu_ps(&mRotationZ[first]);
+	__m128 w = _mm_loadu_ps(&mRotationW[first]);
+
+	__m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+	__m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+	__m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+	__m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 scaleX = _mm_loadu_ps(&mScaleX[first]);
+	__m128 scaleY = _mm_loadu_ps(&mScaleY[first]);
+	__m128 scaleZ = _mm_loadu_ps(&mScaleZ[first]);
+
+	__m128 e00 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(one, yy), zz), scaleX);
+	__m128 e01 = _mm_mul_ps(_mm_add_ps(xy, wz), scaleX);
+	__m128 e02 = _mm_mul_ps(_mm_sub_ps(xz, wy), scaleX);
+	__m128 e03 = _mm_setzero_ps();
+	__m128 e10 = _mm_mul_ps(_mm_sub_ps(xy, wz), scaleY);
+	__m128 e11 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(one, xx), zz), scaleY);
+	__m128 e12 = _mm_mul_ps(_mm_add_ps(yz, wx), scaleY);
+	__m128 e13 = _mm_setzero_ps();
+	__m128 e20 = _mm_mul_ps(_mm_add_ps(xz, wy), scaleZ);
+	__m128 e21 = _mm_mul_ps(_mm_sub_ps(yz, wx), scaleZ);
+	__m128 e22 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(one, xx), yy), scaleZ);
+	__m128 e23 = _mm_setzero_ps();
+	__m128 e30 = _mm_loadu_ps(&mPositionX[first]);
+	__m128 e31 = _mm_loadu_ps(&mPositionY[first]);
+	__m128 e32 = _mm_loadu_ps(&mPositionZ[first]);
+	__m128 e33 = one;
+
+	_MM_TRANSPOSE4_PS(e00, e01, e02, e03);
+	_MM_TRANSPOSE4_PS(e10, e11, e12, e13);
+	_MM_TRANSPOSE4_PS(e20, e21, e22, e23);
+	_MM_TRANSPOSE4_PS(e30, e31, e32, e33);
+
+	// After transposing, e00 is row 0 of the first node, e01 row 0 of the second and so on
+	__m128 rows[4][4] = { { e00, e10, e20, e30 }, { e01, e11, e21, e31 }, { e02, e12, e22, e32 }, { e03, e13, e23, e33 } };
+	for (unsigned int i = 0; i < 4; ++i)
+	{
+		float* matrix = &mLocalMatrices[first + i].e00;
+		_mm_storeu_ps(matrix,      rows[i][0]);
+		_mm_storeu_ps(matrix + 4,  rows[i][1]);
+		_mm_storeu_ps(matrix + 8,  rows[i][2]);
+		_mm_storeu_ps(matrix + 12, rows[i][3]);
+	}
+}
@@ -0,0 +1,127 @@
+//--------------------------------------------------------------------------------------
+// Transform system
+//--------------------------------------------------------------------------------------
+// Holds the position, rotation (a quaternion) and scale of every node of every model in the scene, each component in
+// its own contiguous array (structure of arrays), along with the index of each node's parent. A model only keeps the
+// index of its first node (see Model), so updating the scene walks straight through these arrays rather than
+// following a pointer to each model and then to each model's matrices.
+//
+// Update composes the matrices of nodes that have changed in one pass: the matrices relative to the parent are built
+// from position, rotation and scale four nodes at a time with SSE, then combined with the parent's absolute matrix in
+// node order. The nodes of a model are held together in depth-first order, so a parent is always updated before its
+// children. Both steps are split into batches run as jobs (see JobSystem.h). Freed nodes are reused by later models
+//
+// All functions must be called on the main thread. The absolute matrices are only read by the render worker threads,
+// so Update must be called after moving models and before they are rendered - it is called at the start of each frame
+
+#ifndef _TRANSFORM_SYSTEM_H_INCLUDED_
+#define _TRANSFORM_SYSTEM_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CQuaternion.h"
+#include "CMatrix4x4.h"
+
+#include <vector>
+
+
+class TransformSystem
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Add a hierarchy of nodes, returning the index of the first. parents are relative to the first node with the root
+	// referring to itself (as in Mesh). Each node's starting transform is taken from its matrix, relative to its parent
+	unsigned int Add(unsigned int numNodes, const unsigned int* parents, const CMatrix4x4* matrices);
+
+	// Return the nodes from Add to the system
+	void Remove(unsigned int first, unsigned int numNodes);
+
+	// Recalculate the absolute matrices of changed nodes and their children
+	void Update();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+	// Transform of a node relative to its parent (or the world for a root)
+	CVector3    Position(unsigned int node)  { return { mPositionX[node], mPositionY[node], mPositionZ[node] }; }
+	CQuaternion Rotation(unsigned int node)  { return { mRotationX[node], mRotationY[node], mRotationZ[node], mRotationW[node] }; }
+	CVector3    Scale(unsigned int node)     { return { mScaleX[node], mScaleY[node], mScaleZ[node] }; }
+
+	// The same as a matrix, calculated when called
+	CMatrix4x4 LocalMatrix(unsigned int node);
+
+	// Each setter marks the node as changed, so its absolute matrix (and those of its children) is recalculated on the
+	// next Update
+	void SetPosition(unsigned int node, const CVector3& position);
+	void SetRotation(unsigned int node, const CQuaternion& rotation);
+	void SetScale(unsigned int node, const CVector3& scale);
+
+	// Set position, rotation and scale from a matrix. Any shearing in the matrix is lost
+	void SetMatrix(unsigned int node, const CMatrix4x4& matrix);
+
+	// Set the transforms of count nodes from first, copied from an array of each component (x, y, z then w), e.g. a
+	// whole animated pose at once (see Animation.h)
+	void SetTransforms(unsigned int first, unsigned int count, const float* const position[3], const float* const rotation[4],
+	                   const float* const scale[3]);
+
+	// The absolute matrices of a node and those following it, as of the last Update
+	const CMatrix4x4* WorldMatrices(unsigned int node)  { return &mWorldMatrices[node]; }
+
+	unsigned int NumNodes()  { return mNumNodes; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	struct FreeRange
+	{
+		unsigned int first;
+		unsigned int count;
+	};
+
+	// Take a range of nodes from the free list, returns false if there is no large enough gap
+	bool TakeRange(unsigned int count, unsigned int& first);
+
+	// Make room for the given number of nodes. The arrays are kept a multiple of four long for Update
+	void Resize(unsigned int numNodes);
+
+	// Nodes in each job of Update, a multiple of four
+	static const unsigned int UPDATE_BATCH_SIZE = 1024;
+
+	void SetChanged(unsigned int node)  { mChanged[node] = true;  mAnyChanged = true; }
+
+	// Update steps for a batch of nodes - build the matrices relative to the parent of changed nodes, then combine them
+	// with the parents' absolute matrices. The combine batch must hold whole hierarchies
+	void ComposeLocalMatrices(unsigned int first, unsigned int end);
+	void CombineWithParents(unsigned int first, unsigned int end);
+
+	// Build the matrices relative to the parent of the four nodes from first
+	void ComposeFourLocalMatrices(unsigned int first);
+
+
+	// Node transforms
+	std::vector<float> mPositionX, mPositionY, mPositionZ;
+	std::vector<float> mRotationX, mRotationY, mRotationZ, mRotationW;
+	std::vector<float> mScaleX, mScaleY, mScaleZ;
+	std::vector<int>   mParents; // Index of each node's parent, -1 for roots and unused nodes
+
+	// Matrices from the last Update. Local matrices are kept for nodes that haven't changed but whose parent has
+	std::vector<CMatrix4x4>    mLocalMatrices;
+	std::vector<CMatrix4x4>    mWorldMatrices;
+	std::vector<unsigned char> mChanged;
+	bool                       mAnyChanged = false;
+
+	unsigned int           mNumNodes = 0;
+	std::vector<FreeRange> mFreeRanges; // Sorted by first node, neighbouring ranges are always merged
+};
+
+
+extern TransformSystem gTransformSystem;
+
+
+#endif //_TRANSFORM_SYSTEM_H_INCLUDED_
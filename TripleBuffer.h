@@ -0,0 +1,64 @@
+//--------------------------------------------------------------------------------------
+// Triple buffer
+//--------------------------------------------------------------------------------------
+// Passes the latest copy of some data from one thread to another without either waiting for the other. There are three
+// copies: the writer fills in one, the reader reads another, and the third holds the most recently published copy. The
+// writer swaps its copy with the published one, and the reader swaps its copy for the published one when there is a
+// newer one, so neither ever sees the other's copy changing. A reader that falls behind skips the copies it missed.
+
+#ifndef _TRIPLE_BUFFER_H_INCLUDED_
+#define _TRIPLE_BUFFER_H_INCLUDED_
+
+#include <atomic>
+
+
+template <typename T>
+class TripleBuffer
+{
+public:
+	//-------------------------------------
+	// Writer
+	//-------------------------------------
+
+	// The copy to fill in, only touched by the writing thread until it is published
+	T& Back()  { return mCopies[mBack]; }
+
+	// Make the back copy the latest one for the reader, the writer gets a new back copy
+	void Publish()
+	{
+		mBack = mPublished.exchange(mBack | NEW_COPY, std::memory_order_acq_rel) & COPY_INDEX;
+	}
+
+
+	//-------------------------------------
+	// Reader
+	//-------------------------------------
+
+	// Take the latest published copy as the front copy. Returns false, keeping the current front copy, if nothing new
+	// has been published since the last call
+	bool Acquire()
+	{
+		if ((mPublished.load(std::memory_order_relaxed) & NEW_COPY) == 0)  return false;
+		mFront = mPublished.exchange(mFront, std::memory_order_acq_rel) & COPY_INDEX;
+		return true;
+	}
+
+	// The copy to read, only touched by the reading thread until the next Acquire
+	const T& Front()  { return mCopies[mFront]; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static const int COPY_INDEX = 3; // Low bits of mPublished hold the index of the published copy
+	static const int NEW_COPY   = 4; // Set when the published copy hasn't been acquired yet
+
+	T                mCopies[3] = {};
+	int              mBack  = 0;
+	int              mFront = 1;
+	std::atomic<int> mPublished{ 2 };
+};
+
+
+#endif //_TRIPLE_BUFFER_H_INCLUDED_
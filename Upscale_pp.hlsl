@@ -0,0 +1,30 @@
+//--------------------------------------------------------------------------------------
+// Upscale Post-Processing Pixel Shader
+//--------------------------------------------------------------------------------------
+// With dynamic resolution the scene is rendered into just the top-left part of the scene texture. This stretches
+// that part over the whole output with bilinear filtering, ready for the other post-processes
+
+#include "Common.hlsli"
+
+
+//--------------------------------------------------------------------------------------
+// Textures (texture maps)
+//--------------------------------------------------------------------------------------
+
+// The scene has been rendered to a texture, these variables allow access to that texture
+Texture2D    SceneTexture   : register(t0);
+SamplerState BilinearSample : register(s1); // Clamped bilinear filtering
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+float4 main(PostProcessingInput input) : SV_Target
+{
+	// The uv is already scaled to the rendered part (gPassUVScale). Clamp to stay half a pixel inside it, so filtering
+	// doesn't pick up pixels outside it
+	float2 sceneUV = min(input.uv, gSceneUVMax);
+	float3 colour = SceneTexture.Sample(BilinearSample, sceneUV).rgb;
+	return float4(colour, 1.0f);
+}
@@ -0,0 +1,100 @@
+//--------------------------------------------------------------------------------------
+// Frame limiter class - holds the frame rate to a chosen cap
+//--------------------------------------------------------------------------------------
+
+#include "FrameLimiter.h"
+#include <Windows.h>
+#include <cmath>
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+
+// Constructor / destructor //
+
+FrameLimiter::FrameLimiter()
+{
+	// High resolution waitable timers (Windows 10 1803 onwards) wake within half a millisecond or so. Older timers wake
+	// on the scheduler tick, which may be 1ms or may be 15ms, so spin for longer
+	mWaitableTimer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	mSpinTime = 0.001f;
+	if (mWaitableTimer == nullptr)
+	{
+		mWaitableTimer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+		mSpinTime = 0.002f;
+	}
+}
+
+FrameLimiter::~FrameLimiter()
+{
+	if (mWaitableTimer != nullptr)  CloseHandle(mWaitableTimer);
+}
+
+
+// Limiting //
+
+// Set the most frames per second, 0 for no limit
+void FrameLimiter::SetFrameRate(float framesPerSecond)
+{
+	mFrameRate = (framesPerSecond > 0) ? framesPerSecond : 0;
+	mPeriod = (mFrameRate > 0) ? 1.0f / mFrameRate : 0;
+	mLate = 0;
+	mAverageError = mMaxError = mWindowError = 0;
+	mWindowFrames = 0;
+}
+
+// Wait until the current frame is due
+void FrameLimiter::Wait()
+{
+	if (mPeriod <= 0)
+	{
+		mTimer.Reset();
+		return;
+	}
+
+	float target = mPeriod - mLate;
+	float sleepTime = target - mTimer.GetTime() - mSpinTime;
+	if (sleepTime > 0)  SleepFor(sleepTime);
+	while (mTimer.GetTime() < target)
+	{
+		YieldProcessor();
+	}
+
+	float interval = mTimer.GetTime();
+	mTimer.Reset();
+
+	// A little late is made up on the next frame, a missed frame is not
+	float late = interval - target;
+	mLate = (late < 0.5f * mPeriod) ? late : 0;
+
+	// Pacing error in milliseconds
+	float error = std::abs(interval - mPeriod) * 1000.0f;
+	mAverageError += (error - mAverageError) * 0.05f;
+	if (error > mWindowError)  mWindowError = error;
+	if (++mWindowFrames == PACING_WINDOW)
+	{
+		mMaxError = mWindowError;
+		mWindowError = 0;
+		mWindowFrames = 0;
+	}
+}
+
+
+// Private helpers //
+
+void FrameLimiter::SleepFor(float seconds)
+{
+	if (mWaitableTimer == nullptr)
+	{
+		::Sleep(static_cast<DWORD>(seconds * 1000.0f));
+		return;
+	}
+
+	LARGE_INTEGER dueTime;
+	dueTime.QuadPart = -static_cast<LONGLONG>(seconds * 10000000.0f); // Negative for relative, in 100ns units
+	if (SetWaitableTimer(mWaitableTimer, &dueTime, 0, nullptr, nullptr, FALSE))
+	{
+		WaitForSingleObject(mWaitableTimer, INFINITE);
+	}
+}
@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------------------
+// Frame limiter class - holds the frame rate to a chosen cap
+//--------------------------------------------------------------------------------------
+// Call Wait once per frame just before presenting. It sleeps on a waitable timer until just short of the frame's due
+// time, then spins for the rest, so frames are released within a fraction of a millisecond of the cap rather than to
+// the nearest scheduler tick. Time only just missed is taken off the next frame, so the average rate is exact, but a
+// slow frame isn't made up for by rushing the ones after it
+
+#ifndef _FRAME_LIMITER_H_INCLUDED_
+#define _FRAME_LIMITER_H_INCLUDED_
+
+#include "Timer.h"
+
+class FrameLimiter
+{
+public:
+
+	// Constructor / destructor //
+
+	FrameLimiter();
+	~FrameLimiter();
+
+	FrameLimiter(const FrameLimiter&) = delete;
+	FrameLimiter& operator=(const FrameLimiter&) = delete;
+
+
+	// Limiting //
+
+	// Set the most frames per second, 0 for no limit
+	void SetFrameRate(float framesPerSecond);
+
+	// Wait until the current frame is due. Returns straight away if there is no limit
+	void Wait();
+
+
+	// Data access //
+
+	float FrameRate()  { return mFrameRate; }
+
+	// Average and worst difference (ms) between the time between frames and the target, the worst over the most recent
+	// PACING_WINDOW frames. Both 0 when there is no limit
+	float AveragePacingError()  { return mAverageError; }
+	float MaxPacingError()      { return mMaxError; }
+
+
+private:
+	// Sleep for the given time (seconds) on the waitable timer
+	void SleepFor(float seconds);
+
+	static const int PACING_WINDOW = 120;
+
+	// Time since the last frame was released, reset each frame so the float doesn't lose precision
+	Timer mTimer;
+
+	float mFrameRate = 0;
+	float mPeriod    = 0; // Seconds between frames, 0 for no limit
+	float mLate      = 0; // How late the last frame was released, taken off the next one
+
+	// Waitable timer, and how much of each wait is spun rather than slept to cover its inaccuracy
+	void* mWaitableTimer = nullptr;
+	float mSpinTime      = 0;
+
+	float mAverageError = 0;
+	float mMaxError     = 0;
+	float mWindowError  = 0; // Worst in the current window
+	int   mWindowFrames = 0;
+};
+
+
+#endif //_FRAME_LIMITER_H_INCLUDED_
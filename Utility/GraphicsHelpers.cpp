@@ -5,9 +5,13 @@
 #include "GraphicsHelpers.h"
 #include "../Shader.h"
 #include "../Common.h"
+#include "../CookedAssets.h"
+#include "../AssetPack.h"
+#include "../ResourceRegistry.h"
+#include "../StartupProfiler.h"
 
-#include <WICTextureLoader.h>
 #include <DDSTextureLoader.h>
+#include <vector>
 #include <cmath>
 #include <cctype>
 #include <atlbase.h> // C-string to unicode conversion function CA2CT
@@ -16,23 +20,114 @@
 // Texture Loading
 //--------------------------------------------------------------------------------------
 
-// Using Microsoft's open source DirectX Tool Kit (DirectXTK) to simplify texture loading
+// Create an immutable texture and shader resource view from a decoded image (see CookedAssets.h), using the mip levels
+// from firstMip down (so a larger firstMip gives a smaller, lower detail texture). Only uses the device. False on failure
+bool CreateTextureFromImage(const CookedTexture& image, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV,
+                            size_t firstMip /*= 0*/)
+{
+    if (firstMip >= image.mips.size())  return false;
+
+    D3D11_TEXTURE2D_DESC textureDesc = {};
+    textureDesc.Width = image.mips[firstMip].width;
+    textureDesc.Height = image.mips[firstMip].height;
+    textureDesc.MipLevels = static_cast<UINT>(image.mips.size() - firstMip);
+    textureDesc.ArraySize = 1;
+    textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    textureDesc.SampleDesc.Count = 1;
+    textureDesc.Usage = D3D11_USAGE_IMMUTABLE;
+    textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    std::vector<D3D11_SUBRESOURCE_DATA> initData(textureDesc.MipLevels);
+    for (size_t mip = firstMip; mip < image.mips.size(); ++mip)
+    {
+        initData[mip - firstMip].pSysMem = image.mips[mip].pixels.data();
+        initData[mip - firstMip].SysMemPitch = image.mips[mip].width * 4;
+        initData[mip - firstMip].SysMemSlicePitch = 0;
+    }
+
+    ID3D11Texture2D* texture2D;
+    if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, initData.data(), &texture2D)))  return false;
+    gResourceRegistry.Track(texture2D);
+    if (FAILED(gD3DDevice->CreateShaderResourceView(texture2D, nullptr, textureSRV)))
+    {
+        texture2D->Release();
+        return false;
+    }
+    *texture = texture2D;
+    return true;
+}
+
+
+// Using Microsoft's open source DirectX Tool Kit (DirectXTK) to simplify DDS texture loading
 // This function requires you to pass a ID3D11Resource* (e.g. &gTilesDiffuseMap), which manages the GPU memory for the
 // texture and also a ID3D11ShaderResourceView* (e.g. &gTilesDiffuseMapSRV), which allows us to use the texture in shaders
 // The function will fill in these pointers with usable data. Returns false on failure
+// Only the device is used (mip-maps are built on the CPU, see CookedAssets.h), so textures can be loaded on worker threads
 bool LoadTexture(std::string filename, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV)
 {
-    // DDS files need a different function from other files
-    std::string dds = ".dds"; // So check the filename extension (case insensitive)
-    if (filename.size() >= 4 &&
-        std::equal(dds.rbegin(), dds.rend(), filename.rbegin(), [](unsigned char a, unsigned char b) { return std::tolower(a) == std::tolower(b); }))
+    // DDS files need a different function from other files. Use the copy in the asset pack if there is one. The DDS
+    // loader reads the file and creates the texture in one call, so for the startup profiler it is all reading
+    std::string ddsFile;
     {
-        return SUCCEEDED(DirectX::CreateDDSTextureFromFile(gD3DDevice, CA2CT(filename.c_str()), texture, textureSRV));
+        STARTUP_SCOPE(StartupStage::Read, filename);
+        const void* packData;
+        size_t packSize;
+        if (FindPackedDDS(filename, packData, packSize) &&
+            SUCCEEDED(DirectX::CreateDDSTextureFromMemory(gD3DDevice, static_cast<const uint8_t*>(packData), packSize, texture, textureSRV)))
+        {
+            gResourceRegistry.Track(*texture);
+            return true;
+        }
+        ddsFile = DDSFileForTexture(filename);
+        if (!ddsFile.empty() && SUCCEEDED(DirectX::CreateDDSTextureFromFile(gD3DDevice, CA2CT(ddsFile.c_str()), texture, textureSRV)))
+        {
+            gResourceRegistry.Track(*texture);
+            return true;
+        }
     }
-    else
+    if (ddsFile == filename)  return false;
+
+    // WIC needs COM on this thread. Leave it as it was if it is already initialised in another mode
+    CookedTexture image;
+    bool decoded;
     {
-        return SUCCEEDED(DirectX::CreateWICTextureFromFile(gD3DDevice, gD3DContext, CA2CT(filename.c_str()), texture, textureSRV));
+        STARTUP_SCOPE(StartupStage::Import, filename);
+        HRESULT comResult = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+        std::string error;
+        decoded = DecodeTexture(filename, image, error);
+        if (SUCCEEDED(comResult))  CoUninitialize();
     }
+
+    STARTUP_SCOPE(StartupStage::Upload, filename);
+    return decoded && CreateTextureFromImage(image, texture, textureSRV);
+}
+
+
+// The DDS file to load for a texture: the file itself if it is a DDS file, or the cooked version from the AssetCooker
+// tool if that is up to date (it already has its mip-maps so loads faster). Empty if the image must be decoded with WIC
+std::string DDSFileForTexture(const std::string& filename)
+{
+    if (IsDDSFile(filename))  return filename;
+
+    std::string cooked = CookedTextureFileName(filename);
+    return IsCookedFileNewer(cooked, filename) ? cooked : "";
+}
+
+
+// Find the DDS file for a texture in the asset pack (see AssetPack.h): the file itself if it is a DDS file, otherwise
+// the cooked version. False if it isn't in the pack or is out of date
+bool FindPackedDDS(const std::string& filename, const void*& data, size_t& size)
+{
+    return gAssetPack.Find(IsDDSFile(filename) ? filename : CookedTextureFileName(filename), data, size);
+}
+
+
+// Check the filename extension is .dds (case insensitive)
+bool IsDDSFile(const std::string& filename)
+{
+    std::string dds = ".dds";
+    return filename.size() >= 4 &&
+           std::equal(dds.rbegin(), dds.rend(), filename.rbegin(), [](unsigned char a, unsigned char b) { return std::tolower(a) == std::tolower(b); });
 }
 
 
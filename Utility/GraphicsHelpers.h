@@ -8,7 +8,12 @@
 
 #include "CMatrix4x4.h"
 #include "../Common.h"
+#include "../Shader.h"
 #include <d3d11.h>
+#include <cstring>
+#include <string>
+
+struct CookedTexture;
 
 
 //--------------------------------------------------------------------------------------
@@ -28,6 +33,60 @@ void UpdateConstantBuffer(ID3D11Buffer* buffer, const T& bufferData)
 }
 
 
+// A constant buffer that keeps a copy of the data last sent to the GPU and skips the upload if the new data is the same.
+// Each Map with WRITE_DISCARD makes the driver hand out a fresh copy of the buffer, so uploading unchanged data isn't
+// free - comparing a few hundred bytes on the CPU is much cheaper. Counts uploads so the savings can be checked
+template <class T>
+class VersionedConstantBuffer
+{
+public:
+	// Create the GPU buffer, returns false on failure
+	bool Create()
+	{
+		mBuffer = CreateConstantBuffer(sizeof(T));
+		mHasData = false;
+		return mBuffer != nullptr;
+	}
+
+	void Release()
+	{
+		if (mBuffer)  mBuffer->Release();
+		mBuffer = nullptr;
+	}
+
+	// Upload the data if it differs from the last upload, returns true if it was uploaded
+	bool Update(const T& bufferData)
+	{
+		if (mHasData && std::memcmp(&bufferData, &mUploaded, sizeof(T)) == 0)
+		{
+			++mNumSkipped;
+			return false;
+		}
+		UpdateConstantBuffer(mBuffer, bufferData);
+		mUploaded = bufferData;
+		mHasData = true;
+		++mNumUploads;
+		return true;
+	}
+
+	// The GPU buffer, the address form is for the *SetConstantBuffers functions
+	ID3D11Buffer*        Buffer()         { return mBuffer;  }
+	ID3D11Buffer* const* BufferAddress()  { return &mBuffer; }
+
+	// Number of Update calls that uploaded / found nothing had changed, since the last ResetCounts
+	int  NumUploads()   { return mNumUploads; }
+	int  NumSkipped()   { return mNumSkipped; }
+	void ResetCounts()  { mNumUploads = mNumSkipped = 0; }
+
+private:
+	ID3D11Buffer* mBuffer = nullptr;
+	T             mUploaded;
+	bool          mHasData = false;
+	int           mNumUploads = 0;
+	int           mNumSkipped = 0;
+};
+
+
 //--------------------------------------------------------------------------------------
 // Texture Loading
 //--------------------------------------------------------------------------------------
@@ -36,8 +95,25 @@ void UpdateConstantBuffer(ID3D11Buffer* buffer, const T& bufferData)
 // This function requires you to pass a ID3D11Resource* (e.g. &gTilesDiffuseMap), which manages the GPU memory for the
 // texture and also a ID3D11ShaderResourceView* (e.g. &gTilesDiffuseMapSRV), which allows us to use the texture in shaders
 // The function will fill in these pointers with usable data. Returns false on failure
+// Only uses the device, not the context, so can be called from several threads at once (see AssetLoader.h)
 bool LoadTexture(std::string filename, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV);
 
+// The DDS file to load for a texture: the file itself if it is a DDS file, or the cooked version from the AssetCooker
+// tool if that is up to date. Empty if the image must be decoded with WIC (see DecodeTexture in CookedAssets.h)
+std::string DDSFileForTexture(const std::string& filename);
+
+// Find the DDS file for a texture in the asset pack (see AssetPack.h), the data stays valid while the pack is open.
+// False if it isn't in the pack or is out of date with its source image
+bool FindPackedDDS(const std::string& filename, const void*& data, size_t& size);
+
+// The filename has a .dds extension (case insensitive)
+bool IsDDSFile(const std::string& filename);
+
+// Create an immutable texture and shader resource view from a decoded image, using the mip levels from firstMip down
+// (so a larger firstMip gives a smaller, lower detail texture). Only uses the device. Returns false on failure
+bool CreateTextureFromImage(const CookedTexture& image, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV,
+                            size_t firstMip = 0);
+
 
 //--------------------------------------------------------------------------------------
 // Camera helpers
@@ -4,16 +4,85 @@
 //--------------------------------------------------------------------------------------
 
 #include "Input.h"
+#include "../SpscQueue.h"
+#include <Windows.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstring>
 
 
 //////////////////////////////////
 // Globals
 
-// Current state of all keys (and mouse buttons)
-KeyState gKeyStates[NumKeyCodes];
+// Current state of all keys (and mouse buttons). Set by ProcessInputEvents and read by the render and simulation
+// threads, so they are atomic
+std::atomic<KeyState> gKeyStates[NumKeyCodes];
+
+// Set when a key goes down, cleared by KeyHit. Kept apart from the state so a press and release between two calls to
+// ProcessInputEvents is still seen as a hit
+std::atomic<bool> gKeyHits[NumKeyCodes];
 
 // Current position of mouse
-int gMouseX, gMouseY;
+std::atomic<int> gMouseX, gMouseY;
+
+
+// A key or button going down or up, timestamped when the window thread received it
+struct InputEvent
+{
+    KeyCode key;
+    bool    down;
+    int64_t time; // QueryPerformanceCounter ticks
+};
+
+// Events from the window thread (the only producer) waiting for ProcessInputEvents (the only consumer). Plenty for
+// the longest stall between steps - events arriving when it is full are lost
+SpscQueue<InputEvent, 1024> gInputEvents;
+
+// Keys the window thread has sent a down event for without an up event yet, used to drop auto-repeats. Only used by
+// the window thread
+bool gKeysDown[NumKeyCodes];
+
+// True once raw keyboard input is registered, the legacy WM_KEYDOWN/UP messages are then ignored
+bool gRawKeyboard = false;
+
+
+// An input recording is INPUT_RECORDING_ID followed by records, each a type byte then its data in little-endian order:
+// a key (byte) and down (byte), a mouse position (two 16 bit values), a frame time (float seconds) or nothing for the
+// end of a call to ProcessInputEvents
+const char INPUT_RECORDING_ID[8] = { 'I', 'N', 'P', 'U', 'T', 'R', 'E', '1' };
+
+enum InputRecordType : uint8_t
+{
+    Record_Step  = 0,
+    Record_Key   = 1,
+    Record_Mouse = 2,
+    Record_Frame = 3,
+};
+
+struct InputRecord
+{
+    InputRecordType type;
+    KeyCode         key;
+    bool            down;
+    int             mouseX, mouseY;
+    float           frameTime;
+};
+
+// The recording being written. ProcessInputEvents and RecordFrameTime may be on different threads, so writes are locked
+std::atomic<bool> gRecording(false);
+std::mutex        gRecordingMutex;
+std::ofstream     gRecordingFile;
+int               gRecordedMouseX = -1; // Last position written, only used by ProcessInputEvents
+int               gRecordedMouseY = -1;
+
+// The recording being replayed, all in memory
+std::atomic<bool>    gReplaying(false);
+std::vector<uint8_t> gReplay;
+size_t               gReplayPosition = 0;
+std::string          gReplaySummary;
 
 
 
@@ -26,41 +95,310 @@ void InitInput()
     for (int i = 0; i < NumKeyCodes; ++i)
     {
         gKeyStates[i] = NotPressed;
+        gKeyHits[i] = false;
+        gKeysDown[i] = false;
     }
 
     gMouseX = gMouseY = 0;
 }
 
+bool InitRawInput(HWND hWnd)
+{
+    RAWINPUTDEVICE keyboard;
+    keyboard.usUsagePage = 0x01; // Generic desktop controls
+    keyboard.usUsage     = 0x06; // Keyboard
+    keyboard.dwFlags     = 0;    // Only while the window has focus, and keep the legacy messages for system keys (Alt+F4)
+    keyboard.hwndTarget  = hWnd;
+    gRawKeyboard = (RegisterRawInputDevices(&keyboard, 1, sizeof(keyboard)) != FALSE);
+    return gRawKeyboard;
+}
+
 
 //////////////////////////////////
 // Events
 
+// Queue a key going down or up, dropping repeats
+void QueueKeyEvent(KeyCode Key, bool down)
+{
+    if (Key <= 0 || Key >= NumKeyCodes || gKeysDown[Key] == down)  return;
+    gKeysDown[Key] = down;
+
+    LARGE_INTEGER time;
+    QueryPerformanceCounter(&time);
+    gInputEvents.Push({ Key, down, time.QuadPart });
+}
+
+// Mouse buttons only come from the legacy messages
+bool IsMouseButton(KeyCode Key)
+{
+    return Key == Mouse_LButton || Key == Mouse_RButton || Key == Mouse_MButton ||
+           Key == Mouse_XButton1 || Key == Mouse_XButton2;
+}
+
 // Event called to indicate that a key has been pressed down
 void KeyDownEvent(KeyCode Key)
 {
-    if (gKeyStates[Key] == NotPressed)
-    {
-        gKeyStates[Key] = Pressed;
-    }
-    else
-    {
-        gKeyStates[Key] = Held;
-    }
+    if (!gRawKeyboard || IsMouseButton(Key))  QueueKeyEvent(Key, true);
 }
 
 // Event called to indicate that a key has been lifted up
 void KeyUpEvent(KeyCode Key)
 {
-   gKeyStates[Key] = NotPressed;
+    if (!gRawKeyboard || IsMouseButton(Key))  QueueKeyEvent(Key, false);
 }
 
 // Event called to indicate that the mouse has been moved
 void MouseMoveEvent(int X, int Y)
 {
+    if (gReplaying)  return;
     gMouseX = X;
     gMouseY = Y;
 }
 
+void RawInputEvent(LPARAM lParam)
+{
+    RAWINPUT input;
+    UINT size = sizeof(input);
+    if (GetRawInputData(reinterpret_cast<HRAWINPUT>(lParam), RID_INPUT, &input, &size, sizeof(RAWINPUTHEADER)) == (UINT)-1 ||
+        input.header.dwType != RIM_TYPEKEYBOARD)
+    {
+        return;
+    }
+
+    // 0xFF is sent alongside some keys (e.g. Pause) and isn't a key itself
+    USHORT key = input.data.keyboard.VKey;
+    if (key < NumKeyCodes && key != 0xFF)
+    {
+        QueueKeyEvent(static_cast<KeyCode>(key), (input.data.keyboard.Flags & RI_KEY_BREAK) == 0);
+    }
+}
+
+void FocusLostEvent()
+{
+    for (int i = 0; i < NumKeyCodes; ++i)
+    {
+        if (gKeysDown[i])  QueueKeyEvent(static_cast<KeyCode>(i), false);
+    }
+}
+
+
+//////////////////////////////////
+// Event processing
+
+// Change a key's state for an event, live or replayed
+void ApplyKeyEvent(KeyCode key, bool down)
+{
+    if (down)
+    {
+        gKeyStates[key] = Pressed;
+        gKeyHits[key] = true;
+    }
+    else
+    {
+        gKeyStates[key] = NotPressed;
+    }
+}
+
+// Write one call's records to the recording
+void WriteRecords(const std::vector<uint8_t>& records)
+{
+    std::lock_guard<std::mutex> lock(gRecordingMutex);
+    if (gRecordingFile.is_open())  gRecordingFile.write(reinterpret_cast<const char*>(records.data()), records.size());
+}
+
+// Read the record at the given position in a recording and move past it. Returns false at the end, or if the record
+// is cut short or of an unknown type
+bool ReadRecord(const std::vector<uint8_t>& data, size_t& position, InputRecord& record)
+{
+    if (position >= data.size())  return false;
+    record.type = static_cast<InputRecordType>(data[position]);
+    size_t size;
+    switch (record.type)
+    {
+        case Record_Step:   size = 0;  break;
+        case Record_Key:    size = 2;  break;
+        case Record_Mouse:
+        case Record_Frame:  size = 4;  break;
+        default:            return false;
+    }
+    if (size > data.size() - position - 1)  return false;
+
+    const uint8_t* values = &data[position + 1];
+    if (record.type == Record_Key)
+    {
+        record.key = static_cast<KeyCode>(values[0]);
+        record.down = (values[1] != 0);
+    }
+    else if (record.type == Record_Mouse)
+    {
+        int16_t position16[2];
+        std::memcpy(position16, values, sizeof(position16));
+        record.mouseX = position16[0];
+        record.mouseY = position16[1];
+    }
+    else if (record.type == Record_Frame)
+    {
+        std::memcpy(&record.frameTime, values, sizeof(record.frameTime));
+    }
+    position += 1 + size;
+    return true;
+}
+
+// Apply the next recorded call's input in place of the live events, which are dropped
+void ReplayInputEvents()
+{
+    InputEvent event;
+    while (gInputEvents.Pop(event)) {}
+
+    InputRecord record;
+    while (ReadRecord(gReplay, gReplayPosition, record) && record.type != Record_Step)
+    {
+        if (record.type == Record_Key)  ApplyKeyEvent(record.key, record.down);
+        else if (record.type == Record_Mouse)
+        {
+            gMouseX = record.mouseX;
+            gMouseY = record.mouseY;
+        }
+    }
+
+    // Finished once no step is left to replay
+    size_t position = gReplayPosition;
+    while (ReadRecord(gReplay, position, record))
+    {
+        if (record.type == Record_Step)  return;
+    }
+    gReplaying = false;
+}
+
+void ProcessInputEvents(int64_t upToTime)
+{
+    if (gReplaying)
+    {
+        ReplayInputEvents();
+        return;
+    }
+
+    bool recording = gRecording;
+    std::vector<uint8_t> records;
+    InputEvent event;
+    while (gInputEvents.Peek(event) && event.time <= upToTime)
+    {
+        gInputEvents.Pop(event);
+        ApplyKeyEvent(event.key, event.down);
+        if (recording)  records.insert(records.end(), { Record_Key, static_cast<uint8_t>(event.key), static_cast<uint8_t>(event.down) });
+    }
+
+    if (recording)
+    {
+        int mouseX = gMouseX, mouseY = gMouseY;
+        if (mouseX != gRecordedMouseX || mouseY != gRecordedMouseY)
+        {
+            int16_t position16[2] = { static_cast<int16_t>(mouseX), static_cast<int16_t>(mouseY) };
+            records.push_back(Record_Mouse);
+            records.insert(records.end(), reinterpret_cast<uint8_t*>(position16), reinterpret_cast<uint8_t*>(position16 + 2));
+            gRecordedMouseX = mouseX;
+            gRecordedMouseY = mouseY;
+        }
+        records.push_back(Record_Step);
+        WriteRecords(records);
+    }
+}
+
+
+//////////////////////////////////
+// Recording and replay
+
+bool StartInputRecording(const std::string& fileName)
+{
+    StopInputRecording();
+
+    std::lock_guard<std::mutex> lock(gRecordingMutex);
+    gRecordingFile.open(fileName, std::ios::binary | std::ios::trunc);
+    if (!gRecordingFile)
+    {
+        gRecordingFile.close();
+        return false;
+    }
+    gRecordingFile.write(INPUT_RECORDING_ID, sizeof(INPUT_RECORDING_ID));
+    gRecordedMouseX = gRecordedMouseY = -1;
+    gRecording = true;
+    return true;
+}
+
+void StopInputRecording()
+{
+    gRecording = false;
+    std::lock_guard<std::mutex> lock(gRecordingMutex);
+    if (gRecordingFile.is_open())  gRecordingFile.close();
+}
+
+void RecordFrameTime(float frameTime)
+{
+    if (!gRecording)  return;
+    std::vector<uint8_t> records(1 + sizeof(frameTime), Record_Frame);
+    std::memcpy(&records[1], &frameTime, sizeof(frameTime));
+    WriteRecords(records);
+}
+
+bool StartInputReplay(const std::string& fileName)
+{
+    gReplaying = false;
+
+    std::ifstream file(fileName, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!file.good() && !file.eof())  return false;
+    if (data.size() < sizeof(INPUT_RECORDING_ID) || std::memcmp(data.data(), INPUT_RECORDING_ID, sizeof(INPUT_RECORDING_ID)) != 0)
+    {
+        return false;
+    }
+
+    // Check every record can be read and find the slowest frame
+    int   numSteps = 0, numFrames = 0, slowestStep = 0;
+    float totalTime = 0, slowestTime = 0;
+    size_t position = sizeof(INPUT_RECORDING_ID);
+    InputRecord record;
+    while (ReadRecord(data, position, record))
+    {
+        if (record.type == Record_Step)  ++numSteps;
+        else if (record.type == Record_Frame)
+        {
+            ++numFrames;
+            totalTime += record.frameTime;
+            if (record.frameTime > slowestTime)
+            {
+                slowestTime = record.frameTime;
+                slowestStep = numSteps;
+            }
+        }
+    }
+    if (position != data.size() || numSteps == 0)  return false;
+
+    std::ostringstream summary;
+    summary << "Input replay: " << numSteps << " steps, " << numFrames << " frames recorded";
+    if (numFrames > 0)
+    {
+        summary << " averaging " << totalTime * 1000 / numFrames << "ms, slowest " << slowestTime * 1000 << "ms after step "
+                << slowestStep;
+    }
+    summary << "\n";
+    gReplaySummary = summary.str();
+
+    gReplay.swap(data);
+    gReplayPosition = sizeof(INPUT_RECORDING_ID);
+    gReplaying = true;
+    return true;
+}
+
+bool InputReplaying()
+{
+    return gReplaying;
+}
+
+std::string InputReplaySummary()
+{
+    return gReplaySummary;
+}
+
 
 //////////////////////////////////
 // Input functions
@@ -70,12 +408,14 @@ void MouseMoveEvent(int X, int Y)
 // Mouse_LButton, see input.h for a full list.
 bool KeyHit(KeyCode eKeyCode)
 {
-    if (gKeyStates[eKeyCode] == Pressed)
+    // Only one caller sees each press, even if several threads check the same key
+    if (!gKeyHits[eKeyCode].exchange(false))
     {
-        gKeyStates[eKeyCode] = Held;
-        return true;
+        return false;
     }
-    return false;
+    KeyState pressed = Pressed;
+    gKeyStates[eKeyCode].compare_exchange_strong(pressed, Held);
+    return true;
 }
 
 // Returns true as long as a given key or button is held down. Use for
@@ -87,7 +427,8 @@ bool KeyHeld(KeyCode eKeyCode)
     {
         return false;
     }
-    gKeyStates[eKeyCode] = Held;
+    KeyState pressed = Pressed; // Don't overwrite a release processed since the check
+    gKeyStates[eKeyCode].compare_exchange_strong(pressed, Held);
     return true;
 }
 
@@ -7,6 +7,10 @@
 #ifndef _INPUT_H_DEFINED_
 #define _INPUT_H_DEFINED_
 
+#include <Windows.h>
+#include <stdint.h>
+#include <string>
+
 
 //////////////////////////////////
 // Constants
@@ -168,10 +172,18 @@ enum KeyCode
 // Initialise the input system
 void InitInput();
 
+// Take keyboard input from WM_INPUT messages (see RawInputEvent) rather than WM_KEYDOWN/UP, which are delayed by
+// auto-repeat and only arrive when the message loop gets to them. Returns false if raw input isn't available, the legacy
+// messages are used instead
+bool InitRawInput(HWND hWnd);
+
 
 //////////////////////////////////
 // Events
 
+// The events below are called by the window thread. Key and button events are timestamped and queued without locks,
+// the key states only change when ProcessInputEvents is called
+
 // Event called to indicate that a key has been pressed down
 void KeyDownEvent(KeyCode Key);
 
@@ -181,6 +193,49 @@ void KeyUpEvent(KeyCode Key);
 // Event called to indicate that the mouse has been moved
 void MouseMoveEvent(int X, int Y);
 
+// Event called for a WM_INPUT message, lParam is the message's
+void RawInputEvent(LPARAM lParam);
+
+// Event called when the window loses focus, releases every key still down as their up events won't arrive
+void FocusLostEvent();
+
+
+//////////////////////////////////
+// Event processing
+
+// Update the key states with the events queued before the given time (QueryPerformanceCounter ticks), in the order they
+// happened. Only one thread may call this - the simulation calls it before each step with the step's time, so each step
+// sees the input that arrived before it
+void ProcessInputEvents(int64_t upToTime);
+
+
+//////////////////////////////////
+// Recording and replay
+
+// A recording holds what each call to ProcessInputEvents took - the key events in order and the mouse position when it
+// moved - and the real frame times passed to RecordFrameTime, in a compact binary file. Replaying it feeds the same input
+// back to the same calls, one recorded call each, so running the app with the same switches and a fixed time step
+// repeats the camera path and toggles of the recorded session
+
+// Record from now on to the given file, replacing it. Returns false if it can't be created
+bool StartInputRecording(const std::string& fileName);
+
+// Stop recording, writing out everything recorded. Does nothing if not recording
+void StopInputRecording();
+
+// Note the real time taken by a frame in the recording, to find the hitches in it when replayed. Any thread
+void RecordFrameTime(float frameTime);
+
+// Replay the given recording from now on. The live key and mouse events are ignored while replaying. Returns false if
+// the file can't be read or isn't a recording
+bool StartInputReplay(const std::string& fileName);
+
+// True from StartInputReplay until ProcessInputEvents has been given every recorded call
+bool InputReplaying();
+
+// The steps and frames in the recording being replayed and where its slowest frame was, for the debugger output
+std::string InputReplaySummary();
+
 
 //////////////////////////////////
 // Input functions